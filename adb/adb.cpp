@@ -33,6 +33,7 @@
 #include <chrono>
 #include <condition_variable>
 #include <mutex>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <thread>
@@ -176,13 +177,18 @@ void print_packet(const char *label, apacket *p)
 }
 #endif
 
-static void send_ready(unsigned local, unsigned remote, atransport *t)
+static void send_ready(unsigned local, unsigned remote, atransport* t, int32_t acked_bytes = 0)
 {
     D("Calling send_ready");
     apacket *p = get_apacket();
     p->msg.command = A_OKAY;
     p->msg.arg0 = local;
     p->msg.arg1 = remote;
+    if (t->SupportsDelayedAck()) {
+        p->payload.resize(sizeof(acked_bytes));
+        memcpy(p->payload.data(), &acked_bytes, sizeof(acked_bytes));
+        p->msg.data_length = p->payload.size();
+    }
     send_packet(p, t);
 }
 
@@ -380,7 +386,8 @@ void handle_packet(apacket *p, atransport *t)
                 // TODO: Switch to string_view.
                 std::string signature(p->payload.begin(), p->payload.end());
                 std::string auth_key;
-                if (adbd_auth_verify(t->token, sizeof(t->token), signature, &auth_key)) {
+                if (adbd_auth_verify(t->token, sizeof(t->token), signature, p->msg.arg1,
+                                     &auth_key)) {
                     adbd_auth_verified(t);
                     t->failed_auth_attempts = 0;
                     t->auth_key = auth_key;
@@ -404,8 +411,8 @@ void handle_packet(apacket *p, atransport *t)
         }
         break;
 
-    case A_OPEN: /* OPEN(local-id, 0, "destination") */
-        if (t->online && p->msg.arg0 != 0 && p->msg.arg1 == 0) {
+    case A_OPEN: /* OPEN(local-id, 0 or window, "destination") */
+        if (t->online && p->msg.arg0 != 0 && (p->msg.arg1 == 0 || t->SupportsDelayedAck())) {
             std::string_view address(p->payload.begin(), p->payload.size());
 
             // Historically, we received service names as a char*, and stopped at the first NUL
@@ -419,24 +426,44 @@ void handle_packet(apacket *p, atransport *t)
             } else {
                 s->peer = create_remote_socket(p->msg.arg0, t);
                 s->peer->peer = s;
-                send_ready(s->id, s->peer->id, t);
+                if (t->SupportsDelayedAck()) {
+                    s->peer->available_send_bytes = p->msg.arg1;
+                }
+                send_ready(s->id, s->peer->id, t, INITIAL_DELAYED_ACK_BYTES);
                 s->ready(s);
             }
         }
         break;
 
-    case A_OKAY: /* READY(local-id, remote-id, "") */
+    case A_OKAY: /* READY(local-id, remote-id, "" or acked bytes) */
         if (t->online && p->msg.arg0 != 0 && p->msg.arg1 != 0) {
+            // With delayed acks, the payload is the number of bytes the sender lets us send on
+            // top of what it allowed so far.
+            std::optional<int32_t> acked_bytes;
+            if (t->SupportsDelayedAck() && p->payload.size() == sizeof(int32_t)) {
+                int32_t value;
+                memcpy(&value, p->payload.data(), sizeof(value));
+                acked_bytes = value;
+            }
+
             asocket* s = find_local_socket(p->msg.arg1, 0);
             if (s) {
                 if(s->peer == nullptr) {
                     /* On first READY message, create the connection. */
                     s->peer = create_remote_socket(p->msg.arg0, t);
                     s->peer->peer = s;
+                    s->peer->available_send_bytes = acked_bytes;
                     s->ready(s);
                 } else if (s->peer->id == p->msg.arg0) {
                     /* Other READY messages must use the same local-id */
-                    s->ready(s);
+                    if (s->peer->available_send_bytes && acked_bytes) {
+                        *s->peer->available_send_bytes += *acked_bytes;
+                        if (*s->peer->available_send_bytes > 0) {
+                            s->ready(s);
+                        }
+                    } else {
+                        s->ready(s);
+                    }
                 } else {
                     D("Invalid A_OKAY(%d,%d), expected A_OKAY(%d,%d) on transport %s", p->msg.arg0,
                       p->msg.arg1, s->peer->id, p->msg.arg1, t->serial.c_str());
@@ -479,9 +506,17 @@ void handle_packet(apacket *p, atransport *t)
             asocket* s = find_local_socket(p->msg.arg1, p->msg.arg0);
             if (s) {
                 unsigned rid = p->msg.arg0;
+                if (t->SupportsDelayedAck()) {
+                    s->peer->unacked_bytes += p->payload.size();
+                }
                 if (s->enqueue(s, std::move(p->payload)) == 0) {
                     D("Enqueue the socket");
-                    send_ready(s->id, rid, t);
+                    if (t->SupportsDelayedAck()) {
+                        // Acknowledged in batches by the remote socket.
+                        s->peer->ready(s->peer);
+                    } else {
+                        send_ready(s->id, rid, t);
+                    }
                 }
             }
         }
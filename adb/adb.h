@@ -36,6 +36,11 @@ constexpr size_t MAX_FRAMEWORK_PAYLOAD = 64 * 1024;
 
 constexpr size_t LINUX_MAX_SOCKET_SIZE = 4194304;
 
+// With delayed acks, the number of bytes each end of a stream lets the other end send ahead of
+// its A_OKAYs, and the number of bytes it consumes before acknowledging them.
+constexpr int32_t INITIAL_DELAYED_ACK_BYTES = 4 * MAX_PAYLOAD;
+constexpr size_t DELAYED_ACK_THRESHOLD = INITIAL_DELAYED_ACK_BYTES / 4;
+
 #define A_SYNC 0x434e5953
 #define A_CNXN 0x4e584e43
 #define A_OPEN 0x4e45504f
@@ -64,7 +69,7 @@ constexpr size_t LINUX_MAX_SOCKET_SIZE = 4194304;
 std::string adb_version();
 
 // Increment this when we want to force users to start a new adb server.
-#define ADB_SERVER_VERSION 41
+#define ADB_SERVER_VERSION 45
 
 using TransportId = uint64_t;
 class atransport;
@@ -166,7 +171,7 @@ unique_fd execute_abb_command(std::string_view command);
 #if !ADB_HOST
 int init_jdwp(void);
 asocket* create_jdwp_service_socket();
-asocket* create_jdwp_tracker_service_socket();
+asocket* create_jdwp_tracker_service_socket(bool delta);
 unique_fd create_jdwp_connection_fd(int jdwp_pid);
 #endif
 
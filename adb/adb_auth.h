@@ -54,8 +54,10 @@ void adbd_auth_init(void);
 void adbd_auth_verified(atransport *t);
 
 void adbd_cloexec_auth_socket();
+// |key_id| is the id the client sent with the signature, which is only a hint: the key with that
+// id is tried first, then all of the others.
 bool adbd_auth_verify(const char* token, size_t token_size, const std::string& sig,
-                      std::string* auth_key);
+                      uint32_t key_id, std::string* auth_key);
 void adbd_auth_confirm_key(atransport* t);
 void adbd_notify_framework_connected_key(atransport* t);
 
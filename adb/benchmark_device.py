@@ -15,9 +15,24 @@
 # limitations under the License.
 #
 
+"""End-to-end adb transport benchmarks.
+
+Measures push/pull/shell/sink/source throughput and small-packet round trip
+latency against a connected device, along with the CPU time the adb server
+and adbd spent doing it. Whether this exercises USB, TCP or TLS depends on
+the device selected with -s; the transport in use is recorded in the results.
+
+    benchmark_device.py -s <serial> --json results.json
+"""
+
+import argparse
+import json
 import os
+import platform
+import socket
 import statistics
 import subprocess
+import sys
 import tempfile
 import time
 
@@ -51,106 +66,295 @@ def unlock(device):
 def harmonic_mean(xs):
     return 1.0 / statistics.mean([1.0 / x for x in xs])
 
-def analyze(name, speeds):
-    median = statistics.median(speeds)
-    mean = harmonic_mean(speeds)
-    stddev = statistics.stdev(speeds)
-    msg = "%s: %d runs: median %.2f MiB/s, mean %.2f MiB/s, stddev: %.2f MiB/s"
-    print(msg % (name, len(speeds), median, mean, stddev))
+def parse_cpu_ticks(stat):
+    # utime and stime are fields 14 and 15 of /proc/<pid>/stat, counted after
+    # the parenthesized command name, which may itself contain spaces.
+    fields = stat[stat.rindex(")") + 2:].split()
+    return int(fields[11]) + int(fields[12])
+
+def server_port():
+    return int(os.environ.get("ANDROID_ADB_SERVER_PORT", "5037"))
+
+def find_server_pid():
+    """Returns the pid of the local adb server, or None if it can't be found."""
+    if not os.path.isdir("/proc"):
+        return None
+    for pid in os.listdir("/proc"):
+        if not pid.isdigit():
+            continue
+        try:
+            with open("/proc/%s/cmdline" % pid, "rb") as f:
+                argv = f.read().split(b"\0")
+        except OSError:
+            continue
+        if (argv and os.path.basename(argv[0]) == b"adb" and
+                b"fork-server" in argv and b"server" in argv):
+            return int(pid)
+    return None
+
+class CpuMonitor:
+    """Tracks the CPU time used by the adb server and by adbd.
+
+    Both are sampled from /proc/<pid>/stat outside of the timed region, so
+    the extra round trip to the device doesn't skew the throughput numbers.
+    """
+
+    def __init__(self, device):
+        self.device = device
+        self.host_pid = find_server_pid()
+        self.host_hz = os.sysconf("SC_CLK_TCK") if hasattr(os, "sysconf") else 100
+        self.device_hz = 100
+        self.device_pid = None
+        try:
+            out, _ = self.device.shell(["pidof", "adbd"])
+            self.device_pid = int(out.split()[0])
+            out, _ = self.device.shell(["getconf", "CLK_TCK"])
+            self.device_hz = int(out.strip())
+        except (adb.ShellError, IndexError, ValueError):
+            pass
+
+    def host_ticks(self):
+        if self.host_pid is None:
+            return None
+        try:
+            with open("/proc/%d/stat" % self.host_pid) as f:
+                return parse_cpu_ticks(f.read())
+        except OSError:
+            return None
+
+    def device_ticks(self):
+        if self.device_pid is None:
+            return None
+        _, out, _ = self.device.shell_nocheck(["cat", "/proc/%d/stat" % self.device_pid])
+        try:
+            return parse_cpu_ticks(out)
+        except ValueError:
+            return None
+
+    def sample(self):
+        return (self.host_ticks(), self.device_ticks())
+
+    def elapsed(self, before, after):
+        """Returns the host and device CPU seconds between two samples."""
+        def diff(a, b, hz):
+            if a is None or b is None:
+                return None
+            return (b - a) / float(hz)
+        return (diff(before[0], after[0], self.host_hz),
+                diff(before[1], after[1], self.device_hz))
+
+class Results:
+    def __init__(self, device, args):
+        self.device = device
+        self.benchmarks = []
+        self.info = {
+            "serial": device.serial,
+            "transport": transport_type(device),
+            "host": platform.platform(),
+            "device": device.shell_nocheck(["getprop", "ro.build.fingerprint"])[1].strip(),
+            "features": device_features(device),
+            "runs": args.runs,
+            "size_mb": args.size,
+            "timestamp": int(time.time()),
+        }
 
-def benchmark_sink(device=None, size_mb=100):
-    if device == None:
-        device = adb.get_device()
+    def add(self, name, unit, values, host_cpu, device_cpu):
+        result = {"name": name, "unit": unit, "runs": values}
+        result["median"] = statistics.median(values)
+        if unit == "MiB/s":
+            result["mean"] = harmonic_mean(values)
+        else:
+            result["mean"] = statistics.mean(values)
+        result["stddev"] = statistics.stdev(values) if len(values) > 1 else 0.0
+        result["host_cpu_s"] = host_cpu
+        result["device_cpu_s"] = device_cpu
+        self.benchmarks.append(result)
 
+        msg = "%s: %d runs: median %.2f %s, mean %.2f %s, stddev: %.2f %s"
+        print(msg % (name, len(values), result["median"], unit, result["mean"], unit,
+                     result["stddev"], unit))
+        if host_cpu is not None or device_cpu is not None:
+            def fmt(cpu):
+                return "?" if cpu is None else "%.2fs" % cpu
+            print("    cpu: host %s, device %s" % (fmt(host_cpu), fmt(device_cpu)))
+
+    def to_json(self):
+        return {"info": self.info, "benchmarks": self.benchmarks}
+
+def transport_type(device):
+    """Guesses which of USB, TCP or TLS carries the given device."""
+    if "_adb-tls-connect._tcp" in device.serial:
+        return "tls"
+    try:
+        devpath = subprocess.check_output(device.adb_cmd + ["get-devpath"],
+                                          stderr=subprocess.DEVNULL).decode().strip()
+    except subprocess.CalledProcessError:
+        devpath = ""
+    if devpath.startswith("usb:"):
+        return "usb"
+    if device.serial.startswith("emulator-"):
+        return "emulator"
+    return "tcp"
+
+def device_features(device):
+    try:
+        out = subprocess.check_output(device.adb_cmd + ["features"],
+                                      stderr=subprocess.DEVNULL).decode()
+    except subprocess.CalledProcessError:
+        return []
+    return sorted(out.split())
+
+def run_timed(results, cpu, name, runs, size_mb, fn):
     speeds = list()
+    before = cpu.sample()
+    for _ in range(0, runs):
+        begin = time.time()
+        fn()
+        end = time.time()
+        speeds.append(size_mb / float(end - begin))
+    host_cpu, device_cpu = cpu.elapsed(before, cpu.sample())
+    results.add(name, "MiB/s", speeds, host_cpu, device_cpu)
+
+def benchmark_sink(device, results, cpu, runs, size_mb):
     cmd = device.adb_cmd + ["raw", "sink:%d" % (size_mb * 1024 * 1024)]
 
     with tempfile.TemporaryFile() as tmpfile:
         tmpfile.truncate(size_mb * 1024 * 1024)
 
-        for _ in range(0, 10):
+        def run():
             tmpfile.seek(0)
-            begin = time.time()
             subprocess.check_call(cmd, stdin=tmpfile)
-            end = time.time()
-            speeds.append(size_mb / float(end - begin))
+        run_timed(results, cpu, "sink %dMiB" % size_mb, runs, size_mb, run)
 
-    analyze("sink %dMiB" % size_mb, speeds)
-
-def benchmark_source(device=None, size_mb=100):
-    if device == None:
-        device = adb.get_device()
-
-    speeds = list()
+def benchmark_source(device, results, cpu, runs, size_mb):
     cmd = device.adb_cmd + ["raw", "source:%d" % (size_mb * 1024 * 1024)]
 
     with open(os.devnull, 'w') as devnull:
-        for _ in range(0, 10):
-            begin = time.time()
+        def run():
             subprocess.check_call(cmd, stdout=devnull)
-            end = time.time()
-            speeds.append(size_mb / float(end - begin))
+        run_timed(results, cpu, "source %dMiB" % size_mb, runs, size_mb, run)
 
-    analyze("source %dMiB" % size_mb, speeds)
+def benchmark_push(device, results, cpu, runs, size_mb):
+    remote_path = "/dev/null"
 
-def benchmark_push(device=None, file_size_mb=100):
-    if device == None:
-        device = adb.get_device()
+    with tempfile.NamedTemporaryFile() as tmpfile:
+        tmpfile.truncate(size_mb * 1024 * 1024)
+        tmpfile.flush()
 
-    remote_path = "/dev/null"
-    local_path = "/tmp/adb_benchmark_temp"
+        def run():
+            device.push(local=tmpfile.name, remote=remote_path)
+        run_timed(results, cpu, "push %dMiB" % size_mb, runs, size_mb, run)
 
-    with open(local_path, "wb") as f:
-        f.truncate(file_size_mb * 1024 * 1024)
+def benchmark_pull(device, results, cpu, runs, size_mb):
+    remote_path = "/data/local/tmp/adb_benchmark_temp"
 
-    speeds = list()
-    for _ in range(0, 10):
-        begin = time.time()
-        device.push(local=local_path, remote=remote_path)
-        end = time.time()
-        speeds.append(file_size_mb / float(end - begin))
+    device.shell(["dd", "if=/dev/zero", "of=" + remote_path, "bs=1m",
+                  "count=" + str(size_mb)])
+    with tempfile.TemporaryDirectory() as tmpdir:
+        local_path = os.path.join(tmpdir, "adb_benchmark_temp")
 
-    analyze("push %dMiB" % file_size_mb, speeds)
+        def run():
+            device.pull(remote=remote_path, local=local_path)
+        run_timed(results, cpu, "pull %dMiB" % size_mb, runs, size_mb, run)
+    device.shell_nocheck(["rm", "-f", remote_path])
 
-def benchmark_pull(device=None, file_size_mb=100):
-    if device == None:
-        device = adb.get_device()
+def benchmark_shell(device, results, cpu, runs, size_mb):
+    def run():
+        device.shell(["dd", "if=/dev/zero", "bs=1m", "count=" + str(size_mb)])
+    run_timed(results, cpu, "shell %dMiB" % size_mb, runs, size_mb, run)
 
-    remote_path = "/data/local/tmp/adb_benchmark_temp"
-    local_path = "/tmp/adb_benchmark_temp"
+def open_service(device, service):
+    """Opens a raw stream to a service on the device, via the adb server."""
+    def send(sock, request):
+        sock.sendall(b"%04x%s" % (len(request), request))
+        status = sock.recv(4)
+        if status != b"OKAY":
+            raise RuntimeError("%s failed: %r" % (request.decode(), status + sock.recv(1024)))
 
-    device.shell(["dd", "if=/dev/zero", "of=" + remote_path, "bs=1m",
-                  "count=" + str(file_size_mb)])
-    speeds = list()
-    for _ in range(0, 10):
-        begin = time.time()
-        device.pull(remote=remote_path, local=local_path)
-        end = time.time()
-        speeds.append(file_size_mb / float(end - begin))
+    sock = socket.create_connection(("localhost", server_port()))
+    sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+    send(sock, b"host:transport:" + device.serial.encode())
+    send(sock, service.encode())
+    return sock
 
-    analyze("pull %dMiB" % file_size_mb, speeds)
+def benchmark_latency(device, results, cpu, runs, round_trips=1000, packet_size=1):
+    """Measures round trips of small packets through `cat` on the device.
 
-def benchmark_shell(device=None, file_size_mb=100):
-    if device == None:
-        device = adb.get_device()
+    Each write becomes its own A_WRTE, so this exercises per-packet overhead
+    in the server, the transport and adbd rather than bulk throughput.
+    """
+    latencies = list()
+    payload = b"x" * packet_size
+    before = cpu.sample()
+    for _ in range(0, runs):
+        sock = open_service(device, "exec:cat")
+        try:
+            # Warm up the stream so the first round trip doesn't count the fork.
+            sock.sendall(payload)
+            sock.recv(packet_size, socket.MSG_WAITALL)
 
-    speeds = list()
-    for _ in range(0, 10):
-        begin = time.time()
-        device.shell(["dd", "if=/dev/zero", "bs=1m",
-                      "count=" + str(file_size_mb)])
-        end = time.time()
-        speeds.append(file_size_mb / float(end - begin))
+            begin = time.time()
+            for _ in range(0, round_trips):
+                sock.sendall(payload)
+                received = 0
+                while received < packet_size:
+                    data = sock.recv(packet_size - received)
+                    if not data:
+                        raise RuntimeError("connection closed")
+                    received += len(data)
+            end = time.time()
+        finally:
+            sock.close()
+        latencies.append((end - begin) * 1e6 / round_trips)
+    host_cpu, device_cpu = cpu.elapsed(before, cpu.sample())
+    results.add("latency %dB" % packet_size, "us", latencies, host_cpu, device_cpu)
+
+BENCHMARKS = {
+    "sink": benchmark_sink,
+    "source": benchmark_source,
+    "push": benchmark_push,
+    "pull": benchmark_pull,
+    "shell": benchmark_shell,
+}
 
-    analyze("shell %dMiB" % file_size_mb, speeds)
+ALL_BENCHMARKS = ["sink", "source", "push", "pull", "shell", "latency"]
 
 def main():
-    device = adb.get_device()
-    unlock(device)
-    benchmark_sink(device)
-    benchmark_source(device)
-    benchmark_push(device)
-    benchmark_pull(device)
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("-s", "--serial", help="device to benchmark")
+    parser.add_argument("--runs", type=int, default=10, help="runs per benchmark (default 10)")
+    parser.add_argument("--size", type=int, default=100,
+                        help="transfer size in MiB for throughput benchmarks (default 100)")
+    parser.add_argument("--json", metavar="FILE",
+                        help="write results to FILE as JSON ('-' for stdout)")
+    parser.add_argument("--cpu", choices=["min", "max", "unlock"], default="unlock",
+                        help="device CPU frequency policy (requires root for min/max)")
+    parser.add_argument("benchmarks", nargs="*", metavar="BENCHMARK",
+                        help="benchmarks to run: %s (default: all)" % ", ".join(ALL_BENCHMARKS))
+    args = parser.parse_args()
+    for name in args.benchmarks:
+        if name not in ALL_BENCHMARKS:
+            parser.error("unknown benchmark '%s'" % name)
+
+    device = adb.get_device(args.serial)
+    {"min": lock_min, "max": lock_max, "unlock": unlock}[args.cpu](device)
+
+    results = Results(device, args)
+    cpu = CpuMonitor(device)
+    print("benchmarking %s over %s" % (device.serial, results.info["transport"]))
+
+    for name in args.benchmarks or ALL_BENCHMARKS:
+        if name == "latency":
+            benchmark_latency(device, results, cpu, args.runs)
+        else:
+            BENCHMARKS[name](device, results, cpu, args.runs, args.size)
+
+    if args.json == "-":
+        json.dump(results.to_json(), sys.stdout, indent=2)
+        print()
+    elif args.json:
+        with open(args.json, "w") as f:
+            json.dump(results.to_json(), f, indent=2)
 
 if __name__ == "__main__":
     main()
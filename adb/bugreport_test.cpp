@@ -19,11 +19,13 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <android-base/file.h>
 #include <android-base/strings.h>
 #include <android-base/test_utils.h>
 
 #include "sysdeps.h"
 #include "adb_utils.h"
+#include "client/file_sync_client.h"
 
 using ::testing::_;
 using ::testing::Action;
@@ -43,7 +45,7 @@ using ::testing::internal::GetCapturedStdout;
 // Empty function so tests don't need to be linked against file_sync_service.cpp, which requires
 // SELinux and its transitive dependencies...
 bool do_sync_pull(const std::vector<const char*>& srcs, const char* dst, bool copy_attrs,
-                  const char* name) {
+                  CompressionType compression, const char* name, size_t jobs) {
     ADD_FAILURE() << "do_sync_pull() should have been mocked";
     return false;
 }
@@ -464,3 +466,39 @@ TEST_F(BugreportTest, PullFails) {
     const char* args[] = {"bugreport", "file.zip"};
     ASSERT_EQ(1, br_.DoIt(2, args));
 }
+
+// Tests 'adb bugreport file.zip' when the device streams the zip with 'bugreportz -s'.
+TEST_F(BugreportTest, OkStreamed) {
+    ExpectBugreportzVersion("1.2");
+    TemporaryDir td;
+    std::string dest_file =
+        android::base::StringPrintf("%s%cfile.zip", td.path, OS_PATH_SEPARATOR);
+
+    EXPECT_CALL(br_, SendShellCommand("bugreportz -s", false, _))
+        .WillOnce(DoAll(WithArg<2>(WriteOnStdout("PK\x03\x04")),
+                        WithArg<2>(WriteOnStdout("zipped bugreport")),
+                        WithArg<2>(ReturnCallbackDone(0))));
+
+    const char* args[] = {"bugreport", dest_file.c_str()};
+    ASSERT_EQ(0, br_.DoIt(2, args));
+
+    std::string content;
+    ASSERT_TRUE(android::base::ReadFileToString(dest_file, &content));
+    ASSERT_EQ("PK\x03\x04zipped bugreport", content);
+}
+
+// Tests 'adb bugreport file.zip' when 'bugreportz -s' fails half way through the stream.
+TEST_F(BugreportTest, StreamedFails) {
+    ExpectBugreportzVersion("1.2");
+    TemporaryDir td;
+    std::string dest_file =
+        android::base::StringPrintf("%s%cfile.zip", td.path, OS_PATH_SEPARATOR);
+
+    EXPECT_CALL(br_, SendShellCommand("bugreportz -s", false, _))
+        .WillOnce(DoAll(WithArg<2>(WriteOnStdout("PK\x03\x04")),
+                        WithArg<2>(ReturnCallbackDone(2))));
+
+    const char* args[] = {"bugreport", dest_file.c_str()};
+    ASSERT_EQ(2, br_.DoIt(2, args));
+    ASSERT_EQ(-1, access(dest_file.c_str(), F_OK));
+}
@@ -22,8 +22,10 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <algorithm>
+#include <atomic>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <vector>
 
 #include <android-base/file.h>
@@ -43,6 +45,8 @@
 using namespace std::literals;
 
 static constexpr int kFastDeployMinApi = 24;
+// How many splits install-multiple streams at the same time.
+static constexpr int kMaxParallelInstallWrites = 4;
 
 namespace {
 
@@ -293,7 +297,7 @@ static int install_app_legacy(int argc, const char** argv, bool use_fastdeploy)
         }
     }
 
-    if (do_sync_push(apk_file, apk_dest.c_str(), false, true)) {
+    if (do_sync_push(apk_file, apk_dest.c_str(), false, CompressionType::Any)) {
         result = pm_command(argc, argv);
         delete_device_file(apk_dest);
     }
@@ -536,6 +540,58 @@ int install_app(int argc, const char** argv) {
     return res;
 }
 
+// Streams one split into an install session. Safe to call for several splits at once.
+static bool install_write(const std::string& install_cmd, const std::string& session_id_str,
+                          const char* file) {
+    struct stat sb;
+    if (stat(file, &sb) == -1) {
+        fprintf(stderr, "adb: failed to stat \"%s\": %s\n", file, strerror(errno));
+        return false;
+    }
+
+    std::vector<std::string> cmd_args = {
+            install_cmd,
+            "install-write",
+            "-S",
+            std::to_string(sb.st_size),
+            session_id_str,
+            android::base::Basename(file),
+            "-",
+    };
+
+    unique_fd local_fd(adb_open(file, O_RDONLY | O_CLOEXEC));
+    if (local_fd < 0) {
+        fprintf(stderr, "adb: failed to open \"%s\": %s\n", file, strerror(errno));
+        return false;
+    }
+
+#ifdef __linux__
+    posix_fadvise(local_fd.get(), 0, 0, POSIX_FADV_SEQUENTIAL | POSIX_FADV_NOREUSE);
+#endif
+
+    std::string error;
+    unique_fd remote_fd = send_command(cmd_args, &error);
+    if (remote_fd < 0) {
+        fprintf(stderr, "adb: connect error for write: %s\n", error.c_str());
+        return false;
+    }
+
+    if (!copy_to_file(local_fd.get(), remote_fd.get())) {
+        fprintf(stderr, "adb: failed to write \"%s\": %s\n", file, strerror(errno));
+        return false;
+    }
+
+    char buf[BUFSIZ];
+    read_status_line(remote_fd.get(), buf, sizeof(buf));
+
+    if (strncmp("Success", buf, 7)) {
+        fprintf(stderr, "adb: failed to write \"%s\"\n", file);
+        fputs(buf, stderr);
+        return false;
+    }
+    return true;
+}
+
 static int install_multiple_app_streamed(int argc, const char** argv) {
     // Find all APK arguments starting at end.
     // All other arguments passed through verbatim.
@@ -605,59 +661,26 @@ static int install_multiple_app_streamed(int argc, const char** argv) {
     }
     const auto session_id_str = std::to_string(session_id);
 
-    // Valid session, now stream the APKs
-    bool success = true;
-    for (int i = first_apk; i < argc; i++) {
-        const char* file = argv[i];
-        struct stat sb;
-        if (stat(file, &sb) == -1) {
-            fprintf(stderr, "adb: failed to stat \"%s\": %s\n", file, strerror(errno));
-            success = false;
-            goto finalize_session;
-        }
-
-        std::vector<std::string> cmd_args = {
-                install_cmd,
-                "install-write",
-                "-S",
-                std::to_string(sb.st_size),
-                session_id_str,
-                android::base::Basename(file),
-                "-",
-        };
-
-        unique_fd local_fd(adb_open(file, O_RDONLY | O_CLOEXEC));
-        if (local_fd < 0) {
-            fprintf(stderr, "adb: failed to open \"%s\": %s\n", file, strerror(errno));
-            success = false;
-            goto finalize_session;
-        }
-
-        std::string error;
-        unique_fd remote_fd = send_command(cmd_args, &error);
-        if (remote_fd < 0) {
-            fprintf(stderr, "adb: connect error for write: %s\n", error.c_str());
-            success = false;
-            goto finalize_session;
-        }
-
-        if (!copy_to_file(local_fd.get(), remote_fd.get())) {
-            fprintf(stderr, "adb: failed to write \"%s\": %s\n", file, strerror(errno));
-            success = false;
-            goto finalize_session;
-        }
-
-        read_status_line(remote_fd.get(), buf, sizeof(buf));
-
-        if (strncmp("Success", buf, 7)) {
-            fprintf(stderr, "adb: failed to write \"%s\"\n", file);
-            fputs(buf, stderr);
-            success = false;
-            goto finalize_session;
+    // Valid session, now stream the APKs. Each split goes over its own connection, so the device
+    // can be writing one while the next is still in flight; the first failure stops the rest.
+    std::atomic<int> next_apk = first_apk;
+    std::atomic<bool> success = true;
+    auto write_apks = [&]() {
+        for (int i; success && (i = next_apk++) < argc;) {
+            if (!install_write(install_cmd, session_id_str, argv[i])) {
+                success = false;
+            }
         }
+    };
+    std::vector<std::thread> writers;
+    for (int i = 1; i < std::min(kMaxParallelInstallWrites, argc - first_apk); ++i) {
+        writers.emplace_back(write_apks);
+    }
+    write_apks();
+    for (auto& writer : writers) {
+        writer.join();
     }
 
-finalize_session:
     // Commit session if we streamed everything okay; otherwise abandon.
     std::vector<std::string> service_args = {
             install_cmd,
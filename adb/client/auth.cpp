@@ -474,8 +474,13 @@ void send_auth_response(const char* token, size_t token_size, atransport* t) {
         return;
     }
 
+    // The key id lets the device try the matching key first; older devices ignore it.
+    uint32_t key_id = 0;
+    CalculateKeyId(&key_id, key.get());
+
     p->msg.command = A_AUTH;
     p->msg.arg0 = ADB_AUTH_SIGNATURE;
+    p->msg.arg1 = key_id;
     p->payload.assign(result.begin(), result.end());
     p->msg.data_length = p->payload.size();
     send_packet(p, t);
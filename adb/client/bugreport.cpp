@@ -20,12 +20,16 @@
 
 #include "bugreport.h"
 
+#include <time.h>
+
 #include <string>
 #include <vector>
 
 #include <android-base/file.h>
 #include <android-base/strings.h>
 
+#include "adb_io.h"
+#include "adb_unique_fd.h"
 #include "adb_utils.h"
 #include "client/file_sync_client.h"
 
@@ -196,6 +200,64 @@ class BugreportStandardStreamsCallback : public StandardStreamsCallbackInterface
     DISALLOW_COPY_AND_ASSIGN(BugreportStandardStreamsCallback);
 };
 
+// Custom callback used to write a bugreport streamed by 'bugreportz -s' straight to a file.
+class BugreportStreamingCallback : public StandardStreamsCallbackInterface {
+  public:
+    BugreportStreamingCallback(const std::string& destination, unique_fd fd)
+        : destination_(destination), fd_(std::move(fd)), size_(0), write_errno_(0) {}
+
+    void OnStdout(const char* buffer, int length) {
+        if (fd_ == -1) return;
+        if (!WriteFdExactly(fd_.get(), buffer, length)) {
+            write_errno_ = errno;
+            fd_.reset();
+            return;
+        }
+        size_ += length;
+    }
+
+    void OnStderr(const char* buffer, int length) {
+        OnStream(nullptr, stderr, buffer, length);
+    }
+
+    int Done(int status) {
+        fd_.reset();
+        if (status == 0 && write_errno_ == 0 && size_ > 0) {
+            return 0;
+        }
+
+        if (write_errno_ != 0) {
+            fprintf(stderr, "adb: failed to write bugreport to '%s': %s\n", destination_.c_str(),
+                    strerror(write_errno_));
+        } else {
+            fprintf(stderr, "adb: device failed to stream a zipped bugreport (status %d)\n",
+                    status);
+        }
+        adb_unlink(destination_.c_str());
+        return status != 0 ? status : 1;
+    }
+
+  private:
+    std::string destination_;
+    unique_fd fd_;
+
+    // Number of bytes written to |fd_| so far.
+    size_t size_;
+
+    // errno of the first failed write, if any; the rest of the stream is dropped after it.
+    int write_errno_;
+
+    DISALLOW_COPY_AND_ASSIGN(BugreportStreamingCallback);
+};
+
+// Returns whether bugreportz |version| can stream the zip to stdout with -s, which was added in
+// 1.2. That saves writing the zip on the device and pulling it once dumpstate is done.
+static bool BugreportzSupportsStreaming(const std::string& version) {
+    int major, minor;
+    if (sscanf(version.c_str(), "%d.%d", &major, &minor) != 2) return false;
+    return major > 1 || (major == 1 && minor >= 2);
+}
+
 int Bugreport::DoIt(int argc, const char** argv) {
     if (argc > 2) error_exit("usage: adb bugreport [PATH]");
 
@@ -253,6 +315,10 @@ int Bugreport::DoIt(int argc, const char** argv) {
         }
     }
 
+    if (BugreportzSupportsStreaming(bugz_version)) {
+        return DoStreamedBugreport(dest_dir, dest_file);
+    }
+
     bool show_progress = true;
     std::string bugz_command = "bugreportz -p";
     if (bugz_version == "1.0") {
@@ -269,6 +335,32 @@ int Bugreport::DoIt(int argc, const char** argv) {
     return SendShellCommand(bugz_command, false, &bugz_callback);
 }
 
+int Bugreport::DoStreamedBugreport(const std::string& dest_dir, const std::string& dest_file) {
+    std::string destination;
+    if (dest_dir.empty()) {
+        destination = dest_file;
+    } else {
+        // The device names the zip after the build and time, but it isn't told until the stream
+        // is over, so use the host's time instead.
+        time_t now = time(nullptr);
+        char name[64];
+        strftime(name, sizeof(name), "bugreport-%Y-%m-%d-%H-%M-%S.zip", localtime(&now));
+        destination = android::base::StringPrintf("%s%c%s", dest_dir.c_str(), OS_PATH_SEPARATOR,
+                                                  name);
+    }
+
+    unique_fd fd(adb_creat(destination.c_str(), 0644));
+    if (fd == -1) {
+        fprintf(stderr, "adb: failed to create '%s': %s\n", destination.c_str(), strerror(errno));
+        return 1;
+    }
+
+    fprintf(stderr, "Streaming bugreport to '%s'; this could take minutes.\n",
+            destination.c_str());
+    BugreportStreamingCallback bugz_callback(destination, std::move(fd));
+    return SendShellCommand("bugreportz -s", false, &bugz_callback);
+}
+
 void Bugreport::UpdateProgress(const std::string& message, int progress_percentage) {
     line_printer_.Print(
         android::base::StringPrintf("[%3d%%] %s", progress_percentage, message.c_str()),
@@ -282,5 +374,5 @@ int Bugreport::SendShellCommand(const std::string& command, bool disable_shell_p
 
 bool Bugreport::DoSyncPull(const std::vector<const char*>& srcs, const char* dst, bool copy_attrs,
                            const char* name) {
-    return do_sync_pull(srcs, dst, copy_attrs, name);
+    return do_sync_pull(srcs, dst, copy_attrs, CompressionType::Any, name);
 }
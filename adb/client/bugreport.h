@@ -42,6 +42,9 @@ class Bugreport {
                             const char* name);
 
   private:
+    // Streams the zip from 'bugreportz -s' to the destination as the device produces it.
+    int DoStreamedBugreport(const std::string& dest_dir, const std::string& dest_file);
+
     virtual void UpdateProgress(const std::string& file_name, int progress_percentage);
     LinePrinter line_printer_;
     DISALLOW_COPY_AND_ASSIGN(Bugreport);
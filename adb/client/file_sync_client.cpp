@@ -28,12 +28,18 @@
 #include <unistd.h>
 #include <utime.h>
 
+#include <algorithm>
 #include <chrono>
 #include <deque>
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "sysdeps.h"
@@ -42,7 +48,8 @@
 #include "adb_client.h"
 #include "adb_io.h"
 #include "adb_utils.h"
-#include "brotli_utils.h"
+#include "compression_utils.h"
+#include "file_sync_delta.h"
 #include "file_sync_protocol.h"
 #include "line_printer.h"
 #include "sysdeps/errno.h"
@@ -51,6 +58,7 @@
 #include "client/commandline.h"
 
 #include <android-base/file.h>
+#include <android-base/mapped_file.h>
 #include <android-base/strings.h>
 #include <android-base/stringprintf.h>
 
@@ -222,24 +230,139 @@ struct TransferLedger {
     }
 };
 
+// Chooses the compression for files the user didn't pick one for. Each candidate is scored by
+// the uncompressed bytes per second it achieved on earlier files. That one figure already folds
+// in the link throughput, how well the data compresses, and the CPU cost of the codec on either
+// end. Candidates without a score are tried first, in the order given.
+class CompressionSelector {
+  public:
+    // Files smaller than this are dominated by per-file overhead and don't say much.
+    static constexpr uint64_t kMinSampleBytes = 1024 * 1024;
+
+    CompressionType Select(const std::vector<CompressionType>& candidates) const {
+        CompressionType best = candidates.front();
+        double best_rate = -1;
+        for (CompressionType candidate : candidates) {
+            auto it = rates_.find(candidate);
+            if (it == rates_.end()) {
+                return candidate;
+            }
+            if (it->second > best_rate) {
+                best = candidate;
+                best_rate = it->second;
+            }
+        }
+        return best;
+    }
+
+    void Record(CompressionType compression, uint64_t bytes,
+                std::chrono::duration<double> elapsed) {
+        if (bytes < kMinSampleBytes || elapsed.count() <= 0) {
+            return;
+        }
+        double rate = bytes / elapsed.count();
+        auto [it, inserted] = rates_.try_emplace(compression, rate);
+        if (!inserted) {
+            it->second = (it->second + rate) / 2;
+        }
+    }
+
+  private:
+    std::map<CompressionType, double> rates_;
+};
+
+// Progress shared by every SyncConnection of a parallel transfer, so that they report as one.
+struct TransferProgress {
+    std::mutex mutex;
+    TransferLedger global_ledger;
+    TransferLedger current_ledger;
+    LinePrinter line_printer;
+    // Compression is done by the host for pushes and by the device for pulls, so what works
+    // best has to be learned separately for each.
+    CompressionSelector push_compression;
+    CompressionSelector pull_compression;
+};
+
+static SyncFlag compression_flag(CompressionType compression) {
+    switch (compression) {
+        case CompressionType::None:
+            return kSyncFlagNone;
+        case CompressionType::Brotli:
+            return kSyncFlagBrotli;
+        case CompressionType::LZ4:
+            return kSyncFlagLZ4;
+        case CompressionType::Zstd:
+            return kSyncFlagZstd;
+        case CompressionType::Any:
+            break;
+    }
+    LOG(FATAL) << "unresolved compression type: " << static_cast<int>(compression);
+    return kSyncFlagNone;
+}
+
+static std::unique_ptr<Encoder> create_encoder(CompressionType compression) {
+    switch (compression) {
+        case CompressionType::Brotli:
+            return std::make_unique<BrotliEncoder>(SYNC_DATA_MAX);
+        case CompressionType::LZ4:
+            return std::make_unique<LZ4Encoder>(SYNC_DATA_MAX);
+        case CompressionType::Zstd:
+            return std::make_unique<ZstdEncoder>(SYNC_DATA_MAX);
+        case CompressionType::None:
+        case CompressionType::Any:
+            break;
+    }
+    LOG(FATAL) << "no encoder for compression type: " << static_cast<int>(compression);
+    return nullptr;
+}
+
+static std::unique_ptr<Decoder> create_decoder(CompressionType compression,
+                                               std::span<char> output) {
+    switch (compression) {
+        case CompressionType::Brotli:
+            return std::make_unique<BrotliDecoder>(output);
+        case CompressionType::LZ4:
+            return std::make_unique<LZ4Decoder>(output);
+        case CompressionType::Zstd:
+            return std::make_unique<ZstdDecoder>(output);
+        case CompressionType::None:
+        case CompressionType::Any:
+            break;
+    }
+    LOG(FATAL) << "no decoder for compression type: " << static_cast<int>(compression);
+    return nullptr;
+}
+
 class SyncConnection {
   public:
-    SyncConnection() : acknowledgement_buffer_(sizeof(sync_status) + SYNC_DATA_MAX) {
+    SyncConnection() : SyncConnection(nullptr) {}
+
+    // Opens another sync connection that shares the features and progress reporting of
+    // |parent|, for transferring files in parallel with it.
+    explicit SyncConnection(const SyncConnection* parent)
+        : acknowledgement_buffer_(sizeof(sync_status) + SYNC_DATA_MAX),
+          progress_(parent ? parent->progress_ : std::make_shared<TransferProgress>()) {
         acknowledgement_buffer_.resize(0);
         max = SYNC_DATA_MAX; // TODO: decide at runtime.
 
         std::string error;
-        if (!adb_get_feature_set(&features_, &error)) {
+        if (parent) {
+            features_ = parent->features_;
+        } else if (!adb_get_feature_set(&features_, &error)) {
             Error("failed to get feature set: %s", error.c_str());
-        } else {
-            have_stat_v2_ = CanUseFeature(features_, kFeatureStat2);
-            have_ls_v2_ = CanUseFeature(features_, kFeatureLs2);
-            have_sendrecv_v2_ = CanUseFeature(features_, kFeatureSendRecv2);
-            have_sendrecv_v2_brotli_ = CanUseFeature(features_, kFeatureSendRecv2Brotli);
-            fd.reset(adb_connect("sync:", &error));
-            if (fd < 0) {
-                Error("connect failed: %s", error.c_str());
-            }
+            return;
+        }
+
+        have_stat_v2_ = CanUseFeature(features_, kFeatureStat2);
+        have_ls_v2_ = CanUseFeature(features_, kFeatureLs2);
+        have_sendrecv_v2_ = CanUseFeature(features_, kFeatureSendRecv2);
+        have_sendrecv_v2_brotli_ = CanUseFeature(features_, kFeatureSendRecv2Brotli);
+        have_sendrecv_v2_lz4_ = CanUseFeature(features_, kFeatureSendRecv2LZ4);
+        have_sendrecv_v2_zstd_ = CanUseFeature(features_, kFeatureSendRecv2Zstd);
+        have_send_delta_ = CanUseFeature(features_, kFeatureSendDelta);
+        fd.reset(adb_connect("sync:", &error));
+        if (fd < 0) {
+            Error("connect failed: %s", error.c_str());
         }
     }
 
@@ -256,23 +379,70 @@ class SyncConnection {
             ReadOrderlyShutdown(fd);
         }
 
-        line_printer_.KeepInfoLine();
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        progress_->line_printer.KeepInfoLine();
     }
 
     bool HaveSendRecv2() const { return have_sendrecv_v2_; }
     bool HaveSendRecv2Brotli() const { return have_sendrecv_v2_brotli_; }
+    bool HaveSendRecv2LZ4() const { return have_sendrecv_v2_lz4_; }
+    bool HaveSendRecv2Zstd() const { return have_sendrecv_v2_zstd_; }
+    bool HaveSendDelta() const { return have_send_delta_; }
+
+    // Narrows |compression| down to something the device supports, falling back to none.
+    // CompressionType::Any picks based on how each codec has fared so far in |direction|.
+    CompressionType ResolveCompression(CompressionType compression, TransferDirection direction) {
+        switch (compression) {
+            case CompressionType::None:
+                return CompressionType::None;
+            case CompressionType::Brotli:
+                return HaveSendRecv2Brotli() ? compression : CompressionType::None;
+            case CompressionType::LZ4:
+                return HaveSendRecv2LZ4() ? compression : CompressionType::None;
+            case CompressionType::Zstd:
+                return HaveSendRecv2Zstd() ? compression : CompressionType::None;
+            case CompressionType::Any:
+                break;
+        }
+
+        // Cheapest first, so the first large file isn't stuck behind the slowest codec.
+        std::vector<CompressionType> candidates;
+        if (HaveSendRecv2LZ4()) candidates.push_back(CompressionType::LZ4);
+        if (HaveSendRecv2Zstd()) candidates.push_back(CompressionType::Zstd);
+        if (HaveSendRecv2Brotli()) candidates.push_back(CompressionType::Brotli);
+        if (candidates.empty()) {
+            return CompressionType::None;
+        }
+        candidates.push_back(CompressionType::None);
+
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        return Selector(direction).Select(candidates);
+    }
+
+    // Feeds the time a file took back into the choice made for CompressionType::Any.
+    void RecordCompression(CompressionType requested, CompressionType used,
+                           TransferDirection direction, uint64_t bytes,
+                           std::chrono::steady_clock::time_point start) {
+        if (requested != CompressionType::Any) {
+            return;
+        }
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        Selector(direction).Record(used, bytes, std::chrono::steady_clock::now() - start);
+    }
 
     const FeatureSet& Features() const { return features_; }
 
     bool IsValid() { return fd >= 0; }
 
     void NewTransfer() {
-        current_ledger_.Reset();
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        progress_->current_ledger.Reset();
     }
 
     void RecordBytesTransferred(size_t bytes) {
-        current_ledger_.bytes_transferred += bytes;
-        global_ledger_.bytes_transferred += bytes;
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        progress_->current_ledger.bytes_transferred += bytes;
+        progress_->global_ledger.bytes_transferred += bytes;
     }
 
     void RecordFileSent(std::string from, std::string to) {
@@ -281,27 +451,33 @@ class SyncConnection {
     }
 
     void RecordFilesTransferred(size_t files) {
-        current_ledger_.files_transferred += files;
-        global_ledger_.files_transferred += files;
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        progress_->current_ledger.files_transferred += files;
+        progress_->global_ledger.files_transferred += files;
     }
 
     void RecordFilesSkipped(size_t files) {
-        current_ledger_.files_skipped += files;
-        global_ledger_.files_skipped += files;
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        progress_->current_ledger.files_skipped += files;
+        progress_->global_ledger.files_skipped += files;
     }
 
     void ReportProgress(const std::string& file, uint64_t file_copied_bytes,
                         uint64_t file_total_bytes) {
-        current_ledger_.ReportProgress(line_printer_, file, file_copied_bytes, file_total_bytes);
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        progress_->current_ledger.ReportProgress(progress_->line_printer, file, file_copied_bytes,
+                                                 file_total_bytes);
     }
 
     void ReportTransferRate(const std::string& file, TransferDirection direction) {
-        current_ledger_.ReportTransferRate(line_printer_, file, direction);
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        progress_->current_ledger.ReportTransferRate(progress_->line_printer, file, direction);
     }
 
     void ReportOverallTransferRate(TransferDirection direction) {
-        if (current_ledger_ != global_ledger_) {
-            global_ledger_.ReportTransferRate(line_printer_, "", direction);
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        if (progress_->current_ledger != progress_->global_ledger) {
+            progress_->global_ledger.ReportTransferRate(progress_->line_printer, "", direction);
         }
     }
 
@@ -323,7 +499,7 @@ class SyncConnection {
         return WriteFdExactly(fd, buf.data(), buf.size());
     }
 
-    bool SendSend2(std::string_view path, mode_t mode, bool compressed) {
+    bool SendSend2(std::string_view path, mode_t mode, CompressionType compression) {
         if (path.length() > 1024) {
             Error("SendRequest failed: path too long: %zu", path.length());
             errno = ENAMETOOLONG;
@@ -339,7 +515,7 @@ class SyncConnection {
         syncmsg msg;
         msg.send_v2_setup.id = ID_SEND_V2;
         msg.send_v2_setup.mode = mode;
-        msg.send_v2_setup.flags = compressed ? kSyncFlagBrotli : kSyncFlagNone;
+        msg.send_v2_setup.flags = compression_flag(compression);
 
         buf.resize(sizeof(SyncRequest) + path.length() + sizeof(msg.send_v2_setup));
 
@@ -352,7 +528,7 @@ class SyncConnection {
         return WriteFdExactly(fd, buf.data(), buf.size());
     }
 
-    bool SendRecv2(const std::string& path) {
+    bool SendRecv2(const std::string& path, CompressionType compression) {
         if (path.length() > 1024) {
             Error("SendRequest failed: path too long: %zu", path.length());
             errno = ENAMETOOLONG;
@@ -367,7 +543,7 @@ class SyncConnection {
 
         syncmsg msg;
         msg.recv_v2_setup.id = ID_RECV_V2;
-        msg.recv_v2_setup.flags = kSyncFlagBrotli;
+        msg.recv_v2_setup.flags = compression_flag(compression);
 
         buf.resize(sizeof(SyncRequest) + path.length() + sizeof(msg.recv_v2_setup));
 
@@ -534,8 +710,9 @@ class SyncConnection {
     }
 
     bool SendLargeFileCompressed(const std::string& path, mode_t mode, const std::string& lpath,
-                                 const std::string& rpath, unsigned mtime) {
-        if (!SendSend2(path, mode, true)) {
+                                 const std::string& rpath, unsigned mtime,
+                                 CompressionType compression) {
+        if (!SendSend2(path, mode, compression)) {
             Error("failed to send ID_SEND_V2 message '%s': %s", path.c_str(), strerror(errno));
             return false;
         }
@@ -558,7 +735,7 @@ class SyncConnection {
         syncsendbuf sbuf;
         sbuf.id = ID_DATA;
 
-        BrotliEncoder<SYNC_DATA_MAX> encoder;
+        std::unique_ptr<Encoder> encoder = create_encoder(compression);
         bool sending = true;
         while (sending) {
             Block input(SYNC_DATA_MAX);
@@ -569,10 +746,10 @@ class SyncConnection {
             }
 
             if (r == 0) {
-                encoder.Finish();
+                encoder->Finish();
             } else {
                 input.resize(r);
-                encoder.Append(std::move(input));
+                encoder->Append(std::move(input));
                 RecordBytesTransferred(r);
                 bytes_copied += r;
                 ReportProgress(rpath, bytes_copied, total_size);
@@ -580,8 +757,8 @@ class SyncConnection {
 
             while (true) {
                 Block output;
-                BrotliEncodeResult result = encoder.Encode(&output);
-                if (result == BrotliEncodeResult::Error) {
+                EncodeResult result = encoder->Encode(&output);
+                if (result == EncodeResult::Error) {
                     Error("compressing '%s' locally failed", lpath.c_str());
                     return false;
                 }
@@ -592,12 +769,12 @@ class SyncConnection {
                     WriteOrDie(lpath, rpath, &sbuf, sizeof(SyncRequest) + output.size());
                 }
 
-                if (result == BrotliEncodeResult::Done) {
+                if (result == EncodeResult::Done) {
                     sending = false;
                     break;
-                } else if (result == BrotliEncodeResult::NeedInput) {
+                } else if (result == EncodeResult::NeedInput) {
                     break;
-                } else if (result == BrotliEncodeResult::MoreOutput) {
+                } else if (result == EncodeResult::MoreOutput) {
                     continue;
                 }
             }
@@ -611,9 +788,9 @@ class SyncConnection {
     }
 
     bool SendLargeFile(const std::string& path, mode_t mode, const std::string& lpath,
-                       const std::string& rpath, unsigned mtime, bool compressed) {
-        if (compressed && HaveSendRecv2Brotli()) {
-            return SendLargeFileCompressed(path, mode, lpath, rpath, mtime);
+                       const std::string& rpath, unsigned mtime, CompressionType compression) {
+        if (compression != CompressionType::None) {
+            return SendLargeFileCompressed(path, mode, lpath, rpath, mtime, compression);
         }
 
         std::string path_and_mode = android::base::StringPrintf("%s,%d", path.c_str(), mode);
@@ -665,6 +842,188 @@ class SyncConnection {
         return WriteOrDie(lpath, rpath, &msg.data, sizeof(msg.data));
     }
 
+    // Fetches the block checksums of the existing |rpath|. Returns false if there's nothing to
+    // diff against, in which case the file should be sent whole.
+    bool FetchSignature(const std::string& rpath, sync_signature* signature,
+                        std::vector<sync_block_sum>* sums) {
+        if (!SendRequest(ID_SIGNATURE, rpath)) {
+            return false;
+        }
+
+        if (!ReadFdExactly(fd.get(), signature, sizeof(*signature))) {
+            PLOG(FATAL) << "protocol fault: failed to read signature response";
+        }
+
+        if (signature->id != ID_SIGNATURE) {
+            LOG(FATAL) << "protocol fault: signature response has wrong message id: "
+                       << signature->id;
+        }
+
+        if (signature->error != 0) {
+            errno = errno_from_wire(signature->error);
+            return false;
+        }
+
+        if (signature->block_size != sync_delta_block_size(signature->size) ||
+            signature->block_count != signature->size / signature->block_size) {
+            LOG(FATAL) << "protocol fault: bad signature for " << signature->size
+                       << " bytes: " << signature->block_count << " blocks of "
+                       << signature->block_size;
+        }
+
+        sums->resize(signature->block_count);
+        if (!ReadFdExactly(fd.get(), sums->data(), sums->size() * sizeof(sync_block_sum))) {
+            PLOG(FATAL) << "protocol fault: failed to read block checksums";
+        }
+        return true;
+    }
+
+    // Sends |lpath| as literal data and references to the blocks of the existing file that
+    // |signature| describes.
+    bool SendLargeFileDelta(const std::string& path, mode_t mode, const std::string& lpath,
+                            const std::string& rpath, unsigned mtime,
+                            const sync_signature& signature,
+                            const std::vector<sync_block_sum>& sums) {
+        unique_fd lfd(adb_open(lpath.c_str(), O_RDONLY | O_CLOEXEC));
+        if (lfd < 0) {
+            Error("opening '%s' locally failed: %s", lpath.c_str(), strerror(errno));
+            return false;
+        }
+
+        struct stat st;
+        if (fstat(lfd.get(), &st) == -1) {
+            Error("cannot stat '%s': %s", lpath.c_str(), strerror(errno));
+            return false;
+        }
+
+        const uint64_t total_size = st.st_size;
+        std::unique_ptr<android::base::MappedFile> map =
+                android::base::MappedFile::FromFd(lfd, 0, total_size, PROT_READ);
+        if (!map) {
+            Error("mapping '%s' locally failed: %s", lpath.c_str(), strerror(errno));
+            return false;
+        }
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(map->data());
+
+        // Index the existing blocks by weak checksum, keeping only the first of identical blocks
+        // (runs of zeroes in images, say). The filter rules out most positions without a lookup.
+        const uint32_t block_size = signature.block_size;
+        auto filter_index = [](uint32_t weak) { return (weak ^ (weak >> 16)) & 0xffff; };
+        std::vector<bool> filter(0x10000);
+        std::unordered_multimap<uint32_t, uint32_t> blocks;
+        for (uint32_t i = 0; i < sums.size(); ++i) {
+            auto [begin, end] = blocks.equal_range(sums[i].weak);
+            bool duplicate = std::any_of(begin, end, [&](const auto& entry) {
+                return memcmp(sums[entry.second].strong, sums[i].strong, SYNC_STRONG_SUM_SIZE) == 0;
+            });
+            if (!duplicate) {
+                blocks.emplace(sums[i].weak, i);
+                filter[filter_index(sums[i].weak)] = true;
+            }
+        }
+
+        if (!SendRequest(ID_SEND_DELTA, path)) {
+            Error("failed to send ID_SEND_DELTA message '%s': %s", path.c_str(), strerror(errno));
+            return false;
+        }
+
+        syncmsg msg;
+        msg.send_delta_setup.id = ID_SEND_DELTA;
+        msg.send_delta_setup.mode = mode;
+        msg.send_delta_setup.block_size = block_size;
+        msg.send_delta_setup.base_size = signature.size;
+        if (!WriteOrDie(lpath, rpath, &msg.send_delta_setup, sizeof(msg.send_delta_setup))) {
+            return false;
+        }
+
+        // Everything before |sent| has been sent or is covered by the pending copy.
+        uint64_t sent = 0;
+        uint32_t copy_block = 0;
+        uint32_t copy_count = 0;
+
+        auto flush_copy = [&]() {
+            if (copy_count == 0) return true;
+            msg.copy.id = ID_COPY;
+            msg.copy.count = copy_count;
+            msg.copy.block = copy_block;
+            copy_count = 0;
+            return WriteOrDie(lpath, rpath, &msg.copy, sizeof(msg.copy));
+        };
+
+        syncsendbuf sbuf;
+        sbuf.id = ID_DATA;
+        auto send_literal = [&](uint64_t end) {
+            if (sent == end) return true;
+            if (!flush_copy()) return false;
+            while (sent < end) {
+                size_t length = std::min<uint64_t>(end - sent, max);
+                sbuf.size = length;
+                memcpy(sbuf.data, data + sent, length);
+                if (!WriteOrDie(lpath, rpath, &sbuf, sizeof(SyncRequest) + length)) {
+                    return false;
+                }
+                sent += length;
+                RecordBytesTransferred(length);
+                ReportProgress(rpath, sent, total_size);
+            }
+            return true;
+        };
+
+        uint64_t pos = 0;
+        RollingChecksum checksum(data, std::min<uint64_t>(block_size, total_size));
+        while (pos + block_size <= total_size) {
+            std::optional<uint32_t> match;
+            uint32_t weak = checksum.Value();
+            if (filter[filter_index(weak)]) {
+                auto [begin, end] = blocks.equal_range(weak);
+                if (begin != end) {
+                    uint8_t strong[SYNC_STRONG_SUM_SIZE];
+                    sync_delta_strong_sum(data + pos, block_size, strong);
+                    for (auto it = begin; it != end; ++it) {
+                        if (memcmp(sums[it->second].strong, strong, sizeof(strong)) == 0) {
+                            match = it->second;
+                            break;
+                        }
+                    }
+                }
+            }
+
+            if (!match) {
+                if (pos + block_size < total_size) {
+                    checksum.Roll(data[pos], data[pos + block_size]);
+                }
+                ++pos;
+                continue;
+            }
+
+            if (!send_literal(pos)) return false;
+            if (copy_count != 0 && *match == copy_block + copy_count) {
+                ++copy_count;
+            } else {
+                if (!flush_copy()) return false;
+                copy_block = *match;
+                copy_count = 1;
+            }
+
+            pos += block_size;
+            sent = pos;
+            RecordBytesTransferred(block_size);
+            ReportProgress(rpath, sent, total_size);
+            if (pos + block_size <= total_size) {
+                checksum.Reset(data + pos, block_size);
+            }
+        }
+
+        if (!send_literal(total_size) || !flush_copy()) {
+            return false;
+        }
+
+        msg.data.id = ID_DONE;
+        msg.data.size = mtime;
+        RecordFileSent(lpath, rpath);
+        return WriteOrDie(lpath, rpath, &msg.data, sizeof(msg.data));
+    }
+
     bool ReportCopyFailure(const std::string& from, const std::string& to, const syncmsg& msg) {
         std::vector<char> buf(msg.status.msglen + 1);
         if (!ReadFdExactly(fd, &buf[0], msg.status.msglen)) {
@@ -776,7 +1135,8 @@ class SyncConnection {
         android::base::StringAppendV(&s, fmt, ap);
         va_end(ap);
 
-        line_printer_.Print(s, LinePrinter::INFO);
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        progress_->line_printer.Print(s, LinePrinter::INFO);
     }
 
     void Println(const char* fmt, ...) __attribute__((__format__(__printf__, 2, 3))) {
@@ -787,8 +1147,9 @@ class SyncConnection {
         android::base::StringAppendV(&s, fmt, ap);
         va_end(ap);
 
-        line_printer_.Print(s, LinePrinter::INFO);
-        line_printer_.KeepInfoLine();
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        progress_->line_printer.Print(s, LinePrinter::INFO);
+        progress_->line_printer.KeepInfoLine();
     }
 
     void Error(const char* fmt, ...) __attribute__((__format__(__printf__, 2, 3))) {
@@ -799,7 +1160,8 @@ class SyncConnection {
         android::base::StringAppendV(&s, fmt, ap);
         va_end(ap);
 
-        line_printer_.Print(s, LinePrinter::ERROR);
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        progress_->line_printer.Print(s, LinePrinter::ERROR);
     }
 
     void Warning(const char* fmt, ...) __attribute__((__format__(__printf__, 2, 3))) {
@@ -810,22 +1172,25 @@ class SyncConnection {
         android::base::StringAppendV(&s, fmt, ap);
         va_end(ap);
 
-        line_printer_.Print(s, LinePrinter::WARNING);
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        progress_->line_printer.Print(s, LinePrinter::WARNING);
     }
 
     void ComputeExpectedTotalBytes(const std::vector<copyinfo>& file_list) {
-        current_ledger_.bytes_expected = 0;
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        progress_->current_ledger.bytes_expected = 0;
         for (const copyinfo& ci : file_list) {
             // Unfortunately, this doesn't work for symbolic links, because we'll copy the
             // target of the link rather than just creating a link. (But ci.size is the link size.)
-            if (!ci.skip) current_ledger_.bytes_expected += ci.size;
+            if (!ci.skip) progress_->current_ledger.bytes_expected += ci.size;
         }
-        current_ledger_.expect_multiple_files = true;
+        progress_->current_ledger.expect_multiple_files = true;
     }
 
     void SetExpectedTotalBytes(uint64_t expected_total_bytes) {
-        current_ledger_.bytes_expected = expected_total_bytes;
-        current_ledger_.expect_multiple_files = false;
+        std::lock_guard<std::mutex> lock(progress_->mutex);
+        progress_->current_ledger.bytes_expected = expected_total_bytes;
+        progress_->current_ledger.expect_multiple_files = false;
     }
 
     // TODO: add a char[max] buffer here, to replace syncsendbuf...
@@ -840,10 +1205,16 @@ class SyncConnection {
     bool have_ls_v2_;
     bool have_sendrecv_v2_;
     bool have_sendrecv_v2_brotli_;
+    bool have_sendrecv_v2_lz4_;
+    bool have_sendrecv_v2_zstd_;
+    bool have_send_delta_;
 
-    TransferLedger global_ledger_;
-    TransferLedger current_ledger_;
-    LinePrinter line_printer_;
+    std::shared_ptr<TransferProgress> progress_;
+
+    CompressionSelector& Selector(TransferDirection direction) {
+        return direction == TransferDirection::push ? progress_->push_compression
+                                                    : progress_->pull_compression;
+    }
 
     bool SendQuit() {
         return SendRequest(ID_QUIT, ""); // TODO: add a SendResponse?
@@ -921,7 +1292,8 @@ static bool sync_stat_fallback(SyncConnection& sc, const std::string& path, stru
 }
 
 static bool sync_send(SyncConnection& sc, const std::string& lpath, const std::string& rpath,
-                      unsigned mtime, mode_t mode, bool sync, bool compressed) {
+                      unsigned mtime, mode_t mode, bool sync, bool delta,
+                      CompressionType compression) {
     if (sync) {
         struct stat st;
         if (sync_lstat(sc, rpath, &st)) {
@@ -964,9 +1336,28 @@ static bool sync_send(SyncConnection& sc, const std::string& lpath, const std::s
             return false;
         }
     } else {
-        if (!sc.SendLargeFile(rpath, mode, lpath, rpath, mtime, compressed)) {
+        if (delta && sc.HaveSendDelta() && static_cast<uint64_t>(st.st_size) >= kSyncDeltaMinSize) {
+            // The signature comes back on the same stream as the acknowledgements.
+            if (!sc.ReadAcknowledgements(true)) {
+                return false;
+            }
+
+            sync_signature signature;
+            std::vector<sync_block_sum> sums;
+            if (sc.FetchSignature(rpath, &signature, &sums) && !sums.empty()) {
+                if (!sc.SendLargeFileDelta(rpath, mode, lpath, rpath, mtime, signature, sums)) {
+                    return false;
+                }
+                return sc.ReadAcknowledgements();
+            }
+        }
+
+        CompressionType used = sc.ResolveCompression(compression, TransferDirection::push);
+        auto start = std::chrono::steady_clock::now();
+        if (!sc.SendLargeFile(rpath, mode, lpath, rpath, mtime, used)) {
             return false;
         }
+        sc.RecordCompression(compression, used, TransferDirection::push, st.st_size, start);
     }
     return sc.ReadAcknowledgements();
 }
@@ -1027,8 +1418,8 @@ static bool sync_recv_v1(SyncConnection& sc, const char* rpath, const char* lpat
 }
 
 static bool sync_recv_v2(SyncConnection& sc, const char* rpath, const char* lpath, const char* name,
-                         uint64_t expected_size) {
-    if (!sc.SendRecv2(rpath)) return false;
+                         uint64_t expected_size, CompressionType compression) {
+    if (!sc.SendRecv2(rpath, compression)) return false;
 
     adb_unlink(lpath);
     unique_fd lfd(adb_creat(lpath, 0644));
@@ -1040,7 +1431,8 @@ static bool sync_recv_v2(SyncConnection& sc, const char* rpath, const char* lpat
     uint64_t bytes_copied = 0;
 
     Block buffer(SYNC_DATA_MAX);
-    BrotliDecoder decoder(std::span(buffer.data(), buffer.size()));
+    std::unique_ptr<Decoder> decoder =
+            create_decoder(compression, std::span(buffer.data(), buffer.size()));
     bool reading = true;
     while (reading) {
         syncmsg msg;
@@ -1072,13 +1464,13 @@ static bool sync_recv_v2(SyncConnection& sc, const char* rpath, const char* lpat
             adb_unlink(lpath);
             return false;
         }
-        decoder.Append(std::move(block));
+        decoder->Append(std::move(block));
 
         while (true) {
             std::span<char> output;
-            BrotliDecodeResult result = decoder.Decode(&output);
+            DecodeResult result = decoder->Decode(&output);
 
-            if (result == BrotliDecodeResult::Error) {
+            if (result == DecodeResult::Error) {
                 sc.Error("decompress failed");
                 adb_unlink(lpath);
                 return false;
@@ -1097,15 +1489,15 @@ static bool sync_recv_v2(SyncConnection& sc, const char* rpath, const char* lpat
             sc.RecordBytesTransferred(msg.data.size);
             sc.ReportProgress(name != nullptr ? name : rpath, bytes_copied, expected_size);
 
-            if (result == BrotliDecodeResult::NeedInput) {
+            if (result == DecodeResult::NeedInput) {
                 break;
-            } else if (result == BrotliDecodeResult::MoreOutput) {
+            } else if (result == DecodeResult::MoreOutput) {
                 continue;
-            } else if (result == BrotliDecodeResult::Done) {
+            } else if (result == DecodeResult::Done) {
                 reading = false;
                 break;
             } else {
-                LOG(FATAL) << "invalid BrotliDecodeResult: " << static_cast<int>(result);
+                LOG(FATAL) << "invalid DecodeResult: " << static_cast<int>(result);
             }
         }
     }
@@ -1126,12 +1518,19 @@ static bool sync_recv_v2(SyncConnection& sc, const char* rpath, const char* lpat
 }
 
 static bool sync_recv(SyncConnection& sc, const char* rpath, const char* lpath, const char* name,
-                      uint64_t expected_size, bool compressed) {
-    if (sc.HaveSendRecv2() && compressed) {
-        return sync_recv_v2(sc, rpath, lpath, name, expected_size);
+                      uint64_t expected_size, CompressionType compression) {
+    CompressionType used = sc.ResolveCompression(compression, TransferDirection::pull);
+    auto start = std::chrono::steady_clock::now();
+    bool result;
+    if (used != CompressionType::None) {
+        result = sync_recv_v2(sc, rpath, lpath, name, expected_size, used);
     } else {
-        return sync_recv_v1(sc, rpath, lpath, name, expected_size);
+        result = sync_recv_v1(sc, rpath, lpath, name, expected_size);
+    }
+    if (result) {
+        sc.RecordCompression(compression, used, TransferDirection::pull, expected_size, start);
     }
+    return result;
 }
 
 bool do_sync_ls(const char* path) {
@@ -1209,8 +1608,58 @@ static bool is_root_dir(std::string_view path) {
     return true;
 }
 
+// Spreads |file_list| across up to |jobs| sync connections and runs |transfer| on each share in
+// a thread of its own, |sc| taking the first share on the calling thread. Files are dealt out
+// largest first to whichever connection has the least queued, counting a fixed overhead per file
+// so that a directory of many small files gets split as well as one of a few large ones.
+static bool sync_parallel(
+        SyncConnection& sc, const std::vector<const copyinfo*>& file_list, size_t jobs,
+        const std::function<bool(SyncConnection&, const std::vector<const copyinfo*>&)>& transfer) {
+    static constexpr uint64_t kPerFileCost = 128 * 1024;
+
+    std::vector<std::unique_ptr<SyncConnection>> forks;
+    jobs = std::min(jobs, file_list.size());
+    while (forks.size() + 1 < jobs) {
+        auto fork = std::make_unique<SyncConnection>(&sc);
+        if (!fork->IsValid()) {
+            // Carry on with the connections we did get.
+            break;
+        }
+        forks.push_back(std::move(fork));
+    }
+    if (forks.empty()) {
+        return transfer(sc, file_list);
+    }
+
+    std::vector<const copyinfo*> sorted = file_list;
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [](const copyinfo* a, const copyinfo* b) { return a->size > b->size; });
+
+    std::vector<std::vector<const copyinfo*>> shares(forks.size() + 1);
+    std::vector<uint64_t> loads(shares.size());
+    for (const copyinfo* ci : sorted) {
+        size_t least = std::min_element(loads.begin(), loads.end()) - loads.begin();
+        shares[least].push_back(ci);
+        loads[least] += ci->size + kPerFileCost;
+    }
+
+    std::vector<std::thread> threads;
+    std::vector<char> results(forks.size());
+    for (size_t i = 0; i < forks.size(); ++i) {
+        threads.emplace_back([&, i]() { results[i] = transfer(*forks[i], shares[i + 1]); });
+    }
+    bool success = transfer(sc, shares[0]);
+    for (size_t i = 0; i < threads.size(); ++i) {
+        threads[i].join();
+        success &= results[i] != 0;
+    }
+    return success;
+}
+
 static bool copy_local_dir_remote(SyncConnection& sc, std::string lpath, std::string rpath,
-                                  bool check_timestamps, bool list_only, bool compressed) {
+                                  bool check_timestamps, bool list_only,
+                                  CompressionType compression,
+                                  size_t jobs) {
     sc.NewTransfer();
 
     // Make sure that both directory paths end in a slash.
@@ -1287,28 +1736,40 @@ static bool copy_local_dir_remote(SyncConnection& sc, std::string lpath, std::st
 
     sc.ComputeExpectedTotalBytes(file_list);
 
+    std::vector<const copyinfo*> transfers;
     for (const copyinfo& ci : file_list) {
         if (!ci.skip) {
             if (list_only) {
                 sc.Println("would push: %s -> %s", ci.lpath.c_str(), ci.rpath.c_str());
             } else {
-                if (!sync_send(sc, ci.lpath, ci.rpath, ci.time, ci.mode, false, compressed)) {
-                    return false;
-                }
+                transfers.push_back(&ci);
             }
         } else {
             skipped++;
         }
     }
 
+    auto push = [check_timestamps, compression](SyncConnection& conn,
+                                                 const std::vector<const copyinfo*>& share) {
+        for (const copyinfo* ci : share) {
+            if (!sync_send(conn, ci->lpath, ci->rpath, ci->time, ci->mode, false, check_timestamps,
+                           compression)) {
+                return false;
+            }
+        }
+        return conn.ReadAcknowledgements(true);
+    };
+    if (!sync_parallel(sc, transfers, jobs, push)) {
+        return false;
+    }
+
     sc.RecordFilesSkipped(skipped);
-    bool success = sc.ReadAcknowledgements(true);
     sc.ReportTransferRate(lpath, TransferDirection::push);
-    return success;
+    return true;
 }
 
 bool do_sync_push(const std::vector<const char*>& srcs, const char* dst, bool sync,
-                  bool compressed) {
+                  CompressionType compression, size_t jobs) {
     SyncConnection sc;
     if (!sc.IsValid()) return false;
 
@@ -1373,7 +1834,8 @@ bool do_sync_push(const std::vector<const char*>& srcs, const char* dst, bool sy
                 dst_dir.append(android::base::Basename(src_path));
             }
 
-            success &= copy_local_dir_remote(sc, src_path, dst_dir, sync, false, compressed);
+            success &= copy_local_dir_remote(sc, src_path, dst_dir, sync, false, compression,
+                                             jobs);
             continue;
         } else if (!should_push_file(st.st_mode)) {
             sc.Warning("skipping special file '%s' (mode = 0o%o)", src_path, st.st_mode);
@@ -1394,7 +1856,8 @@ bool do_sync_push(const std::vector<const char*>& srcs, const char* dst, bool sy
 
         sc.NewTransfer();
         sc.SetExpectedTotalBytes(st.st_size);
-        success &= sync_send(sc, src_path, dst_path, st.st_mtime, st.st_mode, sync, compressed);
+        success &= sync_send(sc, src_path, dst_path, st.st_mtime, st.st_mode, sync, sync,
+                             compression);
         sc.ReportTransferRate(src_path, TransferDirection::push);
     }
 
@@ -1480,7 +1943,7 @@ static int set_time_and_mode(const std::string& lpath, time_t time,
 }
 
 static bool copy_remote_dir_local(SyncConnection& sc, std::string rpath, std::string lpath,
-                                  bool copy_attrs, bool compressed) {
+                                  bool copy_attrs, CompressionType compression, size_t jobs) {
     sc.NewTransfer();
 
     // Make sure that both directory paths end in a slash.
@@ -1496,7 +1959,9 @@ static bool copy_remote_dir_local(SyncConnection& sc, std::string rpath, std::st
 
     sc.ComputeExpectedTotalBytes(file_list);
 
+    // Directories are all created up front, so that files can be pulled in any order.
     int skipped = 0;
+    std::vector<const copyinfo*> transfers;
     for (const copyinfo &ci : file_list) {
         if (!ci.skip) {
             if (S_ISDIR(ci.mode)) {
@@ -1509,17 +1974,28 @@ static bool copy_remote_dir_local(SyncConnection& sc, std::string rpath, std::st
                 }
                 continue;
             }
+            transfers.push_back(&ci);
+        } else {
+            skipped++;
+        }
+    }
 
-            if (!sync_recv(sc, ci.rpath.c_str(), ci.lpath.c_str(), nullptr, ci.size, compressed)) {
+    auto pull = [copy_attrs, compression](SyncConnection& conn,
+                                          const std::vector<const copyinfo*>& share) {
+        for (const copyinfo* ci : share) {
+            if (!sync_recv(conn, ci->rpath.c_str(), ci->lpath.c_str(), nullptr, ci->size,
+                           compression)) {
                 return false;
             }
 
-            if (copy_attrs && set_time_and_mode(ci.lpath, ci.time, ci.mode)) {
+            if (copy_attrs && set_time_and_mode(ci->lpath, ci->time, ci->mode)) {
                 return false;
             }
-        } else {
-            skipped++;
         }
+        return true;
+    };
+    if (!sync_parallel(sc, transfers, jobs, pull)) {
+        return false;
     }
 
     sc.RecordFilesSkipped(skipped);
@@ -1528,7 +2004,7 @@ static bool copy_remote_dir_local(SyncConnection& sc, std::string rpath, std::st
 }
 
 bool do_sync_pull(const std::vector<const char*>& srcs, const char* dst, bool copy_attrs,
-                  bool compressed, const char* name) {
+                  CompressionType compression, const char* name, size_t jobs) {
     SyncConnection sc;
     if (!sc.IsValid()) return false;
 
@@ -1602,7 +2078,8 @@ bool do_sync_pull(const std::vector<const char*>& srcs, const char* dst, bool co
                 dst_dir.append(android::base::Basename(src_path));
             }
 
-            success &= copy_remote_dir_local(sc, src_path, dst_dir, copy_attrs, compressed);
+            success &= copy_remote_dir_local(sc, src_path, dst_dir, copy_attrs, compression,
+                                             jobs);
             continue;
         } else if (!should_pull_file(src_st.st_mode)) {
             sc.Warning("skipping special file '%s' (mode = 0o%o)", src_path, src_st.st_mode);
@@ -1621,7 +2098,7 @@ bool do_sync_pull(const std::vector<const char*>& srcs, const char* dst, bool co
 
         sc.NewTransfer();
         sc.SetExpectedTotalBytes(src_st.st_size);
-        if (!sync_recv(sc, src_path, dst_path, name, src_st.st_size, compressed)) {
+        if (!sync_recv(sc, src_path, dst_path, name, src_st.st_size, compression)) {
             success = false;
             continue;
         }
@@ -1638,11 +2115,11 @@ bool do_sync_pull(const std::vector<const char*>& srcs, const char* dst, bool co
 }
 
 bool do_sync_sync(const std::string& lpath, const std::string& rpath, bool list_only,
-                  bool compressed) {
+                  CompressionType compression) {
     SyncConnection sc;
     if (!sc.IsValid()) return false;
 
-    bool success = copy_local_dir_remote(sc, lpath, rpath, true, list_only, compressed);
+    bool success = copy_local_dir_remote(sc, lpath, rpath, true, list_only, compression, 1);
     if (!list_only) {
         sc.ReportOverallTransferRate(TransferDirection::push);
     }
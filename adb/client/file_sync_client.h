@@ -19,11 +19,21 @@
 #include <string>
 #include <vector>
 
+enum class CompressionType {
+    None,
+    // Whichever the device supports that has moved data fastest so far.
+    Any,
+    Brotli,
+    LZ4,
+    Zstd,
+};
+
 bool do_sync_ls(const char* path);
+// |jobs| is the number of sync connections directories get transferred over in parallel.
 bool do_sync_push(const std::vector<const char*>& srcs, const char* dst, bool sync,
-                  bool compressed);
+                  CompressionType compression, size_t jobs = 1);
 bool do_sync_pull(const std::vector<const char*>& srcs, const char* dst, bool copy_attrs,
-                  bool compressed, const char* name = nullptr);
+                  CompressionType compression, const char* name = nullptr, size_t jobs = 1);
 
 bool do_sync_sync(const std::string& lpath, const std::string& rpath, bool list_only,
-                  bool compressed);
+                  CompressionType compression);
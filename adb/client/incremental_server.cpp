@@ -27,13 +27,19 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <array>
+#include <condition_variable>
 #include <deque>
 #include <fstream>
+#include <mutex>
 #include <thread>
 #include <type_traits>
+#include <unordered_map>
 #include <unordered_set>
 
+#include <android-base/thread_annotations.h>
+
 #include "adb.h"
 #include "adb_io.h"
 #include "adb_trace.h"
@@ -154,7 +160,11 @@ class File {
         : File(filepath, id, size, tree_offset) {
         this->fd_ = std::move(fd);
         this->tree_fd_ = std::move(tree_fd);
-        priority_blocks_ = PriorityBlocksForFile(filepath, fd_.get(), size);
+        access_profile_ = LoadAccessProfile(filepath, size);
+        priority_blocks_ = PriorityBlocksForFile(filepath, fd_.get(), size, access_profile_);
+        for (size_t i = 0; i < priority_blocks_.size(); ++i) {
+            priority_positions_.emplace(priority_blocks_[i], i);
+        }
     }
     int64_t ReadDataBlock(BlockIdx block_idx, void* buf, bool* is_zip_compressed) const {
         int64_t bytes_read = -1;
@@ -171,8 +181,34 @@ class File {
 
     const std::vector<BlockIdx>& PriorityBlocks() const { return priority_blocks_; }
 
+    // Where |block_idx| is in PriorityBlocks(), or -1.
+    int32_t PriorityPosition(BlockIdx block_idx) const {
+        auto it = priority_positions_.find(block_idx);
+        return it == priority_positions_.end() ? -1 : it->second;
+    }
+
+    // Records the misses of this session after those of earlier ones, for the next install to
+    // prefetch in that order.
+    void SaveAccessProfile() const {
+        if (misses.empty()) {
+            return;
+        }
+        std::vector<BlockIdx> profile = access_profile_;
+        std::unordered_set<BlockIdx> known(profile.begin(), profile.end());
+        for (BlockIdx block_idx : misses) {
+            if (known.insert(block_idx).second) {
+                profile.push_back(block_idx);
+            }
+        }
+        incremental::SaveAccessProfile(filepath, profile);
+    }
+
     std::vector<bool> sentBlocks;
     NumBlocks sentBlocksCount = 0;
+    // Blocks handed to the BlockPool that haven't come back yet.
+    std::vector<bool> queuedBlocks;
+    // Blocks the device reported missing, in order.
+    std::vector<BlockIdx> misses;
 
     std::vector<bool> sentTreeBlocks;
 
@@ -184,19 +220,160 @@ class File {
     File(const char* filepath, FileId id, int64_t size, int64_t tree_offset)
         : filepath(filepath), id(id), size(size), tree_offset_(tree_offset) {
         sentBlocks.resize(numBytesToNumBlocks(size));
+        queuedBlocks.resize(sentBlocks.size());
         sentTreeBlocks.resize(verity_tree_blocks_for_file(size));
     }
     unique_fd fd_;
+    std::vector<BlockIdx> access_profile_;
     std::vector<BlockIdx> priority_blocks_;
+    std::unordered_map<BlockIdx, int32_t> priority_positions_;
 
     unique_fd tree_fd_;
     const int64_t tree_offset_;
 };
 
+// A data block read from its file, and compressed if that was worth it, ready to be sent.
+struct PreparedBlock {
+    FileId fileId;
+    BlockIdx blockIdx;
+    // Size of the data in |buffer|, or -1 if reading failed.
+    int64_t size;
+    bool compressed;
+    BlockBuffer<kCompressBound> buffer;
+};
+
+static void PrepareDataBlock(const File& file, BlockIdx blockIdx, PreparedBlock* block) {
+    block->fileId = file.id;
+    block->blockIdx = blockIdx;
+    block->compressed = false;
+
+    BlockBuffer raw;
+    bool isZipCompressed = false;
+    block->size = file.ReadDataBlock(blockIdx, raw.data, &isZipCompressed);
+    if (block->size < 0) {
+        return;
+    }
+
+    int16_t compressedSize = 0;
+    if (!isZipCompressed) {
+        compressedSize =
+                LZ4_compress_default(raw.data, block->buffer.data, block->size, kCompressBound);
+    }
+    if (compressedSize > 0 && compressedSize < kCompressedSizeMax) {
+        block->compressed = true;
+        block->size = compressedSize;
+    } else {
+        memcpy(block->buffer.data, raw.data, block->size);
+    }
+}
+
+// Reads and compresses data blocks on worker threads, so that the serving thread only has to send
+// them. Submit, Take and Outstanding may only be called from the serving thread.
+class BlockPool {
+  public:
+    explicit BlockPool(const std::vector<File>& files) : files_(files) {
+        const size_t threads =
+                std::clamp<size_t>(std::thread::hardware_concurrency(), 2, kMaxThreads + 1) - 1;
+        for (size_t i = 0; i < threads; ++i) {
+            threads_.emplace_back([this]() { Run(); });
+        }
+    }
+
+    ~BlockPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        jobs_cv_.notify_all();
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+    }
+
+    // |urgent| blocks get prepared ahead of everything already submitted.
+    void Submit(FileId fileId, BlockIdx blockIdx, bool urgent) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (urgent) {
+                jobs_.emplace_front(fileId, blockIdx);
+            } else {
+                jobs_.emplace_back(fileId, blockIdx);
+            }
+        }
+        ++outstanding_;
+        jobs_cv_.notify_one();
+    }
+
+    // Waits for the next prepared block. Only valid while Outstanding() > 0.
+    std::unique_ptr<PreparedBlock> Take() {
+        CHECK_GT(outstanding_, 0U);
+        std::unique_lock<std::mutex> lock(mutex_);
+        results_cv_.wait(lock, [this]() REQUIRES(mutex_) { return !results_.empty(); });
+        auto block = std::move(results_.front());
+        results_.pop_front();
+        --outstanding_;
+        return block;
+    }
+
+    // Hands a block back for reuse once it's been sent.
+    void Release(std::unique_ptr<PreparedBlock> block) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_.push_back(std::move(block));
+    }
+
+    size_t Outstanding() const { return outstanding_; }
+
+  private:
+    static constexpr size_t kMaxThreads = 8;
+
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            jobs_cv_.wait(lock, [this]() REQUIRES(mutex_) { return stopping_ || !jobs_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            auto [fileId, blockIdx] = jobs_.front();
+            jobs_.pop_front();
+            std::unique_ptr<PreparedBlock> block;
+            if (free_.empty()) {
+                block = std::make_unique<PreparedBlock>();
+            } else {
+                block = std::move(free_.back());
+                free_.pop_back();
+            }
+
+            lock.unlock();
+            PrepareDataBlock(files_[fileId], blockIdx, block.get());
+            lock.lock();
+
+            results_.push_back(std::move(block));
+            results_cv_.notify_one();
+        }
+    }
+
+    const std::vector<File>& files_;
+
+    std::mutex mutex_;
+    std::condition_variable jobs_cv_;
+    std::condition_variable results_cv_;
+    std::deque<std::pair<FileId, BlockIdx>> jobs_ GUARDED_BY(mutex_);
+    std::deque<std::unique_ptr<PreparedBlock>> results_ GUARDED_BY(mutex_);
+    std::vector<std::unique_ptr<PreparedBlock>> free_ GUARDED_BY(mutex_);
+    bool stopping_ GUARDED_BY(mutex_) = false;
+
+    // Submitted blocks that haven't been taken yet.
+    size_t outstanding_ = 0;
+    std::vector<std::thread> threads_;
+};
+
 class IncrementalServer {
   public:
     IncrementalServer(unique_fd adb_fd, unique_fd output_fd, std::vector<File> files)
-        : adb_fd_(std::move(adb_fd)), output_fd_(std::move(output_fd)), files_(std::move(files)) {
+        : adb_fd_(std::move(adb_fd)),
+          output_fd_(std::move(output_fd)),
+          files_(std::move(files)),
+          pool_(files_) {
         buffer_.reserve(kReadBufferSize);
         pendingBlocksBuffer_.resize(kChunkFlushSize + 2 * kBlockSize);
         pendingBlocks_ = pendingBlocksBuffer_.data() + sizeof(ChunkHeader);
@@ -205,27 +382,35 @@ class IncrementalServer {
     bool Serve();
 
   private:
+    // Walks a range of a file's priority blocks, then a range of the file itself.
     struct PrefetchState {
         const File* file;
         BlockIdx overallIndex = 0;
         BlockIdx overallEnd = 0;
         BlockIdx priorityIndex = 0;
+        BlockIdx priorityEnd = 0;
 
+        // |count| blocks from |start|, but nothing from the priority blocks.
         explicit PrefetchState(const File& f, BlockIdx start, int count)
             : file(&f),
               overallIndex(start),
               overallEnd(std::min<BlockIdx>(start + count, f.sentBlocks.size())) {}
 
+        // The whole file, priority blocks first.
         explicit PrefetchState(const File& f)
-            : PrefetchState(f, 0, (BlockIdx)f.sentBlocks.size()) {}
+            : PrefetchState(f, 0, (BlockIdx)f.sentBlocks.size()) {
+            priorityEnd = f.PriorityBlocks().size();
+        }
 
-        bool done() const {
-            const bool overallSent = (overallIndex >= overallEnd);
-            if (file->PriorityBlocks().empty()) {
-                return overallSent;
-            }
-            return overallSent && (priorityIndex >= (BlockIdx)file->PriorityBlocks().size());
+        // |count| of the priority blocks from position |start|.
+        static PrefetchState PriorityRange(const File& f, BlockIdx start, int count) {
+            PrefetchState state(f, 0, 0);
+            state.priorityIndex = start;
+            state.priorityEnd = std::min<BlockIdx>(start + count, f.PriorityBlocks().size());
+            return state;
         }
+
+        bool done() const { return overallIndex >= overallEnd && priorityIndex >= priorityEnd; }
     };
 
     bool SkipToRequest(void* buffer, size_t* size, bool blocking);
@@ -235,12 +420,16 @@ class IncrementalServer {
 
     enum class SendResult { Sent, Skipped, Error };
     SendResult SendDataBlock(FileId fileId, BlockIdx blockIdx, bool flush = false);
+    SendResult SendPreparedBlock(PreparedBlock* block, bool flush);
 
     bool SendTreeBlock(FileId fileId, int32_t fileBlockIdx, BlockIdx blockIdx);
     bool SendTreeBlocksForDataBlock(FileId fileId, BlockIdx blockIdx);
 
     bool SendDone();
+    int QueueBlocks(PrefetchState* prefetch, int maxBlocks, bool urgent);
+    void QueuePrefetches();
     void RunPrefetching();
+    void SaveAccessProfiles();
 
     void Send(const void* data, size_t size, bool flush);
     void Flush();
@@ -250,11 +439,15 @@ class IncrementalServer {
     unique_fd const adb_fd_;
     unique_fd const output_fd_;
     std::vector<File> files_;
+    BlockPool pool_;
 
     // Incoming data buffer.
     std::vector<char> buffer_;
 
+    // Whole files being prefetched, which take turns.
     std::deque<PrefetchState> prefetches_;
+    // Blocks that misses suggest the device is about to read, which go ahead of the files.
+    std::deque<PrefetchState> missPrefetches_;
     int compressed_ = 0, uncompressed_ = 0;
     long long sentSize_ = 0;
 
@@ -265,6 +458,7 @@ class IncrementalServer {
 
     // True when client notifies that all the data has been received
     bool servingComplete_ = false;
+    bool profilesSaved_ = false;
 };
 
 bool IncrementalServer::SkipToRequest(void* buffer, size_t* size, bool blocking) {
@@ -413,46 +607,44 @@ auto IncrementalServer::SendDataBlock(FileId fileId, BlockIdx blockIdx, bool flu
         return SendResult::Skipped;
     }
 
-    if (!SendTreeBlocksForDataBlock(fileId, blockIdx)) {
+    PreparedBlock block;
+    PrepareDataBlock(file, blockIdx, &block);
+    return SendPreparedBlock(&block, flush);
+}
+
+auto IncrementalServer::SendPreparedBlock(PreparedBlock* block, bool flush) -> SendResult {
+    auto& file = files_[block->fileId];
+    const BlockIdx blockIdx = block->blockIdx;
+    if (file.sentBlocks[blockIdx]) {
+        // A miss got it sent while it was being prepared.
+        return SendResult::Skipped;
+    }
+    if (block->size < 0) {
+        fprintf(stderr, "Failed to get data for %s at blockIdx=%d.\n", file.filepath, blockIdx);
         return SendResult::Error;
     }
 
-    BlockBuffer raw;
-    bool isZipCompressed = false;
-    const int64_t bytesRead = file.ReadDataBlock(blockIdx, raw.data, &isZipCompressed);
-    if (bytesRead < 0) {
-        fprintf(stderr, "Failed to get data for %s at blockIdx=%d (%d).\n", file.filepath, blockIdx,
-                errno);
+    if (!SendTreeBlocksForDataBlock(block->fileId, blockIdx)) {
         return SendResult::Error;
     }
 
-    BlockBuffer<kCompressBound> compressed;
-    int16_t compressedSize = 0;
-    if (!isZipCompressed) {
-        compressedSize = LZ4_compress_default(raw.data, compressed.data, bytesRead, kCompressBound);
-    }
-    int16_t blockSize;
-    ResponseHeader* header;
-    if (compressedSize > 0 && compressedSize < kCompressedSizeMax) {
+    ResponseHeader* header = &block->buffer.header;
+    if (block->compressed) {
         ++compressed_;
-        blockSize = compressedSize;
-        header = &compressed.header;
         header->compression_type = kCompressionLZ4;
     } else {
         ++uncompressed_;
-        blockSize = bytesRead;
-        header = &raw.header;
         header->compression_type = kCompressionNone;
     }
 
     header->block_type = kTypeData;
-    header->file_id = toBigEndian(fileId);
-    header->block_size = toBigEndian(blockSize);
+    header->file_id = toBigEndian(block->fileId);
+    header->block_size = toBigEndian(int16_t(block->size));
     header->block_idx = toBigEndian(blockIdx);
 
     file.sentBlocks[blockIdx] = true;
     file.sentBlocksCount += 1;
-    Send(header, ResponseHeader::responseSizeFor(blockSize), flush);
+    Send(header, ResponseHeader::responseSizeFor(block->size), flush);
 
     return SendResult::Sent;
 }
@@ -468,35 +660,82 @@ bool IncrementalServer::SendDone() {
     return true;
 }
 
+// Submits up to |maxBlocks| of the blocks |prefetch| hasn't sent or submitted yet to the pool.
+int IncrementalServer::QueueBlocks(PrefetchState* prefetch, int maxBlocks, bool urgent) {
+    auto& file = files_[prefetch->file->id];
+    int queued = 0;
+    auto queue = [&](BlockIdx blockIdx) {
+        if (file.sentBlocks[blockIdx] || file.queuedBlocks[blockIdx]) {
+            return;
+        }
+        file.queuedBlocks[blockIdx] = true;
+        pool_.Submit(file.id, blockIdx, urgent);
+        ++queued;
+    };
+
+    const auto& priority_blocks = file.PriorityBlocks();
+    for (auto& i = prefetch->priorityIndex; queued < maxBlocks && i < prefetch->priorityEnd; ++i) {
+        queue(priority_blocks[i]);
+    }
+    for (auto& i = prefetch->overallIndex; queued < maxBlocks && i < prefetch->overallEnd; ++i) {
+        queue(i);
+    }
+    return queued;
+}
+
+// Keeps enough blocks in the pool for it to stay busy. The files being prefetched take turns a
+// slice at a time, so that every file of a multi-file install makes progress.
+void IncrementalServer::QueuePrefetches() {
+    constexpr int kMaxBlocksInFlight = 256;
+    constexpr int kBlocksPerSlice = 32;
+
+    while (pool_.Outstanding() < kMaxBlocksInFlight) {
+        const bool urgent = !missPrefetches_.empty();
+        auto& queue = urgent ? missPrefetches_ : prefetches_;
+        if (queue.empty()) {
+            return;
+        }
+
+        const int room = kMaxBlocksInFlight - pool_.Outstanding();
+        auto prefetch = queue.front();
+        queue.pop_front();
+        QueueBlocks(&prefetch, urgent ? room : std::min(room, kBlocksPerSlice), urgent);
+        if (prefetch.done()) {
+            continue;
+        }
+        if (urgent) {
+            queue.push_front(prefetch);
+        } else {
+            queue.push_back(prefetch);
+        }
+    }
+}
+
 void IncrementalServer::RunPrefetching() {
     constexpr auto kPrefetchBlocksPerIteration = 128;
 
+    QueuePrefetches();
     int blocksToSend = kPrefetchBlocksPerIteration;
-    while (!prefetches_.empty() && blocksToSend > 0) {
-        auto& prefetch = prefetches_.front();
-        const auto& file = *prefetch.file;
-        const auto& priority_blocks = file.PriorityBlocks();
-        if (!priority_blocks.empty()) {
-            for (auto& i = prefetch.priorityIndex;
-                 blocksToSend > 0 && i < (BlockIdx)priority_blocks.size(); ++i) {
-                if (auto res = SendDataBlock(file.id, priority_blocks[i]);
-                    res == SendResult::Sent) {
-                    --blocksToSend;
-                } else if (res == SendResult::Error) {
-                    fprintf(stderr, "Failed to send priority block %" PRId32 "\n", i);
-                }
-            }
-        }
-        for (auto& i = prefetch.overallIndex; blocksToSend > 0 && i < prefetch.overallEnd; ++i) {
-            if (auto res = SendDataBlock(file.id, i); res == SendResult::Sent) {
-                --blocksToSend;
-            } else if (res == SendResult::Error) {
-                fprintf(stderr, "Failed to send block %" PRId32 "\n", i);
-            }
-        }
-        if (prefetch.done()) {
-            prefetches_.pop_front();
+    while (blocksToSend > 0 && pool_.Outstanding() > 0) {
+        auto block = pool_.Take();
+        files_[block->fileId].queuedBlocks[block->blockIdx] = false;
+        if (auto res = SendPreparedBlock(block.get(), false); res == SendResult::Sent) {
+            --blocksToSend;
+        } else if (res == SendResult::Error) {
+            fprintf(stderr, "Failed to send block %" PRId32 "\n", block->blockIdx);
         }
+        pool_.Release(std::move(block));
+        QueuePrefetches();
+    }
+}
+
+void IncrementalServer::SaveAccessProfiles() {
+    if (profilesSaved_) {
+        return;
+    }
+    profilesSaved_ = true;
+    for (const auto& file : files_) {
+        file.SaveAccessProfile();
     }
 }
 
@@ -533,6 +772,7 @@ bool IncrementalServer::ServingComplete(std::optional<TimePoint> startTime, int
       "Total time taken: %.3fms",
       missesCount, missesSent, compressed_, uncompressed_, sentSize_ / 1024.0 / 1024.0,
       duration_cast<microseconds>(endTime - (startTime ? *startTime : endTime)).count() / 1000.0);
+    SaveAccessProfiles();
     return true;
 }
 
@@ -552,7 +792,8 @@ bool IncrementalServer::Serve() {
     std::optional<TimePoint> startTime;
 
     while (true) {
-        if (!doneSent && prefetches_.empty() &&
+        if (!doneSent && prefetches_.empty() && missPrefetches_.empty() &&
+            pool_.Outstanding() == 0 &&
             std::all_of(files_.begin(), files_.end(), [](const File& f) {
                 return f.sentBlocksCount == NumBlocks(f.sentBlocks.size());
             })) {
@@ -561,7 +802,8 @@ bool IncrementalServer::Serve() {
             doneSent = true;
         }
 
-        const bool blocking = prefetches_.empty();
+        const bool blocking =
+                prefetches_.empty() && missPrefetches_.empty() && pool_.Outstanding() == 0;
         if (blocking) {
             // We've no idea how long the blocking call is, so let's flush whatever is still unsent.
             Flush();
@@ -579,6 +821,7 @@ bool IncrementalServer::Serve() {
             switch (request->request_type) {
                 case DESTROY: {
                     // Stop everything.
+                    SaveAccessProfiles();
                     return true;
                 }
                 case SERVING_COMPLETE: {
@@ -610,6 +853,8 @@ bool IncrementalServer::Serve() {
                           int(file.PriorityBlocks().size()));
                     }
 
+                    auto& file = files_[fileId];
+                    file.misses.push_back(blockIdx);
                     if (auto res = SendDataBlock(fileId, blockIdx, true);
                         res == SendResult::Error) {
                         fprintf(stderr, "Failed to send block %" PRId32 ".\n", blockIdx);
@@ -617,7 +862,13 @@ bool IncrementalServer::Serve() {
                         ++missesSent;
                         // Make sure we send more pages from this place onward, in case if the OS is
                         // reading a bigger block.
-                        prefetches_.emplace_front(files_[fileId], blockIdx + 1, 7);
+                        missPrefetches_.emplace_front(file, blockIdx + 1, 7);
+                        // If the recorded profile has the block, the device is probably reading
+                        // along it again, further ahead than we are.
+                        if (auto pos = file.PriorityPosition(blockIdx); pos >= 0) {
+                            missPrefetches_.push_back(
+                                    PrefetchState::PriorityRange(file, pos + 1, 32));
+                        }
                     }
                     break;
                 }
@@ -19,7 +19,9 @@
 #include "incremental_utils.h"
 
 #include <android-base/endian.h>
+#include <android-base/file.h>
 #include <android-base/mapped_file.h>
+#include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <ziparchive/zip_archive.h>
 #include <ziparchive/zip_writer.h>
@@ -30,6 +32,7 @@
 
 #include "adb_io.h"
 #include "adb_trace.h"
+#include "adb_utils.h"
 #include "sysdeps.h"
 
 namespace incremental {
@@ -344,21 +347,85 @@ static std::vector<int32_t> InstallationPriorityBlocks(borrowed_fd fd, Size file
     return installationPriorityBlocks;
 }
 
-std::vector<int32_t> PriorityBlocksForFile(const std::string& filepath, borrowed_fd fd,
-                                           Size fileSize) {
-    if (!android::base::EndsWithIgnoreCase(filepath, ".apk")) {
+// Profiles live in the adb user directory, named after the file and a hash of its full path, so
+// a rebuilt APK keeps benefiting from the accesses recorded for its predecessor.
+static constexpr uint32_t kAccessProfileMagic = 0x50434e49;  // LE INCP
+static constexpr size_t kMaxAccessProfileBlocks = 256 * 1024;
+
+static std::string AccessProfilePath(const std::string& filepath) {
+    std::string path = filepath;
+#if !defined(_WIN32)
+    android::base::Realpath(filepath, &path);
+#endif
+    // FNV-1a, since it has to stay the same across adb builds.
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (char c : path) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+    }
+    return android::base::StringPrintf("%s%cincremental%c%s-%016" PRIx64 ".profile",
+                                       adb_get_android_dir_path().c_str(), OS_PATH_SEPARATOR,
+                                       OS_PATH_SEPARATOR,
+                                       android::base::Basename(filepath).c_str(), hash);
+}
+
+std::vector<int32_t> LoadAccessProfile(const std::string& filepath, Size fileSize) {
+    std::string contents;
+    if (!android::base::ReadFileToString(AccessProfilePath(filepath), &contents)) {
         return {};
     }
-    off64_t signerOffset = SignerBlockOffset(fd, fileSize);
-    if (signerOffset < 0) {
-        // No signer block? not a valid APK
+    if (contents.size() < sizeof(uint32_t) || contents.size() % sizeof(int32_t) != 0 ||
+        *reinterpret_cast<const uint32_t*>(contents.data()) != kAccessProfileMagic) {
+        D("%s: ignoring malformed access profile", filepath.c_str());
         return {};
     }
-    std::vector<int32_t> priorityBlocks = ZipPriorityBlocks(signerOffset, fileSize);
-    std::vector<int32_t> installationPriorityBlocks = InstallationPriorityBlocks(fd, fileSize);
 
-    priorityBlocks.insert(priorityBlocks.end(), installationPriorityBlocks.begin(),
-                          installationPriorityBlocks.end());
+    // The file may have changed since; blocks past its end are just dropped.
+    const int32_t numBlocks = (fileSize + kBlockSize - 1) / kBlockSize;
+    std::vector<int32_t> blocks;
+    for (size_t offset = sizeof(uint32_t); offset < contents.size(); offset += sizeof(int32_t)) {
+        int32_t block = *reinterpret_cast<const int32_t*>(contents.data() + offset);
+        if (block >= 0 && block < numBlocks) {
+            blocks.push_back(block);
+        }
+    }
+    D("%s: loaded access profile of %zu blocks", filepath.c_str(), blocks.size());
+    return blocks;
+}
+
+void SaveAccessProfile(const std::string& filepath, const std::vector<int32_t>& blocks) {
+    std::string path = AccessProfilePath(filepath);
+    if (!mkdirs(android::base::Dirname(path))) {
+        D("%s: failed to create access profile directory: %s", filepath.c_str(), strerror(errno));
+        return;
+    }
+
+    const size_t count = std::min(blocks.size(), kMaxAccessProfileBlocks);
+    std::string contents(sizeof(uint32_t) + count * sizeof(int32_t), '\0');
+    memcpy(contents.data(), &kAccessProfileMagic, sizeof(kAccessProfileMagic));
+    memcpy(contents.data() + sizeof(uint32_t), blocks.data(), count * sizeof(int32_t));
+    if (!android::base::WriteStringToFile(contents, path)) {
+        D("%s: failed to write access profile: %s", filepath.c_str(), strerror(errno));
+    }
+}
+
+std::vector<int32_t> PriorityBlocksForFile(const std::string& filepath, borrowed_fd fd,
+                                           Size fileSize,
+                                           const std::vector<int32_t>& accessProfile) {
+    std::vector<int32_t> priorityBlocks;
+    if (android::base::EndsWithIgnoreCase(filepath, ".apk")) {
+        // No signer block means it's not a valid APK, so there's nothing to prioritize.
+        if (off64_t signerOffset = SignerBlockOffset(fd, fileSize); signerOffset >= 0) {
+            priorityBlocks = ZipPriorityBlocks(signerOffset, fileSize);
+            std::vector<int32_t> installationPriorityBlocks =
+                    InstallationPriorityBlocks(fd, fileSize);
+            priorityBlocks.insert(priorityBlocks.end(), installationPriorityBlocks.begin(),
+                                  installationPriorityBlocks.end());
+        }
+    }
+
+    // Installation has to get through before anything can be launched, so what launches read in
+    // the past comes after it.
+    priorityBlocks.insert(priorityBlocks.end(), accessProfile.begin(), accessProfile.end());
     unduplicate(priorityBlocks);
     return priorityBlocks;
 }
@@ -36,8 +36,16 @@ constexpr int kDigestSize = kSha256DigestSize;
 
 constexpr std::string_view IDSIG = ".idsig";
 
+// Blocks to send ahead of the rest of the file: what installing an APK reads, followed by
+// |accessProfile|.
 std::vector<int32_t> PriorityBlocksForFile(const std::string& filepath, borrowed_fd fd,
-                                           Size fileSize);
+                                           Size fileSize,
+                                           const std::vector<int32_t>& accessProfile);
+
+// Blocks of |filepath| that the device asked for in earlier sessions, in the order it first
+// missed them. Empty if nothing was recorded.
+std::vector<int32_t> LoadAccessProfile(const std::string& filepath, Size fileSize);
+void SaveAccessProfile(const std::string& filepath, const std::vector<int32_t>& blocks);
 
 Size verity_tree_blocks_for_file(Size fileSize);
 Size verity_tree_size_for_file(Size fileSize);
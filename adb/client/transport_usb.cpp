@@ -21,6 +21,7 @@
 #include "client/usb.h"
 
 #include <memory>
+#include <vector>
 
 #include "sysdeps.h"
 #include "transport.h"
@@ -33,6 +34,19 @@
 
 #if ADB_HOST
 
+// Payloads are read in chunks of this size, so that several of them can be in flight at once.
+// It's a multiple of every bulk max packet size.
+static constexpr size_t kUsbReadChunkSize = 16384;
+
+static int UsbReadQueued(usb_handle* h, void* data, size_t len) {
+    std::vector<UsbTransfer> transfers;
+    char* p = static_cast<char*>(data);
+    for (size_t offset = 0; offset < len; offset += kUsbReadChunkSize) {
+        transfers.push_back({p + offset, std::min(kUsbReadChunkSize, len - offset)});
+    }
+    return usb_read_queued(h, transfers);
+}
+
 #if defined(__APPLE__)
 #define CHECK_PACKET_OVERFLOW 0
 #else
@@ -84,7 +98,7 @@ static int UsbReadPayload(usb_handle* h, apacket* p) {
     }
 
     p->payload.resize(len);
-    int rc = usb_read(h, &p->payload[0], p->payload.size());
+    int rc = UsbReadQueued(h, &p->payload[0], p->payload.size());
     if (rc != static_cast<int>(p->msg.data_length)) {
         return -1;
     }
@@ -93,7 +107,7 @@ static int UsbReadPayload(usb_handle* h, apacket* p) {
     return rc;
 #else
     p->payload.resize(p->msg.data_length);
-    return usb_read(h, &p->payload[0], p->payload.size());
+    return UsbReadQueued(h, &p->payload[0], p->payload.size());
 #endif
 }
 
@@ -175,6 +189,22 @@ bool UsbConnection::Write(apacket* packet) {
     return true;
 }
 
+bool UsbConnection::WriteBatch(const std::deque<std::unique_ptr<apacket>>& packets) {
+    std::vector<UsbTransfer> transfers;
+    for (const auto& packet : packets) {
+        transfers.push_back({&packet->msg, sizeof(packet->msg)});
+        if (packet->msg.data_length != 0) {
+            transfers.push_back({packet->payload.data(), packet->msg.data_length});
+        }
+    }
+
+    if (usb_write_queued(handle_, transfers) < 0) {
+        PLOG(ERROR) << "remote usb: queued write of " << packets.size() << " packets terminated";
+        return false;
+    }
+    return true;
+}
+
 bool UsbConnection::DoTlsHandshake(RSA* key, std::string* auth_key) {
     // TODO: support TLS for usb connections
     LOG(FATAL) << "Not supported yet.";
@@ -18,6 +18,8 @@
 
 #include <sys/types.h>
 
+#include <span>
+
 #include "adb.h"
 #include "transport.h"
 
@@ -33,11 +35,26 @@
     void usb_kick(handle_ref_type h);                            \
     size_t usb_get_max_packet_size(handle_ref_type)
 
+// One bulk transfer of a batch passed to usb_write_queued or usb_read_queued.
+struct UsbTransfer {
+    void* data;
+    size_t length;
+};
+
+// Performs |transfers| in order, each as its own bulk transfer, and returns the number of bytes
+// transferred or -1 on error. A read may only come up short in its last transfer. The libusb
+// backend keeps up to $ADB_USB_QUEUE_DEPTH (default 8) transfers in flight; the native
+// backends perform them one at a time.
+#define ADB_USB_QUEUED_INTERFACE(handle_ref_type)                                        \
+    int usb_write_queued(handle_ref_type h, std::span<const UsbTransfer> transfers); \
+    int usb_read_queued(handle_ref_type h, std::span<const UsbTransfer> transfers)
+
 // Linux and Darwin clients have native and libusb implementations.
 
 namespace libusb {
 struct usb_handle;
 ADB_USB_INTERFACE(libusb::usb_handle*);
+ADB_USB_QUEUED_INTERFACE(libusb::usb_handle*);
 }  // namespace libusb
 
 namespace native {
@@ -49,6 +66,7 @@ ADB_USB_INTERFACE(native::usb_handle*);
 struct usb_handle {};
 
 ADB_USB_INTERFACE(::usb_handle*);
+ADB_USB_QUEUED_INTERFACE(::usb_handle*);
 
 // USB device detection.
 int is_adb_interface(int usb_class, int usb_subclass, int usb_protocol);
@@ -61,6 +79,7 @@ struct UsbConnection : public BlockingConnection {
 
     bool Read(apacket* packet) override final;
     bool Write(apacket* packet) override final;
+    bool WriteBatch(const std::deque<std::unique_ptr<apacket>>& packets) override final;
     bool DoTlsHandshake(RSA* key, std::string* auth_key) override final;
 
     void Close() override final;
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+
 #include <android-base/logging.h>
 
 #include "client/usb.h"
@@ -68,3 +70,47 @@ size_t usb_get_max_packet_size(usb_handle* h) {
                ? libusb::usb_get_max_packet_size(reinterpret_cast<libusb::usb_handle*>(h))
                : native::usb_get_max_packet_size(reinterpret_cast<native::usb_handle*>(h));
 }
+
+namespace native {
+
+// The native backends have no way to queue transfers, so perform them one at a time.
+template <typename Transfer>
+static int perform_one_by_one(std::span<const UsbTransfer> transfers, bool allow_short_last,
+                              Transfer transfer) {
+    int total = 0;
+    for (size_t i = 0; i < transfers.size(); ++i) {
+        int len = transfers[i].length;
+        int rc = transfer(transfers[i].data, len);
+        if (rc < 0) {
+            return rc;
+        }
+        total += rc;
+        if (rc != len && !(allow_short_last && i == transfers.size() - 1)) {
+            errno = EIO;
+            return -1;
+        }
+    }
+    return total;
+}
+
+}  // namespace native
+
+int usb_write_queued(usb_handle* h, std::span<const UsbTransfer> transfers) {
+    if (should_use_libusb()) {
+        return libusb::usb_write_queued(reinterpret_cast<libusb::usb_handle*>(h), transfers);
+    }
+    auto* handle = reinterpret_cast<native::usb_handle*>(h);
+    return native::perform_one_by_one(transfers, false, [handle](void* data, int len) {
+        return native::usb_write(handle, data, len);
+    });
+}
+
+int usb_read_queued(usb_handle* h, std::span<const UsbTransfer> transfers) {
+    if (should_use_libusb()) {
+        return libusb::usb_read_queued(reinterpret_cast<libusb::usb_handle*>(h), transfers);
+    }
+    auto* handle = reinterpret_cast<native::usb_handle*>(h);
+    return native::perform_one_by_one(transfers, true, [handle](void* data, int len) {
+        return native::usb_read(handle, data, len);
+    });
+}
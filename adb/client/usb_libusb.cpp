@@ -21,6 +21,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
@@ -29,11 +30,14 @@
 #include <string>
 #include <thread>
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <libusb/libusb.h>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/parseint.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 
@@ -125,6 +129,9 @@ struct usb_handle : public ::usb_handle {
         // Cancel already dispatched transfers.
         libusb_cancel_transfer(read.transfer);
         libusb_cancel_transfer(write.transfer);
+        for (libusb_transfer* transfer : queued_transfers) {
+            libusb_cancel_transfer(transfer);
+        }
 
         libusb_release_interface(handle, interface);
         libusb_close(handle);
@@ -140,6 +147,10 @@ struct usb_handle : public ::usb_handle {
     transfer_info read;
     transfer_info write;
 
+    // Transfers in flight from usb_write_queued and usb_read_queued, guarded by
+    // device_handle_mutex.
+    std::unordered_set<libusb_transfer*> queued_transfers;
+
     uint8_t interface;
     uint8_t bulk_in;
     uint8_t bulk_out;
@@ -630,6 +641,172 @@ void usb_kick(usb_handle* h) {
     h->Close();
 }
 
+static size_t usb_queue_depth() {
+    static const size_t depth = []() {
+        size_t value = 8;
+        const char* env = getenv("ADB_USB_QUEUE_DEPTH");
+        if (env && !android::base::ParseUint(env, &value, size_t(64))) {
+            LOG(WARNING) << "ignoring invalid ADB_USB_QUEUE_DEPTH '" << env << "'";
+            value = 8;
+        }
+        return std::max(value, size_t(1));
+    }();
+    return depth;
+}
+
+struct queued_transfer_window {
+    std::mutex mutex;
+    std::condition_variable cv;
+};
+
+// One slot of the window of transfers that perform_queued_transfers keeps in flight.
+struct queued_transfer {
+    queued_transfer() : transfer(libusb_alloc_transfer(0)) {}
+    ~queued_transfer() { libusb_free_transfer(transfer); }
+
+    libusb_transfer* transfer;
+    bool complete;
+    queued_transfer_window* window;
+
+    DISALLOW_COPY_AND_ASSIGN(queued_transfer);
+};
+
+static LIBUSB_CALL void queued_transfer_callback(libusb_transfer* transfer) {
+    queued_transfer* slot = static_cast<queued_transfer*>(transfer->user_data);
+    std::lock_guard<std::mutex> lock(slot->window->mutex);
+    slot->complete = true;
+    slot->window->cv.notify_all();
+}
+
+// Submits |transfers| in order on |endpoint|, up to usb_queue_depth() at a time. The host
+// controller completes the transfers queued on an endpoint in order, so the data lines up just
+// as if they had been performed one after the other.
+static int perform_queued_transfers(usb_handle* h, uint8_t endpoint,
+                                    std::span<const UsbTransfer> transfers) {
+    const bool is_bulk_out = endpoint_is_output(endpoint);
+    const char* name = is_bulk_out ? "queued write" : "queued read";
+
+    queued_transfer_window window;
+    std::vector<queued_transfer> slots(std::min(usb_queue_depth(), transfers.size()));
+    for (queued_transfer& slot : slots) {
+        slot.window = &window;
+    }
+
+    size_t submitted = 0;
+    size_t reaped = 0;
+    int total = 0;
+    bool failed = false;
+
+    // Cancels whatever is still in flight once the batch has failed.
+    auto cancel = [&]() {
+        std::lock_guard<std::mutex> lock(h->device_handle_mutex);
+        for (size_t i = reaped; i < submitted; ++i) {
+            libusb_cancel_transfer(slots[i % slots.size()].transfer);
+        }
+    };
+
+    while (reaped < transfers.size()) {
+        while (!failed && submitted < transfers.size() && submitted - reaped < slots.size()) {
+            std::lock_guard<std::mutex> lock(h->device_handle_mutex);
+            if (!h->device_handle) {
+                failed = true;
+                break;
+            }
+
+            queued_transfer& slot = slots[submitted % slots.size()];
+            libusb_transfer* transfer = slot.transfer;
+            transfer->dev_handle = h->device_handle;
+            transfer->flags = 0;
+            transfer->endpoint = endpoint;
+            transfer->type = LIBUSB_TRANSFER_TYPE_BULK;
+            transfer->length = transfers[submitted].length;
+            transfer->buffer = static_cast<unsigned char*>(transfers[submitted].data);
+            transfer->num_iso_packets = 0;
+            transfer->user_data = &slot;
+            transfer->callback = queued_transfer_callback;
+            transfer->timeout = 0;
+            slot.complete = false;
+
+            int rc = libusb_submit_transfer(transfer);
+            if (rc != 0) {
+                LOG(WARNING) << "failed to submit " << name << " transfer: "
+                             << libusb_error_name(rc);
+                failed = true;
+                break;
+            }
+            h->queued_transfers.insert(transfer);
+            ++submitted;
+        }
+
+        if (reaped == submitted) {
+            break;
+        }
+
+        if (failed) {
+            cancel();
+        }
+
+        queued_transfer& slot = slots[reaped % slots.size()];
+        {
+            std::unique_lock<std::mutex> lock(window.mutex);
+            window.cv.wait(lock, [&slot]() { return slot.complete; });
+        }
+        {
+            std::lock_guard<std::mutex> lock(h->device_handle_mutex);
+            h->queued_transfers.erase(slot.transfer);
+        }
+
+        libusb_transfer* transfer = slot.transfer;
+        const size_t index = reaped++;
+        if (failed) {
+            continue;
+        }
+
+        if (transfer->status != LIBUSB_TRANSFER_COMPLETED) {
+            LOG(WARNING) << name << " transfer failed: " << libusb_error_name(transfer->status);
+            failed = true;
+        } else if (transfer->actual_length != transfer->length &&
+                   (is_bulk_out || index != transfers.size() - 1)) {
+            LOG(WARNING) << name << " transfer came up short: " << transfer->actual_length
+                         << " of " << transfer->length << " bytes";
+            failed = true;
+        } else {
+            total += transfer->actual_length;
+        }
+    }
+
+    if (failed) {
+        errno = EIO;
+        return -1;
+    }
+    return total;
+}
+
+int usb_write_queued(usb_handle* h, std::span<const UsbTransfer> transfers) {
+    // Packet-aligned writes need to be terminated by a zero-length packet, which gets queued up
+    // like any other transfer.
+    std::vector<UsbTransfer> with_zero_packets;
+    int expected = 0;
+    for (const UsbTransfer& transfer : transfers) {
+        with_zero_packets.push_back(transfer);
+        expected += transfer.length;
+        if (should_perform_zero_transfer(h->bulk_out, transfer.length, h->write.zero_mask)) {
+            with_zero_packets.push_back({nullptr, 0});
+        }
+    }
+
+    int rc = perform_queued_transfers(h, h->bulk_out, with_zero_packets);
+    LOG(DEBUG) << "usb_write_queued(" << transfers.size() << " transfers, " << expected
+               << " bytes) = " << rc;
+    return rc;
+}
+
+int usb_read_queued(usb_handle* h, std::span<const UsbTransfer> transfers) {
+    int rc = perform_queued_transfers(h, h->bulk_in, transfers);
+    LOG(DEBUG) << "usb_read_queued(" << transfers.size() << " transfers) = " << rc;
+    return rc;
+}
+
 size_t usb_get_max_packet_size(usb_handle* h) {
     CHECK(h->max_packet_size != 0);
     return h->max_packet_size;
@@ -0,0 +1,367 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string.h>
+
+#include <algorithm>
+#include <memory>
+#include <span>
+
+#include <android-base/logging.h>
+
+#include <brotli/decode.h>
+#include <brotli/encode.h>
+#include <lz4frame.h>
+#include <zstd.h>
+
+#include "types.h"
+
+enum class DecodeResult {
+    Error,
+    Done,
+    NeedInput,
+    MoreOutput,
+};
+
+struct Decoder {
+    virtual ~Decoder() = default;
+
+    void Append(Block&& block) { input_buffer_.append(std::move(block)); }
+
+    // Decodes as much of the appended input as fits in the output buffer. |output| points into
+    // the output buffer, and is only valid until the next call.
+    virtual DecodeResult Decode(std::span<char>* output) = 0;
+
+  protected:
+    explicit Decoder(std::span<char> output_buffer) : output_buffer_(output_buffer) {}
+
+    IOVector input_buffer_;
+    std::span<char> output_buffer_;
+};
+
+enum class EncodeResult {
+    Error,
+    Done,
+    NeedInput,
+    MoreOutput,
+};
+
+struct Encoder {
+    virtual ~Encoder() = default;
+
+    void Append(Block input) { input_buffer_.append(std::move(input)); }
+    void Finish() { finished_ = true; }
+
+    // Encodes the appended input. |output| is set to a full block of output_block_size bytes on
+    // MoreOutput, and to whatever remains once the stream is complete on Done.
+    virtual EncodeResult Encode(Block* output) = 0;
+
+  protected:
+    explicit Encoder(size_t output_block_size)
+        : output_block_size_(output_block_size),
+          output_block_(output_block_size),
+          output_bytes_left_(output_block_size) {}
+
+    char* OutputCursor() {
+        return output_block_.data() + (output_block_size_ - output_bytes_left_);
+    }
+
+    EncodeResult TakeOutput(Block* output, bool done) {
+        if (done) {
+            output_block_.resize(output_block_size_ - output_bytes_left_);
+            *output = std::move(output_block_);
+            return EncodeResult::Done;
+        }
+
+        *output = std::move(output_block_);
+        output_block_.resize(output_block_size_);
+        output_bytes_left_ = output_block_size_;
+        return EncodeResult::MoreOutput;
+    }
+
+    bool finished_ = false;
+    IOVector input_buffer_;
+    const size_t output_block_size_;
+    Block output_block_;
+    size_t output_bytes_left_;
+};
+
+struct BrotliDecoder final : public Decoder {
+    explicit BrotliDecoder(std::span<char> output_buffer)
+        : Decoder(output_buffer),
+          decoder_(BrotliDecoderCreateInstance(nullptr, nullptr, nullptr),
+                   BrotliDecoderDestroyInstance) {}
+
+    DecodeResult Decode(std::span<char>* output) final {
+        size_t available_in = input_buffer_.front_size();
+        const uint8_t* next_in = reinterpret_cast<const uint8_t*>(input_buffer_.front_data());
+
+        size_t available_out = output_buffer_.size();
+        uint8_t* next_out = reinterpret_cast<uint8_t*>(output_buffer_.data());
+
+        BrotliDecoderResult r = BrotliDecoderDecompressStream(
+                decoder_.get(), &available_in, &next_in, &available_out, &next_out, nullptr);
+
+        size_t bytes_consumed = input_buffer_.front_size() - available_in;
+        input_buffer_.drop_front(bytes_consumed);
+
+        size_t bytes_emitted = output_buffer_.size() - available_out;
+        *output = std::span<char>(output_buffer_.data(), bytes_emitted);
+
+        switch (r) {
+            case BROTLI_DECODER_RESULT_SUCCESS:
+                return DecodeResult::Done;
+            case BROTLI_DECODER_RESULT_ERROR:
+                return DecodeResult::Error;
+            case BROTLI_DECODER_RESULT_NEEDS_MORE_INPUT:
+                // Brotli guarantees as one of its invariants that if it returns NEEDS_MORE_INPUT,
+                // it will consume the entire input buffer passed in, so we don't have to worry
+                // about bytes left over in the front block with more input remaining.
+                return DecodeResult::NeedInput;
+            case BROTLI_DECODER_RESULT_NEEDS_MORE_OUTPUT:
+                return DecodeResult::MoreOutput;
+        }
+    }
+
+  private:
+    std::unique_ptr<BrotliDecoderState, void (*)(BrotliDecoderState*)> decoder_;
+};
+
+struct BrotliEncoder final : public Encoder {
+    explicit BrotliEncoder(size_t output_block_size)
+        : Encoder(output_block_size),
+          encoder_(BrotliEncoderCreateInstance(nullptr, nullptr, nullptr),
+                   BrotliEncoderDestroyInstance) {
+        BrotliEncoderSetParameter(encoder_.get(), BROTLI_PARAM_QUALITY, 1);
+    }
+
+    EncodeResult Encode(Block* output) final {
+        output->clear();
+        while (true) {
+            size_t available_in = input_buffer_.front_size();
+            const uint8_t* next_in = reinterpret_cast<const uint8_t*>(input_buffer_.front_data());
+
+            size_t available_out = output_bytes_left_;
+            uint8_t* next_out = reinterpret_cast<uint8_t*>(OutputCursor());
+
+            BrotliEncoderOperation op = BROTLI_OPERATION_PROCESS;
+            if (finished_) {
+                op = BROTLI_OPERATION_FINISH;
+            }
+
+            if (!BrotliEncoderCompressStream(encoder_.get(), op, &available_in, &next_in,
+                                             &available_out, &next_out, nullptr)) {
+                return EncodeResult::Error;
+            }
+
+            size_t bytes_consumed = input_buffer_.front_size() - available_in;
+            input_buffer_.drop_front(bytes_consumed);
+
+            output_bytes_left_ = available_out;
+
+            if (BrotliEncoderIsFinished(encoder_.get())) {
+                return TakeOutput(output, true);
+            } else if (output_bytes_left_ == 0) {
+                return TakeOutput(output, false);
+            } else if (input_buffer_.empty()) {
+                return EncodeResult::NeedInput;
+            }
+        }
+    }
+
+  private:
+    std::unique_ptr<BrotliEncoderState, void (*)(BrotliEncoderState*)> encoder_;
+};
+
+// LZ4 trades compression ratio for speed: it keeps up with USB 3 and fast networks, where Brotli
+// becomes the bottleneck.
+struct LZ4Decoder final : public Decoder {
+    explicit LZ4Decoder(std::span<char> output_buffer)
+        : Decoder(output_buffer), decoder_(nullptr, LZ4F_freeDecompressionContext) {
+        LZ4F_dctx* dctx;
+        if (LZ4F_isError(LZ4F_createDecompressionContext(&dctx, LZ4F_VERSION))) {
+            LOG(FATAL) << "failed to create LZ4 decompression context";
+        }
+        decoder_.reset(dctx);
+    }
+
+    DecodeResult Decode(std::span<char>* output) final {
+        size_t available_in = input_buffer_.front_size();
+        size_t available_out = output_buffer_.size();
+        size_t rc = LZ4F_decompress(decoder_.get(), output_buffer_.data(), &available_out,
+                                    input_buffer_.front_data(), &available_in, nullptr);
+        if (LZ4F_isError(rc)) {
+            return DecodeResult::Error;
+        }
+
+        // LZ4F_decompress updates the sizes to what it consumed and emitted.
+        input_buffer_.drop_front(available_in);
+        *output = std::span<char>(output_buffer_.data(), available_out);
+
+        if (rc == 0) {
+            return DecodeResult::Done;
+        } else if (!input_buffer_.empty() || available_out == output_buffer_.size()) {
+            // A full output buffer may have left decoded data behind in the context.
+            return DecodeResult::MoreOutput;
+        }
+        return DecodeResult::NeedInput;
+    }
+
+  private:
+    std::unique_ptr<LZ4F_dctx, LZ4F_errorCode_t (*)(LZ4F_dctx*)> decoder_;
+};
+
+struct LZ4Encoder final : public Encoder {
+    explicit LZ4Encoder(size_t output_block_size)
+        : Encoder(output_block_size), encoder_(nullptr, LZ4F_freeCompressionContext) {
+        LZ4F_cctx* cctx;
+        if (LZ4F_isError(LZ4F_createCompressionContext(&cctx, LZ4F_VERSION))) {
+            LOG(FATAL) << "failed to create LZ4 compression context";
+        }
+        encoder_.reset(cctx);
+
+        // LZ4F wants room for the worst case of each call, so compress into a staging buffer
+        // of that size and copy out into output blocks from there.
+        memset(&preferences_, 0, sizeof(preferences_));
+        staging_.resize(LZ4F_compressBound(kMaxChunkSize, &preferences_));
+    }
+
+    EncodeResult Encode(Block* output) final {
+        output->clear();
+        while (true) {
+            if (staged_offset_ < staged_size_) {
+                size_t n = std::min(staged_size_ - staged_offset_, output_bytes_left_);
+                memcpy(OutputCursor(), staging_.data() + staged_offset_, n);
+                staged_offset_ += n;
+                output_bytes_left_ -= n;
+                if (output_bytes_left_ == 0) {
+                    return TakeOutput(output, ended_ && staged_offset_ == staged_size_);
+                }
+                continue;
+            }
+
+            size_t rc;
+            if (ended_) {
+                return TakeOutput(output, true);
+            } else if (!begun_) {
+                rc = LZ4F_compressBegin(encoder_.get(), staging_.data(), staging_.size(),
+                                        &preferences_);
+                begun_ = true;
+            } else if (!input_buffer_.empty()) {
+                size_t chunk = std::min(input_buffer_.front_size(), kMaxChunkSize);
+                rc = LZ4F_compressUpdate(encoder_.get(), staging_.data(), staging_.size(),
+                                         input_buffer_.front_data(), chunk, nullptr);
+                input_buffer_.drop_front(chunk);
+            } else if (finished_) {
+                rc = LZ4F_compressEnd(encoder_.get(), staging_.data(), staging_.size(), nullptr);
+                ended_ = true;
+            } else {
+                return EncodeResult::NeedInput;
+            }
+
+            if (LZ4F_isError(rc)) {
+                return EncodeResult::Error;
+            }
+            staged_offset_ = 0;
+            staged_size_ = rc;
+        }
+    }
+
+  private:
+    static constexpr size_t kMaxChunkSize = 64 * 1024;
+
+    std::unique_ptr<LZ4F_cctx, LZ4F_errorCode_t (*)(LZ4F_cctx*)> encoder_;
+    LZ4F_preferences_t preferences_;
+    bool begun_ = false;
+    bool ended_ = false;
+    Block staging_;
+    size_t staged_offset_ = 0;
+    size_t staged_size_ = 0;
+};
+
+// zstd sits between the two: close to LZ4's speed at low levels, and to Brotli's ratio at high
+// ones.
+struct ZstdDecoder final : public Decoder {
+    explicit ZstdDecoder(std::span<char> output_buffer)
+        : Decoder(output_buffer), decoder_(ZSTD_createDCtx(), ZSTD_freeDCtx) {
+        if (!decoder_) {
+            LOG(FATAL) << "failed to create zstd decompression context";
+        }
+    }
+
+    DecodeResult Decode(std::span<char>* output) final {
+        ZSTD_inBuffer in = {input_buffer_.front_data(), input_buffer_.front_size(), 0};
+        ZSTD_outBuffer out = {output_buffer_.data(), output_buffer_.size(), 0};
+        size_t rc = ZSTD_decompressStream(decoder_.get(), &out, &in);
+        if (ZSTD_isError(rc)) {
+            return DecodeResult::Error;
+        }
+
+        input_buffer_.drop_front(in.pos);
+        *output = std::span<char>(output_buffer_.data(), out.pos);
+
+        if (rc == 0) {
+            return DecodeResult::Done;
+        } else if (!input_buffer_.empty() || out.pos == out.size) {
+            return DecodeResult::MoreOutput;
+        }
+        return DecodeResult::NeedInput;
+    }
+
+  private:
+    std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> decoder_;
+};
+
+struct ZstdEncoder final : public Encoder {
+    static constexpr int kDefaultLevel = 1;
+
+    explicit ZstdEncoder(size_t output_block_size, int level = kDefaultLevel)
+        : Encoder(output_block_size), encoder_(ZSTD_createCCtx(), ZSTD_freeCCtx) {
+        if (!encoder_) {
+            LOG(FATAL) << "failed to create zstd compression context";
+        }
+        ZSTD_CCtx_setParameter(encoder_.get(), ZSTD_c_compressionLevel, level);
+    }
+
+    EncodeResult Encode(Block* output) final {
+        output->clear();
+        while (true) {
+            ZSTD_inBuffer in = {input_buffer_.front_data(), input_buffer_.front_size(), 0};
+            ZSTD_outBuffer out = {OutputCursor(), output_bytes_left_, 0};
+            size_t rc = ZSTD_compressStream2(encoder_.get(), &out, &in,
+                                             finished_ ? ZSTD_e_end : ZSTD_e_continue);
+            if (ZSTD_isError(rc)) {
+                return EncodeResult::Error;
+            }
+
+            input_buffer_.drop_front(in.pos);
+            output_bytes_left_ -= out.pos;
+
+            if (finished_ && rc == 0) {
+                return TakeOutput(output, true);
+            } else if (output_bytes_left_ == 0) {
+                return TakeOutput(output, false);
+            } else if (!finished_ && input_buffer_.empty()) {
+                return EncodeResult::NeedInput;
+            }
+        }
+    }
+
+  private:
+    std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> encoder_;
+};
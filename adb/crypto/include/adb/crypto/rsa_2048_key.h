@@ -16,6 +16,8 @@
 
 #pragma once
 
+#include <stdint.h>
+
 #include <memory>
 #include <optional>
 
@@ -30,5 +32,9 @@ std::optional<Key> CreateRSA2048Key();
 // Generates the public key from the RSA private key.
 bool CalculatePublicKey(std::string* out, RSA* private_key);
 
+// Computes a short id for |key|: the first four bytes of the SHA-256 of its Android public key
+// encoding. Ids aren't unique, they're a hint for picking the likely key out of a list.
+bool CalculateKeyId(uint32_t* out, const RSA* key);
+
 }  // namespace crypto
 }  // namespace adb
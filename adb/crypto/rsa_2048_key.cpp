@@ -20,6 +20,7 @@
 #include <crypto_utils/android_pubkey.h>
 #include <openssl/bn.h>
 #include <openssl/rsa.h>
+#include <openssl/sha.h>
 
 namespace adb {
 namespace crypto {
@@ -67,6 +68,19 @@ bool CalculatePublicKey(std::string* out, RSA* private_key) {
     return true;
 }
 
+bool CalculateKeyId(uint32_t* out, const RSA* key) {
+    uint8_t binary_key_data[ANDROID_PUBKEY_ENCODED_SIZE];
+    if (!android_pubkey_encode(key, binary_key_data, sizeof(binary_key_data))) {
+        LOG(ERROR) << "Failed to convert to public key";
+        return false;
+    }
+
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    SHA256(binary_key_data, sizeof(binary_key_data), digest);
+    *out = digest[0] | digest[1] << 8 | digest[2] << 16 | static_cast<uint32_t>(digest[3]) << 24;
+    return true;
+}
+
 std::optional<Key> CreateRSA2048Key() {
     bssl::UniquePtr<EVP_PKEY> pkey(EVP_PKEY_new());
     bssl::UniquePtr<BIGNUM> exponent(BN_new());
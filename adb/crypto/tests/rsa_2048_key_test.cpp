@@ -69,5 +69,32 @@ TEST(RSA2048Key, Smoke) {
     }
 }
 
+TEST(RSA2048Key, KeyId) {
+    auto rsa_2048 = CreateRSA2048Key();
+    ASSERT_NE(rsa_2048, std::nullopt);
+    auto* rsa = EVP_PKEY_get0_RSA(rsa_2048->GetEvpPkey());
+    uint32_t id;
+    ASSERT_TRUE(CalculateKeyId(&id, rsa));
+
+    // The id of the private key matches the id of the public key the device decodes.
+    std::string pub_key_plus_name;
+    ASSERT_TRUE(CalculatePublicKey(&pub_key_plus_name, rsa));
+    std::vector<std::string> split = android::base::Split(pub_key_plus_name, " \t");
+    uint8_t keybuf[ANDROID_PUBKEY_ENCODED_SIZE + 1];
+    ASSERT_EQ(b64_pton(split[0].c_str(), keybuf, sizeof(keybuf)), ANDROID_PUBKEY_ENCODED_SIZE);
+    RSA* key = nullptr;
+    ASSERT_TRUE(android_pubkey_decode(keybuf, ANDROID_PUBKEY_ENCODED_SIZE, &key));
+    bssl::UniquePtr<RSA> public_key(key);
+    uint32_t public_id;
+    ASSERT_TRUE(CalculateKeyId(&public_id, public_key.get()));
+    EXPECT_EQ(id, public_id);
+
+    auto other = CreateRSA2048Key();
+    ASSERT_NE(other, std::nullopt);
+    uint32_t other_id;
+    ASSERT_TRUE(CalculateKeyId(&other_id, EVP_PKEY_get0_RSA(other->GetEvpPkey())));
+    EXPECT_NE(id, other_id);
+}
+
 }  // namespace crypto
 }  // namespace adb
@@ -20,6 +20,9 @@
 #include "adb_utils.h"
 #include "shell_service.h"
 
+#include <condition_variable>
+#include <memory>
+
 #include <android-base/cmsg.h>
 
 namespace {
@@ -31,50 +34,92 @@ struct AbbProcess {
     unique_fd sendCommand(std::string_view command);
 
   private:
+    // abb answers commands in the order they were sent, so several can be in flight at once:
+    // each caller sends its command, then waits for its turn to read the reply.
+    struct Connection {
+        unique_fd fd;
+        uint64_t next_request = 0;
+        uint64_t next_reply = 0;
+        bool broken = false;
+    };
+
     static unique_fd startAbbProcess(unique_fd* error_fd);
 
+    // Wakes everyone waiting on |connection|, and makes sure it isn't used for new commands.
+    void breakConnection(const std::shared_ptr<Connection>& connection);
+
     static constexpr auto kRetries = 2;
     static constexpr auto kErrorProtocol = SubprocessProtocol::kShell;
 
     std::mutex locker_;
-    unique_fd socket_fd_;
+    std::condition_variable reply_cv_;
+    // Shared with the callers still waiting for a reply, so that the socket stays open until
+    // they are done with it.
+    std::shared_ptr<Connection> connection_;
 };
 
 unique_fd AbbProcess::sendCommand(std::string_view command) {
     std::unique_lock lock{locker_};
 
     for (int i = 0; i < kRetries; ++i) {
-        unique_fd error_fd;
-        if (socket_fd_ == -1) {
-            socket_fd_ = startAbbProcess(&error_fd);
-        }
-        if (socket_fd_ == -1) {
-            LOG(ERROR) << "failed to start abb process";
-            return error_fd;
+        if (!connection_) {
+            unique_fd error_fd;
+            unique_fd socket_fd = startAbbProcess(&error_fd);
+            if (socket_fd == -1) {
+                LOG(ERROR) << "failed to start abb process";
+                return error_fd;
+            }
+            connection_ = std::make_shared<Connection>();
+            connection_->fd = std::move(socket_fd);
         }
+        auto connection = connection_;
 
-        if (!SendProtocolString(socket_fd_, command)) {
+        if (!SendProtocolString(connection->fd, command)) {
             PLOG(ERROR) << "failed to send command to abb";
-            socket_fd_.reset();
+            breakConnection(connection);
+            continue;
+        }
+
+        uint64_t request = connection->next_request++;
+        reply_cv_.wait(lock, [&]() {
+            return connection->broken || connection->next_reply == request;
+        });
+        if (connection->broken) {
             continue;
         }
 
+        // Let other callers send their commands while we wait for abb to start ours.
+        lock.unlock();
         unique_fd fd;
         char buf;
-        if (android::base::ReceiveFileDescriptors(socket_fd_, &buf, 1, &fd) != 1) {
+        bool received =
+                android::base::ReceiveFileDescriptors(connection->fd, &buf, 1, &fd) == 1;
+        if (!received) {
             PLOG(ERROR) << "failed to receive FD from abb";
-            socket_fd_.reset();
-            continue;
         }
+        lock.lock();
 
+        if (!received) {
+            breakConnection(connection);
+            continue;
+        }
+        connection->next_reply++;
+        reply_cv_.notify_all();
         return fd;
     }
 
     LOG(ERROR) << "abb is unavailable";
-    socket_fd_.reset();
     return ReportError(kErrorProtocol, "abb is unavailable");
 }
 
+void AbbProcess::breakConnection(const std::shared_ptr<Connection>& connection) {
+    connection->broken = true;
+    if (connection_ == connection) {
+        connection_.reset();
+    }
+    reply_cv_.notify_all();
+}
+
 unique_fd AbbProcess::startAbbProcess(unique_fd* error_fd) {
     constexpr auto abb_process_type = SubprocessType::kRaw;
     constexpr auto abb_protocol = SubprocessProtocol::kNone;
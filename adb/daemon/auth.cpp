@@ -27,7 +27,10 @@
 #include <iomanip>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <thread>
+#include <unordered_map>
+#include <vector>
 
 #include <adb/crypto/rsa_2048_key.h>
 #include <adb/tls/adb_ca_list.h>
@@ -35,6 +38,7 @@
 #include <android-base/file.h>
 #include <android-base/no_destructor.h>
 #include <android-base/strings.h>
+#include <android-base/thread_annotations.h>
 #include <crypto_utils/android_pubkey.h>
 #include <openssl/obj_mac.h>
 #include <openssl/rsa.h>
@@ -103,35 +107,85 @@ static void IteratePublicKeys(std::function<bool(std::string_view public_key)> f
             &f);
 }
 
-bssl::UniquePtr<STACK_OF(X509_NAME)> adbd_tls_client_ca_list() {
-    if (!auth_required) {
+// An authorized key, decoded.
+struct ParsedKey {
+    bssl::UniquePtr<RSA> rsa;
+    uint32_t id;
+};
+
+// libadbd_auth owns the authorized keys and hands out their text on every call, but decoding
+// them is what's expensive with a lot of keys, so the decoded keys are kept here by their text.
+// Keys that libadbd_auth no longer returns are dropped the next time the keys are listed. A key
+// that can't be decoded is kept as null, so that it's only reported once.
+static std::mutex parsed_keys_mutex;
+static android::base::NoDestructor<
+        std::unordered_map<std::string, std::shared_ptr<const ParsedKey>>>
+        parsed_keys GUARDED_BY(parsed_keys_mutex);
+
+static std::shared_ptr<const ParsedKey> ParsePublicKey(std::string_view public_key) {
+    // TODO: do we really have to support both ' ' and '\t'?
+    std::string pubkey(public_key.substr(0, public_key.find_first_of(" \t")));
+    uint8_t keybuf[ANDROID_PUBKEY_ENCODED_SIZE + 1];
+    if (b64_pton(pubkey.c_str(), keybuf, sizeof(keybuf)) != ANDROID_PUBKEY_ENCODED_SIZE) {
+        LOG(ERROR) << "Invalid base64 key " << pubkey;
         return nullptr;
     }
 
-    bssl::UniquePtr<STACK_OF(X509_NAME)> ca_list(sk_X509_NAME_new_null());
+    RSA* key = nullptr;
+    if (!android_pubkey_decode(keybuf, ANDROID_PUBKEY_ENCODED_SIZE, &key)) {
+        LOG(ERROR) << "Failed to parse key " << pubkey;
+        return nullptr;
+    }
+
+    auto parsed = std::make_shared<ParsedKey>();
+    parsed->rsa.reset(key);
+    if (!CalculateKeyId(&parsed->id, key)) {
+        return nullptr;
+    }
+    return parsed;
+}
 
+// Returns the currently authorized keys that could be decoded, with their text.
+static std::vector<std::pair<std::string, std::shared_ptr<const ParsedKey>>> GetPublicKeys() {
+    std::vector<std::pair<std::string, std::shared_ptr<const ParsedKey>>> keys;
+    std::unordered_map<std::string, std::shared_ptr<const ParsedKey>> current;
+
+    std::lock_guard<std::mutex> lock(parsed_keys_mutex);
     IteratePublicKeys([&](std::string_view public_key) {
-        // TODO: do we really have to support both ' ' and '\t'?
-        std::vector<std::string> split = android::base::Split(std::string(public_key), " \t");
-        uint8_t keybuf[ANDROID_PUBKEY_ENCODED_SIZE + 1];
-        const std::string& pubkey = split[0];
-        if (b64_pton(pubkey.c_str(), keybuf, sizeof(keybuf)) != ANDROID_PUBKEY_ENCODED_SIZE) {
-            LOG(ERROR) << "Invalid base64 key " << pubkey;
+        std::string text(public_key);
+        if (current.count(text)) {
             return true;
         }
-
-        RSA* key = nullptr;
-        if (!android_pubkey_decode(keybuf, ANDROID_PUBKEY_ENCODED_SIZE, &key)) {
-            LOG(ERROR) << "Failed to parse key " << pubkey;
-            return true;
+        std::shared_ptr<const ParsedKey> parsed;
+        auto it = parsed_keys->find(text);
+        if (it != parsed_keys->end()) {
+            parsed = std::move(it->second);
+        } else {
+            parsed = ParsePublicKey(public_key);
+        }
+        if (parsed) {
+            keys.emplace_back(text, parsed);
         }
-        bssl::UniquePtr<RSA> rsa_key(key);
+        current.emplace(std::move(text), std::move(parsed));
+        return true;
+    });
+    parsed_keys->swap(current);
+    return keys;
+}
+
+bssl::UniquePtr<STACK_OF(X509_NAME)> adbd_tls_client_ca_list() {
+    if (!auth_required) {
+        return nullptr;
+    }
+
+    bssl::UniquePtr<STACK_OF(X509_NAME)> ca_list(sk_X509_NAME_new_null());
 
+    for (const auto& [public_key, parsed] : GetPublicKeys()) {
         unsigned char* dkey = nullptr;
-        int len = i2d_RSA_PUBKEY(rsa_key.get(), &dkey);
+        int len = i2d_RSA_PUBKEY(parsed->rsa.get(), &dkey);
         if (len <= 0 || dkey == nullptr) {
             LOG(ERROR) << "Failed to encode RSA public key";
-            return true;
+            continue;
         }
 
         uint8_t digest[SHA256_DIGEST_LENGTH];
@@ -146,47 +200,37 @@ bssl::UniquePtr<STACK_OF(X509_NAME)> adbd_tls_client_ca_list() {
         LOG(INFO) << "fingerprint=[" << digest_str << "]";
         auto issuer = CreateCAIssuerFromEncodedKey(digest_str);
         CHECK(bssl::PushToStack(ca_list.get(), std::move(issuer)));
-        return true;
-    });
+    }
 
     return ca_list;
 }
 
 bool adbd_auth_verify(const char* token, size_t token_size, const std::string& sig,
-                      std::string* auth_key) {
-    bool authorized = false;
+                      uint32_t key_id, std::string* auth_key) {
     auth_key->clear();
 
-    IteratePublicKeys([&](std::string_view public_key) {
-        // TODO: do we really have to support both ' ' and '\t'?
-        std::vector<std::string> split = android::base::Split(std::string(public_key), " \t");
-        uint8_t keybuf[ANDROID_PUBKEY_ENCODED_SIZE + 1];
-        const std::string& pubkey = split[0];
-        if (b64_pton(pubkey.c_str(), keybuf, sizeof(keybuf)) != ANDROID_PUBKEY_ENCODED_SIZE) {
-            LOG(ERROR) << "Invalid base64 key " << pubkey;
-            return true;
-        }
-
-        RSA* key = nullptr;
-        if (!android_pubkey_decode(keybuf, ANDROID_PUBKEY_ENCODED_SIZE, &key)) {
-            LOG(ERROR) << "Failed to parse key " << pubkey;
+    auto keys = GetPublicKeys();
+    auto verify = [&](const ParsedKey& key) {
+        return RSA_verify(NID_sha1, reinterpret_cast<const uint8_t*>(token), token_size,
+                          reinterpret_cast<const uint8_t*>(sig.c_str()), sig.size(),
+                          key.rsa.get()) == 1;
+    };
+
+    // Try the key the client says it signed with first, so that with many authorized keys a
+    // connection only costs one verification.
+    for (const auto& [public_key, parsed] : keys) {
+        if (parsed->id == key_id && verify(*parsed)) {
+            *auth_key = public_key;
             return true;
         }
-
-        bool verified =
-                (RSA_verify(NID_sha1, reinterpret_cast<const uint8_t*>(token), token_size,
-                            reinterpret_cast<const uint8_t*>(sig.c_str()), sig.size(), key) == 1);
-        RSA_free(key);
-        if (verified) {
+    }
+    for (const auto& [public_key, parsed] : keys) {
+        if (parsed->id != key_id && verify(*parsed)) {
             *auth_key = public_key;
-            authorized = true;
-            return false;
+            return true;
         }
-
-        return true;
-    });
-
-    return authorized;
+    }
+    return false;
 }
 
 static bool adbd_auth_generate_token(void* token, size_t token_size) {
@@ -316,40 +360,17 @@ int adbd_tls_verify_cert(X509_STORE_CTX* ctx, std::string* auth_key) {
         return 0;
     }
 
-    IteratePublicKeys([&](std::string_view public_key) {
-        // TODO: do we really have to support both ' ' and '\t'?
-        std::vector<std::string> split = android::base::Split(std::string(public_key), " \t");
-        uint8_t keybuf[ANDROID_PUBKEY_ENCODED_SIZE + 1];
-        const std::string& pubkey = split[0];
-        if (b64_pton(pubkey.c_str(), keybuf, sizeof(keybuf)) != ANDROID_PUBKEY_ENCODED_SIZE) {
-            LOG(ERROR) << "Invalid base64 key " << pubkey;
-            return true;
-        }
-
-        RSA* key = nullptr;
-        if (!android_pubkey_decode(keybuf, ANDROID_PUBKEY_ENCODED_SIZE, &key)) {
-            LOG(ERROR) << "Failed to parse key " << pubkey;
-            return true;
-        }
-
-        bool verified = false;
+    for (const auto& [public_key, parsed] : GetPublicKeys()) {
         bssl::UniquePtr<EVP_PKEY> known_evp(EVP_PKEY_new());
-        EVP_PKEY_set1_RSA(known_evp.get(), key);
+        EVP_PKEY_set1_RSA(known_evp.get(), parsed->rsa.get());
         if (EVP_PKEY_cmp(known_evp.get(), evp_pkey.get())) {
             LOG(INFO) << "Matched auth_key=" << public_key;
-            verified = true;
-        } else {
-            LOG(INFO) << "auth_key doesn't match [" << public_key << "]";
-        }
-        RSA_free(key);
-        if (verified) {
             *auth_key = public_key;
             authorized = true;
-            return false;
+            break;
         }
-
-        return true;
-    });
+        LOG(INFO) << "auth_key doesn't match [" << public_key << "]";
+    }
 
     return authorized ? 1 : 0;
 }
@@ -57,7 +57,8 @@
 #include "adb_io.h"
 #include "adb_trace.h"
 #include "adb_utils.h"
-#include "brotli_utils.h"
+#include "compression_utils.h"
+#include "file_sync_delta.h"
 #include "file_sync_protocol.h"
 #include "security_log_tags.h"
 #include "sysdeps/errno.h"
@@ -266,10 +267,60 @@ static bool SendSyncFailErrno(borrowed_fd fd, const std::string& reason) {
     return SendSyncFail(fd, StringPrintf("%s: %s", reason.c_str(), strerror(errno)));
 }
 
-static bool handle_send_file_compressed(borrowed_fd s, unique_fd fd, uint32_t* timestamp) {
+// Picks out the compression flag of a send_v2/recv_v2 setup packet, failing on any other flag.
+static bool parse_compression_flags(borrowed_fd s, uint32_t flags, SyncFlag* compression) {
+    *compression = kSyncFlagNone;
+    for (SyncFlag flag : {kSyncFlagBrotli, kSyncFlagLZ4, kSyncFlagZstd}) {
+        if (flags & flag) {
+            if (*compression != kSyncFlagNone) {
+                SendSyncFail(s, "multiple compression flags");
+                return false;
+            }
+            *compression = flag;
+            flags &= ~flag;
+        }
+    }
+    if (flags) {
+        SendSyncFail(s, android::base::StringPrintf("unknown flags: %d", flags));
+        return false;
+    }
+    return true;
+}
+
+static std::unique_ptr<Decoder> create_decoder(SyncFlag compression, std::span<char> output) {
+    switch (compression) {
+        case kSyncFlagBrotli:
+            return std::make_unique<BrotliDecoder>(output);
+        case kSyncFlagLZ4:
+            return std::make_unique<LZ4Decoder>(output);
+        case kSyncFlagZstd:
+            return std::make_unique<ZstdDecoder>(output);
+        default:
+            LOG(FATAL) << "unexpected compression flag: " << compression;
+            return nullptr;
+    }
+}
+
+static std::unique_ptr<Encoder> create_encoder(SyncFlag compression) {
+    switch (compression) {
+        case kSyncFlagBrotli:
+            return std::make_unique<BrotliEncoder>(SYNC_DATA_MAX);
+        case kSyncFlagLZ4:
+            return std::make_unique<LZ4Encoder>(SYNC_DATA_MAX);
+        case kSyncFlagZstd:
+            return std::make_unique<ZstdEncoder>(SYNC_DATA_MAX);
+        default:
+            LOG(FATAL) << "unexpected compression flag: " << compression;
+            return nullptr;
+    }
+}
+
+static bool handle_send_file_compressed(borrowed_fd s, unique_fd fd, uint32_t* timestamp,
+                                        SyncFlag compression) {
     syncmsg msg;
     Block decode_buffer(SYNC_DATA_MAX);
-    BrotliDecoder decoder(std::span(decode_buffer.data(), decode_buffer.size()));
+    std::unique_ptr<Decoder> decoder =
+            create_decoder(compression, std::span(decode_buffer.data(), decode_buffer.size()));
     while (true) {
         if (!ReadFdExactly(s, &msg.data, sizeof(msg.data))) return false;
 
@@ -284,12 +335,12 @@ static bool handle_send_file_compressed(borrowed_fd s, unique_fd fd, uint32_t* t
 
         Block block(msg.data.size);
         if (!ReadFdExactly(s, block.data(), msg.data.size)) return false;
-        decoder.Append(std::move(block));
+        decoder->Append(std::move(block));
 
         while (true) {
             std::span<char> output;
-            BrotliDecodeResult result = decoder.Decode(&output);
-            if (result == BrotliDecodeResult::Error) {
+            DecodeResult result = decoder->Decode(&output);
+            if (result == DecodeResult::Error) {
                 SendSyncFailErrno(s, "decompress failed");
                 return false;
             }
@@ -299,14 +350,14 @@ static bool handle_send_file_compressed(borrowed_fd s, unique_fd fd, uint32_t* t
                 return false;
             }
 
-            if (result == BrotliDecodeResult::NeedInput) {
+            if (result == DecodeResult::NeedInput) {
                 break;
-            } else if (result == BrotliDecodeResult::MoreOutput) {
+            } else if (result == DecodeResult::MoreOutput) {
                 continue;
-            } else if (result == BrotliDecodeResult::Done) {
+            } else if (result == DecodeResult::Done) {
                 break;
             } else {
-                LOG(FATAL) << "invalid BrotliDecodeResult: " << static_cast<int>(result);
+                LOG(FATAL) << "invalid DecodeResult: " << static_cast<int>(result);
             }
         }
     }
@@ -342,9 +393,70 @@ static bool handle_send_file_uncompressed(borrowed_fd s, unique_fd fd, uint32_t*
     }
 }
 
+// The previous contents of a file being replaced by a send_delta, which ID_COPY refers to.
+struct DeltaBase {
+    unique_fd fd;
+    uint64_t size;
+    uint32_t block_size;
+};
+
+static bool handle_send_file_delta(borrowed_fd s, unique_fd fd, uint32_t* timestamp,
+                                   const DeltaBase& base, std::vector<char>& buffer) {
+    syncmsg msg;
+    uint64_t block_count = base.size / base.block_size;
+
+    while (true) {
+        if (!ReadFdExactly(s, &msg.data, sizeof(msg.data))) return false;
+
+        if (msg.data.id == ID_DONE) {
+            *timestamp = msg.data.size;
+            return true;
+        } else if (msg.data.id == ID_DATA) {
+            if (msg.data.size > buffer.size()) {
+                SendSyncFail(s, "oversize data message");
+                return false;
+            }
+            if (!ReadFdExactly(s, &buffer[0], msg.data.size)) return false;
+            if (!WriteFdExactly(fd, &buffer[0], msg.data.size)) {
+                SendSyncFailErrno(s, "write failed");
+                return false;
+            }
+            continue;
+        } else if (msg.data.id != ID_COPY) {
+            SendSyncFail(s, "invalid data message");
+            return false;
+        }
+
+        // sync_copy starts out the same as sync_data, with the count in place of the size.
+        static_assert(offsetof(sync_copy, count) == offsetof(sync_data, size));
+        if (!ReadFdExactly(s, &msg.copy.block, sizeof(msg.copy.block))) return false;
+        if (msg.copy.block >= block_count || msg.copy.count > block_count - msg.copy.block) {
+            SendSyncFail(s, "copy out of range");
+            return false;
+        }
+
+        uint64_t offset = static_cast<uint64_t>(msg.copy.block) * base.block_size;
+        uint64_t end = offset + static_cast<uint64_t>(msg.copy.count) * base.block_size;
+        while (offset < end) {
+            size_t length = std::min<uint64_t>(end - offset, buffer.size());
+            int r = adb_pread(base.fd, &buffer[0], length, offset);
+            if (r <= 0) {
+                if (r == 0) errno = EIO;
+                SendSyncFailErrno(s, "read of existing file failed");
+                return false;
+            }
+            if (!WriteFdExactly(fd, &buffer[0], r)) {
+                SendSyncFailErrno(s, "write failed");
+                return false;
+            }
+            offset += r;
+        }
+    }
+}
+
 static bool handle_send_file(borrowed_fd s, const char* path, uint32_t* timestamp, uid_t uid,
-                             gid_t gid, uint64_t capabilities, mode_t mode, bool compressed,
-                             std::vector<char>& buffer, bool do_unlink) {
+                             gid_t gid, uint64_t capabilities, mode_t mode, SyncFlag compression,
+                             const DeltaBase* delta, std::vector<char>& buffer, bool do_unlink) {
     int rc;
     syncmsg msg;
 
@@ -390,8 +502,10 @@ static bool handle_send_file(borrowed_fd s, const char* path, uint32_t* timestam
         }
 
         bool result;
-        if (compressed) {
-            result = handle_send_file_compressed(s, std::move(fd), timestamp);
+        if (delta) {
+            result = handle_send_file_delta(s, std::move(fd), timestamp, *delta, buffer);
+        } else if (compression != kSyncFlagNone) {
+            result = handle_send_file_compressed(s, std::move(fd), timestamp, compression);
         } else {
             result = handle_send_file_uncompressed(s, std::move(fd), timestamp, buffer);
         }
@@ -499,8 +613,8 @@ static bool handle_send_link(int s, const std::string& path, uint32_t* timestamp
 }
 #endif
 
-static bool send_impl(int s, const std::string& path, mode_t mode, bool compressed,
-                      std::vector<char>& buffer) {
+static bool send_impl(int s, const std::string& path, mode_t mode, SyncFlag compression,
+                      const DeltaBase* delta, std::vector<char>& buffer) {
     // Don't delete files before copying if they are not "regular" or symlinks.
     struct stat st;
     bool do_unlink = (lstat(path.c_str(), &st) == -1) || S_ISREG(st.st_mode) ||
@@ -527,7 +641,7 @@ static bool send_impl(int s, const std::string& path, mode_t mode, bool compress
         }
 
         result = handle_send_file(s, path.c_str(), &timestamp, uid, gid, capabilities, mode,
-                                  compressed, buffer, do_unlink);
+                                  compression, delta, buffer, do_unlink);
     }
 
     if (!result) {
@@ -560,7 +674,7 @@ static bool do_send_v1(int s, const std::string& spec, std::vector<char>& buffer
         return false;
     }
 
-    return send_impl(s, path, mode, false, buffer);
+    return send_impl(s, path, mode, kSyncFlagNone, nullptr, buffer);
 }
 
 static bool do_send_v2(int s, const std::string& path, std::vector<char>& buffer) {
@@ -574,24 +688,92 @@ static bool do_send_v2(int s, const std::string& path, std::vector<char>& buffer
         PLOG(ERROR) << "failed to read send_v2 setup packet";
     }
 
-    bool compressed = false;
-    if (msg.send_v2_setup.flags & kSyncFlagBrotli) {
-        msg.send_v2_setup.flags &= ~kSyncFlagBrotli;
-        compressed = true;
+    SyncFlag compression;
+    if (!parse_compression_flags(s, msg.send_v2_setup.flags, &compression)) {
+        return false;
     }
-    if (msg.send_v2_setup.flags) {
-        SendSyncFail(s, android::base::StringPrintf("unknown flags: %d", msg.send_v2_setup.flags));
+
+    errno = 0;
+    return send_impl(s, path, msg.send_v2_setup.mode, compression, nullptr, buffer);
+}
+
+static bool do_signature(borrowed_fd s, const char* path) {
+    syncmsg msg = {};
+    msg.signature.id = ID_SIGNATURE;
+
+    unique_fd fd(adb_open(path, O_RDONLY | O_CLOEXEC));
+    struct stat st;
+    if (fd < 0 || fstat(fd.get(), &st) == -1) {
+        msg.signature.error = errno_to_wire(errno);
+        return WriteFdExactly(s, &msg.signature, sizeof(msg.signature));
+    }
+    if (!S_ISREG(st.st_mode)) {
+        msg.signature.error = errno_to_wire(EINVAL);
+        return WriteFdExactly(s, &msg.signature, sizeof(msg.signature));
+    }
+
+    uint32_t block_size = sync_delta_block_size(st.st_size);
+    msg.signature.size = st.st_size;
+    msg.signature.block_size = block_size;
+    msg.signature.block_count = st.st_size / block_size;
+    if (!WriteFdExactly(s, &msg.signature, sizeof(msg.signature))) {
+        return false;
+    }
+
+    // Having promised block_count sums we have to deliver them; should the file shrink under us,
+    // the sums of the missing blocks just won't match anything.
+    std::vector<char> block(block_size);
+    std::vector<sync_block_sum> sums;
+    sums.reserve(SYNC_DATA_MAX / sizeof(sync_block_sum));
+    for (uint32_t i = 0; i < msg.signature.block_count; ++i) {
+        if (!android::base::ReadFully(fd, block.data(), block_size)) {
+            memset(block.data(), 0, block_size);
+        }
+        sums.push_back(sync_delta_block_sum(block.data(), block_size));
+        if (sums.size() == sums.capacity() || i + 1 == msg.signature.block_count) {
+            if (!WriteFdExactly(s, sums.data(), sums.size() * sizeof(sync_block_sum))) {
+                return false;
+            }
+            sums.clear();
+        }
+    }
+    return true;
+}
+
+static bool do_send_delta(int s, const std::string& path, std::vector<char>& buffer) {
+    syncmsg msg;
+    int rc = ReadFdExactly(s, &msg.send_delta_setup, sizeof(msg.send_delta_setup));
+    if (rc == 0) {
+        LOG(ERROR) << "failed to read send_delta setup packet: EOF";
+        return false;
+    } else if (rc < 0) {
+        PLOG(ERROR) << "failed to read send_delta setup packet";
+    }
+
+    // send_impl unlinks the file before creating the new one, but this keeps the old contents
+    // around until we're done copying from them.
+    DeltaBase base;
+    base.fd.reset(adb_open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    struct stat st;
+    if (base.fd < 0 || fstat(base.fd.get(), &st) == -1) {
+        SendSyncFailErrno(s, "open of existing file failed");
+        return false;
+    }
+    base.size = st.st_size;
+    base.block_size = msg.send_delta_setup.block_size;
+    if (!S_ISREG(st.st_mode) || base.size != msg.send_delta_setup.base_size ||
+        base.block_size != sync_delta_block_size(base.size)) {
+        SendSyncFail(s, "existing file changed since ID_SIGNATURE");
         return false;
     }
 
     errno = 0;
-    return send_impl(s, path, msg.send_v2_setup.mode, compressed, buffer);
+    return send_impl(s, path, msg.send_delta_setup.mode, kSyncFlagNone, &base, buffer);
 }
 
 static bool recv_uncompressed(borrowed_fd s, unique_fd fd, std::vector<char>& buffer) {
     syncmsg msg;
     msg.data.id = ID_DATA;
-    std::optional<BrotliEncoder<SYNC_DATA_MAX>> encoder;
     while (true) {
         int r = adb_read(fd.get(), &buffer[0], buffer.size() - sizeof(msg.data));
         if (r <= 0) {
@@ -609,11 +791,11 @@ static bool recv_uncompressed(borrowed_fd s, unique_fd fd, std::vector<char>& bu
     return true;
 }
 
-static bool recv_compressed(borrowed_fd s, unique_fd fd) {
+static bool recv_compressed(borrowed_fd s, unique_fd fd, SyncFlag compression) {
     syncmsg msg;
     msg.data.id = ID_DATA;
 
-    BrotliEncoder<SYNC_DATA_MAX> encoder;
+    std::unique_ptr<Encoder> encoder = create_encoder(compression);
 
     bool sending = true;
     while (sending) {
@@ -625,16 +807,16 @@ static bool recv_compressed(borrowed_fd s, unique_fd fd) {
         }
 
         if (r == 0) {
-            encoder.Finish();
+            encoder->Finish();
         } else {
             input.resize(r);
-            encoder.Append(std::move(input));
+            encoder->Append(std::move(input));
         }
 
         while (true) {
             Block output;
-            BrotliEncodeResult result = encoder.Encode(&output);
-            if (result == BrotliEncodeResult::Error) {
+            EncodeResult result = encoder->Encode(&output);
+            if (result == EncodeResult::Error) {
                 SendSyncFailErrno(s, "compress failed");
                 return false;
             }
@@ -647,12 +829,12 @@ static bool recv_compressed(borrowed_fd s, unique_fd fd) {
                 }
             }
 
-            if (result == BrotliEncodeResult::Done) {
+            if (result == EncodeResult::Done) {
                 sending = false;
                 break;
-            } else if (result == BrotliEncodeResult::NeedInput) {
+            } else if (result == EncodeResult::NeedInput) {
                 break;
-            } else if (result == BrotliEncodeResult::MoreOutput) {
+            } else if (result == EncodeResult::MoreOutput) {
                 continue;
             }
         }
@@ -661,7 +843,8 @@ static bool recv_compressed(borrowed_fd s, unique_fd fd) {
     return true;
 }
 
-static bool recv_impl(borrowed_fd s, const char* path, bool compressed, std::vector<char>& buffer) {
+static bool recv_impl(borrowed_fd s, const char* path, SyncFlag compression,
+                      std::vector<char>& buffer) {
     __android_log_security_bswrite(SEC_TAG_ADB_RECV_FILE, path);
 
     unique_fd fd(adb_open(path, O_RDONLY | O_CLOEXEC));
@@ -676,8 +859,8 @@ static bool recv_impl(borrowed_fd s, const char* path, bool compressed, std::vec
     }
 
     bool result;
-    if (compressed) {
-        result = recv_compressed(s, std::move(fd));
+    if (compression != kSyncFlagNone) {
+        result = recv_compressed(s, std::move(fd), compression);
     } else {
         result = recv_uncompressed(s, std::move(fd), buffer);
     }
@@ -693,7 +876,7 @@ static bool recv_impl(borrowed_fd s, const char* path, bool compressed, std::vec
 }
 
 static bool do_recv_v1(borrowed_fd s, const char* path, std::vector<char>& buffer) {
-    return recv_impl(s, path, false, buffer);
+    return recv_impl(s, path, kSyncFlagNone, buffer);
 }
 
 static bool do_recv_v2(borrowed_fd s, const char* path, std::vector<char>& buffer) {
@@ -707,17 +890,12 @@ static bool do_recv_v2(borrowed_fd s, const char* path, std::vector<char>& buffe
         PLOG(ERROR) << "failed to read recv_v2 setup packet";
     }
 
-    bool compressed = false;
-    if (msg.recv_v2_setup.flags & kSyncFlagBrotli) {
-        msg.recv_v2_setup.flags &= ~kSyncFlagBrotli;
-        compressed = true;
-    }
-    if (msg.recv_v2_setup.flags) {
-        SendSyncFail(s, android::base::StringPrintf("unknown flags: %d", msg.recv_v2_setup.flags));
+    SyncFlag compression;
+    if (!parse_compression_flags(s, msg.recv_v2_setup.flags, &compression)) {
         return false;
     }
 
-    return recv_impl(s, path, compressed, buffer);
+    return recv_impl(s, path, compression, buffer);
 }
 
 static const char* sync_id_to_name(uint32_t id) {
@@ -740,6 +918,10 @@ static const char* sync_id_to_name(uint32_t id) {
         return "recv_v1";
     case ID_RECV_V2:
         return "recv_v2";
+    case ID_SIGNATURE:
+        return "signature";
+    case ID_SEND_DELTA:
+        return "send_delta";
     case ID_QUIT:
         return "quit";
     default:
@@ -796,6 +978,12 @@ static bool handle_sync_command(int fd, std::vector<char>& buffer) {
         case ID_RECV_V2:
             if (!do_recv_v2(fd, name, buffer)) return false;
             break;
+        case ID_SIGNATURE:
+            if (!do_signature(fd, name)) return false;
+            break;
+        case ID_SEND_DELTA:
+            if (!do_send_delta(fd, name, buffer)) return false;
+            break;
         case ID_QUIT:
             return false;
         default:
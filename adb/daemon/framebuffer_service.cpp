@@ -28,6 +28,12 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include <chrono>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <lz4.h>
+
 #include "sysdeps.h"
 
 #include "adb.h"
@@ -57,6 +63,89 @@ struct fbinfo {
     unsigned int alpha_length;
 } __attribute__((packed));
 
+/* Describes the format screencap reported; returns false if it isn't one we know. */
+static bool fill_fbinfo(int w, int h, int f, int c, struct fbinfo* fbinfo) {
+    fbinfo->version = DDMS_RAWIMAGE_VERSION;
+    fbinfo->colorSpace = c;
+    /* see hardware/hardware.h */
+    switch (f) {
+        case 1: /* RGBA_8888 */
+            fbinfo->bpp = 32;
+            fbinfo->size = w * h * 4;
+            fbinfo->width = w;
+            fbinfo->height = h;
+            fbinfo->red_offset = 0;
+            fbinfo->red_length = 8;
+            fbinfo->green_offset = 8;
+            fbinfo->green_length = 8;
+            fbinfo->blue_offset = 16;
+            fbinfo->blue_length = 8;
+            fbinfo->alpha_offset = 24;
+            fbinfo->alpha_length = 8;
+            break;
+        case 2: /* RGBX_8888 */
+            fbinfo->bpp = 32;
+            fbinfo->size = w * h * 4;
+            fbinfo->width = w;
+            fbinfo->height = h;
+            fbinfo->red_offset = 0;
+            fbinfo->red_length = 8;
+            fbinfo->green_offset = 8;
+            fbinfo->green_length = 8;
+            fbinfo->blue_offset = 16;
+            fbinfo->blue_length = 8;
+            fbinfo->alpha_offset = 24;
+            fbinfo->alpha_length = 0;
+            break;
+        case 3: /* RGB_888 */
+            fbinfo->bpp = 24;
+            fbinfo->size = w * h * 3;
+            fbinfo->width = w;
+            fbinfo->height = h;
+            fbinfo->red_offset = 0;
+            fbinfo->red_length = 8;
+            fbinfo->green_offset = 8;
+            fbinfo->green_length = 8;
+            fbinfo->blue_offset = 16;
+            fbinfo->blue_length = 8;
+            fbinfo->alpha_offset = 24;
+            fbinfo->alpha_length = 0;
+            break;
+        case 4: /* RGB_565 */
+            fbinfo->bpp = 16;
+            fbinfo->size = w * h * 2;
+            fbinfo->width = w;
+            fbinfo->height = h;
+            fbinfo->red_offset = 11;
+            fbinfo->red_length = 5;
+            fbinfo->green_offset = 5;
+            fbinfo->green_length = 6;
+            fbinfo->blue_offset = 0;
+            fbinfo->blue_length = 5;
+            fbinfo->alpha_offset = 0;
+            fbinfo->alpha_length = 0;
+            break;
+        case 5: /* BGRA_8888 */
+            fbinfo->bpp = 32;
+            fbinfo->size = w * h * 4;
+            fbinfo->width = w;
+            fbinfo->height = h;
+            fbinfo->red_offset = 16;
+            fbinfo->red_length = 8;
+            fbinfo->green_offset = 8;
+            fbinfo->green_length = 8;
+            fbinfo->blue_offset = 0;
+            fbinfo->blue_length = 8;
+            fbinfo->alpha_offset = 24;
+            fbinfo->alpha_length = 8;
+           break;
+        default:
+            return false;
+    }
+
+    return true;
+}
+
 void framebuffer_service(unique_fd fd) {
     struct fbinfo fbinfo;
     unsigned int i, bsize;
@@ -90,83 +179,7 @@ void framebuffer_service(unique_fd fd) {
     if(!ReadFdExactly(fd_screencap, &f, 4)) goto done;
     if(!ReadFdExactly(fd_screencap, &c, 4)) goto done;
 
-    fbinfo.version = DDMS_RAWIMAGE_VERSION;
-    fbinfo.colorSpace = c;
-    /* see hardware/hardware.h */
-    switch (f) {
-        case 1: /* RGBA_8888 */
-            fbinfo.bpp = 32;
-            fbinfo.size = w * h * 4;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 0;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 16;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 8;
-            break;
-        case 2: /* RGBX_8888 */
-            fbinfo.bpp = 32;
-            fbinfo.size = w * h * 4;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 0;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 16;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 0;
-            break;
-        case 3: /* RGB_888 */
-            fbinfo.bpp = 24;
-            fbinfo.size = w * h * 3;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 0;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 16;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 0;
-            break;
-        case 4: /* RGB_565 */
-            fbinfo.bpp = 16;
-            fbinfo.size = w * h * 2;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 11;
-            fbinfo.red_length = 5;
-            fbinfo.green_offset = 5;
-            fbinfo.green_length = 6;
-            fbinfo.blue_offset = 0;
-            fbinfo.blue_length = 5;
-            fbinfo.alpha_offset = 0;
-            fbinfo.alpha_length = 0;
-            break;
-        case 5: /* BGRA_8888 */
-            fbinfo.bpp = 32;
-            fbinfo.size = w * h * 4;
-            fbinfo.width = w;
-            fbinfo.height = h;
-            fbinfo.red_offset = 16;
-            fbinfo.red_length = 8;
-            fbinfo.green_offset = 8;
-            fbinfo.green_length = 8;
-            fbinfo.blue_offset = 0;
-            fbinfo.blue_length = 8;
-            fbinfo.alpha_offset = 24;
-            fbinfo.alpha_length = 8;
-           break;
-        default:
-            goto done;
-    }
+    if (!fill_fbinfo(w, h, f, c, &fbinfo)) goto done;
 
     /* write header */
     if (!WriteFdExactly(fd.get(), &fbinfo, sizeof(fbinfo))) goto done;
@@ -185,3 +198,136 @@ done:
 
     TEMP_FAILURE_RETRY(waitpid(pid, nullptr, 0));
 }
+
+/* Runs screencap once, filling in |fbinfo| and the frame's |pixels|. */
+static bool capture_screen(struct fbinfo* fbinfo, std::vector<char>* pixels) {
+    unique_fd read_end, write_end;
+    if (!Pipe(&read_end, &write_end)) return false;
+
+    pid_t pid = fork();
+    if (pid < 0) return false;
+
+    if (pid == 0) {
+        dup2(write_end.get(), STDOUT_FILENO);
+        read_end.reset();
+        write_end.reset();
+        const char* command = "screencap";
+        const char *args[2] = {command, nullptr};
+        execvp(command, (char**)args);
+        perror_exit("exec screencap failed");
+    }
+    write_end.reset();
+
+    int header[4];
+    bool ok = ReadFdExactly(read_end, header, sizeof(header)) &&
+              fill_fbinfo(header[0], header[1], header[2], header[3], fbinfo);
+    if (ok) {
+        pixels->resize(fbinfo->size);
+        ok = ReadFdExactly(read_end, pixels->data(), pixels->size());
+    }
+
+    read_end.reset();
+    TEMP_FAILURE_RETRY(waitpid(pid, nullptr, 0));
+    return ok;
+}
+
+struct fbframe {
+    unsigned int x;
+    unsigned int y;
+    unsigned int width;
+    unsigned int height;
+    unsigned int compressed_size;
+} __attribute__((packed));
+
+/* Finds the smallest rectangle covering every pixel that differs between |previous| and
+   |current|. Returns false if the frames are the same. */
+static bool find_damage(const struct fbinfo& fbinfo, const std::vector<char>& previous,
+                        const std::vector<char>& current, struct fbframe* frame) {
+    const size_t pixel_size = fbinfo.bpp / 8;
+    const size_t stride = fbinfo.width * pixel_size;
+
+    size_t top = 0;
+    while (top < fbinfo.height && !memcmp(&previous[top * stride], &current[top * stride], stride)) {
+        ++top;
+    }
+    if (top == fbinfo.height) return false;
+
+    size_t bottom = fbinfo.height - 1;
+    while (bottom > top &&
+           !memcmp(&previous[bottom * stride], &current[bottom * stride], stride)) {
+        --bottom;
+    }
+
+    size_t left = stride;
+    size_t right = 0;
+    for (size_t row = top; row <= bottom; ++row) {
+        const char* a = &previous[row * stride];
+        const char* b = &current[row * stride];
+        size_t first = 0;
+        while (first < left && a[first] == b[first]) ++first;
+        left = std::min(left, first);
+        size_t last = stride;
+        while (last > right && a[last - 1] == b[last - 1]) --last;
+        right = std::max(right, last);
+    }
+
+    frame->x = left / pixel_size;
+    frame->y = top;
+    frame->width = (right + pixel_size - 1) / pixel_size - frame->x;
+    frame->height = bottom - top + 1;
+    return true;
+}
+
+void framebuffer_stream_service(unique_fd fd, std::chrono::milliseconds interval) {
+    struct fbinfo fbinfo;
+    std::vector<char> previous;
+    std::vector<char> current;
+    if (!capture_screen(&fbinfo, &current)) return;
+    if (!WriteFdExactly(fd.get(), &fbinfo, sizeof(fbinfo))) return;
+
+    const size_t pixel_size = fbinfo.bpp / 8;
+    const size_t stride = fbinfo.width * pixel_size;
+    std::vector<char> damage(fbinfo.size);
+    std::vector<char> compressed(LZ4_compressBound(fbinfo.size));
+
+    struct fbframe frame = {0, 0, fbinfo.width, fbinfo.height, 0};
+    while (true) {
+        auto start = std::chrono::steady_clock::now();
+
+        if (previous.empty() || find_damage(fbinfo, previous, current, &frame)) {
+            /* Gather the damaged rows into one contiguous block and compress that. */
+            const size_t row_size = frame.width * pixel_size;
+            for (size_t row = 0; row < frame.height; ++row) {
+                memcpy(&damage[row * row_size],
+                       &current[(frame.y + row) * stride + frame.x * pixel_size], row_size);
+            }
+            int compressed_size = LZ4_compress_default(damage.data(), compressed.data(),
+                                                       row_size * frame.height, compressed.size());
+            if (compressed_size <= 0) {
+                LOG(ERROR) << "failed to compress framebuffer";
+                return;
+            }
+            frame.compressed_size = compressed_size;
+            if (!WriteFdExactly(fd.get(), &frame, sizeof(frame)) ||
+                !WriteFdExactly(fd.get(), compressed.data(), compressed_size)) {
+                return;
+            }
+        }
+
+        /* Wait out the rest of the interval, stopping if the client closes the stream. */
+        auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+                start + interval - std::chrono::steady_clock::now());
+        adb_pollfd pfd = {.fd = fd.get(), .events = POLLIN, .revents = 0};
+        int rc = adb_poll(&pfd, 1, std::max<int>(0, remaining.count()));
+        if (rc < 0 && errno != EINTR) return;
+        if (rc > 0) return;
+
+        std::swap(previous, current);
+        struct fbinfo next;
+        if (!capture_screen(&next, &current)) return;
+        if (memcmp(&next, &fbinfo, sizeof(fbinfo))) {
+            /* The display changed shape; the client has to start over with the new header. */
+            return;
+        }
+    }
+}
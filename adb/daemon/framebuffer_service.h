@@ -16,8 +16,12 @@
 
 #pragma once
 
+#include <chrono>
+
 #include "adb_unique_fd.h"
 
 #if defined(__ANDROID__)
 void framebuffer_service(unique_fd fd);
+// Streams LZ4 compressed changes to the screen, at most one frame per |interval|.
+void framebuffer_stream_service(unique_fd fd, std::chrono::milliseconds interval);
 #endif
@@ -28,13 +28,17 @@
 #include <sys/un.h>
 #include <unistd.h>
 
-#include <list>
+#include <algorithm>
 #include <memory>
+#include <string>
+#include <string_view>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include <adbconnection/server.h>
 #include <android-base/cmsg.h>
+#include <android-base/stringprintf.h>
 #include <android-base/unique_fd.h>
 
 #include "adb.h"
@@ -133,10 +137,10 @@ using android::base::unique_fd;
  **/
 
 static void jdwp_process_event(int socket, unsigned events, void* _proc);
-static void jdwp_process_list_updated(void);
+static void jdwp_process_list_updated(pid_t pid, bool added);
 
 struct JdwpProcess;
-static auto& _jdwp_list = *new std::list<std::unique_ptr<JdwpProcess>>();
+static auto& _jdwp_processes = *new std::unordered_map<pid_t, std::unique_ptr<JdwpProcess>>();
 
 struct JdwpProcess {
     JdwpProcess(unique_fd socket, pid_t pid) {
@@ -165,11 +169,6 @@ struct JdwpProcess {
         out_fds.clear();
     }
 
-    void RemoveFromList() {
-        auto pred = [this](const auto& proc) { return proc.get() == this; };
-        _jdwp_list.remove_if(pred);
-    }
-
     borrowed_fd socket = -1;
     int32_t pid = -1;
     fdevent* fde = nullptr;
@@ -180,8 +179,8 @@ struct JdwpProcess {
 static size_t jdwp_process_list(char* buffer, size_t bufferlen) {
     std::string temp;
 
-    for (auto& proc : _jdwp_list) {
-        std::string next = std::to_string(proc->pid) + "\n";
+    for (const auto& [pid, proc] : _jdwp_processes) {
+        std::string next = std::to_string(pid) + "\n";
         if (temp.length() + next.length() > bufferlen) {
             D("truncating JDWP process list (max len = %zu)", bufferlen);
             break;
@@ -193,12 +192,16 @@ static size_t jdwp_process_list(char* buffer, size_t bufferlen) {
     return temp.length();
 }
 
+// Messages to trackers are length-prefixed with 4 hex digits in ASCII.
+static constexpr size_t kTrackerHeaderLength = 4;
+static constexpr size_t kMaxTrackerMessageLength = kTrackerHeaderLength + 0xffff;
+
 static size_t jdwp_process_list_msg(char* buffer, size_t bufferlen) {
-    // Message is length-prefixed with 4 hex digits in ASCII.
-    static constexpr size_t header_len = 4;
+    static constexpr size_t header_len = kTrackerHeaderLength;
     if (bufferlen < header_len) {
         LOG(FATAL) << "invalid JDWP process list buffer size: " << bufferlen;
     }
+    bufferlen = std::min(bufferlen, kMaxTrackerMessageLength);
 
     char head[header_len + 1];
     size_t len = jdwp_process_list(buffer + header_len, bufferlen - header_len);
@@ -238,33 +241,34 @@ static void jdwp_process_event(int socket, unsigned events, void* _proc) {
     return;
 
 CloseProcess:
-    proc->RemoveFromList();
-    jdwp_process_list_updated();
+    pid_t pid = proc->pid;
+    _jdwp_processes.erase(pid);
+    jdwp_process_list_updated(pid, false);
 }
 
 unique_fd create_jdwp_connection_fd(int pid) {
     D("looking for pid %d in JDWP process list", pid);
 
-    for (auto& proc : _jdwp_list) {
-        if (proc->pid == pid) {
-            int fds[2];
-
-            if (adb_socketpair(fds) < 0) {
-                D("%s: socket pair creation failed: %s", __FUNCTION__, strerror(errno));
-                return unique_fd{};
-            }
-            D("socketpair: (%d,%d)", fds[0], fds[1]);
+    auto it = _jdwp_processes.find(pid);
+    if (it == _jdwp_processes.end()) {
+        D("search failed !!");
+        return unique_fd{};
+    }
+    JdwpProcess* proc = it->second.get();
 
-            proc->out_fds.emplace_back(fds[1]);
-            if (proc->out_fds.size() == 1) {
-                fdevent_add(proc->fde, FDE_WRITE);
-            }
+    int fds[2];
+    if (adb_socketpair(fds) < 0) {
+        D("%s: socket pair creation failed: %s", __FUNCTION__, strerror(errno));
+        return unique_fd{};
+    }
+    D("socketpair: (%d,%d)", fds[0], fds[1]);
 
-            return unique_fd{fds[0]};
-        }
+    proc->out_fds.emplace_back(fds[1]);
+    if (proc->out_fds.size() == 1) {
+        fdevent_add(proc->fde, FDE_WRITE);
     }
-    D("search failed !!");
-    return unique_fd{};
+
+    return unique_fd{fds[0]};
 }
 
 /** "jdwp" local service implementation
@@ -332,29 +336,69 @@ asocket* create_jdwp_service_socket(void) {
     return s;
 }
 
-/** "track-jdwp" local service implementation
- ** this periodically sends the list of known JDWP process pids
- ** to the client...
+/** "track-jdwp" and "track-jdwp-delta" local service implementation
+ ** this sends the list of known JDWP process pids to the client,
+ ** and then either the whole list again or just the changes to it
+ ** whenever processes come and go...
  **/
 
 struct JdwpTracker : public asocket {
     bool need_initial;
+    bool delta;
 };
 
 static auto& _jdwp_trackers = *new std::vector<std::unique_ptr<JdwpTracker>>();
 
-static void jdwp_process_list_updated(void) {
-    std::string data;
-    data.resize(1024);
-    data.resize(jdwp_process_list_msg(&data[0], data.size()));
+// Changes to the process list that trackers haven't been sent yet, as "+<pid>\n" and "-<pid>\n"
+// lines. They're sent in one go once the main thread is done with its current batch of events,
+// so a burst of processes starting or dying costs each tracker a message rather than one each.
+static auto& _jdwp_pending_deltas = *new std::string();
+static bool _jdwp_update_scheduled = false;
+
+// Sends |lines| to a delta tracker, split into as few messages as the transport allows. An empty
+// message is still sent if there are no lines.
+static void jdwp_tracker_send_deltas(JdwpTracker* t, std::string_view lines) {
+    size_t max_len = std::min(t->get_max_payload(), kMaxTrackerMessageLength) -
+                     kTrackerHeaderLength;
+    do {
+        size_t len = lines.size();
+        if (len > max_len) {
+            len = lines.rfind('\n', max_len - 1) + 1;
+        }
+        std::string msg = android::base::StringPrintf("%04zx", len);
+        msg.append(lines.substr(0, len));
+        lines.remove_prefix(len);
+        t->peer->enqueue(t->peer, apacket::payload_type(msg.begin(), msg.end()));
+    } while (!lines.empty());
+}
+
+static void jdwp_trackers_update(void) {
+    _jdwp_update_scheduled = false;
 
     for (auto& t : _jdwp_trackers) {
-        if (t->peer) {
-            // The tracker might not have been connected yet.
-            apacket::payload_type payload(data.begin(), data.end());
-            t->peer->enqueue(t->peer, std::move(payload));
+        // The tracker might not have been connected yet, in which case it will be sent the whole
+        // list once it is.
+        if (!t->peer || t->need_initial) {
+            continue;
+        }
+        if (t->delta) {
+            jdwp_tracker_send_deltas(t.get(), _jdwp_pending_deltas);
+        } else {
+            apacket::payload_type data;
+            data.resize(t->get_max_payload());
+            data.resize(jdwp_process_list_msg(&data[0], data.size()));
+            t->peer->enqueue(t->peer, std::move(data));
         }
     }
+    _jdwp_pending_deltas.clear();
+}
+
+static void jdwp_process_list_updated(pid_t pid, bool added) {
+    _jdwp_pending_deltas.append(android::base::StringPrintf("%c%d\n", added ? '+' : '-', pid));
+    if (!_jdwp_update_scheduled) {
+        _jdwp_update_scheduled = true;
+        fdevent_run_on_main_thread(jdwp_trackers_update);
+    }
 }
 
 static void jdwp_tracker_close(asocket* s) {
@@ -378,10 +422,20 @@ static void jdwp_tracker_ready(asocket* s) {
     JdwpTracker* t = (JdwpTracker*)s;
 
     if (t->need_initial) {
+        t->need_initial = false;
+        if (t->delta) {
+            // The whole list, as if every process had just been added.
+            std::string lines;
+            for (const auto& [pid, proc] : _jdwp_processes) {
+                lines.append(android::base::StringPrintf("+%d\n", pid));
+            }
+            jdwp_tracker_send_deltas(t, lines);
+            return;
+        }
+
         apacket::payload_type data;
         data.resize(s->get_max_payload());
         data.resize(jdwp_process_list_msg(&data[0], data.size()));
-        t->need_initial = false;
         s->peer->enqueue(s->peer, std::move(data));
     }
 }
@@ -393,7 +447,7 @@ static int jdwp_tracker_enqueue(asocket* s, apacket::payload_type) {
     return -1;
 }
 
-asocket* create_jdwp_tracker_service_socket(void) {
+asocket* create_jdwp_tracker_service_socket(bool delta) {
     auto t = std::make_unique<JdwpTracker>();
     if (!t) {
         LOG(FATAL) << "failed to allocate JdwpTracker";
@@ -408,6 +462,7 @@ asocket* create_jdwp_tracker_service_socket(void) {
     t->enqueue = jdwp_tracker_enqueue;
     t->close = jdwp_tracker_close;
     t->need_initial = true;
+    t->delta = delta;
 
     asocket* result = t.get();
 
@@ -427,8 +482,12 @@ int init_jdwp(void) {
                 if (!proc) {
                     LOG(FATAL) << "failed to allocate JdwpProcess";
                 }
-                _jdwp_list.emplace_back(std::move(proc));
-                jdwp_process_list_updated();
+                // A process that connects again replaces its old connection.
+                bool added = _jdwp_processes.count(pid) == 0;
+                _jdwp_processes[pid] = std::move(proc);
+                if (added) {
+                    jdwp_process_list_updated(pid, true);
+                }
             });
         });
     }).detach();
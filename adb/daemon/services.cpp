@@ -240,7 +240,9 @@ asocket* daemon_service_to_socket(std::string_view name) {
     if (name == "jdwp") {
         return create_jdwp_service_socket();
     } else if (name == "track-jdwp") {
-        return create_jdwp_tracker_service_socket();
+        return create_jdwp_tracker_service_socket(false);
+    } else if (name == "track-jdwp-delta") {
+        return create_jdwp_tracker_service_socket(true);
     } else if (android::base::ConsumePrefix(&name, "sink:")) {
         uint64_t byte_count = 0;
         if (!ParseUint(&byte_count, name)) {
@@ -270,6 +272,14 @@ unique_fd daemon_service_to_fd(std::string_view name, atransport* transport) {
 #if defined(__ANDROID__)
     if (name.starts_with("framebuffer:")) {
         return create_service_thread("fb", framebuffer_service);
+    } else if (android::base::ConsumePrefix(&name, "framebuffer-stream:")) {
+        int interval_ms = 0;
+        if (!name.empty() && !android::base::ParseInt(std::string(name), &interval_ms, 0)) {
+            return unique_fd{};
+        }
+        return create_service_thread("fb stream", [interval_ms](unique_fd fd) {
+            framebuffer_stream_service(std::move(fd), std::chrono::milliseconds(interval_ms));
+        });
     } else if (android::base::ConsumePrefix(&name, "remount:")) {
         std::string cmd = "/system/bin/remount ";
         cmd += name;
@@ -82,11 +82,13 @@
 #include "shell_service.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <paths.h>
 #include <pty.h>
 #include <pwd.h>
 #include <termios.h>
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include <thread>
@@ -113,6 +115,11 @@
 
 namespace {
 
+// Subprocess output is held back for up to this long to fill a shell protocol packet, so commands
+// that write a lot in small chunks don't pay for a packet per write(), while interactive output
+// still shows up without a noticeable delay.
+constexpr auto kOutputCoalesceDelay = std::chrono::milliseconds(2);
+
 // Reads from |fd| until close or failure.
 std::string ReadAll(borrowed_fd fd) {
     char buffer[512];
@@ -197,6 +204,12 @@ class Subprocess {
     unique_fd* PassInput();
     unique_fd* PassOutput(unique_fd* sfd, ShellProtocol::Id id);
 
+    // Sends any output held back by PassOutput() as a single packet. Returns false if the
+    // protocol FD failed.
+    bool FlushOutput();
+    // Returns the poll() timeout until held back output is due, or -1 if there is none.
+    int OutputTimeout() const;
+
     const std::string command_;
     const std::string terminal_type_;
     SubprocessType type_;
@@ -210,6 +223,15 @@ class Subprocess {
     std::unique_ptr<ShellProtocol> input_, output_;
     size_t input_bytes_left_ = 0;
 
+    // Output read but not sent yet, and the stream it came from. It is either in |output_|, or,
+    // when the subprocess streams are sockets, spliced into |output_pipe_| so that it goes to
+    // the protocol FD without being copied through this thread.
+    ShellProtocol::Id output_id_ = ShellProtocol::kIdInvalid;
+    size_t output_bytes_ = 0;
+    size_t output_pipe_capacity_ = 0;
+    std::chrono::steady_clock::time_point output_deadline_;
+    unique_fd output_pipe_read_, output_pipe_write_;
+
     DISALLOW_COPY_AND_ASSIGN(Subprocess);
 };
 
@@ -494,6 +516,19 @@ bool Subprocess::ConnectProtocolEndpoints(std::string* _Nonnull error) {
                 }
             }
         }
+
+        // PTYs don't support splice(), so only raw subprocesses get a pipe for output. Without
+        // one, output is copied through |output_| instead.
+        if (type_ == SubprocessType::kRaw && Pipe(&output_pipe_read_, &output_pipe_write_)) {
+            fcntl(output_pipe_write_.get(), F_SETPIPE_SZ, MAX_PAYLOAD);
+            int pipe_size = fcntl(output_pipe_write_.get(), F_GETPIPE_SZ);
+            if (pipe_size > 0) {
+                output_pipe_capacity_ = std::min<size_t>(pipe_size, output_->data_capacity());
+            } else {
+                output_pipe_read_.reset();
+                output_pipe_write_.reset();
+            }
+        }
     }
 
     return true;
@@ -594,6 +629,10 @@ void Subprocess::PassDataStreams() {
             dead_sfd->reset();
         }
     }
+
+    if (protocol_sfd_ != -1 && !FlushOutput()) {
+        protocol_sfd_.reset();
+    }
 }
 
 unique_fd* Subprocess::PollLoop(SubprocessPollfds* pfds) {
@@ -604,7 +643,7 @@ unique_fd* Subprocess::PollLoop(SubprocessPollfds* pfds) {
 
     // Keep calling poll() and passing data until an FD closes/errors.
     while (!dead_sfd) {
-        if (adb_poll(pfds->data(), pfds->size(), -1) < 0) {
+        if (adb_poll(pfds->data(), pfds->size(), OutputTimeout()) < 0) {
             if (errno == EINTR) {
                 continue;
             } else {
@@ -645,6 +684,11 @@ unique_fd* Subprocess::PollLoop(SubprocessPollfds* pfds) {
             }
         }
 
+        if (!dead_sfd && output_bytes_ > 0 &&
+            std::chrono::steady_clock::now() >= output_deadline_ && !FlushOutput()) {
+            return &protocol_sfd_;
+        }
+
         // After handling all of the events we've received, check to see if any fds have died.
         if (stdinout_pfd.revents & (POLLHUP | POLLRDHUP | POLLERR | POLLNVAL)) {
             return &stdinout_sfd_;
@@ -731,7 +775,29 @@ unique_fd* Subprocess::PassInput() {
 }
 
 unique_fd* Subprocess::PassOutput(unique_fd* sfd, ShellProtocol::Id id) {
-    int bytes = adb_read(*sfd, output_->data(), output_->data_capacity());
+    // Keep the streams in order by sending what the other one had first.
+    if (output_bytes_ > 0 && output_id_ != id && !FlushOutput()) {
+        return &protocol_sfd_;
+    }
+
+    int bytes = -1;
+    if (output_pipe_write_ != -1) {
+        bytes = splice(sfd->get(), nullptr, output_pipe_write_.get(), nullptr,
+                       output_pipe_capacity_ - output_bytes_, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (bytes < 0 && errno == EINVAL) {
+            // Not something splice() can read from after all: fall back to copying.
+            D("can't splice from output FD %d", sfd->get());
+            if (!FlushOutput()) {
+                return &protocol_sfd_;
+            }
+            output_pipe_read_.reset();
+            output_pipe_write_.reset();
+        }
+    }
+    if (output_pipe_write_ == -1) {
+        bytes = adb_read(*sfd, output_->data() + output_bytes_,
+                         output_->data_capacity() - output_bytes_);
+    }
     if (bytes == 0 || (bytes < 0 && errno != EAGAIN)) {
         // read() returns EIO if a PTY closes; don't report this as an error,
         // it just means the subprocess completed.
@@ -740,17 +806,67 @@ unique_fd* Subprocess::PassOutput(unique_fd* sfd, ShellProtocol::Id id) {
         }
         return sfd;
     }
+    if (bytes < 0) {
+        return nullptr;
+    }
 
-    if (bytes > 0 && !output_->Write(id, bytes)) {
-        if (errno != 0) {
-            PLOG(ERROR) << "error reading protocol FD " << protocol_sfd_.get();
-        }
+    if (output_bytes_ == 0) {
+        output_id_ = id;
+        output_deadline_ = std::chrono::steady_clock::now() + kOutputCoalesceDelay;
+    }
+    output_bytes_ += bytes;
+
+    size_t capacity = output_pipe_write_ != -1 ? output_pipe_capacity_ : output_->data_capacity();
+    if (output_bytes_ == capacity && !FlushOutput()) {
         return &protocol_sfd_;
     }
 
     return nullptr;
 }
 
+bool Subprocess::FlushOutput() {
+    if (output_bytes_ == 0) {
+        return true;
+    }
+    size_t length = output_bytes_;
+    output_bytes_ = 0;
+
+    bool written;
+    if (output_pipe_read_ == -1) {
+        written = output_->Write(output_id_, length);
+    } else {
+        char header[sizeof(uint8_t) + sizeof(uint32_t)];
+        header[0] = output_id_;
+        uint32_t typed_length = length;
+        memcpy(&header[1], &typed_length, sizeof(typed_length));
+        written = WriteFdExactly(protocol_sfd_, header, sizeof(header));
+        while (written && length > 0) {
+            ssize_t spliced = TEMP_FAILURE_RETRY(splice(output_pipe_read_.get(), nullptr,
+                                                        protocol_sfd_.get(), nullptr, length,
+                                                        SPLICE_F_MOVE | SPLICE_F_MORE));
+            if (spliced <= 0) {
+                written = false;
+            } else {
+                length -= spliced;
+            }
+        }
+    }
+
+    if (!written && errno != 0) {
+        PLOG(ERROR) << "error writing protocol FD " << protocol_sfd_.get();
+    }
+    return written;
+}
+
+int Subprocess::OutputTimeout() const {
+    if (output_bytes_ == 0) {
+        return -1;
+    }
+    auto remaining = std::chrono::ceil<std::chrono::milliseconds>(
+            output_deadline_ - std::chrono::steady_clock::now());
+    return std::max<int>(0, remaining.count());
+}
+
 void Subprocess::WaitForExit() {
     int exit_code = 1;
 
@@ -123,7 +123,16 @@ struct IoBlock {
     TransferId id() const { return TransferId::from_value(control.aio_data); }
 };
 
-using IoReadBlock = IoBlock<Block>;
+// Reads normally land in the block's own payload. Once a packet header announces more payload
+// than the reads already in flight can hold, the reads submitted after it target the rest of the
+// packet's payload directly instead, see ProcessRead.
+struct IoReadBlock : public IoBlock<Block> {
+    bool in_place = false;
+    // Where in incoming_payload_ the read was aimed, and how much it got.
+    size_t offset = 0;
+    size_t length = 0;
+};
+
 using IoWriteBlock = IoBlock<std::shared_ptr<Block>>;
 
 struct ScopedAioContext {
@@ -487,12 +496,25 @@ struct UsbFfsConnection : public Connection {
 
     void PrepareReadBlock(IoReadBlock* block, uint64_t id) {
         block->pending = false;
+        block->control.aio_data = static_cast<uint64_t>(TransferId::read(id));
+
+        if (incoming_header_ && incoming_planned_ < incoming_header_->data_length) {
+            size_t len = std::min(kUsbReadSize, incoming_header_->data_length - incoming_planned_);
+            block->in_place = true;
+            block->offset = incoming_planned_;
+            block->control.aio_buf =
+                    reinterpret_cast<uintptr_t>(incoming_payload_.data() + incoming_planned_);
+            block->control.aio_nbytes = len;
+            incoming_planned_ += len;
+            return;
+        }
+
+        block->in_place = false;
         if (block->payload.capacity() >= kUsbReadSize) {
             block->payload.resize(kUsbReadSize);
         } else {
             block->payload = Block(kUsbReadSize);
         }
-        block->control.aio_data = static_cast<uint64_t>(TransferId::read(id));
         block->control.aio_buf = reinterpret_cast<uintptr_t>(block->payload.data());
         block->control.aio_nbytes = block->payload.size();
     }
@@ -547,7 +569,11 @@ struct UsbFfsConnection : public Connection {
         uint64_t read_idx = id.id % kUsbReadQueueDepth;
         IoReadBlock* block = &read_requests_[read_idx];
         block->pending = false;
-        block->payload.resize(size);
+        if (block->in_place) {
+            block->length = size;
+        } else {
+            block->payload.resize(size);
+        }
 
         // Notification for completed reads can be received out of order.
         if (block->id().id != needed_read_id_) {
@@ -572,7 +598,19 @@ struct UsbFfsConnection : public Connection {
     }
 
     bool ProcessRead(IoReadBlock* block) {
-        if (!block->payload.empty()) {
+        if (block->in_place) {
+            // Earlier short reads leave the data further along than it belongs, the regions of
+            // the reads still in flight all lie past it.
+            if (block->length > incoming_header_->data_length - incoming_size_) {
+                HandleError("received too many bytes while waiting for payload");
+                return false;
+            }
+            if (block->offset != incoming_size_) {
+                memmove(incoming_payload_.data() + incoming_size_,
+                        incoming_payload_.data() + block->offset, block->length);
+            }
+            incoming_size_ += block->length;
+        } else if (!block->payload.empty()) {
             if (!incoming_header_.has_value()) {
                 if (block->payload.size() != sizeof(amessage)) {
                     HandleError("received packet of unexpected length while reading header");
@@ -582,30 +620,36 @@ struct UsbFfsConnection : public Connection {
                 memcpy(&msg, block->payload.data(), sizeof(msg));
                 LOG(DEBUG) << "USB read:" << dump_header(&msg);
                 incoming_header_ = msg;
+
+                // Whatever the reads already in flight get has to be copied over, everything
+                // submitted from now on reads straight into place.
+                incoming_payload_ = Block(msg.data_length);
+                incoming_size_ = 0;
+                incoming_planned_ = std::min<size_t>(msg.data_length,
+                                                     (kUsbReadQueueDepth - 1) * kUsbReadSize);
             } else {
-                size_t bytes_left = incoming_header_->data_length - incoming_payload_.size();
+                size_t bytes_left = incoming_header_->data_length - incoming_size_;
                 if (block->payload.size() > bytes_left) {
                     HandleError("received too many bytes while waiting for payload");
                     return false;
                 }
-                incoming_payload_.append(std::move(block->payload));
+                memcpy(incoming_payload_.data() + incoming_size_, block->payload.data(),
+                       block->payload.size());
+                incoming_size_ += block->payload.size();
             }
+        }
 
-            if (incoming_header_->data_length == incoming_payload_.size()) {
-                auto packet = std::make_unique<apacket>();
-                packet->msg = *incoming_header_;
-
-                // TODO: Make apacket contain an IOVector so we don't have to coalesce.
-                packet->payload = std::move(incoming_payload_).coalesce();
-                read_callback_(this, std::move(packet));
-
-                incoming_header_.reset();
-                // reuse the capacity of the incoming payload while we can.
-                auto free_block = incoming_payload_.clear();
-                if (block->payload.capacity() == 0) {
-                    block->payload = std::move(free_block);
-                }
-            }
+        if (incoming_header_ && incoming_header_->data_length == incoming_size_) {
+            // No read can still be aimed at the payload: they were all submitted before the
+            // ones completing it.
+            auto packet = std::make_unique<apacket>();
+            packet->msg = *incoming_header_;
+            packet->payload = std::move(incoming_payload_);
+            read_callback_(this, std::move(packet));
+
+            incoming_header_.reset();
+            incoming_size_ = 0;
+            incoming_planned_ = 0;
         }
 
         PrepareReadBlock(block, block->id().id + kUsbReadQueueDepth);
@@ -718,7 +762,11 @@ struct UsbFfsConnection : public Connection {
     unique_fd write_fd_;
 
     std::optional<amessage> incoming_header_;
-    IOVector incoming_payload_;
+    // Payload of the packet being received, allocated once its header is in.
+    Block incoming_payload_;
+    size_t incoming_size_ = 0;
+    // Bytes of incoming_payload_ covered by reads submitted so far.
+    size_t incoming_planned_ = 0;
 
     std::array<IoReadBlock, kUsbReadQueueDepth> read_requests_;
     IOVector read_data_;
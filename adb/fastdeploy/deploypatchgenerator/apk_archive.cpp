@@ -35,9 +35,16 @@ static const uint32_t kGPBDDFlagMask = 0x0008;
 
 namespace {
 struct FileRegion {
-    FileRegion(borrowed_fd fd, off64_t offset, size_t length)
-        : mapped_(android::base::MappedFile::FromOsHandle(adb_get_os_handle(fd), offset, length,
-                                                          PROT_READ)) {
+    FileRegion(const android::base::MappedFile* archive, borrowed_fd fd, off64_t offset,
+               size_t length) {
+        if (archive != nullptr && offset >= 0 && size_t(offset) + length <= archive->size()) {
+            view_ = archive->data() + offset;
+            view_size_ = length;
+            return;
+        }
+
+        mapped_ = android::base::MappedFile::FromOsHandle(adb_get_os_handle(fd), offset, length,
+                                                          PROT_READ);
         if (mapped_ != nullptr) {
             return;
         }
@@ -52,13 +59,17 @@ struct FileRegion {
         }
     }
 
-    const char* data() const { return mapped_ ? mapped_->data() : buffer_.data(); }
-    size_t size() const { return mapped_ ? mapped_->size() : buffer_.size(); }
+    const char* data() const {
+        return view_ ? view_ : mapped_ ? mapped_->data() : buffer_.data();
+    }
+    size_t size() const { return view_ ? view_size_ : mapped_ ? mapped_->size() : buffer_.size(); }
 
   private:
     FileRegion() = default;
     DISALLOW_COPY_AND_ASSIGN(FileRegion);
 
+    const char* view_ = nullptr;
+    size_t view_size_ = 0;
     std::unique_ptr<android::base::MappedFile> mapped_;
     std::string buffer_;
 };
@@ -79,6 +90,11 @@ ApkArchive::ApkArchive(const std::string& path) : path_(path), size_(0) {
         return;
     }
     size_ = st.st_size;
+
+    if (size_ > 0) {
+        mapped_ = android::base::MappedFile::FromOsHandle(adb_get_os_handle(fd_), 0, size_,
+                                                          PROT_READ);
+    }
 }
 
 ApkArchive::~ApkArchive() {}
@@ -112,7 +128,7 @@ off_t ApkArchive::FindEndOfCDRecord() const {
 
     auto sizeToRead = std::min(size_, endOfCDMaxSize);
     auto readOffset = size_ - sizeToRead;
-    FileRegion mapped(fd_, readOffset, sizeToRead);
+    FileRegion mapped(mapped_.get(), fd_, readOffset, sizeToRead);
 
     // Start scanning from the end
     auto* start = mapped.data();
@@ -162,7 +178,7 @@ ApkArchive::Location ApkArchive::GetCDLocation() {
     }
 
     // Find Central Directory Record
-    FileRegion mapped(fd_, eocdRecord, cdEntryHeaderSizeBytes);
+    FileRegion mapped(mapped_.get(), fd_, eocdRecord, cdEntryHeaderSizeBytes);
     location = FindCDRecord(mapped.data());
     if (!location.valid) {
         fprintf(stderr, "Unable to find Central Directory File Header in file '%s'\n",
@@ -184,7 +200,7 @@ ApkArchive::Location ApkArchive::GetSignatureLocation(off_t cdRecordOffset) {
         return location;
     }
 
-    FileRegion mapped(fd_, signatureOffset, endOfSignatureSize);
+    FileRegion mapped(mapped_.get(), fd_, signatureOffset, endOfSignatureSize);
 
     uint64_t signatureSize = *(uint64_t*)mapped.data();
     auto* signature = mapped.data() + sizeof(signatureSize);
@@ -202,7 +218,7 @@ ApkArchive::Location ApkArchive::GetSignatureLocation(off_t cdRecordOffset) {
 }
 
 std::string ApkArchive::ReadMetadata(Location loc) const {
-    FileRegion mapped(fd_, loc.offset, loc.size);
+    FileRegion mapped(mapped_.get(), fd_, loc.offset, loc.size);
     return {mapped.data(), mapped.size()};
 }
 
@@ -277,9 +293,11 @@ size_t ApkArchive::ParseCentralDirectoryRecord(const char* input, size_t size, s
     auto end = begin + sizeof(*cdr) + cdr->file_name_length + cdr->extra_field_length +
                cdr->comment_length;
 
-    uint8_t md5Digest[MD5_DIGEST_LENGTH];
-    MD5((const unsigned char*)begin, end - begin, md5Digest);
-    md5Hash->assign((const char*)md5Digest, sizeof(md5Digest));
+    if (md5Hash != nullptr) {
+        uint8_t md5Digest[MD5_DIGEST_LENGTH];
+        MD5((const unsigned char*)begin, end - begin, md5Digest);
+        md5Hash->assign((const char*)md5Digest, sizeof(md5Digest));
+    }
 
     *localFileHeaderOffset = cdr->local_file_header_offset;
     *dataSize = (cdr->compression_method == kCompressStored) ? cdr->uncompressed_size
@@ -339,7 +357,7 @@ size_t ApkArchive::CalculateLocalFileEntrySize(int64_t localFileHeaderOffset,
         return 0;
     }
 
-    FileRegion lfhMapped(fd_, localFileHeaderOffset, sizeof(LocalFileHeader));
+    FileRegion lfhMapped(mapped_.get(), fd_, localFileHeaderOffset, sizeof(LocalFileHeader));
     lfh = reinterpret_cast<const LocalFileHeader*>(lfhMapped.data());
     if (lfh->lfh_signature != kLocalFileHeaderMagic) {
         fprintf(stderr, "Invalid Local File Header signature in file '%s' at offset %lld\n",
@@ -380,7 +398,8 @@ size_t ApkArchive::CalculateLocalFileEntrySize(int64_t localFileHeaderOffset,
             return 0;
         }
 
-        FileRegion ddMapped(fd_, ddOffset, sizeof(uint32_t) + sizeof(DataDescriptor));
+        FileRegion ddMapped(mapped_.get(), fd_, ddOffset,
+                            sizeof(uint32_t) + sizeof(DataDescriptor));
 
         off_t localDDOffset = 0;
         if (kOptionalDataDescriptorMagic == *(uint32_t*)ddMapped.data()) {
@@ -21,13 +21,15 @@
 #include <vector>
 
 #include <adb_unique_fd.h>
+#include <android-base/mapped_file.h>
 
 #include "fastdeploy/proto/ApkEntry.pb.h"
 
 class ApkArchiveTester;
 
 // Manipulates an APK archive. Process it by mmaping it in order to minimize
-// I/Os.
+// I/Os. The whole archive is mapped once up front, so lookups of individual
+// entries are plain memory reads and may be made from several threads at once.
 class ApkArchive {
   public:
     friend ApkArchiveTester;
@@ -46,8 +48,8 @@ class ApkArchive {
     com::android::fastdeploy::APKDump ExtractMetadata();
 
     // Parses the CDr starting from |input| and returns number of bytes consumed.
-    // Extracts local file header offset, data size and calculates MD5 hash of the record.
-    // 0 indicates invalid CDr.
+    // Extracts local file header offset, data size and calculates MD5 hash of the record, unless
+    // |md5Hash| is null. 0 indicates invalid CDr.
     static size_t ParseCentralDirectoryRecord(const char* input, size_t size, std::string* md5Hash,
                                               int64_t* localFileHeaderOffset, int64_t* dataSize);
     // Calculates Local File Entry size including header using offset and data size from CDr.
@@ -77,4 +79,7 @@ class ApkArchive {
     std::string path_;
     off_t size_;
     unique_fd fd_;
+    // Null if the archive couldn't be mapped as a whole, in which case each
+    // region is mapped or read separately.
+    std::unique_ptr<android::base::MappedFile> mapped_;
 };
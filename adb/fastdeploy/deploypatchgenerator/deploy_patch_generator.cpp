@@ -177,7 +177,7 @@ void DeployPatchGenerator::GeneratePatch(const std::vector<SimpleEntry>& entries
 
 bool DeployPatchGenerator::CreatePatch(const char* localApkPath, APKMetaData deviceApkMetadata,
                                        android::base::borrowed_fd output) {
-    return CreatePatch(PatchUtils::GetHostAPKMetaData(localApkPath), std::move(deviceApkMetadata),
+    return CreatePatch(PatchUtils::GetCachedHostAPKMetaData(localApkPath), std::move(deviceApkMetadata),
                        output);
 }
 
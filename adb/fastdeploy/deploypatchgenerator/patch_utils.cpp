@@ -16,11 +16,21 @@
 
 #include "patch_utils.h"
 
+#include <inttypes.h>
 #include <stdio.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
 
 #include "adb_io.h"
 #include "adb_utils.h"
 #include "android-base/endian.h"
+#include "android-base/file.h"
+#include "android-base/stringprintf.h"
 #include "sysdeps.h"
 
 #include "apk_archive.h"
@@ -31,27 +41,63 @@ using namespace android::base;
 
 static constexpr char kSignature[] = "FASTDEPLOY";
 
+// Below this many entries per thread, starting the threads costs more than it saves.
+static constexpr size_t kMinEntriesPerThread = 256;
+
+// Calls |fn| over consecutive slices of [0, count), on as many threads as are worth it.
+static void ParallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& fn) {
+    size_t threadCount = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()),
+                                          count / kMinEntriesPerThread);
+    if (threadCount <= 1) {
+        fn(0, count);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(threadCount);
+    const size_t slice = (count + threadCount - 1) / threadCount;
+    for (size_t begin = 0; begin < count; begin += slice) {
+        threads.emplace_back(fn, begin, std::min(begin + slice, count));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+}
+
 APKMetaData PatchUtils::GetDeviceAPKMetaData(const APKDump& apk_dump) {
     APKMetaData apkMetaData;
     apkMetaData.set_absolute_path(apk_dump.absolute_path());
 
-    std::string md5Hash;
     int64_t localFileHeaderOffset;
     int64_t dataSize;
 
+    // Records are variable length, so finding them is sequential; hashing them isn't.
+    std::vector<std::pair<size_t, size_t>> records;
     const auto& cd = apk_dump.cd();
     auto cur = cd.data();
     int64_t size = cd.size();
     while (auto consumed = ApkArchive::ParseCentralDirectoryRecord(
-                   cur, size, &md5Hash, &localFileHeaderOffset, &dataSize)) {
+                   cur, size, nullptr, &localFileHeaderOffset, &dataSize)) {
+        records.emplace_back(cur - cd.data(), consumed);
         cur += consumed;
         size -= consumed;
 
         auto apkEntry = apkMetaData.add_entries();
-        apkEntry->set_md5(md5Hash);
         apkEntry->set_dataoffset(localFileHeaderOffset);
         apkEntry->set_datasize(dataSize);
     }
+
+    ParallelFor(records.size(), [&](size_t begin, size_t end) {
+        std::string md5Hash;
+        int64_t unusedOffset;
+        int64_t unusedSize;
+        for (size_t i = begin; i < end; ++i) {
+            ApkArchive::ParseCentralDirectoryRecord(cd.data() + records[i].first,
+                                                    records[i].second, &md5Hash, &unusedOffset,
+                                                    &unusedSize);
+            apkMetaData.mutable_entries(i)->set_md5(md5Hash);
+        }
+    });
     return apkMetaData;
 }
 
@@ -66,15 +112,83 @@ APKMetaData PatchUtils::GetHostAPKMetaData(const char* apkPath) {
     auto apkMetaData = GetDeviceAPKMetaData(dump);
 
     // Now let's set data sizes.
-    for (auto& apkEntry : *apkMetaData.mutable_entries()) {
-        auto dataSize =
-                archive.CalculateLocalFileEntrySize(apkEntry.dataoffset(), apkEntry.datasize());
-        if (dataSize == 0) {
-            error_exit("Aborting");
+    std::atomic<bool> failed = false;
+    ParallelFor(apkMetaData.entries_size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end && !failed; ++i) {
+            auto& apkEntry = *apkMetaData.mutable_entries(i);
+            auto dataSize = archive.CalculateLocalFileEntrySize(apkEntry.dataoffset(),
+                                                                apkEntry.datasize());
+            if (dataSize == 0) {
+                failed = true;
+                return;
+            }
+            apkEntry.set_datasize(dataSize);
+        }
+    });
+    if (failed) {
+        error_exit("Aborting");
+    }
+
+    return apkMetaData;
+}
+
+// The metadata of the local APK is cached in the adb user directory, keyed by its full path and
+// checked against its size and modification time, so redeploying an unchanged APK (to another
+// device, or after a failed install) skips reading it again.
+static constexpr uint32_t kMetaDataCacheMagic = 0x4d44464d;  // LE MFDM
+
+struct MetaDataCacheHeader {
+    uint32_t magic;
+    uint32_t reserved;
+    int64_t size;
+    int64_t mtime;
+} __attribute__((packed));
+
+static std::string MetaDataCachePath(const std::string& apkPath) {
+    // FNV-1a, since it has to stay the same across adb builds.
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (char c : apkPath) {
+        hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+    }
+    return StringPrintf("%s%cfastdeploy%c%s-%016" PRIx64 ".metadata",
+                        adb_get_android_dir_path().c_str(), OS_PATH_SEPARATOR, OS_PATH_SEPARATOR,
+                        Basename(apkPath).c_str(), hash);
+}
+
+APKMetaData PatchUtils::GetCachedHostAPKMetaData(const char* apkPath) {
+    std::string path = apkPath;
+#if !defined(_WIN32)
+    Realpath(apkPath, &path);
+#endif
+
+    struct stat st;
+    if (stat(path.c_str(), &st) == -1) {
+        return GetHostAPKMetaData(apkPath);
+    }
+    MetaDataCacheHeader header = {};
+    header.magic = kMetaDataCacheMagic;
+    header.size = st.st_size;
+    header.mtime = st.st_mtime;
+
+    std::string cachePath = MetaDataCachePath(path);
+    std::string contents;
+    if (ReadFileToString(cachePath, &contents) && contents.size() >= sizeof(header) &&
+        memcmp(contents.data(), &header, sizeof(header)) == 0) {
+        APKMetaData apkMetaData;
+        if (apkMetaData.ParseFromArray(contents.data() + sizeof(header),
+                                       contents.size() - sizeof(header))) {
+            apkMetaData.set_absolute_path(apkPath);
+            return apkMetaData;
         }
-        apkEntry.set_datasize(dataSize);
     }
 
+    auto apkMetaData = GetHostAPKMetaData(apkPath);
+    contents.assign(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!mkdirs(Dirname(cachePath)) || !apkMetaData.AppendToString(&contents) ||
+        !WriteStringToFile(contents, cachePath)) {
+        // Not fatal: the next deploy just reads the APK again.
+        fprintf(stderr, "adb: failed to cache metadata of %s: %s\n", apkPath, strerror(errno));
+    }
     return apkMetaData;
 }
 
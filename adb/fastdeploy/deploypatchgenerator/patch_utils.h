@@ -37,6 +37,11 @@ class PatchUtils {
      * is called.
      */
     static com::android::fastdeploy::APKMetaData GetHostAPKMetaData(const char* file);
+    /**
+     * Same as GetHostAPKMetaData, but reuses the result from an earlier call as long as the file
+     * hasn't changed size or modification time since.
+     */
+    static com::android::fastdeploy::APKMetaData GetCachedHostAPKMetaData(const char* file);
     /**
      * Writes a fixed signature string to the header of the patch.
      */
@@ -108,6 +108,22 @@ TEST(PatchUtilsTest, GatherMetadata) {
     EXPECT_EQ(expectedMetadata, actualMetadata);
 }
 
+TEST(PatchUtilsTest, CachedMetadataMatches) {
+    std::string apkFile = GetTestFile("rotating_cube-release.apk");
+    APKMetaData expected = PatchUtils::GetHostAPKMetaData(apkFile.c_str());
+
+    std::string expectedMetadata;
+    expected.SerializeToString(&expectedMetadata);
+
+    // Once to fill the cache, once to read from it.
+    for (int i = 0; i < 2; ++i) {
+        APKMetaData actual = PatchUtils::GetCachedHostAPKMetaData(apkFile.c_str());
+        std::string actualMetadata;
+        actual.SerializeToString(&actualMetadata);
+        EXPECT_EQ(expectedMetadata, actualMetadata);
+    }
+}
+
 static inline void sanitize(APKMetaData& metadata) {
     metadata.clear_absolute_path();
     for (auto&& entry : *metadata.mutable_entries()) {
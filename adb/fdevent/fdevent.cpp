@@ -21,12 +21,14 @@
 #include <inttypes.h>
 
 #include <android-base/logging.h>
+#include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <android-base/threads.h>
 
 #include "adb_utils.h"
 #include "fdevent.h"
 #include "fdevent_epoll.h"
+#include "fdevent_io_uring.h"
 #include "fdevent_poll.h"
 
 using namespace std::chrono_literals;
@@ -185,7 +187,24 @@ void fdevent_context::TerminateLoop() {
     Interrupt();
 }
 
+#if defined(ADB_HAVE_IO_URING)
+// Opt-in for now: ADB_IO_URING=1 for the host server, persist.adb.io_uring for adbd.
+static bool fdevent_want_io_uring() {
+#if defined(__ANDROID__)
+    return android::base::GetBoolProperty("persist.adb.io_uring", false);
+#else
+    const char* env = getenv("ADB_IO_URING");
+    return env && strcmp(env, "1") == 0;
+#endif
+}
+#endif
+
 static std::unique_ptr<fdevent_context> fdevent_create_context() {
+#if defined(ADB_HAVE_IO_URING)
+    if (fdevent_want_io_uring() && fdevent_context_io_uring::Supported()) {
+        return std::make_unique<fdevent_context_io_uring>();
+    }
+#endif
 #if defined(__linux__)
     return std::make_unique<fdevent_context_epoll>();
 #else
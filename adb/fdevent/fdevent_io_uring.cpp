@@ -0,0 +1,416 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fdevent_io_uring.h"
+
+#if defined(ADB_HAVE_IO_URING)
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+
+#include <android-base/logging.h>
+#include <android-base/threads.h>
+
+#include "adb_unique_fd.h"
+#include "fdevent.h"
+
+// Tokens below kFirstPollToken tag completions we don't care about.
+static constexpr uint64_t kTimeoutToken = 0;
+static constexpr uint64_t kRemoveToken = 1;
+static constexpr uint64_t kFirstPollToken = 2;
+
+static constexpr unsigned kRingEntries = 256;
+
+static int io_uring_setup(unsigned entries, io_uring_params* params) {
+    return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned nr_args) {
+    return syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void fdevent_interrupt(int fd, unsigned, void*) {
+    uint64_t buf;
+    ssize_t rc = TEMP_FAILURE_RETRY(adb_read(fd, &buf, sizeof(buf)));
+    if (rc == -1) {
+        PLOG(FATAL) << "failed to read from fdevent interrupt fd";
+    }
+}
+
+bool fdevent_context_io_uring::Supported() {
+    static bool supported = []() {
+        io_uring_params params = {};
+        unique_fd fd(io_uring_setup(4, &params));
+        if (fd == -1) {
+            // ENOSYS on kernels without io_uring, EPERM if seccomp keeps us from it.
+            PLOG(DEBUG) << "io_uring_setup failed";
+            return false;
+        }
+
+        // Without NODROP, completions could be lost once more polls are in flight than the
+        // completion ring holds.
+        if (!(params.features & IORING_FEAT_NODROP)) {
+            return false;
+        }
+
+        size_t probe_size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+        std::unique_ptr<io_uring_probe, decltype(&free)> probe(
+                static_cast<io_uring_probe*>(calloc(1, probe_size)), free);
+        if (io_uring_register(fd.get(), IORING_REGISTER_PROBE, probe.get(), 256) != 0) {
+            return false;
+        }
+        for (unsigned op : {IORING_OP_POLL_ADD, IORING_OP_POLL_REMOVE, IORING_OP_TIMEOUT}) {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                return false;
+            }
+        }
+        return true;
+    }();
+    return supported;
+}
+
+fdevent_context_io_uring::fdevent_context_io_uring() : next_token_(kFirstPollToken) {
+    io_uring_params params = {};
+    ring_fd_.reset(io_uring_setup(kRingEntries, &params));
+    if (ring_fd_ == -1) {
+        PLOG(FATAL) << "failed to create io_uring";
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring_fd_.get(), IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        PLOG(FATAL) << "failed to map io_uring submission ring";
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd_.get(), IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            PLOG(FATAL) << "failed to map io_uring completion ring";
+        }
+    }
+    sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+    sqes_ = static_cast<io_uring_sqe*>(mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE,
+                                            MAP_SHARED | MAP_POPULATE, ring_fd_.get(),
+                                            IORING_OFF_SQES));
+    if (sqes_ == MAP_FAILED) {
+        PLOG(FATAL) << "failed to map io_uring submission entries";
+    }
+
+    char* sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_entries_ = params.sq_entries;
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+
+    char* cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+    unique_fd interrupt_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    if (interrupt_fd == -1) {
+        PLOG(FATAL) << "failed to create fdevent interrupt eventfd";
+    }
+
+    unique_fd interrupt_fd_dup(fcntl(interrupt_fd.get(), F_DUPFD_CLOEXEC, 3));
+    if (interrupt_fd_dup == -1) {
+        PLOG(FATAL) << "failed to dup fdevent interrupt eventfd";
+    }
+
+    this->interrupt_fd_ = std::move(interrupt_fd_dup);
+    fdevent* fde = this->Create(std::move(interrupt_fd), fdevent_interrupt, nullptr);
+    CHECK(fde != nullptr);
+    this->interrupt_fde_ = fde;
+    this->Add(fde, FDE_READ);
+}
+
+fdevent_context_io_uring::~fdevent_context_io_uring() {
+    // Destroy calls virtual methods, but this class is final, so that's okay.
+    this->Destroy(this->interrupt_fde_);
+
+    // Closing the ring cancels whatever is still in flight.
+    munmap(sqes_, sqes_size_);
+    if (cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    munmap(sq_ring_, sq_ring_size_);
+}
+
+static unsigned calculate_poll_mask(fdevent* fde) {
+    // Always enable POLLRDHUP, like the epoll backend, so that disconnects are noticed even
+    // without FDE_READ. POLLERR and POLLHUP are always reported.
+    unsigned mask = POLLRDHUP;
+    if (fde->state & FDE_READ) {
+        mask |= POLLIN;
+    }
+    if (fde->state & FDE_WRITE) {
+        mask |= POLLOUT;
+    }
+    return mask;
+}
+
+io_uring_sqe* fdevent_context_io_uring::GetSqe() {
+    unsigned tail = *sq_tail_;
+    if (tail - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) >= sq_entries_) {
+        // Full, hand what we have to the kernel without waiting for anything.
+        Submit(false);
+    }
+
+    unsigned index = tail & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[index] = index;
+    return sqe;
+}
+
+// Publish the SQE returned by the last GetSqe().
+void fdevent_context_io_uring::CommitSqe() {
+    __atomic_store_n(sq_tail_, *sq_tail_ + 1, __ATOMIC_RELEASE);
+    ++to_submit_;
+}
+
+void fdevent_context_io_uring::QueuePoll(fdevent* fde, unsigned mask) {
+    uint64_t token = next_token_++;
+    io_uring_sqe* sqe = GetSqe();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fde->fd.get();
+    sqe->poll_events = mask;
+    sqe->user_data = token;
+    CommitSqe();
+
+    polls_[token] = fde;
+    armed_[fde] = {token, mask};
+}
+
+void fdevent_context_io_uring::QueuePollRemove(uint64_t token) {
+    io_uring_sqe* sqe = GetSqe();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = token;
+    sqe->user_data = kRemoveToken;
+    CommitSqe();
+
+    polls_.erase(token);
+}
+
+void fdevent_context_io_uring::QueueTimeout(std::chrono::milliseconds timeout) {
+    timeout_ts_.tv_sec = timeout.count() / 1000;
+    timeout_ts_.tv_nsec = (timeout.count() % 1000) * 1000000;
+
+    // With off set to 1 this also completes with the first other completion, so it normally
+    // doesn't outlive the wait it bounds.
+    io_uring_sqe* sqe = GetSqe();
+    sqe->opcode = IORING_OP_TIMEOUT;
+    sqe->fd = -1;
+    sqe->addr = reinterpret_cast<uint64_t>(&timeout_ts_);
+    sqe->len = 1;
+    sqe->off = 1;
+    sqe->user_data = kTimeoutToken;
+    CommitSqe();
+}
+
+void fdevent_context_io_uring::Register(fdevent* fde) {
+    dirty_.insert(fde);
+}
+
+void fdevent_context_io_uring::Unregister(fdevent* fde) {
+    dirty_.erase(fde);
+    if (auto it = armed_.find(fde); it != armed_.end()) {
+        QueuePollRemove(it->second.token);
+        armed_.erase(it);
+    }
+}
+
+void fdevent_context_io_uring::Set(fdevent* fde, unsigned events) {
+    unsigned previous_state = fde->state;
+    fde->state = events;
+
+    // If the state is the same, or only differed by FDE_TIMEOUT, the armed poll is still right.
+    if ((previous_state & ~FDE_TIMEOUT) == (events & ~FDE_TIMEOUT)) {
+        return;
+    }
+    dirty_.insert(fde);
+}
+
+void fdevent_context_io_uring::ArmPolls() {
+    for (fdevent* fde : dirty_) {
+        unsigned mask = calculate_poll_mask(fde);
+        if (auto it = armed_.find(fde); it != armed_.end()) {
+            if (it->second.mask == mask) {
+                continue;
+            }
+            QueuePollRemove(it->second.token);
+            armed_.erase(it);
+        }
+        QueuePoll(fde, mask);
+    }
+    dirty_.clear();
+}
+
+void fdevent_context_io_uring::Submit(bool wait) {
+    while (true) {
+        unsigned cq_ready = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE) - *cq_head_;
+        unsigned min_complete = (wait && !cq_ready) ? 1 : 0;
+        if (!to_submit_ && !min_complete) {
+            return;
+        }
+
+        int rc = io_uring_enter(ring_fd_.get(), to_submit_, min_complete,
+                                min_complete ? IORING_ENTER_GETEVENTS : 0);
+        if (rc == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            PLOG(FATAL) << "io_uring_enter failed";
+        }
+        // The wait can be cut short after submitting, go around until there is something to reap.
+        to_submit_ -= rc;
+        if (!wait) {
+            return;
+        }
+    }
+}
+
+void fdevent_context_io_uring::ReapCompletions(std::unordered_map<fdevent*, unsigned>* event_map) {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    for (; head != tail; ++head) {
+        const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+        if (cqe.user_data < kFirstPollToken) {
+            continue;
+        }
+
+        // Polls that got removed may still complete before the removal, drop those.
+        auto it = polls_.find(cqe.user_data);
+        if (it == polls_.end()) {
+            continue;
+        }
+        fdevent* fde = it->second;
+        polls_.erase(it);
+        armed_.erase(fde);
+        // One-shot: rearm on the next iteration, which keeps this level-triggered.
+        dirty_.insert(fde);
+
+        unsigned events = 0;
+        if (cqe.res < 0) {
+            events |= FDE_READ | FDE_ERROR;
+        } else {
+            if ((cqe.res & POLLIN) && (fde->state & FDE_READ)) {
+                events |= FDE_READ;
+            }
+            if ((cqe.res & POLLOUT) && (fde->state & FDE_WRITE)) {
+                events |= FDE_WRITE;
+            }
+            if (cqe.res & (POLLERR | POLLHUP | POLLRDHUP)) {
+                // We fake a read, as the rest of the code assumes that errors will
+                // be detected at that point.
+                events |= FDE_READ | FDE_ERROR;
+            }
+        }
+        if (events) {
+            (*event_map)[fde] |= events;
+        }
+    }
+    __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+}
+
+void fdevent_context_io_uring::Loop() {
+    main_thread_id_ = android::base::GetThreadId();
+
+    std::vector<fdevent_event> fde_events;
+    std::unordered_map<fdevent*, unsigned> event_map;
+
+    while (true) {
+        if (terminate_loop_) {
+            break;
+        }
+
+        ArmPolls();
+        std::optional<std::chrono::milliseconds> timeout = CalculatePollDuration();
+        if (timeout) {
+            QueueTimeout(*timeout);
+        }
+        Submit(true);
+
+        auto post_poll = std::chrono::steady_clock::now();
+        ReapCompletions(&event_map);
+
+        for (auto& [fd, fde] : installed_fdevents_) {
+            unsigned events = 0;
+            if (auto it = event_map.find(&fde); it != event_map.end()) {
+                events = it->second;
+            }
+
+            if (events == 0) {
+                if (fde.timeout) {
+                    auto deadline = fde.last_active + *fde.timeout;
+                    if (deadline < post_poll) {
+                        events |= FDE_TIMEOUT;
+                    }
+                }
+            }
+
+            if (events != 0) {
+                LOG(DEBUG) << dump_fde(&fde) << " got events " << std::hex << std::showbase
+                           << events;
+                fde_events.push_back({&fde, events});
+                fde.last_active = post_poll;
+            }
+        }
+        event_map.clear();
+        this->HandleEvents(fde_events);
+        fde_events.clear();
+    }
+
+    main_thread_id_.reset();
+}
+
+size_t fdevent_context_io_uring::InstalledCount() {
+    // We always have an installed fde for interrupt.
+    return this->installed_fdevents_.size() - 1;
+}
+
+void fdevent_context_io_uring::Interrupt() {
+    uint64_t i = 1;
+    ssize_t rc = TEMP_FAILURE_RETRY(adb_write(this->interrupt_fd_, &i, sizeof(i)));
+    if (rc != sizeof(i)) {
+        PLOG(FATAL) << "failed to write to fdevent interrupt eventfd";
+    }
+}
+
+#endif  // defined(ADB_HAVE_IO_URING)
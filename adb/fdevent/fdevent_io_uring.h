@@ -0,0 +1,117 @@
+#pragma once
+
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#if defined(__linux__)
+
+#include <sys/syscall.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+
+// IORING_FEAT_RW_CUR_POS marks headers recent enough to have IORING_REGISTER_PROBE.
+#if defined(__NR_io_uring_setup) && defined(IORING_FEAT_RW_CUR_POS)
+#define ADB_HAVE_IO_URING 1
+#endif
+
+#endif  // defined(__linux__)
+
+#if defined(ADB_HAVE_IO_URING)
+
+#include "sysdeps.h"
+
+#include <linux/time_types.h>
+
+#include <unordered_map>
+#include <unordered_set>
+
+#include "adb_unique_fd.h"
+#include "fdevent.h"
+
+// fdevent backend that arms a one-shot IORING_OP_POLL_ADD per fdevent instead of keeping an epoll
+// set. Changes of interest are collected between iterations and submitted together with the wait,
+// so a loop iteration costs a single io_uring_enter however many fdevents were Set.
+struct fdevent_context_io_uring final : public fdevent_context {
+    fdevent_context_io_uring();
+    virtual ~fdevent_context_io_uring();
+
+    // Whether the running kernel has everything this backend needs.
+    static bool Supported();
+
+    virtual void Register(fdevent* fde) final;
+    virtual void Unregister(fdevent* fde) final;
+
+    virtual void Set(fdevent* fde, unsigned events) final;
+
+    virtual void Loop() final;
+    size_t InstalledCount() final;
+
+  protected:
+    virtual void Interrupt() final;
+
+  private:
+    struct Poll {
+        uint64_t token;
+        unsigned mask;
+    };
+
+    io_uring_sqe* GetSqe();
+    void CommitSqe();
+    void QueuePoll(fdevent* fde, unsigned mask);
+    void QueuePollRemove(uint64_t token);
+    void QueueTimeout(std::chrono::milliseconds timeout);
+    void ArmPolls();
+    void Submit(bool wait);
+    void ReapCompletions(std::unordered_map<fdevent*, unsigned>* event_map);
+
+    unique_fd ring_fd_;
+    unique_fd interrupt_fd_;
+    fdevent* interrupt_fde_ = nullptr;
+
+    void* sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void* cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned sq_mask_;
+    unsigned sq_entries_;
+    unsigned* sq_array_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned cq_mask_;
+    io_uring_cqe* cqes_;
+
+    // SQEs queued since the last io_uring_enter.
+    unsigned to_submit_ = 0;
+
+    // Outstanding polls by token, and by fdevent.
+    uint64_t next_token_;
+    std::unordered_map<uint64_t, fdevent*> polls_;
+    std::unordered_map<fdevent*, Poll> armed_;
+    // fdevents whose poll needs to be (re)armed before the next wait.
+    std::unordered_set<fdevent*> dirty_;
+
+    // Read by the kernel when the timeout SQE gets submitted.
+    __kernel_timespec timeout_ts_;
+};
+
+#endif  // defined(ADB_HAVE_IO_URING)
@@ -27,6 +27,7 @@
 #include <vector>
 
 #include "adb_io.h"
+#include "fdevent_io_uring.h"
 #include "fdevent_test.h"
 
 using namespace std::chrono_literals;
@@ -319,3 +320,55 @@ TEST_F(FdeventTest, timeout) {
     ASSERT_LT(diff[1], delta.count() * 0.5);
     ASSERT_LT(diff[2], delta.count() * 0.5);
 }
+
+#if defined(ADB_HAVE_IO_URING)
+// Runs a context directly rather than the ambient one, which only uses io_uring when asked to.
+TEST(fdevent_io_uring, read_write_timeout) {
+    if (!fdevent_context_io_uring::Supported()) {
+        GTEST_SKIP() << "io_uring is not available";
+    }
+
+    struct State {
+        fdevent_context_io_uring context;
+        std::vector<unsigned> events;
+    } state;
+
+    int fds[2];
+    ASSERT_EQ(0, adb_socketpair(fds));
+    unique_fd peer(fds[1]);
+
+    auto callback = [](fdevent* fde, unsigned events, void* arg) {
+        State* state = static_cast<State*>(arg);
+        state->events.push_back(events);
+        switch (state->events.size()) {
+            case 1: {
+                char c;
+                ASSERT_EQ(1, adb_read(fde->fd.get(), &c, 1));
+                state->context.Set(fde, FDE_WRITE);
+                break;
+            }
+            case 2:
+                state->context.Set(fde, 0);
+                state->context.SetTimeout(fde, 10ms);
+                break;
+            default:
+                state->context.TerminateLoop();
+                break;
+        }
+    };
+    fdevent* fde = state.context.Create(unique_fd(fds[0]), fd_func2(callback), &state);
+    state.context.Set(fde, FDE_READ);
+
+    std::thread thread([&state]() { state.context.Loop(); });
+    ASSERT_TRUE(WriteFdExactly(peer, "x", 1));
+    thread.join();
+
+    ASSERT_EQ(3ULL, state.events.size());
+    EXPECT_EQ(static_cast<unsigned>(FDE_READ), state.events[0]);
+    EXPECT_EQ(static_cast<unsigned>(FDE_WRITE), state.events[1]);
+    EXPECT_EQ(static_cast<unsigned>(FDE_TIMEOUT), state.events[2]);
+
+    state.context.Destroy(fde);
+    EXPECT_EQ(0ULL, state.context.InstalledCount());
+}
+#endif  // defined(ADB_HAVE_IO_URING)
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+// Block checksums for delta pushes: adbd sends the checksums of each block of the file being
+// replaced, and the client sends only what doesn't match one of them, in the manner of rsync.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <openssl/sha.h>
+
+#include "file_sync_protocol.h"
+
+// Files smaller than this are cheaper to send whole than to diff.
+static constexpr uint64_t kSyncDeltaMinSize = 1024 * 1024;
+
+static constexpr uint32_t kSyncDeltaMinBlockSize = 4 * 1024;
+static constexpr uint32_t kSyncDeltaMaxBlockSize = 256 * 1024;
+
+// Aims for at most 16Ki blocks, which keeps the checksums under half a MiB.
+static inline uint32_t sync_delta_block_size(uint64_t file_size) {
+    uint32_t block_size = kSyncDeltaMinBlockSize;
+    while (block_size < kSyncDeltaMaxBlockSize && file_size / block_size > 16 * 1024) {
+        block_size *= 2;
+    }
+    return block_size;
+}
+
+// rsync's weak checksum, which can be moved along the data one byte at a time.
+class RollingChecksum {
+  public:
+    RollingChecksum(const void* data, size_t length) { Reset(data, length); }
+
+    void Reset(const void* data, size_t length) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        length_ = length;
+        a_ = 0;
+        b_ = 0;
+        for (size_t i = 0; i < length; ++i) {
+            a_ += p[i];
+            b_ += (length - i) * p[i];
+        }
+    }
+
+    // Drops |out| from the front of the window and appends |in|.
+    void Roll(uint8_t out, uint8_t in) {
+        a_ += in - out;
+        b_ += a_ - length_ * out;
+    }
+
+    uint32_t Value() const { return (a_ & 0xffff) | (b_ << 16); }
+
+  private:
+    size_t length_;
+    uint32_t a_;
+    uint32_t b_;
+};
+
+static inline void sync_delta_strong_sum(const void* data, size_t length,
+                                         uint8_t (&sum)[SYNC_STRONG_SUM_SIZE]) {
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    SHA256(static_cast<const uint8_t*>(data), length, digest);
+    memcpy(sum, digest, sizeof(sum));
+}
+
+static inline sync_block_sum sync_delta_block_sum(const void* data, size_t length) {
+    sync_block_sum sum;
+    sum.weak = RollingChecksum(data, length).Value();
+    sync_delta_strong_sum(data, length, sum.strong);
+    return sum;
+}
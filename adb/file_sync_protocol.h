@@ -31,6 +31,9 @@
 #define ID_SEND_V2 MKID('S', 'N', 'D', '2')
 #define ID_RECV_V1 MKID('R', 'E', 'C', 'V')
 #define ID_RECV_V2 MKID('R', 'C', 'V', '2')
+#define ID_SIGNATURE MKID('S', 'I', 'G', 'N')
+#define ID_SEND_DELTA MKID('S', 'N', 'D', 'D')
+#define ID_COPY MKID('C', 'O', 'P', 'Y')
 #define ID_DONE MKID('D', 'O', 'N', 'E')
 #define ID_DATA MKID('D', 'A', 'T', 'A')
 #define ID_OKAY MKID('O', 'K', 'A', 'Y')
@@ -92,6 +95,8 @@ struct __attribute__((packed)) sync_dent_v2 {
 enum SyncFlag : uint32_t {
     kSyncFlagNone = 0,
     kSyncFlagBrotli = 1,
+    kSyncFlagLZ4 = 2,
+    kSyncFlagZstd = 4,
 };
 
 // send_v1 sent the path in a buffer, followed by a comma and the mode as a string.
@@ -109,6 +114,39 @@ struct __attribute__((packed)) sync_recv_v2 {
     uint32_t flags;
 };
 
+// The reply to ID_SIGNATURE: the checksums of each block of an existing file, which the client
+// can then refer to with ID_COPY in a send_delta. A file shorter than a block has none.
+struct __attribute__((packed)) sync_signature {
+    uint32_t id;
+    uint32_t error;
+    uint64_t size;
+    uint32_t block_size;
+    uint32_t block_count;
+};  // followed by `block_count` sync_block_sums, if error == 0.
+
+#define SYNC_STRONG_SUM_SIZE 16
+
+struct __attribute__((packed)) sync_block_sum {
+    uint32_t weak;
+    uint8_t strong[SYNC_STRONG_SUM_SIZE];  // Truncated SHA-256.
+};
+
+// send_delta is send_v2 against the file's current contents. As well as ID_DATA, the file data
+// can contain ID_COPY messages, which take whole blocks from those contents. `base_size` and
+// `block_size` must be what the preceding ID_SIGNATURE returned.
+struct __attribute__((packed)) sync_send_delta {
+    uint32_t id;
+    uint32_t mode;
+    uint32_t block_size;
+    uint64_t base_size;
+};
+
+struct __attribute__((packed)) sync_copy {
+    uint32_t id;
+    uint32_t count;
+    uint32_t block;
+};
+
 struct __attribute__((packed)) sync_data {
     uint32_t id;
     uint32_t size;
@@ -128,6 +166,9 @@ union syncmsg {
     sync_status status;
     sync_send_v2 send_v2_setup;
     sync_recv_v2 recv_v2_setup;
+    sync_signature signature;
+    sync_send_delta send_delta_setup;
+    sync_copy copy;
 };
 
 #define SYNC_DATA_MAX (64 * 1024)
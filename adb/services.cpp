@@ -210,6 +210,8 @@ asocket* host_service_to_socket(std::string_view name, std::string_view serial,
         return create_device_tracker(false);
     } else if (name == "track-devices-l") {
         return create_device_tracker(true);
+    } else if (name == "track-devices-delta") {
+        return create_device_tracker(true, true);
     } else if (android::base::ConsumePrefix(&name, "wait-for-")) {
         std::shared_ptr<state_info> sinfo = std::make_shared<state_info>();
         if (sinfo == nullptr) {
@@ -21,6 +21,7 @@
 
 #include <deque>
 #include <memory>
+#include <optional>
 #include <string>
 
 #include "adb_unique_fd.h"
@@ -95,6 +96,13 @@ struct asocket {
     /* A socket is bound to atransport */
     atransport* transport = nullptr;
 
+    // For remote sockets on a transport with delayed acks: the number of bytes we may still
+    // send before waiting for an A_OKAY from the other end, and the number of bytes received
+    // from the other end and consumed by our peer, but not yet acknowledged. Without delayed
+    // acks, available_send_bytes is empty and every A_WRTE waits for an A_OKAY.
+    std::optional<int64_t> available_send_bytes;
+    size_t unacked_bytes = 0;
+
     size_t get_max_payload() const;
 };
 
@@ -103,6 +103,64 @@ TEST_F(LocalSocketTest, smoke) {
     TerminateThread();
 }
 
+TEST_F(LocalSocketTest, find_local_socket) {
+    constexpr size_t SOCKET_PAIR_COUNT = 200;
+    std::vector<unique_fd> remote_fds;
+    std::vector<std::pair<unsigned, unsigned>> ids;
+
+    PrepareThread();
+
+    fdevent_run_on_main_thread([&remote_fds, &ids]() {
+        for (size_t i = 0; i < SOCKET_PAIR_COUNT; ++i) {
+            asocket* pair[2];
+            for (asocket*& s : pair) {
+                int fds[2];
+                ASSERT_EQ(0, adb_socketpair(fds)) << strerror(errno);
+                remote_fds.emplace_back(fds[0]);
+                s = create_local_socket(unique_fd(fds[1]));
+                ASSERT_NE(nullptr, s);
+            }
+            pair[0]->peer = pair[1];
+            pair[1]->peer = pair[0];
+            pair[0]->ready(pair[0]);
+            pair[1]->ready(pair[1]);
+            ids.emplace_back(pair[0]->id, pair[1]->id);
+
+            EXPECT_EQ(pair[0], find_local_socket(pair[0]->id, 0));
+            EXPECT_EQ(pair[0], find_local_socket(pair[0]->id, pair[1]->id));
+            EXPECT_EQ(pair[1], find_local_socket(pair[1]->id, pair[0]->id));
+            EXPECT_EQ(nullptr, find_local_socket(pair[0]->id, pair[0]->id));
+        }
+    });
+    WaitForFdeventLoop();
+    ASSERT_EQ(SOCKET_PAIR_COUNT, ids.size());
+
+    // Closing the other end of a local socket closes it and its peer.
+    for (size_t i = 0; i < SOCKET_PAIR_COUNT; i += 2) {
+        remote_fds[2 * i].reset();
+    }
+    WaitForFdeventLoop();
+
+    fdevent_run_on_main_thread([&ids]() {
+        for (size_t i = 0; i < ids.size(); ++i) {
+            auto [id, peer_id] = ids[i];
+            if (i % 2 == 0) {
+                EXPECT_EQ(nullptr, find_local_socket(id, 0));
+                EXPECT_EQ(nullptr, find_local_socket(peer_id, 0));
+            } else {
+                EXPECT_NE(nullptr, find_local_socket(id, peer_id));
+                EXPECT_NE(nullptr, find_local_socket(peer_id, id));
+            }
+        }
+    });
+    WaitForFdeventLoop();
+
+    remote_fds.clear();
+    WaitForFdeventLoop();
+    ASSERT_EQ(GetAdditionalLocalSocketCount(), fdevent_installed_count());
+    TerminateThread();
+}
+
 struct CloseWithPacketArg {
     unique_fd socket_fd;
     size_t bytes_written;
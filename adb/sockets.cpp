@@ -29,6 +29,7 @@
 #include <chrono>
 #include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <android-base/strings.h>
@@ -49,7 +50,9 @@ using namespace std::chrono_literals;
 static std::recursive_mutex& local_socket_list_lock = *new std::recursive_mutex();
 static unsigned local_socket_next_id = 1;
 
-static auto& local_socket_list = *new std::vector<asocket*>();
+// The open local sockets, by id. find_local_socket() runs for every A_OKAY and
+// A_WRTE packet, so it mustn't cost more with hundreds of forwarded sockets.
+static auto& local_socket_list = *new std::unordered_map<unsigned, asocket*>();
 
 /* the the list of currently closing local sockets.
 ** these have no peer anymore, but still packets to
@@ -57,24 +60,21 @@ static auto& local_socket_list = *new std::vector<asocket*>();
 */
 static auto& local_socket_closing_list = *new std::vector<asocket*>();
 
-// Parse the global list of sockets to find one with id |local_id|.
+// Look up the socket with id |local_id| in the global table of sockets.
 // If |peer_id| is not 0, also check that it is connected to a peer
 // with id |peer_id|. Returns an asocket handle on success, NULL on failure.
 asocket* find_local_socket(unsigned local_id, unsigned peer_id) {
-    asocket* result = nullptr;
-
     std::lock_guard<std::recursive_mutex> lock(local_socket_list_lock);
-    for (asocket* s : local_socket_list) {
-        if (s->id != local_id) {
-            continue;
-        }
-        if (peer_id == 0 || (s->peer && s->peer->id == peer_id)) {
-            result = s;
-        }
-        break;
+    auto it = local_socket_list.find(local_id);
+    if (it == local_socket_list.end()) {
+        return nullptr;
     }
 
-    return result;
+    asocket* s = it->second;
+    if (peer_id == 0 || (s->peer && s->peer->id == peer_id)) {
+        return s;
+    }
+    return nullptr;
 }
 
 void install_local_socket(asocket* s) {
@@ -87,15 +87,18 @@ void install_local_socket(asocket* s) {
         LOG(FATAL) << "local socket id overflow";
     }
 
-    local_socket_list.push_back(s);
+    local_socket_list.emplace(s->id, s);
 }
 
 void remove_socket(asocket* s) {
     std::lock_guard<std::recursive_mutex> lock(local_socket_list_lock);
-    for (auto list : { &local_socket_list, &local_socket_closing_list }) {
-        list->erase(std::remove_if(list->begin(), list->end(), [s](asocket* x) { return x == s; }),
-                    list->end());
+    auto it = local_socket_list.find(s->id);
+    if (it != local_socket_list.end() && it->second == s) {
+        local_socket_list.erase(it);
     }
+    local_socket_closing_list.erase(
+            std::remove(local_socket_closing_list.begin(), local_socket_closing_list.end(), s),
+            local_socket_closing_list.end());
 }
 
 void close_all_sockets(atransport* t) {
@@ -104,7 +107,7 @@ void close_all_sockets(atransport* t) {
     */
     std::lock_guard<std::recursive_mutex> lock(local_socket_list_lock);
 restart:
-    for (asocket* s : local_socket_list) {
+    for (const auto& [id, s] : local_socket_list) {
         if (s->transport == t || (s->peer && s->peer->transport == t)) {
             s->close(s);
             goto restart;
@@ -442,17 +445,40 @@ static int remote_socket_enqueue(asocket* s, apacket::payload_type data) {
 
     p->payload = std::move(data);
     p->msg.data_length = p->payload.size();
+    size_t size = p->payload.size();
 
     send_packet(p, s->transport);
+
+    if (s->available_send_bytes) {
+        // Keep sending until the other end's window is used up.
+        *s->available_send_bytes -= size;
+        return *s->available_send_bytes > 0 ? 0 : 1;
+    }
     return 1;
 }
 
 static void remote_socket_ready(asocket* s) {
     D("entered remote_socket_ready RS(%d) OKAY fd=%d peer.fd=%d", s->id, s->fd, s->peer->fd);
+    int32_t acked_bytes = 0;
+    if (s->transport->SupportsDelayedAck()) {
+        // Acknowledge in batches. The other end only stops sending once it has a whole window
+        // in flight, which is more than the threshold, so it never waits on an ack held back.
+        if (s->unacked_bytes < DELAYED_ACK_THRESHOLD) {
+            return;
+        }
+        acked_bytes = s->unacked_bytes;
+        s->unacked_bytes = 0;
+    }
+
     apacket* p = get_apacket();
     p->msg.command = A_OKAY;
     p->msg.arg0 = s->peer->id;
     p->msg.arg1 = s->id;
+    if (s->transport->SupportsDelayedAck()) {
+        p->payload.resize(sizeof(acked_bytes));
+        memcpy(p->payload.data(), &acked_bytes, sizeof(acked_bytes));
+        p->msg.data_length = p->payload.size();
+    }
     send_packet(p, s->transport);
 }
 
@@ -507,6 +533,10 @@ void connect_to_remote(asocket* s, std::string_view destination) {
     LOG(VERBOSE) << "LS(" << s->id << ": connect(" << destination << ")";
     p->msg.command = A_OPEN;
     p->msg.arg0 = s->id;
+    if (s->transport->SupportsDelayedAck()) {
+        // The window the other end may send to us before our first A_OKAY.
+        p->msg.arg1 = INITIAL_DELAYED_ACK_BYTES;
+    }
 
     // adbd used to expect a null-terminated string.
     // Keep doing so to maintain backward compatibility.
@@ -108,6 +108,18 @@ class TlsConnection {
     // Returns false otherwise.
     virtual bool WriteFully(std::string_view data) = 0;
 
+    // Hands the symmetric keys of an established connection to the kernel
+    // (kTLS), so that records are encrypted and decrypted in the socket layer
+    // instead of by BoringSSL. Must be called after |DoHandshake| succeeds and
+    // before any other reads or writes. A client only offloads receiving if
+    // the post-handshake check is enabled, since that's what guarantees the
+    // server's session tickets have been consumed.
+    //
+    // Returns true if at least one direction was offloaded. ReadFully and
+    // WriteFully keep working either way; once writes are offloaded, the
+    // plaintext can also be written to the fd directly.
+    virtual bool EnableKernelTls() = 0;
+
     // Create a new TlsConnection instance. |cert| and |priv_key| cannot be
     // empty.
     static std::unique_ptr<TlsConnection> Create(Role role, std::string_view cert,
@@ -16,6 +16,10 @@
 
 #define LOG_TAG "AdbWifiTlsConnectionTest"
 
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/socket.h>
+
 #include <thread>
 
 #include <gtest/gtest.h>
@@ -422,6 +426,63 @@ TEST_F(AdbWifiTlsConnectionTest, ExportKeyingMaterial) {
     ASSERT_EQ(client_key_material, server_key_material);
 }
 
+// kTLS only works on TCP sockets, so this connects over loopback rather than a socketpair. The
+// kernel may not support it at all, in which case everything should keep working in userspace.
+TEST_F(AdbWifiTlsConnectionTest, EnableKernelTls) {
+    unique_fd listener(socket(AF_INET, SOCK_STREAM, 0));
+    ASSERT_GE(listener.get(), 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addr_len = sizeof(addr);
+    ASSERT_EQ(0, bind(listener.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+    ASSERT_EQ(0, listen(listener.get(), 1));
+    ASSERT_EQ(0, getsockname(listener.get(), reinterpret_cast<sockaddr*>(&addr), &addr_len));
+
+    client_fd_.reset(socket(AF_INET, SOCK_STREAM, 0));
+    ASSERT_EQ(0, connect(client_fd_.get(), reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+    server_fd_.reset(accept(listener.get(), nullptr, nullptr));
+    ASSERT_GE(server_fd_.get(), 0);
+
+    server_ = TlsConnection::Create(TlsConnection::Role::Server, kTestRsa2048ServerCert,
+                                    kTestRsa2048ServerPrivKey, server_fd_);
+    client_ = TlsConnection::Create(TlsConnection::Role::Client, kTestRsa2048ClientCert,
+                                    kTestRsa2048ClientPrivKey, client_fd_);
+    server_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    client_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
+    // Like adb, have the client peek at the server's first message after the handshake. That
+    // leaves it decrypted in BoringSSL, which EnableKernelTls has to hand over.
+    client_->EnableClientPostHandshakeCheck(true);
+    StartClientHandshakeAsync(TlsError::Success);
+
+    ASSERT_EQ(server_->DoHandshake(), TlsError::Success);
+    server_->EnableKernelTls();
+    EXPECT_TRUE(server_->WriteFully(
+            std::string_view(reinterpret_cast<const char*>(msg_.data()), msg_.size())));
+    WaitForClientConnection();
+    client_->EnableKernelTls();
+    EXPECT_EQ(client_->ReadFully(msg_.size()), msg_);
+
+    // Push enough through for several records each way.
+    std::string big(1024 * 1024, '\0');
+    for (size_t i = 0; i < big.size(); ++i) {
+        big[i] = static_cast<char>(i * 7);
+    }
+    client_thread_ = std::thread([&]() {
+        EXPECT_TRUE(client_->WriteFully(big));
+        std::vector<uint8_t> buf(big.size());
+        ASSERT_TRUE(client_->ReadFully(buf.data(), buf.size()));
+        EXPECT_EQ(0, memcmp(buf.data(), big.data(), big.size()));
+    });
+
+    auto data = server_->ReadFully(big.size());
+    ASSERT_EQ(data.size(), big.size());
+    EXPECT_EQ(0, memcmp(data.data(), big.data(), big.size()));
+    EXPECT_TRUE(server_->WriteFully(big));
+
+    WaitForClientConnection();
+}
+
 TEST_F(AdbWifiTlsConnectionTest, SetCertVerifyCallback_ClientAcceptsServerRejects) {
     // Client accepts all
     client_->SetCertVerifyCallback([](X509_STORE_CTX*) { return 1; });
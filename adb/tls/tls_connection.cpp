@@ -16,14 +16,37 @@
 
 #include "adb/tls/tls_connection.h"
 
+#include <string.h>
+
 #include <algorithm>
 #include <vector>
 
 #include <android-base/logging.h>
 #include <android-base/strings.h>
 #include <openssl/err.h>
+#include <openssl/hkdf.h>
 #include <openssl/ssl.h>
 
+#if defined(__linux__) && __has_include(<linux/tls.h>)
+#include <errno.h>
+#include <linux/tls.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#if defined(TLS_1_3_VERSION)
+#define ADB_HAVE_KTLS 1
+#endif
+
+#ifndef SOL_TLS
+#define SOL_TLS 282
+#endif
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
+#endif
+
 using android::base::borrowed_fd;
 
 namespace adb {
@@ -49,6 +72,7 @@ class TlsConnectionImpl : public TlsConnection {
     std::vector<uint8_t> ReadFully(size_t size) override;
     bool ReadFully(void* buf, size_t size) override;
     bool WriteFully(std::string_view data) override;
+    bool EnableKernelTls() override;
 
     static bssl::UniquePtr<EVP_PKEY> EvpPkeyFromPEM(std::string_view pem);
     static bssl::UniquePtr<CRYPTO_BUFFER> BufferFromPEM(std::string_view pem);
@@ -61,6 +85,12 @@ class TlsConnectionImpl : public TlsConnection {
     static const char* SSLErrorString();
     void Invalidate();
     TlsError GetFailureReason(int err);
+#if defined(ADB_HAVE_KTLS)
+    bool SetKernelKey(int direction, bssl::Span<const uint8_t> secret, uint64_t sequence);
+    bool KernelRead(void* buf, size_t size);
+    bool KernelWrite(std::string_view data);
+    void KernelShutdown();
+#endif
     const char* RoleToString() { return role_ == Role::Server ? kServerRoleStr : kClientRoleStr; }
 
     Role role_;
@@ -73,6 +103,12 @@ class TlsConnectionImpl : public TlsConnection {
     std::vector<bssl::UniquePtr<X509>> known_certificates_;
     bool client_verify_post_handshake_ = false;
 
+    // Set once the kernel has taken over each direction of the record layer.
+    bool kernel_rx_ = false;
+    bool kernel_tx_ = false;
+    // Plaintext BoringSSL had already decrypted when reading moved to the kernel.
+    std::vector<uint8_t> pending_;
+
     CertVerifyCb cert_verify_cb_;
     SetCertCb set_cert_cb_;
     borrowed_fd fd_;
@@ -93,6 +129,13 @@ TlsConnectionImpl::TlsConnectionImpl(Role role, std::string_view cert, std::stri
 
 TlsConnectionImpl::~TlsConnectionImpl() {
     // shutdown the SSL connection
+#if defined(ADB_HAVE_KTLS)
+    if (kernel_tx_) {
+        // BoringSSL's write state is stale, so the close_notify has to come from the kernel.
+        KernelShutdown();
+        return;
+    }
+#endif
     if (ssl_ != nullptr) {
         SSL_shutdown(ssl_.get());
     }
@@ -324,6 +367,18 @@ bool TlsConnectionImpl::ReadFully(void* buf, size_t size) {
 
     size_t offset = 0;
     uint8_t* p8 = reinterpret_cast<uint8_t*>(buf);
+    if (!pending_.empty()) {
+        size_t n = std::min(size, pending_.size());
+        memcpy(p8, pending_.data(), n);
+        pending_.erase(pending_.begin(), pending_.begin() + n);
+        offset += n;
+        size -= n;
+    }
+#if defined(ADB_HAVE_KTLS)
+    if (kernel_rx_) {
+        return size == 0 || KernelRead(p8 + offset, size);
+    }
+#endif
     while (size > 0) {
         int bytes_read =
                 SSL_read(ssl_.get(), p8 + offset, std::min(static_cast<size_t>(INT_MAX), size));
@@ -344,6 +399,12 @@ bool TlsConnectionImpl::WriteFully(std::string_view data) {
         return false;
     }
 
+#if defined(ADB_HAVE_KTLS)
+    if (kernel_tx_) {
+        return KernelWrite(data);
+    }
+#endif
+
     while (!data.empty()) {
         int bytes_out = SSL_write(ssl_.get(), data.data(),
                                   std::min(static_cast<size_t>(INT_MAX), data.size()));
@@ -355,6 +416,217 @@ bool TlsConnectionImpl::WriteFully(std::string_view data) {
     }
     return true;
 }
+
+#if defined(ADB_HAVE_KTLS)
+// HKDF-Expand-Label from RFC 8446 section 7.1, with an empty context.
+static bool HkdfExpandLabel(uint8_t* out, size_t out_len, const EVP_MD* digest,
+                            bssl::Span<const uint8_t> secret, std::string_view label) {
+    static constexpr char kPrefix[] = "tls13 ";
+    std::vector<uint8_t> info;
+    info.push_back(out_len >> 8);
+    info.push_back(out_len & 0xff);
+    info.push_back(sizeof(kPrefix) - 1 + label.size());
+    info.insert(info.end(), kPrefix, kPrefix + sizeof(kPrefix) - 1);
+    info.insert(info.end(), label.begin(), label.end());
+    info.push_back(0);
+    return HKDF_expand(out, out_len, digest, secret.data(), secret.size(), info.data(),
+                       info.size());
+}
+
+template <typename CryptoInfo>
+static bool FillCryptoInfo(CryptoInfo* info, uint16_t cipher_type, const EVP_MD* digest,
+                           bssl::Span<const uint8_t> secret, uint64_t sequence) {
+    // The kernel wants the 12 byte IV split into the leading salt, if the cipher has one, and
+    // the remainder.
+    static constexpr size_t kSaltSize = sizeof(info->iv) == 12 ? 0 : 4;
+    uint8_t iv[kSaltSize + sizeof(info->iv)];
+    static_assert(sizeof(iv) == 12);
+
+    memset(info, 0, sizeof(*info));
+    info->info.version = TLS_1_3_VERSION;
+    info->info.cipher_type = cipher_type;
+    if (!HkdfExpandLabel(info->key, sizeof(info->key), digest, secret, "key") ||
+        !HkdfExpandLabel(iv, sizeof(iv), digest, secret, "iv")) {
+        return false;
+    }
+    if constexpr (kSaltSize != 0) {
+        memcpy(info->salt, iv, kSaltSize);
+    }
+    memcpy(info->iv, iv + kSaltSize, sizeof(info->iv));
+    for (size_t i = 0; i < sizeof(info->rec_seq); ++i) {
+        info->rec_seq[i] = sequence >> (8 * (sizeof(info->rec_seq) - 1 - i));
+    }
+    return true;
+}
+
+bool TlsConnectionImpl::SetKernelKey(int direction, bssl::Span<const uint8_t> secret,
+                                     uint64_t sequence) {
+    const SSL_CIPHER* cipher = SSL_get_current_cipher(ssl_.get());
+    const EVP_MD* digest = SSL_CIPHER_get_handshake_digest(cipher);
+    union {
+        tls12_crypto_info_aes_gcm_128 aes_gcm_128;
+        tls12_crypto_info_aes_gcm_256 aes_gcm_256;
+#if defined(TLS_CIPHER_CHACHA20_POLY1305)
+        tls12_crypto_info_chacha20_poly1305 chacha20_poly1305;
+#endif
+    } crypto_info;
+    size_t crypto_info_size;
+
+    bool filled;
+    switch (SSL_CIPHER_get_protocol_id(cipher)) {
+        case 0x1301:  // TLS_AES_128_GCM_SHA256
+            filled = FillCryptoInfo(&crypto_info.aes_gcm_128, TLS_CIPHER_AES_GCM_128, digest,
+                                    secret, sequence);
+            crypto_info_size = sizeof(crypto_info.aes_gcm_128);
+            break;
+        case 0x1302:  // TLS_AES_256_GCM_SHA384
+            filled = FillCryptoInfo(&crypto_info.aes_gcm_256, TLS_CIPHER_AES_GCM_256, digest,
+                                    secret, sequence);
+            crypto_info_size = sizeof(crypto_info.aes_gcm_256);
+            break;
+#if defined(TLS_CIPHER_CHACHA20_POLY1305)
+        case 0x1303:  // TLS_CHACHA20_POLY1305_SHA256
+            filled = FillCryptoInfo(&crypto_info.chacha20_poly1305, TLS_CIPHER_CHACHA20_POLY1305,
+                                    digest, secret, sequence);
+            crypto_info_size = sizeof(crypto_info.chacha20_poly1305);
+            break;
+#endif
+        default:
+            LOG(INFO) << RoleToString() << "kTLS doesn't support " << SSL_CIPHER_get_name(cipher);
+            return false;
+    }
+
+    bool result = filled && setsockopt(fd_.get(), SOL_TLS, direction, &crypto_info,
+                                       crypto_info_size) == 0;
+    if (filled && !result) {
+        PLOG(INFO) << RoleToString() << "failed to set kTLS "
+                   << (direction == TLS_TX ? "TX" : "RX") << " key";
+    }
+    OPENSSL_cleanse(&crypto_info, sizeof(crypto_info));
+    return result;
+}
+
+bool TlsConnectionImpl::KernelRead(void* buf, size_t size) {
+    uint8_t* p8 = reinterpret_cast<uint8_t*>(buf);
+    while (size > 0) {
+        char control[CMSG_SPACE(sizeof(uint8_t))];
+        iovec iov = {.iov_base = p8, .iov_len = size};
+        msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t rc = TEMP_FAILURE_RETRY(recvmsg(fd_.get(), &msg, 0));
+        if (rc <= 0) {
+            if (rc < 0) {
+                PLOG(ERROR) << RoleToString() << "kTLS recvmsg failed";
+            }
+            return false;
+        }
+
+        // Anything other than application data is a control record, which BoringSSL would have
+        // handled. Nothing the peer is expected to send at this point needs a reply, so the only
+        // one that isn't an error is close_notify, which ends the read like EOF would.
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        if (cmsg != nullptr && cmsg->cmsg_level == SOL_TLS &&
+            cmsg->cmsg_type == TLS_GET_RECORD_TYPE) {
+            uint8_t record_type = *CMSG_DATA(cmsg);
+            if (record_type != SSL3_RT_APPLICATION_DATA) {
+                if (record_type != SSL3_RT_ALERT || rc < 2 || p8[1] != SSL_AD_CLOSE_NOTIFY) {
+                    LOG(ERROR) << RoleToString() << "unexpected TLS record type "
+                               << static_cast<int>(record_type) << " on kTLS socket";
+                }
+                return false;
+            }
+        }
+
+        p8 += rc;
+        size -= rc;
+    }
+    return true;
+}
+
+bool TlsConnectionImpl::KernelWrite(std::string_view data) {
+    while (!data.empty()) {
+        ssize_t rc = TEMP_FAILURE_RETRY(send(fd_.get(), data.data(), data.size(), MSG_NOSIGNAL));
+        if (rc <= 0) {
+            PLOG(ERROR) << RoleToString() << "kTLS send failed";
+            return false;
+        }
+        data = data.substr(rc);
+    }
+    return true;
+}
+
+void TlsConnectionImpl::KernelShutdown() {
+    uint8_t alert[2] = {SSL3_AL_WARNING, SSL_AD_CLOSE_NOTIFY};
+    char control[CMSG_SPACE(sizeof(uint8_t))];
+    iovec iov = {.iov_base = alert, .iov_len = sizeof(alert)};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_TLS;
+    cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(uint8_t));
+    *CMSG_DATA(cmsg) = SSL3_RT_ALERT;
+
+    // Best effort, like SSL_shutdown: the peer may well be gone already.
+    TEMP_FAILURE_RETRY(sendmsg(fd_.get(), &msg, MSG_NOSIGNAL | MSG_DONTWAIT));
+}
+#endif  // defined(ADB_HAVE_KTLS)
+
+bool TlsConnectionImpl::EnableKernelTls() {
+#if defined(ADB_HAVE_KTLS)
+    CHECK(ssl_);
+    if (SSL_version(ssl_.get()) != TLS1_3_VERSION) {
+        return false;
+    }
+
+    bssl::Span<const uint8_t> read_secret;
+    bssl::Span<const uint8_t> write_secret;
+    if (!SSL_get_traffic_secrets(ssl_.get(), &read_secret, &write_secret)) {
+        LOG(INFO) << RoleToString() << "failed to get TLS traffic secrets";
+        return false;
+    }
+
+    if (setsockopt(fd_.get(), SOL_TCP, TCP_ULP, "tls", sizeof("tls")) != 0) {
+        PLOG(INFO) << RoleToString() << "kTLS unavailable";
+        return false;
+    }
+
+    kernel_tx_ = SetKernelKey(TLS_TX, write_secret, SSL_get_write_sequence(ssl_.get()));
+
+    // The kernel can only take over reading at a record boundary, so whatever BoringSSL has
+    // already decrypted is drained first, for ReadFully to return before anything else. A
+    // server's post-handshake messages are only known to be behind us once the client has read
+    // application data after them.
+    if (role_ == Role::Server || client_verify_post_handshake_) {
+        size_t pending = SSL_pending(ssl_.get());
+        if (pending > 0) {
+            pending_.resize(pending);
+            if (SSL_read(ssl_.get(), pending_.data(), pending) != static_cast<int>(pending)) {
+                LOG(ERROR) << RoleToString() << "failed to drain decrypted TLS data";
+                pending_.clear();
+                return kernel_tx_;
+            }
+        }
+        if (!SSL_has_pending(ssl_.get())) {
+            kernel_rx_ = SetKernelKey(TLS_RX, read_secret, SSL_get_read_sequence(ssl_.get()));
+        }
+    }
+
+    LOG(INFO) << RoleToString() << "kTLS enabled: TX " << (kernel_tx_ ? "on" : "off") << ", RX "
+              << (kernel_rx_ ? "on" : "off");
+    return kernel_tx_ || kernel_rx_;
+#else
+    return false;
+#endif
+}
 }  // namespace
 
 // static
@@ -30,11 +30,15 @@
 
 #include <algorithm>
 #include <deque>
+#include <iterator>
 #include <list>
 #include <memory>
 #include <mutex>
 #include <set>
 #include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include <adb/crypto/rsa_2048_key.h>
 #include <adb/crypto/x509_generator.h>
@@ -63,12 +67,45 @@ using TlsError = TlsConnection::TlsError;
 static void remove_transport(atransport* transport);
 static void transport_destroy(atransport* transport);
 
-// TODO: unordered_map<TransportId, atransport*>
-static auto& transport_list = *new std::list<atransport*>();
+static auto& transport_list = *new std::unordered_set<atransport*>();
 static auto& pending_list = *new std::list<atransport*>();
 
+// Indexes into transport_list, so that a server with thousands of devices doesn't walk all of
+// them for every lookup. Only ever changed by transport_list_add and transport_list_remove.
+static auto& transports_by_id = *new std::unordered_map<TransportId, atransport*>();
+static auto& transports_by_serial = *new std::unordered_multimap<std::string, atransport*>();
+
 static auto& transport_lock = *new std::recursive_mutex();
 
+// Bumped whenever something that list_transports reports may have changed.
+static std::atomic<uint64_t> transport_list_generation(0);
+
+static void transport_list_add(atransport* t) {
+    std::lock_guard<std::recursive_mutex> lock(transport_lock);
+    if (!transport_list.insert(t).second) {
+        return;
+    }
+    transports_by_id[t->id] = t;
+    transports_by_serial.emplace(t->serial, t);
+    ++transport_list_generation;
+}
+
+static void transport_list_remove(atransport* t) {
+    std::lock_guard<std::recursive_mutex> lock(transport_lock);
+    if (transport_list.erase(t) == 0) {
+        return;
+    }
+    transports_by_id.erase(t->id);
+    auto [begin, end] = transports_by_serial.equal_range(t->serial);
+    for (auto it = begin; it != end; ++it) {
+        if (it->second == t) {
+            transports_by_serial.erase(it);
+            break;
+        }
+    }
+    ++transport_list_generation;
+}
+
 const char* const kFeatureShell2 = "shell_v2";
 const char* const kFeatureCmd = "cmd";
 const char* const kFeatureStat2 = "stat_v2";
@@ -83,6 +120,12 @@ const char* const kFeatureAbbExec = "abb_exec";
 const char* const kFeatureRemountShell = "remount_shell";
 const char* const kFeatureSendRecv2 = "sendrecv_v2";
 const char* const kFeatureSendRecv2Brotli = "sendrecv_v2_brotli";
+const char* const kFeatureSendRecv2LZ4 = "sendrecv_v2_lz4";
+const char* const kFeatureSendRecv2Zstd = "sendrecv_v2_zstd";
+const char* const kFeatureSendDelta = "send_delta";
+const char* const kFeatureFramebufferStream = "framebuffer_stream";
+const char* const kFeatureTrackJdwpDelta = "track_jdwp_delta";
+const char* const kFeatureDelayedAck = "delayed_ack";
 
 namespace {
 
@@ -272,6 +315,15 @@ void Connection::Reset() {
     Stop();
 }
 
+bool BlockingConnection::WriteBatch(const std::deque<std::unique_ptr<apacket>>& packets) {
+    for (const auto& packet : packets) {
+        if (!Write(packet.get())) {
+            return false;
+        }
+    }
+    return true;
+}
+
 BlockingConnectionAdapter::BlockingConnectionAdapter(std::unique_ptr<BlockingConnection> connection)
     : underlying_(std::move(connection)) {}
 
@@ -302,11 +354,11 @@ void BlockingConnectionAdapter::Start() {
                 return;
             }
 
-            std::unique_ptr<apacket> packet = std::move(this->write_queue_.front());
-            this->write_queue_.pop_front();
+            std::deque<std::unique_ptr<apacket>> packets;
+            packets.swap(this->write_queue_);
             lock.unlock();
 
-            if (!this->underlying_->Write(packet.get())) {
+            if (!this->underlying_->WriteBatch(packets)) {
                 break;
             }
         }
@@ -533,6 +585,11 @@ bool FdConnection::DoTlsHandshake(RSA* key, std::string* auth_key) {
 
     auto err = tls_->DoHandshake();
     if (err == TlsError::Success) {
+        // Let the kernel do the record encryption, unless asked not to.
+        const char* ktls = getenv("ADB_KTLS");
+        if (ktls == nullptr || strcmp(ktls, "0") != 0) {
+            tls_->EnableKernelTls();
+        }
         return true;
     }
 
@@ -572,7 +629,7 @@ void kick_transport(atransport* t, bool reset) {
     // check if the transport is in transport_list first.
     //
     // TODO(jmgao): WTF? Is this actually true?
-    if (std::find(transport_list.begin(), transport_list.end(), t) != transport_list.end()) {
+    if (transport_list.count(t) != 0) {
         if (reset) {
             t->Reset();
         } else {
@@ -600,6 +657,10 @@ struct device_tracker {
     asocket socket;
     bool update_needed = false;
     bool long_output = false;
+    // Send only the lines that changed since the last update, rather than the whole list.
+    bool delta = false;
+    // The lines of the last list sent, sorted, for working out the next delta.
+    std::vector<std::string> last_lines;
     device_tracker* next = nullptr;
 };
 
@@ -652,6 +713,45 @@ static int device_tracker_send(device_tracker* tracker, const std::string& strin
     return peer->enqueue(peer, std::move(data));
 }
 
+// Sends |listing| whole, or for a delta tracker, as the lines that went away since the last
+// update prefixed with '-' followed by the new ones prefixed with '+'. A device whose state
+// changed shows up as both. Deltas are split at line boundaries to fit the hex4 length.
+static int device_tracker_update(device_tracker* tracker, const std::string& listing) {
+    if (!tracker->delta) {
+        return device_tracker_send(tracker, listing);
+    }
+
+    std::vector<std::string> lines = android::base::Split(listing, "\n");
+    lines.pop_back();
+    std::sort(lines.begin(), lines.end());
+
+    std::vector<std::string> removed;
+    std::set_difference(tracker->last_lines.begin(), tracker->last_lines.end(), lines.begin(),
+                        lines.end(), std::back_inserter(removed));
+    std::vector<std::string> added;
+    std::set_difference(lines.begin(), lines.end(), tracker->last_lines.begin(),
+                        tracker->last_lines.end(), std::back_inserter(added));
+    tracker->last_lines = std::move(lines);
+
+    std::string message;
+    auto append = [&](char prefix, const std::string& line) {
+        if (!message.empty() && message.size() + line.size() + 2 > 0xffff) {
+            device_tracker_send(tracker, message);
+            message.clear();
+        }
+        message += prefix;
+        message += line;
+        message += '\n';
+    };
+    for (const std::string& line : removed) append('-', line);
+    for (const std::string& line : added) append('+', line);
+
+    if (message.empty()) {
+        return 0;
+    }
+    return device_tracker_send(tracker, message);
+}
+
 static void device_tracker_ready(asocket* socket) {
     device_tracker* tracker = reinterpret_cast<device_tracker*>(socket);
 
@@ -659,11 +759,17 @@ static void device_tracker_ready(asocket* socket) {
     // for the first time, even if no update occurred.
     if (tracker->update_needed) {
         tracker->update_needed = false;
-        device_tracker_send(tracker, list_transports(tracker->long_output));
+        std::string listing = list_transports(tracker->long_output);
+        if (tracker->delta && listing.empty()) {
+            // There are no lines for a delta, but the client still needs to hear about it.
+            device_tracker_send(tracker, listing);
+        } else {
+            device_tracker_update(tracker, listing);
+        }
     }
 }
 
-asocket* create_device_tracker(bool long_output) {
+asocket* create_device_tracker(bool long_output, bool delta) {
     device_tracker* tracker = new device_tracker();
     if (tracker == nullptr) LOG(FATAL) << "cannot allocate device tracker";
 
@@ -674,6 +780,7 @@ asocket* create_device_tracker(bool long_output) {
     tracker->socket.close = device_tracker_close;
     tracker->update_needed = true;
     tracker->long_output = long_output;
+    tracker->delta = delta;
 
     tracker->next = device_tracker_list;
     device_tracker_list = tracker;
@@ -699,6 +806,8 @@ bool iterate_transports(std::function<bool(const atransport*)> fn) {
 
 // Call this function each time the transport list has changed.
 void update_transports() {
+    // Whatever changed, the cached listings are stale now.
+    ++transport_list_generation;
     update_transport_status();
 
     // Notify `adb track-devices` clients.
@@ -706,7 +815,7 @@ void update_transports() {
     while (tracker != nullptr) {
         device_tracker* next = tracker->next;
         // This may destroy the tracker if the connection is closed.
-        device_tracker_send(tracker, list_transports(tracker->long_output));
+        device_tracker_update(tracker, list_transports(tracker->long_output));
         tracker = next;
     }
 }
@@ -777,11 +886,7 @@ static void transport_registration_func(int _fd, unsigned ev, void*) {
     if (m.action == 0) {
         D("transport: %s deleting", t->serial.c_str());
 
-        {
-            std::lock_guard<std::recursive_mutex> lock(transport_lock);
-            transport_list.remove(t);
-        }
-
+        transport_list_remove(t);
         delete t;
 
         update_transports();
@@ -825,7 +930,7 @@ static void transport_registration_func(int _fd, unsigned ev, void*) {
         auto it = std::find(pending_list.begin(), pending_list.end(), t);
         if (it != pending_list.end()) {
             pending_list.remove(t);
-            transport_list.push_front(t);
+            transport_list_add(t);
         }
     }
 
@@ -971,52 +1076,69 @@ atransport* acquire_one_transport(TransportType type, const char* serial, Transp
     }
 
     std::unique_lock<std::recursive_mutex> lock(transport_lock);
-    for (const auto& t : transport_list) {
-        if (t->GetConnectionState() == kCsNoPerm) {
-            *error_out = UsbNoPermissionsLongHelpText();
-            continue;
+
+    // Most requests name a transport id or an exact serial, which the indexes answer directly.
+    // Anything else, including misses, gets the full matching (and error reporting) below.
+    atransport* candidate = nullptr;
+    if (transport_id) {
+        auto it = transports_by_id.find(transport_id);
+        if (it != transports_by_id.end()) {
+            candidate = it->second;
         }
+    } else if (serial && transports_by_serial.count(serial) == 1) {
+        candidate = transports_by_serial.find(serial)->second;
+    }
 
-        if (transport_id) {
-            if (t->id == transport_id) {
-                result = t;
-                break;
+    if (candidate && candidate->GetConnectionState() != kCsNoPerm) {
+        result = candidate;
+    } else {
+        for (const auto& t : transport_list) {
+            if (t->GetConnectionState() == kCsNoPerm) {
+                *error_out = UsbNoPermissionsLongHelpText();
+                continue;
             }
-        } else if (serial) {
-            if (t->MatchesTarget(serial)) {
-                if (result) {
-                    *error_out = "more than one device";
-                    if (is_ambiguous) *is_ambiguous = true;
-                    result = nullptr;
+
+            if (transport_id) {
+                if (t->id == transport_id) {
+                    result = t;
                     break;
                 }
-                result = t;
-            }
-        } else {
-            if (type == kTransportUsb && t->type == kTransportUsb) {
-                if (result) {
-                    *error_out = "more than one device";
-                    if (is_ambiguous) *is_ambiguous = true;
-                    result = nullptr;
-                    break;
+            } else if (serial) {
+                if (t->MatchesTarget(serial)) {
+                    if (result) {
+                        *error_out = "more than one device";
+                        if (is_ambiguous) *is_ambiguous = true;
+                        result = nullptr;
+                        break;
+                    }
+                    result = t;
                 }
-                result = t;
-            } else if (type == kTransportLocal && t->type == kTransportLocal) {
-                if (result) {
-                    *error_out = "more than one emulator";
-                    if (is_ambiguous) *is_ambiguous = true;
-                    result = nullptr;
-                    break;
-                }
-                result = t;
-            } else if (type == kTransportAny) {
-                if (result) {
-                    *error_out = "more than one device/emulator";
-                    if (is_ambiguous) *is_ambiguous = true;
-                    result = nullptr;
-                    break;
+            } else {
+                if (type == kTransportUsb && t->type == kTransportUsb) {
+                    if (result) {
+                        *error_out = "more than one device";
+                        if (is_ambiguous) *is_ambiguous = true;
+                        result = nullptr;
+                        break;
+                    }
+                    result = t;
+                } else if (type == kTransportLocal && t->type == kTransportLocal) {
+                    if (result) {
+                        *error_out = "more than one emulator";
+                        if (is_ambiguous) *is_ambiguous = true;
+                        result = nullptr;
+                        break;
+                    }
+                    result = t;
+                } else if (type == kTransportAny) {
+                    if (result) {
+                        *error_out = "more than one device/emulator";
+                        if (is_ambiguous) *is_ambiguous = true;
+                        result = nullptr;
+                        break;
+                    }
+                    result = t;
                 }
-                result = t;
             }
         }
     }
@@ -1115,6 +1237,7 @@ ConnectionState atransport::GetConnectionState() const {
 void atransport::SetConnectionState(ConnectionState state) {
     check_main_thread();
     connection_state_ = state;
+    ++transport_list_generation;
 }
 
 void atransport::SetConnection(std::unique_ptr<Connection> connection) {
@@ -1184,6 +1307,12 @@ const FeatureSet& supported_features() {
             kFeatureRemountShell,
             kFeatureSendRecv2,
             kFeatureSendRecv2Brotli,
+            kFeatureSendRecv2LZ4,
+            kFeatureSendRecv2Zstd,
+            kFeatureSendDelta,
+            kFeatureFramebufferStream,
+            kFeatureTrackJdwpDelta,
+            kFeatureDelayedAck,
             // Increment ADB_SERVER_VERSION when adding a feature that adbd needs
             // to know about. Otherwise, the client can be stuck running an old
             // version of the server even after upgrading their copy of adb.
@@ -1216,6 +1345,7 @@ bool atransport::has_feature(const std::string& feature) const {
 
 void atransport::SetFeatures(const std::string& features_string) {
     features_ = StringToFeatureSet(features_string);
+    delayed_ack_ = CanUseFeature(features_, kFeatureDelayedAck);
 }
 
 void atransport::AddDisconnect(adisconnect* disconnect) {
@@ -1325,20 +1455,36 @@ static void append_transport(const atransport* t, std::string* result, bool long
 }
 
 std::string list_transports(bool long_listing) {
+    // A big lab asks for the same listing over and over (devices, and one per tracker for every
+    // change), so keep the latest one of each kind around until something changes.
+    struct CachedListing {
+        uint64_t generation = UINT64_MAX;
+        std::string text;
+    };
+    static CachedListing cached_listings[2];
+
     std::lock_guard<std::recursive_mutex> lock(transport_lock);
+    CachedListing& cached = cached_listings[long_listing];
+    uint64_t generation = transport_list_generation;
+    if (cached.generation == generation) {
+        return cached.text;
+    }
 
-    auto sorted_transport_list = transport_list;
-    sorted_transport_list.sort([](atransport*& x, atransport*& y) {
-        if (x->type != y->type) {
-            return x->type < y->type;
-        }
-        return x->serial < y->serial;
-    });
+    std::vector<atransport*> sorted_transport_list(transport_list.begin(), transport_list.end());
+    std::sort(sorted_transport_list.begin(), sorted_transport_list.end(),
+              [](atransport* x, atransport* y) {
+                  if (x->type != y->type) {
+                      return x->type < y->type;
+                  }
+                  return x->serial < y->serial;
+              });
 
     std::string result;
     for (const auto& t : sorted_transport_list) {
         append_transport(t, &result, long_listing);
     }
+    cached.generation = generation;
+    cached.text = result;
     return result;
 }
 
@@ -1384,14 +1530,12 @@ bool register_socket_transport(unique_fd s, std::string serial, int port, int lo
         }
     }
 
-    for (const auto& transport : transport_list) {
-        if (serial == transport->serial) {
-            VLOG(TRANSPORT) << "socket transport " << transport->serial
-                            << " is already in transport_list and fails to register";
-            delete t;
-            if (error) *error = EALREADY;
-            return false;
-        }
+    if (transports_by_serial.count(serial) != 0) {
+        VLOG(TRANSPORT) << "socket transport " << serial
+                        << " is already in transport_list and fails to register";
+        delete t;
+        if (error) *error = EALREADY;
+        return false;
     }
 
     t->serial = std::move(serial);
@@ -1422,17 +1566,9 @@ bool register_socket_transport(unique_fd s, std::string serial, int port, int lo
 
 #if ADB_HOST
 atransport* find_transport(const char* serial) {
-    atransport* result = nullptr;
-
     std::lock_guard<std::recursive_mutex> lock(transport_lock);
-    for (auto& t : transport_list) {
-        if (strcmp(serial, t->serial.c_str()) == 0) {
-            result = t;
-            break;
-        }
-    }
-
-    return result;
+    auto it = transports_by_serial.find(serial);
+    return it == transports_by_serial.end() ? nullptr : it->second;
 }
 
 void kick_all_tcp_devices() {
@@ -1481,9 +1617,15 @@ void register_usb_transport(usb_handle* usb, const char* serial, const char* dev
 // This should only be used for transports with connection_state == kCsNoPerm.
 void unregister_usb_transport(usb_handle* usb) {
     std::lock_guard<std::recursive_mutex> lock(transport_lock);
-    transport_list.remove_if([usb](atransport* t) {
-        return t->GetUsbHandle() == usb && t->GetConnectionState() == kCsNoPerm;
-    });
+    std::vector<atransport*> removed;
+    for (atransport* t : transport_list) {
+        if (t->GetUsbHandle() == usb && t->GetConnectionState() == kCsNoPerm) {
+            removed.push_back(t);
+        }
+    }
+    for (atransport* t : removed) {
+        transport_list_remove(t);
+    }
 }
 #endif
 
@@ -87,6 +87,18 @@ extern const char* const kFeatureRemountShell;
 extern const char* const kFeatureSendRecv2;
 // adbd supports brotli for send/recv v2.
 extern const char* const kFeatureSendRecv2Brotli;
+// adbd supports LZ4 for send/recv v2.
+extern const char* const kFeatureSendRecv2LZ4;
+// adbd supports zstd for send/recv v2.
+extern const char* const kFeatureSendRecv2Zstd;
+// adbd supports ID_SIGNATURE and ID_SEND_DELTA, for sending only the changed blocks of a file.
+extern const char* const kFeatureSendDelta;
+// adbd supports the framebuffer-stream: service.
+extern const char* const kFeatureFramebufferStream;
+// adbd supports the track-jdwp-delta service.
+extern const char* const kFeatureTrackJdwpDelta;
+// Streams are flow controlled with a window of bytes rather than an A_OKAY per A_WRTE.
+extern const char* const kFeatureDelayedAck;
 
 TransportId NextTransportId();
 
@@ -127,6 +139,12 @@ struct Connection {
     ErrorCallback error_callback_;
 
     static std::unique_ptr<Connection> FromFd(unique_fd fd);
+
+    // Like FromFd, but driven by the fdevent loop rather than a thread of its own. |on_close| is
+    // called once the connection has been stopped or destroyed. TLS handshakes on it have to
+    // happen off the main thread.
+    static std::unique_ptr<Connection> FromFdevent(unique_fd fd,
+                                                   std::function<void()> on_close = {});
 };
 
 // Abstraction for a blocking packet transport.
@@ -143,6 +161,10 @@ struct BlockingConnection {
     virtual bool Read(apacket* packet) = 0;
     virtual bool Write(apacket* packet) = 0;
 
+    // Write every packet queued up since the last write, in order. Connections that can keep
+    // several transfers in flight override this; by default the packets are written one by one.
+    virtual bool WriteBatch(const std::deque<std::unique_ptr<apacket>>& packets);
+
     virtual bool DoTlsHandshake(RSA* key, std::string* auth_key = nullptr) = 0;
 
     // Terminate a connection.
@@ -335,6 +357,9 @@ class atransport : public enable_weak_from_this<atransport> {
 
     bool has_feature(const std::string& feature) const;
 
+    // Whether both ends flow control streams with delayed acks, see kFeatureDelayedAck.
+    bool SupportsDelayedAck() const { return delayed_ack_; }
+
     // Loads the transport's feature set from the given string.
     void SetFeatures(const std::string& features_string);
 
@@ -373,6 +398,7 @@ class atransport : public enable_weak_from_this<atransport> {
     // A set of features transmitted in the banner with the initial connection.
     // This is stored in the banner as 'features=feature0,feature1,etc'.
     FeatureSet features_;
+    bool delayed_ack_ = false;
     int protocol_version;
     size_t max_payload;
 
@@ -460,7 +486,7 @@ void close_usb_devices(std::function<bool(const atransport*)> predicate, bool re
 
 void send_packet(apacket* p, atransport* t);
 
-asocket* create_device_tracker(bool long_output);
+asocket* create_device_tracker(bool long_output, bool delta = false);
 
 #if !ADB_HOST
 unique_fd adb_listen(std::string_view addr, std::string* error);
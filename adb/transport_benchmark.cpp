@@ -21,6 +21,7 @@
 #include <benchmark/benchmark.h>
 
 #include "adb_trace.h"
+#include "fdevent/fdevent.h"
 #include "sysdeps.h"
 #include "transport.h"
 
@@ -31,12 +32,18 @@
         ->Arg(MAX_PAYLOAD)                                                     \
         ->UseRealTime();                                                       \
     BENCHMARK_TEMPLATE(benchmark_name, NonblockingFdConnection, ##__VA_ARGS__) \
+        ->Arg(1)                                                               \
+        ->Arg(16384)                                                           \
+        ->Arg(MAX_PAYLOAD)                                                     \
+        ->UseRealTime();                                                       \
+    BENCHMARK_TEMPLATE(benchmark_name, FdeventConnection, ##__VA_ARGS__)       \
         ->Arg(1)                                                               \
         ->Arg(16384)                                                           \
         ->Arg(MAX_PAYLOAD)                                                     \
         ->UseRealTime()
 
 struct NonblockingFdConnection;
+struct FdeventConnection;
 template <typename ConnectionType>
 std::unique_ptr<Connection> MakeConnection(unique_fd fd);
 
@@ -51,6 +58,11 @@ std::unique_ptr<Connection> MakeConnection<NonblockingFdConnection>(unique_fd fd
     return Connection::FromFd(std::move(fd));
 }
 
+template <>
+std::unique_ptr<Connection> MakeConnection<FdeventConnection>(unique_fd fd) {
+    return Connection::FromFdevent(std::move(fd));
+}
+
 template <typename ConnectionType>
 void BM_Connection_Unidirectional(benchmark::State& state) {
     int fds[2];
@@ -63,6 +75,10 @@ void BM_Connection_Unidirectional(benchmark::State& state) {
 
     std::atomic<size_t> received_bytes;
 
+    // FdeventConnection does its I/O on the fdevent thread.
+    fdevent_reset();
+    std::thread fdevent_thread([]() { fdevent_loop(); });
+
     client->SetReadCallback([](Connection*, std::unique_ptr<apacket>) -> bool { return true; });
     server->SetReadCallback([&received_bytes](Connection*, std::unique_ptr<apacket> packet) -> bool {
         received_bytes += packet->payload.size();
@@ -97,6 +113,11 @@ void BM_Connection_Unidirectional(benchmark::State& state) {
 
     client->Stop();
     server->Stop();
+
+    fdevent_terminate_loop();
+    fdevent_run_on_main_thread([]() {});
+
+    fdevent_thread.join();
 }
 
 ADB_CONNECTION_BENCHMARK(BM_Connection_Unidirectional);
@@ -16,7 +16,10 @@
 
 #include <stdint.h>
 
+#include <algorithm>
 #include <deque>
+#include <functional>
+#include <future>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -26,8 +29,10 @@
 #include <android-base/stringprintf.h>
 #include <android-base/thread_annotations.h>
 
+#include "adb_io.h"
 #include "adb_unique_fd.h"
 #include "adb_utils.h"
+#include "fdevent/fdevent.h"
 #include "sysdeps.h"
 #include "transport.h"
 #include "types.h"
@@ -239,3 +244,364 @@ struct NonblockingFdConnection : public Connection {
 std::unique_ptr<Connection> Connection::FromFd(unique_fd fd) {
     return std::make_unique<NonblockingFdConnection>(std::move(fd));
 }
+
+// A Connection whose I/O happens on the fdevent thread, for hosts with so many devices that a
+// read and a write thread for each of them adds up. Write can be called from any thread; it
+// writes as much as the socket takes straight away, and leaves the rest to the fdevent.
+//
+// TlsConnection can only do blocking I/O, so a TLS handshake hands the socket over to a
+// BlockingConnectionAdapter, which the connection forwards to from then on. The handshake has
+// to happen off the fdevent thread, which is the case on the host.
+struct FdeventConnection : public Connection {
+    FdeventConnection(unique_fd fd, std::function<void()> on_close)
+        : state_(std::make_shared<State>(this, std::move(fd))), on_close_(std::move(on_close)) {}
+
+    ~FdeventConnection() {
+        Stop();
+        Close();
+    }
+
+    void Start() override final {
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            if (started_) {
+                LOG(FATAL) << "FdeventConnection(" << transport_name_
+                           << "): started multiple times";
+            }
+            started_ = true;
+        }
+        fdevent_run_on_main_thread([state = state_]() { state->Attach(); });
+    }
+
+    void Stop() override final {
+        BlockingConnectionAdapter* delegate;
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            if (!started_ || state_->connection == nullptr) {
+                return;
+            }
+            state_->connection = nullptr;
+            delegate = delegate_.get();
+        }
+
+        LOG(INFO) << "FdeventConnection(" << transport_name_ << "): stopping";
+        if (delegate) {
+            delegate->Stop();
+        }
+        fdevent_run_on_main_thread([state = state_]() { state->Detach(); });
+        Close();
+        ReportError("requested stop");
+    }
+
+    void Reset() override final { Stop(); }
+
+    bool Write(std::unique_ptr<apacket> packet) override final {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (delegate_) {
+            return delegate_->Write(std::move(packet));
+        }
+        if (state_->connection == nullptr) {
+            return false;
+        }
+        if (state_->handing_over) {
+            handover_queue_.push_back(std::move(packet));
+            return true;
+        }
+
+        state_->Append(std::move(packet));
+        if (state_->write_pending) {
+            return true;
+        }
+
+        switch (state_->Flush()) {
+            case WriteResult::Completed:
+                return true;
+            case WriteResult::TryAgain:
+                state_->write_pending = true;
+                fdevent_run_on_main_thread([state = state_]() { state->WatchWrites(); });
+                return true;
+            case WriteResult::Error:
+                break;
+        }
+        ReportError(std::string("write failed: ") + strerror(errno));
+        return false;
+    }
+
+    bool DoTlsHandshake(RSA* key, std::string* auth_key) override final {
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            if (state_->connection == nullptr) {
+                return false;
+            }
+            state_->handing_over = true;
+        }
+
+        // Take the socket back from the fdevent loop once it has written out everything before
+        // the handshake.
+        std::promise<unique_fd> released;
+        std::future<unique_fd> future = released.get_future();
+        fdevent_run_on_main_thread(
+                [state = state_, &released]() { released.set_value(state->Release()); });
+        unique_fd fd = future.get();
+        if (fd < 0) {
+            return false;
+        }
+
+        auto fd_connection = std::make_unique<FdConnection>(std::move(fd));
+        bool success = fd_connection->DoTlsHandshake(key, auth_key);
+
+        auto delegate = std::make_unique<BlockingConnectionAdapter>(std::move(fd_connection));
+        delegate->SetTransportName(transport_name_);
+        delegate->SetReadCallback([this](Connection*, std::unique_ptr<apacket> packet) {
+            return read_callback_(this, std::move(packet));
+        });
+        delegate->SetErrorCallback(
+                [this](Connection*, const std::string& error) { ReportError(error); });
+
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        if (state_->connection == nullptr) {
+            return false;
+        }
+        delegate->Start();
+        for (auto& packet : handover_queue_) {
+            delegate->Write(std::move(packet));
+        }
+        handover_queue_.clear();
+        delegate_ = std::move(delegate);
+        return success;
+    }
+
+  private:
+    enum class WriteResult {
+        Error,
+        Completed,
+        TryAgain,
+    };
+
+    // Everything the fdevent callback needs, which outlives the connection until the fdevent
+    // has been destroyed on the main thread.
+    struct State {
+        State(FdeventConnection* connection, unique_fd fd)
+            : connection(connection), raw_fd(fd.get()), fd(std::move(fd)) {
+            set_file_block_mode(raw_fd, false);
+        }
+
+        std::mutex mutex;
+
+        // Cleared by Stop, after which queued up events do nothing.
+        FdeventConnection* connection GUARDED_BY(mutex);
+        IOVector write_buffer GUARDED_BY(mutex);
+        // Whether the fdevent is waiting for the socket to become writable.
+        bool write_pending GUARDED_BY(mutex) = false;
+        // Set once a TLS handshake is taking the socket away from the fdevent.
+        bool handing_over GUARDED_BY(mutex) = false;
+
+        const int raw_fd;
+
+        // Only touched on the main thread. |fd| belongs to |fde| once attached.
+        unique_fd fd;
+        fdevent* fde = nullptr;
+        amessage header;
+        size_t header_bytes = 0;
+        std::unique_ptr<apacket> packet;
+        size_t payload_bytes = 0;
+
+        static void OnEvent(fdevent*, unsigned events, void* arg) {
+            State* state = static_cast<State*>(arg);
+            if (events & FDE_WRITE) {
+                state->OnWritable();
+            }
+            if (events & FDE_READ) {
+                state->OnReadable();
+            }
+        }
+
+        void Attach() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (connection == nullptr || fd < 0) {
+                return;
+            }
+            fde = fdevent_create(fd.release(), &State::OnEvent, this);
+            fdevent_set(fde, FDE_READ | (write_pending ? FDE_WRITE : 0));
+        }
+
+        void Detach() {
+            if (fde) {
+                fdevent_destroy(fde);
+                fde = nullptr;
+            }
+        }
+
+        unique_fd Release() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (connection == nullptr || !fde) {
+                return {};
+            }
+
+            unique_fd result = fdevent_release(fde);
+            fde = nullptr;
+            set_file_block_mode(result.get(), true);
+            if (!write_buffer.empty()) {
+                if (!write_buffer.coalesced([&result](const char* data, size_t len) {
+                        return WriteFdExactly(result.get(), data, len);
+                    })) {
+                    return {};
+                }
+                write_buffer.clear();
+            }
+            write_pending = false;
+            return result;
+        }
+
+        void Append(std::unique_ptr<apacket> p) REQUIRES(mutex) {
+            const char* header_begin = reinterpret_cast<const char*>(&p->msg);
+            write_buffer.append(IOVector::block_type(header_begin, header_begin + sizeof(p->msg)));
+            write_buffer.append(std::move(p->payload));
+        }
+
+        WriteResult Flush() REQUIRES(mutex) {
+            while (!write_buffer.empty()) {
+                std::vector<adb_iovec> iovs = write_buffer.iovecs();
+                iovs.resize(std::min<size_t>(iovs.size(), 256));
+                ssize_t rc = adb_writev(raw_fd, iovs.data(), iovs.size());
+                if (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    return WriteResult::TryAgain;
+                } else if (rc <= 0) {
+                    if (rc == 0) errno = EPIPE;
+                    return WriteResult::Error;
+                }
+                write_buffer.drop_front(rc);
+            }
+            return WriteResult::Completed;
+        }
+
+        void WatchWrites() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (fde && write_pending) {
+                fdevent_add(fde, FDE_WRITE);
+            }
+        }
+
+        void OnWritable() {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (connection == nullptr || !write_pending) {
+                fdevent_del(fde, FDE_WRITE);
+                return;
+            }
+
+            switch (Flush()) {
+                case WriteResult::Completed:
+                    write_pending = false;
+                    fdevent_del(fde, FDE_WRITE);
+                    break;
+                case WriteResult::TryAgain:
+                    break;
+                case WriteResult::Error:
+                    Fail(std::string("write failed: ") + strerror(errno));
+                    break;
+            }
+        }
+
+        void OnReadable() {
+            // Bound the work done per event, so that one busy device can't starve the rest.
+            size_t budget = 2 * MAX_PAYLOAD;
+            while (budget > 0) {
+                char* buf;
+                size_t len;
+                if (header_bytes < sizeof(header)) {
+                    buf = reinterpret_cast<char*>(&header) + header_bytes;
+                    len = sizeof(header) - header_bytes;
+                } else {
+                    buf = packet->payload.data() + payload_bytes;
+                    len = header.data_length - payload_bytes;
+                }
+
+                ssize_t rc = adb_read(raw_fd, buf, len);
+                if (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    return;
+                } else if (rc <= 0) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    Fail(rc == 0 ? "read failed: EOF"
+                                 : std::string("read failed: ") + strerror(errno));
+                    return;
+                }
+                budget -= std::min<size_t>(budget, rc);
+
+                if (header_bytes < sizeof(header)) {
+                    header_bytes += rc;
+                    if (header_bytes < sizeof(header)) {
+                        continue;
+                    }
+                    if (header.data_length > MAX_PAYLOAD) {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        Fail(android::base::StringPrintf("read failed: payload too large (%u)",
+                                                         header.data_length));
+                        return;
+                    }
+                    packet = std::make_unique<apacket>();
+                    packet->msg = header;
+                    packet->payload.resize(header.data_length);
+                    payload_bytes = 0;
+                } else {
+                    payload_bytes += rc;
+                }
+
+                if (payload_bytes < header.data_length) {
+                    continue;
+                }
+
+                header_bytes = 0;
+                bool stls = packet->msg.command == A_STLS;
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (connection == nullptr) {
+                        return;
+                    }
+                    connection->read_callback_(connection, std::move(packet));
+                }
+
+                // What follows is the TLS handshake, which isn't ours to read.
+                if (stls) {
+                    fdevent_del(fde, FDE_READ);
+                    return;
+                }
+            }
+        }
+
+        // Only on the main thread; other threads report errors directly.
+        void Fail(const std::string& error) REQUIRES(mutex) {
+            if (connection == nullptr) {
+                return;
+            }
+            if (fde) {
+                fdevent_set(fde, 0);
+            }
+            connection->ReportError(error);
+        }
+    };
+
+    void Close() {
+        std::call_once(close_flag_, [this]() {
+            if (on_close_) on_close_();
+        });
+    }
+
+    void ReportError(const std::string& error) {
+        std::call_once(error_flag_, [this, &error]() { error_callback_(this, error); });
+    }
+
+    std::shared_ptr<State> state_;
+    std::function<void()> on_close_;
+
+    // Guarded by state_->mutex.
+    bool started_ = false;
+    std::unique_ptr<BlockingConnectionAdapter> delegate_;
+    std::deque<std::unique_ptr<apacket>> handover_queue_;
+
+    std::once_flag close_flag_;
+    std::once_flag error_flag_;
+};
+
+std::unique_ptr<Connection> Connection::FromFdevent(unique_fd fd, std::function<void()> on_close) {
+    return std::make_unique<FdeventConnection>(std::move(fd), std::move(on_close));
+}
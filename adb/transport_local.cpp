@@ -311,28 +311,22 @@ void local_init(const std::string& addr) {
 }
 
 #if ADB_HOST
-struct EmulatorConnection : public FdConnection {
-    EmulatorConnection(unique_fd fd, int local_port)
-        : FdConnection(std::move(fd)), local_port_(local_port) {}
-
-    ~EmulatorConnection() {
-        VLOG(TRANSPORT) << "remote_close, local_port = " << local_port_;
-        std::unique_lock<std::mutex> lock(retry_ports_lock);
-        RetryPort port;
-        port.port = local_port_;
-        port.retry_count = LOCAL_PORT_RETRY_COUNT;
-        retry_ports.push_back(port);
-        retry_ports_cond.notify_one();
-    }
-
-    void Close() override {
+// Forgets the emulator at |local_port| once its connection closes, and keeps an eye out for it
+// coming back.
+static void emulator_connection_closed(int local_port) {
+    {
         std::lock_guard<std::mutex> lock(local_transports_lock);
-        local_transports.erase(local_port_);
-        FdConnection::Close();
+        local_transports.erase(local_port);
     }
 
-    int local_port_;
-};
+    VLOG(TRANSPORT) << "remote_close, local_port = " << local_port;
+    std::unique_lock<std::mutex> lock(retry_ports_lock);
+    RetryPort port;
+    port.port = local_port;
+    port.retry_count = LOCAL_PORT_RETRY_COUNT;
+    retry_ports.push_back(port);
+    retry_ports_cond.notify_one();
+}
 
 /* Only call this function if you already hold local_transports_lock. */
 static atransport* find_emulator_transport_by_adb_port_locked(int adb_port)
@@ -366,9 +360,8 @@ int init_socket_transport(atransport* t, unique_fd fd, int adb_port, int local)
 #if ADB_HOST
     // Emulator connection.
     if (local) {
-        auto emulator_connection = std::make_unique<EmulatorConnection>(std::move(fd), adb_port);
-        t->SetConnection(
-                std::make_unique<BlockingConnectionAdapter>(std::move(emulator_connection)));
+        t->SetConnection(Connection::FromFdevent(
+                std::move(fd), [adb_port]() { emulator_connection_closed(adb_port); }));
         std::lock_guard<std::mutex> lock(local_transports_lock);
         atransport* existing_transport = find_emulator_transport_by_adb_port_locked(adb_port);
         if (existing_transport != nullptr) {
@@ -383,7 +376,12 @@ int init_socket_transport(atransport* t, unique_fd fd, int adb_port, int local)
 #endif
 
     // Regular tcp connection.
+#if ADB_HOST
+    // A server can have hundreds of these, so don't spend a pair of threads on each.
+    t->SetConnection(Connection::FromFdevent(std::move(fd)));
+#else
     auto fd_connection = std::make_unique<FdConnection>(std::move(fd));
     t->SetConnection(std::make_unique<BlockingConnectionAdapter>(std::move(fd_connection)));
+#endif
     return fail;
 }
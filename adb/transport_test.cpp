@@ -18,8 +18,16 @@
 
 #include <gtest/gtest.h>
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
 #include "adb.h"
+#include "adb_io.h"
 #include "fdevent/fdevent_test.h"
+#include "socket.h"
 
 struct TransportTest : public FdeventTest {};
 
@@ -80,6 +88,67 @@ TEST_F(TransportTest, SetFeatures) {
     ASSERT_EQ(0U, t.features().size());
 }
 
+// Keeps every packet written to it.
+struct RecordingConnection : public Connection {
+    explicit RecordingConnection(std::vector<std::unique_ptr<apacket>>* packets)
+        : packets_(packets) {}
+
+    bool Write(std::unique_ptr<apacket> packet) override {
+        packets_->push_back(std::move(packet));
+        return true;
+    }
+    void Start() override {}
+    void Stop() override {}
+    bool DoTlsHandshake(RSA*, std::string*) override { return false; }
+
+    std::vector<std::unique_ptr<apacket>>* packets_;
+};
+
+TEST_F(TransportTest, delayed_ack) {
+    atransport t;
+    t.SetFeatures(FeatureSetToString(FeatureSet{kFeatureDelayedAck}));
+    ASSERT_TRUE(t.SupportsDelayedAck());
+
+    std::vector<std::unique_ptr<apacket>> packets;
+    t.SetConnection(std::make_unique<RecordingConnection>(&packets));
+
+    asocket local;
+    local.id = 1;
+    asocket* remote = create_remote_socket(2, &t);
+    remote->peer = &local;
+
+    // Writes go out back to back until the other end's window is used up.
+    remote->available_send_bytes = 3 * 1024;
+    ASSERT_EQ(0, remote->enqueue(remote, apacket::payload_type(1024)));
+    ASSERT_EQ(0, remote->enqueue(remote, apacket::payload_type(1024)));
+    ASSERT_EQ(1, remote->enqueue(remote, apacket::payload_type(1024)));
+    ASSERT_EQ(3U, packets.size());
+    for (const auto& packet : packets) {
+        ASSERT_EQ(static_cast<uint32_t>(A_WRTE), packet->msg.command);
+        ASSERT_EQ(1024U, packet->msg.data_length);
+    }
+    packets.clear();
+
+    // Acks are held back until enough has been consumed, and then carry the byte count.
+    remote->unacked_bytes = DELAYED_ACK_THRESHOLD - 1;
+    remote->ready(remote);
+    ASSERT_TRUE(packets.empty());
+
+    remote->unacked_bytes += 1;
+    remote->ready(remote);
+    ASSERT_EQ(1U, packets.size());
+    ASSERT_EQ(static_cast<uint32_t>(A_OKAY), packets[0]->msg.command);
+    ASSERT_EQ(1U, packets[0]->msg.arg0);
+    ASSERT_EQ(2U, packets[0]->msg.arg1);
+    ASSERT_EQ(sizeof(int32_t), packets[0]->payload.size());
+    int32_t acked_bytes;
+    memcpy(&acked_bytes, packets[0]->payload.data(), sizeof(acked_bytes));
+    ASSERT_EQ(static_cast<int32_t>(DELAYED_ACK_THRESHOLD), acked_bytes);
+    ASSERT_EQ(0U, remote->unacked_bytes);
+
+    delete remote;
+}
+
 TEST_F(TransportTest, parse_banner_no_features) {
     atransport t;
 
@@ -183,3 +252,74 @@ TEST_F(TransportTest, test_matches_target_local) {
         EXPECT_FALSE(t.MatchesTarget("abc:100.100.100.100"));
     }
 }
+
+TEST_F(TransportTest, FdeventConnection) {
+    PrepareThread();
+
+    int fds[2];
+    ASSERT_EQ(0, adb_socketpair(fds));
+    unique_fd remote(fds[1]);
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::unique_ptr<apacket>> received;
+    std::string error;
+
+    auto connection = Connection::FromFdevent(unique_fd(fds[0]));
+    connection->SetReadCallback([&](Connection*, std::unique_ptr<apacket> packet) {
+        std::lock_guard<std::mutex> lock(mutex);
+        received.push_back(std::move(packet));
+        cv.notify_one();
+        return true;
+    });
+    connection->SetErrorCallback([&](Connection*, const std::string& e) {
+        std::lock_guard<std::mutex> lock(mutex);
+        error = e;
+        cv.notify_one();
+    });
+    connection->Start();
+
+    // Write a packet a byte at a time, so that it has to be put back together.
+    amessage msg = {};
+    msg.command = A_WRTE;
+    msg.data_length = 5;
+    std::string bytes(reinterpret_cast<const char*>(&msg), sizeof(msg));
+    bytes += "hello";
+    for (char c : bytes) {
+        ASSERT_TRUE(WriteFdExactly(remote, &c, 1));
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        ASSERT_TRUE(cv.wait_for(lock, 5s, [&]() { return !received.empty(); }));
+        ASSERT_EQ(1U, received.size());
+        EXPECT_EQ(static_cast<uint32_t>(A_WRTE), received[0]->msg.command);
+        EXPECT_EQ("hello", std::string(received[0]->payload.begin(), received[0]->payload.end()));
+    }
+
+    // A payload larger than the socket buffer has to be finished off by the fdevent.
+    auto packet = std::make_unique<apacket>();
+    packet->msg.command = A_WRTE;
+    packet->msg.data_length = MAX_PAYLOAD;
+    packet->payload.resize(MAX_PAYLOAD);
+    memset(packet->payload.data(), 'x', MAX_PAYLOAD);
+    ASSERT_TRUE(connection->Write(std::move(packet)));
+
+    amessage header;
+    ASSERT_TRUE(ReadFdExactly(remote, &header, sizeof(header)));
+    EXPECT_EQ(static_cast<uint32_t>(A_WRTE), header.command);
+    ASSERT_EQ(static_cast<uint32_t>(MAX_PAYLOAD), header.data_length);
+    std::string payload(MAX_PAYLOAD, '\0');
+    ASSERT_TRUE(ReadFdExactly(remote, payload.data(), payload.size()));
+    EXPECT_EQ(std::string(MAX_PAYLOAD, 'x'), payload);
+
+    connection->Stop();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        EXPECT_EQ("requested stop", error);
+    }
+    connection.reset();
+
+    WaitForFdeventLoop();
+    TerminateThread();
+}
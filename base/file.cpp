@@ -46,6 +46,7 @@
 
 #include "android-base/logging.h"  // and must be after windows.h for ERROR
 #include "android-base/macros.h"   // For TEMP_FAILURE_RETRY on Darwin.
+#include "android-base/mapped_file.h"
 #include "android-base/unique_fd.h"
 #include "android-base/utf8.h"
 
@@ -244,6 +245,86 @@ bool ReadFileToString(const std::string& path, std::string* content, bool follow
   return ReadFdToString(fd, content);
 }
 
+FileView::FileView() : data_(""), size_(0) {}
+
+FileView::~FileView() {}
+
+FileView::FileView(FileView&& other) : FileView() {
+  *this = std::move(other);
+}
+
+FileView& FileView::operator=(FileView&& other) {
+  if (this == &other) return *this;
+  mapping_ = std::move(other.mapping_);
+  buffer_ = std::move(other.buffer_);
+  // A short buffer_ lives inside the string object, so the pointer can't just be copied.
+  data_ = mapping_ ? other.data_ : buffer_.data();
+  size_ = other.size_;
+  other.Reset();
+  return *this;
+}
+
+void FileView::Reset() {
+  mapping_.reset();
+  buffer_.clear();
+  data_ = "";
+  size_ = 0;
+}
+
+// Below this, read(2) into a string is cheaper than setting up and tearing down a mapping.
+static constexpr off_t kMinMappedFileSize = 32 * 1024;
+
+bool ReadFdView(borrowed_fd fd, FileView* view) {
+  view->Reset();
+
+  struct stat sb;
+  off_t offset;
+  if (fstat(fd.get(), &sb) != -1 && S_ISREG(sb.st_mode) && sb.st_size >= kMinMappedFileSize &&
+      (offset = lseek(fd.get(), 0, SEEK_CUR)) != -1 && sb.st_size - offset >= kMinMappedFileSize) {
+    size_t size = sb.st_size - offset;
+    auto mapping = MappedFile::FromFd(fd, offset, size, PROT_READ);
+    if (mapping != nullptr && lseek(fd.get(), sb.st_size, SEEK_SET) != -1) {
+#if !defined(_WIN32)
+      // The caller is about to look at the whole file, so have it read in ahead of the faults.
+      // The mapping starts on a page boundary, except for the part of the page before offset.
+      uintptr_t page_mask = getpagesize() - 1;
+      char* start = reinterpret_cast<char*>(reinterpret_cast<uintptr_t>(mapping->data()) &
+                                            ~page_mask);
+      size_t length = mapping->data() + size - start;
+      madvise(start, length, MADV_WILLNEED);
+#if defined(MADV_HUGEPAGE)
+      // Where the kernel supports huge pages for files, this saves TLB misses on multi-MiB
+      // files. It fails harmlessly everywhere else.
+      if (length >= 2 * 1024 * 1024) madvise(start, length, MADV_HUGEPAGE);
+#endif
+#endif
+      view->data_ = mapping->data();
+      view->size_ = size;
+      view->mapping_ = std::move(mapping);
+      return true;
+    }
+  }
+
+  if (!ReadFdToString(fd, &view->buffer_)) {
+    view->buffer_.clear();
+    return false;
+  }
+  view->data_ = view->buffer_.data();
+  view->size_ = view->buffer_.size();
+  return true;
+}
+
+bool ReadFileView(const std::string& path, FileView* view, bool follow_symlinks) {
+  view->Reset();
+
+  int flags = O_RDONLY | O_CLOEXEC | O_BINARY | (follow_symlinks ? 0 : O_NOFOLLOW);
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), flags)));
+  if (fd == -1) {
+    return false;
+  }
+  return ReadFdView(fd, view);
+}
+
 bool WriteStringToFd(const std::string& content, borrowed_fd fd) {
   const char* p = content.data();
   size_t left = content.size();
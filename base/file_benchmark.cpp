@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "android-base/file.h"
+
+#include <string>
+
+#include <benchmark/benchmark.h>
+
+// Sizes from a small config file to a multi-MiB proto.
+static void FileSizes(benchmark::internal::Benchmark* b) {
+  for (int size : {4 * 1024, 32 * 1024, 256 * 1024, 1024 * 1024, 16 * 1024 * 1024}) {
+    b->Arg(size);
+  }
+}
+
+static void WriteTestFile(const TemporaryFile& tf, size_t size) {
+  android::base::WriteStringToFile(std::string(size, 'x'), tf.path);
+}
+
+static void BenchmarkReadFileToString(benchmark::State& state) {
+  TemporaryFile tf;
+  WriteTestFile(tf, state.range(0));
+  std::string content;
+  for (auto _ : state) {
+    android::base::ReadFileToString(tf.path, &content);
+    // Look at every page, as a parser would.
+    for (size_t i = 0; i < content.size(); i += 4096) {
+      benchmark::DoNotOptimize(content[i]);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BenchmarkReadFileToString)->Apply(FileSizes);
+
+static void BenchmarkReadFileView(benchmark::State& state) {
+  TemporaryFile tf;
+  WriteTestFile(tf, state.range(0));
+  android::base::FileView view;
+  for (auto _ : state) {
+    android::base::ReadFileView(tf.path, &view);
+    for (size_t i = 0; i < view.size(); i += 4096) {
+      benchmark::DoNotOptimize(view.data()[i]);
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BenchmarkReadFileView)->Apply(FileSizes);
@@ -383,3 +383,61 @@ TEST(file, ReadFileToString_capacity_0) {
   EXPECT_EQ(0U, s.size());
   EXPECT_EQ(initial_capacity, s.capacity());
 }
+
+TEST(file, ReadFileView) {
+  TemporaryFile tf;
+  ASSERT_NE(tf.fd, -1) << tf.path;
+
+  android::base::FileView view;
+  for (size_t size : {0, 1, 4096, 32 * 1024 - 1, 32 * 1024, 3 * 1024 * 1024 + 123}) {
+    std::string content(size, 'x');
+    for (size_t i = 0; i < size; i += 997) content[i] = 'a' + i % 26;
+    ASSERT_TRUE(android::base::WriteStringToFile(content, tf.path));
+    ASSERT_TRUE(android::base::ReadFileView(tf.path, &view)) << size;
+    EXPECT_EQ(size, view.size());
+    EXPECT_TRUE(view.view() == content) << size;
+  }
+
+  // Moving a view keeps it valid, whether it is mapped or a small copy.
+  android::base::FileView moved(std::move(view));
+  EXPECT_EQ(3U * 1024 * 1024 + 123, moved.size());
+  EXPECT_EQ(0U, view.size());
+  ASSERT_TRUE(android::base::WriteStringToFile("short", tf.path));
+  ASSERT_TRUE(android::base::ReadFileView(tf.path, &view));
+  moved = std::move(view);
+  EXPECT_EQ("short", moved.view());
+}
+
+TEST(file, ReadFileView_ENOENT) {
+  android::base::FileView view;
+  errno = 0;
+  EXPECT_FALSE(android::base::ReadFileView("/this/does/not/exist", &view));
+  EXPECT_EQ(ENOENT, errno);
+  EXPECT_EQ(0U, view.size());
+}
+
+TEST(file, ReadFdView_offset) {
+  TemporaryFile tf;
+  ASSERT_NE(tf.fd, -1) << tf.path;
+  std::string content(128 * 1024, 'x');
+  content[100] = 'y';
+  ASSERT_TRUE(android::base::WriteStringToFd(content, tf.fd));
+
+  // Reading starts at the current offset, which doesn't have to be page-aligned, and leaves the
+  // offset at the end of the file.
+  ASSERT_EQ(100, lseek(tf.fd, 100, SEEK_SET));
+  android::base::FileView view;
+  ASSERT_TRUE(android::base::ReadFdView(tf.fd, &view));
+  ASSERT_EQ(content.size() - 100, view.size());
+  EXPECT_TRUE(view.view() == std::string_view(content).substr(100));
+  EXPECT_EQ(static_cast<off_t>(content.size()), lseek(tf.fd, 0, SEEK_CUR));
+}
+
+#if defined(__linux__)
+TEST(file, ReadFileView_proc) {
+  // Files in /proc claim to be empty, so they have to be read.
+  android::base::FileView view;
+  ASSERT_TRUE(android::base::ReadFileView("/proc/self/status", &view));
+  EXPECT_NE(std::string_view::npos, view.view().find("Pid:"));
+}
+#endif
@@ -19,7 +19,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <memory>
 #include <string>
+#include <string_view>
 
 #include "android-base/macros.h"
 #include "android-base/off64_t.h"
@@ -82,6 +84,45 @@ bool ReadFdToString(borrowed_fd fd, std::string* content);
 bool ReadFileToString(const std::string& path, std::string* content,
                       bool follow_symlinks = false);
 
+class MappedFile;
+
+// The contents of a file, as returned by ReadFileView. Not copyable but movable.
+class FileView {
+ public:
+  FileView();
+  ~FileView();
+  FileView(FileView&& other);
+  FileView& operator=(FileView&& other);
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  std::string_view view() const { return std::string_view(data_, size_); }
+
+ private:
+  friend bool ReadFdView(borrowed_fd fd, FileView* view);
+  friend bool ReadFileView(const std::string& path, FileView* view, bool follow_symlinks);
+
+  void Reset();
+
+  std::unique_ptr<MappedFile> mapping_;
+  std::string buffer_;
+  const char* data_;
+  size_t size_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileView);
+};
+
+// Like ReadFileToString, but large regular files are mapped into memory rather than copied, with
+// hints for the kernel to read them ahead (and to back them with huge pages where it can). Small
+// files, and files whose size isn't known up front such as those in /proc, are read as usual.
+//
+// A mapping shares the file's pages, so it sees later writes to the file, and accessing it past
+// the end of a file that has since been truncated raises SIGBUS. Only use this for files that
+// aren't modified while they are being looked at.
+bool ReadFileView(const std::string& path, FileView* view, bool follow_symlinks = false);
+// Reads from the current offset of `fd` to the end of the file, leaving the offset at the end.
+bool ReadFdView(borrowed_fd fd, FileView* view);
+
 bool WriteStringToFile(const std::string& content, const std::string& path,
                        bool follow_symlinks = false);
 bool WriteStringToFd(const std::string& content, borrowed_fd fd);
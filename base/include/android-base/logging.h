@@ -133,6 +133,35 @@ class LogdLogger {
   LogId default_log_id_;
 };
 
+class AsyncLoggerState;
+
+// The AsyncLogger passes messages on to another logger, typically a LogdLogger, from a background
+// thread, so that the threads that log don't wait for each message to be written:
+//
+//   InitLogging(argv, AsyncLogger(LogdLogger()));
+//
+// The background thread is started by the first message, and hands everything that was queued
+// while it was busy to the wrapped logger in one go.  Threads that log wait while more than
+// max_queued_bytes of messages are queued.  FATAL and FATAL_WITHOUT_ABORT messages are written by
+// the thread that logs them, after the messages queued before them, so that they are out before
+// the process aborts; anything still queued when the process exits is written by an atexit
+// handler.  Copies of an AsyncLogger share the same queue and thread.
+//
+// Note that logd sees the background thread, not the thread that logged, as the message's writer.
+class AsyncLogger {
+ public:
+  explicit AsyncLogger(LogFunction&& logger, size_t max_queued_bytes = 256 * 1024);
+
+  void operator()(LogId, LogSeverity, const char* tag, const char* file, unsigned int line,
+                  const char* message);
+
+  // Waits until every message queued so far has been passed on to the wrapped logger.
+  void Flush();
+
+ private:
+  std::shared_ptr<AsyncLoggerState> state_;
+};
+
 // Configure logging based on ANDROID_LOG_TAGS environment variable.
 // We need to parse a string that looks like
 //
@@ -406,7 +435,8 @@ class LogMessage {
   ~LogMessage();
 
   // Returns the stream associated with the message, the LogMessage performs
-  // output when it goes out of scope.
+  // output when it goes out of scope.  If the severity is filtered out, this is a
+  // stream that discards its input without formatting it.
   std::ostream& stream();
 
   // The routine that performs the actual logging.
@@ -414,6 +444,7 @@ class LogMessage {
                       const char* msg);
 
  private:
+  // Null if the message is filtered out.
   const std::unique_ptr<LogMessageData> data_;
 
   DISALLOW_COPY_AND_ASSIGN(LogMessage);
@@ -32,6 +32,21 @@ namespace base {
 std::vector<std::string> Split(const std::string& s,
                                const std::string& delimiters);
 
+// Like Split, but returns views into `s` instead of copies, so `s` must outlive the result.
+std::vector<std::string_view> SplitView(std::string_view s, std::string_view delimiters);
+// The same, but clears and refills `result`, reusing its storage, so that a loop splitting many
+// lines doesn't allocate once the vector is big enough.
+void SplitView(std::string_view s, std::string_view delimiters,
+               std::vector<std::string_view>* result);
+
+// Splits a string at runs of the characters in delimiters, returning only the non-empty pieces,
+// as views into `s`. For example, Tokenize("  a b\t c ", " \t") is {"a", "b", "c"}.
+//
+// The empty string is not a valid delimiter list.
+std::vector<std::string_view> Tokenize(std::string_view s, std::string_view delimiters);
+void Tokenize(std::string_view s, std::string_view delimiters,
+              std::vector<std::string_view>* result);
+
 // Trims whitespace off both ends of the given string.
 std::string Trim(const std::string& s);
 
@@ -37,12 +37,14 @@
 #endif
 
 #include <atomic>
+#include <condition_variable>
 #include <iostream>
 #include <limits>
 #include <mutex>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -339,6 +341,166 @@ void LogdLogger::operator()(LogId id, LogSeverity severity, const char* tag, con
   SplitByLogdChunks(id, severity, tag, file, line, message, LogdLogChunk);
 }
 
+class AsyncLoggerState : public std::enable_shared_from_this<AsyncLoggerState> {
+ public:
+  AsyncLoggerState(LogFunction&& logger, size_t max_queued_bytes)
+      : logger_(std::move(logger)), max_queued_bytes_(max_queued_bytes) {}
+
+  void Log(LogId id, LogSeverity severity, const char* tag, const char* file, unsigned int line,
+           const char* message) {
+    // The queue belongs to the process that started the background thread; a forked child
+    // doesn't have that thread, and its lock may have been copied while held.  worker_id_ is
+    // published by the store to worker_pid_.
+    pid_t worker_pid = worker_pid_.load(std::memory_order_acquire);
+    bool sync = severity >= FATAL_WITHOUT_ABORT ||
+                (worker_pid != 0 &&
+                 (worker_pid != getpid() || std::this_thread::get_id() == worker_id_));
+    if (sync) {
+      Flush();
+      logger_(id, severity, tag, file, line, message);
+      return;
+    }
+
+    std::unique_lock<std::mutex> lock(lock_);
+    if (worker_pid_.load(std::memory_order_relaxed) == 0) {
+      StartWorker();
+    }
+    done_cv_.wait(lock, [this] { return text_.size() < max_queued_bytes_; });
+
+    Entry entry = {id, severity, line, Append(tag), Append(file), Append(message)};
+    entries_.push_back(entry);
+    queued_++;
+    if (entries_.size() == 1) {
+      work_cv_.notify_one();
+    }
+  }
+
+  void Flush() {
+    if (worker_pid_.load(std::memory_order_acquire) != getpid() ||
+        std::this_thread::get_id() == worker_id_) {
+      return;
+    }
+    std::unique_lock<std::mutex> lock(lock_);
+    uint64_t target = queued_;
+    done_cv_.wait(lock, [this, target] { return written_ >= target; });
+  }
+
+  static void FlushAll() {
+    std::vector<AsyncLoggerState*> states;
+    {
+      std::lock_guard<std::mutex> lock(RegistryLock());
+      states = Registry();
+    }
+    for (auto state : states) {
+      state->Flush();
+    }
+  }
+
+ private:
+  // The strings of the queued messages are stored back to back in text_, each followed by its
+  // terminating NUL, and entries refer to them by offset, so that queuing a message usually
+  // doesn't allocate.
+  struct Entry {
+    LogId id;
+    LogSeverity severity;
+    unsigned int line;
+    size_t tag;
+    size_t file;
+    size_t message;
+  };
+
+  size_t Append(const char* s) {
+    if (s == nullptr) {
+      return std::string::npos;
+    }
+    size_t offset = text_.size();
+    text_.append(s, strlen(s) + 1);
+    return offset;
+  }
+
+  static const char* At(const std::string& text, size_t offset) {
+    return offset == std::string::npos ? nullptr : text.data() + offset;
+  }
+
+  static std::mutex& RegistryLock() {
+    static auto& lock = *new std::mutex();
+    return lock;
+  }
+
+  // States are only registered once their thread runs, and that thread keeps them alive.
+  static std::vector<AsyncLoggerState*>& Registry() {
+    static auto& registry = *new std::vector<AsyncLoggerState*>();
+    return registry;
+  }
+
+  // Called with lock_ held.
+  void StartWorker() {
+    std::thread worker([self = shared_from_this()] { self->Run(); });
+    worker_id_ = worker.get_id();
+    worker.detach();
+    worker_pid_.store(getpid(), std::memory_order_release);
+
+    static std::once_flag atexit_once;
+    std::call_once(atexit_once, [] { atexit(FlushAll); });
+    std::lock_guard<std::mutex> registry_lock(RegistryLock());
+    Registry().push_back(this);
+  }
+
+  void Run() {
+    std::vector<Entry> entries;
+    std::string text;
+    std::unique_lock<std::mutex> lock(lock_);
+    while (true) {
+      work_cv_.wait(lock, [this] { return !entries_.empty(); });
+      entries.swap(entries_);
+      text.swap(text_);
+      // Threads waiting for room can go on queuing while this batch is written.
+      done_cv_.notify_all();
+      lock.unlock();
+
+      for (const auto& entry : entries) {
+        logger_(entry.id, entry.severity, At(text, entry.tag), At(text, entry.file), entry.line,
+                At(text, entry.message));
+      }
+      size_t written = entries.size();
+      entries.clear();
+      text.clear();
+
+      lock.lock();
+      written_ += written;
+      done_cv_.notify_all();
+    }
+  }
+
+  const LogFunction logger_;
+  const size_t max_queued_bytes_;
+
+  std::atomic<pid_t> worker_pid_ = 0;
+  std::thread::id worker_id_;
+
+  std::mutex lock_;
+  // Signaled when the queue stops being empty.
+  std::condition_variable work_cv_;
+  // Signaled when the queue is taken and when a batch has been written.
+  std::condition_variable done_cv_;
+  std::vector<Entry> entries_;
+  std::string text_;
+  uint64_t queued_ = 0;
+  uint64_t written_ = 0;
+};
+
+AsyncLogger::AsyncLogger(LogFunction&& logger, size_t max_queued_bytes)
+    : state_(std::make_shared<AsyncLoggerState>(std::move(logger), max_queued_bytes)) {}
+
+void AsyncLogger::operator()(LogId id, LogSeverity severity, const char* tag, const char* file,
+                             unsigned int line, const char* message) {
+  state_->Log(id, severity, tag, file, line, message);
+}
+
+void AsyncLogger::Flush() {
+  state_->Flush();
+}
+
 void InitLogging(char* argv[], LogFunction&& logger, AbortFunction&& aborter) {
   SetLogger(std::forward<LogFunction>(logger));
   SetAborter(std::forward<AbortFunction>(aborter));
@@ -475,13 +637,14 @@ LogMessage::LogMessage(const char* file, unsigned int line, LogId, LogSeverity s
                        const char* tag, int error)
     : LogMessage(file, line, severity, tag, error) {}
 
+// Check severity again. This is duplicate work wrt/ LOG macros, but not LOG_STREAM, and it means
+// that filtered out messages aren't formatted at all.
 LogMessage::LogMessage(const char* file, unsigned int line, LogSeverity severity, const char* tag,
                        int error)
-    : data_(new LogMessageData(file, line, severity, tag, error)) {}
+    : data_(WOULD_LOG(severity) ? new LogMessageData(file, line, severity, tag, error) : nullptr) {}
 
 LogMessage::~LogMessage() {
-  // Check severity again. This is duplicate work wrt/ LOG macros, but not LOG_STREAM.
-  if (!WOULD_LOG(data_->GetSeverity())) {
+  if (data_ == nullptr) {
     return;
   }
 
@@ -514,6 +677,11 @@ LogMessage::~LogMessage() {
 }
 
 std::ostream& LogMessage::stream() {
+  if (data_ == nullptr) {
+    // A stream without a buffer is always bad, so << returns without formatting anything.
+    static thread_local std::ostream null_stream(nullptr);
+    return null_stream;
+  }
   return data_->GetBuffer();
 }
 
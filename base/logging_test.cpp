@@ -22,9 +22,12 @@
 #include <signal.h>
 #endif
 
+#include <chrono>
+#include <mutex>
 #include <regex>
 #include <string>
 #include <thread>
+#include <vector>
 
 #include "android-base/file.h"
 #include "android-base/scopeguard.h"
@@ -620,6 +623,130 @@ TEST(logging, StdioLogger) {
   ASSERT_EQ(android::base::Basename(android::base::GetExecutablePath()) + ": err\n", cap_err.str());
 }
 
+TEST(logging, filtered_LOG_STREAM_is_not_formatted) {
+  android::base::ScopedLogSeverity sls(android::base::INFO);
+  std::ostream& filtered = LOG_STREAM(VERBOSE);
+  EXPECT_FALSE(filtered.good());
+  filtered << "dropped " << 42;
+  EXPECT_FALSE(filtered.good());
+}
+
+namespace {
+
+struct LoggedMessage {
+  android::base::LogSeverity severity;
+  std::string tag;
+  std::string message;
+  std::thread::id thread;
+};
+
+struct MessageCollector {
+  std::mutex lock;
+  std::vector<LoggedMessage> messages;
+
+  android::base::LogFunction Logger(int delay_ms = 0) {
+    return [this, delay_ms](android::base::LogId, android::base::LogSeverity severity,
+                            const char* tag, const char*, unsigned int, const char* message) {
+      if (delay_ms != 0) std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
+      std::lock_guard<std::mutex> guard(lock);
+      messages.push_back({severity, tag != nullptr ? tag : "(null)", message,
+                          std::this_thread::get_id()});
+    };
+  }
+};
+
+}  // namespace
+
+TEST(logging, AsyncLogger) {
+  using namespace android::base;
+  MessageCollector collector;
+  AsyncLogger logger(collector.Logger());
+
+  for (int i = 0; i < 100; i++) {
+    logger(MAIN, INFO, "tag", __FILE__, __LINE__, std::to_string(i).c_str());
+  }
+  logger(MAIN, INFO, nullptr, nullptr, 0, "no tag");
+  logger.Flush();
+
+  std::lock_guard<std::mutex> guard(collector.lock);
+  ASSERT_EQ(101U, collector.messages.size());
+  for (int i = 0; i < 100; i++) {
+    EXPECT_EQ(std::to_string(i), collector.messages[i].message);
+    EXPECT_EQ("tag", collector.messages[i].tag);
+    EXPECT_NE(std::this_thread::get_id(), collector.messages[i].thread);
+  }
+  EXPECT_EQ("(null)", collector.messages[100].tag);
+}
+
+TEST(logging, AsyncLogger_fatal_is_synchronous) {
+  using namespace android::base;
+  MessageCollector collector;
+  AsyncLogger logger(collector.Logger(1));
+
+  for (int i = 0; i < 10; i++) {
+    logger(MAIN, ERROR, "tag", __FILE__, __LINE__, "queued");
+  }
+  logger(MAIN, FATAL_WITHOUT_ABORT, "tag", __FILE__, __LINE__, "fatal");
+
+  std::lock_guard<std::mutex> guard(collector.lock);
+  ASSERT_EQ(11U, collector.messages.size());
+  EXPECT_EQ("queued", collector.messages[9].message);
+  EXPECT_EQ("fatal", collector.messages[10].message);
+  EXPECT_EQ(std::this_thread::get_id(), collector.messages[10].thread);
+}
+
+TEST(logging, AsyncLogger_full_queue) {
+  using namespace android::base;
+  MessageCollector collector;
+  // Room for a couple of messages only, so that the threads wait for the slow logger.
+  AsyncLogger logger(collector.Logger(1), 64);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([&logger, t] {
+      for (int i = 0; i < 20; i++) {
+        logger(MAIN, INFO, "tag", __FILE__, __LINE__, StringPrintf("%d %d", t, i).c_str());
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  logger.Flush();
+
+  std::lock_guard<std::mutex> guard(collector.lock);
+  ASSERT_EQ(80U, collector.messages.size());
+  // Each thread's messages come out in order.
+  int next[4] = {};
+  for (const auto& message : collector.messages) {
+    int t, i;
+    ASSERT_EQ(2, sscanf(message.message.c_str(), "%d %d", &t, &i));
+    EXPECT_EQ(next[t]++, i);
+  }
+}
+
+TEST(logging, AsyncLogger_SetLogger) {
+  using namespace android::base;
+  MessageCollector collector;
+  AsyncLogger logger(collector.Logger());
+  SetLogger(AsyncLogger(logger));
+  auto guard = make_scope_guard([&] {
+#ifdef __ANDROID__
+    SetLogger(LogdLogger());
+#else
+    SetLogger(StderrLogger);
+#endif
+  });
+
+  LOG(WARNING) << "through " << "LOG";
+  logger.Flush();
+
+  std::lock_guard<std::mutex> lock(collector.lock);
+  ASSERT_EQ(1U, collector.messages.size());
+  EXPECT_EQ(WARNING, collector.messages[0].severity);
+  EXPECT_EQ("through LOG", collector.messages[0].message);
+}
+
 TEST(logging, ForkSafe) {
 #if !defined(_WIN32)
   using namespace android::base;
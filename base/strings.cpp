@@ -16,6 +16,7 @@
 
 #include "android-base/strings.h"
 
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -28,24 +29,129 @@ namespace base {
 #define CHECK_NE(a, b) \
   if ((a) == (b)) abort();
 
-std::vector<std::string> Split(const std::string& s,
-                               const std::string& delimiters) {
-  CHECK_NE(delimiters.size(), 0U);
+namespace {
+
+// Finds the characters of a delimiter list in strings.  Split and friends are called in loops over
+// whole files, so rather than testing one character at a time against every delimiter as
+// find_first_of does, a single delimiter is left to memchr, and up to four are looked for eight
+// bytes at a time with the usual bit trick to find a zero byte in a word, which works the same on
+// every architecture that libbase is built for.
+class DelimiterFinder {
+ public:
+  explicit DelimiterFinder(std::string_view delimiters) : delimiters_(delimiters) {
+    CHECK_NE(delimiters.size(), 0U);
+    if (delimiters.size() <= kMaxWordDelimiters) {
+      // Unused patterns repeat the first delimiter, so that the scan doesn't depend on the count.
+      for (size_t i = 0; i < kMaxWordDelimiters; i++) {
+        unsigned char c = delimiters[i < delimiters.size() ? i : 0];
+        patterns_[i] = kOnes * c;
+      }
+    } else {
+      memset(table_, 0, sizeof(table_));
+      for (unsigned char c : delimiters) {
+        table_[c] = true;
+      }
+    }
+  }
 
-  std::vector<std::string> result;
+  // Returns the position of the first delimiter in s at or after pos, or npos.
+  size_t Find(std::string_view s, size_t pos) const {
+    const char* p = s.data() + pos;
+    const char* end = s.data() + s.size();
+    if (delimiters_.size() == 1) {
+      p = static_cast<const char*>(memchr(p, delimiters_[0], end - p));
+      return p != nullptr ? p - s.data() : s.npos;
+    }
+
+    if (delimiters_.size() > kMaxWordDelimiters) {
+      for (; p < end; p++) {
+        if (table_[static_cast<unsigned char>(*p)]) return p - s.data();
+      }
+      return s.npos;
+    }
 
+    if (kLittleEndian) {
+      for (; end - p >= 8; p += 8) {
+        uint64_t word;
+        memcpy(&word, p, sizeof(word));
+        // The lowest flagged byte of each term is a true match (borrows only propagate upwards),
+        // so the lowest flagged byte of all of them is the first delimiter.
+        uint64_t matches = 0;
+        for (size_t i = 0; i < kMaxWordDelimiters; i++) {
+          uint64_t v = word ^ patterns_[i];
+          matches |= (v - kOnes) & ~v & kHighBits;
+        }
+        if (matches != 0) {
+          return p - s.data() + __builtin_ctzll(matches) / 8;
+        }
+      }
+    }
+    for (; p < end; p++) {
+      if (memchr(delimiters_.data(), *p, delimiters_.size()) != nullptr) return p - s.data();
+    }
+    return s.npos;
+  }
+
+ private:
+  static constexpr size_t kMaxWordDelimiters = 4;
+  static constexpr uint64_t kOnes = 0x0101010101010101ULL;
+  static constexpr uint64_t kHighBits = 0x8080808080808080ULL;
+  static constexpr bool kLittleEndian = __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__;
+
+  std::string_view delimiters_;
+  uint64_t patterns_[kMaxWordDelimiters];
+  bool table_[256];
+};
+
+template <typename PieceT>
+void SplitInto(std::string_view s, std::string_view delimiters, bool skip_empty,
+               std::vector<PieceT>* result) {
+  DelimiterFinder finder(delimiters);
   size_t base = 0;
-  size_t found;
   while (true) {
-    found = s.find_first_of(delimiters, base);
-    result.push_back(s.substr(base, found - base));
+    size_t found = finder.Find(s, base);
+    size_t end = (found == s.npos) ? s.size() : found;
+    if (!skip_empty || end != base) {
+      result->emplace_back(s.data() + base, end - base);
+    }
     if (found == s.npos) break;
     base = found + 1;
   }
+}
 
+}  // namespace
+
+std::vector<std::string> Split(const std::string& s,
+                               const std::string& delimiters) {
+  std::vector<std::string> result;
+  SplitInto(s, delimiters, false, &result);
+  return result;
+}
+
+std::vector<std::string_view> SplitView(std::string_view s, std::string_view delimiters) {
+  std::vector<std::string_view> result;
+  SplitInto(s, delimiters, false, &result);
   return result;
 }
 
+void SplitView(std::string_view s, std::string_view delimiters,
+               std::vector<std::string_view>* result) {
+  result->clear();
+  SplitInto(s, delimiters, false, result);
+}
+
+std::vector<std::string_view> Tokenize(std::string_view s, std::string_view delimiters) {
+  std::vector<std::string_view> result;
+  SplitInto(s, delimiters, true, &result);
+  return result;
+}
+
+void Tokenize(std::string_view s, std::string_view delimiters,
+              std::vector<std::string_view>* result) {
+  result->clear();
+  SplitInto(s, delimiters, true, result);
+}
+
 std::string Trim(const std::string& s) {
   std::string result;
 
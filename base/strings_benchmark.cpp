@@ -0,0 +1,71 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "android-base/strings.h"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+// Typical inputs: an init .rc line, a /proc/<pid>/stat line, and a long list of values.
+static const char* const kLines[] = {
+    "service vold /system/bin/vold --blkid_context=u:r:blkid:s0 --fsck_context=u:r:fsck:s0",
+    "1234 (surfaceflinger) S 1 1234 0 0 -1 1077936384 34791 0 10 0 2312 1289 0 0 -8 0 12 0 1011 "
+    "2337304576 9104 18446744073709551615 1 1 0 0 0 0 0 4096 1073775864 0 0 0 17 3 0 0 0 0 0",
+    "0,1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31,32,33,"
+    "34,35,36,37,38,39,40,41,42,43,44,45,46,47,48,49,50,51,52,53,54,55,56,57,58,59,60,61,62,63",
+};
+static const char* const kDelimiters[] = {" ", " ", ","};
+
+static void BenchmarkSplit(benchmark::State& state) {
+  std::string line = kLines[state.range(0)];
+  std::string delimiters = kDelimiters[state.range(0)];
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(android::base::Split(line, delimiters));
+  }
+}
+BENCHMARK(BenchmarkSplit)->DenseRange(0, 2);
+
+static void BenchmarkSplit_whitespace(benchmark::State& state) {
+  std::string line = kLines[state.range(0)];
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(android::base::Split(line, " \t\n"));
+  }
+}
+BENCHMARK(BenchmarkSplit_whitespace)->DenseRange(0, 2);
+
+static void BenchmarkSplitView(benchmark::State& state) {
+  std::string line = kLines[state.range(0)];
+  std::vector<std::string_view> pieces;
+  for (auto _ : state) {
+    android::base::SplitView(line, kDelimiters[state.range(0)], &pieces);
+    benchmark::DoNotOptimize(pieces.data());
+  }
+}
+BENCHMARK(BenchmarkSplitView)->DenseRange(0, 2);
+
+static void BenchmarkTokenize_whitespace(benchmark::State& state) {
+  std::string line = kLines[state.range(0)];
+  std::vector<std::string_view> pieces;
+  for (auto _ : state) {
+    android::base::Tokenize(line, " \t\n", &pieces);
+    benchmark::DoNotOptimize(pieces.data());
+  }
+}
+BENCHMARK(BenchmarkTokenize_whitespace)->DenseRange(0, 2);
@@ -18,7 +18,9 @@
 
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <set>
 #include <unordered_set>
@@ -83,6 +85,76 @@ TEST(strings, split_any_with_empty_part) {
   ASSERT_EQ("bar", parts[2]);
 }
 
+TEST(strings, split_view) {
+  std::string s = "foo:,bar:";
+  std::vector<std::string_view> parts = android::base::SplitView(s, ",:");
+  ASSERT_EQ(4U, parts.size());
+  EXPECT_EQ("foo", parts[0]);
+  EXPECT_EQ("", parts[1]);
+  EXPECT_EQ("bar", parts[2]);
+  EXPECT_EQ("", parts[3]);
+  // The pieces point into the original string.
+  EXPECT_EQ(s.data() + 5, parts[2].data());
+
+  android::base::SplitView("a b", " ", &parts);
+  ASSERT_EQ(2U, parts.size());
+  EXPECT_EQ("a", parts[0]);
+  EXPECT_EQ("b", parts[1]);
+}
+
+TEST(strings, tokenize) {
+  std::vector<std::string_view> parts =
+      android::base::Tokenize("  service  foo\t/bin/foo \n", " \t\n");
+  ASSERT_EQ(3U, parts.size());
+  EXPECT_EQ("service", parts[0]);
+  EXPECT_EQ("foo", parts[1]);
+  EXPECT_EQ("/bin/foo", parts[2]);
+
+  EXPECT_EQ(0U, android::base::Tokenize("", " ").size());
+  EXPECT_EQ(0U, android::base::Tokenize(" \t ", " \t").size());
+
+  android::base::Tokenize("x", " ", &parts);
+  ASSERT_EQ(1U, parts.size());
+  EXPECT_EQ("x", parts[0]);
+}
+
+// Checks the word-at-a-time scan against find_first_of for every delimiter count it handles
+// differently, with delimiters at every position of a word and bytes with the high bit set.
+TEST(strings, split_matches_find_first_of) {
+  const std::string alphabet("ab,: \t\x80\xff\0", 9);
+  unsigned seed = 1;
+  for (size_t delimiter_count = 1; delimiter_count <= 6; delimiter_count++) {
+    std::string delimiters = alphabet.substr(alphabet.size() - delimiter_count);
+    for (int round = 0; round < 500; round++) {
+      std::string s;
+      seed = seed * 1103515245 + 12345;
+      size_t length = (seed >> 16) % 40;
+      for (size_t i = 0; i < length; i++) {
+        seed = seed * 1103515245 + 12345;
+        // Mostly non-delimiters, so that some words have no delimiter at all.
+        s += (seed >> 16) % 4 ? alphabet[(seed >> 20) % 2] : alphabet[(seed >> 20) % 9];
+      }
+
+      std::vector<std::string> expected;
+      size_t base = 0;
+      while (true) {
+        size_t found = s.find_first_of(delimiters, base);
+        expected.push_back(s.substr(base, found - base));
+        if (found == s.npos) break;
+        base = found + 1;
+      }
+      ASSERT_EQ(expected, android::base::Split(s, delimiters));
+
+      std::vector<std::string_view> views = android::base::SplitView(s, delimiters);
+      ASSERT_EQ(expected, std::vector<std::string>(views.begin(), views.end()));
+
+      expected.erase(std::remove(expected.begin(), expected.end(), ""), expected.end());
+      views = android::base::Tokenize(s, delimiters);
+      ASSERT_EQ(expected, std::vector<std::string>(views.begin(), views.end()));
+    }
+  }
+}
+
 TEST(strings, trim_empty) {
   ASSERT_EQ("", android::base::Trim(""));
 }
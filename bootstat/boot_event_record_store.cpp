@@ -18,11 +18,15 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #include <utime.h>
 
 #include <chrono>
 #include <cstdlib>
+#include <cstring>
 #include <string>
 #include <utility>
 
@@ -30,11 +34,51 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
+#include <android-base/strings.h>
 
 namespace {
 
 const char BOOTSTAT_DATA_DIR[] = "/data/misc/bootstat/";
 
+// The boot event log lives in the record store directory. The leading '.'
+// keeps it from being mistaken for a boot event record.
+const char BOOT_EVENT_LOG_NAME[] = ".boot_event_log";
+
+const char BOOT_EVENT_LOG_MAGIC[8] = {'B', 'T', 'E', 'V', 'L', 'O', 'G', '1'};
+
+// The boot event log starts with a header identifying the boot it belongs to,
+// followed by one fixed-size record per event.
+struct BootEventLogHeader {
+  char magic[8];
+  // The kernel's boot_id, NUL-terminated.
+  char boot_id[56];
+};
+
+struct BootEventLogRecord {
+  int64_t timestamp_ns;
+  int64_t value;
+  // NUL-terminated.
+  char event[BootEventRecordStore::kMaxLogEventLength + 1];
+};
+
+static_assert(sizeof(BootEventLogHeader) == 64);
+static_assert(sizeof(BootEventLogRecord) == 64);
+
+// Reads the kernel's random identifier of the current boot.
+bool ReadBootId(std::string* boot_id) {
+  if (!android::base::ReadFileToString("/proc/sys/kernel/random/boot_id", boot_id)) {
+    PLOG(ERROR) << "Failed to read boot_id";
+    return false;
+  }
+  *boot_id = android::base::Trim(*boot_id);
+  return !boot_id->empty() && boot_id->size() < sizeof(BootEventLogHeader::boot_id);
+}
+
+bool IsCurrentBootLog(const BootEventLogHeader& header, const std::string& boot_id) {
+  return memcmp(header.magic, BOOT_EVENT_LOG_MAGIC, sizeof(header.magic)) == 0 &&
+         strncmp(header.boot_id, boot_id.c_str(), sizeof(header.boot_id)) == 0;
+}
+
 // Given a boot even record file at |path|, extracts the event's relative time
 // from the record into |uptime|.
 bool ParseRecordEventTime(const std::string& path, int32_t* uptime) {
@@ -121,8 +165,8 @@ std::vector<BootEventRecordStore::BootEventRecord> BootEventRecordStore::GetAllB
 
   struct dirent* entry;
   while ((entry = readdir(dir.get())) != NULL) {
-    // Only parse regular files.
-    if (entry->d_type != DT_REG) {
+    // Only parse regular files, and skip the boot event log.
+    if (entry->d_type != DT_REG || entry->d_name[0] == '.') {
       continue;
     }
 
@@ -139,12 +183,117 @@ std::vector<BootEventRecordStore::BootEventRecord> BootEventRecordStore::GetAllB
   return events;
 }
 
+void BootEventRecordStore::LogBootEvent(const std::string& event, int64_t value) {
+  // Take the timestamp first, so that opening the log isn't counted against the event.
+  BootEventLogRecord record = {};
+  record.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            android::base::boot_clock::now().time_since_epoch())
+                            .count();
+  record.value = value;
+  event.copy(record.event, kMaxLogEventLength);
+
+  if (!OpenBootEventLog()) {
+    return;
+  }
+
+  // A single write of a whole record to an O_APPEND file doesn't interleave
+  // with the records appended by other processes.
+  if (TEMP_FAILURE_RETRY(write(log_fd_, &record, sizeof(record))) != sizeof(record)) {
+    PLOG(ERROR) << "Failed to log boot event " << event;
+  }
+}
+
+std::vector<BootEventRecordStore::BootEventLogEntry> BootEventRecordStore::GetBootEventLog()
+    const {
+  std::vector<BootEventLogEntry> entries;
+
+  std::string boot_id;
+  if (!ReadBootId(&boot_id)) {
+    return entries;
+  }
+
+  const std::string log_path = GetBootEventPath(BOOT_EVENT_LOG_NAME);
+  android::base::unique_fd fd(open(log_path.c_str(), O_RDONLY | O_CLOEXEC));
+  struct stat file_stat;
+  if (fd == -1 || fstat(fd, &file_stat) == -1 ||
+      static_cast<size_t>(file_stat.st_size) < sizeof(BootEventLogHeader)) {
+    return entries;
+  }
+
+  const size_t size = file_stat.st_size;
+  void* map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    PLOG(ERROR) << "Failed to map " << log_path;
+    return entries;
+  }
+
+  const auto* header = static_cast<const BootEventLogHeader*>(map);
+  if (IsCurrentBootLog(*header, boot_id)) {
+    // A record still being appended is left out.
+    const size_t count = (size - sizeof(*header)) / sizeof(BootEventLogRecord);
+    const auto* records = reinterpret_cast<const BootEventLogRecord*>(header + 1);
+    entries.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+      const BootEventLogRecord& record = records[i];
+      entries.push_back({std::string(record.event, strnlen(record.event, sizeof(record.event))),
+                         record.timestamp_ns, record.value});
+    }
+  }
+
+  munmap(map, size);
+  return entries;
+}
+
 void BootEventRecordStore::SetStorePath(const std::string& path) {
   DCHECK_EQ('/', path.back());
   store_path_ = path;
+  log_fd_.reset();
 }
 
 std::string BootEventRecordStore::GetBootEventPath(const std::string& event) const {
   DCHECK_EQ('/', store_path_.back());
   return store_path_ + event;
 }
+
+bool BootEventRecordStore::OpenBootEventLog() {
+  if (log_fd_ != -1) {
+    return true;
+  }
+
+  std::string boot_id;
+  if (!ReadBootId(&boot_id)) {
+    return false;
+  }
+
+  const std::string log_path = GetBootEventPath(BOOT_EVENT_LOG_NAME);
+  android::base::unique_fd fd(
+      open(log_path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, S_IRUSR | S_IWUSR));
+  if (fd == -1) {
+    PLOG(ERROR) << "Failed to open " << log_path;
+    return false;
+  }
+
+  // The first process to log during a boot replaces the previous boot's log.
+  // The lock keeps others from appending to the log before its header is
+  // written; once it is, the log is only ever appended to.
+  if (TEMP_FAILURE_RETRY(flock(fd, LOCK_EX)) == -1) {
+    PLOG(ERROR) << "Failed to lock " << log_path;
+    return false;
+  }
+  BootEventLogHeader header;
+  if (TEMP_FAILURE_RETRY(pread(fd, &header, sizeof(header), 0)) != sizeof(header) ||
+      !IsCurrentBootLog(header, boot_id)) {
+    header = {};
+    memcpy(header.magic, BOOT_EVENT_LOG_MAGIC, sizeof(header.magic));
+    boot_id.copy(header.boot_id, sizeof(header.boot_id) - 1);
+    if (ftruncate(fd, 0) == -1 ||
+        TEMP_FAILURE_RETRY(write(fd, &header, sizeof(header))) != sizeof(header)) {
+      PLOG(ERROR) << "Failed to start " << log_path;
+      return false;
+    }
+  }
+  flock(fd, LOCK_UN);
+
+  log_fd_ = std::move(fd);
+  return true;
+}
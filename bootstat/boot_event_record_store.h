@@ -18,7 +18,9 @@
 #define BOOT_EVENT_RECORD_STORE_H_
 
 #include <android-base/macros.h>
+#include <android-base/unique_fd.h>
 #include <gtest/gtest_prod.h>
+#include <cstddef>
 #include <cstdint>
 #include <string>
 #include <utility>
@@ -48,6 +50,27 @@ class BootEventRecordStore {
   // Returns a list of all of the boot events persisted in the record store.
   std::vector<BootEventRecord> GetAllBootEvents() const;
 
+  // An entry of the boot event log.
+  struct BootEventLogEntry {
+    std::string event;
+    // The boot_clock time at which the event was logged.
+    int64_t timestamp_ns;
+    int64_t value;
+  };
+
+  // Appends |event| and |value| to the log of this boot's events, stamped with
+  // the current boot_clock time in nanoseconds. The log is an append-only file
+  // of fixed-size records, so once it is open each call is a single write(),
+  // and several processes can log to it at once. Event names are truncated to
+  // kMaxLogEventLength characters. Unlike the records above, the log does not
+  // survive a reboot.
+  void LogBootEvent(const std::string& event, int64_t value = 0);
+
+  // Returns the events logged during this boot, in the order they were logged.
+  std::vector<BootEventLogEntry> GetBootEventLog() const;
+
+  static constexpr size_t kMaxLogEventLength = 47;
+
  private:
   // The tests call SetStorePath to override the default store location with a
   // more test-friendly path.
@@ -56,6 +79,9 @@ class BootEventRecordStore {
   FRIEND_TEST(BootEventRecordStoreTest, AddBootEventWithValue);
   FRIEND_TEST(BootEventRecordStoreTest, GetBootEvent);
   FRIEND_TEST(BootEventRecordStoreTest, GetBootEventNoFileContent);
+  FRIEND_TEST(BootEventRecordStoreTest, LogBootEvent);
+  FRIEND_TEST(BootEventRecordStoreTest, LogBootEventTruncatesName);
+  FRIEND_TEST(BootEventRecordStoreTest, LogBootEventDiscardsPreviousBoot);
 
   // Sets the filesystem path of the record store.
   void SetStorePath(const std::string& path);
@@ -63,9 +89,16 @@ class BootEventRecordStore {
   // Constructs the full path of the given boot |event|.
   std::string GetBootEventPath(const std::string& event) const;
 
+  // Opens the boot event log for appending, starting a new one if it was
+  // written during a previous boot.
+  bool OpenBootEventLog();
+
   // The filesystem path of the record store.
   std::string store_path_;
 
+  // The boot event log, opened by the first LogBootEvent call.
+  android::base::unique_fd log_fd_;
+
   DISALLOW_COPY_AND_ASSIGN(BootEventRecordStore);
 };
 
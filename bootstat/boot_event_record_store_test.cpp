@@ -223,3 +223,78 @@ TEST_F(BootEventRecordStoreTest, GetBootEventNoFileContent) {
   EXPECT_EQ("devonian", record.first);
   EXPECT_EQ(2718, record.second);
 }
+
+TEST_F(BootEventRecordStoreTest, LogBootEvent) {
+  BootEventRecordStore store;
+  store.SetStorePath(GetStorePathForTesting());
+
+  EXPECT_TRUE(store.GetBootEventLog().empty());
+
+  auto before = android::base::boot_clock::now();
+  store.LogBootEvent("ordovician");
+  store.LogBootEvent("silurian", -7);
+  auto after = android::base::boot_clock::now();
+
+  // A second store appends to the same log.
+  BootEventRecordStore other_store;
+  other_store.SetStorePath(GetStorePathForTesting());
+  other_store.LogBootEvent("devonian", 1LL << 40);
+
+  auto entries = store.GetBootEventLog();
+  ASSERT_EQ(3U, entries.size());
+  EXPECT_EQ("ordovician", entries[0].event);
+  EXPECT_EQ(0, entries[0].value);
+  EXPECT_EQ("silurian", entries[1].event);
+  EXPECT_EQ(-7, entries[1].value);
+  EXPECT_EQ("devonian", entries[2].event);
+  EXPECT_EQ(1LL << 40, entries[2].value);
+
+  EXPECT_LE(before.time_since_epoch().count(), entries[0].timestamp_ns);
+  EXPECT_LE(entries[0].timestamp_ns, entries[1].timestamp_ns);
+  EXPECT_LE(entries[1].timestamp_ns, after.time_since_epoch().count());
+  EXPECT_LE(entries[1].timestamp_ns, entries[2].timestamp_ns);
+
+  // The log isn't a boot event record.
+  EXPECT_TRUE(store.GetAllBootEvents().empty());
+}
+
+TEST_F(BootEventRecordStoreTest, LogBootEventTruncatesName) {
+  BootEventRecordStore store;
+  store.SetStorePath(GetStorePathForTesting());
+
+  const std::string name(BootEventRecordStore::kMaxLogEventLength + 10, 'x');
+  store.LogBootEvent(name);
+
+  auto entries = store.GetBootEventLog();
+  ASSERT_EQ(1U, entries.size());
+  EXPECT_EQ(name.substr(0, BootEventRecordStore::kMaxLogEventLength), entries[0].event);
+}
+
+TEST_F(BootEventRecordStoreTest, LogBootEventDiscardsPreviousBoot) {
+  BootEventRecordStore store;
+  store.SetStorePath(GetStorePathForTesting());
+
+  store.LogBootEvent("mississippian");
+  store.LogBootEvent("pennsylvanian");
+  ASSERT_EQ(2U, store.GetBootEventLog().size());
+
+  // Pretend that the log was written during another boot.
+  const std::string log_path = store.GetBootEventPath(".boot_event_log");
+  {
+    android::base::unique_fd fd(open(log_path.c_str(), O_WRONLY | O_CLOEXEC));
+    ASSERT_NE(-1, fd);
+    const char stale_boot_id[] = "00000000-0000-0000-0000-000000000000";
+    ASSERT_EQ(static_cast<ssize_t>(sizeof(stale_boot_id)),
+              pwrite(fd, stale_boot_id, sizeof(stale_boot_id), 8));
+  }
+  EXPECT_TRUE(store.GetBootEventLog().empty());
+
+  BootEventRecordStore next_boot_store;
+  next_boot_store.SetStorePath(GetStorePathForTesting());
+  next_boot_store.LogBootEvent("permian", 3);
+
+  auto entries = next_boot_store.GetBootEventLog();
+  ASSERT_EQ(1U, entries.size());
+  EXPECT_EQ("permian", entries[0].event);
+  EXPECT_EQ(3, entries[0].value);
+}
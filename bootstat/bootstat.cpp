@@ -22,6 +22,7 @@
 #include <sys/klog.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <chrono>
 #include <cmath>
 #include <cstddef>
@@ -189,9 +190,11 @@ void RecordBootEventFromCommandLine(const std::string& event, const std::string&
   if (!value_str.empty()) {
     int32_t value = 0;
     if (android::base::ParseInt(value_str, &value)) {
+      boot_event_store.LogBootEvent(event, value);
       boot_event_store.AddBootEventWithValue(event, value);
     }
   } else {
+    boot_event_store.LogBootEvent(event);
     boot_event_store.AddBootEvent(event);
   }
 }
@@ -207,6 +210,45 @@ void PrintBootEvents() {
   }
 }
 
+// Prints the boot events logged during this boot in the format of init's
+// write_boot_timeline builtin, "bootstat <ns> <ns> <event>[=<value>]", merged
+// in time order with the timeline at |init_timeline| if one is given, so that
+// init/boot_timeline.py can place them along boot's critical path.
+void PrintBootTimeline(const char* init_timeline) {
+  std::vector<std::pair<int64_t, std::string>> lines;
+
+  if (init_timeline != nullptr && *init_timeline != '\0') {
+    std::string content;
+    if (!android::base::ReadFileToString(init_timeline, &content)) {
+      PLOG(ERROR) << "Failed to read " << init_timeline;
+    }
+    for (auto& line : android::base::Split(content, "\n")) {
+      auto fields = android::base::Split(line, " ");
+      int64_t start;
+      if (fields.size() < 4 || !android::base::ParseInt(fields[1], &start)) {
+        continue;
+      }
+      lines.emplace_back(start, std::move(line));
+    }
+  }
+
+  BootEventRecordStore boot_event_store;
+  for (const auto& entry : boot_event_store.GetBootEventLog()) {
+    std::string timestamp = std::to_string(entry.timestamp_ns);
+    std::string line = "bootstat " + timestamp + " " + timestamp + " " + entry.event;
+    if (entry.value != 0) {
+      line += "=" + std::to_string(entry.value);
+    }
+    lines.emplace_back(entry.timestamp_ns, std::move(line));
+  }
+
+  std::stable_sort(lines.begin(), lines.end(),
+                   [](const auto& a, const auto& b) { return a.first < b.first; });
+  for (const auto& line : lines) {
+    printf("%s\n", line.second.c_str());
+  }
+}
+
 void ShowHelp(const char* cmd) {
   fprintf(stderr, "Usage: %s [options]...\n", cmd);
   fprintf(stderr,
@@ -219,7 +261,8 @@ void ShowHelp(const char* cmd) {
           "  --record_boot_complete  Record metrics related to the time for the device boot\n"
           "  --record_boot_reason    Record the reason why the device booted\n"
           "  --record_time_since_factory_reset  Record the time since the device was reset\n"
-          "  --boot_reason_enum=<reason>  Report the match to the kBootReasonMap table\n");
+          "  --boot_reason_enum=<reason>  Report the match to the kBootReasonMap table\n"
+          "  --timeline[=<init timeline>]  Dump this boot's events, merged with init's timeline\n");
 }
 
 // Constructs a readable, printable string from the givencommand line
@@ -1466,6 +1509,7 @@ int main(int argc, char** argv) {
   static const char boot_reason_str[] = "record_boot_reason";
   static const char factory_reset_str[] = "record_time_since_factory_reset";
   static const char boot_reason_enum_str[] = "boot_reason_enum";
+  static const char timeline_str[] = "timeline";
   static const struct option long_options[] = {
       // clang-format off
       { "help",                 no_argument,       NULL,   'h' },
@@ -1478,6 +1522,7 @@ int main(int argc, char** argv) {
       { boot_reason_str,        no_argument,       NULL,   0 },
       { factory_reset_str,      no_argument,       NULL,   0 },
       { boot_reason_enum_str,   optional_argument, NULL,   0 },
+      { timeline_str,           optional_argument, NULL,   0 },
       { NULL,                   0,                 NULL,   0 }
       // clang-format on
   };
@@ -1504,6 +1549,8 @@ int main(int argc, char** argv) {
           RecordFactoryReset();
         } else if (option_name == boot_reason_enum_str) {
           PrintBootReasonEnum(optarg);
+        } else if (option_name == timeline_str) {
+          PrintBootTimeline(optarg);
         } else {
           LOG(ERROR) << "Invalid option: " << option_name;
         }
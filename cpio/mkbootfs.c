@@ -11,6 +11,10 @@
 
 #include <stdarg.h>
 #include <fcntl.h>
+#include <pthread.h>
+
+#include <lz4.h>
+#include <lz4hc.h>
 
 #include <private/android_filesystem_config.h>
 
@@ -21,6 +25,9 @@
 ** - dotfiles are ignored
 ** - directories named 'root' are ignored
 ** - device notes, pipes, etc are not supported (error)
+** - with -c lz4 the archive is compressed in the lz4 legacy format,
+**   the same as `lz4 -l -12`; blocks are compressed on worker threads
+**   while the tree is still being walked
 */
 
 void die(const char *why, ...)
@@ -56,6 +63,117 @@ static char *target_out_path = NULL;
 static int verbose = 0;
 static int total_size = 0;
 
+/* The lz4 legacy format is a magic number followed by blocks of up to
+ * 8MiB of input, each compressed independently and preceded by its
+ * compressed size, so the blocks can be compressed in parallel. */
+#define LZ4_LEGACY_MAGIC 0x184C2102
+#define LZ4_LEGACY_BLOCK_SIZE (8 << 20)
+
+struct lz4_block {
+    pthread_t thread;
+    char *in;
+    int in_size;
+    char *out;
+    int out_size;
+};
+
+static int compress_lz4 = 0;
+static char *lz4_input = NULL;
+static int lz4_input_size = 0;
+/* A ring of blocks being compressed, written out in order. */
+static struct lz4_block *lz4_blocks = NULL;
+static int lz4_max_blocks = 0;
+static int lz4_first_block = 0;
+static int lz4_num_blocks = 0;
+
+static void write_le32(unsigned value)
+{
+    unsigned char bytes[4] = { value, value >> 8, value >> 16, value >> 24 };
+    if (fwrite(bytes, sizeof(bytes), 1, stdout) != 1) die("cannot write output");
+}
+
+static void *compress_block(void *arg)
+{
+    struct lz4_block *b = arg;
+    b->out_size = LZ4_compress_HC(b->in, b->out, b->in_size, LZ4_compressBound(b->in_size),
+                                  LZ4HC_CLEVEL_MAX);
+    return NULL;
+}
+
+static void finish_block()
+{
+    struct lz4_block *b = &lz4_blocks[lz4_first_block];
+    pthread_join(b->thread, NULL);
+    if (b->out_size <= 0) die("cannot compress %d bytes", b->in_size);
+    write_le32(b->out_size);
+    if (fwrite(b->out, b->out_size, 1, stdout) != 1) die("cannot write output");
+    free(b->in);
+    free(b->out);
+    lz4_first_block = (lz4_first_block + 1) % lz4_max_blocks;
+    lz4_num_blocks--;
+}
+
+static void start_block()
+{
+    if (lz4_num_blocks == lz4_max_blocks) finish_block();
+
+    struct lz4_block *b = &lz4_blocks[(lz4_first_block + lz4_num_blocks) % lz4_max_blocks];
+    b->in = lz4_input;
+    b->in_size = lz4_input_size;
+    b->out = malloc(LZ4_compressBound(lz4_input_size));
+    if (b->out == 0) die("cannot allocate compression buffer");
+    if (pthread_create(&b->thread, NULL, compress_block, b)) die("cannot start thread");
+    lz4_num_blocks++;
+
+    lz4_input = malloc(LZ4_LEGACY_BLOCK_SIZE);
+    if (lz4_input == 0) die("cannot allocate compression buffer");
+    lz4_input_size = 0;
+}
+
+static void init_lz4()
+{
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    lz4_max_blocks = cpus > 0 ? cpus : 1;
+    lz4_blocks = calloc(lz4_max_blocks, sizeof(struct lz4_block));
+    lz4_input = malloc(LZ4_LEGACY_BLOCK_SIZE);
+    if (lz4_blocks == 0 || lz4_input == 0) die("cannot allocate compression buffers");
+    write_le32(LZ4_LEGACY_MAGIC);
+}
+
+static void finish_lz4()
+{
+    if (lz4_input_size > 0) start_block();
+    while (lz4_num_blocks > 0) finish_block();
+    free(lz4_input);
+    free(lz4_blocks);
+}
+
+/* All of the archive goes through here, to stdout or the compressor. */
+static void emit(const void *data, unsigned size)
+{
+    if (!compress_lz4) {
+        if (size && fwrite(data, size, 1, stdout) != 1) die("cannot write output");
+        return;
+    }
+    while (size > 0) {
+        unsigned n = LZ4_LEGACY_BLOCK_SIZE - lz4_input_size;
+        if (n > size) n = size;
+        memcpy(lz4_input + lz4_input_size, data, n);
+        lz4_input_size += n;
+        data = (const char*) data + n;
+        size -= n;
+        if (lz4_input_size == LZ4_LEGACY_BLOCK_SIZE) start_block();
+    }
+}
+
+static void pad(int alignment)
+{
+    static const char zeroes[256];
+    int n = (alignment - (total_size & (alignment - 1))) & (alignment - 1);
+    emit(zeroes, n);
+    total_size += n;
+}
+
 static void fix_stat(const char *path, struct stat *s)
 {
     uint64_t capabilities;
@@ -94,17 +212,16 @@ static void _eject(struct stat *s, char *out, int olen, char *data, unsigned dat
     // approximate range that was being used already, and avoiding small
     // values which may be special.
     static unsigned next_inode = 300000;
+    char header[6 + 8*13 + 1];
 
-    while(total_size & 3) {
-        total_size++;
-        putchar(0);
-    }
+    pad(4);
 
     fix_stat(out, s);
 //    fprintf(stderr, "_eject %s: mode=0%o\n", out, s->st_mode);
 
-    printf("%06x%08x%08x%08x%08x%08x%08x"
-           "%08x%08x%08x%08x%08x%08x%08x%s%c",
+    snprintf(header, sizeof(header),
+           "%06x%08x%08x%08x%08x%08x%08x"
+           "%08x%08x%08x%08x%08x%08x%08x",
            0x070701,
            next_inode++,  //  s.st_ino,
            s->st_mode,
@@ -118,22 +235,19 @@ static void _eject(struct stat *s, char *out, int olen, char *data, unsigned dat
            0, // devmajor
            0, // devminor,
            olen + 1,
-           0,
-           out,
            0
            );
+    emit(header, 6 + 8*13);
+    emit(out, olen + 1);
 
     total_size += 6 + 8*13 + olen + 1;
 
     if(strlen(out) != (unsigned int)olen) die("ACK!");
 
-    while(total_size & 3) {
-        total_size++;
-        putchar(0);
-    }
+    pad(4);
 
     if(datasize) {
-        fwrite(data, datasize, 1, stdout);
+        emit(data, datasize);
         total_size += datasize;
     }
 }
@@ -144,10 +258,7 @@ static void _eject_trailer()
     memset(&s, 0, sizeof(s));
     _eject(&s, TRAILER, 10, 0, 0);
 
-    while(total_size & 0xff) {
-        total_size++;
-        putchar(0);
-    }
+    pad(256);
 }
 
 static void _archive(char *in, char *out, int ilen, int olen);
@@ -346,8 +457,17 @@ int main(int argc, char *argv[])
         argv += 2;
     }
 
+    if (argc > 1 && strcmp(argv[0], "-c") == 0) {
+        if (strcmp(argv[1], "lz4") != 0) die("unsupported compression '%s'", argv[1]);
+        compress_lz4 = 1;
+        argc -= 2;
+        argv += 2;
+    }
+
     if(argc == 0) die("no directories to process?!");
 
+    if (compress_lz4) init_lz4();
+
     while(argc-- > 0){
         char *x = strchr(*argv, '=');
         if(x != 0) {
@@ -363,5 +483,8 @@ int main(int argc, char *argv[])
 
     _eject_trailer();
 
+    if (compress_lz4) finish_lz4();
+    if (fflush(stdout)) die("cannot write output");
+
     return 0;
 }
@@ -20,6 +20,7 @@
 #include <stdlib.h>
 #include <sys/prctl.h>
 #include <sys/ptrace.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/un.h>
 #include <sys/wait.h>
@@ -32,6 +33,7 @@
 #include <set>
 #include <vector>
 
+#include <android-base/cmsg.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/macros.h>
@@ -253,6 +255,61 @@ static void ParseArgs(int argc, char** argv, pid_t* pseudothread_tid, DebuggerdD
   *dump_type = static_cast<DebuggerdDumpType>(dump_type_int);
 }
 
+// Wait for a crash on the socket from tombstoned's pool that was passed in argv, and take
+// over the pipes that an exec'd crash_dump would have as stdout and stdin. A crash_dump from the
+// pool handles a single dump, tombstoned starts another one to take its place.
+static void AcceptCrash(char** argv, pid_t* target_process, uid_t* target_uid,
+                        pid_t* pseudothread_tid, DebuggerdDumpType* dump_type,
+                        unique_fd* input_pipe, unique_fd* output_pipe) {
+  int listen_fd;
+  if (!android::base::ParseInt(argv[2], &listen_fd, 0)) {
+    LOG(FATAL) << "invalid pool socket: " << argv[2];
+  }
+
+  unique_fd sock(TEMP_FAILURE_RETRY(accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC)));
+  if (sock == -1) {
+    PLOG(FATAL) << "failed to accept crash";
+  }
+  close(listen_fd);
+
+  // The crashing process connects from its pseudothread, so the kernel tells us which process
+  // it is, rather than the request.
+  ucred cr = {};
+  socklen_t len = sizeof(cr);
+  if (getsockopt(sock.get(), SOL_SOCKET, SO_PEERCRED, &cr, &len) != 0) {
+    PLOG(FATAL) << "failed to getsockopt(..SO_PEERCRED)";
+  }
+
+  // The handler only waits so long before exec'ing a crash_dump of its own, in which case it has
+  // closed the connection by now, and there's nothing left for us to do.
+  CrashDumpRequest request;
+  ssize_t rc = -1;
+  if (TEMP_FAILURE_RETRY(write(sock.get(), "\1", 1)) == 1) {
+    rc = android::base::ReceiveFileDescriptors(sock.get(), &request, sizeof(request),
+                                               output_pipe, input_pipe);
+  }
+  if (rc != sizeof(request)) {
+    LOG(WARNING) << "pid " << cr.pid << " went elsewhere for its dump";
+    _exit(1);
+  }
+
+  if (request.tid < 1) {
+    LOG(FATAL) << "invalid target tid: " << request.tid;
+  }
+  g_target_thread = request.tid;
+  if (request.pseudothread_tid < 1) {
+    LOG(FATAL) << "invalid pseudothread tid: " << request.pseudothread_tid;
+  }
+  if (request.dump_type != kDebuggerdNativeBacktrace && request.dump_type != kDebuggerdTombstone) {
+    LOG(FATAL) << "invalid requested dump type: " << request.dump_type;
+  }
+
+  *target_process = cr.pid;
+  *target_uid = cr.uid;
+  *pseudothread_tid = request.pseudothread_tid;
+  *dump_type = request.dump_type;
+}
+
 static void ReadCrashInfo(unique_fd& fd, siginfo_t* siginfo,
                           std::unique_ptr<unwindstack::Regs>* regs, uintptr_t* abort_msg_address,
                           uintptr_t* fdsan_table_address, uintptr_t* gwp_asan_state,
@@ -381,58 +438,85 @@ int main(int argc, char** argv) {
   // avoid hitting this.
   setsid();
 
-  atrace_begin(ATRACE_TAG, "before reparent");
-  pid_t target_process = getppid();
+  // crash_dump is either exec'd by the signal handler of the crashing process, or started ahead
+  // of time by tombstoned, with `--pool <socket fd>`, to wait for a crash to be handed over.
+  bool pooled = argc == 3 && strcmp(argv[1], "--pool") == 0;
 
-  // Open /proc/`getppid()` before we daemonize.
-  std::string target_proc_path = "/proc/" + std::to_string(target_process);
-  int target_proc_fd = open(target_proc_path.c_str(), O_DIRECTORY | O_RDONLY);
-  if (target_proc_fd == -1) {
-    PLOG(FATAL) << "failed to open " << target_proc_path;
-  }
+  pid_t target_process;
+  uid_t target_uid;
+  unique_fd target_proc_fd;
+  unique_fd output_pipe;
+  unique_fd input_pipe;
+  unique_fd fork_exit_read, fork_exit_write;
+  pid_t pseudothread_tid;
+  DebuggerdDumpType dump_type;
 
-  // Make sure getppid() hasn't changed.
-  if (getppid() != target_process) {
-    LOG(FATAL) << "parent died";
-  }
-  atrace_end(ATRACE_TAG);
+  if (pooled) {
+    Initialize(argv);
+    AcceptCrash(argv, &target_process, &target_uid, &pseudothread_tid, &dump_type, &input_pipe,
+                &output_pipe);
+
+    std::string target_proc_path = "/proc/" + std::to_string(target_process);
+    target_proc_fd.reset(open(target_proc_path.c_str(), O_DIRECTORY | O_RDONLY | O_CLOEXEC));
+    if (target_proc_fd == -1) {
+      PLOG(FATAL) << "failed to open " << target_proc_path;
+    }
+    if (!pid_contains_tid(target_proc_fd.get(), g_target_thread)) {
+      LOG(FATAL) << "thread " << g_target_thread << " is not in process " << target_process;
+    }
+  } else {
+    atrace_begin(ATRACE_TAG, "before reparent");
+    target_process = getppid();
+    target_uid = getuid();
+
+    // Open /proc/`getppid()` before we daemonize.
+    std::string target_proc_path = "/proc/" + std::to_string(target_process);
+    target_proc_fd.reset(open(target_proc_path.c_str(), O_DIRECTORY | O_RDONLY));
+    if (target_proc_fd == -1) {
+      PLOG(FATAL) << "failed to open " << target_proc_path;
+    }
 
-  // Reparent ourselves to init, so that the signal handler can waitpid on the
-  // original process to avoid leaving a zombie for non-fatal dumps.
-  // Move the input/output pipes off of stdout/stderr, out of paranoia.
-  unique_fd output_pipe(dup(STDOUT_FILENO));
-  unique_fd input_pipe(dup(STDIN_FILENO));
+    // Make sure getppid() hasn't changed.
+    if (getppid() != target_process) {
+      LOG(FATAL) << "parent died";
+    }
+    atrace_end(ATRACE_TAG);
 
-  unique_fd fork_exit_read, fork_exit_write;
-  if (!Pipe(&fork_exit_read, &fork_exit_write)) {
-    PLOG(FATAL) << "failed to create pipe";
-  }
+    // Reparent ourselves to init, so that the signal handler can waitpid on the
+    // original process to avoid leaving a zombie for non-fatal dumps.
+    // Move the input/output pipes off of stdout/stderr, out of paranoia.
+    output_pipe.reset(dup(STDOUT_FILENO));
+    input_pipe.reset(dup(STDIN_FILENO));
 
-  pid_t forkpid = fork();
-  if (forkpid == -1) {
-    PLOG(FATAL) << "fork failed";
-  } else if (forkpid == 0) {
-    fork_exit_read.reset();
-  } else {
-    // We need the pseudothread to live until we get around to verifying the vm pid against it.
-    // The last thing it does is block on a waitpid on us, so wait until our child tells us to die.
-    fork_exit_write.reset();
-    char buf;
-    TEMP_FAILURE_RETRY(read(fork_exit_read.get(), &buf, sizeof(buf)));
-    _exit(0);
+    if (!Pipe(&fork_exit_read, &fork_exit_write)) {
+      PLOG(FATAL) << "failed to create pipe";
+    }
+
+    pid_t forkpid = fork();
+    if (forkpid == -1) {
+      PLOG(FATAL) << "fork failed";
+    } else if (forkpid == 0) {
+      fork_exit_read.reset();
+    } else {
+      // We need the pseudothread to live until we get around to verifying the vm pid against it.
+      // The last thing it does is block on a waitpid on us, so wait until our child tells us to
+      // die.
+      fork_exit_write.reset();
+      char buf;
+      TEMP_FAILURE_RETRY(read(fork_exit_read.get(), &buf, sizeof(buf)));
+      _exit(0);
+    }
+
+    Initialize(argv);
+    ParseArgs(argc, argv, &pseudothread_tid, &dump_type);
   }
 
   ATRACE_NAME("after reparent");
-  pid_t pseudothread_tid;
-  DebuggerdDumpType dump_type;
   uintptr_t abort_msg_address = 0;
   uintptr_t fdsan_table_address = 0;
   uintptr_t gwp_asan_state = 0;
   uintptr_t gwp_asan_metadata = 0;
 
-  Initialize(argv);
-  ParseArgs(argc, argv, &pseudothread_tid, &dump_type);
-
   // Die if we take too long.
   //
   // Note: processes with many threads and minidebug-info can take a bit to
@@ -469,7 +553,7 @@ int main(int argc, char** argv) {
         continue;
       }
 
-      if (!ptrace_seize_thread(target_proc_fd, thread, &error)) {
+      if (!ptrace_seize_thread(target_proc_fd.get(), thread, &error)) {
         bool fatal = thread == g_target_thread;
         LOG(fatal ? FATAL : WARNING) << error;
       }
@@ -477,7 +561,7 @@ int main(int argc, char** argv) {
       ThreadInfo info;
       info.pid = target_process;
       info.tid = thread;
-      info.uid = getuid();
+      info.uid = target_uid;
       info.process_name = process_name;
       info.thread_name = get_thread_name(thread);
 
@@ -507,7 +591,8 @@ int main(int argc, char** argv) {
   }
 
   // Trace the pseudothread with PTRACE_O_TRACECLONE and tell it to fork.
-  if (!ptrace_seize_thread(target_proc_fd, pseudothread_tid, &error, PTRACE_O_TRACECLONE)) {
+  if (!ptrace_seize_thread(target_proc_fd.get(), pseudothread_tid, &error,
+                          PTRACE_O_TRACECLONE)) {
     LOG(FATAL) << "failed to seize pseudothread: " << error;
   }
 
@@ -520,8 +605,12 @@ int main(int argc, char** argv) {
     PLOG(FATAL) << "failed to detach from pseudothread";
   }
 
-  // The pseudothread can die now.
+  // The pseudothread can die now. A pooled crash_dump isn't its child, so it waits for its pipe
+  // to be closed instead, which for crashes happens when we exit after the dump.
   fork_exit_write.reset();
+  if (pooled && siginfo.si_signo == BIONIC_SIGNAL_DEBUGGER) {
+    output_pipe.reset();
+  }
 
   // Defer the message until later, for readability.
   bool wait_for_gdb = android::base::GetBoolProperty("debug.debuggerd.wait_for_gdb", false);
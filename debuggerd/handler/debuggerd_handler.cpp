@@ -32,6 +32,7 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <linux/futex.h>
+#include <poll.h>
 #include <pthread.h>
 #include <sched.h>
 #include <signal.h>
@@ -85,6 +86,16 @@ using unique_fd = android::base::unique_fd_impl<FdsanBypassCloser>;
 
 #define CRASH_DUMP_PATH "/system/bin/" CRASH_DUMP_NAME
 
+#if defined(__LP64__)
+#define CRASH_DUMP_SOCKET_NAME kTombstonedCrashDump64SocketName
+#else
+#define CRASH_DUMP_SOCKET_NAME kTombstonedCrashDump32SocketName
+#endif
+
+// How long to wait for a crash_dump from tombstoned's pool to pick up a dump,
+// before falling back to exec'ing one of our own.
+static constexpr int kCrashDumpPoolTimeoutMs = 500;
+
 // Wrappers that directly invoke the respective syscalls, in case the cached values are invalid.
 #pragma GCC poison getpid gettid
 static pid_t __getpid() {
@@ -319,6 +330,61 @@ static DebuggerdDumpType get_dump_type(const debugger_thread_info* thread_info)
   return kDebuggerdTombstone;
 }
 
+// Hand the dump over to a crash_dump that tombstoned started ahead of time, which saves the exec
+// and dynamic linking of a new one. Returns false if the dump should go to an exec'd crash_dump.
+static bool dispatch_to_crash_dump_pool(const debugger_thread_info* thread_info, int input_write,
+                                        int output_read) {
+  // Non-blocking, so that the connect fails rather than waits if the backlog is full.
+  unique_fd sock(socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0));
+  if (sock == -1) {
+    return false;
+  }
+
+  sockaddr_un addr = {};
+  addr.sun_family = AF_UNIX;
+  async_safe_format_buffer(addr.sun_path, sizeof(addr.sun_path), "/dev/socket/%s",
+                           CRASH_DUMP_SOCKET_NAME);
+  sockaddr* sa = reinterpret_cast<sockaddr*>(&addr);
+  if (TEMP_FAILURE_RETRY(connect(sock.get(), sa, sizeof(addr))) != 0) {
+    return false;
+  }
+
+  // The connection is queued even if every crash_dump in the pool is busy, so only go ahead once
+  // one of them has accepted it. If that takes too long, the one that eventually does sees the
+  // connection closed and gives up.
+  pollfd pfd = {.fd = sock.get(), .events = POLLIN};
+  if (TEMP_FAILURE_RETRY(poll(&pfd, 1, kCrashDumpPoolTimeoutMs)) != 1) {
+    return false;
+  }
+  char ready;
+  if (TEMP_FAILURE_RETRY(recv(sock.get(), &ready, sizeof(ready), 0)) != 1 || ready != '\1') {
+    return false;
+  }
+
+  CrashDumpRequest request = {
+      .tid = thread_info->crashing_tid,
+      .pseudothread_tid = thread_info->pseudothread_tid,
+      .dump_type = get_dump_type(thread_info),
+  };
+  iovec iov = {.iov_base = &request, .iov_len = sizeof(request)};
+  alignas(cmsghdr) char cmsg_buf[CMSG_SPACE(2 * sizeof(int))] = {};
+  msghdr msg = {};
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = cmsg_buf;
+  msg.msg_controllen = sizeof(cmsg_buf);
+
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(2 * sizeof(int));
+  int fds[2] = {input_write, output_read};
+  memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+  return TEMP_FAILURE_RETRY(sendmsg(sock.get(), &msg, MSG_NOSIGNAL)) ==
+         static_cast<ssize_t>(sizeof(request));
+}
+
 static int debuggerd_dispatch_pseudothread(void* arg) {
   debugger_thread_info* thread_info = static_cast<debugger_thread_info*>(arg);
 
@@ -370,35 +436,39 @@ static int debuggerd_dispatch_pseudothread(void* arg) {
     fatal("failed to write crash info, wrote %zd bytes, expected %zd", rc, expected);
   }
 
-  // Don't use fork(2) to avoid calling pthread_atfork handlers.
-  pid_t crash_dump_pid = __fork();
-  if (crash_dump_pid == -1) {
-    async_safe_format_log(ANDROID_LOG_FATAL, "libc",
-                          "failed to fork in debuggerd signal handler: %s", strerror(errno));
-  } else if (crash_dump_pid == 0) {
-    TEMP_FAILURE_RETRY(dup2(input_write.get(), STDOUT_FILENO));
-    TEMP_FAILURE_RETRY(dup2(output_read.get(), STDIN_FILENO));
-    input_read.reset();
-    input_write.reset();
-    output_read.reset();
-    output_write.reset();
-
-    raise_caps();
-
-    char main_tid[10];
-    char pseudothread_tid[10];
-    char debuggerd_dump_type[10];
-    async_safe_format_buffer(main_tid, sizeof(main_tid), "%d", thread_info->crashing_tid);
-    async_safe_format_buffer(pseudothread_tid, sizeof(pseudothread_tid), "%d",
-                             thread_info->pseudothread_tid);
-    async_safe_format_buffer(debuggerd_dump_type, sizeof(debuggerd_dump_type), "%d",
-                             get_dump_type(thread_info));
-
-    execle(CRASH_DUMP_PATH, CRASH_DUMP_NAME, main_tid, pseudothread_tid, debuggerd_dump_type,
-           nullptr, nullptr);
-    async_safe_format_log(ANDROID_LOG_FATAL, "libc", "failed to exec crash_dump helper: %s",
-                          strerror(errno));
-    return 1;
+  pid_t crash_dump_pid = -1;
+  bool pooled = dispatch_to_crash_dump_pool(thread_info, input_write.get(), output_read.get());
+  if (!pooled) {
+    // Don't use fork(2) to avoid calling pthread_atfork handlers.
+    crash_dump_pid = __fork();
+    if (crash_dump_pid == -1) {
+      async_safe_format_log(ANDROID_LOG_FATAL, "libc",
+                            "failed to fork in debuggerd signal handler: %s", strerror(errno));
+    } else if (crash_dump_pid == 0) {
+      TEMP_FAILURE_RETRY(dup2(input_write.get(), STDOUT_FILENO));
+      TEMP_FAILURE_RETRY(dup2(output_read.get(), STDIN_FILENO));
+      input_read.reset();
+      input_write.reset();
+      output_read.reset();
+      output_write.reset();
+
+      raise_caps();
+
+      char main_tid[10];
+      char pseudothread_tid[10];
+      char debuggerd_dump_type[10];
+      async_safe_format_buffer(main_tid, sizeof(main_tid), "%d", thread_info->crashing_tid);
+      async_safe_format_buffer(pseudothread_tid, sizeof(pseudothread_tid), "%d",
+                               thread_info->pseudothread_tid);
+      async_safe_format_buffer(debuggerd_dump_type, sizeof(debuggerd_dump_type), "%d",
+                               get_dump_type(thread_info));
+
+      execle(CRASH_DUMP_PATH, CRASH_DUMP_NAME, main_tid, pseudothread_tid, debuggerd_dump_type,
+             nullptr, nullptr);
+      async_safe_format_log(ANDROID_LOG_FATAL, "libc", "failed to exec crash_dump helper: %s",
+                            strerror(errno));
+      return 1;
+    }
   }
 
   input_write.reset();
@@ -426,6 +496,13 @@ static int debuggerd_dispatch_pseudothread(void* arg) {
   // crash_dump is ptracing us, fork off a copy of our address space for it to use.
   create_vm_process();
 
+  if (pooled) {
+    // A pooled crash_dump isn't our child, so there's nothing to reap. It closes its end of the
+    // pipe once it's done with us, which for crashes is when the dump is complete.
+    TEMP_FAILURE_RETRY(read(input_read, &buf, sizeof(buf)));
+    return 0;
+  }
+
   // Don't leave a zombie child.
   int status;
   if (TEMP_FAILURE_RETRY(waitpid(crash_dump_pid, &status, 0)) == -1) {
@@ -30,9 +30,12 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <map>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <android-base/unique_fd.h>
 #include <log/log.h>
@@ -41,6 +44,9 @@
 #include "libdebuggerd/types.h"
 #include "libdebuggerd/utility.h"
 
+// Each unwind thread keeps its own cache of the process's memory.
+static constexpr unsigned int kMaxUnwindThreads = 8;
+
 static void dump_process_header(log_t* log, pid_t pid, const char* process_name) {
   time_t t = time(NULL);
   struct tm tm;
@@ -91,11 +97,32 @@ void dump_backtrace(android::base::unique_fd output_fd, unwindstack::Unwinder* u
 
   dump_process_header(&log, target->second.pid, target->second.process_name.c_str());
 
-  dump_backtrace_thread(output_fd.get(), unwinder, target->second);
+  // Unwind every thread first, several at a time, since the process stays
+  // frozen until the dump is done. Then write them out in order, target
+  // thread first.
+  std::vector<const ThreadInfo*> threads;
+  threads.push_back(&target->second);
   for (const auto& [tid, info] : thread_info) {
     if (tid != target_thread) {
-      dump_backtrace_thread(output_fd.get(), unwinder, info);
+      threads.push_back(&info);
+    }
+  }
+  std::vector<unwindstack::ThreadUnwind> unwinds(threads.size());
+  for (size_t i = 0; i < threads.size(); i++) {
+    unwinds[i].tid = threads[i]->tid;
+    unwinds[i].regs = threads[i]->registers.get();
+  }
+  size_t num_workers = std::clamp(std::thread::hardware_concurrency(), 1U, kMaxUnwindThreads);
+  unwinder->UnwindThreads(target->second.pid, &unwinds, num_workers);
+
+  for (size_t i = 0; i < threads.size(); i++) {
+    _LOG(&log, logtype::BACKTRACE, "\n\"%s\" sysTid=%d\n", threads[i]->thread_name.c_str(),
+         threads[i]->tid);
+    if (unwinds[i].frames.empty()) {
+      _LOG(&log, logtype::THREAD, "Unwind failed: tid = %d", threads[i]->tid);
+      continue;
     }
+    log_backtrace(&log, unwinder, unwinds[i], "  ");
   }
 
   dump_process_footer(&log, target->second.pid);
@@ -77,9 +77,13 @@ void _VLOG(log_t* log, logtype ltype, const char* fmt, va_list ap);
 namespace unwindstack {
 class Unwinder;
 class Memory;
+struct ThreadUnwind;
 }
 
 void log_backtrace(log_t* log, unwindstack::Unwinder* unwinder, const char* prefix);
+// Logs the frames of |thread|, which |unwinder| unwound with UnwindThreads.
+void log_backtrace(log_t* log, unwindstack::Unwinder* unwinder,
+                   const unwindstack::ThreadUnwind& thread, const char* prefix);
 
 void dump_memory(log_t* log, unwindstack::Memory* backtrace, uint64_t addr, const std::string&);
 
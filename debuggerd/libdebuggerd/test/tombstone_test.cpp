@@ -18,8 +18,10 @@
 #include <sys/mman.h>
 #include <time.h>
 
+#include <chrono>
 #include <memory>
 #include <string>
+#include <thread>
 
 #include <android-base/file.h>
 #include <android-base/properties.h>
@@ -366,6 +368,29 @@ TEST_F(TombstoneTest, dump_timestamp) {
   ASSERT_STREQ("Timestamp: 1970-01-01 00:00:00+0000\n", amfd_data_.c_str());
 }
 
+TEST_F(TombstoneTest, tombstone_timer_sections) {
+  TombstoneTimer timer(std::chrono::milliseconds(0));
+  timer.EndSection("header");
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  timer.EndSection("other threads");
+  ASSERT_FALSE(timer.Expired());
+  ASSERT_THAT(timer.Summary(),
+              MatchesRegex("header [0-9]+ms, other threads [1-9][0-9]*ms, total [1-9][0-9]*ms"));
+}
+
+TEST_F(TombstoneTest, tombstone_timer_budget) {
+  TombstoneTimer timer(std::chrono::milliseconds(1));
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  ASSERT_TRUE(timer.Expired());
+
+  dump_budget_exhausted(&log_, timer, "open files");
+  std::string tombstone_contents;
+  ASSERT_TRUE(lseek(log_.tfd, 0, SEEK_SET) == 0);
+  ASSERT_TRUE(android::base::ReadFdToString(log_.tfd, &tombstone_contents));
+  ASSERT_STREQ("\n*** tombstone time budget of 1ms exhausted, open files left out\n",
+               tombstone_contents.c_str());
+}
+
 class GwpAsanCrashDataTest : public GwpAsanCrashData {
 public:
   GwpAsanCrashDataTest(
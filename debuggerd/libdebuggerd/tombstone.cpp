@@ -32,8 +32,12 @@
 #include <sys/stat.h>
 #include <time.h>
 
+#include <algorithm>
+#include <chrono>
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
@@ -62,6 +66,7 @@
 
 using android::base::GetBoolProperty;
 using android::base::GetProperty;
+using android::base::GetUintProperty;
 using android::base::StringPrintf;
 using android::base::unique_fd;
 
@@ -69,6 +74,61 @@ using namespace std::literals::string_literals;
 
 #define STACK_WORDS 16
 
+// The most threads that unwind at once, each with a memory cache of its own.
+static constexpr unsigned int kMaxUnwindThreads = 8;
+
+// The crashed process stays frozen until its tombstone is written, and
+// crash_dump is killed by an alarm after 30 seconds. Sections that would
+// start once the budget has run out are left out of the tombstone instead.
+// The budget can be changed with debug.debuggerd.tombstone_budget_ms, and 0
+// means there is none.
+static constexpr uint64_t kDefaultTombstoneBudgetMs = 20000;
+
+// Times each section of a tombstone, and keeps track of the budget.
+class TombstoneTimer {
+ public:
+  explicit TombstoneTimer(std::chrono::milliseconds budget)
+      : budget_(budget), start_(Clock::now()), section_start_(start_) {}
+
+  bool Expired() const { return budget_.count() != 0 && Clock::now() - start_ >= budget_; }
+
+  // Ends the current section, which started when the last one ended.
+  void EndSection(const char* name) {
+    Clock::time_point now = Clock::now();
+    sections_.emplace_back(name, ToMs(now - section_start_));
+    section_start_ = now;
+  }
+
+  // Returns the time of every section so far, and the total.
+  std::string Summary() const {
+    std::string summary;
+    for (const auto& [name, ms] : sections_) {
+      summary += StringPrintf("%s %" PRId64 "ms, ", name, ms);
+    }
+    return summary + StringPrintf("total %" PRId64 "ms", ToMs(Clock::now() - start_));
+  }
+
+  int64_t budget_ms() const { return budget_.count(); }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  static int64_t ToMs(Clock::duration duration) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(duration).count();
+  }
+
+  std::chrono::milliseconds budget_;
+  Clock::time_point start_;
+  Clock::time_point section_start_;
+  std::vector<std::pair<const char*, int64_t>> sections_;
+};
+
+static void dump_budget_exhausted(log_t* log, const TombstoneTimer& timer, const char* left_out) {
+  _LOG(log, logtype::THREAD,
+       "\n*** tombstone time budget of %" PRId64 "ms exhausted, %s left out\n",
+       timer.budget_ms(), left_out);
+}
+
 static void dump_header_info(log_t* log) {
   auto fingerprint = GetProperty("ro.build.fingerprint", "unknown");
   auto revision = GetProperty("ro.revision", "unknown");
@@ -375,9 +435,10 @@ void dump_memory_and_code(log_t* log, unwindstack::Maps* maps, unwindstack::Memo
   });
 }
 
+// |unwind| holds the frames of the thread, which were unwound up front.
 static bool dump_thread(log_t* log, unwindstack::Unwinder* unwinder, const ThreadInfo& thread_info,
-                        uint64_t abort_msg_address, bool primary_thread,
-                        const GwpAsanCrashData& gwp_asan_crash_data) {
+                        const unwindstack::ThreadUnwind& unwind, uint64_t abort_msg_address,
+                        bool primary_thread, const GwpAsanCrashData& gwp_asan_crash_data) {
   log->current_tid = thread_info.tid;
   if (!primary_thread) {
     _LOG(log, logtype::THREAD, "--- --- --- --- --- --- --- --- --- --- --- --- --- --- --- ---\n");
@@ -401,15 +462,11 @@ static bool dump_thread(log_t* log, unwindstack::Unwinder* unwinder, const Threa
 
   dump_registers(log, thread_info.registers.get());
 
-  // Unwind will mutate the registers, so make a copy first.
-  std::unique_ptr<unwindstack::Regs> regs_copy(thread_info.registers->Clone());
-  unwinder->SetRegs(regs_copy.get());
-  unwinder->Unwind();
-  if (unwinder->NumFrames() == 0) {
+  if (unwind.frames.empty()) {
     _LOG(log, logtype::THREAD, "Failed to unwind");
   } else {
     _LOG(log, logtype::BACKTRACE, "\nbacktrace:\n");
-    log_backtrace(log, unwinder, "    ");
+    log_backtrace(log, unwinder, unwind, "    ");
   }
 
   if (primary_thread) {
@@ -619,6 +676,9 @@ void engrave_tombstone(unique_fd output_fd, unwindstack::Unwinder* unwinder,
   log.tfd = output_fd.get();
   log.amfd_data = amfd_data;
 
+  TombstoneTimer timer(std::chrono::milliseconds(GetUintProperty<uint64_t>(
+      "debug.debuggerd.tombstone_budget_ms", kDefaultTombstoneBudgetMs)));
+
   _LOG(&log, logtype::HEADER, "*** *** *** *** *** *** *** *** *** *** *** *** *** *** *** ***\n");
   dump_header_info(&log);
   dump_timestamp(&log, time(nullptr));
@@ -627,32 +687,85 @@ void engrave_tombstone(unique_fd output_fd, unwindstack::Unwinder* unwinder,
   if (it == threads.end()) {
     LOG(FATAL) << "failed to find target thread";
   }
+  pid_t pid = it->second.pid;
 
   GwpAsanCrashData gwp_asan_crash_data(unwinder->GetProcessMemory().get(),
                                        gwp_asan_state_ptr,
                                        gwp_asan_metadata_ptr, it->second);
+  timer.EndSection("header");
+
+  // The crashing thread is always dumped in full, however long it takes.
+  std::vector<unwindstack::ThreadUnwind> target_unwind(1);
+  target_unwind[0].tid = target_thread;
+  target_unwind[0].regs = it->second.registers.get();
+  unwinder->UnwindThreads(pid, &target_unwind, 1);
+  timer.EndSection("unwind");
 
-  dump_thread(&log, unwinder, it->second, abort_msg_address, true,
+  dump_thread(&log, unwinder, it->second, target_unwind[0], abort_msg_address, true,
               gwp_asan_crash_data);
+  timer.EndSection("crashing thread");
 
   if (want_logs) {
-    dump_logs(&log, it->second.pid, 50);
+    if (timer.Expired()) {
+      dump_budget_exhausted(&log, timer, "log tail");
+    } else {
+      dump_logs(&log, pid, 50);
+      timer.EndSection("log tail");
+    }
   }
 
+  // The other threads are unwound several at a time, and a batch at a time
+  // so that the budget is still checked between batches.
+  std::vector<const ThreadInfo*> other_threads;
   for (auto& [tid, thread_info] : threads) {
-    if (tid == target_thread) {
-      continue;
+    if (tid != target_thread) {
+      other_threads.push_back(&thread_info);
+    }
+  }
+  size_t num_workers = std::clamp(std::thread::hardware_concurrency(), 1U, kMaxUnwindThreads);
+  size_t batch_size = num_workers * 4;
+  std::vector<unwindstack::ThreadUnwind> unwinds;
+  for (size_t start = 0; start < other_threads.size(); start += batch_size) {
+    if (timer.Expired()) {
+      std::string left_out = StringPrintf("%zu of %zu other threads",
+                                          other_threads.size() - start, other_threads.size());
+      dump_budget_exhausted(&log, timer, left_out.c_str());
+      break;
+    }
+    size_t end = std::min(start + batch_size, other_threads.size());
+    unwinds.clear();
+    unwinds.resize(end - start);
+    for (size_t i = start; i < end; i++) {
+      unwinds[i - start].tid = other_threads[i]->tid;
+      unwinds[i - start].regs = other_threads[i]->registers.get();
+    }
+    unwinder->UnwindThreads(pid, &unwinds, num_workers);
+    for (size_t i = start; i < end; i++) {
+      dump_thread(&log, unwinder, *other_threads[i], unwinds[i - start], 0, false,
+                  gwp_asan_crash_data);
     }
-
-    dump_thread(&log, unwinder, thread_info, 0, false, gwp_asan_crash_data);
   }
+  timer.EndSection("other threads");
 
   if (open_files) {
-    _LOG(&log, logtype::OPEN_FILES, "\nopen files:\n");
-    dump_open_files_list(&log, *open_files, "    ");
+    if (timer.Expired()) {
+      dump_budget_exhausted(&log, timer, "open files");
+    } else {
+      _LOG(&log, logtype::OPEN_FILES, "\nopen files:\n");
+      dump_open_files_list(&log, *open_files, "    ");
+      timer.EndSection("open files");
+    }
   }
 
   if (want_logs) {
-    dump_logs(&log, it->second.pid, 0);
+    if (timer.Expired()) {
+      dump_budget_exhausted(&log, timer, "logs");
+    } else {
+      dump_logs(&log, pid, 0);
+      timer.EndSection("logs");
+    }
   }
+
+  ALOGI("tombstone for pid %d with %zu threads took: %s", pid, threads.size(),
+        timer.Summary().c_str());
 }
@@ -431,17 +431,21 @@ const char* get_sigcode(const siginfo_t* si) {
   return "?";
 }
 
-void log_backtrace(log_t* log, unwindstack::Unwinder* unwinder, const char* prefix) {
-  if (unwinder->elf_from_memory_not_file()) {
-    _LOG(log, logtype::BACKTRACE,
-         "%sNOTE: Function names and BuildId information is missing for some frames due\n", prefix);
-    _LOG(log, logtype::BACKTRACE,
-         "%sNOTE: to unreadable libraries. For unwinds of apps, only shared libraries\n", prefix);
-    _LOG(log, logtype::BACKTRACE, "%sNOTE: found under the lib/ directory are readable.\n", prefix);
+static void log_elf_from_memory_note(log_t* log, const char* prefix) {
+  _LOG(log, logtype::BACKTRACE,
+       "%sNOTE: Function names and BuildId information is missing for some frames due\n", prefix);
+  _LOG(log, logtype::BACKTRACE,
+       "%sNOTE: to unreadable libraries. For unwinds of apps, only shared libraries\n", prefix);
+  _LOG(log, logtype::BACKTRACE, "%sNOTE: found under the lib/ directory are readable.\n", prefix);
 #if defined(ROOT_POSSIBLE)
-    _LOG(log, logtype::BACKTRACE,
-         "%sNOTE: On this device, run setenforce 0 to make the libraries readable.\n", prefix);
+  _LOG(log, logtype::BACKTRACE,
+       "%sNOTE: On this device, run setenforce 0 to make the libraries readable.\n", prefix);
 #endif
+}
+
+void log_backtrace(log_t* log, unwindstack::Unwinder* unwinder, const char* prefix) {
+  if (unwinder->elf_from_memory_not_file()) {
+    log_elf_from_memory_note(log, prefix);
   }
 
   unwinder->SetDisplayBuildID(true);
@@ -449,3 +453,15 @@ void log_backtrace(log_t* log, unwindstack::Unwinder* unwinder, const char* pref
     _LOG(log, logtype::BACKTRACE, "%s%s\n", prefix, unwinder->FormatFrame(i).c_str());
   }
 }
+
+void log_backtrace(log_t* log, unwindstack::Unwinder* unwinder,
+                   const unwindstack::ThreadUnwind& thread, const char* prefix) {
+  if (thread.elf_from_memory_not_file) {
+    log_elf_from_memory_note(log, prefix);
+  }
+
+  unwinder->SetDisplayBuildID(true);
+  for (const auto& frame : thread.frames) {
+    _LOG(log, logtype::BACKTRACE, "%s%s\n", prefix, unwinder->FormatFrame(frame).c_str());
+  }
+}
@@ -29,6 +29,13 @@ constexpr char kTombstonedCrashSocketName[] = "tombstoned_crash";
 constexpr char kTombstonedJavaTraceSocketName[] = "tombstoned_java_trace";
 constexpr char kTombstonedInterceptSocketName[] = "tombstoned_intercept";
 
+// Sockets that crash_dump processes started ahead of time by tombstoned accept
+// crashes on, one for each ABI, since crash_dump has to match the ucontext_t
+// of the crashing process. tombstoned only listens on them if the pool is
+// enabled, so a connection is refused otherwise.
+constexpr char kTombstonedCrashDump32SocketName[] = "tombstoned_crash_dump32";
+constexpr char kTombstonedCrashDump64SocketName[] = "tombstoned_crash_dump64";
+
 enum class CrashPacketType : uint8_t {
   // Initial request from crash_dump.
   kDumpRequest = 0,
@@ -80,6 +87,16 @@ struct InterceptResponse {
   char error_message[127];  // always null-terminated
 };
 
+// Sent from handler to a pooled crash_dump, once it has accepted the
+// connection and written a single '\1' byte to say that it's ready.
+// Comes with two file descriptors via SCM_RIGHTS, the ends of the pipes that
+// an exec'd crash_dump gets as stdout and stdin.
+struct CrashDumpRequest {
+  int32_t tid;
+  int32_t pseudothread_tid;
+  DebuggerdDumpType dump_type;
+};
+
 // Sent from handler to crash_dump via pipe.
 struct __attribute__((__packed__)) CrashInfoHeader {
   uint32_t version;
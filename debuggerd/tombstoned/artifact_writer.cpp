@@ -0,0 +1,100 @@
+/*
+ * Copyright 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "artifact_writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <android-base/logging.h>
+#include <android-base/stringprintf.h>
+
+using android::base::StringPrintf;
+
+ArtifactWriter::ArtifactWriter() : thread_(&ArtifactWriter::Run, this) {
+  // tombstoned never exits, so the thread is never joined.
+  thread_.detach();
+}
+
+void ArtifactWriter::Add(Artifact artifact) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  pending_.push_back(std::move(artifact));
+  cv_.notify_one();
+}
+
+void ArtifactWriter::Run() {
+  std::vector<Artifact> batch;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      cv_.wait(lock, [this]() { return !pending_.empty(); });
+      while (!pending_.empty()) {
+        batch.push_back(std::move(pending_.front()));
+        pending_.pop_front();
+      }
+    }
+
+    std::set<int> dir_fds;
+    for (Artifact& artifact : batch) {
+      Write(&artifact);
+      dir_fds.insert(artifact.dir_fd);
+    }
+    for (int dir_fd : dir_fds) {
+      if (fsync(dir_fd) != 0) {
+        PLOG(ERROR) << "failed to sync dump directory";
+      }
+    }
+    batch.clear();
+  }
+}
+
+void ArtifactWriter::Write(Artifact* artifact) {
+  if (fdatasync(artifact->fd.get()) != 0) {
+    PLOG(WARNING) << "failed to sync dump for pid " << artifact->pid;
+  }
+
+  std::string fd_path = StringPrintf("/proc/self/fd/%d", artifact->fd.get());
+
+  // linkat doesn't let us replace a file, so we need to unlink first.
+  int rc = unlink(artifact->path.c_str());
+  if (rc != 0 && errno != ENOENT) {
+    PLOG(ERROR) << "failed to unlink tombstone at " << artifact->path;
+  } else if (linkat(AT_FDCWD, fd_path.c_str(), AT_FDCWD, artifact->path.c_str(),
+                    AT_SYMLINK_FOLLOW) != 0) {
+    PLOG(ERROR) << "failed to link tombstone";
+  } else if (artifact->dump_type == kDebuggerdJavaBacktrace) {
+    LOG(ERROR) << "Traces for pid " << artifact->pid << " written to: " << artifact->path;
+  } else {
+    // NOTE: Several tools parse this log message to figure out where the
+    // tombstone associated with a given native crash was written. Any changes
+    // to this message must be carefully considered.
+    LOG(ERROR) << "Tombstone written to: " << artifact->path;
+  }
+
+  // If we don't have O_TMPFILE, we need to clean up after ourselves.
+  if (!artifact->temporary_path.empty()) {
+    rc = unlink(artifact->temporary_path.c_str());
+    if (rc != 0) {
+      PLOG(ERROR) << "failed to unlink temporary tombstone at " << artifact->temporary_path;
+    }
+  }
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <android-base/unique_fd.h>
+
+#include "dump_type.h"
+
+// A finished dump, written by crash_dump to an unnamed (or temporary) file,
+// that still has to be moved to its place in /data/tombstones or /data/anr.
+struct Artifact {
+  android::base::unique_fd fd;
+  // Set if the file had to be created with a name, which is removed once
+  // the artifact has been linked into place.
+  std::string temporary_path;
+  std::string path;
+  int dir_fd = -1;
+
+  pid_t pid = -1;
+  DebuggerdDumpType dump_type = kDebuggerdTombstone;
+};
+
+// Syncs finished dumps to disk and links them into place on a thread of its
+// own, so that the event loop doesn't wait for the disk, and so that a crash
+// loop costs one sync of the directory per batch of dumps rather than one
+// per dump. Artifacts are linked in the order they were added, so a later
+// dump that reuses a path always wins.
+class ArtifactWriter {
+ public:
+  ArtifactWriter();
+  ArtifactWriter(const ArtifactWriter&) = delete;
+  ArtifactWriter& operator=(const ArtifactWriter&) = delete;
+
+  void Add(Artifact artifact);
+
+ private:
+  void Run();
+  static void Write(Artifact* artifact);
+
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<Artifact> pending_;
+  std::thread thread_;
+};
@@ -0,0 +1,107 @@
+/*
+ * Copyright 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "crash_dump_pool.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <android-base/logging.h>
+
+// crash_dump gets its socket at a known fd, and nothing else of ours.
+static constexpr int kSocketFd = 3;
+static constexpr char kSocketFdArg[] = "3";
+
+// Exit status of a child that failed to exec crash_dump, which isn't worth retrying.
+static constexpr int kExecFailed = 127;
+
+CrashDumpPool::CrashDumpPool(event_base* base) {
+  sigchld_event_ = evsignal_new(
+      base, SIGCHLD,
+      [](evutil_socket_t, short, void* arg) { static_cast<CrashDumpPool*>(arg)->Reap(); }, this);
+  if (!sigchld_event_ || event_add(sigchld_event_, nullptr) != 0) {
+    LOG(FATAL) << "failed to create SIGCHLD event";
+  }
+}
+
+void CrashDumpPool::Add(const std::string& path, int socket, size_t size) {
+  if (access(path.c_str(), X_OK) != 0) {
+    return;
+  }
+  if (socket == -1) {
+    PLOG(ERROR) << "failed to get socket for " << path << " from init";
+    return;
+  }
+
+  // Until we listen, the signal handler's connection is refused, and it execs crash_dump itself.
+  if (listen(socket, size) != 0) {
+    PLOG(ERROR) << "failed to listen for " << path;
+    return;
+  }
+
+  size_t index = pools_.size();
+  pools_.push_back({path, path.substr(path.rfind('/') + 1), socket});
+  for (size_t i = 0; i < size; i++) {
+    Spawn(index);
+  }
+  LOG(INFO) << "started " << size << " " << pools_[index].name << " processes";
+}
+
+void CrashDumpPool::Spawn(size_t index) {
+  const Pool& pool = pools_[index];
+  pid_t pid = fork();
+  if (pid == -1) {
+    PLOG(ERROR) << "failed to fork " << pool.name;
+    return;
+  }
+
+  if (pid == 0) {
+    // We have other threads, so stick to async-signal-safe calls until the exec.
+    if (pool.socket != kSocketFd && dup2(pool.socket, kSocketFd) == -1) {
+      _exit(kExecFailed);
+    }
+    fcntl(kSocketFd, F_SETFD, 0);
+    for (int fd = kSocketFd + 1; fd < 1024; ++fd) {
+      close(fd);
+    }
+    execl(pool.path.c_str(), pool.name.c_str(), "--pool", kSocketFdArg, nullptr);
+    _exit(kExecFailed);
+  }
+
+  workers_[pid] = index;
+}
+
+void CrashDumpPool::Reap() {
+  int status;
+  pid_t pid;
+  while ((pid = TEMP_FAILURE_RETRY(waitpid(-1, &status, WNOHANG))) > 0) {
+    auto it = workers_.find(pid);
+    if (it == workers_.end()) {
+      continue;
+    }
+    size_t index = it->second;
+    workers_.erase(it);
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == kExecFailed) {
+      LOG(ERROR) << "failed to start " << pools_[index].name << ", not replacing it";
+      continue;
+    }
+    Spawn(index);
+  }
+}
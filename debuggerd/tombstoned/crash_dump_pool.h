@@ -0,0 +1,57 @@
+/*
+ * Copyright 2020, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <event2/event.h>
+
+// crash_dump processes started ahead of time, each waiting on a socket for
+// the signal handler of a crashing process to hand it a dump, so that a crash
+// doesn't have to wait for a crash_dump to be exec'd and dynamically linked.
+// A crash_dump handles a single dump, and is replaced once it exits. The
+// signal handler still execs a crash_dump of its own if none of them picks
+// the dump up in time.
+class CrashDumpPool {
+ public:
+  explicit CrashDumpPool(event_base* base);
+  CrashDumpPool(const CrashDumpPool&) = delete;
+  CrashDumpPool& operator=(const CrashDumpPool&) = delete;
+
+  // Starts |size| crash_dumps from |path|, accepting on |socket|, if the
+  // binary exists on this device.
+  void Add(const std::string& path, int socket, size_t size);
+
+ private:
+  struct Pool {
+    std::string path;
+    std::string name;
+    int socket;
+  };
+
+  void Spawn(size_t index);
+  void Reap();
+
+  std::vector<Pool> pools_;
+  // Running crash_dumps, and the index of the pool they belong to.
+  std::unordered_map<pid_t, size_t> workers_;
+  event* sigchld_event_ = nullptr;
+};
@@ -17,6 +17,8 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/capability.h>
+#include <sys/prctl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -43,14 +45,19 @@
 #include "protocol.h"
 #include "util.h"
 
+#include "artifact_writer.h"
+#include "crash_dump_pool.h"
 #include "intercept_manager.h"
 
 using android::base::GetIntProperty;
+using android::base::GetUintProperty;
 using android::base::SendFileDescriptors;
 using android::base::StringPrintf;
 using android::base::unique_fd;
 
 static InterceptManager* intercept_manager;
+static ArtifactWriter* artifact_writer;
+static CrashDumpPool* crash_dump_pool;
 
 enum CrashStatus {
   kCrashStatusRunning,
@@ -74,15 +81,22 @@ struct Crash {
 
 class CrashQueue {
  public:
+  // A queue with an empty |dir_path| is only used to limit how many dumps
+  // run at once, and never hands out any output files.
   CrashQueue(const std::string& dir_path, const std::string& file_name_prefix, size_t max_artifacts,
              size_t max_concurrent_dumps)
       : file_name_prefix_(file_name_prefix),
         dir_path_(dir_path),
-        dir_fd_(open(dir_path.c_str(), O_DIRECTORY | O_RDONLY | O_CLOEXEC)),
+        dir_fd_(dir_path.empty() ? -1
+                                 : open(dir_path.c_str(), O_DIRECTORY | O_RDONLY | O_CLOEXEC)),
         max_artifacts_(max_artifacts),
         next_artifact_(0),
         max_concurrent_dumps_(max_concurrent_dumps),
         num_concurrent_dumps_(0) {
+    CHECK(max_concurrent_dumps_ > 0);
+    if (dir_path.empty()) {
+      return;
+    }
     if (dir_fd_ == -1) {
       PLOG(FATAL) << "failed to open directory: " << dir_path;
     }
@@ -95,24 +109,42 @@ class CrashQueue {
   }
 
   static CrashQueue* for_crash(const Crash* crash) {
-    return (crash->crash_type == kDebuggerdJavaBacktrace) ? for_anrs() : for_tombstones();
+    switch (crash->crash_type) {
+      case kDebuggerdJavaBacktrace:
+        return for_anrs();
+      case kDebuggerdNativeBacktrace:
+        return for_native_backtraces();
+      default:
+        return for_tombstones();
+    }
   }
 
   static CrashQueue* for_tombstones() {
     static CrashQueue queue("/data/tombstones", "tombstone_" /* file_name_prefix */,
                             GetIntProperty("tombstoned.max_tombstone_count", 32),
-                            1 /* max_concurrent_dumps */);
+                            GetIntProperty("tombstoned.max_concurrent_tombstones", 1));
     return &queue;
   }
 
   static CrashQueue* for_anrs() {
     static CrashQueue queue("/data/anr", "trace_" /* file_name_prefix */,
                             GetIntProperty("tombstoned.max_anr_count", 64),
-                            4 /* max_concurrent_dumps */);
+                            GetIntProperty("tombstoned.max_concurrent_anrs", 4));
     return &queue;
   }
 
+  // Native backtraces only ever go to an interceptor or to /dev/null, so
+  // they don't need to wait behind tombstones during a crash loop.
+  static CrashQueue* for_native_backtraces() {
+    static CrashQueue queue("" /* dir_path */, "" /* file_name_prefix */, 0 /* max_artifacts */,
+                            GetIntProperty("tombstoned.max_concurrent_native_backtraces", 4));
+    return &queue;
+  }
+
+  int dir_fd() const { return dir_fd_; }
+
   std::pair<std::string, unique_fd> get_output() {
+    CHECK(dir_fd_ != -1);
     std::string path;
     unique_fd result(openat(dir_fd_, ".", O_WRONLY | O_APPEND | O_TMPFILE | O_CLOEXEC, 0640));
     if (result == -1) {
@@ -131,6 +163,7 @@ class CrashQueue {
   }
 
   std::string get_next_artifact_path() {
+    CHECK(dir_fd_ != -1);
     std::string file_name =
         StringPrintf("%s/%s%02d", dir_path_.c_str(), file_name_prefix_.c_str(), next_artifact_);
     next_artifact_ = (next_artifact_ + 1) % max_artifacts_;
@@ -146,6 +179,17 @@ class CrashQueue {
     return false;
   }
 
+  // Whether a dump of the same type for |pid| is already waiting to run. A
+  // second request would only produce the same dump again.
+  bool has_queued_request(pid_t pid, DebuggerdDumpType type) const {
+    for (const Crash* crash : queued_requests_) {
+      if (crash->crash_pid == pid && crash->crash_type == type) {
+        return true;
+      }
+    }
+    return false;
+  }
+
   void maybe_dequeue_crashes(void (*handler)(Crash* crash)) {
     while (!queued_requests_.empty() && num_concurrent_dumps_ < max_concurrent_dumps_) {
       Crash* next_crash = queued_requests_.front();
@@ -322,6 +366,11 @@ static void crash_request_cb(evutil_socket_t sockfd, short ev, void* arg) {
 
   LOG(INFO) << "received crash request for pid " << crash->crash_pid;
 
+  if (CrashQueue::for_crash(crash)->has_queued_request(crash->crash_pid, crash->crash_type)) {
+    LOG(INFO) << "dropping duplicate crash request for pid " << crash->crash_pid;
+    goto fail;
+  }
+
   if (CrashQueue::for_crash(crash)->maybe_enqueue_crash(crash)) {
     LOG(INFO) << "enqueueing crash request for pid " << crash->crash_pid;
   } else {
@@ -362,37 +411,15 @@ static void crash_completed_cb(evutil_socket_t sockfd, short ev, void* arg) {
   }
 
   if (crash->crash_tombstone_fd != -1) {
-    std::string fd_path = StringPrintf("/proc/self/fd/%d", crash->crash_tombstone_fd.get());
-    std::string tombstone_path = CrashQueue::for_crash(crash)->get_next_artifact_path();
-
-    // linkat doesn't let us replace a file, so we need to unlink first.
-    int rc = unlink(tombstone_path.c_str());
-    if (rc != 0 && errno != ENOENT) {
-      PLOG(ERROR) << "failed to unlink tombstone at " << tombstone_path;
-      goto fail;
-    }
-
-    rc = linkat(AT_FDCWD, fd_path.c_str(), AT_FDCWD, tombstone_path.c_str(), AT_SYMLINK_FOLLOW);
-    if (rc != 0) {
-      PLOG(ERROR) << "failed to link tombstone";
-    } else {
-      if (crash->crash_type == kDebuggerdJavaBacktrace) {
-        LOG(ERROR) << "Traces for pid " << crash->crash_pid << " written to: " << tombstone_path;
-      } else {
-        // NOTE: Several tools parse this log message to figure out where the
-        // tombstone associated with a given native crash was written. Any changes
-        // to this message must be carefully considered.
-        LOG(ERROR) << "Tombstone written to: " << tombstone_path;
-      }
-    }
-
-    // If we don't have O_TMPFILE, we need to clean up after ourselves.
-    if (!crash->crash_tombstone_path.empty()) {
-      rc = unlink(crash->crash_tombstone_path.c_str());
-      if (rc != 0) {
-        PLOG(ERROR) << "failed to unlink temporary tombstone at " << crash->crash_tombstone_path;
-      }
-    }
+    CrashQueue* queue = CrashQueue::for_crash(crash);
+    Artifact artifact;
+    artifact.fd = std::move(crash->crash_tombstone_fd);
+    artifact.temporary_path = std::move(crash->crash_tombstone_path);
+    artifact.path = queue->get_next_artifact_path();
+    artifact.dir_fd = queue->dir_fd();
+    artifact.pid = crash->crash_pid;
+    artifact.dump_type = crash->crash_type;
+    artifact_writer->Add(std::move(artifact));
   }
 
 fail:
@@ -430,6 +457,7 @@ int main(int, char* []) {
   }
 
   intercept_manager = new InterceptManager(base, intercept_socket);
+  artifact_writer = new ArtifactWriter();
 
   evconnlistener* tombstone_listener =
       evconnlistener_new(base, crash_accept_cb, CrashQueue::for_tombstones(), LEV_OPT_CLOSE_ON_FREE,
@@ -453,6 +481,23 @@ int main(int, char* []) {
     }
   }
 
+  // crash_dumps started from here attach to processes that aren't ours, which init has to allow
+  // by passing CAP_SYS_PTRACE down to us.
+  size_t crash_dump_pool_size = GetUintProperty<size_t>("tombstoned.crash_dump_pool_size", 0);
+  if (crash_dump_pool_size > 0) {
+    if (prctl(PR_CAP_AMBIENT, PR_CAP_AMBIENT_IS_SET, CAP_SYS_PTRACE, 0, 0) != 1) {
+      LOG(ERROR) << "not starting crash_dump pool without ambient CAP_SYS_PTRACE";
+    } else {
+      crash_dump_pool = new CrashDumpPool(base);
+      crash_dump_pool->Add("/system/bin/crash_dump64",
+                           android_get_control_socket(kTombstonedCrashDump64SocketName),
+                           crash_dump_pool_size);
+      crash_dump_pool->Add("/system/bin/crash_dump32",
+                           android_get_control_socket(kTombstonedCrashDump32SocketName),
+                           crash_dump_pool_size);
+    }
+  }
+
   LOG(INFO) << "tombstoned successfully initialized";
   event_base_dispatch(base);
 }
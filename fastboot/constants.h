@@ -35,6 +35,8 @@
 #define FB_CMD_OEM "oem"
 #define FB_CMD_GSI "gsi"
 #define FB_CMD_SNAPSHOT_UPDATE "snapshot-update"
+#define FB_CMD_DOWNLOAD_COMPRESSED "download-compressed"
+#define FB_CMD_FLASH_STREAM "flash-stream"
 
 #define RESPONSE_OKAY "OKAY"
 #define RESPONSE_FAIL "FAIL"
@@ -77,3 +79,9 @@
 #define FB_VAR_FIRST_API_LEVEL "first-api-level"
 #define FB_VAR_SECURITY_PATCH_LEVEL "security-patch-level"
 #define FB_VAR_TREBLE_ENABLED "treble-enabled"
+#define FB_VAR_DOWNLOAD_COMPRESSION "download-compression"
+#define FB_VAR_FLASH_STREAM "flash-stream"
+
+#define FB_COMPRESSION_LZ4 "lz4"
+// Largest amount of data a single block of a compressed download decompresses to.
+#define FB_COMPRESSED_BLOCK_SZ (1024 * 1024)
@@ -16,9 +16,13 @@
 
 #include "commands.h"
 
+#include <endian.h>
+#include <fcntl.h>
+#include <string.h>
 #include <sys/socket.h>
 #include <sys/un.h>
 
+#include <algorithm>
 #include <unordered_set>
 
 #include <android-base/logging.h>
@@ -36,6 +40,7 @@
 #include <liblp/builder.h>
 #include <liblp/liblp.h>
 #include <libsnapshot/snapshot.h>
+#include <lz4.h>
 #include <uuid/uuid.h>
 
 #include "constants.h"
@@ -115,6 +120,8 @@ bool GetVarHandler(FastbootDevice* device, const std::vector<std::string>& args)
             {FB_VAR_SECURE, {GetSecure, nullptr}},
             {FB_VAR_UNLOCKED, {GetUnlocked, nullptr}},
             {FB_VAR_MAX_DOWNLOAD_SIZE, {GetMaxDownloadSize, nullptr}},
+            {FB_VAR_DOWNLOAD_COMPRESSION, {GetDownloadCompression, nullptr}},
+            {FB_VAR_FLASH_STREAM, {GetFlashStream, nullptr}},
             {FB_VAR_CURRENT_SLOT, {::GetCurrentSlot, nullptr}},
             {FB_VAR_SLOT_COUNT, {GetSlotCount, nullptr}},
             {FB_VAR_HAS_SLOT, {GetHasSlot, GetAllPartitionArgsNoSlot}},
@@ -284,6 +291,157 @@ bool DownloadHandler(FastbootDevice* device, const std::vector<std::string>& arg
     return device->WriteStatus(FastbootResult::FAIL, "Couldn't download data");
 }
 
+// Reads one block of a compressed download into |dest|, which has room for |max_size| bytes.
+// Returns the size of the block once decompressed, or -1 on error.
+static ssize_t ReadCompressedBlock(FastbootDevice* device, char* dest, size_t max_size,
+                                   std::vector<char>* compressed) {
+    uint32_t header[2];
+    if (device->get_transport()->Read(header, sizeof(header)) !=
+        static_cast<ssize_t>(sizeof(header))) {
+        PLOG(ERROR) << "Couldn't read compressed block header";
+        return -1;
+    }
+    uint32_t compressed_size = le32toh(header[0]);
+    uint32_t size = le32toh(header[1]);
+    if (size == 0 || size > FB_COMPRESSED_BLOCK_SZ || size > max_size || compressed_size == 0 ||
+        compressed_size > uint32_t(LZ4_compressBound(size))) {
+        LOG(ERROR) << "Invalid compressed block: " << compressed_size << " -> " << size;
+        return -1;
+    }
+
+    if (compressed_size == size) {
+        if (device->get_transport()->Read(dest, size) != static_cast<ssize_t>(size)) {
+            PLOG(ERROR) << "Couldn't read stored block";
+            return -1;
+        }
+    } else {
+        compressed->resize(compressed_size);
+        if (!device->HandleData(true, compressed)) {
+            PLOG(ERROR) << "Couldn't read compressed block";
+            return -1;
+        }
+        if (LZ4_decompress_safe(compressed->data(), dest, compressed_size, size) !=
+            static_cast<int>(size)) {
+            LOG(ERROR) << "Couldn't decompress block";
+            return -1;
+        }
+    }
+    return size;
+}
+
+// Reads the blocks of a compressed download, decompressing each one straight into place in the
+// download buffer.
+static bool ReadCompressedData(FastbootDevice* device) {
+    auto& data = device->download_data();
+    std::vector<char> compressed;
+    size_t offset = 0;
+    while (offset < data.size()) {
+        ssize_t size = ReadCompressedBlock(device, data.data() + offset, data.size() - offset,
+                                           &compressed);
+        if (size < 0) {
+            return false;
+        }
+        offset += size;
+    }
+    return true;
+}
+
+// Hands out a download, plain or compressed, in whatever pieces the caller asks for. The
+// transport is always read in whole transfers of at most 1 MiB, or whole compressed blocks, so
+// small reads never split a USB packet.
+class DownloadStream {
+  public:
+    DownloadStream(FastbootDevice* device, uint64_t size, bool compressed)
+        : device_(device), unread_(size), compressed_(compressed) {}
+
+    bool Read(char* data, size_t len) {
+        while (len > 0) {
+            if (offset_ == buffer_len_ && !Fill()) {
+                return false;
+            }
+            size_t n = std::min(len, buffer_len_ - offset_);
+            memcpy(data, buffer_.data() + offset_, n);
+            offset_ += n;
+            data += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    // Reads and discards the rest of the download, so that the host is listening for the
+    // response by the time it is sent.
+    void Drain() {
+        while (unread_ > 0 && Fill()) {
+        }
+    }
+
+    uint64_t remaining() const { return unread_ + buffer_len_ - offset_; }
+
+  private:
+    bool Fill() {
+        if (unread_ == 0) {
+            LOG(ERROR) << "Read past the end of the download";
+            return false;
+        }
+        buffer_.resize(FB_COMPRESSED_BLOCK_SZ);
+        size_t max_size = std::min<uint64_t>(unread_, buffer_.size());
+        if (compressed_) {
+            ssize_t size = ReadCompressedBlock(device_, buffer_.data(), max_size, &scratch_);
+            if (size < 0) {
+                return false;
+            }
+            buffer_len_ = size;
+        } else {
+            ssize_t size = device_->get_transport()->Read(buffer_.data(), max_size);
+            if (size != static_cast<ssize_t>(max_size)) {
+                PLOG(ERROR) << "Couldn't read download data";
+                return false;
+            }
+            buffer_len_ = max_size;
+        }
+        offset_ = 0;
+        unread_ -= buffer_len_;
+        return true;
+    }
+
+    FastbootDevice* device_;
+    uint64_t unread_;
+    bool compressed_;
+    std::vector<char> buffer_;
+    size_t buffer_len_ = 0;
+    size_t offset_ = 0;
+    std::vector<char> scratch_;
+};
+
+bool DownloadCompressedHandler(FastbootDevice* device, const std::vector<std::string>& args) {
+    if (args.size() < 3) {
+        return device->WriteStatus(FastbootResult::FAIL, "size argument unspecified");
+    }
+
+    if (GetDeviceLockStatus()) {
+        return device->WriteStatus(FastbootResult::FAIL,
+                                   "Download is not allowed on locked devices");
+    }
+
+    // arg[1] is the compression algorithm, arg[2] the decompressed size of the data.
+    if (args[1] != FB_COMPRESSION_LZ4) {
+        return device->WriteStatus(FastbootResult::FAIL, "Unsupported compression");
+    }
+    unsigned int size;
+    if (!android::base::ParseUint("0x" + args[2], &size, kMaxDownloadSizeDefault)) {
+        return device->WriteStatus(FastbootResult::FAIL, "Invalid size");
+    }
+    device->download_data().resize(size);
+    if (!device->WriteStatus(FastbootResult::DATA, android::base::StringPrintf("%08x", size))) {
+        return false;
+    }
+
+    if (ReadCompressedData(device)) {
+        return device->WriteStatus(FastbootResult::OKAY, "");
+    }
+    return device->WriteStatus(FastbootResult::FAIL, "Couldn't download data");
+}
+
 bool SetActiveHandler(FastbootDevice* device, const std::vector<std::string>& args) {
     if (args.size() < 2) {
         return device->WriteStatus(FastbootResult::FAIL, "Missing slot argument");
@@ -594,6 +752,75 @@ bool FlashHandler(FastbootDevice* device, const std::vector<std::string>& args)
     return device->WriteStatus(FastbootResult::OKAY, "Flashing succeeded");
 }
 
+bool FlashStreamHandler(FastbootDevice* device, const std::vector<std::string>& args) {
+    if (args.size() < 3) {
+        return device->WriteStatus(FastbootResult::FAIL, "Invalid arguments");
+    }
+
+    if (GetDeviceLockStatus()) {
+        return device->WriteStatus(FastbootResult::FAIL,
+                                   "Flashing is not allowed on locked devices");
+    }
+
+    // arg[1] is the partition, arg[2] the size of the image and arg[3], if present, the
+    // compression algorithm it is sent with.
+    const auto& partition_name = args[1];
+    uint32_t size;
+    if (!android::base::ParseUint("0x" + args[2], &size) || size == 0) {
+        return device->WriteStatus(FastbootResult::FAIL, "Invalid size");
+    }
+    bool compressed = args.size() >= 4;
+    if (compressed && args[3] != FB_COMPRESSION_LZ4) {
+        return device->WriteStatus(FastbootResult::FAIL, "Unsupported compression");
+    }
+
+    if (IsProtectedPartitionDuringMerge(device, partition_name)) {
+        auto message = "Cannot flash " + partition_name + " while a snapshot update is in progress";
+        return device->WriteFail(message);
+    }
+
+    if (LogicalPartitionExists(device, partition_name)) {
+        CancelPartitionSnapshot(device, partition_name);
+    }
+
+    DownloadStream stream(device, size, compressed);
+    int ret;
+    if (partition_name == "boot" || partition_name == "boot_a" || partition_name == "boot_b") {
+        // Boot images need their AVB footer moved to the end of the partition, which takes the
+        // whole image, so they go through the download buffer as before.
+        if (size > kMaxDownloadSizeDefault) {
+            return device->WriteStatus(FastbootResult::FAIL, "Invalid size");
+        }
+        device->download_data().resize(size);
+        if (!device->WriteStatus(FastbootResult::DATA, android::base::StringPrintf("%08x", size))) {
+            return false;
+        }
+        if (!stream.Read(device->download_data().data(), size)) {
+            return device->WriteStatus(FastbootResult::FAIL, "Couldn't download data");
+        }
+        ret = Flash(device, partition_name);
+    } else {
+        PartitionHandle handle;
+        if (!OpenPartition(device, partition_name, &handle, O_DIRECT)) {
+            return device->WriteStatus(FastbootResult::FAIL, strerror(ENOENT));
+        }
+        if (!device->WriteStatus(FastbootResult::DATA, android::base::StringPrintf("%08x", size))) {
+            return false;
+        }
+        ret = FlashStream(device, partition_name, &handle, size,
+                          [&stream](char* data, size_t len) { return stream.Read(data, len); });
+        if (ret == 0 && stream.remaining() > 0) {
+            LOG(ERROR) << "Image ended " << stream.remaining() << " bytes before the download";
+            ret = -EINVAL;
+        }
+    }
+    if (ret < 0) {
+        stream.Drain();
+        return device->WriteStatus(FastbootResult::FAIL, strerror(-ret));
+    }
+    return device->WriteStatus(FastbootResult::OKAY, "Flashing succeeded");
+}
+
 bool UpdateSuperHandler(FastbootDevice* device, const std::vector<std::string>& args) {
     if (args.size() < 2) {
         return device->WriteFail("Invalid arguments");
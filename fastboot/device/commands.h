@@ -34,6 +34,8 @@ enum class FastbootResult {
 using CommandHandler = std::function<bool(FastbootDevice*, const std::vector<std::string>&)>;
 
 bool DownloadHandler(FastbootDevice* device, const std::vector<std::string>& args);
+bool DownloadCompressedHandler(FastbootDevice* device, const std::vector<std::string>& args);
+bool FlashStreamHandler(FastbootDevice* device, const std::vector<std::string>& args);
 bool SetActiveHandler(FastbootDevice* device, const std::vector<std::string>& args);
 bool ShutDownHandler(FastbootDevice* device, const std::vector<std::string>& args);
 bool RebootHandler(FastbootDevice* device, const std::vector<std::string>& args);
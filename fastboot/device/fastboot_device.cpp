@@ -46,6 +46,8 @@ FastbootDevice::FastbootDevice()
     : kCommandMap({
               {FB_CMD_SET_ACTIVE, SetActiveHandler},
               {FB_CMD_DOWNLOAD, DownloadHandler},
+              {FB_CMD_DOWNLOAD_COMPRESSED, DownloadCompressedHandler},
+              {FB_CMD_FLASH_STREAM, FlashStreamHandler},
               {FB_CMD_GETVAR, GetVarHandler},
               {FB_CMD_SHUTDOWN, ShutDownHandler},
               {FB_CMD_REBOOT, RebootHandler},
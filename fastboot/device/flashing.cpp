@@ -16,6 +16,8 @@
 #include "flashing.h"
 
 #include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
@@ -28,6 +30,7 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
+#include <asyncio/IoQueue.h>
 #include <ext4_utils/ext4_utils.h>
 #include <fs_mgr_overlayfs.h>
 #include <fstab/fstab.h>
@@ -72,6 +75,285 @@ void WipeOverlayfsForPartition(FastbootDevice* device, const std::string& partit
     }
 }
 
+// The headers of a sparse image, as laid out in libsparse's sparse_format.h.
+struct SparseHeader {
+    uint32_t magic;
+    uint16_t major_version;
+    uint16_t minor_version;
+    uint16_t file_hdr_sz;
+    uint16_t chunk_hdr_sz;
+    uint32_t blk_sz;
+    uint32_t total_blks;
+    uint32_t total_chunks;
+    uint32_t image_checksum;
+} __attribute__((packed));
+
+struct SparseChunkHeader {
+    uint16_t chunk_type;
+    uint16_t reserved1;
+    uint32_t chunk_sz;
+    uint32_t total_sz;
+} __attribute__((packed));
+
+constexpr uint16_t kChunkTypeRaw = 0xcac1;
+constexpr uint16_t kChunkTypeFill = 0xcac2;
+constexpr uint16_t kChunkTypeDontCare = 0xcac3;
+constexpr uint16_t kChunkTypeCrc32 = 0xcac4;
+
+constexpr size_t kStreamBufferSize = 1024 * 1024;
+constexpr size_t kStreamQueueDepth = 8;
+constexpr uint64_t kDirectIoAlignment = 4096;
+
+// Writes streamed data through a handful of aligned buffers, queueing each one as it fills so
+// that the device is written while the next part of the image is still arriving.  The buffers and
+// the block device are registered with the queue up front, which on io_uring saves pinning the
+// pages and looking up the file on every write.
+// Writes that O_DIRECT can't take, like the unaligned tail of a raw image, go through the page
+// cache once everything before them has landed.
+class StreamWriter {
+  public:
+    explicit StreamWriter(int fd) : fd_(fd) {}
+    ~StreamWriter();
+
+    bool Init();
+    // Writes |len| bytes, produced by |read| a buffer at a time, at |offset|.
+    bool Write(uint64_t offset, uint64_t len, const FlashDataSource& read);
+    // Waits for everything written so far to reach the device.
+    bool Finish();
+
+  private:
+    struct Buffer {
+        char* data = nullptr;
+        uint64_t offset = 0;
+        size_t len = 0;
+    };
+
+    bool Submit();
+    bool Reap(size_t min_events);
+    bool WriteThroughCache(const char* data, size_t len, uint64_t offset);
+
+    int fd_;
+    std::unique_ptr<android::asyncio::IoQueue> queue_;
+    std::vector<Buffer> buffers_;
+    std::vector<Buffer*> free_;
+    size_t in_flight_ = 0;
+
+    Buffer* current_ = nullptr;
+    uint64_t current_offset_ = 0;
+    size_t current_len_ = 0;
+};
+
+StreamWriter::~StreamWriter() {
+    // The kernel may still be writing from the buffers, so wait for it before freeing them.
+    if (in_flight_) Reap(in_flight_);
+    queue_.reset();
+    for (auto& buffer : buffers_) {
+        free(buffer.data);
+    }
+}
+
+bool StreamWriter::Init() {
+    queue_ = android::asyncio::IoQueue::Create(kStreamQueueDepth);
+    if (!queue_) {
+        PLOG(ERROR) << "Couldn't create I/O queue";
+        return false;
+    }
+    // Completions point into |buffers_|, so it is sized once here and never again.
+    buffers_.resize(kStreamQueueDepth);
+    std::vector<iovec> iovecs;
+    for (auto& buffer : buffers_) {
+        void* data;
+        if (posix_memalign(&data, kDirectIoAlignment, kStreamBufferSize) != 0) {
+            LOG(ERROR) << "Couldn't allocate stream buffer";
+            return false;
+        }
+        buffer.data = static_cast<char*>(data);
+        free_.push_back(&buffer);
+        iovecs.push_back({data, kStreamBufferSize});
+    }
+    // Registration is only an optimization; without it writes just take the slower path.
+    queue_->RegisterBuffers(iovecs.data(), iovecs.size());
+    queue_->RegisterFiles(&fd_, 1);
+    return true;
+}
+
+bool StreamWriter::Write(uint64_t offset, uint64_t len, const FlashDataSource& read) {
+    while (len > 0) {
+        if (current_ &&
+            (offset != current_offset_ + current_len_ || current_len_ == kStreamBufferSize)) {
+            if (!Submit()) return false;
+        }
+        if (!current_) {
+            if (free_.empty() && !Reap(1)) return false;
+            current_ = free_.back();
+            free_.pop_back();
+            current_offset_ = offset;
+            current_len_ = 0;
+        }
+
+        size_t n = std::min<uint64_t>(len, kStreamBufferSize - current_len_);
+        if (!read(current_->data + current_len_, n)) {
+            return false;
+        }
+        current_len_ += n;
+        offset += n;
+        len -= n;
+    }
+    return true;
+}
+
+bool StreamWriter::Finish() {
+    if (current_ && !Submit()) return false;
+    return in_flight_ == 0 || Reap(in_flight_);
+}
+
+bool StreamWriter::Submit() {
+    Buffer* buffer = current_;
+    current_ = nullptr;
+
+    if (current_offset_ % kDirectIoAlignment || current_len_ % kDirectIoAlignment) {
+        bool ok = (in_flight_ == 0 || Reap(in_flight_)) &&
+                  WriteThroughCache(buffer->data, current_len_, current_offset_);
+        free_.push_back(buffer);
+        return ok;
+    }
+
+    buffer->offset = current_offset_;
+    buffer->len = current_len_;
+    // A free buffer means a free slot in the queue, so preparing the write can't fail.
+    queue_->PrepWrite(fd_, buffer->data, buffer->len, buffer->offset,
+                      reinterpret_cast<uintptr_t>(buffer));
+    if (queue_->Submit() != 1) {
+        PLOG(ERROR) << "Couldn't submit write at offset " << current_offset_;
+        free_.push_back(buffer);
+        return false;
+    }
+    in_flight_++;
+    return true;
+}
+
+bool StreamWriter::Reap(size_t min_events) {
+    android::asyncio::IoQueue::Completion completions[kStreamQueueDepth];
+    int n = queue_->Wait(completions, min_events, kStreamQueueDepth);
+    if (n < 0) {
+        PLOG(ERROR) << "Couldn't wait for writes";
+        return false;
+    }
+
+    bool ok = true;
+    for (int i = 0; i < n; i++) {
+        Buffer* buffer = reinterpret_cast<Buffer*>(static_cast<uintptr_t>(completions[i].data));
+        if (completions[i].res != static_cast<int64_t>(buffer->len)) {
+            errno = completions[i].res < 0 ? -completions[i].res : EIO;
+            PLOG(ERROR) << "Failed to flash data at offset " << buffer->offset;
+            ok = false;
+        }
+        free_.push_back(buffer);
+        in_flight_--;
+    }
+    return ok;
+}
+
+bool StreamWriter::WriteThroughCache(const char* data, size_t len, uint64_t offset) {
+    int flags = fcntl(fd_, F_GETFL);
+    if (flags < 0 || fcntl(fd_, F_SETFL, flags & ~O_DIRECT) < 0) {
+        PLOG(ERROR) << "Couldn't clear O_DIRECT";
+        return false;
+    }
+    bool ok = true;
+    while (len > 0) {
+        ssize_t n = TEMP_FAILURE_RETRY(pwrite64(fd_, data, len, offset));
+        if (n <= 0) {
+            PLOG(ERROR) << "Failed to flash data at offset " << offset;
+            ok = false;
+            break;
+        }
+        data += n;
+        len -= n;
+        offset += n;
+    }
+    if (fcntl(fd_, F_SETFL, flags) < 0) {
+        PLOG(ERROR) << "Couldn't restore O_DIRECT";
+        return false;
+    }
+    return ok;
+}
+
+bool SkipStreamData(const FlashDataSource& read, size_t len) {
+    char scratch[64];
+    while (len > 0) {
+        size_t n = std::min(len, sizeof(scratch));
+        if (!read(scratch, n)) return false;
+        len -= n;
+    }
+    return true;
+}
+
+int FlashSparseStream(StreamWriter* writer, uint64_t block_device_size, const SparseHeader& header,
+                      const FlashDataSource& read) {
+    if (header.major_version != 1 || header.file_hdr_sz < sizeof(SparseHeader) ||
+        header.chunk_hdr_sz < sizeof(SparseChunkHeader) || header.blk_sz == 0 ||
+        header.blk_sz % sizeof(uint32_t)) {
+        LOG(ERROR) << "Invalid sparse image header";
+        return -EINVAL;
+    }
+    uint64_t image_size = static_cast<uint64_t>(header.total_blks) * header.blk_sz;
+    if (image_size > block_device_size) {
+        return -EOVERFLOW;
+    }
+    if (!SkipStreamData(read, header.file_hdr_sz - sizeof(SparseHeader))) {
+        return -EIO;
+    }
+
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < header.total_chunks; i++) {
+        SparseChunkHeader chunk;
+        if (!read(reinterpret_cast<char*>(&chunk), sizeof(chunk)) ||
+            !SkipStreamData(read, header.chunk_hdr_sz - sizeof(chunk))) {
+            return -EIO;
+        }
+        uint64_t len = static_cast<uint64_t>(chunk.chunk_sz) * header.blk_sz;
+        if (len > image_size - offset) {
+            LOG(ERROR) << "Sparse chunk " << i << " runs past the end of the image";
+            return -EINVAL;
+        }
+
+        switch (chunk.chunk_type) {
+            case kChunkTypeRaw:
+                if (chunk.total_sz != header.chunk_hdr_sz + len) {
+                    LOG(ERROR) << "Bad size for raw sparse chunk " << i;
+                    return -EINVAL;
+                }
+                if (!writer->Write(offset, len, read)) return -EIO;
+                break;
+            case kChunkTypeFill: {
+                uint32_t fill;
+                if (!read(reinterpret_cast<char*>(&fill), sizeof(fill))) return -EIO;
+                // Chunks start on block boundaries and buffers fill up in whole words, so every
+                // piece asked for starts on a word of the pattern.
+                auto fill_source = [fill](char* data, size_t n) {
+                    for (size_t j = 0; j < n; j += sizeof(fill)) {
+                        memcpy(data + j, &fill, std::min(sizeof(fill), n - j));
+                    }
+                    return true;
+                };
+                if (!writer->Write(offset, len, fill_source)) return -EIO;
+                break;
+            }
+            case kChunkTypeDontCare:
+                break;
+            case kChunkTypeCrc32:
+                if (!SkipStreamData(read, sizeof(uint32_t))) return -EIO;
+                break;
+            default:
+                LOG(ERROR) << "Unknown sparse chunk type 0x" << std::hex << chunk.chunk_type;
+                return -EINVAL;
+        }
+        offset += len;
+    }
+    return 0;
+}
+
 }  // namespace
 
 int FlashRawDataChunk(int fd, const char* data, size_t len) {
@@ -166,6 +448,45 @@ int Flash(FastbootDevice* device, const std::string& partition_name) {
     return FlashBlockDevice(handle.fd(), data);
 }
 
+int FlashStream(FastbootDevice* device, const std::string& partition_name,
+                PartitionHandle* handle, uint64_t size, const FlashDataSource& read) {
+    uint64_t block_device_size = get_block_device_size(handle->fd());
+    StreamWriter writer(handle->fd());
+    if (!writer.Init()) {
+        return -ENOMEM;
+    }
+
+    SparseHeader header;
+    size_t header_len = std::min<uint64_t>(size, sizeof(header));
+    if (!read(reinterpret_cast<char*>(&header), header_len)) {
+        return -EIO;
+    }
+
+    WipeOverlayfsForPartition(device, partition_name);
+    int ret = 0;
+    if (header_len == sizeof(header) && header.magic == SPARSE_HEADER_MAGIC) {
+        ret = FlashSparseStream(&writer, block_device_size, header, read);
+    } else if (size > block_device_size) {
+        ret = -EOVERFLOW;
+    } else {
+        // The bytes read to look for a sparse header are the start of the raw image.
+        const char* head = reinterpret_cast<const char*>(&header);
+        auto head_source = [&head](char* data, size_t len) {
+            memcpy(data, head, len);
+            head += len;
+            return true;
+        };
+        if (!writer.Write(0, header_len, head_source) ||
+            !writer.Write(header_len, size - header_len, read)) {
+            ret = -EIO;
+        }
+    }
+    if (ret == 0 && !writer.Finish()) {
+        ret = -EIO;
+    }
+    return ret;
+}
+
 bool UpdateSuper(FastbootDevice* device, const std::string& super_name, bool wipe) {
     std::vector<char> data = std::move(device->download_data());
     if (data.empty()) {
@@ -16,10 +16,21 @@
 
 #pragma once
 
+#include <stdint.h>
+
+#include <functional>
 #include <string>
 #include <vector>
 
 class FastbootDevice;
+class PartitionHandle;
+
+// Fills the buffer with the next |len| bytes of the image being flashed.
+using FlashDataSource = std::function<bool(char* data, size_t len)>;
 
 int Flash(FastbootDevice* device, const std::string& partition_name);
+// Writes a raw or sparse image of |size| bytes to the partition as it is read, rather than from
+// the download buffer. |handle| should have been opened with O_DIRECT.
+int FlashStream(FastbootDevice* device, const std::string& partition_name,
+                PartitionHandle* handle, uint64_t size, const FlashDataSource& read);
 bool UpdateSuper(FastbootDevice* device, const std::string& super_name, bool wipe);
@@ -268,6 +268,18 @@ bool GetMaxDownloadSize(FastbootDevice* /* device */, const std::vector<std::str
     return true;
 }
 
+bool GetDownloadCompression(FastbootDevice* /* device */,
+                            const std::vector<std::string>& /* args */, std::string* message) {
+    *message = FB_COMPRESSION_LZ4;
+    return true;
+}
+
+bool GetFlashStream(FastbootDevice* /* device */, const std::vector<std::string>& /* args */,
+                    std::string* message) {
+    *message = "yes";
+    return true;
+}
+
 bool GetUnlocked(FastbootDevice* /* device */, const std::vector<std::string>& /* args */,
                  std::string* message) {
     *message = GetDeviceLockStatus() ? "no" : "yes";
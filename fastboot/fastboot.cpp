@@ -42,6 +42,10 @@
 #include <sys/time.h>
 #include <sys/types.h>
 #include <unistd.h>
+#if !defined(_WIN32)
+#include <poll.h>
+#include <sys/wait.h>
+#endif
 
 #include <chrono>
 #include <functional>
@@ -116,6 +120,7 @@ struct fastboot_buffer {
     int64_t sz;
     int fd;
     int64_t image_size;
+    int64_t sparse_limit;  // FB_BUFFER_SPARSE is resparsed to pieces of at most this size
 };
 
 enum class ImageType {
@@ -434,6 +439,8 @@ static int show_help() {
             " -w                         Wipe userdata.\n"
             " -s SERIAL                  Specify a USB device.\n"
             " -s tcp|udp:HOST[:PORT]     Specify a network device.\n"
+            "                            Repeat -s to run the commands on several\n"
+            "                            devices in parallel.\n"
             " -S SIZE[K|M|G]             Break into sparse files no larger than SIZE.\n"
             " --force                    Force a flash operation that may be unsafe.\n"
             " --slot SLOT                Use SLOT; 'all' for both slots, 'other' for\n"
@@ -814,7 +821,7 @@ static void DumpInfo() {
 
 }
 
-static struct sparse_file** load_sparse_files(int fd, int64_t max_size) {
+static struct sparse_file* load_sparse_file(int fd, int64_t max_size) {
     struct sparse_file* s = sparse_file_import_auto(fd, false, true);
     if (!s) die("cannot sparse read file");
 
@@ -822,16 +829,7 @@ static struct sparse_file** load_sparse_files(int fd, int64_t max_size) {
       die("invalid max size %" PRId64, max_size);
     }
 
-    int files = sparse_file_resparse(s, max_size, nullptr, 0);
-    if (files < 0) die("Failed to resparse");
-
-    sparse_file** out_s = reinterpret_cast<sparse_file**>(calloc(sizeof(struct sparse_file *), files + 1));
-    if (!out_s) die("Failed to allocate sparse file array");
-
-    files = sparse_file_resparse(s, max_size, out_s, files);
-    if (files < 0) die("Failed to resparse");
-
-    return out_s;
+    return s;
 }
 
 static int64_t get_target_sparse_limit() {
@@ -892,12 +890,13 @@ static bool load_buf_fd(int fd, struct fastboot_buffer* buf) {
     lseek(fd, 0, SEEK_SET);
     int64_t limit = get_sparse_limit(sz);
     if (limit) {
-        sparse_file** s = load_sparse_files(fd, limit);
+        sparse_file* s = load_sparse_file(fd, limit);
         if (s == nullptr) {
             return false;
         }
         buf->type = FB_BUFFER_SPARSE;
         buf->data = s;
+        buf->sparse_limit = limit;
     } else {
         buf->type = FB_BUFFER_FD;
         buf->data = nullptr;
@@ -1041,10 +1040,20 @@ static void copy_boot_avb_footer(const std::string& partition, struct fastboot_b
     lseek(fd, 0, SEEK_SET);
 }
 
+struct SparseFlash {
+    const std::string& partition;
+    int total;
+};
+
+static int flash_sparse_piece(void* priv, sparse_file* s, int index) {
+    const SparseFlash* flash = reinterpret_cast<SparseFlash*>(priv);
+    int64_t sz = sparse_file_len(s, true, false);
+    fb->FlashPartition(flash->partition, s, sz, index + 1, flash->total);
+    return 0;
+}
+
 static void flash_buf(const std::string& partition, struct fastboot_buffer *buf)
 {
-    sparse_file** s;
-
     if (partition == "boot" || partition == "boot_a" || partition == "boot_b") {
         copy_boot_avb_footer(partition, buf);
     }
@@ -1061,17 +1070,14 @@ static void flash_buf(const std::string& partition, struct fastboot_buffer *buf)
 
     switch (buf->type) {
         case FB_BUFFER_SPARSE: {
-            std::vector<std::pair<sparse_file*, int64_t>> sparse_files;
-            s = reinterpret_cast<sparse_file**>(buf->data);
-            while (*s) {
-                int64_t sz = sparse_file_len(*s, true, false);
-                sparse_files.emplace_back(*s, sz);
-                ++s;
-            }
-
-            for (size_t i = 0; i < sparse_files.size(); ++i) {
-                const auto& pair = sparse_files[i];
-                fb->FlashPartition(partition, pair.first, pair.second, i + 1, sparse_files.size());
+            // Counting the pieces only walks the chunk list; each piece is then split off and
+            // sent in turn rather than building all of them before the first download.
+            sparse_file* s = reinterpret_cast<sparse_file*>(buf->data);
+            unsigned int limit = buf->sparse_limit;
+            SparseFlash flash{partition, sparse_file_resparse(s, limit, nullptr, 0)};
+            if (flash.total < 0 ||
+                sparse_file_resparse_foreach(s, limit, flash_sparse_piece, &flash) < 0) {
+                die("Failed to resparse");
             }
             break;
         }
@@ -1753,6 +1759,93 @@ static void do_wipe_super(const std::string& image, const std::string& slot_over
     }
 }
 
+#if !defined(_WIN32)
+// Forks a child per serial to run the commands against that device. In the parent, passes on the
+// children's output with each line prefixed by its device's serial, then prints how each device
+// did and returns true with |status| set to the overall exit status. Returns false in the
+// children, which carry on with |serial| set to their device.
+//
+// The children read the same images, so after the first one the reads come from the page cache.
+static bool fork_per_device(const std::vector<std::string>& serials, int* status) {
+    struct Device {
+        const std::string* serial;
+        pid_t pid;
+        unique_fd output;
+        std::string line;
+    };
+    std::vector<Device> devices;
+    for (const std::string& device_serial : serials) {
+        unique_fd read_end, write_end;
+        if (!android::base::Pipe(&read_end, &write_end)) die("pipe failed: %s", strerror(errno));
+
+        fflush(stdout);
+        fflush(stderr);
+        pid_t pid = fork();
+        if (pid == -1) die("fork failed: %s", strerror(errno));
+        if (pid == 0) {
+            dup2(write_end.get(), STDOUT_FILENO);
+            dup2(write_end.get(), STDERR_FILENO);
+            setvbuf(stdout, nullptr, _IOLBF, 0);
+            serial = device_serial.c_str();
+            return false;
+        }
+        devices.push_back({&device_serial, pid, std::move(read_end), {}});
+    }
+
+    auto print_line = [](const Device& device) {
+        fprintf(stderr, "[%s] %s\n", device.serial->c_str(), device.line.c_str());
+    };
+
+    size_t open_outputs = devices.size();
+    while (open_outputs > 0) {
+        std::vector<pollfd> pfds;
+        for (const Device& device : devices) {
+            pfds.push_back({.fd = device.output.get(), .events = POLLIN, .revents = 0});
+        }
+        if (poll(pfds.data(), pfds.size(), -1) == -1) {
+            if (errno == EINTR) continue;
+            die("poll failed: %s", strerror(errno));
+        }
+
+        for (size_t i = 0; i < devices.size(); ++i) {
+            Device& device = devices[i];
+            if (device.output == -1 || !(pfds[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+                continue;
+            }
+
+            char buf[4096];
+            ssize_t n = TEMP_FAILURE_RETRY(read(device.output.get(), buf, sizeof(buf)));
+            if (n <= 0) {
+                if (!device.line.empty()) print_line(device);
+                device.output.reset();
+                --open_outputs;
+                continue;
+            }
+            for (ssize_t j = 0; j < n; ++j) {
+                if (buf[j] == '\n') {
+                    print_line(device);
+                    device.line.clear();
+                } else {
+                    device.line += buf[j];
+                }
+            }
+        }
+    }
+
+    *status = 0;
+    for (const Device& device : devices) {
+        int child_status;
+        if (TEMP_FAILURE_RETRY(waitpid(device.pid, &child_status, 0)) == -1) {
+            child_status = -1;
+        }
+        bool ok = WIFEXITED(child_status) && WEXITSTATUS(child_status) == 0;
+        fprintf(stderr, "%-22s %s\n", device.serial->c_str(), ok ? "OKAY" : "FAILED");
+        if (!ok) *status = 1;
+    }
+    return true;
+}
+#endif
+
 int FastBootTool::Main(int argc, char* argv[]) {
     bool wants_wipe = false;
     bool wants_reboot = false;
@@ -1767,6 +1860,7 @@ int FastBootTool::Main(int argc, char* argv[]) {
     int longindex;
     std::string slot_override;
     std::string next_active;
+    std::vector<std::string> serials;
 
     g_boot_img_hdr.kernel_addr = 0x00008000;
     g_boot_img_hdr.ramdisk_addr = 0x01000000;
@@ -1873,6 +1967,7 @@ int FastBootTool::Main(int argc, char* argv[]) {
                     break;
                 case 's':
                     serial = optarg;
+                    serials.push_back(optarg);
                     break;
                 case 'S':
                     if (!android::base::ParseByteCount(optarg, &sparse_limit)) {
@@ -1907,6 +2002,15 @@ int FastBootTool::Main(int argc, char* argv[]) {
         return show_help();
     }
 
+    if (serials.size() > 1) {
+#if defined(_WIN32)
+        die("running on several devices at once isn't supported on Windows");
+#else
+        int status;
+        if (fork_per_device(serials, &status)) return status;
+#endif
+    }
+
     Transport* transport = open_device();
     if (transport == nullptr) {
         return 1;
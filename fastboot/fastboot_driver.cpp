@@ -35,16 +35,22 @@
 #include <string.h>
 #include <algorithm>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <memory>
+#include <mutex>
 #include <regex>
+#include <thread>
 #include <vector>
 
+#include <android-base/endian.h>
 #include <android-base/file.h>
 #include <android-base/mapped_file.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <android-base/unique_fd.h>
+#include <lz4.h>
 
 #include "constants.h"
 #include "transport.h"
@@ -141,6 +147,15 @@ RetCode FastBootDriver::FlashPartition(const std::string& partition,
 }
 
 RetCode FastBootDriver::FlashPartition(const std::string& partition, int fd, uint32_t size) {
+    if (UseFlashStream()) {
+        prolog_(StringPrintf("Flashing '%s' (%u KB)", partition.c_str(), size / 1024));
+        auto result = FlashStream(partition, size, [this, fd, size](bool compressed) {
+            return SendBuffer(fd, size, compressed);
+        });
+        epilog_(result);
+        return result;
+    }
+
     RetCode ret;
     if ((ret = Download(partition, fd, size))) {
         return ret;
@@ -150,6 +165,23 @@ RetCode FastBootDriver::FlashPartition(const std::string& partition, int fd, uin
 
 RetCode FastBootDriver::FlashPartition(const std::string& partition, sparse_file* s, uint32_t size,
                                        size_t current, size_t total) {
+    if (UseFlashStream()) {
+        prolog_(StringPrintf("Flashing sparse '%s' %zu/%zu (%u KB)", partition.c_str(), current,
+                             total, size / 1024));
+        int64_t len = sparse_file_len(s, true, false);
+        RetCode result;
+        if (len <= 0 || len > std::numeric_limits<uint32_t>::max()) {
+            error_ = "Sparse file is too large or invalid";
+            result = BAD_ARG;
+        } else {
+            result = FlashStream(partition, len, [this, s](bool compressed) {
+                return SendSparse(s, false, compressed);
+            });
+        }
+        epilog_(result);
+        return result;
+    }
+
     RetCode ret;
     if ((ret = Download(partition, s, size, current, total, false))) {
         return ret;
@@ -195,13 +227,14 @@ RetCode FastBootDriver::Download(int fd, size_t size, std::string* response,
         return BAD_ARG;
     }
 
+    bool compressed = UseCompression();
     uint32_t u32size = static_cast<uint32_t>(size);
-    if ((ret = DownloadCommand(u32size, response, info))) {
+    if ((ret = DownloadCommand(u32size, response, info, compressed))) {
         return ret;
     }
 
     // Write the buffer
-    if ((ret = SendBuffer(fd, size))) {
+    if ((ret = SendBuffer(fd, size, compressed))) {
         return ret;
     }
 
@@ -226,12 +259,13 @@ RetCode FastBootDriver::Download(const std::vector<char>& buf, std::string* resp
         return BAD_ARG;
     }
 
-    if ((ret = DownloadCommand(buf.size(), response, info))) {
+    bool compressed = UseCompression();
+    if ((ret = DownloadCommand(buf.size(), response, info, compressed))) {
         return ret;
     }
 
     // Write the buffer
-    if ((ret = SendBuffer(buf))) {
+    if ((ret = compressed ? SendCompressed(buf.data(), buf.size()) : SendBuffer(buf))) {
         return ret;
     }
 
@@ -259,30 +293,13 @@ RetCode FastBootDriver::Download(sparse_file* s, bool use_crc, std::string* resp
     }
 
     RetCode ret;
+    bool compressed = UseCompression();
     uint32_t u32size = static_cast<uint32_t>(size);
-    if ((ret = DownloadCommand(u32size, response, info))) {
+    if ((ret = DownloadCommand(u32size, response, info, compressed))) {
         return ret;
     }
 
-    struct SparseCBPrivate {
-        FastBootDriver* self;
-        std::vector<char> tpbuf;
-    } cb_priv;
-    cb_priv.self = this;
-
-    auto cb = [](void* priv, const void* buf, size_t len) -> int {
-        SparseCBPrivate* data = static_cast<SparseCBPrivate*>(priv);
-        const char* cbuf = static_cast<const char*>(buf);
-        return data->self->SparseWriteCallback(data->tpbuf, cbuf, len);
-    };
-
-    if (sparse_file_callback(s, true, use_crc, cb, &cb_priv) < 0) {
-        error_ = "Error reading sparse file";
-        return IO_ERROR;
-    }
-
-    // Now flush
-    if (cb_priv.tpbuf.size() && (ret = SendBuffer(cb_priv.tpbuf))) {
+    if ((ret = SendSparse(s, use_crc, compressed))) {
         return ret;
     }
 
@@ -400,8 +417,12 @@ RetCode FastBootDriver::RawCommand(const std::string& cmd, std::string* response
 }
 
 RetCode FastBootDriver::DownloadCommand(uint32_t size, std::string* response,
-                                        std::vector<std::string>* info) {
-    std::string cmd(android::base::StringPrintf("%s:%08" PRIx32, FB_CMD_DOWNLOAD, size));
+                                        std::vector<std::string>* info, bool compressed) {
+    std::string cmd(compressed ? android::base::StringPrintf("%s:%s:%08" PRIx32,
+                                                             FB_CMD_DOWNLOAD_COMPRESSED,
+                                                             FB_COMPRESSION_LZ4, size)
+                               : android::base::StringPrintf("%s:%08" PRIx32, FB_CMD_DOWNLOAD,
+                                                             size));
     RetCode ret;
     if ((ret = RawCommand(cmd, response, info))) {
         return ret;
@@ -409,6 +430,23 @@ RetCode FastBootDriver::DownloadCommand(uint32_t size, std::string* response,
     return SUCCESS;
 }
 
+RetCode FastBootDriver::FlashStream(const std::string& partition, uint32_t size,
+                                    const std::function<RetCode(bool compressed)>& send) {
+    error_ = "";
+    bool compressed = UseCompression();
+    std::string cmd = android::base::StringPrintf("%s:%s:%08" PRIx32, FB_CMD_FLASH_STREAM,
+                                                  partition.c_str(), size);
+    if (compressed) {
+        cmd += ":" FB_COMPRESSION_LZ4;
+    }
+
+    RetCode ret;
+    if ((ret = RawCommand(cmd)) || (ret = send(compressed))) {
+        return ret;
+    }
+    return HandleResponse();
+}
+
 RetCode FastBootDriver::HandleResponse(std::string* response, std::vector<std::string>* info,
                                        int* dsize) {
     char status[FB_RESPONSE_SZ + 1];
@@ -473,7 +511,7 @@ std::string FastBootDriver::ErrnoStr(const std::string& msg) {
 }
 
 /******************************* PRIVATE **************************************/
-RetCode FastBootDriver::SendBuffer(int fd, size_t size) {
+RetCode FastBootDriver::SendBuffer(int fd, size_t size, bool compressed) {
     static constexpr uint32_t MAX_MAP_SIZE = 512 * 1024 * 1024;
     off64_t offset = 0;
     uint32_t remaining = size;
@@ -488,7 +526,8 @@ RetCode FastBootDriver::SendBuffer(int fd, size_t size) {
             return IO_ERROR;
         }
 
-        if ((ret = SendBuffer(mapping->data(), mapping->size()))) {
+        if ((ret = compressed ? SendCompressed(mapping->data(), mapping->size())
+                              : SendBuffer(mapping->data(), mapping->size()))) {
             return ret;
         }
 
@@ -544,40 +583,192 @@ RetCode FastBootDriver::ReadBuffer(void* buf, size_t size) {
     return SUCCESS;
 }
 
-int FastBootDriver::SparseWriteCallback(std::vector<char>& tpbuf, const char* data, size_t len) {
-    size_t total = 0;
-    size_t to_write = std::min(TRANSPORT_CHUNK_SIZE - tpbuf.size(), len);
-
-    // Handle the residual
-    tpbuf.insert(tpbuf.end(), data, data + to_write);
-    if (tpbuf.size() < TRANSPORT_CHUNK_SIZE) {  // Nothing enough to send rn
+// Compresses one block of a compressed download into |out|, returning its size, or 0 if the block
+// is better sent as it is.
+static size_t CompressBlock(const char* data, size_t size, std::vector<char>* out) {
+    out->resize(LZ4_compressBound(size));
+    int compressed_size = LZ4_compress_default(data, out->data(), size, out->size());
+    if (compressed_size <= 0 || static_cast<size_t>(compressed_size) >= size) {
         return 0;
     }
+    return compressed_size;
+}
+
+bool FastBootDriver::UseCompression() {
+    if (!use_compression_) {
+        std::string algorithms;
+        use_compression_ = false;
+        if (!disable_checks_ && GetVar(FB_VAR_DOWNLOAD_COMPRESSION, &algorithms) == SUCCESS) {
+            auto supported = android::base::Split(algorithms, ",");
+            use_compression_ = std::find(supported.begin(), supported.end(),
+                                         FB_COMPRESSION_LZ4) != supported.end();
+        }
+        error_ = "";
+    }
+    return *use_compression_;
+}
+
+bool FastBootDriver::UseFlashStream() {
+    if (!use_flash_stream_) {
+        std::string value;
+        use_flash_stream_ = !disable_checks_ &&
+                            GetVar(FB_VAR_FLASH_STREAM, &value) == SUCCESS && value == "yes";
+        error_ = "";
+    }
+    return *use_flash_stream_;
+}
+
+RetCode FastBootDriver::SendCompressedBlock(const char* data, size_t size,
+                                            const std::vector<char>& compressed,
+                                            size_t compressed_size) {
+    uint32_t header[2] = {htole32(compressed_size ? compressed_size : size), htole32(size)};
+    RetCode ret;
+    if ((ret = SendBuffer(header, sizeof(header)))) {
+        return ret;
+    }
+    return compressed_size ? SendBuffer(compressed.data(), compressed_size)
+                           : SendBuffer(data, size);
+}
 
-    if (SendBuffer(tpbuf)) {
-        error_ = ErrnoStr("Send failed in SparseWriteCallback()");
-        return -1;
+RetCode FastBootDriver::SendCompressed(const char* data, size_t size) {
+    std::vector<char> compressed;
+    while (size > 0) {
+        size_t block_size = std::min<size_t>(size, FB_COMPRESSED_BLOCK_SZ);
+        size_t compressed_size = CompressBlock(data, block_size, &compressed);
+        RetCode ret;
+        if ((ret = SendCompressedBlock(data, block_size, compressed, compressed_size))) {
+            return ret;
+        }
+        data += block_size;
+        size -= block_size;
     }
-    tpbuf.clear();
-    total += to_write;
+    return SUCCESS;
+}
 
-    // Now we need to send a multiple of chunk size
-    size_t nchunks = (len - total) / TRANSPORT_CHUNK_SIZE;
-    size_t nbytes = TRANSPORT_CHUNK_SIZE * nchunks;
-    if (nbytes && SendBuffer(data + total, nbytes)) {  // Don't send a ZLP
-        error_ = ErrnoStr("Send failed in SparseWriteCallback()");
-        return -1;
+// Sparse images are sent through a small pool of buffers: a thread walks the sparse file (reading
+// the backing files, building chunk headers and CRCs) and fills them, compressing each one if
+// |compressed|, while this one sends them, so preparing the next part of the image overlaps with
+// the transfer of the previous one.
+RetCode FastBootDriver::SendSparse(sparse_file* s, bool use_crc, bool compressed) {
+    static constexpr size_t kBufferSize = FB_COMPRESSED_BLOCK_SZ;
+    static constexpr size_t kBufferCount = 4;
+    // Anything but the last write has to be whole chunks, so no ZLP is sent.
+    static_assert(kBufferSize % TRANSPORT_CHUNK_SIZE == 0);
+
+    struct Buffer {
+        std::vector<char> data;
+        std::vector<char> compressed;
+        size_t compressed_size = 0;
+    };
+    struct SparsePipeline {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::vector<Buffer> free;
+        std::deque<Buffer> ready;
+        Buffer current;
+        bool compress = false;
+        bool done = false;
+        bool cancelled = false;
+
+        void PushCurrent() {
+            if (compress) {
+                current.compressed_size = CompressBlock(current.data.data(), current.data.size(),
+                                                        &current.compressed);
+            }
+            std::lock_guard lock(mutex);
+            ready.push_back(std::move(current));
+            current = {};
+            cv.notify_all();
+        }
+    } pipeline;
+    pipeline.compress = compressed;
+    for (size_t i = 0; i < kBufferCount; ++i) {
+        pipeline.free.emplace_back().data.reserve(kBufferSize);
     }
-    total += nbytes;
 
-    if (len - total > 0) {  // We have residual data to save for next time
-        tpbuf.assign(data + total, data + len);
+    auto cb = [](void* priv, const void* buf, size_t len) -> int {
+        SparsePipeline* pipeline = static_cast<SparsePipeline*>(priv);
+        const char* data = static_cast<const char*>(buf);
+        while (len > 0) {
+            if (pipeline->current.data.capacity() == 0) {
+                std::unique_lock lock(pipeline->mutex);
+                pipeline->cv.wait(lock, [&] {
+                    return !pipeline->free.empty() || pipeline->cancelled;
+                });
+                if (pipeline->cancelled) {
+                    return -1;
+                }
+                pipeline->current = std::move(pipeline->free.back());
+                pipeline->free.pop_back();
+            }
+
+            auto& current = pipeline->current.data;
+            size_t to_copy = std::min(kBufferSize - current.size(), len);
+            current.insert(current.end(), data, data + to_copy);
+            data += to_copy;
+            len -= to_copy;
+
+            if (current.size() == kBufferSize) {
+                pipeline->PushCurrent();
+            }
+        }
+        return 0;
+    };
+
+    bool read_failed = false;
+    std::thread reader([&] {
+        read_failed = sparse_file_callback(s, true, use_crc, cb, &pipeline) < 0;
+        if (!pipeline.current.data.empty()) {
+            pipeline.PushCurrent();
+        }
+        std::lock_guard lock(pipeline.mutex);
+        pipeline.done = true;
+        pipeline.cv.notify_all();
+    });
+
+    RetCode ret = SUCCESS;
+    while (true) {
+        Buffer buf;
+        {
+            std::unique_lock lock(pipeline.mutex);
+            pipeline.cv.wait(lock, [&] { return !pipeline.ready.empty() || pipeline.done; });
+            if (pipeline.ready.empty()) {
+                break;
+            }
+            buf = std::move(pipeline.ready.front());
+            pipeline.ready.pop_front();
+        }
+
+        if ((ret = compressed ? SendCompressedBlock(buf.data.data(), buf.data.size(),
+                                                    buf.compressed, buf.compressed_size)
+                              : SendBuffer(buf.data))) {
+            std::lock_guard lock(pipeline.mutex);
+            pipeline.cancelled = true;
+            pipeline.cv.notify_all();
+            break;
+        }
+
+        buf.data.clear();
+        std::lock_guard lock(pipeline.mutex);
+        pipeline.free.push_back(std::move(buf));
+        pipeline.cv.notify_all();
     }
+    reader.join();
 
-    return 0;
+    if (ret) {
+        return ret;
+    }
+    if (read_failed) {
+        error_ = "Error reading sparse file";
+        return IO_ERROR;
+    }
+    return SUCCESS;
 }
 
 Transport* FastBootDriver::set_transport(Transport* transport) {
+    // The new transport may well be a different fastboot implementation.
+    use_compression_.reset();
+    use_flash_stream_.reset();
     std::swap(transport_, transport);
     return transport;
 }
@@ -29,6 +29,7 @@
 #include <cstdlib>
 #include <deque>
 #include <limits>
+#include <optional>
 #include <string>
 #include <vector>
 
@@ -136,7 +137,10 @@ class FastBootDriver {
 
   protected:
     RetCode DownloadCommand(uint32_t size, std::string* response = nullptr,
-                            std::vector<std::string>* info = nullptr);
+                            std::vector<std::string>* info = nullptr, bool compressed = false);
+    // Sends |size| bytes with |send| straight into |partition|, without a separate download.
+    RetCode FlashStream(const std::string& partition, uint32_t size,
+                        const std::function<RetCode(bool compressed)>& send);
     RetCode HandleResponse(std::string* response = nullptr,
                            std::vector<std::string>* info = nullptr, int* dsize = nullptr);
 
@@ -145,7 +149,7 @@ class FastBootDriver {
     Transport* transport_;
 
   private:
-    RetCode SendBuffer(int fd, size_t size);
+    RetCode SendBuffer(int fd, size_t size, bool compressed = false);
     RetCode SendBuffer(const std::vector<char>& buf);
     RetCode SendBuffer(const void* buf, size_t size);
 
@@ -155,13 +159,24 @@ class FastBootDriver {
     RetCode UploadInner(const std::string& outfile, std::string* response = nullptr,
                         std::vector<std::string>* info = nullptr);
 
-    int SparseWriteCallback(std::vector<char>& tpbuf, const char* data, size_t len);
+    RetCode SendSparse(sparse_file* s, bool use_crc, bool compressed);
+    // Sends |size| bytes at |data| as the blocks of a compressed download.
+    RetCode SendCompressed(const char* data, size_t size);
+    RetCode SendCompressedBlock(const char* data, size_t size, const std::vector<char>& compressed,
+                                size_t compressed_size);
+
+    // Whether the device accepts compressed downloads; asked once, on the first download.
+    bool UseCompression();
+    // Whether the device can flash images as they are sent, through "flash-stream".
+    bool UseFlashStream();
 
     std::string error_;
     std::function<void(const std::string&)> prolog_;
     std::function<void(int)> epilog_;
     std::function<void(const std::string&)> info_;
     bool disable_checks_;
+    std::optional<bool> use_compression_;
+    std::optional<bool> use_flash_stream_;
 };
 
 }  // namespace fastboot
@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+// Benchmarks for download throughput, command latency and flash bandwidth, over whichever
+// transport the device is connected with. They only run when --benchmark_output is given, and
+// their results are written there as JSON so they can be compared across releases.
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <gtest/gtest.h>
+#include <sparse/sparse.h>
+
+#include "fastboot_driver.h"
+
+#include "benchmarks.h"
+#include "fixtures.h"
+#include "test_utils.h"
+
+namespace fastboot {
+
+std::string BENCHMARK_OUTPUT;
+std::vector<std::pair<std::string, extension::Configuration::PartitionInfo>> BENCHMARK_PARTITION;
+
+namespace {
+
+// Download sizes, up to the device's max-download-size. Each is repeated until at least
+// kDownloadBytesPerSize has been sent.
+const std::vector<int64_t> kDownloadSizes = {4 * 1024, 64 * 1024, 1024 * 1024, 16 * 1024 * 1024,
+                                             64 * 1024 * 1024};
+constexpr int64_t kDownloadBytesPerSize = 64 * 1024 * 1024;
+constexpr int kLatencyIterations = 50;
+constexpr int64_t kMaxFlashBytes = 64 * 1024 * 1024;
+constexpr unsigned kSparseBlockSize = 4096;
+
+std::string JsonString(const std::string& s) {
+    std::string ret = "\"";
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            ret += '\\';
+            ret += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            ret += android::base::StringPrintf("\\u%04x", c);
+        } else {
+            ret += c;
+        }
+    }
+    return ret + "\"";
+}
+
+// A JSON object of measurements, in the order they were added.
+class Result {
+  public:
+    explicit Result(const std::string& benchmark) { Add("benchmark", benchmark); }
+
+    Result& Add(const std::string& key, const std::string& value) {
+        fields_.emplace_back(key, JsonString(value));
+        return *this;
+    }
+    Result& Add(const std::string& key, double value) {
+        fields_.emplace_back(key, android::base::StringPrintf("%.6g", value));
+        return *this;
+    }
+
+    std::string ToJson() const {
+        std::vector<std::string> fields;
+        for (const auto& [key, value] : fields_) {
+            fields.push_back(JsonString(key) + ": " + value);
+        }
+        return "{" + android::base::Join(fields, ", ") + "}";
+    }
+
+  private:
+    std::vector<std::pair<std::string, std::string>> fields_;
+};
+
+std::vector<Result> results;
+// The getvars identifying the device, read by the first benchmark that runs.
+std::vector<std::pair<std::string, std::string>> device_info;
+
+double SecondsSince(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+std::string TransportName() {
+    if (FastBootTest::IsFastbootOverTcp()) return "tcp";
+    if (FastBootTest::IsFastbootOverUdp()) return "udp";
+    return "usb";
+}
+
+void RecordDeviceInfo(FastBootDriver* fb) {
+    if (!device_info.empty()) {
+        return;
+    }
+    for (const char* var : {"product", "version-bootloader", "version-baseband", "is-userspace",
+                            "max-download-size"}) {
+        std::string value;
+        // Not every device has all of these.
+        fb->GetVar(var, &value);
+        device_info.emplace_back(var, value);
+    }
+}
+
+// Adds the minimum, median, 95th percentile and maximum of |ms| to |result|.
+void AddLatencies(std::vector<double> ms, Result* result) {
+    std::sort(ms.begin(), ms.end());
+    result->Add("iterations", ms.size())
+            .Add("min_ms", ms.front())
+            .Add("median_ms", ms[ms.size() / 2])
+            .Add("p95_ms", ms[ms.size() * 95 / 100])
+            .Add("max_ms", ms.back());
+}
+
+}  // namespace
+
+void Performance::SetUp() {
+    if (BENCHMARK_OUTPUT.empty()) {
+        GTEST_SKIP() << "Benchmarks only run with --benchmark_output";
+    }
+    ASSERT_NO_FATAL_FAILURE(ModeTest<true>::SetUp());
+    RecordDeviceInfo(fb.get());
+}
+
+void Performance::TearDown() {
+    if (fb) {
+        ModeTest<true>::TearDown();
+    }
+}
+
+void FlashPerformance::SetUp() {
+    if (BENCHMARK_OUTPUT.empty()) {
+        GTEST_SKIP() << "Benchmarks only run with --benchmark_output";
+    }
+    ASSERT_NO_FATAL_FAILURE(ExtensionsPartition<true>::SetUp());
+    RecordDeviceInfo(fb.get());
+}
+
+void FlashPerformance::TearDown() {
+    if (fb) {
+        ExtensionsPartition<true>::TearDown();
+    }
+}
+
+TEST_F(Performance, CommandLatency) {
+    for (const std::string var : {"product", "max-download-size"}) {
+        std::vector<double> ms;
+        for (int i = 0; i < kLatencyIterations; i++) {
+            std::string value;
+            auto start = std::chrono::steady_clock::now();
+            ASSERT_EQ(fb->GetVar(var, &value), SUCCESS) << "getvar:" << var << " failed";
+            ms.push_back(SecondsSince(start) * 1000);
+        }
+        Result result("latency");
+        result.Add("command", "getvar:" + var);
+        AddLatencies(ms, &result);
+        results.push_back(result);
+    }
+}
+
+TEST_F(Performance, DownloadThroughput) {
+    std::string var;
+    ASSERT_EQ(fb->GetVar("max-download-size", &var), SUCCESS) << "getvar:max-download-size failed";
+    int64_t max_dl = strtoll(var.c_str(), nullptr, 16);
+    ASSERT_GT(max_dl, 0) << "Max download size reported was invalid";
+
+    for (int64_t size : kDownloadSizes) {
+        if (size > max_dl) {
+            break;
+        }
+        std::vector<char> buf = RandomBuf(size);
+        int64_t iterations = std::max<int64_t>(1, kDownloadBytesPerSize / size);
+
+        auto start = std::chrono::steady_clock::now();
+        for (int64_t i = 0; i < iterations; i++) {
+            ASSERT_EQ(fb->Download(buf), SUCCESS) << "Downloading " << size << " bytes failed";
+        }
+        double seconds = SecondsSince(start);
+        results.push_back(Result("download")
+                                  .Add("format", "raw")
+                                  .Add("chunk_bytes", size)
+                                  .Add("iterations", iterations)
+                                  .Add("seconds", seconds)
+                                  .Add("mb_per_s", size * iterations / seconds / 1e6));
+
+        // The same data as a sparse image.
+        SparseWrapper sparse(kSparseBlockSize, size);
+        ASSERT_TRUE(*sparse) << "Sparse file creation failed";
+        ASSERT_EQ(sparse_file_add_data(*sparse, buf.data(), size, 0), 0)
+                << "Adding data to sparse file failed";
+        start = std::chrono::steady_clock::now();
+        for (int64_t i = 0; i < iterations; i++) {
+            ASSERT_EQ(fb->Download(*sparse), SUCCESS) << "Downloading sparse failed: "
+                                                      << sparse.Rep();
+        }
+        seconds = SecondsSince(start);
+        results.push_back(Result("download")
+                                  .Add("format", "sparse")
+                                  .Add("chunk_bytes", size)
+                                  .Add("iterations", iterations)
+                                  .Add("seconds", seconds)
+                                  .Add("mb_per_s", size * iterations / seconds / 1e6));
+    }
+}
+
+TEST_P(FlashPerformance, FlashAndErase) {
+    const std::string& part = real_parts.front();
+    int64_t size = std::min(max_flash, kMaxFlashBytes) / kSparseBlockSize * kSparseBlockSize;
+    ASSERT_GT(size, 0) << "Partition '" << part << "' is too small to benchmark";
+    std::vector<char> buf = RandomBuf(size);
+
+    // Times downloading with |download| then flashing, which is the device writing the data.
+    auto flash = [&](const std::string& format, const std::function<RetCode()>& download) {
+        auto start = std::chrono::steady_clock::now();
+        ASSERT_EQ(download(), SUCCESS) << "Downloading " << format << " image failed";
+        double download_seconds = SecondsSince(start);
+        start = std::chrono::steady_clock::now();
+        ASSERT_EQ(fb->Flash(part), SUCCESS) << "Flashing " << format << " image failed";
+        double flash_seconds = SecondsSince(start);
+        results.push_back(Result("flash")
+                                  .Add("partition", part)
+                                  .Add("format", format)
+                                  .Add("bytes", size)
+                                  .Add("download_seconds", download_seconds)
+                                  .Add("flash_seconds", flash_seconds)
+                                  .Add("flash_mb_per_s", size / flash_seconds / 1e6));
+    };
+
+    ASSERT_NO_FATAL_FAILURE(flash("raw", [&]() { return fb->Download(buf); }));
+
+    SparseWrapper sparse(kSparseBlockSize, size);
+    ASSERT_TRUE(*sparse) << "Sparse file creation failed";
+    ASSERT_EQ(sparse_file_add_data(*sparse, buf.data(), size, 0), 0)
+            << "Adding data to sparse file failed";
+    ASSERT_NO_FATAL_FAILURE(flash("sparse", [&]() { return fb->Download(*sparse); }));
+
+    // A single fill chunk, so the time is all in the device.
+    SparseWrapper fill(kSparseBlockSize, size);
+    ASSERT_TRUE(*fill) << "Sparse file creation failed";
+    ASSERT_EQ(sparse_file_add_fill(*fill, 0xdeadbeef, size, 0), 0) << "Adding fill chunk failed";
+    ASSERT_NO_FATAL_FAILURE(flash("sparse_fill", [&]() { return fb->Download(*fill); }));
+
+    auto start = std::chrono::steady_clock::now();
+    ASSERT_EQ(fb->Erase(part), SUCCESS) << "Erasing '" << part << "' failed";
+    results.push_back(Result("erase").Add("partition", part).Add("seconds",
+                                                                 SecondsSince(start)));
+}
+
+INSTANTIATE_TEST_CASE_P(XMLBenchmark, FlashPerformance, ::testing::ValuesIn(BENCHMARK_PARTITION));
+
+bool WriteBenchmarkResults(std::string* error) {
+    std::vector<std::string> device;
+    for (const auto& [var, value] : device_info) {
+        device.push_back(JsonString(var) + ": " + JsonString(value));
+    }
+    std::vector<std::string> result_json;
+    for (const Result& result : results) {
+        result_json.push_back("    " + result.ToJson());
+    }
+
+    std::string json = "{\n";
+    json += "  \"transport\": " + JsonString(TransportName()) + ",\n";
+    json += "  \"device\": {" + android::base::Join(device, ", ") + "},\n";
+    json += "  \"results\": [\n" + android::base::Join(result_json, ",\n") + "\n  ]\n";
+    json += "}\n";
+    if (!android::base::WriteStringToFile(json, BENCHMARK_OUTPUT)) {
+        *error = "Writing benchmark results to '" + BENCHMARK_OUTPUT + "' failed";
+        return false;
+    }
+    return true;
+}
+
+}  // end namespace fastboot
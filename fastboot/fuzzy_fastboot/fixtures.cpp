@@ -50,6 +50,7 @@
 
 #include "fastboot_driver.h"
 #include "tcp.h"
+#include "udp.h"
 #include "usb.h"
 
 #include "extensions.h"
@@ -80,8 +81,16 @@ bool FastBootTest::IsFastbootOverTcp() {
     return android::base::StartsWith(device_serial, "tcp:");
 }
 
+bool FastBootTest::IsFastbootOverUdp() {
+    return android::base::StartsWith(device_serial, "udp:");
+}
+
+bool FastBootTest::IsFastbootOverNetwork() {
+    return IsFastbootOverTcp() || IsFastbootOverUdp();
+}
+
 bool FastBootTest::UsbStillAvailible() {
-    if (IsFastbootOverTcp()) return true;
+    if (IsFastbootOverNetwork()) return true;
 
     // For some reason someone decided to prefix the path with "usb:"
     std::string prefix("usb:");
@@ -121,8 +130,8 @@ void FastBootTest::SetUp() {
         ASSERT_TRUE(UsbStillAvailible());  // The device disconnected
     }
 
-    if (IsFastbootOverTcp()) {
-        ConnectTcpFastbootDevice();
+    if (IsFastbootOverNetwork()) {
+        ConnectNetworkFastbootDevice();
     } else {
         const auto matcher = [](usb_ifc_info* info) -> int {
             return MatchFastboot(info, device_serial);
@@ -166,7 +175,7 @@ void FastBootTest::TearDown() {
 
 // TODO, this should eventually be piped to a file instead of stdout
 void FastBootTest::TearDownSerial() {
-    if (IsFastbootOverTcp()) return;
+    if (IsFastbootOverNetwork()) return;
 
     if (!transport) return;
     // One last read from serial
@@ -181,13 +190,19 @@ void FastBootTest::TearDownSerial() {
     }
 }
 
-void FastBootTest::ConnectTcpFastbootDevice() {
+void FastBootTest::ConnectNetworkFastbootDevice() {
     for (int i = 0; i < MAX_TCP_TRIES && !transport; i++) {
         std::string error;
-        std::unique_ptr<Transport> tcp(
-                tcp::Connect(device_serial.substr(4), tcp::kDefaultPort, &error).release());
-        if (tcp)
-            transport = std::unique_ptr<TransportSniffer>(new TransportSniffer(std::move(tcp), 0));
+        std::unique_ptr<Transport> network;
+        if (IsFastbootOverUdp()) {
+            network = udp::Connect(device_serial.substr(4), udp::kDefaultPort, &error);
+        } else {
+            network.reset(
+                    tcp::Connect(device_serial.substr(4), tcp::kDefaultPort, &error).release());
+        }
+        if (network)
+            transport = std::unique_ptr<TransportSniffer>(
+                    new TransportSniffer(std::move(network), 0));
         if (transport != nullptr) break;
         std::this_thread::sleep_for(std::chrono::milliseconds(10));
     }
@@ -197,8 +212,8 @@ void FastBootTest::ReconnectFastbootDevice() {
     fb.reset();
     transport.reset();
 
-    if (IsFastbootOverTcp()) {
-        ConnectTcpFastbootDevice();
+    if (IsFastbootOverNetwork()) {
+        ConnectNetworkFastbootDevice();
         device_path = cb_scratch;
         fb = std::unique_ptr<FastBootDriver>(new FastBootDriver(transport.get(), {}, true));
         return;
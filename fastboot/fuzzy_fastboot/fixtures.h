@@ -49,10 +49,12 @@ class FastBootTest : public testing::Test {
 
     static int MatchFastboot(usb_ifc_info* info, const std::string& local_serial = "");
     static bool IsFastbootOverTcp();
+    static bool IsFastbootOverUdp();
+    static bool IsFastbootOverNetwork();
     bool UsbStillAvailible();
     bool UserSpaceFastboot();
     void ReconnectFastbootDevice();
-    void ConnectTcpFastbootDevice();
+    void ConnectNetworkFastbootDevice();
 
   protected:
     RetCode DownloadCommand(uint32_t size, std::string* response = nullptr,
@@ -143,4 +145,17 @@ class UserdataPartition : public ExtensionsPartition<true> {};
 
 class SparseTestPartition : public ExtensionsPartition<true> {};
 
+// The benchmarks are skipped unless --benchmark_output is given; see benchmarks.cpp.
+class Performance : public ModeTest<true> {
+  protected:
+    void SetUp() override;
+    void TearDown() override;
+};
+
+class FlashPerformance : public ExtensionsPartition<true> {
+  protected:
+    void SetUp() override;
+    void TearDown() override;
+};
+
 }  // end namespace fastboot
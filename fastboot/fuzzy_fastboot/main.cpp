@@ -51,6 +51,7 @@
 #include "fastboot_driver.h"
 #include "usb.h"
 
+#include "benchmarks.h"
 #include "extensions.h"
 #include "fixtures.h"
 #include "test_utils.h"
@@ -1697,6 +1698,10 @@ void GenerateXmlTests(const extension::Configuration& config) {
         SINGLE_PARTITION_XML_WRITE_HASHABLE.push_back(PARTITION_XML_WRITE_HASHABLE.front());
     }
 
+    if (!PARTITION_XML_WRITEABLE.empty()) {
+        BENCHMARK_PARTITION.push_back(PARTITION_XML_WRITEABLE.front());
+    }
+
     // Build oem tests
     for (const auto& it : config.oem) {
         auto oem_cmd = it.second;
@@ -1735,9 +1740,13 @@ int main(int argc, char** argv) {
         fastboot::FastBootTest::device_serial = args.at("serial");
     }
 
+    if (args.find("benchmark_output") != args.end()) {
+        fastboot::BENCHMARK_OUTPUT = args.at("benchmark_output");
+    }
+
     setbuf(stdout, NULL);  // no buffering
 
-    if (!fastboot::FastBootTest::IsFastbootOverTcp()) {
+    if (!fastboot::FastBootTest::IsFastbootOverNetwork()) {
         printf("<Waiting for Device>\n");
         const auto matcher = [](usb_ifc_info* info) -> int {
             return fastboot::FastBootTest::MatchFastboot(info, fastboot::FastBootTest::device_serial);
@@ -1759,5 +1768,11 @@ int main(int argc, char** argv) {
     if (fastboot::FastBootTest::serial_port > 0) {
         close(fastboot::FastBootTest::serial_port);
     }
+    if (!fastboot::BENCHMARK_OUTPUT.empty()) {
+        if (!fastboot::WriteBenchmarkResults(&err)) {
+            printf("%s\n", err.c_str());
+            return -1;
+        }
+    }
     return ret;
 }
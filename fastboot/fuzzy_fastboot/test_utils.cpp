@@ -90,13 +90,16 @@ std::unordered_map<std::string, std::string> ParseArgs(int argc, char** argv,
     // We ignore any gtest stuff
     std::unordered_map<std::string, std::string> ret;
 
-    for (int i = 1; i < argc - 1; i++) {
+    for (int i = 1; i < argc; i++) {
         std::string arg(argv[i]);
 
         const std::string gtest_start("--gtest");
+        // Help is left for gtest to print.
+        if (!arg.find("-h")) {
+            continue;
+        }
         // We found a non gtest argument
-        if (!arg.find("-h") ||
-            (!arg.find("--") && arg.find("--gtest") && arg.find("=") != arg.npos)) {
+        if (!arg.find("--") && arg.find("--gtest") && arg.find("=") != arg.npos) {
             const std::string start(arg.begin() + 2, arg.begin() + arg.find("="));
             const std::string end(arg.begin() + arg.find("=") + 1, arg.end());
             ret[start] = end;
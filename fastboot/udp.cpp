@@ -33,6 +33,8 @@
 #include <errno.h>
 #include <stdio.h>
 
+#include <algorithm>
+#include <deque>
 #include <list>
 #include <memory>
 #include <vector>
@@ -68,6 +70,7 @@ class Header {
     ~Header() = default;
 
     uint8_t id() const { return bytes_[kIndexId]; }
+    uint16_t sequence() const { return ExtractUint16(bytes_ + kIndexSeqH); }
     const uint8_t* bytes() const { return bytes_; }
 
     void Set(uint8_t id, uint16_t sequence, Flag flag);
@@ -131,9 +134,19 @@ class UdpTransport : public Transport {
                                    uint8_t* rx_data, size_t rx_length, int attempts,
                                    std::string* error);
 
+    // Helper for SendData() in windowed mode; sends all of |tx_data| as a run of continuation
+    // packets with up to |window_| of them unacknowledged at a time, and retransmits only the
+    // ones that weren't acknowledged. Returns the number of data bytes in the responses, or -1
+    // and fills |error| on failure.
+    ssize_t SendWindowedHelper(Id id, const uint8_t* tx_data, size_t tx_length, int attempts,
+                               std::string* error);
+
     std::unique_ptr<Socket> socket_;
     int sequence_ = -1;
     size_t max_data_length_ = kMinPacketSize - kHeaderSize;
+    // The number of packets that may be unacknowledged at once; 1 unless the device supports
+    // windowing.
+    size_t window_ = 1;
     std::vector<uint8_t> rx_packet_;
 
     DISALLOW_COPY_AND_ASSIGN(UdpTransport);
@@ -151,7 +164,7 @@ std::unique_ptr<UdpTransport> UdpTransport::NewTransport(std::unique_ptr<Socket>
 }
 
 bool UdpTransport::InitializeProtocol(std::string* error) {
-    uint8_t rx_data[4];
+    uint8_t rx_data[6];
 
     sequence_ = 0;
     rx_packet_.resize(kMinPacketSize);
@@ -184,7 +197,7 @@ bool UdpTransport::InitializeProtocol(std::string* error) {
     // The first two data bytes contain the version, the second two bytes contain the target max
     // supported packet size, which must be at least 512 bytes.
     uint16_t version = ExtractUint16(rx_data);
-    if (version < kProtocolVersion) {
+    if (version < kMinProtocolVersion) {
         *error = android::base::StringPrintf("target reported invalid protocol version %d",
                                              version);
         return false;
@@ -199,6 +212,13 @@ bool UdpTransport::InitializeProtocol(std::string* error) {
     max_data_length_ = packet_size - kHeaderSize;
     rx_packet_.resize(packet_size);
 
+    // Devices that support windowing follow those with the number of packets they can have
+    // unacknowledged.
+    window_ = 1;
+    if (std::min(version, kProtocolVersion) >= kWindowedProtocolVersion && rx_bytes >= 6) {
+        window_ = std::clamp<uint16_t>(ExtractUint16(rx_data + 4), 1, kHostMaxWindow);
+    }
+
     return true;
 }
 
@@ -211,6 +231,12 @@ ssize_t UdpTransport::SendData(Id id, const uint8_t* tx_data, size_t tx_length,
         return -1;
     }
 
+    // Writes that take more than one packet can keep several in flight if the device allows it.
+    // The device can only send data in response to an empty packet, so reads are never windowed.
+    if (window_ > 1 && tx_length > max_data_length_ && rx_length == 0) {
+        return SendWindowedHelper(id, tx_data, tx_length, attempts, error);
+    }
+
     Header header;
     size_t packet_data_length;
     ssize_t ret = 0;
@@ -325,6 +351,108 @@ ssize_t UdpTransport::SendSinglePacketHelper(
     return total_data_bytes;
 }
 
+ssize_t UdpTransport::SendWindowedHelper(Id id, const uint8_t* tx_data, size_t tx_length,
+                                         const int attempts, std::string* error) {
+    struct Packet {
+        Header header;
+        const uint8_t* data;
+        size_t length;
+        bool acked = false;
+        int attempts = 0;
+        int later_acks = 0;
+    };
+
+    auto send = [&](Packet* packet) {
+        packet->attempts++;
+        packet->later_acks = 0;
+        return socket_->Send({{packet->header.bytes(), kHeaderSize}, {packet->data,
+                                                                       packet->length}});
+    };
+
+    error->clear();
+    ssize_t total_data_bytes = 0;
+    // The unacknowledged packets, oldest first; acknowledged ones are only removed from the front.
+    std::deque<Packet> in_flight;
+    while (tx_length > 0 || !in_flight.empty()) {
+        while (tx_length > 0 && in_flight.size() < window_) {
+            Packet& packet = in_flight.emplace_back();
+            packet.data = tx_data;
+            packet.length = std::min(tx_length, max_data_length_);
+            tx_data += packet.length;
+            tx_length -= packet.length;
+            packet.header.Set(id, sequence_++, tx_length > 0 ? kFlagContinuation : kFlagNone);
+            if (!send(&packet)) {
+                *error = Socket::GetErrorMessage();
+                return -1;
+            }
+        }
+
+        ssize_t bytes = socket_->Receive(rx_packet_.data(), rx_packet_.size(), kResponseTimeoutMs);
+        if (bytes == -1) {
+            if (!socket_->ReceiveTimedOut()) {
+                *error = Socket::GetErrorMessage();
+                return -1;
+            }
+            // Nothing has arrived for a whole timeout, so everything still unacknowledged was
+            // sent at least that long ago.
+            for (Packet& packet : in_flight) {
+                if (packet.acked) {
+                    continue;
+                }
+                if (packet.attempts >= attempts) {
+                    *error = "no response from target";
+                    return -1;
+                }
+                if (!send(&packet)) {
+                    *error = Socket::GetErrorMessage();
+                    return -1;
+                }
+            }
+            continue;
+        } else if (bytes < static_cast<ssize_t>(kHeaderSize)) {
+            *error = "protocol error: incomplete header";
+            return -1;
+        }
+
+        // Responses to anything other than a packet in flight are old retransmissions.
+        uint16_t offset = ExtractUint16(&rx_packet_[kIndexSeqH]) -
+                          in_flight.front().header.sequence();
+        if (offset >= in_flight.size()) {
+            continue;
+        }
+        Packet& packet = in_flight[offset];
+        if (!packet.header.Matches(rx_packet_.data()) || packet.acked) {
+            continue;
+        }
+
+        if (rx_packet_[kIndexId] == kIdError) {
+            *error = "target reported error: " +
+                     std::string(rx_packet_.data() + kHeaderSize, rx_packet_.data() + bytes);
+            return -1;
+        }
+        packet.acked = true;
+        total_data_bytes += bytes - kHeaderSize;
+
+        // A packet that's still unacknowledged while several sent after it have been acknowledged
+        // was probably lost, so don't wait for the timeout to resend it.
+        for (size_t i = 0; i < offset; ++i) {
+            Packet& earlier = in_flight[i];
+            if (!earlier.acked && ++earlier.later_acks == kFastRetransmitAcks) {
+                if (!send(&earlier)) {
+                    *error = Socket::GetErrorMessage();
+                    return -1;
+                }
+            }
+        }
+
+        while (!in_flight.empty() && in_flight.front().acked) {
+            in_flight.pop_front();
+        }
+    }
+
+    return total_data_bytes;
+}
+
 ssize_t UdpTransport::Read(void* data, size_t length) {
     // Read from the target by sending an empty packet.
     std::string error;
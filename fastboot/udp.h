@@ -45,10 +45,19 @@ std::unique_ptr<Transport> Connect(const std::string& hostname, int port, std::s
 // Internal namespace for test use only.
 namespace internal {
 
-constexpr uint16_t kProtocolVersion = 1;
+// The host speaks version 2, which adds windowed writes, and falls back to version 1 for devices
+// that don't support it.
+constexpr uint16_t kProtocolVersion = 2;
+constexpr uint16_t kMinProtocolVersion = 1;
+constexpr uint16_t kWindowedProtocolVersion = 2;
 
-// This will be negotiated with the device so may end up being smaller.
+// These will be negotiated with the device so may end up being smaller.
 constexpr uint16_t kHostMaxPacketSize = 8192;
+constexpr uint16_t kHostMaxWindow = 64;
+
+// In windowed mode, an unacknowledged packet is retransmitted early once this many packets sent
+// after it have been acknowledged.
+constexpr int kFastRetransmitAcks = 3;
 
 // Retransmission constants. Retransmission timeout must be at least 500ms, and the host must
 // attempt to send packets for at least 1 minute once the device has connected. See
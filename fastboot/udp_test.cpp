@@ -16,6 +16,7 @@
 
 #include "udp.h"
 
+#include <android-base/strings.h>
 #include <gtest/gtest.h>
 
 #include "socket.h"
@@ -309,15 +310,22 @@ class UdpTest : public ::testing::Test {
     }
 
     // Sets up |mock_socket_| to correctly initialize the protocol and creates |transport_|. This
-    // can be called multiple times in a test if needed.
-    bool InitializeTransport(uint16_t starting_sequence, int device_max_packet_size = 512) {
+    // can be called multiple times in a test if needed. A non-zero |device_window| is sent after
+    // the packet size, as a device that supports windowing would.
+    bool InitializeTransport(uint16_t starting_sequence, int device_max_packet_size = 512,
+                             uint16_t device_window = 0,
+                             uint16_t device_version = kProtocolVersion) {
         mock_socket_ = new SocketMock;
         mock_socket_->ExpectSend(QueryPacket(0));
         mock_socket_->AddReceive(QueryPacket(0, starting_sequence));
         mock_socket_->ExpectSend(
                 InitPacket(starting_sequence, kProtocolVersion, kHostMaxPacketSize));
-        mock_socket_->AddReceive(
-                InitPacket(starting_sequence, kProtocolVersion, device_max_packet_size));
+        std::string init_response =
+                InitPacket(starting_sequence, device_version, device_max_packet_size);
+        if (device_window != 0) {
+            init_response += PacketValue(device_window);
+        }
+        mock_socket_->AddReceive(init_response);
 
         std::string error;
         transport_ = Connect(std::unique_ptr<Socket>(mock_socket_), &error);
@@ -522,6 +530,115 @@ TEST_F(UdpTest, ErrorResponse) {
     EXPECT_FALSE(Write("foo"));
 }
 
+// Returns |count| chunks of test data that each fill a 512-byte packet.
+static std::vector<std::string> WindowedChunks(size_t count) {
+    std::vector<std::string> chunks;
+    for (size_t i = 0; i < count; ++i) {
+        chunks.emplace_back(508, static_cast<char>('a' + i));
+    }
+    return chunks;
+}
+
+// Tests that a device that supports windowing gets several packets at once, and that a new packet
+// is sent as each of the oldest ones is acknowledged.
+TEST_F(UdpTest, WindowedWrite) {
+    ASSERT_TRUE(InitializeTransport(0, 512, 4));
+    std::vector<std::string> chunks = WindowedChunks(6);
+
+    for (int i = 0; i < 4; ++i) {
+        mock_socket_->ExpectSend(FastbootPacket(i + 1, chunks[i], kFlagContinuation));
+    }
+    mock_socket_->AddReceive(FastbootPacket(1));
+    mock_socket_->ExpectSend(FastbootPacket(5, chunks[4], kFlagContinuation));
+    mock_socket_->AddReceive(FastbootPacket(2));
+    mock_socket_->ExpectSend(FastbootPacket(6, chunks[5]));
+    for (int i = 3; i <= 6; ++i) {
+        mock_socket_->AddReceive(FastbootPacket(i));
+    }
+    EXPECT_TRUE(Write(android::base::Join(chunks, "")));
+
+    // Reads, and writes that fit in one packet, are still one packet at a time.
+    mock_socket_->ExpectSend(FastbootPacket(7));
+    mock_socket_->AddReceive(FastbootPacket(7, "foo", kFlagContinuation));
+    mock_socket_->ExpectSend(FastbootPacket(8));
+    mock_socket_->AddReceive(FastbootPacket(8, "bar"));
+    EXPECT_TRUE(Read("foobar"));
+}
+
+// Tests that a timeout only retransmits the packets that weren't acknowledged.
+TEST_F(UdpTest, WindowedTimeoutRetransmission) {
+    ASSERT_TRUE(InitializeTransport(0xFFFE, 512, 4));
+    std::vector<std::string> chunks = WindowedChunks(4);
+
+    for (int i = 0; i < 4; ++i) {
+        mock_socket_->ExpectSend(FastbootPacket(0xFFFF + i, chunks[i],
+                                                i < 3 ? kFlagContinuation : kFlagNone));
+    }
+    mock_socket_->AddReceive(FastbootPacket(0xFFFF));
+    mock_socket_->AddReceive(FastbootPacket(1));
+    mock_socket_->AddReceiveTimeout();
+    mock_socket_->ExpectSend(FastbootPacket(0, chunks[1], kFlagContinuation));
+    mock_socket_->ExpectSend(FastbootPacket(2, chunks[3]));
+    mock_socket_->AddReceive(FastbootPacket(2));
+    mock_socket_->AddReceive(FastbootPacket(0));
+    EXPECT_TRUE(Write(android::base::Join(chunks, "")));
+}
+
+// Tests that a packet is retransmitted without waiting for a timeout once enough of the packets
+// after it have been acknowledged.
+TEST_F(UdpTest, WindowedFastRetransmission) {
+    ASSERT_TRUE(InitializeTransport(0, 512, 4));
+    std::vector<std::string> chunks = WindowedChunks(5);
+
+    for (int i = 0; i < 4; ++i) {
+        mock_socket_->ExpectSend(FastbootPacket(i + 1, chunks[i], kFlagContinuation));
+    }
+    mock_socket_->AddReceive(FastbootPacket(2));
+    mock_socket_->AddReceive(FastbootPacket(3));
+    mock_socket_->AddReceive(FastbootPacket(4));
+    mock_socket_->ExpectSend(FastbootPacket(1, chunks[0], kFlagContinuation));
+    mock_socket_->AddReceive(FastbootPacket(1));
+    mock_socket_->ExpectSend(FastbootPacket(5, chunks[4]));
+    mock_socket_->AddReceive(FastbootPacket(5));
+    EXPECT_TRUE(Write(android::base::Join(chunks, "")));
+}
+
+// Tests that stale and duplicate acknowledgements are ignored, and that an error response to any
+// packet in flight fails the write.
+TEST_F(UdpTest, WindowedUnexpectedResponses) {
+    ASSERT_TRUE(InitializeTransport(0, 512, 4));
+    std::vector<std::string> chunks = WindowedChunks(2);
+
+    mock_socket_->ExpectSend(FastbootPacket(1, chunks[0], kFlagContinuation));
+    mock_socket_->ExpectSend(FastbootPacket(2, chunks[1]));
+    mock_socket_->AddReceive(FastbootPacket(0));
+    mock_socket_->AddReceive(FastbootPacket(9));
+    mock_socket_->AddReceive(QueryPacket(1));
+    mock_socket_->AddReceive(FastbootPacket(2));
+    mock_socket_->AddReceive(FastbootPacket(2));
+    mock_socket_->AddReceive(FastbootPacket(1));
+    EXPECT_TRUE(Write(android::base::Join(chunks, "")));
+
+    mock_socket_->ExpectSend(FastbootPacket(3, chunks[0], kFlagContinuation));
+    mock_socket_->ExpectSend(FastbootPacket(4, chunks[1]));
+    mock_socket_->AddReceive(FastbootPacket(3));
+    mock_socket_->AddReceive(ErrorPacket(4, "test error"));
+    EXPECT_FALSE(Write(android::base::Join(chunks, "")));
+}
+
+// Tests that packets are still sent one at a time to a version 1 device, even if it sends extra
+// data in its initialization response.
+TEST_F(UdpTest, WindowRequiresVersion2) {
+    ASSERT_TRUE(InitializeTransport(0, 512, 4, 1));
+    std::vector<std::string> chunks = WindowedChunks(2);
+
+    mock_socket_->ExpectSend(FastbootPacket(1, chunks[0], kFlagContinuation));
+    mock_socket_->AddReceive(FastbootPacket(1));
+    mock_socket_->ExpectSend(FastbootPacket(2, chunks[1]));
+    mock_socket_->AddReceive(FastbootPacket(2));
+    EXPECT_TRUE(Write(android::base::Join(chunks, "")));
+}
+
 // Tests that attempting to use a closed transport returns -1 without making any socket calls.
 TEST_F(UdpTest, CloseTransport) {
     char buffer[32];
@@ -45,6 +45,7 @@
 
 #include <android-base/chrono_utils.h>
 #include <android-base/file.h>
+#include <android-base/parseint.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
@@ -98,6 +99,7 @@
 using android::base::Basename;
 using android::base::GetBoolProperty;
 using android::base::GetUintProperty;
+using android::base::ParseUint;
 using android::base::Realpath;
 using android::base::SetProperty;
 using android::base::StartsWith;
@@ -726,10 +728,63 @@ bool fs_mgr_is_device_unlocked() {
     return false;
 }
 
+// Queues reads of a sparse sample of the data blocks of a dm-verity device: one for every hash
+// block of the second lowest hashtree level. Verifying them makes dm-verity read, and cache,
+// every hash block above the lowest level, so that the first real reads of the partition need
+// at most one hash block read of their own rather than a chain of dependent ones. The reads
+// are only queued, so this does not hold up the mount.
+static void PrefetchVerityHashtree(const std::string& blk_device) {
+    auto& dm = DeviceMapper::Instance();
+    auto name = dm.GetDmDeviceNameByPath(blk_device);
+    std::vector<DeviceMapper::TargetInfo> table;
+    if (!name || !dm.GetTableInfo(*name, &table) || table.size() != 1 ||
+        DeviceMapper::GetTargetType(table[0].spec) != "verity") {
+        LWARNING << "Not prefetching hashtree of " << blk_device << ": not a verity device";
+        return;
+    }
+
+    // <version> <data_dev> <hash_dev> <data_block_size> <hash_block_size> <num_data_blocks>
+    // <hash_start_block> <algorithm> <digest> <salt> [<optional args>]
+    auto args = android::base::Split(table[0].data, " ");
+    uint64_t data_block_size, hash_block_size, num_data_blocks;
+    if (args.size() < 8 || !ParseUint(args[3], &data_block_size) ||
+        !ParseUint(args[4], &hash_block_size) || !ParseUint(args[5], &num_data_blocks)) {
+        LERROR << "Could not parse verity table of " << blk_device << ": " << table[0].data;
+        return;
+    }
+    static const std::map<std::string, uint64_t> kDigestSizes = {
+            {"sha1", 20}, {"sha256", 32}, {"sha512", 64}};
+    auto digest_size = kDigestSizes.find(args[7]);
+    if (digest_size == kDigestSizes.end() || hash_block_size < digest_size->second) {
+        LWARNING << "Not prefetching hashtree of " << blk_device << ": unknown algorithm "
+                 << args[7];
+        return;
+    }
+
+    unique_fd fd(TEMP_FAILURE_RETRY(open(blk_device.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd < 0) {
+        PWARNING << "Not prefetching hashtree of " << blk_device;
+        return;
+    }
+    // dm-verity rounds the number of hashes per block down to a power of two.
+    uint64_t hashes = hash_block_size / digest_size->second;
+    uint64_t hashes_per_block = 1ULL << (63 - __builtin_clzll(hashes));
+    uint64_t stride = hashes_per_block * hashes_per_block;
+    for (uint64_t block = 0; block < num_data_blocks; block += stride) {
+        posix_fadvise(fd, block * data_block_size, data_block_size, POSIX_FADV_WILLNEED);
+    }
+    LINFO << "Prefetching hashtree of " << blk_device << " with "
+          << (num_data_blocks + stride - 1) / stride << " reads";
+}
+
 // __mount(): wrapper around the mount() system call which also
 // sets the underlying block device to read-only if the mount is read-only.
 // See "man 2 mount" for return values.
 static int __mount(const std::string& source, const std::string& target, const FstabEntry& entry) {
+    if (entry.fs_mgr_flags.prefetch_hashtree) {
+        PrefetchVerityHashtree(source);
+    }
+
     // We need this because sometimes we have legacy symlinks that are
     // lingering around and need cleaning up.
     struct stat info;
@@ -1969,20 +2024,10 @@ static bool PrepareZramBackingDevice(off64_t size) {
         return false;
     }
 
-    // Allocate loop device and attach it to file_path.
+    // Allocate loop device and attach it to file_path, with block size & direct IO set.
     LoopControl loop_control;
     std::string device;
-    if (!loop_control.Attach(target_fd.get(), 5s, &device)) {
-        return false;
-    }
-
-    // set block size & direct IO
-    unique_fd device_fd(TEMP_FAILURE_RETRY(open(device.c_str(), O_RDWR | O_CLOEXEC)));
-    if (device_fd.get() == -1) {
-        PERROR << "Cannot open " << device;
-        return false;
-    }
-    if (!LoopControl::EnableDirectIo(device_fd.get())) {
+    if (!loop_control.Attach(target_fd.get(), 5s, &device, /*direct_io=*/true)) {
         return false;
     }
 
@@ -21,10 +21,14 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mount.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <algorithm>
 #include <array>
+#include <map>
+#include <mutex>
+#include <optional>
 #include <utility>
 #include <vector>
 
@@ -179,6 +183,7 @@ void ParseFsMgrFlags(const std::string& flags, FstabEntry* entry) {
         CheckFlag("fsverity", fs_verity);
         CheckFlag("metadata_csum", ext_meta_csum);
         CheckFlag("wrappedkey", wrapped_key);
+        CheckFlag("prefetch_hashtree", prefetch_hashtree);
 
 #undef CheckFlag
 
@@ -509,6 +514,54 @@ err:
     return false;
 }
 
+bool IsSameFile(const struct stat& a, const struct stat& b) {
+    return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size &&
+           a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec &&
+           a.st_ctim.tv_sec == b.st_ctim.tv_sec && a.st_ctim.tv_nsec == b.st_ctim.tv_nsec;
+}
+
+// init, vold, remount and libsnapshot read the same fstab files many times over, so the parsed
+// contents are kept per path, and reused for as long as the file is unchanged.  Only the parsing
+// is cached: the adjustments that depend on other files (DSU, skip_mount.cfg) are made again on
+// every read.
+struct ParsedFstab {
+    struct stat st;
+    Fstab fstab;
+};
+
+std::mutex parsed_fstabs_lock;
+
+std::map<std::string, ParsedFstab>& ParsedFstabs() {
+    static auto& parsed_fstabs = *new std::map<std::string, ParsedFstab>;
+    return parsed_fstabs;
+}
+
+bool ReadFstabFileCached(const std::string& path, FILE* fstab_file, bool proc_mounts,
+                         Fstab* fstab_out) {
+    struct stat st;
+    // The timestamps of files in /proc say nothing about their contents.
+    if (StartsWith(path, "/proc/") || fstat(fileno(fstab_file), &st) == -1) {
+        return ReadFstabFile(fstab_file, proc_mounts, fstab_out);
+    }
+
+    {
+        std::lock_guard lock(parsed_fstabs_lock);
+        auto it = ParsedFstabs().find(path);
+        if (it != ParsedFstabs().end() && IsSameFile(it->second.st, st)) {
+            *fstab_out = it->second.fstab;
+            return true;
+        }
+    }
+
+    if (!ReadFstabFile(fstab_file, proc_mounts, fstab_out)) {
+        return false;
+    }
+
+    std::lock_guard lock(parsed_fstabs_lock);
+    ParsedFstabs()[path] = ParsedFstab{st, *fstab_out};
+    return true;
+}
+
 /* Extracts <device>s from the by-name symlinks specified in a fstab:
  *   /dev/block/<type>/<device>/by-name/<partition>
  *
@@ -681,7 +734,7 @@ bool ReadFstabFromFile(const std::string& path, Fstab* fstab) {
 
     bool is_proc_mounts = path == "/proc/mounts";
 
-    if (!ReadFstabFile(fstab_file.get(), is_proc_mounts, fstab)) {
+    if (!ReadFstabFileCached(path, fstab_file.get(), is_proc_mounts, fstab)) {
         LERROR << __FUNCTION__ << "(): failed to load fstab from : '" << path << "'";
         return false;
     }
@@ -701,27 +754,37 @@ bool ReadFstabFromFile(const std::string& path, Fstab* fstab) {
 
 // Returns fstab entries parsed from the device tree if they exist
 bool ReadFstabFromDt(Fstab* fstab, bool log) {
-    std::string fstab_buf = ReadFstabFromDt();
-    if (fstab_buf.empty()) {
-        if (log) LINFO << __FUNCTION__ << "(): failed to read fstab from dt";
-        return false;
-    }
-
-    std::unique_ptr<FILE, decltype(&fclose)> fstab_file(
-        fmemopen(static_cast<void*>(const_cast<char*>(fstab_buf.c_str())),
-                 fstab_buf.length(), "r"), fclose);
-    if (!fstab_file) {
-        if (log) PERROR << __FUNCTION__ << "(): failed to create a file stream for fstab dt";
-        return false;
-    }
-
-    if (!ReadFstabFile(fstab_file.get(), false, fstab)) {
-        if (log) {
-            LERROR << __FUNCTION__ << "(): failed to load fstab from kernel:" << std::endl
-                   << fstab_buf;
+    // The device tree can't change while running, so the entries found in it are parsed once.
+    static std::mutex dt_fstab_lock;
+    static auto& dt_fstab = *new std::optional<Fstab>;
+    std::lock_guard lock(dt_fstab_lock);
+
+    if (!dt_fstab) {
+        std::string fstab_buf = ReadFstabFromDt();
+        if (fstab_buf.empty()) {
+            if (log) LINFO << __FUNCTION__ << "(): failed to read fstab from dt";
+            return false;
+        }
+
+        std::unique_ptr<FILE, decltype(&fclose)> fstab_file(
+            fmemopen(static_cast<void*>(const_cast<char*>(fstab_buf.c_str())),
+                     fstab_buf.length(), "r"), fclose);
+        if (!fstab_file) {
+            if (log) PERROR << __FUNCTION__ << "(): failed to create a file stream for fstab dt";
+            return false;
+        }
+
+        Fstab parsed;
+        if (!ReadFstabFile(fstab_file.get(), false, &parsed)) {
+            if (log) {
+                LERROR << __FUNCTION__ << "(): failed to load fstab from kernel:" << std::endl
+                       << fstab_buf;
+            }
+            return false;
         }
-        return false;
+        dt_fstab = std::move(parsed);
     }
+    *fstab = *dt_fstab;
 
 #ifndef NO_SKIP_MOUNT
     SkipMountingPartitions(fstab);
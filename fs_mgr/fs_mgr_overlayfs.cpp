@@ -101,6 +101,11 @@ bool fs_mgr_overlayfs_setup(const char*, const char*, bool* change, bool) {
     return false;
 }
 
+bool fs_mgr_overlayfs_prepare_scratch(bool* change) {
+    if (change) *change = false;
+    return false;
+}
+
 bool fs_mgr_overlayfs_teardown(const char*, bool* change) {
     if (change) *change = false;
     return false;
@@ -1303,6 +1308,22 @@ bool fs_mgr_overlayfs_setup(const char* backing, const char* mount_point, bool*
     return ret;
 }
 
+bool fs_mgr_overlayfs_prepare_scratch(bool* change) {
+    if (change) *change = false;
+    if (fs_mgr_overlayfs_valid() == OverlayfsValidResult::kNotSupported) return false;
+    if (!fs_mgr_boot_completed()) {
+        errno = EBUSY;
+        PERROR << "prepare scratch";
+        return false;
+    }
+
+    Fstab fstab;
+    if (!ReadDefaultFstab(&fstab)) {
+        return false;
+    }
+    return fs_mgr_overlayfs_setup_scratch(fstab, change);
+}
+
 static bool EnsureScratchMapped(std::string* device, bool* mapped) {
     *mapped = false;
     *device = GetBootScratchDevice();
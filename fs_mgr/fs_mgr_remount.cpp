@@ -23,6 +23,7 @@
 #include <sys/vfs.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <string>
 #include <thread>
 #include <utility>
@@ -284,7 +285,18 @@ static int do_remount(int argc, char* argv[]) {
         partitions = all;
     }
 
-    // Check verity and optionally setup overlayfs backing.
+    // Creating and formatting scratch is the slow part of overlayfs setup, so get it going in the
+    // background while verity is checked. fs_mgr_overlayfs_setup() finds it mounted afterwards,
+    // or tries again itself, reporting any error, if this failed.
+    std::thread prepare_scratch;
+    if (android::base::GetProperty("ro.boot.vbmeta.device_state", "") != "locked" &&
+        std::any_of(partitions.begin(), partitions.end(), [&](const auto& entry) {
+            return GetEntryForMountPoint(&overlayfs_candidates, entry.mount_point) != nullptr;
+        })) {
+        prepare_scratch = std::thread([]() { fs_mgr_overlayfs_prepare_scratch(); });
+    }
+
+    // Check verity.
     auto reboot_later = false;
     auto user_please_reboot_later = false;
     auto setup_overlayfs = false;
@@ -319,7 +331,16 @@ static int do_remount(int argc, char* argv[]) {
                 continue;
             }
         }
+        ++it;
+    }
 
+    if (prepare_scratch.joinable()) {
+        prepare_scratch.join();
+    }
+
+    // Optionally setup overlayfs backing.
+    for (auto it = partitions.begin(); it != partitions.end();) {
+        auto& mount_point = it->mount_point;
         auto change = false;
         errno = 0;
         if (fs_mgr_overlayfs_setup(nullptr, mount_point.c_str(), &change, just_disabled_verity)) {
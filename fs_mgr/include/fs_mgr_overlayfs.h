@@ -30,6 +30,11 @@ bool fs_mgr_overlayfs_mount_all(android::fs_mgr::Fstab* fstab);
 std::vector<std::string> fs_mgr_overlayfs_required_devices(android::fs_mgr::Fstab* fstab);
 bool fs_mgr_overlayfs_setup(const char* backing = nullptr, const char* mount_point = nullptr,
                             bool* change = nullptr, bool force = true);
+// Creates, formats and mounts the scratch partition that fs_mgr_overlayfs_setup() would back
+// overlays with, without setting any overlay up. That is the slow part of setup, so callers can
+// start it early on another thread while they do other work, as long as it has returned before
+// they call fs_mgr_overlayfs_setup().
+bool fs_mgr_overlayfs_prepare_scratch(bool* change = nullptr);
 bool fs_mgr_overlayfs_teardown(const char* mount_point = nullptr, bool* change = nullptr);
 bool fs_mgr_overlayfs_is_setup();
 bool fs_mgr_has_shared_blocks(const std::string& mount_point, const std::string& dev);
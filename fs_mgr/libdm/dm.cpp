@@ -145,8 +145,8 @@ static bool IsRecovery() {
     return access("/system/bin/recovery", F_OK) == 0;
 }
 
-bool DeviceMapper::CreateDevice(const std::string& name, const DmTable& table, std::string* path,
-                                const std::chrono::milliseconds& timeout_ms) {
+bool DeviceMapper::CreateDeviceNoWait(const std::string& name, const DmTable& table,
+                                      std::string* path, std::string* wait_path) {
     std::string uuid = GenerateUuid();
     if (!CreateDevice(name, uuid)) {
         return false;
@@ -155,34 +155,78 @@ bool DeviceMapper::CreateDevice(const std::string& name, const DmTable& table, s
     // We use the unique path for testing whether the device is ready. After
     // that, it's safe to use the dm-N path which is compatible with callers
     // that expect it to be formatted as such.
-    std::string unique_path;
-    if (!LoadTableAndActivate(name, table) || !GetDeviceUniquePath(name, &unique_path) ||
+    if (!LoadTableAndActivate(name, table) || !GetDeviceUniquePath(name, wait_path) ||
         !GetDmDevicePathByName(name, path)) {
         DeleteDevice(name);
         return false;
     }
 
-    if (timeout_ms <= std::chrono::milliseconds::zero()) {
-        return true;
-    }
-
     if (IsRecovery()) {
         bool non_ab_device = android::base::GetProperty("ro.build.ab_update", "").empty();
         int sdk = android::base::GetIntProperty("ro.build.version.sdk", 0);
         if (non_ab_device && sdk && sdk <= 29) {
             LOG(INFO) << "Detected ueventd incompatibility, reverting to legacy libdm behavior.";
-            unique_path = *path;
+            *wait_path = *path;
         }
     }
+    return true;
+}
+
+bool DeviceMapper::CreateDevice(const std::string& name, const DmTable& table, std::string* path,
+                                const std::chrono::milliseconds& timeout_ms) {
+    std::string wait_path;
+    if (!CreateDeviceNoWait(name, table, path, &wait_path)) {
+        return false;
+    }
+
+    if (timeout_ms <= std::chrono::milliseconds::zero()) {
+        return true;
+    }
 
-    if (!WaitForFile(unique_path, timeout_ms)) {
-        LOG(ERROR) << "Failed waiting for device path: " << unique_path;
+    if (!WaitForFile(wait_path, timeout_ms)) {
+        LOG(ERROR) << "Failed waiting for device path: " << wait_path;
         DeleteDevice(name);
         return false;
     }
     return true;
 }
 
+bool DeviceMapper::CreateDevices(const std::vector<std::pair<std::string, DmTable>>& devices,
+                                 std::vector<std::string>* paths,
+                                 const std::chrono::milliseconds& timeout_ms) {
+    std::vector<std::string> created;
+    auto delete_created = [&, this]() {
+        // Delete in reverse, since later tables may refer to earlier devices.
+        for (auto iter = created.rbegin(); iter != created.rend(); ++iter) {
+            DeleteDevice(*iter);
+        }
+        paths->clear();
+    };
+
+    paths->clear();
+    std::vector<std::string> wait_paths;
+    for (const auto& [name, table] : devices) {
+        std::string path, wait_path;
+        if (!CreateDeviceNoWait(name, table, &path, &wait_path)) {
+            delete_created();
+            return false;
+        }
+        created.emplace_back(name);
+        paths->emplace_back(std::move(path));
+        wait_paths.emplace_back(std::move(wait_path));
+    }
+
+    if (timeout_ms <= std::chrono::milliseconds::zero()) {
+        return true;
+    }
+
+    if (!WaitForFiles(std::move(wait_paths), timeout_ms)) {
+        delete_created();
+        return false;
+    }
+    return true;
+}
+
 bool DeviceMapper::GetDeviceUniquePath(const std::string& name, std::string* path) {
     struct dm_ioctl io;
     InitIo(&io, name);
@@ -558,6 +558,41 @@ TEST(libdm, DeleteDeviceWithTimeout) {
     ASSERT_EQ(ENOENT, errno);
 }
 
+TEST(libdm, CreateDevices) {
+    unique_fd tmp(CreateTempFile("file_1", 4096));
+    ASSERT_GE(tmp, 0);
+    LoopDevice loop(tmp, 10s);
+    ASSERT_TRUE(loop.valid());
+
+    std::vector<std::pair<std::string, DmTable>> devices;
+    for (const auto& name : {"libdm-test-create-devices-a", "libdm-test-create-devices-b"}) {
+        DmTable table;
+        ASSERT_TRUE(table.Emplace<DmTargetLinear>(0, 1, loop.device(), 0));
+        devices.emplace_back(name, std::move(table));
+    }
+
+    DeviceMapper& dm = DeviceMapper::Instance();
+    std::vector<std::string> paths;
+    ASSERT_TRUE(dm.CreateDevices(devices, &paths, 5s));
+    ASSERT_EQ(devices.size(), paths.size());
+    for (size_t i = 0; i < devices.size(); ++i) {
+        std::string path;
+        ASSERT_TRUE(dm.GetDmDevicePathByName(devices[i].first, &path));
+        EXPECT_EQ(path, paths[i]);
+        EXPECT_EQ(0, access(paths[i].c_str(), F_OK));
+        EXPECT_EQ(DmDeviceState::ACTIVE, dm.GetState(devices[i].first));
+    }
+
+    // The second device still exists, so creating it fails, and the first
+    // device is deleted again.
+    ASSERT_TRUE(dm.DeleteDevice(devices[0].first, 5s));
+    ASSERT_FALSE(dm.CreateDevices(devices, &paths, 5s));
+    EXPECT_TRUE(paths.empty());
+    EXPECT_EQ(DmDeviceState::INVALID, dm.GetState(devices[0].first));
+
+    ASSERT_TRUE(dm.DeleteDevice(devices[1].first));
+}
+
 TEST(libdm, IsDmBlockDevice) {
     unique_fd tmp(CreateTempFile("file_1", 4096));
     ASSERT_GE(tmp, 0);
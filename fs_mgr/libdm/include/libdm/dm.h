@@ -135,6 +135,20 @@ class DeviceMapper final {
     bool CreateDevice(const std::string& name, const DmTable& table, std::string* path,
                       const std::chrono::milliseconds& timeout_ms);
 
+    // Creates and activates several devices, as the variant above does, but
+    // without waiting in between: all of the devices are set up first, then
+    // their paths are waited for together, for at most |timeout_ms| in total.
+    // Devices are created in order, so a table may refer to a device that
+    // comes before it in |devices|.
+    //
+    // On success, |paths| contains the GetDmDevicePathByName() path of each
+    // device, in the same order. If any device fails to be created, or not
+    // all of the paths are available in time, every device created by this
+    // call is deleted and false is returned.
+    bool CreateDevices(const std::vector<std::pair<std::string, DmTable>>& devices,
+                       std::vector<std::string>* paths,
+                       const std::chrono::milliseconds& timeout_ms);
+
     // Create a device and activate the given table, without waiting to acquire
     // a valid path. If the caller will use GetDmDevicePathByName(), it should
     // use the timeout variant above.
@@ -242,6 +256,10 @@ class DeviceMapper final {
     static constexpr uint32_t kMaxPossibleDmDevices = 256;
 
     bool CreateDevice(const std::string& name, const std::string& uuid = {});
+    // Creates and activates a device. |wait_path| is set to the path that
+    // shows up once ueventd has processed the device.
+    bool CreateDeviceNoWait(const std::string& name, const DmTable& table, std::string* path,
+                            std::string* wait_path);
     bool GetTable(const std::string& name, uint32_t flags, std::vector<TargetInfo>* table);
     void InitIo(struct dm_ioctl* io, const std::string& name = std::string()) const;
 
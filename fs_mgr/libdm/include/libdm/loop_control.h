@@ -19,6 +19,7 @@
 
 #include <chrono>
 #include <string>
+#include <vector>
 
 #include <android-base/unique_fd.h>
 
@@ -37,8 +38,26 @@ class LoopControl final {
     //
     // The caller does not have to call WaitForFile(); it is implicitly called.
     // The given |timeout_ms| covers both potential sources of timeout.
-    bool Attach(int file_fd, const std::chrono::milliseconds& timeout_ms,
-                std::string* loopdev) const;
+    //
+    // If |direct_io| is true, the loop device is also set up the way
+    // EnableDirectIo() does it. On kernels with LOOP_CONFIGURE, that happens
+    // in the same ioctl that attaches the file. If direct I/O can't be
+    // enabled, the file is detached again and Attach() fails.
+    bool Attach(int file_fd, const std::chrono::milliseconds& timeout_ms, std::string* loopdev,
+                bool direct_io = false) const;
+
+    // Attaches each file in |file_fds| to its own loop device, and returns the
+    // devices in the same order in |loopdevs|. The loop devices are created
+    // up front, so that ueventd makes their nodes in one go instead of one
+    // attach at a time. If any attach fails, the devices already attached are
+    // detached again.
+    bool Attach(const std::vector<int>& file_fds, const std::chrono::milliseconds& timeout_ms,
+                std::vector<std::string>* loopdevs, bool direct_io = false) const;
+
+    // Makes sure that |count| loop devices exist, starting at the first free
+    // one, and waits for their nodes to appear. The next attaches then find a
+    // node ready instead of waiting for ueventd.
+    bool Prewarm(size_t count, const std::chrono::milliseconds& timeout_ms) const;
 
     // Detach the loop device given by 'loopdev' from the attached backing file.
     bool Detach(const std::string& loopdev) const;
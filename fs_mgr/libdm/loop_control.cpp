@@ -23,15 +23,90 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <atomic>
+
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 #include <android-base/unique_fd.h>
 
 #include "utility.h"
 
+#if !defined(LO_FLAGS_DIRECT_IO)
+#define LO_FLAGS_DIRECT_IO 16
+#endif
+#if !defined(LOOP_SET_BLOCK_SIZE)
+#define LOOP_SET_BLOCK_SIZE 0x4C09
+#endif
+#if !defined(LOOP_SET_DIRECT_IO)
+#define LOOP_SET_DIRECT_IO 0x4C08
+#endif
+#if !defined(LOOP_CONFIGURE)
+#define LOOP_CONFIGURE 0x4C0A
+struct loop_config {
+    __u32 fd;
+    __u32 block_size;
+    struct loop_info64 info;
+    __u64 __reserved[8];
+};
+#endif
+
 namespace android {
 namespace dm {
 
+// Note: the block size has to be >= the logical block size of the underlying
+// block device, *not* the filesystem block size.
+static constexpr uint32_t kDirectIoBlockSize = 4096;
+
+// Cleared the first time LOOP_CONFIGURE turns out not to be supported (before kernel 5.8).
+static std::atomic<bool> loop_configure_supported = true;
+
+static std::string LoopDevicePath(int index) {
+    // Ueventd on android creates all loop devices as /dev/block/loopX
+    // The total number of available devices is determined by 'loop.max_part'
+    // kernel command line argument.
+    return ::android::base::StringPrintf("/dev/block/loop%d", index);
+}
+
+// Attaches |file_fd| to |loop_fd| with a single LOOP_CONFIGURE. Returns false and
+// sets errno on failure, including ENOTTY if the kernel doesn't support it.
+static bool ConfigureLoopDevice(int loop_fd, int file_fd, bool direct_io) {
+    if (!loop_configure_supported) {
+        errno = ENOTTY;
+        return false;
+    }
+
+    loop_config config = {};
+    config.fd = file_fd;
+    if (direct_io) {
+        config.block_size = kDirectIoBlockSize;
+        config.info.lo_flags = LO_FLAGS_DIRECT_IO;
+    }
+    if (ioctl(loop_fd, LOOP_CONFIGURE, &config) == 0) {
+        return true;
+    }
+    // Older kernels reject the unknown ioctl with EINVAL.
+    if (errno == EINVAL || errno == ENOTTY) {
+        loop_configure_supported = false;
+        errno = ENOTTY;
+    }
+    return false;
+}
+
+// Returns whether |loop_fd| ended up doing direct I/O. LOOP_CONFIGURE quietly
+// falls back to buffered I/O if the backing file doesn't support it, where
+// LOOP_SET_DIRECT_IO fails, so ask for it again to get the error.
+static bool CheckDirectIo(int loop_fd) {
+    loop_info64 info;
+    if (ioctl(loop_fd, LOOP_GET_STATUS64, &info) == 0 && (info.lo_flags & LO_FLAGS_DIRECT_IO)) {
+        return true;
+    }
+    if (ioctl(loop_fd, LOOP_SET_DIRECT_IO, 1)) {
+        PLOG(ERROR) << "Could not set loop direct IO";
+        return false;
+    }
+    return true;
+}
+
 LoopControl::LoopControl() : control_fd_(-1) {
     control_fd_.reset(TEMP_FAILURE_RETRY(open(kLoopControlDevice, O_RDWR | O_CLOEXEC)));
     if (control_fd_ < 0) {
@@ -40,7 +115,7 @@ LoopControl::LoopControl() : control_fd_(-1) {
 }
 
 bool LoopControl::Attach(int file_fd, const std::chrono::milliseconds& timeout_ms,
-                         std::string* loopdev) const {
+                         std::string* loopdev, bool direct_io) const {
     auto start_time = std::chrono::steady_clock::now();
     auto condition = [&]() -> WaitResult {
         if (!FindFreeLoopDevice(loopdev)) {
@@ -62,11 +137,24 @@ bool LoopControl::Attach(int file_fd, const std::chrono::milliseconds& timeout_m
             return WaitResult::Fail;
         }
 
-        if (int rc = ioctl(loop_fd, LOOP_SET_FD, file_fd); rc == 0) {
+        if (ConfigureLoopDevice(loop_fd, file_fd, direct_io)) {
+            if (direct_io && !CheckDirectIo(loop_fd)) {
+                ioctl(loop_fd, LOOP_CLR_FD, 0);
+                return WaitResult::Fail;
+            }
             return WaitResult::Done;
         }
+        if (errno == ENOTTY) {
+            if (int rc = ioctl(loop_fd, LOOP_SET_FD, file_fd); rc == 0) {
+                if (direct_io && !EnableDirectIo(loop_fd)) {
+                    ioctl(loop_fd, LOOP_CLR_FD, 0);
+                    return WaitResult::Fail;
+                }
+                return WaitResult::Done;
+            }
+        }
         if (errno != EBUSY) {
-            PLOG(ERROR) << "Failed LOOP_SET_FD";
+            PLOG(ERROR) << "Failed to attach to " << *loopdev;
             return WaitResult::Fail;
         }
         return WaitResult::Wait;
@@ -78,6 +166,56 @@ bool LoopControl::Attach(int file_fd, const std::chrono::milliseconds& timeout_m
     return true;
 }
 
+bool LoopControl::Attach(const std::vector<int>& file_fds,
+                         const std::chrono::milliseconds& timeout_ms,
+                         std::vector<std::string>* loopdevs, bool direct_io) const {
+    auto start_time = std::chrono::steady_clock::now();
+    loopdevs->clear();
+    if (!Prewarm(file_fds.size(), timeout_ms)) {
+        return false;
+    }
+
+    for (int file_fd : file_fds) {
+        auto now = std::chrono::steady_clock::now();
+        auto time_elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start_time);
+
+        std::string loopdev;
+        if (!Attach(file_fd, timeout_ms - time_elapsed, &loopdev, direct_io)) {
+            for (const auto& attached : *loopdevs) {
+                Detach(attached);
+            }
+            loopdevs->clear();
+            return false;
+        }
+        loopdevs->emplace_back(std::move(loopdev));
+    }
+    return true;
+}
+
+bool LoopControl::Prewarm(size_t count, const std::chrono::milliseconds& timeout_ms) const {
+    if (count == 0) {
+        return true;
+    }
+
+    // LOOP_CTL_GET_FREE creates the first free device if there is none.
+    int first = ioctl(control_fd_, LOOP_CTL_GET_FREE);
+    if (first < 0) {
+        PLOG(ERROR) << "Failed to get free loop device";
+        return false;
+    }
+
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < count; i++) {
+        int index = first + i;
+        if (i > 0 && ioctl(control_fd_, LOOP_CTL_ADD, index) < 0 && errno != EEXIST) {
+            PLOG(ERROR) << "Failed to add loop device " << index;
+            return false;
+        }
+        paths.emplace_back(LoopDevicePath(index));
+    }
+    return WaitForFiles(paths, timeout_ms);
+}
+
 bool LoopControl::Detach(const std::string& loopdev) const {
     if (loopdev.empty()) {
         LOG(ERROR) << "Must provide a loop device";
@@ -105,24 +243,12 @@ bool LoopControl::FindFreeLoopDevice(std::string* loopdev) const {
         return false;
     }
 
-    // Ueventd on android creates all loop devices as /dev/block/loopX
-    // The total number of available devices is determined by 'loop.max_part'
-    // kernel command line argument.
-    *loopdev = ::android::base::StringPrintf("/dev/block/loop%d", rc);
+    *loopdev = LoopDevicePath(rc);
     return true;
 }
 
 bool LoopControl::EnableDirectIo(int fd) {
-#if !defined(LOOP_SET_BLOCK_SIZE)
-    static constexpr int LOOP_SET_BLOCK_SIZE = 0x4C09;
-#endif
-#if !defined(LOOP_SET_DIRECT_IO)
-    static constexpr int LOOP_SET_DIRECT_IO = 0x4C08;
-#endif
-
-    // Note: the block size has to be >= the logical block size of the underlying
-    // block device, *not* the filesystem block size.
-    if (ioctl(fd, LOOP_SET_BLOCK_SIZE, 4096)) {
+    if (ioctl(fd, LOOP_SET_BLOCK_SIZE, kDirectIoBlockSize)) {
         PLOG(ERROR) << "Could not set loop device block size";
         return false;
     }
@@ -62,3 +62,31 @@ TEST(libdm, LoopControl) {
     ASSERT_TRUE(android::base::ReadFully(loop_fd, buffer, sizeof(buffer)));
     ASSERT_EQ(memcmp(buffer, "Hello", 6), 0);
 }
+
+TEST(libdm, LoopControlBatch) {
+    static constexpr size_t kNumFiles = 4;
+    std::vector<unique_fd> files;
+    std::vector<int> file_fds;
+    for (size_t i = 0; i < kNumFiles; i++) {
+        unique_fd fd = TempFile();
+        ASSERT_GE(fd, 0);
+        file_fds.emplace_back(fd.get());
+        files.emplace_back(std::move(fd));
+    }
+
+    LoopControl control;
+    std::vector<std::string> devices;
+    ASSERT_TRUE(control.Attach(file_fds, 10s, &devices));
+    ASSERT_EQ(devices.size(), kNumFiles);
+
+    for (const auto& device : devices) {
+        char buffer[6];
+        unique_fd loop_fd(open(device.c_str(), O_RDWR));
+        ASSERT_GE(loop_fd, 0);
+        ASSERT_TRUE(android::base::ReadFully(loop_fd, buffer, sizeof(buffer)));
+        ASSERT_EQ(memcmp(buffer, "Hello", 6), 0);
+    }
+    for (const auto& device : devices) {
+        ASSERT_TRUE(control.Detach(device));
+    }
+}
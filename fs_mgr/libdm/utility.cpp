@@ -58,6 +58,30 @@ bool WaitForFile(const std::string& path, const std::chrono::milliseconds& timeo
     return WaitForCondition(condition, timeout_ms);
 }
 
+bool WaitForFiles(std::vector<std::string> paths, const std::chrono::milliseconds& timeout_ms) {
+    auto condition = [&]() -> WaitResult {
+        for (auto iter = paths.begin(); iter != paths.end();) {
+            if (access(iter->c_str(), F_OK) != 0) {
+                if (errno == ENOENT) {
+                    ++iter;
+                    continue;
+                }
+                PLOG(ERROR) << "access failed: " << *iter;
+                return WaitResult::Fail;
+            }
+            iter = paths.erase(iter);
+        }
+        return paths.empty() ? WaitResult::Done : WaitResult::Wait;
+    };
+    if (!WaitForCondition(condition, timeout_ms)) {
+        for (const auto& path : paths) {
+            LOG(ERROR) << "Failed waiting for device path: " << path;
+        }
+        return false;
+    }
+    return true;
+}
+
 bool WaitForFileDeleted(const std::string& path, const std::chrono::milliseconds& timeout_ms) {
     auto condition = [&]() -> WaitResult {
         if (access(path.c_str(), F_OK) == 0) {
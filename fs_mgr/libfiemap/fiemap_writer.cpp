@@ -48,6 +48,9 @@ using namespace android::dm;
 // We cap the maximum number of extents as a sanity measure.
 static constexpr uint32_t kMaxExtents = 50000;
 
+// Zeroes are written in chunks of up to this size, rounded down to the file system block size.
+static constexpr uint64_t kMaxZeroWriteSize = 1024 * 1024;
+
 // TODO: Fallback to using fibmap if FIEMAP_EXTENT_MERGED is set.
 static constexpr const uint32_t kUnsupportedExtentFlags =
         FIEMAP_EXTENT_UNKNOWN | FIEMAP_EXTENT_UNWRITTEN | FIEMAP_EXTENT_DELALLOC |
@@ -379,13 +382,16 @@ static bool PinFile(int file_fd, const std::string& file_path, uint32_t fs_type)
     return true;
 }
 
-// write zeroes in 'blocksz' byte increments until we reach file_size to make sure the data
-// blocks are actually written to by the file system and thus getting rid of the holes in the
-// file.
+// write zeroes until we reach file_size to make sure the data blocks are actually written to by
+// the file system and thus getting rid of the holes in the file. file_size must be a multiple of
+// 'blocksz'; the writes are as large as kMaxZeroWriteSize allows, since issuing them one block
+// at a time makes allocating a multi-GB image take minutes.
 static FiemapStatus WriteZeroes(int file_fd, const std::string& file_path, size_t blocksz,
                                 uint64_t file_size,
                                 const std::function<bool(uint64_t, uint64_t)>& on_progress) {
-    auto buffer = std::unique_ptr<void, decltype(&free)>(calloc(1, blocksz), free);
+    size_t write_size =
+            std::max<uint64_t>(blocksz, kMaxZeroWriteSize - kMaxZeroWriteSize % blocksz);
+    auto buffer = std::unique_ptr<void, decltype(&free)>(calloc(1, write_size), free);
     if (buffer == nullptr) {
         LOG(ERROR) << "failed to allocate memory for writing file";
         return FiemapStatus::Error();
@@ -399,13 +405,14 @@ static FiemapStatus WriteZeroes(int file_fd, const std::string& file_path, size_
 
     int permille = -1;
     while (offset < file_size) {
-        if (!::android::base::WriteFully(file_fd, buffer.get(), blocksz)) {
-            PLOG(ERROR) << "Failed to write" << blocksz << " bytes at offset" << offset
+        size_t to_write = std::min<uint64_t>(write_size, file_size - offset);
+        if (!::android::base::WriteFully(file_fd, buffer.get(), to_write)) {
+            PLOG(ERROR) << "Failed to write" << to_write << " bytes at offset" << offset
                         << " in file " << file_path;
             return FiemapStatus::FromErrno(errno);
         }
 
-        offset += blocksz;
+        offset += to_write;
 
         // Don't invoke the callback every iteration - wait until a significant
         // chunk (here, 1/1000th) of the data has been processed.
@@ -575,9 +582,46 @@ static bool FiemapToExtents(struct fiemap* fiemap, std::vector<struct fiemap_ext
     return true;
 }
 
+// Images are normally allocated in a handful of extents, so ReadFiemap() first asks for up to
+// this many in one call, and only counts them with a separate call if there turn out to be more.
+static constexpr uint32_t kInitialFiemapExtents = 64;
+
+static std::unique_ptr<struct fiemap, decltype(&free)> QueryFiemap(int file_fd,
+                                                                  const std::string& file_path,
+                                                                  uint32_t num_extents) {
+    uint64_t fiemap_size = sizeof(struct fiemap) + num_extents * sizeof(struct fiemap_extent);
+    auto fiemap = std::unique_ptr<struct fiemap, decltype(&free)>(
+            reinterpret_cast<struct fiemap*>(calloc(1, fiemap_size)), free);
+    if (fiemap == nullptr) {
+        LOG(ERROR) << "Failed to allocate memory for fiemap";
+        return fiemap;
+    }
+
+    fiemap->fm_start = 0;
+    fiemap->fm_length = UINT64_MAX;
+    // make sure file is synced to disk before we read the fiemap
+    fiemap->fm_flags = FIEMAP_FLAG_SYNC;
+    fiemap->fm_extent_count = num_extents;
+
+    if (ioctl(file_fd, FS_IOC_FIEMAP, fiemap.get())) {
+        PLOG(ERROR) << "Failed to get FIEMAP from the kernel for file: " << file_path;
+        fiemap.reset();
+    }
+    return fiemap;
+}
+
 static bool ReadFiemap(int file_fd, const std::string& file_path,
                        std::vector<struct fiemap_extent>* extents) {
-    uint32_t num_extents;
+    auto fiemap = QueryFiemap(file_fd, file_path, kInitialFiemapExtents);
+    if (!fiemap) {
+        return false;
+    }
+    uint32_t num_extents = fiemap->fm_mapped_extents;
+    if (num_extents > 0 && (num_extents < kInitialFiemapExtents ||
+                            IsLastExtent(&fiemap->fm_extents[num_extents - 1]))) {
+        return FiemapToExtents(fiemap.get(), extents, num_extents, file_path);
+    }
+
     if (!CountFiemapExtents(file_fd, file_path, &num_extents)) {
         return false;
     }
@@ -591,22 +635,8 @@ static bool ReadFiemap(int file_fd, const std::string& file_path,
         return false;
     }
 
-    uint64_t fiemap_size = sizeof(struct fiemap) + num_extents * sizeof(struct fiemap_extent);
-    auto buffer = std::unique_ptr<void, decltype(&free)>(calloc(1, fiemap_size), free);
-    if (buffer == nullptr) {
-        LOG(ERROR) << "Failed to allocate memory for fiemap";
-        return false;
-    }
-
-    struct fiemap* fiemap = reinterpret_cast<struct fiemap*>(buffer.get());
-    fiemap->fm_start = 0;
-    fiemap->fm_length = UINT64_MAX;
-    // make sure file is synced to disk before we read the fiemap
-    fiemap->fm_flags = FIEMAP_FLAG_SYNC;
-    fiemap->fm_extent_count = num_extents;
-
-    if (ioctl(file_fd, FS_IOC_FIEMAP, fiemap)) {
-        PLOG(ERROR) << "Failed to get FIEMAP from the kernel for file: " << file_path;
+    fiemap = QueryFiemap(file_fd, file_path, num_extents);
+    if (!fiemap) {
         return false;
     }
     if (fiemap->fm_mapped_extents != num_extents) {
@@ -615,10 +645,13 @@ static bool ReadFiemap(int file_fd, const std::string& file_path,
         return false;
     }
 
-    return FiemapToExtents(fiemap, extents, num_extents, file_path);
+    return FiemapToExtents(fiemap.get(), extents, num_extents, file_path);
 }
 
-static bool ReadFibmap(int file_fd, const std::string& file_path,
+// |alloc_size| is the file system's allocation unit (the cluster size on vfat). Blocks within
+// one allocation unit are always contiguous on disk, so only the first block of each is looked
+// up, rather than issuing a FIBMAP for every block.
+static bool ReadFibmap(int file_fd, const std::string& file_path, uint64_t alloc_size,
                        std::vector<struct fiemap_extent>* extents) {
     struct stat s;
     if (fstat(file_fd, &s)) {
@@ -642,7 +675,13 @@ static bool ReadFibmap(int file_fd, const std::string& file_path,
         return false;
     }
 
-    for (uint32_t last_block, block_number = 0; block_number < num_blocks; block_number++) {
+    uint32_t blocks_per_unit = 1;
+    if (alloc_size > blksize && alloc_size % blksize == 0) {
+        blocks_per_unit = alloc_size / blksize;
+    }
+
+    for (uint32_t last_block, block_number = 0; block_number < num_blocks;
+         block_number += blocks_per_unit) {
         uint32_t block = block_number;
         if (ioctl(file_fd, FIBMAP, &block)) {
             PLOG(ERROR) << "Failed to get FIBMAP for file " << file_path;
@@ -653,19 +692,21 @@ static bool ReadFibmap(int file_fd, const std::string& file_path,
             return false;
         }
 
+        uint32_t count = std::min<uint64_t>(blocks_per_unit, num_blocks - block_number);
+        uint64_t length = static_cast<uint64_t>(count) * blksize;
         if (!extents->empty() && block == last_block + 1) {
-            extents->back().fe_length += blksize;
+            extents->back().fe_length += length;
         } else {
             extents->push_back(fiemap_extent{.fe_logical = block_number,
                                              .fe_physical = static_cast<uint64_t>(block) * blksize,
-                                             .fe_length = static_cast<uint64_t>(blksize),
+                                             .fe_length = length,
                                              .fe_flags = 0});
             if (extents->size() > kMaxExtents) {
                 LOG(ERROR) << "File has more than " << kMaxExtents << "extents: " << file_path;
                 return false;
             }
         }
-        last_block = block;
+        last_block = block + count - 1;
     }
     return true;
 }
@@ -782,7 +823,7 @@ FiemapStatus FiemapWriter::Open(const std::string& file_path, uint64_t file_size
             }
             break;
         case MSDOS_SUPER_MAGIC:
-            if (!ReadFibmap(file_fd, abs_path, &fmap->extents_)) {
+            if (!ReadFibmap(file_fd, abs_path, blocksz, &fmap->extents_)) {
                 LOG(ERROR) << "Failed to read fibmap of file: " << abs_path;
                 cleanup(abs_path, create);
                 return FiemapStatus::Error();
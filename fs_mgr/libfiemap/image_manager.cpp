@@ -315,23 +315,6 @@ bool ImageManager::MapWithDmLinear(const IPartitionOpener& opener, const std::st
     return true;
 }
 
-// Helper to create a loop device for a file.
-static bool CreateLoopDevice(LoopControl& control, const std::string& file,
-                             const std::chrono::milliseconds& timeout_ms, std::string* path) {
-    static constexpr int kOpenFlags = O_RDWR | O_NOFOLLOW | O_CLOEXEC;
-    android::base::unique_fd file_fd(open(file.c_str(), kOpenFlags));
-    if (file_fd < 0) {
-        PLOG(ERROR) << "Could not open file: " << file;
-        return false;
-    }
-    if (!control.Attach(file_fd, timeout_ms, path)) {
-        LOG(ERROR) << "Could not create loop device for: " << file;
-        return false;
-    }
-    LOG(INFO) << "Created loop device " << *path << " for file " << file;
-    return true;
-}
-
 class AutoDetachLoopDevices final {
   public:
     AutoDetachLoopDevices(LoopControl& control, const std::vector<std::string>& devices)
@@ -426,20 +409,6 @@ bool ImageManager::MapWithLoopDeviceList(const std::vector<std::string>& device_
     return true;
 }
 
-static bool OptimizeLoopDevices(const std::vector<std::string>& device_list) {
-    for (const auto& device : device_list) {
-        unique_fd fd(open(device.c_str(), O_RDWR | O_CLOEXEC | O_NOFOLLOW));
-        if (fd < 0) {
-            PLOG(ERROR) << "Open failed: " << device;
-            return false;
-        }
-        if (!LoopControl::EnableDirectIo(fd)) {
-            return false;
-        }
-    }
-    return true;
-}
-
 // Helper to use one or more loop devices around image files.
 bool ImageManager::MapWithLoopDevice(const std::string& name,
                                      const std::chrono::milliseconds& timeout_ms,
@@ -452,31 +421,31 @@ bool ImageManager::MapWithLoopDevice(const std::string& name,
         return false;
     }
 
-    // Map each image file as a loopback device.
-    LoopControl control;
-    std::vector<std::string> loop_devices;
-    AutoDetachLoopDevices auto_detach(control, loop_devices);
-
-    auto start_time = std::chrono::steady_clock::now();
+    // Map each image file as a loopback device. If direct I/O can't be enabled,
+    // fail, since otherwise we'd use double the memory.
+    std::vector<unique_fd> files;
+    std::vector<int> file_fds;
     for (const auto& file : file_list) {
-        auto now = std::chrono::steady_clock::now();
-        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start_time);
-
-        std::string loop_device;
-        if (!CreateLoopDevice(control, file, timeout_ms - elapsed, &loop_device)) {
-            break;
+        static constexpr int kOpenFlags = O_RDWR | O_NOFOLLOW | O_CLOEXEC;
+        unique_fd file_fd(open(file.c_str(), kOpenFlags));
+        if (file_fd < 0) {
+            PLOG(ERROR) << "Could not open file: " << file;
+            return false;
         }
-        loop_devices.emplace_back(loop_device);
-    }
-    if (loop_devices.size() != file_list.size()) {
-        // The number of devices will mismatch if CreateLoopDevice() failed.
-        return false;
+        file_fds.emplace_back(file_fd.get());
+        files.emplace_back(std::move(file_fd));
     }
 
-    // If OptimizeLoopDevices fails, we'd use double the memory.
-    if (!OptimizeLoopDevices(loop_devices)) {
+    LoopControl control;
+    std::vector<std::string> loop_devices;
+    if (!control.Attach(file_fds, timeout_ms, &loop_devices, /*direct_io=*/true)) {
+        LOG(ERROR) << "Could not create loop devices for: " << android::base::Join(file_list, ", ");
         return false;
     }
+    AutoDetachLoopDevices auto_detach(control, loop_devices);
+    for (size_t i = 0; i < file_list.size(); i++) {
+        LOG(INFO) << "Created loop device " << loop_devices[i] << " for file " << file_list[i];
+    }
 
     // If there's only one loop device (by far the most common case, splits
     // will normally only happen on sdcards with FAT32), then just return that
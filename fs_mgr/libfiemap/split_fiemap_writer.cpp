@@ -22,8 +22,11 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <android-base/file.h>
@@ -42,6 +45,9 @@ using android::base::unique_fd;
 // We use a four-digit suffix at the end of filenames.
 static const size_t kMaxFilePieces = 500;
 
+// Existing pieces are opened by up to this many threads at once.
+static const size_t kMaxParallelOpens = 4;
+
 std::unique_ptr<SplitFiemap> SplitFiemap::Create(const std::string& file_path, uint64_t file_size,
                                                  uint64_t max_piece_size,
                                                  ProgressCallback progress) {
@@ -152,12 +158,34 @@ std::unique_ptr<SplitFiemap> SplitFiemap::Open(const std::string& file_path) {
     std::unique_ptr<SplitFiemap> out(new SplitFiemap());
     out->list_file_ = file_path;
 
-    for (const auto& file : files) {
-        auto writer = FiemapWriter::Open(file, 0, false);
-        if (!writer) {
-            // Error was logged in Open().
-            return nullptr;
+    // Opening a piece reads its whole block map, which on vfat takes a FIBMAP call per cluster,
+    // so the pieces are opened concurrently. Pieces are only read here, so unlike creating
+    // them this cannot make their allocation any more fragmented.
+    std::vector<FiemapUniquePtr> writers(files.size());
+    std::atomic<size_t> next_file = 0;
+    std::atomic<bool> failed = false;
+    auto open_files = [&]() {
+        for (size_t i = next_file++; i < files.size() && !failed; i = next_file++) {
+            writers[i] = FiemapWriter::Open(files[i], 0, false);
+            if (!writers[i]) {
+                // Error was logged in Open().
+                failed = true;
+            }
         }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min(files.size(), kMaxParallelOpens); i++) {
+        threads.emplace_back(open_files);
+    }
+    open_files();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    if (failed) {
+        return nullptr;
+    }
+
+    for (auto& writer : writers) {
         out->AddFile(std::move(writer));
     }
     return out;
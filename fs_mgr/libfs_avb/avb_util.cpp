@@ -20,6 +20,7 @@
 
 #include <array>
 #include <sstream>
+#include <thread>
 
 #include <android-base/file.h>
 #include <android-base/strings.h>
@@ -641,12 +642,30 @@ VBMetaVerifyResult LoadAndVerifyVbmetaByPartition(
         if (fatal_error) {
             return VBMetaVerifyResult::kError;
         }
-        for (auto& chain : chain_partitions) {
-            auto sub_ret = LoadAndVerifyVbmetaByPartition(
-                chain.partition_name, ab_suffix, ab_other_suffix, chain.public_key_blob,
-                allow_verification_error, load_chained_vbmeta, rollback_protection,
-                device_path_constructor, true, /* is_chained_vbmeta */
-                out_vbmeta_images);
+        // The chained vbmeta images don't depend on each other, so they are loaded and verified
+        // concurrently.  Their results are still taken in descriptor order, as the vbmeta digest
+        // covers the images in that order.
+        std::vector<std::vector<VBMetaData>> chain_vbmeta_images(chain_partitions.size());
+        std::vector<VBMetaVerifyResult> chain_results(chain_partitions.size());
+        std::vector<std::thread> threads;
+        for (size_t i = 0; i < chain_partitions.size(); i++) {
+            threads.emplace_back([&, i] {
+                const auto& chain = chain_partitions[i];
+                chain_results[i] = LoadAndVerifyVbmetaByPartition(
+                        chain.partition_name, ab_suffix, ab_other_suffix, chain.public_key_blob,
+                        allow_verification_error, load_chained_vbmeta, rollback_protection,
+                        device_path_constructor, true, /* is_chained_vbmeta */
+                        &chain_vbmeta_images[i]);
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        for (size_t i = 0; i < chain_partitions.size(); i++) {
+            for (auto& chain_vbmeta : chain_vbmeta_images[i]) {
+                out_vbmeta_images->emplace_back(std::move(chain_vbmeta));
+            }
+            auto sub_ret = chain_results[i];
             if (sub_ret != VBMetaVerifyResult::kSuccess) {
                 verify_result = sub_ret;  // might be 'ERROR' or 'ERROR VERIFICATION'.
                 if (verify_result == VBMetaVerifyResult::kError) {
@@ -84,11 +84,13 @@ void Partition::AddExtent(std::unique_ptr<Extent>&& extent) {
         }
     }
     extents_.push_back(std::move(extent));
+    ExtentsChanged();
 }
 
 void Partition::RemoveExtents() {
     size_ = 0;
     extents_.clear();
+    ExtentsChanged();
 }
 
 void Partition::ShrinkTo(uint64_t aligned_size) {
@@ -96,6 +98,7 @@ void Partition::ShrinkTo(uint64_t aligned_size) {
         RemoveExtents();
         return;
     }
+    ExtentsChanged();
 
     // Remove or shrink extents of any kind until the total partition size is
     // equal to the requested size.
@@ -501,6 +504,7 @@ Partition* MetadataBuilder::AddPartition(std::string_view name, std::string_view
         return nullptr;
     }
     partitions_.push_back(std::make_unique<Partition>(name, group_name, attributes));
+    partitions_.back()->extents_version_ = &extents_version_;
     return partitions_.back().get();
 }
 
@@ -537,6 +541,7 @@ void MetadataBuilder::RemovePartition(std::string_view name) {
     for (auto iter = partitions_.begin(); iter != partitions_.end(); iter++) {
         if ((*iter)->name() == name) {
             partitions_.erase(iter);
+            extents_version_++;
             return;
         }
     }
@@ -566,6 +571,23 @@ void MetadataBuilder::ExtentsToFreeList(const std::vector<Interval>& extents,
 }
 
 auto MetadataBuilder::GetFreeRegions() const -> std::vector<Interval> {
+    UpdateFreeRegions();
+
+    std::vector<Interval> free_regions;
+    for (size_t i = 0; i < free_regions_.size(); i++) {
+        for (const auto& [start, end] : free_regions_[i]) {
+            free_regions.emplace_back(i, start, end);
+        }
+    }
+    return free_regions;
+}
+
+void MetadataBuilder::UpdateFreeRegions() const {
+    if (free_regions_version_ == extents_version_ &&
+        free_regions_.size() == block_devices_.size()) {
+        return;
+    }
+
     std::vector<Interval> free_regions;
 
     // Collect all extents in the partition table, per-device, then sort them
@@ -598,7 +620,39 @@ auto MetadataBuilder::GetFreeRegions() const -> std::vector<Interval> {
         std::sort(extents.begin(), extents.end());
         ExtentsToFreeList(extents, &free_regions);
     }
-    return free_regions;
+
+    free_regions_.assign(block_devices_.size(), {});
+    for (const auto& region : free_regions) {
+        free_regions_[region.device_index].emplace(region.start, region.end);
+    }
+    free_regions_version_ = extents_version_;
+}
+
+void MetadataBuilder::RemoveFromFreeRegions(const LinearExtent& extent) {
+    auto& regions = free_regions_[extent.device_index()];
+    auto iter = regions.upper_bound(extent.physical_sector());
+    if (iter == regions.begin()) {
+        return;
+    }
+    --iter;
+    auto [start, end] = *iter;
+    if (extent.physical_sector() >= end) {
+        // The extent was not taken from a free region, e.g. it fills the misaligned tail of
+        // the partition's last extent.
+        return;
+    }
+    CHECK(extent.end_sector() <= end);
+
+    // Same as ExtentsToFreeList(): the space after an extent is only free from the next
+    // aligned sector onward.
+    regions.erase(iter);
+    if (start < extent.physical_sector()) {
+        regions.emplace(start, extent.physical_sector());
+    }
+    uint64_t aligned = AlignSector(block_devices_[extent.device_index()], extent.end_sector());
+    if (aligned < end) {
+        regions.emplace(aligned, end);
+    }
 }
 
 bool MetadataBuilder::ValidatePartitionSizeChange(Partition* partition, uint64_t old_size,
@@ -720,10 +774,13 @@ bool MetadataBuilder::GrowPartition(Partition* partition, uint64_t aligned_size,
         return false;
     }
 
-    // Everything succeeded, so commit the new extents.
+    // Everything succeeded, so commit the new extents, and take them out of the free list
+    // rather than rebuilding it from scratch on the next allocation.
     for (auto& extent : new_extents) {
+        RemoveFromFreeRegions(*extent);
         partition->AddExtent(std::move(extent));
     }
+    free_regions_version_ = extents_version_;
     return true;
 }
 
@@ -1006,6 +1063,7 @@ bool MetadataBuilder::UpdateBlockDeviceInfo(size_t index, const BlockDeviceInfo&
     if (device_info.alignment_offset) {
         block_device.alignment_offset = device_info.alignment_offset;
     }
+    extents_version_++;
     return true;
 }
 
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <liblp/builder.h>
+
+using namespace android::fs_mgr;
+
+static constexpr uint64_t kSuperSize = 64ULL * 1024 * 1024 * 1024;
+static constexpr uint64_t kStepSize = 1024 * 1024;
+
+static std::unique_ptr<MetadataBuilder> NewBuilder() {
+    BlockDeviceInfo super("super", kSuperSize, 1024 * 1024, 0, 4096);
+    return MetadataBuilder::New({super}, "super", 256 * 1024, 2);
+}
+
+// Creates range(0) partitions and grows them in round-robin steps, as an OTA or a device with
+// many dynamic partitions would. Every step interleaves with the other partitions, so each
+// partition ends up with many extents and the free list stays fragmented.
+static void BM_GrowPartitions(benchmark::State& state) {
+    int num_partitions = state.range(0);
+    for (auto _ : state) {
+        auto builder = NewBuilder();
+        std::vector<Partition*> partitions;
+        for (int i = 0; i < num_partitions; i++) {
+            partitions.push_back(builder->AddPartition("p" + std::to_string(i), 0));
+        }
+        for (int step = 1; step <= 8; step++) {
+            for (auto partition : partitions) {
+                if (!builder->ResizePartition(partition, step * kStepSize)) {
+                    state.SkipWithError("ResizePartition failed");
+                    return;
+                }
+            }
+        }
+        benchmark::DoNotOptimize(builder->GetFreeRegions());
+    }
+    state.SetItemsProcessed(state.iterations() * num_partitions * 8);
+}
+BENCHMARK(BM_GrowPartitions)->RangeMultiplier(4)->Range(16, 1024)->Unit(benchmark::kMillisecond);
+
+// Shrinks and regrows one partition among range(0) others, which has to rebuild the free list
+// after every shrink.
+static void BM_ShrinkAndGrow(benchmark::State& state) {
+    int num_partitions = state.range(0);
+    auto builder = NewBuilder();
+    std::vector<Partition*> partitions;
+    for (int i = 0; i < num_partitions; i++) {
+        partitions.push_back(builder->AddPartition("p" + std::to_string(i), 0));
+    }
+    for (int step = 1; step <= 8; step++) {
+        for (auto partition : partitions) {
+            builder->ResizePartition(partition, step * kStepSize);
+        }
+    }
+    size_t next = 0;
+    for (auto _ : state) {
+        Partition* partition = partitions[next++ % partitions.size()];
+        builder->ResizePartition(partition, kStepSize);
+        builder->ResizePartition(partition, 8 * kStepSize);
+    }
+}
+BENCHMARK(BM_ShrinkAndGrow)->RangeMultiplier(4)->Range(16, 1024);
+
+BENCHMARK_MAIN();
@@ -14,6 +14,8 @@
  * limitations under the License.
  */
 
+#include <random>
+
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 #include <liblp/builder.h>
@@ -1019,3 +1021,55 @@ TEST_F(BuilderTest, LinearExtentOverlap) {
     EXPECT_FALSE(extent.OverlapsWith(LinearExtent{20, 1, 15}));
     EXPECT_FALSE(extent.OverlapsWith(LinearExtent{20, 1, 10}));
 }
+
+static std::vector<std::tuple<uint32_t, uint64_t, uint64_t>> FreeRegionsOf(
+        const MetadataBuilder& builder) {
+    std::vector<std::tuple<uint32_t, uint64_t, uint64_t>> regions;
+    for (const auto& region : builder.GetFreeRegions()) {
+        regions.emplace_back(region.device_index, region.start, region.end);
+    }
+    return regions;
+}
+
+TEST_F(BuilderTest, FreeRegionsTrackResizes) {
+    // Two devices, one of them with an alignment larger than the block size, so that
+    // allocations leave misaligned gaps behind.
+    BlockDeviceInfo super("super", 512_MiB, 786432, 229376, 4096);
+    BlockDeviceInfo other("other", 256_MiB, 0, 0, 4096);
+    unique_ptr<MetadataBuilder> builder =
+            MetadataBuilder::New({super, other}, "super", 65536, 2);
+    ASSERT_NE(builder, nullptr);
+
+    std::vector<Partition*> partitions;
+    for (int i = 0; i < 16; i++) {
+        Partition* partition = builder->AddPartition("p" + std::to_string(i), 0);
+        ASSERT_NE(partition, nullptr);
+        partitions.push_back(partition);
+    }
+
+    std::mt19937 rng(1234);
+    for (int i = 0; i < 500; i++) {
+        Partition* partition = partitions[rng() % partitions.size()];
+        uint64_t size = (rng() % 12_MiB) & ~uint64_t(4095);
+        if (i % 7 == 0) {
+            // Restrict the allocation to somewhere in the middle of a device.
+            auto regions = builder->GetFreeRegions();
+            if (!regions.empty()) {
+                const auto& region = regions[rng() % regions.size()];
+                uint64_t start = region.start + (region.length() / 2) / 8 * 8;
+                builder->ResizePartition(partition, size, {Interval(region.device_index, start,
+                                                                    region.end)});
+            }
+        } else {
+            builder->ResizePartition(partition, size);
+        }
+
+        // The free list maintained across resizes must be the same as the one computed from
+        // scratch for the same extents.
+        auto exported = builder->Export();
+        ASSERT_NE(exported, nullptr);
+        auto fresh = MetadataBuilder::New(*exported.get());
+        ASSERT_NE(fresh, nullptr);
+        ASSERT_EQ(FreeRegionsOf(*builder.get()), FreeRegionsOf(*fresh.get())) << "step " << i;
+    }
+}
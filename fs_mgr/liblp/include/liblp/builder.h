@@ -138,6 +138,9 @@ class Partition final {
   private:
     void ShrinkTo(uint64_t aligned_size);
     void set_group_name(std::string_view group_name) { group_name_ = group_name; }
+    void ExtentsChanged() {
+        if (extents_version_) ++*extents_version_;
+    }
 
     std::string name_;
     std::string group_name_;
@@ -145,6 +148,9 @@ class Partition final {
     uint32_t attributes_;
     uint64_t size_;
     bool disabled_;
+    // Counter of the MetadataBuilder this partition belongs to, bumped whenever the extents
+    // change so that the builder knows its free list is stale.
+    uint64_t* extents_version_ = nullptr;
 };
 
 // An interval in the metadata. This is similar to a LinearExtent with one difference.
@@ -387,6 +393,8 @@ class MetadataBuilder {
     bool IsAnyRegionAllocated(const LinearExtent& candidate) const;
     void ExtentsToFreeList(const std::vector<Interval>& extents,
                            std::vector<Interval>* free_regions) const;
+    void UpdateFreeRegions() const;
+    void RemoveFromFreeRegions(const LinearExtent& extent);
     std::vector<Interval> PrioritizeSecondHalfOfSuper(const std::vector<Interval>& free_list);
     std::unique_ptr<LinearExtent> ExtendFinalExtent(Partition* partition,
                                                     const std::vector<Interval>& free_list,
@@ -401,6 +409,14 @@ class MetadataBuilder {
     std::vector<std::unique_ptr<PartitionGroup>> groups_;
     std::vector<LpMetadataBlockDevice> block_devices_;
     bool auto_slot_suffixing_;
+
+    // Free regions of each block device, as a map from start sector to end sector. This is
+    // rebuilt from the extents only when they changed since it was last valid; allocations
+    // take their extents out of it directly so that growing many partitions in a row does not
+    // re-sort every extent each time.
+    mutable std::vector<std::map<uint64_t, uint64_t>> free_regions_;
+    mutable uint64_t free_regions_version_ = 0;
+    uint64_t extents_version_ = 1;
 };
 
 // Read BlockDeviceInfo for a given block device. This always returns false
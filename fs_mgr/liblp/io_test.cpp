@@ -251,6 +251,37 @@ TEST_F(LiblpTest, UpdateAnyMetadataSlot) {
     }
 }
 
+TEST_F(LiblpTest, ReadMetadataCache) {
+    unique_fd fd = CreateFlashedDisk();
+    ASSERT_GE(fd, 0);
+
+    DefaultPartitionOpener opener(fd);
+
+    unique_ptr<LpMetadata> imported = ReadMetadata(opener, "super", 0);
+    ASSERT_NE(imported, nullptr);
+
+    // Corrupt the tables of both copies, but not their headers. Since the
+    // headers still match, the tables that were read before are used.
+    std::string corruption(imported->header.tables_size, '\xff');
+    for (auto offset : {GetPrimaryMetadataOffset(imported->geometry, 0),
+                        GetBackupMetadataOffset(imported->geometry, 0)}) {
+        ASSERT_GE(lseek(fd, offset + imported->header.header_size, SEEK_SET), 0);
+        ASSERT_TRUE(android::base::WriteFully(fd, corruption.data(), corruption.size()));
+    }
+    unique_ptr<LpMetadata> cached = ReadMetadata(opener, "super", 0);
+    ASSERT_NE(cached, nullptr);
+    ASSERT_EQ(cached->partitions.size(), 1);
+    EXPECT_EQ(GetPartitionName(cached->partitions[0]), "system");
+
+    // Updating the tables changes the header, so they are read again.
+    strncpy(imported->partitions[0].name, "vendor", sizeof(imported->partitions[0].name));
+    ASSERT_TRUE(UpdatePartitionTable(opener, "super", *imported.get(), 0));
+    imported = ReadMetadata(opener, "super", 0);
+    ASSERT_NE(imported, nullptr);
+    ASSERT_EQ(imported->partitions.size(), 1);
+    EXPECT_EQ(GetPartitionName(imported->partitions[0]), "vendor");
+}
+
 TEST_F(LiblpTest, InvalidMetadataSlot) {
     unique_fd fd = CreateFlashedDisk();
     ASSERT_GE(fd, 0);
@@ -22,6 +22,9 @@
 #include <unistd.h>
 
 #include <functional>
+#include <map>
+#include <mutex>
+#include <utility>
 
 #include <android-base/file.h>
 #include <android-base/unique_fd.h>
@@ -241,10 +244,18 @@ static bool ReadMetadataHeader(Reader* reader, LpMetadata* metadata) {
     return true;
 }
 
+static bool IsSameHeader(const LpMetadata& a, const LpMetadata& b) {
+    return !memcmp(&a.geometry, &b.geometry, sizeof(a.geometry)) &&
+           !memcmp(&a.header, &b.header, sizeof(a.header));
+}
+
 // Parse and validate all metadata at the current position in the given file
-// descriptor.
+// descriptor. If the header matches the one in |cached|, which was parsed and
+// validated earlier, the tables are not read again: the header checksum covers
+// the tables checksum, so they are the same tables.
 static std::unique_ptr<LpMetadata> ParseMetadata(const LpMetadataGeometry& geometry,
-                                                 Reader* reader) {
+                                                 Reader* reader,
+                                                 const LpMetadata* cached = nullptr) {
     // First read and validate the header.
     std::unique_ptr<LpMetadata> metadata = std::make_unique<LpMetadata>();
 
@@ -255,6 +266,10 @@ static std::unique_ptr<LpMetadata> ParseMetadata(const LpMetadataGeometry& geome
 
     LpMetadataHeader& header = metadata->header;
 
+    if (cached && IsSameHeader(*cached, *metadata)) {
+        return std::make_unique<LpMetadata>(*cached);
+    }
+
     // Sanity check the table size.
     if (header.tables_size > geometry.metadata_max_size) {
         LERROR << "Invalid partition metadata header table size.";
@@ -395,6 +410,41 @@ std::unique_ptr<LpMetadata> ReadBackupMetadata(int fd, const LpMetadataGeometry&
 
 namespace {
 
+// Metadata that ReadMetadata() parsed, before slot suffixes were applied, by
+// super partition and slot. This saves reading and checksumming the tables
+// again when one process reads the same metadata several times, e.g. once for
+// each partition it maps.
+class MetadataCache {
+  public:
+    std::shared_ptr<const LpMetadata> Find(const std::string& super_partition,
+                                           uint32_t slot_number) {
+        std::lock_guard<std::mutex> lock(lock_);
+        auto iter = entries_.find({super_partition, slot_number});
+        return iter != entries_.end() ? iter->second : nullptr;
+    }
+
+    void Add(const std::string& super_partition, uint32_t slot_number,
+             const LpMetadata& metadata) {
+        std::lock_guard<std::mutex> lock(lock_);
+        if (entries_.size() >= kMaxEntries) {
+            entries_.clear();
+        }
+        entries_[{super_partition, slot_number}] = std::make_shared<const LpMetadata>(metadata);
+    }
+
+  private:
+    // There is usually one super partition with two slots.
+    static constexpr size_t kMaxEntries = 8;
+
+    std::mutex lock_;
+    std::map<std::pair<std::string, uint32_t>, std::shared_ptr<const LpMetadata>> entries_;
+};
+
+MetadataCache* GetMetadataCache() {
+    static auto cache = new MetadataCache();
+    return cache;
+}
+
 bool AdjustMetadataForSlot(LpMetadata* metadata, uint32_t slot_number) {
     std::string slot_suffix = SlotSuffixForSlotNumber(slot_number);
     for (auto& partition : metadata->partitions) {
@@ -458,16 +508,21 @@ std::unique_ptr<LpMetadata> ReadMetadata(const IPartitionOpener& opener,
             GetBackupMetadataOffset(geometry, slot_number),
     };
     std::unique_ptr<LpMetadata> metadata;
+    auto cached = GetMetadataCache()->Find(super_partition, slot_number);
 
     for (const auto& offset : offsets) {
         if (SeekFile64(fd, offset, SEEK_SET) < 0) {
             PERROR << __PRETTY_FUNCTION__ << " lseek failed, offset " << offset;
             continue;
         }
-        if ((metadata = ParseMetadata(geometry, fd)) != nullptr) {
+        FileReader reader(fd);
+        if ((metadata = ParseMetadata(geometry, &reader, cached.get())) != nullptr) {
             break;
         }
     }
+    if (metadata && (!cached || !IsSameHeader(*cached, *metadata))) {
+        GetMetadataCache()->Add(super_partition, slot_number, *metadata);
+    }
     if (!metadata || !AdjustMetadataForSlot(metadata.get(), slot_number)) {
         return nullptr;
     }
@@ -16,6 +16,7 @@
 
 #include <stdint.h>
 
+#include <algorithm>
 #include <vector>
 
 namespace android {
@@ -37,6 +38,20 @@ class DmSnapCowSizeCalculator {
         modified_chunks_[chunk_id] = true;
     }
 
+    // Marks every chunk touched by |num_sectors| sectors starting at |sector|. This is the same
+    // as calling WriteSector() for each of them, but costs one pass over the chunk bitmap
+    // rather than a call per sector.
+    void WriteSectors(uint64_t sector, uint64_t num_sectors) {
+        if (num_sectors == 0) return;
+        uint64_t first_chunk = sector / chunk_sectors_;
+        uint64_t end_chunk = (sector + num_sectors - 1) / chunk_sectors_ + 1;
+        if (modified_chunks_.size() < end_chunk) {
+            modified_chunks_.resize(end_chunk, false);
+        }
+        std::fill(modified_chunks_.begin() + first_chunk, modified_chunks_.begin() + end_chunk,
+                  true);
+    }
+
     uint64_t cow_size_bytes() const { return cow_size_sectors() * sector_bytes_; }
     uint64_t cow_size_sectors() const { return cow_size_chunks() * chunk_sectors_; }
 
@@ -57,15 +72,10 @@ class DmSnapCowSizeCalculator {
      * - 1 extra chunk
      */
     uint64_t cow_size_chunks() const {
-        uint64_t modified_chunks_count = 0;
+        uint64_t modified_chunks_count =
+                std::count(modified_chunks_.begin(), modified_chunks_.end(), true);
         uint64_t cow_chunks = 0;
 
-        for (const auto& c : modified_chunks_) {
-            if (c) {
-                ++modified_chunks_count;
-            }
-        }
-
         /* disk header + padding = 1 chunk */
         cow_chunks += 1;
 
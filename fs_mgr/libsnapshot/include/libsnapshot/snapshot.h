@@ -15,10 +15,12 @@
 #pragma once
 
 #include <stdint.h>
+#include <sys/stat.h>
 
 #include <chrono>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <ostream>
 #include <string>
@@ -449,7 +451,9 @@ class SnapshotManager final {
     //   UpdateState::MergeNeedsReboot
     UpdateState CheckMergeState(const std::function<bool()>& before_cancel);
     UpdateState CheckMergeState(LockedFile* lock, const std::function<bool()>& before_cancel);
-    UpdateState CheckTargetMergeState(LockedFile* lock, const std::string& name);
+    // If the snapshot is still merging, its dm status is added to |merge_status|.
+    UpdateState CheckTargetMergeState(LockedFile* lock, const std::string& name,
+                                      DmTargetSnapshot::Status* merge_status);
 
     // Interact with status files under /metadata/ota/snapshots.
     bool WriteSnapshotStatus(LockedFile* lock, const SnapshotStatus& status);
@@ -550,6 +554,25 @@ class SnapshotManager final {
     std::unique_ptr<IImageManager> images_;
     bool has_local_image_manager_ = false;
     bool in_factory_data_reset_ = false;
+
+    // Status files as last parsed by ReadSnapshotStatus(), keyed by snapshot name. An entry is
+    // only used while the file still has the same inode, size and mtime; status files are
+    // always replaced atomically, so any write gives them a new inode.
+    struct CachedSnapshotStatus {
+        struct stat st;
+        SnapshotStatus status;
+    };
+    // Sum of the dm status of the snapshots that were still merging at the last merge poll.
+    // GetUpdateState() reports progress from this while it is fresh, rather than querying
+    // every device again, since it is typically called from the ProcessUpdateState() callback
+    // right after a poll.
+    struct MergeProgress {
+        std::chrono::steady_clock::time_point time;
+        DmTargetSnapshot::Status status;
+    };
+    std::mutex cache_lock_;
+    std::map<std::string, CachedSnapshotStatus> snapshot_status_cache_;
+    std::optional<MergeProgress> last_merge_progress_;
 };
 
 }  // namespace snapshot
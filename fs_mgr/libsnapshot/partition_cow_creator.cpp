@@ -128,13 +128,7 @@ bool OptimizeSourceCopyOperation(const InstallOperation& operation, InstallOpera
 
 void WriteExtent(DmSnapCowSizeCalculator* sc, const chromeos_update_engine::Extent& de,
                  unsigned int sectors_per_block) {
-    const auto block_boundary = de.start_block() + de.num_blocks();
-    for (auto b = de.start_block(); b < block_boundary; ++b) {
-        for (unsigned int s = 0; s < sectors_per_block; ++s) {
-            const auto sector_id = b * sectors_per_block + s;
-            sc->WriteSector(sector_id);
-        }
-    }
+    sc->WriteSectors(de.start_block() * sectors_per_block, de.num_blocks() * sectors_per_block);
 }
 
 uint64_t PartitionCowCreator::GetCowSize() {
@@ -231,6 +231,27 @@ TEST(DmSnapshotInternals, CowSizeCalculator) {
     }
 }
 
+TEST(DmSnapshotInternals, CowSizeCalculatorSectorRanges) {
+    SKIP_IF_NON_VIRTUAL_AB();
+
+    DmSnapCowSizeCalculator by_sector(512, 8);
+    DmSnapCowSizeCalculator by_range(512, 8);
+
+    // Overlapping ranges that start and end in the middle of chunks, as well as empty ones,
+    // must give the same size as writing each sector on its own.
+    const std::vector<std::pair<uint64_t, uint64_t>> ranges = {
+            {0, 0}, {3, 1}, {7, 2}, {100, 0}, {64, 64}, {70, 200}, {1000, 1}, {4096, 8192},
+    };
+    for (const auto& [sector, num_sectors] : ranges) {
+        for (uint64_t s = sector; s < sector + num_sectors; ++s) {
+            by_sector.WriteSector(s);
+        }
+        by_range.WriteSectors(sector, num_sectors);
+        ASSERT_EQ(by_sector.cow_size_sectors(), by_range.cow_size_sectors())
+                << "after writing " << num_sectors << " sectors at " << sector;
+    }
+}
+
 void BlocksToExtents(const std::vector<uint64_t>& blocks,
                      google::protobuf::RepeatedPtrField<UeExtent>* extents) {
     for (uint64_t block : blocks) {
@@ -781,13 +781,8 @@ bool SnapshotManager::IsSnapshotDevice(const std::string& dm_name, TargetInfo* t
     return true;
 }
 
-bool SnapshotManager::QuerySnapshotStatus(const std::string& dm_name, std::string* target_type,
-                                          DmTargetSnapshot::Status* status) {
-    DeviceMapper::TargetInfo target;
-    if (!IsSnapshotDevice(dm_name, &target)) {
-        LOG(ERROR) << "Device " << dm_name << " is not a snapshot or snapshot-merge device";
-        return false;
-    }
+static bool ParseSnapshotTarget(const std::string& dm_name, const DeviceMapper::TargetInfo& target,
+                                std::string* target_type, DmTargetSnapshot::Status* status) {
     if (!DmTargetSnapshot::ParseStatusText(target.data, status)) {
         LOG(ERROR) << "Could not parse snapshot status text: " << dm_name;
         return false;
@@ -798,6 +793,16 @@ bool SnapshotManager::QuerySnapshotStatus(const std::string& dm_name, std::strin
     return true;
 }
 
+bool SnapshotManager::QuerySnapshotStatus(const std::string& dm_name, std::string* target_type,
+                                          DmTargetSnapshot::Status* status) {
+    DeviceMapper::TargetInfo target;
+    if (!IsSnapshotDevice(dm_name, &target)) {
+        LOG(ERROR) << "Device " << dm_name << " is not a snapshot or snapshot-merge device";
+        return false;
+    }
+    return ParseSnapshotTarget(dm_name, target, target_type, status);
+}
+
 // Note that when a merge fails, we will *always* try again to complete the
 // merge each time the device boots. There is no harm in doing so, and if
 // the problem was transient, we might manage to get a new outcome.
@@ -883,8 +888,9 @@ UpdateState SnapshotManager::CheckMergeState(LockedFile* lock,
     bool failed = false;
     bool merging = false;
     bool needs_reboot = false;
+    DmTargetSnapshot::Status merge_status = {};
     for (const auto& snapshot : snapshots) {
-        UpdateState snapshot_state = CheckTargetMergeState(lock, snapshot);
+        UpdateState snapshot_state = CheckTargetMergeState(lock, snapshot, &merge_status);
         switch (snapshot_state) {
             case UpdateState::MergeFailed:
                 failed = true;
@@ -908,6 +914,15 @@ UpdateState SnapshotManager::CheckMergeState(LockedFile* lock,
         }
     }
 
+    {
+        std::lock_guard<std::mutex> guard(cache_lock_);
+        if (merging) {
+            last_merge_progress_ = {std::chrono::steady_clock::now(), merge_status};
+        } else {
+            last_merge_progress_.reset();
+        }
+    }
+
     if (merging) {
         // Note that we handle "Merging" before we handle anything else. We
         // want to poll until *nothing* is merging if we can, so everything has
@@ -934,7 +949,8 @@ UpdateState SnapshotManager::CheckMergeState(LockedFile* lock,
     return UpdateState::MergeCompleted;
 }
 
-UpdateState SnapshotManager::CheckTargetMergeState(LockedFile* lock, const std::string& name) {
+UpdateState SnapshotManager::CheckTargetMergeState(LockedFile* lock, const std::string& name,
+                                                   DmTargetSnapshot::Status* merge_status) {
     SnapshotStatus snapshot_status;
     if (!ReadSnapshotStatus(lock, name, &snapshot_status)) {
         return UpdateState::MergeFailed;
@@ -944,7 +960,9 @@ UpdateState SnapshotManager::CheckTargetMergeState(LockedFile* lock, const std::
 
     std::unique_ptr<LpMetadata> current_metadata;
 
-    if (!IsSnapshotDevice(dm_name)) {
+    // The table status is read once and used for both the target type and the merge progress.
+    DeviceMapper::TargetInfo target;
+    if (!IsSnapshotDevice(dm_name, &target)) {
         if (!current_metadata) {
             current_metadata = ReadCurrentMetadata();
         }
@@ -976,7 +994,7 @@ UpdateState SnapshotManager::CheckTargetMergeState(LockedFile* lock, const std::
 
     std::string target_type;
     DmTargetSnapshot::Status status;
-    if (!QuerySnapshotStatus(dm_name, &target_type, &status)) {
+    if (!ParseSnapshotTarget(dm_name, target, &target_type, &status)) {
         return UpdateState::MergeFailed;
     }
     if (target_type != "snapshot-merge") {
@@ -993,6 +1011,9 @@ UpdateState SnapshotManager::CheckTargetMergeState(LockedFile* lock, const std::
             LOG(ERROR) << "Snapshot " << name << " is merging after being marked merge-complete.";
             return UpdateState::MergeFailed;
         }
+        merge_status->sectors_allocated += status.sectors_allocated;
+        merge_status->total_sectors += status.total_sectors;
+        merge_status->metadata_sectors += status.metadata_sectors;
         return UpdateState::Merging;
     }
 
@@ -1443,7 +1464,17 @@ UpdateState SnapshotManager::GetUpdateState(double* progress) {
 
     // Sum all the snapshot states as if the system consists of a single huge
     // snapshots device, then compute the merge completion percentage of that
-    // device.
+    // device. If this process has just polled the merge, reuse what it found.
+    {
+        std::lock_guard<std::mutex> guard(cache_lock_);
+        auto now = std::chrono::steady_clock::now();
+        if (last_merge_progress_ && now - last_merge_progress_->time < kUpdateStateCheckInterval) {
+            *progress = DmTargetSnapshot::MergePercent(last_merge_progress_->status,
+                                                       update_status.sectors_allocated());
+            return state;
+        }
+    }
+
     std::vector<std::string> snapshots;
     if (!ListSnapshots(lock.get(), &snapshots)) {
         LOG(ERROR) << "Could not list snapshots";
@@ -2034,6 +2065,20 @@ bool SnapshotManager::ReadSnapshotStatus(LockedFile* lock, const std::string& na
     CHECK(lock);
     auto path = GetSnapshotStatusFilePath(name);
 
+    std::lock_guard<std::mutex> guard(cache_lock_);
+    struct stat st;
+    auto cached = snapshot_status_cache_.find(name);
+    if (cached != snapshot_status_cache_.end()) {
+        const struct stat& old = cached->second.st;
+        if (lstat(path.c_str(), &st) == 0 && st.st_dev == old.st_dev && st.st_ino == old.st_ino &&
+            st.st_size == old.st_size && st.st_mtim.tv_sec == old.st_mtim.tv_sec &&
+            st.st_mtim.tv_nsec == old.st_mtim.tv_nsec) {
+            *status = cached->second.status;
+            return true;
+        }
+        snapshot_status_cache_.erase(cached);
+    }
+
     unique_fd fd(open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW));
     if (fd < 0) {
         PLOG(ERROR) << "Open failed: " << path;
@@ -2050,6 +2095,9 @@ bool SnapshotManager::ReadSnapshotStatus(LockedFile* lock, const std::string& na
         status->set_name(name);
     }
 
+    if (fstat(fd.get(), &st) == 0) {
+        snapshot_status_cache_[name] = {st, *status};
+    }
     return true;
 }
 
@@ -2067,11 +2115,18 @@ bool SnapshotManager::WriteSnapshotStatus(LockedFile* lock, const SnapshotStatus
         return false;
     }
 
+    std::lock_guard<std::mutex> guard(cache_lock_);
+    snapshot_status_cache_.erase(status.name());
     if (!WriteStringToFileAtomic(content, path)) {
         PLOG(ERROR) << "Unable to write SnapshotStatus to " << path;
         return false;
     }
 
+    // Keep the cache in step with what this process writes, so polls after a write still hit.
+    struct stat st;
+    if (lstat(path.c_str(), &st) == 0) {
+        snapshot_status_cache_[status.name()] = {st, status};
+    }
     return true;
 }
 
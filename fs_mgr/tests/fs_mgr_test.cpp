@@ -306,7 +306,8 @@ static bool CompareFlags(FstabEntry::FsMgrFlags& lhs, FstabEntry::FsMgrFlags& rh
            lhs.checkpoint_fs == rhs.checkpoint_fs &&
            lhs.first_stage_mount == rhs.first_stage_mount &&
            lhs.slot_select_other == rhs.slot_select_other &&
-           lhs.fs_verity == rhs.fs_verity;
+           lhs.fs_verity == rhs.fs_verity &&
+           lhs.prefetch_hashtree == rhs.prefetch_hashtree;
     // clang-format on
 }
 
@@ -654,6 +655,29 @@ source none0       swap   defaults      forceencrypt=/dir/key
     EXPECT_EQ("/dir/key", entry->key_loc);
 }
 
+TEST(fs_mgr, ReadFstabFromFile_FsMgrOptions_PrefetchHashtree) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    std::string fstab_contents = R"fs(
+source none0       swap   defaults      avb,prefetch_hashtree
+source none1       swap   defaults      avb
+)fs";
+
+    ASSERT_TRUE(android::base::WriteStringToFile(fstab_contents, tf.path));
+
+    Fstab fstab;
+    EXPECT_TRUE(ReadFstabFromFile(tf.path, &fstab));
+    ASSERT_EQ(2U, fstab.size());
+
+    FstabEntry::FsMgrFlags flags = {};
+    flags.avb = true;
+    flags.prefetch_hashtree = true;
+    EXPECT_TRUE(CompareFlags(flags, fstab[0].fs_mgr_flags));
+
+    flags.prefetch_hashtree = false;
+    EXPECT_TRUE(CompareFlags(flags, fstab[1].fs_mgr_flags));
+}
+
 TEST(fs_mgr, ReadFstabFromFile_FsMgrOptions_ForceFdeOrFbe) {
     TemporaryFile tf;
     ASSERT_TRUE(tf.fd != -1);
@@ -988,6 +1012,31 @@ source none4       swap   defaults      zram_backingdev_size=2m
     entry++;
 }
 
+TEST(fs_mgr, ReadFstabFromFile_Rewritten) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    ASSERT_TRUE(android::base::WriteStringToFile("source /a ext4 ro wait\n", tf.path));
+
+    Fstab fstab;
+    EXPECT_TRUE(ReadFstabFromFile(tf.path, &fstab));
+    ASSERT_EQ(1U, fstab.size());
+    EXPECT_EQ("/a", fstab[0].mount_point);
+
+    // Reading the same file again gives the same entries, even after they were modified.
+    fstab[0].mount_point = "/modified";
+    EXPECT_TRUE(ReadFstabFromFile(tf.path, &fstab));
+    ASSERT_EQ(1U, fstab.size());
+    EXPECT_EQ("/a", fstab[0].mount_point);
+
+    // A changed file is parsed again.
+    ASSERT_TRUE(android::base::WriteStringToFile(
+            "source /b ext4 ro wait\nsource /c f2fs ro wait\n", tf.path));
+    EXPECT_TRUE(ReadFstabFromFile(tf.path, &fstab));
+    ASSERT_EQ(2U, fstab.size());
+    EXPECT_EQ("/b", fstab[0].mount_point);
+    EXPECT_EQ("/c", fstab[1].mount_point);
+}
+
 TEST(fs_mgr, DefaultFstabContainsUserdata) {
     Fstab fstab;
     ASSERT_TRUE(ReadDefaultFstab(&fstab)) << "Failed to read default fstab";
@@ -30,6 +30,8 @@
 #include <algorithm>
 #include <memory>
 #include <optional>
+#include <set>
+#include <string_view>
 
 #include <android-base/file.h>
 #include <android-base/parseint.h>
@@ -96,7 +98,9 @@ BatteryMonitor::BatteryMonitor()
     initHealthInfo(mHealthInfo.get());
 }
 
-BatteryMonitor::~BatteryMonitor() {}
+BatteryMonitor::~BatteryMonitor() {
+    for (const auto& [path, fd] : mSysfsFds) close(fd);
+}
 
 const HealthInfo_1_0& BatteryMonitor::getHealthInfo_1_0() const {
     return getHealthInfo_2_0().legacy;
@@ -174,10 +178,41 @@ BatteryHealth getBatteryHealth(const char* status) {
     return *ret;
 }
 
+int BatteryMonitor::openSysfsFile(const String8& path) {
+    auto it = mSysfsFds.find(path);
+    if (it != mSysfsFds.end()) return it->second;
+
+    int fd = TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC));
+    if (fd != -1) mSysfsFds.emplace(path, fd);
+    return fd;
+}
+
+void BatteryMonitor::closeSysfsFile(const String8& path) {
+    auto it = mSysfsFds.find(path);
+    if (it == mSysfsFds.end()) return;
+    close(it->second);
+    mSysfsFds.erase(it);
+}
+
 int BatteryMonitor::readFromFile(const String8& path, std::string* buf) {
-    if (android::base::ReadFileToString(path.c_str(), buf)) {
-        *buf = android::base::Trim(*buf);
+    // A sysfs attribute is at most a page, and is regenerated on each read from offset 0, so the
+    // fd is kept open rather than reopening the path on every update.
+    char data[4096];
+    ssize_t len = -1;
+
+    buf->clear();
+    if (path.isEmpty()) return 0;
+
+    for (int attempt = 0; attempt < 2 && len < 0; attempt++) {
+        int fd = openSysfsFile(path);
+        if (fd == -1) return 0;
+        len = TEMP_FAILURE_RETRY(pread(fd, data, sizeof(data), 0));
+        // The power supply may have gone away, or been replaced by one with the same name.
+        if (len < 0) closeSysfsFile(path);
     }
+    if (len <= 0) return 0;
+
+    *buf = android::base::Trim(std::string(data, len));
     return buf->length();
 }
 
@@ -242,7 +277,8 @@ bool BatteryMonitor::isScopedPowerSupply(const char* name) {
     return (readFromFile(path, &scope) > 0 && scope == kScopeDevice);
 }
 
-void BatteryMonitor::updateValues(void) {
+bool BatteryMonitor::updateValues(void) {
+    HealthInfo_2_1 previous = std::move(*mHealthInfo);
     initHealthInfo(mHealthInfo.get());
 
     HealthInfo_1_0& props = mHealthInfo->legacy.legacy;
@@ -308,6 +344,7 @@ void BatteryMonitor::updateValues(void) {
     } else {
         struct dirent* entry;
         String8 path;
+        std::set<std::string> present;
 
         mChargerNames.clear();
 
@@ -316,6 +353,7 @@ void BatteryMonitor::updateValues(void) {
 
             if (!strcmp(name, ".") || !strcmp(name, ".."))
                 continue;
+            present.emplace(name);
 
             // Look for "type" file in each subdirectory
             path.clear();
@@ -326,13 +364,28 @@ void BatteryMonitor::updateValues(void) {
             case ANDROID_POWER_SUPPLY_TYPE_WIRELESS:
                 path.clear();
                 path.appendFormat("%s/%s/online", POWER_SUPPLY_SYSFS_PATH, name);
-                if (access(path.string(), R_OK) == 0)
+                if (openSysfsFile(path) != -1)
                     mChargerNames.add(String8(name));
                 break;
             default:
                 break;
             }
         }
+
+        // Don't hold on to the attributes of power supplies that have gone away.
+        constexpr std::string_view kPrefix = POWER_SUPPLY_SYSFS_PATH "/";
+        for (auto it = mSysfsFds.begin(); it != mSysfsFds.end();) {
+            std::string_view file(it->first.c_str(), it->first.length());
+            if (android::base::StartsWith(file, kPrefix)) {
+                file.remove_prefix(kPrefix.size());
+                if (!present.count(std::string(file.substr(0, file.find('/'))))) {
+                    close(it->second);
+                    it = mSysfsFds.erase(it);
+                    continue;
+                }
+            }
+            ++it;
+        }
     }
 
     for (size_t i = 0; i < mChargerNames.size(); i++) {
@@ -360,16 +413,14 @@ void BatteryMonitor::updateValues(void) {
             path.clear();
             path.appendFormat("%s/%s/current_max", POWER_SUPPLY_SYSFS_PATH,
                               mChargerNames[i].string());
-            int ChargingCurrent =
-                    (access(path.string(), R_OK) == 0) ? getIntField(path) : 0;
+            int ChargingCurrent = (openSysfsFile(path) != -1) ? getIntField(path) : 0;
 
             path.clear();
             path.appendFormat("%s/%s/voltage_max", POWER_SUPPLY_SYSFS_PATH,
                               mChargerNames[i].string());
 
             int ChargingVoltage =
-                (access(path.string(), R_OK) == 0) ? getIntField(path) :
-                DEFAULT_VBUS_VOLTAGE;
+                (openSysfsFile(path) != -1) ? getIntField(path) : DEFAULT_VBUS_VOLTAGE;
 
             double power = ((double)ChargingCurrent / MILLION) *
                            ((double)ChargingVoltage / MILLION);
@@ -380,6 +431,8 @@ void BatteryMonitor::updateValues(void) {
             }
         }
     }
+
+    return !(*mHealthInfo == previous);
 }
 
 void BatteryMonitor::logValues(void) {
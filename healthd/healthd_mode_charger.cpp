@@ -565,6 +565,9 @@ void Charger::Heartbeat() {
 }
 
 void Charger::OnHealthInfoChanged(const HealthInfo_2_1& health_info) {
+    // Nothing to redraw or reschedule if a uevent didn't change anything we look at.
+    if (have_battery_state_ && health_info.legacy.legacy == health_info_) return;
+
     set_charger_online(health_info);
 
     if (!have_battery_state_) {
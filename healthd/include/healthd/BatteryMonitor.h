@@ -17,6 +17,7 @@
 #ifndef HEALTHD_BATTERYMONITOR_H
 #define HEALTHD_BATTERYMONITOR_H
 
+#include <map>
 #include <memory>
 
 #include <batteryservice/BatteryService.h>
@@ -62,7 +63,9 @@ class BatteryMonitor {
     const android::hardware::health::V2_0::HealthInfo& getHealthInfo_2_0() const;
     const android::hardware::health::V2_1::HealthInfo& getHealthInfo_2_1() const;
 
-    void updateValues(void);
+    // Re-reads the power supply state. Returns true if any field of the HealthInfo changed since
+    // the previous update, so callers can skip notifying listeners when nothing did.
+    bool updateValues(void);
     void logValues(void);
     bool isChargerOnline();
 
@@ -73,7 +76,11 @@ class BatteryMonitor {
     int mBatteryFixedCapacity;
     int mBatteryFixedTemperature;
     std::unique_ptr<android::hardware::health::V2_1::HealthInfo> mHealthInfo;
+    // Read-only fds of the sysfs attributes read so far, kept open and re-read with pread().
+    std::map<String8, int> mSysfsFds;
 
+    int openSysfsFile(const String8& path);
+    void closeSysfsFile(const String8& path);
     int readFromFile(const String8& path, std::string* buf);
     PowerSupplyType readPowerSupplyType(const String8& path);
     bool getBooleanField(const String8& path);
@@ -21,6 +21,7 @@
 #include <android-base/properties.h>
 #include <android-base/strings.h>
 
+#include "boot_timeline.h"
 #include "util.h"
 
 using android::base::Join;
@@ -143,23 +144,75 @@ size_t Action::CheckAllCommands() const {
     return failures;
 }
 
-void Action::ExecuteOneCommand(std::size_t command) const {
+// Consecutive commands that run in the subcontext are sent to it together, to save a round trip
+// per command.  There are at most this many to a batch, so that the main loop isn't held up for
+// much longer than by a single command.
+static constexpr std::size_t kMaxSubcontextBatch = 16;
+
+std::size_t Action::ExecuteOneCommand(std::size_t command) const {
+    if (subcontext_ && commands_[command].execute_in_subcontext()) {
+        std::vector<Command> batch;
+        for (std::size_t i = command; i < commands_.size() && batch.size() < kMaxSubcontextBatch &&
+                                      commands_[i].execute_in_subcontext();
+             ++i) {
+            batch.emplace_back(commands_[i]);
+        }
+        if (batch.size() > 1) {
+            return ExecuteSubcontextBatch(batch);
+        }
+    }
+
     // We need a copy here since some Command execution may result in
     // changing commands_ vector by importing .rc files through parser
     Command cmd = commands_[command];
     ExecuteCommand(cmd);
+    return 1;
 }
 
 void Action::ExecuteAllCommands() const {
-    for (const auto& c : commands_) {
-        ExecuteCommand(c);
+    for (std::size_t i = 0; i < commands_.size();) {
+        i += ExecuteOneCommand(i);
     }
 }
 
 void Action::ExecuteCommand(const Command& command) const {
-    android::base::Timer t;
+    auto start = android::base::boot_clock::now();
     auto result = command.InvokeFunc(subcontext_);
-    auto duration = t.duration();
+    LogCommand(command, start, android::base::boot_clock::now(), result);
+}
+
+std::size_t Action::ExecuteSubcontextBatch(const std::vector<Command>& commands) const {
+    std::vector<std::vector<std::string>> args;
+    args.reserve(commands.size());
+    for (const auto& command : commands) {
+        args.emplace_back(command.args());
+    }
+
+    auto start = android::base::boot_clock::now();
+    auto results = subcontext_->BatchExecute(args);
+    if (!results.ok()) {
+        // As with a single command, the subcontext has been restarted and the failure is put
+        // down to the first command.  The others are tried again.
+        LogCommand(commands[0], start, android::base::boot_clock::now(), results.error());
+        return 1;
+    }
+
+    // The subcontext reports how long each command took, so they can be laid end to end.
+    for (std::size_t i = 0; i < results->size(); ++i) {
+        auto end = start + (*results)[i].duration;
+        LogCommand(commands[i], start, end, (*results)[i].result);
+        start = end;
+    }
+    return results->size();
+}
+
+void Action::LogCommand(const Command& command, android::base::boot_clock::time_point start,
+                        android::base::boot_clock::time_point end,
+                        const Result<void>& result) const {
+    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+    RecordBootEvent(BootEventType::kCommand, start, end,
+                    command.BuildCommandString() + " (" + filename_ + ":" +
+                            std::to_string(command.line()) + ")");
 
     // Any action longer than 50ms will be warned to user as slow operation
     if (!result.has_value() || duration > 50ms ||
@@ -22,6 +22,8 @@
 #include <variant>
 #include <vector>
 
+#include <android-base/chrono_utils.h>
+
 #include "builtins.h"
 #include "keyword_map.h"
 #include "result.h"
@@ -43,6 +45,8 @@ class Command {
     Result<void> CheckCommand() const;
 
     int line() const { return line_; }
+    bool execute_in_subcontext() const { return execute_in_subcontext_; }
+    const std::vector<std::string>& args() const { return args_; }
 
   private:
     BuiltinFunction func_;
@@ -64,7 +68,9 @@ class Action {
     Result<void> AddCommand(std::vector<std::string>&& args, int line);
     void AddCommand(BuiltinFunction f, std::vector<std::string>&& args, int line);
     size_t NumCommands() const;
-    void ExecuteOneCommand(std::size_t command) const;
+    // Runs the command at index |command|, and possibly some of the ones after it.  Returns the
+    // number of commands run.
+    std::size_t ExecuteOneCommand(std::size_t command) const;
     void ExecuteAllCommands() const;
     bool CheckEvent(const EventTrigger& event_trigger) const;
     bool CheckEvent(const PropertyChange& property_change) const;
@@ -74,6 +80,10 @@ class Action {
     size_t CheckAllCommands() const;
 
     bool oneshot() const { return oneshot_; }
+    const std::string& event_trigger() const { return event_trigger_; }
+    const std::map<std::string, std::string>& property_triggers() const {
+        return property_triggers_;
+    }
     const std::string& filename() const { return filename_; }
     int line() const { return line_; }
     static void set_function_map(const BuiltinFunctionMap* function_map) {
@@ -82,6 +92,9 @@ class Action {
 
   private:
     void ExecuteCommand(const Command& command) const;
+    std::size_t ExecuteSubcontextBatch(const std::vector<Command>& commands) const;
+    void LogCommand(const Command& command, android::base::boot_clock::time_point start,
+                    android::base::boot_clock::time_point end, const Result<void>& result) const;
     bool CheckPropertyTriggers(const std::string& name = "",
                                const std::string& value = "") const;
 
@@ -16,8 +16,14 @@
 
 #include "action_manager.h"
 
+#include <algorithm>
+
 #include <android-base/logging.h>
 
+#include "boot_timeline.h"
+
+using android::base::boot_clock;
+
 namespace android {
 namespace init {
 
@@ -37,9 +43,42 @@ ActionManager& ActionManager::GetInstance() {
 }
 
 void ActionManager::AddAction(std::unique_ptr<Action> action) {
+    IndexAction(action.get());
     actions_.emplace_back(std::move(action));
 }
 
+void ActionManager::IndexAction(Action* action) {
+    if (!action->event_trigger().empty()) {
+        event_trigger_actions_[action->event_trigger()].emplace_back(action);
+        return;
+    }
+    // Property changes only trigger actions that have no event trigger.
+    property_actions_.emplace_back(action);
+    for (const auto& [name, value] : action->property_triggers()) {
+        property_trigger_actions_[name].emplace_back(action);
+    }
+}
+
+void ActionManager::UnindexAction(const Action* action) {
+    auto erase_from = [action](auto& map, const std::string& key) {
+        auto it = map.find(key);
+        if (it == map.end()) return;
+        auto& list = it->second;
+        list.erase(std::remove(list.begin(), list.end(), action), list.end());
+        if (list.empty()) map.erase(it);
+    };
+
+    if (!action->event_trigger().empty()) {
+        erase_from(event_trigger_actions_, action->event_trigger());
+        return;
+    }
+    property_actions_.erase(std::remove(property_actions_.begin(), property_actions_.end(), action),
+                            property_actions_.end());
+    for (const auto& [name, value] : action->property_triggers()) {
+        erase_from(property_trigger_actions_, name);
+    }
+}
+
 void ActionManager::QueueEventTrigger(const std::string& trigger) {
     auto lock = std::lock_guard{event_queue_lock_};
     event_queue_.emplace(trigger);
@@ -61,20 +100,49 @@ void ActionManager::QueueBuiltinAction(BuiltinFunction func, const std::string&
     action->AddCommand(std::move(func), {name}, 0);
 
     event_queue_.emplace(action.get());
+    IndexAction(action.get());
+    builtin_actions_.emplace(action.get());
     actions_.emplace_back(std::move(action));
 }
 
+void ActionManager::QueueMatchingActions(const EventTrigger& event_trigger) {
+    auto it = event_trigger_actions_.find(event_trigger);
+    if (it == event_trigger_actions_.end()) return;
+    for (const auto& action : it->second) {
+        if (action->CheckEvent(event_trigger)) {
+            current_executing_actions_.emplace(action);
+        }
+    }
+}
+
+void ActionManager::QueueMatchingActions(const PropertyChange& property_change) {
+    const std::vector<Action*>* actions = &property_actions_;
+    if (!property_change.first.empty()) {
+        auto it = property_trigger_actions_.find(property_change.first);
+        if (it == property_trigger_actions_.end()) return;
+        actions = &it->second;
+    }
+    for (const auto& action : *actions) {
+        if (action->CheckEvent(property_change)) {
+            current_executing_actions_.emplace(action);
+        }
+    }
+}
+
+void ActionManager::QueueMatchingActions(const BuiltinAction& builtin_action) {
+    // The action may already have run and been removed, if an event trigger matched its name.
+    if (builtin_actions_.count(builtin_action) != 0) {
+        current_executing_actions_.emplace(builtin_action);
+    }
+}
+
 void ActionManager::ExecuteOneCommand() {
     {
         auto lock = std::lock_guard{event_queue_lock_};
         // Loop through the event queue until we have an action to execute
         while (current_executing_actions_.empty() && !event_queue_.empty()) {
-            for (const auto& action : actions_) {
-                if (std::visit([&action](const auto& event) { return action->CheckEvent(event); },
-                               event_queue_.front())) {
-                    current_executing_actions_.emplace(action.get());
-                }
-            }
+            std::visit([this](const auto& event) { QueueMatchingActions(event); },
+                       event_queue_.front());
             event_queue_.pop();
         }
     }
@@ -86,21 +154,25 @@ void ActionManager::ExecuteOneCommand() {
     auto action = current_executing_actions_.front();
 
     if (current_command_ == 0) {
+        current_action_start_ = boot_clock::now();
         std::string trigger_name = action->BuildTriggersString();
         LOG(INFO) << "processing action (" << trigger_name << ") from (" << action->filename()
                   << ":" << action->line() << ")";
     }
 
-    action->ExecuteOneCommand(current_command_);
-
     // If this was the last command in the current action, then remove
     // the action from the executing list.
     // If this action was oneshot, then also remove it from actions_.
-    ++current_command_;
+    current_command_ += action->ExecuteOneCommand(current_command_);
     if (current_command_ == action->NumCommands()) {
+        RecordBootEvent(BootEventType::kAction, current_action_start_,
+                        action->BuildTriggersString() + " (" + action->filename() + ":" +
+                                std::to_string(action->line()) + ")");
         current_executing_actions_.pop();
         current_command_ = 0;
         if (action->oneshot()) {
+            UnindexAction(action);
+            builtin_actions_.erase(action);
             auto eraser = [&action](std::unique_ptr<Action>& a) { return a.get() == action; };
             actions_.erase(std::remove_if(actions_.begin(), actions_.end(), eraser),
                            actions_.end());
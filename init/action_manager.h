@@ -16,10 +16,13 @@
 
 #pragma once
 
+#include <map>
 #include <mutex>
+#include <set>
 #include <string>
 #include <vector>
 
+#include <android-base/chrono_utils.h>
 #include <android-base/thread_annotations.h>
 
 #include "action.h"
@@ -50,12 +53,29 @@ class ActionManager {
     ActionManager(ActionManager const&) = delete;
     void operator=(ActionManager const&) = delete;
 
+    void IndexAction(Action* action);
+    void UnindexAction(const Action* action);
+    void QueueMatchingActions(const EventTrigger& event_trigger);
+    void QueueMatchingActions(const PropertyChange& property_change);
+    void QueueMatchingActions(const BuiltinAction& builtin_action);
+
     std::vector<std::unique_ptr<Action>> actions_;
+    // The actions that each event could trigger, so that an event only checks those rather than
+    // every action. Each list is in the same order as actions_, which is the order that actions
+    // run in.
+    std::map<std::string, std::vector<Action*>> event_trigger_actions_;
+    // Actions without an event trigger, by the name of each of their property triggers.
+    std::map<std::string, std::vector<Action*>> property_trigger_actions_;
+    // All actions without an event trigger, for QueueAllPropertyActions().
+    std::vector<Action*> property_actions_;
+    // The builtin actions that haven't run yet.
+    std::set<const Action*> builtin_actions_;
     std::queue<std::variant<EventTrigger, PropertyChange, BuiltinAction>> event_queue_
             GUARDED_BY(event_queue_lock_);
     mutable std::mutex event_queue_lock_;
     std::queue<const Action*> current_executing_actions_;
     std::size_t current_command_;
+    android::base::boot_clock::time_point current_action_start_;
 };
 
 }  // namespace init
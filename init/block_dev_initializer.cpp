@@ -116,29 +116,43 @@ bool BlockDevInitializer::InitDevices(std::set<std::string> devices) {
 
 // Creates "/dev/block/dm-XX" for dm nodes by running coldboot on /sys/block/dm-XX.
 bool BlockDevInitializer::InitDmDevice(const std::string& device) {
-    const std::string device_name(basename(device.c_str()));
-    const std::string syspath = "/sys/block/" + device_name;
-    bool found = false;
+    return InitDmDevices({device});
+}
 
-    auto uevent_callback = [&device_name, &device, this, &found](const Uevent& uevent) {
-        if (uevent.device_name == device_name) {
-            LOG(VERBOSE) << "Creating device-mapper device : " << device;
+// Same as above for several dm nodes, with a single wait for any whose uevents haven't been sent
+// yet, rather than one for each.
+bool BlockDevInitializer::InitDmDevices(std::set<std::string> devices) {
+    std::set<std::string> device_names;
+    for (const auto& device : devices) {
+        device_names.emplace(basename(device.c_str()));
+    }
+
+    auto uevent_callback = [&device_names, this](const Uevent& uevent) {
+        auto iter = device_names.find(uevent.device_name);
+        if (iter != device_names.end()) {
+            LOG(VERBOSE) << "Creating device-mapper device : " << uevent.device_name;
             device_handler_->HandleUevent(uevent);
-            found = true;
-            return ListenerAction::kStop;
+            device_names.erase(iter);
+            if (device_names.empty()) return ListenerAction::kStop;
         }
         return ListenerAction::kContinue;
     };
 
-    uevent_listener_.RegenerateUeventsForPath(syspath, uevent_callback);
-    if (!found) {
-        LOG(INFO) << "dm device '" << device << "' not found in /sys, waiting for its uevent";
+    for (const auto& device : devices) {
+        const std::string device_name(basename(device.c_str()));
+        if (!device_names.count(device_name)) continue;
+        uevent_listener_.RegenerateUeventsForPath("/sys/block/" + device_name, uevent_callback);
+    }
+    if (!device_names.empty()) {
+        LOG(INFO) << "dm device(s) not found in /sys, waiting for their uevent(s): "
+                  << android::base::Join(device_names, ", ");
         Timer t;
         uevent_listener_.Poll(uevent_callback, 10s);
-        LOG(INFO) << "wait for dm device '" << device << "' returned after " << t;
+        LOG(INFO) << "wait for dm device(s) returned after " << t;
     }
-    if (!found) {
-        LOG(ERROR) << "dm device '" << device << "' not found after polling timeout";
+    if (!device_names.empty()) {
+        LOG(ERROR) << "dm device(s) not found after polling timeout: "
+                   << android::base::Join(device_names, ", ");
         return false;
     }
     return true;
@@ -29,6 +29,7 @@ class BlockDevInitializer final {
     bool InitDeviceMapper();
     bool InitDevices(std::set<std::string> devices);
     bool InitDmDevice(const std::string& device);
+    bool InitDmDevices(std::set<std::string> devices);
 
   private:
     ListenerAction HandleUevent(const Uevent& uevent, std::set<std::string>* devices);
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "boot_io.h"
+
+#include <fcntl.h>
+#include <fts.h>
+#include <inttypes.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+
+#include <android-base/file.h>
+#include <android-base/logging.h>
+#include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
+#include <android-base/strings.h>
+#include <android-base/unique_fd.h>
+
+using android::base::ParseUint;
+using android::base::ReadFileToString;
+using android::base::Split;
+using android::base::StartsWith;
+using android::base::StringAppendF;
+using android::base::unique_fd;
+using android::base::WriteStringToFile;
+
+namespace android {
+namespace init {
+
+namespace {
+
+constexpr char kFingerprintPrefix[] = "fingerprint ";
+
+// Appends the runs of pages of |path| that are in the page cache to |ranges|.
+Result<void> AddResidentRanges(const std::string& path, std::vector<BootIoRange>* ranges) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW)));
+    if (fd == -1) {
+        return ErrnoError() << "Unable to open";
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) == -1) {
+        return ErrnoError() << "Unable to stat";
+    }
+    if (sb.st_size == 0) {
+        return {};
+    }
+
+    // Mapping the file does not fault anything in, and mincore() then reports which of its pages
+    // are resident without disturbing the page cache we are trying to observe.
+    size_t size = sb.st_size;
+    void* addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+        return ErrnoError() << "Unable to mmap";
+    }
+    auto unmap = [size](void* p) { munmap(p, size); };
+    std::unique_ptr<void, decltype(unmap)> mapping(addr, unmap);
+
+    size_t page_size = getpagesize();
+    std::vector<unsigned char> resident((size + page_size - 1) / page_size);
+    if (mincore(addr, size, resident.data()) == -1) {
+        return ErrnoError() << "Unable to mincore";
+    }
+
+    for (size_t i = 0; i < resident.size();) {
+        if (!(resident[i] & 1)) {
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        while (i < resident.size() && (resident[i] & 1)) {
+            ++i;
+        }
+        uint64_t offset = uint64_t(start) * page_size;
+        uint64_t end = std::min(uint64_t(i) * page_size, uint64_t(size));
+        ranges->emplace_back(BootIoRange{path, offset, end - offset});
+    }
+    return {};
+}
+
+}  // namespace
+
+Result<void> RecordBootIo(const std::string& path, const std::vector<std::string>& dirs,
+                          const std::string& fingerprint) {
+    std::vector<BootIoRange> ranges;
+    for (const auto& dir : dirs) {
+        char* paths[] = {const_cast<char*>(dir.c_str()), nullptr};
+        std::unique_ptr<FTS, decltype(&fts_close)> fts(
+                fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR | FTS_XDEV, nullptr), fts_close);
+        if (!fts) {
+            return ErrnoError() << "Unable to open directory '" << dir << "'";
+        }
+        for (FTSENT* ftsent = fts_read(fts.get()); ftsent != nullptr;
+             ftsent = fts_read(fts.get())) {
+            if (ftsent->fts_info != FTS_F) {
+                continue;
+            }
+            std::string file = ftsent->fts_accpath;
+            if (auto result = AddResidentRanges(file, &ranges); !result.ok()) {
+                LOG(WARNING) << "Unable to record boot I/O of '" << file << "': "
+                             << result.error();
+            }
+        }
+    }
+
+    std::string contents = kFingerprintPrefix + fingerprint + "\n";
+    for (const auto& range : MergeBootIoRanges(std::move(ranges))) {
+        StringAppendF(&contents, "%" PRIu64 " %" PRIu64 " %s\n", range.offset, range.length,
+                      range.path.c_str());
+    }
+    // Write to a temporary file first, so that a reboot part way through leaves either the old
+    // working set or the new one.
+    std::string temp_path = path + ".tmp";
+    if (!WriteStringToFile(contents, temp_path)) {
+        return ErrnoError() << "Unable to write boot I/O to '" << temp_path << "'";
+    }
+    if (rename(temp_path.c_str(), path.c_str()) == -1) {
+        return ErrnoError() << "Unable to rename '" << temp_path << "' to '" << path << "'";
+    }
+    return {};
+}
+
+Result<std::vector<BootIoRange>> ReadBootIo(const std::string& path,
+                                            const std::string& fingerprint) {
+    std::string contents;
+    if (!ReadFileToString(path, &contents)) {
+        return ErrnoError() << "Unable to read '" << path << "'";
+    }
+    auto lines = Split(contents, "\n");
+    if (lines.empty() || lines[0] != kFingerprintPrefix + fingerprint) {
+        return Error() << "'" << path << "' was recorded for a different build";
+    }
+
+    std::vector<BootIoRange> ranges;
+    for (size_t i = 1; i < lines.size(); ++i) {
+        if (lines[i].empty()) {
+            continue;
+        }
+        // The path comes last, so that it may contain spaces.
+        auto fields = Split(lines[i], " ");
+        BootIoRange range;
+        if (fields.size() < 3 || !ParseUint(fields[0], &range.offset) ||
+            !ParseUint(fields[1], &range.length)) {
+            return Error() << "Malformed line " << i + 1 << " in '" << path << "'";
+        }
+        range.path = lines[i].substr(fields[0].size() + fields[1].size() + 2);
+        ranges.emplace_back(std::move(range));
+    }
+    return ranges;
+}
+
+std::vector<BootIoRange> MergeBootIoRanges(std::vector<BootIoRange> ranges) {
+    std::sort(ranges.begin(), ranges.end(), [](const auto& a, const auto& b) {
+        return a.path != b.path ? a.path < b.path : a.offset < b.offset;
+    });
+
+    std::vector<BootIoRange> merged;
+    for (auto& range : ranges) {
+        if (!merged.empty()) {
+            auto& last = merged.back();
+            uint64_t last_end = last.offset + last.length;
+            if (last.path == range.path && range.offset <= last_end + kBootIoMergeGap) {
+                last.length = std::max(last_end, range.offset + range.length) - last.offset;
+                continue;
+            }
+        }
+        merged.emplace_back(std::move(range));
+    }
+    return merged;
+}
+
+uint64_t ReplayBootIo(const std::vector<BootIoRange>& ranges) {
+    uint64_t bytes = 0;
+    unique_fd fd;
+    const std::string* open_path = nullptr;
+    for (const auto& range : ranges) {
+        // Ranges of the same file are adjacent, so each file is only opened once.
+        if (!open_path || *open_path != range.path) {
+            open_path = &range.path;
+            fd.reset(TEMP_FAILURE_RETRY(open(range.path.c_str(), O_RDONLY | O_CLOEXEC)));
+            if (fd == -1) {
+                PLOG(WARNING) << "Unable to open '" << range.path << "' for readahead";
+            }
+        }
+        if (fd == -1) {
+            continue;
+        }
+        if (readahead(fd, range.offset, range.length) == -1) {
+            PLOG(WARNING) << "Unable to readahead '" << range.path << "'";
+            continue;
+        }
+        bytes += range.length;
+    }
+    return bytes;
+}
+
+}  // namespace init
+}  // namespace android
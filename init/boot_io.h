@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "result.h"
+
+namespace android {
+namespace init {
+
+// The boot working set: the parts of files that were in the page cache once boot completed.
+// record_boot_io writes it out, and readahead_boot_io reads it back on the next boot so that
+// those blocks can be read in large batches as soon as the partitions are mounted, instead of
+// one page fault at a time.
+struct BootIoRange {
+    std::string path;
+    uint64_t offset;
+    uint64_t length;
+};
+
+// Reads that are less than this far apart in the same file are merged into a single readahead,
+// since reading the gap costs less than another round trip to the storage.
+static constexpr uint64_t kBootIoMergeGap = 256 * 1024;
+
+// Records the resident ranges of every regular file under |dirs|, without crossing into other
+// filesystems.  The file starts with |fingerprint| so that a working set is never replayed
+// against a different build.
+Result<void> RecordBootIo(const std::string& path, const std::vector<std::string>& dirs,
+                          const std::string& fingerprint);
+
+// Reads a working set written by RecordBootIo, failing if it was recorded for another build.
+Result<std::vector<BootIoRange>> ReadBootIo(const std::string& path,
+                                            const std::string& fingerprint);
+
+// Sorts |ranges| by file and offset, and merges those less than kBootIoMergeGap apart.
+std::vector<BootIoRange> MergeBootIoRanges(std::vector<BootIoRange> ranges);
+
+// Issues a readahead() for each range, returning the number of bytes requested.
+uint64_t ReplayBootIo(const std::vector<BootIoRange>& ranges);
+
+}  // namespace init
+}  // namespace android
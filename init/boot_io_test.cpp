@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "boot_io.h"
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+using android::base::ReadFileToString;
+using android::base::WriteStringToFile;
+
+namespace android {
+namespace init {
+
+TEST(boot_io, MergeRanges) {
+    std::vector<BootIoRange> ranges = {
+            {"/b", 0, 4096},
+            {"/a", kBootIoMergeGap + 8192, 4096},
+            {"/a", 0, 4096},
+            {"/a", 4096 + kBootIoMergeGap, 4096},
+            {"/a", 1 << 30, 4096},
+    };
+    auto merged = MergeBootIoRanges(ranges);
+    ASSERT_EQ(3u, merged.size());
+    EXPECT_EQ("/a", merged[0].path);
+    EXPECT_EQ(0u, merged[0].offset);
+    EXPECT_EQ(kBootIoMergeGap + 12288, merged[0].length);
+    EXPECT_EQ("/a", merged[1].path);
+    EXPECT_EQ(1u << 30, merged[1].offset);
+    EXPECT_EQ(4096u, merged[1].length);
+    EXPECT_EQ("/b", merged[2].path);
+}
+
+TEST(boot_io, RecordAndReplay) {
+    TemporaryDir dir;
+    std::string file = std::string(dir.path) + "/file with spaces";
+    ASSERT_TRUE(WriteStringToFile(std::string(64 * 1024, 'x'), file));
+    std::string empty = std::string(dir.path) + "/empty";
+    ASSERT_TRUE(WriteStringToFile("", empty));
+    // Bring the whole file into the page cache.
+    std::string contents;
+    ASSERT_TRUE(ReadFileToString(file, &contents));
+
+    TemporaryFile working_set;
+    ASSERT_RESULT_OK(RecordBootIo(working_set.path, {dir.path}, "fingerprint-1"));
+
+    auto ranges = ReadBootIo(working_set.path, "fingerprint-1");
+    ASSERT_RESULT_OK(ranges);
+    ASSERT_EQ(1u, ranges->size());
+    EXPECT_EQ(file, (*ranges)[0].path);
+    EXPECT_EQ(0u, (*ranges)[0].offset);
+    EXPECT_EQ(contents.size(), (*ranges)[0].length);
+
+    EXPECT_EQ(contents.size(), ReplayBootIo(*ranges));
+}
+
+TEST(boot_io, DifferentBuild) {
+    TemporaryDir dir;
+    TemporaryFile working_set;
+    ASSERT_RESULT_OK(RecordBootIo(working_set.path, {dir.path}, "fingerprint-1"));
+    EXPECT_FALSE(ReadBootIo(working_set.path, "fingerprint-2").ok());
+}
+
+TEST(boot_io, Malformed) {
+    TemporaryFile working_set;
+    ASSERT_TRUE(WriteStringToFile("fingerprint a\n0 x /system/lib/libc.so\n", working_set.path));
+    EXPECT_FALSE(ReadBootIo(working_set.path, "a").ok());
+    EXPECT_FALSE(ReadBootIo("/does/not/exist", "a").ok());
+}
+
+}  // namespace init
+}  // namespace android
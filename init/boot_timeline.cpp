@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "boot_timeline.h"
+
+#include <inttypes.h>
+
+#include <mutex>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+
+using android::base::boot_clock;
+using android::base::StringAppendF;
+using android::base::WriteStringToFile;
+
+namespace android {
+namespace init {
+
+namespace {
+
+// Events are recorded from the main thread as well as the property service threads, which
+// report the end of a wait_for_prop.
+std::mutex boot_events_lock;
+std::vector<BootEvent> boot_events;
+size_t next_boot_event = 0;
+
+int64_t ToNs(boot_clock::time_point time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+}  // namespace
+
+const char* BootEventTypeName(BootEventType type) {
+    switch (type) {
+        case BootEventType::kAction:
+            return "action";
+        case BootEventType::kCommand:
+            return "command";
+        case BootEventType::kServiceStart:
+            return "service_start";
+        case BootEventType::kServiceRun:
+            return "service_run";
+        case BootEventType::kExecWait:
+            return "exec_wait";
+        case BootEventType::kWaitForProperty:
+            return "wait_for_prop";
+    }
+    return "unknown";
+}
+
+void RecordBootEvent(BootEventType type, boot_clock::time_point start, std::string name) {
+    RecordBootEvent(type, start, boot_clock::now(), std::move(name));
+}
+
+void RecordBootEvent(BootEventType type, boot_clock::time_point start, boot_clock::time_point end,
+                     std::string name) {
+    auto lock = std::lock_guard{boot_events_lock};
+    BootEvent event = {.type = type, .start = start, .end = end, .name = std::move(name)};
+    if (boot_events.size() < kBootTimelineSize) {
+        boot_events.emplace_back(std::move(event));
+    } else {
+        boot_events[next_boot_event] = std::move(event);
+    }
+    next_boot_event = (next_boot_event + 1) % kBootTimelineSize;
+}
+
+std::vector<BootEvent> GetBootEvents() {
+    auto lock = std::lock_guard{boot_events_lock};
+    if (boot_events.size() < kBootTimelineSize) {
+        return boot_events;
+    }
+    std::vector<BootEvent> events(boot_events.begin() + next_boot_event, boot_events.end());
+    events.insert(events.end(), boot_events.begin(), boot_events.begin() + next_boot_event);
+    return events;
+}
+
+Result<void> WriteBootTimeline(const std::string& path) {
+    std::string timeline;
+    for (const auto& event : GetBootEvents()) {
+        StringAppendF(&timeline, "%s %" PRId64 " %" PRId64 " %s\n", BootEventTypeName(event.type),
+                      ToNs(event.start), ToNs(event.end), event.name.c_str());
+    }
+    if (!WriteStringToFile(timeline, path)) {
+        return ErrnoError() << "Unable to write boot timeline to '" << path << "'";
+    }
+    return {};
+}
+
+}  // namespace init
+}  // namespace android
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <android-base/chrono_utils.h>
+
+#include "result.h"
+
+namespace android {
+namespace init {
+
+// What init spent its time on during boot, kept in a ring of the most recent kBootTimelineSize
+// events so that it costs a fixed amount of memory however long init runs.  The timeline is
+// written out by the write_boot_timeline builtin, and init/boot_timeline.py turns it into the
+// critical path of boot.
+enum class BootEventType {
+    kAction,          // An action, from its first command starting to its last one finishing.
+    kCommand,         // A single command of an action.
+    kServiceStart,    // init starting a service, up to the point the child is let go to exec.
+    kServiceRun,      // A oneshot service, from being started to being reaped.
+    kExecWait,        // The main loop waiting on an exec service, until it is reaped.
+    kWaitForProperty, // The main loop waiting in wait_for_prop.
+};
+
+struct BootEvent {
+    BootEventType type;
+    android::base::boot_clock::time_point start;
+    android::base::boot_clock::time_point end;
+    std::string name;
+};
+
+static constexpr size_t kBootTimelineSize = 4096;
+
+void RecordBootEvent(BootEventType type, android::base::boot_clock::time_point start,
+                     std::string name);
+// As above, for an event that ended before now.
+void RecordBootEvent(BootEventType type, android::base::boot_clock::time_point start,
+                     android::base::boot_clock::time_point end, std::string name);
+// The recorded events, oldest first.
+std::vector<BootEvent> GetBootEvents();
+// Writes one event per line as "<type> <start ns> <end ns> <name>", with boot_clock times.
+Result<void> WriteBootTimeline(const std::string& path);
+
+const char* BootEventTypeName(BootEventType type);
+
+}  // namespace init
+}  // namespace android
@@ -0,0 +1,126 @@
+#!/usr/bin/env python
+
+# Copyright (C) 2020 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Print the critical path of boot from a timeline written by init.
+
+The file is written by the write_boot_timeline builtin, one event per line:
+
+<type> <start ns> <end ns> <name>
+
+init runs actions one at a time, so everything up to the target (by default the
+first action triggered by sys.boot_completed=1) is on the critical path. This
+script splits that time into the commands init ran, the exec services and
+wait_for_prop waits that blocked it, and the time init sat idle until the event
+that queued its next action, and lists the largest of them.
+"""
+
+from __future__ import print_function
+
+import argparse
+import bisect
+import collections
+
+Event = collections.namedtuple('Event', 'type start end name')
+
+
+def read_timeline(path):
+    events = []
+    with open(path) as f:
+        for line in f:
+            fields = line.rstrip('\n').split(' ', 3)
+            if len(fields) != 4:
+                continue
+            events.append(Event(fields[0], int(fields[1]), int(fields[2]), fields[3]))
+    events.sort(key=lambda e: e.start)
+    return events
+
+
+def find_target(actions, target):
+    for action in actions:
+        if target in action.name:
+            return action.start
+    return actions[-1].end if actions else 0
+
+
+def critical_path(events, target_trigger):
+    actions = [e for e in events if e.type == 'action']
+    target = find_target(actions, target_trigger)
+    action_starts = [a.start for a in actions]
+    commands = [e for e in events if e.type == 'command' and e.start < target]
+    waits = [e for e in events if e.type in ('exec_wait', 'wait_for_prop')]
+
+    # init runs one command at a time, so the time between two commands was either spent
+    # blocked on an exec service or wait_for_prop, or idle until the next trigger.
+    segments = []
+    last_end = None
+    for command in commands:
+        if last_end is not None and command.start > last_end:
+            gap = command.start - last_end
+            blockers = [w for w in waits if w.start <= last_end < w.end]
+            if blockers:
+                segments.append((blockers[0].type, gap, last_end, blockers[0].name))
+            else:
+                index = bisect.bisect_right(action_starts, command.start) - 1
+                name = actions[index].name if index >= 0 else 'next command'
+                segments.append(('idle', gap, last_end, 'until ' + name))
+        segments.append(('command', command.end - command.start, command.start, command.name))
+        last_end = command.end
+    if last_end is not None and target > last_end:
+        segments.append(('idle', target - last_end, last_end, 'until ' + target_trigger))
+    return segments, target
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('timeline', help='file written by write_boot_timeline')
+    parser.add_argument('--target', default='sys.boot_completed=1',
+                        help='trigger of the action that marks the end of boot')
+    parser.add_argument('--top', type=int, default=20,
+                        help='number of segments to list')
+    args = parser.parse_args()
+
+    events = read_timeline(args.timeline)
+    segments, target = critical_path(events, args.target)
+    if not segments:
+        print('No actions before %s' % args.target)
+        return
+
+    first = segments[0][2]
+    print('Critical path to %s: %.1f ms' % (args.target, (target - first) / 1e6))
+    totals = collections.Counter()
+    for kind, duration, _, _ in segments:
+        totals[kind] += duration
+    for kind, duration in totals.most_common():
+        print('  %-14s %10.1f ms' % (kind, duration / 1e6))
+
+    print()
+    print('Largest %d segments:' % args.top)
+    for kind, duration, start, name in sorted(segments, key=lambda s: -s[1])[:args.top]:
+        print('  %10.1f ms at %9.1f ms  %-14s %s' % (duration / 1e6, (start - first) / 1e6,
+                                                     kind, name))
+
+    # Events logged with bootstat, when the timeline was merged by bootstat --timeline.
+    milestones = [e for e in events if e.type == 'bootstat' and e.start <= target]
+    if milestones:
+        print()
+        print('Boot events:')
+        for event in milestones:
+            print('  at %9.1f ms  %s' % ((event.start - first) / 1e6, event.name))
+
+
+if __name__ == '__main__':
+    main()
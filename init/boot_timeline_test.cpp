@@ -0,0 +1,67 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "boot_timeline.h"
+
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/strings.h>
+#include <gtest/gtest.h>
+
+using android::base::boot_clock;
+using android::base::ReadFileToString;
+using android::base::Split;
+
+namespace android {
+namespace init {
+
+TEST(boot_timeline, KeepsMostRecentEvents) {
+    auto start = boot_clock::now();
+    for (size_t i = 0; i < kBootTimelineSize + 10; ++i) {
+        RecordBootEvent(BootEventType::kCommand, start, "event " + std::to_string(i));
+    }
+
+    auto events = GetBootEvents();
+    ASSERT_EQ(kBootTimelineSize, events.size());
+    EXPECT_EQ("event 10", events.front().name);
+    EXPECT_EQ("event " + std::to_string(kBootTimelineSize + 9), events.back().name);
+    for (const auto& event : events) {
+        EXPECT_EQ(BootEventType::kCommand, event.type);
+        EXPECT_LE(event.start, event.end);
+    }
+}
+
+TEST(boot_timeline, Write) {
+    RecordBootEvent(BootEventType::kWaitForProperty, boot_clock::now(), "a.b=c d");
+
+    TemporaryFile tf;
+    ASSERT_RESULT_OK(WriteBootTimeline(tf.path));
+    std::string timeline;
+    ASSERT_TRUE(ReadFileToString(tf.path, &timeline));
+    auto lines = Split(timeline, "\n");
+    ASSERT_GE(lines.size(), 2u);
+    EXPECT_EQ("", lines.back());
+    auto fields = Split(lines[lines.size() - 2], " ");
+    ASSERT_EQ(5u, fields.size());
+    EXPECT_EQ("wait_for_prop", fields[0]);
+    EXPECT_LE(std::stoll(fields[1]), std::stoll(fields[2]));
+    EXPECT_EQ("a.b=c", fields[3]);
+    EXPECT_EQ("d", fields[4]);
+}
+
+}  // namespace init
+}  // namespace android
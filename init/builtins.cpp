@@ -68,11 +68,14 @@
 #include <system/thread_defs.h>
 
 #include "action_manager.h"
+#include "boot_io.h"
+#include "boot_timeline.h"
 #include "bootchart.h"
 #include "builtin_arguments.h"
 #include "fscrypt_init_extensions.h"
 #include "init.h"
 #include "mount_namespace.h"
+#include "parallel_restorecon.h"
 #include "parser.h"
 #include "property_service.h"
 #include "reboot.h"
@@ -870,6 +873,10 @@ static Result<void> do_write(const BuiltinArguments& args) {
     return {};
 }
 
+static Result<void> do_write_boot_timeline(const BuiltinArguments& args) {
+    return WriteBootTimeline(args[1]);
+}
+
 static Result<void> readahead_file(const std::string& filename, bool fully) {
     android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(filename.c_str(), O_RDONLY | O_CLOEXEC)));
     if (fd == -1) {
@@ -952,6 +959,52 @@ static Result<void> do_readahead(const BuiltinArguments& args) {
     return {};
 }
 
+// Replays the working set recorded by record_boot_io on a previous boot of the same build.  This
+// runs at normal priority, unlike readahead, since the point is to have the blocks read before
+// the processes that need them fault them in one page at a time.
+static Result<void> do_readahead_boot_io(const BuiltinArguments& args) {
+    auto fingerprint = android::base::GetProperty("ro.build.fingerprint", "");
+    auto ranges = ReadBootIo(args[1], fingerprint);
+    if (!ranges.ok()) {
+        return ErrorIgnoreEnoent() << "Unable to read boot I/O: " << ranges.error();
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        android::base::Timer t;
+        uint64_t bytes = ReplayBootIo(*ranges);
+        LOG(INFO) << "Readahead of " << ranges->size() << " boot I/O ranges (" << bytes
+                  << " bytes) took " << t << " asynchronously";
+        _exit(0);
+    } else if (pid < 0) {
+        return ErrnoError() << "Fork failed";
+    }
+    return {};
+}
+
+static Result<void> do_record_boot_io(const BuiltinArguments& args) {
+    auto fingerprint = android::base::GetProperty("ro.build.fingerprint", "");
+    std::vector<std::string> dirs(args.begin() + 2, args.end());
+
+    // Walking every file of the system partitions takes a while, so do it in the background.
+    pid_t pid = fork();
+    if (pid == 0) {
+        if (setpriority(PRIO_PROCESS, 0, static_cast<int>(ANDROID_PRIORITY_LOWEST)) != 0) {
+            PLOG(WARNING) << "setpriority failed";
+        }
+        android::base::Timer t;
+        if (auto result = RecordBootIo(args[1], dirs, fingerprint); !result.ok()) {
+            LOG(ERROR) << "Unable to record boot I/O: " << result.error();
+            _exit(EXIT_FAILURE);
+        }
+        LOG(INFO) << "Recording boot I/O to " << args[1] << " took " << t;
+        _exit(0);
+    } else if (pid < 0) {
+        return ErrnoError() << "Fork failed";
+    }
+    return {};
+}
+
 static Result<void> do_copy(const BuiltinArguments& args) {
     auto file_contents = ReadFile(args[1]);
     if (!file_contents.ok()) {
@@ -1017,14 +1070,15 @@ static Result<void> do_restorecon(const BuiltinArguments& args) {
 
     const auto& [flag, paths] = *restorecon_info;
 
-    int ret = 0;
+    // The paths are independent, so they can be restored at the same time.
+    ParallelRestorecon restorecon(flag);
     for (const auto& path : paths) {
-        if (selinux_android_restorecon(path.c_str(), flag) < 0) {
-            ret = errno;
-        }
+        restorecon.Add(path);
     }
 
-    if (ret) return ErrnoErrorIgnoreEnoent() << "selinux_android_restorecon() failed";
+    if (int ret = restorecon.Run(DefaultRestoreconThreads())) {
+        return ErrorIgnoreEnoent(ret) << "selinux_android_restorecon() failed";
+    }
     return {};
 }
 
@@ -1305,6 +1359,10 @@ static Result<void> do_perform_apex_config(const BuiltinArguments& args) {
     if (!create_dirs.ok()) {
         return create_dirs.error();
     }
+    if (ApexesKeptAcrossUserspaceReboot()) {
+        // Nothing has changed since the configs were parsed and the linker config generated.
+        return {};
+    }
     auto parse_configs = parse_apex_configs();
     if (!parse_configs.ok()) {
         return parse_configs.error();
@@ -1371,6 +1429,8 @@ const BuiltinFunctionMap& GetBuiltinFunctionMap() {
         {"umount_all",              {0,     1,    {false,  do_umount_all}}},
         {"update_linker_config",    {0,     0,    {false,  do_update_linker_config}}},
         {"readahead",               {1,     2,    {true,   do_readahead}}},
+        {"readahead_boot_io",       {1,     1,    {false,  do_readahead_boot_io}}},
+        {"record_boot_io",          {2,     kMax, {false,  do_record_boot_io}}},
         {"remount_userdata",        {0,     0,    {false,  do_remount_userdata}}},
         {"restart",                 {1,     1,    {false,  do_restart}}},
         {"restorecon",              {1,     kMax, {true,   do_restorecon}}},
@@ -1390,6 +1450,7 @@ const BuiltinFunctionMap& GetBuiltinFunctionMap() {
         {"wait",                    {1,     2,    {true,   do_wait}}},
         {"wait_for_prop",           {2,     2,    {false,  do_wait_for_prop}}},
         {"write",                   {2,     2,    {true,   do_write}}},
+        {"write_boot_timeline",     {1,     1,    {false,  do_write_boot_timeline}}},
     };
     // clang-format on
     return builtin_functions;
@@ -0,0 +1,210 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config_cache.h"
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include <android-base/file.h>
+#include <android-base/unique_fd.h>
+
+using android::base::MappedFile;
+using android::base::unique_fd;
+using android::base::WriteStringToFile;
+
+namespace android {
+namespace init {
+
+namespace {
+
+void AppendUint32(std::string* record, uint32_t value) {
+    record->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Reads a record, taking care not to trust any of the sizes in it.
+class RecordReader {
+  public:
+    RecordReader(const char* data, size_t size) : data_(data), size_(size) {}
+
+    bool ReadUint32(uint32_t* value) {
+        if (size_ - offset_ < sizeof(*value)) return false;
+        memcpy(value, data_ + offset_, sizeof(*value));
+        offset_ += sizeof(*value);
+        return true;
+    }
+
+    bool ReadString(std::string* value) {
+        uint32_t length;
+        if (!ReadUint32(&length) || size_ - offset_ < length) return false;
+        value->assign(data_ + offset_, length);
+        offset_ += length;
+        return true;
+    }
+
+    bool AtEnd() const { return offset_ == size_; }
+
+  private:
+    const char* data_;
+    size_t size_;
+    size_t offset_ = 0;
+};
+
+}  // namespace
+
+uint64_t ConfigCache::Hash(const std::string& contents) {
+    // 64-bit FNV-1a.  The cache is as trusted as the partition it is on, so this only needs to
+    // tell apart versions of a file, not resist anyone crafting collisions.
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : contents) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+Result<void> ConfigCache::Open(const std::string& path) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC)));
+    if (fd == -1) {
+        return ErrnoError() << "open() failed";
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) == -1) {
+        return ErrnoError() << "fstat() failed";
+    }
+    if (static_cast<size_t>(sb.st_size) < sizeof(Header)) {
+        return Error() << "Config cache is too small";
+    }
+    auto mapped_file = MappedFile::FromFd(fd, 0, sb.st_size, PROT_READ);
+    if (!mapped_file) {
+        return ErrnoError() << "mmap() failed";
+    }
+
+    Header header;
+    memcpy(&header, mapped_file->data(), sizeof(header));
+    if (header.magic != kMagic || header.version != kVersion) {
+        return Error() << "Config cache has an unknown format";
+    }
+    if (header.num_entries > (mapped_file->size() - sizeof(Header)) / sizeof(Entry)) {
+        return Error() << "Config cache is truncated";
+    }
+    mapped_file_ = std::move(mapped_file);
+    return {};
+}
+
+const ConfigCache::Entry* ConfigCache::entries() const {
+    return reinterpret_cast<const Entry*>(mapped_file_->data() + sizeof(Header));
+}
+
+size_t ConfigCache::num_entries() const {
+    if (!mapped_file_) return 0;
+    return reinterpret_cast<const Header*>(mapped_file_->data())->num_entries;
+}
+
+std::optional<std::vector<ConfigLine>> ConfigCache::Find(const std::string& contents) const {
+    if (!mapped_file_) return {};
+
+    uint64_t hash = Hash(contents);
+    auto end = entries() + num_entries();
+    auto entry = std::lower_bound(entries(), end, hash, [](const Entry& entry, uint64_t hash) {
+        return entry.hash < hash;
+    });
+    if (entry == end || entry->hash != hash || entry->size != contents.size()) {
+        return {};
+    }
+    if (entry->record_offset > mapped_file_->size() ||
+        entry->record_size > mapped_file_->size() - entry->record_offset) {
+        return {};
+    }
+
+    RecordReader reader(mapped_file_->data() + entry->record_offset, entry->record_size);
+    uint32_t num_lines;
+    if (!reader.ReadUint32(&num_lines)) return {};
+    std::vector<ConfigLine> lines;
+    for (uint32_t i = 0; i < num_lines; ++i) {
+        uint32_t line, num_args;
+        if (!reader.ReadUint32(&line) || !reader.ReadUint32(&num_args) || num_args == 0) {
+            return {};
+        }
+        auto& config_line = lines.emplace_back();
+        config_line.line = line;
+        for (uint32_t j = 0; j < num_args; ++j) {
+            if (!reader.ReadString(&config_line.args.emplace_back())) return {};
+        }
+    }
+    if (!reader.AtEnd()) return {};
+    return lines;
+}
+
+void ConfigCache::Add(const std::string& contents, const std::vector<ConfigLine>& lines) {
+    std::string record;
+    AppendUint32(&record, lines.size());
+    for (const auto& [line, args] : lines) {
+        AppendUint32(&record, line);
+        AppendUint32(&record, args.size());
+        for (const auto& arg : args) {
+            AppendUint32(&record, arg.size());
+            record.append(arg);
+        }
+    }
+    added_[Hash(contents)] = {static_cast<uint32_t>(contents.size()), std::move(record)};
+}
+
+Result<void> ConfigCache::Write(const std::string& path) const {
+    auto records = added_;
+    for (size_t i = 0; i < num_entries(); ++i) {
+        const Entry& entry = entries()[i];
+        if (entry.record_offset > mapped_file_->size() ||
+            entry.record_size > mapped_file_->size() - entry.record_offset) {
+            continue;
+        }
+        // Files that were added again replace what was there before.
+        records.try_emplace(entry.hash, entry.size,
+                            std::string(mapped_file_->data() + entry.record_offset,
+                                        entry.record_size));
+    }
+
+    Header header = {.magic = kMagic,
+                     .version = kVersion,
+                     .num_entries = static_cast<uint32_t>(records.size()),
+                     .reserved = 0};
+    std::string cache(reinterpret_cast<const char*>(&header), sizeof(header));
+    size_t record_offset = sizeof(Header) + records.size() * sizeof(Entry);
+    // std::map keeps the entries sorted by hash, which is what Find() relies on.
+    for (const auto& [hash, record] : records) {
+        Entry entry = {.hash = hash,
+                       .size = record.first,
+                       .record_offset = static_cast<uint32_t>(record_offset),
+                       .record_size = static_cast<uint32_t>(record.second.size()),
+                       .reserved = 0};
+        cache.append(reinterpret_cast<const char*>(&entry), sizeof(entry));
+        record_offset += record.second.size();
+    }
+    for (const auto& [hash, record] : records) {
+        cache.append(record.second);
+    }
+
+    if (!WriteStringToFile(cache, path)) {
+        return ErrnoError() << "Unable to write config cache";
+    }
+    return {};
+}
+
+}  // namespace init
+}  // namespace android
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <map>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <android-base/mapped_file.h>
+
+#include "parser.h"
+#include "result.h"
+
+namespace android {
+namespace init {
+
+// A precompiled form of init's config files: the lines of each file, already tokenized, looked up
+// by a hash of the file's contents.  host_init_verifier builds it at build time, and init maps it
+// so that any .rc file whose contents are in the cache doesn't need to be tokenized again.  A file
+// that changed simply misses the cache and is tokenized as usual.
+//
+// Only the tokenized form is cached.  What the section parsers make of it depends on the device
+// (property expansion, subcontexts, the builtin function map), so that is still done at boot.
+//
+// The file is a header, followed by an array of entries sorted by hash, followed by the records
+// the entries point to.  A record is a uint32_t line count, then for each line a uint32_t line
+// number, a uint32_t argument count, and each argument as a uint32_t length and its characters.
+class ConfigCache {
+  public:
+    static constexpr uint32_t kMagic = 0x43524e49;  // "INRC"
+    static constexpr uint32_t kVersion = 1;
+
+    // Maps an existing cache.  Find() on a cache that couldn't be opened finds nothing.
+    Result<void> Open(const std::string& path);
+    std::optional<std::vector<ConfigLine>> Find(const std::string& contents) const;
+
+    // Adds a file to the cache, which is only written out by Write().  Entries of an opened cache
+    // are written out as well, so that a cache can be built up one file at a time.
+    void Add(const std::string& contents, const std::vector<ConfigLine>& lines);
+    Result<void> Write(const std::string& path) const;
+
+    static uint64_t Hash(const std::string& contents);
+
+  private:
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t num_entries;
+        uint32_t reserved;
+    };
+
+    struct Entry {
+        uint64_t hash;
+        uint32_t size;
+        uint32_t record_offset;
+        uint32_t record_size;
+        uint32_t reserved;
+    };
+
+    const Entry* entries() const;
+    size_t num_entries() const;
+
+    std::unique_ptr<android::base::MappedFile> mapped_file_;
+    // Entries added by Add(), by hash: the size of the file contents and the encoded record.
+    std::map<uint64_t, std::pair<uint32_t, std::string>> added_;
+};
+
+}  // namespace init
+}  // namespace android
@@ -0,0 +1,138 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "config_cache.h"
+
+#include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <gtest/gtest.h>
+
+#include "parser.h"
+
+using android::base::ReadFileToString;
+using android::base::WriteStringToFile;
+
+namespace android {
+namespace init {
+
+namespace {
+
+std::vector<ConfigLine> TokenizeCopy(std::string data) {
+    return Parser::Tokenize(&data);
+}
+
+void ExpectLinesEqual(const std::vector<ConfigLine>& expected,
+                      const std::vector<ConfigLine>& actual) {
+    ASSERT_EQ(expected.size(), actual.size());
+    for (size_t i = 0; i < expected.size(); ++i) {
+        EXPECT_EQ(expected[i].line, actual[i].line);
+        EXPECT_EQ(expected[i].args, actual[i].args);
+    }
+}
+
+const std::string kFirstScript = "on boot\n    setprop a \"b c\"\n\nservice foo /bin/foo\n";
+const std::string kSecondScript = "import /system/etc/init/bar.rc\n";
+
+}  // namespace
+
+TEST(config_cache, RoundTrip) {
+    TemporaryFile tf;
+    auto first_lines = TokenizeCopy(kFirstScript);
+    auto second_lines = TokenizeCopy(kSecondScript);
+
+    ConfigCache writer;
+    writer.Add(kFirstScript, first_lines);
+    writer.Add(kSecondScript, second_lines);
+    ASSERT_RESULT_OK(writer.Write(tf.path));
+
+    ConfigCache reader;
+    ASSERT_RESULT_OK(reader.Open(tf.path));
+    auto found = reader.Find(kFirstScript);
+    ASSERT_TRUE(found);
+    ExpectLinesEqual(first_lines, *found);
+    found = reader.Find(kSecondScript);
+    ASSERT_TRUE(found);
+    ExpectLinesEqual(second_lines, *found);
+}
+
+TEST(config_cache, ChangedContentsMiss) {
+    TemporaryFile tf;
+    ConfigCache writer;
+    writer.Add(kFirstScript, TokenizeCopy(kFirstScript));
+    ASSERT_RESULT_OK(writer.Write(tf.path));
+
+    ConfigCache reader;
+    ASSERT_RESULT_OK(reader.Open(tf.path));
+    EXPECT_FALSE(reader.Find(kFirstScript + "    oneshot\n"));
+    EXPECT_FALSE(reader.Find(kSecondScript));
+}
+
+TEST(config_cache, NotOpened) {
+    ConfigCache cache;
+    EXPECT_FALSE(cache.Open("/does/not/exist").ok());
+    EXPECT_FALSE(cache.Find(kFirstScript));
+}
+
+TEST(config_cache, CorruptCache) {
+    TemporaryFile tf;
+    ConfigCache writer;
+    writer.Add(kFirstScript, TokenizeCopy(kFirstScript));
+    ASSERT_RESULT_OK(writer.Write(tf.path));
+
+    std::string contents;
+    ASSERT_TRUE(ReadFileToString(tf.path, &contents));
+
+    // Every truncation either fails to open or misses, but never returns a partial file.
+    for (size_t size = 0; size < contents.size(); ++size) {
+        ASSERT_TRUE(WriteStringToFile(contents.substr(0, size), tf.path));
+        ConfigCache reader;
+        if (reader.Open(tf.path).ok()) {
+            EXPECT_FALSE(reader.Find(kFirstScript)) << "size " << size;
+        }
+    }
+
+    auto bad_magic = contents;
+    bad_magic[0] ^= 0xff;
+    ASSERT_TRUE(WriteStringToFile(bad_magic, tf.path));
+    ConfigCache reader;
+    EXPECT_FALSE(reader.Open(tf.path).ok());
+}
+
+TEST(config_cache, WriteMergesOpenedCache) {
+    TemporaryFile tf;
+    ConfigCache first;
+    first.Add(kFirstScript, TokenizeCopy(kFirstScript));
+    ASSERT_RESULT_OK(first.Write(tf.path));
+
+    ConfigCache second;
+    ASSERT_RESULT_OK(second.Open(tf.path));
+    second.Add(kSecondScript, TokenizeCopy(kSecondScript));
+    ASSERT_RESULT_OK(second.Write(tf.path));
+
+    ConfigCache reader;
+    ASSERT_RESULT_OK(reader.Open(tf.path));
+    auto found = reader.Find(kFirstScript);
+    ASSERT_TRUE(found);
+    ExpectLinesEqual(TokenizeCopy(kFirstScript), *found);
+    found = reader.Find(kSecondScript);
+    ASSERT_TRUE(found);
+    ExpectLinesEqual(TokenizeCopy(kSecondScript), *found);
+}
+
+}  // namespace init
+}  // namespace android
@@ -23,6 +23,8 @@
 
 #include <chrono>
 #include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <thread>
 
@@ -156,13 +158,76 @@ bool Permissions::Match(const std::string& path) const {
 bool SysfsPermissions::MatchWithSubsystem(const std::string& path,
                                           const std::string& subsystem) const {
     std::string path_basename = Basename(path);
-    if (name().find(subsystem) != std::string::npos) {
+    if (MatchesSubsystem(subsystem)) {
         if (Match("/sys/class/" + subsystem + "/" + path_basename)) return true;
         if (Match("/sys/bus/" + subsystem + "/devices/" + path_basename)) return true;
     }
     return Match(path);
 }
 
+void PermissionsMatcher::Add(size_t index, const Permissions& permissions) {
+    if (permissions.wildcard_) {
+        wildcard_rules_.emplace_back(index, permissions.name_);
+    } else if (permissions.prefix_) {
+        size_t node = 0;
+        for (char c : permissions.name_) {
+            auto it = prefix_trie_[node].children.find(c);
+            if (it == prefix_trie_[node].children.end()) {
+                it = prefix_trie_[node].children.emplace(c, prefix_trie_.size()).first;
+                prefix_trie_.emplace_back();
+            }
+            node = it->second;
+        }
+        prefix_trie_[node].rules.emplace_back(index);
+    } else {
+        exact_rules_[permissions.name_].emplace_back(index);
+    }
+}
+
+std::vector<size_t> PermissionsMatcher::MatchUncached(const std::string& path) const {
+    std::vector<size_t> matches;
+    if (auto it = exact_rules_.find(path); it != exact_rules_.end()) {
+        matches = it->second;
+    }
+
+    size_t node = 0;
+    for (size_t i = 0;; ++i) {
+        const auto& rules = prefix_trie_[node].rules;
+        matches.insert(matches.end(), rules.begin(), rules.end());
+        if (i == path.size()) break;
+        auto it = prefix_trie_[node].children.find(path[i]);
+        if (it == prefix_trie_[node].children.end()) break;
+        node = it->second;
+    }
+
+    for (const auto& [index, pattern] : wildcard_rules_) {
+        if (fnmatch(pattern.c_str(), path.c_str(), FNM_PATHNAME) == 0) {
+            matches.emplace_back(index);
+        }
+    }
+
+    std::sort(matches.begin(), matches.end());
+    return matches;
+}
+
+std::vector<size_t> PermissionsMatcher::Match(const std::string& path) const {
+    {
+        auto lock = std::lock_guard{cache_lock_};
+        if (auto it = cache_.find(path); it != cache_.end()) {
+            return it->second;
+        }
+    }
+
+    auto matches = MatchUncached(path);
+
+    auto lock = std::lock_guard{cache_lock_};
+    if (cache_.size() >= kMaxCachedPaths) {
+        cache_.clear();
+    }
+    cache_.emplace(path, matches);
+    return matches;
+}
+
 void SysfsPermissions::SetPermissions(const std::string& path) const {
     std::string attribute_file = path + "/" + attribute_;
     LOG(VERBOSE) << "fixup " << attribute_file << " " << uid() << " " << gid() << " " << std::oct
@@ -216,8 +281,20 @@ void DeviceHandler::FixupSysPermissions(const std::string& upath,
     // contain, so we prepend it...
     std::string path = "/sys" + upath;
 
-    for (const auto& s : sysfs_permissions_) {
-        if (s.MatchWithSubsystem(path, subsystem)) s.SetPermissions(path);
+    // The same rules, in the same order, as calling MatchWithSubsystem() on each of them.
+    auto matches = sysfs_permissions_matcher_.Match(path);
+    std::string path_basename = Basename(path);
+    for (const auto& subsystem_path : {"/sys/class/" + subsystem + "/" + path_basename,
+                                       "/sys/bus/" + subsystem + "/devices/" + path_basename}) {
+        for (size_t i : sysfs_permissions_matcher_.Match(subsystem_path)) {
+            if (sysfs_permissions_[i].MatchesSubsystem(subsystem)) matches.emplace_back(i);
+        }
+    }
+    std::sort(matches.begin(), matches.end());
+    matches.erase(std::unique(matches.begin(), matches.end()), matches.end());
+
+    for (size_t i : matches) {
+        sysfs_permissions_[i].SetPermissions(path);
     }
 
     if (!skip_restorecon_ && access(path.c_str(), F_OK) == 0) {
@@ -230,17 +307,28 @@ void DeviceHandler::FixupSysPermissions(const std::string& upath,
 
 std::tuple<mode_t, uid_t, gid_t> DeviceHandler::GetDevicePermissions(
     const std::string& path, const std::vector<std::string>& links) const {
-    // Search the perms list in reverse so that ueventd.$hardware can override ueventd.rc.
-    for (auto it = dev_permissions_.crbegin(); it != dev_permissions_.crend(); ++it) {
-        if (it->Match(path) || std::any_of(links.cbegin(), links.cend(),
-                                           [it](const auto& link) { return it->Match(link); })) {
-            return {it->perm(), it->uid(), it->gid()};
+    // Use the last matching rule so that ueventd.$hardware can override ueventd.rc.
+    std::optional<size_t> last_match;
+    auto update_last_match = [this, &last_match](const std::string& path) {
+        auto matches = dev_permissions_matcher_.Match(path);
+        if (!matches.empty() && (!last_match || matches.back() > *last_match)) {
+            last_match = matches.back();
         }
+    };
+    update_last_match(path);
+    for (const auto& link : links) {
+        update_last_match(link);
+    }
+    if (last_match) {
+        const auto& permissions = dev_permissions_[*last_match];
+        return {permissions.perm(), permissions.uid(), permissions.gid()};
     }
     /* Default if nothing found. */
     return {0600, 0, 0};
 }
 
+static std::mutex make_device_lock;
+
 void DeviceHandler::MakeDevice(const std::string& path, bool block, int major, int minor,
                                const std::vector<std::string>& links) const {
     auto[mode, uid, gid] = GetDevicePermissions(path, links);
@@ -256,6 +344,8 @@ void DeviceHandler::MakeDevice(const std::string& path, bool block, int major, i
     }
 
     dev_t dev = makedev(major, minor);
+    // setegid() changes the egid of every thread, so only one thread may have it changed at once.
+    auto lock = std::lock_guard{make_device_lock};
     /* Temporarily change egid to avoid race condition setting the gid of the
      * device node. Unforunately changing the euid would prevent creation of
      * some device nodes, so the uid has to be set with chown() and is still
@@ -518,6 +608,8 @@ DeviceHandler::DeviceHandler(std::vector<Permissions> dev_permissions,
                              bool skip_restorecon)
     : dev_permissions_(std::move(dev_permissions)),
       sysfs_permissions_(std::move(sysfs_permissions)),
+      dev_permissions_matcher_(dev_permissions_),
+      sysfs_permissions_matcher_(sysfs_permissions_),
       subsystems_(std::move(subsystems)),
       boot_devices_(std::move(boot_devices)),
       skip_restorecon_(skip_restorecon),
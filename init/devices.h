@@ -21,8 +21,11 @@
 #include <sys/types.h>
 
 #include <algorithm>
+#include <map>
+#include <mutex>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <android-base/file.h>
@@ -37,6 +40,7 @@ namespace init {
 class Permissions {
   public:
     friend void TestPermissions(const Permissions& expected, const Permissions& test);
+    friend class PermissionsMatcher;
 
     Permissions(const std::string& name, mode_t perm, uid_t uid, gid_t gid);
 
@@ -67,12 +71,52 @@ class SysfsPermissions : public Permissions {
         : Permissions(name, perm, uid, gid), attribute_(attribute) {}
 
     bool MatchWithSubsystem(const std::string& path, const std::string& subsystem) const;
+    // Whether this rule also applies to the /sys/class and /sys/bus paths of |subsystem|.
+    bool MatchesSubsystem(const std::string& subsystem) const {
+        return name().find(subsystem) != std::string::npos;
+    }
     void SetPermissions(const std::string& path) const;
 
   private:
     const std::string attribute_;
 };
 
+// A list of Permissions, compiled so that finding the rules that match a path doesn't mean trying
+// every one of them: rules without a '*' are looked up by path, rules ending in a '*' are found by
+// walking a trie along the path, and only the few rules with a '*' anywhere else go through
+// fnmatch().  Results are cached by path, since the same devices come and go with hotplug.
+class PermissionsMatcher {
+  public:
+    PermissionsMatcher() = default;
+    template <typename T>
+    explicit PermissionsMatcher(const std::vector<T>& permissions) {
+        for (size_t i = 0; i < permissions.size(); ++i) {
+            Add(i, permissions[i]);
+        }
+    }
+
+    // The indices of the rules that match |path|, in increasing order.
+    std::vector<size_t> Match(const std::string& path) const;
+
+  private:
+    static constexpr size_t kMaxCachedPaths = 4096;
+
+    struct TrieNode {
+        std::map<char, size_t> children;
+        std::vector<size_t> rules;
+    };
+
+    void Add(size_t index, const Permissions& permissions);
+    std::vector<size_t> MatchUncached(const std::string& path) const;
+
+    std::unordered_map<std::string, std::vector<size_t>> exact_rules_;
+    std::vector<TrieNode> prefix_trie_ = std::vector<TrieNode>(1);
+    std::vector<std::pair<size_t, std::string>> wildcard_rules_;
+
+    mutable std::mutex cache_lock_;
+    mutable std::unordered_map<std::string, std::vector<size_t>> cache_;
+};
+
 class Subsystem {
   public:
     friend class SubsystemParser;
@@ -134,6 +178,8 @@ class DeviceHandler : public UeventHandler {
 
     std::vector<Permissions> dev_permissions_;
     std::vector<SysfsPermissions> sysfs_permissions_;
+    PermissionsMatcher dev_permissions_matcher_;
+    PermissionsMatcher sysfs_permissions_matcher_;
     std::vector<Subsystem> subsystems_;
     std::set<std::string> boot_devices_;
     bool skip_restorecon_;
@@ -309,5 +309,31 @@ TEST(device_handler, SysfsPermissionsMatchWithSubsystemBus) {
     EXPECT_EQ(1001U, permissions.gid());
 }
 
+TEST(device_handler, PermissionsMatcherMatchesEveryRule) {
+    std::vector<Permissions> permissions = {
+            {"/dev/null", 0666, 0, 0},
+            {"/dev/dri/*", 0666, 0, 1000},
+            {"/dev/d*", 0660, 0, 1000},
+            {"/dev/device*name", 0666, 0, 1000},
+            {"/dev/device*name*", 0666, 0, 1000},
+            {"/dev/null", 0600, 0, 0},
+            {"*", 0600, 0, 0},
+            {"/dev/dri/card0", 0660, 0, 1000},
+    };
+    PermissionsMatcher matcher(permissions);
+
+    for (const auto& path : {"/dev/null", "/dev/nul", "/dev/nullsuffix", "/dev/dri/card0",
+                             "/dev/dri/", "/dev/dr", "/dev/device123name", "/dev/devicename/x",
+                             "/dev/device123namesuffix", "", "/sys/class/input"}) {
+        std::vector<size_t> expected;
+        for (size_t i = 0; i < permissions.size(); ++i) {
+            if (permissions[i].Match(path)) expected.emplace_back(i);
+        }
+        EXPECT_EQ(expected, matcher.Match(path)) << path;
+        // The second lookup comes from the cache.
+        EXPECT_EQ(expected, matcher.Match(path)) << path;
+    }
+}
+
 }  // namespace init
 }  // namespace android
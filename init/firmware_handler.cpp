@@ -21,6 +21,7 @@
 #include <signal.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/sendfile.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -44,19 +45,54 @@ using android::base::WriteFully;
 namespace android {
 namespace init {
 
+// sendfile() may copy less than asked for, so keep going until all of the firmware is sent.  The
+// sysfs data node doesn't support sendfile() on some kernels, which fail it with EINVAL, so the
+// rest is then written from a mapping of the file instead of through a user space buffer.
+static bool CopyFirmware(int fw_fd, size_t fw_size, int data_fd) {
+    size_t sent = 0;
+    while (sent < fw_size) {
+        ssize_t rc = TEMP_FAILURE_RETRY(sendfile(data_fd, fw_fd, nullptr, fw_size - sent));
+        if (rc == -1 && (errno == EINVAL || errno == ENOSYS)) break;
+        if (rc <= 0) {
+            if (rc == 0) errno = EIO;
+            PLOG(ERROR) << "firmware: sendfile failed after " << sent << " of " << fw_size
+                        << " bytes";
+            return false;
+        }
+        sent += rc;
+    }
+    if (sent == fw_size) return true;
+
+    void* map = mmap(nullptr, fw_size, PROT_READ, MAP_PRIVATE, fw_fd, 0);
+    if (map == MAP_FAILED) {
+        PLOG(ERROR) << "firmware: mmap failed";
+        return false;
+    }
+    madvise(map, fw_size, MADV_SEQUENTIAL);
+    bool success = WriteFully(data_fd, static_cast<char*>(map) + sent, fw_size - sent);
+    if (!success) {
+        PLOG(ERROR) << "firmware: write failed";
+    }
+    munmap(map, fw_size);
+    return success;
+}
+
 static void LoadFirmware(const std::string& firmware, const std::string& root, int fw_fd,
                          size_t fw_size, int loading_fd, int data_fd) {
     // Start transfer.
     WriteFully(loading_fd, "1", 1);
 
     // Copy the firmware.
-    int rc = sendfile(data_fd, fw_fd, nullptr, fw_size);
-    if (rc == -1) {
-        PLOG(ERROR) << "firmware: sendfile failed { '" << root << "', '" << firmware << "' }";
+    Timer t;
+    bool success = CopyFirmware(fw_fd, fw_size, data_fd);
+    if (success) {
+        LOG(INFO) << "firmware: copied " << fw_size << " bytes of '" << firmware << "' in " << t;
+    } else {
+        LOG(ERROR) << "firmware: copy failed { '" << root << "', '" << firmware << "' }";
     }
 
     // Tell the firmware whether to abort or commit.
-    const char* response = (rc != -1) ? "0" : "-1";
+    const char* response = success ? "0" : "-1";
     WriteFully(loading_fd, response, strlen(response));
 }
 
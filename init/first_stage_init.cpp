@@ -29,6 +29,7 @@
 
 #include <filesystem>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <android-base/chrono_utils.h>
@@ -98,6 +99,13 @@ bool ForceNormalBoot(const std::string& cmdline) {
     return cmdline.find("androidboot.force_normal_boot=1") != std::string::npos;
 }
 
+bool LoadListedModules(Modprobe& m, bool want_console, bool want_parallel) {
+    if (want_parallel) {
+        return m.LoadModulesParallel(std::thread::hardware_concurrency(), !want_console);
+    }
+    return m.LoadListedModules(!want_console);
+}
+
 }  // namespace
 
 std::string GetModuleLoadList(bool recovery, const std::string& dir_path) {
@@ -114,7 +122,7 @@ std::string GetModuleLoadList(bool recovery, const std::string& dir_path) {
 }
 
 #define MODULE_BASE_DIR "/lib/modules"
-bool LoadKernelModules(bool recovery, bool want_console) {
+bool LoadKernelModules(bool recovery, bool want_console, bool want_parallel) {
     struct utsname uts;
     if (uname(&uts)) {
         LOG(FATAL) << "Failed to get kernel version.";
@@ -155,7 +163,7 @@ bool LoadKernelModules(bool recovery, bool want_console) {
         std::string dir_path = MODULE_BASE_DIR "/";
         dir_path.append(module_dir);
         Modprobe m({dir_path}, GetModuleLoadList(recovery, dir_path));
-        bool retval = m.LoadListedModules(!want_console);
+        bool retval = LoadListedModules(m, want_console, want_parallel);
         int modules_loaded = m.GetModuleCount();
         if (modules_loaded > 0) {
             return retval;
@@ -163,7 +171,7 @@ bool LoadKernelModules(bool recovery, bool want_console) {
     }
 
     Modprobe m({MODULE_BASE_DIR}, GetModuleLoadList(recovery, MODULE_BASE_DIR));
-    bool retval = m.LoadListedModules(!want_console);
+    bool retval = LoadListedModules(m, want_console, want_parallel);
     int modules_loaded = m.GetModuleCount();
     if (modules_loaded > 0) {
         return retval;
@@ -264,7 +272,10 @@ int FirstStageMain(int argc, char** argv) {
 
     auto want_console = ALLOW_FIRST_STAGE_CONSOLE ? FirstStageConsole(cmdline) : 0;
 
-    if (!LoadKernelModules(IsRecoveryMode() && !ForceNormalBoot(cmdline), want_console)) {
+    auto want_parallel =
+            cmdline.find("androidboot.load_modules_parallel=true") != std::string::npos;
+    if (!LoadKernelModules(IsRecoveryMode() && !ForceNormalBoot(cmdline), want_console,
+                           want_parallel)) {
         if (want_console != FirstStageConsoleParam::DISABLED) {
             LOG(ERROR) << "Failed to load kernel modules, starting console";
         } else {
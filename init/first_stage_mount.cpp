@@ -26,6 +26,7 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include <android-base/chrono_utils.h>
@@ -51,6 +52,7 @@
 
 using android::base::ReadFileToString;
 using android::base::Split;
+using android::base::StartsWith;
 using android::base::StringPrintf;
 using android::base::Timer;
 using android::fiemap::IImageManager;
@@ -86,7 +88,9 @@ class FirstStageMount {
 
   protected:
     bool InitRequiredDevices(std::set<std::string> devices);
+    bool InitDmDevice(const std::string& device);
     bool CreateLogicalPartitions();
+    bool SetUpPartition(FstabEntry* entry);
     bool MountPartition(const Fstab::iterator& begin, bool erase_same_mounts,
                         Fstab::iterator* end = nullptr);
 
@@ -115,6 +119,8 @@ class FirstStageMount {
     std::string super_path_;
     std::string super_partition_name_;
     BlockDevInitializer block_dev_init_;
+    // While set, InitDmDevice() adds to this rather than waiting for each device on its own.
+    std::set<std::string>* pending_dm_devices_ = nullptr;
     // Reads all AVB keys before chroot into /system, as they might be used
     // later when mounting other partitions, e.g., /vendor and /product.
     std::map<std::string, std::vector<std::string>> preload_avb_key_blobs_;
@@ -226,6 +232,24 @@ static bool IsStandaloneImageRollback(const AvbHandle& builtin_vbmeta,
     return rollbacked;
 }
 
+// Mounts the first of [begin, end), which all have the same mount point, that mounts.
+static bool MountFirstOf(Fstab::iterator begin, Fstab::iterator end) {
+    bool mounted = (fs_mgr_do_mount_one(*begin) == 0);
+
+    // Try other mounts with the same mount point.
+    for (auto current = begin + 1; !mounted && current != end; current++) {
+        // blk_device is already updated to /dev/dm-<N> by SetUpDmVerity().
+        // Copy it from the begin iterator.
+        current->blk_device = begin->blk_device;
+        mounted = (fs_mgr_do_mount_one(*current) == 0);
+    }
+    return mounted;
+}
+
+static bool IsSameOrUnderMountPoint(const std::string& path, const std::string& mount_point) {
+    return path == mount_point || mount_point == "/" || StartsWith(path, mount_point + "/");
+}
+
 // Class Definitions
 // -----------------
 FirstStageMount::FirstStageMount(Fstab fstab) : need_dm_verity_(false), fstab_(std::move(fstab)) {
@@ -305,6 +329,16 @@ bool FirstStageMount::InitRequiredDevices(std::set<std::string> devices) {
     return block_dev_init_.InitDevices(std::move(devices));
 }
 
+// Creates the node for a dm-verity device that was just set up, or leaves it for
+// MountPartitions() to wait for along with the others.
+bool FirstStageMount::InitDmDevice(const std::string& device) {
+    if (pending_dm_devices_) {
+        pending_dm_devices_->emplace(device);
+        return true;
+    }
+    return block_dev_init_.InitDmDevice(device);
+}
+
 bool FirstStageMount::InitDmLinearBackingDevices(const android::fs_mgr::LpMetadata& metadata) {
     std::set<std::string> devices;
 
@@ -358,6 +392,25 @@ bool FirstStageMount::CreateLogicalPartitions() {
     return android::fs_mgr::CreateLogicalPartitions(*metadata.get(), super_path_);
 }
 
+// Sets up the dm-linear and dm-verity devices for a partition.
+bool FirstStageMount::SetUpPartition(FstabEntry* entry) {
+    if (entry->fs_mgr_flags.logical) {
+        if (!fs_mgr_update_logical_partition(entry)) {
+            return false;
+        }
+        // The logical partitions were created in CreateLogicalPartitions(), so their nodes can
+        // be created right away, and dm-verity needs them to be there.
+        if (!block_dev_init_.InitDmDevice(entry->blk_device)) {
+            return false;
+        }
+    }
+    if (!SetUpDmVerity(entry)) {
+        PLOG(ERROR) << "Failed to setup verity for '" << entry->mount_point << "'";
+        return false;
+    }
+    return true;
+}
+
 bool FirstStageMount::MountPartition(const Fstab::iterator& begin, bool erase_same_mounts,
                                      Fstab::iterator* end) {
     // Sets end to begin + 1, so we can just return on failure below.
@@ -365,31 +418,15 @@ bool FirstStageMount::MountPartition(const Fstab::iterator& begin, bool erase_sa
         *end = begin + 1;
     }
 
-    if (begin->fs_mgr_flags.logical) {
-        if (!fs_mgr_update_logical_partition(&(*begin))) {
-            return false;
-        }
-        if (!block_dev_init_.InitDmDevice(begin->blk_device)) {
-            return false;
-        }
-    }
-    if (!SetUpDmVerity(&(*begin))) {
-        PLOG(ERROR) << "Failed to setup verity for '" << begin->mount_point << "'";
+    if (!SetUpPartition(&(*begin))) {
         return false;
     }
 
-    bool mounted = (fs_mgr_do_mount_one(*begin) == 0);
-
-    // Try other mounts with the same mount point.
     Fstab::iterator current = begin + 1;
-    for (; current != fstab_.end() && current->mount_point == begin->mount_point; current++) {
-        if (!mounted) {
-            // blk_device is already updated to /dev/dm-<N> by SetUpDmVerity() above.
-            // Copy it from the begin iterator.
-            current->blk_device = begin->blk_device;
-            mounted = (fs_mgr_do_mount_one(*current) == 0);
-        }
+    while (current != fstab_.end() && current->mount_point == begin->mount_point) {
+        current++;
     }
+    bool mounted = MountFirstOf(begin, current);
     if (erase_same_mounts) {
         current = fstab_.erase(begin, current);
     }
@@ -492,6 +529,19 @@ bool FirstStageMount::MountPartitions() {
 
     if (!SkipMountingPartitions(&fstab_)) return false;
 
+    // The rest of the partitions are set up first, so that the nodes of all of their dm-verity
+    // devices can be waited for at once, and then mounted concurrently.
+    struct MountGroup {
+        Fstab::iterator begin;
+        Fstab::iterator end;
+        bool set_up = false;
+        bool mounted = false;
+        int mount_errno = 0;
+        size_t depth = 0;
+    };
+    std::vector<MountGroup> groups;
+    std::set<std::string> dm_devices;
+    pending_dm_devices_ = &dm_devices;
     for (auto current = fstab_.begin(); current != fstab_.end();) {
         // We've already mounted /system above.
         if (current->mount_point == "/system") {
@@ -507,20 +557,64 @@ bool FirstStageMount::MountPartitions() {
             continue;
         }
 
-        Fstab::iterator end;
-        if (!MountPartition(current, false /* erase_same_mounts */, &end)) {
-            if (current->fs_mgr_flags.no_fail) {
-                LOG(INFO) << "Failed to mount " << current->mount_point
-                          << ", ignoring mount for no_fail partition";
-            } else if (current->fs_mgr_flags.formattable) {
-                LOG(INFO) << "Failed to mount " << current->mount_point
-                          << ", ignoring mount for formattable partition";
-            } else {
-                PLOG(ERROR) << "Failed to mount " << current->mount_point;
-                return false;
+        auto& group = groups.emplace_back(MountGroup{.begin = current, .end = current + 1});
+        group.set_up = SetUpPartition(&(*current));
+        group.mount_errno = errno;
+        // As in MountPartition(), other mounts with the same mount point are only tried if this
+        // one was set up.
+        while (group.set_up && group.end != fstab_.end() &&
+               group.end->mount_point == current->mount_point) {
+            group.end++;
+        }
+        current = group.end;
+    }
+    pending_dm_devices_ = nullptr;
+    // Partitions whose node doesn't show up fail to mount below, and are handled like any other
+    // mount failure.
+    block_dev_init_.InitDmDevices(std::move(dm_devices));
+
+    // A partition mounted on or under another one's mount point has to wait for it to be mounted,
+    // anything else can be mounted at the same time.
+    size_t max_depth = 0;
+    for (size_t i = 0; i < groups.size(); ++i) {
+        for (size_t j = 0; j < i; ++j) {
+            if (IsSameOrUnderMountPoint(groups[i].begin->mount_point,
+                                        groups[j].begin->mount_point)) {
+                groups[i].depth = std::max(groups[i].depth, groups[j].depth + 1);
             }
         }
-        current = end;
+        max_depth = std::max(max_depth, groups[i].depth);
+    }
+    for (size_t depth = 0; depth <= max_depth; ++depth) {
+        auto mount_group = [](MountGroup* group) {
+            group->mounted = MountFirstOf(group->begin, group->end);
+            group->mount_errno = errno;
+        };
+        std::vector<std::thread> threads;
+        for (auto& group : groups) {
+            if (group.depth != depth || !group.set_up) continue;
+            threads.emplace_back(mount_group, &group);
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    for (const auto& group : groups) {
+        if (group.mounted) continue;
+
+        const auto& entry = *group.begin;
+        if (entry.fs_mgr_flags.no_fail) {
+            LOG(INFO) << "Failed to mount " << entry.mount_point
+                      << ", ignoring mount for no_fail partition";
+        } else if (entry.fs_mgr_flags.formattable) {
+            LOG(INFO) << "Failed to mount " << entry.mount_point
+                      << ", ignoring mount for formattable partition";
+        } else {
+            errno = group.mount_errno;
+            PLOG(ERROR) << "Failed to mount " << entry.mount_point;
+            return false;
+        }
     }
 
     // If we don't see /system or / in the fstab, then we need to create an root entry for
@@ -654,7 +748,7 @@ bool FirstStageMountVBootV1::SetUpDmVerity(FstabEntry* fstab_entry) {
                 // The exact block device name (fstab_rec->blk_device) is changed to
                 // "/dev/block/dm-XX". Needs to create it because ueventd isn't started in init
                 // first stage.
-                return block_dev_init_.InitDmDevice(fstab_entry->blk_device);
+                return InitDmDevice(fstab_entry->blk_device);
             default:
                 return false;
         }
@@ -774,7 +868,7 @@ bool FirstStageMountVBootV2::SetUpDmVerity(FstabEntry* fstab_entry) {
             // The exact block device name (fstab_rec->blk_device) is changed to
             // "/dev/block/dm-XX". Needs to create it because ueventd isn't started in init
             // first stage.
-            return block_dev_init_.InitDmDevice(fstab_entry->blk_device);
+            return InitDmDevice(fstab_entry->blk_device);
         default:
             return false;
     }
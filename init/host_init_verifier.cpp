@@ -39,6 +39,7 @@
 #include "action_manager.h"
 #include "action_parser.h"
 #include "check_builtins.h"
+#include "config_cache.h"
 #include "host_import_parser.h"
 #include "host_init_stubs.h"
 #include "interface_utils.h"
@@ -156,6 +157,7 @@ void PrintUsage() {
                  "\n"
                  "-p FILE\tSearch this passwd file for users and groups\n"
                  "--property_contexts=FILE\t Use this file for property_contexts\n"
+                 "--out_config_cache=FILE\t Add the tokenized script to this config cache\n"
               << std::endl;
 }
 
@@ -200,17 +202,36 @@ void HandlePropertyContexts(const std::string& filename,
     }
 }
 
+// Adds the tokenized form of |path| to the config cache at |cache_path|, creating it if needed.
+Result<void> AddToConfigCache(const std::string& path, const std::string& cache_path) {
+    std::string contents;
+    if (!ReadFileToString(path, &contents)) {
+        return ErrnoError() << "Unable to read '" << path << "'";
+    }
+    std::string data = contents;
+    auto lines = Parser::Tokenize(&data);
+
+    ConfigCache config_cache;
+    // A missing or out of date cache is simply replaced.
+    (void)config_cache.Open(cache_path);
+    config_cache.Add(contents, lines);
+    return config_cache.Write(cache_path);
+}
+
 int main(int argc, char** argv) {
     android::base::InitLogging(argv, &android::base::StdioLogger);
     android::base::SetMinimumLogSeverity(android::base::ERROR);
 
     auto property_infos = std::vector<PropertyInfoEntry>();
+    std::string out_config_cache;
 
     while (true) {
         static const char kPropertyContexts[] = "property-contexts=";
+        static const char kOutConfigCache[] = "out_config_cache";
         static const struct option long_options[] = {
                 {"help", no_argument, nullptr, 'h'},
                 {kPropertyContexts, required_argument, nullptr, 0},
+                {kOutConfigCache, required_argument, nullptr, 0},
                 {nullptr, 0, nullptr, 0},
         };
 
@@ -226,6 +247,9 @@ int main(int argc, char** argv) {
                 if (long_options[option_index].name == kPropertyContexts) {
                     HandlePropertyContexts(optarg, &property_infos);
                 }
+                if (long_options[option_index].name == kOutConfigCache) {
+                    out_config_cache = optarg;
+                }
                 break;
             case 'h':
                 PrintUsage();
@@ -284,6 +308,13 @@ int main(int argc, char** argv) {
                    << " errors";
         return EXIT_FAILURE;
     }
+    if (!out_config_cache.empty()) {
+        if (auto result = AddToConfigCache(*argv, out_config_cache); !result.ok()) {
+            LOG(ERROR) << "Failed to write config cache '" << out_config_cache
+                       << "': " << result.error();
+            return EXIT_FAILURE;
+        }
+    }
     return EXIT_SUCCESS;
 }
 
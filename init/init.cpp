@@ -56,7 +56,9 @@
 #include <selinux/android.h>
 
 #include "action_parser.h"
+#include "boot_timeline.h"
 #include "builtins.h"
+#include "config_cache.h"
 #include "epoll.h"
 #include "first_stage_init.h"
 #include "first_stage_mount.h"
@@ -176,6 +178,9 @@ static class PropWaiterState {
             if (wait_prop_name_ == name && wait_prop_value_ == value) {
                 LOG(INFO) << "Wait for property '" << wait_prop_name_ << "=" << wait_prop_value_
                           << "' took " << *waiting_for_prop_;
+                RecordBootEvent(BootEventType::kWaitForProperty,
+                                boot_clock::now() - waiting_for_prop_->duration(),
+                                name + "=" + value);
                 ResetWaitForPropLocked();
                 WakeMainInitThread();
             }
@@ -246,6 +251,7 @@ static class ShutdownState {
 void DumpState() {
     ServiceList::GetInstance().DumpState();
     ActionManager::GetInstance().DumpState();
+    DumpPropertyServiceState();
 }
 
 Parser CreateParser(ActionManager& action_manager, ServiceList& service_list) {
@@ -269,9 +275,19 @@ Parser CreateServiceOnlyParser(ServiceList& service_list, bool from_apex) {
     return parser;
 }
 
+// Tokenized forms of the .rc files on the system image, written by host_init_verifier.
+static constexpr const char* kConfigCachePath = "/system/etc/init/hw/init.config_cache";
+
 static void LoadBootScripts(ActionManager& action_manager, ServiceList& service_list) {
     Parser parser = CreateParser(action_manager, service_list);
 
+    ConfigCache config_cache;
+    if (auto result = config_cache.Open(kConfigCachePath); result.ok()) {
+        parser.set_config_cache(&config_cache);
+    } else {
+        LOG(INFO) << "Not using config cache " << kConfigCachePath << ": " << result.error();
+    }
+
     std::string bootscript = GetProperty("ro.boot.init_rc", "");
     if (bootscript.empty()) {
         parser.ParseConfig("/system/etc/init/hw/init.rc");
@@ -315,33 +331,25 @@ void PropertyChanged(const std::string& name, const std::string& value) {
 }
 
 static std::optional<boot_clock::time_point> HandleProcessActions() {
-    std::optional<boot_clock::time_point> next_process_action_time;
-    for (const auto& s : ServiceList::GetInstance()) {
+    auto now = boot_clock::now();
+    while (Service* s = Service::TakeDueProcessAction(now)) {
         if ((s->flags() & SVC_RUNNING) && s->timeout_period()) {
             auto timeout_time = s->time_started() + *s->timeout_period();
-            if (boot_clock::now() > timeout_time) {
+            if (now > timeout_time) {
                 s->Timeout();
-            } else {
-                if (!next_process_action_time || timeout_time < *next_process_action_time) {
-                    next_process_action_time = timeout_time;
-                }
             }
         }
 
         if (!(s->flags() & SVC_RESTARTING)) continue;
 
         auto restart_time = s->time_started() + s->restart_period();
-        if (boot_clock::now() > restart_time) {
+        if (now > restart_time) {
             if (auto result = s->Start(); !result.ok()) {
                 LOG(ERROR) << "Could not restart process '" << s->name() << "': " << result.error();
             }
-        } else {
-            if (!next_process_action_time || restart_time < *next_process_action_time) {
-                next_process_action_time = restart_time;
-            }
         }
     }
-    return next_process_action_time;
+    return Service::NextProcessActionTime();
 }
 
 static Result<void> DoControlStart(Service* service) {
@@ -479,6 +487,10 @@ static Result<void> SetupCgroupsAction(const BuiltinArguments&) {
     if (!CgroupSetup()) {
         return ErrnoError() << "Failed to setup cgroups";
     }
+    // Not fatal: without the compiled file, every process parses the JSON files instead.
+    if (!WriteTaskProfilesRcFile()) {
+        LOG(WARNING) << "Failed to compile task profiles";
+    }
 
     return {};
 }
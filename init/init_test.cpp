@@ -18,6 +18,7 @@
 
 #include <android-base/file.h>
 #include <android-base/properties.h>
+#include <android-base/stringprintf.h>
 #include <gtest/gtest.h>
 
 #include "action.h"
@@ -34,6 +35,7 @@
 #include "util.h"
 
 using android::base::GetIntProperty;
+using android::base::StringPrintf;
 
 namespace android {
 namespace init {
@@ -157,6 +159,58 @@ execute_third
     TestInitText(init_script, test_function_map, commands, &service_list);
 }
 
+TEST(init, PropertyTriggerOrder) {
+    std::string init_script =
+            R"init(
+on property:init.test.a=1
+execute 1
+
+on boot && property:init.test.a=1
+execute 100
+
+on property:init.test.b=1
+execute 100
+
+on property:init.test.a=*
+execute 2
+
+on boot
+execute 4
+
+on property:init.test.a=2
+execute 100
+
+on property:init.test.a=1
+execute 3
+
+)init";
+
+    int num_executed = 0;
+    auto execute_command = [&num_executed](const BuiltinArguments& args) {
+        EXPECT_EQ(2U, args.size());
+        EXPECT_EQ(++num_executed, std::stoi(args[1]));
+        return Result<void>{};
+    };
+
+    BuiltinFunctionMap test_function_map = {
+            {"execute", {1, 1, {false, execute_command}}},
+    };
+
+    ActionManagerCommand trigger_a = [](ActionManager& am) {
+        am.QueuePropertyChange("init.test.a", "1");
+    };
+    ActionManagerCommand trigger_c = [](ActionManager& am) {
+        am.QueuePropertyChange("init.test.c", "1");
+    };
+    ActionManagerCommand trigger_boot = [](ActionManager& am) { am.QueueEventTrigger("boot"); };
+    std::vector<ActionManagerCommand> commands{trigger_a, trigger_c, trigger_boot};
+
+    ServiceList service_list;
+    TestInitText(init_script, test_function_map, commands, &service_list);
+
+    EXPECT_EQ(4, num_executed);
+}
+
 TEST(init, OverrideService) {
     std::string init_script = R"init(
 service A something
@@ -242,6 +296,34 @@ TEST(init, EventTriggerOrderMultipleFiles) {
     EXPECT_EQ(6, num_executed);
 }
 
+TEST(init, EventTriggerOrderManyFilesInDir) {
+    // Files in a directory are read in parallel, but must still be parsed in sorted order.
+    TemporaryDir dir;
+    for (int i = 1; i <= 50; ++i) {
+        std::string script = "on boot\nexecute " + std::to_string(i);
+        ASSERT_RESULT_OK(WriteFile(StringPrintf("%s/%02d.rc", dir.path, i), script));
+    }
+
+    int num_executed = 0;
+    auto execute_command = [&num_executed](const BuiltinArguments& args) {
+        EXPECT_EQ(2U, args.size());
+        EXPECT_EQ(++num_executed, std::stoi(args[1]));
+        return Result<void>{};
+    };
+
+    BuiltinFunctionMap test_function_map = {
+            {"execute", {1, 1, {false, execute_command}}},
+    };
+
+    ActionManagerCommand trigger_boot = [](ActionManager& am) { am.QueueEventTrigger("boot"); };
+    std::vector<ActionManagerCommand> commands{trigger_boot};
+
+    ServiceList service_list;
+    TestInit(dir.path, test_function_map, commands, &service_list);
+
+    EXPECT_EQ(50, num_executed);
+}
+
 TEST(init, RejectsCriticalAndOneshotService) {
     if (GetIntProperty("ro.product.first_api_level", 10000) < 30) {
         GTEST_SKIP() << "Test only valid for devices launching with R or later";
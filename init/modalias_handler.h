@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -35,6 +36,9 @@ class ModaliasHandler : public UeventHandler {
     void HandleUevent(const Uevent& uevent) override;
 
   private:
+    // Modprobe keeps track of the modules it loaded, so uevents handled on different threads
+    // during cold boot take turns with it.
+    std::mutex modprobe_lock_;
     Modprobe modprobe_;
 };
 
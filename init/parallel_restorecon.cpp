@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "parallel_restorecon.h"
+
+#include <errno.h>
+
+#include <algorithm>
+#include <thread>
+
+#include <selinux/android.h>
+
+namespace android {
+namespace init {
+
+void ParallelRestorecon::Work() {
+    for (size_t i = next_++; i < paths_.size(); i = next_++) {
+        if (selinux_android_restorecon(paths_[i].c_str(), flags_) < 0) {
+            error_ = errno;
+        }
+    }
+}
+
+int ParallelRestorecon::Run(unsigned int max_threads) {
+    size_t num_threads = std::min<size_t>(std::max(max_threads, 1U), paths_.size());
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; ++i) {
+        threads.emplace_back(&ParallelRestorecon::Work, this);
+    }
+    Work();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    return error_;
+}
+
+unsigned int DefaultRestoreconThreads() {
+    // restorecon is mostly stat() and getxattr() calls, so a few threads are enough to keep the
+    // storage busy.
+    return std::min(std::thread::hardware_concurrency() ?: 4, 8U);
+}
+
+}  // namespace init
+}  // namespace android
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace android {
+namespace init {
+
+// Runs selinux_android_restorecon() over a list of paths on several threads.  Each path is handed
+// to libselinux whole, so the labels, the security.sehash bookkeeping and the special cases for app
+// data and CE storage are exactly those of restoring the paths one after another; only the thread
+// that restores each path differs.  Paths are taken one at a time by whichever thread is free, so
+// one large tree doesn't hold up the rest.
+//
+// Splitting a single tree into its subdirectories is left to callers that know it is safe, such as
+// ueventd for /sys, since libselinux treats some subtrees differently depending on where the walk
+// started.
+class ParallelRestorecon {
+  public:
+    explicit ParallelRestorecon(unsigned int flags) : flags_(flags) {}
+
+    // Queues a path.  Paths must all be added before any thread starts working.
+    void Add(std::string path) { paths_.emplace_back(std::move(path)); }
+    size_t size() const { return paths_.size(); }
+
+    // Restores queued paths until none are left.  Any number of threads may call this at once.
+    void Work();
+
+    // Restores every queued path on up to |max_threads| threads, the calling thread included.
+    // Returns 0, or the errno of a path that failed.
+    int Run(unsigned int max_threads);
+
+    // The errno of a path that failed, or 0.
+    int error() const { return error_; }
+
+  private:
+    const unsigned int flags_;
+    std::vector<std::string> paths_;
+    std::atomic<size_t> next_ = 0;
+    std::atomic<int> error_ = 0;
+};
+
+// The number of threads to restore with when the caller has no better idea.
+unsigned int DefaultRestoreconThreads();
+
+}  // namespace init
+}  // namespace android
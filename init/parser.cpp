@@ -18,18 +18,26 @@
 
 #include <dirent.h>
 
+#include <algorithm>
+#include <atomic>
+#include <thread>
+
 #include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 
+#include "config_cache.h"
 #include "tokenizer.h"
 #include "util.h"
 
 namespace android {
 namespace init {
 
+// Config directories are read by at most this many threads.
+static constexpr size_t kMaxReadThreads = 8;
+
 Parser::Parser() {}
 
 void Parser::AddSectionParser(const std::string& name, std::unique_ptr<SectionParser> parser) {
@@ -40,7 +48,7 @@ void Parser::AddSingleLineParser(const std::string& prefix, LineCallback callbac
     line_callbacks_.emplace_back(prefix, std::move(callback));
 }
 
-void Parser::ParseData(const std::string& filename, std::string* data) {
+std::vector<ConfigLine> Parser::Tokenize(std::string* data) {
     data->push_back('\n');  // TODO: fix tokenizer
     data->push_back('\0');
 
@@ -49,9 +57,46 @@ void Parser::ParseData(const std::string& filename, std::string* data) {
     state.ptr = data->data();
     state.nexttoken = 0;
 
+    std::vector<ConfigLine> lines;
+    std::vector<std::string> args;
+    for (;;) {
+        switch (next_token(&state)) {
+            case T_EOF:
+                return lines;
+            case T_NEWLINE:
+                state.line++;
+                if (args.empty()) break;
+                lines.push_back({state.line, std::move(args)});
+                args.clear();
+                break;
+            case T_TEXT:
+                args.emplace_back(state.text);
+                break;
+        }
+    }
+}
+
+Result<std::vector<ConfigLine>> Parser::ReadConfigFile(const std::string& path) const {
+    auto config_contents = ReadFile(path);
+    if (!config_contents.ok()) {
+        return config_contents.error();
+    }
+    if (config_cache_ != nullptr) {
+        if (auto lines = config_cache_->Find(*config_contents); lines) {
+            return std::move(*lines);
+        }
+    }
+    return Tokenize(&config_contents.value());
+}
+
+void Parser::ParseData(const std::string& filename, std::string* data) {
+    auto lines = Tokenize(data);
+    ParseLines(filename, &lines);
+}
+
+void Parser::ParseLines(const std::string& filename, std::vector<ConfigLine>* lines) {
     SectionParser* section_parser = nullptr;
     int section_start_line = -1;
-    std::vector<std::string> args;
 
     // If we encounter a bad section start, there is no valid parser object to parse the subsequent
     // sections, so we must suppress errors until the next valid section is found.
@@ -70,63 +115,48 @@ void Parser::ParseData(const std::string& filename, std::string* data) {
         section_start_line = -1;
     };
 
-    for (;;) {
-        switch (next_token(&state)) {
-            case T_EOF:
-                end_section();
-
-                for (const auto& [section_name, section_parser] : section_parsers_) {
-                    section_parser->EndFile();
-                }
-
-                return;
-            case T_NEWLINE: {
-                state.line++;
-                if (args.empty()) break;
-                // If we have a line matching a prefix we recognize, call its callback and unset any
-                // current section parsers.  This is meant for /sys/ and /dev/ line entries for
-                // uevent.
-                auto line_callback = std::find_if(
-                    line_callbacks_.begin(), line_callbacks_.end(),
-                    [&args](const auto& c) { return android::base::StartsWith(args[0], c.first); });
-                if (line_callback != line_callbacks_.end()) {
-                    end_section();
-
-                    if (auto result = line_callback->second(std::move(args)); !result.ok()) {
-                        parse_error_count_++;
-                        LOG(ERROR) << filename << ": " << state.line << ": " << result.error();
-                    }
-                } else if (section_parsers_.count(args[0])) {
-                    end_section();
-                    section_parser = section_parsers_[args[0]].get();
-                    section_start_line = state.line;
-                    if (auto result =
-                                section_parser->ParseSection(std::move(args), filename, state.line);
-                        !result.ok()) {
-                        parse_error_count_++;
-                        LOG(ERROR) << filename << ": " << state.line << ": " << result.error();
-                        section_parser = nullptr;
-                        bad_section_found = true;
-                    }
-                } else if (section_parser) {
-                    if (auto result = section_parser->ParseLineSection(std::move(args), state.line);
-                        !result.ok()) {
-                        parse_error_count_++;
-                        LOG(ERROR) << filename << ": " << state.line << ": " << result.error();
-                    }
-                } else if (!bad_section_found) {
-                    parse_error_count_++;
-                    LOG(ERROR) << filename << ": " << state.line
-                               << ": Invalid section keyword found";
-                }
-                args.clear();
-                break;
+    for (auto& [line, args] : *lines) {
+        // If we have a line matching a prefix we recognize, call its callback and unset any
+        // current section parsers.  This is meant for /sys/ and /dev/ line entries for
+        // uevent.
+        auto line_callback = std::find_if(
+            line_callbacks_.begin(), line_callbacks_.end(),
+            [&args](const auto& c) { return android::base::StartsWith(args[0], c.first); });
+        if (line_callback != line_callbacks_.end()) {
+            end_section();
+
+            if (auto result = line_callback->second(std::move(args)); !result.ok()) {
+                parse_error_count_++;
+                LOG(ERROR) << filename << ": " << line << ": " << result.error();
             }
-            case T_TEXT:
-                args.emplace_back(state.text);
-                break;
+        } else if (section_parsers_.count(args[0])) {
+            end_section();
+            section_parser = section_parsers_[args[0]].get();
+            section_start_line = line;
+            if (auto result = section_parser->ParseSection(std::move(args), filename, line);
+                !result.ok()) {
+                parse_error_count_++;
+                LOG(ERROR) << filename << ": " << line << ": " << result.error();
+                section_parser = nullptr;
+                bad_section_found = true;
+            }
+        } else if (section_parser) {
+            if (auto result = section_parser->ParseLineSection(std::move(args), line);
+                !result.ok()) {
+                parse_error_count_++;
+                LOG(ERROR) << filename << ": " << line << ": " << result.error();
+            }
+        } else if (!bad_section_found) {
+            parse_error_count_++;
+            LOG(ERROR) << filename << ": " << line << ": Invalid section keyword found";
         }
     }
+
+    end_section();
+
+    for (const auto& [section_name, section_parser] : section_parsers_) {
+        section_parser->EndFile();
+    }
 }
 
 bool Parser::ParseConfigFileInsecure(const std::string& path) {
@@ -142,13 +172,13 @@ bool Parser::ParseConfigFileInsecure(const std::string& path) {
 bool Parser::ParseConfigFile(const std::string& path) {
     LOG(INFO) << "Parsing file " << path << "...";
     android::base::Timer t;
-    auto config_contents = ReadFile(path);
-    if (!config_contents.ok()) {
-        LOG(INFO) << "Unable to read config file '" << path << "': " << config_contents.error();
+    auto lines = ReadConfigFile(path);
+    if (!lines.ok()) {
+        LOG(INFO) << "Unable to read config file '" << path << "': " << lines.error();
         return false;
     }
 
-    ParseData(path, &config_contents.value());
+    ParseLines(path, &lines.value());
 
     LOG(VERBOSE) << "(Parsing " << path << " took " << t << ".)";
     return true;
@@ -173,10 +203,38 @@ bool Parser::ParseConfigDir(const std::string& path) {
     }
     // Sort first so we load files in a consistent order (bug 31996208)
     std::sort(files.begin(), files.end());
-    for (const auto& file : files) {
-        if (!ParseConfigFile(file)) {
-            LOG(ERROR) << "could not import file '" << file << "'";
+
+    // Reading and tokenizing the files doesn't depend on the order they're parsed in, so it
+    // happens on several threads.  The section parsers then see them one at a time, in order.
+    android::base::Timer t;
+    std::vector<Result<std::vector<ConfigLine>>> file_lines(files.size());
+    std::atomic<size_t> next_file = 0;
+    auto read_files = [&] {
+        for (size_t i; (i = next_file++) < files.size();) {
+            file_lines[i] = ReadConfigFile(files[i]);
+        }
+    };
+    size_t num_threads = std::min<size_t>(
+            {files.size(), std::max(std::thread::hardware_concurrency(), 1U), kMaxReadThreads});
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < num_threads; ++i) {
+        threads.emplace_back(read_files);
+    }
+    read_files();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    LOG(VERBOSE) << "(Reading " << files.size() << " files in " << path << " took " << t << ".)";
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        LOG(INFO) << "Parsing file " << files[i] << "...";
+        if (!file_lines[i].ok()) {
+            LOG(INFO) << "Unable to read config file '" << files[i]
+                      << "': " << file_lines[i].error();
+            LOG(ERROR) << "could not import file '" << files[i] << "'";
+            continue;
         }
+        ParseLines(files[i], &file_lines[i].value());
     }
     return true;
 }
@@ -17,6 +17,7 @@
 #ifndef _INIT_PARSER_H_
 #define _INIT_PARSER_H_
 
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
@@ -48,6 +49,15 @@
 namespace android {
 namespace init {
 
+// A line of a config file, split into its arguments.  Config files are read and tokenized
+// without touching the section parsers, so that this can happen on any thread.
+struct ConfigLine {
+    int line;
+    std::vector<std::string> args;
+};
+
+class ConfigCache;
+
 class SectionParser {
   public:
     virtual ~SectionParser() {}
@@ -81,13 +91,22 @@ class Parser {
 
     size_t parse_error_count() const { return parse_error_count_; }
 
+    // Files whose contents are in the cache aren't tokenized again.  The cache must outlive the
+    // parser.
+    void set_config_cache(const ConfigCache* config_cache) { config_cache_ = config_cache; }
+
+    static std::vector<ConfigLine> Tokenize(std::string* data);
+
   private:
+    Result<std::vector<ConfigLine>> ReadConfigFile(const std::string& path) const;
     void ParseData(const std::string& filename, std::string* data);
+    void ParseLines(const std::string& filename, std::vector<ConfigLine>* lines);
     bool ParseConfigDir(const std::string& path);
 
     std::map<std::string, std::unique_ptr<SectionParser>> section_parsers_;
     std::vector<std::pair<std::string, LineCallback>> line_callbacks_;
     size_t parse_error_count_ = 0;
+    const ConfigCache* config_cache_ = nullptr;
 };
 
 }  // namespace init
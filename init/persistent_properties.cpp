@@ -18,12 +18,16 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <string.h>
 #include <sys/stat.h>
 #include <sys/system_properties.h>
 #include <sys/types.h>
+#include <unistd.h>
 
 #include <memory>
+#include <mutex>
 
+#include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
@@ -31,6 +35,7 @@
 
 #include "util.h"
 
+using android::base::boot_clock;
 using android::base::Dirname;
 using android::base::ReadFdToString;
 using android::base::StartsWith;
@@ -41,11 +46,26 @@ namespace android {
 namespace init {
 
 std::string persistent_property_filename = "/data/property/persistent_properties";
+// Once the journal is larger than this, it is folded into the property file.
+size_t persistent_property_journal_limit = 64 * 1024;
 
 namespace {
 
 constexpr const char kLegacyPersistentPropertyDir[] = "/data/property";
 
+// Properties that were set but not yet committed, and when they have to be committed by.
+// Commits happen on the property service thread, but sets may come from init's main thread too.
+std::mutex persistent_property_lock;
+PersistentProperties pending_properties;
+std::optional<boot_clock::time_point> pending_deadline;
+
+// The properties as they are on disk, i.e. the property file with the journal replayed over it,
+// so that committing doesn't need to read the property file back.
+std::optional<PersistentProperties> committed_properties;
+std::string committed_filename;
+size_t journal_size = 0;
+bool needs_compaction = false;
+
 void AddPersistentProperty(const std::string& name, const std::string& value,
                            PersistentProperties* persistent_properties) {
     auto persistent_property_record = persistent_properties->add_properties();
@@ -53,6 +73,86 @@ void AddPersistentProperty(const std::string& name, const std::string& value,
     persistent_property_record->set_value(value);
 }
 
+void SetPersistentProperty(const std::string& name, const std::string& value,
+                           PersistentProperties* persistent_properties) {
+    auto it = std::find_if(persistent_properties->mutable_properties()->begin(),
+                           persistent_properties->mutable_properties()->end(),
+                           [&name](const auto& record) { return record.name() == name; });
+    if (it != persistent_properties->mutable_properties()->end()) {
+        it->set_value(value);
+    } else {
+        AddPersistentProperty(name, value, persistent_properties);
+    }
+}
+
+std::string JournalFilename() {
+    return persistent_property_filename + ".journal";
+}
+
+size_t JournalSize() {
+    struct stat sb;
+    if (stat(JournalFilename().c_str(), &sb) == -1) {
+        return 0;
+    }
+    return sb.st_size;
+}
+
+Result<void> FsyncPersistentPropertyDirectory() {
+    auto dir = Dirname(persistent_property_filename);
+    auto dir_fd = unique_fd{open(dir.c_str(), O_DIRECTORY | O_RDONLY | O_CLOEXEC)};
+    if (dir_fd < 0) {
+        return ErrnoError() << "Unable to open persistent properties directory for fsync()";
+    }
+    fsync(dir_fd);
+    return {};
+}
+
+// Each journal record is a native endian uint32_t length followed by a serialized
+// PersistentProperties holding every property that was committed together.
+Result<void> AppendPersistentPropertyJournal(const PersistentProperties& persistent_properties) {
+    std::string record;
+    if (!persistent_properties.SerializeToString(&record)) {
+        return Error() << "Unable to serialize properties";
+    }
+    uint32_t record_size = record.size();
+    record.insert(0, reinterpret_cast<const char*>(&record_size), sizeof(record_size));
+
+    const std::string filename = JournalFilename();
+    bool created = false;
+    unique_fd fd(TEMP_FAILURE_RETRY(
+            open(filename.c_str(), O_WRONLY | O_APPEND | O_NOFOLLOW | O_CLOEXEC)));
+    if (fd == -1 && errno == ENOENT) {
+        fd.reset(TEMP_FAILURE_RETRY(open(filename.c_str(),
+                                         O_WRONLY | O_APPEND | O_CREAT | O_NOFOLLOW | O_CLOEXEC,
+                                         0600)));
+        created = true;
+    }
+    if (fd == -1) {
+        return ErrnoError() << "Could not open persistent property journal";
+    }
+
+    struct stat sb;
+    if (fstat(fd, &sb) == -1) {
+        return ErrnoError() << "fstat on persistent property journal failed";
+    }
+    if (!WriteStringToFd(record, fd)) {
+        int saved_errno = errno;
+        // Don't leave a partial record behind for the next one to be appended to.
+        ftruncate(fd, sb.st_size);
+        return Error(saved_errno) << "Unable to write persistent property journal";
+    }
+    if (fdatasync(fd) == -1) {
+        return ErrnoError() << "Unable to sync persistent property journal";
+    }
+    journal_size = sb.st_size + record.size();
+
+    // A new journal is only reachable once its directory entry is on disk as well.
+    if (created) {
+        return FsyncPersistentPropertyDirectory();
+    }
+    return {};
+}
+
 Result<PersistentProperties> LoadLegacyPersistentProperties() {
     std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(kLegacyPersistentPropertyDir), closedir);
     if (!dir) {
@@ -157,6 +257,46 @@ Result<std::string> ReadPersistentPropertyFile() {
 
 }  // namespace
 
+Result<void> ReplayPersistentPropertyJournal(PersistentProperties* persistent_properties) {
+    unique_fd fd(TEMP_FAILURE_RETRY(
+            open(JournalFilename().c_str(), O_RDWR | O_NOFOLLOW | O_CLOEXEC)));
+    if (fd == -1) {
+        if (errno == ENOENT) return {};
+        return ErrnoError() << "Unable to open persistent property journal";
+    }
+    std::string contents;
+    if (!ReadFdToString(fd, &contents)) {
+        return ErrnoError() << "Unable to read persistent property journal";
+    }
+
+    size_t offset = 0;
+    PersistentProperties record;
+    while (contents.size() - offset >= sizeof(uint32_t)) {
+        uint32_t record_size;
+        memcpy(&record_size, contents.data() + offset, sizeof(record_size));
+        if (record_size > contents.size() - offset - sizeof(record_size) ||
+            !record.ParseFromArray(contents.data() + offset + sizeof(record_size), record_size)) {
+            break;
+        }
+        for (const auto& persistent_property_record : record.properties()) {
+            SetPersistentProperty(persistent_property_record.name(),
+                                  persistent_property_record.value(), persistent_properties);
+        }
+        offset += sizeof(record_size) + record_size;
+    }
+
+    if (offset != contents.size()) {
+        // The device went down while the last record was being appended.  None of it was committed,
+        // so drop it, and make sure that the next record isn't appended after it.
+        LOG(WARNING) << "Dropping incomplete persistent property journal record ("
+                     << contents.size() - offset << " bytes)";
+        if (ftruncate(fd, offset) == -1) {
+            return ErrnoError() << "Unable to truncate persistent property journal";
+        }
+    }
+    return {};
+}
+
 Result<PersistentProperties> LoadPersistentPropertyFile() {
     auto file_contents = ReadPersistentPropertyFile();
     if (!file_contents.ok()) return file_contents.error();
@@ -197,42 +337,105 @@ Result<void> WritePersistentPropertyFile(const PersistentProperties& persistent_
     // directories must be fsync()'ed otherwise, the rename is not necessarily written to storage.
     // Note in this case, that the source and destination directories are the same, so only one
     // fsync() is required.
-    auto dir = Dirname(persistent_property_filename);
-    auto dir_fd = unique_fd{open(dir.c_str(), O_DIRECTORY | O_RDONLY | O_CLOEXEC)};
-    if (dir_fd < 0) {
-        return ErrnoError() << "Unable to open persistent properties directory for fsync()";
+    return FsyncPersistentPropertyDirectory();
+}
+
+namespace {
+
+void CommitPersistentPropertiesLocked() {
+    if (pending_properties.properties_size() == 0) {
+        pending_deadline.reset();
+        return;
     }
-    fsync(dir_fd);
 
-    return {};
+    if (!committed_properties || committed_filename != persistent_property_filename) {
+        auto persistent_properties = LoadPersistentPropertyFile();
+        if (persistent_properties.ok()) {
+            if (auto result = ReplayPersistentPropertyJournal(&*persistent_properties);
+                !result.ok()) {
+                LOG(ERROR) << "Could not replay persistent property journal: " << result.error();
+            }
+        } else {
+            LOG(ERROR) << "Recovering persistent properties from memory: "
+                       << persistent_properties.error();
+            persistent_properties = LoadPersistentPropertiesFromMemory();
+            needs_compaction = true;
+        }
+        committed_properties = std::move(*persistent_properties);
+        committed_filename = persistent_property_filename;
+        journal_size = JournalSize();
+    }
+
+    // The whole batch is one journal record, so it survives a reboot either completely or not at
+    // all, and never without the batches that were committed before it.
+    if (auto result = AppendPersistentPropertyJournal(pending_properties); !result.ok()) {
+        LOG(ERROR) << "Could not journal persistent properties: " << result.error();
+        needs_compaction = true;
+    }
+    for (const auto& persistent_property_record : pending_properties.properties()) {
+        SetPersistentProperty(persistent_property_record.name(),
+                              persistent_property_record.value(), &*committed_properties);
+    }
+    pending_properties.Clear();
+    pending_deadline.reset();
+
+    if (!needs_compaction && journal_size <= persistent_property_journal_limit) {
+        return;
+    }
+    // The journal is only emptied once the property file that replaces it is on disk.  Replaying
+    // the journal over that file is harmless, since the file already holds the journal's results.
+    if (auto result = WritePersistentPropertyFile(*committed_properties); !result.ok()) {
+        LOG(ERROR) << "Could not store persistent properties: " << result.error();
+        return;
+    }
+    if (truncate(JournalFilename().c_str(), 0) == -1 && errno != ENOENT) {
+        PLOG(ERROR) << "Unable to truncate persistent property journal";
+        return;
+    }
+    journal_size = 0;
+    needs_compaction = false;
 }
 
-// Persistent properties are not written often, so we rather not keep any data in memory and read
-// then rewrite the persistent property file for each update.
+}  // namespace
+
 void WritePersistentProperty(const std::string& name, const std::string& value) {
-    auto persistent_properties = LoadPersistentPropertyFile();
+    auto lock = std::lock_guard{persistent_property_lock};
+    SetPersistentProperty(name, value, &pending_properties);
+    if (!pending_deadline) {
+        pending_deadline = boot_clock::now() + kPersistentPropertyCommitDelay;
+    }
+}
 
-    if (!persistent_properties.ok()) {
-        LOG(ERROR) << "Recovering persistent properties from memory: "
-                   << persistent_properties.error();
-        persistent_properties = LoadPersistentPropertiesFromMemory();
+std::optional<std::chrono::milliseconds> PersistentPropertyCommitTimeout() {
+    auto lock = std::lock_guard{persistent_property_lock};
+    if (!pending_deadline) {
+        return std::nullopt;
     }
-    auto it = std::find_if(persistent_properties->mutable_properties()->begin(),
-                           persistent_properties->mutable_properties()->end(),
-                           [&name](const auto& record) { return record.name() == name; });
-    if (it != persistent_properties->mutable_properties()->end()) {
-        it->set_name(name);
-        it->set_value(value);
-    } else {
-        AddPersistentProperty(name, value, &persistent_properties.value());
+    auto now = boot_clock::now();
+    if (*pending_deadline <= now) {
+        return std::chrono::milliseconds::zero();
     }
+    // Round up, so that the caller doesn't wake up just before the deadline.
+    return std::chrono::ceil<std::chrono::milliseconds>(*pending_deadline - now);
+}
 
-    if (auto result = WritePersistentPropertyFile(*persistent_properties); !result.ok()) {
-        LOG(ERROR) << "Could not store persistent property: " << result.error();
+void CommitPersistentProperties() {
+    auto lock = std::lock_guard{persistent_property_lock};
+    if (pending_deadline && *pending_deadline <= boot_clock::now()) {
+        CommitPersistentPropertiesLocked();
     }
 }
 
+void FlushPersistentProperties() {
+    auto lock = std::lock_guard{persistent_property_lock};
+    CommitPersistentPropertiesLocked();
+}
+
 PersistentProperties LoadPersistentProperties() {
+    auto lock = std::lock_guard{persistent_property_lock};
+    // Anything that was set before has to be read back.
+    CommitPersistentPropertiesLocked();
+
     auto persistent_properties = LoadPersistentPropertyFile();
 
     if (!persistent_properties.ok()) {
@@ -242,9 +445,9 @@ PersistentProperties LoadPersistentProperties() {
         if (!persistent_properties.ok()) {
             LOG(ERROR) << "Unable to load legacy persistent properties: "
                        << persistent_properties.error();
-            return {};
-        }
-        if (auto result = WritePersistentPropertyFile(*persistent_properties); result.ok()) {
+            // Fall through so that we still set the properties that are in the journal.
+            persistent_properties = PersistentProperties{};
+        } else if (auto result = WritePersistentPropertyFile(*persistent_properties); result.ok()) {
             RemoveLegacyPersistentPropertyFiles();
         } else {
             LOG(ERROR) << "Unable to write single persistent property file: " << result.error();
@@ -252,6 +455,13 @@ PersistentProperties LoadPersistentProperties() {
         }
     }
 
+    if (auto result = ReplayPersistentPropertyJournal(&*persistent_properties); !result.ok()) {
+        LOG(ERROR) << "Could not replay persistent property journal: " << result.error();
+    }
+    committed_properties = *persistent_properties;
+    committed_filename = persistent_property_filename;
+    journal_size = JournalSize();
+
     return *persistent_properties;
 }
 
@@ -17,6 +17,8 @@
 #ifndef _INIT_PERSISTENT_PROPERTIES_H
 #define _INIT_PERSISTENT_PROPERTIES_H
 
+#include <chrono>
+#include <optional>
 #include <string>
 
 #include "result.h"
@@ -26,12 +28,29 @@ namespace android {
 namespace init {
 
 PersistentProperties LoadPersistentProperties();
+
+// Persistent properties are written behind: WritePersistentProperty() only queues the new value,
+// and everything queued within kPersistentPropertyCommitDelay is appended to a journal next to the
+// property file as a single record, with a single fdatasync().  The journal is folded back into the
+// property file once it grows large.  Records are committed in the order the properties were set,
+// so after a reboot the properties reflect some prefix of the sets that were made.
 void WritePersistentProperty(const std::string& name, const std::string& value);
+// Returns how long the caller may wait before calling CommitPersistentProperties(), or
+// std::nullopt if nothing is queued.
+std::optional<std::chrono::milliseconds> PersistentPropertyCommitTimeout();
+// Commits the queued properties if their commit delay has passed.
+void CommitPersistentProperties();
+// Commits the queued properties immediately, e.g. before a reboot.
+void FlushPersistentProperties();
+
+constexpr std::chrono::milliseconds kPersistentPropertyCommitDelay = std::chrono::milliseconds(100);
 
 // Exposed only for testing
 Result<PersistentProperties> LoadPersistentPropertyFile();
 Result<void> WritePersistentPropertyFile(const PersistentProperties& persistent_properties);
+Result<void> ReplayPersistentPropertyJournal(PersistentProperties* persistent_properties);
 extern std::string persistent_property_filename;
+extern size_t persistent_property_journal_limit;
 
 }  // namespace init
 }  // namespace android
@@ -17,6 +17,8 @@
 #include "persistent_properties.h"
 
 #include <errno.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <vector>
 
@@ -155,5 +157,121 @@ TEST(persistent_properties, UpdatePropertyBadParse) {
     EXPECT_FALSE(it == read_back_properties.properties().end());
 }
 
+TEST(persistent_properties, JournalCoalescesSets) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    persistent_property_filename = tf.path;
+    auto journal_filename = persistent_property_filename + ".journal";
+
+    std::vector<std::pair<std::string, std::string>> persistent_properties = {
+        {"persist.sys.timezone", "America/Los_Angeles"},
+    };
+    ASSERT_RESULT_OK(
+            WritePersistentPropertyFile(VectorToPersistentProperties(persistent_properties)));
+
+    WritePersistentProperty("persist.sys.locale", "en-US");
+    WritePersistentProperty("persist.test.numbers", "1234567890");
+    WritePersistentProperty("persist.sys.locale", "pt-BR");
+    auto timeout = PersistentPropertyCommitTimeout();
+    ASSERT_TRUE(timeout.has_value());
+    EXPECT_LE(*timeout, kPersistentPropertyCommitDelay);
+
+    FlushPersistentProperties();
+    EXPECT_FALSE(PersistentPropertyCommitTimeout().has_value());
+
+    // All three sets were committed as a single journal record.
+    std::string journal;
+    ASSERT_TRUE(android::base::ReadFileToString(journal_filename, &journal));
+    ASSERT_GT(journal.size(), sizeof(uint32_t));
+    uint32_t record_size;
+    memcpy(&record_size, journal.data(), sizeof(record_size));
+    EXPECT_EQ(journal.size(), sizeof(record_size) + record_size);
+
+    // The property file itself is left alone until the journal is compacted.
+    auto property_file = LoadPersistentPropertyFile();
+    ASSERT_RESULT_OK(property_file);
+    CheckPropertiesEqual(persistent_properties, *property_file);
+
+    std::vector<std::pair<std::string, std::string>> persistent_properties_expected = {
+        {"persist.sys.timezone", "America/Los_Angeles"},
+        {"persist.sys.locale", "pt-BR"},
+        {"persist.test.numbers", "1234567890"},
+    };
+    CheckPropertiesEqual(persistent_properties_expected, LoadPersistentProperties());
+
+    unlink(journal_filename.c_str());
+}
+
+TEST(persistent_properties, JournalCompaction) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    persistent_property_filename = tf.path;
+    auto journal_filename = persistent_property_filename + ".journal";
+
+    std::vector<std::pair<std::string, std::string>> persistent_properties = {
+        {"persist.sys.timezone", "America/Los_Angeles"},
+    };
+    ASSERT_RESULT_OK(
+            WritePersistentPropertyFile(VectorToPersistentProperties(persistent_properties)));
+    LoadPersistentProperties();
+
+    auto saved_journal_limit = persistent_property_journal_limit;
+    persistent_property_journal_limit = 0;
+    WritePersistentProperty("persist.sys.locale", "pt-BR");
+    FlushPersistentProperties();
+    persistent_property_journal_limit = saved_journal_limit;
+
+    std::string journal;
+    ASSERT_TRUE(android::base::ReadFileToString(journal_filename, &journal));
+    EXPECT_TRUE(journal.empty());
+
+    std::vector<std::pair<std::string, std::string>> persistent_properties_expected = {
+        {"persist.sys.timezone", "America/Los_Angeles"},
+        {"persist.sys.locale", "pt-BR"},
+    };
+    auto property_file = LoadPersistentPropertyFile();
+    ASSERT_RESULT_OK(property_file);
+    CheckPropertiesEqual(persistent_properties_expected, *property_file);
+
+    unlink(journal_filename.c_str());
+}
+
+TEST(persistent_properties, JournalIncompleteRecord) {
+    TemporaryFile tf;
+    ASSERT_TRUE(tf.fd != -1);
+    persistent_property_filename = tf.path;
+    auto journal_filename = persistent_property_filename + ".journal";
+
+    ASSERT_RESULT_OK(WritePersistentPropertyFile(PersistentProperties{}));
+    LoadPersistentProperties();
+
+    WritePersistentProperty("persist.sys.locale", "pt-BR");
+    FlushPersistentProperties();
+
+    std::string journal;
+    ASSERT_TRUE(android::base::ReadFileToString(journal_filename, &journal));
+    auto complete_size = journal.size();
+
+    // Simulate a device that went down in the middle of appending a second record.
+    std::string incomplete_record = journal.substr(0, complete_size - 1);
+    ASSERT_TRUE(android::base::WriteStringToFile(journal + incomplete_record, journal_filename));
+
+    std::vector<std::pair<std::string, std::string>> persistent_properties_expected = {
+        {"persist.sys.locale", "pt-BR"},
+    };
+    CheckPropertiesEqual(persistent_properties_expected, LoadPersistentProperties());
+
+    ASSERT_TRUE(android::base::ReadFileToString(journal_filename, &journal));
+    EXPECT_EQ(complete_size, journal.size());
+
+    // New records are appended after the last complete one.
+    WritePersistentProperty("persist.sys.timezone", "America/Los_Angeles");
+    FlushPersistentProperties();
+    persistent_properties_expected.emplace_back("persist.sys.timezone", "America/Los_Angeles");
+    CheckPropertiesEqual(persistent_properties_expected, LoadPersistentProperties());
+
+    unlink(journal_filename.c_str());
+}
+
 }  // namespace init
 }  // namespace android
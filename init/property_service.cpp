@@ -39,11 +39,16 @@
 #define _REALLY_INCLUDE_SYS__SYSTEM_PROPERTIES_H_
 #include <sys/_system_properties.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <queue>
+#include <set>
 #include <thread>
 #include <vector>
 
@@ -54,6 +59,7 @@
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
+#include <cutils/properties.h>
 #include <property_info_parser/property_info_parser.h>
 #include <property_info_serializer/property_info_serializer.h>
 #include <selinux/android.h>
@@ -63,6 +69,7 @@
 #include "debug_ramdisk.h"
 #include "epoll.h"
 #include "init.h"
+#include "parallel_restorecon.h"
 #include "persistent_properties.h"
 #include "property_type.h"
 #include "proto_utils.h"
@@ -92,7 +99,7 @@ using android::sysprop::InitProperties::is_userspace_reboot_supported;
 namespace android {
 namespace init {
 
-static bool persistent_properties_loaded = false;
+static std::atomic<bool> persistent_properties_loaded = false;
 
 static int property_set_fd = -1;
 static int from_init_socket = -1;
@@ -103,6 +110,11 @@ static std::thread property_service_thread;
 
 static PropertyInfoAreaFile property_info_area;
 
+// Properties are set from several threads, see PropertySetDispatcher.
+static std::mutex property_area_lock;
+// libselinux's AVC isn't set up for concurrent use.
+static std::mutex selinux_check_access_lock;
+
 struct PropertyAuditData {
     const ucred* cr;
     const char* name;
@@ -144,24 +156,74 @@ bool CanReadProperty(const std::string& source_context, const std::string& name)
     ucred cr = {.pid = 0, .uid = 0, .gid = 0};
     audit_data.cr = &cr;
 
+    auto lock = std::lock_guard{selinux_check_access_lock};
     return selinux_check_access(source_context.c_str(), target_context, "file", "read",
                                 &audit_data) == 0;
 }
 
+// Remembers which (source context, target context) pairs have been allowed property_service:set,
+// the only permission that property sets are checked for, so that properties that are written
+// over and over don't each go through selinux_check_access().  Denials aren't cached, so that
+// every one of them is still audited.  The cache is dropped whenever the policy is reloaded or the
+// enforcing mode changes.
+class MacPermsCache {
+  public:
+    bool IsAllowed(const char* source_context, const char* target_context) {
+        auto lock = std::lock_guard{lock_};
+        // selinux_status_updated() returns 1 if the status changed, and < 0 if it can't tell.
+        if (selinux_status_updated() != 0) {
+            allowed_.clear();
+        }
+        if (allowed_.count({source_context, target_context}) > 0) {
+            ++hits_;
+            return true;
+        }
+        ++misses_;
+        return false;
+    }
+
+    void Allow(const char* source_context, const char* target_context) {
+        auto lock = std::lock_guard{lock_};
+        allowed_.emplace(source_context, target_context);
+    }
+
+    void DumpState() {
+        auto lock = std::lock_guard{lock_};
+        LOG(INFO) << "SELinux property set cache: " << allowed_.size() << " entries, " << hits_
+                  << " hits, " << misses_ << " misses";
+    }
+
+  private:
+    std::mutex lock_;
+    std::set<std::pair<std::string, std::string>> allowed_;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
+
+static MacPermsCache mac_perms_cache;
+
 static bool CheckMacPerms(const std::string& name, const char* target_context,
                           const char* source_context, const ucred& cr) {
     if (!target_context || !source_context) {
         return false;
     }
 
+    if (mac_perms_cache.IsAllowed(source_context, target_context)) {
+        return true;
+    }
+
     PropertyAuditData audit_data;
 
     audit_data.name = name.c_str();
     audit_data.cr = &cr;
 
+    auto lock = std::lock_guard{selinux_check_access_lock};
     bool has_access = (selinux_check_access(source_context, target_context, "property_service",
                                             "set", &audit_data) == 0);
 
+    if (has_access) {
+        mac_perms_cache.Allow(source_context, target_context);
+    }
     return has_access;
 }
 
@@ -178,20 +240,24 @@ static uint32_t PropertySet(const std::string& name, const std::string& value, s
         return PROP_ERROR_INVALID_VALUE;
     }
 
-    prop_info* pi = (prop_info*) __system_property_find(name.c_str());
-    if (pi != nullptr) {
-        // ro.* properties are actually "write-once", unless the system decides to
-        if (StartsWith(name, "ro.") && !weaken_prop_override_security) {
-            *error = "Read-only property was already set";
-            return PROP_ERROR_READ_ONLY_PROPERTY;
-        }
+    {
+        // The property area only supports a single writer at a time.
+        auto lock = std::lock_guard{property_area_lock};
+        prop_info* pi = (prop_info*) __system_property_find(name.c_str());
+        if (pi != nullptr) {
+            // ro.* properties are actually "write-once", unless the system decides to
+            if (StartsWith(name, "ro.") && !weaken_prop_override_security) {
+                *error = "Read-only property was already set";
+                return PROP_ERROR_READ_ONLY_PROPERTY;
+            }
 
-        __system_property_update(pi, value.c_str(), valuelen);
-    } else {
-        int rc = __system_property_add(name.c_str(), name.size(), value.c_str(), valuelen);
-        if (rc < 0) {
-            *error = "__system_property_add failed";
-            return PROP_ERROR_SET_FAILED;
+            __system_property_update(pi, value.c_str(), valuelen);
+        } else {
+            int rc = __system_property_add(name.c_str(), name.size(), value.c_str(), valuelen);
+            if (rc < 0) {
+                *error = "__system_property_add failed";
+                return PROP_ERROR_SET_FAILED;
+            }
         }
     }
 
@@ -199,6 +265,9 @@ static uint32_t PropertySet(const std::string& name, const std::string& value, s
     // properties to prevent them from being overwritten by default values.
     if (persistent_properties_loaded && StartsWith(name, "persist.")) {
         WritePersistentProperty(name, value);
+    } else if (name == "sys.powerctl") {
+        // Don't leave persistent properties that were set right before a reboot behind.
+        FlushPersistentProperties();
     }
     // If init hasn't started its main loop, then it won't be handling property changed messages
     // anyway, so there's no need to try to send them.
@@ -209,14 +278,16 @@ static uint32_t PropertySet(const std::string& name, const std::string& value, s
     return PROP_SUCCESS;
 }
 
+// Restores each requested path on its own thread, up to DefaultRestoreconThreads() at a time, so
+// that a large tree doesn't hold up the paths requested after it.
 class AsyncRestorecon {
   public:
     void TriggerRestorecon(const std::string& path) {
         auto guard = std::lock_guard{mutex_};
         paths_.emplace(path);
 
-        if (!thread_started_) {
-            thread_started_ = true;
+        if (threads_started_ < DefaultRestoreconThreads()) {
+            threads_started_++;
             std::thread{&AsyncRestorecon::ThreadFunction, this}.detach();
         }
     }
@@ -237,12 +308,12 @@ class AsyncRestorecon {
             lock.lock();
         }
 
-        thread_started_ = false;
+        threads_started_--;
     }
 
     std::mutex mutex_;
     std::queue<std::string> paths_;
-    bool thread_started_ = false;
+    unsigned int threads_started_ = 0;
 };
 
 class SocketConnection {
@@ -292,6 +363,15 @@ class SocketConnection {
         return result == sizeof(value);
     }
 
+    bool SendUint32s(const std::vector<uint32_t>& values) {
+        if (!socket_.ok()) {
+            return true;
+        }
+        size_t size = values.size() * sizeof(uint32_t);
+        ssize_t result = TEMP_FAILURE_RETRY(send(socket_, values.data(), size, 0));
+        return result == static_cast<ssize_t>(size);
+    }
+
     bool GetSourceContext(std::string* source_context) const {
         char* c_source_context = nullptr;
         if (getpeercon(socket_, &c_source_context) != 0) {
@@ -379,6 +459,99 @@ class SocketConnection {
     DISALLOW_IMPLICIT_CONSTRUCTORS(SocketConnection);
 };
 
+// Sets properties on a small pool of threads, so that a slow set, such as one that has to wait for
+// SELinux or for a control message to be queued, doesn't hold up the sets of unrelated properties.
+// All sets of one property go to the same thread, so they happen in the order they were received.
+// Sets of different properties may happen in any order.
+class PropertySetDispatcher {
+  public:
+    void Start(size_t num_threads) {
+        for (size_t i = 0; i < num_threads; ++i) {
+            auto worker = std::make_unique<Worker>();
+            std::thread(&PropertySetDispatcher::Run, worker.get()).detach();
+            workers_.emplace_back(std::move(worker));
+        }
+    }
+
+    void Dispatch(const std::string& name, std::function<void()> set) {
+        if (workers_.empty()) {
+            set();
+            return;
+        }
+        auto& worker = *workers_[std::hash<std::string>{}(name) % workers_.size()];
+        auto lock = std::lock_guard{worker.lock};
+        worker.queue.emplace(std::move(set));
+        worker.max_depth = std::max(worker.max_depth, worker.queue.size());
+        worker.cv.notify_one();
+    }
+
+    void DumpState() {
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            auto& worker = *workers_[i];
+            auto lock = std::lock_guard{worker.lock};
+            LOG(INFO) << "Property set thread " << i << ": " << worker.queue.size()
+                      << " queued, " << worker.max_depth << " queued at most, " << worker.handled
+                      << " handled";
+        }
+    }
+
+  private:
+    struct Worker {
+        std::mutex lock;
+        std::condition_variable cv;
+        std::queue<std::function<void()>> queue;
+        size_t max_depth = 0;
+        uint64_t handled = 0;
+    };
+
+    static void Run(Worker* worker) {
+        auto lock = std::unique_lock{worker->lock};
+        while (true) {
+            worker->cv.wait(lock, [worker] { return !worker->queue.empty(); });
+            auto set = std::move(worker->queue.front());
+            worker->queue.pop();
+            lock.unlock();
+            set();
+            lock.lock();
+            ++worker->handled;
+        }
+    }
+
+    // Workers are never destroyed, since their threads run as long as init does.
+    std::vector<std::unique_ptr<Worker>> workers_;
+};
+
+static constexpr size_t kPropertySetThreads = 4;
+static PropertySetDispatcher property_set_dispatcher;
+
+// A PROP_MSG_SETPROP_BATCH request whose properties are being set by the dispatcher.  Whichever
+// thread sets the last of them sends the results.
+class BatchPropertySet {
+  public:
+    BatchPropertySet(std::shared_ptr<SocketConnection> socket, size_t count)
+        : socket_(std::move(socket)), results_(count + 1, PROP_SUCCESS), remaining_(count) {}
+
+    const ucred& cred() { return socket_->cred(); }
+
+    void SetResult(size_t index, uint32_t result) {
+        // The request as a whole is acknowledged first, followed by one result per property.
+        results_[index + 1] = result;
+        if (remaining_.fetch_sub(1) == 1) {
+            socket_->SendUint32s(results_);
+        }
+    }
+
+  private:
+    std::shared_ptr<SocketConnection> socket_;
+    std::vector<uint32_t> results_;
+    std::atomic<size_t> remaining_;
+};
+
+void DumpPropertyServiceState() {
+    mac_perms_cache.DumpState();
+    property_set_dispatcher.DumpState();
+}
+
 static uint32_t SendControlMessage(const std::string& msg, const std::string& name, pid_t pid,
                                    SocketConnection* socket, std::string* error) {
     auto lock = std::lock_guard{accept_messages_lock};
@@ -529,13 +702,14 @@ static void handle_property_set_fd() {
         return;
     }
 
-    SocketConnection socket(s, cr);
+    // Shared with the dispatcher, which replies once the property is set.
+    auto socket = std::make_shared<SocketConnection>(s, cr);
     uint32_t timeout_ms = kDefaultSocketTimeout;
 
     uint32_t cmd = 0;
-    if (!socket.RecvUint32(&cmd, &timeout_ms)) {
+    if (!socket->RecvUint32(&cmd, &timeout_ms)) {
         PLOG(ERROR) << "sys_prop: error while reading command from the socket";
-        socket.SendUint32(PROP_ERROR_READ_CMD);
+        socket->SendUint32(PROP_ERROR_READ_CMD);
         return;
     }
 
@@ -544,8 +718,8 @@ static void handle_property_set_fd() {
         char prop_name[PROP_NAME_MAX];
         char prop_value[PROP_VALUE_MAX];
 
-        if (!socket.RecvChars(prop_name, PROP_NAME_MAX, &timeout_ms) ||
-            !socket.RecvChars(prop_value, PROP_VALUE_MAX, &timeout_ms)) {
+        if (!socket->RecvChars(prop_name, PROP_NAME_MAX, &timeout_ms) ||
+            !socket->RecvChars(prop_value, PROP_VALUE_MAX, &timeout_ms)) {
           PLOG(ERROR) << "sys_prop(PROP_MSG_SETPROP): error while reading name/value from the socket";
           return;
         }
@@ -554,54 +728,118 @@ static void handle_property_set_fd() {
         prop_value[PROP_VALUE_MAX-1] = 0;
 
         std::string source_context;
-        if (!socket.GetSourceContext(&source_context)) {
+        if (!socket->GetSourceContext(&source_context)) {
             PLOG(ERROR) << "Unable to set property '" << prop_name << "': getpeercon() failed";
             return;
         }
 
-        const auto& cr = socket.cred();
-        std::string error;
-        uint32_t result =
-                HandlePropertySet(prop_name, prop_value, source_context, cr, nullptr, &error);
-        if (result != PROP_SUCCESS) {
-            LOG(ERROR) << "Unable to set property '" << prop_name << "' from uid:" << cr.uid
-                       << " gid:" << cr.gid << " pid:" << cr.pid << ": " << error;
-        }
-
+        // The client waits for the connection to be closed, which happens once the property is set.
+        std::string name = prop_name;
+        property_set_dispatcher.Dispatch(name, [socket, name, value = std::string(prop_value),
+                                                source_context] {
+            const auto& cr = socket->cred();
+            std::string error;
+            uint32_t result = HandlePropertySet(name, value, source_context, cr, nullptr, &error);
+            if (result != PROP_SUCCESS) {
+                LOG(ERROR) << "Unable to set property '" << name << "' from uid:" << cr.uid
+                           << " gid:" << cr.gid << " pid:" << cr.pid << ": " << error;
+            }
+        });
         break;
       }
 
     case PROP_MSG_SETPROP2: {
         std::string name;
         std::string value;
-        if (!socket.RecvString(&name, &timeout_ms) ||
-            !socket.RecvString(&value, &timeout_ms)) {
+        if (!socket->RecvString(&name, &timeout_ms) ||
+            !socket->RecvString(&value, &timeout_ms)) {
           PLOG(ERROR) << "sys_prop(PROP_MSG_SETPROP2): error while reading name/value from the socket";
-          socket.SendUint32(PROP_ERROR_READ_DATA);
+          socket->SendUint32(PROP_ERROR_READ_DATA);
           return;
         }
 
         std::string source_context;
-        if (!socket.GetSourceContext(&source_context)) {
+        if (!socket->GetSourceContext(&source_context)) {
             PLOG(ERROR) << "Unable to set property '" << name << "': getpeercon() failed";
-            socket.SendUint32(PROP_ERROR_PERMISSION_DENIED);
+            socket->SendUint32(PROP_ERROR_PERMISSION_DENIED);
             return;
         }
 
-        const auto& cr = socket.cred();
-        std::string error;
-        uint32_t result = HandlePropertySet(name, value, source_context, cr, &socket, &error);
-        if (result != PROP_SUCCESS) {
-            LOG(ERROR) << "Unable to set property '" << name << "' from uid:" << cr.uid
-                       << " gid:" << cr.gid << " pid:" << cr.pid << ": " << error;
+        property_set_dispatcher.Dispatch(name, [socket, name, value, source_context] {
+            const auto& cr = socket->cred();
+            std::string error;
+            uint32_t result =
+                    HandlePropertySet(name, value, source_context, cr, socket.get(), &error);
+            if (result != PROP_SUCCESS) {
+                LOG(ERROR) << "Unable to set property '" << name << "' from uid:" << cr.uid
+                           << " gid:" << cr.gid << " pid:" << cr.pid << ": " << error;
+            }
+            socket->SendUint32(result);
+        });
+        break;
+      }
+
+    case PROP_MSG_SETPROP_BATCH: {
+        uint32_t count = 0;
+        if (!socket->RecvUint32(&count, &timeout_ms)) {
+            PLOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): error while reading the batch size";
+            socket->SendUint32(PROP_ERROR_READ_DATA);
+            return;
+        }
+        if (count > PROPERTY_BATCH_MAX) {
+            LOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): batch of " << count
+                       << " properties is too large";
+            socket->SendUint32(PROP_ERROR_READ_DATA);
+            return;
+        }
+
+        std::vector<std::pair<std::string, std::string>> properties(count);
+        for (auto& [name, value] : properties) {
+            if (!socket->RecvString(&name, &timeout_ms) ||
+                !socket->RecvString(&value, &timeout_ms)) {
+                PLOG(ERROR) << "sys_prop(PROP_MSG_SETPROP_BATCH): error while reading name/value "
+                               "from the socket";
+                socket->SendUint32(PROP_ERROR_READ_DATA);
+                return;
+            }
+        }
+
+        std::string source_context;
+        if (!socket->GetSourceContext(&source_context)) {
+            PLOG(ERROR) << "Unable to set " << count << " properties: getpeercon() failed";
+            socket->SendUint32(PROP_ERROR_PERMISSION_DENIED);
+            return;
+        }
+
+        if (properties.empty()) {
+            socket->SendUint32(PROP_SUCCESS);
+            break;
+        }
+
+        // Each property is dispatched on its own, so that it is ordered with respect to other sets
+        // of the same property.  One that fails doesn't stop the others.
+        auto batch = std::make_shared<BatchPropertySet>(socket, properties.size());
+        for (size_t i = 0; i < properties.size(); ++i) {
+            std::string name = properties[i].first;
+            std::string value = properties[i].second;
+            property_set_dispatcher.Dispatch(name, [batch, i, name, value, source_context] {
+                const auto& cr = batch->cred();
+                std::string error;
+                uint32_t result =
+                        HandlePropertySet(name, value, source_context, cr, nullptr, &error);
+                if (result != PROP_SUCCESS) {
+                    LOG(ERROR) << "Unable to set property '" << name << "' from uid:" << cr.uid
+                               << " gid:" << cr.gid << " pid:" << cr.pid << ": " << error;
+                }
+                batch->SetResult(i, result);
+            });
         }
-        socket.SendUint32(result);
         break;
       }
 
     default:
         LOG(ERROR) << "sys_prop: invalid command " << cmd;
-        socket.SendUint32(PROP_ERROR_INVALID_CMD);
+        socket->SendUint32(PROP_ERROR_INVALID_CMD);
         break;
     }
 }
@@ -1157,6 +1395,10 @@ void PropertyInit() {
     selinux_callback cb;
     cb.func_audit = PropertyAuditCallback;
     selinux_set_callback(SELINUX_CB_AUDIT, cb);
+    // Lets the SELinux decision cache notice policy reloads and setenforce.
+    if (selinux_status_open(true) < 0) {
+        PLOG(WARNING) << "Unable to open the SELinux status page, decisions won't be cached";
+    }
 
     mkdir("/dev/__properties__", S_IRWXU | S_IXGRP | S_IXOTH);
     CreateSerializedPropertyInfo();
@@ -1226,7 +1468,7 @@ static void PropertyServiceThread() {
     }
 
     while (true) {
-        auto pending_functions = epoll.Wait(std::nullopt);
+        auto pending_functions = epoll.Wait(PersistentPropertyCommitTimeout());
         if (!pending_functions.ok()) {
             LOG(ERROR) << pending_functions.error();
         } else {
@@ -1234,6 +1476,7 @@ static void PropertyServiceThread() {
                 (*function)();
             }
         }
+        CommitPersistentProperties();
     }
 }
 
@@ -1258,6 +1501,7 @@ void StartPropertyService(int* epoll_socket) {
 
     listen(property_set_fd, 8);
 
+    property_set_dispatcher.Start(kPropertySetThreads);
     auto new_thread = std::thread{PropertyServiceThread};
     property_service_thread.swap(new_thread);
 }
@@ -35,5 +35,7 @@ void StartPropertyService(int* epoll_socket);
 void StartSendingMessages();
 void StopSendingMessages();
 
+void DumpPropertyServiceState();
+
 }  // namespace init
 }  // namespace android
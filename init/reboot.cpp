@@ -214,9 +214,29 @@ static Result<void> CallVdc(const std::string& system, const std::string& cmd) {
     return Error() << "'/system/bin/vdc " << system << " " << cmd << "' failed : " << status;
 }
 
-static void LogShutdownTime(UmountStat stat, Timer* t) {
+// Times each step of a shutdown, so that the total logged by LogShutdownTime can be broken
+// down into where it went.
+class ShutdownPhases {
+  public:
+    // Ends the current phase, naming it |phase|, and starts the next one.
+    void End(const char* phase) {
+        if (!phases_.empty()) phases_ += ",";
+        phases_ += phase;
+        phases_ += "=" + std::to_string(t_.duration().count());
+        t_ = Timer();
+    }
+
+    const std::string& str() const { return phases_; }
+
+  private:
+    Timer t_;
+    std::string phases_;
+};
+
+static void LogShutdownTime(UmountStat stat, Timer* t, const ShutdownPhases& phases) {
     LOG(WARNING) << "powerctl_shutdown_time_ms:" << std::to_string(t->duration().count()) << ":"
                  << stat;
+    LOG(WARNING) << "powerctl_shutdown_phases_ms:" << phases.str();
 }
 
 static bool IsDataMounted() {
@@ -279,6 +299,9 @@ static void DumpUmountDebuggingInfo() {
 
 static UmountStat UmountPartitions(std::chrono::milliseconds timeout) {
     Timer t;
+    // What keeps a partition busy is usually a process that was just killed and is about to
+    // release its files, so retry quickly at first and back off from there.
+    auto retry_delay = 5ms;
     /* data partition needs all pending writes to be completed and all emulated partitions
      * umounted.If the current waiting is not good enough, give
      * up and leave it to e2fsck after reboot to fix it.
@@ -310,7 +333,8 @@ static UmountStat UmountPartitions(std::chrono::milliseconds timeout) {
         if ((timeout < t.duration())) {  // try umount at least once
             return UMOUNT_STAT_TIMEOUT;
         }
-        std::this_thread::sleep_for(100ms);
+        std::this_thread::sleep_for(retry_delay);
+        retry_delay = std::min(retry_delay * 2, 100ms);
     }
 }
 
@@ -553,6 +577,7 @@ static int StopServicesAndLogViolations(const std::vector<Service*>& services,
 static void DoReboot(unsigned int cmd, const std::string& reason, const std::string& reboot_target,
                      bool run_fsck) {
     Timer t;
+    ShutdownPhases phases;
     LOG(INFO) << "Reboot start, reason: " << reason << ", reboot_target: " << reboot_target;
 
     bool is_thermal_shutdown = cmd == ANDROID_RB_THERMOFF;
@@ -667,6 +692,8 @@ static void DoReboot(unsigned int cmd, const std::string& reason, const std::str
         }
     }
 
+    phases.End("prepare");
+
     // optional shutdown step
     // 1. terminate all services except shutdown critical ones. wait for delay to finish
     if (shutdown_timeout > 0ms) {
@@ -677,6 +704,7 @@ static void DoReboot(unsigned int cmd, const std::string& reason, const std::str
     SubcontextTerminate();
     // Reap subcontext pids.
     ReapAnyOutstandingChildren();
+    phases.End("stop_services");
 
     // 3. send volume abort_fuse and volume shutdown to vold
     Service* vold_service = ServiceList::GetInstance().FindService("vold");
@@ -691,6 +719,7 @@ static void DoReboot(unsigned int cmd, const std::string& reason, const std::str
     }
     // logcat stopped here
     StopServices(GetDebuggingServices(false /* only_post_data */), 0ms, false /* SIGKILL */);
+    phases.End("vold");
     // 4. sync, try umount, and optionally run fsck for user shutdown
     {
         Timer sync_timer;
@@ -698,11 +727,14 @@ static void DoReboot(unsigned int cmd, const std::string& reason, const std::str
         sync();
         LOG(INFO) << "sync() before umount took" << sync_timer;
     }
+    phases.End("sync");
     // 5. drop caches and disable zram backing device, if exist
     KillZramBackingDevice();
+    phases.End("zram");
 
     UmountStat stat =
             TryUmountAndFsck(cmd, run_fsck, shutdown_timeout - t.duration(), &reboot_semaphore);
+    phases.End("umount");
     // Follow what linux shutdown is doing: one more sync with little bit delay
     {
         Timer sync_timer;
@@ -711,7 +743,8 @@ static void DoReboot(unsigned int cmd, const std::string& reason, const std::str
         LOG(INFO) << "sync() after umount took" << sync_timer;
     }
     if (!is_thermal_shutdown) std::this_thread::sleep_for(100ms);
-    LogShutdownTime(stat, &t);
+    phases.End("final_sync");
+    LogShutdownTime(stat, &t, phases);
 
     // Send signal to terminate reboot monitor thread.
     reboot_monitor_run = false;
@@ -751,6 +784,25 @@ static Result<void> UnmountAllApexes() {
     return Error() << "'/system/bin/apexd --unmount-all' failed : " << status;
 }
 
+// Whether apexd has any sessions, which a userspace reboot might be meant to apply. Completed
+// sessions count too; they only cost us the slow path.
+static bool HasApexSessions() {
+    for (const char* dir : {"/metadata/apex/sessions", "/data/apex/sessions"}) {
+        std::unique_ptr<DIR, decltype(&closedir)> dirp(opendir(dir), closedir);
+        if (!dirp) continue;
+        while (dirent* entry = readdir(dirp.get())) {
+            if (entry->d_name[0] != '.') return true;
+        }
+    }
+    return false;
+}
+
+static bool apexes_kept = false;
+
+bool ApexesKeptAcrossUserspaceReboot() {
+    return apexes_kept;
+}
+
 static std::chrono::milliseconds GetMillisProperty(const std::string& name,
                                                    std::chrono::milliseconds default_value) {
     auto value = GetUintProperty(name, static_cast<uint64_t>(default_value.count()));
@@ -779,6 +831,7 @@ static Result<void> DoUserspaceReboot() {
         sub_reason = "resetprop";
         return Error() << "Failed to reset sys.powerctl property";
     }
+    ShutdownPhases phases;
     std::vector<Service*> stop_first;
     // Remember the services that were enabled. We will need to manually enable them again otherwise
     // triggers like class_start won't restart them.
@@ -798,6 +851,7 @@ static Result<void> DoUserspaceReboot() {
         sync();
         LOG(INFO) << "sync() took " << sync_timer;
     }
+    phases.End("sync");
     auto sigterm_timeout = GetMillisProperty("init.userspace_reboot.sigterm.timeoutmillis", 5s);
     auto sigkill_timeout = GetMillisProperty("init.userspace_reboot.sigkill.timeoutmillis", 10s);
     LOG(INFO) << "Timeout to terminate services: " << sigterm_timeout.count() << "ms "
@@ -809,6 +863,7 @@ static Result<void> DoUserspaceReboot() {
         // TODO(b/135984674): store information about offending services for debugging.
         return Error() << r << " post-data services are still running";
     }
+    phases.End("stop_services");
     if (auto result = KillZramBackingDevice(); !result.ok()) {
         sub_reason = "zram";
         return result;
@@ -824,13 +879,22 @@ static Result<void> DoUserspaceReboot() {
         // TODO(b/135984674): store information about offending services for debugging.
         return Error() << r << " debugging services are still running";
     }
+    phases.End("vold");
     {
         Timer sync_timer;
         LOG(INFO) << "sync() after stopping services...";
         sync();
         LOG(INFO) << "sync() took " << sync_timer;
     }
-    if (auto result = UnmountAllApexes(); !result.ok()) {
+    phases.End("final_sync");
+    // Unless there's an update to apply, APEXes can be left mounted and their services and
+    // linker config reused, instead of apexd deactivating and activating every one of them.
+    // This needs an apexd that adopts packages that are already active when it starts.
+    apexes_kept = GetBoolProperty("init.userspace_reboot.keep_apexes", false) &&
+                  !HasApexSessions();
+    if (apexes_kept) {
+        LOG(INFO) << "No APEX sessions, keeping APEXes mounted";
+    } else if (auto result = UnmountAllApexes(); !result.ok()) {
         sub_reason = "apex";
         return result;
     }
@@ -838,14 +902,20 @@ static Result<void> DoUserspaceReboot() {
         sub_reason = "ns_switch";
         return Error() << "Failed to switch to bootstrap namespace";
     }
-    // Remove services that were defined in an APEX.
-    ServiceList::GetInstance().RemoveServiceIf([](const std::unique_ptr<Service>& s) -> bool {
-        if (s->is_from_apex()) {
-            LOG(INFO) << "Removing service '" << s->name() << "' because it's defined in an APEX";
-            return true;
-        }
-        return false;
-    });
+    phases.End("apex");
+    LOG(INFO) << "Userspace reboot phases (ms): " << phases.str();
+    // Remove services that were defined in an APEX, they are parsed again once APEXes have been
+    // activated.
+    if (!apexes_kept) {
+        ServiceList::GetInstance().RemoveServiceIf([](const std::unique_ptr<Service>& s) -> bool {
+            if (s->is_from_apex()) {
+                LOG(INFO) << "Removing service '" << s->name()
+                          << "' because it's defined in an APEX";
+                return true;
+            }
+            return false;
+        });
+    }
     // Re-enable services
     for (const auto& s : were_enabled) {
         LOG(INFO) << "Re-enabling service '" << s->name() << "'";
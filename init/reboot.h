@@ -26,6 +26,10 @@ namespace init {
 void HandlePowerctlMessage(const std::string& command);
 
 bool IsShuttingDown();
+
+// Whether the last userspace reboot left APEXes mounted, so that their configs are still parsed
+// and the linker config is still up to date.
+bool ApexesKeptAcrossUserspaceReboot();
 }  // namespace init
 }  // namespace android
 
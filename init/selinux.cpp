@@ -48,14 +48,19 @@
 //    LoadSplitPolicy() function below to compile the SEPolicy to a temp directory and load it.
 //    That function contains even more documentation with the specific implementation details of how
 //    the SEPolicy is compiled if needed.
+// 3) On unlocked devices, a policy compiled in step 2 is kept in /metadata/sepolicy along with a
+//    hash of everything it was compiled from.  Later boots with the same inputs load it from
+//    there instead of running secilc again.
 
 #include "selinux.h"
 
 #include <android/api-level.h>
 #include <fcntl.h>
+#include <inttypes.h>
 #include <linux/audit.h>
 #include <linux/netlink.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -63,6 +68,7 @@
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/parseint.h>
+#include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <android-base/unique_fd.h>
 #include <fs_avb/fs_avb.h>
@@ -79,6 +85,8 @@
 using namespace std::string_literals;
 
 using android::base::ParseInt;
+using android::base::ParseUint;
+using android::base::StringPrintf;
 using android::base::Timer;
 using android::base::unique_fd;
 using android::fs_mgr::AvbHandle;
@@ -294,6 +302,131 @@ bool GetVendorMappingVersion(std::string* plat_vers) {
 
 constexpr const char plat_policy_cil_file[] = "/system/etc/selinux/plat_sepolicy.cil";
 
+constexpr const char kPolicyCacheDir[] = "/metadata/sepolicy";
+constexpr const char kPolicyCacheFile[] = "/metadata/sepolicy/compiled_sepolicy";
+constexpr const char kPolicyCacheKeyFile[] = "/metadata/sepolicy/compiled_sepolicy.key";
+
+// 64-bit FNV-1a, as used by ConfigCache.  The key only needs to tell apart versions of the policy
+// inputs; whoever can write /metadata could replace the cached policy anyway.
+constexpr uint64_t kPolicyHashBasis = 0xcbf29ce484222325ULL;
+
+uint64_t HashPolicyBytes(uint64_t hash, const std::string& bytes) {
+    for (unsigned char c : bytes) {
+        hash ^= c;
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+// /metadata isn't covered by verified boot, so a policy from there is only trusted where the
+// user could have replaced the system policy anyway.  It must also really be mounted, rather than
+// being the empty directory on /system.
+bool IsPolicyCacheUsable() {
+    if (!AvbHandle::IsDeviceUnlocked()) {
+        return false;
+    }
+    struct stat root_sb, metadata_sb;
+    return stat("/", &root_sb) == 0 && stat("/metadata", &metadata_sb) == 0 &&
+           root_sb.st_dev != metadata_sb.st_dev;
+}
+
+// Hashes what secilc is given: its arguments along with the contents of secilc itself and of each
+// CIL file, so that a change to any of them misses the cache.  The output paths are left out.
+bool HashPolicyInputs(const std::vector<const char*>& compile_args, uint64_t* key) {
+    uint64_t hash = kPolicyHashBasis;
+    for (size_t i = 0; i < compile_args.size(); ++i) {
+        std::string arg = compile_args[i];
+        if (arg == "-o" || arg == "-f") {
+            ++i;
+            continue;
+        }
+        hash = HashPolicyBytes(hash, arg + '\0');
+        if (arg[0] != '/') {
+            continue;
+        }
+        std::string contents;
+        if (!android::base::ReadFileToString(arg, &contents)) {
+            PLOG(ERROR) << "Failed to read " << arg << " for the policy cache";
+            return false;
+        }
+        hash = HashPolicyBytes(hash, std::to_string(contents.size()) + '\0');
+        hash = HashPolicyBytes(hash, contents);
+    }
+    *key = hash;
+    return true;
+}
+
+// The key file is a single line: the key of the inputs, then the size and hash of the cached policy
+// so that a torn or truncated write isn't loaded.
+bool LoadCachedPolicy(uint64_t key) {
+    std::string line;
+    if (!ReadFirstLine(kPolicyCacheKeyFile, &line)) {
+        return false;
+    }
+    auto fields = android::base::Split(line, " ");
+    uint64_t cached_key, size, hash;
+    if (fields.size() != 3 || !ParseUint(fields[0], &cached_key) || !ParseUint(fields[1], &size) ||
+        !ParseUint(fields[2], &hash)) {
+        LOG(ERROR) << "Ignoring malformed " << kPolicyCacheKeyFile;
+        return false;
+    }
+    if (cached_key != key) {
+        LOG(INFO) << "SELinux policy inputs changed since the cached policy was compiled";
+        return false;
+    }
+
+    unique_fd fd(open(kPolicyCacheFile, O_RDONLY | O_CLOEXEC | O_NOFOLLOW));
+    std::string policy;
+    if (fd == -1 || !android::base::ReadFdToString(fd, &policy)) {
+        PLOG(ERROR) << "Failed to read " << kPolicyCacheFile;
+        return false;
+    }
+    if (policy.size() != size || HashPolicyBytes(kPolicyHashBasis, policy) != hash) {
+        LOG(ERROR) << kPolicyCacheFile << " does not match " << kPolicyCacheKeyFile;
+        return false;
+    }
+
+    LOG(INFO) << "Loading cached SELinux policy";
+    if (lseek(fd, 0, SEEK_SET) == -1 ||
+        selinux_android_load_policy_from_fd(fd, kPolicyCacheFile) < 0) {
+        LOG(ERROR) << "Failed to load SELinux policy from " << kPolicyCacheFile;
+        return false;
+    }
+    return true;
+}
+
+// Replaces the cached policy.  The key file is removed first and written last, so a cache that was
+// only partly written never matches.
+void WritePolicyCache(uint64_t key, int policy_fd) {
+    std::string policy;
+    if (lseek(policy_fd, 0, SEEK_SET) == -1 ||
+        !android::base::ReadFdToString(policy_fd, &policy)) {
+        PLOG(ERROR) << "Failed to read the compiled policy for the policy cache";
+        return;
+    }
+    if (mkdir(kPolicyCacheDir, 0700) == -1 && errno != EEXIST) {
+        PLOG(ERROR) << "Failed to create " << kPolicyCacheDir;
+        return;
+    }
+    if (unlink(kPolicyCacheKeyFile) == -1 && errno != ENOENT) {
+        PLOG(ERROR) << "Failed to remove " << kPolicyCacheKeyFile;
+        return;
+    }
+
+    std::string policy_tmp = kPolicyCacheFile + ".tmp"s;
+    std::string key_tmp = kPolicyCacheKeyFile + ".tmp"s;
+    std::string key_line = StringPrintf("0x%016" PRIx64 " %zu 0x%016" PRIx64 "\n", key,
+                                        policy.size(), HashPolicyBytes(kPolicyHashBasis, policy));
+    if (!android::base::WriteStringToFile(policy, policy_tmp, 0600, 0, 0) ||
+        rename(policy_tmp.c_str(), kPolicyCacheFile) == -1 ||
+        !android::base::WriteStringToFile(key_line, key_tmp, 0600, 0, 0) ||
+        rename(key_tmp.c_str(), kPolicyCacheKeyFile) == -1) {
+        PLOG(ERROR) << "Failed to write the SELinux policy cache";
+        return;
+    }
+    LOG(INFO) << "Cached compiled SELinux policy in " << kPolicyCacheFile;
+}
+
 bool IsSplitPolicyDevice() {
     return access(plat_policy_cil_file, R_OK) != -1;
 }
@@ -334,16 +467,10 @@ bool LoadSplitPolicy() {
     }
     // No suitable precompiled policy could be loaded
 
-    LOG(INFO) << "Compiling SELinux policy";
-
     // We store the output of the compilation on /dev because this is the most convenient tmpfs
-    // storage mount available this early in the boot sequence.
+    // storage mount available this early in the boot sequence.  The name is filled in by
+    // mkostemp() once we know that the policy has to be compiled.
     char compiled_sepolicy[] = "/dev/sepolicy.XXXXXX";
-    unique_fd compiled_sepolicy_fd(mkostemp(compiled_sepolicy, O_CLOEXEC));
-    if (compiled_sepolicy_fd < 0) {
-        PLOG(ERROR) << "Failed to create temporary file " << compiled_sepolicy;
-        return false;
-    }
 
     // Determine which mapping file to include
     std::string vend_plat_vers;
@@ -438,6 +565,22 @@ bool LoadSplitPolicy() {
     if (!odm_policy_cil_file.empty()) {
         compile_args.push_back(odm_policy_cil_file.c_str());
     }
+
+    // A policy compiled from the same inputs on an earlier boot can be loaded as is.
+    uint64_t cache_key;
+    bool use_cache = IsPolicyCacheUsable() && HashPolicyInputs(compile_args, &cache_key);
+    if (use_cache && LoadCachedPolicy(cache_key)) {
+        return true;
+    }
+
+    LOG(INFO) << "Compiling SELinux policy";
+
+    unique_fd compiled_sepolicy_fd(mkostemp(compiled_sepolicy, O_CLOEXEC));
+    if (compiled_sepolicy_fd < 0) {
+        PLOG(ERROR) << "Failed to create temporary file " << compiled_sepolicy;
+        return false;
+    }
+
     compile_args.push_back(nullptr);
 
     if (!ForkExecveAndWaitForCompletion(compile_args[0], (char**)compile_args.data())) {
@@ -446,6 +589,11 @@ bool LoadSplitPolicy() {
     }
     unlink(compiled_sepolicy);
 
+    // No policy is loaded yet, so init can still write to /metadata without any SELinux checks.
+    if (use_cache) {
+        WritePolicyCache(cache_key, compiled_sepolicy_fd);
+    }
+
     LOG(INFO) << "Loading compiled SELinux policy";
     if (selinux_android_load_policy_from_fd(compiled_sepolicy_fd, compiled_sepolicy) < 0) {
         LOG(ERROR) << "Failed to load SELinux policy from " << compiled_sepolicy;
@@ -545,6 +693,8 @@ void SelinuxRestoreContext() {
     selinux_android_restorecon(SnapshotManager::GetGlobalRollbackIndicatorPath().c_str(), 0);
     selinux_android_restorecon("/metadata/gsi", SELINUX_ANDROID_RESTORECON_RECURSE |
                                                         SELINUX_ANDROID_RESTORECON_SKIP_SEHASH);
+    selinux_android_restorecon(kPolicyCacheDir, SELINUX_ANDROID_RESTORECON_RECURSE |
+                                                SELINUX_ANDROID_RESTORECON_SKIP_SEHASH);
 }
 
 int SelinuxKlogCallback(int type, const char* fmt, ...) {
@@ -36,6 +36,7 @@
 #include <processgroup/processgroup.h>
 #include <selinux/selinux.h>
 
+#include "boot_timeline.h"
 #include "lmkd_service.h"
 #include "service_list.h"
 #include "util.h"
@@ -54,9 +55,11 @@ using android::base::boot_clock;
 using android::base::GetProperty;
 using android::base::Join;
 using android::base::make_scope_guard;
+using android::base::Pipe;
 using android::base::SetProperty;
 using android::base::StartsWith;
 using android::base::StringPrintf;
+using android::base::unique_fd;
 using android::base::WriteStringToFile;
 
 namespace android {
@@ -103,6 +106,11 @@ static Result<std::string> ComputeContextFromExecutable(const std::string& servi
     return computed_context;
 }
 
+static bool IsSameFile(const struct stat& a, const struct stat& b) {
+    return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_ctim.tv_sec == b.st_ctim.tv_sec &&
+           a.st_ctim.tv_nsec == b.st_ctim.tv_nsec;
+}
+
 static bool ExpandArgsAndExecv(const std::vector<std::string>& args, bool sigstop) {
     std::vector<std::string> expanded_args;
     std::vector<char*> c_strings;
@@ -134,6 +142,8 @@ static bool AreRuntimeApexesReady() {
 
 unsigned long Service::next_start_order_ = 1;
 bool Service::is_exec_service_running_ = false;
+std::unordered_map<pid_t, Service*> Service::services_by_pid_;
+std::multimap<boot_clock::time_point, Service*> Service::process_action_times_;
 
 Service::Service(const std::string& name, Subcontext* subcontext_for_restart_commands,
                  const std::vector<std::string>& args, bool from_apex)
@@ -190,6 +200,49 @@ void Service::NotifyStateChange(const std::string& new_state) const {
     }
 }
 
+Service::~Service() {
+    SetPid(0);
+    for (auto it = process_action_times_.begin(); it != process_action_times_.end();) {
+        if (it->second == this) {
+            it = process_action_times_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+Service* Service::FindByPid(pid_t pid) {
+    auto it = services_by_pid_.find(pid);
+    return it != services_by_pid_.end() ? it->second : nullptr;
+}
+
+void Service::SetPid(pid_t pid) {
+    if (pid_ != 0) {
+        services_by_pid_.erase(pid_);
+    }
+    pid_ = pid;
+    if (pid_ != 0) {
+        services_by_pid_[pid_] = this;
+    }
+}
+
+std::optional<boot_clock::time_point> Service::NextProcessActionTime() {
+    if (process_action_times_.empty()) return {};
+    return process_action_times_.begin()->first;
+}
+
+Service* Service::TakeDueProcessAction(boot_clock::time_point now) {
+    auto it = process_action_times_.begin();
+    if (it == process_action_times_.end() || !(it->first < now)) return nullptr;
+    Service* service = it->second;
+    process_action_times_.erase(it);
+    return service;
+}
+
+void Service::ScheduleProcessAction(boot_clock::time_point time) {
+    process_action_times_.emplace(time, this);
+}
+
 void Service::KillProcessGroup(int signal, bool report_oneshot) {
     // If we've already seen a successful result from killProcessGroup*(), then we have removed
     // the cgroup already and calling these functions a second time will simply result in an error.
@@ -292,7 +345,7 @@ void Service::Reap(const siginfo_t& siginfo) {
 
     if (flags_ & SVC_TEMPORARY) return;
 
-    pid_ = 0;
+    SetPid(0);
     flags_ &= (~SVC_RUNNING);
     start_order_ = 0;
 
@@ -342,6 +395,7 @@ void Service::Reap(const siginfo_t& siginfo) {
 
     flags_ &= (~SVC_RESTART);
     flags_ |= SVC_RESTARTING;
+    ScheduleProcessAction(time_started_ + restart_period_);
 
     // Execute all onrestart commands for this service.
     onrestart_.ExecuteAllCommands();
@@ -395,6 +449,7 @@ Result<void> Service::ExecStart() {
 }
 
 Result<void> Service::Start() {
+    auto start_time = boot_clock::now();
     auto reboot_on_failure = make_scope_guard([this] {
         if (on_failure_reboot_target_) {
             trigger_shutdown(*on_failure_reboot_target_);
@@ -452,12 +507,16 @@ Result<void> Service::Start() {
     std::string scon;
     if (!seclabel_.empty()) {
         scon = seclabel_;
+    } else if (!computed_context_.empty() && IsSameFile(sb, computed_context_stat_)) {
+        scon = computed_context_;
     } else {
         auto result = ComputeContextFromExecutable(args_[0]);
         if (!result.ok()) {
             return result.error();
         }
         scon = *result;
+        computed_context_ = scon;
+        computed_context_stat_ = sb;
     }
 
     if (!AreRuntimeApexesReady() && !pre_apexd_) {
@@ -489,6 +548,13 @@ Result<void> Service::Start() {
         }
     }
 
+    // The child waits on this pipe until the parent has moved it into its task profiles and
+    // process group, so that it never runs its executable outside of them.
+    unique_fd setup_read, setup_write;
+    if (!Pipe(&setup_read, &setup_write)) {
+        return ErrnoError() << "Failed to create setup pipe";
+    }
+
     pid_t pid = -1;
     if (namespaces_.flags) {
         pid = clone(nullptr, nullptr, namespaces_.flags | SIGCHLD, nullptr);
@@ -499,6 +565,11 @@ Result<void> Service::Start() {
     if (pid == 0) {
         umask(077);
 
+        setup_write.reset();
+        char setup_done;
+        TEMP_FAILURE_RETRY(read(setup_read, &setup_done, sizeof(setup_done)));
+        setup_read.reset();
+
         if (auto result = EnterNamespaces(namespaces_, name_, pre_apexd_); !result.ok()) {
             LOG(FATAL) << "Service '" << name_
                        << "' failed to set up namespaces: " << result.error();
@@ -516,10 +587,6 @@ Result<void> Service::Start() {
             LOG(ERROR) << "failed to write pid to files: " << result.error();
         }
 
-        if (task_profiles_.size() > 0 && !SetTaskProfiles(getpid(), task_profiles_)) {
-            LOG(ERROR) << "failed to set task profiles";
-        }
-
         // As requested, set our gid, supplemental gids, uid, context, and
         // priority. Aborts on failure.
         SetProcessAttributesAndCaps();
@@ -533,9 +600,16 @@ Result<void> Service::Start() {
     }
 
     if (pid < 0) {
-        pid_ = 0;
+        SetPid(0);
         return ErrnoError() << "Failed to fork";
     }
+    setup_read.reset();
+
+    // Applied from init, rather than from the child, so that the cgroup fds init already has
+    // open are reused instead of being opened again in every new process.
+    if (task_profiles_.size() > 0 && !SetTaskProfiles(pid, task_profiles_, true)) {
+        LOG(ERROR) << "failed to set task profiles";
+    }
 
     if (oom_score_adjust_ != DEFAULT_OOM_SCORE_ADJUST) {
         std::string oom_str = std::to_string(oom_score_adjust_);
@@ -546,8 +620,11 @@ Result<void> Service::Start() {
     }
 
     time_started_ = boot_clock::now();
-    pid_ = pid;
+    SetPid(pid);
     flags_ |= SVC_RUNNING;
+    if (timeout_period_) {
+        ScheduleProcessAction(time_started_ + *timeout_period_);
+    }
     start_order_ = next_start_order_++;
     process_cgroup_empty_ = false;
 
@@ -598,6 +675,10 @@ Result<void> Service::Start() {
         }
     }
 
+    // Let the child continue now that its cgroups are in place.
+    setup_write.reset();
+    RecordBootEvent(BootEventType::kServiceStart, start_time, name_);
+
     if (oom_score_adjust_ != DEFAULT_OOM_SCORE_ADJUST) {
         LmkdRegister(name_, proc_attr_.uid, pid_, oom_score_adjust_);
     }
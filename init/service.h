@@ -17,13 +17,16 @@
 #pragma once
 
 #include <signal.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 
 #include <chrono>
+#include <map>
 #include <memory>
 #include <optional>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <android-base/chrono_utils.h>
@@ -71,6 +74,7 @@ class Service {
             const std::vector<gid_t>& supp_gids, int namespace_flags, const std::string& seclabel,
             Subcontext* subcontext_for_restart_commands, const std::vector<std::string>& args,
             bool from_apex = false);
+    ~Service();
 
     static Result<std::unique_ptr<Service>> MakeTemporaryOneshotService(
             const std::vector<std::string>& args);
@@ -103,6 +107,15 @@ class Service {
 
     static bool is_exec_service_running() { return is_exec_service_running_; }
 
+    // The service whose process is |pid|, if any.  Looked up in a map kept up to date as services
+    // start and are reaped, since init looks up every child it reaps this way.
+    static Service* FindByPid(pid_t pid);
+    // The earliest pending restart or timeout, if any service has one.
+    static std::optional<android::base::boot_clock::time_point> NextProcessActionTime();
+    // Removes and returns a service whose restart or timeout was due before |now|, or nullptr.
+    // The caller must check the service's state again, as it may have changed since.
+    static Service* TakeDueProcessAction(android::base::boot_clock::time_point now);
+
     const std::string& name() const { return name_; }
     const std::set<std::string>& classnames() const { return classnames_; }
     unsigned flags() const { return flags_; }
@@ -143,9 +156,15 @@ class Service {
     void StopOrReset(int how);
     void KillProcessGroup(int signal, bool report_oneshot = false);
     void SetProcessAttributesAndCaps();
+    void SetPid(pid_t pid);
+    void ScheduleProcessAction(android::base::boot_clock::time_point time);
 
     static unsigned long next_start_order_;
     static bool is_exec_service_running_;
+    static std::unordered_map<pid_t, Service*> services_by_pid_;
+    // Restart and timeout deadlines, so that the main loop only looks at the services that are
+    // due instead of every service.  Entries are not removed when a service changes state.
+    static std::multimap<android::base::boot_clock::time_point, Service*> process_action_times_;
 
     std::string name_;
     std::set<std::string> classnames_;
@@ -161,6 +180,10 @@ class Service {
     NamespaceInfo namespaces_;
 
     std::string seclabel_;
+    // The context computed from args_[0] when there is no seclabel, reused until the executable
+    // is replaced or relabeled, either of which changes its stat.
+    std::string computed_context_;
+    struct stat computed_context_stat_ = {};
 
     std::vector<SocketDescriptor> sockets_;
     std::vector<FileDescriptor> files_;
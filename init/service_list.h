@@ -52,6 +52,9 @@ class ServiceList {
         return nullptr;
     }
 
+    // Equivalent to FindService(pid, &Service::pid), without walking the list.
+    Service* FindServiceByPid(pid_t pid) const { return pid ? Service::FindByPid(pid) : nullptr; }
+
     Service* FindInterface(const std::string& interface_name) {
         for (const auto& svc : services_) {
             if (svc->interfaces().count(interface_name) > 0) {
@@ -16,9 +16,11 @@
 
 #include "sigchld_handler.h"
 
+#include <poll.h>
 #include <signal.h>
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -27,9 +29,12 @@
 #include <android-base/logging.h>
 #include <android-base/scopeguard.h>
 #include <android-base/stringprintf.h>
+#include <android-base/unique_fd.h>
 
+#include <algorithm>
 #include <thread>
 
+#include "boot_timeline.h"
 #include "init.h"
 #include "service.h"
 #include "service_list.h"
@@ -38,6 +43,7 @@ using android::base::boot_clock;
 using android::base::make_scope_guard;
 using android::base::StringPrintf;
 using android::base::Timer;
+using android::base::unique_fd;
 
 namespace android {
 namespace init {
@@ -67,7 +73,7 @@ static pid_t ReapOneProcess() {
     if (SubcontextChildReap(pid)) {
         name = "Subcontext";
     } else {
-        service = ServiceList::GetInstance().FindService(pid, &Service::pid);
+        service = ServiceList::GetInstance().FindServiceByPid(pid);
 
         if (service) {
             name = StringPrintf("Service '%s' (pid %d)", service->name().c_str(), pid);
@@ -76,6 +82,7 @@ static pid_t ReapOneProcess() {
                 auto exec_duration_ms =
                     std::chrono::duration_cast<std::chrono::milliseconds>(exec_duration).count();
                 wait_string = StringPrintf(" waiting took %f seconds", exec_duration_ms / 1000.0f);
+                RecordBootEvent(BootEventType::kExecWait, service->time_started(), service->name());
             } else if (service->flags() & SVC_ONESHOT) {
                 auto exec_duration = boot_clock::now() - service->time_started();
                 auto exec_duration_ms =
@@ -83,6 +90,8 @@ static pid_t ReapOneProcess() {
                                 .count();
                 wait_string = StringPrintf(" oneshot service took %f seconds in background",
                                            exec_duration_ms / 1000.0f);
+                RecordBootEvent(BootEventType::kServiceRun, service->time_started(),
+                                service->name());
             }
         } else {
             name = StringPrintf("Untracked pid %d", pid);
@@ -111,21 +120,64 @@ void ReapAnyOutstandingChildren() {
     }
 }
 
+static unique_fd OpenPidFd(pid_t pid) {
+#if defined(__NR_pidfd_open)
+    return unique_fd(syscall(__NR_pidfd_open, pid, 0));
+#else
+    errno = ENOSYS;
+    return unique_fd();
+#endif
+}
+
 void WaitToBeReaped(const std::vector<pid_t>& pids, std::chrono::milliseconds timeout) {
     Timer t;
     std::vector<pid_t> alive_pids(pids.begin(), pids.end());
+
+    // A pidfd becomes readable once its process has exited, so with them we wake up as soon as
+    // there's something to reap instead of polling.  Kernels without pidfds fall back to sleeping.
+    std::vector<unique_fd> pidfds;
+    bool use_pidfds = true;
+    for (auto it = alive_pids.begin(); it != alive_pids.end();) {
+        unique_fd pidfd = OpenPidFd(*it);
+        if (pidfd < 0 && errno == ESRCH) {
+            // Already reaped.
+            it = alive_pids.erase(it);
+            continue;
+        }
+        if (pidfd < 0) {
+            use_pidfds = false;
+            break;
+        }
+        pidfds.push_back(std::move(pidfd));
+        it++;
+    }
+
     while (!alive_pids.empty() && t.duration() < timeout) {
         pid_t pid;
         while ((pid = ReapOneProcess()) != 0) {
             auto it = std::find(alive_pids.begin(), alive_pids.end(), pid);
             if (it != alive_pids.end()) {
+                if (use_pidfds) {
+                    pidfds.erase(pidfds.begin() + (it - alive_pids.begin()));
+                }
                 alive_pids.erase(it);
             }
         }
         if (alive_pids.empty()) {
             break;
         }
-        std::this_thread::sleep_for(50ms);
+        if (!use_pidfds) {
+            std::this_thread::sleep_for(50ms);
+            continue;
+        }
+
+        std::vector<pollfd> pfds;
+        for (const auto& pidfd : pidfds) {
+            pfds.push_back({.fd = pidfd.get(), .events = POLLIN});
+        }
+        auto remaining =
+                std::chrono::duration_cast<std::chrono::milliseconds>(timeout - t.duration());
+        TEMP_FAILURE_RETRY(poll(pfds.data(), pfds.size(), std::max<int>(remaining.count(), 1)));
     }
     LOG(INFO) << "Waiting for " << pids.size() << " pids to be reaped took " << t << " with "
               << alive_pids.size() << " of them still running";
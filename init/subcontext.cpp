@@ -20,6 +20,7 @@
 #include <poll.h>
 #include <unistd.h>
 
+#include <android-base/chrono_utils.h>
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
@@ -40,6 +41,7 @@
 #include "host_init_stubs.h"
 #endif
 
+using android::base::boot_clock;
 using android::base::GetExecutablePath;
 using android::base::Join;
 using android::base::Socketpair;
@@ -62,8 +64,9 @@ class SubcontextProcess {
     void MainLoop();
 
   private:
-    void RunCommand(const SubcontextCommand::ExecuteCommand& execute_command,
-                    SubcontextReply* reply) const;
+    Result<void> RunCommand(const SubcontextCommand::ExecuteCommand& execute_command) const;
+    void BatchExecute(const SubcontextCommand::BatchExecuteCommand& batch_execute_command,
+                      SubcontextReply* reply) const;
     void ExpandArgs(const SubcontextCommand::ExpandArgsCommand& expand_args_command,
                     SubcontextReply* reply) const;
 
@@ -72,8 +75,13 @@ class SubcontextProcess {
     const int init_fd_;
 };
 
-void SubcontextProcess::RunCommand(const SubcontextCommand::ExecuteCommand& execute_command,
-                                   SubcontextReply* reply) const {
+static void SetFailure(const ResultError& error, SubcontextReply::Failure* failure) {
+    failure->set_error_string(error.message());
+    failure->set_error_errno(error.code());
+}
+
+Result<void> SubcontextProcess::RunCommand(
+        const SubcontextCommand::ExecuteCommand& execute_command) const {
     // Need to use ArraySplice instead of this code.
     auto args = std::vector<std::string>();
     for (const auto& string : execute_command.args()) {
@@ -87,13 +95,39 @@ void SubcontextProcess::RunCommand(const SubcontextCommand::ExecuteCommand& exec
     } else {
         result = RunBuiltinFunction(map_result->function, args, context_);
     }
+    return result;
+}
 
-    if (result.ok()) {
-        reply->set_success(true);
-    } else {
-        auto* failure = reply->mutable_failure();
-        failure->set_error_string(result.error().message());
-        failure->set_error_errno(result.error().code());
+void SubcontextProcess::BatchExecute(
+        const SubcontextCommand::BatchExecuteCommand& batch_execute_command,
+        SubcontextReply* reply) const {
+    // Room is left for trigger_shutdown, and for at least one more result before we stop.
+    static constexpr size_t kReplyMargin = 512;
+
+    auto* batch_reply = reply->mutable_batch_execute_reply();
+    for (const auto& command : batch_execute_command.commands()) {
+        auto start = boot_clock::now();
+        auto result = RunCommand(command);
+        auto* command_result = batch_reply->add_results();
+        command_result->set_duration_ns(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(boot_clock::now() - start)
+                        .count());
+        if (!result.ok()) {
+            SetFailure(result.error(), command_result->mutable_failure());
+            // An error too long to fit is cut short, rather than failing the whole batch.
+            size_t size = reply->ByteSizeLong();
+            if (size > kBufferSize - kReplyMargin / 2) {
+                auto* error_string = command_result->mutable_failure()->mutable_error_string();
+                error_string->resize(error_string->size() -
+                                     std::min(error_string->size(),
+                                              size - (kBufferSize - kReplyMargin / 2)));
+            }
+        }
+        // The rest are run by another round trip: init handles a shutdown request first, and
+        // otherwise the reply is full.
+        if (!shutdown_command.empty() || reply->ByteSizeLong() > kBufferSize - kReplyMargin) {
+            break;
+        }
     }
 }
 
@@ -145,7 +179,16 @@ void SubcontextProcess::MainLoop() {
         auto reply = SubcontextReply();
         switch (subcontext_command.command_case()) {
             case SubcontextCommand::kExecuteCommand: {
-                RunCommand(subcontext_command.execute_command(), &reply);
+                auto result = RunCommand(subcontext_command.execute_command());
+                if (result.ok()) {
+                    reply.set_success(true);
+                } else {
+                    SetFailure(result.error(), reply.mutable_failure());
+                }
+                break;
+            }
+            case SubcontextCommand::kBatchExecuteCommand: {
+                BatchExecute(subcontext_command.batch_execute_command(), &reply);
                 break;
             }
             case SubcontextCommand::kExpandArgsCommand: {
@@ -296,6 +339,51 @@ Result<void> Subcontext::Execute(const std::vector<std::string>& args) {
     return {};
 }
 
+Result<std::vector<Subcontext::CommandResult>> Subcontext::BatchExecute(
+        const std::vector<std::vector<std::string>>& commands) {
+    auto subcontext_command = SubcontextCommand();
+    auto* batch_execute_command = subcontext_command.mutable_batch_execute_command();
+    for (const auto& args : commands) {
+        auto* execute_command = batch_execute_command->add_commands();
+        std::copy(args.begin(), args.end(),
+                  RepeatedPtrFieldBackInserter(execute_command->mutable_args()));
+        // Whatever doesn't fit in this message is left for the caller to send again.
+        if (batch_execute_command->commands_size() > 1 &&
+            subcontext_command.ByteSizeLong() > kBufferSize) {
+            batch_execute_command->mutable_commands()->RemoveLast();
+            break;
+        }
+    }
+
+    auto subcontext_reply = TransmitMessage(subcontext_command);
+    if (!subcontext_reply.ok()) {
+        return subcontext_reply.error();
+    }
+
+    if (subcontext_reply->reply_case() != SubcontextReply::kBatchExecuteReply) {
+        return Error() << "Unexpected message type from subcontext: "
+                       << subcontext_reply->reply_case();
+    }
+
+    auto& reply = subcontext_reply->batch_execute_reply();
+    if (reply.results_size() == 0 ||
+        reply.results_size() > batch_execute_command->commands_size()) {
+        return Error() << "Subcontext returned " << reply.results_size() << " results for "
+                       << batch_execute_command->commands_size() << " commands";
+    }
+    auto results = std::vector<CommandResult>{};
+    for (const auto& command_result : reply.results()) {
+        Result<void> result;
+        if (command_result.has_failure()) {
+            auto& failure = command_result.failure();
+            result = ResultError(failure.error_string(), failure.error_errno());
+        }
+        results.push_back(
+                {std::move(result), std::chrono::nanoseconds(command_result.duration_ns())});
+    }
+    return results;
+}
+
 Result<std::vector<std::string>> Subcontext::ExpandArgs(const std::vector<std::string>& args) {
     auto subcontext_command = SubcontextCommand{};
     std::copy(args.begin(), args.end(),
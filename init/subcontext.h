@@ -18,6 +18,7 @@
 
 #include <signal.h>
 
+#include <chrono>
 #include <string>
 #include <vector>
 
@@ -41,7 +42,17 @@ class Subcontext {
         Fork();
     }
 
+    struct CommandResult {
+        Result<void> result;
+        std::chrono::nanoseconds duration;
+    };
+
     Result<void> Execute(const std::vector<std::string>& args);
+    // Runs |commands| in order with a single round trip, rather than one per command.  Returns a
+    // result for each command that was run, which can be fewer than were given when they don't
+    // all fit in one message; the caller sends the rest again.
+    Result<std::vector<CommandResult>> BatchExecute(
+            const std::vector<std::vector<std::string>>& commands);
     Result<std::vector<std::string>> ExpandArgs(const std::vector<std::string>& args);
     void Restart();
     bool PathMatchesSubcontext(const std::string& path);
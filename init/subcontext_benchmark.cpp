@@ -22,7 +22,8 @@
 namespace android {
 namespace init {
 
-static void BenchmarkSuccess(benchmark::State& state) {
+template <typename F>
+static void RunBenchmark(benchmark::State& state, F&& benchmark_function) {
     if (getuid() != 0) {
         state.SkipWithError("Skipping benchmark, must be run as root.");
         return;
@@ -36,9 +37,7 @@ static void BenchmarkSuccess(benchmark::State& state) {
     auto subcontext = Subcontext({"path"}, context);
     free(context);
 
-    while (state.KeepRunning()) {
-        subcontext.Execute(std::vector<std::string>{"return_success"});
-    }
+    benchmark_function(subcontext);
 
     if (subcontext.pid() > 0) {
         kill(subcontext.pid(), SIGTERM);
@@ -46,8 +45,41 @@ static void BenchmarkSuccess(benchmark::State& state) {
     }
 }
 
+static void BenchmarkSuccess(benchmark::State& state) {
+    RunBenchmark(state, [&state](Subcontext& subcontext) {
+        while (state.KeepRunning()) {
+            subcontext.Execute(std::vector<std::string>{"return_success"});
+        }
+    });
+}
+
 BENCHMARK(BenchmarkSuccess);
 
+// An action's worth of commands, one round trip each.
+static void BenchmarkExecuteEach(benchmark::State& state) {
+    RunBenchmark(state, [&state](Subcontext& subcontext) {
+        while (state.KeepRunning()) {
+            for (int i = 0; i < state.range(0); ++i) {
+                subcontext.Execute(std::vector<std::string>{"return_success"});
+            }
+        }
+    });
+}
+
+BENCHMARK(BenchmarkExecuteEach)->Arg(4)->Arg(16);
+
+// The same commands in a single round trip.
+static void BenchmarkBatchExecute(benchmark::State& state) {
+    RunBenchmark(state, [&state](Subcontext& subcontext) {
+        auto commands = std::vector<std::vector<std::string>>(state.range(0), {"return_success"});
+        while (state.KeepRunning()) {
+            subcontext.BatchExecute(commands);
+        }
+    });
+}
+
+BENCHMARK(BenchmarkBatchExecute)->Arg(4)->Arg(16);
+
 BuiltinFunctionMap BuildTestFunctionMap() {
     auto function = [](const BuiltinArguments& args) { return Result<void>{}; };
     BuiltinFunctionMap test_function_map = {
@@ -177,6 +177,56 @@ TEST(subcontext, ExpandArgsFailure) {
     });
 }
 
+TEST(subcontext, BatchExecute) {
+    RunTest([](auto& subcontext) {
+        auto first_pid = subcontext.pid();
+
+        auto commands = std::vector<std::vector<std::string>>{
+                {"add_word", "this"},
+                {"add_word", "is"},
+                {"add_word", "a"},
+                {"add_word", "test"},
+                {"return_words_as_error"},
+                {"return_context_as_error"},
+        };
+        auto results = subcontext.BatchExecute(commands);
+        ASSERT_RESULT_OK(results);
+        ASSERT_EQ(commands.size(), results->size());
+        for (size_t i = 0; i < 4; ++i) {
+            EXPECT_RESULT_OK((*results)[i].result);
+        }
+        ASSERT_FALSE((*results)[4].result.ok());
+        EXPECT_EQ("this is a test", (*results)[4].result.error().message());
+        ASSERT_FALSE((*results)[5].result.ok());
+        EXPECT_EQ(kTestContext, (*results)[5].result.error().message());
+        EXPECT_EQ(first_pid, subcontext.pid());
+    });
+}
+
+TEST(subcontext, BatchExecuteReplyFull) {
+    RunTest([](auto& subcontext) {
+        auto first_pid = subcontext.pid();
+
+        // The error is too long to send whole, and leaves no room for the second result.
+        auto commands = std::vector<std::vector<std::string>>{
+                {"cause_log_fatal"},
+                {"generate_sane_error"},
+        };
+        auto results = subcontext.BatchExecute(commands);
+        ASSERT_RESULT_OK(results);
+        ASSERT_EQ(1U, results->size());
+        ASSERT_FALSE((*results)[0].result.ok());
+        EXPECT_EQ(std::string::npos, (*results)[0].result.error().message().find_first_not_of('f'));
+        EXPECT_EQ(first_pid, subcontext.pid());
+
+        results = subcontext.BatchExecute({commands[1]});
+        ASSERT_RESULT_OK(results);
+        ASSERT_EQ(1U, results->size());
+        ASSERT_FALSE((*results)[0].result.ok());
+        EXPECT_EQ("Sane error!", (*results)[0].result.error().message());
+    });
+}
+
 BuiltinFunctionMap BuildTestFunctionMap() {
     // For CheckDifferentPid
     auto do_return_pids_as_error = [](const BuiltinArguments& args) -> Result<void> {
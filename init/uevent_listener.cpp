@@ -17,8 +17,10 @@
 #include "uevent_listener.h"
 
 #include <fcntl.h>
+#include <linux/netlink.h>
 #include <poll.h>
 #include <string.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
 #include <memory>
@@ -86,7 +88,10 @@ static void ParseEvent(const char* msg, Uevent* uevent) {
     }
 }
 
-UeventListener::UeventListener(size_t uevent_socket_rcvbuf_size) {
+UeventListener::UeventListener(size_t uevent_socket_rcvbuf_size)
+    : batch_buffer_(kUeventBatchSize * (UEVENT_MSG_LEN + 2)),
+      batch_uevents_(kUeventBatchSize),
+      batch_valid_(kUeventBatchSize) {
     device_fd_.reset(uevent_open_socket(uevent_socket_rcvbuf_size, true));
     if (device_fd_ == -1) {
         LOG(FATAL) << "Could not open uevent socket";
@@ -95,25 +100,70 @@ UeventListener::UeventListener(size_t uevent_socket_rcvbuf_size) {
     fcntl(device_fd_, F_SETFL, O_NONBLOCK);
 }
 
-ReadUeventResult UeventListener::ReadUevent(Uevent* uevent) const {
-    char msg[UEVENT_MSG_LEN + 2];
-    int n = uevent_kernel_multicast_recv(device_fd_, msg, UEVENT_MSG_LEN);
+// Receives the uevents that are pending on the socket, up to kUeventBatchSize of them, and
+// returns how many were received.  Like uevent_kernel_multicast_recv(), this only accepts
+// multicast messages from the kernel.
+size_t UeventListener::ReceiveUeventBatch() {
+    struct Control {
+        alignas(cmsghdr) char data[CMSG_SPACE(sizeof(struct ucred))];
+    };
+    mmsghdr msgs[kUeventBatchSize] = {};
+    iovec iovs[kUeventBatchSize];
+    sockaddr_nl addrs[kUeventBatchSize];
+    Control controls[kUeventBatchSize];
+    for (size_t i = 0; i < kUeventBatchSize; ++i) {
+        iovs[i] = {&batch_buffer_[i * (UEVENT_MSG_LEN + 2)], UEVENT_MSG_LEN};
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+        msgs[i].msg_hdr.msg_control = controls[i].data;
+        msgs[i].msg_hdr.msg_controllen = sizeof(controls[i].data);
+    }
+
+    int n = TEMP_FAILURE_RETRY(recvmmsg(device_fd_, msgs, kUeventBatchSize, MSG_DONTWAIT, nullptr));
     if (n <= 0) {
-        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) {
             PLOG(ERROR) << "Error reading from Uevent Fd";
         }
-        return ReadUeventResult::kFailed;
-    }
-    if (n >= UEVENT_MSG_LEN) {
-        LOG(ERROR) << "Uevent overflowed buffer, discarding";
-        return ReadUeventResult::kInvalid;
+        return 0;
     }
 
-    msg[n] = '\0';
-    msg[n + 1] = '\0';
+    for (int i = 0; i < n; ++i) {
+        batch_valid_[i] = false;
+        char* msg = static_cast<char*>(iovs[i].iov_base);
+        size_t length = msgs[i].msg_len;
 
-    ParseEvent(msg, uevent);
+        cmsghdr* cmsg = CMSG_FIRSTHDR(&msgs[i].msg_hdr);
+        if (cmsg == nullptr || cmsg->cmsg_type != SCM_CREDENTIALS || addrs[i].nl_pid != 0 ||
+            addrs[i].nl_groups == 0) {
+            LOG(ERROR) << "Ignoring uevent that didn't come from the kernel";
+            continue;
+        }
+        if (length >= UEVENT_MSG_LEN || (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)) {
+            LOG(ERROR) << "Uevent overflowed buffer, discarding";
+            continue;
+        }
+
+        msg[length] = '\0';
+        msg[length + 1] = '\0';
+
+        ParseEvent(msg, &batch_uevents_[i]);
+        batch_valid_[i] = true;
+    }
+    return n;
+}
+
+ReadUeventResult UeventListener::ReadUevent(const Uevent** uevent) {
+    if (next_batch_uevent_ == batch_size_) {
+        batch_size_ = ReceiveUeventBatch();
+        next_batch_uevent_ = 0;
+        if (batch_size_ == 0) return ReadUeventResult::kFailed;
+    }
 
+    size_t i = next_batch_uevent_++;
+    if (!batch_valid_[i]) return ReadUeventResult::kInvalid;
+    *uevent = &batch_uevents_[i];
     return ReadUeventResult::kSuccess;
 }
 
@@ -126,7 +176,7 @@ ReadUeventResult UeventListener::ReadUevent(Uevent* uevent) const {
 //
 
 ListenerAction UeventListener::RegenerateUeventsForDir(DIR* d,
-                                                       const ListenerCallback& callback) const {
+                                                       const ListenerCallback& callback) {
     int dfd = dirfd(d);
 
     int fd = openat(dfd, "uevent", O_WRONLY | O_CLOEXEC);
@@ -134,12 +184,12 @@ ListenerAction UeventListener::RegenerateUeventsForDir(DIR* d,
         write(fd, "add\n", 4);
         close(fd);
 
-        Uevent uevent;
+        const Uevent* uevent;
         ReadUeventResult result;
         while ((result = ReadUevent(&uevent)) != ReadUeventResult::kFailed) {
             // Skip processing the uevent if it is invalid.
             if (result == ReadUeventResult::kInvalid) continue;
-            if (callback(uevent) == ListenerAction::kStop) return ListenerAction::kStop;
+            if (callback(*uevent) == ListenerAction::kStop) return ListenerAction::kStop;
         }
     }
 
@@ -165,7 +215,7 @@ ListenerAction UeventListener::RegenerateUeventsForDir(DIR* d,
 }
 
 ListenerAction UeventListener::RegenerateUeventsForPath(const std::string& path,
-                                                        const ListenerCallback& callback) const {
+                                                        const ListenerCallback& callback) {
     std::unique_ptr<DIR, decltype(&closedir)> d(opendir(path.c_str()), closedir);
     if (!d) return ListenerAction::kContinue;
 
@@ -174,14 +224,14 @@ ListenerAction UeventListener::RegenerateUeventsForPath(const std::string& path,
 
 static const char* kRegenerationPaths[] = {"/sys/devices"};
 
-void UeventListener::RegenerateUevents(const ListenerCallback& callback) const {
+void UeventListener::RegenerateUevents(const ListenerCallback& callback) {
     for (const auto path : kRegenerationPaths) {
         if (RegenerateUeventsForPath(path, callback) == ListenerAction::kStop) return;
     }
 }
 
 void UeventListener::Poll(const ListenerCallback& callback,
-                          const std::optional<std::chrono::milliseconds> relative_timeout) const {
+                          const std::optional<std::chrono::milliseconds> relative_timeout) {
     using namespace std::chrono;
 
     pollfd ufd;
@@ -212,12 +262,12 @@ void UeventListener::Poll(const ListenerCallback& callback,
         if (ufd.revents & POLLIN) {
             // We're non-blocking, so if we receive a poll event keep processing until
             // we have exhausted all uevent messages.
-            Uevent uevent;
+            const Uevent* uevent;
             ReadUeventResult result;
             while ((result = ReadUevent(&uevent)) != ReadUeventResult::kFailed) {
                 // Skip processing the uevent if it is invalid.
                 if (result == ReadUeventResult::kInvalid) continue;
-                if (callback(uevent) == ListenerAction::kStop) return;
+                if (callback(*uevent) == ListenerAction::kStop) return;
             }
         }
     }
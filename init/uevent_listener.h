@@ -22,6 +22,7 @@
 #include <chrono>
 #include <functional>
 #include <optional>
+#include <vector>
 
 #include <android-base/unique_fd.h>
 
@@ -49,17 +50,30 @@ class UeventListener {
   public:
     UeventListener(size_t uevent_socket_rcvbuf_size);
 
-    void RegenerateUevents(const ListenerCallback& callback) const;
+    void RegenerateUevents(const ListenerCallback& callback);
     ListenerAction RegenerateUeventsForPath(const std::string& path,
-                                            const ListenerCallback& callback) const;
+                                            const ListenerCallback& callback);
     void Poll(const ListenerCallback& callback,
-              const std::optional<std::chrono::milliseconds> relative_timeout = {}) const;
+              const std::optional<std::chrono::milliseconds> relative_timeout = {});
 
   private:
-    ReadUeventResult ReadUevent(Uevent* uevent) const;
-    ListenerAction RegenerateUeventsForDir(DIR* d, const ListenerCallback& callback) const;
+    // The most uevents received with one recvmmsg() call.
+    static constexpr size_t kUeventBatchSize = 16;
+
+    ReadUeventResult ReadUevent(const Uevent** uevent);
+    size_t ReceiveUeventBatch();
+    ListenerAction RegenerateUeventsForDir(DIR* d, const ListenerCallback& callback);
 
     android::base::unique_fd device_fd_;
+
+    // Uevents are received a batch at a time into these buffers, which are reused for every batch
+    // so that the strings in each Uevent keep their capacity.  Uevents that were received but not
+    // yet read, e.g. because a callback returned kStop, are read by the next call.
+    std::vector<char> batch_buffer_;
+    std::vector<Uevent> batch_uevents_;
+    std::vector<bool> batch_valid_;
+    size_t batch_size_ = 0;
+    size_t next_batch_uevent_ = 0;
 };
 
 }  // namespace init
@@ -27,7 +27,7 @@
 #include <sys/wait.h>
 #include <unistd.h>
 
-#include <set>
+#include <atomic>
 #include <thread>
 
 #include <android-base/chrono_utils.h>
@@ -40,6 +40,7 @@
 #include "devices.h"
 #include "firmware_handler.h"
 #include "modalias_handler.h"
+#include "parallel_restorecon.h"
 #include "selabel.h"
 #include "selinux.h"
 #include "uevent_handler.h"
@@ -68,13 +69,12 @@
 
 // Handling of uevent messages has two unique properties:
 // 1) It can be done in isolation; it doesn't need to read or write any status once it is started.
-// 2) It uses setegid() and setfscreatecon() so either care (aka locking) must be taken to ensure
-//    that no file system operations are done while the uevent process has an abnormal egid or
-//    fscreatecon or this handling must happen in a separate process.
-// Given the above two properties, it is best to fork() subprocesses to handle the uevents.  This
-// reduces the overhead and complexity that would be required in a solution with threads and locks.
-// In testing, a racy multithreaded solution has the same performance as the fork() solution, so
-// there is no reason to deal with the complexity of the former.
+// 2) It uses setegid() and setfscreatecon().  setfscreatecon() only affects the calling thread, but
+//    setegid() affects the whole process, so DeviceHandler holds a lock for as long as its egid is
+//    changed.
+// Given the above two properties, the uevents are handled by a pool of threads.  Unlike forked
+// subprocesses, the threads don't each pay for a fork(), and whatever the handlers learn while
+// handling the coldboot uevents stays around for the uevents that come after.
 
 // One other important caveat during the boot process is the handling of SELinux restorecon.
 // Since many devices have child devices, calling selinux_android_restorecon() recursively for each
@@ -87,17 +87,18 @@
 // 1) ueventd regenerates uevents by doing the /sys traversal and listens to the netlink socket for
 //    the generated uevents.  It writes these uevents into a queue represented by a vector.
 //
-// 2) ueventd forks 'n' separate uevent handler subprocesses and has each of them to handle the
-//    uevents in the queue based on a starting offset (their process number) and a stride (the total
-//    number of processes).  Note that no IPC happens at this point and only const functions from
-//    DeviceHandler should be called from this context.
+// 2) ueventd starts 'n' uevent handler threads, each of which takes the next unhandled uevent
+//    from the queue until there are none left.  Since some uevents take much longer than others
+//    to handle (e.g. those that load modules), handing them out one at a time keeps every thread
+//    busy until the end.
 //
-// 3) In parallel to the subprocesses handling the uevents, the main thread of ueventd calls
-//    selinux_android_restorecon() recursively on /sys/class, /sys/block, and /sys/devices.
+// 3) In parallel to the threads handling the uevents, the main thread of ueventd calls
+//    selinux_android_restorecon() recursively on /sys.  With parallel restorecon enabled, the
+//    handler threads instead take the subdirectories of /sys and /sys/devices the same way they
+//    take uevents, once the uevents are done.
 //
-// 4) Once the restorecon operation finishes, the main thread calls waitpid() to wait for all
-//    subprocess handlers to complete and exit.  Once this happens, it marks coldboot as having
-//    completed.
+// 4) Once the restorecon operation finishes, the main thread joins all of the handler threads.
+//    Once this happens, it marks coldboot as having completed.
 //
 // At this point, ueventd is single threaded, poll()'s and then handles any future uevents.
 
@@ -117,34 +118,35 @@ class ColdBoot {
              bool enable_parallel_restorecon)
         : uevent_listener_(uevent_listener),
           uevent_handlers_(uevent_handlers),
-          num_handler_subprocesses_(std::thread::hardware_concurrency() ?: 4),
-          enable_parallel_restorecon_(enable_parallel_restorecon) {}
+          num_handler_threads_(std::thread::hardware_concurrency() ?: 4),
+          enable_parallel_restorecon_(enable_parallel_restorecon),
+          restorecon_(SELINUX_ANDROID_RESTORECON_RECURSE) {}
 
     void Run();
 
   private:
-    void UeventHandlerMain(unsigned int process_num, unsigned int total_processes);
+    void UeventHandlerMain();
     void RegenerateUevents();
-    void ForkSubProcesses();
-    void WaitForSubProcesses();
-    void RestoreConHandler(unsigned int process_num, unsigned int total_processes);
+    void StartHandlerThreads();
+    void WaitForHandlerThreads();
     void GenerateRestoreCon(const std::string& directory);
 
     UeventListener& uevent_listener_;
     std::vector<std::unique_ptr<UeventHandler>>& uevent_handlers_;
 
-    unsigned int num_handler_subprocesses_;
+    unsigned int num_handler_threads_;
     bool enable_parallel_restorecon_;
 
     std::vector<Uevent> uevent_queue_;
+    std::atomic<size_t> next_uevent_ = 0;
 
-    std::set<pid_t> subprocess_pids_;
+    std::vector<std::thread> handler_threads_;
 
-    std::vector<std::string> restorecon_queue_;
+    ParallelRestorecon restorecon_;
 };
 
-void ColdBoot::UeventHandlerMain(unsigned int process_num, unsigned int total_processes) {
-    for (unsigned int i = process_num; i < uevent_queue_.size(); i += total_processes) {
+void ColdBoot::UeventHandlerMain() {
+    for (size_t i = next_uevent_++; i < uevent_queue_.size(); i = next_uevent_++) {
         auto& uevent = uevent_queue_[i];
 
         for (auto& uevent_handler : uevent_handlers_) {
@@ -153,14 +155,6 @@ void ColdBoot::UeventHandlerMain(unsigned int process_num, unsigned int total_pr
     }
 }
 
-void ColdBoot::RestoreConHandler(unsigned int process_num, unsigned int total_processes) {
-    for (unsigned int i = process_num; i < restorecon_queue_.size(); i += total_processes) {
-        auto& dir = restorecon_queue_[i];
-
-        selinux_android_restorecon(dir.c_str(), SELINUX_ANDROID_RESTORECON_RECURSE);
-    }
-}
-
 void ColdBoot::GenerateRestoreCon(const std::string& directory) {
     std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(directory.c_str()), &closedir);
 
@@ -176,7 +170,7 @@ void ColdBoot::GenerateRestoreCon(const std::string& directory) {
         if (S_ISDIR(st.st_mode)) {
             std::string fullpath = directory + "/" + dent->d_name;
             if (fullpath != "/sys/devices") {
-                restorecon_queue_.emplace_back(fullpath);
+                restorecon_.Add(fullpath);
             }
         }
     }
@@ -189,56 +183,28 @@ void ColdBoot::RegenerateUevents() {
     });
 }
 
-void ColdBoot::ForkSubProcesses() {
-    for (unsigned int i = 0; i < num_handler_subprocesses_; ++i) {
-        auto pid = fork();
-        if (pid < 0) {
-            PLOG(FATAL) << "fork() failed!";
-        }
-
-        if (pid == 0) {
-            UeventHandlerMain(i, num_handler_subprocesses_);
+void ColdBoot::StartHandlerThreads() {
+    for (unsigned int i = 0; i < num_handler_threads_; ++i) {
+        handler_threads_.emplace_back([this] {
+            UeventHandlerMain();
             if (enable_parallel_restorecon_) {
-                RestoreConHandler(i, num_handler_subprocesses_);
+                restorecon_.Work();
             }
-            _exit(EXIT_SUCCESS);
-        }
-
-        subprocess_pids_.emplace(pid);
+        });
     }
 }
 
-void ColdBoot::WaitForSubProcesses() {
-    // Treat subprocesses that crash or get stuck the same as if ueventd itself has crashed or gets
-    // stuck.
-    //
-    // When a subprocess crashes, we fatally abort from ueventd.  init will restart ueventd when
+void ColdBoot::WaitForHandlerThreads() {
+    // A handler thread that crashes takes ueventd down with it.  init will restart ueventd when
     // init reaps it, and the cold boot process will start again.  If this continues to fail, then
     // since ueventd is marked as a critical service, init will reboot to bootloader.
     //
-    // When a subprocess gets stuck, keep ueventd spinning waiting for it.  init has a timeout for
-    // cold boot and will reboot to the bootloader if ueventd does not complete in time.
-    while (!subprocess_pids_.empty()) {
-        int status;
-        pid_t pid = TEMP_FAILURE_RETRY(waitpid(-1, &status, 0));
-        if (pid == -1) {
-            PLOG(ERROR) << "waitpid() failed";
-            continue;
-        }
-
-        auto it = std::find(subprocess_pids_.begin(), subprocess_pids_.end(), pid);
-        if (it == subprocess_pids_.end()) continue;
-
-        if (WIFEXITED(status)) {
-            if (WEXITSTATUS(status) == EXIT_SUCCESS) {
-                subprocess_pids_.erase(it);
-            } else {
-                LOG(FATAL) << "subprocess exited with status " << WEXITSTATUS(status);
-            }
-        } else if (WIFSIGNALED(status)) {
-            LOG(FATAL) << "subprocess killed by signal " << WTERMSIG(status);
-        }
+    // When a handler thread gets stuck, keep ueventd waiting for it.  init has a timeout for cold
+    // boot and will reboot to the bootloader if ueventd does not complete in time.
+    for (auto& thread : handler_threads_) {
+        thread.join();
     }
+    handler_threads_.clear();
 }
 
 void ColdBoot::Run() {
@@ -254,13 +220,13 @@ void ColdBoot::Run() {
         GenerateRestoreCon("/sys/devices");
     }
 
-    ForkSubProcesses();
+    StartHandlerThreads();
 
     if (!enable_parallel_restorecon_) {
         selinux_android_restorecon("/sys", SELINUX_ANDROID_RESTORECON_RECURSE);
     }
 
-    WaitForSubProcesses();
+    WaitForHandlerThreads();
 
     android::base::SetProperty(kColdBootDoneProp, "true");
     LOG(INFO) << "Coldboot took " << cold_boot_timer.duration().count() / 1000.0f << " seconds";
@@ -315,10 +281,9 @@ int ueventd_main(int argc, char** argv) {
         uevent_handler->ColdbootDone();
     }
 
-    // We use waitpid() in ColdBoot, so we can't ignore SIGCHLD until now.
+    // FirmwareHandler forks a child for each firmware request, and these are never waited for.
     signal(SIGCHLD, SIG_IGN);
-    // Reap and pending children that exited between the last call to waitpid() and setting SIG_IGN
-    // for SIGCHLD above.
+    // Reap any of those children that exited during cold boot, before SIGCHLD was ignored.
     while (waitpid(-1, nullptr, WNOHANG) > 0) {
     }
 
@@ -17,8 +17,10 @@
 #include "libappfuse/FuseBridgeLoop.h"
 
 #include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/socket.h>
 
+#include <thread>
 #include <unordered_map>
 
 #include <android-base/logging.h>
@@ -77,6 +79,18 @@ class FuseBridgeEntry {
           last_proxy_events_({this, 0}),
           open_count_(0) {}
 
+    ~FuseBridgeEntry() {
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    // Starts a thread that services this bridge until it is closed or |stop_fd| is signalled,
+    // reporting back through |callback| from that thread.
+    void Start(int stop_fd, FuseBridgeLoopCallback* callback) {
+        thread_ = std::thread([this, stop_fd, callback] { Run(stop_fd, callback); });
+    }
+
     // Transfer bytes depends on availability of FDs and the internal |state_|.
     void Transfer(FuseBridgeLoopCallback* callback) {
         constexpr int kUnexpectedEventMask = ~(EPOLLIN | EPOLLOUT);
@@ -131,6 +145,8 @@ class FuseBridgeEntry {
   private:
     friend class BridgeEpollController;
 
+    void Run(int stop_fd, FuseBridgeLoopCallback* callback);
+
     FuseBridgeState ReadFromProxy() {
         switch (buffer_.response.ReadOrAgain(proxy_fd_)) {
             case ResultOrAgain::kSuccess:
@@ -254,6 +270,8 @@ class FuseBridgeEntry {
 
     int open_count_;
 
+    std::thread thread_;
+
     DISALLOW_COPY_AND_ASSIGN(FuseBridgeEntry);
 };
 
@@ -265,19 +283,27 @@ class BridgeEpollController : private EpollController {
         return InvokeControl(EPOLL_CTL_ADD, bridge);
     }
 
+    bool AddStopPoll(int stop_fd) const {
+        return EpollController::InvokeControl(EPOLL_CTL_ADD, stop_fd, EPOLLIN, nullptr);
+    }
+
     bool UpdateOrDeleteBridgePoll(FuseBridgeEntry* bridge) const {
         return InvokeControl(
             bridge->state_ != FuseBridgeState::kClosing ? EPOLL_CTL_MOD : EPOLL_CTL_DEL, bridge);
     }
 
+    // Returns false on error, or once the stop FD has been signalled.
     bool Wait(size_t bridge_count, std::unordered_set<FuseBridgeEntry*>* entries_out) {
         CHECK(entries_out);
-        const size_t event_count = std::max<size_t>(bridge_count * 2, 1);
+        const size_t event_count = bridge_count * 2 + 1;
         if (!EpollController::Wait(event_count)) {
             return false;
         }
         entries_out->clear();
         for (const auto& event : events()) {
+            if (event.data.ptr == nullptr) {
+                return false;
+            }
             FuseBridgeEntryEvent* const entry_event =
                 reinterpret_cast<FuseBridgeEntryEvent*>(event.data.ptr);
             entry_event->events = event.events;
@@ -311,16 +337,87 @@ class BridgeEpollController : private EpollController {
     }
 };
 
-std::recursive_mutex FuseBridgeLoop::mutex_;
-
-FuseBridgeLoop::FuseBridgeLoop() : opened_(true) {
+void FuseBridgeEntry::Run(int stop_fd, FuseBridgeLoopCallback* callback) {
     base::unique_fd epoll_fd(epoll_create1(EPOLL_CLOEXEC));
     if (epoll_fd.get() == -1) {
         PLOG(ERROR) << "Failed to open FD for epoll";
+        callback->OnClosed(mount_id_);
+        return;
+    }
+    BridgeEpollController controller(std::move(epoll_fd));
+    if (!controller.AddStopPoll(stop_fd) || !controller.AddBridgePoll(this)) {
+        callback->OnClosed(mount_id_);
+        return;
+    }
+
+    std::unordered_set<FuseBridgeEntry*> entries;
+    while (controller.Wait(1, &entries)) {
+        Transfer(callback);
+        if (!controller.UpdateOrDeleteBridgePoll(this) || IsClosing()) {
+            break;
+        }
+    }
+    callback->OnClosed(mount_id_);
+}
+
+struct BridgeEvent {
+    bool closed;
+    int mount_id;
+};
+
+// Carries OnMount() and OnClosed() from the bridges' threads to the thread running the loop, so
+// that the loop's callback is only ever invoked from the thread that called Start().
+class BridgeEventQueue : public FuseBridgeLoopCallback {
+  public:
+    explicit BridgeEventQueue(base::unique_fd&& event_fd) : event_fd_(std::move(event_fd)) {}
+
+    void OnMount(int mount_id) override { Push({false, mount_id}); }
+
+    void OnClosed(int mount_id) override { Push({true, mount_id}); }
+
+    // Blocks until there are events, and moves all of them to |events_out|.
+    bool Wait(std::vector<BridgeEvent>* events_out) {
+        uint64_t count;
+        if (TEMP_FAILURE_RETRY(read(event_fd_, &count, sizeof(count))) != sizeof(count)) {
+            PLOG(ERROR) << "Failed to read bridge events";
+            return false;
+        }
+        events_out->clear();
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_out->swap(events_);
+        return true;
+    }
+
+  private:
+    void Push(const BridgeEvent& event) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            events_.push_back(event);
+        }
+        const uint64_t count = 1;
+        if (TEMP_FAILURE_RETRY(write(event_fd_, &count, sizeof(count))) != sizeof(count)) {
+            PLOG(ERROR) << "Failed to signal a bridge event";
+        }
+    }
+
+    base::unique_fd event_fd_;
+    std::mutex mutex_;
+    std::vector<BridgeEvent> events_;
+
+    DISALLOW_COPY_AND_ASSIGN(BridgeEventQueue);
+};
+
+std::recursive_mutex FuseBridgeLoop::mutex_;
+
+FuseBridgeLoop::FuseBridgeLoop() : opened_(true) {
+    base::unique_fd event_fd(eventfd(0, EFD_CLOEXEC));
+    stop_fd_.reset(eventfd(0, EFD_CLOEXEC));
+    if (event_fd.get() == -1 || stop_fd_.get() == -1) {
+        PLOG(ERROR) << "Failed to open FD for events";
         opened_ = false;
         return;
     }
-    epoll_controller_.reset(new BridgeEpollController(std::move(epoll_fd)));
+    events_.reset(new BridgeEventQueue(std::move(event_fd)));
 }
 
 FuseBridgeLoop::~FuseBridgeLoop() { CHECK(bridges_.empty()); }
@@ -339,29 +436,29 @@ bool FuseBridgeLoop::AddBridge(int mount_id, base::unique_fd dev_fd, base::uniqu
         LOG(ERROR) << "Tried to add a mount point that has already been added";
         return false;
     }
-    if (!epoll_controller_->AddBridgePoll(bridge.get())) {
-        return false;
-    }
 
+    bridge->Start(stop_fd_, events_.get());
     bridges_.emplace(mount_id, std::move(bridge));
     return true;
 }
 
-bool FuseBridgeLoop::ProcessEventLocked(const std::unordered_set<FuseBridgeEntry*>& entries,
+bool FuseBridgeLoop::ProcessEventLocked(const std::vector<BridgeEvent>& events,
                                         FuseBridgeLoopCallback* callback) {
-    for (auto entry : entries) {
-        entry->Transfer(callback);
-        if (!epoll_controller_->UpdateOrDeleteBridgePoll(entry)) {
-            return false;
+    for (const auto& event : events) {
+        auto it = bridges_.find(event.mount_id);
+        if (it == bridges_.end()) {
+            continue;
         }
-        if (entry->IsClosing()) {
-            const int mount_id = entry->mount_id();
-            bridges_.erase(mount_id);
-            callback->OnClosed(mount_id);
-            if (bridges_.size() == 0) {
-                // All bridges are now closed.
-                return false;
-            }
+        if (!event.closed) {
+            callback->OnMount(event.mount_id);
+            continue;
+        }
+        // The bridge's thread has nothing left to do, so this doesn't wait for long.
+        bridges_.erase(it);
+        callback->OnClosed(event.mount_id);
+        if (bridges_.size() == 0) {
+            // All bridges are now closed.
+            return false;
         }
     }
     return true;
@@ -369,13 +466,21 @@ bool FuseBridgeLoop::ProcessEventLocked(const std::unordered_set<FuseBridgeEntry
 
 void FuseBridgeLoop::Start(FuseBridgeLoopCallback* callback) {
     LOG(DEBUG) << "Start fuse bridge loop";
-    std::unordered_set<FuseBridgeEntry*> entries;
+    if (!opened_) {
+        return;
+    }
+    std::vector<BridgeEvent> events;
     while (true) {
-        const bool wait_result = epoll_controller_->Wait(bridges_.size(), &entries);
-        LOG(VERBOSE) << "Receive epoll events";
+        const bool wait_result = events_->Wait(&events);
+        LOG(VERBOSE) << "Receive bridge events";
         {
             std::lock_guard<std::recursive_mutex> lock(mutex_);
-            if (!(wait_result && ProcessEventLocked(entries, callback))) {
+            if (!(wait_result && ProcessEventLocked(events, callback))) {
+                // Stop the bridges that are still running before closing them.
+                const uint64_t count = 1;
+                if (TEMP_FAILURE_RETRY(write(stop_fd_, &count, sizeof(count))) != sizeof(count)) {
+                    PLOG(FATAL) << "Failed to stop the bridges";
+                }
                 for (auto it = bridges_.begin(); it != bridges_.end();) {
                     callback->OnClosed(it->second->mount_id());
                     it = bridges_.erase(it);
@@ -18,11 +18,14 @@
 #define ANDROID_LIBAPPFUSE_FUSEBRIDGELOOP_H_
 
 #include <map>
+#include <memory>
 #include <mutex>
 #include <queue>
 #include <unordered_set>
+#include <vector>
 
 #include <android-base/macros.h>
+#include <android-base/unique_fd.h>
 
 #include "libappfuse/FuseBuffer.h"
 
@@ -38,7 +41,12 @@ class FuseBridgeLoopCallback {
 
 class FuseBridgeEntry;
 class BridgeEpollController;
+class BridgeEventQueue;
+struct BridgeEvent;
 
+// Forwards FUSE messages between each mount's device FD and its proxy FD. Every bridge is served
+// by a thread of its own, so that mounts don't wait on each other, while the callback is always
+// invoked on the thread running Start().
 class FuseBridgeLoop final {
   public:
     FuseBridgeLoop();
@@ -55,10 +63,12 @@ class FuseBridgeLoop final {
     static void Unlock();
 
   private:
-    bool ProcessEventLocked(const std::unordered_set<FuseBridgeEntry*>& entries,
+    bool ProcessEventLocked(const std::vector<BridgeEvent>& events,
                             FuseBridgeLoopCallback* callback);
 
-    std::unique_ptr<BridgeEpollController> epoll_controller_;
+    // Events from the bridges' threads, and an FD that tells all of them to stop.
+    std::unique_ptr<BridgeEventQueue> events_;
+    base::unique_fd stop_fd_;
 
     // Map between |mount_id| and bridge entry.
     std::map<int, std::unique_ptr<FuseBridgeEntry>> bridges_;
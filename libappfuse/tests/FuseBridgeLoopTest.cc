@@ -18,6 +18,9 @@
 
 #include <sys/socket.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <set>
 #include <sstream>
 #include <thread>
 
@@ -210,5 +213,97 @@ TEST_F(FuseBridgeLoopTest, Proxy) {
   Close();
 }
 
+class MultipleCallback : public FuseBridgeLoopCallback {
+ public:
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::set<int> mounted;
+  std::set<int> closed;
+  std::set<std::thread::id> threads;
+
+  void OnMount(int mount_id) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    mounted.insert(mount_id);
+    threads.insert(std::this_thread::get_id());
+  }
+
+  void OnClosed(int mount_id) override {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed.insert(mount_id);
+    threads.insert(std::this_thread::get_id());
+    cv.notify_all();
+  }
+};
+
+TEST(FuseBridgeLoopMultipleTest, IndependentMounts) {
+  constexpr int kMounts = 3;
+  base::unique_fd dev_sockets[kMounts][2];
+  base::unique_fd proxy_sockets[kMounts][2];
+  FuseBridgeLoop loop;
+  for (int i = 0; i < kMounts; i++) {
+    ASSERT_TRUE(SetupMessageSockets(&dev_sockets[i]));
+    ASSERT_TRUE(SetupMessageSockets(&proxy_sockets[i]));
+    ASSERT_TRUE(loop.AddBridge(i, std::move(dev_sockets[i][1]), std::move(proxy_sockets[i][0])));
+  }
+  ASSERT_FALSE(loop.AddBridge(0, base::unique_fd(), base::unique_fd()));
+
+  MultipleCallback callback;
+  std::thread thread([&] { loop.Start(&callback); });
+
+  FuseRequest request;
+  FuseResponse response;
+  for (int i = 0; i < kMounts; i++) {
+    memset(&request, 0, sizeof(FuseRequest));
+    request.header.opcode = FUSE_INIT;
+    request.header.unique = 1;
+    request.header.len = sizeof(fuse_in_header) + sizeof(fuse_init_in);
+    request.init_in.major = FUSE_KERNEL_VERSION;
+    request.init_in.minor = FUSE_KERNEL_MINOR_VERSION;
+    ASSERT_TRUE(request.Write(dev_sockets[i][0]));
+    ASSERT_TRUE(response.Read(dev_sockets[i][0]));
+    EXPECT_EQ(kFuseSuccess, response.header.error);
+  }
+
+  // A request that mount 0's proxy never answers doesn't hold up the others.
+  memset(&request, 0, sizeof(FuseRequest));
+  request.header.opcode = FUSE_GETATTR;
+  request.header.unique = 2;
+  request.header.len = sizeof(fuse_in_header);
+  ASSERT_TRUE(request.Write(dev_sockets[0][0]));
+  ASSERT_TRUE(request.Read(proxy_sockets[0][1]));
+  for (int i = 1; i < kMounts; i++) {
+    ASSERT_TRUE(request.Write(dev_sockets[i][0]));
+    ASSERT_TRUE(request.Read(proxy_sockets[i][1]));
+    response.ResetHeader(0, kFuseSuccess, 2);
+    ASSERT_TRUE(response.Write(proxy_sockets[i][1]));
+    ASSERT_TRUE(response.Read(dev_sockets[i][0]));
+    EXPECT_EQ(2u, response.header.unique);
+  }
+
+  // Closing one mount leaves the others running.
+  dev_sockets[1][0].reset();
+  proxy_sockets[1][1].reset();
+  {
+    std::unique_lock<std::mutex> lock(callback.mutex);
+    callback.cv.wait(lock, [&] { return callback.closed.count(1) != 0; });
+  }
+  response.ResetHeader(0, kFuseSuccess, 2);
+  ASSERT_TRUE(response.Write(proxy_sockets[0][1]));
+  ASSERT_TRUE(response.Read(dev_sockets[0][0]));
+  EXPECT_EQ(2u, response.header.unique);
+
+  for (int i = 0; i < kMounts; i++) {
+    dev_sockets[i][0].reset();
+    proxy_sockets[i][1].reset();
+  }
+  thread.join();
+
+  EXPECT_EQ(kMounts, static_cast<int>(callback.mounted.size()));
+  EXPECT_EQ(kMounts, static_cast<int>(callback.closed.size()));
+  // The callback is only ever invoked on the thread running the loop.
+  EXPECT_EQ(1u, callback.threads.size());
+  EXPECT_EQ(0u, callback.threads.count(std::this_thread::get_id()));
+}
+
 }  // namespace fuse
 }  // namespace android
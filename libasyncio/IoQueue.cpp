@@ -0,0 +1,345 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <asyncio/IoQueue.h>
+
+#include <asyncio/AsyncIO.h>
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+namespace android {
+namespace asyncio {
+
+namespace {
+
+class AioQueue : public IoQueue {
+  public:
+    explicit AioQueue(unsigned depth) : depth_(depth), events_(depth) {}
+    ~AioQueue() override {
+        if (ctx_) io_destroy(ctx_);
+    }
+
+    bool Init() { return io_setup(depth_, &ctx_) == 0; }
+
+    const char* backend() const override { return "aio"; }
+
+    bool RegisterFiles(const int*, unsigned) override { return false; }
+    bool RegisterBuffers(const struct iovec*, unsigned) override { return false; }
+
+    bool SetEventFd(int fd) override {
+        event_fd_ = fd;
+        return true;
+    }
+
+    bool PrepRead(int fd, void* buf, size_t count, int64_t offset, uint64_t data) override {
+        return Prep(fd, buf, count, offset, data, true);
+    }
+
+    bool PrepWrite(int fd, const void* buf, size_t count, int64_t offset,
+                   uint64_t data) override {
+        return Prep(fd, buf, count, offset, data, false);
+    }
+
+    int Submit() override {
+        if (prepared_.empty()) return 0;
+        // The kernel copies the iocbs in, so they can go as soon as they are submitted.
+        std::vector<iocb*> iocbs;
+        for (auto& cb : prepared_) iocbs.push_back(&cb);
+        int rc = TEMP_FAILURE_RETRY(io_submit(ctx_, iocbs.size(), iocbs.data()));
+        if (rc < 0 && errno != EAGAIN) {
+            // io_submit() fails outright when the first request is bad.  Complete it with the
+            // error, as io_uring would, so that one bad request can't wedge the queue.
+            failed_.push_back({prepared_.front().aio_data, -errno});
+            rc = 1;
+        }
+        if (rc <= 0) return rc;
+        prepared_.erase(prepared_.begin(), prepared_.begin() + rc);
+        return rc;
+    }
+
+    int Wait(Completion* completions, unsigned min_completions, unsigned max_completions,
+             const struct timespec* timeout) override {
+        if (Submit() < 0 && errno != EAGAIN) return -1;
+        unsigned n = std::min<size_t>(failed_.size(), max_completions);
+        std::copy(failed_.begin(), failed_.begin() + n, completions);
+        failed_.erase(failed_.begin(), failed_.begin() + n);
+        min_completions -= std::min(min_completions, n);
+        max_completions = std::min(max_completions - n, depth_);
+        if (max_completions == 0) return n;
+
+        struct timespec ts;
+        if (timeout) ts = *timeout;
+        int rc = TEMP_FAILURE_RETRY(io_getevents(ctx_, min_completions, max_completions,
+                                                 events_.data(), timeout ? &ts : nullptr));
+        if (rc < 0) return n > 0 ? n : -1;
+        for (int i = 0; i < rc; i++) {
+            completions[n + i] = {events_[i].data, events_[i].res};
+        }
+        return n + rc;
+    }
+
+  private:
+    bool Prep(int fd, const void* buf, size_t count, int64_t offset, uint64_t data, bool read) {
+        if (prepared_.size() == depth_) {
+            errno = EAGAIN;
+            return false;
+        }
+        iocb& cb = prepared_.emplace_back();
+        io_prep(&cb, fd, buf, count, offset, read);
+        cb.aio_data = data;
+        if (event_fd_ >= 0) {
+            cb.aio_flags = IOCB_FLAG_RESFD;
+            cb.aio_resfd = event_fd_;
+        }
+        return true;
+    }
+
+    unsigned depth_;
+    aio_context_t ctx_ = 0;
+    int event_fd_ = -1;
+    std::vector<iocb> prepared_;
+    std::vector<io_event> events_;
+    std::vector<Completion> failed_;
+};
+
+#if defined(__NR_io_uring_setup)
+
+// The ring indices are shared with the kernel: what it writes is loaded with acquire, and what
+// we write is stored with release semantics.
+unsigned LoadAcquire(const unsigned* p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+void StoreRelease(unsigned* p, unsigned value) {
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+class UringQueue : public IoQueue {
+  public:
+    ~UringQueue() override {
+        if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_size_);
+        if (ring_ != MAP_FAILED) munmap(ring_, ring_size_);
+        if (ring_fd_ >= 0) close(ring_fd_);
+    }
+
+    bool Init(unsigned depth) {
+        io_uring_params params = {};
+        ring_fd_ = syscall(__NR_io_uring_setup, depth, &params);
+        if (ring_fd_ < 0) return false;
+        // IORING_OP_READ and IORING_OP_WRITE came with 5.6, as did this feature; a single
+        // mapping for both rings came before.
+        if (!(params.features & IORING_FEAT_RW_CUR_POS) ||
+            !(params.features & IORING_FEAT_SINGLE_MMAP)) {
+            errno = ENOSYS;
+            return false;
+        }
+
+        ring_size_ = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                              params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+        ring_ = mmap(nullptr, ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring_fd_, IORING_OFF_SQ_RING);
+        if (ring_ == MAP_FAILED) return false;
+        sqes_size_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     ring_fd_, IORING_OFF_SQES);
+        if (sqes_ == MAP_FAILED) return false;
+
+        auto ring = static_cast<char*>(ring_);
+        sq_head_ = reinterpret_cast<unsigned*>(ring + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(ring + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(ring + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(ring + params.sq_off.array);
+        sq_entries_ = params.sq_entries;
+        cq_head_ = reinterpret_cast<unsigned*>(ring + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(ring + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(ring + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(ring + params.cq_off.cqes);
+        prepared_tail_ = *sq_tail_;
+        return true;
+    }
+
+    const char* backend() const override { return "io_uring"; }
+
+    bool RegisterFiles(const int* fds, unsigned count) override {
+        if (Register(IORING_REGISTER_FILES, fds, count) < 0) return false;
+        files_.assign(fds, fds + count);
+        return true;
+    }
+
+    bool RegisterBuffers(const struct iovec* buffers, unsigned count) override {
+        if (Register(IORING_REGISTER_BUFFERS, buffers, count) < 0) return false;
+        buffers_.assign(buffers, buffers + count);
+        return true;
+    }
+
+    bool SetEventFd(int fd) override { return Register(IORING_REGISTER_EVENTFD, &fd, 1) == 0; }
+
+    bool PrepRead(int fd, void* buf, size_t count, int64_t offset, uint64_t data) override {
+        return Prep(IORING_OP_READ, IORING_OP_READ_FIXED, fd, buf, count, offset, data);
+    }
+
+    bool PrepWrite(int fd, const void* buf, size_t count, int64_t offset,
+                   uint64_t data) override {
+        return Prep(IORING_OP_WRITE, IORING_OP_WRITE_FIXED, fd, buf, count, offset, data);
+    }
+
+    int Submit() override { return Enter(0, 0); }
+
+    int Wait(Completion* completions, unsigned min_completions, unsigned max_completions,
+             const struct timespec* timeout) override {
+        if (!timeout) {
+            // Submitting and waiting take one system call between them.
+            if (Enter(min_completions, IORING_ENTER_GETEVENTS) < 0) return -1;
+        } else {
+            if (Enter(0, 0) < 0 && errno != EAGAIN && errno != EBUSY) return -1;
+            timespec now, deadline;
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += timeout->tv_sec;
+            deadline.tv_nsec += timeout->tv_nsec;
+            while (Ready() < min_completions) {
+                clock_gettime(CLOCK_MONOTONIC, &now);
+                int64_t timeout_ms = (deadline.tv_sec - now.tv_sec) * 1000 +
+                                     (deadline.tv_nsec - now.tv_nsec + 999999) / 1000000;
+                if (timeout_ms <= 0) break;
+                // The ring fd polls readable while there are completions to reap.
+                pollfd pfd = {.fd = ring_fd_, .events = POLLIN, .revents = 0};
+                if (poll(&pfd, 1, timeout_ms) < 0 && errno != EINTR) return -1;
+            }
+        }
+
+        unsigned head = *cq_head_;
+        unsigned tail = LoadAcquire(cq_tail_);
+        unsigned n = 0;
+        for (; n < max_completions && head != tail; n++, head++) {
+            const io_uring_cqe& cqe = cqes_[head & cq_mask_];
+            completions[n] = {cqe.user_data, cqe.res};
+        }
+        StoreRelease(cq_head_, head);
+        return n;
+    }
+
+  private:
+    int Register(unsigned opcode, const void* arg, unsigned count) {
+        return syscall(__NR_io_uring_register, ring_fd_, opcode, arg, count);
+    }
+
+    unsigned Ready() { return LoadAcquire(cq_tail_) - *cq_head_; }
+
+    // Hands the prepared entries over and, with IORING_ENTER_GETEVENTS, waits for
+    // |min_completions|.  Returns how many entries were submitted.
+    int Enter(unsigned min_completions, unsigned flags) {
+        StoreRelease(sq_tail_, prepared_tail_);
+        unsigned to_submit = prepared_tail_ - LoadAcquire(sq_head_);
+        if (to_submit == 0 && !(flags & IORING_ENTER_GETEVENTS)) return 0;
+        int rc;
+        do {
+            rc = syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_completions, flags,
+                         nullptr, 0);
+            // An interrupted wait has submitted everything already.
+            to_submit = prepared_tail_ - LoadAcquire(sq_head_);
+        } while (rc < 0 && errno == EINTR);
+        return rc;
+    }
+
+    bool Prep(uint8_t opcode, uint8_t fixed_opcode, int fd, const void* buf, size_t count,
+              int64_t offset, uint64_t data) {
+        if (prepared_tail_ - LoadAcquire(sq_head_) == sq_entries_) {
+            errno = EAGAIN;
+            return false;
+        }
+        unsigned index = prepared_tail_ & sq_mask_;
+        io_uring_sqe* sqe = &static_cast<io_uring_sqe*>(sqes_)[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->addr = reinterpret_cast<uintptr_t>(buf);
+        sqe->len = count;
+        sqe->off = offset;
+        sqe->user_data = data;
+
+        auto file = std::find(files_.begin(), files_.end(), fd);
+        if (file != files_.end()) {
+            sqe->fd = file - files_.begin();
+            sqe->flags |= IOSQE_FIXED_FILE;
+        }
+        auto start = static_cast<const char*>(buf);
+        for (size_t i = 0; i < buffers_.size(); i++) {
+            auto base = static_cast<const char*>(buffers_[i].iov_base);
+            if (start >= base && start + count <= base + buffers_[i].iov_len) {
+                sqe->opcode = fixed_opcode;
+                sqe->buf_index = i;
+                break;
+            }
+        }
+
+        sq_array_[index] = index;
+        prepared_tail_++;
+        return true;
+    }
+
+    int ring_fd_ = -1;
+    void* ring_ = MAP_FAILED;
+    size_t ring_size_ = 0;
+    void* sqes_ = MAP_FAILED;
+    size_t sqes_size_ = 0;
+
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    // Entries up to here are filled in, but only published to the kernel by Enter().
+    unsigned prepared_tail_ = 0;
+
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    std::vector<int> files_;
+    std::vector<struct iovec> buffers_;
+};
+
+#endif  // __NR_io_uring_setup
+
+}  // namespace
+
+std::unique_ptr<IoQueue> IoQueue::Create(unsigned depth, bool allow_io_uring) {
+#if defined(__NR_io_uring_setup)
+    if (allow_io_uring) {
+        auto uring = std::make_unique<UringQueue>();
+        // Old kernels, and seccomp or SELinux policy that doesn't allow io_uring, all end up
+        // with AIO.
+        if (uring->Init(depth)) return uring;
+    }
+#else
+    (void)allow_io_uring;
+#endif
+    auto aio = std::make_unique<AioQueue>(depth);
+    if (aio->Init()) return aio;
+    return nullptr;
+}
+
+}  // namespace asyncio
+}  // namespace android
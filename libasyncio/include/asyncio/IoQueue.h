@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include <memory>
+
+namespace android {
+namespace asyncio {
+
+/**
+ * A queue of asynchronous reads and writes, backed by io_uring when the kernel supports it and
+ * by Linux AIO otherwise.
+ *
+ * Requests are prepared one at a time and handed to the kernel together by Submit(), and
+ * completions are reaped in batches by Wait().  A queue is not thread-safe, and everything
+ * submitted must be reaped before it is destroyed, as the kernel may still be using the buffers.
+ */
+class IoQueue {
+  public:
+    struct Completion {
+        uint64_t data;  // as passed to PrepRead() or PrepWrite()
+        int64_t res;    // bytes transferred, or a negative errno value
+    };
+
+    /**
+     * Creates a queue with room for |depth| requests in flight.  io_uring is only tried if
+     * |allow_io_uring|.  Returns nullptr with errno set if neither backend is available.
+     */
+    static std::unique_ptr<IoQueue> Create(unsigned depth, bool allow_io_uring = true);
+
+    virtual ~IoQueue() = default;
+
+    /** "io_uring" or "aio", for logging. */
+    virtual const char* backend() const = 0;
+
+    /**
+     * Registers files and buffers with the kernel up front, so that requests using them skip the
+     * per-request file lookup and page pinning.  Requests keep passing plain fds and pointers;
+     * the queue picks the registered ones up by itself.  Both may only be called once, and
+     * returning false, as the AIO backend always does, only means requests take the slow path.
+     */
+    virtual bool RegisterFiles(const int* fds, unsigned count) = 0;
+    virtual bool RegisterBuffers(const struct iovec* buffers, unsigned count) = 0;
+
+    /** Signals |fd|, an eventfd, for each completion. */
+    virtual bool SetEventFd(int fd) = 0;
+
+    /**
+     * Prepares a request, without any system call.  |data| is passed back in its completion.
+     * Returns false if the queue is full.
+     */
+    virtual bool PrepRead(int fd, void* buf, size_t count, int64_t offset, uint64_t data) = 0;
+    virtual bool PrepWrite(int fd, const void* buf, size_t count, int64_t offset,
+                           uint64_t data) = 0;
+
+    /**
+     * Submits all prepared requests with a single system call.  Returns how many were accepted,
+     * the rest stay prepared, or -1 with errno set.
+     */
+    virtual int Submit() = 0;
+
+    /**
+     * Submits anything still prepared, then waits for at least |min_completions| and reaps up to
+     * |max_completions| into |completions|.  A null |timeout| waits forever.  Returns the number
+     * reaped, or -1 with errno set.
+     */
+    virtual int Wait(Completion* completions, unsigned min_completions, unsigned max_completions,
+                     const struct timespec* timeout = nullptr) = 0;
+};
+
+}  // namespace asyncio
+}  // namespace android
@@ -39,19 +39,14 @@ extern "C" char* __cxa_demangle(const char*, char*, size_t*, int*);
 // Backtrace functions.
 //-------------------------------------------------------------------------
 Backtrace::Backtrace(pid_t pid, pid_t tid, BacktraceMap* map)
-    : pid_(pid), tid_(tid), map_(map), map_shared_(true) {
+    : pid_(pid), tid_(tid), map_(map) {
   if (map_ == nullptr) {
-    map_ = BacktraceMap::Create(pid);
-    map_shared_ = false;
+    shared_map_ = BacktraceMap::CreateShared(pid);
+    map_ = shared_map_.get();
   }
 }
 
-Backtrace::~Backtrace() {
-  if (map_ && !map_shared_) {
-    delete map_;
-    map_ = nullptr;
-  }
-}
+Backtrace::~Backtrace() {}
 
 std::string Backtrace::GetFunctionName(uint64_t pc, uint64_t* offset, const backtrace_map_t* map) {
   backtrace_map_t map_value;
@@ -22,6 +22,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include <log/log.h>
 
 #include <android-base/stringprintf.h>
@@ -50,14 +52,16 @@ BacktraceMap::~BacktraceMap() {}
 
 void BacktraceMap::FillIn(uint64_t addr, backtrace_map_t* map) {
   ScopedBacktraceMapIteratorLock lock(this);
-  for (auto it = begin(); it != end(); ++it) {
-    const backtrace_map_t* entry = *it;
-    if (addr >= entry->start && addr < entry->end) {
-      *map = *entry;
-      return;
-    }
+  // The only map that can contain addr is the last one that starts at or before it.
+  auto it = std::upper_bound(
+      maps_.begin(), maps_.end(), addr,
+      [](uint64_t addr, const backtrace_map_t& entry) { return addr < entry.start; });
+  if (it == maps_.begin() || addr >= std::prev(it)->end) {
+    *map = {};
+    return;
   }
-  *map = {};
+  // Go through the iterator so that the load bias is filled in.
+  *map = **iterator(this, std::prev(it) - maps_.begin());
 }
 
 #if defined(__APPLE__)
@@ -120,6 +124,9 @@ bool BacktraceMap::Build() {
     }
   }
   pclose(fp);
+  std::stable_sort(
+      maps_.begin(), maps_.end(),
+      [](const backtrace_map_t& a, const backtrace_map_t& b) { return a.start < b.start; });
   return true;
 #else
   return android::procinfo::ReadProcessMaps(
@@ -145,4 +152,8 @@ BacktraceMap* BacktraceMap::Create(pid_t pid, bool /*uncached*/) {
   }
   return map;
 }
+
+std::shared_ptr<BacktraceMap> BacktraceMap::CreateShared(pid_t pid) {
+  return std::shared_ptr<BacktraceMap>(Create(pid));
+}
 #endif
@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define _GNU_SOURCE 1
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+#include <backtrace/Backtrace.h>
+
+// Frame records are read with process_vm_readv on our own pid, rather than
+// dereferenced, so that a corrupt frame pointer makes the unwind stop
+// instead of crashing the caller, which may be a signal handler.
+//
+// Stack reads are done a window at a time, so most frames cost no system
+// call at all. A remote iovec is never allowed to cross a 4K boundary, since
+// a partial read only ever stops between iovecs, and the window would
+// otherwise be lost entirely when it runs into an unmapped page.
+namespace {
+
+constexpr uintptr_t kChunkSize = 4096;
+constexpr size_t kWindowSize = 1024;
+// Frames bigger than this are taken to be a corrupt frame pointer.
+constexpr uintptr_t kMaxFrameSize = 1024 * 1024;
+
+class StackReader {
+ public:
+  StackReader() : pid_(getpid()) {}
+
+  // Reads the frame record at |fp|, the caller's frame pointer followed by
+  // the return address.
+  bool ReadFrameRecord(uintptr_t fp, uintptr_t* next_fp, uintptr_t* return_addr) {
+    if (fp < start_ || fp - start_ + 2 * sizeof(uintptr_t) > size_) {
+      if (!Fill(fp)) {
+        return false;
+      }
+    }
+    memcpy(next_fp, &window_[fp - start_], sizeof(uintptr_t));
+    memcpy(return_addr, &window_[fp - start_ + sizeof(uintptr_t)], sizeof(uintptr_t));
+    return true;
+  }
+
+ private:
+  bool Fill(uintptr_t addr) {
+    if (addr > UINTPTR_MAX - kWindowSize) {
+      return false;
+    }
+    iovec local = {window_, kWindowSize};
+    iovec remote[2];
+    size_t num_remote = 0;
+    uintptr_t cur = addr;
+    const uintptr_t end = addr + kWindowSize;
+    while (cur < end) {
+      uintptr_t chunk_end = (cur | (kChunkSize - 1)) + 1;
+      if (chunk_end == 0 || chunk_end > end) {
+        chunk_end = end;
+      }
+      remote[num_remote].iov_base = reinterpret_cast<void*>(cur);
+      remote[num_remote].iov_len = chunk_end - cur;
+      num_remote++;
+      cur = chunk_end;
+    }
+
+    ssize_t bytes = process_vm_readv(pid_, &local, 1, remote, num_remote, 0);
+    if (bytes < static_cast<ssize_t>(2 * sizeof(uintptr_t))) {
+      start_ = 0;
+      size_ = 0;
+      return false;
+    }
+    start_ = addr;
+    size_ = static_cast<size_t>(bytes);
+    return true;
+  }
+
+  pid_t pid_;
+  uintptr_t start_ = 0;
+  size_t size_ = 0;
+  uint8_t window_[kWindowSize];
+};
+
+}  // namespace
+
+static bool GetContextRegs(void* ucontext, uintptr_t* pc, uintptr_t* fp) {
+  const ucontext_t* context = reinterpret_cast<const ucontext_t*>(ucontext);
+#if defined(__aarch64__)
+  *pc = context->uc_mcontext.pc;
+  *fp = context->uc_mcontext.regs[29];
+  return true;
+#elif defined(__arm__)
+  *pc = context->uc_mcontext.arm_pc;
+  // Thumb code uses r7 as the frame pointer.
+  if (context->uc_mcontext.arm_cpsr & (1 << 5)) {
+    *fp = context->uc_mcontext.arm_r7;
+  } else {
+    *fp = context->uc_mcontext.arm_fp;
+  }
+  return true;
+#elif defined(__x86_64__)
+  *pc = context->uc_mcontext.gregs[REG_RIP];
+  *fp = context->uc_mcontext.gregs[REG_RBP];
+  return true;
+#elif defined(__i386__)
+  *pc = context->uc_mcontext.gregs[REG_EIP];
+  *fp = context->uc_mcontext.gregs[REG_EBP];
+  return true;
+#else
+  (void)context;
+  (void)pc;
+  (void)fp;
+  return false;
+#endif
+}
+
+size_t Backtrace::UnwindFramePointers(uint64_t* pcs, size_t max_frames, size_t num_ignore_frames,
+                                      void* context) {
+  if (max_frames == 0) {
+    return 0;
+  }
+
+  int saved_errno = errno;
+  size_t num_frames = 0;
+  auto add_pc = [&](uintptr_t pc) {
+    if (num_ignore_frames > 0) {
+      num_ignore_frames--;
+      return true;
+    }
+    pcs[num_frames++] = pc;
+    return num_frames < max_frames;
+  };
+
+  uintptr_t fp;
+  if (context != nullptr) {
+    uintptr_t pc;
+    if (!GetContextRegs(context, &pc, &fp) || !add_pc(pc)) {
+      errno = saved_errno;
+      return num_frames;
+    }
+  } else {
+    fp = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+  }
+
+  StackReader reader;
+  while (fp != 0 && (fp & (sizeof(uintptr_t) - 1)) == 0) {
+    uintptr_t next_fp;
+    uintptr_t return_addr;
+    if (!reader.ReadFrameRecord(fp, &next_fp, &return_addr) || return_addr == 0 ||
+        !add_pc(return_addr)) {
+      break;
+    }
+    // The stack grows down, so callers' frames are always higher up.
+    if (next_fp <= fp || next_fp - fp > kMaxFrameSize) {
+      break;
+    }
+    fp = next_fp;
+  }
+  errno = saved_errno;
+  return num_frames;
+}
@@ -20,6 +20,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include <backtrace/BacktraceMap.h>
 
 #include <libunwind.h>
@@ -61,9 +63,10 @@ bool UnwindMapRemote::GenerateMap() {
     map.flags = unw_map.flags;
     map.name = unw_map.path;
 
-    // The maps are in descending order, but we want them in ascending order.
-    maps_.push_front(map);
+    maps_.push_back(map);
   }
+  // The maps are in descending order, but we want them in ascending order.
+  std::reverse(maps_.begin(), maps_.end());
 
   return true;
 }
@@ -112,9 +115,10 @@ bool UnwindMapLocal::GenerateMap() {
 
       free(unw_map.path);
 
-      // The maps are in descending order, but we want them in ascending order.
-      maps_.push_front(map);
+      maps_.push_back(map);
     }
+    // The maps are in descending order, but we want them in ascending order.
+    std::reverse(maps_.begin(), maps_.end());
     // Check to see if the map changed while getting the data.
     if (ret != -UNW_EINVAL) {
       generated = true;
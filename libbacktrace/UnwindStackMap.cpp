@@ -18,9 +18,14 @@
 #include <stdlib.h>
 #include <sys/types.h>
 
+#include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
 #include <backtrace/BacktraceMap.h>
 #include <unwindstack/Elf.h>
 #include <unwindstack/MapInfo.h>
@@ -39,7 +44,36 @@ bool UnwindStackMap::Build() {
   } else {
     stack_maps_.reset(new unwindstack::RemoteMaps(pid_));
   }
+  return ParseMaps();
+}
 
+bool UnwindStackMap::BuildFrom(const std::string& content, UnwindStackMap* previous) {
+  stack_maps_.reset(new unwindstack::BufferMaps(content.c_str()));
+  if (!ParseMaps()) {
+    return false;
+  }
+  if (previous == nullptr) {
+    return true;
+  }
+
+  // Both sets of maps are sorted by start, so walk them side by side.
+  unwindstack::Maps* old_maps = previous->stack_maps();
+  size_t old_index = 0;
+  for (const auto& map_info : *stack_maps_) {
+    unwindstack::MapInfo* old_info;
+    while ((old_info = old_maps->Get(old_index)) != nullptr && old_info->start < map_info->start) {
+      old_index++;
+    }
+    if (old_info != nullptr && old_info->start == map_info->start &&
+        old_info->end == map_info->end && old_info->offset == map_info->offset &&
+        old_info->flags == map_info->flags && old_info->name == map_info->name) {
+      map_info->ShareElf(old_info);
+    }
+  }
+  return true;
+}
+
+bool UnwindStackMap::ParseMaps() {
   // Create the process memory object.
   process_memory_ = unwindstack::Memory::CreateProcessMemory(pid_);
 
@@ -152,3 +186,52 @@ BacktraceMap* BacktraceMap::Create(pid_t pid, bool uncached) {
   }
   return map;
 }
+
+std::shared_ptr<BacktraceMap> BacktraceMap::CreateShared(pid_t pid) {
+  struct SharedMap {
+    // The maps file that the map was built from.
+    std::string content;
+    std::weak_ptr<BacktraceMap> map;
+  };
+  static std::mutex lock;
+  static auto& shared_maps = *new std::unordered_map<pid_t, SharedMap>;
+  // The map of the current process is kept between backtraces, since it is
+  // likely to be used again. The others only live as long as they are used.
+  static auto& local_map = *new std::shared_ptr<BacktraceMap>;
+
+  if (pid < 0) {
+    pid = getpid();
+  }
+  // Reading the file is cheap compared to parsing it and reading the elf
+  // files all over again, which is what it saves when nothing has changed.
+  std::string content;
+  if (!android::base::ReadFileToString(android::base::StringPrintf("/proc/%d/maps", pid),
+                                       &content)) {
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> guard(lock);
+  for (auto it = shared_maps.begin(); it != shared_maps.end();) {
+    if (it->second.map.expired()) {
+      it = shared_maps.erase(it);
+    } else {
+      ++it;
+    }
+  }
+
+  SharedMap& shared = shared_maps[pid];
+  std::shared_ptr<BacktraceMap> map = shared.map.lock();
+  if (map != nullptr && shared.content == content) {
+    return map;
+  }
+  std::shared_ptr<UnwindStackMap> new_map(new UnwindStackMap(pid));
+  if (!new_map->BuildFrom(content, static_cast<UnwindStackMap*>(map.get()))) {
+    return nullptr;
+  }
+  shared.content = std::move(content);
+  shared.map = new_map;
+  if (pid == getpid()) {
+    local_map = new_map;
+  }
+  return new_map;
+}
@@ -20,8 +20,10 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <atomic>
 #include <memory>
 #include <mutex>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -45,6 +47,10 @@ class UnwindStackMap : public BacktraceMap {
 
   bool Build() override;
 
+  // Builds the maps from content, the maps file of the process, sharing the
+  // elf objects of the maps that are unchanged since previous, if not null.
+  bool BuildFrom(const std::string& content, UnwindStackMap* previous);
+
   void FillIn(uint64_t addr, backtrace_map_t* map) override;
 
   virtual std::string GetFunctionName(uint64_t pc, uint64_t* offset) override;
@@ -62,9 +68,16 @@ class UnwindStackMap : public BacktraceMap {
 
   void SetArch(unwindstack::ArchEnum arch) { arch_ = arch; }
 
+  // A map may be shared by backtraces running on different threads, see
+  // CreateShared(), and iterating fills in the load bias.
+  void LockIterator() override { iterator_lock_.lock(); }
+  void UnlockIterator() override { iterator_lock_.unlock(); }
+
  protected:
   uint64_t GetLoadBias(size_t index) override;
 
+  bool ParseMaps();
+
   std::unique_ptr<unwindstack::Maps> stack_maps_;
   std::shared_ptr<unwindstack::Memory> process_memory_;
   std::unique_ptr<unwindstack::JitDebug> jit_debug_;
@@ -72,7 +85,9 @@ class UnwindStackMap : public BacktraceMap {
   std::unique_ptr<unwindstack::DexFiles> dex_files_;
 #endif
 
-  unwindstack::ArchEnum arch_ = unwindstack::ARCH_UNKNOWN;
+  std::atomic<unwindstack::ArchEnum> arch_{unwindstack::ARCH_UNKNOWN};
+  // Recursive since FillIn() takes it, and may be called while iterating.
+  std::recursive_mutex iterator_lock_;
 };
 
 #endif  // _LIBBACKTRACE_UNWINDSTACK_MAP_H
@@ -163,4 +163,12 @@ static void BM_create_backtrace(benchmark::State& state) {
 }
 BENCHMARK(BM_create_backtrace);
 
+static void BM_unwind_frame_pointers(benchmark::State& state) {
+  uint64_t pcs[64];
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(Backtrace::UnwindFramePointers(pcs, 64));
+  }
+}
+BENCHMARK(BM_unwind_frame_pointers);
+
 BENCHMARK_MAIN();
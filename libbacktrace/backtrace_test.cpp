@@ -22,6 +22,7 @@
 #include <inttypes.h>
 #include <malloc.h>
 #include <pthread.h>
+#include <setjmp.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -799,6 +800,56 @@ TEST_F(BacktraceTest, simultaneous_maps) {
   delete map3;
 }
 
+TEST_F(BacktraceTest, shared_map_snapshot) {
+  std::shared_ptr<BacktraceMap> map1(BacktraceMap::CreateShared(getpid()));
+  ASSERT_TRUE(map1 != nullptr);
+  std::shared_ptr<BacktraceMap> map2(BacktraceMap::CreateShared(getpid()));
+  ASSERT_EQ(map1, map2);
+
+  std::unique_ptr<Backtrace> back(Backtrace::Create(getpid(), BACKTRACE_CURRENT_THREAD));
+  ASSERT_TRUE(back != nullptr);
+  ASSERT_EQ(map1.get(), back->GetMap());
+  EXPECT_TRUE(back->Unwind(0));
+  VERIFY_NO_ERROR(back->GetError().error_code);
+
+  // A new map means a new snapshot, the old one stays as it was.
+  void* addr = mmap(nullptr, 3 * getpagesize(), PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  ASSERT_NE(MAP_FAILED, addr);
+  std::shared_ptr<BacktraceMap> map3(BacktraceMap::CreateShared(getpid()));
+  ASSERT_TRUE(map3 != nullptr);
+  ASSERT_NE(map1, map3);
+
+  backtrace_map_t map;
+  map3->FillIn(reinterpret_cast<uint64_t>(addr), &map);
+  ASSERT_TRUE(BacktraceMap::IsValid(map));
+  ASSERT_LE(map.start, reinterpret_cast<uint64_t>(addr));
+  ASSERT_GE(map.end, reinterpret_cast<uint64_t>(addr) + 3 * getpagesize());
+  backtrace_map_t old_map;
+  map1->FillIn(reinterpret_cast<uint64_t>(addr), &old_map);
+  ASSERT_FALSE(BacktraceMap::IsValid(old_map) && old_map.start == map.start &&
+               old_map.end == map.end);
+  munmap(addr, 3 * getpagesize());
+}
+
+TEST_F(BacktraceTest, fillin_matches_iteration) {
+  std::unique_ptr<BacktraceMap> back_map(BacktraceMap::Create(getpid()));
+  ASSERT_TRUE(back_map != nullptr);
+
+  ScopedBacktraceMapIteratorLock lock(back_map.get());
+  uint64_t last_end = 0;
+  for (const backtrace_map_t* entry : *back_map) {
+    ASSERT_LE(last_end, entry->start);
+    last_end = entry->end;
+    for (uint64_t addr : {entry->start, entry->end - 1}) {
+      backtrace_map_t map;
+      back_map->FillIn(addr, &map);
+      ASSERT_EQ(entry->start, map.start) << std::hex << addr;
+      ASSERT_EQ(entry->end, map.end) << std::hex << addr;
+      ASSERT_EQ(entry->name, map.name) << std::hex << addr;
+    }
+  }
+}
+
 TEST_F(BacktraceTest, fillin_erases) {
   BacktraceMap* back_map = BacktraceMap::Create(getpid());
 
@@ -1837,6 +1888,92 @@ TEST_F(BacktraceTest, unwind_frame_skip_numbering) {
   TestFrameSkipNumbering(Backtrace::Create, BacktraceMap::Create);
 }
 
+static std::string FunctionName(Backtrace* backtrace, uint64_t pc) {
+  uint64_t offset;
+  // The pcs are return addresses, so look up the call instead.
+  return backtrace->GetFunctionName(pc - 1, &offset);
+}
+
+static size_t __attribute__((noinline))
+FramePointerLevel3(uint64_t* pcs, size_t max_frames, size_t num_ignore_frames) {
+  return Backtrace::UnwindFramePointers(pcs, max_frames, num_ignore_frames);
+}
+
+static size_t __attribute__((noinline))
+FramePointerLevel2(uint64_t* pcs, size_t max_frames, size_t num_ignore_frames) {
+  return FramePointerLevel3(pcs, max_frames, num_ignore_frames);
+}
+
+static size_t __attribute__((noinline))
+FramePointerLevel1(uint64_t* pcs, size_t max_frames, size_t num_ignore_frames) {
+  return FramePointerLevel2(pcs, max_frames, num_ignore_frames);
+}
+
+TEST_F(BacktraceTest, unwind_frame_pointers) {
+  uint64_t pcs[64];
+  size_t num_frames = FramePointerLevel1(pcs, 64, 0);
+  ASSERT_LE(4U, num_frames);
+
+  std::unique_ptr<Backtrace> backtrace(
+      Backtrace::Create(BACKTRACE_CURRENT_PROCESS, BACKTRACE_CURRENT_THREAD));
+  ASSERT_TRUE(backtrace.get() != nullptr);
+  ASSERT_NE(std::string::npos, FunctionName(backtrace.get(), pcs[0]).find("FramePointerLevel3"));
+  ASSERT_NE(std::string::npos, FunctionName(backtrace.get(), pcs[1]).find("FramePointerLevel2"));
+  ASSERT_NE(std::string::npos, FunctionName(backtrace.get(), pcs[2]).find("FramePointerLevel1"));
+
+  uint64_t ignored_pcs[64];
+  ASSERT_EQ(num_frames - 2, FramePointerLevel1(ignored_pcs, 64, 2));
+  ASSERT_NE(std::string::npos,
+            FunctionName(backtrace.get(), ignored_pcs[0]).find("FramePointerLevel1"));
+
+  uint64_t max_pcs[2];
+  ASSERT_EQ(2U, FramePointerLevel1(max_pcs, 2, 0));
+  ASSERT_EQ(pcs[1], max_pcs[1]);
+
+  ASSERT_EQ(0U, FramePointerLevel1(pcs, 0, 0));
+}
+
+static volatile int* g_null_ptr = nullptr;
+static sigjmp_buf g_frame_pointer_jmp_buf;
+static uint64_t g_frame_pointer_pcs[64];
+static size_t g_frame_pointer_num_frames;
+
+static void FramePointerSignalAction(int, siginfo_t*, void* ucontext) {
+  g_frame_pointer_num_frames =
+      Backtrace::UnwindFramePointers(g_frame_pointer_pcs, 64, 0, ucontext);
+  siglongjmp(g_frame_pointer_jmp_buf, 1);
+}
+
+static int __attribute__((noinline)) FramePointerSignalLevel2() {
+  return *g_null_ptr;
+}
+
+static int __attribute__((noinline)) FramePointerSignalLevel1() {
+  return FramePointerSignalLevel2();
+}
+
+TEST_F(BacktraceTest, unwind_frame_pointers_from_signal) {
+  {
+    ScopedSignalHandler handler(SIGSEGV, FramePointerSignalAction);
+    g_frame_pointer_num_frames = 0;
+    if (sigsetjmp(g_frame_pointer_jmp_buf, 1) == 0) {
+      FramePointerSignalLevel1();
+      FAIL() << "Reading a null pointer did not crash.";
+    }
+  }
+  ASSERT_LE(3U, g_frame_pointer_num_frames);
+
+  std::unique_ptr<Backtrace> backtrace(
+      Backtrace::Create(BACKTRACE_CURRENT_PROCESS, BACKTRACE_CURRENT_THREAD));
+  ASSERT_TRUE(backtrace.get() != nullptr);
+  // The first pc is the faulting instruction rather than a return address.
+  uint64_t offset;
+  ASSERT_NE(std::string::npos, backtrace->GetFunctionName(g_frame_pointer_pcs[0], &offset)
+                                   .find("FramePointerSignalLevel2"));
+  ASSERT_NE(std::string::npos,
+            FunctionName(backtrace.get(), g_frame_pointer_pcs[1]).find("FramePointerSignalLevel1"));
+}
+
 #define MAX_LEAK_BYTES (32*1024UL)
 
 static void CheckForLeak(pid_t pid, pid_t tid) {
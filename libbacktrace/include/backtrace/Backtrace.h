@@ -20,6 +20,7 @@
 #include <inttypes.h>
 #include <stdint.h>
 
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -122,7 +123,8 @@ class Backtrace {
   // If pid >= 0 and tid < 0, then the Backtrace object corresponds to a
   // different process.
   // Tracing a thread in a different process is not supported.
-  // If map is NULL, then create the map and manage it internally.
+  // If map is NULL, then use the map of the process shared by all
+  // backtraces, see BacktraceMap::CreateShared().
   // If map is not NULL, the map is still owned by the caller.
   static Backtrace* Create(pid_t pid, pid_t tid, BacktraceMap* map = nullptr);
 
@@ -135,6 +137,16 @@ class Backtrace {
                      std::vector<backtrace_frame_data_t>* frames, size_t num_ignore_frames,
                      std::vector<std::string>* skip_names, BacktraceUnwindError* error = nullptr);
 
+  // Walk the frame pointers of the current thread, storing up to max_frames
+  // pcs in the caller's array, and return how many were stored. If context
+  // is not NULL, the unwind starts from the pc and frame pointer in it.
+  // Only code built with frame pointers can be unwound this way, and the
+  // unwind stops at the first frame without a valid one.
+  // Nothing is allocated and no locks are taken, so this is async signal
+  // safe. Symbolizing the pcs is left to GetFunctionName and FillInMap.
+  static size_t UnwindFramePointers(uint64_t* pcs, size_t max_frames, size_t num_ignore_frames = 0,
+                                    void* context = nullptr);
+
   // Get the function name and offset into the function given the pc.
   // If the string is empty, then no valid function name was found,
   // or the pc is not in any valid map.
@@ -201,7 +213,8 @@ class Backtrace {
   pid_t tid_;
 
   BacktraceMap* map_;
-  bool map_shared_;
+  // Keeps the shared map alive when no map was given.
+  std::shared_ptr<BacktraceMap> shared_map_;
 
   std::vector<backtrace_frame_data_t> frames_;
 
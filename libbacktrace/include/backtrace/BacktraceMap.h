@@ -29,7 +29,6 @@
 #include <sys/mman.h>
 #endif
 
-#include <deque>
 #include <iterator>
 #include <memory>
 #include <string>
@@ -69,6 +68,14 @@ public:
   // is unsupported.
   static BacktraceMap* Create(pid_t pid, bool uncached = false);
 
+  // Returns a snapshot of the maps of pid that is shared with every other
+  // caller, and every Backtrace created without a map, for as long as the
+  // maps of the process are unchanged. If they have changed, a new snapshot
+  // is created, which keeps the elf data of the maps that are still the same.
+  // The snapshot must not be modified, so do not call SetSuffixesToIgnore()
+  // or SetResolveNames() on it.
+  static std::shared_ptr<BacktraceMap> CreateShared(pid_t pid);
+
   virtual ~BacktraceMap();
 
   class iterator : public std::iterator<std::bidirectional_iterator_tag, backtrace_map_t*> {
@@ -169,7 +176,8 @@ public:
   virtual uint64_t GetLoadBias(size_t /* index */) { return 0; }
 
   pid_t pid_;
-  std::deque<backtrace_map_t> maps_;
+  // Sorted by start address, so that FillIn() can binary search it.
+  std::vector<backtrace_map_t> maps_;
   std::vector<std::string> suffixes_to_ignore_;
   bool resolve_names_ = true;
 };
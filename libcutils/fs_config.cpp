@@ -32,7 +32,13 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
 #include <string>
+#include <vector>
 
 #include <android-base/strings.h>
 #include <log/log.h>
@@ -306,68 +312,176 @@ static bool fs_config_cmp(bool dir, const char* prefix, size_t len, const char*
 auto __for_testing_only__fs_config_cmp = fs_config_cmp;
 #endif
 
-void fs_config(const char* path, int dir, const char* target_out_path, unsigned* uid, unsigned* gid,
-               unsigned* mode, uint64_t* capabilities) {
-    const struct fs_path_config* pc;
-    size_t which, plen;
+// The rules of the config files and of the tables above, in the order they are tried.  To
+// avoid trying them all for every path, each rule is filed in a trie under the part of its
+// pattern that comes before any wildcard, so only the rules found along the path (or along its
+// alias without a leading "system/" or "vendor/") need to be matched.
+struct fs_config_rules {
+    struct rule {
+        std::string prefix;
+        unsigned mode;
+        unsigned uid;
+        unsigned gid;
+        uint64_t capabilities;
+    };
+    struct node {
+        std::map<char, uint32_t> children;
+        std::vector<uint32_t> rules;
+    };
+
+    bool dir;
+    std::vector<rule> rules;
+    std::vector<node> nodes;
+    const struct fs_path_config* fallback;
+};
 
-    if (path[0] == '/') {
-        path++;
+static void fs_config_add_rule(fs_config_rules* rules, const char* prefix, size_t len,
+                               unsigned mode, unsigned uid, unsigned gid, uint64_t capabilities) {
+    // Find the literal part of the pattern the way fs_config_cmp() will see it.
+    std::string pattern(prefix, len);
+    if (rules->dir && !EndsWith(pattern, "/*")) {
+        pattern.append(EndsWith(pattern, "/") ? "*" : "/*");
     }
+    size_t literal = pattern.find_first_of("*?[");
+    if (literal == std::string::npos) literal = pattern.size();
+
+    uint32_t n = 0;
+    for (size_t i = 0; i < literal; i++) {
+        auto it = rules->nodes[n].children.find(pattern[i]);
+        if (it != rules->nodes[n].children.end()) {
+            n = it->second;
+        } else {
+            uint32_t child = rules->nodes.size();
+            rules->nodes[n].children.emplace(pattern[i], child);
+            rules->nodes.emplace_back();
+            n = child;
+        }
+    }
+    rules->nodes[n].rules.push_back(rules->rules.size());
+    rules->rules.push_back({std::string(prefix, len), mode, uid, gid, capabilities});
+}
 
-    plen = strlen(path);
-
-    for (which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
-        struct fs_path_config_from_file header;
+static void fs_config_load_file(fs_config_rules* rules, int dir, size_t which,
+                                const char* target_out_path) {
+    struct fs_path_config_from_file header;
 
-        int fd = fs_config_open(dir, which, target_out_path);
-        if (fd < 0) continue;
+    int fd = fs_config_open(dir, which, target_out_path);
+    if (fd < 0) return;
 
-        while (TEMP_FAILURE_RETRY(read(fd, &header, sizeof(header))) == sizeof(header)) {
-            char* prefix;
-            uint16_t host_len = header.len;
-            ssize_t len, remainder = host_len - sizeof(header);
-            if (remainder <= 0) {
-                ALOGE("%s len is corrupted", conf[which][dir]);
-                break;
-            }
-            prefix = static_cast<char*>(calloc(1, remainder));
-            if (!prefix) {
-                ALOGE("%s out of memory", conf[which][dir]);
-                break;
-            }
-            if (TEMP_FAILURE_RETRY(read(fd, prefix, remainder)) != remainder) {
-                free(prefix);
-                ALOGE("%s prefix is truncated", conf[which][dir]);
-                break;
-            }
-            len = strnlen(prefix, remainder);
-            if (len >= remainder) {  // missing a terminating null
-                free(prefix);
-                ALOGE("%s is corrupted", conf[which][dir]);
-                break;
-            }
-            if (fs_config_cmp(dir, prefix, len, path, plen)) {
-                free(prefix);
-                close(fd);
-                *uid = header.uid;
-                *gid = header.gid;
-                *mode = (*mode & (~07777)) | header.mode;
-                *capabilities = header.capabilities;
-                return;
-            }
-            free(prefix);
+    while (TEMP_FAILURE_RETRY(read(fd, &header, sizeof(header))) == sizeof(header)) {
+        uint16_t host_len = header.len;
+        ssize_t len, remainder = host_len - sizeof(header);
+        if (remainder <= 0) {
+            ALOGE("%s len is corrupted", conf[which][dir]);
+            break;
+        }
+        std::unique_ptr<char[]> prefix(new (std::nothrow) char[remainder]);
+        if (!prefix) {
+            ALOGE("%s out of memory", conf[which][dir]);
+            break;
+        }
+        if (TEMP_FAILURE_RETRY(read(fd, prefix.get(), remainder)) != remainder) {
+            ALOGE("%s prefix is truncated", conf[which][dir]);
+            break;
         }
-        close(fd);
+        len = strnlen(prefix.get(), remainder);
+        if (len >= remainder) {  // missing a terminating null
+            ALOGE("%s is corrupted", conf[which][dir]);
+            break;
+        }
+        fs_config_add_rule(rules, prefix.get(), len, header.mode, header.uid, header.gid,
+                           header.capabilities);
     }
+    close(fd);
+}
 
+// The config files are read once per target_out_path and kind of entry.
+static const fs_config_rules* fs_config_get_rules(int dir, const char* target_out_path) {
+    static std::mutex lock;
+    static std::map<std::string, std::unique_ptr<fs_config_rules>> cache[2];
+
+    dir = dir ? 1 : 0;
+    std::lock_guard<std::mutex> guard(lock);
+    std::unique_ptr<fs_config_rules>& rules = cache[dir][target_out_path ? target_out_path : ""];
+    if (rules) return rules.get();
+
+    rules.reset(new fs_config_rules);
+    rules->dir = dir;
+    rules->nodes.emplace_back();
+    for (size_t which = 0; which < (sizeof(conf) / sizeof(conf[0])); ++which) {
+        fs_config_load_file(rules.get(), dir, which, target_out_path);
+    }
+    const struct fs_path_config* pc;
     for (pc = dir ? android_dirs : android_files; pc->prefix; pc++) {
-        if (fs_config_cmp(dir, pc->prefix, strlen(pc->prefix), path, plen)) {
-            break;
+        fs_config_add_rule(rules.get(), pc->prefix, strlen(pc->prefix), pc->mode, pc->uid,
+                           pc->gid, pc->capabilities);
+    }
+    rules->fallback = pc;
+    return rules.get();
+}
+
+// Collects the rules filed along input.
+static void fs_config_candidates(const fs_config_rules* rules, const std::string& input,
+                                 std::vector<uint32_t>* candidates) {
+    uint32_t n = 0;
+    for (size_t i = 0;; i++) {
+        const fs_config_rules::node& node = rules->nodes[n];
+        candidates->insert(candidates->end(), node.rules.begin(), node.rules.end());
+        if (i == input.size()) break;
+        auto it = node.children.find(input[i]);
+        if (it == node.children.end()) break;
+        n = it->second;
+    }
+}
+
+static void fs_config_lookup(const fs_config_rules* rules, const char* path, unsigned* uid,
+                             unsigned* gid, unsigned* mode, uint64_t* capabilities) {
+    if (path[0] == '/') {
+        path++;
+    }
+    size_t plen = strlen(path);
+
+    std::string input(path, plen);
+    if (rules->dir && !EndsWith(input, "/")) {
+        input.append("/");
+    }
+    std::vector<uint32_t> candidates;
+    fs_config_candidates(rules, input, &candidates);
+    // fs_config_cmp() also tries "system/vendor/<stuff>" as "vendor/<stuff>" and so on.
+    if (StartsWith(input, "system/") || StartsWith(input, "vendor/")) {
+        fs_config_candidates(rules, input.substr(input.find('/') + 1), &candidates);
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    for (uint32_t candidate : candidates) {
+        const fs_config_rules::rule& rule = rules->rules[candidate];
+        if (fs_config_cmp(rules->dir, rule.prefix.c_str(), rule.prefix.size(), path, plen)) {
+            *uid = rule.uid;
+            *gid = rule.gid;
+            *mode = (*mode & (~07777)) | rule.mode;
+            *capabilities = rule.capabilities;
+            return;
         }
     }
+    const struct fs_path_config* pc = rules->fallback;
     *uid = pc->uid;
     *gid = pc->gid;
     *mode = (*mode & (~07777)) | pc->mode;
     *capabilities = pc->capabilities;
 }
+
+void fs_config(const char* path, int dir, const char* target_out_path, unsigned* uid, unsigned* gid,
+               unsigned* mode, uint64_t* capabilities) {
+    fs_config_lookup(fs_config_get_rules(dir, target_out_path), path, uid, gid, mode,
+                     capabilities);
+}
+
+void fs_config_batch(struct fs_config_entry* entries, size_t count, const char* target_out_path) {
+    const fs_config_rules* rules[2] = {fs_config_get_rules(0, target_out_path),
+                                       fs_config_get_rules(1, target_out_path)};
+    for (size_t i = 0; i < count; i++) {
+        struct fs_config_entry* entry = &entries[i];
+        fs_config_lookup(rules[entry->dir ? 1 : 0], entry->path, &entry->uid, &entry->gid,
+                         &entry->mode, &entry->capabilities);
+    }
+}
@@ -15,8 +15,10 @@
  */
 
 #include <inttypes.h>
+#include <sys/stat.h>
 
 #include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -25,6 +27,7 @@
 #include <android-base/strings.h>
 
 #include <private/android_filesystem_config.h>
+#include <private/fs_config.h>
 
 #include "fs_config.h"
 
@@ -258,3 +261,52 @@ TEST(fs_config, odm_files_alias) {
 TEST(fs_config, system_alias) {
     EXPECT_FALSE(check_fs_config_cmp(fs_config_cmp_tests));
 }
+
+static void expect_fs_config(const char* path, int dir, unsigned mode, unsigned uid,
+                             unsigned gid) {
+    unsigned actual_uid, actual_gid, actual_mode = S_IFREG | 0777;
+    uint64_t capabilities;
+    fs_config(path, dir, nullptr, &actual_uid, &actual_gid, &actual_mode, &capabilities);
+    EXPECT_EQ(S_IFREG | mode, actual_mode) << path;
+    EXPECT_EQ(uid, actual_uid) << path;
+    EXPECT_EQ(gid, actual_gid) << path;
+}
+
+TEST(fs_config, first_match) {
+    expect_fs_config("data/nativetest/tests.txt", 0, 00640, AID_ROOT, AID_SHELL);
+    expect_fs_config("/data/nativetest/foo", 0, 00750, AID_ROOT, AID_SHELL);
+    expect_fs_config("data/local/tmp", 1, 00771, AID_SHELL, AID_SHELL);
+    expect_fs_config("data/local/tmp/foo/", 1, 00771, AID_SHELL, AID_SHELL);
+    expect_fs_config("data/local", 1, 00771, AID_SHELL, AID_SHELL);
+    expect_fs_config("data/localfoo", 1, 00771, AID_SYSTEM, AID_SYSTEM);
+    expect_fs_config("system/apex/com.android.foo/bin", 1, 00751, AID_ROOT, AID_SHELL);
+    // Matched as "vendor/bin/*".
+    expect_fs_config("system/vendor/bin/foo", 0, 00755, AID_ROOT, AID_SHELL);
+    expect_fs_config("no/rule/for/this", 0, 00644, AID_ROOT, AID_ROOT);
+    expect_fs_config("no/rule/for/this", 1, 00755, AID_ROOT, AID_ROOT);
+}
+
+TEST(fs_config, batch) {
+    static const char* paths[] = {
+            "system/bin/sh", "system/bin", "/system/xbin/su", "vendor", "vendor/bin/foo",
+            "system/vendor/bin/foo", "data/app/foo.apk", "data/local/tmp", "init.rc",
+            "fstab.device", "system/apex/com.android.foo/bin/bar", "no/rule/for/this",
+    };
+    std::vector<fs_config_entry> entries;
+    for (const char* path : paths) {
+        for (int dir = 0; dir < 2; dir++) {
+            entries.push_back({path, dir, 0, 0, S_IFREG | 0777, 0});
+        }
+    }
+    fs_config_batch(entries.data(), entries.size(), nullptr);
+
+    for (const fs_config_entry& entry : entries) {
+        unsigned uid, gid, mode = S_IFREG | 0777;
+        uint64_t capabilities;
+        fs_config(entry.path, entry.dir, nullptr, &uid, &gid, &mode, &capabilities);
+        EXPECT_EQ(mode, entry.mode) << entry.path;
+        EXPECT_EQ(uid, entry.uid) << entry.path;
+        EXPECT_EQ(gid, entry.gid) << entry.path;
+        EXPECT_EQ(capabilities, entry.capabilities) << entry.path;
+    }
+}
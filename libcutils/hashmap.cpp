@@ -19,27 +19,56 @@
 #include <assert.h>
 #include <errno.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 
-typedef struct Entry Entry;
-struct Entry {
+#include <atomic>
+#include <new>
+
+/*
+ * The entries live in a single array and are found by linear probing, with Robin Hood
+ * displacement: along a probe run, entries are kept sorted by their home slot, and a lookup
+ * gives up as soon as it meets an entry that is closer to its own home than the key would be
+ * to its home.  Entries with the same home are kept in the order they were put, except that
+ * an expansion reverses them.  That is what the chained buckets this replaced did, so
+ * together with the same growth policy, hashmapForEach() visits entries in the very same
+ * order, which some callers (like str_parms_to_str()) expose.
+ */
+
+enum SlotState : uint8_t {
+    EMPTY,
+    FULL,
+    // Removed while hashmapForEach() was running, so that no other entry had to move; the
+    // slot is freed for real once the iteration ends.
+    REMOVED,
+};
+
+struct Slot {
     void* key;
-    int hash;
     void* value;
-    Entry* next;
+    int hash;
+    SlotState state;
 };
 
 struct Hashmap {
-    Entry** buckets;
-    size_t bucketCount;
+    Slot* slots;
+    size_t slotCount;
     int (*hash)(void* key);
     bool (*equals)(void* keyA, void* keyB);
-    pthread_mutex_t lock;
+    pthread_rwlock_t lock;
     size_t size;
+    // Number of REMOVED slots.
+    size_t removed;
+    // Number of hashmapForEach() calls in progress, which may come from several readers.
+    std::atomic<int> iterating;
 };
 
+static Slot* allocateSlots(size_t slotCount) {
+    return static_cast<Slot*>(calloc(slotCount, sizeof(Slot)));
+}
+
 Hashmap* hashmapCreate(size_t initialCapacity,
         int (*hash)(void* key), bool (*equals)(void* keyA, void* keyB)) {
     assert(hash != NULL);
@@ -51,25 +80,27 @@ Hashmap* hashmapCreate(size_t initialCapacity,
     }
 
     // 0.75 load factor.
-    size_t minimumBucketCount = initialCapacity * 4 / 3;
-    map->bucketCount = 1;
-    while (map->bucketCount <= minimumBucketCount) {
-        // Bucket count must be power of 2.
-        map->bucketCount <<= 1;
+    size_t minimumSlotCount = initialCapacity * 4 / 3;
+    map->slotCount = 1;
+    while (map->slotCount <= minimumSlotCount) {
+        // Slot count must be power of 2.
+        map->slotCount <<= 1;
     }
 
-    map->buckets = static_cast<Entry**>(calloc(map->bucketCount, sizeof(Entry*)));
-    if (map->buckets == NULL) {
+    map->slots = allocateSlots(map->slotCount);
+    if (map->slots == NULL) {
         free(map);
         return NULL;
     }
 
     map->size = 0;
+    map->removed = 0;
+    new (&map->iterating) std::atomic<int>(0);
 
     map->hash = hash;
     map->equals = equals;
 
-    pthread_mutex_init(&map->lock, nullptr);
+    pthread_rwlock_init(&map->lock, nullptr);
 
     return map;
 }
@@ -93,61 +124,121 @@ static inline int hashKey(Hashmap* map, void* key) {
     return h;
 }
 
-static inline size_t calculateIndex(size_t bucketCount, int hash) {
-    return ((size_t) hash) & (bucketCount - 1);
+static inline size_t calculateIndex(size_t slotCount, int hash) {
+    return ((size_t) hash) & (slotCount - 1);
 }
 
-static void expandIfNecessary(Hashmap* map) {
-    // If the load factor exceeds 0.75...
-    if (map->size > (map->bucketCount * 3 / 4)) {
-        // Start off with a 0.33 load factor.
-        size_t newBucketCount = map->bucketCount << 1;
-        Entry** newBuckets = static_cast<Entry**>(calloc(newBucketCount, sizeof(Entry*)));
-        if (newBuckets == NULL) {
-            // Abort expansion.
-            return;
+/**
+ * How far the entry in the given slot is from its home slot.
+ */
+static inline size_t distance(const Hashmap* map, size_t index) {
+    return (index - calculateIndex(map->slotCount, map->slots[index].hash)) & (map->slotCount - 1);
+}
+
+/**
+ * Puts an entry known not to be in the map yet, after the entries with the same home slot, or
+ * ahead of them.  There must be an empty slot.
+ */
+static void insertEntry(Hashmap* map, Slot entry, bool ahead) {
+    const size_t mask = map->slotCount - 1;
+    size_t index = calculateIndex(map->slotCount, entry.hash);
+    size_t entryDistance = 0;
+    while (map->slots[index].state != EMPTY) {
+        size_t slotDistance = distance(map, index);
+        if (slotDistance < entryDistance || (ahead && slotDistance == entryDistance)) {
+            // A displaced entry stays ahead of those with the same home, so they all shift
+            // down by one, in order.
+            Slot displaced = map->slots[index];
+            map->slots[index] = entry;
+            entry = displaced;
+            entryDistance = slotDistance;
+            ahead = true;
         }
+        index = (index + 1) & mask;
+        entryDistance++;
+    }
+    map->slots[index] = entry;
+}
+
+/**
+ * Iterates in the order of the home slots: a probe run that wraps around past the end of the
+ * array is visited from its start, at the end.
+ */
+static size_t firstIndex(const Hashmap* map) {
+    size_t index = 0;
+    while (index < map->slotCount && map->slots[index].state != EMPTY &&
+            distance(map, index) > index) {
+        index++;
+    }
+    return index;
+}
+
+/**
+ * Doubles the number of slots.  If pending isn't NULL, it is a new entry that did not fit,
+ * and gets added as if it had been put before the expansion.
+ */
+static bool expand(Hashmap* map, const Slot* pending) {
+    size_t newSlotCount = map->slotCount << 1;
+    Slot* newSlots = allocateSlots(newSlotCount);
+    if (newSlots == NULL) {
+        return false;
+    }
 
-        // Move over existing entries.
-        size_t i;
-        for (i = 0; i < map->bucketCount; i++) {
-            Entry* entry = map->buckets[i];
-            while (entry != NULL) {
-                Entry* next = entry->next;
-                size_t index = calculateIndex(newBucketCount, entry->hash);
-                entry->next = newBuckets[index];
-                newBuckets[index] = entry;
-                entry = next;
-            }
+    // Move over existing entries in iteration order, each ahead of those with the same new
+    // home slot, like the chained buckets used to.  The pending entry comes after those that
+    // had the same home slot, as it would have been put last.
+    Slot* oldSlots = map->slots;
+    size_t oldSlotCount = map->slotCount;
+    size_t first = firstIndex(map);
+    size_t pendingHome = pending != NULL ? calculateIndex(oldSlotCount, pending->hash) : 0;
+    map->slots = newSlots;
+    map->slotCount = newSlotCount;
+    map->removed = 0;
+    for (size_t i = 0; i < oldSlotCount; i++) {
+        const Slot& slot = oldSlots[(first + i) & (oldSlotCount - 1)];
+        if (slot.state == EMPTY) {
+            continue;
+        }
+        if (pending != NULL && calculateIndex(oldSlotCount, slot.hash) > pendingHome) {
+            insertEntry(map, *pending, true);
+            pending = NULL;
         }
+        if (slot.state == FULL) {
+            insertEntry(map, slot, true);
+        }
+    }
+    if (pending != NULL) {
+        insertEntry(map, *pending, true);
+    }
+    free(oldSlots);
+    return true;
+}
 
-        // Copy over internals.
-        free(map->buckets);
-        map->buckets = newBuckets;
-        map->bucketCount = newBucketCount;
+static void expandIfNecessary(Hashmap* map) {
+    // If the load factor exceeds 0.75...
+    if (map->size + map->removed > (map->slotCount * 3 / 4)) {
+        // Start off with a 0.375 load factor.  Expansion is simply retried on the next put if
+        // it fails here.
+        expand(map, NULL);
     }
 }
 
 void hashmapLock(Hashmap* map) {
-    pthread_mutex_lock(&map->lock);
+    pthread_rwlock_wrlock(&map->lock);
+}
+
+void hashmapReadLock(Hashmap* map) {
+    pthread_rwlock_rdlock(&map->lock);
 }
 
 void hashmapUnlock(Hashmap* map) {
-    pthread_mutex_unlock(&map->lock);
+    pthread_rwlock_unlock(&map->lock);
 }
 
 void hashmapFree(Hashmap* map) {
-    size_t i;
-    for (i = 0; i < map->bucketCount; i++) {
-        Entry* entry = map->buckets[i];
-        while (entry != NULL) {
-            Entry* next = entry->next;
-            free(entry);
-            entry = next;
-        }
-    }
-    free(map->buckets);
-    pthread_mutex_destroy(&map->lock);
+    free(map->slots);
+    pthread_rwlock_destroy(&map->lock);
+    map->iterating.~atomic();
     free(map);
 }
 
@@ -166,18 +257,6 @@ int hashmapHash(void* key, size_t keySize) {
     return h;
 }
 
-static Entry* createEntry(void* key, int hash, void* value) {
-    Entry* entry = static_cast<Entry*>(malloc(sizeof(Entry)));
-    if (entry == NULL) {
-        return NULL;
-    }
-    entry->key = key;
-    entry->hash = hash;
-    entry->value = value;
-    entry->next = NULL;
-    return entry;
-}
-
 static inline bool equalKeys(void* keyA, int hashA, void* keyB, int hashB,
         bool (*equals)(void*, void*)) {
     if (keyA == keyB) {
@@ -189,86 +268,113 @@ static inline bool equalKeys(void* keyA, int hashA, void* keyB, int hashB,
     return equals(keyA, keyB);
 }
 
-void* hashmapPut(Hashmap* map, void* key, void* value) {
-    int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    Entry** p = &(map->buckets[index]);
-    while (true) {
-        Entry* current = *p;
-
-        // Add a new entry.
-        if (current == NULL) {
-            *p = createEntry(key, hash, value);
-            if (*p == NULL) {
-                errno = ENOMEM;
-                return NULL;
-            }
-            map->size++;
-            expandIfNecessary(map);
-            return NULL;
+/**
+ * Returns the index of the entry for the given key, or -1.
+ */
+static inline ssize_t findIndex(Hashmap* map, void* key, int hash) {
+    const size_t mask = map->slotCount - 1;
+    size_t index = calculateIndex(map->slotCount, hash);
+    for (size_t keyDistance = 0; map->slots[index].state != EMPTY; keyDistance++) {
+        const Slot& slot = map->slots[index];
+        if (slot.hash == hash && slot.state == FULL &&
+                equalKeys(slot.key, slot.hash, key, hash, map->equals)) {
+            return index;
         }
-
-        // Replace existing entry.
-        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
-            void* oldValue = current->value;
-            current->value = value;
-            return oldValue;
+        if (distance(map, index) < keyDistance) {
+            // The key would have displaced this entry.
+            break;
         }
-
-        // Move to next entry.
-        p = &current->next;
+        index = (index + 1) & mask;
     }
+    return -1;
 }
 
-void* hashmapGet(Hashmap* map, void* key) {
+void* hashmapPut(Hashmap* map, void* key, void* value) {
     int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
+    ssize_t index = findIndex(map, key, hash);
 
-    Entry* entry = map->buckets[index];
-    while (entry != NULL) {
-        if (equalKeys(entry->key, entry->hash, key, hash, map->equals)) {
-            return entry->value;
-        }
-        entry = entry->next;
+    // Replace existing entry.
+    if (index >= 0) {
+        void* oldValue = map->slots[index].value;
+        map->slots[index].value = value;
+        return oldValue;
     }
 
+    // Add a new entry.  At least one slot must stay empty so that probes end, which the
+    // expansion after the put normally guarantees, but not in the smallest maps.
+    Slot entry = {key, value, hash, FULL};
+    if (map->size + map->removed + 1 < map->slotCount) {
+        insertEntry(map, entry, false);
+        map->size++;
+        expandIfNecessary(map);
+    } else if (expand(map, &entry)) {
+        map->size++;
+    } else {
+        errno = ENOMEM;
+    }
     return NULL;
 }
 
+void* hashmapGet(Hashmap* map, void* key) {
+    ssize_t index = findIndex(map, key, hashKey(map, key));
+    return index >= 0 ? map->slots[index].value : NULL;
+}
+
+/**
+ * Empties the given slot, moving the rest of its probe run back by one.
+ */
+static void eraseSlot(Hashmap* map, size_t index) {
+    const size_t mask = map->slotCount - 1;
+    size_t next = (index + 1) & mask;
+    while (map->slots[next].state != EMPTY && distance(map, next) != 0) {
+        map->slots[index] = map->slots[next];
+        index = next;
+        next = (next + 1) & mask;
+    }
+    map->slots[index].state = EMPTY;
+}
+
 void* hashmapRemove(Hashmap* map, void* key) {
-    int hash = hashKey(map, key);
-    size_t index = calculateIndex(map->bucketCount, hash);
-
-    // Pointer to the current entry.
-    Entry** p = &(map->buckets[index]);
-    Entry* current;
-    while ((current = *p) != NULL) {
-        if (equalKeys(current->key, current->hash, key, hash, map->equals)) {
-            void* value = current->value;
-            *p = current->next;
-            free(current);
-            map->size--;
-            return value;
-        }
+    ssize_t index = findIndex(map, key, hashKey(map, key));
+    if (index < 0) {
+        return NULL;
+    }
 
-        p = &current->next;
+    void* value = map->slots[index].value;
+    if (map->iterating.load(std::memory_order_relaxed) > 0) {
+        // Nothing may move under hashmapForEach(); see purgeRemoved().
+        map->slots[index].state = REMOVED;
+        map->removed++;
+    } else {
+        eraseSlot(map, index);
     }
+    map->size--;
+    return value;
+}
 
-    return NULL;
+static void purgeRemoved(Hashmap* map) {
+    // Erasing moves the following entries back, possibly into this slot, or from the start of
+    // the array to its end, so keep going round until all are gone.
+    for (size_t i = 0; map->removed > 0; i = (i + 1) & (map->slotCount - 1)) {
+        while (map->slots[i].state == REMOVED) {
+            eraseSlot(map, i);
+            map->removed--;
+        }
+    }
 }
 
 void hashmapForEach(Hashmap* map, bool (*callback)(void* key, void* value, void* context),
                     void* context) {
-    size_t i;
-    for (i = 0; i < map->bucketCount; i++) {
-        Entry* entry = map->buckets[i];
-        while (entry != NULL) {
-            Entry *next = entry->next;
-            if (!callback(entry->key, entry->value, context)) {
-                return;
-            }
-            entry = next;
+    map->iterating.fetch_add(1, std::memory_order_relaxed);
+    size_t first = firstIndex(map);
+    for (size_t i = 0; i < map->slotCount; i++) {
+        const Slot& slot = map->slots[(first + i) & (map->slotCount - 1)];
+        if (slot.state == FULL && !callback(slot.key, slot.value, context)) {
+            break;
         }
     }
+    // Entries can only have been removed by a caller holding the map exclusively.
+    if (map->iterating.fetch_sub(1, std::memory_order_relaxed) == 1 && map->removed > 0) {
+        purgeRemoved(map);
+    }
 }
@@ -0,0 +1,213 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <cutils/hashmap.h>
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <map>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+static void* Key(intptr_t i) {
+    return reinterpret_cast<void*>(i);
+}
+
+static intptr_t Int(void* p) {
+    return reinterpret_cast<intptr_t>(p);
+}
+
+static int IntHash(void* key) {
+    return static_cast<int>(Int(key));
+}
+
+// Puts every key in one of a handful of home slots.
+static int CollidingHash(void* key) {
+    return static_cast<int>(Int(key) % 3);
+}
+
+static bool IntEquals(void* a, void* b) {
+    return a == b;
+}
+
+static bool Collect(void* key, void* value, void* context) {
+    auto* entries = static_cast<std::vector<std::pair<intptr_t, intptr_t>>*>(context);
+    entries->emplace_back(Int(key), Int(value));
+    return true;
+}
+
+static std::vector<std::pair<intptr_t, intptr_t>> Entries(Hashmap* map) {
+    std::vector<std::pair<intptr_t, intptr_t>> entries;
+    hashmapForEach(map, Collect, &entries);
+    return entries;
+}
+
+TEST(hashmap, put_get_remove) {
+    Hashmap* map = hashmapCreate(0, IntHash, IntEquals);
+    ASSERT_NE(nullptr, map);
+
+    for (intptr_t i = 1; i <= 1000; i++) {
+        ASSERT_EQ(nullptr, hashmapPut(map, Key(i), Key(i * 2)));
+    }
+    for (intptr_t i = 1; i <= 1000; i++) {
+        ASSERT_EQ(i * 2, Int(hashmapGet(map, Key(i))));
+    }
+    EXPECT_EQ(nullptr, hashmapGet(map, Key(1001)));
+
+    EXPECT_EQ(20, Int(hashmapPut(map, Key(10), Key(7))));
+    EXPECT_EQ(7, Int(hashmapGet(map, Key(10))));
+
+    for (intptr_t i = 1; i <= 1000; i += 2) {
+        ASSERT_EQ(i == 10 ? 7 : i * 2, Int(hashmapRemove(map, Key(i))));
+    }
+    EXPECT_EQ(nullptr, hashmapRemove(map, Key(1)));
+    for (intptr_t i = 1; i <= 1000; i++) {
+        ASSERT_EQ(i % 2 ? 0 : (i == 10 ? 7 : i * 2), Int(hashmapGet(map, Key(i)))) << i;
+    }
+    EXPECT_EQ(500U, Entries(map).size());
+
+    hashmapFree(map);
+}
+
+TEST(hashmap, matches_reference_model) {
+    for (int (*hash)(void*) : {IntHash, CollidingHash}) {
+        Hashmap* map = hashmapCreate(4, hash, IntEquals);
+        std::map<intptr_t, intptr_t> model;
+        unsigned seed = 1;
+        for (int i = 0; i < 20000; i++) {
+            seed = seed * 1103515245 + 12345;
+            intptr_t key = 1 + (seed >> 8) % 300;
+            intptr_t value = 1 + (seed >> 20);
+            if ((seed >> 4) % 3 == 0) {
+                auto it = model.find(key);
+                ASSERT_EQ(it == model.end() ? 0 : it->second, Int(hashmapRemove(map, Key(key))));
+                if (it != model.end()) model.erase(it);
+            } else {
+                auto it = model.find(key);
+                ASSERT_EQ(it == model.end() ? 0 : it->second,
+                          Int(hashmapPut(map, Key(key), Key(value))));
+                model[key] = value;
+            }
+        }
+        auto entries = Entries(map);
+        std::sort(entries.begin(), entries.end());
+        std::vector<std::pair<intptr_t, intptr_t>> expected(model.begin(), model.end());
+        EXPECT_EQ(expected, entries);
+        hashmapFree(map);
+    }
+}
+
+static bool RemoveOdd(void* key, void* value, void* context) {
+    auto* visited = static_cast<std::vector<intptr_t>*>(context);
+    visited->push_back(Int(value));
+    if (Int(key) % 2) {
+        hashmapRemove(reinterpret_cast<Hashmap*>(visited->front()), key);
+    }
+    return true;
+}
+
+TEST(hashmap, remove_in_for_each) {
+    Hashmap* map = hashmapCreate(0, CollidingHash, IntEquals);
+    for (intptr_t i = 1; i <= 100; i++) {
+        hashmapPut(map, Key(i), Key(i));
+    }
+
+    // The first element smuggles the map into the callback.
+    std::vector<intptr_t> visited = {Int(map)};
+    hashmapForEach(map, RemoveOdd, &visited);
+    visited.erase(visited.begin());
+    std::sort(visited.begin(), visited.end());
+    ASSERT_EQ(100U, visited.size());
+    for (intptr_t i = 1; i <= 100; i++) {
+        EXPECT_EQ(i, visited[i - 1]);
+    }
+
+    for (intptr_t i = 1; i <= 100; i++) {
+        EXPECT_EQ(i % 2 ? 0 : i, Int(hashmapGet(map, Key(i)))) << i;
+    }
+    EXPECT_EQ(50U, Entries(map).size());
+
+    // The removed entries are gone for good once the iteration is over.
+    for (intptr_t i = 101; i <= 300; i++) {
+        hashmapPut(map, Key(i), Key(i));
+    }
+    EXPECT_EQ(250U, Entries(map).size());
+
+    hashmapFree(map);
+}
+
+TEST(hashmap, iteration_order) {
+    // Callers such as str_parms_to_str() expose the iteration order, so it is pinned down
+    // here: entries with the same home slot are visited in the order they were put, until an
+    // expansion reverses them.
+    Hashmap* map = hashmapCreate(4, CollidingHash, IntEquals);
+    std::vector<intptr_t> keys;
+    for (intptr_t key = 3; key <= 18; key += 3) {
+        hashmapPut(map, Key(key), Key(0));
+        keys.push_back(key);
+    }
+    auto entries = Entries(map);
+    ASSERT_EQ(keys.size(), entries.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        EXPECT_EQ(keys[i], entries[i].first);
+    }
+
+    // The seventh entry takes the map over its load factor.
+    hashmapPut(map, Key(21), Key(0));
+    keys.push_back(21);
+    entries = Entries(map);
+    ASSERT_EQ(keys.size(), entries.size());
+    for (size_t i = 0; i < keys.size(); i++) {
+        EXPECT_EQ(keys[keys.size() - 1 - i], entries[i].first);
+    }
+
+    hashmapFree(map);
+}
+
+TEST(hashmap, concurrent_readers) {
+    Hashmap* map = hashmapCreate(0, IntHash, IntEquals);
+    for (intptr_t i = 1; i <= 1000; i++) {
+        hashmapPut(map, Key(i), Key(i));
+    }
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([map]() {
+            for (int round = 0; round < 100; round++) {
+                hashmapReadLock(map);
+                for (intptr_t i = 1; i <= 1000; i++) {
+                    EXPECT_EQ(i, Int(hashmapGet(map, Key(i))));
+                }
+                EXPECT_EQ(1000U, Entries(map).size());
+                hashmapUnlock(map);
+            }
+        });
+    }
+    for (int round = 0; round < 100; round++) {
+        hashmapLock(map);
+        hashmapPut(map, Key(2000), Key(round));
+        hashmapRemove(map, Key(2000));
+        hashmapUnlock(map);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    hashmapFree(map);
+}
@@ -93,7 +93,16 @@ void hashmapForEach(Hashmap* map, bool (*callback)(void* key, void* value, void*
 void hashmapLock(Hashmap* map);
 
 /**
- * Unlocks the hash map so other threads can access it.
+ * Locks the hash map for reading. Other threads may hold read locks at the
+ * same time, but not the lock taken by hashmapLock(). While holding a read
+ * lock, only hashmapGet() and hashmapForEach() may be called, and the
+ * callback must not modify the map.
+ */
+void hashmapReadLock(Hashmap* map);
+
+/**
+ * Unlocks the hash map so other threads can access it, whichever way it was
+ * locked.
  */
 void hashmapUnlock(Hashmap* map);
 
@@ -107,6 +107,25 @@ int32_t property_get_int32(const char *key, int32_t default_value);
 */
 int property_set(const char *key, const char *value);
 
+/* property_set_batch: sets count properties with a single request to the
+** property service, rather than one request per property.  Sets of the same
+** property happen in order, and one that fails doesn't stop the others.
+**
+** Returns the number of properties that could not be set, or < 0 if the
+** request could not be made at all.  At most PROPERTY_BATCH_MAX properties
+** can be set with one call.
+*/
+int property_set_batch(const char* const* keys, const char* const* values, size_t count);
+
+#define PROPERTY_BATCH_MAX 256
+
+/* The property service message used by property_set_batch().  It is followed
+** by a uint32_t count and count length-prefixed name/value string pairs, and
+** answered with a uint32_t status and, if that is PROP_SUCCESS, one uint32_t
+** result per property.
+*/
+#define PROP_MSG_SETPROP_BATCH 0x00030001
+
 int property_list(void (*propfn)(const char *key, const char *value, void *cookie), void *cookie);
 
 #if defined(__BIONIC_FORTIFY)
@@ -17,6 +17,7 @@
 #ifndef __CUTILS_STR_PARMS_H
 #define __CUTILS_STR_PARMS_H
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/cdefs.h>
 
@@ -52,6 +53,12 @@ int str_parms_get_float(struct str_parms *str_parms, const char *key,
 
 char *str_parms_to_str(struct str_parms *str_parms);
 
+// Writes the same string as str_parms_to_str() into the buffer pointed to by out_str,
+// truncating it to len - 1 characters if needed, and NUL-terminating it if len isn't 0.
+// Returns the length of the whole string, so a return value of len or more means that the
+// string was truncated.
+size_t str_parms_to_str_buf(struct str_parms *str_parms, char *out_str, size_t len);
+
 /* debug */
 void str_parms_dump(struct str_parms *str_parms);
 
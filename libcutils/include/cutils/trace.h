@@ -116,6 +116,58 @@ void atrace_set_debuggable(bool debuggable);
  */
 void atrace_set_tracing_enabled(bool enabled);
 
+/**
+ * Set whether every trace call checks the debug.atrace.tags.enableflags
+ * property for changes, which is the default.  Without polling, the enabled
+ * tags only change when atrace_update_tags() is called, so the process must
+ * call it when the property changes, for example from a sysprop change
+ * callback.  In exchange, checking whether a tag is enabled never reads the
+ * property area.
+ */
+void atrace_set_tag_polling(bool polling);
+
+/**
+ * A trace event recorded while the trace ring is enabled.
+ */
+struct atrace_ring_event {
+    /** When the event happened, in CLOCK_BOOTTIME nanoseconds like ftrace. */
+    uint64_t timestamp_ns;
+    /** The thread that traced the event. */
+    pid_t tid;
+    /** 'B', 'E', 'S', 'F' or 'C', as in the trace_marker text format. */
+    char type;
+    /** The name of the context or counter, not NUL-terminated. */
+    const char* name;
+    size_t name_length;
+    /** The cookie of an asynchronous event, or the value of a counter. */
+    int64_t value;
+};
+
+/**
+ * Enable recording trace events in per-thread ring buffers of buffer_size
+ * bytes (rounded up to a power of two), instead of writing each of them to the
+ * kernel's trace buffer.  Events are kept in binary form until a collector
+ * calls atrace_ring_drain(); those that don't fit in a full ring are dropped.
+ * Rings that already exist keep their size.
+ * Returns 0 on success, or a negative errno value.
+ */
+int atrace_ring_enable(size_t buffer_size);
+
+/**
+ * Go back to writing trace events to the kernel's trace buffer.  Events
+ * still in the rings can be drained afterwards.
+ */
+void atrace_ring_disable();
+
+/**
+ * Pass every event in the rings to the callback, oldest first for each
+ * thread, and free up their space.  Only one collector may drain at a time.
+ * Returns the number of events that were dropped since the last call.
+ */
+uint64_t atrace_ring_drain(void (*callback)(const struct atrace_ring_event* event,
+                                            void* context),
+                           void* context);
+
 /**
  * This is always set to false. This forces code that uses an old version
  * of this header to always call into atrace_setup, in which we call
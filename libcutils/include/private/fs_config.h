@@ -21,6 +21,7 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/cdefs.h>
 
@@ -47,4 +48,20 @@ __BEGIN_DECLS
 void fs_config(const char* path, int dir, const char* target_out_path, unsigned* uid, unsigned* gid,
                unsigned* mode, uint64_t* capabilities);
 
+struct fs_config_entry {
+    const char* path;
+    int dir;
+    unsigned uid;
+    unsigned gid;
+    unsigned mode;
+    uint64_t capabilities;
+};
+
+/*
+ * Same as calling fs_config() on each of the entries, for example all of those
+ * found walking a directory tree, with mode holding the st_mode to update.
+ * The config files are only read once per target_out_path for all calls.
+ */
+void fs_config_batch(struct fs_config_entry* entries, size_t count, const char* target_out_path);
+
 __END_DECLS
@@ -25,8 +25,15 @@
 #include <inttypes.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include <unistd.h>
 
+#include <string>
+#include <vector>
+
+#include <android-base/unique_fd.h>
+
 #include <cutils/sockets.h>
 #include <log/log.h>
 
@@ -111,6 +118,81 @@ int property_set(const char *key, const char *value) {
     return __system_property_set(key, value);
 }
 
+static void append_uint32(std::string* request, uint32_t value) {
+    request->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void append_string(std::string* request, const char* value) {
+    if (value == nullptr) {
+        value = "";
+    }
+    uint32_t length = strlen(value);
+    append_uint32(request, length);
+    request->append(value, length);
+}
+
+int property_set_batch(const char* const* keys, const char* const* values, size_t count) {
+    if (count > PROPERTY_BATCH_MAX) {
+        errno = E2BIG;
+        return -1;
+    }
+    if (count == 0) {
+        return 0;
+    }
+
+    std::string request;
+    append_uint32(&request, PROP_MSG_SETPROP_BATCH);
+    append_uint32(&request, count);
+    for (size_t i = 0; i < count; i++) {
+        append_string(&request, keys[i]);
+        append_string(&request, values[i]);
+    }
+
+    android::base::unique_fd fd(socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0));
+    if (fd == -1) {
+        return -1;
+    }
+    sockaddr_un addr = {};
+    addr.sun_family = AF_LOCAL;
+    strlcpy(addr.sun_path, "/dev/socket/" PROP_SERVICE_NAME, sizeof(addr.sun_path));
+    if (TEMP_FAILURE_RETRY(connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr))) == -1) {
+        return -1;
+    }
+
+    for (size_t sent = 0; sent < request.size();) {
+        ssize_t result =
+                TEMP_FAILURE_RETRY(send(fd, request.data() + sent, request.size() - sent, 0));
+        if (result <= 0) {
+            return -1;
+        }
+        sent += result;
+    }
+
+    uint32_t status;
+    if (TEMP_FAILURE_RETRY(recv(fd, &status, sizeof(status), MSG_WAITALL)) != sizeof(status)) {
+        return -1;
+    }
+    if (status != PROP_SUCCESS) {
+        ALOGE("property_set_batch of %zu properties failed: 0x%x", count, status);
+        return -1;
+    }
+
+    std::vector<uint32_t> results(count);
+    ssize_t size = count * sizeof(uint32_t);
+    if (TEMP_FAILURE_RETRY(recv(fd, results.data(), size, MSG_WAITALL)) != size) {
+        return -1;
+    }
+    int failed = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (results[i] != PROP_SUCCESS) {
+            ALOGV("property_set_batch(\"%s\", \"%s\") failed: 0x%x", keys[i], values[i],
+                  results[i]);
+            failed++;
+        }
+    }
+    return failed;
+}
+
 int property_get(const char *key, char *value, const char *default_value) {
     int len = __system_property_get(key, value);
     if (len > 0) {
@@ -157,6 +157,28 @@ TEST_F(PropertiesTest, SetString) {
     }
 }
 
+TEST_F(PropertiesTest, SetBatch) {
+    {
+        const char* keys[] = {PROPERTY_TEST_KEY, PROPERTY_TEST_KEY};
+        const char* values[] = {"first", "second"};
+        ASSERT_OK(property_set_batch(keys, values, arraysize(keys)));
+        ASSERT_EQ(6, property_get(PROPERTY_TEST_KEY, mValue, PROPERTY_TEST_VALUE_DEFAULT));
+        ASSERT_STREQ("second", mValue);
+    }
+
+    // A property that can't be set doesn't stop the ones after it.
+    {
+        const char* keys[] = {PROPERTY_TEST_KEY "..invalid", PROPERTY_TEST_KEY};
+        const char* values[] = {"first", "third"};
+        ASSERT_EQ(1, property_set_batch(keys, values, arraysize(keys)));
+        ASSERT_EQ(5, property_get(PROPERTY_TEST_KEY, mValue, PROPERTY_TEST_VALUE_DEFAULT));
+        ASSERT_STREQ("third", mValue);
+    }
+
+    ASSERT_OK(property_set_batch(nullptr, nullptr, 0));
+    ASSERT_GT(0, property_set_batch(nullptr, nullptr, PROPERTY_BATCH_MAX + 1));
+}
+
 TEST_F(PropertiesTest, GetString) {
 
     // Try to use a default value that's too long => get truncates the value
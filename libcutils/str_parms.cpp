@@ -26,178 +26,224 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include <cutils/hashmap.h>
 #include <cutils/memory.h>
 #include <log/log.h>
 
-/* When an object is allocated but not freed in a function,
- * because its ownership is released to other object like a hashmap,
- * call RELEASE_OWNERSHIP to tell the clang analyzer and avoid
- * false warnings about potential memory leak.
- * For now, a "temporary" assignment to global variables
- * is enough to confuse the clang static analyzer.
+/*
+ * All keys and values live NUL-terminated in a single arena.  A parsed string is copied there
+ * once and split in place, and added pairs are appended.  The pairs themselves are a small
+ * array of offsets into the arena, searched linearly and kept in the order the keys were first
+ * added, which is also the order str_parms_to_str() writes them in.
  */
-#ifdef __clang_analyzer__
-static void *released_pointer;
-#define RELEASE_OWNERSHIP(x) { released_pointer = x; released_pointer = 0; }
-#else
-#define RELEASE_OWNERSHIP(x)
-#endif
 
-struct str_parms {
-    Hashmap *map;
+struct str_parm {
+    uint32_t hash;
+    uint32_t key;
+    uint32_t key_len;
+    uint32_t value;
+    uint32_t value_len;
 };
 
-
-static bool str_eq(void *key_a, void *key_b)
-{
-    return !strcmp((const char *)key_a, (const char *)key_b);
-}
+struct str_parms {
+    char *arena;
+    size_t arena_size;
+    size_t arena_used;
+    /* Bytes of the arena no pair refers to anymore. */
+    size_t arena_garbage;
+    struct str_parm *parms;
+    size_t count;
+    size_t capacity;
+};
 
 /* use djb hash unless we find it inadequate */
 #ifdef __clang__
 __attribute__((no_sanitize("integer")))
 #endif
-static int str_hash_fn(void *str)
+static uint32_t str_hash(const char *str, size_t len)
 {
     uint32_t hash = 5381;
 
-    for (char* p = static_cast<char*>(str); p && *p; p++)
-        hash = ((hash << 5) + hash) + *p;
-    return (int)hash;
+    for (size_t i = 0; i < len; i++)
+        hash = ((hash << 5) + hash) + str[i];
+    return hash;
 }
 
 struct str_parms *str_parms_create(void)
 {
-    str_parms* s = static_cast<str_parms*>(calloc(1, sizeof(str_parms)));
-    if (!s) return NULL;
+    return static_cast<str_parms*>(calloc(1, sizeof(str_parms)));
+}
+
+void str_parms_destroy(struct str_parms *str_parms)
+{
+    free(str_parms->arena);
+    free(str_parms->parms);
+    free(str_parms);
+}
+
+static struct str_parm *find_parm(struct str_parms *str_parms, const char *key, size_t key_len)
+{
+    uint32_t hash = str_hash(key, key_len);
 
-    s->map = hashmapCreate(5, str_hash_fn, str_eq);
-    if (!s->map) {
-        free(s);
-        return NULL;
+    for (size_t i = 0; i < str_parms->count; i++) {
+        struct str_parm *parm = &str_parms->parms[i];
+        if (parm->hash == hash && parm->key_len == key_len &&
+                !memcmp(str_parms->arena + parm->key, key, key_len))
+            return parm;
     }
+    return NULL;
+}
 
-    return s;
+static const char *find_value(struct str_parms *str_parms, const char *key)
+{
+    struct str_parm *parm = find_parm(str_parms, key, strlen(key));
+    return parm ? str_parms->arena + parm->value : NULL;
 }
 
-struct remove_ctxt {
-    struct str_parms *str_parms;
-    const char *key;
-};
+static bool reserve_arena(struct str_parms *str_parms, size_t len)
+{
+    if (str_parms->arena_size - str_parms->arena_used >= len)
+        return true;
+    if (len > UINT32_MAX - str_parms->arena_used)
+        return false;
+
+    size_t size = str_parms->arena_size ? str_parms->arena_size : 64;
+    while (size < str_parms->arena_used + len)
+        size *= 2;
+    char *arena = static_cast<char*>(realloc(str_parms->arena, size));
+    if (!arena)
+        return false;
+    str_parms->arena = arena;
+    str_parms->arena_size = size;
+    return true;
+}
 
-static bool remove_pair(void *key, void *value, void *context)
+static bool reserve_parm(struct str_parms *str_parms)
 {
-    remove_ctxt* ctxt = static_cast<remove_ctxt*>(context);
-    bool should_continue;
-
-    /*
-     * - if key is not supplied, then we are removing all entries,
-     *   so remove key and continue (i.e. return true)
-     * - if key is supplied and matches, then remove it and don't
-     *   continue (return false). Otherwise, return true and keep searching
-     *   for key.
-     *
-     */
-    if (!ctxt->key) {
-        should_continue = true;
-        goto do_remove;
-    } else if (!strcmp(ctxt->key, static_cast<const char*>(key))) {
-        should_continue = false;
-        goto do_remove;
-    }
+    if (str_parms->count < str_parms->capacity)
+        return true;
 
+    size_t capacity = str_parms->capacity ? str_parms->capacity * 2 : 8;
+    struct str_parm *parms = static_cast<str_parm*>(
+            realloc(str_parms->parms, capacity * sizeof(struct str_parm)));
+    if (!parms)
+        return false;
+    str_parms->parms = parms;
+    str_parms->capacity = capacity;
     return true;
+}
 
-do_remove:
-    hashmapRemove(ctxt->str_parms->map, key);
-    free(key);
-    free(value);
-    return should_continue;
+/* Copies len bytes and a NUL into the arena, which must have room, and returns the offset. */
+static uint32_t append(struct str_parms *str_parms, const char *str, size_t len)
+{
+    uint32_t offset = str_parms->arena_used;
+
+    memcpy(str_parms->arena + offset, str, len);
+    str_parms->arena[offset + len] = '\0';
+    str_parms->arena_used += len + 1;
+    return offset;
 }
 
-void str_parms_del(struct str_parms *str_parms, const char *key)
+/* Moves the strings still in use to the start of the arena, in the order of the pairs. */
+static void compact_arena(struct str_parms *str_parms)
 {
-    struct remove_ctxt ctxt = {
-        .str_parms = str_parms,
-        .key = key,
-    };
-    hashmapForEach(str_parms->map, remove_pair, &ctxt);
+    char *arena = static_cast<char*>(malloc(str_parms->arena_size));
+    if (!arena)
+        return;
+
+    size_t used = 0;
+    for (size_t i = 0; i < str_parms->count; i++) {
+        struct str_parm *parm = &str_parms->parms[i];
+        memcpy(arena + used, str_parms->arena + parm->key, parm->key_len + 1);
+        parm->key = used;
+        used += parm->key_len + 1;
+        memcpy(arena + used, str_parms->arena + parm->value, parm->value_len + 1);
+        parm->value = used;
+        used += parm->value_len + 1;
+    }
+    free(str_parms->arena);
+    str_parms->arena = arena;
+    str_parms->arena_used = used;
+    str_parms->arena_garbage = 0;
 }
 
-void str_parms_destroy(struct str_parms *str_parms)
+static void remove_parm(struct str_parms *str_parms, struct str_parm *parm)
 {
-    struct remove_ctxt ctxt = {
-        .str_parms = str_parms,
-    };
+    str_parms->arena_garbage += parm->key_len + parm->value_len + 2;
+    memmove(parm, parm + 1,
+            (str_parms->parms + str_parms->count - (parm + 1)) * sizeof(struct str_parm));
+    str_parms->count--;
+}
 
-    hashmapForEach(str_parms->map, remove_pair, &ctxt);
-    hashmapFree(str_parms->map);
-    free(str_parms);
+void str_parms_del(struct str_parms *str_parms, const char *key)
+{
+    struct str_parm *parm = find_parm(str_parms, key, strlen(key));
+    if (parm)
+        remove_parm(str_parms, parm);
 }
 
 struct str_parms *str_parms_create_str(const char *_string)
 {
     struct str_parms *str_parms;
-    char *str;
-    char *kvpair;
-    char *tmpstr;
+    size_t len = strlen(_string);
     int items = 0;
 
     str_parms = str_parms_create();
     if (!str_parms)
         goto err_create_str_parms;
 
-    str = strdup(_string);
-    if (!str)
-        goto err_strdup;
+    if (!reserve_arena(str_parms, len + 1))
+        goto err_arena;
+    append(str_parms, _string, len);
 
     ALOGV("%s: source string == '%s'\n", __func__, _string);
 
-    kvpair = strtok_r(str, ";", &tmpstr);
-    while (kvpair && *kvpair) {
-        char *eq = strchr(kvpair, '='); /* would love strchrnul */
-        char *value;
-        char *key;
-        void *old_val;
-
-        if (eq == kvpair)
-            goto next_pair;
-
-        if (eq) {
-            key = strndup(kvpair, eq - kvpair);
-            if (*(++eq))
-                value = strdup(eq);
-            else
-                value = strdup("");
-        } else {
-            key = strdup(kvpair);
-            value = strdup("");
+    for (uint32_t pos = 0; pos < len;) {
+        char *kvpair = str_parms->arena + pos;
+        char *end = kvpair + strcspn(kvpair, ";");
+        uint32_t next = pos + (end - kvpair) + 1;
+        *end = '\0';
+
+        /* Empty pairs and pairs without a key are skipped. */
+        if (*kvpair == '\0' || *kvpair == '=') {
+            str_parms->arena_garbage += next - pos;
+            pos = next;
+            continue;
         }
 
-        /* if we replaced a value, free it */
-        old_val = hashmapPut(str_parms->map, key, value);
-        RELEASE_OWNERSHIP(value);
-        if (old_val) {
-            free(old_val);
-            free(key);
+        char *eq = kvpair + strcspn(kvpair, "=");
+        size_t key_len = eq - kvpair;
+        /* Without a '=', the value is the empty string at the end of the key. */
+        uint32_t value = *eq ? pos + key_len + 1 : pos + key_len;
+        *eq = '\0';
+
+        struct str_parm *parm = find_parm(str_parms, kvpair, key_len);
+        if (parm) {
+            /* The last value wins. */
+            str_parms->arena_garbage += parm->key_len + parm->value_len + 2;
+            parm->key = pos;
+            parm->value = value;
+            parm->value_len = end - (str_parms->arena + value);
         } else {
-            RELEASE_OWNERSHIP(key);
+            if (!reserve_parm(str_parms))
+                goto err_arena;
+            parm = &str_parms->parms[str_parms->count++];
+            parm->hash = str_hash(kvpair, key_len);
+            parm->key = pos;
+            parm->key_len = key_len;
+            parm->value = value;
+            parm->value_len = end - (str_parms->arena + value);
         }
 
         items++;
-next_pair:
-        kvpair = strtok_r(NULL, ";", &tmpstr);
+        pos = next;
     }
 
     if (!items)
         ALOGV("%s: no items found in string\n", __func__);
 
-    free(str);
-
     return str_parms;
 
-err_strdup:
+err_arena:
     str_parms_destroy(str_parms);
 err_create_str_parms:
     return NULL;
@@ -206,49 +252,39 @@ err_create_str_parms:
 int str_parms_add_str(struct str_parms *str_parms, const char *key,
                       const char *value)
 {
-    void *tmp_key = NULL;
-    void *tmp_val = NULL;
-    void *old_val = NULL;
-
-    // strdup and hashmapPut both set errno on failure.
-    // Set errno to 0 so we can recognize whether anything went wrong.
-    int saved_errno = errno;
-    errno = 0;
-
-    tmp_key = strdup(key);
-    if (tmp_key == NULL) {
-        goto clean_up;
-    }
-
-    tmp_val = strdup(value);
-    if (tmp_val == NULL) {
-        goto clean_up;
-    }
-
-    old_val = hashmapPut(str_parms->map, tmp_key, tmp_val);
-    if (old_val == NULL) {
-        // Did hashmapPut fail?
-        if (errno == ENOMEM) {
-            goto clean_up;
+    size_t key_len = strlen(key);
+    size_t value_len = strlen(value);
+    struct str_parm *parm = find_parm(str_parms, key, key_len);
+
+    if (parm) {
+        if (value_len <= parm->value_len) {
+            /* Reuse the space of the old value. */
+            memcpy(str_parms->arena + parm->value, value, value_len + 1);
+            str_parms->arena_garbage += parm->value_len - value_len;
+            parm->value_len = value_len;
+            return 0;
         }
-        // For new keys, hashmap takes ownership of tmp_key and tmp_val.
-        RELEASE_OWNERSHIP(tmp_key);
-        RELEASE_OWNERSHIP(tmp_val);
-        tmp_key = tmp_val = NULL;
-    } else {
-        // For existing keys, hashmap takes ownership of tmp_val.
-        // (It also gives up ownership of old_val.)
-        RELEASE_OWNERSHIP(tmp_val);
-        tmp_val = NULL;
+        if (str_parms->arena_garbage > str_parms->arena_used / 2)
+            compact_arena(str_parms);
+        if (!reserve_arena(str_parms, value_len + 1))
+            return -ENOMEM;
+        str_parms->arena_garbage += parm->value_len + 1;
+        parm->value = append(str_parms, value, value_len);
+        parm->value_len = value_len;
+        return 0;
     }
 
-clean_up:
-    free(tmp_key);
-    free(tmp_val);
-    free(old_val);
-    int result = -errno;
-    errno = saved_errno;
-    return result;
+    if (str_parms->arena_garbage > str_parms->arena_used / 2)
+        compact_arena(str_parms);
+    if (!reserve_parm(str_parms) || !reserve_arena(str_parms, key_len + value_len + 2))
+        return -ENOMEM;
+    parm = &str_parms->parms[str_parms->count++];
+    parm->hash = str_hash(key, key_len);
+    parm->key = append(str_parms, key, key_len);
+    parm->key_len = key_len;
+    parm->value = append(str_parms, value, value_len);
+    parm->value_len = value_len;
+    return 0;
 }
 
 int str_parms_add_int(struct str_parms *str_parms, const char *key, int value)
@@ -279,14 +315,13 @@ int str_parms_add_float(struct str_parms *str_parms, const char *key,
 }
 
 int str_parms_has_key(struct str_parms *str_parms, const char *key) {
-    return hashmapGet(str_parms->map, (void *)key) != NULL;
+    return find_value(str_parms, key) != NULL;
 }
 
 int str_parms_get_str(struct str_parms *str_parms, const char *key, char *val,
                       int len)
 {
-    // TODO: hashmapGet should take a const* key.
-    char* value = static_cast<char*>(hashmapGet(str_parms->map, (void*)key));
+    const char *value = find_value(str_parms, key);
     if (value)
         return strlcpy(val, value, len);
 
@@ -297,8 +332,7 @@ int str_parms_get_int(struct str_parms *str_parms, const char *key, int *val)
 {
     char *end;
 
-    // TODO: hashmapGet should take a const* key.
-    char* value = static_cast<char*>(hashmapGet(str_parms->map, (void*)key));
+    const char *value = find_value(str_parms, key);
     if (!value)
         return -ENOENT;
 
@@ -315,8 +349,7 @@ int str_parms_get_float(struct str_parms *str_parms, const char *key,
     float out;
     char *end;
 
-    // TODO: hashmapGet should take a const* key.
-    char* value = static_cast<char*>(hashmapGet(str_parms->map, (void*)(key)));
+    const char *value = find_value(str_parms, key);
     if (!value)
         return -ENOENT;
 
@@ -328,42 +361,43 @@ int str_parms_get_float(struct str_parms *str_parms, const char *key,
     return 0;
 }
 
-static bool combine_strings(void *key, void *value, void *context)
+size_t str_parms_to_str_buf(struct str_parms *str_parms, char *out_str, size_t len)
 {
-    char** old_str = static_cast<char**>(context);
-    char *new_str;
-    int ret;
-
-    ret = asprintf(&new_str, "%s%s%s=%s",
-                   *old_str ? *old_str : "",
-                   *old_str ? ";" : "",
-                   (char *)key,
-                   (char *)value);
-    if (*old_str)
-        free(*old_str);
-
-    if (ret >= 0) {
-        *old_str = new_str;
-        return true;
+    size_t needed = 0;
+
+    for (size_t i = 0; i < str_parms->count; i++) {
+        const struct str_parm *parm = &str_parms->parms[i];
+        const char *pieces[] = {
+            i ? ";" : "", str_parms->arena + parm->key, "=", str_parms->arena + parm->value,
+        };
+        const size_t lengths[] = {i ? 1u : 0u, parm->key_len, 1, parm->value_len};
+        for (size_t j = 0; j < 4; j++) {
+            if (needed < len) {
+                size_t n = lengths[j] < len - needed ? lengths[j] : len - needed;
+                memcpy(out_str + needed, pieces[j], n);
+            }
+            needed += lengths[j];
+        }
     }
-
-    *old_str = NULL;
-    return false;
+    if (len)
+        out_str[needed < len ? needed : len - 1] = '\0';
+    return needed;
 }
 
 char *str_parms_to_str(struct str_parms *str_parms)
 {
-    char *str = NULL;
-    hashmapForEach(str_parms->map, combine_strings, &str);
-    return (str != NULL) ? str : strdup("");
-}
-
-static bool dump_entry(void* key, void* value, void* /*context*/) {
-    ALOGI("key: '%s' value: '%s'\n", (char *)key, (char *)value);
-    return true;
+    size_t len = str_parms_to_str_buf(str_parms, NULL, 0);
+    char *str = static_cast<char*>(malloc(len + 1));
+    if (str)
+        str_parms_to_str_buf(str_parms, str, len + 1);
+    return str;
 }
 
 void str_parms_dump(struct str_parms *str_parms)
 {
-    hashmapForEach(str_parms->map, dump_entry, str_parms);
+    for (size_t i = 0; i < str_parms->count; i++) {
+        const struct str_parm *parm = &str_parms->parms[i];
+        ALOGI("key: '%s' value: '%s'\n", str_parms->arena + parm->key,
+              str_parms->arena + parm->value);
+    }
 }
@@ -17,6 +17,8 @@
 #include <cutils/str_parms.h>
 #include <gtest/gtest.h>
 
+#include <string>
+
 static void test_str_parms_str(const char* str, const char* expected) {
     str_parms* str_parms = str_parms_create_str(str);
     str_parms_add_str(str_parms, "dude", "woah");
@@ -55,3 +57,55 @@ TEST(str_parms, put_ENOMEM) {
     ASSERT_EQ(ENOMEM, errno);
     test_str_parms_str("foo=bar;baz=", "foo=bar;baz=");
 }
+
+TEST(str_parms, to_str_keeps_order) {
+    str_parms* str_parms = str_parms_create_str("c=3;a=1;b=2;a=4");
+    ASSERT_EQ(0, str_parms_add_int(str_parms, "d", 5));
+    str_parms_del(str_parms, "c");
+    ASSERT_EQ(0, str_parms_add_str(str_parms, "c", "6"));
+    char* out_str = str_parms_to_str(str_parms);
+    EXPECT_STREQ("a=4;b=2;d=5;c=6", out_str);
+    free(out_str);
+    str_parms_destroy(str_parms);
+}
+
+TEST(str_parms, to_str_buf) {
+    str_parms* str_parms = str_parms_create_str("foo=bar;baz=bat");
+    char buf[32];
+    ASSERT_EQ(15U, str_parms_to_str_buf(str_parms, buf, sizeof(buf)));
+    EXPECT_STREQ("foo=bar;baz=bat", buf);
+    ASSERT_EQ(15U, str_parms_to_str_buf(str_parms, buf, 16));
+    EXPECT_STREQ("foo=bar;baz=bat", buf);
+    ASSERT_EQ(15U, str_parms_to_str_buf(str_parms, buf, 10));
+    EXPECT_STREQ("foo=bar;b", buf);
+    ASSERT_EQ(15U, str_parms_to_str_buf(str_parms, nullptr, 0));
+    str_parms_destroy(str_parms);
+
+    str_parms = str_parms_create();
+    buf[0] = 'x';
+    ASSERT_EQ(0U, str_parms_to_str_buf(str_parms, buf, sizeof(buf)));
+    EXPECT_STREQ("", buf);
+    str_parms_destroy(str_parms);
+}
+
+TEST(str_parms, replace_values) {
+    str_parms* str_parms = str_parms_create_str("routing=2;sampling_rate=48000");
+    std::string long_value(100, 'v');
+    for (int i = 0; i < 1000; i++) {
+        ASSERT_EQ(0, str_parms_add_int(str_parms, "routing", i));
+        ASSERT_EQ(0, str_parms_add_str(str_parms, "long", long_value.c_str() + i % 100));
+        ASSERT_EQ(0, str_parms_add_str(str_parms, "other", i % 2 ? "" : "set"));
+        str_parms_del(str_parms, "other");
+    }
+    int routing;
+    ASSERT_EQ(0, str_parms_get_int(str_parms, "routing", &routing));
+    EXPECT_EQ(999, routing);
+    int rate;
+    ASSERT_EQ(0, str_parms_get_int(str_parms, "sampling_rate", &rate));
+    EXPECT_EQ(48000, rate);
+    char buf[128];
+    ASSERT_EQ(1, str_parms_get_str(str_parms, "long", buf, sizeof(buf)));
+    EXPECT_STREQ("v", buf);
+    EXPECT_FALSE(str_parms_has_key(str_parms, "other"));
+    str_parms_destroy(str_parms);
+}
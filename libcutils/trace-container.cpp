@@ -122,6 +122,19 @@ void atrace_setup()
     pthread_once(&atrace_once_control, atrace_init_once);
 }
 
+// The trace ring isn't supported in containers, where events go through the socket.
+int atrace_ring_enable(size_t /*buffer_size*/)
+{
+    return -ENOTSUP;
+}
+
+void atrace_ring_disable() {}
+
+uint64_t atrace_ring_drain(void (*)(const struct atrace_ring_event*, void*), void* /*context*/)
+{
+    return 0;
+}
+
 static inline uint64_t gettime(clockid_t clk_id)
 {
     struct timespec ts;
@@ -18,6 +18,8 @@
 
 #include "trace-dev.inc"
 
+#include <time.h>
+
 static pthread_once_t atrace_once_control = PTHREAD_ONCE_INIT;
 
 // Set whether tracing is enabled in this process.  This is used to prevent
@@ -69,32 +71,242 @@ void atrace_setup()
     atrace_init();
 }
 
+/*
+ * The trace ring: each thread appends its events to a ring buffer of its own, with no lock and
+ * no system call, and a collector takes them out with atrace_ring_drain().  A record is a
+ * ring_record followed by the name, padded to a multiple of 8 bytes.  Records may wrap around
+ * the end of the buffer.
+ */
+
+struct ring_record {
+    uint64_t timestamp_ns;
+    int64_t value;
+    uint32_t size;
+    uint16_t name_length;
+    char type;
+};
+
+struct atrace_ring {
+    // Total number of bytes written, only changed by the thread that owns the ring.
+    _Atomic(uint64_t) head;
+    // Total number of bytes drained, only changed by the collector.
+    _Atomic(uint64_t) tail;
+    _Atomic(uint64_t) dropped;
+    // Set when the owning thread exits; the collector frees the ring once it's empty.
+    atomic_bool orphaned;
+    pid_t tid;
+    size_t size;
+    struct atrace_ring* next;
+    char data[];
+};
+
+static atomic_bool       atrace_ring_enabled   = ATOMIC_VAR_INIT(false);
+static size_t            atrace_ring_size      = 0;
+static pthread_once_t    atrace_ring_once      = PTHREAD_ONCE_INIT;
+static pthread_key_t     atrace_ring_key;
+// Guards the list of rings, and serializes collectors.
+static pthread_mutex_t   atrace_ring_mutex     = PTHREAD_MUTEX_INITIALIZER;
+static struct atrace_ring* atrace_rings        = NULL;
+
+static void atrace_ring_thread_exit(void* ring)
+{
+    atomic_store_explicit(&static_cast<atrace_ring*>(ring)->orphaned, true, memory_order_release);
+}
+
+static void atrace_ring_init_once()
+{
+    pthread_key_create(&atrace_ring_key, atrace_ring_thread_exit);
+}
+
+int atrace_ring_enable(size_t buffer_size)
+{
+    if (buffer_size < sizeof(ring_record) + ATRACE_MESSAGE_LENGTH ||
+            buffer_size > (SIZE_MAX >> 1)) {
+        return -EINVAL;
+    }
+    size_t size = 1;
+    while (size < buffer_size) {
+        size <<= 1;
+    }
+    pthread_once(&atrace_ring_once, atrace_ring_init_once);
+    pthread_mutex_lock(&atrace_ring_mutex);
+    atrace_ring_size = size;
+    pthread_mutex_unlock(&atrace_ring_mutex);
+    atomic_store_explicit(&atrace_ring_enabled, true, memory_order_release);
+    return 0;
+}
+
+void atrace_ring_disable()
+{
+    atomic_store_explicit(&atrace_ring_enabled, false, memory_order_relaxed);
+}
+
+static atrace_ring* atrace_ring_for_thread()
+{
+    atrace_ring* ring = static_cast<atrace_ring*>(pthread_getspecific(atrace_ring_key));
+    if (CC_LIKELY(ring != NULL)) {
+        return ring;
+    }
+
+    pthread_mutex_lock(&atrace_ring_mutex);
+    ring = static_cast<atrace_ring*>(malloc(sizeof(atrace_ring) + atrace_ring_size));
+    if (ring != NULL) {
+        atomic_init(&ring->head, 0);
+        atomic_init(&ring->tail, 0);
+        atomic_init(&ring->dropped, 0);
+        atomic_init(&ring->orphaned, false);
+        ring->tid = gettid();
+        ring->size = atrace_ring_size;
+        ring->next = atrace_rings;
+        atrace_rings = ring;
+        pthread_setspecific(atrace_ring_key, ring);
+    }
+    pthread_mutex_unlock(&atrace_ring_mutex);
+    return ring;
+}
+
+static void atrace_ring_copy_in(atrace_ring* ring, uint64_t position, const void* src, size_t n)
+{
+    size_t offset = position & (ring->size - 1);
+    size_t first = n < ring->size - offset ? n : ring->size - offset;
+    memcpy(ring->data + offset, src, first);
+    memcpy(ring->data, static_cast<const char*>(src) + first, n - first);
+}
+
+static void atrace_ring_copy_out(const atrace_ring* ring, uint64_t position, void* dst, size_t n)
+{
+    size_t offset = position & (ring->size - 1);
+    size_t first = n < ring->size - offset ? n : ring->size - offset;
+    memcpy(dst, ring->data + offset, first);
+    memcpy(static_cast<char*>(dst) + first, ring->data, n - first);
+}
+
+static void atrace_ring_write(char type, const char* name, int64_t value)
+{
+    atrace_ring* ring = atrace_ring_for_thread();
+    if (ring == NULL) {
+        return;
+    }
+
+    ring_record record;
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    record.timestamp_ns = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    record.value = value;
+    // Names are truncated like in the kernel's trace buffer.
+    record.name_length = strnlen(name, ATRACE_MESSAGE_LENGTH);
+    record.size = (sizeof(record) + record.name_length + 7) & ~7;
+    record.type = type;
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    if (head - tail + record.size > ring->size) {
+        atomic_fetch_add_explicit(&ring->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    atrace_ring_copy_in(ring, head, &record, sizeof(record));
+    atrace_ring_copy_in(ring, head + sizeof(record), name, record.name_length);
+    atomic_store_explicit(&ring->head, head + record.size, memory_order_release);
+}
+
+uint64_t atrace_ring_drain(void (*callback)(const struct atrace_ring_event* event, void* context),
+                           void* context)
+{
+    char name[ATRACE_MESSAGE_LENGTH];
+    uint64_t dropped = 0;
+
+    pthread_mutex_lock(&atrace_ring_mutex);
+    atrace_ring** p = &atrace_rings;
+    while (*p != NULL) {
+        atrace_ring* ring = *p;
+        // Read this first: once the thread is gone, everything it wrote is in the ring.
+        bool orphaned = atomic_load_explicit(&ring->orphaned, memory_order_acquire);
+        uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        uint64_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        while (tail != head) {
+            ring_record record;
+            atrace_ring_copy_out(ring, tail, &record, sizeof(record));
+            atrace_ring_copy_out(ring, tail + sizeof(record), name, record.name_length);
+            atrace_ring_event event;
+            event.timestamp_ns = record.timestamp_ns;
+            event.tid = ring->tid;
+            event.type = record.type;
+            event.name = name;
+            event.name_length = record.name_length;
+            event.value = record.value;
+            callback(&event, context);
+            tail += record.size;
+        }
+        atomic_store_explicit(&ring->tail, tail, memory_order_release);
+        dropped += atomic_exchange_explicit(&ring->dropped, 0, memory_order_relaxed);
+
+        if (orphaned) {
+            *p = ring->next;
+            free(ring);
+        } else {
+            p = &ring->next;
+        }
+    }
+    pthread_mutex_unlock(&atrace_ring_mutex);
+    return dropped;
+}
+
 void atrace_begin_body(const char* name)
 {
+    if (CC_UNLIKELY(atomic_load_explicit(&atrace_ring_enabled, memory_order_acquire))) {
+        atrace_ring_write('B', name, 0);
+        return;
+    }
+
     WRITE_MSG("B|%d|", "%s", name, "");
 }
 
 void atrace_end_body()
 {
+    if (CC_UNLIKELY(atomic_load_explicit(&atrace_ring_enabled, memory_order_acquire))) {
+        atrace_ring_write('E', "", 0);
+        return;
+    }
+
     WRITE_MSG("E|%d", "%s", "", "");
 }
 
 void atrace_async_begin_body(const char* name, int32_t cookie)
 {
+    if (CC_UNLIKELY(atomic_load_explicit(&atrace_ring_enabled, memory_order_acquire))) {
+        atrace_ring_write('S', name, cookie);
+        return;
+    }
+
     WRITE_MSG("S|%d|", "|%" PRId32, name, cookie);
 }
 
 void atrace_async_end_body(const char* name, int32_t cookie)
 {
+    if (CC_UNLIKELY(atomic_load_explicit(&atrace_ring_enabled, memory_order_acquire))) {
+        atrace_ring_write('F', name, cookie);
+        return;
+    }
+
     WRITE_MSG("F|%d|", "|%" PRId32, name, cookie);
 }
 
 void atrace_int_body(const char* name, int32_t value)
 {
+    if (CC_UNLIKELY(atomic_load_explicit(&atrace_ring_enabled, memory_order_acquire))) {
+        atrace_ring_write('C', name, value);
+        return;
+    }
+
     WRITE_MSG("C|%d|", "|%" PRId32, name, value);
 }
 
 void atrace_int64_body(const char* name, int64_t value)
 {
+    if (CC_UNLIKELY(atomic_load_explicit(&atrace_ring_enabled, memory_order_acquire))) {
+        atrace_ring_write('C', name, value);
+        return;
+    }
+
     WRITE_MSG("C|%d|", "|%" PRId64, name, value);
 }
@@ -19,6 +19,8 @@
 
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/stringprintf.h>
@@ -292,3 +294,161 @@ TEST_F(TraceDevTest, atrace_int64_body_truncated) {
   expected += android::base::StringPrintf("%.*s|17179869183", expected_len, name.c_str());
   ASSERT_STREQ(expected.c_str(), actual.c_str());
 }
+
+struct RingEvent {
+  pid_t tid;
+  char type;
+  std::string name;
+  int64_t value;
+  uint64_t timestamp_ns;
+};
+
+static void CollectRingEvent(const atrace_ring_event* event, void* context) {
+  static_cast<std::vector<RingEvent>*>(context)->push_back(
+      {event->tid, event->type, std::string(event->name, event->name_length), event->value,
+       event->timestamp_ns});
+}
+
+class TraceRingTest : public TraceDevTest {
+ protected:
+  void SetUp() override {
+    TraceDevTest::SetUp();
+    ASSERT_EQ(0, atrace_ring_enable(4096));
+  }
+
+  void TearDown() override {
+    atrace_ring_disable();
+    Drain();
+    TraceDevTest::TearDown();
+  }
+
+  std::vector<RingEvent> Drain(uint64_t* dropped = nullptr) {
+    std::vector<RingEvent> events;
+    uint64_t n = atrace_ring_drain(CollectRingEvent, &events);
+    if (dropped != nullptr) *dropped = n;
+    return events;
+  }
+};
+
+TEST_F(TraceRingTest, records_events) {
+  atrace_begin_body("fake_name");
+  atrace_int_body("counter", -7);
+  atrace_int64_body("counter64", 17179869183L);
+  atrace_async_begin_body("async", 42);
+  atrace_async_end_body("async", 42);
+  atrace_end_body();
+
+  // Nothing goes to the kernel's trace buffer.
+  EXPECT_EQ(0, lseek(atrace_marker_fd, 0, SEEK_CUR));
+
+  uint64_t dropped;
+  std::vector<RingEvent> events = Drain(&dropped);
+  EXPECT_EQ(0U, dropped);
+  ASSERT_EQ(6U, events.size());
+  std::string types;
+  for (const RingEvent& event : events) {
+    types += event.type;
+    EXPECT_EQ(gettid(), event.tid);
+  }
+  EXPECT_EQ("BCCSFE", types);
+  EXPECT_EQ("fake_name", events[0].name);
+  EXPECT_EQ("counter", events[1].name);
+  EXPECT_EQ(-7, events[1].value);
+  EXPECT_EQ(17179869183L, events[2].value);
+  EXPECT_EQ("async", events[3].name);
+  EXPECT_EQ(42, events[4].value);
+  EXPECT_EQ("", events[5].name);
+  for (size_t i = 1; i < events.size(); i++) {
+    EXPECT_LE(events[i - 1].timestamp_ns, events[i].timestamp_ns);
+  }
+
+  EXPECT_TRUE(Drain().empty());
+}
+
+TEST_F(TraceRingTest, drops_events_when_full) {
+  // Each record takes 24 bytes plus the name, so only some of these fit.
+  for (int i = 0; i < 200; i++) {
+    atrace_int_body("counter", i);
+  }
+  uint64_t dropped;
+  std::vector<RingEvent> events = Drain(&dropped);
+  EXPECT_EQ(128U, events.size());
+  EXPECT_EQ(200U, events.size() + dropped);
+  for (size_t i = 0; i < events.size(); i++) {
+    EXPECT_EQ(static_cast<int64_t>(i), events[i].value);
+  }
+
+  // Draining makes room again, and the records now wrap around the end of the ring.
+  for (int i = 0; i < 100; i++) {
+    atrace_int_body("counter", 1000 + i);
+  }
+  events = Drain(&dropped);
+  EXPECT_EQ(0U, dropped);
+  ASSERT_EQ(100U, events.size());
+  for (size_t i = 0; i < events.size(); i++) {
+    EXPECT_EQ("counter", events[i].name);
+    EXPECT_EQ(static_cast<int64_t>(1000 + i), events[i].value);
+  }
+}
+
+TEST_F(TraceRingTest, truncates_long_names) {
+  std::string name = MakeName(2 * ATRACE_MESSAGE_LENGTH);
+  atrace_begin_body(name.c_str());
+  std::vector<RingEvent> events = Drain();
+  ASSERT_EQ(1U, events.size());
+  EXPECT_EQ(name.substr(0, ATRACE_MESSAGE_LENGTH), events[0].name);
+}
+
+TEST_F(TraceRingTest, one_ring_per_thread) {
+  pid_t other_tid = 0;
+  std::thread thread([&other_tid]() {
+    other_tid = gettid();
+    atrace_begin_body("other");
+    atrace_end_body();
+  });
+  thread.join();
+  atrace_begin_body("main");
+
+  // The exited thread's events can still be drained, after which its ring is freed.
+  std::vector<RingEvent> events = Drain();
+  ASSERT_EQ(3U, events.size());
+  size_t other = 0;
+  for (const RingEvent& event : events) {
+    if (event.tid == other_tid) {
+      other++;
+    } else {
+      EXPECT_EQ(gettid(), event.tid);
+      EXPECT_EQ("main", event.name);
+    }
+  }
+  EXPECT_EQ(2U, other);
+}
+
+TEST_F(TraceRingTest, disable) {
+  atrace_ring_disable();
+  atrace_begin_body("fake_name");
+  EXPECT_TRUE(Drain().empty());
+
+  ASSERT_EQ(0, lseek(atrace_marker_fd, 0, SEEK_SET));
+  std::string actual;
+  ASSERT_TRUE(android::base::ReadFdToString(atrace_marker_fd, &actual));
+  EXPECT_EQ(android::base::StringPrintf("B|%d|fake_name", getpid()), actual);
+}
+
+TEST(TraceRingEnableTest, rejects_small_buffers) {
+  EXPECT_EQ(-EINVAL, atrace_ring_enable(64));
+}
+
+TEST(TraceTagPollingTest, atrace_init) {
+  atrace_init();
+  atrace_set_tag_polling(false);
+  // Once initialized, a change to the property isn't noticed without polling...
+  atomic_store_explicit(&last_sequence_number, 1234, memory_order_relaxed);
+  atrace_init();
+  EXPECT_EQ(1234U, atomic_load_explicit(&last_sequence_number, memory_order_relaxed));
+
+  // ...but it is with.
+  atrace_set_tag_polling(true);
+  atrace_init();
+  EXPECT_NE(1234U, atomic_load_explicit(&last_sequence_number, memory_order_relaxed));
+}
@@ -16,12 +16,20 @@
 
 #include <cutils/trace.h>
 
+#include <errno.h>
+
 atomic_bool             atrace_is_ready      = ATOMIC_VAR_INIT(true);
 int                     atrace_marker_fd     = -1;
 uint64_t                atrace_enabled_tags  = 0;
 
 void atrace_set_debuggable(bool /*debuggable*/) {}
 void atrace_set_tracing_enabled(bool /*enabled*/) {}
+void atrace_set_tag_polling(bool /*polling*/) {}
+int atrace_ring_enable(size_t /*buffer_size*/) { return -ENOTSUP; }
+void atrace_ring_disable() {}
+uint64_t atrace_ring_drain(void (*)(const struct atrace_ring_event*, void*), void* /*context*/) {
+    return 0;
+}
 void atrace_update_tags() { }
 void atrace_setup() { }
 void atrace_begin_body(const char* /*name*/) {}
@@ -20,7 +20,10 @@
 #include <stdint.h>
 
 #ifdef __cplusplus
+#include <string.h>
+
 #include <string>
+#include <type_traits>
 #endif
 
 #include <log/log.h>
@@ -270,6 +273,97 @@ class android_log_event_list {
     return ret >= 0;
   }
 };
+
+/*
+ * A list of a fixed number of integer and float elements, encoded as
+ * android_log_event_list would encode them, but into a buffer that is part
+ * of the object and sized at compile time, so that writing it needs no
+ * allocation and no per element checks:
+ *
+ *   android_log_event_tuple(tag, pid, uid, elapsed_ms).write();
+ *
+ * Strings and nested lists still need android_log_event_list.
+ */
+template <typename... Ts>
+class android_log_event_tuple {
+ private:
+  template <typename T>
+  static constexpr uint8_t type_of() {
+    static_assert(std::is_same_v<T, float> ||
+                      (std::is_integral_v<T> && (sizeof(T) <= sizeof(int32_t) ||
+                                                 sizeof(T) == sizeof(int64_t))),
+                  "use android_log_event_list for elements other than integers and floats");
+    if constexpr (std::is_same_v<T, float>) {
+      return EVENT_TYPE_FLOAT;
+    } else if constexpr (sizeof(T) == sizeof(int64_t)) {
+      return EVENT_TYPE_LONG;
+    } else {
+      return EVENT_TYPE_INT;
+    }
+  }
+
+  template <typename T>
+  static constexpr size_t size_of() {
+    return sizeof(uint8_t) + (type_of<T>() == EVENT_TYPE_LONG ? sizeof(int64_t) : sizeof(int32_t));
+  }
+
+  /* Like android_log_write_list, a single element is not wrapped in a list. */
+  static constexpr size_t header_size = (sizeof...(Ts) > 1) ? 2 * sizeof(uint8_t) : 0;
+  static constexpr size_t payload_size = (header_size + ... + size_of<Ts>());
+  static_assert(sizeof...(Ts) <= UINT8_MAX, "too many elements for one event");
+  static_assert(payload_size <= LOGGER_ENTRY_MAX_PAYLOAD - sizeof(int32_t),
+                "event does not fit in a log entry");
+
+  int32_t tag;
+  char payload[payload_size > 0 ? payload_size : 1];
+
+  template <typename T>
+  void put(char*& pos, T value) {
+    *pos++ = type_of<T>();
+    if constexpr (type_of<T>() == EVENT_TYPE_FLOAT) {
+      memcpy(pos, &value, sizeof(float));
+      pos += sizeof(float);
+    } else if constexpr (type_of<T>() == EVENT_TYPE_LONG) {
+      int64_t data = static_cast<int64_t>(value);
+      memcpy(pos, &data, sizeof(data));
+      pos += sizeof(data);
+    } else {
+      int32_t data = static_cast<int32_t>(value);
+      memcpy(pos, &data, sizeof(data));
+      pos += sizeof(data);
+    }
+  }
+
+ public:
+  explicit android_log_event_tuple(int event_tag, Ts... values) : tag(event_tag) {
+    char* pos = payload;
+    if constexpr (header_size > 0) {
+      *pos++ = EVENT_TYPE_LIST;
+      *pos++ = sizeof...(Ts);
+    }
+    (put(pos, values), ...);
+  }
+
+  const char* data() const {
+    return payload;
+  }
+
+  static constexpr size_t size() {
+    return payload_size;
+  }
+
+  /* Only LOG_ID_EVENTS and LOG_ID_STATS, use android_log_event_list for LOG_ID_SECURITY */
+  int write(log_id_t id = LOG_ID_EVENTS) const {
+    switch (id) {
+      case LOG_ID_EVENTS:
+        return __android_log_bwrite(tag, payload, payload_size);
+      case LOG_ID_STATS:
+        return __android_log_stats_bwrite(tag, payload, payload_size);
+      default:
+        return -EINVAL;
+    }
+  }
+};
 }
 #endif
 
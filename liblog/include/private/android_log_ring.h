@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+/*
+ * Shared memory transport between liblog and logd.
+ *
+ * A client creates a sealed memfd holding a log_ring_header_t followed by a
+ * power of two sized data area, and registers it by sending logd a datagram
+ * on /dev/socket/logdw whose android_log_header_t id is LOG_RING_REGISTER_ID,
+ * carrying log_ring_register_t as payload and three descriptors as
+ * SCM_RIGHTS: the memfd, an eventfd doorbell, and the read end of a pipe the
+ * client keeps open for as long as it lives. logd sets ready once it drains
+ * the ring, until then the client keeps using the socket.
+ *
+ * The client is the only producer and advances head, logd is the only
+ * consumer and advances tail. Both are free running byte counts. Records are
+ * 8 byte aligned and never wrap; a record with id LOG_RING_PAD_ID asks the
+ * consumer to skip to the start of the data area. logd must not trust
+ * anything it reads from the ring.
+ */
+
+#include <stdint.h>
+
+#include <atomic>
+
+#include <log/log_id.h>
+
+#define LOG_RING_MAGIC 0x676e6972 /* "ring" */
+#define LOG_RING_VERSION 1
+#define LOG_RING_REGISTER_ID 0xFE
+#define LOG_RING_PAD_ID 0xFF
+#define LOG_RING_MIN_SIZE (16 * 1024)
+#define LOG_RING_MAX_SIZE (1024 * 1024)
+#define LOG_RING_DEFAULT_SIZE (128 * 1024)
+
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t size; /* of the data area, a power of two */
+  /* set by logd once it consumes the ring */
+  std::atomic<uint32_t> ready;
+  /* set by logd before it waits on the doorbell, cleared by whoever rings it */
+  std::atomic<uint32_t> sleeping;
+  alignas(64) std::atomic<uint32_t> head;
+  alignas(64) std::atomic<uint32_t> tail;
+  alignas(64) unsigned char data[];
+} log_ring_header_t;
+
+typedef struct __attribute__((__packed__)) {
+  uint16_t len; /* of the payload that follows */
+  uint8_t id;
+  uint8_t reserved;
+  uint32_t tid;
+  uint32_t tv_sec;
+  uint32_t tv_nsec;
+} log_ring_record_t;
+
+typedef struct __attribute__((__packed__)) {
+  uint32_t magic;
+  uint32_t version;
+} log_ring_register_t;
+
+static inline uint32_t log_ring_record_size(uint32_t len) {
+  return (sizeof(log_ring_record_t) + len + 7) & ~7U;
+}
@@ -162,6 +162,42 @@ bool __android_logger_valid_buffer_size(unsigned long value);
 /* Retrieve the composed event buffer */
 int android_log_write_list_buffer(android_log_context ctx, const char** msg);
 
+/*
+ * Hold back logd writes from this process for up to max_delay_us, or until
+ * max_bytes (0 for the default 64K) of payload are pending, and send them
+ * with a single sendmmsg(). Crash and security logs and text logs of ERROR
+ * and above are never delayed. A max_delay_us of 0 flushes and turns batching
+ * back off. Returns 0 on success or a negative errno.
+ */
+int __android_log_set_logd_batching(uint32_t max_delay_us, size_t max_bytes);
+
+/*
+ * Hold back pmsg writes from this process for up to max_delay_us, or until
+ * max_bytes (0 for the default 16K) of records are pending, and write them
+ * to /dev/pmsg0 with a single write(). The records are unchanged, so pstore
+ * readers need nothing new. Fatal messages are never delayed. A max_delay_us
+ * of 0 flushes and turns batching back off. Returns 0 on success or a
+ * negative errno.
+ */
+int __android_log_set_pmsg_batching(uint32_t max_delay_us, size_t max_bytes);
+
+/*
+ * Register a shared memory ring of size bytes (0 for the default) with logd
+ * and write to it instead of the socket for as long as it has room and logd
+ * drains it. The socket remains the fallback, and logd must have
+ * logd.ring_transport enabled. Returns 0 on success or a negative errno.
+ */
+int __android_log_set_logd_ring(size_t size);
+
+/*
+ * Have logd drop what filter, in the android_log_addFilterString() syntax,
+ * would not print before sending it to this logger_list. Entries logd can not
+ * attribute to a tag are still sent, the reader must keep filtering. Must be
+ * called before the first android_logger_list_read(). Returns 0 on success or
+ * a negative errno.
+ */
+int __android_logger_list_set_filter(struct logger_list* logger_list, const char* filter);
+
 #if defined(__cplusplus)
 }
 #endif
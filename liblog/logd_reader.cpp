@@ -260,7 +260,7 @@ int android_logger_set_prune_list(struct logger_list* logger_list, const char* b
 }
 
 static int logdOpen(struct logger_list* logger_list) {
-  char buffer[256], *cp, c;
+  char buffer[256 + sizeof(" filter=") + LOGGER_FILTER_MAX], *cp, c;
   int ret, remaining, sock;
 
   sock = atomic_load(&logger_list->fd);
@@ -319,6 +319,14 @@ static int logdOpen(struct logger_list* logger_list) {
   if (logger_list->pid) {
     ret = snprintf(cp, remaining, " pid=%u", logger_list->pid);
     ret = MIN(ret, remaining);
+    remaining -= ret;
+    cp += ret;
+  }
+
+  // Last, logd takes everything after it as the filter.
+  if (logger_list->filter) {
+    ret = snprintf(cp, remaining, " filter=%s", logger_list->filter);
+    ret = MIN(ret, remaining);
     cp += ret;
   }
 
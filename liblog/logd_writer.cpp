@@ -20,11 +20,14 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <poll.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
@@ -32,13 +35,56 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <new>
+
 #include <private/android_filesystem_config.h>
+#include <private/android_log_ring.h>
 #include <private/android_logger.h>
 
 #include "logger.h"
 #include "uio.h"
 
 static atomic_int logd_socket;
+static atomic_int dropped;
+static atomic_int droppedSecurity;
+
+static constexpr size_t kMaxBatchRecords = 64;
+static constexpr size_t kMaxBatchBytes = 64 * 1024;
+
+// Messages held back by __android_log_set_logd_batching(), sent to logd with a single sendmmsg()
+// when the batch fills up, max_delay_us after the first message was queued, or right away for
+// messages that must not be delayed.
+struct LogdBatch {
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;
+  uint32_t max_delay_us;
+  size_t max_bytes;
+  pid_t flusher_pid;  // process the flusher thread runs in, 0 if none
+  struct timespec first;
+  size_t count;
+  size_t used;
+  android_log_header_t headers[kMaxBatchRecords];
+  size_t lengths[kMaxBatchRecords];
+  unsigned char data[kMaxBatchBytes];
+};
+
+static std::atomic<LogdBatch*> logd_batch;
+
+// A shared memory ring registered with logd by __android_log_set_logd_ring(). Only the process
+// that registered it may write to it, a forked child goes back to the socket.
+struct LogdRing {
+  pthread_mutex_t lock;
+  log_ring_header_t* header;
+  size_t map_size;
+  uint32_t size;
+  uint32_t head;
+  pid_t pid;
+  int doorbell;
+  int alive;  // write end of the pipe logd watches to see us go away
+};
+
+static std::atomic<LogdRing*> logd_ring;
 
 // Note that it is safe to call connect() multiple times on DGRAM Unix domain sockets, so this
 // function is used to reconnect to logd without requiring a new socket.
@@ -79,58 +125,35 @@ static void GetSocket() {
 // explicitly not thread safe.  It sets logd_socket to 0, so future logs will be safely initialized
 // whenever they happen.
 void LogdClose() {
+  LogdFlush();
   if (logd_socket > 0) {
     close(logd_socket);
   }
   logd_socket = 0;
 }
 
-int LogdWrite(log_id_t logId, struct timespec* ts, struct iovec* vec, size_t nr) {
+// Tell logd about the messages we failed to send it, header holds the tid and time to use.
+static void WriteDropped(android_log_header_t* header) {
+  struct iovec newVec[2];
   ssize_t ret;
-  static const unsigned headerLength = 1;
-  struct iovec newVec[nr + headerLength];
-  android_log_header_t header;
-  size_t i, payloadSize;
-  static atomic_int dropped;
-  static atomic_int droppedSecurity;
-
-  GetSocket();
-
-  if (logd_socket <= 0) {
-    return -EBADF;
-  }
-
-  /* logd, after initialization and priv drop */
-  if (getuid() == AID_LOGD) {
-    /*
-     * ignore log messages we send to ourself (logd).
-     * Such log messages are often generated by libraries we depend on
-     * which use standard Android logging.
-     */
-    return 0;
-  }
 
-  header.tid = gettid();
-  header.realtime.tv_sec = ts->tv_sec;
-  header.realtime.tv_nsec = ts->tv_nsec;
-
-  newVec[0].iov_base = (unsigned char*)&header;
-  newVec[0].iov_len = sizeof(header);
+  newVec[0].iov_base = (unsigned char*)header;
+  newVec[0].iov_len = sizeof(*header);
 
   int32_t snapshot = atomic_exchange_explicit(&droppedSecurity, 0, memory_order_relaxed);
   if (snapshot) {
     android_log_event_int_t buffer;
 
-    header.id = LOG_ID_SECURITY;
+    header->id = LOG_ID_SECURITY;
     buffer.header.tag = LIBLOG_LOG_TAG;
     buffer.payload.type = EVENT_TYPE_INT;
     buffer.payload.data = snapshot;
 
-    newVec[headerLength].iov_base = &buffer;
-    newVec[headerLength].iov_len = sizeof(buffer);
+    newVec[1].iov_base = &buffer;
+    newVec[1].iov_len = sizeof(buffer);
 
     ret = TEMP_FAILURE_RETRY(writev(logd_socket, newVec, 2));
-    if (ret != (ssize_t)(sizeof(header) + sizeof(buffer))) {
+    if (ret != (ssize_t)(sizeof(*header) + sizeof(buffer))) {
       atomic_fetch_add_explicit(&droppedSecurity, snapshot, memory_order_relaxed);
     }
   }
@@ -139,21 +162,440 @@ int LogdWrite(log_id_t logId, struct timespec* ts, struct iovec* vec, size_t nr)
                                                 ANDROID_LOG_VERBOSE)) {
     android_log_event_int_t buffer;
 
-    header.id = LOG_ID_EVENTS;
+    header->id = LOG_ID_EVENTS;
     buffer.header.tag = LIBLOG_LOG_TAG;
     buffer.payload.type = EVENT_TYPE_INT;
     buffer.payload.data = snapshot;
 
-    newVec[headerLength].iov_base = &buffer;
-    newVec[headerLength].iov_len = sizeof(buffer);
+    newVec[1].iov_base = &buffer;
+    newVec[1].iov_len = sizeof(buffer);
 
     ret = TEMP_FAILURE_RETRY(writev(logd_socket, newVec, 2));
-    if (ret != (ssize_t)(sizeof(header) + sizeof(buffer))) {
+    if (ret != (ssize_t)(sizeof(*header) + sizeof(buffer))) {
       atomic_fetch_add_explicit(&dropped, snapshot, memory_order_relaxed);
     }
   }
+}
 
-  header.id = logId;
+static void FlushLocked(LogdBatch* batch) {
+  if (batch->count == 0) {
+    return;
+  }
+
+  size_t sent = 0;
+  GetSocket();
+  if (logd_socket > 0) {
+    android_log_header_t header = batch->headers[0];
+    WriteDropped(&header);
+
+    struct iovec vecs[kMaxBatchRecords][2];
+    struct mmsghdr msgs[kMaxBatchRecords] = {};
+    unsigned char* data = batch->data;
+    for (size_t i = 0; i < batch->count; ++i) {
+      vecs[i][0].iov_base = &batch->headers[i];
+      vecs[i][0].iov_len = sizeof(batch->headers[i]);
+      vecs[i][1].iov_base = data;
+      vecs[i][1].iov_len = batch->lengths[i];
+      data += batch->lengths[i];
+      msgs[i].msg_hdr.msg_iov = vecs[i];
+      msgs[i].msg_hdr.msg_iovlen = 2;
+    }
+
+    // Same policy as the unbatched write: EAGAIN means logd is overloaded and the rest is lost,
+    // anything else resets the connection once and tries again.
+    bool reconnected = false;
+    while (sent < batch->count) {
+      int ret = TEMP_FAILURE_RETRY(sendmmsg(logd_socket, msgs + sent, batch->count - sent, 0));
+      if (ret > 0) {
+        sent += ret;
+        continue;
+      }
+      if (ret < 0 && errno != EAGAIN && !reconnected) {
+        LogdConnect();
+        reconnected = true;
+        continue;
+      }
+      break;
+    }
+  }
+
+  for (size_t i = sent; i < batch->count; ++i) {
+    atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+    if (batch->headers[i].id == LOG_ID_SECURITY) {
+      atomic_fetch_add_explicit(&droppedSecurity, 1, memory_order_relaxed);
+    }
+  }
+  batch->count = 0;
+  batch->used = 0;
+}
+
+static void* LogdFlusher(void* arg) {
+  LogdBatch* batch = static_cast<LogdBatch*>(arg);
+  pid_t pid = getpid();
+
+  pthread_mutex_lock(&batch->lock);
+  while (batch->flusher_pid == pid) {
+    if (batch->count == 0) {
+      pthread_cond_wait(&batch->wakeup, &batch->lock);
+      continue;
+    }
+    struct timespec deadline = batch->first;
+    deadline.tv_sec += batch->max_delay_us / 1000000;
+    deadline.tv_nsec += (batch->max_delay_us % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    if (pthread_cond_timedwait(&batch->wakeup, &batch->lock, &deadline) == ETIMEDOUT) {
+      FlushLocked(batch);
+    }
+  }
+  pthread_mutex_unlock(&batch->lock);
+  return nullptr;
+}
+
+static bool StartFlusherLocked(LogdBatch* batch) {
+  pid_t pid = getpid();
+  if (batch->flusher_pid == pid) {
+    return true;
+  }
+
+  pthread_t thread;
+  pthread_attr_t attr;
+  bool started = false;
+  if (!pthread_attr_init(&attr)) {
+    if (!pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) {
+      batch->flusher_pid = pid;
+      started = !pthread_create(&thread, &attr, LogdFlusher, batch);
+      if (!started) {
+        batch->flusher_pid = 0;
+      }
+    }
+    pthread_attr_destroy(&attr);
+  }
+  return started;
+}
+
+// Returns false if batching is off and the caller should write the message itself.
+static bool BatchWrite(LogdBatch* batch, log_id_t logId, const android_log_header_t* header,
+                       const struct iovec* vec, size_t nr, size_t payloadSize) {
+  pthread_mutex_lock(&batch->lock);
+  if (batch->max_delay_us == 0) {
+    pthread_mutex_unlock(&batch->lock);
+    return false;
+  }
+
+  if (batch->count == kMaxBatchRecords || batch->used + payloadSize > batch->max_bytes) {
+    FlushLocked(batch);
+  }
+
+  size_t i = batch->count++;
+  batch->headers[i] = *header;
+  batch->headers[i].id = logId;
+  batch->lengths[i] = payloadSize;
+  unsigned char* data = batch->data + batch->used;
+  for (size_t v = 0; v < nr; ++v) {
+    memcpy(data, vec[v].iov_base, vec[v].iov_len);
+    data += vec[v].iov_len;
+  }
+  batch->used += payloadSize;
+
+  // Crashes, security events and errors are what is most likely to be lost if the process dies
+  // before the flusher gets to them.
+  bool urgent = logId == LOG_ID_CRASH || logId == LOG_ID_SECURITY;
+  if (logId != LOG_ID_EVENTS && logId != LOG_ID_STATS && logId != LOG_ID_SECURITY && nr > 0 &&
+      vec[0].iov_len > 0 && *static_cast<const unsigned char*>(vec[0].iov_base) >= ANDROID_LOG_ERROR) {
+    urgent = true;
+  }
+
+  if (urgent || !StartFlusherLocked(batch)) {
+    FlushLocked(batch);
+  } else if (batch->count == 1) {
+    clock_gettime(CLOCK_MONOTONIC, &batch->first);
+    pthread_cond_signal(&batch->wakeup);
+  }
+  pthread_mutex_unlock(&batch->lock);
+  return true;
+}
+
+static void BatchForkPrepare() {
+  pthread_mutex_lock(&logd_batch.load()->lock);
+}
+
+static void BatchForkParent() {
+  pthread_mutex_unlock(&logd_batch.load()->lock);
+}
+
+// The parent sends what is pending, the child has no flusher thread until it logs again.
+static void BatchForkChild() {
+  LogdBatch* batch = logd_batch.load();
+  batch->count = 0;
+  batch->used = 0;
+  batch->flusher_pid = 0;
+  pthread_mutex_unlock(&batch->lock);
+}
+
+static LogdBatch* GetBatch() {
+  LogdBatch* batch = logd_batch.load(std::memory_order_acquire);
+  if (batch) {
+    return batch;
+  }
+
+  LogdBatch* new_batch = new (std::nothrow) LogdBatch();
+  if (!new_batch) {
+    return nullptr;
+  }
+  pthread_mutex_init(&new_batch->lock, nullptr);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&new_batch->wakeup, &attr);
+  pthread_condattr_destroy(&attr);
+  new_batch->max_bytes = kMaxBatchBytes;
+
+  if (!logd_batch.compare_exchange_strong(batch, new_batch, std::memory_order_acq_rel)) {
+    pthread_cond_destroy(&new_batch->wakeup);
+    pthread_mutex_destroy(&new_batch->lock);
+    delete new_batch;
+    return batch;
+  }
+  pthread_atfork(BatchForkPrepare, BatchForkParent, BatchForkChild);
+  return new_batch;
+}
+
+int LogdSetBatching(uint32_t max_delay_us, size_t max_bytes) {
+  LogdBatch* batch = logd_batch.load(std::memory_order_acquire);
+  if (max_delay_us == 0 && !batch) {
+    return 0;
+  }
+  if (!batch && !(batch = GetBatch())) {
+    return -ENOMEM;
+  }
+
+  if (max_bytes == 0 || max_bytes > kMaxBatchBytes) {
+    max_bytes = kMaxBatchBytes;
+  } else if (max_bytes < LOGGER_ENTRY_MAX_PAYLOAD) {
+    max_bytes = LOGGER_ENTRY_MAX_PAYLOAD;
+  }
+
+  pthread_mutex_lock(&batch->lock);
+  FlushLocked(batch);
+  batch->max_delay_us = max_delay_us;
+  batch->max_bytes = max_bytes;
+  if (max_delay_us == 0) {
+    // Let the flusher thread exit.
+    batch->flusher_pid = 0;
+  }
+  pthread_cond_signal(&batch->wakeup);
+  pthread_mutex_unlock(&batch->lock);
+  return 0;
+}
+
+void LogdFlush() {
+  LogdBatch* batch = logd_batch.load(std::memory_order_acquire);
+  if (!batch) {
+    return;
+  }
+  pthread_mutex_lock(&batch->lock);
+  FlushLocked(batch);
+  pthread_mutex_unlock(&batch->lock);
+}
+
+// Returns false if the ring can not take the message right now, and the caller should write it to
+// the socket instead. Never blocks, so it is safe from signal handlers.
+static bool RingWrite(LogdRing* ring, log_id_t logId, const android_log_header_t* header,
+                      const struct iovec* vec, size_t nr, size_t payloadSize) {
+  log_ring_header_t* shared = ring->header;
+  if (ring->pid != getpid() || !shared->ready.load(std::memory_order_acquire)) {
+    return false;
+  }
+  if (pthread_mutex_trylock(&ring->lock)) {
+    return false;
+  }
+
+  uint32_t head = ring->head;
+  uint32_t offset = head & (ring->size - 1);
+  uint32_t need = log_ring_record_size(payloadSize);
+  uint32_t pad = (offset + need > ring->size) ? ring->size - offset : 0;
+  // A full ring, or logd is gone and no longer consuming it.
+  if (head + pad + need - shared->tail.load(std::memory_order_acquire) > ring->size) {
+    pthread_mutex_unlock(&ring->lock);
+    return false;
+  }
+
+  if (pad >= sizeof(log_ring_record_t)) {
+    log_ring_record_t skip = {};
+    skip.id = LOG_RING_PAD_ID;
+    memcpy(shared->data + offset, &skip, sizeof(skip));
+  }
+  if (pad) {
+    head += pad;
+    offset = 0;
+  }
+
+  log_ring_record_t record = {};
+  record.len = payloadSize;
+  record.id = logId;
+  record.tid = header->tid;
+  record.tv_sec = header->realtime.tv_sec;
+  record.tv_nsec = header->realtime.tv_nsec;
+  unsigned char* data = shared->data + offset;
+  memcpy(data, &record, sizeof(record));
+  data += sizeof(record);
+  for (size_t i = 0; i < nr; ++i) {
+    memcpy(data, vec[i].iov_base, vec[i].iov_len);
+    data += vec[i].iov_len;
+  }
+  ring->head = head + need;
+
+  // Pairs with logd: either it sees the new head before it goes to sleep, or we see it sleeping.
+  shared->head.store(ring->head, std::memory_order_seq_cst);
+  bool wake = shared->sleeping.exchange(0, std::memory_order_seq_cst);
+  pthread_mutex_unlock(&ring->lock);
+
+  if (wake) {
+    uint64_t one = 1;
+    TEMP_FAILURE_RETRY(write(ring->doorbell, &one, sizeof(one)));
+  }
+  return true;
+}
+
+int LogdSetRing(size_t size) {
+  if (size == 0) {
+    size = LOG_RING_DEFAULT_SIZE;
+  }
+  if (size < LOG_RING_MIN_SIZE || size > LOG_RING_MAX_SIZE || (size & (size - 1))) {
+    return -EINVAL;
+  }
+
+  LogdRing* old_ring = logd_ring.load(std::memory_order_acquire);
+  if (old_ring && old_ring->pid == getpid()) {
+    return 0;
+  }
+
+  GetSocket();
+  if (logd_socket <= 0) {
+    return -EBADF;
+  }
+
+  int ret = 0;
+  size_t map_size = sizeof(log_ring_header_t) + size;
+  void* map = MAP_FAILED;
+  int pipe_fds[2] = {-1, -1};
+  int doorbell = -1;
+  int memfd = memfd_create("logd_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (memfd < 0 || ftruncate(memfd, map_size) ||
+      fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) ||
+      (map = mmap(nullptr, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0)) == MAP_FAILED ||
+      (doorbell = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) < 0 || pipe2(pipe_fds, O_CLOEXEC)) {
+    ret = -errno;
+  }
+
+  log_ring_header_t* shared = static_cast<log_ring_header_t*>(map);
+  if (ret == 0) {
+    shared->magic = LOG_RING_MAGIC;
+    shared->version = LOG_RING_VERSION;
+    shared->size = size;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    android_log_header_t header = {};
+    header.id = LOG_RING_REGISTER_ID;
+    header.tid = gettid();
+    header.realtime.tv_sec = ts.tv_sec;
+    header.realtime.tv_nsec = ts.tv_nsec;
+    log_ring_register_t reg = {LOG_RING_MAGIC, LOG_RING_VERSION};
+    struct iovec vec[2] = {{&header, sizeof(header)}, {&reg, sizeof(reg)}};
+
+    int fds[3] = {memfd, doorbell, pipe_fds[0]};
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    struct msghdr msg = {};
+    msg.msg_iov = vec;
+    msg.msg_iovlen = 2;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+    if (TEMP_FAILURE_RETRY(sendmsg(logd_socket, &msg, 0)) < 0) {
+      ret = -errno;
+    }
+  }
+
+  // logd holds its own references now.
+  if (memfd >= 0) close(memfd);
+  if (pipe_fds[0] >= 0) close(pipe_fds[0]);
+
+  LogdRing* ring = nullptr;
+  if (ret == 0 && !(ring = new (std::nothrow) LogdRing)) {
+    ret = -ENOMEM;
+  }
+  if (ret) {
+    if (map != MAP_FAILED) munmap(map, map_size);
+    if (doorbell >= 0) close(doorbell);
+    if (pipe_fds[1] >= 0) close(pipe_fds[1]);
+    return ret;
+  }
+
+  pthread_mutex_init(&ring->lock, nullptr);
+  ring->header = shared;
+  ring->map_size = map_size;
+  ring->size = size;
+  ring->head = 0;
+  ring->pid = getpid();
+  ring->doorbell = doorbell;
+  ring->alive = pipe_fds[1];
+
+  if (!logd_ring.compare_exchange_strong(old_ring, ring, std::memory_order_acq_rel)) {
+    // Another thread registered first, logd sees our pipe close and drops this one.
+    munmap(map, map_size);
+    close(doorbell);
+    close(pipe_fds[1]);
+    delete ring;
+    return 0;
+  }
+
+  // The parent's ring, inherited over fork(). Other threads only ever look at its pid, so the
+  // struct itself has to stay.
+  if (old_ring) {
+    munmap(old_ring->header, old_ring->map_size);
+    close(old_ring->doorbell);
+    close(old_ring->alive);
+  }
+  return 0;
+}
+
+int LogdWrite(log_id_t logId, struct timespec* ts, struct iovec* vec, size_t nr) {
+  ssize_t ret;
+  static const unsigned headerLength = 1;
+  struct iovec newVec[nr + headerLength];
+  android_log_header_t header;
+  size_t i, payloadSize;
+
+  GetSocket();
+
+  if (logd_socket <= 0) {
+    return -EBADF;
+  }
+
+  /* logd, after initialization and priv drop */
+  if (getuid() == AID_LOGD) {
+    /*
+     * ignore log messages we send to ourself (logd).
+     * Such log messages are often generated by libraries we depend on
+     * which use standard Android logging.
+     */
+    return 0;
+  }
+
+  header.tid = gettid();
+  header.realtime.tv_sec = ts->tv_sec;
+  header.realtime.tv_nsec = ts->tv_nsec;
+
+  newVec[0].iov_base = (unsigned char*)&header;
+  newVec[0].iov_len = sizeof(header);
 
   for (payloadSize = 0, i = headerLength; i < nr + headerLength; i++) {
     newVec[i].iov_base = vec[i - headerLength].iov_base;
@@ -161,6 +603,7 @@ int LogdWrite(log_id_t logId, struct timespec* ts, struct iovec* vec, size_t nr)
 
     if (payloadSize > LOGGER_ENTRY_MAX_PAYLOAD) {
       newVec[i].iov_len -= payloadSize - LOGGER_ENTRY_MAX_PAYLOAD;
+      payloadSize = LOGGER_ENTRY_MAX_PAYLOAD;
       if (newVec[i].iov_len) {
         ++i;
       }
@@ -168,6 +611,22 @@ int LogdWrite(log_id_t logId, struct timespec* ts, struct iovec* vec, size_t nr)
     }
   }
 
+  LogdRing* ring = logd_ring.load(std::memory_order_acquire);
+  if (ring && RingWrite(ring, logId, &header, newVec + headerLength, i - headerLength,
+                        payloadSize)) {
+    return payloadSize;
+  }
+
+  LogdBatch* batch = logd_batch.load(std::memory_order_acquire);
+  if (batch && BatchWrite(batch, logId, &header, newVec + headerLength, i - headerLength,
+                          payloadSize)) {
+    return payloadSize;
+  }
+
+  WriteDropped(&header);
+
+  header.id = logId;
+
   // The write below could be lost, but will never block.
   // EAGAIN occurs if logd is overloaded, other errors indicate that something went wrong with
   // the connection, so we reset it and try again.
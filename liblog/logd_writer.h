@@ -17,8 +17,12 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <android/log.h>
 
 int LogdWrite(log_id_t logId, struct timespec* ts, struct iovec* vec, size_t nr);
 void LogdClose();
+int LogdSetBatching(uint32_t max_delay_us, size_t max_bytes);
+void LogdFlush();
+int LogdSetRing(size_t size);
@@ -32,8 +32,12 @@ struct logger_list {
   log_time start;
   pid_t pid;
   uint32_t log_mask;
+  char* filter; /* whitespace already turned into ',' */
 };
 
+/* Longest filter logd is asked to apply, so the whole command fits logd's 1K read */
+#define LOGGER_FILTER_MAX 640
+
 // Format for a 'logger' entry: uintptr_t where only the bottom 32 bits are used.
 // bit 31: Set if this 'logger' is for logd.
 // bit 30: Set if this 'logger' is for pmsg
@@ -16,6 +16,7 @@
 
 #include "log/log_read.h"
 
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
@@ -27,6 +28,7 @@
 #include <unistd.h>
 
 #include <android/log.h>
+#include <private/android_logger.h>
 
 #include "logd_reader.h"
 #include "logger.h"
@@ -145,5 +147,31 @@ void android_logger_list_free(struct logger_list* logger_list) {
   }
 #endif
 
+  free(logger_list->filter);
   free(logger_list);
 }
+
+int __android_logger_list_set_filter(struct logger_list* logger_list, const char* filter) {
+  if (logger_list == nullptr || filter == nullptr || (logger_list->mode & ANDROID_LOG_PSTORE)) {
+    return -EINVAL;
+  }
+  if (atomic_load(&logger_list->fd) > 0) {
+    return -EBUSY;
+  }
+  size_t len = strlen(filter);
+  if (len > LOGGER_FILTER_MAX) {
+    return -E2BIG;
+  }
+
+  char* copy = strdup(filter);
+  if (!copy) {
+    return -ENOMEM;
+  }
+  // logd takes the filter as the last argument of its command, without spaces.
+  for (char* cp = copy; *cp; ++cp) {
+    if (isspace(static_cast<unsigned char>(*cp))) *cp = ',';
+  }
+  free(logger_list->filter);
+  logger_list->filter = copy;
+  return 0;
+}
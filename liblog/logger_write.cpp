@@ -180,9 +180,42 @@ void __android_log_set_aborter(__android_aborter_function aborter) {
 }
 
 void __android_log_call_aborter(const char* abort_message) {
+#ifdef __ANDROID__
+  LogdFlush();
+  PmsgFlush();
+#endif
   aborter_function(abort_message);
 }
 
+int __android_log_set_logd_batching(uint32_t max_delay_us, size_t max_bytes) {
+#ifdef __ANDROID__
+  return LogdSetBatching(max_delay_us, max_bytes);
+#else
+  UNUSED(max_delay_us);
+  UNUSED(max_bytes);
+  return -ENOTSUP;
+#endif
+}
+
+int __android_log_set_pmsg_batching(uint32_t max_delay_us, size_t max_bytes) {
+#ifdef __ANDROID__
+  return PmsgSetBatching(max_delay_us, max_bytes);
+#else
+  UNUSED(max_delay_us);
+  UNUSED(max_bytes);
+  return -ENOTSUP;
+#endif
+}
+
+int __android_log_set_logd_ring(size_t size) {
+#ifdef __ANDROID__
+  return LogdSetRing(size);
+#else
+  UNUSED(size);
+  return -ENOTSUP;
+#endif
+}
+
 #ifdef __ANDROID__
 static int write_to_log(log_id_t log_id, struct iovec* vec, size_t nr) {
   int ret;
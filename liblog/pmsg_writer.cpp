@@ -18,11 +18,16 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 
+#include <atomic>
+#include <new>
+
 #include <log/log_properties.h>
 #include <private/android_logger.h>
 
@@ -31,6 +36,17 @@
 
 static atomic_int pmsg_fd;
 
+// Kernels built without pmsg have no /dev/pmsg0.  After a failed open, wait a while before trying
+// again, rather than paying for a failing open() with every message of a burst.
+static constexpr int64_t kPmsgOpenRetryNs = 1000000000;
+static std::atomic_int64_t pmsg_open_retry_time;
+
+static int64_t MonotonicNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * INT64_C(1000000000) + ts.tv_nsec;
+}
+
 // pmsg_fd should only beopened once.  If we see that pmsg_fd is uninitialized, we open "/dev/pmsg0"
 // then attempt to compare/exchange it into pmsg_fd.  If the compare/exchange was successful, then
 // that will be the fd used for the duration of the program, otherwise a different thread has
@@ -40,8 +56,14 @@ static void GetPmsgFd() {
     return;
   }
 
+  int64_t now = MonotonicNs();
+  if (now < pmsg_open_retry_time) {
+    return;
+  }
+
   int new_fd = TEMP_FAILURE_RETRY(open("/dev/pmsg0", O_WRONLY | O_CLOEXEC));
   if (new_fd <= 0) {
+    pmsg_open_retry_time = now + kPmsgOpenRetryNs;
     return;
   }
 
@@ -52,11 +74,205 @@ static void GetPmsgFd() {
   }
 }
 
+static constexpr size_t kMaxPmsgBatchBytes = 16 * 1024;
+
+// Records held back by __android_log_set_pmsg_batching().  Each record keeps its own headers, so
+// the batch is written with a single write() in exactly the format of separate writes, and readers
+// of the pstore console see no difference.
+struct PmsgBatch {
+  pthread_mutex_t lock;
+  pthread_cond_t wakeup;
+  uint32_t max_delay_us;
+  size_t max_bytes;
+  pid_t flusher_pid;  // process the flusher thread runs in, 0 if none
+  struct timespec first;
+  size_t used;
+  unsigned char data[kMaxPmsgBatchBytes];
+};
+
+static std::atomic<PmsgBatch*> pmsg_batch;
+
+static void FlushLocked(PmsgBatch* batch) {
+  if (batch->used == 0) {
+    return;
+  }
+  // Like an unbatched write, a record that can't be written is lost.
+  if (pmsg_fd > 0) {
+    TEMP_FAILURE_RETRY(write(pmsg_fd, batch->data, batch->used));
+  }
+  batch->used = 0;
+}
+
+static void* PmsgFlusher(void* arg) {
+  PmsgBatch* batch = static_cast<PmsgBatch*>(arg);
+  pid_t pid = getpid();
+
+  pthread_mutex_lock(&batch->lock);
+  while (batch->flusher_pid == pid) {
+    if (batch->used == 0) {
+      pthread_cond_wait(&batch->wakeup, &batch->lock);
+      continue;
+    }
+    struct timespec deadline = batch->first;
+    deadline.tv_sec += batch->max_delay_us / 1000000;
+    deadline.tv_nsec += (batch->max_delay_us % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+    if (pthread_cond_timedwait(&batch->wakeup, &batch->lock, &deadline) == ETIMEDOUT) {
+      FlushLocked(batch);
+    }
+  }
+  pthread_mutex_unlock(&batch->lock);
+  return nullptr;
+}
+
+static bool StartFlusherLocked(PmsgBatch* batch) {
+  pid_t pid = getpid();
+  if (batch->flusher_pid == pid) {
+    return true;
+  }
+
+  pthread_t thread;
+  pthread_attr_t attr;
+  bool started = false;
+  if (!pthread_attr_init(&attr)) {
+    if (!pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) {
+      batch->flusher_pid = pid;
+      started = !pthread_create(&thread, &attr, PmsgFlusher, batch);
+      if (!started) {
+        batch->flusher_pid = 0;
+      }
+    }
+    pthread_attr_destroy(&attr);
+  }
+  return started;
+}
+
+// Returns false if batching is off and the caller should write the record itself.
+static bool BatchWrite(PmsgBatch* batch, const struct iovec* vec, size_t nr, size_t length,
+                       bool urgent) {
+  pthread_mutex_lock(&batch->lock);
+  if (batch->max_delay_us == 0) {
+    pthread_mutex_unlock(&batch->lock);
+    return false;
+  }
+
+  if (batch->used + length > batch->max_bytes) {
+    FlushLocked(batch);
+  }
+
+  unsigned char* data = batch->data + batch->used;
+  for (size_t v = 0; v < nr; ++v) {
+    memcpy(data, vec[v].iov_base, vec[v].iov_len);
+    data += vec[v].iov_len;
+  }
+  batch->used += length;
+
+  if (urgent || !StartFlusherLocked(batch)) {
+    FlushLocked(batch);
+  } else if (batch->used == length) {
+    clock_gettime(CLOCK_MONOTONIC, &batch->first);
+    pthread_cond_signal(&batch->wakeup);
+  }
+  pthread_mutex_unlock(&batch->lock);
+  return true;
+}
+
+static void BatchForkPrepare() {
+  pthread_mutex_lock(&pmsg_batch.load()->lock);
+}
+
+static void BatchForkParent() {
+  pthread_mutex_unlock(&pmsg_batch.load()->lock);
+}
+
+// The parent writes what is pending, the child has no flusher thread until it logs again.
+static void BatchForkChild() {
+  PmsgBatch* batch = pmsg_batch.load();
+  batch->used = 0;
+  batch->flusher_pid = 0;
+  pthread_mutex_unlock(&batch->lock);
+}
+
+static PmsgBatch* GetBatch() {
+  PmsgBatch* batch = pmsg_batch.load(std::memory_order_acquire);
+  if (batch) {
+    return batch;
+  }
+
+  PmsgBatch* new_batch = new (std::nothrow) PmsgBatch();
+  if (!new_batch) {
+    return nullptr;
+  }
+  pthread_mutex_init(&new_batch->lock, nullptr);
+  pthread_condattr_t attr;
+  pthread_condattr_init(&attr);
+  pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+  pthread_cond_init(&new_batch->wakeup, &attr);
+  pthread_condattr_destroy(&attr);
+  new_batch->max_bytes = kMaxPmsgBatchBytes;
+
+  if (!pmsg_batch.compare_exchange_strong(batch, new_batch, std::memory_order_acq_rel)) {
+    pthread_cond_destroy(&new_batch->wakeup);
+    pthread_mutex_destroy(&new_batch->lock);
+    delete new_batch;
+    return batch;
+  }
+  pthread_atfork(BatchForkPrepare, BatchForkParent, BatchForkChild);
+  return new_batch;
+}
+
+int PmsgSetBatching(uint32_t max_delay_us, size_t max_bytes) {
+  PmsgBatch* batch = pmsg_batch.load(std::memory_order_acquire);
+  if (max_delay_us == 0 && !batch) {
+    return 0;
+  }
+  if (!batch && !(batch = GetBatch())) {
+    return -ENOMEM;
+  }
+
+  // A batch must have room for at least one record of the largest payload.
+  static constexpr size_t kMinPmsgBatchBytes = sizeof(android_pmsg_log_header_t) +
+                                               sizeof(android_log_header_t) +
+                                               LOGGER_ENTRY_MAX_PAYLOAD;
+  if (max_bytes == 0 || max_bytes > kMaxPmsgBatchBytes) {
+    max_bytes = kMaxPmsgBatchBytes;
+  } else if (max_bytes < kMinPmsgBatchBytes) {
+    max_bytes = kMinPmsgBatchBytes;
+  }
+
+  pthread_mutex_lock(&batch->lock);
+  FlushLocked(batch);
+  batch->max_delay_us = max_delay_us;
+  batch->max_bytes = max_bytes;
+  if (max_delay_us == 0) {
+    // Let the flusher thread exit.
+    batch->flusher_pid = 0;
+  }
+  pthread_cond_signal(&batch->wakeup);
+  pthread_mutex_unlock(&batch->lock);
+  return 0;
+}
+
+void PmsgFlush() {
+  PmsgBatch* batch = pmsg_batch.load(std::memory_order_acquire);
+  if (!batch) {
+    return;
+  }
+  pthread_mutex_lock(&batch->lock);
+  FlushLocked(batch);
+  pthread_mutex_unlock(&batch->lock);
+}
+
 void PmsgClose() {
+  PmsgFlush();
   if (pmsg_fd > 0) {
     close(pmsg_fd);
   }
   pmsg_fd = 0;
+  pmsg_open_retry_time = 0;
 }
 
 int PmsgWrite(log_id_t logId, struct timespec* ts, struct iovec* vec, size_t nr) {
@@ -139,9 +355,18 @@ int PmsgWrite(log_id_t logId, struct timespec* ts, struct iovec* vec, size_t nr)
   }
   pmsgHeader.len += payloadSize;
 
-  ret = TEMP_FAILURE_RETRY(writev(pmsg_fd, newVec, i));
-  if (ret < 0) {
-    ret = errno ? -errno : -ENOTCONN;
+  // A fatal message is written right away, as the process is about to go.
+  bool urgent = logId != LOG_ID_EVENTS && logId != LOG_ID_STATS && logId != LOG_ID_SECURITY &&
+                nr > 0 && vec[0].iov_len > 0 &&
+                *static_cast<const unsigned char*>(vec[0].iov_base) >= ANDROID_LOG_FATAL;
+  PmsgBatch* batch = pmsg_batch.load(std::memory_order_acquire);
+  if (batch && BatchWrite(batch, newVec, i, pmsgHeader.len, urgent)) {
+    ret = pmsgHeader.len;
+  } else {
+    ret = TEMP_FAILURE_RETRY(writev(pmsg_fd, newVec, i));
+    if (ret < 0) {
+      ret = errno ? -errno : -ENOTCONN;
+    }
   }
 
   if (ret > (ssize_t)(sizeof(header) + sizeof(pmsgHeader))) {
@@ -17,8 +17,11 @@
 #pragma once
 
 #include <stddef.h>
+#include <stdint.h>
 
 #include <android/log.h>
 
 int PmsgWrite(log_id_t logId, struct timespec* ts, struct iovec* vec, size_t nr);
 void PmsgClose();
+int PmsgSetBatching(uint32_t max_delay_us, size_t max_bytes);
+void PmsgFlush();
@@ -23,6 +23,7 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
 
 #include <private/android_logger.h>
 
@@ -273,9 +274,82 @@ static int __android_log_level(const char* tag, size_t len) {
   return -1;
 }
 
+/*
+ * Lock free cache in front of __android_log_level(). Any property change bumps
+ * the property area serial, so a level computed under the current area serial
+ * is still good and the common case costs one atomic load and a seqlock read.
+ * Each slot is a seqlock and readers never retry, a torn or mismatched slot just
+ * falls back to __android_log_level(). Tags longer than the slot are not cached.
+ */
+#define LEVEL_CACHE_SIZE 64
+#define LEVEL_CACHE_TAG_WORDS 4
+
+struct level_cache_slot {
+  std::atomic<uint32_t> seq; /* odd while being written, 0 if never written */
+  std::atomic<uint32_t> area_serial;
+  std::atomic<uint32_t> len;
+  std::atomic<int32_t> level;
+  std::atomic<uint64_t> tag[LEVEL_CACHE_TAG_WORDS];
+};
+
+static struct level_cache_slot level_cache[LEVEL_CACHE_SIZE];
+
+static int __android_log_level_cached(const char* tag, size_t len) {
+  if (tag == nullptr || len == 0) {
+    auto& tag_string = GetDefaultTag();
+    tag = tag_string.c_str();
+    len = tag_string.size();
+  }
+  if (len > sizeof(level_cache[0].tag)) {
+    return __android_log_level(tag, len);
+  }
+
+  uint64_t words[LEVEL_CACHE_TAG_WORDS] = {};
+  memcpy(words, tag, len);
+  uint32_t hash = 2166136261u; /* FNV-1a */
+  for (size_t i = 0; i < len; ++i) {
+    hash = (hash ^ static_cast<unsigned char>(tag[i])) * 16777619u;
+  }
+  struct level_cache_slot* slot = &level_cache[hash % LEVEL_CACHE_SIZE];
+
+  /* read before computing, so a change racing with us invalidates the slot */
+  uint32_t area_serial = __system_property_area_serial();
+
+  uint32_t seq = slot->seq.load(std::memory_order_acquire);
+  if (seq && !(seq & 1)) {
+    bool match = slot->area_serial.load(std::memory_order_relaxed) == area_serial &&
+                 slot->len.load(std::memory_order_relaxed) == len;
+    for (size_t i = 0; i < LEVEL_CACHE_TAG_WORDS; ++i) {
+      match &= slot->tag[i].load(std::memory_order_relaxed) == words[i];
+    }
+    int level = slot->level.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (match && slot->seq.load(std::memory_order_relaxed) == seq) {
+      return level;
+    }
+  }
+
+  int level = __android_log_level(tag, len);
+
+  /* Publish unless another writer, possibly a signal handler, holds the slot. */
+  seq = slot->seq.load(std::memory_order_relaxed);
+  if (!(seq & 1) &&
+      slot->seq.compare_exchange_strong(seq, seq + 1, std::memory_order_relaxed)) {
+    std::atomic_thread_fence(std::memory_order_release);
+    slot->area_serial.store(area_serial, std::memory_order_relaxed);
+    slot->len.store(len, std::memory_order_relaxed);
+    for (size_t i = 0; i < LEVEL_CACHE_TAG_WORDS; ++i) {
+      slot->tag[i].store(words[i], std::memory_order_relaxed);
+    }
+    slot->level.store(level, std::memory_order_relaxed);
+    slot->seq.store(seq + 2, std::memory_order_release);
+  }
+  return level;
+}
+
 int __android_log_is_loggable_len(int prio, const char* tag, size_t len, int default_prio) {
   int minimum_log_priority = __android_log_get_minimum_priority();
-  int property_log_level = __android_log_level(tag, len);
+  int property_log_level = __android_log_level_cached(tag, len);
 
   if (property_log_level >= 0 && minimum_log_priority != ANDROID_LOG_DEFAULT) {
     return prio >= std::min(property_log_level, minimum_log_priority);
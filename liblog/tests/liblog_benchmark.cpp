@@ -30,6 +30,7 @@
 #include <benchmark/benchmark.h>
 #include <cutils/sockets.h>
 #include <log/event_tag_map.h>
+#include <log/log_event_list.h>
 #include <private/android_logger.h>
 
 BENCHMARK_MAIN();
@@ -603,6 +604,32 @@ static void BM_log_event_overhead_42(benchmark::State& state) {
 }
 BENCHMARK(BM_log_event_overhead_42);
 
+/*
+ *	Measure the time it takes to compose a three element event with
+ * android_log_event_list, without submitting it.
+ */
+static void BM_log_event_list_compose(benchmark::State& state) {
+  for (int64_t i = 0; state.KeepRunning(); ++i) {
+    android_log_event_list list(42);
+    list << static_cast<int32_t>(i) << i << 0.5f;
+    const char* buffer;
+    benchmark::DoNotOptimize(android_log_write_list_buffer(list, &buffer));
+  }
+}
+BENCHMARK(BM_log_event_list_compose);
+
+/*
+ *	Measure the time it takes to compose the same event with
+ * android_log_event_tuple, without submitting it.
+ */
+static void BM_log_event_tuple_compose(benchmark::State& state) {
+  for (int64_t i = 0; state.KeepRunning(); ++i) {
+    android_log_event_tuple tuple(42, static_cast<int32_t>(i), i, 0.5f);
+    benchmark::DoNotOptimize(tuple.data());
+  }
+}
+BENCHMARK(BM_log_event_tuple_compose);
+
 /*
  *	Measure the time it takes to submit the android event logging call
  * using discrete acquisition under very-light load (<1% CPU utilization).
@@ -791,6 +818,21 @@ static void BM_is_loggable(benchmark::State& state) {
 }
 BENCHMARK(BM_is_loggable);
 
+/*
+ *	Measure __android_log_is_loggable for a suppressed ALOGV from many
+ * threads at once, a few distinct tags between them.
+ */
+static void BM_is_loggable_contended(benchmark::State& state) {
+  static const char* const tags[] = {"logd", "liblog", "ActivityManager", "libc"};
+  const char* tag = tags[state.thread_index % (sizeof(tags) / sizeof(tags[0]))];
+  size_t len = strlen(tag);
+
+  while (state.KeepRunning()) {
+    __android_log_is_loggable_len(ANDROID_LOG_VERBOSE, tag, len, ANDROID_LOG_INFO);
+  }
+}
+BENCHMARK(BM_is_loggable_contended)->ThreadRange(1, 16);
+
 /*
  *	Measure the time it takes for android_log_clockid.
  */
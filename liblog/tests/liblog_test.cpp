@@ -42,6 +42,7 @@
 #include <log/log_properties.h>
 #include <log/logprint.h>
 #include <private/android_filesystem_config.h>
+#include <private/android_log_ring.h>
 #include <private/android_logger.h>
 
 using android::base::make_scope_guard;
@@ -330,6 +331,188 @@ TEST(liblog, __android_log_write__android_logger_list_read) {
 #endif
 }
 
+TEST(liblog, __android_log_set_logd_batching) {
+#ifdef __ANDROID__
+  pid_t pid = getpid();
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  std::string buf = android::base::StringPrintf("pid=%u ts=%ld.%09ld", pid, ts.tv_sec, ts.tv_nsec);
+  static const char tag[] = "liblog.__android_log_set_logd_batching";
+  static const char prio = ANDROID_LOG_DEBUG;
+
+  std::string expected_message =
+      std::string(&prio, sizeof(prio)) + tag + std::string("", 1) + buf + std::string("", 1);
+
+  // Turning batching off must flush what it held back.
+  auto write_function = [&] {
+    ASSERT_EQ(0, __android_log_set_logd_batching(60 * 1000 * 1000, 0));
+    ASSERT_LT(0, __android_log_write(prio, tag, buf.c_str()));
+    ASSERT_EQ(0, __android_log_set_logd_batching(0, 0));
+  };
+
+  auto check_function = [&](log_msg log_msg, bool* found) {
+    if (log_msg.entry.len != expected_message.length()) {
+      return;
+    }
+
+    if (expected_message != std::string(log_msg.msg(), log_msg.entry.len)) {
+      return;
+    }
+
+    *found = true;
+  };
+
+  RunLogTests(LOG_ID_MAIN, write_function, check_function);
+
+#else
+  GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
+}
+
+TEST(liblog, __android_log_set_logd_batching_error) {
+#ifdef __ANDROID__
+  pid_t pid = getpid();
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  std::string buf = android::base::StringPrintf("pid=%u ts=%ld.%09ld", pid, ts.tv_sec, ts.tv_nsec);
+  static const char tag[] = "liblog.__android_log_set_logd_batching_error";
+  static const char prio = ANDROID_LOG_ERROR;
+
+  std::string expected_message =
+      std::string(&prio, sizeof(prio)) + tag + std::string("", 1) + buf + std::string("", 1);
+
+  // Errors are sent right away, well before the 10s delay or RunLogTests()' alarm.
+  auto write_function = [&] {
+    ASSERT_EQ(0, __android_log_set_logd_batching(10 * 1000 * 1000, 0));
+    ASSERT_LT(0, __android_log_write(prio, tag, buf.c_str()));
+  };
+  auto disable_guard =
+      android::base::make_scope_guard([] { __android_log_set_logd_batching(0, 0); });
+
+  auto check_function = [&](log_msg log_msg, bool* found) {
+    if (log_msg.entry.len != expected_message.length()) {
+      return;
+    }
+
+    if (expected_message != std::string(log_msg.msg(), log_msg.entry.len)) {
+      return;
+    }
+
+    *found = true;
+  };
+
+  RunLogTests(LOG_ID_MAIN, write_function, check_function);
+
+#else
+  GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
+}
+
+TEST(liblog, __android_log_set_pmsg_batching) {
+#ifdef __ANDROID__
+  // What reaches pmsg can only be read back after a reboot, so this only covers turning batching
+  // on and off around a write, and that it is idempotent.
+  EXPECT_EQ(0, __android_log_set_pmsg_batching(0, 0));
+  ASSERT_EQ(0, __android_log_set_pmsg_batching(1000 * 1000, 0));
+  auto disable_guard =
+      android::base::make_scope_guard([] { __android_log_set_pmsg_batching(0, 0); });
+  EXPECT_EQ(0, __android_log_set_pmsg_batching(1000 * 1000, 1));
+  EXPECT_LT(0, __android_log_write(ANDROID_LOG_DEBUG, "liblog.__android_log_set_pmsg_batching",
+                                   "pmsg batching"));
+  EXPECT_EQ(0, __android_log_set_pmsg_batching(0, 0));
+  EXPECT_EQ(0, __android_log_set_pmsg_batching(0, 0));
+#else
+  EXPECT_EQ(-ENOTSUP, __android_log_set_pmsg_batching(1000 * 1000, 0));
+#endif
+}
+
+TEST(liblog, __android_log_set_logd_ring) {
+#ifdef __ANDROID__
+  pid_t pid = getpid();
+
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  std::string buf = android::base::StringPrintf("pid=%u ts=%ld.%09ld", pid, ts.tv_sec, ts.tv_nsec);
+  static const char tag[] = "liblog.__android_log_set_logd_ring";
+  static const char prio = ANDROID_LOG_DEBUG;
+
+  std::string expected_message =
+      std::string(&prio, sizeof(prio)) + tag + std::string("", 1) + buf + std::string("", 1);
+
+  EXPECT_EQ(-EINVAL, __android_log_set_logd_ring(LOG_RING_MIN_SIZE + 1));
+
+  // Whether or not logd takes the ring, the message must arrive exactly once.
+  auto write_function = [&] {
+    ASSERT_EQ(0, __android_log_set_logd_ring(0));
+    ASSERT_LT(0, __android_log_write(prio, tag, buf.c_str()));
+  };
+
+  auto check_function = [&](log_msg log_msg, bool* found) {
+    if (log_msg.entry.len != expected_message.length()) {
+      return;
+    }
+
+    if (expected_message != std::string(log_msg.msg(), log_msg.entry.len)) {
+      return;
+    }
+
+    *found = true;
+  };
+
+  RunLogTests(LOG_ID_MAIN, write_function, check_function);
+
+#else
+  GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
+}
+
+TEST(liblog, __android_logger_list_set_filter) {
+#ifdef __ANDROID__
+  pid_t pid = getpid();
+  static const char tag[] = "liblog.set_filter";
+  static const char other_tag[] = "liblog.set_filter_other";
+
+  auto logger_list = std::unique_ptr<struct logger_list, ListCloser>{
+      android_logger_list_open(LOG_ID_MAIN, ANDROID_LOG_RDONLY | ANDROID_LOG_NONBLOCK, 1000, pid)};
+  ASSERT_TRUE(logger_list);
+  EXPECT_EQ(-EINVAL, __android_logger_list_set_filter(logger_list.get(), nullptr));
+  EXPECT_EQ(-E2BIG, __android_logger_list_set_filter(logger_list.get(),
+                                                     std::string(1024, 'x').c_str()));
+  ASSERT_EQ(0, __android_logger_list_set_filter(logger_list.get(), "liblog.set_filter:W *:S"));
+
+  ASSERT_LT(0, __android_log_write(ANDROID_LOG_WARN, tag, "sent"));
+  ASSERT_LT(0, __android_log_write(ANDROID_LOG_INFO, tag, "below the filter"));
+  ASSERT_LT(0, __android_log_write(ANDROID_LOG_ERROR, other_tag, "silenced"));
+  usleep(1000000);
+
+  size_t count = 0;
+  while (true) {
+    log_msg log_msg;
+    auto ret = android_logger_list_read(logger_list.get(), &log_msg);
+    if (ret == -EAGAIN) {
+      break;
+    }
+    ASSERT_GT(ret, 0);
+    if (log_msg.entry.len < 2) {
+      continue;
+    }
+    // Anything logd lets through must pass the filter.
+    std::string msg_tag(log_msg.msg() + 1);
+    EXPECT_EQ(tag, msg_tag);
+    EXPECT_LE(ANDROID_LOG_WARN, log_msg.msg()[0]);
+    if (msg_tag == tag) ++count;
+  }
+  EXPECT_LE(1U, count);
+
+  EXPECT_EQ(-EBUSY, __android_logger_list_set_filter(logger_list.get(), "*:V"));
+
+#else
+  GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
+}
+
 static void bswrite_test(const char* message) {
 #ifdef __ANDROID__
   pid_t pid = getpid();
@@ -2645,6 +2828,27 @@ TEST(liblog, create_android_logger_overflow) {
   ASSERT_TRUE(NULL == ctx);
 }
 
+template <typename... Ts>
+static void compare_android_log_event_tuple(Ts... values) {
+  android_log_event_list list(1005);
+  (void)(list << ... << values);
+  const char* expected;
+  int len = android_log_write_list_buffer(list, &expected);
+  ASSERT_LE(0, len);
+
+  android_log_event_tuple tuple(1005, values...);
+  ASSERT_EQ(static_cast<size_t>(len), tuple.size());
+  EXPECT_EQ(0, memcmp(expected, tuple.data(), len));
+}
+
+TEST(liblog, android_log_event_tuple) {
+  compare_android_log_event_tuple();
+  compare_android_log_event_tuple(42);
+  compare_android_log_event_tuple(INT64_C(-42));
+  compare_android_log_event_tuple(1.5f);
+  compare_android_log_event_tuple(getpid(), getuid(), true, UINT64_MAX, 0.25f, INT32_MIN);
+}
+
 #ifdef ENABLE_FLAKY_TESTS
 #ifdef __ANDROID__
 #ifndef NO_PSTORE
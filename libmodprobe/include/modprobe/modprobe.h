@@ -16,8 +16,10 @@
 
 #pragma once
 
+#include <mutex>
 #include <set>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -27,6 +29,11 @@ class Modprobe {
     Modprobe(const std::vector<std::string>&, const std::string load_file = "modules.load");
 
     bool LoadListedModules(bool strict = true);
+    // Loads the same modules as LoadListedModules(), with up to num_threads of them being loaded
+    // at once.  A module is only loaded once its dependencies and soft pre-dependencies have
+    // been, and before its soft post-dependencies.  With strict, a module that fails to load
+    // stops any further modules from being started.
+    bool LoadModulesParallel(int num_threads, bool strict = true);
     bool LoadWithAliases(const std::string& module_name, bool strict,
                          const std::string& parameters = "");
     bool Remove(const std::string& module_name);
@@ -40,7 +47,13 @@ class Modprobe {
     void EnableVerbose(bool enable);
 
   private:
+    struct LoadGraph;
+
     std::string MakeCanonical(const std::string& module_path);
+    std::set<std::string> ExpandAliases(const std::string& module_name);
+    bool AddToLoadGraph(const std::string& module_name, bool strict, LoadGraph* graph,
+                        std::vector<size_t>* nodes);
+    size_t AddModuleToLoadGraph(const std::string& module, LoadGraph* graph);
     bool InsmodWithDeps(const std::string& module_name, const std::string& parameters);
     bool Insmod(const std::string& path_name, const std::string& parameters);
     bool Rmmod(const std::string& module_name);
@@ -60,6 +73,8 @@ class Modprobe {
     void ParseCfg(const std::string& cfg, std::function<bool(const std::vector<std::string>&)> f);
 
     std::vector<std::pair<std::string, std::string>> module_aliases_;
+    // Index into module_aliases_ by the literal prefix of their patterns.
+    std::unordered_multimap<std::string_view, size_t> alias_prefixes_;
     std::unordered_map<std::string, std::vector<std::string>> module_deps_;
     std::vector<std::pair<std::string, std::string>> module_pre_softdep_;
     std::vector<std::pair<std::string, std::string>> module_post_softdep_;
@@ -68,5 +83,7 @@ class Modprobe {
     std::set<std::string> module_blocklist_;
     std::unordered_set<std::string> module_loaded_;
     int module_count_ = 0;
+    // Guards module_loaded_ and module_count_ in Insmod() while loading in parallel.
+    std::mutex module_loaded_lock_;
     bool blocklist_enabled = false;
 };
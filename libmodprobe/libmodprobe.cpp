@@ -21,8 +21,13 @@
 #include <sys/syscall.h>
 
 #include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <set>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #include <android-base/chrono_utils.h>
@@ -226,13 +231,30 @@ void Modprobe::ParseCfg(const std::string& cfg,
         return;
     }
 
-    std::vector<std::string> lines = android::base::Split(cfg_contents, "\n");
-    for (const std::string line : lines) {
+    // Split into lines and then words in place, reusing the strings in args from line to line;
+    // modules.alias alone runs into the tens of thousands of lines.
+    std::vector<std::string> args;
+    std::string_view contents(cfg_contents);
+    while (!contents.empty()) {
+        auto end = contents.find('\n');
+        auto line = contents.substr(0, end);
+        contents.remove_prefix(end == std::string_view::npos ? contents.size() : end + 1);
         if (line.empty() || line[0] == '#') {
             continue;
         }
-        const std::vector<std::string> args = android::base::Split(line, " ");
-        if (args.empty()) continue;
+        size_t count = 0;
+        for (size_t start = 0;; ++count) {
+            auto space = line.find(' ', start);
+            auto word = line.substr(start, space == std::string_view::npos ? space : space - start);
+            if (count == args.size()) {
+                args.emplace_back(word);
+            } else {
+                args[count].assign(word);
+            }
+            if (space == std::string_view::npos) break;
+            start = space + 1;
+        }
+        args.resize(count + 1);
         f(args);
     }
     return;
@@ -335,6 +357,14 @@ Modprobe::Modprobe(const std::vector<std::string>& base_paths, const std::string
         ParseCfg(base_path + "/modules.blocklist", blocklist_callback);
     }
 
+    // Index the aliases by the part of their pattern before the first wildcard.
+    // module_aliases_ no longer changes, so the views stay valid.
+    alias_prefixes_.reserve(module_aliases_.size());
+    for (size_t i = 0; i < module_aliases_.size(); ++i) {
+        std::string_view alias = module_aliases_[i].first;
+        alias_prefixes_.emplace(alias.substr(0, alias.find_first_of("*?[\\")), i);
+    }
+
     ParseKernelCmdlineOptions();
     android::base::SetMinimumLogSeverity(android::base::INFO);
 }
@@ -403,6 +433,26 @@ bool Modprobe::InsmodWithDeps(const std::string& module_name, const std::string&
     return true;
 }
 
+std::set<std::string> Modprobe::ExpandAliases(const std::string& module_name) {
+    std::set<std::string> modules_to_load = {MakeCanonical(module_name)};
+
+    // use aliases to expand list of modules to load (multiple modules
+    // may alias themselves to the requested name).  Only the aliases
+    // whose literal prefix is a prefix of the name can match.
+    for (size_t length = 0; length <= module_name.size(); ++length) {
+        std::string_view prefix(module_name.data(), length);
+        auto [begin, end] = alias_prefixes_.equal_range(prefix);
+        for (auto it = begin; it != end; ++it) {
+            const auto& [alias, aliased_module] = module_aliases_[it->second];
+            if (fnmatch(alias.c_str(), module_name.c_str(), 0) != 0) continue;
+            LOG(VERBOSE) << "Found alias for '" << module_name << "': '" << aliased_module;
+            if (module_loaded_.count(MakeCanonical(aliased_module))) continue;
+            modules_to_load.emplace(aliased_module);
+        }
+    }
+    return modules_to_load;
+}
+
 bool Modprobe::LoadWithAliases(const std::string& module_name, bool strict,
                                const std::string& parameters) {
     auto canonical_name = MakeCanonical(module_name);
@@ -410,20 +460,10 @@ bool Modprobe::LoadWithAliases(const std::string& module_name, bool strict,
         return true;
     }
 
-    std::set<std::string> modules_to_load = {canonical_name};
     bool module_loaded = false;
 
-    // use aliases to expand list of modules to load (multiple modules
-    // may alias themselves to the requested name)
-    for (const auto& [alias, aliased_module] : module_aliases_) {
-        if (fnmatch(alias.c_str(), module_name.c_str(), 0) != 0) continue;
-        LOG(VERBOSE) << "Found alias for '" << module_name << "': '" << aliased_module;
-        if (module_loaded_.count(MakeCanonical(aliased_module))) continue;
-        modules_to_load.emplace(aliased_module);
-    }
-
     // attempt to load all modules aliased to this name
-    for (const auto& module : modules_to_load) {
+    for (const auto& module : ExpandAliases(module_name)) {
         if (!ModuleExists(module)) continue;
         if (InsmodWithDeps(module, parameters)) module_loaded = true;
     }
@@ -446,6 +486,201 @@ bool Modprobe::LoadListedModules(bool strict) {
     return ret;
 }
 
+// The modules LoadModulesParallel() is going to load, each one a node waiting for its
+// dependencies to be loaded.
+struct Modprobe::LoadGraph {
+    struct Node {
+        std::string path;
+        std::vector<size_t> hard_dependencies;
+        // Nodes waiting for this one, and whether it is a hard dependency of theirs.
+        std::vector<std::pair<size_t, bool>> dependents;
+        size_t pending = 0;     // dependencies not loaded or given up on yet
+        bool required = false;  // failing to load it fails a listed module
+        bool doomed = false;    // a hard dependency could not be loaded
+        bool loaded = false;
+    };
+    std::vector<Node> nodes;
+    std::unordered_map<std::string, size_t> index;
+};
+
+// Adds the modules LoadWithAliases() would load for module_name to the graph, and returns their
+// nodes.
+bool Modprobe::AddToLoadGraph(const std::string& module_name, bool strict, LoadGraph* graph,
+                              std::vector<size_t>* nodes) {
+    if (module_loaded_.count(MakeCanonical(module_name))) {
+        return true;
+    }
+    for (const auto& module : ExpandAliases(module_name)) {
+        if (!ModuleExists(module)) continue;
+        nodes->emplace_back(AddModuleToLoadGraph(module, graph));
+    }
+    if (strict && nodes->empty()) {
+        LOG(ERROR) << "LoadModulesParallel was unable to load " << module_name;
+        return false;
+    }
+    return true;
+}
+
+// Adds a node for the module along with everything InsmodWithDeps() would load with it.
+size_t Modprobe::AddModuleToLoadGraph(const std::string& module, LoadGraph* graph) {
+    auto it = graph->index.find(module);
+    if (it != graph->index.end()) {
+        return it->second;
+    }
+    // Nodes are only referred to by index, the vector grows as dependencies are added.
+    auto node = graph->nodes.size();
+    graph->index.emplace(module, node);
+    graph->nodes.emplace_back();
+
+    auto depend = [graph](size_t dependency, size_t dependent, bool hard) {
+        graph->nodes[dependency].dependents.emplace_back(dependent, hard);
+        graph->nodes[dependent].pending++;
+        if (hard) graph->nodes[dependent].hard_dependencies.emplace_back(dependency);
+    };
+
+    auto dependencies = GetDependencies(module);
+    graph->nodes[node].path = dependencies[0];
+    for (auto dep = dependencies.begin() + 1; dep != dependencies.end(); ++dep) {
+        std::vector<size_t> nodes;
+        if (!AddToLoadGraph(*dep, true, graph, &nodes)) {
+            graph->nodes[node].doomed = true;
+        }
+        for (auto dependency : nodes) depend(dependency, node, true);
+    }
+    for (const auto& [it_module, softdep] : module_pre_softdep_) {
+        if (module != it_module) continue;
+        std::vector<size_t> nodes;
+        AddToLoadGraph(softdep, false, graph, &nodes);
+        for (auto dependency : nodes) depend(dependency, node, false);
+    }
+    for (const auto& [it_module, softdep] : module_post_softdep_) {
+        if (module != it_module) continue;
+        std::vector<size_t> nodes;
+        AddToLoadGraph(softdep, false, graph, &nodes);
+        for (auto dependent : nodes) depend(node, dependent, false);
+    }
+    return node;
+}
+
+bool Modprobe::LoadModulesParallel(int num_threads, bool strict) {
+    android::base::Timer t;
+    LoadGraph graph;
+    std::vector<std::pair<std::string, std::vector<size_t>>> listed;
+    auto ret = true;
+    for (const auto& module : module_load_) {
+        std::vector<size_t> nodes;
+        if (!AddToLoadGraph(module, true, &graph, &nodes)) {
+            ret = false;
+            if (strict) break;
+        }
+        listed.emplace_back(module, std::move(nodes));
+    }
+
+    // Soft dependencies may fail to load, hard dependencies of listed modules may not.
+    std::vector<size_t> required;
+    for (const auto& [module, nodes] : listed) {
+        required.insert(required.end(), nodes.begin(), nodes.end());
+    }
+    while (!required.empty()) {
+        auto& node = graph.nodes[required.back()];
+        required.pop_back();
+        if (node.required) continue;
+        node.required = true;
+        required.insert(required.end(), node.hard_dependencies.begin(),
+                        node.hard_dependencies.end());
+    }
+
+    std::mutex lock;
+    std::condition_variable cv;
+    std::deque<size_t> ready;
+    size_t running = 0;
+    bool failed = false;
+
+    // Called with lock held once a node is loaded or given up on.
+    auto finish = [&](size_t node) {
+        std::vector<size_t> done = {node};
+        while (!done.empty()) {
+            auto& n = graph.nodes[done.back()];
+            done.pop_back();
+            if (!n.loaded && n.required && strict) failed = true;
+            for (const auto& [dependent, hard] : n.dependents) {
+                auto& d = graph.nodes[dependent];
+                if (hard && !n.loaded) d.doomed = true;
+                if (--d.pending != 0) continue;
+                if (d.doomed) {
+                    done.emplace_back(dependent);
+                } else {
+                    ready.emplace_back(dependent);
+                }
+            }
+        }
+    };
+
+    for (size_t node = 0; node < graph.nodes.size(); ++node) {
+        if (graph.nodes[node].pending != 0) continue;
+        if (graph.nodes[node].doomed) {
+            finish(node);
+        } else {
+            ready.emplace_back(node);
+        }
+    }
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> guard(lock);
+        while (true) {
+            cv.wait(guard, [&] { return !ready.empty() || failed || running == 0; });
+            if (failed || ready.empty()) break;
+            auto node = ready.front();
+            ready.pop_front();
+            running++;
+            guard.unlock();
+            auto loaded = Insmod(graph.nodes[node].path, "");
+            guard.lock();
+            running--;
+            graph.nodes[node].loaded = loaded;
+            finish(node);
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < num_threads; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    if (failed) {
+        return false;
+    }
+    size_t loaded = 0;
+    size_t given_up = 0;
+    for (const auto& node : graph.nodes) {
+        if (node.loaded) loaded++;
+        if (!node.loaded && node.pending == 0) given_up++;
+    }
+    if (loaded + given_up != graph.nodes.size()) {
+        // Soft dependencies that form a cycle never become ready, leave them to the serial
+        // loader, which skips everything that is already loaded.
+        LOG(WARNING) << "Module dependency cycle, loading the remaining "
+                     << graph.nodes.size() - loaded - given_up << " modules serially";
+        return LoadListedModules(strict) && ret;
+    }
+    for (const auto& [module, nodes] : listed) {
+        if (nodes.empty()) continue;
+        if (std::none_of(nodes.begin(), nodes.end(),
+                         [&](size_t node) { return graph.nodes[node].loaded; })) {
+            LOG(ERROR) << "LoadModulesParallel was unable to load " << module;
+            ret = false;
+        }
+    }
+    LOG(INFO) << "Loaded " << loaded << " modules on " << std::max(num_threads, 1)
+              << " threads in " << t;
+    return ret;
+}
+
 bool Modprobe::Remove(const std::string& module_name) {
     auto dependencies = GetDependencies(MakeCanonical(module_name));
     if (dependencies.empty()) {
@@ -17,6 +17,7 @@
 #include <sys/stat.h>
 #include <sys/syscall.h>
 
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -34,6 +35,7 @@ std::string Modprobe::GetKernelCmdline(void) {
 }
 
 bool Modprobe::Insmod(const std::string& path_name, const std::string& parameters) {
+    std::lock_guard<std::mutex> guard(module_loaded_lock_);
     auto deps = GetDependencies(MakeCanonical(path_name));
     if (deps.empty()) {
         return false;
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <algorithm>
 #include <functional>
 
 #include <android-base/file.h>
@@ -179,3 +180,117 @@ TEST(libmodprobe, Test) {
     m.EnableBlocklist(true);
     EXPECT_FALSE(m.LoadWithAliases("test4", true));
 }
+
+TEST(libmodprobe, LoadModulesParallel) {
+    kernel_cmdline = "";
+    modules_loaded.clear();
+    test_modules = {
+            "/mod_a.ko", "/mod_b.ko", "/mod_c.ko", "/mod_d.ko", "/mod_e.ko",
+            "/mod_f.ko", "/mod_g.ko", "/mod_h.ko", "/mod_i.ko",
+    };
+
+    const std::string modules_dep =
+            "mod_a.ko:\n"
+            "mod_b.ko: mod_a.ko\n"
+            "mod_c.ko: mod_b.ko mod_a.ko\n"
+            "mod_d.ko:\n"
+            "mod_e.ko:\n"
+            "mod_f.ko:\n"
+            "mod_g.ko:\n"
+            "mod_h.ko: mod_g.ko\n"
+            "mod_i.ko:\n";
+
+    const std::string modules_softdep = "softdep mod_d pre: mod_e post: mod_f\n";
+
+    const std::string modules_blocklist = "blocklist mod_g.ko\n";
+
+    const std::string modules_load =
+            "mod_c.ko\n"
+            "mod_h.ko\n"
+            "mod_d.ko\n"
+            "mod_i.ko\n";
+
+    TemporaryDir dir;
+    auto dir_path = std::string(dir.path);
+    ASSERT_TRUE(android::base::WriteStringToFile(modules_dep, dir_path + "/modules.dep", 0600,
+                                                 getuid(), getgid()));
+    ASSERT_TRUE(android::base::WriteStringToFile(modules_softdep, dir_path + "/modules.softdep",
+                                                 0600, getuid(), getgid()));
+    ASSERT_TRUE(android::base::WriteStringToFile(modules_load, dir_path + "/modules.load", 0600,
+                                                 getuid(), getgid()));
+    ASSERT_TRUE(android::base::WriteStringToFile(modules_blocklist, dir_path + "/modules.blocklist",
+                                                 0600, getuid(), getgid()));
+
+    for (auto i = test_modules.begin(); i != test_modules.end(); ++i) {
+        *i = dir.path + *i;
+    }
+    auto position = [&](const std::string& module) {
+        auto it = std::find(modules_loaded.begin(), modules_loaded.end(), dir_path + module);
+        return it - modules_loaded.begin();
+    };
+
+    Modprobe m({dir.path});
+    EXPECT_TRUE(m.LoadModulesParallel(4));
+    ASSERT_EQ(9U, modules_loaded.size());
+    EXPECT_LT(position("/mod_a.ko"), position("/mod_b.ko"));
+    EXPECT_LT(position("/mod_b.ko"), position("/mod_c.ko"));
+    EXPECT_LT(position("/mod_g.ko"), position("/mod_h.ko"));
+    EXPECT_LT(position("/mod_e.ko"), position("/mod_d.ko"));
+    EXPECT_LT(position("/mod_d.ko"), position("/mod_f.ko"));
+    EXPECT_EQ(9, m.GetModuleCount());
+
+    // mod_h.ko can not be loaded without its blocklisted dependency, the rest still is.
+    modules_loaded.clear();
+    Modprobe blocklisted({dir.path});
+    blocklisted.EnableBlocklist(true);
+    EXPECT_FALSE(blocklisted.LoadModulesParallel(4, false));
+    EXPECT_EQ(7U, modules_loaded.size());
+    EXPECT_EQ(modules_loaded.end(),
+              std::find(modules_loaded.begin(), modules_loaded.end(), dir_path + "/mod_h.ko"));
+}
+
+TEST(libmodprobe, AliasPatterns) {
+    kernel_cmdline = "";
+    modules_loaded.clear();
+    test_modules = {"/mod_pci.ko", "/mod_dev.ko", "/mod_usb.ko", "/mod_any.ko", "/mod_set.ko"};
+
+    const std::string modules_dep =
+            "mod_pci.ko:\n"
+            "mod_dev.ko:\n"
+            "mod_usb.ko:\n"
+            "mod_any.ko:\n"
+            "mod_set.ko:\n";
+
+    const std::string modules_alias =
+            "alias pci:v00008086d* mod_pci\n"
+            "alias pci:v*d00001234* mod_dev\n"
+            "alias usb:v1234p* mod_usb\n"
+            "alias *:serial mod_any\n"
+            "alias pci:v0000808[67]d00001234 mod_set\n";
+
+    TemporaryDir dir;
+    auto dir_path = std::string(dir.path);
+    ASSERT_TRUE(android::base::WriteStringToFile(modules_dep, dir_path + "/modules.dep", 0600,
+                                                 getuid(), getgid()));
+    ASSERT_TRUE(android::base::WriteStringToFile(modules_alias, dir_path + "/modules.alias", 0600,
+                                                 getuid(), getgid()));
+    for (auto i = test_modules.begin(); i != test_modules.end(); ++i) {
+        *i = dir.path + *i;
+    }
+
+    Modprobe m({dir.path});
+    EXPECT_TRUE(m.LoadWithAliases("pci:v00008086d00001234", true));
+    std::sort(modules_loaded.begin(), modules_loaded.end());
+    std::vector<std::string> expected = {dir_path + "/mod_dev.ko", dir_path + "/mod_pci.ko",
+                                         dir_path + "/mod_set.ko"};
+    EXPECT_EQ(expected, modules_loaded);
+
+    modules_loaded.clear();
+    EXPECT_TRUE(m.LoadWithAliases("usb:serial", true));
+    expected = {dir_path + "/mod_any.ko"};
+    EXPECT_EQ(expected, modules_loaded);
+
+    modules_loaded.clear();
+    EXPECT_FALSE(m.LoadWithAliases("usb:v4321p0001", true));
+    EXPECT_TRUE(modules_loaded.empty());
+}
@@ -75,6 +75,27 @@ bool packagelist_parse(bool (*callback)(pkg_info* info, void* user_data), void*
 bool packagelist_parse_file(const char* path, bool (*callback)(pkg_info* info, void* user_data),
                             void* user_data);
 
+/**
+ * Looks up the package called `name` in the system's default package list.
+ * Returns a `pkg_info*` that the caller owns and should free with packagelist_free(),
+ * or NULL if there is no such package, or the package list couldn't be read.
+ * The package list is indexed on first use, and only read again once it has changed,
+ * so this is much cheaper than packagelist_parse() for a single package.
+ */
+pkg_info* packagelist_find_by_name(const char* name);
+
+/**
+ * Like packagelist_find_by_name(), but looks up the package with the given uid.
+ * If several packages share the uid, the first of them in the package list is returned.
+ */
+pkg_info* packagelist_find_by_uid(uid_t uid);
+
+/** Like packagelist_find_by_name(), but in the given package list. */
+pkg_info* packagelist_find_by_name_file(const char* path, const char* name);
+
+/** Like packagelist_find_by_uid(), but in the given package list. */
+pkg_info* packagelist_find_by_uid_file(const char* path, uid_t uid);
+
 /** Frees the given `pkg_info`. */
 void packagelist_free(pkg_info* info);
 
@@ -21,10 +21,17 @@
 #include <errno.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/limits.h>
+#include <sys/stat.h>
 
+#include <algorithm>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
 
 #include <log/log.h>
 
@@ -129,6 +136,149 @@ bool packagelist_parse(bool (*callback)(pkg_info*, void*), void* user_data) {
   return packagelist_parse_file("/data/system/packages.list", callback, user_data);
 }
 
+namespace {
+
+// The lines of a package list, sorted by name and by uid, so that a single package can be looked
+// up without parsing (and allocating) all of the others.
+struct PackageIndex {
+  struct Line {
+    size_t offset;
+    size_t length;
+    size_t line_number;
+    std::string_view name;
+    uid_t uid;
+  };
+
+  std::string path;
+  struct stat st = {};
+  std::string contents;
+  std::vector<Line> by_name;
+  std::vector<Line> by_uid;
+
+  bool IsCurrent(const char* path, const struct stat& st) const;
+  bool Load(const char* path, const struct stat& st);
+  pkg_info* Parse(const Line& line) const;
+};
+
+}  // namespace
+
+static std::mutex g_index_lock;
+static PackageIndex g_index;
+
+// packages.list is replaced by a rename when it changes, but check everything that would tell us
+// about an update in place too.
+bool PackageIndex::IsCurrent(const char* path, const struct stat& st) const {
+  return this->path == path && this->st.st_dev == st.st_dev && this->st.st_ino == st.st_ino &&
+         this->st.st_size == st.st_size && this->st.st_mtim.tv_sec == st.st_mtim.tv_sec &&
+         this->st.st_mtim.tv_nsec == st.st_mtim.tv_nsec;
+}
+
+bool PackageIndex::Load(const char* path, const struct stat& st) {
+  this->path.clear();
+  contents.clear();
+  by_name.clear();
+  by_uid.clear();
+
+  // Read rather than map the file, so that a writer truncating it can't take a long-lived
+  // reader (like adbd) down with SIGBUS.
+  std::unique_ptr<FILE, decltype(&fclose)> fp(fopen(path, "re"), &fclose);
+  if (!fp) {
+    ALOGE("couldn't open '%s': %s", path, strerror(errno));
+    return false;
+  }
+  contents.resize(st.st_size);
+  contents.resize(fread(contents.data(), 1, contents.size(), fp.get()));
+  if (ferror(fp.get())) {
+    ALOGE("couldn't read '%s': %s", path, strerror(errno));
+    return false;
+  }
+
+  // Only the name and uid are needed to index a line, the rest is parsed when it's looked up.
+  size_t offset = 0;
+  size_t line_number = 0;
+  while (offset < contents.size()) {
+    ++line_number;
+    size_t end = contents.find('\n', offset);
+    if (end == std::string::npos) end = contents.size();
+    std::string_view line(contents.data() + offset, end - offset);
+    size_t name_end = line.find(' ');
+    if (name_end != std::string_view::npos && name_end > 0) {
+      char* uid_end;
+      unsigned long uid = strtoul(line.data() + name_end + 1, &uid_end, 10);
+      if (uid <= UID_MAX && *uid_end == ' ') {
+        by_name.push_back({offset, line.size(), line_number, line.substr(0, name_end),
+                           static_cast<uid_t>(uid)});
+      }
+    }
+    offset = end + 1;
+  }
+
+  by_uid = by_name;
+  std::stable_sort(by_uid.begin(), by_uid.end(),
+                   [](const Line& lhs, const Line& rhs) { return lhs.uid < rhs.uid; });
+  std::stable_sort(by_name.begin(), by_name.end(),
+                   [](const Line& lhs, const Line& rhs) { return lhs.name < rhs.name; });
+
+  this->path = path;
+  this->st = st;
+  return true;
+}
+
+pkg_info* PackageIndex::Parse(const Line& line) const {
+  std::unique_ptr<pkg_info, decltype(&packagelist_free)> info(
+      static_cast<pkg_info*>(calloc(1, sizeof(pkg_info))), &packagelist_free);
+  if (!info) {
+    ALOGE("%s: couldn't allocate pkg_info", path.c_str());
+    return nullptr;
+  }
+
+  std::string text(contents, line.offset, line.length);
+  if (!parse_line(path.c_str(), line.line_number, text.c_str(), info.get())) return nullptr;
+  return info.release();
+}
+
+// Runs `find` on the index of `path`, (re)loading it first if the file has changed.
+template <typename F>
+static pkg_info* packagelist_find(const char* path, F find) {
+  struct stat st;
+  if (stat(path, &st) == -1) {
+    ALOGE("couldn't stat '%s': %s", path, strerror(errno));
+    return nullptr;
+  }
+
+  std::lock_guard<std::mutex> lock(g_index_lock);
+  if (!g_index.IsCurrent(path, st) && !g_index.Load(path, st)) return nullptr;
+  const PackageIndex::Line* line = find(g_index);
+  return line ? g_index.Parse(*line) : nullptr;
+}
+
+pkg_info* packagelist_find_by_name_file(const char* path, const char* name) {
+  return packagelist_find(path, [name](const PackageIndex& index) -> const PackageIndex::Line* {
+    std::string_view key(name);
+    auto it = std::lower_bound(
+        index.by_name.begin(), index.by_name.end(), key,
+        [](const PackageIndex::Line& line, std::string_view key) { return line.name < key; });
+    return (it != index.by_name.end() && it->name == key) ? &*it : nullptr;
+  });
+}
+
+pkg_info* packagelist_find_by_uid_file(const char* path, uid_t uid) {
+  return packagelist_find(path, [uid](const PackageIndex& index) -> const PackageIndex::Line* {
+    auto it = std::lower_bound(
+        index.by_uid.begin(), index.by_uid.end(), uid,
+        [](const PackageIndex::Line& line, uid_t uid) { return line.uid < uid; });
+    return (it != index.by_uid.end() && it->uid == uid) ? &*it : nullptr;
+  });
+}
+
+pkg_info* packagelist_find_by_name(const char* name) {
+  return packagelist_find_by_name_file("/data/system/packages.list", name);
+}
+
+pkg_info* packagelist_find_by_uid(uid_t uid) {
+  return packagelist_find_by_uid_file("/data/system/packages.list", uid);
+}
+
 void packagelist_free(pkg_info* info) {
   if (!info) return;
 
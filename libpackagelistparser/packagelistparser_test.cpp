@@ -16,7 +16,11 @@
 
 #include <packagelistparser/packagelistparser.h>
 
+#include <stdio.h>
+#include <unistd.h>
+
 #include <memory>
+#include <string>
 
 #include <android-base/file.h>
 
@@ -132,3 +136,91 @@ TEST(packagelistparser, system_package_list) {
 TEST(packagelistparser, packagelist_free_nullptr) {
   packagelist_free(nullptr);
 }
+
+TEST(packagelistparser, find) {
+  TemporaryFile tf;
+  android::base::WriteStringToFile(
+      "com.test.c 10030 0 /data/user/0/com.test.c c none\n"
+      "com.test.a 10010 1 /data/user/0/com.test.a a 1023 1 123\n"
+      "com.test.b 10030 0 /data/user/0/com.test.b b 2001,1065\n",
+      tf.path);
+
+  std::unique_ptr<pkg_info, decltype(&packagelist_free)> info(
+      packagelist_find_by_name_file(tf.path, "com.test.a"), &packagelist_free);
+  ASSERT_TRUE(info != nullptr);
+  ASSERT_STREQ("com.test.a", info->name);
+  ASSERT_EQ(10010, info->uid);
+  ASSERT_TRUE(info->debuggable);
+  ASSERT_STREQ("/data/user/0/com.test.a", info->data_dir);
+  ASSERT_STREQ("a", info->seinfo);
+  ASSERT_EQ(1U, info->gids.cnt);
+  ASSERT_EQ(1023U, info->gids.gids[0]);
+  ASSERT_TRUE(info->profileable_from_shell);
+  ASSERT_EQ(123, info->version_code);
+
+  info.reset(packagelist_find_by_name_file(tf.path, "com.test.b"));
+  ASSERT_TRUE(info != nullptr);
+  ASSERT_EQ(2U, info->gids.cnt);
+  ASSERT_EQ(1065U, info->gids.gids[1]);
+
+  // A shared uid finds the first package in the list.
+  info.reset(packagelist_find_by_uid_file(tf.path, 10030));
+  ASSERT_TRUE(info != nullptr);
+  ASSERT_STREQ("com.test.c", info->name);
+
+  ASSERT_EQ(nullptr, packagelist_find_by_name_file(tf.path, "com.test"));
+  ASSERT_EQ(nullptr, packagelist_find_by_name_file(tf.path, "com.test.d"));
+  ASSERT_EQ(nullptr, packagelist_find_by_uid_file(tf.path, 10020));
+  ASSERT_EQ(nullptr, packagelist_find_by_uid_file(tf.path, 10040));
+}
+
+TEST(packagelistparser, find_after_change) {
+  TemporaryDir td;
+  std::string path = std::string(td.path) + "/packages.list";
+  std::string new_path = path + ".new";
+  ASSERT_TRUE(android::base::WriteStringToFile("com.test.a 10010 0 / a none\n", path));
+
+  std::unique_ptr<pkg_info, decltype(&packagelist_free)> info(
+      packagelist_find_by_name_file(path.c_str(), "com.test.a"), &packagelist_free);
+  ASSERT_TRUE(info != nullptr);
+  ASSERT_EQ(10010, info->uid);
+
+  // Replaced the way PackageManager does it.
+  ASSERT_TRUE(android::base::WriteStringToFile(
+      "com.test.a 10011 0 / a none\ncom.test.b 10012 0 / b none\n", new_path));
+  ASSERT_EQ(0, rename(new_path.c_str(), path.c_str()));
+  info.reset(packagelist_find_by_name_file(path.c_str(), "com.test.a"));
+  ASSERT_TRUE(info != nullptr);
+  ASSERT_EQ(10011, info->uid);
+  info.reset(packagelist_find_by_uid_file(path.c_str(), 10012));
+  ASSERT_TRUE(info != nullptr);
+  ASSERT_STREQ("com.test.b", info->name);
+
+  // And rewritten in place, with a different size.
+  ASSERT_TRUE(android::base::WriteStringToFile("com.test.c 10013 0 / c none\n", path));
+  ASSERT_EQ(nullptr, packagelist_find_by_name_file(path.c_str(), "com.test.a"));
+  info.reset(packagelist_find_by_name_file(path.c_str(), "com.test.c"));
+  ASSERT_TRUE(info != nullptr);
+
+  ASSERT_EQ(0, unlink(path.c_str()));
+  ASSERT_EQ(nullptr, packagelist_find_by_name_file(path.c_str(), "com.test.c"));
+}
+
+TEST(packagelistparser, system_package_list_find) {
+  pkg_info* first = nullptr;
+  packagelist_parse(
+      [](pkg_info* info, void* user_data) -> bool {
+        *reinterpret_cast<pkg_info**>(user_data) = info;
+        return false;
+      },
+      &first);
+  ASSERT_TRUE(first != nullptr);
+
+  std::unique_ptr<pkg_info, decltype(&packagelist_free)> info(packagelist_find_by_name(first->name),
+                                                              &packagelist_free);
+  ASSERT_TRUE(info != nullptr);
+  ASSERT_EQ(first->uid, info->uid);
+  info.reset(packagelist_find_by_uid(first->uid));
+  ASSERT_TRUE(info != nullptr);
+  packagelist_free(first);
+}
@@ -28,12 +28,11 @@
 #include <time.h>
 #include <unistd.h>
 
-#include <regex>
-
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/properties.h>
 #include <android-base/stringprintf.h>
+#include <android-base/strings.h>
 #include <android-base/unique_fd.h>
 #include <cgroup_map.h>
 #include <json/reader.h>
@@ -42,6 +41,7 @@
 
 using android::base::GetBoolProperty;
 using android::base::StringPrintf;
+using android::base::StringReplace;
 using android::base::unique_fd;
 
 static constexpr const char* CGROUP_PROCS_FILE = "/cgroup.procs";
@@ -95,8 +95,8 @@ std::string CgroupController::GetProcsFilePath(const std::string& rel_path, uid_
                                                pid_t pid) const {
     std::string proc_path(path());
     proc_path.append("/").append(rel_path);
-    proc_path = regex_replace(proc_path, std::regex("<uid>"), std::to_string(uid));
-    proc_path = regex_replace(proc_path, std::regex("<pid>"), std::to_string(pid));
+    proc_path = StringReplace(proc_path, "<uid>", std::to_string(uid), true);
+    proc_path = StringReplace(proc_path, "<pid>", std::to_string(pid), true);
 
     return proc_path.append(CGROUP_PROCS_FILE);
 }
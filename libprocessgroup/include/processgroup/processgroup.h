@@ -32,9 +32,27 @@ bool CgroupGetAttributePathForTask(const std::string& attr_name, int tid, std::s
 bool SetTaskProfiles(int tid, const std::vector<std::string>& profiles, bool use_fd_cache = false);
 bool SetProcessProfiles(uid_t uid, pid_t pid, const std::vector<std::string>& profiles);
 
+// Task profiles looked up by name once, for callers that apply the same ones over and over.
+// Handles are valid for the lifetime of the process, and asking twice for the same list of
+// profiles returns the same handle.
+struct TaskProfilesHandle;
+const TaskProfilesHandle* GetTaskProfilesHandle(const std::vector<std::string>& profiles);
+bool SetTaskProfilesHandle(int tid, const TaskProfilesHandle* profiles,
+                           bool use_fd_cache = false);
+
+// Applies task profiles to every thread of process pid.  Cgroup actions move the whole process
+// with a single write to the cgroup's cgroup.procs file instead of one write per thread, the other
+// actions are applied thread by thread.
+bool SetProcessThreadsProfiles(pid_t pid, const TaskProfilesHandle* profiles);
+
 #ifndef __ANDROID_VNDK__
 
 static constexpr const char* CGROUPS_RC_PATH = "/dev/cgroup_info/cgroup.rc";
+static constexpr const char* TASK_PROFILES_RC_PATH = "/dev/cgroup_info/task_profiles.rc";
+
+// Compiles the task profiles JSON files into TASK_PROFILES_RC_PATH, which processes then map
+// instead of parsing the JSON files themselves.  Meant to be called by init after CgroupSetup().
+bool WriteTaskProfilesRcFile();
 
 bool UsePerAppMemcg();
 
@@ -55,6 +73,11 @@ int killProcessGroup(uid_t uid, int initialPid, int signal, int* max_processes =
 // that it only returns 0 in the case that the cgroup exists and it contains no processes.
 int killProcessGroupOnce(uid_t uid, int initialPid, int signal, int* max_processes = nullptr);
 
+// Signals the processes like killProcessGroupOnce(), then leaves waiting for them to exit and
+// removing the cgroup to a background thread, which retries for up to 200ms like
+// killProcessGroup().  Returns 0 once the signal has been sent, or -1 on error.
+int killProcessGroupAsync(uid_t uid, int initialPid, int signal, int* max_processes = nullptr);
+
 int createProcessGroup(uid_t uid, int initialPid, bool memControl = false);
 
 // Set various properties of a process group. For these functions to work, the process group must
@@ -22,14 +22,21 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -49,11 +56,14 @@
 using android::base::GetBoolProperty;
 using android::base::StartsWith;
 using android::base::StringPrintf;
+using android::base::unique_fd;
 using android::base::WriteStringToFile;
 
 using namespace std::chrono_literals;
 
 #define PROCESSGROUP_CGROUP_PROCS_FILE "/cgroup.procs"
+#define PROCESSGROUP_CGROUP_KILL_FILE "/cgroup.kill"
+#define PROCESSGROUP_CGROUP_EVENTS_FILE "/cgroup.events"
 
 bool CgroupGetControllerPath(const std::string& cgroup_name, std::string* path) {
     auto controller = CgroupMap::GetInstance().FindController(cgroup_name);
@@ -123,6 +133,18 @@ bool SetTaskProfiles(int tid, const std::vector<std::string>& profiles, bool use
     return TaskProfiles::GetInstance().SetTaskProfiles(tid, profiles, use_fd_cache);
 }
 
+const TaskProfilesHandle* GetTaskProfilesHandle(const std::vector<std::string>& profiles) {
+    return TaskProfiles::GetInstance().GetHandle(profiles);
+}
+
+bool SetTaskProfilesHandle(int tid, const TaskProfilesHandle* profiles, bool use_fd_cache) {
+    return TaskProfiles::GetInstance().SetTaskProfiles(tid, *profiles, use_fd_cache);
+}
+
+bool SetProcessThreadsProfiles(pid_t pid, const TaskProfilesHandle* profiles) {
+    return TaskProfiles::GetInstance().SetProcessThreadsProfiles(pid, *profiles);
+}
+
 static std::string ConvertUidToPath(const char* cgroup, uid_t uid) {
     return StringPrintf("%s/uid_%d", cgroup, uid);
 }
@@ -227,12 +249,42 @@ static bool MkdirAndChown(const std::string& path, mode_t mode, uid_t uid, gid_t
     return true;
 }
 
+// Kills every process in the cgroup at once, including any forked while the kill is in progress,
+// through the cgroup.kill file of cgroup v2 (Linux 5.14 and later).
+static bool KillCgroup(const std::string& group_path) {
+    static std::atomic<bool> unsupported(false);
+    if (unsupported.load(std::memory_order_relaxed)) {
+        return false;
+    }
+
+    auto kill_path = group_path + PROCESSGROUP_CGROUP_KILL_FILE;
+    unique_fd fd(TEMP_FAILURE_RETRY(open(kill_path.c_str(), O_WRONLY | O_CLOEXEC)));
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            // Either the group is gone, or the kernel or the hierarchy has no cgroup.kill.
+            unsupported = access(group_path.c_str(), F_OK) == 0;
+        } else {
+            PLOG(WARNING) << "Failed to open " << kill_path;
+        }
+        return false;
+    }
+    if (TEMP_FAILURE_RETRY(write(fd, "1", 1)) == -1) {
+        PLOG(WARNING) << "Failed to write to " << kill_path;
+        return false;
+    }
+    return true;
+}
+
 // Returns number of processes killed on success
 // Returns 0 if there are no processes in the process cgroup left to kill
 // Returns -1 on error
-static int DoKillProcessGroupOnce(const char* cgroup, uid_t uid, int initialPid, int signal) {
-    auto path = ConvertUidPidToPath(cgroup, uid, initialPid) + PROCESSGROUP_CGROUP_PROCS_FILE;
+// The pids that were signalled are returned in killed_pids.
+static int DoKillProcessGroupOnce(const char* cgroup, uid_t uid, int initialPid, int signal,
+                                  std::vector<pid_t>* killed_pids) {
+    auto group_path = ConvertUidPidToPath(cgroup, uid, initialPid);
+    auto path = group_path + PROCESSGROUP_CGROUP_PROCS_FILE;
     std::unique_ptr<FILE, decltype(&fclose)> fd(fopen(path.c_str(), "re"), fclose);
+    killed_pids->clear();
     if (!fd) {
         if (errno == ENOENT) {
             // This happens when process is already dead
@@ -258,6 +310,11 @@ static int DoKillProcessGroupOnce(const char* cgroup, uid_t uid, int initialPid,
             LOG(WARNING) << "Yikes, we've been told to kill pid 0!  How about we don't do that?";
             continue;
         }
+        killed_pids->push_back(pid);
+        if (signal == SIGKILL) {
+            // cgroup.kill doesn't need the process groups.
+            continue;
+        }
         pid_t pgid = getpgid(pid);
         if (pgid == -1) PLOG(ERROR) << "getpgid(" << pid << ") failed";
         if (pgid == pid) {
@@ -266,6 +323,26 @@ static int DoKillProcessGroupOnce(const char* cgroup, uid_t uid, int initialPid,
             pids.emplace(pid);
         }
     }
+    if (!feof(fd.get())) {
+        return -1;
+    }
+
+    if (signal == SIGKILL && processes > 0) {
+        if (KillCgroup(group_path)) {
+            LOG(VERBOSE) << "Killed process cgroup uid " << uid << " pid " << initialPid
+                         << " through cgroup.kill";
+            return processes;
+        }
+        for (const auto pid : *killed_pids) {
+            pid_t pgid = getpgid(pid);
+            if (pgid == -1) PLOG(ERROR) << "getpgid(" << pid << ") failed";
+            if (pgid == pid) {
+                pgids.emplace(pid);
+            } else {
+                pids.emplace(pid);
+            }
+        }
+    }
 
     // Erase all pids that will be killed when we kill the process groups.
     for (auto it = pids.begin(); it != pids.end();) {
@@ -297,11 +374,71 @@ static int DoKillProcessGroupOnce(const char* cgroup, uid_t uid, int initialPid,
         }
     }
 
-    return feof(fd.get()) ? processes : -1;
+    return processes;
 }
 
-static int KillProcessGroup(uid_t uid, int initialPid, int signal, int retries,
-                            int* max_processes) {
+static unique_fd OpenPidFd(pid_t pid) {
+#if defined(__NR_pidfd_open)
+    return unique_fd(syscall(__NR_pidfd_open, pid, 0));
+#else
+    errno = ENOSYS;
+    return unique_fd();
+#endif
+}
+
+// Waits until the cgroup is empty or the timeout expires, whichever comes first.  On cgroup v2 the
+// cgroup.events file reports when the group becomes empty; otherwise the processes that were
+// signalled are waited for through pidfds.  Without either, this just sleeps for the timeout.
+static void WaitForProcessGroupEmpty(const std::string& group_path, const std::vector<pid_t>& pids,
+                                     std::chrono::milliseconds timeout) {
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    auto remaining_ms = [&deadline]() {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now());
+        return std::max(static_cast<int>(left.count()), 0);
+    };
+
+    auto events_path = group_path + PROCESSGROUP_CGROUP_EVENTS_FILE;
+    unique_fd events_fd(TEMP_FAILURE_RETRY(open(events_path.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (events_fd >= 0) {
+        char buf[256];
+        do {
+            ssize_t n = TEMP_FAILURE_RETRY(pread(events_fd, buf, sizeof(buf) - 1, 0));
+            if (n < 0) break;
+            buf[n] = '\0';
+            if (strstr(buf, "populated 0") != nullptr) return;
+            // The file signals POLLPRI each time one of its values changes.
+            struct pollfd pfd = {.fd = events_fd, .events = POLLPRI};
+            if (TEMP_FAILURE_RETRY(poll(&pfd, 1, remaining_ms())) <= 0) return;
+        } while (remaining_ms() > 0);
+        return;
+    }
+
+    std::vector<struct pollfd> pfds;
+    std::vector<unique_fd> pidfds;
+    for (const auto pid : pids) {
+        unique_fd pidfd = OpenPidFd(pid);
+        if (pidfd < 0) {
+            if (errno == ESRCH) continue;
+            // No pidfd support.
+            std::this_thread::sleep_for(timeout);
+            return;
+        }
+        pfds.push_back({.fd = pidfd, .events = POLLIN});
+        pidfds.push_back(std::move(pidfd));
+    }
+
+    // A pidfd becomes readable once its process has exited.
+    while (!pfds.empty()) {
+        int ready = TEMP_FAILURE_RETRY(poll(pfds.data(), pfds.size(), remaining_ms()));
+        if (ready <= 0) return;
+        pfds.erase(std::remove_if(pfds.begin(), pfds.end(),
+                                  [](const struct pollfd& pfd) { return pfd.revents != 0; }),
+                   pfds.end());
+    }
+}
+
+static std::string GetProcessGroupCgroup(uid_t uid, int initialPid) {
     std::string cpuacct_path;
     std::string memory_path;
 
@@ -309,10 +446,16 @@ static int KillProcessGroup(uid_t uid, int initialPid, int signal, int retries,
     CgroupGetControllerPath("memory", &memory_path);
     memory_path += "/apps";
 
-    const char* cgroup =
-            (!access(ConvertUidPidToPath(cpuacct_path.c_str(), uid, initialPid).c_str(), F_OK))
-                    ? cpuacct_path.c_str()
-                    : memory_path.c_str();
+    return (!access(ConvertUidPidToPath(cpuacct_path.c_str(), uid, initialPid).c_str(), F_OK))
+                   ? cpuacct_path
+                   : memory_path;
+}
+
+static int KillProcessGroup(uid_t uid, int initialPid, int signal, int retries,
+                            int* max_processes) {
+    std::string cgroup_path = GetProcessGroupCgroup(uid, initialPid);
+    const char* cgroup = cgroup_path.c_str();
+    std::string group_path = ConvertUidPidToPath(cgroup, uid, initialPid);
 
     std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
 
@@ -322,13 +465,15 @@ static int KillProcessGroup(uid_t uid, int initialPid, int signal, int retries,
 
     int retry = retries;
     int processes;
-    while ((processes = DoKillProcessGroupOnce(cgroup, uid, initialPid, signal)) > 0) {
+    std::vector<pid_t> killed_pids;
+    while ((processes = DoKillProcessGroupOnce(cgroup, uid, initialPid, signal, &killed_pids)) >
+           0) {
         if (max_processes != nullptr && processes > *max_processes) {
             *max_processes = processes;
         }
         LOG(VERBOSE) << "Killed " << processes << " processes for processgroup " << initialPid;
         if (retry > 0) {
-            std::this_thread::sleep_for(5ms);
+            WaitForProcessGroupEmpty(group_path, killed_pids, 5ms);
             --retry;
         } else {
             break;
@@ -374,6 +519,68 @@ int killProcessGroupOnce(uid_t uid, int initialPid, int signal, int* max_process
     return KillProcessGroup(uid, initialPid, signal, 0 /*retries*/, max_processes);
 }
 
+namespace {
+
+// Finishes off the process groups passed to killProcessGroupAsync() on a thread of its own.
+class ProcessGroupReaper {
+  public:
+    static ProcessGroupReaper& GetInstance() {
+        // Never destroyed, the thread may still be running at exit.
+        static ProcessGroupReaper* instance = new ProcessGroupReaper;
+        return *instance;
+    }
+
+    void Add(uid_t uid, int initialPid, int signal) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_.push_back({uid, initialPid, signal});
+        if (!started_) {
+            std::thread(&ProcessGroupReaper::Run, this).detach();
+            started_ = true;
+        }
+        cv_.notify_one();
+    }
+
+  private:
+    struct Group {
+        uid_t uid;
+        int initial_pid;
+        int signal;
+    };
+
+    void Run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (true) {
+            cv_.wait(lock, [this]() { return !pending_.empty(); });
+            Group group = pending_.front();
+            pending_.pop_front();
+            lock.unlock();
+            KillProcessGroup(group.uid, group.initial_pid, group.signal, 40 /*retries*/, nullptr);
+            lock.lock();
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<Group> pending_;
+    bool started_ = false;
+};
+
+}  // namespace
+
+int killProcessGroupAsync(uid_t uid, int initialPid, int signal, int* max_processes) {
+    int processes = 0;
+    int ret = KillProcessGroup(uid, initialPid, signal, 0 /*retries*/, &processes);
+    if (max_processes != nullptr) {
+        *max_processes = processes;
+    }
+    if (processes == 0) {
+        // The group was already empty, and has been removed unless there was an error.
+        return ret;
+    }
+    ProcessGroupReaper::GetInstance().Add(uid, initialPid, signal);
+    return 0;
+}
+
 int createProcessGroup(uid_t uid, int initialPid, bool memControl) {
     std::string cgroup;
     if (isMemoryCgroupSupported() && (memControl || UsePerAppMemcg())) {
@@ -21,6 +21,8 @@
 #include <errno.h>
 #include <unistd.h>
 
+#include <atomic>
+
 #include <android-base/logging.h>
 #include <android-base/threads.h>
 #include <cgroup_map.h>
@@ -38,6 +40,22 @@ static inline SchedPolicy _policy(SchedPolicy p) {
 
 #if defined(__ANDROID__)
 
+// Each profile is looked up by name the first time it is applied, and by handle after that.
+static std::atomic<const TaskProfilesHandle*> cpuset_background, cpuset_foreground, cpuset_top_app,
+        cpuset_system, cpuset_restricted;
+static std::atomic<const TaskProfilesHandle*> sched_background, sched_foreground, sched_top_app,
+        sched_rt_app, sched_default;
+
+static int SetTaskProfile(int tid, std::atomic<const TaskProfilesHandle*>* handle,
+                          const char* name) {
+    const TaskProfilesHandle* profiles = handle->load(std::memory_order_acquire);
+    if (profiles == nullptr) {
+        profiles = GetTaskProfilesHandle({name});
+        handle->store(profiles, std::memory_order_release);
+    }
+    return SetTaskProfilesHandle(tid, profiles, true) ? 0 : -1;
+}
+
 int set_cpuset_policy(int tid, SchedPolicy policy) {
     if (tid == 0) {
         tid = GetThreadId();
@@ -46,17 +64,17 @@ int set_cpuset_policy(int tid, SchedPolicy policy) {
 
     switch (policy) {
         case SP_BACKGROUND:
-            return SetTaskProfiles(tid, {"CPUSET_SP_BACKGROUND"}, true) ? 0 : -1;
+            return SetTaskProfile(tid, &cpuset_background, "CPUSET_SP_BACKGROUND");
         case SP_FOREGROUND:
         case SP_AUDIO_APP:
         case SP_AUDIO_SYS:
-            return SetTaskProfiles(tid, {"CPUSET_SP_FOREGROUND"}, true) ? 0 : -1;
+            return SetTaskProfile(tid, &cpuset_foreground, "CPUSET_SP_FOREGROUND");
         case SP_TOP_APP:
-            return SetTaskProfiles(tid, {"CPUSET_SP_TOP_APP"}, true) ? 0 : -1;
+            return SetTaskProfile(tid, &cpuset_top_app, "CPUSET_SP_TOP_APP");
         case SP_SYSTEM:
-            return SetTaskProfiles(tid, {"CPUSET_SP_SYSTEM"}, true) ? 0 : -1;
+            return SetTaskProfile(tid, &cpuset_system, "CPUSET_SP_SYSTEM");
         case SP_RESTRICTED:
-            return SetTaskProfiles(tid, {"CPUSET_SP_RESTRICTED"}, true) ? 0 : -1;
+            return SetTaskProfile(tid, &cpuset_restricted, "CPUSET_SP_RESTRICTED");
         default:
             break;
     }
@@ -117,17 +135,17 @@ int set_sched_policy(int tid, SchedPolicy policy) {
 
     switch (policy) {
         case SP_BACKGROUND:
-            return SetTaskProfiles(tid, {"SCHED_SP_BACKGROUND"}, true) ? 0 : -1;
+            return SetTaskProfile(tid, &sched_background, "SCHED_SP_BACKGROUND");
         case SP_FOREGROUND:
         case SP_AUDIO_APP:
         case SP_AUDIO_SYS:
-            return SetTaskProfiles(tid, {"SCHED_SP_FOREGROUND"}, true) ? 0 : -1;
+            return SetTaskProfile(tid, &sched_foreground, "SCHED_SP_FOREGROUND");
         case SP_TOP_APP:
-            return SetTaskProfiles(tid, {"SCHED_SP_TOP_APP"}, true) ? 0 : -1;
+            return SetTaskProfile(tid, &sched_top_app, "SCHED_SP_TOP_APP");
         case SP_RT_APP:
-            return SetTaskProfiles(tid, {"SCHED_SP_RT_APP"}, true) ? 0 : -1;
+            return SetTaskProfile(tid, &sched_rt_app, "SCHED_SP_RT_APP");
         default:
-            return SetTaskProfiles(tid, {"SCHED_SP_DEFAULT"}, true) ? 0 : -1;
+            return SetTaskProfile(tid, &sched_default, "SCHED_SP_DEFAULT");
     }
 
     return 0;
@@ -17,16 +17,24 @@
 //#define LOG_NDEBUG 0
 #define LOG_TAG "libprocessgroup"
 
+#include <dirent.h>
 #include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <task_profiles.h>
+#include <memory>
 #include <string>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/mapped_file.h>
+#include <android-base/parseint.h>
 #include <android-base/stringprintf.h>
 #include <android-base/threads.h>
 
 #include <cutils/android_filesystem_config.h>
+#include <processgroup/processgroup.h>
 
 #include <json/reader.h>
 #include <json/value.h>
@@ -37,6 +45,7 @@
 #endif
 
 using android::base::GetThreadId;
+using android::base::ParseInt;
 using android::base::StringPrintf;
 using android::base::unique_fd;
 using android::base::WriteStringToFile;
@@ -44,6 +53,41 @@ using android::base::WriteStringToFile;
 #define TASK_PROFILE_DB_FILE "/etc/task_profiles.json"
 #define TASK_PROFILE_DB_VENDOR_FILE "/vendor/etc/task_profiles.json"
 
+const std::vector<int>& ThreadGroup::tids() const {
+    if (listed_) {
+        return tids_;
+    }
+    listed_ = true;
+
+    std::string task_path = StringPrintf("/proc/%d/task", pid_);
+    std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(task_path.c_str()), closedir);
+    if (dir == nullptr) {
+        // The process has exited, so there is nothing left to do.
+        if (errno != ENOENT) {
+            PLOG(WARNING) << "Failed to list the threads of " << pid_;
+        }
+        return tids_;
+    }
+    dirent* entry;
+    while ((entry = readdir(dir.get())) != nullptr) {
+        int tid;
+        if (ParseInt(entry->d_name, &tid, 1)) {
+            tids_.push_back(tid);
+        }
+    }
+    return tids_;
+}
+
+bool ProfileAction::ExecuteForThreadGroup(const ThreadGroup& group) const {
+    bool success = true;
+    for (int tid : group.tids()) {
+        if (!ExecuteForTask(tid)) {
+            success = false;
+        }
+    }
+    return success;
+}
+
 void ProfileAttribute::Reset(const CgroupController& controller, const std::string& file_name) {
     controller_ = controller;
     file_name_ = file_name;
@@ -180,13 +224,60 @@ void SetCgroupAction::EnableResourceCaching() {
 
 void SetCgroupAction::DropResourceCaching() {
     std::lock_guard<std::mutex> lock(fd_mutex_);
-    if (fd_ == FDS_NOT_CACHED) {
+    procs_fd_.reset();
+    for (auto& entry : app_procs_fds_) {
+        entry.fd.reset();
+    }
+    if (fd_ == FDS_NOT_CACHED || fd_ == FDS_APP_DEPENDENT) {
         return;
     }
 
     fd_.reset(FDS_NOT_CACHED);
 }
 
+int SetCgroupAction::GetProcsFdLocked(uid_t uid, pid_t pid) const {
+    if (fd_ != FDS_APP_DEPENDENT && procs_fd_ >= 0) {
+        return procs_fd_;
+    }
+    if (fd_ == FDS_APP_DEPENDENT) {
+        for (const auto& entry : app_procs_fds_) {
+            if (entry.fd >= 0 && entry.uid == uid && entry.pid == pid) {
+                return entry.fd;
+            }
+        }
+    }
+
+    std::string procs_path = controller()->GetProcsFilePath(path_, uid, pid);
+    unique_fd fd(TEMP_FAILURE_RETRY(open(procs_path.c_str(), O_WRONLY | O_CLOEXEC)));
+    if (fd < 0) {
+        PLOG(WARNING) << "Failed to open " << procs_path;
+        return -1;
+    }
+
+    if (fd_ != FDS_APP_DEPENDENT) {
+        procs_fd_ = std::move(fd);
+        return procs_fd_;
+    }
+    AppProcsFd& entry = app_procs_fds_[next_app_procs_fd_];
+    next_app_procs_fd_ = (next_app_procs_fd_ + 1) % kAppProcsFdCacheSize;
+    entry.uid = uid;
+    entry.pid = pid;
+    entry.fd = std::move(fd);
+    return entry.fd;
+}
+
+void SetCgroupAction::DropProcsFdLocked(uid_t uid, pid_t pid) const {
+    if (fd_ != FDS_APP_DEPENDENT) {
+        procs_fd_.reset();
+        return;
+    }
+    for (auto& entry : app_procs_fds_) {
+        if (entry.uid == uid && entry.pid == pid) {
+            entry.fd.reset();
+        }
+    }
+}
+
 bool SetCgroupAction::AddTidToCgroup(int tid, int fd) {
     if (tid <= 0) {
         return true;
@@ -206,20 +297,44 @@ bool SetCgroupAction::AddTidToCgroup(int tid, int fd) {
 }
 
 bool SetCgroupAction::ExecuteForProcess(uid_t uid, pid_t pid) const {
-    std::string procs_path = controller()->GetProcsFilePath(path_, uid, pid);
-    unique_fd tmp_fd(TEMP_FAILURE_RETRY(open(procs_path.c_str(), O_WRONLY | O_CLOEXEC)));
-    if (tmp_fd < 0) {
-        PLOG(WARNING) << "Failed to open " << procs_path;
+    std::lock_guard<std::mutex> lock(fd_mutex_);
+    int fd = GetProcsFdLocked(uid, pid);
+    if (fd < 0) {
         return false;
     }
-    if (!AddTidToCgroup(pid, tmp_fd)) {
-        LOG(ERROR) << "Failed to add task into cgroup";
-        return false;
+
+    // A cached file may belong to a cgroup that has been removed since it was opened, so a failed
+    // write is retried once with the file opened afresh.
+    std::string value = std::to_string(pid);
+    if (TEMP_FAILURE_RETRY(write(fd, value.c_str(), value.length())) < 0 && errno != ESRCH) {
+        DropProcsFdLocked(uid, pid);
+        fd = GetProcsFdLocked(uid, pid);
+        if (fd < 0 || !AddTidToCgroup(pid, fd)) {
+            LOG(ERROR) << "Failed to add task into cgroup";
+            return false;
+        }
     }
 
     return true;
 }
 
+bool SetCgroupAction::ExecuteForThreadGroup(const ThreadGroup& group) const {
+    {
+        std::lock_guard<std::mutex> lock(fd_mutex_);
+        if (fd_ == FDS_INACCESSIBLE) {
+            // no permissions to access the file, ignore
+            return true;
+        }
+        if (fd_ == FDS_APP_DEPENDENT) {
+            LOG(ERROR) << "Application profile can't be applied to the threads of a process";
+            return false;
+        }
+    }
+
+    // Writing the pid to cgroup.procs moves all of the threads of the process at once.
+    return ExecuteForProcess(0, group.pid());
+}
+
 bool SetCgroupAction::ExecuteForTask(int tid) const {
     std::lock_guard<std::mutex> lock(fd_mutex_);
     if (IsFdValid()) {
@@ -242,14 +357,15 @@ bool SetCgroupAction::ExecuteForTask(int tid) const {
         return false;
     }
 
-    // fd was not cached because cached fd can't be used
+    // fd is not cached yet; keep it open for the next call, until DropResourceCaching()
     std::string tasks_path = controller()->GetTasksFilePath(path_);
     unique_fd tmp_fd(TEMP_FAILURE_RETRY(open(tasks_path.c_str(), O_WRONLY | O_CLOEXEC)));
     if (tmp_fd < 0) {
         PLOG(WARNING) << "Failed to open " << tasks_path << ": " << strerror(errno);
         return false;
     }
-    if (!AddTidToCgroup(tid, tmp_fd)) {
+    fd_ = std::move(tmp_fd);
+    if (!AddTidToCgroup(tid, fd_)) {
         LOG(ERROR) << "Failed to add task into cgroup";
         return false;
     }
@@ -275,6 +391,15 @@ bool ApplyProfileAction::ExecuteForTask(int tid) const {
     return true;
 }
 
+bool ApplyProfileAction::ExecuteForThreadGroup(const ThreadGroup& group) const {
+    for (const auto& profile : profiles_) {
+        if (!profile->ExecuteForThreadGroup(group)) {
+            PLOG(WARNING) << "ExecuteForThreadGroup failed for aggregate profile";
+        }
+    }
+    return true;
+}
+
 void ApplyProfileAction::EnableResourceCaching() {
     for (const auto& profile : profiles_) {
         profile->EnableResourceCaching();
@@ -313,6 +438,15 @@ bool TaskProfile::ExecuteForTask(int tid) const {
     return true;
 }
 
+bool TaskProfile::ExecuteForThreadGroup(const ThreadGroup& group) const {
+    for (const auto& element : elements_) {
+        if (!element->ExecuteForThreadGroup(group)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void TaskProfile::EnableResourceCaching() {
     if (res_cached_) {
         return;
@@ -350,21 +484,113 @@ TaskProfiles& TaskProfiles::GetInstance() {
     return *instance;
 }
 
-TaskProfiles::TaskProfiles() {
-    // load system task profiles
-    if (!Load(CgroupMap::GetInstance(), TASK_PROFILE_DB_FILE)) {
-        LOG(ERROR) << "Loading " << TASK_PROFILE_DB_FILE << " for [" << getpid() << "] failed";
+// Compiled task profiles are a sequence of records that follow the JSON files statement by
+// statement, so that loading them behaves exactly like loading the JSON files in the same order.
+// Each record is a RecordHeader followed by field_count NUL-terminated strings, each of them
+// preceded by its length as a uint32_t and padded to 4 bytes.  Names are still resolved when the
+// records are loaded, because cgroup controllers depend on the device.
+namespace {
+
+struct CompiledProfilesHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;
+
+    static constexpr uint32_t MAGIC = 0x46525054;  // "TPRF"
+    static constexpr uint32_t FILE_VERSION_1 = 1;
+    static constexpr uint32_t FILE_CURR_VERSION = FILE_VERSION_1;
+};
+
+enum RecordType : uint32_t {
+    RECORD_ATTRIBUTE = 1,          // Name, Controller, File
+    RECORD_PROFILE = 2,            // Name; followed by the records of its actions
+    RECORD_JOIN_CGROUP = 3,        // Controller, Path
+    RECORD_SET_TIMER_SLACK = 4,    // Slack
+    RECORD_SET_ATTRIBUTE = 5,      // Name, Value
+    RECORD_SET_CLAMPS = 6,         // Boost, Clamp
+    RECORD_AGGREGATE_PROFILE = 7,  // Name, Profiles...
+};
+
+struct RecordHeader {
+    uint32_t type;
+    uint32_t field_count;
+};
+
+struct Record {
+    uint32_t type;
+    std::vector<const char*> fields;
+};
+
+void AppendRecord(std::string* out, RecordType type, const std::vector<std::string>& fields) {
+    RecordHeader header = {type, static_cast<uint32_t>(fields.size())};
+    out->append(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (const auto& field : fields) {
+        uint32_t length = field.size();
+        out->append(reinterpret_cast<const char*>(&length), sizeof(length));
+        out->append(field);
+        out->append(4 - field.size() % 4, '\0');
+    }
+}
+
+bool IsActionRecord(uint32_t type) {
+    return type == RECORD_JOIN_CGROUP || type == RECORD_SET_TIMER_SLACK ||
+           type == RECORD_SET_ATTRIBUTE || type == RECORD_SET_CLAMPS;
+}
+
+bool HasValidFieldCount(const Record& record) {
+    switch (record.type) {
+        case RECORD_PROFILE:
+        case RECORD_SET_TIMER_SLACK:
+            return record.fields.size() == 1;
+        case RECORD_JOIN_CGROUP:
+        case RECORD_SET_ATTRIBUTE:
+        case RECORD_SET_CLAMPS:
+            return record.fields.size() == 2;
+        case RECORD_ATTRIBUTE:
+            return record.fields.size() == 3;
+        case RECORD_AGGREGATE_PROFILE:
+            return !record.fields.empty();
+        default:
+            return false;
     }
+}
 
-    // load vendor task profiles if the file exists
-    if (!access(TASK_PROFILE_DB_VENDOR_FILE, F_OK) &&
-        !Load(CgroupMap::GetInstance(), TASK_PROFILE_DB_VENDOR_FILE)) {
-        LOG(ERROR) << "Loading " << TASK_PROFILE_DB_VENDOR_FILE << " for [" << getpid()
-                   << "] failed";
+// Splits compiled profiles into records, or fails if any of them is malformed.
+bool ParseRecords(const char* data, size_t size, std::vector<Record>* records) {
+    auto read_u32 = [&data, &size](uint32_t* value) {
+        if (size < sizeof(*value)) return false;
+        memcpy(value, data, sizeof(*value));
+        data += sizeof(*value);
+        size -= sizeof(*value);
+        return true;
+    };
+
+    while (size > 0) {
+        Record record;
+        uint32_t field_count;
+        if (!read_u32(&record.type) || !read_u32(&field_count) || field_count > size / 8) {
+            return false;
+        }
+        for (uint32_t i = 0; i < field_count; ++i) {
+            uint32_t length;
+            if (!read_u32(&length) || length >= size || data[length] != '\0') {
+                return false;
+            }
+            record.fields.push_back(data);
+            size_t padded = (length + 4) & ~3u;
+            if (padded > size) {
+                return false;
+            }
+            data += padded;
+            size -= padded;
+        }
+        records->push_back(std::move(record));
     }
+    return true;
 }
 
-bool TaskProfiles::Load(const CgroupMap& cg_map, const std::string& file_name) {
+// Translates a task profiles JSON file into records.
+bool CompileProfiles(const std::string& file_name, std::string* out) {
     std::string json_doc;
 
     if (!android::base::ReadFileToString(file_name, &json_doc)) {
@@ -381,129 +607,288 @@ bool TaskProfiles::Load(const CgroupMap& cg_map, const std::string& file_name) {
 
     const Json::Value& attr = root["Attributes"];
     for (Json::Value::ArrayIndex i = 0; i < attr.size(); ++i) {
-        std::string name = attr[i]["Name"].asString();
-        std::string controller_name = attr[i]["Controller"].asString();
-        std::string file_attr = attr[i]["File"].asString();
-
-        auto controller = cg_map.FindController(controller_name);
-        if (controller.HasValue()) {
-            auto iter = attributes_.find(name);
-            if (iter == attributes_.end()) {
-                attributes_[name] = std::make_unique<ProfileAttribute>(controller, file_attr);
-            } else {
-                iter->second->Reset(controller, file_attr);
-            }
-        } else {
-            LOG(WARNING) << "Controller " << controller_name << " is not found";
-        }
+        AppendRecord(out, RECORD_ATTRIBUTE,
+                     {attr[i]["Name"].asString(), attr[i]["Controller"].asString(),
+                      attr[i]["File"].asString()});
     }
 
     const Json::Value& profiles_val = root["Profiles"];
     for (Json::Value::ArrayIndex i = 0; i < profiles_val.size(); ++i) {
         const Json::Value& profile_val = profiles_val[i];
+        AppendRecord(out, RECORD_PROFILE, {profile_val["Name"].asString()});
 
-        std::string profile_name = profile_val["Name"].asString();
         const Json::Value& actions = profile_val["Actions"];
-        auto profile = std::make_shared<TaskProfile>();
-
         for (Json::Value::ArrayIndex act_idx = 0; act_idx < actions.size(); ++act_idx) {
             const Json::Value& action_val = actions[act_idx];
             std::string action_name = action_val["Name"].asString();
             const Json::Value& params_val = action_val["Params"];
             if (action_name == "JoinCgroup") {
-                std::string controller_name = params_val["Controller"].asString();
-                std::string path = params_val["Path"].asString();
+                AppendRecord(out, RECORD_JOIN_CGROUP,
+                             {params_val["Controller"].asString(), params_val["Path"].asString()});
+            } else if (action_name == "SetTimerSlack") {
+                AppendRecord(out, RECORD_SET_TIMER_SLACK, {params_val["Slack"].asString()});
+            } else if (action_name == "SetAttribute") {
+                AppendRecord(out, RECORD_SET_ATTRIBUTE,
+                             {params_val["Name"].asString(), params_val["Value"].asString()});
+            } else if (action_name == "SetClamps") {
+                AppendRecord(out, RECORD_SET_CLAMPS,
+                             {params_val["Boost"].asString(), params_val["Clamp"].asString()});
+            } else {
+                LOG(WARNING) << "Unknown profile action: " << action_name;
+            }
+        }
+    }
+
+    const Json::Value& aggregateprofiles_val = root["AggregateProfiles"];
+    for (Json::Value::ArrayIndex i = 0; i < aggregateprofiles_val.size(); ++i) {
+        const Json::Value& aggregateprofile_val = aggregateprofiles_val[i];
+        std::vector<std::string> fields = {aggregateprofile_val["Name"].asString()};
+        const Json::Value& aggregateprofiles = aggregateprofile_val["Profiles"];
+        for (Json::Value::ArrayIndex pf_idx = 0; pf_idx < aggregateprofiles.size(); ++pf_idx) {
+            fields.push_back(aggregateprofiles[pf_idx].asString());
+        }
+        AppendRecord(out, RECORD_AGGREGATE_PROFILE, fields);
+    }
+
+    return true;
+}
+
+// Compiles the system task profiles, and the vendor ones if there are any.
+bool CompileAllProfiles(std::string* out) {
+    if (!CompileProfiles(TASK_PROFILE_DB_FILE, out)) {
+        return false;
+    }
+    if (!access(TASK_PROFILE_DB_VENDOR_FILE, F_OK) &&
+        !CompileProfiles(TASK_PROFILE_DB_VENDOR_FILE, out)) {
+        return false;
+    }
+    return true;
+}
+
+}  // namespace
+
+bool WriteTaskProfilesRcFile() {
+    if (access(TASK_PROFILES_RC_PATH, F_OK) == 0) {
+        return true;
+    }
+
+    CompiledProfilesHeader header = {CompiledProfilesHeader::MAGIC,
+                                     CompiledProfilesHeader::FILE_CURR_VERSION, 0};
+    std::string content(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (!CompileAllProfiles(&content)) {
+        return false;
+    }
+    header.size = content.size() - sizeof(header);
+    memcpy(content.data(), &header, sizeof(header));
+
+    // Written under a temporary name so that no process can see a partial file.
+    std::string tmp_path = std::string(TASK_PROFILES_RC_PATH) + ".tmp";
+    if (!android::base::WriteStringToFile(content, tmp_path, 0644, getuid(), getgid())) {
+        PLOG(ERROR) << "Failed to write " << tmp_path;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    if (rename(tmp_path.c_str(), TASK_PROFILES_RC_PATH) == -1) {
+        PLOG(ERROR) << "Failed to rename " << tmp_path << " to " << TASK_PROFILES_RC_PATH;
+        unlink(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+TaskProfiles::TaskProfiles() {
+    // Profiles compiled by init at boot spare every process from parsing JSON.
+    if (LoadCompiled(CgroupMap::GetInstance(), TASK_PROFILES_RC_PATH)) {
+        return;
+    }
+
+    // load system task profiles
+    if (!Load(CgroupMap::GetInstance(), TASK_PROFILE_DB_FILE)) {
+        LOG(ERROR) << "Loading " << TASK_PROFILE_DB_FILE << " for [" << getpid() << "] failed";
+    }
+
+    // load vendor task profiles if the file exists
+    if (!access(TASK_PROFILE_DB_VENDOR_FILE, F_OK) &&
+        !Load(CgroupMap::GetInstance(), TASK_PROFILE_DB_VENDOR_FILE)) {
+        LOG(ERROR) << "Loading " << TASK_PROFILE_DB_VENDOR_FILE << " for [" << getpid()
+                   << "] failed";
+    }
+}
+
+bool TaskProfiles::Load(const CgroupMap& cg_map, const std::string& file_name) {
+    std::string records;
+    if (!CompileProfiles(file_name, &records)) {
+        return false;
+    }
+    return LoadRecords(cg_map, records.data(), records.size());
+}
+
+bool TaskProfiles::LoadCompiled(const CgroupMap& cg_map, const std::string& file_name) {
+    unique_fd fd(TEMP_FAILURE_RETRY(open(file_name.c_str(), O_RDONLY | O_CLOEXEC)));
+    if (fd < 0) {
+        if (errno != ENOENT) {
+            PLOG(WARNING) << "Failed to open " << file_name;
+        }
+        return false;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) == -1 || static_cast<size_t>(sb.st_size) < sizeof(CompiledProfilesHeader)) {
+        LOG(WARNING) << "Invalid compiled task profiles " << file_name;
+        return false;
+    }
+    auto map = android::base::MappedFile::FromFd(fd, 0, sb.st_size, PROT_READ);
+    if (map == nullptr) {
+        PLOG(WARNING) << "Failed to map " << file_name;
+        return false;
+    }
+
+    CompiledProfilesHeader header;
+    memcpy(&header, map->data(), sizeof(header));
+    if (header.magic != CompiledProfilesHeader::MAGIC ||
+        header.version != CompiledProfilesHeader::FILE_CURR_VERSION ||
+        header.size != map->size() - sizeof(header)) {
+        LOG(WARNING) << "Invalid compiled task profiles " << file_name;
+        return false;
+    }
+    return LoadRecords(cg_map, map->data() + sizeof(header), header.size);
+}
+
+bool TaskProfiles::LoadRecords(const CgroupMap& cg_map, const char* data, size_t size) {
+    std::vector<Record> records;
+    if (!ParseRecords(data, size, &records)) {
+        LOG(ERROR) << "Malformed compiled task profiles";
+        return false;
+    }
+
+    // The profile that action records are added to, and its name.
+    std::shared_ptr<TaskProfile> profile;
+    std::string profile_name;
+    auto finish_profile = [this, &profile, &profile_name]() {
+        if (profile == nullptr) {
+            return;
+        }
+        auto iter = profiles_.find(profile_name);
+        if (iter == profiles_.end()) {
+            profiles_[profile_name] = profile;
+        } else {
+            // Move the content rather that replace the profile because old profile might be
+            // referenced from an aggregate profile if vendor overrides task profiles
+            profile->MoveTo(iter->second.get());
+        }
+        profile.reset();
+    };
+
+    for (const auto& record : records) {
+        const auto& fields = record.fields;
+        if (!HasValidFieldCount(record)) {
+            LOG(WARNING) << "Skipping malformed task profiles record of type " << record.type;
+            continue;
+        }
+        if (IsActionRecord(record.type) && profile == nullptr) {
+            LOG(WARNING) << "Skipping task profile action outside of a profile";
+            continue;
+        }
+        if (!IsActionRecord(record.type)) {
+            finish_profile();
+        }
 
-                auto controller = cg_map.FindController(controller_name);
+        switch (record.type) {
+            case RECORD_ATTRIBUTE: {
+                std::string name = fields[0];
+                auto controller = cg_map.FindController(fields[1]);
+                if (controller.HasValue()) {
+                    auto iter = attributes_.find(name);
+                    if (iter == attributes_.end()) {
+                        attributes_[name] =
+                                std::make_unique<ProfileAttribute>(controller, fields[2]);
+                    } else {
+                        iter->second->Reset(controller, fields[2]);
+                    }
+                } else {
+                    LOG(WARNING) << "Controller " << fields[1] << " is not found";
+                }
+                break;
+            }
+            case RECORD_PROFILE:
+                profile = std::make_shared<TaskProfile>();
+                profile_name = fields[0];
+                break;
+            case RECORD_JOIN_CGROUP: {
+                auto controller = cg_map.FindController(fields[0]);
                 if (controller.HasValue()) {
-                    profile->Add(std::make_unique<SetCgroupAction>(controller, path));
+                    profile->Add(std::make_unique<SetCgroupAction>(controller, fields[1]));
                 } else {
-                    LOG(WARNING) << "JoinCgroup: controller " << controller_name << " is not found";
+                    LOG(WARNING) << "JoinCgroup: controller " << fields[0] << " is not found";
                 }
-            } else if (action_name == "SetTimerSlack") {
-                std::string slack_value = params_val["Slack"].asString();
+                break;
+            }
+            case RECORD_SET_TIMER_SLACK: {
                 char* end;
-                unsigned long slack;
-
-                slack = strtoul(slack_value.c_str(), &end, 10);
-                if (end > slack_value.c_str()) {
+                unsigned long slack = strtoul(fields[0], &end, 10);
+                if (end > fields[0]) {
                     profile->Add(std::make_unique<SetTimerSlackAction>(slack));
                 } else {
-                    LOG(WARNING) << "SetTimerSlack: invalid parameter: " << slack_value;
+                    LOG(WARNING) << "SetTimerSlack: invalid parameter: " << fields[0];
                 }
-            } else if (action_name == "SetAttribute") {
-                std::string attr_name = params_val["Name"].asString();
-                std::string attr_value = params_val["Value"].asString();
-
-                auto iter = attributes_.find(attr_name);
+                break;
+            }
+            case RECORD_SET_ATTRIBUTE: {
+                auto iter = attributes_.find(fields[0]);
                 if (iter != attributes_.end()) {
                     profile->Add(
-                            std::make_unique<SetAttributeAction>(iter->second.get(), attr_value));
+                            std::make_unique<SetAttributeAction>(iter->second.get(), fields[1]));
                 } else {
-                    LOG(WARNING) << "SetAttribute: unknown attribute: " << attr_name;
+                    LOG(WARNING) << "SetAttribute: unknown attribute: " << fields[0];
                 }
-            } else if (action_name == "SetClamps") {
-                std::string boost_value = params_val["Boost"].asString();
-                std::string clamp_value = params_val["Clamp"].asString();
+                break;
+            }
+            case RECORD_SET_CLAMPS: {
                 char* end;
-                unsigned long boost;
-
-                boost = strtoul(boost_value.c_str(), &end, 10);
-                if (end > boost_value.c_str()) {
-                    unsigned long clamp = strtoul(clamp_value.c_str(), &end, 10);
-                    if (end > clamp_value.c_str()) {
+                unsigned long boost = strtoul(fields[0], &end, 10);
+                if (end > fields[0]) {
+                    unsigned long clamp = strtoul(fields[1], &end, 10);
+                    if (end > fields[1]) {
                         profile->Add(std::make_unique<SetClampsAction>(boost, clamp));
                     } else {
-                        LOG(WARNING) << "SetClamps: invalid parameter " << clamp_value;
+                        LOG(WARNING) << "SetClamps: invalid parameter " << fields[1];
                     }
                 } else {
-                    LOG(WARNING) << "SetClamps: invalid parameter: " << boost_value;
+                    LOG(WARNING) << "SetClamps: invalid parameter: " << fields[0];
                 }
-            } else {
-                LOG(WARNING) << "Unknown profile action: " << action_name;
-            }
-        }
-        auto iter = profiles_.find(profile_name);
-        if (iter == profiles_.end()) {
-            profiles_[profile_name] = profile;
-        } else {
-            // Move the content rather that replace the profile because old profile might be
-            // referenced from an aggregate profile if vendor overrides task profiles
-            profile->MoveTo(iter->second.get());
-            profile.reset();
-        }
-    }
-
-    const Json::Value& aggregateprofiles_val = root["AggregateProfiles"];
-    for (Json::Value::ArrayIndex i = 0; i < aggregateprofiles_val.size(); ++i) {
-        const Json::Value& aggregateprofile_val = aggregateprofiles_val[i];
-
-        std::string aggregateprofile_name = aggregateprofile_val["Name"].asString();
-        const Json::Value& aggregateprofiles = aggregateprofile_val["Profiles"];
-        std::vector<std::shared_ptr<TaskProfile>> profiles;
-        bool ret = true;
-
-        for (Json::Value::ArrayIndex pf_idx = 0; pf_idx < aggregateprofiles.size(); ++pf_idx) {
-            std::string profile_name = aggregateprofiles[pf_idx].asString();
-
-            if (profile_name == aggregateprofile_name) {
-                LOG(WARNING) << "AggregateProfiles: recursive profile name: " << profile_name;
-                ret = false;
                 break;
-            } else if (profiles_.find(profile_name) == profiles_.end()) {
-                LOG(WARNING) << "AggregateProfiles: undefined profile name: " << profile_name;
-                ret = false;
+            }
+            case RECORD_AGGREGATE_PROFILE: {
+                std::string aggregateprofile_name = fields[0];
+                std::vector<std::shared_ptr<TaskProfile>> profiles;
+                bool ret = true;
+
+                for (size_t pf_idx = 1; pf_idx < fields.size(); ++pf_idx) {
+                    std::string profile_name = fields[pf_idx];
+
+                    if (profile_name == aggregateprofile_name) {
+                        LOG(WARNING) << "AggregateProfiles: recursive profile name: "
+                                     << profile_name;
+                        ret = false;
+                        break;
+                    } else if (profiles_.find(profile_name) == profiles_.end()) {
+                        LOG(WARNING) << "AggregateProfiles: undefined profile name: "
+                                     << profile_name;
+                        ret = false;
+                        break;
+                    } else {
+                        profiles.push_back(profiles_[profile_name]);
+                    }
+                }
+                if (ret) {
+                    auto profile = std::make_shared<TaskProfile>();
+                    profile->Add(std::make_unique<ApplyProfileAction>(profiles));
+                    profiles_[aggregateprofile_name] = profile;
+                }
                 break;
-            } else {
-                profiles.push_back(profiles_[profile_name]);
             }
         }
-        if (ret) {
-            auto profile = std::make_shared<TaskProfile>();
-            profile->Add(std::make_unique<ApplyProfileAction>(profiles));
-            profiles_[aggregateprofile_name] = profile;
-        }
     }
+    finish_profile();
 
     return true;
 }
@@ -558,3 +943,50 @@ bool TaskProfiles::SetTaskProfiles(int tid, const std::vector<std::string>& prof
     }
     return true;
 }
+
+const TaskProfilesHandle* TaskProfiles::GetHandle(const std::vector<std::string>& profiles) {
+    std::lock_guard<std::mutex> lock(handles_mutex_);
+    auto& handle = handles_[profiles];
+    if (handle == nullptr) {
+        handle = std::make_unique<TaskProfilesHandle>();
+        handle->names = profiles;
+        for (const auto& name : profiles) {
+            handle->profiles.push_back(GetProfile(name));
+        }
+    }
+    return handle.get();
+}
+
+bool TaskProfiles::SetTaskProfiles(int tid, const TaskProfilesHandle& handle, bool use_fd_cache) {
+    for (size_t i = 0; i < handle.profiles.size(); ++i) {
+        TaskProfile* profile = handle.profiles[i];
+        if (profile != nullptr) {
+            if (use_fd_cache) {
+                profile->EnableResourceCaching();
+            }
+            if (!profile->ExecuteForTask(tid)) {
+                PLOG(WARNING) << "Failed to apply " << handle.names[i] << " task profile";
+            }
+        } else {
+            LOG(WARNING) << "Failed to find " << handle.names[i] << " task profile";
+        }
+    }
+    return true;
+}
+
+bool TaskProfiles::SetProcessThreadsProfiles(pid_t pid, const TaskProfilesHandle& handle) {
+    ThreadGroup group(pid);
+    for (size_t i = 0; i < handle.profiles.size(); ++i) {
+        TaskProfile* profile = handle.profiles[i];
+        if (profile != nullptr) {
+            profile->EnableResourceCaching();
+            if (!profile->ExecuteForThreadGroup(group)) {
+                PLOG(WARNING) << "Failed to apply " << handle.names[i] << " task profile to "
+                              << pid;
+            }
+        } else {
+            LOG(WARNING) << "Failed to find " << handle.names[i] << " task profile";
+        }
+    }
+    return true;
+}
@@ -42,6 +42,20 @@ class ProfileAttribute {
     std::string file_name_;
 };
 
+// The threads of a process, listed from /proc the first time they are asked for.
+class ThreadGroup {
+  public:
+    explicit ThreadGroup(pid_t pid) : pid_(pid) {}
+
+    pid_t pid() const { return pid_; }
+    const std::vector<int>& tids() const;
+
+  private:
+    pid_t pid_;
+    mutable bool listed_ = false;
+    mutable std::vector<int> tids_;
+};
+
 // Abstract profile element
 class ProfileAction {
   public:
@@ -50,6 +64,8 @@ class ProfileAction {
     // Default implementations will fail
     virtual bool ExecuteForProcess(uid_t, pid_t) const { return false; };
     virtual bool ExecuteForTask(int) const { return false; };
+    // Applies the action to all threads of a process; by default, one thread at a time.
+    virtual bool ExecuteForThreadGroup(const ThreadGroup& group) const;
 
     virtual void EnableResourceCaching() {}
     virtual void DropResourceCaching() {}
@@ -115,6 +131,7 @@ class SetCgroupAction : public ProfileAction {
 
     virtual bool ExecuteForProcess(uid_t uid, pid_t pid) const;
     virtual bool ExecuteForTask(int tid) const;
+    virtual bool ExecuteForThreadGroup(const ThreadGroup& group) const;
     virtual void EnableResourceCaching();
     virtual void DropResourceCaching();
 
@@ -128,14 +145,29 @@ class SetCgroupAction : public ProfileAction {
         FDS_NOT_CACHED = -3,
     };
 
+    // cgroup.procs files of app-dependent paths, for the last few processes they were opened for.
+    struct AppProcsFd {
+        uid_t uid = 0;
+        pid_t pid = 0;
+        android::base::unique_fd fd;
+    };
+    static constexpr size_t kAppProcsFdCacheSize = 8;
+
     CgroupController controller_;
     std::string path_;
-    android::base::unique_fd fd_;
+    // The tasks file, opened on first use or by EnableResourceCaching().
+    mutable android::base::unique_fd fd_;
+    // The cgroup.procs file, opened on first use, unless the path is app-dependent.
+    mutable android::base::unique_fd procs_fd_;
+    mutable AppProcsFd app_procs_fds_[kAppProcsFdCacheSize];
+    mutable size_t next_app_procs_fd_ = 0;
     mutable std::mutex fd_mutex_;
 
     static bool IsAppDependentPath(const std::string& path);
     static bool AddTidToCgroup(int tid, int fd);
 
+    int GetProcsFdLocked(uid_t uid, pid_t pid) const;
+    void DropProcsFdLocked(uid_t uid, pid_t pid) const;
     bool IsFdValid() const { return fd_ > FDS_INACCESSIBLE; }
 };
 
@@ -148,6 +180,7 @@ class TaskProfile {
 
     bool ExecuteForProcess(uid_t uid, pid_t pid) const;
     bool ExecuteForTask(int tid) const;
+    bool ExecuteForThreadGroup(const ThreadGroup& group) const;
     void EnableResourceCaching();
     void DropResourceCaching();
 
@@ -164,6 +197,7 @@ class ApplyProfileAction : public ProfileAction {
 
     virtual bool ExecuteForProcess(uid_t uid, pid_t pid) const;
     virtual bool ExecuteForTask(int tid) const;
+    virtual bool ExecuteForThreadGroup(const ThreadGroup& group) const;
     virtual void EnableResourceCaching();
     virtual void DropResourceCaching();
 
@@ -171,6 +205,13 @@ class ApplyProfileAction : public ProfileAction {
     std::vector<std::shared_ptr<TaskProfile>> profiles_;
 };
 
+// A list of profiles resolved by name, see GetTaskProfilesHandle().
+struct TaskProfilesHandle {
+    std::vector<std::string> names;
+    // Null where no profile has the name.
+    std::vector<TaskProfile*> profiles;
+};
+
 class TaskProfiles {
   public:
     // Should be used by all users
@@ -182,11 +223,21 @@ class TaskProfiles {
     bool SetProcessProfiles(uid_t uid, pid_t pid, const std::vector<std::string>& profiles);
     bool SetTaskProfiles(int tid, const std::vector<std::string>& profiles, bool use_fd_cache);
 
+    const TaskProfilesHandle* GetHandle(const std::vector<std::string>& profiles);
+    bool SetTaskProfiles(int tid, const TaskProfilesHandle& handle, bool use_fd_cache);
+    bool SetProcessThreadsProfiles(pid_t pid, const TaskProfilesHandle& handle);
+
   private:
     std::map<std::string, std::shared_ptr<TaskProfile>> profiles_;
     std::map<std::string, std::unique_ptr<ProfileAttribute>> attributes_;
+    // Handles are never freed, so the same lists of names share one.
+    std::map<std::vector<std::string>, std::unique_ptr<TaskProfilesHandle>> handles_;
+    std::mutex handles_mutex_;
 
     TaskProfiles();
 
     bool Load(const CgroupMap& cg_map, const std::string& file_name);
+    // Loads profiles compiled by WriteTaskProfilesRcFile().
+    bool LoadCompiled(const CgroupMap& cg_map, const std::string& file_name);
+    bool LoadRecords(const CgroupMap& cg_map, const char* data, size_t size);
 };
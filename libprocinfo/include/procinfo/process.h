@@ -24,6 +24,7 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <type_traits>
 
 #include <android-base/logging.h>
@@ -62,6 +63,13 @@ bool GetProcessInfo(pid_t tid, ProcessInfo* process_info, std::string* error = n
 // |fd| should be an fd pointing at a /proc/<pid> directory.
 bool GetProcessInfoFromProcPidFd(int fd, ProcessInfo* process_info, std::string* error = nullptr);
 
+// Parse the contents of a /proc/<tid>/status file into |process_info|.
+// Returns false if any of the fields of ProcessInfo are missing.
+bool ParseProcessStatus(std::string_view content, ProcessInfo* process_info);
+
+// Map the state letter used in /proc/<tid>/stat and status to a ProcessState.
+ProcessState ParseProcessState(char state);
+
 // Fetch the list of threads from a given process's /proc/<pid> directory.
 // |fd| should be an fd pointing at a /proc/<pid> directory.
 template <typename Collection>
@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -23,6 +24,7 @@
 
 #include <functional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <android-base/file.h>
@@ -30,117 +32,168 @@
 namespace android {
 namespace procinfo {
 
-template <class CallbackType>
-bool ReadMapFileContent(char* content, const CallbackType& callback) {
-  uint64_t start_addr;
-  uint64_t end_addr;
-  uint16_t flags;
-  uint64_t pgoff;
-  ino_t inode;
-  char* next_line = content;
-  char* p;
-
-  auto pass_space = [&]() {
-    if (*p != ' ') {
-      return false;
-    }
-    while (*p == ' ') {
-      p++;
+// Parses the hex number at |p|, stopping at |end| or at the first non-hex character.
+inline bool ParseMapHex(const char*& p, const char* end, uint64_t* value) {
+  const char* begin = p;
+  uint64_t v = 0;
+  for (; p != end; p++) {
+    unsigned c = static_cast<unsigned char>(*p);
+    if (c - '0' < 10) {
+      v = (v << 4) | (c - '0');
+    } else if ((c | 0x20) - 'a' < 6) {
+      v = (v << 4) | ((c | 0x20) - 'a' + 10);
+    } else {
+      break;
     }
-    return true;
-  };
+  }
+  *value = v;
+  return p != begin;
+}
 
-  auto pass_xdigit = [&]() {
-    if (!isxdigit(*p)) {
+// Parses a single line of a maps file, without its newline, like:
+// 00400000-00409000 r-xp 00000000 fc:00 426998  /usr/lib/gvfs/gvfsd-http
+// On success, |name| points at the rest of the line, which runs up to |end| and may be empty.
+inline bool ParseMapLine(const char* p, const char* end, uint64_t* start_addr, uint64_t* end_addr,
+                         uint16_t* flags, uint64_t* pgoff, ino_t* inode, const char** name) {
+  auto pass_space = [&]() {
+    if (p == end || *p != ' ') {
       return false;
     }
     do {
       p++;
-    } while (isxdigit(*p));
+    } while (p != end && *p == ' ');
     return true;
   };
 
+  uint64_t value;
+  // start_addr
+  if (!ParseMapHex(p, end, start_addr) || p == end || *p++ != '-') {
+    return false;
+  }
+  // end_addr
+  if (!ParseMapHex(p, end, end_addr) || !pass_space()) {
+    return false;
+  }
+  // flags
+  if (end - p < 4) {
+    return false;
+  }
+  *flags = 0;
+  if (p[0] == 'r') {
+    *flags |= PROT_READ;
+  } else if (p[0] != '-') {
+    return false;
+  }
+  if (p[1] == 'w') {
+    *flags |= PROT_WRITE;
+  } else if (p[1] != '-') {
+    return false;
+  }
+  if (p[2] == 'x') {
+    *flags |= PROT_EXEC;
+  } else if (p[2] != '-') {
+    return false;
+  }
+  if (p[3] != 'p' && p[3] != 's') {
+    return false;
+  }
+  p += 4;
+  if (!pass_space()) {
+    return false;
+  }
+  // pgoff
+  if (!ParseMapHex(p, end, pgoff) || !pass_space()) {
+    return false;
+  }
+  // major:minor
+  if (!ParseMapHex(p, end, &value) || p == end || *p++ != ':' || !ParseMapHex(p, end, &value) ||
+      !pass_space()) {
+    return false;
+  }
+  // inode
+  const char* digits = p;
+  value = 0;
+  for (; p != end && static_cast<unsigned>(*p - '0') < 10; p++) {
+    value = value * 10 + (*p - '0');
+  }
+  if (p == digits) {
+    return false;
+  }
+  *inode = value;
+
+  if (p != end && !pass_space()) {
+    return false;
+  }
+
+  // filename
+  *name = p;
+  return true;
+}
+
+// Parses |content|, the NUL-terminated contents of a maps file, in place: each newline is
+// replaced with a NUL so that the name passed to |callback| is a C string.
+template <class CallbackType>
+bool ReadMapFileContent(char* content, const CallbackType& callback) {
+  uint64_t start_addr;
+  uint64_t end_addr;
+  uint16_t flags;
+  uint64_t pgoff;
+  ino_t inode;
+  const char* name;
+  char* next_line = content;
+
   while (next_line != nullptr && *next_line != '\0') {
-    p = next_line;
+    char* line = next_line;
     next_line = strchr(next_line, '\n');
+    char* line_end;
     if (next_line != nullptr) {
+      line_end = next_line;
       *next_line = '\0';
       next_line++;
+    } else {
+      line_end = line + strlen(line);
     }
-    // Parse line like: 00400000-00409000 r-xp 00000000 fc:00 426998  /usr/lib/gvfs/gvfsd-http
-    char* end;
-    // start_addr
-    start_addr = strtoull(p, &end, 16);
-    if (end == p || *end != '-') {
-      return false;
-    }
-    p = end + 1;
-    // end_addr
-    end_addr = strtoull(p, &end, 16);
-    if (end == p) {
-      return false;
-    }
-    p = end;
-    if (!pass_space()) {
-      return false;
-    }
-    // flags
-    flags = 0;
-    if (*p == 'r') {
-      flags |= PROT_READ;
-    } else if (*p != '-') {
-      return false;
-    }
-    p++;
-    if (*p == 'w') {
-      flags |= PROT_WRITE;
-    } else if (*p != '-') {
-      return false;
-    }
-    p++;
-    if (*p == 'x') {
-      flags |= PROT_EXEC;
-    } else if (*p != '-') {
-      return false;
-    }
-    p++;
-    if (*p != 'p' && *p != 's') {
-      return false;
-    }
-    p++;
-    if (!pass_space()) {
-      return false;
-    }
-    // pgoff
-    pgoff = strtoull(p, &end, 16);
-    if (end == p) {
-      return false;
-    }
-    p = end;
-    if (!pass_space()) {
+    if (!ParseMapLine(line, line_end, &start_addr, &end_addr, &flags, &pgoff, &inode, &name)) {
       return false;
     }
-    // major:minor
-    if (!pass_xdigit() || *p++ != ':' || !pass_xdigit() || !pass_space()) {
-      return false;
-    }
-    // inode
-    inode = strtoull(p, &end, 10);
-    if (end == p) {
-      return false;
-    }
-    p = end;
+    callback(start_addr, end_addr, flags, pgoff, inode, name);
+  }
+  return true;
+}
 
-    if (*p != '\0' && !pass_space()) {
+// Parses |content|, the contents of a maps file, without modifying or copying it. The name passed
+// to |callback| is a std::string_view into |content|.
+template <class CallbackType>
+bool ParseMapFileContent(std::string_view content, const CallbackType& callback) {
+  uint64_t start_addr;
+  uint64_t end_addr;
+  uint16_t flags;
+  uint64_t pgoff;
+  ino_t inode;
+  const char* name;
+  const char* p = content.data();
+  const char* end = p + content.size();
+
+  while (p != end) {
+    const char* line_end = static_cast<const char*>(memchr(p, '\n', end - p));
+    if (line_end == nullptr) {
+      line_end = end;
+    }
+    if (!ParseMapLine(p, line_end, &start_addr, &end_addr, &flags, &pgoff, &inode, &name)) {
       return false;
     }
-
-    // filename
-    callback(start_addr, end_addr, flags, pgoff, inode, p);
+    callback(start_addr, end_addr, flags, pgoff, inode,
+             std::string_view(name, line_end - name));
+    p = line_end == end ? end : line_end + 1;
   }
   return true;
 }
 
+// Reads all of |map_file| into |buffer|, which is grown as needed and never shrunk, so that a
+// buffer reused across calls stops allocating once it is big enough. On success, |content| is
+// set to the part of |buffer| that holds the file.
+bool ReadMapFileToBuffer(const char* map_file, std::string* buffer, std::string_view* content);
+
 inline bool ReadMapFile(const std::string& map_file,
                         const std::function<void(uint64_t, uint64_t, uint16_t, uint64_t, ino_t,
                                                  const char*)>& callback) {
@@ -157,6 +210,21 @@ inline bool ReadProcessMaps(pid_t pid,
   return ReadMapFile("/proc/" + std::to_string(pid) + "/maps", callback);
 }
 
+// Reads and parses |map_file| using |buffer| as scratch space; see ParseMapFileContent. The name
+// passed to |callback| is only valid until |buffer| is next used.
+template <class CallbackType>
+bool ReadMapFile(const char* map_file, std::string* buffer, const CallbackType& callback) {
+  std::string_view content;
+  return ReadMapFileToBuffer(map_file, buffer, &content) && ParseMapFileContent(content, callback);
+}
+
+template <class CallbackType>
+bool ReadProcessMaps(pid_t pid, std::string* buffer, const CallbackType& callback) {
+  char map_file[32];
+  snprintf(map_file, sizeof(map_file), "/proc/%d/maps", pid);
+  return ReadMapFile(map_file, buffer, callback);
+}
+
 struct MapInfo {
   uint64_t start;
   uint64_t end;
@@ -168,12 +236,18 @@ struct MapInfo {
   MapInfo(uint64_t start, uint64_t end, uint16_t flags, uint64_t pgoff, ino_t inode,
           const char* name)
       : start(start), end(end), flags(flags), pgoff(pgoff), inode(inode), name(name) {}
+  MapInfo(uint64_t start, uint64_t end, uint16_t flags, uint64_t pgoff, ino_t inode,
+          std::string_view name)
+      : start(start), end(end), flags(flags), pgoff(pgoff), inode(inode), name(name) {}
 };
 
 inline bool ReadProcessMaps(pid_t pid, std::vector<MapInfo>* maps) {
-  return ReadProcessMaps(
-      pid, [&](uint64_t start, uint64_t end, uint16_t flags, uint64_t pgoff, ino_t inode,
-               const char* name) { maps->emplace_back(start, end, flags, pgoff, inode, name); });
+  std::string buffer;
+  return ReadProcessMaps(pid, &buffer,
+                         [&](uint64_t start, uint64_t end, uint16_t flags, uint64_t pgoff,
+                             ino_t inode, std::string_view name) {
+                           maps->emplace_back(start, end, flags, pgoff, inode, name);
+                         });
 }
 
 bool ReadMapFileAsyncSafe(const char* map_file, void* buffer, size_t buffer_size,
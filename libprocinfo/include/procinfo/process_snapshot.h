@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <procinfo/process.h>
+
+namespace android {
+namespace procinfo {
+
+#if defined(__linux__)
+
+// A snapshot of every process, or every thread, on the system.
+//
+// Update() walks /proc once and then reads stat, status and cmdline for all of the tasks it
+// found, spread across a few worker threads. The results are stored column by column: row i of
+// the snapshot is tids()[i], pids()[i], names()[i] and so on. Tasks that exit while the snapshot
+// is being taken are left out. Buffers are kept between updates, so a snapshot that is updated
+// periodically stops allocating once it has grown to fit the system.
+//
+// A ProcessSnapshot is not thread-safe.
+class ProcessSnapshot {
+ public:
+  struct Options {
+    // One row per thread, rather than one per process.
+    bool threads;
+    // Whether to read cmdline; it's the most expensive file to read.
+    bool cmdline;
+    // The number of threads reading /proc, including the caller. 0 means one per online CPU.
+    unsigned parallelism;
+  };
+
+  ProcessSnapshot() : ProcessSnapshot(Options{false, true, 0}) {}
+  explicit ProcessSnapshot(const Options& options);
+
+  // Takes a new snapshot. With |incremental|, status and cmdline are only read for tasks that are
+  // new since the last update, as identified by their tid and start time; stat, which has the
+  // state, parent and CPU times, is always read. Names, uids and command lines changed by an
+  // already known task in the meantime are missed. Returns false, leaving the snapshot empty, if
+  // /proc can't be read.
+  bool Update(bool incremental = false, std::string* error = nullptr);
+
+  size_t size() const { return tids_.size(); }
+
+  // Returns the row of |tid|, or -1 if it isn't in the snapshot.
+  ssize_t Find(pid_t tid) const;
+
+  // From the directory walk. A process's pid is its main thread's tid.
+  const std::vector<pid_t>& tids() const { return tids_; }
+  const std::vector<pid_t>& pids() const { return pids_; }
+
+  // From stat.
+  const std::vector<pid_t>& ppids() const { return ppids_; }
+  const std::vector<ProcessState>& states() const { return states_; }
+  // In clock ticks.
+  const std::vector<uint64_t>& utimes() const { return utimes_; }
+  const std::vector<uint64_t>& stimes() const { return stimes_; }
+  const std::vector<uint64_t>& start_times() const { return start_times_; }
+  // In pages.
+  const std::vector<uint64_t>& rss() const { return rss_; }
+
+  // From status.
+  const std::vector<std::string>& names() const { return names_; }
+  const std::vector<uid_t>& uids() const { return uids_; }
+  const std::vector<gid_t>& gids() const { return gids_; }
+  const std::vector<pid_t>& tracers() const { return tracers_; }
+
+  // From cmdline, with the arguments separated by NULs. Empty for kernel threads, and if
+  // Options::cmdline isn't set.
+  const std::vector<std::string>& cmdlines() const { return cmdlines_; }
+
+ private:
+  bool ListTasks(int proc_fd, std::string* error);
+  void ReadTasks(int proc_fd, bool incremental);
+  bool ReadTask(int proc_fd, size_t row, bool incremental, std::string* buffer);
+  void Resize(size_t size);
+  void Compact();
+
+  Options options_;
+
+  // Scratch space for getdents64 and for each worker's reads.
+  std::vector<char> proc_dirents_;
+  std::vector<char> task_dirents_;
+  std::vector<std::string> buffers_;
+  // Whether each row's task was read successfully, and the row of each tid in this update and
+  // the previous one.
+  std::vector<char> valid_;
+  std::unordered_map<pid_t, size_t> index_;
+  std::unordered_map<pid_t, size_t> previous_index_;
+
+  std::vector<pid_t> tids_;
+  std::vector<pid_t> pids_;
+  std::vector<pid_t> ppids_;
+  std::vector<ProcessState> states_;
+  std::vector<uint64_t> utimes_;
+  std::vector<uint64_t> stimes_;
+  std::vector<uint64_t> start_times_;
+  std::vector<uint64_t> rss_;
+  std::vector<std::string> names_;
+  std::vector<uid_t> uids_;
+  std::vector<gid_t> gids_;
+  std::vector<pid_t> tracers_;
+  std::vector<std::string> cmdlines_;
+
+  // The previous update's columns that can be carried over by an incremental update.
+  std::vector<uint64_t> previous_start_times_;
+  std::vector<std::string> previous_names_;
+  std::vector<uid_t> previous_uids_;
+  std::vector<gid_t> previous_gids_;
+  std::vector<pid_t> previous_tracers_;
+  std::vector<std::string> previous_cmdlines_;
+};
+
+#endif
+
+} /* namespace procinfo */
+} /* namespace android */
@@ -22,7 +22,9 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <string>
+#include <string_view>
 
 #include <android-base/unique_fd.h>
 
@@ -46,8 +48,8 @@ bool GetProcessInfo(pid_t tid, ProcessInfo* process_info, std::string* error) {
   return GetProcessInfoFromProcPidFd(dirfd.get(), process_info, error);
 }
 
-static ProcessState parse_state(const char* state) {
-  switch (*state) {
+ProcessState ParseProcessState(char state) {
+  switch (state) {
     case 'R':
       return kProcessStateRunning;
     case 'S':
@@ -63,8 +65,25 @@ static ProcessState parse_state(const char* state) {
   }
 }
 
+// Parses the first number in |value|, like atoi().
+static int parse_int(std::string_view value) {
+  size_t i = 0;
+  while (i < value.size() && (value[i] == ' ' || value[i] == '\t')) {
+    i++;
+  }
+  bool negative = i < value.size() && value[i] == '-';
+  if (negative) {
+    i++;
+  }
+  unsigned int result = 0;
+  for (; i < value.size() && static_cast<unsigned>(value[i] - '0') < 10; i++) {
+    result = result * 10 + (value[i] - '0');
+  }
+  return negative ? -static_cast<int>(result) : static_cast<int>(result);
+}
+
 bool GetProcessInfoFromProcPidFd(int fd, ProcessInfo* process_info, std::string* error) {
-  int status_fd = openat(fd, "status", O_RDONLY | O_CLOEXEC);
+  unique_fd status_fd(openat(fd, "status", O_RDONLY | O_CLOEXEC));
 
   if (status_fd == -1) {
     if (error != nullptr) {
@@ -73,61 +92,81 @@ bool GetProcessInfoFromProcPidFd(int fd, ProcessInfo* process_info, std::string*
     return false;
   }
 
-  std::unique_ptr<FILE, decltype(&fclose)> fp(fdopen(status_fd, "r"), fclose);
-  if (!fp) {
+  // All of the fields we want come before the variable-length ones like Groups, so they fit in
+  // a fixed buffer and the file can be read without allocating or going through stdio.
+  char buf[4096];
+  size_t len = 0;
+  while (len < sizeof(buf)) {
+    ssize_t bytes = TEMP_FAILURE_RETRY(read(status_fd, buf + len, sizeof(buf) - len));
+    if (bytes == -1) {
+      if (error != nullptr) {
+        *error = "failed to read status file in GetProcessInfoFromProcPidFd";
+      }
+      return false;
+    }
+    if (bytes == 0) {
+      break;
+    }
+    len += bytes;
+  }
+
+  std::string_view content(buf, len);
+  if (len == sizeof(buf)) {
+    // A partial line at the end of a full buffer is of no use.
+    content = content.substr(0, content.rfind('\n') + 1);
+  }
+  if (!ParseProcessStatus(content, process_info)) {
     if (error != nullptr) {
-      *error = "failed to open status file in GetProcessInfoFromProcPidFd";
+      *error = "missing fields in status file in GetProcessInfoFromProcPidFd";
     }
-    close(status_fd);
     return false;
   }
+  return true;
+}
 
+bool ParseProcessStatus(std::string_view content, ProcessInfo* process_info) {
   int field_bitmap = 0;
   static constexpr int finished_bitmap = 255;
-  char* line = nullptr;
-  size_t len = 0;
 
-  while (getline(&line, &len, fp.get()) != -1 && field_bitmap != finished_bitmap) {
-    char* tab = strchr(line, '\t');
-    if (tab == nullptr) {
+  while (!content.empty() && field_bitmap != finished_bitmap) {
+    size_t newline = std::min(content.find('\n'), content.size());
+    std::string_view line = content.substr(0, newline);
+    content.remove_prefix(std::min(newline + 1, content.size()));
+
+    size_t tab = line.find('\t');
+    if (tab == std::string_view::npos) {
       continue;
     }
 
-    size_t header_len = tab - line;
-    std::string header = std::string(line, header_len);
+    std::string_view header = line.substr(0, tab);
+    std::string_view value = line.substr(tab + 1);
     if (header == "Name:") {
-      std::string name = line + header_len + 1;
-
-      // line includes the trailing newline.
-      name.pop_back();
-      process_info->name = std::move(name);
-
+      process_info->name = value;
       field_bitmap |= 1;
     } else if (header == "Pid:") {
-      process_info->tid = atoi(tab + 1);
+      process_info->tid = parse_int(value);
       field_bitmap |= 2;
     } else if (header == "Tgid:") {
-      process_info->pid = atoi(tab + 1);
+      process_info->pid = parse_int(value);
       field_bitmap |= 4;
     } else if (header == "PPid:") {
-      process_info->ppid = atoi(tab + 1);
+      process_info->ppid = parse_int(value);
       field_bitmap |= 8;
     } else if (header == "TracerPid:") {
-      process_info->tracer = atoi(tab + 1);
+      process_info->tracer = parse_int(value);
       field_bitmap |= 16;
     } else if (header == "Uid:") {
-      process_info->uid = atoi(tab + 1);
+      process_info->uid = parse_int(value);
       field_bitmap |= 32;
     } else if (header == "Gid:") {
-      process_info->gid = atoi(tab + 1);
+      process_info->gid = parse_int(value);
       field_bitmap |= 64;
     } else if (header == "State:") {
-      process_info->state = parse_state(tab + 1);
+      process_info->state = ParseProcessState(value.empty() ? '\0' : value[0]);
       field_bitmap |= 128;
     }
   }
 
-  free(line);
   return field_bitmap == finished_bitmap;
 }
 
@@ -20,6 +20,7 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <android-base/unique_fd.h>
 #include <procinfo/process.h>
 
 namespace android {
@@ -93,5 +94,35 @@ bool ReadMapFileAsyncSafe(const char* map_file, void* buffer, size_t buffer_size
   }
 }
 
+bool ReadMapFileToBuffer(const char* map_file, std::string* buffer, std::string_view* content) {
+  android::base::unique_fd fd(open(map_file, O_RDONLY | O_CLOEXEC));
+  if (fd == -1) {
+    return false;
+  }
+
+  // The buffer is used at its full size rather than cleared and appended to, so that reusing it
+  // doesn't zero it again. Large reads also mean fewer trips through the kernel's seq_file code.
+  static constexpr size_t kMinBufferSize = 64 * 1024;
+  if (buffer->size() < kMinBufferSize) {
+    buffer->resize(kMinBufferSize);
+  }
+  size_t used = 0;
+  while (true) {
+    if (used == buffer->size()) {
+      buffer->resize(buffer->size() * 2);
+    }
+    ssize_t bytes = TEMP_FAILURE_RETRY(read(fd, &(*buffer)[used], buffer->size() - used));
+    if (bytes == -1) {
+      return false;
+    }
+    if (bytes == 0) {
+      break;
+    }
+    used += bytes;
+  }
+  *content = std::string_view(buffer->data(), used);
+  return true;
+}
+
 } /* namespace procinfo */
 } /* namespace android */
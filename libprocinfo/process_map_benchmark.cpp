@@ -16,52 +16,126 @@
 
 #include <procinfo/process_map.h>
 
+#include <inttypes.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 
+#include <map>
+#include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
+#include <android-base/stringprintf.h>
 #include <backtrace/BacktraceMap.h>
 #include <unwindstack/Maps.h>
 
 #include <benchmark/benchmark.h>
 
-static void BM_ReadMapFile(benchmark::State& state) {
+static constexpr size_t kMapsPerFile = 2043;
+
+// Returns the path to a maps file with |copies| copies of the maps in testdata/maps, so that
+// processes with tens of thousands of maps can be covered as well. Each copy is moved up in the
+// address space, so the file stays sorted like a real one.
+static std::string GetMapFile(int64_t copies) {
   std::string map_file = android::base::GetExecutableDirectory() + "/testdata/maps";
+  if (copies == 1) {
+    return map_file;
+  }
+
+  static std::map<int64_t, std::unique_ptr<TemporaryFile>> files;
+  std::unique_ptr<TemporaryFile>& file = files[copies];
+  if (file == nullptr) {
+    std::vector<android::procinfo::MapInfo> maps;
+    CHECK(android::procinfo::ReadMapFile(
+        map_file, [&](uint64_t start, uint64_t end, uint16_t flags, uint64_t pgoff, ino_t inode,
+                      const char* name) {
+          maps.emplace_back(start, end, flags, pgoff, inode, name);
+        }));
+    std::string content;
+    for (int64_t i = 0; i < copies; i++) {
+      uint64_t shift = static_cast<uint64_t>(i) << 40;
+      for (const auto& map : maps) {
+        content += android::base::StringPrintf(
+            "%" PRIx64 "-%" PRIx64 " %c%c%cp %08" PRIx64 " 00:00 %" PRIu64 " %s\n",
+            map.start + shift, map.end + shift, (map.flags & PROT_READ) ? 'r' : '-',
+            (map.flags & PROT_WRITE) ? 'w' : '-', (map.flags & PROT_EXEC) ? 'x' : '-', map.pgoff,
+            static_cast<uint64_t>(map.inode), map.name.c_str());
+      }
+    }
+    file = std::make_unique<TemporaryFile>();
+    CHECK(android::base::WriteStringToFd(content, file->fd));
+  }
+  return file->path;
+}
+
+static void BM_ReadMapFile(benchmark::State& state) {
+  std::string map_file = GetMapFile(state.range(0));
   for (auto _ : state) {
     std::vector<android::procinfo::MapInfo> maps;
     android::procinfo::ReadMapFile(map_file, [&](uint64_t start, uint64_t end, uint16_t flags,
                                                  uint64_t pgoff, ino_t inode, const char* name) {
       maps.emplace_back(start, end, flags, pgoff, inode, name);
     });
-    CHECK_EQ(maps.size(), 2043u);
+    CHECK_EQ(maps.size(), kMapsPerFile * state.range(0));
+  }
+}
+BENCHMARK(BM_ReadMapFile)->Arg(1)->Arg(10);
+
+static void BM_ReadMapFile_buffer(benchmark::State& state) {
+  std::string map_file = GetMapFile(state.range(0));
+  std::string buffer;
+  for (auto _ : state) {
+    size_t count = 0;
+    android::procinfo::ReadMapFile(
+        map_file.c_str(), &buffer,
+        [&](uint64_t, uint64_t, uint16_t, uint64_t, ino_t, std::string_view name) {
+          benchmark::DoNotOptimize(name);
+          count++;
+        });
+    CHECK_EQ(count, kMapsPerFile * state.range(0));
+  }
+}
+BENCHMARK(BM_ReadMapFile_buffer)->Arg(1)->Arg(10);
+
+static void BM_ParseMapFileContent(benchmark::State& state) {
+  std::string content;
+  CHECK(android::base::ReadFileToString(GetMapFile(state.range(0)), &content));
+  for (auto _ : state) {
+    size_t count = 0;
+    android::procinfo::ParseMapFileContent(
+        content, [&](uint64_t, uint64_t, uint16_t, uint64_t, ino_t, std::string_view name) {
+          benchmark::DoNotOptimize(name);
+          count++;
+        });
+    CHECK_EQ(count, kMapsPerFile * state.range(0));
   }
 }
-BENCHMARK(BM_ReadMapFile);
+BENCHMARK(BM_ParseMapFileContent)->Arg(1)->Arg(10);
 
 static void BM_unwindstack_FileMaps(benchmark::State& state) {
-  std::string map_file = android::base::GetExecutableDirectory() + "/testdata/maps";
+  std::string map_file = GetMapFile(state.range(0));
   for (auto _ : state) {
     unwindstack::FileMaps maps(map_file);
     maps.Parse();
-    CHECK_EQ(maps.Total(), 2043u);
+    CHECK_EQ(maps.Total(), kMapsPerFile * state.range(0));
   }
 }
-BENCHMARK(BM_unwindstack_FileMaps);
+BENCHMARK(BM_unwindstack_FileMaps)->Arg(1)->Arg(10);
 
 static void BM_unwindstack_BufferMaps(benchmark::State& state) {
-  std::string map_file = android::base::GetExecutableDirectory() + "/testdata/maps";
   std::string content;
-  CHECK(android::base::ReadFileToString(map_file, &content));
+  CHECK(android::base::ReadFileToString(GetMapFile(state.range(0)), &content));
   for (auto _ : state) {
     unwindstack::BufferMaps maps(content.c_str());
     maps.Parse();
-    CHECK_EQ(maps.Total(), 2043u);
+    CHECK_EQ(maps.Total(), kMapsPerFile * state.range(0));
   }
 }
-BENCHMARK(BM_unwindstack_BufferMaps);
+BENCHMARK(BM_unwindstack_BufferMaps)->Arg(1)->Arg(10);
 
 static void BM_backtrace_BacktraceMap(benchmark::State& state) {
   pid_t pid = getpid();
@@ -20,6 +20,7 @@
 #include <sys/mman.h>
 
 #include <string>
+#include <string_view>
 #include <vector>
 
 #include <android-base/file.h>
@@ -69,6 +70,84 @@ TEST(process_map, ReadProcessMaps) {
   ASSERT_GT(maps.size(), 0u);
 }
 
+TEST(process_map, ReadMapFile_buffer) {
+  std::string map_file = android::base::GetExecutableDirectory() + "/testdata/maps";
+  std::vector<android::procinfo::MapInfo> expected;
+  ASSERT_TRUE(android::procinfo::ReadMapFile(
+      map_file,
+      [&](uint64_t start, uint64_t end, uint16_t flags, uint64_t pgoff, ino_t inode,
+          const char* name) { expected.emplace_back(start, end, flags, pgoff, inode, name); }));
+
+  // A small buffer has to grow, and the second read reuses it.
+  std::string buffer(16, '\0');
+  for (size_t i = 0; i < 2; i++) {
+    std::vector<android::procinfo::MapInfo> maps;
+    ASSERT_TRUE(android::procinfo::ReadMapFile(
+        map_file.c_str(), &buffer,
+        [&](uint64_t start, uint64_t end, uint16_t flags, uint64_t pgoff, ino_t inode,
+            std::string_view name) { maps.emplace_back(start, end, flags, pgoff, inode, name); }));
+    ASSERT_EQ(expected.size(), maps.size());
+    for (size_t j = 0; j < maps.size(); j++) {
+      ASSERT_EQ(expected[j].start, maps[j].start);
+      ASSERT_EQ(expected[j].end, maps[j].end);
+      ASSERT_EQ(expected[j].flags, maps[j].flags);
+      ASSERT_EQ(expected[j].pgoff, maps[j].pgoff);
+      ASSERT_EQ(expected[j].inode, maps[j].inode);
+      ASSERT_EQ(expected[j].name, maps[j].name);
+    }
+  }
+
+  ASSERT_FALSE(android::procinfo::ReadMapFile(
+      "/does/not/exist", &buffer,
+      [](uint64_t, uint64_t, uint16_t, uint64_t, ino_t, std::string_view) {}));
+}
+
+TEST(process_map, ReadProcessMaps_buffer) {
+  std::string buffer;
+  size_t count = 0;
+  ASSERT_TRUE(android::procinfo::ReadProcessMaps(
+      getpid(), &buffer,
+      [&](uint64_t, uint64_t, uint16_t, uint64_t, ino_t, std::string_view) { count++; }));
+  ASSERT_GT(count, 0u);
+}
+
+TEST(process_map, ParseMapFileContent) {
+  std::vector<android::procinfo::MapInfo> maps;
+  auto callback = [&](uint64_t start, uint64_t end, uint16_t flags, uint64_t pgoff, ino_t inode,
+                      std::string_view name) {
+    maps.emplace_back(start, end, flags, pgoff, inode, name);
+  };
+
+  // The content isn't NUL-terminated, and the last line has no newline.
+  std::string content =
+      "12c00000-2ac00000 rw-p 00000000 00:05 10267643   [anon:dalvik-main space]\n"
+      "70e6c4f000-70e6c6b000 r-xs 0000A000 fd:00 2407  /system/lib64/libutils.so\n"
+      "70e6c6b000-70e6c6c000 ---p 00000000 00:00 0\n"
+      "7fffffff000-80000000000 r--p 00000000 00:00 0 name with  spaces Xtrailing";
+  ASSERT_TRUE(android::procinfo::ParseMapFileContent(
+      std::string_view(content.data(), content.size() - strlen("Xtrailing")), callback));
+  ASSERT_EQ(4u, maps.size());
+  EXPECT_EQ(0x12c00000ULL, maps[0].start);
+  EXPECT_EQ(0x2ac00000ULL, maps[0].end);
+  EXPECT_EQ(PROT_READ | PROT_WRITE, maps[0].flags);
+  EXPECT_EQ(10267643UL, maps[0].inode);
+  EXPECT_EQ("[anon:dalvik-main space]", maps[0].name);
+  EXPECT_EQ(0x70e6c4f000ULL, maps[1].start);
+  EXPECT_EQ(PROT_READ | PROT_EXEC, maps[1].flags);
+  EXPECT_EQ(0xa000ULL, maps[1].pgoff);
+  EXPECT_EQ("/system/lib64/libutils.so", maps[1].name);
+  EXPECT_EQ(0, maps[2].flags);
+  EXPECT_EQ("", maps[2].name);
+  EXPECT_EQ(0x80000000000ULL, maps[3].end);
+  EXPECT_EQ("name with  spaces ", maps[3].name);
+
+  for (const char* bad : {"", "\n", "12c00000 rw-p 00000000 00:05 0", "1-2 rw-p 0 00:05",
+                          "1-2 rw-q 0 00:05 0", "1-2 rw-p 0 0005 0", "1-2 rw-p 0 00:05 0x"}) {
+    maps.clear();
+    EXPECT_EQ(*bad == '\0', android::procinfo::ParseMapFileContent(bad, callback)) << bad;
+  }
+}
+
 extern "C" void malloc_disable();
 extern "C" void malloc_enable();
 
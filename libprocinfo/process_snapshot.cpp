@@ -0,0 +1,346 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <procinfo/process_snapshot.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string_view>
+#include <thread>
+
+#include <android-base/unique_fd.h>
+
+using android::base::unique_fd;
+
+namespace android {
+namespace procinfo {
+
+// Rows are handed out to the workers in batches of this many, and there's no point in starting
+// a worker for fewer than kMinRowsPerWorker.
+static constexpr size_t kRowsPerBatch = 16;
+static constexpr size_t kMinRowsPerWorker = 64;
+
+// Calls |callback| with each numeric entry of the directory |dir_fd|.
+template <typename CallbackType>
+static bool ForEachPid(int dir_fd, std::vector<char>* buffer, const CallbackType& callback) {
+  if (buffer->empty()) {
+    buffer->resize(32 * 1024);
+  }
+  while (true) {
+    // getdents64 has no libc wrapper.
+    long bytes = TEMP_FAILURE_RETRY(
+        syscall(__NR_getdents64, dir_fd, buffer->data(), buffer->size()));
+    if (bytes <= 0) {
+      return bytes == 0;
+    }
+    for (long offset = 0; offset < bytes;) {
+      const dirent64* entry = reinterpret_cast<const dirent64*>(buffer->data() + offset);
+      offset += entry->d_reclen;
+
+      pid_t pid = 0;
+      const char* p = entry->d_name;
+      for (; static_cast<unsigned>(*p - '0') < 10; p++) {
+        pid = pid * 10 + (*p - '0');
+      }
+      if (p != entry->d_name && *p == '\0') {
+        callback(pid);
+      }
+    }
+  }
+}
+
+// Reads all of |path|, relative to |dir_fd|, into |buffer|, which is grown as needed.
+static bool ReadFileAt(int dir_fd, const char* path, std::string* buffer,
+                       std::string_view* content) {
+  unique_fd fd(openat(dir_fd, path, O_RDONLY | O_CLOEXEC));
+  if (fd == -1) {
+    return false;
+  }
+
+  if (buffer->size() < 4096) {
+    buffer->resize(4096);
+  }
+  size_t used = 0;
+  while (true) {
+    if (used == buffer->size()) {
+      buffer->resize(buffer->size() * 2);
+    }
+    ssize_t bytes = TEMP_FAILURE_RETRY(read(fd, &(*buffer)[used], buffer->size() - used));
+    if (bytes == -1) {
+      return false;
+    }
+    if (bytes == 0) {
+      break;
+    }
+    used += bytes;
+  }
+  *content = std::string_view(buffer->data(), used);
+  return true;
+}
+
+// Parses the fields we want out of the contents of a /proc/<tid>/stat file.
+static bool ParseStat(std::string_view content, ProcessState* state, pid_t* ppid,
+                      uint64_t* utime, uint64_t* stime, uint64_t* start_time, uint64_t* rss) {
+  // The name in the second field is in parentheses, and can contain anything.
+  size_t paren = content.rfind(')');
+  if (paren == std::string_view::npos || content.size() < paren + 3) {
+    return false;
+  }
+  content.remove_prefix(paren + 2);
+  *state = ParseProcessState(content[0]);
+
+  // The rest of the fields, from the fourth on, are numbers separated by single spaces.
+  size_t field = 3;
+  size_t i = 1;
+  while (field < 24) {
+    if (i == content.size() || content[i] != ' ') {
+      return false;
+    }
+    i++;
+    field++;
+    if (i < content.size() && content[i] == '-') {
+      i++;
+    }
+    size_t digits = i;
+    uint64_t value = 0;
+    for (; i < content.size() && static_cast<unsigned>(content[i] - '0') < 10; i++) {
+      value = value * 10 + (content[i] - '0');
+    }
+    if (i == digits) {
+      return false;
+    }
+    switch (field) {
+      case 4:
+        *ppid = value;
+        break;
+      case 14:
+        *utime = value;
+        break;
+      case 15:
+        *stime = value;
+        break;
+      case 22:
+        *start_time = value;
+        break;
+      case 24:
+        *rss = value;
+        break;
+    }
+  }
+  return true;
+}
+
+ProcessSnapshot::ProcessSnapshot(const Options& options) : options_(options) {
+  if (options_.parallelism == 0) {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    options_.parallelism = cpus > 0 ? cpus : 1;
+  }
+}
+
+bool ProcessSnapshot::Update(bool incremental, std::string* error) {
+  // The previous snapshot is kept for incremental updates, and its strings' buffers for reuse.
+  previous_index_.swap(index_);
+  previous_start_times_.swap(start_times_);
+  previous_names_.swap(names_);
+  previous_uids_.swap(uids_);
+  previous_gids_.swap(gids_);
+  previous_tracers_.swap(tracers_);
+  previous_cmdlines_.swap(cmdlines_);
+
+  unique_fd proc_fd(open("/proc", O_DIRECTORY | O_RDONLY | O_CLOEXEC));
+  if (proc_fd == -1 || !ListTasks(proc_fd.get(), error)) {
+    if (proc_fd == -1 && error != nullptr) {
+      *error = "failed to open /proc";
+    }
+    tids_.clear();
+    pids_.clear();
+    Resize(0);
+    index_.clear();
+    return false;
+  }
+
+  Resize(tids_.size());
+  ReadTasks(proc_fd.get(), incremental);
+  Compact();
+  return true;
+}
+
+ssize_t ProcessSnapshot::Find(pid_t tid) const {
+  auto it = index_.find(tid);
+  return it == index_.end() ? -1 : it->second;
+}
+
+bool ProcessSnapshot::ListTasks(int proc_fd, std::string* error) {
+  tids_.clear();
+  pids_.clear();
+  bool listed = ForEachPid(proc_fd, &proc_dirents_, [&](pid_t pid) {
+    if (!options_.threads) {
+      tids_.push_back(pid);
+      pids_.push_back(pid);
+      return;
+    }
+
+    char path[32];
+    snprintf(path, sizeof(path), "%d/task", pid);
+    unique_fd task_fd(openat(proc_fd, path, O_DIRECTORY | O_RDONLY | O_CLOEXEC));
+    if (task_fd == -1) {
+      // The process has already exited.
+      return;
+    }
+    ForEachPid(task_fd.get(), &task_dirents_, [&](pid_t tid) {
+      tids_.push_back(tid);
+      pids_.push_back(pid);
+    });
+  });
+  if (!listed && error != nullptr) {
+    *error = "failed to read /proc";
+  }
+  return listed;
+}
+
+void ProcessSnapshot::ReadTasks(int proc_fd, bool incremental) {
+  size_t size = tids_.size();
+  size_t workers = std::max<size_t>(
+      1, std::min<size_t>(options_.parallelism, size / kMinRowsPerWorker));
+  if (buffers_.size() < workers) {
+    buffers_.resize(workers);
+  }
+
+  std::atomic<size_t> next_row(0);
+  auto work = [&](std::string* buffer) {
+    size_t begin;
+    while ((begin = next_row.fetch_add(kRowsPerBatch, std::memory_order_relaxed)) < size) {
+      size_t end = std::min(begin + kRowsPerBatch, size);
+      for (size_t row = begin; row < end; row++) {
+        valid_[row] = ReadTask(proc_fd, row, incremental, buffer);
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < workers; i++) {
+    threads.emplace_back(work, &buffers_[i]);
+  }
+  work(&buffers_[0]);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+bool ProcessSnapshot::ReadTask(int proc_fd, size_t row, bool incremental, std::string* buffer) {
+  char path[64];
+  int dir_len = options_.threads ? snprintf(path, sizeof(path), "%d/task/%d/", pids_[row],
+                                            tids_[row])
+                                 : snprintf(path, sizeof(path), "%d/", tids_[row]);
+  auto read_file = [&](const char* file, std::string_view* content) {
+    snprintf(path + dir_len, sizeof(path) - dir_len, "%s", file);
+    return ReadFileAt(proc_fd, path, buffer, content);
+  };
+
+  std::string_view content;
+  if (!read_file("stat", &content) ||
+      !ParseStat(content, &states_[row], &ppids_[row], &utimes_[row], &stimes_[row],
+                 &start_times_[row], &rss_[row])) {
+    return false;
+  }
+
+  if (incremental) {
+    auto it = previous_index_.find(tids_[row]);
+    if (it != previous_index_.end() && previous_start_times_[it->second] == start_times_[row]) {
+      size_t previous_row = it->second;
+      names_[row].swap(previous_names_[previous_row]);
+      uids_[row] = previous_uids_[previous_row];
+      gids_[row] = previous_gids_[previous_row];
+      tracers_[row] = previous_tracers_[previous_row];
+      cmdlines_[row].swap(previous_cmdlines_[previous_row]);
+      return true;
+    }
+  }
+
+  ProcessInfo info;
+  info.name.swap(names_[row]);
+  bool parsed = read_file("status", &content) && ParseProcessStatus(content, &info);
+  info.name.swap(names_[row]);
+  if (!parsed) {
+    return false;
+  }
+  uids_[row] = info.uid;
+  gids_[row] = info.gid;
+  tracers_[row] = info.tracer;
+
+  cmdlines_[row].clear();
+  if (options_.cmdline && read_file("cmdline", &content)) {
+    if (!content.empty() && content.back() == '\0') {
+      content.remove_suffix(1);
+    }
+    cmdlines_[row].assign(content);
+  }
+  return true;
+}
+
+void ProcessSnapshot::Resize(size_t size) {
+  valid_.resize(size);
+  ppids_.resize(size);
+  states_.resize(size);
+  utimes_.resize(size);
+  stimes_.resize(size);
+  start_times_.resize(size);
+  rss_.resize(size);
+  names_.resize(size);
+  uids_.resize(size);
+  gids_.resize(size);
+  tracers_.resize(size);
+  cmdlines_.resize(size);
+}
+
+void ProcessSnapshot::Compact() {
+  index_.clear();
+  size_t size = 0;
+  for (size_t row = 0; row < tids_.size(); row++) {
+    if (!valid_[row]) {
+      continue;
+    }
+    if (size != row) {
+      tids_[size] = tids_[row];
+      pids_[size] = pids_[row];
+      ppids_[size] = ppids_[row];
+      states_[size] = states_[row];
+      utimes_[size] = utimes_[row];
+      stimes_[size] = stimes_[row];
+      start_times_[size] = start_times_[row];
+      rss_[size] = rss_[row];
+      names_[size].swap(names_[row]);
+      uids_[size] = uids_[row];
+      gids_[size] = gids_[row];
+      tracers_[size] = tracers_[row];
+      cmdlines_[size].swap(cmdlines_[row]);
+    }
+    index_[tids_[size]] = size;
+    size++;
+  }
+  tids_.resize(size);
+  pids_.resize(size);
+  Resize(size);
+}
+
+} /* namespace procinfo */
+} /* namespace android */
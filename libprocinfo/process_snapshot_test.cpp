@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <procinfo/process_snapshot.h>
+
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+
+#include <android-base/file.h>
+
+#include <gtest/gtest.h>
+
+#if !defined(__BIONIC__)
+#include <syscall.h>
+static pid_t gettid() {
+  return syscall(__NR_gettid);
+}
+#endif
+
+using android::procinfo::ProcessSnapshot;
+
+static void CheckSelf(const ProcessSnapshot& snapshot, pid_t tid) {
+  ssize_t row = snapshot.Find(tid);
+  ASSERT_NE(-1, row);
+  EXPECT_EQ(tid, snapshot.tids()[row]);
+  EXPECT_EQ(getpid(), snapshot.pids()[row]);
+  EXPECT_EQ(getppid(), snapshot.ppids()[row]);
+  EXPECT_EQ(android::procinfo::kProcessStateRunning, snapshot.states()[row]);
+  EXPECT_EQ(getuid(), snapshot.uids()[row]);
+  EXPECT_EQ(getgid(), snapshot.gids()[row]);
+  EXPECT_EQ(0, snapshot.tracers()[row]);
+  EXPECT_GT(snapshot.start_times()[row], 0u);
+  EXPECT_GT(snapshot.rss()[row], 0u);
+
+  std::string comm;
+  ASSERT_TRUE(android::base::ReadFileToString("/proc/self/comm", &comm));
+  comm.pop_back();
+  EXPECT_EQ(comm, snapshot.names()[row]);
+}
+
+TEST(process_snapshot, processes) {
+  ProcessSnapshot snapshot;
+  ASSERT_TRUE(snapshot.Update());
+  ASSERT_NO_FATAL_FAILURE(CheckSelf(snapshot, getpid()));
+
+  std::string cmdline;
+  ASSERT_TRUE(android::base::ReadFileToString("/proc/self/cmdline", &cmdline));
+  cmdline.pop_back();
+  EXPECT_EQ(cmdline, snapshot.cmdlines()[snapshot.Find(getpid())]);
+
+  for (size_t row = 0; row < snapshot.size(); row++) {
+    EXPECT_EQ(snapshot.tids()[row], snapshot.pids()[row]);
+    EXPECT_EQ(static_cast<ssize_t>(row), snapshot.Find(snapshot.tids()[row]));
+  }
+}
+
+TEST(process_snapshot, threads) {
+  std::thread thread([]() {
+    ProcessSnapshot snapshot(ProcessSnapshot::Options{true, false, 2});
+    ASSERT_TRUE(snapshot.Update());
+    ASSERT_NO_FATAL_FAILURE(CheckSelf(snapshot, gettid()));
+
+    size_t threads = 0;
+    for (size_t row = 0; row < snapshot.size(); row++) {
+      if (snapshot.pids()[row] == getpid()) {
+        threads++;
+      }
+      EXPECT_EQ("", snapshot.cmdlines()[row]);
+    }
+    EXPECT_GE(threads, 2u);
+  });
+  thread.join();
+}
+
+TEST(process_snapshot, incremental) {
+  ProcessSnapshot snapshot;
+  ASSERT_TRUE(snapshot.Update());
+
+  pid_t child = fork();
+  ASSERT_NE(-1, child);
+  if (child == 0) {
+    pause();
+    _exit(0);
+  }
+
+  // The new child is picked up, and the others carry their status and cmdline over.
+  ASSERT_TRUE(snapshot.Update(true));
+  ASSERT_NO_FATAL_FAILURE(CheckSelf(snapshot, getpid()));
+  ssize_t row = snapshot.Find(child);
+  ASSERT_NE(-1, row);
+  EXPECT_EQ(getpid(), snapshot.ppids()[row]);
+  EXPECT_EQ(snapshot.cmdlines()[snapshot.Find(getpid())], snapshot.cmdlines()[row]);
+
+  ASSERT_EQ(0, kill(child, SIGKILL));
+  ASSERT_EQ(child, waitpid(child, nullptr, 0));
+  ASSERT_TRUE(snapshot.Update(true));
+  EXPECT_EQ(-1, snapshot.Find(child));
+  ASSERT_NO_FATAL_FAILURE(CheckSelf(snapshot, getpid()));
+}
@@ -20,6 +20,10 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <iterator>
+#include <map>
+#include <new>
+
 #include "backed_block.h"
 #include "sparse_defs.h"
 
@@ -46,12 +50,34 @@ struct backed_block {
   struct backed_block* next;
 };
 
+/* Blocks are kept in a list sorted by block number, which is what the iterators walk. The index
+ * holds the same blocks by block number, so finding where a block goes, or the block before one,
+ * takes O(log n) however out of order the blocks are added. */
 struct backed_block_list {
-  struct backed_block* data_blocks;
-  struct backed_block* last_used;
-  unsigned int block_size;
+  struct backed_block* data_blocks = nullptr;
+  std::multimap<unsigned int, struct backed_block*> index;
+  unsigned int block_size = 0;
 };
 
+typedef std::multimap<unsigned int, struct backed_block*>::iterator backed_block_index_iter;
+
+static backed_block_index_iter index_find(struct backed_block_list* bbl, struct backed_block* bb) {
+  auto range = bbl->index.equal_range(bb->block);
+  for (auto it = range.first; it != range.second; ++it) {
+    if (it->second == bb) {
+      return it;
+    }
+  }
+  assert(false);
+  return bbl->index.end();
+}
+
+/* Returns the block before |bb| in the list, or nullptr if |bb| is the first. */
+static struct backed_block* index_prev(struct backed_block_list* bbl, struct backed_block* bb) {
+  auto it = index_find(bbl, bb);
+  return it == bbl->index.begin() ? nullptr : std::prev(it)->second;
+}
+
 struct backed_block* backed_block_iter_new(struct backed_block_list* bbl) {
   return bbl->data_blocks;
 }
@@ -110,9 +136,10 @@ void backed_block_destroy(struct backed_block* bb) {
 }
 
 struct backed_block_list* backed_block_list_new(unsigned int block_size) {
-  struct backed_block_list* b =
-      reinterpret_cast<backed_block_list*>(calloc(sizeof(struct backed_block_list), 1));
-  b->block_size = block_size;
+  struct backed_block_list* b = new (std::nothrow) backed_block_list;
+  if (b) {
+    b->block_size = block_size;
+  }
   return b;
 }
 
@@ -126,7 +153,7 @@ void backed_block_list_destroy(struct backed_block_list* bbl) {
     }
   }
 
-  free(bbl);
+  delete bbl;
 }
 
 void backed_block_list_move(struct backed_block_list* from, struct backed_block_list* to,
@@ -137,38 +164,37 @@ void backed_block_list_move(struct backed_block_list* from, struct backed_block_
     start = from->data_blocks;
   }
 
-  if (!end) {
-    for (end = start; end && end->next; end = end->next)
-      ;
+  if (start == nullptr) {
+    return;
   }
 
-  if (start == nullptr || end == nullptr) {
-    return;
+  if (!end) {
+    end = from->index.rbegin()->second;
   }
 
-  from->last_used = nullptr;
-  to->last_used = nullptr;
-  if (from->data_blocks == start) {
+  bb = index_prev(from, start);
+  if (bb == nullptr) {
     from->data_blocks = end->next;
   } else {
-    for (bb = from->data_blocks; bb; bb = bb->next) {
-      if (bb->next == start) {
-        bb->next = end->next;
-        break;
-      }
-    }
+    bb->next = end->next;
   }
 
-  if (!to->data_blocks) {
+  auto pos = to->index.upper_bound(start->block);
+  bb = pos == to->index.begin() ? nullptr : std::prev(pos)->second;
+  if (bb == nullptr) {
+    end->next = to->data_blocks;
     to->data_blocks = start;
-    end->next = nullptr;
   } else {
-    for (bb = to->data_blocks; bb; bb = bb->next) {
-      if (!bb->next || bb->next->block > start->block) {
-        end->next = bb->next;
-        bb->next = start;
-        break;
-      }
+    end->next = bb->next;
+    bb->next = start;
+  }
+
+  for (auto it = index_find(from, start);;) {
+    struct backed_block* moved = it->second;
+    it = from->index.erase(it);
+    to->index.emplace_hint(pos, moved->block, moved);
+    if (moved == end) {
+      break;
     }
   }
 }
@@ -222,49 +248,55 @@ static int merge_bb(struct backed_block_list* bbl, struct backed_block* a, struc
   a->len += b->len;
   a->next = b->next;
 
+  bbl->index.erase(index_find(bbl, b));
   backed_block_destroy(b);
 
   return 0;
 }
 
-static int queue_bb(struct backed_block_list* bbl, struct backed_block* new_bb) {
-  struct backed_block* bb;
+void backed_block_list_append(struct backed_block_list* to, struct backed_block_list* from) {
+  struct backed_block* start = from->data_blocks;
+  struct backed_block* tail;
 
-  if (bbl->data_blocks == nullptr) {
-    bbl->data_blocks = new_bb;
-    return 0;
+  if (start == nullptr) {
+    return;
   }
 
-  if (bbl->data_blocks->block > new_bb->block) {
-    new_bb->next = bbl->data_blocks;
-    bbl->data_blocks = new_bb;
-    return 0;
+  tail = to->index.empty() ? nullptr : to->index.rbegin()->second;
+  for (auto& entry : from->index) {
+    to->index.emplace_hint(to->index.end(), entry);
+  }
+  from->index.clear();
+  from->data_blocks = nullptr;
+
+  if (tail == nullptr) {
+    to->data_blocks = start;
+    return;
   }
 
-  /* Optimization: blocks are mostly queued in sequence, so save the
-     pointer to the last bb that was added, and start searching from
-     there if the next block number is higher */
-  if (bbl->last_used && new_bb->block > bbl->last_used->block)
-    bb = bbl->last_used;
-  else
-    bb = bbl->data_blocks;
-  bbl->last_used = new_bb;
+  assert(tail->block < start->block);
+  tail->next = start;
+  merge_bb(to, tail, start);
+}
 
-  for (; bb->next && bb->next->block < new_bb->block; bb = bb->next)
-    ;
+static int queue_bb(struct backed_block_list* bbl, struct backed_block* new_bb) {
+  struct backed_block* bb;
 
-  if (bb->next == nullptr) {
-    bb->next = new_bb;
+  /* new_bb goes after the last block that starts before it */
+  auto pos = bbl->index.lower_bound(new_bb->block);
+  bb = pos == bbl->index.begin() ? nullptr : std::prev(pos)->second;
+  bbl->index.emplace_hint(pos, new_bb->block, new_bb);
+
+  if (bb == nullptr) {
+    new_bb->next = bbl->data_blocks;
+    bbl->data_blocks = new_bb;
   } else {
     new_bb->next = bb->next;
     bb->next = new_bb;
   }
 
   merge_bb(bbl, new_bb, new_bb->next);
-  if (!merge_bb(bbl, bb, new_bb)) {
-    /* new_bb destroyed, point to retained as last_used */
-    bbl->last_used = bb;
-  }
+  merge_bb(bbl, bb, new_bb);
 
   return 0;
 }
@@ -361,6 +393,7 @@ int backed_block_split(struct backed_block_list* bbl, struct backed_block* bb,
   new_bb->next = bb->next;
   bb->next = new_bb;
   bb->len = max_len;
+  bbl->index.emplace_hint(std::next(index_find(bbl, bb)), new_bb->block, new_bb);
 
   switch (bb->type) {
     case BACKED_BLOCK_DATA:
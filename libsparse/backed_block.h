@@ -58,5 +58,8 @@ void backed_block_list_destroy(struct backed_block_list* bbl);
 
 void backed_block_list_move(struct backed_block_list* from, struct backed_block_list* to,
                             struct backed_block* start, struct backed_block* end);
+/* Moves every block of |from|, which must all come after the blocks of |to|, onto the end of
+ * |to|, merging the two blocks where they meet if possible. */
+void backed_block_list_append(struct backed_block_list* to, struct backed_block_list* from);
 
 #endif
@@ -316,11 +316,33 @@ struct sparse_file *sparse_file_import_auto(int fd, bool crc, bool verbose);
  *
  * Splits chunks of an existing sparse file into smaller sparse files such that
  * each sparse file is less than max_len.  Returns the number of sparse_files
- * that would have been written to out_s if out_s were big enough.
+ * that would have been written to out_s if out_s were big enough.  Pieces that
+ * do not fit in out_s are only counted, so counting with an out_s_count of 0 is
+ * cheap.
  */
 int sparse_file_resparse(struct sparse_file *in_s, unsigned int max_len,
 		struct sparse_file **out_s, int out_s_count);
 
+/** sparse_file_resparse_foreach - rechunk an existing sparse file a piece at a time
+ *
+ * @in_s - sparse file cookie of the existing sparse file
+ * @max_len - maximum file size
+ * @cb - function to call for each piece
+ * @priv - value passed to cb
+ *
+ * Splits chunks of an existing sparse file into the same pieces as
+ * sparse_file_resparse, but only builds each piece when the previous call to
+ * cb has returned, so a large file can be sent while it is still being split.
+ * cb is passed the piece and its index; the piece is only valid for the
+ * duration of the call.  Its chunks are handed back to in_s afterwards, so
+ * in_s can be resparsed again.
+ *
+ * Returns the number of pieces passed to cb, the first non-zero value
+ * returned by cb, or negative errno on error.
+ */
+int sparse_file_resparse_foreach(struct sparse_file *in_s, unsigned int max_len,
+		int (*cb)(void *priv, struct sparse_file *s, int index), void *priv);
+
 /**
  * sparse_file_verbose - set a sparse file cookie to print verbose errors
  *
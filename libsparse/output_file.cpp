@@ -83,6 +83,11 @@ struct output_file {
   char* zero_buf;
   uint32_t* fill_buf;
   char* buf;
+  /* Mapping of the whole of the fd that fd chunks were last written from, reused while
+   * consecutive chunks come from the same fd. */
+  int map_fd;
+  char* map_data;
+  int64_t map_len;
 };
 
 struct output_file_gz {
@@ -491,8 +496,47 @@ static struct sparse_file_ops normal_file_ops = {
     .write_end_chunk = write_normal_end_chunk,
 };
 
+#ifndef _WIN32
+static void output_file_unmap(struct output_file* out) {
+  if (out->map_data) {
+    munmap(out->map_data, out->map_len);
+  }
+  out->map_fd = -1;
+  out->map_data = nullptr;
+  out->map_len = 0;
+}
+
+/* Returns a pointer to [offset, offset + len) of |fd| in a mapping of the whole file, or nullptr
+ * if the file can't be mapped that way. */
+static char* output_file_map_fd(struct output_file* out, int fd, int64_t offset,
+                                unsigned int len) {
+  if (out->map_data && out->map_fd == fd && offset + len <= out->map_len) {
+    return out->map_data + offset;
+  }
+  output_file_unmap(out);
+
+  struct stat st;
+  if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || (uint64_t)st.st_size > SIZE_MAX ||
+      offset + len > st.st_size) {
+    return nullptr;
+  }
+  void* data = mmap64(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+  out->map_fd = fd;
+  out->map_data = reinterpret_cast<char*>(data);
+  out->map_len = st.st_size;
+  return out->map_data + offset;
+}
+#endif
+
 void output_file_close(struct output_file* out) {
   out->sparse_ops->write_end_chunk(out);
+#ifndef _WIN32
+  output_file_unmap(out);
+#endif
   free(out->zero_buf);
   free(out->fill_buf);
   out->zero_buf = nullptr;
@@ -510,6 +554,9 @@ static int output_file_init(struct output_file* out, int block_size, int64_t len
   out->chunk_cnt = 0;
   out->crc32 = 0;
   out->use_crc = crc;
+  out->map_fd = -1;
+  out->map_data = nullptr;
+  out->map_len = 0;
 
   out->zero_buf = reinterpret_cast<char*>(calloc(block_size, 1));
   if (!out->zero_buf) {
@@ -660,6 +707,13 @@ int write_fd_chunk(struct output_file* out, unsigned int len, int fd, int64_t of
   buffer_size = (uint64_t)len + (uint64_t)aligned_diff;
 
 #ifndef _WIN32
+  /* Chunks of an image usually come from one fd, so map it once and hand the writer pointers
+   * into that mapping rather than mapping every chunk on its own. */
+  ptr = output_file_map_fd(out, fd, offset, len);
+  if (ptr) {
+    return out->sparse_ops->write_data_chunk(out, len, ptr);
+  }
+
   if (buffer_size > SIZE_MAX) return -E2BIG;
   char* data =
       reinterpret_cast<char*>(mmap64(nullptr, buffer_size, PROT_READ, MAP_SHARED, fd, aligned_offset));
@@ -708,6 +762,10 @@ int write_file_chunk(struct output_file* out, unsigned int len, const char* file
 
   ret = write_fd_chunk(out, len, file_fd, offset);
 
+#ifndef _WIN32
+  /* The fd number may be reused for another file once closed, so don't keep its mapping. */
+  output_file_unmap(out);
+#endif
   close(file_fd);
 
   return ret;
@@ -260,16 +260,21 @@ unsigned int sparse_file_block_size(struct sparse_file* s) {
   return s->block_size;
 }
 
-static struct backed_block* move_chunks_up_to_len(struct sparse_file* from, struct sparse_file* to,
-                                                  unsigned int len) {
+/*
+ * Finds the chunks from start onwards that fit in a sparse file of len bytes, splitting the
+ * chunk that crosses len if that leaves a file of at least 7/8ths of it.  Sets *end to the last
+ * chunk that fits and *next to the chunk after it, or nullptr if none are left.
+ */
+static int find_chunks_up_to_len(struct sparse_file* from, struct backed_block* start,
+                                 unsigned int len, struct backed_block** end,
+                                 struct backed_block** next) {
   int64_t count = 0;
   struct output_file* out_counter;
   struct backed_block* last_bb = nullptr;
   struct backed_block* bb;
-  struct backed_block* start;
   unsigned int last_block = 0;
   int64_t file_len = 0;
-  int ret;
+  int ret = 0;
 
   /*
    * overhead is sparse file header, the potential end skip
@@ -278,22 +283,20 @@ static struct backed_block* move_chunks_up_to_len(struct sparse_file* from, stru
   int overhead = sizeof(sparse_header_t) + 2 * sizeof(chunk_header_t) + sizeof(uint32_t);
   len -= overhead;
 
-  start = backed_block_iter_new(from->backed_block_list);
-  out_counter = output_file_open_callback(out_counter_write, &count, to->block_size, to->len, false,
-                                          true, 0, false);
+  out_counter = output_file_open_callback(out_counter_write, &count, from->block_size, from->len,
+                                          false, true, 0, false);
   if (!out_counter) {
-    return nullptr;
+    return -ENOMEM;
   }
 
   for (bb = start; bb; bb = backed_block_iter_next(bb)) {
     count = 0;
     if (backed_block_block(bb) > last_block) count += sizeof(chunk_header_t);
-    last_block = backed_block_block(bb) + DIV_ROUND_UP(backed_block_len(bb), to->block_size);
+    last_block = backed_block_block(bb) + DIV_ROUND_UP(backed_block_len(bb), from->block_size);
 
     /* will call out_counter_write to update count */
     ret = sparse_file_write_block(out_counter, bb);
     if (ret) {
-      bb = nullptr;
       goto out;
     }
     if (file_len + count > len) {
@@ -306,51 +309,91 @@ static struct backed_block* move_chunks_up_to_len(struct sparse_file* from, stru
       if (!last_bb || (len - file_len > (len / 8))) {
         backed_block_split(from->backed_block_list, bb, len - file_len);
         last_bb = bb;
+        bb = backed_block_iter_next(bb);
       }
-      goto move;
+      break;
     }
     file_len += count;
     last_bb = bb;
   }
 
-move:
-  backed_block_list_move(from->backed_block_list, to->backed_block_list, start, last_bb);
+  *end = last_bb;
+  *next = bb;
 
 out:
   output_file_close(out_counter);
 
-  return bb;
+  return ret;
 }
 
 int sparse_file_resparse(struct sparse_file* in_s, unsigned int max_len, struct sparse_file** out_s,
                          int out_s_count) {
-  struct backed_block* bb;
+  struct backed_block* start = backed_block_iter_new(in_s->backed_block_list);
+  struct backed_block* end;
+  struct backed_block* next;
   struct sparse_file* s;
-  struct sparse_file* tmp;
   int c = 0;
+  int ret;
 
-  tmp = sparse_file_new(in_s->block_size, in_s->len);
-  if (!tmp) {
-    return -ENOMEM;
-  }
-
+  /* Pieces past the end of out_s are only counted, so their chunks never leave in_s. */
   do {
-    s = sparse_file_new(in_s->block_size, in_s->len);
-
-    bb = move_chunks_up_to_len(in_s, s, max_len);
+    ret = find_chunks_up_to_len(in_s, start, max_len, &end, &next);
+    if (ret) {
+      return ret;
+    }
 
     if (c < out_s_count) {
+      s = sparse_file_new(in_s->block_size, in_s->len);
+      if (!s) {
+        return -ENOMEM;
+      }
+      if (end) {
+        backed_block_list_move(in_s->backed_block_list, s->backed_block_list, start, end);
+      }
       out_s[c] = s;
-    } else {
-      backed_block_list_move(s->backed_block_list, tmp->backed_block_list, nullptr, nullptr);
-      sparse_file_destroy(s);
     }
     c++;
-  } while (bb);
+    start = next;
+  } while (start);
 
-  backed_block_list_move(tmp->backed_block_list, in_s->backed_block_list, nullptr, nullptr);
+  return c;
+}
+
+int sparse_file_resparse_foreach(struct sparse_file* in_s, unsigned int max_len,
+                                 int (*cb)(void* priv, struct sparse_file* s, int index),
+                                 void* priv) {
+  struct backed_block* start = backed_block_iter_new(in_s->backed_block_list);
+  struct backed_block* end;
+  struct backed_block* next;
+  struct sparse_file* s;
+  int c = 0;
+  int ret;
+
+  do {
+    ret = find_chunks_up_to_len(in_s, start, max_len, &end, &next);
+    if (ret) {
+      return ret;
+    }
+
+    s = sparse_file_new(in_s->block_size, in_s->len);
+    if (!s) {
+      return -ENOMEM;
+    }
+    if (end) {
+      backed_block_list_move(in_s->backed_block_list, s->backed_block_list, start, end);
+    }
 
-  sparse_file_destroy(tmp);
+    ret = cb(priv, s, c);
+
+    /* Put the chunks back where they came from; next is still in in_s. */
+    backed_block_list_move(s->backed_block_list, in_s->backed_block_list, nullptr, nullptr);
+    sparse_file_destroy(s);
+    if (ret) {
+      return ret;
+    }
+    c++;
+    start = next;
+  } while (start);
 
   return c;
 }
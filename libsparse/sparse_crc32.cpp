@@ -43,10 +43,24 @@
  */
 
 /* Code taken from FreeBSD 8 */
+#include "sparse_crc32.h"
+
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+
+#if defined(__aarch64__) && defined(__linux__)
+#include <arm_acle.h>
+#include <asm/hwcap.h>
+#include <sys/auxv.h>
+#define SPARSE_CRC32_ARM 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define SPARSE_CRC32_X86 1
+#endif
 
-static uint32_t crc32_tab[] = {
+static constexpr uint32_t crc32_tab[] = {
     0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3,
     0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91,
     0x1db71064, 0x6ab020f2, 0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
@@ -87,7 +101,7 @@ static uint32_t crc32_tab[] = {
  * in sys/libkern.h, where it can be inlined.
  */
 
-uint32_t sparse_crc32(uint32_t crc_in, const void* buf, size_t size) {
+uint32_t sparse_crc32_reference(uint32_t crc_in, const void* buf, size_t size) {
   const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
   uint32_t crc;
 
@@ -95,3 +109,183 @@ uint32_t sparse_crc32(uint32_t crc_in, const void* buf, size_t size) {
   while (size--) crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
   return crc ^ ~0U;
 }
+
+/*
+ * The implementations below all work on the inverted CRC, and leave the
+ * inversion to sparse_crc32().
+ */
+
+static inline uint32_t crc32_bytes(uint32_t crc, const uint8_t* p, size_t size) {
+  while (size--) crc = crc32_tab[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+/*
+ * Slicing-by-8: crc32_slices[k][n] is the CRC of byte n followed by k zero
+ * bytes, so eight table lookups advance the CRC by eight bytes at once.
+ */
+struct Crc32Slices {
+  uint32_t table[8][256];
+};
+
+static constexpr Crc32Slices make_crc32_slices() {
+  Crc32Slices slices = {};
+  for (int n = 0; n < 256; n++) slices.table[0][n] = crc32_tab[n];
+  for (int k = 1; k < 8; k++) {
+    for (int n = 0; n < 256; n++) {
+      uint32_t prev = slices.table[k - 1][n];
+      slices.table[k][n] = crc32_tab[prev & 0xFF] ^ (prev >> 8);
+    }
+  }
+  return slices;
+}
+
+static constexpr Crc32Slices crc32_slices = make_crc32_slices();
+
+static uint32_t crc32_slicing_by_8(uint32_t crc, const uint8_t* p, size_t size) {
+  const auto& t = crc32_slices.table;
+  while (size >= 8) {
+    uint32_t lo, hi;
+    memcpy(&lo, p, sizeof(lo));
+    memcpy(&hi, p + 4, sizeof(hi));
+    lo ^= crc;
+    crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+          t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^ t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+    p += 8;
+    size -= 8;
+  }
+  return crc32_bytes(crc, p, size);
+}
+
+#if defined(SPARSE_CRC32_ARM)
+
+/* The ARMv8 CRC32 instructions use the same polynomial as the table. */
+__attribute__((target("crc"))) static uint32_t crc32_armv8(uint32_t crc, const uint8_t* p,
+                                                           size_t size) {
+  while (size && (reinterpret_cast<uintptr_t>(p) & 7)) {
+    crc = __crc32b(crc, *p++);
+    size--;
+  }
+  while (size >= 32) {
+    uint64_t v[4];
+    memcpy(v, p, sizeof(v));
+    crc = __crc32d(crc, v[0]);
+    crc = __crc32d(crc, v[1]);
+    crc = __crc32d(crc, v[2]);
+    crc = __crc32d(crc, v[3]);
+    p += 32;
+    size -= 32;
+  }
+  while (size >= 8) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    crc = __crc32d(crc, v);
+    p += 8;
+    size -= 8;
+  }
+  while (size--) crc = __crc32b(crc, *p++);
+  return crc;
+}
+
+#elif defined(SPARSE_CRC32_X86)
+
+/*
+ * Folds 64-byte blocks with carry-less multiplication, as described in
+ * Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction", then reduces the remaining 128 bits with Barrett reduction.
+ * The constants are the bit-reflected k1-k5 and polynomials from the paper.
+ * |size| must be a multiple of 16 and at least 64.
+ */
+#define PCLMUL_TARGET __attribute__((target("pclmul,sse4.1")))
+
+PCLMUL_TARGET static inline __m128i load(const uint8_t* p) {
+  return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+}
+
+/* Folds |x| forward by the distance |k| was computed for, and adds in |next|. */
+PCLMUL_TARGET static inline __m128i fold(__m128i x, __m128i k, __m128i next) {
+  __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+  __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+  return _mm_xor_si128(_mm_xor_si128(hi, lo), next);
+}
+
+PCLMUL_TARGET static uint32_t crc32_pclmul_blocks(uint32_t crc, const uint8_t* p, size_t size) {
+  const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596, 0x0154442bd4);
+  const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009e, 0x01751997d0);
+  const __m128i k5k0 = _mm_set_epi64x(0, 0x0163cd6124);
+  const __m128i poly = _mm_set_epi64x(0x01f7011641, 0x01db710641);
+  const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+  __m128i x1 = _mm_xor_si128(load(p), _mm_cvtsi32_si128(crc));
+  __m128i x2 = load(p + 16);
+  __m128i x3 = load(p + 32);
+  __m128i x4 = load(p + 48);
+  p += 64;
+  size -= 64;
+
+  while (size >= 64) {
+    x1 = fold(x1, k1k2, load(p));
+    x2 = fold(x2, k1k2, load(p + 16));
+    x3 = fold(x3, k1k2, load(p + 32));
+    x4 = fold(x4, k1k2, load(p + 48));
+    p += 64;
+    size -= 64;
+  }
+
+  x1 = fold(x1, k3k4, x2);
+  x1 = fold(x1, k3k4, x3);
+  x1 = fold(x1, k3k4, x4);
+  while (size >= 16) {
+    x1 = fold(x1, k3k4, load(p));
+    p += 16;
+    size -= 16;
+  }
+
+  /* Fold 128 bits down to 64. */
+  __m128i x2r = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2r);
+  x2r = _mm_srli_si128(x1, 4);
+  x1 = _mm_and_si128(x1, mask32);
+  x1 = _mm_xor_si128(_mm_clmulepi64_si128(x1, k5k0, 0x00), x2r);
+
+  /* Barrett reduction to 32 bits. */
+  x2r = _mm_and_si128(x1, mask32);
+  x2r = _mm_clmulepi64_si128(x2r, poly, 0x10);
+  x2r = _mm_and_si128(x2r, mask32);
+  x2r = _mm_clmulepi64_si128(x2r, poly, 0x00);
+  x1 = _mm_xor_si128(x1, x2r);
+  return _mm_extract_epi32(x1, 1);
+}
+
+#undef PCLMUL_TARGET
+
+static uint32_t crc32_pclmul(uint32_t crc, const uint8_t* p, size_t size) {
+  if (size >= 64) {
+    size_t blocks = size & ~static_cast<size_t>(15);
+    crc = crc32_pclmul_blocks(crc, p, blocks);
+    p += blocks;
+    size -= blocks;
+  }
+  return crc32_slicing_by_8(crc, p, size);
+}
+
+#endif
+
+using crc32_fn = uint32_t (*)(uint32_t crc, const uint8_t* p, size_t size);
+
+static crc32_fn select_crc32() {
+#if defined(SPARSE_CRC32_ARM)
+  if (getauxval(AT_HWCAP) & HWCAP_CRC32) return crc32_armv8;
+#elif defined(SPARSE_CRC32_X86)
+  unsigned int eax, ebx, ecx, edx;
+  if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_PCLMUL) && (ecx & bit_SSE4_1)) {
+    return crc32_pclmul;
+  }
+#endif
+  return crc32_slicing_by_8;
+}
+
+uint32_t sparse_crc32(uint32_t crc_in, const void* buf, size_t size) {
+  static const crc32_fn impl = select_crc32();
+  return impl(crc_in ^ ~0U, reinterpret_cast<const uint8_t*>(buf), size) ^ ~0U;
+}
@@ -17,8 +17,13 @@
 #ifndef _LIBSPARSE_SPARSE_CRC32_H_
 #define _LIBSPARSE_SPARSE_CRC32_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
+// Uses the CPU's CRC32 or carry-less multiply instructions where it has them.
 uint32_t sparse_crc32(uint32_t crc, const void* buf, size_t size);
 
+// The original table-driven implementation, a byte at a time. For comparison in benchmarks.
+uint32_t sparse_crc32_reference(uint32_t crc, const void* buf, size_t size);
+
 #endif
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "sparse_crc32.h"
+
+// Inputs larger than this are checksummed by going over the same buffer repeatedly, so that
+// multi-GB runs don't need multi-GB of memory.
+static constexpr size_t kBufferSize = 64 * 1024 * 1024;
+
+static const std::vector<uint8_t>& TestData() {
+  static const std::vector<uint8_t> data = [] {
+    std::vector<uint8_t> data(kBufferSize);
+    std::mt19937 rng;
+    for (auto& byte : data) byte = rng();
+    return data;
+  }();
+  return data;
+}
+
+template <uint32_t (*Crc32)(uint32_t, const void*, size_t)>
+static void BM_crc32(benchmark::State& state) {
+  const auto& data = TestData();
+  uint64_t size = state.range(0);
+  for (auto _ : state) {
+    uint32_t crc = 0;
+    for (uint64_t done = 0; done < size;) {
+      size_t len = std::min<uint64_t>(size - done, data.size());
+      crc = Crc32(crc, data.data(), len);
+      done += len;
+    }
+    benchmark::DoNotOptimize(crc);
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+}
+
+static void Sizes(benchmark::internal::Benchmark* b) {
+  b->Arg(4 * 1024)->Arg(1024 * 1024)->Arg(kBufferSize)->Arg(int64_t(4) * 1024 * 1024 * 1024);
+  b->Unit(benchmark::kMillisecond);
+}
+
+BENCHMARK_TEMPLATE(BM_crc32, sparse_crc32_reference)->Apply(Sizes);
+BENCHMARK_TEMPLATE(BM_crc32, sparse_crc32)->Apply(Sizes);
+
+BENCHMARK_MAIN();
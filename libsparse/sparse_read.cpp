@@ -24,21 +24,32 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <algorithm>
+#include <memory>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include <sparse/sparse.h>
 
+#include "android-base/file.h"
 #include "android-base/stringprintf.h"
+#include "backed_block.h"
 #include "defs.h"
 #include "output_file.h"
 #include "sparse_crc32.h"
 #include "sparse_file.h"
 #include "sparse_format.h"
 
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
 #if defined(__APPLE__) && defined(__MACH__)
 #define lseek64 lseek
+#define mmap64 mmap
 #define off64_t off_t
 #endif
 
@@ -157,6 +168,94 @@ class SparseFileBufSource : public SparseFileSource {
   }
 };
 
+#ifndef _WIN32
+/* Reads a sparse image through a read-only mapping of the whole file. Headers are copied out of
+ * the mapping and checksums are computed over it in place, so no data passes through copybuf.
+ * Data chunks are still added as references to the fd, which the caller keeps open, so the
+ * resulting sparse_file doesn't depend on the mapping. */
+class SparseFileMmapSource : public SparseFileSource {
+ private:
+  int fd;
+  char* data;
+  int64_t len;
+  int64_t offset;
+
+  SparseFileMmapSource(int fd, char* data, int64_t len, int64_t offset)
+      : fd(fd), data(data), len(len), offset(offset) {}
+
+ public:
+  /* Maps |fd| if it is a regular file that fits in the address space. Returns nullptr if it
+   * can't be mapped, in which case the caller should fall back to SparseFileFdSource. */
+  static SparseFileMmapSource* Create(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size == 0 ||
+        (uint64_t)st.st_size > SIZE_MAX) {
+      return nullptr;
+    }
+    int64_t offset = lseek64(fd, 0, SEEK_CUR);
+    if (offset < 0) {
+      return nullptr;
+    }
+    void* data = mmap64(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      return nullptr;
+    }
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    return new SparseFileMmapSource(fd, reinterpret_cast<char*>(data), st.st_size, offset);
+  }
+
+  ~SparseFileMmapSource() override {
+    munmap(data, len);
+    /* Leave the fd where SparseFileFdSource would have. */
+    lseek64(fd, std::min(offset, len), SEEK_SET);
+  }
+
+  void Seek(int64_t off) override { offset += off; }
+
+  int64_t GetOffset() override { return offset; }
+
+  int SetOffset(int64_t off) override {
+    offset = off;
+    return 0;
+  }
+
+  int AddToSparseFile(struct sparse_file* s, int64_t len, unsigned int block) override {
+    return sparse_file_add_fd(s, fd, offset, len, block);
+  }
+
+  int ReadValue(void* ptr, int size) override {
+    if (offset < 0 || offset > len - size) {
+      return -EINVAL;
+    }
+    memcpy(ptr, data + offset, size);
+    offset += size;
+    return 0;
+  }
+
+  int GetCrc32(uint32_t* crc32, int64_t size) override {
+    if (offset < 0 || offset > len - size) {
+      return -EINVAL;
+    }
+    *crc32 = sparse_crc32(*crc32, data + offset, size);
+    offset += size;
+    return 0;
+  }
+};
+#endif
+
+/* Runs |fn| on a source reading from |fd|: a mapping of it where possible, or reads otherwise. */
+template <typename Fn>
+static auto with_fd_source(int fd, Fn fn) {
+#ifndef _WIN32
+  std::unique_ptr<SparseFileMmapSource> mapped(SparseFileMmapSource::Create(fd));
+  if (mapped) {
+    return fn(mapped.get());
+  }
+#endif
+  SparseFileFdSource source(fd);
+  return fn(&source);
+}
+
 static void verbose_error(bool verbose, int err, const char* fmt, ...) {
   if (!verbose) return;
 
@@ -410,65 +509,139 @@ static int sparse_file_read_sparse(struct sparse_file* s, SparseFileSource* sour
   return 0;
 }
 
-static int sparse_file_read_normal(struct sparse_file* s, int fd) {
-  int ret;
-  uint32_t* buf = (uint32_t*)malloc(s->block_size);
-  unsigned int block = 0;
-  int64_t remain = s->len;
-  int64_t offset = 0;
-  unsigned int to_read;
-  unsigned int i;
-  bool sparse_block;
-
-  if (!buf) {
-    return -ENOMEM;
+/* Images are split into ranges of at least this many bytes, each scanned on a thread of its
+ * own. */
+static constexpr int64_t SCAN_RANGE_MIN_SIZE = 64 * 1024 * 1024;
+static constexpr int64_t SCAN_READ_SIZE = 1024 * 1024;
+
+/* Returns true if the block is one 32-bit value repeated. Differences are accumulated over 64
+ * bytes at a time before being tested, which lets the compiler turn the inner loop into vector
+ * compares. */
+static bool is_fill_block(const uint8_t* block, unsigned int block_size) {
+  uint32_t fill;
+  memcpy(&fill, block, sizeof(fill));
+  const uint64_t pattern = fill | (uint64_t)fill << 32;
+
+  unsigned int i = 0;
+  for (; i + 64 <= block_size; i += 64) {
+    uint64_t diff = 0;
+    for (unsigned int j = 0; j < 64; j += sizeof(uint64_t)) {
+      uint64_t v;
+      memcpy(&v, block + i + j, sizeof(v));
+      diff |= v ^ pattern;
+    }
+    if (diff) return false;
   }
+  for (; i + sizeof(fill) <= block_size; i += sizeof(fill)) {
+    uint32_t v;
+    memcpy(&v, block + i, sizeof(v));
+    if (v != fill) return false;
+  }
+  return true;
+}
 
-  while (remain > 0) {
-    to_read = std::min(remain, (int64_t)(s->block_size));
-    ret = read_all(fd, buf, to_read);
-    if (ret < 0) {
-      error("failed to read sparse file");
-      free(buf);
-      return ret;
-    }
+/* Adds the blocks of [offset, end) of the image to |bbl|, as fills where they are one value
+ * repeated and as references to |fd| where they aren't. Unless |seekable|, the range is read
+ * from the current position of |fd|. */
+static int sparse_file_scan_range(struct sparse_file* s, int fd, bool seekable, int64_t offset,
+                                  int64_t end, struct backed_block_list* bbl) {
+  const int64_t read_size = std::max<int64_t>(1, SCAN_READ_SIZE / s->block_size) * s->block_size;
+  std::vector<uint8_t> buf(std::min(read_size, end - offset));
+  unsigned int block = offset / s->block_size;
+  int ret;
 
-    if (to_read == s->block_size) {
-      sparse_block = true;
-      for (i = 1; i < s->block_size / sizeof(uint32_t); i++) {
-        if (buf[0] != buf[i]) {
-          sparse_block = false;
-          break;
-        }
+  while (offset < end) {
+    int64_t to_read = std::min(read_size, end - offset);
+    if (seekable) {
+      errno = 0;
+      if (!android::base::ReadFullyAtOffset(fd, buf.data(), to_read, offset)) {
+        ret = errno ? -errno : -EINVAL;
+        error("failed to read sparse file");
+        return ret;
       }
     } else {
-      sparse_block = false;
+      ret = read_all(fd, buf.data(), to_read);
+      if (ret < 0) {
+        error("failed to read sparse file");
+        return ret;
+      }
     }
 
-    if (sparse_block) {
-      /* TODO: add flag to use skip instead of fill for buf[0] == 0 */
-      sparse_file_add_fill(s, buf[0], to_read, block);
-    } else {
-      sparse_file_add_fd(s, fd, offset, to_read, block);
+    for (int64_t pos = 0; pos < to_read; pos += s->block_size, block++) {
+      unsigned int len = std::min<int64_t>(to_read - pos, s->block_size);
+      if (len == s->block_size && is_fill_block(buf.data() + pos, len)) {
+        /* TODO: add flag to use skip instead of fill for buf[0] == 0 */
+        uint32_t fill;
+        memcpy(&fill, buf.data() + pos, sizeof(fill));
+        ret = backed_block_add_fill(bbl, fill, len, block);
+      } else {
+        ret = backed_block_add_fd(bbl, fd, offset + pos, len, block);
+      }
+      if (ret < 0) {
+        return ret;
+      }
     }
-
-    remain -= to_read;
     offset += to_read;
-    block++;
   }
-
-  free(buf);
   return 0;
 }
 
+static int sparse_file_read_normal(struct sparse_file* s, int fd) {
+  bool seekable = lseek64(fd, 0, SEEK_CUR) >= 0;
+  unsigned int threads = 1;
+  if (seekable) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = std::min<int64_t>(threads, std::max<int64_t>(1, s->len / SCAN_RANGE_MIN_SIZE));
+  }
+  if (threads == 1) {
+    return sparse_file_scan_range(s, fd, seekable, 0, s->len, s->backed_block_list);
+  }
+
+  /* Each thread gets a whole number of blocks and its own list, and the lists are joined in
+   * order once they are all done. */
+  int64_t blocks = DIV_ROUND_UP(s->len, s->block_size);
+  std::vector<struct backed_block_list*> lists(threads);
+  std::vector<int> results(threads);
+  std::vector<std::thread> workers;
+  for (unsigned int i = 0; i < threads; i++) {
+    int64_t start = std::min(s->len, blocks * i / threads * s->block_size);
+    int64_t end = std::min(s->len, blocks * (i + 1) / threads * s->block_size);
+    lists[i] = backed_block_list_new(s->block_size);
+    if (!lists[i]) {
+      results[i] = -ENOMEM;
+      continue;
+    }
+    workers.emplace_back([=, &lists, &results] {
+      results[i] = sparse_file_scan_range(s, fd, true, start, end, lists[i]);
+    });
+  }
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  int ret = 0;
+  for (unsigned int i = 0; i < threads; i++) {
+    if (ret == 0 && results[i] < 0) {
+      ret = results[i];
+    }
+    if (lists[i]) {
+      if (ret == 0) {
+        backed_block_list_append(s->backed_block_list, lists[i]);
+      }
+      backed_block_list_destroy(lists[i]);
+    }
+  }
+  return ret;
+}
+
 int sparse_file_read(struct sparse_file* s, int fd, bool sparse, bool crc) {
   if (crc && !sparse) {
     return -EINVAL;
   }
 
   if (sparse) {
-    SparseFileFdSource source(fd);
-    return sparse_file_read_sparse(s, &source, crc);
+    return with_fd_source(
+        fd, [&](SparseFileSource* source) { return sparse_file_read_sparse(s, source, crc); });
   } else {
     return sparse_file_read_normal(s, fd);
   }
@@ -536,8 +709,9 @@ static struct sparse_file* sparse_file_import_source(SparseFileSource* source, b
 }
 
 struct sparse_file* sparse_file_import(int fd, bool verbose, bool crc) {
-  SparseFileFdSource source(fd);
-  return sparse_file_import_source(&source, verbose, crc);
+  return with_fd_source(fd, [&](SparseFileSource* source) {
+    return sparse_file_import_source(source, verbose, crc);
+  });
 }
 
 struct sparse_file* sparse_file_import_buf(char* buf, bool verbose, bool crc) {
@@ -14,7 +14,12 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <iterator>
 #include <map>
+#include <mutex>
 #include <thread>
 #include <vector>
 
@@ -101,6 +106,37 @@ void AStatsManager_PullAtomMetadata_getAdditiveFields(AStatsManager_PullAtomMeta
     std::copy(metadata->additive_fields.begin(), metadata->additive_fields.end(), fields);
 }
 
+class StatsPullAtomCallbackInternal;
+
+// Fails pulls that are still waiting for their callback when statsd's timeout for them runs out,
+// so that statsd gets an answer it can still use. A single thread serves all pullers.
+class PullDeadlines {
+  public:
+    void add(std::chrono::steady_clock::time_point deadline,
+             const std::shared_ptr<StatsPullAtomCallbackInternal>& puller) {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mDeadlines.emplace(deadline, puller);
+        if (!mStarted) {
+            mStarted = true;
+            std::thread(&PullDeadlines::run, this).detach();
+        }
+        mWakeup.notify_one();
+    }
+
+  private:
+    void run();
+
+    std::mutex mMutex;
+    std::condition_variable mWakeup;
+    std::multimap<std::chrono::steady_clock::time_point,
+                  std::weak_ptr<StatsPullAtomCallbackInternal>>
+            mDeadlines;
+    bool mStarted = false;
+};
+
+// Never destroyed, as its thread keeps running until the process exits.
+static PullDeadlines& pullDeadlines = *new PullDeadlines();
+
 class StatsPullAtomCallbackInternal : public BnPullAtomCallback {
   public:
     StatsPullAtomCallbackInternal(const AStatsManager_PullAtomCallback callback, void* cookie,
@@ -112,8 +148,61 @@ class StatsPullAtomCallbackInternal : public BnPullAtomCallback {
           mTimeoutMillis(timeoutMillis),
           mAdditiveFields(additiveFields) {}
 
+    // Runs the callback on a thread of its own, so that a slow puller holds up neither the binder
+    // thread nor the other pullers statsd is waiting for. Pulls that arrive while one is already
+    // running share its result instead of running the callback concurrently with itself, and
+    // pulls within the cool down of a successful one get its result straight away.
     Status onPullAtom(int32_t atomTag,
                       const std::shared_ptr<IPullAtomResultReceiver>& resultReceiver) override {
+        auto now = std::chrono::steady_clock::now();
+        std::unique_lock<std::mutex> lock(mMutex);
+        if (mCached && now < mCachedAt + std::chrono::milliseconds(mCoolDownMillis)) {
+            std::vector<StatsEventParcel> parcels = mCachedParcels;
+            lock.unlock();
+            sendResult(atomTag, resultReceiver, /*success=*/true, parcels);
+            return Status::ok();
+        }
+
+        auto deadline = now + std::chrono::milliseconds(mTimeoutMillis);
+        mWaiters.push_back({atomTag, resultReceiver, deadline});
+        std::shared_ptr<StatsPullAtomCallbackInternal> self = ref<StatsPullAtomCallbackInternal>();
+        if (!mPulling) {
+            mPulling = true;
+            std::thread(&StatsPullAtomCallbackInternal::pull, self, atomTag).detach();
+        }
+        lock.unlock();
+
+        pullDeadlines.add(deadline, self);
+        return Status::ok();
+    }
+
+    // Fails the pulls whose deadline has passed.
+    void expire(std::chrono::steady_clock::time_point now) {
+        std::vector<Waiter> expired;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            auto it = std::partition(mWaiters.begin(), mWaiters.end(),
+                                     [now](const Waiter& w) { return w.deadline > now; });
+            std::move(it, mWaiters.end(), std::back_inserter(expired));
+            mWaiters.erase(it, mWaiters.end());
+        }
+        for (const auto& waiter : expired) {
+            sendResult(waiter.atomTag, waiter.receiver, /*success=*/false, {});
+        }
+    }
+
+    int64_t getCoolDownMillis() const { return mCoolDownMillis; }
+    int64_t getTimeoutMillis() const { return mTimeoutMillis; }
+    const std::vector<int32_t>& getAdditiveFields() const { return mAdditiveFields; }
+
+  private:
+    struct Waiter {
+        int32_t atomTag;
+        std::shared_ptr<IPullAtomResultReceiver> receiver;
+        std::chrono::steady_clock::time_point deadline;
+    };
+
+    void pull(int32_t atomTag) {
         AStatsEventList statsEventList;
         int successInt = mCallback(atomTag, &statsEventList, mCookie);
         bool success = successInt == AStatsManager_PULL_SUCCESS;
@@ -130,30 +219,77 @@ class StatsPullAtomCallbackInternal : public BnPullAtomCallback {
             p.buffer.assign(buffer, buffer + size);
             parcels.push_back(std::move(p));
         }
+        for (int i = 0; i < statsEventList.data.size(); i++) {
+            AStatsEvent_release(statsEventList.data[i]);
+        }
 
+        std::vector<Waiter> waiters;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            waiters.swap(mWaiters);
+            mPulling = false;
+            if (success) {
+                mCached = true;
+                mCachedAt = std::chrono::steady_clock::now();
+                mCachedParcels = parcels;
+            }
+        }
+        for (const auto& waiter : waiters) {
+            sendResult(atomTag, waiter.receiver, success, parcels);
+        }
+    }
+
+    static void sendResult(int32_t atomTag,
+                           const std::shared_ptr<IPullAtomResultReceiver>& resultReceiver,
+                           bool success, const std::vector<StatsEventParcel>& parcels) {
         Status status = resultReceiver->pullFinished(atomTag, success, parcels);
         if (!status.isOk()) {
             std::vector<StatsEventParcel> emptyParcels;
             resultReceiver->pullFinished(atomTag, /*success=*/false, emptyParcels);
         }
-        for (int i = 0; i < statsEventList.data.size(); i++) {
-            AStatsEvent_release(statsEventList.data[i]);
-        }
-        return Status::ok();
     }
 
-    int64_t getCoolDownMillis() const { return mCoolDownMillis; }
-    int64_t getTimeoutMillis() const { return mTimeoutMillis; }
-    const std::vector<int32_t>& getAdditiveFields() const { return mAdditiveFields; }
-
-  private:
     const AStatsManager_PullAtomCallback mCallback;
     void* mCookie;
     const int64_t mCoolDownMillis;
     const int64_t mTimeoutMillis;
     const std::vector<int32_t> mAdditiveFields;
+
+    std::mutex mMutex;
+    bool mPulling = false;
+    std::vector<Waiter> mWaiters;
+    bool mCached = false;
+    std::chrono::steady_clock::time_point mCachedAt;
+    std::vector<StatsEventParcel> mCachedParcels;
 };
 
+void PullDeadlines::run() {
+    std::unique_lock<std::mutex> lock(mMutex);
+    while (true) {
+        if (mDeadlines.empty()) {
+            mWakeup.wait(lock);
+            continue;
+        }
+        auto first = mDeadlines.begin()->first;
+        auto now = std::chrono::steady_clock::now();
+        if (first > now) {
+            mWakeup.wait_until(lock, first);
+            continue;
+        }
+        std::vector<std::shared_ptr<StatsPullAtomCallbackInternal>> due;
+        auto end = mDeadlines.upper_bound(now);
+        for (auto it = mDeadlines.begin(); it != end; it++) {
+            if (auto puller = it->second.lock()) due.push_back(std::move(puller));
+        }
+        mDeadlines.erase(mDeadlines.begin(), end);
+        lock.unlock();
+        for (const auto& puller : due) {
+            puller->expire(now);
+        }
+        lock.lock();
+    }
+}
+
 static std::mutex pullAtomMutex;
 static std::shared_ptr<IStatsd> sStatsd = nullptr;
 
@@ -24,6 +24,7 @@ extern "C" {
 #endif  // __CPLUSPLUS
 void stats_log_close();
 int stats_log_is_closed();
+int stats_log_set_batching(uint32_t max_delay_us, size_t max_bytes);
 int write_buffer_to_statsd(void* buffer, size_t size, uint32_t atomId);
 #ifdef __cplusplus
 }
@@ -16,6 +16,9 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 /**
  * Helpers to manage the statsd socket.
  **/
@@ -28,6 +31,16 @@ extern "C" {
  * Closes the statsd socket file descriptor.
  **/
 void AStatsSocket_close();
+
+/**
+ * Holds back writes from this process for up to max_delay_us, or until max_bytes (0 for the
+ * default 64K) are pending, and sends them to statsd with a single system call. Each event is
+ * still sent as its own datagram, and events that can't be sent are counted as dropped, like
+ * failed unbatched writes. A max_delay_us of 0 flushes and turns batching back off.
+ *
+ * Returns 0 on success or a negative errno.
+ **/
+int AStatsSocket_setBatching(uint32_t max_delay_us, size_t max_bytes);
 #ifdef __cplusplus
 }
 #endif  // __CPLUSPLUS
@@ -27,14 +27,16 @@ static const uint32_t kStatsEventTag = 1937006964;
 
 extern struct android_log_transport_write statsdLoggerWrite;
 
-static int __write_to_statsd_init(struct iovec* vec, size_t nr);
-static int (*__write_to_statsd)(struct iovec* vec, size_t nr) = __write_to_statsd_init;
+static int __write_to_statsd_init(struct iovec* vec, size_t nr, uint32_t atomId);
+static int (*__write_to_statsd)(struct iovec* vec, size_t nr,
+                                uint32_t atomId) = __write_to_statsd_init;
 
 void note_log_drop(int error, int atomId) {
     statsdLoggerWrite.noteDrop(error, atomId);
 }
 
 void stats_log_close() {
+    statsd_writer_flush();
     statsd_writer_init_lock();
     __write_to_statsd = __write_to_statsd_init;
     if (statsdLoggerWrite.close) {
@@ -47,6 +49,10 @@ int stats_log_is_closed() {
     return statsdLoggerWrite.isClosed && (*statsdLoggerWrite.isClosed)();
 }
 
+int stats_log_set_batching(uint32_t max_delay_us, size_t max_bytes) {
+    return statsd_writer_set_batching(max_delay_us, max_bytes);
+}
+
 int write_buffer_to_statsd(void* buffer, size_t size, uint32_t atomId) {
     int ret = 1;
 
@@ -56,7 +62,7 @@ int write_buffer_to_statsd(void* buffer, size_t size, uint32_t atomId) {
     vecs[1].iov_base = buffer;
     vecs[1].iov_len = size;
 
-    ret = __write_to_statsd(vecs, 2);
+    ret = __write_to_statsd(vecs, 2, atomId);
 
     if (ret < 0) {
         note_log_drop(ret, atomId);
@@ -65,7 +71,7 @@ int write_buffer_to_statsd(void* buffer, size_t size, uint32_t atomId) {
     return ret;
 }
 
-static int __write_to_stats_daemon(struct iovec* vec, size_t nr) {
+static int __write_to_stats_daemon(struct iovec* vec, size_t nr, uint32_t atomId) {
     int save_errno;
     struct timespec ts;
     size_t len, i;
@@ -87,7 +93,10 @@ static int __write_to_stats_daemon(struct iovec* vec, size_t nr) {
     ts.tv_nsec = tv.tv_usec * 1000;
 #endif
 
-    int ret = (int)(*statsdLoggerWrite.write)(&ts, vec, nr);
+    int ret = statsd_writer_write_batched(&ts, vec, nr, atomId);
+    if (ret == 0) {
+        ret = (int)(*statsdLoggerWrite.write)(&ts, vec, nr);
+    }
     errno = save_errno;
     return ret;
 }
@@ -102,7 +111,7 @@ static int __write_to_statsd_initialize_locked() {
     return 1;
 }
 
-static int __write_to_statsd_init(struct iovec* vec, size_t nr) {
+static int __write_to_statsd_init(struct iovec* vec, size_t nr, uint32_t atomId) {
     int ret, save_errno = errno;
 
     statsd_writer_init_lock();
@@ -120,7 +129,7 @@ static int __write_to_statsd_init(struct iovec* vec, size_t nr) {
 
     statsd_writer_init_unlock();
 
-    ret = __write_to_statsd(vec, nr);
+    ret = __write_to_statsd(vec, nr, atomId);
     errno = save_errno;
     return ret;
 }
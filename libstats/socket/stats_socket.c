@@ -20,3 +20,7 @@
 void AStatsSocket_close() {
     stats_log_close();
 }
+
+int AStatsSocket_setBatching(uint32_t max_delay_us, size_t max_bytes) {
+    return stats_log_set_batching(max_delay_us, max_bytes);
+}
@@ -162,6 +162,17 @@ static int statsdIsClosed() {
     return 0;
 }
 
+/* Reconnects after statsd went away, returns the new socket or -errno. */
+static int statsdReopen(int negative_errno) {
+    if (statd_writer_trylock()) {
+        return negative_errno; /* in a signal handler? try again when less stressed */
+    }
+    __statsdClose(negative_errno);
+    int ret = statsdOpen();
+    statsd_writer_init_unlock();
+    return ret < 0 ? ret : atomic_load(&statsdLoggerWrite.sock);
+}
+
 static int statsdWrite(struct timespec* ts, struct iovec* vec, size_t nr) {
     ssize_t ret;
     int sock;
@@ -265,19 +276,12 @@ static int statsdWrite(struct timespec* ts, struct iovec* vec, size_t nr) {
         case -ENOTCONN:
         case -ECONNREFUSED:
         case -ENOENT:
-            if (statd_writer_trylock()) {
-                return ret; /* in a signal handler? try again when less stressed
-                             */
-            }
-            __statsdClose(ret);
-            ret = statsdOpen();
-            statsd_writer_init_unlock();
-
+            ret = statsdReopen(ret);
             if (ret < 0) {
                 return ret;
             }
 
-            ret = TEMP_FAILURE_RETRY(writev(atomic_load(&statsdLoggerWrite.sock), newVec, i));
+            ret = TEMP_FAILURE_RETRY(writev(ret, newVec, i));
             if (ret < 0) {
                 ret = -errno;
             }
@@ -292,3 +296,290 @@ static int statsdWrite(struct timespec* ts, struct iovec* vec, size_t nr) {
 
     return ret;
 }
+
+/*
+ * Writes held back by AStatsSocket_setBatching(), sent to statsd with a single sendmmsg() when
+ * the batch fills up or max_delay_us after the first one was queued. Each write keeps its own
+ * datagram, header included, so statsd receives exactly what unbatched writes would have sent.
+ */
+#define BATCH_MAX_LOGS 64
+#define BATCH_MAX_BYTES (64 * 1024)
+
+struct statsd_batch {
+    pthread_mutex_t lock;
+    pthread_cond_t wakeup;
+    uint32_t max_delay_us;
+    size_t max_bytes;
+    pid_t flusher_pid; /* process the flusher thread runs in, 0 if none */
+    struct timespec first;
+    size_t count;
+    size_t used;
+    int tags[BATCH_MAX_LOGS];
+    struct iovec logs[BATCH_MAX_LOGS];
+    unsigned char data[BATCH_MAX_BYTES];
+};
+
+static _Atomic(struct statsd_batch*) statsd_batch = NULL;
+
+static int sendLogs(int sock, struct mmsghdr* msgs, size_t count, size_t* sent) {
+    while (*sent < count) {
+        int n = TEMP_FAILURE_RETRY(sendmmsg(sock, msgs + *sent, count - *sent, 0));
+        if (n < 0) {
+            return -errno;
+        }
+        *sent += n;
+    }
+    return 0;
+}
+
+static void flushLocked(struct statsd_batch* batch) {
+    struct mmsghdr msgs[BATCH_MAX_LOGS + 1];
+    size_t count = 0, sent = 0, first_log, i;
+    int ret;
+
+    if (batch->count == 0) {
+        return;
+    }
+    memset(msgs, 0, sizeof(msgs));
+
+    // If we dropped events before, try to tell statsd first, as statsdWrite() does.
+    android_log_header_t header;
+    android_log_event_long_t buffer;
+    struct iovec report[2];
+    int32_t snapshot = 0;
+    int sock = atomic_load(&statsdLoggerWrite.sock);
+    if (sock >= 0) {
+        snapshot = atomic_exchange_explicit(&dropped, 0, memory_order_relaxed);
+    }
+    if (snapshot) {
+        memcpy(&header, batch->logs[0].iov_base, sizeof(header));
+        buffer.header.tag = atomic_load(&log_error);
+        buffer.payload.type = EVENT_TYPE_LONG;
+        buffer.payload.data = ((int64_t)atomic_load(&atom_tag) << 32) | ((int64_t)snapshot);
+        report[0].iov_base = &header;
+        report[0].iov_len = sizeof(header);
+        report[1].iov_base = &buffer;
+        report[1].iov_len = sizeof(buffer);
+        msgs[count].msg_hdr.msg_iov = report;
+        msgs[count].msg_hdr.msg_iovlen = 2;
+        count++;
+    }
+    first_log = count;
+    for (i = 0; i < batch->count; i++, count++) {
+        msgs[count].msg_hdr.msg_iov = &batch->logs[i];
+        msgs[count].msg_hdr.msg_iovlen = 1;
+    }
+
+    /* Same policy as statsdWrite(): the sends could be lost, but will never block. */
+    ret = sock < 0 ? sock : sendLogs(sock, msgs, count, &sent);
+    switch (ret) {
+        case -ENOTCONN:
+        case -ECONNREFUSED:
+        case -ENOENT:
+            ret = statsdReopen(ret);
+            if (ret >= 0) {
+                ret = sendLogs(ret, msgs, count, &sent);
+            }
+            break;
+        default:
+            break;
+    }
+
+    if (sent < first_log) {
+        atomic_fetch_add_explicit(&dropped, snapshot, memory_order_relaxed);
+    }
+    for (i = sent > first_log ? sent - first_log : 0; i < batch->count; i++) {
+        statsdNoteDrop(ret, batch->tags[i]);
+    }
+    batch->count = 0;
+    batch->used = 0;
+}
+
+static void* statsdFlusher(void* arg) {
+    struct statsd_batch* batch = (struct statsd_batch*)arg;
+    pid_t pid = getpid();
+
+    pthread_mutex_lock(&batch->lock);
+    while (batch->flusher_pid == pid) {
+        if (batch->count == 0) {
+            pthread_cond_wait(&batch->wakeup, &batch->lock);
+            continue;
+        }
+        struct timespec deadline = batch->first;
+        deadline.tv_sec += batch->max_delay_us / 1000000;
+        deadline.tv_nsec += (batch->max_delay_us % 1000000) * 1000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        if (pthread_cond_timedwait(&batch->wakeup, &batch->lock, &deadline) == ETIMEDOUT) {
+            flushLocked(batch);
+        }
+    }
+    pthread_mutex_unlock(&batch->lock);
+    return NULL;
+}
+
+static int startFlusherLocked(struct statsd_batch* batch) {
+    pid_t pid = getpid();
+    if (batch->flusher_pid == pid) {
+        return 1;
+    }
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    int started = 0;
+    if (!pthread_attr_init(&attr)) {
+        if (!pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) {
+            batch->flusher_pid = pid;
+            started = !pthread_create(&thread, &attr, statsdFlusher, batch);
+            if (!started) {
+                batch->flusher_pid = 0;
+            }
+        }
+        pthread_attr_destroy(&attr);
+    }
+    return started;
+}
+
+static void batchForkPrepare() {
+    pthread_mutex_lock(&atomic_load(&statsd_batch)->lock);
+}
+
+static void batchForkParent() {
+    pthread_mutex_unlock(&atomic_load(&statsd_batch)->lock);
+}
+
+/* The parent sends what is pending, the child has no flusher thread until it writes again. */
+static void batchForkChild() {
+    struct statsd_batch* batch = atomic_load(&statsd_batch);
+    batch->count = 0;
+    batch->used = 0;
+    batch->flusher_pid = 0;
+    pthread_mutex_unlock(&batch->lock);
+}
+
+static struct statsd_batch* getBatch() {
+    struct statsd_batch* batch = atomic_load(&statsd_batch);
+    if (batch) {
+        return batch;
+    }
+
+    struct statsd_batch* new_batch = (struct statsd_batch*)calloc(1, sizeof(struct statsd_batch));
+    if (!new_batch) {
+        return NULL;
+    }
+    pthread_mutex_init(&new_batch->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&new_batch->wakeup, &attr);
+    pthread_condattr_destroy(&attr);
+    new_batch->max_bytes = BATCH_MAX_BYTES;
+
+    if (!atomic_compare_exchange_strong(&statsd_batch, &batch, new_batch)) {
+        pthread_cond_destroy(&new_batch->wakeup);
+        pthread_mutex_destroy(&new_batch->lock);
+        free(new_batch);
+        return batch;
+    }
+    pthread_atfork(batchForkPrepare, batchForkParent, batchForkChild);
+    return new_batch;
+}
+
+int statsd_writer_set_batching(uint32_t max_delay_us, size_t max_bytes) {
+    struct statsd_batch* batch = atomic_load(&statsd_batch);
+    if (max_delay_us == 0 && !batch) {
+        return 0;
+    }
+    if (!batch && !(batch = getBatch())) {
+        return -ENOMEM;
+    }
+
+    if (max_bytes == 0 || max_bytes > BATCH_MAX_BYTES) {
+        max_bytes = BATCH_MAX_BYTES;
+    } else if (max_bytes < sizeof(android_log_header_t) + LOGGER_ENTRY_MAX_PAYLOAD) {
+        max_bytes = sizeof(android_log_header_t) + LOGGER_ENTRY_MAX_PAYLOAD;
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    flushLocked(batch);
+    batch->max_delay_us = max_delay_us;
+    batch->max_bytes = max_bytes;
+    if (max_delay_us == 0) {
+        // Let the flusher thread exit.
+        batch->flusher_pid = 0;
+    }
+    pthread_cond_signal(&batch->wakeup);
+    pthread_mutex_unlock(&batch->lock);
+    return 0;
+}
+
+void statsd_writer_flush() {
+    struct statsd_batch* batch = atomic_load(&statsd_batch);
+    if (!batch) {
+        return;
+    }
+    pthread_mutex_lock(&batch->lock);
+    flushLocked(batch);
+    pthread_mutex_unlock(&batch->lock);
+}
+
+int statsd_writer_write_batched(struct timespec* ts, struct iovec* vec, size_t nr, int tag) {
+    struct statsd_batch* batch = atomic_load(&statsd_batch);
+    size_t i, len, payloadSize = 0;
+
+    if (!batch) {
+        return 0;
+    }
+    for (i = 0; i < nr; i++) {
+        payloadSize += vec[i].iov_len;
+    }
+    if (payloadSize > LOGGER_ENTRY_MAX_PAYLOAD) {
+        payloadSize = LOGGER_ENTRY_MAX_PAYLOAD;
+    }
+    if (payloadSize == 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&batch->lock);
+    if (batch->max_delay_us == 0) {
+        pthread_mutex_unlock(&batch->lock);
+        return 0;
+    }
+    if (batch->count == BATCH_MAX_LOGS ||
+        batch->used + sizeof(android_log_header_t) + payloadSize > batch->max_bytes) {
+        flushLocked(batch);
+    }
+
+    android_log_header_t header;
+    header.id = LOG_ID_STATS;
+    header.tid = gettid();
+    header.realtime.tv_sec = ts->tv_sec;
+    header.realtime.tv_nsec = ts->tv_nsec;
+    unsigned char* data = batch->data + batch->used;
+    memcpy(data, &header, sizeof(header));
+    len = sizeof(header);
+    for (i = 0; i < nr && len < sizeof(header) + payloadSize; i++) {
+        size_t n = vec[i].iov_len;
+        if (n > sizeof(header) + payloadSize - len) {
+            n = sizeof(header) + payloadSize - len;
+        }
+        memcpy(data + len, vec[i].iov_base, n);
+        len += n;
+    }
+    batch->logs[batch->count].iov_base = data;
+    batch->logs[batch->count].iov_len = len;
+    batch->tags[batch->count] = tag;
+    batch->count++;
+    batch->used += len;
+
+    if (!startFlusherLocked(batch)) {
+        flushLocked(batch);
+    } else if (batch->count == 1) {
+        clock_gettime(CLOCK_MONOTONIC, &batch->first);
+        pthread_cond_signal(&batch->wakeup);
+    }
+    pthread_mutex_unlock(&batch->lock);
+    return payloadSize;
+}
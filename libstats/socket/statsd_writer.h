@@ -19,6 +19,8 @@
 
 #include <pthread.h>
 #include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <sys/socket.h>
 
 /**
@@ -44,4 +46,12 @@ struct android_log_transport_write {
     int (*isClosed)();
 };
 
+/*
+ * Batching of writes, see AStatsSocket_setBatching(). statsd_writer_write_batched() queues a log
+ * and returns its payload size, or returns 0 if batching is off and the caller should write it.
+ */
+int statsd_writer_set_batching(uint32_t max_delay_us, size_t max_bytes);
+int statsd_writer_write_batched(struct timespec* ts, struct iovec* vec, size_t nr, int tag);
+void statsd_writer_flush();
+
 #endif  // ANDROID_STATS_LOG_STATS_WRITER_H
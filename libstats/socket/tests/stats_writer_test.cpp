@@ -34,3 +34,21 @@ TEST(StatsWriterTest, TestSocketClose) {
 
     EXPECT_TRUE(stats_log_is_closed());
 }
+
+TEST(StatsWriterTest, TestBatching) {
+    ASSERT_EQ(0, AStatsSocket_setBatching(1000000, 0));
+    for (int i = 0; i < 100; i++) {
+        AStatsEvent* event = AStatsEvent_obtain();
+        AStatsEvent_setAtomId(event, 100);
+        AStatsEvent_writeInt32(event, i);
+        // Queued events report the number of bytes that will be written.
+        EXPECT_GT(AStatsEvent_write(event), 0);
+        AStatsEvent_release(event);
+    }
+
+    // Turning batching off sends whatever is still queued.
+    EXPECT_EQ(0, AStatsSocket_setBatching(0, 0));
+    EXPECT_FALSE(stats_log_is_closed());
+
+    AStatsSocket_close();
+}
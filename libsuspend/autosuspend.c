@@ -113,3 +113,27 @@ void autosuspend_set_wakeup_callback(void (*func)(bool success)) {
 
     autosuspend_ops->set_wakeup_callback(func);
 }
+
+void autosuspend_wakeup_released(void) {
+    int ret;
+
+    ret = autosuspend_init();
+    if (ret) {
+        return;
+    }
+
+    ALOGV("autosuspend_wakeup_released");
+
+    autosuspend_ops->wakeup_released();
+}
+
+int autosuspend_get_stats(struct autosuspend_stats* stats) {
+    int ret;
+
+    ret = autosuspend_init();
+    if (ret) {
+        return ret;
+    }
+
+    return autosuspend_ops->get_stats(stats);
+}
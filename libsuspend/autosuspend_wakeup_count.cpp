@@ -17,6 +17,7 @@
 #define LOG_TAG "libsuspend"
 //#define LOG_NDEBUG 0
 
+#include <errno.h>
 #include <fcntl.h>
 #include <pthread.h>
 #include <semaphore.h>
@@ -26,11 +27,13 @@
 #include <sys/param.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/strings.h>
+#include <suspend/autosuspend.h>
 
 #include "autosuspend_ops.h"
 
@@ -53,8 +56,23 @@ static constexpr char sys_power_state[] = "/sys/power/state";
 static constexpr char sys_power_wakeup_count[] = "/sys/power/wakeup_count";
 static bool autosuspend_is_init = false;
 
-static void update_sleep_time(bool success) {
-    if (success) {
+// Protects stats and retry_requested, and wakes the suspend thread from its backoff.
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t retry_cond;
+static bool retry_requested = false;
+static struct autosuspend_stats stats;
+
+enum class AttemptResult {
+    kSuccess,
+    // A wakeup event came in between reading and writing wakeup_count.
+    kWakeupEvent,
+    kFailure,
+};
+
+static void update_sleep_time(AttemptResult result) {
+    // A wakeup event only means that a wakeup source was activated, and the next read of
+    // wakeup_count blocks until it has been released again, so there's nothing to back off from.
+    if (result != AttemptResult::kFailure) {
         sleep_time = BASE_SLEEP_TIME;
         return;
     }
@@ -62,24 +80,70 @@ static void update_sleep_time(bool success) {
     sleep_time = MIN(sleep_time * 2, MAX_SLEEP_TIME);
 }
 
+static uint64_t now_us(void) {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000ULL + ts.tv_nsec / 1000;
+}
+
+// Sleeps for sleep_time, or until a client tells us that a wakeup source has been released.
+static void backoff(void) {
+    timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += sleep_time / 1000000;
+    deadline.tv_nsec += (sleep_time % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&lock);
+    while (!retry_requested) {
+        if (pthread_cond_timedwait(&retry_cond, &lock, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    retry_requested = false;
+    pthread_mutex_unlock(&lock);
+}
+
+static void record_failure(uint64_t* counter, int error) {
+    pthread_mutex_lock(&lock);
+    (*counter)++;
+    stats.last_errno = error;
+    pthread_mutex_unlock(&lock);
+}
+
 static void* suspend_thread_func(void* arg __attribute__((unused))) {
-    bool success = true;
+    AttemptResult result = AttemptResult::kSuccess;
 
     while (true) {
-        update_sleep_time(success);
-        usleep(sleep_time);
-        success = false;
+        update_sleep_time(result);
+        uint64_t backoff_start = now_us();
+        backoff();
+        if (result == AttemptResult::kFailure) {
+            pthread_mutex_lock(&lock);
+            stats.total_backoff_us += now_us() - backoff_start;
+            pthread_mutex_unlock(&lock);
+        }
+        result = AttemptResult::kFailure;
+
+        // This blocks for as long as any wakeup source is active.
         LOG(VERBOSE) << "read wakeup_count";
+        uint64_t wait_start = now_us();
         lseek(wakeup_count_fd, 0, SEEK_SET);
         std::string wakeup_count;
         if (!ReadFdToString(wakeup_count_fd, &wakeup_count)) {
             PLOG(ERROR) << "error reading from " << sys_power_wakeup_count;
+            record_failure(&stats.read_failures, errno);
             continue;
         }
+        uint64_t wait_us = now_us() - wait_start;
 
         wakeup_count = Trim(wakeup_count);
         if (wakeup_count.empty()) {
             LOG(ERROR) << "empty wakeup count";
+            record_failure(&stats.read_failures, EINVAL);
             continue;
         }
 
@@ -93,7 +157,23 @@ static void* suspend_thread_func(void* arg __attribute__((unused))) {
         LOG(VERBOSE) << "write " << wakeup_count << " to wakeup_count";
         if (WriteStringToFd(wakeup_count, wakeup_count_fd)) {
             LOG(VERBOSE) << "write " << sleep_state << " to " << sys_power_state;
-            success = WriteStringToFd(sleep_state, state_fd);
+            uint64_t suspend_start = now_us();
+            bool success = WriteStringToFd(sleep_state, state_fd);
+            int error = errno;
+            uint64_t suspend_us = now_us() - suspend_start;
+            result = success ? AttemptResult::kSuccess : AttemptResult::kFailure;
+
+            pthread_mutex_lock(&lock);
+            stats.attempts++;
+            if (success) {
+                stats.successes++;
+            } else {
+                stats.suspend_failures++;
+                stats.last_errno = error;
+            }
+            stats.last_wait_us = wait_us;
+            stats.last_suspend_us = suspend_us;
+            pthread_mutex_unlock(&lock);
 
             void (*func)(bool success) = wakeup_func;
             if (func != NULL) {
@@ -101,6 +181,15 @@ static void* suspend_thread_func(void* arg __attribute__((unused))) {
             }
         } else {
             PLOG(ERROR) << "error writing to " << sys_power_wakeup_count;
+            result = AttemptResult::kWakeupEvent;
+
+            pthread_mutex_lock(&lock);
+            stats.attempts++;
+            stats.wakeup_event_aborts++;
+            stats.last_errno = errno;
+            stats.last_wait_us = wait_us;
+            stats.last_suspend_us = 0;
+            pthread_mutex_unlock(&lock);
         }
 
         LOG(VERBOSE) << "release sem";
@@ -150,6 +239,13 @@ static int autosuspend_init(void) {
         goto err_sem_init;
     }
 
+    // The backoff deadline is on CLOCK_MONOTONIC, so that it isn't cut short by time suspended.
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&retry_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
     ret = pthread_create(&suspend_thread, NULL, suspend_thread_func, NULL);
     if (ret) {
         LOG(ERROR) << "error creating thread: " << strerror(ret);
@@ -161,6 +257,7 @@ static int autosuspend_init(void) {
     return 0;
 
 err_pthread_create:
+    pthread_cond_destroy(&retry_cond);
     sem_destroy(&suspend_lockout);
 err_sem_init:
     close(wakeup_count_fd);
@@ -216,7 +313,7 @@ static int force_suspend(int timeout_ms) {
     return WriteStringToFd(sleep_state, state_fd) ? 0 : -1;
 }
 
-static void autosuspend_set_wakeup_callback(void (*func)(bool success)) {
+static void autosuspend_wakeup_count_set_wakeup_callback(void (*func)(bool success)) {
     if (wakeup_func != NULL) {
         LOG(ERROR) << "duplicate wakeup callback applied, keeping original";
         return;
@@ -224,11 +321,29 @@ static void autosuspend_set_wakeup_callback(void (*func)(bool success)) {
     wakeup_func = func;
 }
 
+static void autosuspend_wakeup_count_wakeup_released(void) {
+    pthread_mutex_lock(&lock);
+    retry_requested = true;
+    if (autosuspend_is_init) {
+        pthread_cond_signal(&retry_cond);
+    }
+    pthread_mutex_unlock(&lock);
+}
+
+static int autosuspend_wakeup_count_get_stats(struct autosuspend_stats* out) {
+    pthread_mutex_lock(&lock);
+    *out = stats;
+    pthread_mutex_unlock(&lock);
+    return 0;
+}
+
 struct autosuspend_ops autosuspend_wakeup_count_ops = {
     .enable = autosuspend_wakeup_count_enable,
     .disable = autosuspend_wakeup_count_disable,
     .force_suspend = force_suspend,
-    .set_wakeup_callback = autosuspend_set_wakeup_callback,
+    .set_wakeup_callback = autosuspend_wakeup_count_set_wakeup_callback,
+    .wakeup_released = autosuspend_wakeup_count_wakeup_released,
+    .get_stats = autosuspend_wakeup_count_get_stats,
 };
 
 struct autosuspend_ops* autosuspend_wakeup_count_init(void) {
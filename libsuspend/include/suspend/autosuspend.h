@@ -19,6 +19,7 @@
 
 #include <sys/cdefs.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 __BEGIN_DECLS
 
@@ -64,6 +65,46 @@ int autosuspend_force_suspend(int timeout_ms);
  */
 void autosuspend_set_wakeup_callback(void (*func)(bool success));
 
+/*
+ * autosuspend_wakeup_released
+ *
+ * Tell autosuspend that a wakeup source it may be waiting on has been
+ * released. If it is backing off after a failed suspend, it tries again
+ * right away instead of waiting for the backoff to run out.
+ */
+void autosuspend_wakeup_released(void);
+
+struct autosuspend_stats {
+    /* Number of times suspend was attempted. */
+    uint64_t attempts;
+    /* Number of attempts that suspended the device. */
+    uint64_t successes;
+    /* Number of attempts aborted by a wakeup event before suspend was entered. */
+    uint64_t wakeup_event_aborts;
+    /* Number of attempts where the kernel failed to suspend. */
+    uint64_t suspend_failures;
+    /* Number of failed reads of the wakeup count, which aren't counted as attempts. */
+    uint64_t read_failures;
+    /* Time the last attempt waited for wakeup sources to be released. */
+    uint64_t last_wait_us;
+    /* Time the last attempt spent entering and leaving suspend, not counting the time suspended. */
+    uint64_t last_suspend_us;
+    /* Total time spent backing off after failures. */
+    uint64_t total_backoff_us;
+    /* errno of the last failure, 0 if there hasn't been one. */
+    int last_errno;
+};
+
+/*
+ * autosuspend_get_stats
+ *
+ * Fill in stats with counts and timings of the suspend attempts made since
+ * autosuspend was first enabled.
+ *
+ * Returns 0 on success, -1 if the stats are not available.
+ */
+int autosuspend_get_stats(struct autosuspend_stats* stats);
+
 __END_DECLS
 
 #endif
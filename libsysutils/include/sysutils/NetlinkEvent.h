@@ -42,12 +42,19 @@ private:
     Action mAction;
     char *mSubsystem;
     char *mParams[NL_PARAMS_MAX];
+    // mPath, mSubsystem and mParams point into the decoded buffer rather than the heap.
+    bool mInPlace;
 
 public:
     NetlinkEvent();
     virtual ~NetlinkEvent();
 
     bool decode(char *buffer, int size, int format = NetlinkListener::NETLINK_FORMAT_ASCII);
+    // Like decode(), but an ASCII uevent's path, subsystem and parameters are left in |buffer|
+    // instead of being copied, so it must outlive the event.  Binary messages are decoded as
+    // usual, as their parameters are formatted rather than found in the buffer.
+    bool decodeInPlace(char *buffer, int size,
+                       int format = NetlinkListener::NETLINK_FORMAT_ASCII);
     const char *findParam(const char *paramName);
 
     const char *getSubsystem() { return mSubsystem; }
@@ -30,6 +30,7 @@ class SocketListener {
     std::unordered_map<int, SocketClient*> mClients;
     pthread_mutex_t         mClientsLock;
     int                     mCtrlPipe[2];
+    int                     mEpollFd;
     pthread_t               mThread;
     bool                    mUseCmdNum;
 
@@ -60,6 +61,9 @@ private:
     std::vector<SocketClient*> snapshotClients();
 
     bool release(SocketClient *c, bool wakeup);
+    // Registers |fd| with the epoll set for as long as it is open, instead of re-adding every
+    // client on each pass through the loop.
+    bool watch(int fd);
     void runListener();
     void init(const char *socketName, int socketFd, bool listen, bool useCmdNum);
 };
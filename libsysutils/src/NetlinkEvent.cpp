@@ -66,10 +66,13 @@ NetlinkEvent::NetlinkEvent() {
     memset(mParams, 0, sizeof(mParams));
     mPath = nullptr;
     mSubsystem = nullptr;
+    mInPlace = false;
 }
 
 NetlinkEvent::~NetlinkEvent() {
     int i;
+    if (mInPlace)
+        return;
     if (mPath)
         free(mPath);
     if (mSubsystem)
@@ -625,6 +628,11 @@ has_prefix(const char* str, const char* end, const char* prefix, size_t prefixle
 #define HAS_CONST_PREFIX(str,end,prefix)  has_prefix((str),(end),prefix,CONST_STRLEN(prefix))
 
 
+/* Returns 's' itself if it may point into the buffer being decoded, or a copy. */
+static char *keep(const char *s, bool inPlace) {
+    return inPlace ? const_cast<char *>(s) : strdup(s);
+}
+
 /*
  * Parse an ASCII-formatted message from a NETLINK_KOBJECT_UEVENT
  * netlink socket.
@@ -651,7 +659,7 @@ bool NetlinkEvent::parseAsciiNetlinkMessage(char *buffer, int size) {
                     return false;
                 }
             }
-            mPath = strdup(p+1);
+            mPath = keep(p+1, mInPlace);
             first = 0;
         } else {
             const char* a;
@@ -667,9 +675,9 @@ bool NetlinkEvent::parseAsciiNetlinkMessage(char *buffer, int size) {
                     SLOGE("NetlinkEvent::parseAsciiNetlinkMessage: failed to parse SEQNUM=%s", a);
                 }
             } else if ((a = HAS_CONST_PREFIX(s, end, "SUBSYSTEM=")) != nullptr) {
-                mSubsystem = strdup(a);
+                mSubsystem = keep(a, mInPlace);
             } else if (param_idx < NL_PARAMS_MAX) {
-                mParams[param_idx++] = strdup(s);
+                mParams[param_idx++] = keep(s, mInPlace);
             }
         }
         s += strlen(s) + 1;
@@ -686,6 +694,11 @@ bool NetlinkEvent::decode(char *buffer, int size, int format) {
     }
 }
 
+bool NetlinkEvent::decodeInPlace(char *buffer, int size, int format) {
+    mInPlace = (format == NetlinkListener::NETLINK_FORMAT_ASCII);
+    return decode(buffer, size, format);
+}
+
 const char *NetlinkEvent::findParam(const char *paramName) {
     size_t len = strlen(paramName);
     for (int i = 0; i < NL_PARAMS_MAX && mParams[i] != nullptr; ++i) {
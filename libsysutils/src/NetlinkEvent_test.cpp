@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2021 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <sysutils/NetlinkEvent.h>
+
+#include <string>
+
+#include <gtest/gtest.h>
+
+namespace {
+
+const char kUevent[] =
+        "add@/devices/virtual/block/loop7\0"
+        "ACTION=add\0"
+        "DEVPATH=/devices/virtual/block/loop7\0"
+        "SUBSYSTEM=block\0"
+        "MAJOR=7\0"
+        "MINOR=7\0"
+        "DEVNAME=loop7\0"
+        "DEVTYPE=disk\0"
+        "SEQNUM=1234\0";
+
+void checkUevent(NetlinkEvent& evt) {
+    EXPECT_EQ(NetlinkEvent::Action::kAdd, evt.getAction());
+    EXPECT_STREQ("block", evt.getSubsystem());
+    EXPECT_STREQ("/devices/virtual/block/loop7", evt.findParam("DEVPATH"));
+    EXPECT_STREQ("7", evt.findParam("MAJOR"));
+    EXPECT_STREQ("loop7", evt.findParam("DEVNAME"));
+    EXPECT_STREQ("disk", evt.findParam("DEVTYPE"));
+    EXPECT_EQ(nullptr, evt.findParam("DEV"));
+}
+
+}  // unnamed namespace
+
+TEST(NetlinkEventTest, DecodesUevent) {
+    std::string buffer(kUevent, sizeof(kUevent));
+    NetlinkEvent evt;
+    ASSERT_TRUE(evt.decode(buffer.data(), buffer.size()));
+
+    // The event has its own copies.
+    buffer.assign(buffer.size(), 'x');
+    checkUevent(evt);
+}
+
+TEST(NetlinkEventTest, DecodesUeventInPlace) {
+    std::string buffer(kUevent, sizeof(kUevent));
+    NetlinkEvent evt;
+    ASSERT_TRUE(evt.decodeInPlace(buffer.data(), buffer.size()));
+    checkUevent(evt);
+
+    // The event points into the buffer.
+    const char* devname = evt.findParam("DEVNAME");
+    EXPECT_GE(devname, buffer.data());
+    EXPECT_LT(devname, buffer.data() + buffer.size());
+}
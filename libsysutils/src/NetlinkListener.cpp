@@ -28,6 +28,13 @@
 #include <log/log.h>
 #include <sysutils/NetlinkEvent.h>
 
+/*
+ * Uevents are small, the kernel caps their environment at 2KiB, so the buffer is split up to
+ * receive a burst of them with a single recvmmsg().  Binary messages can be much larger, as
+ * nfnetlink_log packs several packets into one, so they still get the whole buffer.
+ */
+static constexpr size_t kUeventBatch = 8;
+
 #if 1
 /* temporary version until we can get Motorola to update their
  * ril.so.  Their prebuilt ril.so is using this private class
@@ -49,6 +56,10 @@ bool NetlinkListener::onDataAvailable(SocketClient *cli)
     ssize_t count;
     uid_t uid = -1;
 
+    if (mFormat == NETLINK_FORMAT_ASCII) {
+        return receiveUevents(socket);
+    }
+
     bool require_group = true;
     if (mFormat == NETLINK_FORMAT_BINARY_UNICAST) {
         require_group = false;
@@ -61,15 +72,61 @@ bool NetlinkListener::onDataAvailable(SocketClient *cli)
         return false;
     }
 
-    NetlinkEvent *evt = new NetlinkEvent();
-    if (evt->decode(mBuffer, count, mFormat)) {
-        onEvent(evt);
+    dispatch(mBuffer, count);
+    return true;
+}
+
+bool NetlinkListener::receiveUevents(int socket) {
+    constexpr size_t kSlotSize = sizeof(mBuffer) / kUeventBatch;
+    struct iovec iov[kUeventBatch];
+    struct sockaddr_nl addr[kUeventBatch];
+    char control[kUeventBatch][CMSG_SPACE(sizeof(struct ucred))];
+    struct mmsghdr msgs[kUeventBatch];
+    for (size_t i = 0; i < kUeventBatch; i++) {
+        iov[i] = {mBuffer + i * kSlotSize, kSlotSize};
+        msgs[i].msg_hdr = {
+            .msg_name = &addr[i],
+            .msg_namelen = sizeof(addr[i]),
+            .msg_iov = &iov[i],
+            .msg_iovlen = 1,
+            .msg_control = control[i],
+            .msg_controllen = sizeof(control[i]),
+        };
+    }
+
+    // Blocks for the first uevent only, then takes whatever else has already queued up.
+    int n = TEMP_FAILURE_RETRY(recvmmsg(socket, msgs, kUeventBatch, MSG_WAITFORONE, nullptr));
+    if (n < 0) {
+        SLOGE("recvmmsg failed (%s)", strerror(errno));
+        return false;
+    }
+
+    for (int i = 0; i < n; i++) {
+        // The same checks as uevent_kernel_recv(): only multicasts from the kernel count.
+        const struct msghdr& hdr = msgs[i].msg_hdr;
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr);
+        if (cmsg == nullptr || cmsg->cmsg_type != SCM_CREDENTIALS ||
+            addr[i].nl_pid != 0 || addr[i].nl_groups == 0) {
+            memset(iov[i].iov_base, 0, kSlotSize);
+            continue;
+        }
+        if (hdr.msg_flags & MSG_TRUNC) {
+            SLOGE("Dropping truncated uevent (%u bytes)", msgs[i].msg_len);
+            continue;
+        }
+        dispatch(static_cast<char *>(iov[i].iov_base), msgs[i].msg_len);
+    }
+    return true;
+}
+
+void NetlinkListener::dispatch(char *buffer, ssize_t count) {
+    // The event only lives for the duration of onEvent(), so it can borrow the buffer.
+    NetlinkEvent evt;
+    if (evt.decodeInPlace(buffer, count, mFormat)) {
+        onEvent(&evt);
     } else if (mFormat != NETLINK_FORMAT_BINARY) {
         // Don't complain if parseBinaryNetlinkMessage returns false. That can
         // just mean that the buffer contained no messages we're interested in.
         SLOGE("Error decoding NetlinkEvent");
     }
-
-    delete evt;
-    return true;
 }
@@ -19,7 +19,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
-#include <sys/poll.h>
+#include <sys/epoll.h>
 #include <sys/socket.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -36,6 +36,9 @@
 #define CtrlPipe_Shutdown 0
 #define CtrlPipe_Wakeup   1
 
+// How many ready fds a single epoll_wait() call can hand back.
+static constexpr int kMaxEvents = 32;
+
 SocketListener::SocketListener(const char *socketName, bool listen) {
     init(socketName, -1, listen, false);
 }
@@ -53,6 +56,8 @@ void SocketListener::init(const char *socketName, int socketFd, bool listen, boo
     mSocketName = socketName;
     mSock = socketFd;
     mUseCmdNum = useCmdNum;
+    mCtrlPipe[0] = mCtrlPipe[1] = -1;
+    mEpollFd = -1;
     pthread_mutex_init(&mClientsLock, nullptr);
 }
 
@@ -64,6 +69,7 @@ SocketListener::~SocketListener() {
         close(mCtrlPipe[0]);
         close(mCtrlPipe[1]);
     }
+    if (mEpollFd != -1) close(mEpollFd);
     for (auto pair : mClients) {
         pair.second->decRef();
     }
@@ -92,14 +98,21 @@ int SocketListener::startListener(int backlog) {
     if (mListen && listen(mSock, backlog) < 0) {
         SLOGE("Unable to listen on socket (%s)", strerror(errno));
         return -1;
-    } else if (!mListen)
-        mClients[mSock] = new SocketClient(mSock, false, mUseCmdNum);
+    }
 
     if (pipe2(mCtrlPipe, O_CLOEXEC)) {
         SLOGE("pipe failed (%s)", strerror(errno));
         return -1;
     }
 
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (mEpollFd == -1) {
+        SLOGE("epoll_create1 failed (%s)", strerror(errno));
+        return -1;
+    }
+    if (!watch(mCtrlPipe[0]) || !watch(mSock)) return -1;
+    if (!mListen) mClients[mSock] = new SocketClient(mSock, false, mUseCmdNum);
+
     if (pthread_create(&mThread, nullptr, SocketListener::threadStart, this)) {
         SLOGE("pthread_create (%s)", strerror(errno));
         return -1;
@@ -127,6 +140,8 @@ int SocketListener::stopListener() {
     close(mCtrlPipe[1]);
     mCtrlPipe[0] = -1;
     mCtrlPipe[1] = -1;
+    close(mEpollFd);
+    mEpollFd = -1;
 
     if (mSocketName && mSock > -1) {
         close(mSock);
@@ -148,67 +163,61 @@ void *SocketListener::threadStart(void *obj) {
     return nullptr;
 }
 
+bool SocketListener::watch(int fd) {
+    // Level-triggered: onDataAvailable() implementations read a single message per call from a
+    // blocking socket, so anything they leave behind has to wake us up again.
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = fd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+        SLOGE("epoll_ctl add %d failed (%s)", fd, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
 void SocketListener::runListener() {
+    epoll_event events[kMaxEvents];
+    std::vector<SocketClient*> pending;
     while (true) {
-        std::vector<pollfd> fds;
-
-        pthread_mutex_lock(&mClientsLock);
-        fds.reserve(2 + mClients.size());
-        fds.push_back({.fd = mCtrlPipe[0], .events = POLLIN});
-        if (mListen) fds.push_back({.fd = mSock, .events = POLLIN});
-        for (auto pair : mClients) {
-            // NB: calling out to an other object with mClientsLock held (safe)
-            const int fd = pair.second->getSocket();
-            if (fd != pair.first) SLOGE("fd mismatch: %d != %d", fd, pair.first);
-            fds.push_back({.fd = fd, .events = POLLIN});
-        }
-        pthread_mutex_unlock(&mClientsLock);
-
         SLOGV("mListen=%d, mSocketName=%s", mListen, mSocketName);
-        int rc = TEMP_FAILURE_RETRY(poll(fds.data(), fds.size(), -1));
+        int rc = TEMP_FAILURE_RETRY(epoll_wait(mEpollFd, events, kMaxEvents, -1));
         if (rc < 0) {
-            SLOGE("poll failed (%s) mListen=%d", strerror(errno), mListen);
+            SLOGE("epoll_wait failed (%s) mListen=%d", strerror(errno), mListen);
             sleep(1);
             continue;
         }
 
-        if (fds[0].revents & (POLLIN | POLLERR)) {
-            char c = CtrlPipe_Shutdown;
-            TEMP_FAILURE_RETRY(read(mCtrlPipe[0], &c, 1));
-            if (c == CtrlPipe_Shutdown) {
-                break;
+        // Look up all ready clients under a single lock, so we can release it before invoking
+        // the callbacks.  The fds are registered for as long as they are in the map, but one
+        // may have been released by another thread since epoll_wait() returned.
+        bool accept_ready = false;
+        pending.clear();
+        pthread_mutex_lock(&mClientsLock);
+        for (int i = 0; i < rc; ++i) {
+            const int fd = events[i].data.fd;
+            if (fd == mCtrlPipe[0]) {
+                char c = CtrlPipe_Shutdown;
+                TEMP_FAILURE_RETRY(read(mCtrlPipe[0], &c, 1));
+                if (c == CtrlPipe_Shutdown) {
+                    pthread_mutex_unlock(&mClientsLock);
+                    for (SocketClient* client : pending) client->decRef();
+                    return;
+                }
+                continue;
             }
-            continue;
-        }
-        if (mListen && (fds[1].revents & (POLLIN | POLLERR))) {
-            int c = TEMP_FAILURE_RETRY(accept4(mSock, nullptr, nullptr, SOCK_CLOEXEC));
-            if (c < 0) {
-                SLOGE("accept failed (%s)", strerror(errno));
-                sleep(1);
+            if (mListen && fd == mSock) {
+                accept_ready = true;
                 continue;
             }
-            pthread_mutex_lock(&mClientsLock);
-            mClients[c] = new SocketClient(c, true, mUseCmdNum);
-            pthread_mutex_unlock(&mClientsLock);
-        }
-
-        // Add all active clients to the pending list first, so we can release
-        // the lock before invoking the callbacks.
-        std::vector<SocketClient*> pending;
-        pthread_mutex_lock(&mClientsLock);
-        const int size = fds.size();
-        for (int i = mListen ? 2 : 1; i < size; ++i) {
-            const struct pollfd& p = fds[i];
-            if (p.revents & (POLLIN | POLLERR)) {
-                auto it = mClients.find(p.fd);
-                if (it == mClients.end()) {
-                    SLOGE("fd vanished: %d", p.fd);
-                    continue;
-                }
-                SocketClient* c = it->second;
-                pending.push_back(c);
-                c->incRef();
+            auto it = mClients.find(fd);
+            if (it == mClients.end()) {
+                SLOGV("fd vanished: %d", fd);
+                continue;
             }
+            SocketClient* c = it->second;
+            pending.push_back(c);
+            c->incRef();
         }
         pthread_mutex_unlock(&mClientsLock);
 
@@ -220,6 +229,23 @@ void SocketListener::runListener() {
             }
             c->decRef();
         }
+
+        if (accept_ready) {
+            int c = TEMP_FAILURE_RETRY(accept4(mSock, nullptr, nullptr, SOCK_CLOEXEC));
+            if (c < 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK) continue;
+                SLOGE("accept failed (%s)", strerror(errno));
+                sleep(1);
+                continue;
+            }
+            pthread_mutex_lock(&mClientsLock);
+            if (watch(c)) {
+                mClients[c] = new SocketClient(c, true, mUseCmdNum);
+            } else {
+                close(c);
+            }
+            pthread_mutex_unlock(&mClientsLock);
+        }
     }
 }
 
@@ -231,6 +257,11 @@ bool SocketListener::release(SocketClient* c, bool wakeup) {
         SLOGV("going to zap %d for %s", c->getSocket(), mSocketName);
         pthread_mutex_lock(&mClientsLock);
         ret = (mClients.erase(c->getSocket()) != 0);
+        if (ret) {
+            // Unregister before the fd can be closed and reused, while still holding the lock so
+            // the listener thread can't pick up a stale event for it.
+            epoll_ctl(mEpollFd, EPOLL_CTL_DEL, c->getSocket(), nullptr);
+        }
         pthread_mutex_unlock(&mClientsLock);
         if (ret) {
             ret = c->decRef();
@@ -181,3 +181,30 @@ TEST_F(FrameworkListenerTest, MultipleClients) {
     EXPECT_EQ(std::string("42 test,2") + '\0', recvReply(client2.get()));
     EXPECT_EQ(std::string("42 test,1") + '\0', recvReply(client1.get()));
 }
+
+TEST_F(FrameworkListenerTest, ManyClients) {
+    // The listen backlog is small, so make sure each client has been accepted before
+    // connecting the next one.
+    std::vector<unique_fd> clients;
+    for (int i = 0; i < 100; i++) {
+        clients.push_back(clientSocket(mSocketPath));
+        sendCmd(clients.back().get(), "test");
+        EXPECT_EQ(std::string("42 test") + '\0', recvReply(clients.back().get()));
+    }
+    for (size_t i = 0; i < clients.size(); i++) {
+        sendCmd(clients[i].get(), ("test " + std::to_string(i)).c_str());
+    }
+    for (size_t i = 0; i < clients.size(); i++) {
+        EXPECT_EQ("42 test," + std::to_string(i) + '\0', recvReply(clients[i].get()));
+    }
+
+    // Clients that hang up are dropped without disturbing the others.
+    for (size_t i = 0; i < clients.size(); i += 2) {
+        clients[i].reset();
+    }
+    for (size_t i = 1; i < clients.size(); i += 2) {
+        sendCmd(clients[i].get(), "test again");
+        EXPECT_EQ(std::string("42 test,again") + '\0', recvReply(clients[i].get()));
+    }
+    testCommand("test new", "42 test,new");
+}
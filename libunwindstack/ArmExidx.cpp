@@ -827,6 +827,255 @@ bool ArmExidx::Eval() {
   return status_ == ARM_STATUS_FINISH;
 }
 
+namespace {
+
+// What the first byte of an opcode stands for, so that Compile() can look
+// it up instead of going down the prefix tree that Decode() follows.
+enum ArmOpClass : uint8_t {
+  ARM_OP_CLASS_SPARE = 0,
+  ARM_OP_CLASS_RESERVED,
+  ARM_OP_CLASS_FINISH,
+  ARM_OP_CLASS_ADD_CFA,        // vsp = vsp + value
+  ARM_OP_CLASS_SET_CFA,        // vsp = r[value]
+  ARM_OP_CLASS_POP,            // pop the registers in mask value
+  ARM_OP_CLASS_POP_MASK,       // 1000iiii iiiiiiii
+  ARM_OP_CLASS_POP_LOW,        // 10110001 0000iiii
+  ARM_OP_CLASS_ADD_CFA_ULEB,   // 10110010 uleb128
+  ARM_OP_CLASS_ADD_CFA_COUNT,  // xxxxxxxx sssscccc: vsp = vsp + cccc * 8 + value
+  ARM_OP_CLASS_ADD_CFA_WCGR,   // 11000111 0000iiii
+};
+
+struct ArmOpInfo {
+  ArmOpClass op_class = ARM_OP_CLASS_SPARE;
+  uint32_t value = 0;
+};
+
+constexpr ArmOpInfo DecodeFirstByte(uint8_t byte) {
+  switch (byte >> 4) {
+    case 0x0:
+    case 0x1:
+    case 0x2:
+    case 0x3:
+      return {ARM_OP_CLASS_ADD_CFA, ((byte & 0x3fu) << 2) + 4};
+    case 0x4:
+    case 0x5:
+    case 0x6:
+    case 0x7:
+      return {ARM_OP_CLASS_ADD_CFA, 0u - (((byte & 0x3fu) << 2) + 4)};
+    case 0x8:
+      return {ARM_OP_CLASS_POP_MASK, (byte & 0xfu) << 8};
+    case 0x9:
+      if ((byte & 0xf) == 13 || (byte & 0xf) == 15) {
+        return {ARM_OP_CLASS_RESERVED, 0};
+      }
+      return {ARM_OP_CLASS_SET_CFA, byte & 0xfu};
+    case 0xa: {
+      uint32_t registers = ((2u << (byte & 0x7)) - 1) << 4;
+      if (byte & 0x8) {
+        registers |= 1 << ARM_REG_R14;
+      }
+      return {ARM_OP_CLASS_POP, registers};
+    }
+    case 0xb:
+      switch (byte & 0xf) {
+        case 0:
+          return {ARM_OP_CLASS_FINISH, 0};
+        case 1:
+          return {ARM_OP_CLASS_POP_LOW, 0};
+        case 2:
+          return {ARM_OP_CLASS_ADD_CFA_ULEB, 0};
+        case 3:
+          return {ARM_OP_CLASS_ADD_CFA_COUNT, 12};
+        case 4:
+        case 5:
+        case 6:
+        case 7:
+          return {ARM_OP_CLASS_SPARE, 0};
+        default:
+          return {ARM_OP_CLASS_ADD_CFA, (byte & 0x7u) * 8 + 12};
+      }
+    case 0xc:
+      switch (byte & 0xf) {
+        case 6:
+        case 8:
+        case 9:
+          return {ARM_OP_CLASS_ADD_CFA_COUNT, 8};
+        case 7:
+          return {ARM_OP_CLASS_ADD_CFA_WCGR, 0};
+        default:
+          if (byte & 0x8) {
+            return {ARM_OP_CLASS_SPARE, 0};
+          }
+          return {ARM_OP_CLASS_ADD_CFA, (byte & 0x7u) * 8 + 8};
+      }
+    case 0xd:
+      if (byte & 0x8) {
+        return {ARM_OP_CLASS_SPARE, 0};
+      }
+      return {ARM_OP_CLASS_ADD_CFA, (byte & 0x7u) * 8 + 8};
+    default:
+      return {ARM_OP_CLASS_SPARE, 0};
+  }
+}
+
+struct ArmOpTable {
+  ArmOpInfo ops[256];
+
+  constexpr ArmOpTable() {
+    for (size_t i = 0; i < 256; i++) {
+      ops[i] = DecodeFirstByte(i);
+    }
+  }
+};
+
+constexpr ArmOpTable kArmOps;
+
+}  // namespace
+
+void ArmExidx::Compile(ArmExidxProgram* program) {
+  std::vector<ArmExidxOp>& ops = program->ops;
+  ops.clear();
+  // Runs of stack adjustments are folded into a single op.
+  auto add_cfa = [&ops](uint32_t value) {
+    if (!ops.empty() && ops.back().type == ArmExidxOp::ADD_CFA) {
+      ops.back().value += value;
+    } else {
+      ops.push_back({ArmExidxOp::ADD_CFA, value});
+    }
+  };
+
+  status_ = ARM_STATUS_NONE;
+  uint8_t byte;
+  while (GetByte(&byte)) {
+    const ArmOpInfo& info = kArmOps.ops[byte];
+    switch (info.op_class) {
+      case ARM_OP_CLASS_ADD_CFA:
+        add_cfa(info.value);
+        continue;
+      case ARM_OP_CLASS_SET_CFA:
+        ops.push_back({ArmExidxOp::SET_CFA, info.value});
+        continue;
+      case ARM_OP_CLASS_POP:
+        ops.push_back({ArmExidxOp::POP, info.value});
+        continue;
+      case ARM_OP_CLASS_POP_MASK:
+        if (!GetByte(&byte)) {
+          break;
+        }
+        if ((info.value | byte) == 0) {
+          status_ = ARM_STATUS_NO_UNWIND;
+          break;
+        }
+        ops.push_back({ArmExidxOp::POP, (info.value | byte) << 4});
+        continue;
+      case ARM_OP_CLASS_POP_LOW:
+        if (!GetByte(&byte)) {
+          break;
+        }
+        if (byte == 0 || (byte >> 4)) {
+          status_ = ARM_STATUS_SPARE;
+          break;
+        }
+        ops.push_back({ArmExidxOp::POP, byte});
+        continue;
+      case ARM_OP_CLASS_ADD_CFA_ULEB: {
+        uint32_t result = 0;
+        uint32_t shift = 0;
+        do {
+          if (!GetByte(&byte)) {
+            break;
+          }
+          result |= (byte & 0x7f) << shift;
+          shift += 7;
+        } while (byte & 0x80);
+        if (status_ == ARM_STATUS_TRUNCATED) {
+          break;
+        }
+        add_cfa(0x204 + (result << 2));
+        continue;
+      }
+      case ARM_OP_CLASS_ADD_CFA_COUNT:
+        if (!GetByte(&byte)) {
+          break;
+        }
+        add_cfa((byte & 0xf) * 8 + info.value);
+        continue;
+      case ARM_OP_CLASS_ADD_CFA_WCGR:
+        if (!GetByte(&byte)) {
+          break;
+        }
+        if (byte == 0 || (byte >> 4)) {
+          status_ = ARM_STATUS_SPARE;
+          break;
+        }
+        add_cfa(__builtin_popcount(byte) * 4);
+        continue;
+      case ARM_OP_CLASS_FINISH:
+        status_ = ARM_STATUS_FINISH;
+        break;
+      case ARM_OP_CLASS_RESERVED:
+        status_ = ARM_STATUS_RESERVED;
+        break;
+      case ARM_OP_CLASS_SPARE:
+        status_ = ARM_STATUS_SPARE;
+        break;
+    }
+    break;
+  }
+  program->status = status_;
+}
+
+bool ArmExidx::Eval(const ArmExidxProgram& program) {
+  pc_set_ = false;
+  for (const ArmExidxOp& op : program.ops) {
+    switch (op.type) {
+      case ArmExidxOp::ADD_CFA:
+        cfa_ += op.value;
+        break;
+      case ArmExidxOp::SET_CFA:
+        cfa_ = (*regs_)[op.value];
+        break;
+      case ArmExidxOp::POP: {
+        // The registers are stored next to each other, so read them at once
+        // and only go one by one to find out which read failed.
+        uint32_t values[16];
+        size_t count = __builtin_popcount(op.value);
+        if (process_memory_->ReadFully(cfa_, values, count * sizeof(uint32_t))) {
+          uint32_t* value = values;
+          for (size_t reg = 0; reg < 16; reg++) {
+            if (op.value & (1 << reg)) {
+              (*regs_)[reg] = *value++;
+            }
+          }
+          cfa_ += count * sizeof(uint32_t);
+        } else {
+          for (size_t reg = 0; reg < 16; reg++) {
+            if (op.value & (1 << reg)) {
+              if (!process_memory_->Read32(cfa_, &(*regs_)[reg])) {
+                status_ = ARM_STATUS_READ_FAILED;
+                status_address_ = cfa_;
+                return false;
+              }
+              cfa_ += 4;
+            }
+          }
+        }
+        // If the sp register is modified, change the cfa value.
+        if (op.value & (1 << ARM_REG_SP)) {
+          cfa_ = (*regs_)[ARM_REG_SP];
+        }
+        // Indicate if the pc register was set.
+        if (op.value & (1 << ARM_REG_PC)) {
+          pc_set_ = true;
+        }
+        break;
+      }
+    }
+  }
+  status_ = program.status;
+  return status_ == ARM_STATUS_FINISH;
+}
+
 void ArmExidx::LogByReg() {
   if (log_type_ != ARM_LOG_BY_REG) {
     return;
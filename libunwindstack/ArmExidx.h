@@ -21,6 +21,7 @@
 
 #include <deque>
 #include <map>
+#include <vector>
 
 namespace unwindstack {
 
@@ -51,6 +52,24 @@ enum ArmLogType : uint8_t {
   ARM_LOG_BY_REG,
 };
 
+// One step of an unwind program pre-decoded by ArmExidx::Compile().
+struct ArmExidxOp {
+  enum Type : uint8_t {
+    ADD_CFA,  // cfa += value
+    SET_CFA,  // cfa = r[value]
+    POP,      // pop the registers in the mask value, lowest first
+  };
+  Type type;
+  uint32_t value;
+};
+
+// The unwind instructions of an exidx entry, and the status decoding them
+// ended with, ARM_STATUS_FINISH if they are complete.
+struct ArmExidxProgram {
+  std::vector<ArmExidxOp> ops;
+  ArmStatus status = ARM_STATUS_NONE;
+};
+
 class ArmExidx {
  public:
   ArmExidx(RegsArm* regs, Memory* elf_memory, Memory* process_memory)
@@ -67,6 +86,12 @@ class ArmExidx {
 
   bool Decode();
 
+  // Decode all of the data extracted by ExtractEntryData() at once, for
+  // Eval(const ArmExidxProgram&) to run as often as needed. Nothing is logged.
+  void Compile(ArmExidxProgram* program);
+
+  bool Eval(const ArmExidxProgram& program);
+
   std::deque<uint8_t>* data() { return &data_; }
 
   ArmStatus status() { return status_; }
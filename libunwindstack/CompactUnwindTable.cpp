@@ -0,0 +1,320 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/mapped_file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/threads.h>
+#include <android-base/unique_fd.h>
+
+#include <unwindstack/CompactUnwindTable.h>
+#include <unwindstack/DwarfSection.h>
+#include <unwindstack/DwarfStructs.h>
+
+namespace unwindstack {
+
+static constexpr uint32_t kMagic = 0x54435755;  // "UWCT"
+static constexpr uint32_t kVersion = 1;
+
+namespace {
+
+struct CacheDir {
+  std::mutex lock;
+  std::string path;
+};
+
+}  // namespace
+
+static CacheDir* GetCacheDir() {
+  static CacheDir* cache_dir = new CacheDir;
+  return cache_dir;
+}
+
+CompactUnwindTable::~CompactUnwindTable() {}
+
+void CompactUnwindTable::SetCacheDir(const std::string& cache_dir) {
+  CacheDir* dir = GetCacheDir();
+  std::lock_guard<std::mutex> guard(dir->lock);
+  dir->path = cache_dir;
+}
+
+bool CompactUnwindTable::Enabled() {
+  CacheDir* dir = GetCacheDir();
+  std::lock_guard<std::mutex> guard(dir->lock);
+  return !dir->path.empty();
+}
+
+std::string CompactUnwindTable::CachePath(const std::string& build_id, uint64_t section_offset,
+                                          const char* extension) {
+  if (build_id.empty()) {
+    return "";
+  }
+
+  std::string path;
+  {
+    CacheDir* dir = GetCacheDir();
+    std::lock_guard<std::mutex> guard(dir->lock);
+    if (dir->path.empty()) {
+      return "";
+    }
+    path = dir->path + '/';
+  }
+  for (const char& c : build_id) {
+    path += android::base::StringPrintf("%02hhx", c);
+  }
+  path += android::base::StringPrintf("_%" PRIx64 "%s", section_offset, extension);
+  return path;
+}
+
+std::unique_ptr<CompactUnwindTable> CompactUnwindTable::Get(DwarfSection* section,
+                                                            const std::string& build_id,
+                                                            uint64_t section_offset) {
+  std::string path = CachePath(build_id, section_offset, ".unwind");
+  if (path.empty()) {
+    return nullptr;
+  }
+
+  std::unique_ptr<CompactUnwindTable> table = Load(path);
+  if (table != nullptr) {
+    return table;
+  }
+  table = Create(section);
+  if (table == nullptr) {
+    return nullptr;
+  }
+
+  // Other threads and processes may be writing the same table, so only a
+  // complete one is ever moved into place.
+  std::string tmp_path = path + android::base::StringPrintf(".%d.%" PRIu64, getpid(),
+                                                            android::base::GetThreadId());
+  if (!table->Save(tmp_path) || rename(tmp_path.c_str(), path.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+  }
+  return table;
+}
+
+std::unique_ptr<CompactUnwindTable> CompactUnwindTable::Create(DwarfSection* section) {
+  std::vector<const DwarfFde*> fdes;
+  section->GetFdes(&fdes);
+
+  std::vector<Row> rows;
+  std::vector<Loc> locs;
+  std::vector<uint64_t> return_address_registers;
+  // The index in locs of each distinct set of rules, keyed by its bytes.
+  std::unordered_map<std::string, uint32_t> loc_sets;
+  std::vector<Loc> loc_set;
+  for (const DwarfFde* fde : fdes) {
+    if (fde->cie == nullptr) {
+      continue;
+    }
+
+    auto ra_it = std::find(return_address_registers.begin(), return_address_registers.end(),
+                           fde->cie->return_address_register);
+    if (ra_it == return_address_registers.end()) {
+      if (return_address_registers.size() > UINT16_MAX) {
+        continue;
+      }
+      ra_it = return_address_registers.insert(ra_it, fde->cie->return_address_register);
+    }
+    const uint16_t cie_index = static_cast<uint16_t>(ra_it - return_address_registers.begin());
+
+    // Each evaluation gives the range its rules hold for, and the next row
+    // starts where that one ends.
+    uint64_t pc = fde->pc_start;
+    while (pc < fde->pc_end) {
+      dwarf_loc_regs_t loc_regs;
+      if (!section->GetCfaLocationInfo(pc, fde, &loc_regs) || loc_regs.pc_end <= pc ||
+          loc_regs.size() > UINT16_MAX) {
+        break;
+      }
+      const uint64_t pc_end = std::min(loc_regs.pc_end, fde->pc_end);
+
+      loc_set.clear();
+      for (const auto& entry : loc_regs) {
+        loc_set.push_back(Loc{entry.first, entry.second.type,
+                              {entry.second.values[0], entry.second.values[1]}});
+      }
+      std::sort(loc_set.begin(), loc_set.end(),
+                [](const Loc& a, const Loc& b) { return a.reg < b.reg; });
+      std::string key(reinterpret_cast<const char*>(loc_set.data()),
+                      loc_set.size() * sizeof(Loc));
+      auto set_it = loc_sets.find(key);
+      if (set_it == loc_sets.end()) {
+        set_it = loc_sets.emplace(std::move(key), static_cast<uint32_t>(locs.size())).first;
+        locs.insert(locs.end(), loc_set.begin(), loc_set.end());
+      }
+
+      Row row{pc, pc_end, set_it->second, static_cast<uint16_t>(loc_set.size()), cie_index};
+      Row* last = rows.empty() ? nullptr : &rows.back();
+      if (last != nullptr && last->pc_end == row.pc_start && last->first_loc == row.first_loc &&
+          last->num_locs == row.num_locs && last->cie_index == row.cie_index) {
+        last->pc_end = row.pc_end;
+      } else {
+        rows.push_back(row);
+      }
+      pc = pc_end;
+    }
+  }
+  if (rows.empty()) {
+    return nullptr;
+  }
+
+  // FDEs don't have to be in pc order, and shouldn't overlap. If they do,
+  // keep the rows of the first one.
+  std::stable_sort(rows.begin(), rows.end(),
+                   [](const Row& a, const Row& b) { return a.pc_start < b.pc_start; });
+  size_t num_rows = 1;
+  for (size_t i = 1; i < rows.size(); i++) {
+    if (rows[i].pc_start >= rows[num_rows - 1].pc_end) {
+      rows[num_rows++] = rows[i];
+    }
+  }
+  rows.resize(num_rows);
+
+  Header header{kMagic,
+                kVersion,
+                static_cast<uint32_t>(return_address_registers.size()),
+                static_cast<uint32_t>(rows.size()),
+                static_cast<uint32_t>(locs.size()),
+                0};
+  std::unique_ptr<CompactUnwindTable> table(new CompactUnwindTable);
+  std::vector<uint8_t>* buffer = &table->buffer_;
+  auto append = [buffer](const void* data, size_t size) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+    buffer->insert(buffer->end(), bytes, bytes + size);
+  };
+  append(&header, sizeof(header));
+  append(return_address_registers.data(), return_address_registers.size() * sizeof(uint64_t));
+  append(rows.data(), rows.size() * sizeof(Row));
+  append(locs.data(), locs.size() * sizeof(Loc));
+  if (!table->Init(buffer->data(), buffer->size())) {
+    return nullptr;
+  }
+  return table;
+}
+
+std::unique_ptr<CompactUnwindTable> CompactUnwindTable::Load(const std::string& path) {
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(path.c_str(), O_RDONLY | O_CLOEXEC)));
+  if (fd == -1) {
+    return nullptr;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size < static_cast<off_t>(sizeof(Header))) {
+    return nullptr;
+  }
+
+  std::unique_ptr<CompactUnwindTable> table(new CompactUnwindTable);
+  table->mapped_file_ =
+      android::base::MappedFile::FromFd(fd, 0, static_cast<size_t>(st.st_size), PROT_READ);
+  if (table->mapped_file_ == nullptr ||
+      !table->Init(reinterpret_cast<const uint8_t*>(table->mapped_file_->data()),
+                   table->mapped_file_->size())) {
+    return nullptr;
+  }
+  return table;
+}
+
+bool CompactUnwindTable::Save(const std::string& path) const {
+  android::base::unique_fd fd(
+      TEMP_FAILURE_RETRY(open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)));
+  if (fd == -1) {
+    return false;
+  }
+  return android::base::WriteFully(fd, data_, size_);
+}
+
+// A table may come from a file, so nothing in it is trusted until it has been
+// checked here.
+bool CompactUnwindTable::Init(const uint8_t* data, size_t size) {
+  Header header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != kMagic || header.version != kVersion) {
+    return false;
+  }
+  const uint64_t cies_offset = sizeof(Header);
+  const uint64_t rows_offset = cies_offset + uint64_t{header.num_cies} * sizeof(uint64_t);
+  const uint64_t locs_offset = rows_offset + uint64_t{header.num_rows} * sizeof(Row);
+  if (locs_offset + uint64_t{header.num_locs} * sizeof(Loc) != size) {
+    return false;
+  }
+
+  const Row* rows = reinterpret_cast<const Row*>(data + rows_offset);
+  const Loc* locs = reinterpret_cast<const Loc*>(data + locs_offset);
+  for (size_t i = 0; i < header.num_rows; i++) {
+    const Row& row = rows[i];
+    if (row.pc_start >= row.pc_end || (i > 0 && row.pc_start < rows[i - 1].pc_end) ||
+        row.cie_index >= header.num_cies ||
+        uint64_t{row.first_loc} + row.num_locs > header.num_locs) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < header.num_locs; i++) {
+    if (locs[i].type > DWARF_LOCATION_VAL_EXPRESSION) {
+      return false;
+    }
+  }
+
+  cies_.resize(header.num_cies);
+  for (size_t i = 0; i < header.num_cies; i++) {
+    memcpy(&cies_[i].return_address_register, data + cies_offset + i * sizeof(uint64_t),
+           sizeof(uint64_t));
+  }
+  data_ = data;
+  size_ = size;
+  rows_ = rows;
+  num_rows_ = header.num_rows;
+  locs_ = locs;
+  return true;
+}
+
+bool CompactUnwindTable::GetLocRegs(uint64_t pc, dwarf_loc_regs_t* loc_regs) const {
+  const Row* end = rows_ + num_rows_;
+  const Row* row = std::upper_bound(rows_, end, pc,
+                                    [](uint64_t pc, const Row& row) { return pc < row.pc_start; });
+  if (row == rows_ || pc >= (--row)->pc_end) {
+    return false;
+  }
+
+  for (const Loc* loc = &locs_[row->first_loc]; loc != &locs_[row->first_loc + row->num_locs];
+       loc++) {
+    (*loc_regs)[loc->reg] =
+        DwarfLocation{static_cast<DwarfLocationEnum>(loc->type), {loc->values[0], loc->values[1]}};
+  }
+  loc_regs->cie = &cies_[row->cie_index];
+  loc_regs->pc_start = row->pc_start;
+  loc_regs->pc_end = row->pc_end;
+  return true;
+}
+
+}  // namespace unwindstack
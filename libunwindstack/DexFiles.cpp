@@ -20,6 +20,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 
 #include <unwindstack/DexFiles.h>
@@ -100,33 +101,39 @@ uint64_t DexFiles::ReadEntryPtr64(uint64_t addr) {
   return entry;
 }
 
-bool DexFiles::ReadEntry32() {
+bool DexFiles::ReadEntry32(uint64_t addr, uint64_t* next, uint64_t* dex_file) {
   DEXFileEntry32 entry;
-  if (!memory_->ReadFully(entry_addr_, &entry, sizeof(entry)) || entry.dex_file == 0) {
-    entry_addr_ = 0;
+  if (!memory_->ReadFully(addr, &entry, sizeof(entry)) || entry.dex_file == 0) {
     return false;
   }
 
-  addrs_.push_back(entry.dex_file);
-  entry_addr_ = entry.next;
+  *next = entry.next;
+  *dex_file = entry.dex_file;
   return true;
 }
 
-bool DexFiles::ReadEntry64() {
+bool DexFiles::ReadEntry64(uint64_t addr, uint64_t* next, uint64_t* dex_file) {
   DEXFileEntry64 entry;
-  if (!memory_->ReadFully(entry_addr_, &entry, sizeof(entry)) || entry.dex_file == 0) {
-    entry_addr_ = 0;
+  if (!memory_->ReadFully(addr, &entry, sizeof(entry)) || entry.dex_file == 0) {
     return false;
   }
 
-  addrs_.push_back(entry.dex_file);
-  entry_addr_ = entry.next;
+  *next = entry.next;
+  *dex_file = entry.dex_file;
   return true;
 }
 
 bool DexFiles::ReadVariableData(uint64_t ptr_offset) {
   entry_addr_ = (this->*read_entry_ptr_func_)(ptr_offset);
-  return entry_addr_ != 0;
+  if (entry_addr_ == 0) {
+    return false;
+  }
+  Descriptor descriptor;
+  if (ReadDescriptor(ptr_offset, &descriptor) && descriptor.has_seqlock) {
+    entry_addr_ = descriptor.first_entry;
+    FollowChanges(ptr_offset, descriptor);
+  }
+  return true;
 }
 
 void DexFiles::Init(Maps* maps) {
@@ -139,6 +146,41 @@ void DexFiles::Init(Maps* maps) {
   FindAndReadVariable(maps, "__dex_debug_descriptor");
 }
 
+// Applies the changes made to the list since the last call, if they can be
+// worked out without reading all of it again.
+void DexFiles::Update() {
+  std::vector<uint64_t> added;
+  uint64_t removed;
+  uint64_t first_entry;
+  switch (ReadChanges(&added, &removed, &first_entry)) {
+    case LIST_UNCHANGED:
+      return;
+    case LIST_CHANGED:
+      // The rest of the list can't be found from an entry that is gone.
+      if (removed == 0 || removed != entry_addr_) {
+        added_entries_.erase(std::remove(added_entries_.begin(), added_entries_.end(), removed),
+                             added_entries_.end());
+        for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+          if (it->entry == removed) {
+            files_.erase(it->dex_file);
+            entries_.erase(it);
+            break;
+          }
+        }
+        added_entries_.insert(added_entries_.end(), added.begin(), added.end());
+        return;
+      }
+      break;
+    case LIST_RELOAD:
+      break;
+  }
+
+  files_.clear();
+  entries_.clear();
+  added_entries_.clear();
+  entry_addr_ = first_entry;
+}
+
 #if defined(DEXFILE_SUPPORT)
 DexFile* DexFiles::GetDexFile(uint64_t dex_file_offset, MapInfo* info) {
   // Lock while processing the data.
@@ -160,12 +202,37 @@ DexFile* DexFiles::GetDexFile(uint64_t, MapInfo*) {
 #endif
 
 bool DexFiles::GetAddr(size_t index, uint64_t* addr) {
-  if (index < addrs_.size()) {
-    *addr = addrs_[index];
+  if (index < entries_.size()) {
+    *addr = entries_[index].dex_file;
     return true;
   }
-  if (entry_addr_ != 0 && (this->*read_entry_func_)()) {
-    *addr = addrs_.back();
+
+  // Read the entries added since the list was first read before the rest of
+  // the list.
+  while (!added_entries_.empty() || entry_addr_ != 0) {
+    bool in_list = added_entries_.empty();
+    uint64_t entry;
+    if (in_list) {
+      entry = entry_addr_;
+    } else {
+      entry = added_entries_.back();
+      added_entries_.pop_back();
+    }
+
+    uint64_t next;
+    uint64_t dex_file;
+    if (!(this->*read_entry_func_)(entry, &next, &dex_file)) {
+      if (in_list) {
+        entry_addr_ = 0;
+        return false;
+      }
+      continue;
+    }
+    if (in_list) {
+      entry_addr_ = next;
+    }
+    entries_.push_back(DexEntry{entry, dex_file});
+    *addr = dex_file;
     return true;
   }
   return false;
@@ -177,6 +244,8 @@ void DexFiles::GetMethodInformation(Maps* maps, MapInfo* info, uint64_t dex_pc,
   std::lock_guard<std::mutex> guard(lock_);
   if (!initialized_) {
     Init(maps);
+  } else {
+    Update();
   }
 
   size_t index = 0;
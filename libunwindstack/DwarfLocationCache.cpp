@@ -0,0 +1,129 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <utility>
+
+#include <unwindstack/DwarfLocationCache.h>
+
+namespace unwindstack {
+
+// A power of two, so a key picks its shard with a mask.
+static constexpr size_t kShards = 16;
+
+// Rows are a few hundred bytes each, so this keeps the whole cache to a few megabytes.
+static constexpr size_t kMaxRowsPerShard = 2048;
+
+namespace {
+
+struct Shard {
+  std::shared_mutex lock;
+  // Indexed by section key and pc_end.
+  std::map<std::pair<uint64_t, uint64_t>, std::shared_ptr<const DwarfLocationCache::Row>> rows;
+};
+
+}  // namespace
+
+static std::atomic_bool g_enabled;
+
+static Shard* GetShards() {
+  // Never freed, so that disabling the cache can't race with a lookup.
+  static Shard* shards = new Shard[kShards];
+  return shards;
+}
+
+static Shard* GetShard(uint64_t key) {
+  return &GetShards()[key & (kShards - 1)];
+}
+
+void DwarfLocationCache::SetEnabled(bool enable) {
+  g_enabled = enable;
+  if (!enable) {
+    Clear();
+  }
+}
+
+bool DwarfLocationCache::Enabled() {
+  return g_enabled;
+}
+
+// FNV-1a, folded down so that the low bits that pick a shard depend on all of it.
+uint64_t DwarfLocationCache::Key(const std::string& build_id, uint64_t section_offset) {
+  if (build_id.empty()) {
+    return 0;
+  }
+
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (char c : build_id) {
+    hash = (hash ^ static_cast<uint8_t>(c)) * 0x100000001b3ULL;
+  }
+  for (size_t i = 0; i < sizeof(section_offset); i++) {
+    hash = (hash ^ ((section_offset >> (8 * i)) & 0xff)) * 0x100000001b3ULL;
+  }
+  hash ^= hash >> 32;
+  return hash == 0 ? 1 : hash;
+}
+
+std::shared_ptr<const DwarfLocationCache::Row> DwarfLocationCache::Find(uint64_t key,
+                                                                        uint64_t pc) {
+  if (!g_enabled) {
+    return nullptr;
+  }
+
+  Shard* shard = GetShard(key);
+  std::shared_lock<std::shared_mutex> guard(shard->lock);
+  auto it = shard->rows.upper_bound(std::make_pair(key, pc));
+  if (it == shard->rows.end() || it->first.first != key || pc < it->second->loc_regs.pc_start) {
+    return nullptr;
+  }
+  return it->second;
+}
+
+void DwarfLocationCache::Add(uint64_t key, const DwarfCie& cie,
+                             const dwarf_loc_regs_t& loc_regs) {
+  if (!g_enabled) {
+    return;
+  }
+
+  std::shared_ptr<Row> row(new Row);
+  row->cie = cie;
+  row->loc_regs = loc_regs;
+  row->loc_regs.cie = &row->cie;
+
+  Shard* shard = GetShard(key);
+  std::lock_guard<std::shared_mutex> guard(shard->lock);
+  if (shard->rows.size() >= kMaxRowsPerShard) {
+    shard->rows.clear();
+  }
+  shard->rows.emplace(std::make_pair(key, loc_regs.pc_end), std::move(row));
+}
+
+void DwarfLocationCache::Clear() {
+  for (size_t i = 0; i < kShards; i++) {
+    Shard* shard = &GetShards()[i];
+    std::lock_guard<std::shared_mutex> guard(shard->lock);
+    shard->rows.clear();
+  }
+}
+
+}  // namespace unwindstack
@@ -16,7 +16,7 @@
 
 #include <stdint.h>
 
-#include <deque>
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -1498,7 +1498,7 @@ bool DwarfOp<AddressType>::Eval(uint64_t start, uint64_t end) {
     return true;
   }
   bool check_for_drop;
-  if (cur_op_ == 0x0c && operands_.back() == 0x31584544) {
+  if (cur_op_ == 0x0c && operands_[num_operands_ - 1] == 0x31584544) {
     check_for_drop = true;
   } else {
     check_for_drop = false;
@@ -1553,7 +1553,7 @@ bool DwarfOp<AddressType>::Decode() {
     return false;
   }
 
-  operands_.clear();
+  num_operands_ = 0;
   for (size_t i = 0; i < op->num_operands; i++) {
     uint64_t value;
     if (!memory_->ReadEncodedValue<AddressType>(op->operands[i], &value)) {
@@ -1561,11 +1561,128 @@ bool DwarfOp<AddressType>::Decode() {
       last_error_.address = memory_->cur_offset();
       return false;
     }
-    operands_.push_back(value);
+    operands_[num_operands_++] = value;
   }
   return (this->*handle_func)();
 }
 
+template <typename AddressType>
+void DwarfOp<AddressType>::Compile(uint64_t start, uint64_t end, DwarfOpProgram* program) {
+  program->start = start;
+  program->instructions.clear();
+  program->compiled = false;
+  program->dex_pc = false;
+
+  // Decode every op up front. Anything that would only fail once it is
+  // reached is left to Eval(start, end), so errors are reported the same way.
+  std::vector<uint64_t> offsets;
+  std::vector<DwarfOpInstruction>& instructions = program->instructions;
+  memory_->set_cur_offset(start);
+  while (memory_->cur_offset() < end) {
+    offsets.push_back(memory_->cur_offset());
+    uint8_t cur_op;
+    if (!memory_->ReadBytes(&cur_op, 1)) {
+      return;
+    }
+    const auto* op = &kCallbackTable[cur_op];
+    if (op->handle_func == OP_ILLEGAL || op->handle_func == OP_NOT_IMPLEMENTED) {
+      return;
+    }
+
+    DwarfOpInstruction instruction{.op = cur_op,
+                                   .handle_func = op->handle_func,
+                                   .num_required_stack_values = op->num_required_stack_values,
+                                   .num_operands = op->num_operands};
+    for (size_t i = 0; i < op->num_operands; i++) {
+      if (!memory_->ReadEncodedValue<AddressType>(op->operands[i], &instruction.operands[i])) {
+        return;
+      }
+    }
+    instructions.push_back(instruction);
+  }
+  offsets.push_back(end);
+
+  // Turn the branch offsets into instruction indexes. A branch past the end
+  // finishes the expression, like it does in Eval(start, end).
+  for (size_t i = 0; i < instructions.size(); i++) {
+    DwarfOpInstruction* instruction = &instructions[i];
+    if (instruction->handle_func != OP_SKIP && instruction->handle_func != OP_BRA) {
+      continue;
+    }
+    int16_t offset = static_cast<int16_t>(static_cast<AddressType>(instruction->operands[0]));
+    uint64_t targets[2] = {offsets[i + 1] + offset, offsets[i + 1] - offset};
+    size_t num_targets = (instruction->handle_func == OP_BRA) ? 2 : 1;
+    for (size_t j = 0; j < num_targets; j++) {
+      if (targets[j] >= end) {
+        instruction->targets[j] = instructions.size();
+        continue;
+      }
+      auto entry = std::lower_bound(offsets.begin(), offsets.end(), targets[j]);
+      if (entry == offsets.end() || *entry != targets[j]) {
+        // Branching before the expression or into the middle of an op.
+        return;
+      }
+      instruction->targets[j] = entry - offsets.begin();
+    }
+  }
+
+  if (instructions.size() >= 2 && instructions[0].op == 0x0c &&
+      static_cast<AddressType>(instructions[0].operands[0]) == 0x31584544 &&
+      instructions[1].op == 0x13) {
+    program->dex_pc = true;
+  }
+  program->compiled = true;
+}
+
+template <typename AddressType>
+bool DwarfOp<AddressType>::Eval(const DwarfOpProgram& program) {
+  is_register_ = false;
+  stack_.clear();
+  dex_pc_set_ = false;
+
+  const std::vector<DwarfOpInstruction>& instructions = program.instructions;
+  size_t index = 0;
+  uint32_t iterations = 0;
+  while (index < instructions.size()) {
+    const DwarfOpInstruction& instruction = instructions[index++];
+    last_error_.code = DWARF_ERROR_NONE;
+    cur_op_ = instruction.op;
+    if (stack_.size() < instruction.num_required_stack_values) {
+      last_error_.code = DWARF_ERROR_STACK_INDEX_NOT_VALID;
+      return false;
+    }
+    num_operands_ = instruction.num_operands;
+    for (size_t i = 0; i < num_operands_; i++) {
+      operands_[i] = instruction.operands[i];
+    }
+
+    switch (instruction.handle_func) {
+      case OP_SKIP:
+        index = instruction.targets[0];
+        break;
+      case OP_BRA:
+        index = instruction.targets[StackPop() != 0 ? 0 : 1];
+        break;
+      default:
+        if (!(this->*kOpHandleFuncList[instruction.handle_func])()) {
+          return false;
+        }
+        break;
+    }
+
+    // Keep to the same limit as Eval(start, end).
+    iterations++;
+    if (iterations == 2 && program.dex_pc) {
+      dex_pc_set_ = true;
+    }
+    if (iterations == 1001) {
+      last_error_.code = DWARF_ERROR_TOO_MANY_ITERATIONS;
+      return false;
+    }
+  }
+  return true;
+}
+
 template <typename AddressType>
 void DwarfOp<AddressType>::GetLogInfo(uint64_t start, uint64_t end,
                                       std::vector<std::string>* lines) {
@@ -1644,8 +1761,8 @@ bool DwarfOp<AddressType>::op_deref_size() {
 template <typename AddressType>
 bool DwarfOp<AddressType>::op_push() {
   // Push all of the operands.
-  for (auto operand : operands_) {
-    stack_.push_front(operand);
+  for (size_t i = 0; i < num_operands_; i++) {
+    stack_.push_front(operands_[i]);
   }
   return true;
 }
@@ -1671,7 +1788,7 @@ bool DwarfOp<AddressType>::op_over() {
 template <typename AddressType>
 bool DwarfOp<AddressType>::op_pick() {
   AddressType index = OperandAt(0);
-  if (index > StackSize()) {
+  if (index >= StackSize()) {
     last_error_.code = DWARF_ERROR_STACK_INDEX_NOT_VALID;
     return false;
   }
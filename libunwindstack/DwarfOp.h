@@ -19,7 +19,6 @@
 
 #include <stdint.h>
 
-#include <deque>
 #include <string>
 #include <type_traits>
 #include <vector>
@@ -37,6 +36,70 @@ class Memory;
 template <typename AddressType>
 class RegsImpl;
 
+// One op of an expression decoded by DwarfOp::Compile().
+struct DwarfOpInstruction {
+  uint8_t op;
+  uint8_t handle_func;
+  uint8_t num_required_stack_values;
+  uint8_t num_operands;
+  // For DW_OP_skip and DW_OP_bra, the index of the instruction to continue
+  // at. DW_OP_bra uses the second one when the value popped is zero.
+  uint32_t targets[2];
+  uint64_t operands[2];
+};
+
+// An expression decoded once, so that evaluating it again does not have to
+// read and decode the DWARF data. If |compiled| is false, the expression
+// could not be validated and has to be evaluated from memory.
+struct DwarfOpProgram {
+  uint64_t start = 0;
+  std::vector<DwarfOpInstruction> instructions;
+  bool compiled = false;
+  bool dex_pc = false;
+};
+
+// The expression stack, index 0 being the top of the stack. The first few
+// values are kept in the object itself, so that the usual short expressions
+// can be evaluated without allocating.
+template <typename AddressType>
+class DwarfOpStack {
+ public:
+  DwarfOpStack() = default;
+  DwarfOpStack(const DwarfOpStack&) = delete;
+  DwarfOpStack& operator=(const DwarfOpStack&) = delete;
+
+  size_t size() const { return size_; }
+  void clear() { size_ = 0; }
+
+  AddressType& operator[](size_t index) { return values_[size_ - 1 - index]; }
+  AddressType& front() { return (*this)[0]; }
+
+  void push_front(AddressType value) {
+    if (size_ == capacity_) {
+      Grow();
+    }
+    values_[size_++] = value;
+  }
+  void pop_front() { size_--; }
+
+ private:
+  void Grow() {
+    if (values_ == inline_values_) {
+      overflow_.assign(inline_values_, inline_values_ + size_);
+    }
+    capacity_ *= 2;
+    overflow_.resize(capacity_);
+    values_ = overflow_.data();
+  }
+
+  static constexpr size_t kInlineValues = 16;
+  AddressType inline_values_[kInlineValues];
+  std::vector<AddressType> overflow_;
+  AddressType* values_ = inline_values_;
+  size_t size_ = 0;
+  size_t capacity_ = kInlineValues;
+};
+
 template <typename AddressType>
 class DwarfOp {
   // Signed version of AddressType
@@ -51,6 +114,12 @@ class DwarfOp {
 
   bool Eval(uint64_t start, uint64_t end);
 
+  // Decode the expression between start and end into |program|, for
+  // Eval(const DwarfOpProgram&) to evaluate as often as needed.
+  void Compile(uint64_t start, uint64_t end, DwarfOpProgram* program);
+
+  bool Eval(const DwarfOpProgram& program);
+
   void GetLogInfo(uint64_t start, uint64_t end, std::vector<std::string>* lines);
 
   AddressType StackAt(size_t index) { return stack_[index]; }
@@ -72,7 +141,7 @@ class DwarfOp {
 
  protected:
   AddressType OperandAt(size_t index) { return operands_[index]; }
-  size_t OperandsSize() { return operands_.size(); }
+  size_t OperandsSize() { return num_operands_; }
 
   AddressType StackPop() {
     AddressType value = stack_.front();
@@ -89,8 +158,9 @@ class DwarfOp {
   bool is_register_ = false;
   DwarfErrorData last_error_{DWARF_ERROR_NONE, 0};
   uint8_t cur_op_;
-  std::vector<AddressType> operands_;
-  std::deque<AddressType> stack_;
+  AddressType operands_[2];
+  size_t num_operands_ = 0;
+  DwarfOpStack<AddressType> stack_;
 
   inline AddressType bool_to_dwarf_bool(bool value) { return value ? 1 : 0; }
 
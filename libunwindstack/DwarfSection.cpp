@@ -16,8 +16,10 @@
 
 #include <stdint.h>
 
+#include <unwindstack/CompactUnwindTable.h>
 #include <unwindstack/DwarfError.h>
 #include <unwindstack/DwarfLocation.h>
+#include <unwindstack/DwarfLocationCache.h>
 #include <unwindstack/DwarfMemory.h>
 #include <unwindstack/DwarfSection.h>
 #include <unwindstack/DwarfStructs.h>
@@ -36,10 +38,28 @@ namespace unwindstack {
 
 DwarfSection::DwarfSection(Memory* memory) : memory_(memory) {}
 
+DwarfSection::~DwarfSection() = default;
+
 bool DwarfSection::Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* finished) {
   // Lookup the pc in the cache.
   auto it = loc_regs_.upper_bound(pc);
   if (it == loc_regs_.end() || pc < it->second.pc_start) {
+    // A precompiled table has the locations without any DWARF to look at.
+    dwarf_loc_regs_t compact_loc_regs;
+    if (compact_table_ != nullptr && compact_table_->GetLocRegs(pc, &compact_loc_regs)) {
+      it = loc_regs_.emplace(compact_loc_regs.pc_end, std::move(compact_loc_regs)).first;
+      return Eval(it->second.cie, process_memory, it->second, regs, finished);
+    }
+
+    // Another copy of this elf may have already worked it out.
+    if (location_cache_key_ != 0) {
+      std::shared_ptr<const DwarfLocationCache::Row> row =
+          DwarfLocationCache::Find(location_cache_key_, pc);
+      if (row != nullptr) {
+        return Eval(&row->cie, process_memory, row->loc_regs, regs, finished);
+      }
+    }
+
     last_error_.code = DWARF_ERROR_NONE;
     const DwarfFde* fde = GetFdeFromPc(pc);
     if (fde == nullptr || fde->cie == nullptr) {
@@ -53,6 +73,9 @@ bool DwarfSection::Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* f
       return false;
     }
     loc_regs.cie = fde->cie;
+    if (location_cache_key_ != 0) {
+      DwarfLocationCache::Add(location_cache_key_, *fde->cie, loc_regs);
+    }
 
     // Store it in the cache.
     it = loc_regs_.emplace(loc_regs.pc_end, std::move(loc_regs)).first;
@@ -380,10 +403,15 @@ bool DwarfSectionImpl<AddressType>::EvalExpression(const DwarfLocation& loc, Mem
   DwarfOp<AddressType> op(&memory_, regular_memory);
   op.set_regs_info(regs_info);
 
-  // Need to evaluate the op data.
+  // Need to evaluate the op data. It is only decoded the first time.
   uint64_t end = loc.values[1];
   uint64_t start = end - loc.values[0];
-  if (!op.Eval(start, end)) {
+  std::unique_ptr<DwarfOpProgram>& program = expressions_[end];
+  if (program == nullptr || program->start != start) {
+    program.reset(new DwarfOpProgram);
+    op.Compile(start, end, program.get());
+  }
+  if (!(program->compiled ? op.Eval(*program) : op.Eval(start, end))) {
     last_error_ = op.last_error();
     return false;
   }
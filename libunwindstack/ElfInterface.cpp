@@ -25,7 +25,9 @@
 #include <Xz.h>
 #include <XzCrc64.h>
 
+#include <unwindstack/CompactUnwindTable.h>
 #include <unwindstack/DwarfError.h>
+#include <unwindstack/DwarfLocationCache.h>
 #include <unwindstack/DwarfSection.h>
 #include <unwindstack/ElfInterface.h>
 #include <unwindstack/Log.h>
@@ -183,6 +185,35 @@ void ElfInterface::InitHeadersWithTemplate() {
       debug_frame_size_ = static_cast<uint64_t>(-1);
     }
   }
+
+  // Let copies of this elf file elsewhere in the process, or in a later run, share what is worked
+  // out for each pc.
+  bool location_cache = DwarfLocationCache::Enabled();
+  bool compact_tables = CompactUnwindTable::Enabled();
+  if ((location_cache || compact_tables) && (eh_frame_ != nullptr || debug_frame_ != nullptr)) {
+    std::string build_id = GetBuildID();
+    auto share = [&](DwarfSection* section, uint64_t offset) {
+      if (section == nullptr) {
+        return;
+      }
+      if (location_cache) {
+        section->SetLocationCacheKey(DwarfLocationCache::Key(build_id, offset));
+      }
+      if (compact_tables) {
+        section->SetCompactTable(CompactUnwindTable::Get(section, build_id, offset));
+      }
+    };
+    share(eh_frame_.get(), eh_frame_offset_);
+    share(debug_frame_.get(), debug_frame_offset_);
+  }
+
+  // The symbol tables are shared through the same cache directory.
+  if (compact_tables && !symbols_.empty()) {
+    std::string build_id = GetBuildID();
+    for (Symbols* symbols : symbols_) {
+      symbols->SetCachePath(CompactUnwindTable::CachePath(build_id, symbols->offset(), ".symbols"));
+    }
+  }
 }
 
 template <typename EhdrType, typename PhdrType, typename ShdrType>
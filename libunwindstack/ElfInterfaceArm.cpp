@@ -126,7 +126,17 @@ bool ElfInterfaceArm::StepExidx(uint64_t pc, Regs* regs, Memory* process_memory,
   ArmExidx arm(regs_arm, memory_, process_memory);
   arm.set_cfa(regs_arm->sp());
   bool return_value = false;
-  if (arm.ExtractEntryData(entry_offset) && arm.Eval()) {
+  ArmExidxProgram* program = nullptr;
+  auto entry = programs_.find(entry_offset);
+  if (entry != programs_.end()) {
+    program = &entry->second;
+  } else if (arm.ExtractEntryData(entry_offset)) {
+    // Only entries that could be read are kept, so a failure is reported
+    // again the next time the entry is used.
+    program = &programs_[entry_offset];
+    arm.Compile(program);
+  }
+  if (program != nullptr && arm.Eval(*program)) {
     // If the pc was not set, then use the LR registers for the PC.
     if (!arm.pc_set()) {
       (*regs_arm)[ARM_REG_PC] = (*regs_arm)[ARM_REG_LR];
@@ -26,6 +26,8 @@
 #include <unwindstack/ElfInterface.h>
 #include <unwindstack/Memory.h>
 
+#include "ArmExidx.h"
+
 namespace unwindstack {
 
 class ElfInterfaceArm : public ElfInterface32 {
@@ -90,6 +92,10 @@ class ElfInterfaceArm : public ElfInterface32 {
   uint64_t load_bias_ = 0;
 
   std::unordered_map<size_t, uint32_t> addrs_;
+
+  // Decoded unwind programs keyed by exidx entry offset. Like addrs_, this
+  // is bounded by the number of entries in the table.
+  std::unordered_map<uint64_t, ArmExidxProgram> programs_;
 };
 
 }  // namespace unwindstack
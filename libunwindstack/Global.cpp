@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <stddef.h>
 #include <stdint.h>
 #include <string.h>
 #include <sys/mman.h>
@@ -28,6 +29,35 @@
 
 namespace unwindstack {
 
+struct JITDescriptorHeader {
+  uint32_t version;
+  uint32_t action_flag;
+};
+
+struct JITDescriptor32 {
+  JITDescriptorHeader header;
+  uint32_t relevant_entry;
+  uint32_t first_entry;
+};
+
+struct JITDescriptor64 {
+  JITDescriptorHeader header;
+  uint64_t relevant_entry;
+  uint64_t first_entry;
+};
+
+// Follows the standard fields in descriptors written by ART.
+struct JITDescriptorAndroid {
+  uint8_t magic[8];
+  uint32_t flags;
+  uint32_t sizeof_descriptor;
+  uint32_t sizeof_entry;
+  uint32_t action_seqlock;
+  uint64_t action_timestamp;
+};
+
+static constexpr uint32_t JIT_UNREGISTER_FN = 2;
+
 Global::Global(std::shared_ptr<Memory>& memory) : memory_(memory) {}
 Global::Global(std::shared_ptr<Memory>& memory, std::vector<std::string>& search_libs)
     : memory_(memory), search_libs_(search_libs) {}
@@ -96,4 +126,142 @@ void Global::FindAndReadVariable(Maps* maps, const char* var_str) {
   }
 }
 
+static bool Is32Bit(ArchEnum arch) {
+  return arch == ARCH_ARM || arch == ARCH_MIPS || arch == ARCH_X86;
+}
+
+// Every entry starts with the pointer to the next one, and ART puts the time
+// it was registered after the standard fields.
+static uint64_t EntryTimestampOffset(ArchEnum arch) {
+  switch (arch) {
+    case ARCH_X86:
+      return 20;
+    case ARCH_ARM:
+    case ARCH_MIPS:
+      return 24;
+    default:
+      return 32;
+  }
+}
+
+bool Global::ReadDescriptor(uint64_t addr, Descriptor* descriptor) {
+  uint64_t android_offset;
+  if (Is32Bit(arch())) {
+    JITDescriptor32 desc;
+    if (!memory_->ReadFully(addr, &desc, sizeof(desc))) {
+      return false;
+    }
+    descriptor->version = desc.header.version;
+    descriptor->action_flag = desc.header.action_flag;
+    descriptor->relevant_entry = desc.relevant_entry;
+    descriptor->first_entry = desc.first_entry;
+    android_offset = sizeof(desc);
+  } else {
+    JITDescriptor64 desc;
+    if (!memory_->ReadFully(addr, &desc, sizeof(desc))) {
+      return false;
+    }
+    descriptor->version = desc.header.version;
+    descriptor->action_flag = desc.header.action_flag;
+    descriptor->relevant_entry = desc.relevant_entry;
+    descriptor->first_entry = desc.first_entry;
+    android_offset = sizeof(desc);
+  }
+
+  JITDescriptorAndroid android;
+  descriptor->has_seqlock =
+      memory_->ReadFully(addr + android_offset, &android, sizeof(android)) &&
+      (memcmp(android.magic, "Android1", 8) == 0 || memcmp(android.magic, "Android2", 8) == 0) &&
+      android.sizeof_entry >= EntryTimestampOffset(arch()) + sizeof(uint64_t);
+  if (descriptor->has_seqlock) {
+    descriptor->action_seqlock = android.action_seqlock;
+    descriptor->action_timestamp = android.action_timestamp;
+  }
+  return true;
+}
+
+void Global::FollowChanges(uint64_t addr, const Descriptor& descriptor) {
+  // A list that was being changed can't be trusted as a starting point.
+  if (!descriptor.has_seqlock || (descriptor.action_seqlock & 1) != 0) {
+    return;
+  }
+  descriptor_addr_ = addr;
+  action_seqlock_ = descriptor.action_seqlock;
+  action_timestamp_ = descriptor.action_timestamp;
+}
+
+bool Global::ReadEntryLink(uint64_t addr, uint64_t* next, uint64_t* timestamp) {
+  *next = 0;
+  return memory_->ReadFully(addr, next, Is32Bit(arch()) ? 4 : 8) &&
+         ReadEntryTimestamp(addr, timestamp);
+}
+
+bool Global::ReadEntryTimestamp(uint64_t addr, uint64_t* timestamp) {
+  return descriptor_addr_ != 0 &&
+         memory_->ReadFully(addr + EntryTimestampOffset(arch()), timestamp, sizeof(*timestamp));
+}
+
+Global::ListChange Global::ReadChanges(std::vector<uint64_t>* added, uint64_t* removed,
+                                       uint64_t* first_entry) {
+  Descriptor descriptor;
+  if (descriptor_addr_ == 0 || !ReadDescriptor(descriptor_addr_, &descriptor) ||
+      !descriptor.has_seqlock || (descriptor.action_seqlock & 1) != 0 ||
+      descriptor.action_seqlock == action_seqlock_) {
+    return LIST_UNCHANGED;
+  }
+
+  // Every change adds two to the seqlock, and entries are added to the head
+  // of the list. So if the only entries at the head that are newer than the
+  // last change that was seen account for all the changes, nothing else
+  // happened. The same goes if all but the last change are accounted for,
+  // and the last change removed an entry.
+  uint32_t changes = (descriptor.action_seqlock - action_seqlock_) / 2;
+  bool consistent = true;
+  added->clear();
+  uint64_t last_timestamp = UINT64_MAX;
+  uint64_t entry = descriptor.first_entry;
+  while (entry != 0 && added->size() <= changes) {
+    uint64_t next;
+    uint64_t timestamp;
+    if (!ReadEntryLink(entry, &next, &timestamp)) {
+      return LIST_UNCHANGED;
+    }
+    if (timestamp <= action_timestamp_) {
+      break;
+    }
+    if (timestamp >= last_timestamp) {
+      // Newer entries always come first, so the list isn't what it seems.
+      consistent = false;
+      break;
+    }
+    added->push_back(entry);
+    last_timestamp = timestamp;
+    entry = next;
+  }
+
+  // Anything read while the list was being changed can't be used.
+  uint32_t seqlock;
+  uint64_t seqlock_offset =
+      (Is32Bit(arch()) ? sizeof(JITDescriptor32) : sizeof(JITDescriptor64)) +
+      offsetof(JITDescriptorAndroid, action_seqlock);
+  if (!memory_->ReadFully(descriptor_addr_ + seqlock_offset, &seqlock, sizeof(seqlock)) ||
+      seqlock != descriptor.action_seqlock) {
+    return LIST_UNCHANGED;
+  }
+  action_seqlock_ = descriptor.action_seqlock;
+  action_timestamp_ = descriptor.action_timestamp;
+
+  *first_entry = descriptor.first_entry;
+  *removed = 0;
+  if (consistent && added->size() == changes) {
+    return LIST_CHANGED;
+  }
+  if (consistent && added->size() + 1 == changes &&
+      descriptor.action_flag == JIT_UNREGISTER_FN) {
+    *removed = descriptor.relevant_entry;
+    return LIST_CHANGED;
+  }
+  return LIST_RELOAD;
+}
+
 }  // namespace unwindstack
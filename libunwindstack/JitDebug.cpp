@@ -17,6 +17,7 @@
 #include <stdint.h>
 #include <sys/mman.h>
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -53,112 +54,70 @@ struct JITCodeEntry64 {
   uint64_t symfile_size;
 };
 
-struct JITDescriptorHeader {
-  uint32_t version;
-  uint32_t action_flag;
-};
-
-struct JITDescriptor32 {
-  JITDescriptorHeader header;
-  uint32_t relevant_entry;
-  uint32_t first_entry;
-};
-
-struct JITDescriptor64 {
-  JITDescriptorHeader header;
-  uint64_t relevant_entry;
-  uint64_t first_entry;
-};
-
 JitDebug::JitDebug(std::shared_ptr<Memory>& memory) : Global(memory) {}
 
 JitDebug::JitDebug(std::shared_ptr<Memory>& memory, std::vector<std::string>& search_libs)
     : Global(memory, search_libs) {}
 
 JitDebug::~JitDebug() {
-  for (auto* elf : elf_list_) {
-    delete elf;
-  }
-}
-
-uint64_t JitDebug::ReadDescriptor32(uint64_t addr) {
-  JITDescriptor32 desc;
-  if (!memory_->ReadFully(addr, &desc, sizeof(desc))) {
-    return 0;
+  for (auto& jit_elf : elf_list_) {
+    delete jit_elf.elf;
   }
-
-  if (desc.header.version != 1 || desc.first_entry == 0) {
-    // Either unknown version, or no jit entries.
-    return 0;
+  for (auto& entry : old_elfs_) {
+    delete entry.second.elf;
   }
-
-  return desc.first_entry;
-}
-
-uint64_t JitDebug::ReadDescriptor64(uint64_t addr) {
-  JITDescriptor64 desc;
-  if (!memory_->ReadFully(addr, &desc, sizeof(desc))) {
-    return 0;
-  }
-
-  if (desc.header.version != 1 || desc.first_entry == 0) {
-    // Either unknown version, or no jit entries.
-    return 0;
-  }
-
-  return desc.first_entry;
 }
 
-uint64_t JitDebug::ReadEntry32Pack(uint64_t* start, uint64_t* size) {
+bool JitDebug::ReadEntry32Pack(uint64_t addr, uint64_t* next, uint64_t* start, uint64_t* size) {
   JITCodeEntry32Pack code;
-  if (!memory_->ReadFully(entry_addr_, &code, sizeof(code))) {
-    return 0;
+  if (!memory_->ReadFully(addr, &code, sizeof(code))) {
+    return false;
   }
 
+  *next = code.next;
   *start = code.symfile_addr;
   *size = code.symfile_size;
-  return code.next;
+  return true;
 }
 
-uint64_t JitDebug::ReadEntry32Pad(uint64_t* start, uint64_t* size) {
+bool JitDebug::ReadEntry32Pad(uint64_t addr, uint64_t* next, uint64_t* start, uint64_t* size) {
   JITCodeEntry32Pad code;
-  if (!memory_->ReadFully(entry_addr_, &code, sizeof(code))) {
-    return 0;
+  if (!memory_->ReadFully(addr, &code, sizeof(code))) {
+    return false;
   }
 
+  *next = code.next;
   *start = code.symfile_addr;
   *size = code.symfile_size;
-  return code.next;
+  return true;
 }
 
-uint64_t JitDebug::ReadEntry64(uint64_t* start, uint64_t* size) {
+bool JitDebug::ReadEntry64(uint64_t addr, uint64_t* next, uint64_t* start, uint64_t* size) {
   JITCodeEntry64 code;
-  if (!memory_->ReadFully(entry_addr_, &code, sizeof(code))) {
-    return 0;
+  if (!memory_->ReadFully(addr, &code, sizeof(code))) {
+    return false;
   }
 
+  *next = code.next;
   *start = code.symfile_addr;
   *size = code.symfile_size;
-  return code.next;
+  return true;
 }
 
 void JitDebug::ProcessArch() {
   switch (arch()) {
     case ARCH_X86:
-      read_descriptor_func_ = &JitDebug::ReadDescriptor32;
       read_entry_func_ = &JitDebug::ReadEntry32Pack;
       break;
 
     case ARCH_ARM:
     case ARCH_MIPS:
-      read_descriptor_func_ = &JitDebug::ReadDescriptor32;
       read_entry_func_ = &JitDebug::ReadEntry32Pad;
       break;
 
     case ARCH_ARM64:
     case ARCH_X86_64:
     case ARCH_MIPS64:
-      read_descriptor_func_ = &JitDebug::ReadDescriptor64;
       read_entry_func_ = &JitDebug::ReadEntry64;
       break;
     case ARCH_UNKNOWN:
@@ -167,8 +126,15 @@ void JitDebug::ProcessArch() {
 }
 
 bool JitDebug::ReadVariableData(uint64_t ptr) {
-  entry_addr_ = (this->*read_descriptor_func_)(ptr);
-  return entry_addr_ != 0;
+  Descriptor descriptor;
+  if (!ReadDescriptor(ptr, &descriptor) || descriptor.version != 1 ||
+      descriptor.first_entry == 0) {
+    // Either unknown version, or no jit entries.
+    return false;
+  }
+  entry_addr_ = descriptor.first_entry;
+  FollowChanges(ptr, descriptor);
+  return true;
 }
 
 void JitDebug::Init(Maps* maps) {
@@ -181,36 +147,128 @@ void JitDebug::Init(Maps* maps) {
   FindAndReadVariable(maps, "__jit_debug_descriptor");
 }
 
+// Applies the changes made to the list since the last call, if they can be
+// worked out without reading all of it again.
+void JitDebug::Update() {
+  std::vector<uint64_t> added;
+  uint64_t removed;
+  uint64_t first_entry;
+  switch (ReadChanges(&added, &removed, &first_entry)) {
+    case LIST_UNCHANGED:
+      return;
+    case LIST_CHANGED:
+      // The rest of the list can't be found from an entry that is gone.
+      if (removed == 0 || removed != entry_addr_) {
+        RemoveElf(removed);
+        added_entries_.insert(added_entries_.end(), added.begin(), added.end());
+        return;
+      }
+      break;
+    case LIST_RELOAD:
+      break;
+  }
+
+  for (auto& jit_elf : elf_list_) {
+    old_elfs_.emplace(jit_elf.entry, jit_elf);
+  }
+  elf_list_.clear();
+  added_entries_.clear();
+  entry_addr_ = first_entry;
+}
+
+Elf* JitDebug::AddElf(uint64_t entry, uint64_t start, uint64_t size) {
+  uint64_t timestamp;
+  if (ReadEntryTimestamp(entry, &timestamp)) {
+    auto range = old_elfs_.equal_range(entry);
+    for (auto it = range.first; it != range.second; ++it) {
+      if (it->second.timestamp == timestamp) {
+        JitElf jit_elf = it->second;
+        old_elfs_.erase(it);
+        elf_list_.push_back(jit_elf);
+        return jit_elf.elf;
+      }
+    }
+  } else {
+    timestamp = 0;
+  }
+
+  Elf* elf = new Elf(new MemoryRange(memory_, start, size, 0));
+  elf->Init();
+  if (!elf->valid()) {
+    delete elf;
+    return nullptr;
+  }
+  elf_list_.push_back(JitElf{entry, timestamp, elf});
+  return elf;
+}
+
+void JitDebug::RemoveElf(uint64_t entry) {
+  if (entry == 0) {
+    return;
+  }
+  added_entries_.erase(std::remove(added_entries_.begin(), added_entries_.end(), entry),
+                       added_entries_.end());
+  for (auto it = elf_list_.begin(); it != elf_list_.end(); ++it) {
+    if (it->entry == entry) {
+      old_elfs_.emplace(entry, *it);
+      elf_list_.erase(it);
+      return;
+    }
+  }
+}
+
 Elf* JitDebug::GetElf(Maps* maps, uint64_t pc) {
   // Use a single lock, this object should be used so infrequently that
   // a fine grain lock is unnecessary.
   std::lock_guard<std::mutex> guard(lock_);
   if (!initialized_) {
     Init(maps);
+  } else {
+    Update();
   }
 
   // Search the existing elf object first.
-  for (Elf* elf : elf_list_) {
-    if (elf->IsValidPc(pc)) {
-      return elf;
+  for (const JitElf& jit_elf : elf_list_) {
+    if (jit_elf.elf->IsValidPc(pc)) {
+      return jit_elf.elf;
     }
   }
 
-  while (entry_addr_ != 0) {
+  // Then the entries that haven't been read yet, those added since the list
+  // was first read before the rest of the list.
+  while (!added_entries_.empty() || entry_addr_ != 0) {
+    bool in_list = added_entries_.empty();
+    uint64_t entry;
+    if (in_list) {
+      entry = entry_addr_;
+    } else {
+      entry = added_entries_.back();
+      added_entries_.pop_back();
+    }
+
+    uint64_t next;
     uint64_t start;
     uint64_t size;
-    entry_addr_ = (this->*read_entry_func_)(&start, &size);
+    if (!(this->*read_entry_func_)(entry, &next, &start, &size)) {
+      if (in_list) {
+        entry_addr_ = 0;
+      }
+      continue;
+    }
+    if (in_list) {
+      entry_addr_ = next;
+    }
 
-    Elf* elf = new Elf(new MemoryRange(memory_, start, size, 0));
-    elf->Init();
-    if (!elf->valid()) {
+    Elf* elf = AddElf(entry, start, size);
+    if (elf == nullptr) {
+      if (!in_list) {
+        continue;
+      }
       // The data is not formatted in a way we understand, do not attempt
       // to process any other entries.
       entry_addr_ = 0;
-      delete elf;
       return nullptr;
     }
-    elf_list_.push_back(elf);
 
     if (elf->IsValidPc(pc)) {
       return elf;
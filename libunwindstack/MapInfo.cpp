@@ -292,6 +292,18 @@ uint64_t MapInfo::GetLoadBias(const std::shared_ptr<Memory>& process_memory) {
   return cur_load_bias;
 }
 
+void MapInfo::ShareElf(MapInfo* other) {
+  std::lock_guard<std::mutex> guard(other->mutex_);
+  if (other->elf == nullptr) {
+    return;
+  }
+  elf = other->elf;
+  elf_offset = other->elf_offset;
+  elf_start_offset = other->elf_start_offset;
+  memory_backed_elf = other->memory_backed_elf;
+  load_bias = other->load_bias.load();
+}
+
 MapInfo::~MapInfo() {
   uintptr_t id = build_id.load();
   if (id != 0) {
@@ -24,6 +24,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <android-base/file.h>
 #include <android-base/unique_fd.h>
 #include <procinfo/process_map.h>
 
@@ -40,9 +41,17 @@
 namespace unwindstack {
 
 MapInfo* Maps::Find(uint64_t pc) {
-  if (maps_.empty()) {
-    return nullptr;
+  if (map_ends_.size() == maps_.size()) {
+    // Find the first map that ends after pc.
+    auto end = std::upper_bound(map_ends_.begin(), map_ends_.end(), pc);
+    if (end == map_ends_.end()) {
+      return nullptr;
+    }
+    MapInfo* info = maps_[end - map_ends_.begin()].get();
+    return pc >= info->start ? info : nullptr;
   }
+
+  // The maps were changed without updating the index.
   size_t first = 0;
   size_t last = maps_.size();
   while (first < last) {
@@ -59,22 +68,44 @@ MapInfo* Maps::Find(uint64_t pc) {
   return nullptr;
 }
 
-bool Maps::Parse() {
+void Maps::UpdateIndex() {
+  map_ends_.resize(maps_.size());
+  for (size_t i = 0; i < maps_.size(); i++) {
+    map_ends_[i] = maps_[i]->end;
+  }
+}
+
+static uint16_t MapFlags(uint16_t flags, const char* name) {
+  // Mark a device map in /dev/ and not in /dev/ashmem/ specially.
+  if (strncmp(name, "/dev/", 5) == 0 && strncmp(name + 5, "ashmem/", 7) != 0) {
+    flags |= unwindstack::MAPS_FLAGS_DEVICE_MAP;
+  }
+  return flags;
+}
+
+bool Maps::ParseContent(char* content) {
+  maps_.reserve(maps_.size() + std::count(content, content + strlen(content), '\n') + 1);
   MapInfo* prev_map = nullptr;
   MapInfo* prev_real_map = nullptr;
-  return android::procinfo::ReadMapFile(
-      GetMapsFile(),
+  bool parsed = android::procinfo::ReadMapFileContent(
+      content,
       [&](uint64_t start, uint64_t end, uint16_t flags, uint64_t pgoff, ino_t, const char* name) {
-        // Mark a device map in /dev/ and not in /dev/ashmem/ specially.
-        if (strncmp(name, "/dev/", 5) == 0 && strncmp(name + 5, "ashmem/", 7) != 0) {
-          flags |= unwindstack::MAPS_FLAGS_DEVICE_MAP;
-        }
-        maps_.emplace_back(new MapInfo(prev_map, prev_real_map, start, end, pgoff, flags, name));
+        maps_.emplace_back(new MapInfo(prev_map, prev_real_map, start, end, pgoff,
+                                       MapFlags(flags, name), name));
         prev_map = maps_.back().get();
         if (!prev_map->IsBlank()) {
           prev_real_map = prev_map;
         }
       });
+  UpdateIndex();
+  return parsed;
+}
+
+bool Maps::Parse() {
+  if (!android::base::ReadFileToString(GetMapsFile(), &content_)) {
+    return false;
+  }
+  return ParseContent(&content_[0]);
 }
 
 void Maps::Add(uint64_t start, uint64_t end, uint64_t offset, uint64_t flags,
@@ -89,6 +120,9 @@ void Maps::Add(uint64_t start, uint64_t end, uint64_t offset, uint64_t flags,
       std::make_unique<MapInfo>(prev_map, prev_real_map, start, end, offset, flags, name);
   map_info->load_bias = load_bias;
   maps_.emplace_back(std::move(map_info));
+  if (map_ends_.size() + 1 == maps_.size()) {
+    map_ends_.push_back(end);
+  }
 }
 
 void Maps::Sort() {
@@ -107,25 +141,12 @@ void Maps::Sort() {
       prev_real_map = prev_map;
     }
   }
+  UpdateIndex();
 }
 
 bool BufferMaps::Parse() {
-  std::string content(buffer_);
-  MapInfo* prev_map = nullptr;
-  MapInfo* prev_real_map = nullptr;
-  return android::procinfo::ReadMapFileContent(
-      &content[0],
-      [&](uint64_t start, uint64_t end, uint16_t flags, uint64_t pgoff, ino_t, const char* name) {
-        // Mark a device map in /dev/ and not in /dev/ashmem/ specially.
-        if (strncmp(name, "/dev/", 5) == 0 && strncmp(name + 5, "ashmem/", 7) != 0) {
-          flags |= unwindstack::MAPS_FLAGS_DEVICE_MAP;
-        }
-        maps_.emplace_back(new MapInfo(prev_map, prev_real_map, start, end, pgoff, flags, name));
-        prev_map = maps_.back().get();
-        if (!prev_map->IsBlank()) {
-          prev_real_map = prev_map;
-        }
-      });
+  content_ = buffer_;
+  return ParseContent(&content_[0]);
 }
 
 const std::string RemoteMaps::GetMapsFile() const {
@@ -137,72 +158,69 @@ const std::string LocalUpdatableMaps::GetMapsFile() const {
 }
 
 bool LocalUpdatableMaps::Reparse() {
-  // New maps will be added at the end without deleting the old ones.
-  size_t last_map_idx = maps_.size();
-  if (!Parse()) {
-    maps_.resize(last_map_idx);
+  if (!android::base::ReadFileToString(GetMapsFile(), &content_)) {
     return false;
   }
 
-  size_t total_entries = maps_.size();
-  size_t search_map_idx = 0;
-  for (size_t new_map_idx = last_map_idx; new_map_idx < maps_.size(); new_map_idx++) {
-    auto& new_map_info = maps_[new_map_idx];
-    uint64_t start = new_map_info->start;
-    uint64_t end = new_map_info->end;
-    uint64_t flags = new_map_info->flags;
-    std::string* name = &new_map_info->name;
-    for (size_t old_map_idx = search_map_idx; old_map_idx < last_map_idx; old_map_idx++) {
-      auto& info = maps_[old_map_idx];
-      if (start == info->start && end == info->end && flags == info->flags && *name == info->name) {
-        // No need to check
-        search_map_idx = old_map_idx + 1;
-        if (new_map_idx + 1 < maps_.size()) {
-          maps_[new_map_idx + 1]->prev_map = info.get();
-          maps_[new_map_idx + 1]->prev_real_map =
-              info->IsBlank() ? info->prev_real_map : info.get();
+  // Walk the new maps and the current ones, both sorted by start, side by
+  // side. Nothing is changed until the whole file has parsed.
+  constexpr size_t kNewMap = SIZE_MAX;
+  std::vector<size_t> kept;
+  kept.reserve(maps_.size());
+  std::vector<std::unique_ptr<MapInfo>> new_maps;
+  size_t old_idx = 0;
+  MapInfo* prev_map = nullptr;
+  MapInfo* prev_real_map = nullptr;
+  bool parsed = android::procinfo::ReadMapFileContent(
+      &content_[0],
+      [&](uint64_t start, uint64_t end, uint16_t flags, uint64_t pgoff, ino_t, const char* name) {
+        flags = MapFlags(flags, name);
+        while (old_idx < maps_.size() && maps_[old_idx]->start < start) {
+          old_idx++;
         }
-        maps_[new_map_idx] = nullptr;
-        total_entries--;
-        break;
-      } else if (info->start > start) {
-        // Stop, there isn't going to be a match.
-        search_map_idx = old_map_idx;
-        break;
-      }
-
-      // Never delete these maps, they may be in use. The assumption is
-      // that there will only every be a handful of these so waiting
-      // to destroy them is not too expensive.
-      saved_maps_.emplace_back(std::move(info));
-      search_map_idx = old_map_idx + 1;
-      maps_[old_map_idx] = nullptr;
-      total_entries--;
-    }
-    if (search_map_idx >= last_map_idx) {
-      break;
-    }
+        if (old_idx < maps_.size()) {
+          MapInfo* info = maps_[old_idx].get();
+          if (info->start == start && info->end == end && info->offset == pgoff &&
+              info->flags == flags && info->name == name) {
+            kept.push_back(old_idx++);
+            prev_map = info;
+            if (!info->IsBlank()) {
+              prev_real_map = info;
+            }
+            return;
+          }
+        }
+        kept.push_back(kNewMap);
+        new_maps.emplace_back(new MapInfo(prev_map, prev_real_map, start, end, pgoff, flags, name));
+        prev_map = new_maps.back().get();
+        if (!prev_map->IsBlank()) {
+          prev_real_map = prev_map;
+        }
+      });
+  if (!parsed) {
+    return false;
   }
 
-  // Now move out any of the maps that never were found.
-  for (size_t i = search_map_idx; i < last_map_idx; i++) {
-    saved_maps_.emplace_back(std::move(maps_[i]));
-    maps_[i] = nullptr;
-    total_entries--;
+  std::vector<std::unique_ptr<MapInfo>> maps;
+  maps.reserve(kept.size());
+  auto new_map = new_maps.begin();
+  for (size_t idx : kept) {
+    if (idx == kNewMap) {
+      maps.emplace_back(std::move(*new_map++));
+    } else {
+      maps.emplace_back(std::move(maps_[idx]));
+    }
   }
-
-  // Sort all of the values such that the nullptrs wind up at the end, then
-  // resize them away.
-  std::sort(maps_.begin(), maps_.end(), [](const auto& a, const auto& b) {
-    if (a == nullptr) {
-      return false;
-    } else if (b == nullptr) {
-      return true;
+  // Never delete the maps that are gone, they may be in use. The assumption
+  // is that there will only ever be a handful of these so waiting to destroy
+  // them is not too expensive.
+  for (auto& info : maps_) {
+    if (info != nullptr) {
+      saved_maps_.emplace_back(std::move(info));
     }
-    return a->start < b->start;
-  });
-  maps_.resize(total_entries);
-
+  }
+  maps_ = std::move(maps);
+  UpdateIndex();
   return true;
 }
 
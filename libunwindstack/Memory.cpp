@@ -26,6 +26,7 @@
 
 #include <algorithm>
 #include <memory>
+#include <mutex>
 
 #include <android-base/unique_fd.h>
 
@@ -99,6 +100,51 @@ static size_t ProcessVmRead(pid_t pid, uint64_t remote_src, void* dst, size_t le
   return total_read;
 }
 
+static size_t ProcessVmReadBlocks(pid_t pid, const uint64_t* addrs, void* const* dsts,
+                                  size_t size, size_t count) {
+  if (size == 0) {
+    return count;
+  }
+
+  // One iovec per block on each side, so that one call reads them all. A
+  // block that is only partly read ends the transfer, and isn't counted.
+  constexpr size_t kMaxIovecs = 64;
+  struct iovec src_iovs[kMaxIovecs];
+  struct iovec dst_iovs[kMaxIovecs];
+
+  size_t blocks_read = 0;
+  while (blocks_read < count) {
+    size_t iovecs_used = 0;
+    while (iovecs_used < kMaxIovecs && blocks_read + iovecs_used < count) {
+      uint64_t addr = addrs[blocks_read + iovecs_used];
+      // struct iovec uses void* for iov_base.
+      if (addr >= UINTPTR_MAX || UINTPTR_MAX - addr < size) {
+        break;
+      }
+      src_iovs[iovecs_used].iov_base = reinterpret_cast<void*>(addr);
+      src_iovs[iovecs_used].iov_len = size;
+      dst_iovs[iovecs_used].iov_base = dsts[blocks_read + iovecs_used];
+      dst_iovs[iovecs_used].iov_len = size;
+      ++iovecs_used;
+    }
+    if (iovecs_used == 0) {
+      errno = EFAULT;
+      return blocks_read;
+    }
+
+    ssize_t rc = process_vm_readv(pid, dst_iovs, iovecs_used, src_iovs, iovecs_used, 0);
+    if (rc == -1) {
+      return blocks_read;
+    }
+    size_t blocks = static_cast<size_t>(rc) / size;
+    blocks_read += blocks;
+    if (blocks < iovecs_used) {
+      break;
+    }
+  }
+  return blocks_read;
+}
+
 static bool PtraceReadLong(pid_t pid, uint64_t addr, long* value) {
   // ptrace() returns -1 and sets errno when the operation fails.
   // To disambiguate -1 from a valid result, we clear errno beforehand.
@@ -158,6 +204,15 @@ bool Memory::ReadFully(uint64_t addr, void* dst, size_t size) {
   return rc == size;
 }
 
+size_t Memory::ReadBlocks(const uint64_t* addrs, void* const* dsts, size_t size, size_t count) {
+  for (size_t i = 0; i < count; i++) {
+    if (!ReadFully(addrs[i], dsts[i], size)) {
+      return i;
+    }
+  }
+  return count;
+}
+
 bool Memory::ReadString(uint64_t addr, std::string* string, uint64_t max_read) {
   string->clear();
   uint64_t bytes_read = 0;
@@ -320,10 +375,25 @@ size_t MemoryRemote::Read(uint64_t addr, void* dst, size_t size) {
   }
 }
 
+size_t MemoryRemote::ReadBlocks(const uint64_t* addrs, void* const* dsts, size_t size,
+                                size_t count) {
+  // Batching only helps once process_vm_readv is known to work, ptrace reads
+  // a word at a time either way.
+  if (read_redirect_func_.load() == reinterpret_cast<uintptr_t>(ProcessVmRead)) {
+    return ProcessVmReadBlocks(pid_, addrs, dsts, size, count);
+  }
+  return Memory::ReadBlocks(addrs, dsts, size, count);
+}
+
 size_t MemoryLocal::Read(uint64_t addr, void* dst, size_t size) {
   return ProcessVmRead(getpid(), addr, dst, size);
 }
 
+size_t MemoryLocal::ReadBlocks(const uint64_t* addrs, void* const* dsts, size_t size,
+                               size_t count) {
+  return ProcessVmReadBlocks(getpid(), addrs, dsts, size, count);
+}
+
 MemoryRange::MemoryRange(const std::shared_ptr<Memory>& memory, uint64_t begin, uint64_t length,
                          uint64_t offset)
     : memory_(memory), begin_(begin), length_(length), offset_(offset) {}
@@ -429,24 +499,140 @@ size_t MemoryOfflineParts::Read(uint64_t addr, void* dst, size_t size) {
   return 0;
 }
 
+MemoryCache::MemoryCache(Memory* memory, size_t max_pages)
+    : max_pages_(std::max(std::min(max_pages, size_t{kNoSlot}), size_t{1})), impl_(memory) {}
+
+MemoryCache::~MemoryCache() {
+  if (arena_ != nullptr) {
+    munmap(arena_, max_pages_ << kCacheBits);
+  }
+}
+
+void MemoryCache::Clear() {
+  std::lock_guard<std::mutex> guard(lock_);
+  slots_.clear();
+  free_slots_.clear();
+  lru_head_ = kNoSlot;
+  lru_tail_ = kNoSlot;
+  index_.clear();
+}
+
+void MemoryCache::Unlink(uint32_t slot) {
+  Slot& entry = slots_[slot];
+  if (entry.prev != kNoSlot) {
+    slots_[entry.prev].next = entry.next;
+  } else {
+    lru_head_ = entry.next;
+  }
+  if (entry.next != kNoSlot) {
+    slots_[entry.next].prev = entry.prev;
+  } else {
+    lru_tail_ = entry.prev;
+  }
+}
+
+void MemoryCache::PushFront(uint32_t slot) {
+  Slot& entry = slots_[slot];
+  entry.prev = kNoSlot;
+  entry.next = lru_head_;
+  if (lru_head_ != kNoSlot) {
+    slots_[lru_head_].prev = slot;
+  } else {
+    lru_tail_ = slot;
+  }
+  lru_head_ = slot;
+}
+
+uint32_t MemoryCache::AllocSlot(uint64_t page) {
+  uint32_t slot;
+  if (!free_slots_.empty()) {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  } else if (slots_.size() < max_pages_) {
+    slot = static_cast<uint32_t>(slots_.size());
+    slots_.emplace_back();
+  } else {
+    slot = lru_tail_;
+    Unlink(slot);
+    index_.erase(slots_[slot].page);
+  }
+  slots_[slot].page = page;
+  PushFront(slot);
+  index_[page] = slot;
+  return slot;
+}
+
+void MemoryCache::FreeSlot(uint32_t slot) {
+  Unlink(slot);
+  index_.erase(slots_[slot].page);
+  free_slots_.push_back(slot);
+}
+
+uint8_t* MemoryCache::GetPage(uint64_t page) {
+  auto entry = index_.find(page);
+  if (entry != index_.end()) {
+    if (entry->second != lru_head_) {
+      Unlink(entry->second);
+      PushFront(entry->second);
+    }
+    return SlotData(entry->second);
+  }
+
+  if (arena_ == nullptr) {
+    void* map = mmap(nullptr, max_pages_ << kCacheBits, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+      return nullptr;
+    }
+    arena_ = reinterpret_cast<uint8_t*>(map);
+  }
+
+  // Read ahead into the pages that follow, up to the first one that is
+  // already cached. Reading ahead never takes more than half the cache, so
+  // it can't push out everything that is in use.
+  size_t max_read = std::max(std::min(kMaxReadPages, max_pages_ / 2), size_t{1});
+  uint64_t addrs[kMaxReadPages];
+  void* dsts[kMaxReadPages];
+  uint32_t read_slots[kMaxReadPages];
+  size_t num_pages = 0;
+  while (num_pages < max_read) {
+    uint64_t read_page = page + num_pages;
+    if ((num_pages > 0 && index_.count(read_page) != 0) || read_page > (UINT64_MAX >> kCacheBits)) {
+      break;
+    }
+    read_slots[num_pages] = AllocSlot(read_page);
+    addrs[num_pages] = read_page << kCacheBits;
+    dsts[num_pages] = SlotData(read_slots[num_pages]);
+    num_pages++;
+  }
+
+  size_t pages_read = impl_->ReadBlocks(addrs, dsts, kCacheSize, num_pages);
+  for (size_t i = pages_read; i < num_pages; i++) {
+    FreeSlot(read_slots[i]);
+  }
+  if (pages_read == 0) {
+    return nullptr;
+  }
+  // The pages were pushed to the front in order, put the one asked for
+  // ahead of the ones read with it.
+  if (read_slots[0] != lru_head_) {
+    Unlink(read_slots[0]);
+    PushFront(read_slots[0]);
+  }
+  return reinterpret_cast<uint8_t*>(dsts[0]);
+}
+
 size_t MemoryCache::Read(uint64_t addr, void* dst, size_t size) {
   // Only bother caching and looking at the cache if this is a small read for now.
   if (size > 64) {
     return impl_->Read(addr, dst, size);
   }
 
+  std::lock_guard<std::mutex> guard(lock_);
   uint64_t addr_page = addr >> kCacheBits;
-  auto entry = cache_.find(addr_page);
-  uint8_t* cache_dst;
-  if (entry != cache_.end()) {
-    cache_dst = entry->second;
-  } else {
-    cache_dst = cache_[addr_page];
-    if (!impl_->ReadFully(addr_page << kCacheBits, cache_dst, kCacheSize)) {
-      // Erase the entry.
-      cache_.erase(addr_page);
-      return impl_->Read(addr, dst, size);
-    }
+  uint8_t* cache_dst = GetPage(addr_page);
+  if (cache_dst == nullptr) {
+    return impl_->Read(addr, dst, size);
   }
   size_t max_read = ((addr_page + 1) << kCacheBits) - addr;
   if (size <= max_read) {
@@ -460,16 +646,9 @@ size_t MemoryCache::Read(uint64_t addr, void* dst, size_t size) {
   dst = &reinterpret_cast<uint8_t*>(dst)[max_read];
   addr_page++;
 
-  entry = cache_.find(addr_page);
-  if (entry != cache_.end()) {
-    cache_dst = entry->second;
-  } else {
-    cache_dst = cache_[addr_page];
-    if (!impl_->ReadFully(addr_page << kCacheBits, cache_dst, kCacheSize)) {
-      // Erase the entry.
-      cache_.erase(addr_page);
-      return impl_->Read(addr_page << kCacheBits, dst, size - max_read) + max_read;
-    }
+  cache_dst = GetPage(addr_page);
+  if (cache_dst == nullptr) {
+    return impl_->Read(addr_page << kCacheBits, dst, size - max_read) + max_read;
   }
   memcpy(dst, cache_dst, size - max_read);
   return size;
@@ -20,27 +20,74 @@
 #include <stdint.h>
 
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <unwindstack/Memory.h>
 
 namespace unwindstack {
 
+// Caches small reads a page at a time. Pages live in a page aligned arena
+// that is never bigger than |max_pages|, and the least recently used page is
+// dropped to make room for a new one. A miss reads the page and the uncached
+// pages after it in one ReadBlocks call, so walking up a stack or through the
+// tables of an elf file in memory costs a few system calls rather than one
+// per page.
+//
+// A cache may be read from many threads at once. Elf objects created from
+// the memory of one unwinder keep using it when another unwinder, perhaps
+// on another thread, steps through them.
 class MemoryCache : public Memory {
  public:
-  MemoryCache(Memory* memory) : impl_(memory) {}
-  virtual ~MemoryCache() = default;
+  // 1MB, enough for the stack and unwind tables a typical unwind touches.
+  constexpr static size_t kDefaultMaxPages = 256;
+
+  MemoryCache(Memory* memory, size_t max_pages = kDefaultMaxPages);
+  virtual ~MemoryCache();
 
   size_t Read(uint64_t addr, void* dst, size_t size) override;
 
-  void Clear() override { cache_.clear(); }
+  void Clear() override;
 
  private:
   constexpr static size_t kCacheBits = 12;
   constexpr static size_t kCacheMask = (1 << kCacheBits) - 1;
   constexpr static size_t kCacheSize = 1 << kCacheBits;
-  std::unordered_map<uint64_t, uint8_t[kCacheSize]> cache_;
+  // The most pages read on a miss, including the one that missed.
+  constexpr static size_t kMaxReadPages = 8;
+
+  // Returns the cached data of |page|, reading it in if needed. Returns
+  // nullptr if the page can't be read fully.
+  uint8_t* GetPage(uint64_t page);
+
+  // Takes a free slot, or the least recently used one, and makes it the
+  // most recently used.
+  uint32_t AllocSlot(uint64_t page);
+  void FreeSlot(uint32_t slot);
+  void Unlink(uint32_t slot);
+  void PushFront(uint32_t slot);
+
+  uint8_t* SlotData(uint32_t slot) { return &arena_[size_t{slot} << kCacheBits]; }
+
+  struct Slot {
+    uint64_t page;
+    uint32_t prev;
+    uint32_t next;
+  };
+  constexpr static uint32_t kNoSlot = UINT32_MAX;
+
+  size_t max_pages_;
+  // Mapped on the first cached read, so caches that are never used cost nothing.
+  uint8_t* arena_ = nullptr;
+  std::vector<Slot> slots_;
+  std::vector<uint32_t> free_slots_;
+  // Most recently used first.
+  uint32_t lru_head_ = kNoSlot;
+  uint32_t lru_tail_ = kNoSlot;
+  std::unordered_map<uint64_t, uint32_t> index_;
+  std::mutex lock_;
 
   std::unique_ptr<Memory> impl_;
 };
@@ -29,6 +29,7 @@ class MemoryLocal : public Memory {
   virtual ~MemoryLocal() = default;
 
   size_t Read(uint64_t addr, void* dst, size_t size) override;
+  size_t ReadBlocks(const uint64_t* addrs, void* const* dsts, size_t size, size_t count) override;
 };
 
 }  // namespace unwindstack
@@ -32,6 +32,7 @@ class MemoryRemote : public Memory {
   virtual ~MemoryRemote() = default;
 
   size_t Read(uint64_t addr, void* dst, size_t size) override;
+  size_t ReadBlocks(const uint64_t* addrs, void* const* dsts, size_t size, size_t count) override;
 
   pid_t pid() { return pid_; }
 
@@ -15,92 +15,238 @@
  */
 
 #include <elf.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include <algorithm>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
+
+#include <android-base/file.h>
+#include <android-base/mapped_file.h>
+#include <android-base/stringprintf.h>
+#include <android-base/threads.h>
+#include <android-base/unique_fd.h>
 
 #include <unwindstack/Memory.h>
 
-#include "Check.h"
 #include "Symbols.h"
 
 namespace unwindstack {
 
+static constexpr uint32_t kCacheMagic = 0x59535755;  // "UWSY"
+static constexpr uint32_t kCacheVersion = 1;
+
+namespace {
+
+// A cache file is this header followed by the sorted Infos.
+struct CacheHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t section_size;
+  uint64_t str_size;
+  uint64_t num_symbols;
+};
+
+}  // namespace
+
 Symbols::Symbols(uint64_t offset, uint64_t size, uint64_t entry_size, uint64_t str_offset,
                  uint64_t str_size)
-    : cur_offset_(offset),
-      offset_(offset),
+    : offset_(offset),
       end_(offset + size),
       entry_size_(entry_size),
       str_offset_(str_offset),
       str_end_(str_offset_ + str_size) {}
 
+Symbols::~Symbols() {}
+
+void Symbols::ClearCache() {
+  std::lock_guard<std::mutex> guard(lock_);
+  symbols_.clear();
+  symbols_.shrink_to_fit();
+  mapped_file_.reset();
+  infos_ = nullptr;
+  num_infos_ = 0;
+  built_ = false;
+}
+
 const Symbols::Info* Symbols::GetInfoFromCache(uint64_t addr) {
-  // Binary search the table.
-  size_t first = 0;
-  size_t last = symbols_.size();
-  while (first < last) {
-    size_t current = first + (last - first) / 2;
-    const Info* info = &symbols_[current];
-    if (addr < info->start_offset) {
-      last = current;
-    } else if (addr < info->end_offset) {
-      return info;
-    } else {
-      first = current + 1;
-    }
+  // Find the last function that starts at or before addr.
+  const Info* next = std::upper_bound(infos_, infos_ + num_infos_, addr,
+                                      [](uint64_t value, const Info& info) {
+                                        return value < info.start_offset;
+                                      });
+  if (next == infos_) {
+    return nullptr;
   }
-  return nullptr;
+  const Info* info = next - 1;
+  if (addr - info->start_offset >= info->size) {
+    return nullptr;
+  }
+  return info;
 }
 
+// Returns false if the section could not be read completely.
 template <typename SymType>
-bool Symbols::GetName(uint64_t addr, Memory* elf_memory, std::string* name, uint64_t* func_offset) {
-  if (symbols_.size() != 0) {
-    const Info* info = GetInfoFromCache(addr);
-    if (info) {
-      CHECK(addr >= info->start_offset && addr <= info->end_offset);
-      *func_offset = addr - info->start_offset;
-      return elf_memory->ReadString(info->str_offset, name, str_end_ - info->str_offset);
+bool Symbols::BuildCache(Memory* elf_memory) {
+  // Enough entries to make a read worth it, without a big buffer.
+  constexpr size_t kEntriesPerRead = 256;
+  if (entry_size_ == 0) {
+    return true;
+  }
+
+  std::vector<uint8_t> buffer;
+  bool corrupted = false;
+  uint64_t cur_offset = offset_;
+  while (cur_offset + entry_size_ <= end_) {
+    size_t num_entries =
+        static_cast<size_t>(std::min<uint64_t>(kEntriesPerRead, (end_ - cur_offset) / entry_size_));
+    // An entry can be smaller than the SymType read from it.
+    size_t read_size = (num_entries - 1) * entry_size_ + sizeof(SymType);
+    buffer.resize(read_size);
+    if (!elf_memory->ReadFully(cur_offset, buffer.data(), read_size)) {
+      // Something looks like it is corrupted, keep what can be read one entry
+      // at a time and stop there.
+      size_t entries_read = 0;
+      while (entries_read < num_entries &&
+             elf_memory->ReadFully(cur_offset + entries_read * entry_size_,
+                                   &buffer[entries_read * entry_size_], sizeof(SymType))) {
+        entries_read++;
+      }
+      num_entries = entries_read;
+      corrupted = true;
     }
+
+    for (size_t i = 0; i < num_entries; i++) {
+      SymType entry;
+      memcpy(&entry, &buffer[i * entry_size_], sizeof(entry));
+      if (entry.st_shndx != SHN_UNDEF && ELF32_ST_TYPE(entry.st_info) == STT_FUNC &&
+          entry.st_size != 0 && str_offset_ + entry.st_name < str_end_) {
+        // Treat st_value as virtual address.
+        uint32_t size = static_cast<uint32_t>(std::min<uint64_t>(entry.st_size, UINT32_MAX));
+        symbols_.push_back(Info{entry.st_value, size, entry.st_name});
+      }
+    }
+    if (corrupted) {
+      break;
+    }
+    cur_offset += num_entries * entry_size_;
   }
 
-  bool symbol_added = false;
-  bool return_value = false;
-  while (cur_offset_ + entry_size_ <= end_) {
-    SymType entry;
-    if (!elf_memory->ReadFully(cur_offset_, &entry, sizeof(entry))) {
-      // Stop all processing, something looks like it is corrupted.
-      cur_offset_ = UINT64_MAX;
+  // If more than one function starts at the same address, the one that comes
+  // first in the table is used.
+  std::stable_sort(symbols_.begin(), symbols_.end(),
+                   [](const Info& a, const Info& b) { return a.start_offset < b.start_offset; });
+  symbols_.erase(std::unique(symbols_.begin(), symbols_.end(),
+                             [](const Info& a, const Info& b) {
+                               return a.start_offset == b.start_offset;
+                             }),
+                 symbols_.end());
+  symbols_.shrink_to_fit();
+  return !corrupted;
+}
+
+// A cache file may have been written by anyone, so nothing in it is used
+// until it has been checked here.
+bool Symbols::LoadCache() {
+  if (cache_path_.empty()) {
+    return false;
+  }
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(cache_path_.c_str(), O_RDONLY | O_CLOEXEC)));
+  if (fd == -1) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 || st.st_size < static_cast<off_t>(sizeof(CacheHeader))) {
+    return false;
+  }
+  std::unique_ptr<android::base::MappedFile> mapped_file =
+      android::base::MappedFile::FromFd(fd, 0, static_cast<size_t>(st.st_size), PROT_READ);
+  if (mapped_file == nullptr) {
+    return false;
+  }
+
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(mapped_file->data());
+  CacheHeader header;
+  memcpy(&header, data, sizeof(header));
+  if (header.magic != kCacheMagic || header.version != kCacheVersion ||
+      header.section_size != end_ - offset_ || header.str_size != str_end_ - str_offset_ ||
+      header.num_symbols > (mapped_file->size() - sizeof(header)) / sizeof(Info) ||
+      sizeof(header) + header.num_symbols * sizeof(Info) != mapped_file->size()) {
+    return false;
+  }
+  const Info* infos = reinterpret_cast<const Info*>(data + sizeof(header));
+  for (size_t i = 0; i < header.num_symbols; i++) {
+    if (str_offset_ + infos[i].name >= str_end_ ||
+        (i > 0 && infos[i].start_offset <= infos[i - 1].start_offset)) {
       return false;
     }
-    cur_offset_ += entry_size_;
-
-    if (entry.st_shndx != SHN_UNDEF && ELF32_ST_TYPE(entry.st_info) == STT_FUNC) {
-      // Treat st_value as virtual address.
-      uint64_t start_offset = entry.st_value;
-      uint64_t end_offset = start_offset + entry.st_size;
-
-      // Cache the value.
-      symbols_.emplace_back(start_offset, end_offset, str_offset_ + entry.st_name);
-      symbol_added = true;
-
-      if (addr >= start_offset && addr < end_offset) {
-        *func_offset = addr - start_offset;
-        uint64_t offset = str_offset_ + entry.st_name;
-        if (offset < str_end_) {
-          return_value = elf_memory->ReadString(offset, name, str_end_ - offset);
+  }
+
+  mapped_file_ = std::move(mapped_file);
+  infos_ = infos;
+  num_infos_ = header.num_symbols;
+  return true;
+}
+
+void Symbols::SaveCache() {
+  if (cache_path_.empty()) {
+    return;
+  }
+  CacheHeader header{.magic = kCacheMagic,
+                     .version = kCacheVersion,
+                     .section_size = end_ - offset_,
+                     .str_size = str_end_ - str_offset_,
+                     .num_symbols = symbols_.size()};
+
+  // Other threads and processes may be writing the same file, so only a
+  // complete one is ever moved into place.
+  std::string tmp_path = cache_path_ + android::base::StringPrintf(
+                                           ".%d.%" PRIu64, getpid(), android::base::GetThreadId());
+  android::base::unique_fd fd(TEMP_FAILURE_RETRY(
+      open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)));
+  if (fd == -1) {
+    return;
+  }
+  if (!android::base::WriteFully(fd, &header, sizeof(header)) ||
+      !android::base::WriteFully(fd, symbols_.data(), symbols_.size() * sizeof(Info)) ||
+      rename(tmp_path.c_str(), cache_path_.c_str()) != 0) {
+    unlink(tmp_path.c_str());
+  }
+}
+
+template <typename SymType>
+bool Symbols::GetName(uint64_t addr, Memory* elf_memory, std::string* name, uint64_t* func_offset) {
+  if (!built_.load(std::memory_order_acquire)) {
+    std::lock_guard<std::mutex> guard(lock_);
+    if (!built_.load(std::memory_order_relaxed)) {
+      if (!LoadCache()) {
+        // A table that could not be read completely is not shared, another
+        // process may be able to read all of it.
+        if (BuildCache<SymType>(elf_memory)) {
+          SaveCache();
         }
-        break;
+        infos_ = symbols_.data();
+        num_infos_ = symbols_.size();
       }
+      built_.store(true, std::memory_order_release);
     }
   }
 
-  if (symbol_added) {
-    std::sort(symbols_.begin(), symbols_.end(),
-              [](const Info& a, const Info& b) { return a.start_offset < b.start_offset; });
+  const Info* info = GetInfoFromCache(addr);
+  if (info == nullptr) {
+    return false;
   }
-  return return_value;
+  *func_offset = addr - info->start_offset;
+  uint64_t offset = str_offset_ + info->name;
+  return elf_memory->ReadString(offset, name, str_end_ - offset);
 }
 
 template <typename SymType>
@@ -19,27 +19,50 @@
 
 #include <stdint.h>
 
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
+namespace android {
+namespace base {
+class MappedFile;
+}  // namespace base
+}  // namespace android
+
 namespace unwindstack {
 
 // Forward declaration.
 class Memory;
 
+// The function symbols of a .symtab or .dynsym section. The first lookup
+// reads the whole section, in large blocks, into an array sorted by address.
+// Every lookup after that is a binary search, and only the name is read.
+// Lookups may be made from several threads at once.
+//
+// With a cache path, the sorted array is mapped from that file instead, and
+// written there by the first process that has to read the section, so that
+// every process unwinding through the same build of a library shares one
+// copy of it.
 class Symbols {
   struct Info {
-    Info(uint64_t start_offset, uint64_t end_offset, uint64_t str_offset)
-        : start_offset(start_offset), end_offset(end_offset), str_offset(str_offset) {}
     uint64_t start_offset;
-    uint64_t end_offset;
-    uint64_t str_offset;
+    // Function sizes are clamped to 4GB to keep an entry to 16 bytes.
+    uint32_t size;
+    // Offset of the name in the string table.
+    uint32_t name;
   };
 
  public:
   Symbols(uint64_t offset, uint64_t size, uint64_t entry_size, uint64_t str_offset,
           uint64_t str_size);
-  virtual ~Symbols() = default;
+  virtual ~Symbols();
+
+  uint64_t offset() { return offset_; }
+
+  // Must be called before the first lookup.
+  void SetCachePath(const std::string& path) { cache_path_ = path; }
 
   const Info* GetInfoFromCache(uint64_t addr);
 
@@ -49,20 +72,31 @@ class Symbols {
   template <typename SymType>
   bool GetGlobal(Memory* elf_memory, const std::string& name, uint64_t* memory_address);
 
-  void ClearCache() {
-    symbols_.clear();
-    cur_offset_ = offset_;
-  }
+  // Not safe to call while other threads are looking up symbols.
+  void ClearCache();
 
  private:
-  uint64_t cur_offset_;
+  template <typename SymType>
+  bool BuildCache(Memory* elf_memory);
+
+  bool LoadCache();
+  void SaveCache();
+
   uint64_t offset_;
   uint64_t end_;
   uint64_t entry_size_;
   uint64_t str_offset_;
   uint64_t str_end_;
 
+  std::mutex lock_;
+  std::atomic_bool built_ = false;
+  // Sorted by start_offset, with no two entries starting at the same address.
+  // They are either in symbols_ or in the mapped cache file.
+  const Info* infos_ = nullptr;
+  size_t num_infos_ = 0;
   std::vector<Info> symbols_;
+  std::string cache_path_;
+  std::unique_ptr<android::base::MappedFile> mapped_file_;
 };
 
 }  // namespace unwindstack
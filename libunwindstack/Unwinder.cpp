@@ -23,6 +23,8 @@
 #include <unistd.h>
 
 #include <algorithm>
+#include <atomic>
+#include <thread>
 
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
@@ -353,6 +355,67 @@ std::string Unwinder::FormatFrame(const FrameData& frame) const {
   return data;
 }
 
+void Unwinder::UnwindThreads(pid_t pid, std::vector<ThreadUnwind>* threads,
+                             size_t num_workers) {
+  num_workers = std::max(std::min(num_workers, threads->size()), size_t{1});
+
+  auto make_unwinder = [this](std::shared_ptr<Memory> memory) {
+    std::unique_ptr<Unwinder> unwinder(new Unwinder(max_frames_, maps_, memory));
+    unwinder->jit_debug_ = jit_debug_;
+    unwinder->dex_files_ = dex_files_;
+    unwinder->resolve_names_ = resolve_names_;
+    unwinder->embedded_soname_ = embedded_soname_;
+    unwinder->display_build_id_ = display_build_id_;
+    return unwinder;
+  };
+  auto unwind = [](Unwinder* unwinder, ThreadUnwind* thread) {
+    std::unique_ptr<Regs> regs(thread->regs->Clone());
+    unwinder->SetRegs(regs.get());
+    unwinder->Unwind();
+    unwinder->SetRegs(nullptr);
+    thread->frames = unwinder->ConsumeFrames();
+    thread->error = unwinder->last_error_;
+    thread->elf_from_memory_not_file = unwinder->elf_from_memory_not_file_;
+  };
+
+  std::atomic_size_t next_thread(0);
+  // Set for threads that a worker couldn't read the stack of. Reads may
+  // only work through ptrace, which is only allowed from the thread that
+  // attached, so these are unwound again on the calling thread.
+  std::unique_ptr<std::atomic_bool[]> retry(new std::atomic_bool[threads->size()]());
+  auto work = [&](std::shared_ptr<Memory> memory, bool is_worker) {
+    std::unique_ptr<Unwinder> unwinder = make_unwinder(memory);
+    for (size_t i = next_thread++; i < threads->size(); i = next_thread++) {
+      ThreadUnwind* thread = &(*threads)[i];
+      unwind(unwinder.get(), thread);
+      uint64_t value;
+      if (is_worker && thread->error.code == ERROR_MEMORY_INVALID &&
+          !memory->Read64(thread->regs->sp(), &value)) {
+        retry[i] = true;
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < num_workers; i++) {
+    workers.emplace_back(work, Memory::CreateProcessMemoryCached(pid), true);
+  }
+  work(process_memory_, false);
+  for (auto& worker : workers) {
+    worker.join();
+  }
+
+  std::unique_ptr<Unwinder> unwinder;
+  for (size_t i = 0; i < threads->size(); i++) {
+    if (retry[i]) {
+      if (unwinder == nullptr) {
+        unwinder = make_unwinder(process_memory_);
+      }
+      unwind(unwinder.get(), &(*threads)[i]);
+    }
+  }
+}
+
 std::string Unwinder::FormatFrame(size_t frame_num) const {
   if (frame_num >= frames_.size()) {
     return "";
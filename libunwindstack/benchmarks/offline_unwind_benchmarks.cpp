@@ -0,0 +1,421 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Replays the offline snapshots written by unwind_for_offline, the same ones
+// UnwindOfflineTest uses, so that a change to the unwinder can be measured
+// against real processes: large apps, jit frames and arm exidx unwinds.
+//
+// Besides time, every benchmark reports:
+//   frames            frames unwound per second
+//   frames_per_unwind
+//   allocs_per_unwind calls to operator new
+//   reads_per_unwind  reads of process memory by the unwinder
+//   cache_hit_rate    reads served by the memory cache, for _cached runs
+//
+// By default snapshots are read from tests/files/offline/ next to the
+// executable, use --offline_dir=<dir> to read them from somewhere else.
+
+#include <dirent.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <android-base/file.h>
+#include <android-base/strings.h>
+
+#include <unwindstack/JitDebug.h>
+#include <unwindstack/MachineArm.h>
+#include <unwindstack/MachineArm64.h>
+#include <unwindstack/MachineX86.h>
+#include <unwindstack/MachineX86_64.h>
+#include <unwindstack/Maps.h>
+#include <unwindstack/Memory.h>
+#include <unwindstack/RegsArm.h>
+#include <unwindstack/RegsArm64.h>
+#include <unwindstack/RegsX86.h>
+#include <unwindstack/RegsX86_64.h>
+#include <unwindstack/Unwinder.h>
+
+#include "MemoryCache.h"
+#include "MemoryOffline.h"
+
+static std::atomic_size_t g_allocs;
+
+void* operator new(size_t size) {
+  g_allocs.fetch_add(1, std::memory_order_relaxed);
+  void* ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    abort();
+  }
+  return ptr;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+  free(ptr);
+}
+
+namespace {
+
+struct Snapshot {
+  const char* dir;
+  unwindstack::ArchEnum arch;
+};
+
+constexpr Snapshot kSnapshots[] = {
+    {"art_quick_osr_stub_arm", unwindstack::ARCH_ARM},        // art, large libart.so
+    {"jit_debug_arm", unwindstack::ARCH_ARM},                 // jit frames, arm
+    {"jit_debug_x86", unwindstack::ARCH_X86},                 // jit frames, x86
+    {"jit_map_arm", unwindstack::ARCH_ARM},                   // jit maps
+    {"straddle_arm", unwindstack::ARCH_ARM},                  // arm exidx
+    {"offset_arm", unwindstack::ARCH_ARM},                    // arm exidx, elf at an offset
+    {"gnu_debugdata_arm", unwindstack::ARCH_ARM},             // minidebuginfo
+    {"signal_load_bias_arm", unwindstack::ARCH_ARM},          // signal frame
+    {"shared_lib_in_apk_arm64", unwindstack::ARCH_ARM64},     // library in an apk
+    {"debug_frame_load_bias_arm", unwindstack::ARCH_ARM},     // debug_frame
+    {"eh_frame_hdr_begin_x86_64", unwindstack::ARCH_X86_64},  // eh_frame_hdr
+    {"debug_frame_first_x86", unwindstack::ARCH_X86},         // debug_frame first
+};
+
+class CountingMemory : public unwindstack::Memory {
+ public:
+  // A read that doesn't lead to a read of |backing| counts as a hit.
+  CountingMemory(std::shared_ptr<unwindstack::Memory> impl, const CountingMemory* backing = nullptr)
+      : impl_(impl), backing_(backing) {}
+  virtual ~CountingMemory() = default;
+
+  size_t Read(uint64_t addr, void* dst, size_t size) override {
+    reads_++;
+    if (backing_ == nullptr) {
+      return impl_->Read(addr, dst, size);
+    }
+    size_t backing_reads = backing_->reads();
+    size_t bytes = impl_->Read(addr, dst, size);
+    if (backing_->reads() == backing_reads) {
+      hits_++;
+    }
+    return bytes;
+  }
+
+  size_t reads() const { return reads_; }
+  size_t hits() const { return hits_; }
+
+ private:
+  std::shared_ptr<unwindstack::Memory> impl_;
+  const CountingMemory* backing_;
+  size_t reads_ = 0;
+  size_t hits_ = 0;
+};
+
+template <typename AddressType>
+bool SetRegs(unwindstack::RegsImpl<AddressType>* regs,
+             const std::unordered_map<std::string, uint32_t>& names,
+             const std::unordered_map<std::string, uint64_t>& values) {
+  for (const auto& [name, value] : values) {
+    auto entry = names.find(name);
+    if (entry == names.end()) {
+      return false;
+    }
+    (*regs)[entry->second] = value;
+  }
+  return true;
+}
+
+// Returns nullptr if |dir| doesn't hold valid registers for |arch|. Only the
+// registers that were saved are in regs.txt, which isn't always enough to
+// tell the arch from.
+unwindstack::Regs* ReadRegs(const std::string& dir, unwindstack::ArchEnum arch) {
+  std::string content;
+  if (!android::base::ReadFileToString(dir + "regs.txt", &content)) {
+    return nullptr;
+  }
+  std::unordered_map<std::string, uint64_t> values;
+  for (const auto& line : android::base::Split(content, "\n")) {
+    char name[100];
+    uint64_t value;
+    if (sscanf(line.c_str(), "%99[^:]: %" SCNx64, name, &value) == 2) {
+      values[name] = value;
+    }
+  }
+
+  std::unordered_map<std::string, uint32_t> names;
+  switch (arch) {
+    case unwindstack::ARCH_ARM: {
+      for (uint32_t i = 0; i <= 11; i++) {
+        names["r" + std::to_string(i)] = unwindstack::ARM_REG_R0 + i;
+      }
+      names["ip"] = unwindstack::ARM_REG_R12;
+      names["sp"] = unwindstack::ARM_REG_SP;
+      names["lr"] = unwindstack::ARM_REG_LR;
+      names["pc"] = unwindstack::ARM_REG_PC;
+      auto regs = std::make_unique<unwindstack::RegsArm>();
+      return SetRegs<uint32_t>(regs.get(), names, values) ? regs.release() : nullptr;
+    }
+    case unwindstack::ARCH_ARM64: {
+      for (uint32_t i = 0; i <= 29; i++) {
+        names["x" + std::to_string(i)] = unwindstack::ARM64_REG_R0 + i;
+      }
+      names["sp"] = unwindstack::ARM64_REG_SP;
+      names["lr"] = unwindstack::ARM64_REG_LR;
+      names["pc"] = unwindstack::ARM64_REG_PC;
+      names["pst"] = unwindstack::ARM64_REG_PSTATE;
+      auto regs = std::make_unique<unwindstack::RegsArm64>();
+      return SetRegs<uint64_t>(regs.get(), names, values) ? regs.release() : nullptr;
+    }
+    case unwindstack::ARCH_X86: {
+      names = {
+          {"eax", unwindstack::X86_REG_EAX}, {"ebx", unwindstack::X86_REG_EBX},
+          {"ecx", unwindstack::X86_REG_ECX}, {"edx", unwindstack::X86_REG_EDX},
+          {"ebp", unwindstack::X86_REG_EBP}, {"edi", unwindstack::X86_REG_EDI},
+          {"esi", unwindstack::X86_REG_ESI}, {"esp", unwindstack::X86_REG_ESP},
+          {"eip", unwindstack::X86_REG_EIP},
+      };
+      auto regs = std::make_unique<unwindstack::RegsX86>();
+      return SetRegs<uint32_t>(regs.get(), names, values) ? regs.release() : nullptr;
+    }
+    case unwindstack::ARCH_X86_64: {
+      names = {
+          {"rax", unwindstack::X86_64_REG_RAX}, {"rbx", unwindstack::X86_64_REG_RBX},
+          {"rcx", unwindstack::X86_64_REG_RCX}, {"rdx", unwindstack::X86_64_REG_RDX},
+          {"r8", unwindstack::X86_64_REG_R8},   {"r9", unwindstack::X86_64_REG_R9},
+          {"r10", unwindstack::X86_64_REG_R10}, {"r11", unwindstack::X86_64_REG_R11},
+          {"r12", unwindstack::X86_64_REG_R12}, {"r13", unwindstack::X86_64_REG_R13},
+          {"r14", unwindstack::X86_64_REG_R14}, {"r15", unwindstack::X86_64_REG_R15},
+          {"rdi", unwindstack::X86_64_REG_RDI}, {"rsi", unwindstack::X86_64_REG_RSI},
+          {"rbp", unwindstack::X86_64_REG_RBP}, {"rsp", unwindstack::X86_64_REG_RSP},
+          {"rip", unwindstack::X86_64_REG_RIP},
+      };
+      auto regs = std::make_unique<unwindstack::RegsX86_64>();
+      return SetRegs<uint64_t>(regs.get(), names, values) ? regs.release() : nullptr;
+    }
+    default:
+      return nullptr;
+  }
+}
+
+// All the memory in a snapshot: stacks, jit descriptors and entries, and
+// libraries that only exist in memory.
+std::shared_ptr<unwindstack::Memory> ReadMemory(const std::string& dir) {
+  DIR* dirp = opendir(dir.c_str());
+  if (dirp == nullptr) {
+    return nullptr;
+  }
+  std::vector<std::string> files;
+  dirent* entry;
+  while ((entry = readdir(dirp)) != nullptr) {
+    if (android::base::EndsWith(entry->d_name, ".data")) {
+      files.push_back(entry->d_name);
+    }
+  }
+  closedir(dirp);
+  if (files.empty()) {
+    return nullptr;
+  }
+  std::sort(files.begin(), files.end());
+
+  auto parts = std::make_shared<unwindstack::MemoryOfflineParts>();
+  for (const auto& file : files) {
+    auto memory = std::make_unique<unwindstack::MemoryOffline>();
+    if (!memory->Init(dir + file, 0)) {
+      return nullptr;
+    }
+    parts->Add(memory.release());
+  }
+  return parts;
+}
+
+enum Mode {
+  // Maps, and the elf objects in them, are kept from one unwind to the next.
+  MODE_WARM,
+  // Every unwind parses the maps again, and so starts with no elf objects.
+  MODE_COLD,
+  // As warm, with process memory read through a MemoryCache.
+  MODE_CACHED,
+};
+
+void BM_offline_unwind(benchmark::State& state, const std::string& dir,
+                       unwindstack::ArchEnum arch, Mode mode) {
+  std::string maps_data;
+  std::unique_ptr<unwindstack::Regs> regs(ReadRegs(dir, arch));
+  std::shared_ptr<unwindstack::Memory> offline_memory(ReadMemory(dir));
+  if (!android::base::ReadFileToString(dir + "maps.txt", &maps_data) || regs == nullptr ||
+      offline_memory == nullptr) {
+    state.SkipWithError(("Cannot read the snapshot in " + dir).c_str());
+    return;
+  }
+
+  // Libraries are found relative to the snapshot.
+  std::string cwd;
+  {
+    char* cur = getcwd(nullptr, 0);
+    cwd = cur;
+    free(cur);
+  }
+  if (chdir(dir.c_str()) != 0) {
+    state.SkipWithError(("Cannot change to " + dir).c_str());
+    return;
+  }
+
+  // Counting happens below the cache, so cache_hit_rate is the share of reads
+  // that never got to the snapshot.
+  auto counting_memory = new CountingMemory(offline_memory);
+  std::shared_ptr<unwindstack::Memory> process_memory;
+  std::shared_ptr<CountingMemory> outer_memory;
+  if (mode == MODE_CACHED) {
+    outer_memory.reset(new CountingMemory(
+        std::shared_ptr<unwindstack::Memory>(new unwindstack::MemoryCache(counting_memory)),
+        counting_memory));
+    process_memory = outer_memory;
+  } else {
+    process_memory.reset(counting_memory);
+  }
+
+  std::unique_ptr<unwindstack::Maps> maps;
+  std::unique_ptr<unwindstack::JitDebug> jit_debug;
+  auto init = [&]() {
+    maps.reset(new unwindstack::BufferMaps(maps_data.c_str()));
+    jit_debug.reset(new unwindstack::JitDebug(process_memory));
+    return maps->Parse();
+  };
+  if (!init()) {
+    state.SkipWithError(("Cannot parse the maps in " + dir).c_str());
+    chdir(cwd.c_str());
+    return;
+  }
+
+  auto unwind = [&]() {
+    std::unique_ptr<unwindstack::Regs> unwind_regs(regs->Clone());
+    unwindstack::Unwinder unwinder(128, maps.get(), unwind_regs.get(), process_memory);
+    unwinder.SetJitDebug(jit_debug.get(), unwind_regs->Arch());
+    unwinder.Unwind();
+    return unwinder.NumFrames();
+  };
+
+  // One unwind outside of the timing loop, for the warm modes to be warm.
+  size_t expected_frames = unwind();
+  if (expected_frames <= 1) {
+    state.SkipWithError(("Unwinding " + dir + " gives no frames").c_str());
+    chdir(cwd.c_str());
+    return;
+  }
+
+  size_t frames = 0;
+  size_t allocs = 0;
+  size_t reads_before = counting_memory->reads();
+  size_t outer_reads_before = outer_memory != nullptr ? outer_memory->reads() : 0;
+  size_t hits_before = outer_memory != nullptr ? outer_memory->hits() : 0;
+  for (auto _ : state) {
+    if (mode == MODE_COLD) {
+      state.PauseTiming();
+      init();
+      state.ResumeTiming();
+    }
+    size_t allocs_before = g_allocs.load(std::memory_order_relaxed);
+    size_t num_frames = unwind();
+    allocs += g_allocs.load(std::memory_order_relaxed) - allocs_before;
+    frames += num_frames;
+    if (num_frames != expected_frames) {
+      state.SkipWithError("Unwinds of the same snapshot gave different frames.");
+      break;
+    }
+  }
+  size_t reads = counting_memory->reads() - reads_before;
+
+  state.counters["frames"] = benchmark::Counter(frames, benchmark::Counter::kIsRate);
+  state.counters["frames_per_unwind"] =
+      benchmark::Counter(frames, benchmark::Counter::kAvgIterations);
+  state.counters["allocs_per_unwind"] =
+      benchmark::Counter(allocs, benchmark::Counter::kAvgIterations);
+  if (outer_memory != nullptr) {
+    size_t outer_reads = outer_memory->reads() - outer_reads_before;
+    state.counters["reads_per_unwind"] =
+        benchmark::Counter(outer_reads, benchmark::Counter::kAvgIterations);
+    size_t hits = outer_memory->hits() - hits_before;
+    state.counters["cache_hit_rate"] =
+        outer_reads == 0 ? 0 : static_cast<double>(hits) / outer_reads;
+  } else {
+    state.counters["reads_per_unwind"] =
+        benchmark::Counter(reads, benchmark::Counter::kAvgIterations);
+  }
+
+  chdir(cwd.c_str());
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  benchmark::Initialize(&argc, argv);
+
+  std::string offline_dir;
+  for (int i = 1; i < argc; i++) {
+    if (android::base::StartsWith(argv[i], "--offline_dir=")) {
+      offline_dir = std::string(argv[i] + strlen("--offline_dir=")) + '/';
+    } else {
+      fprintf(stderr, "Unknown argument: %s\n", argv[i]);
+      return 1;
+    }
+  }
+  if (offline_dir.empty()) {
+    offline_dir = android::base::GetExecutableDirectory() + "/tests/files/offline/";
+  }
+  if (offline_dir[0] != '/') {
+    char* cwd = getcwd(nullptr, 0);
+    offline_dir = std::string(cwd) + '/' + offline_dir;
+    free(cwd);
+  }
+
+  for (const auto& snapshot : kSnapshots) {
+    std::string dir = offline_dir + snapshot.dir + '/';
+    std::string name = std::string("BM_offline_") + snapshot.dir;
+    benchmark::RegisterBenchmark(name.c_str(), BM_offline_unwind, dir, snapshot.arch, MODE_WARM)
+        ->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark((name + "_cold").c_str(), BM_offline_unwind, dir, snapshot.arch,
+                                 MODE_COLD)
+        ->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark((name + "_cached").c_str(), BM_offline_unwind, dir,
+                                 snapshot.arch, MODE_CACHED)
+        ->Unit(benchmark::kMicrosecond);
+  }
+  benchmark::RunSpecifiedBenchmarks();
+  return 0;
+}
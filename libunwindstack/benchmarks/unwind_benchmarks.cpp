@@ -15,6 +15,7 @@
  */
 
 #include <stdint.h>
+#include <string.h>
 
 #include <memory>
 
@@ -26,9 +27,14 @@
 #include <unwindstack/Maps.h>
 #include <unwindstack/Memory.h>
 #include <unwindstack/Regs.h>
+#include <unwindstack/RegsArm.h>
 #include <unwindstack/RegsGetLocal.h>
 #include <unwindstack/Unwinder.h>
 
+#include "ArmExidx.h"
+#include "ElfInterfaceArm.h"
+#include "MemoryBuffer.h"
+
 size_t Call6(std::shared_ptr<unwindstack::Memory>& process_memory, unwindstack::Maps* maps) {
   std::unique_ptr<unwindstack::Regs> regs(unwindstack::Regs::CreateFromLocal());
   unwindstack::RegsGetLocal(regs.get());
@@ -142,4 +148,107 @@ static void BM_get_build_id_from_file(benchmark::State& state) {
 }
 BENCHMARK(BM_get_build_id_from_file);
 
+// An exidx table where every entry points at the same personality 1 extab
+// entry: vsp += 12, vpop {d0-d7}, pop {r4-r11, r14}, finish.
+static constexpr uint64_t kExidxOffset = 0x1000;
+static constexpr size_t kExidxEntries = 512;
+static constexpr uint64_t kExtabOffset = 0x8000;
+static constexpr uint32_t kFunctionStart = 0x100000;
+static constexpr uint32_t kFunctionSize = 0x40;
+static constexpr uint64_t kStackTop = 0x100;
+
+static void SetPrel31(unwindstack::MemoryBuffer* memory, uint64_t offset, uint64_t target) {
+  uint32_t value = static_cast<uint32_t>(target - offset) & 0x7fffffff;
+  memcpy(memory->GetPtr(offset), &value, sizeof(value));
+}
+
+static void InitArmExidx(unwindstack::MemoryBuffer* elf_memory,
+                         unwindstack::MemoryBuffer* process_memory) {
+  elf_memory->Resize(0x10000);
+  for (size_t i = 0; i < kExidxEntries; i++) {
+    uint64_t entry = kExidxOffset + i * 8;
+    SetPrel31(elf_memory, entry, kFunctionStart + i * kFunctionSize);
+    SetPrel31(elf_memory, entry + 4, kExtabOffset);
+  }
+  uint32_t extab[] = {0x810102c9, 0x87afb0b0};
+  memcpy(elf_memory->GetPtr(kExtabOffset), extab, sizeof(extab));
+
+  process_memory->Resize(0x1000);
+  for (size_t i = 0; i < 0x1000 / sizeof(uint32_t); i++) {
+    uint32_t value = 0x1000 + i;
+    memcpy(process_memory->GetPtr(i * sizeof(uint32_t)), &value, sizeof(value));
+  }
+}
+
+// What every step used to do: extract the entry and interpret its bytes.
+static void BM_arm_exidx_decode(benchmark::State& state) {
+  unwindstack::MemoryBuffer elf_memory;
+  unwindstack::MemoryBuffer process_memory;
+  InitArmExidx(&elf_memory, &process_memory);
+
+  unwindstack::RegsArm regs;
+  for (auto _ : state) {
+    unwindstack::ArmExidx arm(&regs, &elf_memory, &process_memory);
+    arm.set_cfa(kStackTop);
+    if (!arm.ExtractEntryData(kExidxOffset) || !arm.Eval()) {
+      state.SkipWithError("Failed to decode exidx entry.");
+      break;
+    }
+    benchmark::DoNotOptimize(arm.cfa());
+  }
+}
+BENCHMARK(BM_arm_exidx_decode);
+
+// Running an entry that has already been compiled.
+static void BM_arm_exidx_compiled(benchmark::State& state) {
+  unwindstack::MemoryBuffer elf_memory;
+  unwindstack::MemoryBuffer process_memory;
+  InitArmExidx(&elf_memory, &process_memory);
+
+  unwindstack::RegsArm regs;
+  unwindstack::ArmExidxProgram program;
+  unwindstack::ArmExidx compiler(&regs, &elf_memory, &process_memory);
+  if (!compiler.ExtractEntryData(kExidxOffset)) {
+    state.SkipWithError("Failed to extract exidx entry.");
+    return;
+  }
+  compiler.Compile(&program);
+
+  for (auto _ : state) {
+    unwindstack::ArmExidx arm(&regs, &elf_memory, &process_memory);
+    arm.set_cfa(kStackTop);
+    if (!arm.Eval(program)) {
+      state.SkipWithError("Failed to evaluate exidx program.");
+      break;
+    }
+    benchmark::DoNotOptimize(arm.cfa());
+  }
+}
+BENCHMARK(BM_arm_exidx_compiled);
+
+// A full step, including the entry lookup, cycling through the table.
+static void BM_arm_exidx_step(benchmark::State& state) {
+  unwindstack::MemoryBuffer elf_memory;
+  unwindstack::MemoryBuffer process_memory;
+  InitArmExidx(&elf_memory, &process_memory);
+
+  unwindstack::ElfInterfaceArm interface(&elf_memory);
+  interface.HandleUnknownType(0x70000001 /* PT_ARM_EXIDX */, kExidxOffset,
+                              kExidxEntries * 8);
+
+  unwindstack::RegsArm regs;
+  size_t entry = 0;
+  for (auto _ : state) {
+    regs.set_sp(kStackTop);
+    bool finished;
+    uint64_t pc = kFunctionStart + entry * kFunctionSize + 4;
+    if (!interface.StepExidx(pc, &regs, &process_memory, &finished)) {
+      state.SkipWithError("Failed to step through exidx entry.");
+      break;
+    }
+    entry = (entry + 1) % kExidxEntries;
+  }
+}
+BENCHMARK(BM_arm_exidx_step);
+
 BENCHMARK_MAIN();
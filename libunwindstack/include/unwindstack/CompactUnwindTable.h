@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_COMPACT_UNWIND_TABLE_H
+#define _LIBUNWINDSTACK_COMPACT_UNWIND_TABLE_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <unwindstack/DwarfLocation.h>
+#include <unwindstack/DwarfStructs.h>
+
+namespace android {
+namespace base {
+class MappedFile;
+}  // namespace base
+}  // namespace android
+
+namespace unwindstack {
+
+// Forward declarations.
+class DwarfSection;
+
+// Every row of CFA rules of a DwarfSection, worked out ahead of time and
+// laid out as a flat array sorted by pc. Looking up a pc is a binary search,
+// with no FDE to find and no CFA instructions to run.
+//
+// The rules are kept exactly as DWARF evaluation produces them, so
+// unwinding through a table gives the same result as unwinding through
+// the section. Identical sets of rules, which most rows of most functions
+// are, are only stored once.
+//
+// Working a table out means running the CFA instructions of every FDE, so
+// tables are written to a cache directory, named by build id, and mapped
+// from there by later runs. The sorted symbol tables of the same elf files
+// are kept there too, see Symbols.
+class CompactUnwindTable {
+ public:
+  ~CompactUnwindTable();
+
+  // Sections of elf files with a build id that are created from now on use
+  // tables kept in |cache_dir|. An empty |cache_dir| turns tables off.
+  static void SetCacheDir(const std::string& cache_dir);
+  static bool Enabled();
+
+  // Returns the file in the cache directory for the section at
+  // |section_offset| in the elf file with |build_id|, ending in |extension|.
+  // Returns an empty string if there is no cache directory or no build id.
+  static std::string CachePath(const std::string& build_id, uint64_t section_offset,
+                               const char* extension);
+
+  // Returns the table of |section|, which is at |section_offset| in the elf
+  // file with |build_id|, from the cache directory. If it isn't there, it is
+  // created and added to it. Returns nullptr if there is no build id or no
+  // table could be created.
+  static std::unique_ptr<CompactUnwindTable> Get(DwarfSection* section,
+                                                 const std::string& build_id,
+                                                 uint64_t section_offset);
+
+  static std::unique_ptr<CompactUnwindTable> Create(DwarfSection* section);
+
+  // Returns nullptr if |path| doesn't hold a valid table.
+  static std::unique_ptr<CompactUnwindTable> Load(const std::string& path);
+
+  bool Save(const std::string& path) const;
+
+  // Fills in the rules for |pc|, including the range of pcs they cover and
+  // the CIE that gives the return address register. The CIE belongs to the
+  // table. Returns false if the table has nothing for |pc|.
+  bool GetLocRegs(uint64_t pc, dwarf_loc_regs_t* loc_regs) const;
+
+  size_t NumRows() const { return num_rows_; }
+
+ private:
+  // A table is a Header, the return address register of each CIE as a
+  // uint64_t, the Rows and then the Locs, the same in memory and on disk.
+  struct Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t num_cies;
+    uint32_t num_rows;
+    uint32_t num_locs;
+    uint32_t reserved;
+  };
+  struct Row {
+    uint64_t pc_start;
+    uint64_t pc_end;
+    uint32_t first_loc;
+    uint16_t num_locs;
+    uint16_t cie_index;
+  };
+  struct Loc {
+    uint32_t reg;
+    uint32_t type;
+    uint64_t values[2];
+  };
+
+  CompactUnwindTable() = default;
+
+  bool Init(const uint8_t* data, size_t size);
+
+  // Set for tables that were created rather than loaded.
+  std::vector<uint8_t> buffer_;
+  std::unique_ptr<android::base::MappedFile> mapped_file_;
+
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  const Row* rows_ = nullptr;
+  size_t num_rows_ = 0;
+  const Loc* locs_ = nullptr;
+  // Only the return address register is used when evaluating.
+  std::vector<DwarfCie> cies_;
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_COMPACT_UNWIND_TABLE_H
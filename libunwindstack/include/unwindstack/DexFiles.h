@@ -50,15 +50,17 @@ class DexFiles : public Global {
  private:
   void Init(Maps* maps);
 
+  void Update();
+
   bool GetAddr(size_t index, uint64_t* addr);
 
   uint64_t ReadEntryPtr32(uint64_t addr);
 
   uint64_t ReadEntryPtr64(uint64_t addr);
 
-  bool ReadEntry32();
+  bool ReadEntry32(uint64_t addr, uint64_t* next, uint64_t* dex_file);
 
-  bool ReadEntry64();
+  bool ReadEntry64(uint64_t addr, uint64_t* next, uint64_t* dex_file);
 
   bool ReadVariableData(uint64_t ptr_offset) override;
 
@@ -68,10 +70,18 @@ class DexFiles : public Global {
   bool initialized_ = false;
   std::unordered_map<uint64_t, std::unique_ptr<DexFile>> files_;
 
+  struct DexEntry {
+    uint64_t entry;
+    uint64_t dex_file;
+  };
+
+  // The next entry of the list to read.
   uint64_t entry_addr_ = 0;
+  // Entries added to the list after it was first read, still to be read.
+  std::vector<uint64_t> added_entries_;
   uint64_t (DexFiles::*read_entry_ptr_func_)(uint64_t) = nullptr;
-  bool (DexFiles::*read_entry_func_)() = nullptr;
-  std::vector<uint64_t> addrs_;
+  bool (DexFiles::*read_entry_func_)(uint64_t, uint64_t*, uint64_t*) = nullptr;
+  std::vector<DexEntry> entries_;
 };
 
 }  // namespace unwindstack
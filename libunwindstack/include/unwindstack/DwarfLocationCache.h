@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBUNWINDSTACK_DWARF_LOCATION_CACHE_H
+#define _LIBUNWINDSTACK_DWARF_LOCATION_CACHE_H
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+#include <unwindstack/DwarfLocation.h>
+#include <unwindstack/DwarfStructs.h>
+
+namespace unwindstack {
+
+// A process wide cache of the register locations that a DwarfSection works
+// out for a range of pcs. Each DwarfSection already keeps the rows it has
+// evaluated, but that only helps the unwinders that share its Elf object.
+// With this cache enabled, every section of an elf file with a build id
+// looks here before evaluating any DWARF, so a library is only evaluated
+// once per pc range however many maps, processes or unwinders it is seen
+// through.
+//
+// Rows are spread over shards by section, and lookups only take a shard's
+// lock for reading. A shard that fills up is emptied and starts over.
+class DwarfLocationCache {
+ public:
+  struct Row {
+    Row() = default;
+    Row(const Row&) = delete;
+    Row& operator=(const Row&) = delete;
+
+    // The copy of the CIE that loc_regs.cie points to, so the row doesn't
+    // depend on the section that added it still being around.
+    DwarfCie cie;
+    dwarf_loc_regs_t loc_regs;
+  };
+
+  // Sections created while the cache is disabled never use it.
+  static void SetEnabled(bool enable);
+  static bool Enabled();
+
+  // Returns the key of the section at |section_offset| in the elf file with
+  // |build_id|, or 0, which is never used, if there is no build id.
+  static uint64_t Key(const std::string& build_id, uint64_t section_offset);
+
+  // Returns the row of the section with |key| that covers |pc|, or nullptr.
+  static std::shared_ptr<const Row> Find(uint64_t key, uint64_t pc);
+
+  // Adds |loc_regs|, which were worked out using |cie|, to the rows of the
+  // section with |key|.
+  static void Add(uint64_t key, const DwarfCie& cie, const dwarf_loc_regs_t& loc_regs);
+
+  static void Clear();
+};
+
+}  // namespace unwindstack
+
+#endif  // _LIBUNWINDSTACK_DWARF_LOCATION_CACHE_H
@@ -21,8 +21,10 @@
 
 #include <iterator>
 #include <map>
+#include <memory>
 #include <unordered_map>
 
+#include <unwindstack/CompactUnwindTable.h>
 #include <unwindstack/DwarfError.h>
 #include <unwindstack/DwarfLocation.h>
 #include <unwindstack/DwarfMemory.h>
@@ -33,13 +35,14 @@ namespace unwindstack {
 // Forward declarations.
 class Memory;
 class Regs;
+struct DwarfOpProgram;
 template <typename AddressType>
 struct RegsInfo;
 
 class DwarfSection {
  public:
   DwarfSection(Memory* memory);
-  virtual ~DwarfSection() = default;
+  virtual ~DwarfSection();
 
   class iterator : public std::iterator<std::bidirectional_iterator_tag, DwarfFde*> {
    public:
@@ -106,6 +109,14 @@ class DwarfSection {
 
   bool Step(uint64_t pc, Regs* regs, Memory* process_memory, bool* finished);
 
+  // Shares the locations worked out by Step through the DwarfLocationCache under |key|.
+  void SetLocationCacheKey(uint64_t key) { location_cache_key_ = key; }
+
+  // Has Step look pcs up in |table| before evaluating any DWARF.
+  void SetCompactTable(std::unique_ptr<CompactUnwindTable> table) {
+    compact_table_ = std::move(table);
+  }
+
  protected:
   DwarfMemory memory_;
   DwarfErrorData last_error_{DWARF_ERROR_NONE, 0};
@@ -117,6 +128,10 @@ class DwarfSection {
   std::unordered_map<uint64_t, DwarfCie> cie_entries_;
   std::unordered_map<uint64_t, dwarf_loc_regs_t> cie_loc_regs_;
   std::map<uint64_t, dwarf_loc_regs_t> loc_regs_;  // Single row indexed by pc_end.
+  // Expressions used by the rows above, indexed by end offset.
+  std::unordered_map<uint64_t, std::unique_ptr<DwarfOpProgram>> expressions_;
+  uint64_t location_cache_key_ = 0;
+  std::unique_ptr<CompactUnwindTable> compact_table_;
 };
 
 template <typename AddressType>
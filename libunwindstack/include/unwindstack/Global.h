@@ -52,10 +52,56 @@ class Global {
 
   virtual void ProcessArch() = 0;
 
+  // The fields of a JIT or dex descriptor. ART follows the standard ones with
+  // a seqlock, which is odd while the list of entries is being changed, and
+  // the time of the last change. It also gives every entry the time it was
+  // registered. Together they let a list be kept up to date without reading
+  // all of it again.
+  struct Descriptor {
+    uint32_t version;
+    uint32_t action_flag;
+    uint64_t relevant_entry;
+    uint64_t first_entry;
+    // Set if the descriptor has the ART fields.
+    bool has_seqlock;
+    uint32_t action_seqlock;
+    uint64_t action_timestamp;
+  };
+  bool ReadDescriptor(uint64_t addr, Descriptor* descriptor);
+
+  // Starts following the changes to the list of the descriptor at |addr|,
+  // from the state in |descriptor|. Does nothing if it doesn't have the ART
+  // fields.
+  void FollowChanges(uint64_t addr, const Descriptor& descriptor);
+
+  // Reads the time the entry at |addr| was registered. Returns false if the
+  // changes to the list aren't being followed.
+  bool ReadEntryTimestamp(uint64_t addr, uint64_t* timestamp);
+
+  enum ListChange : uint8_t {
+    // Nothing changed, or the changes can't be read right now.
+    LIST_UNCHANGED = 0,
+    // The entries in |added|, newest first, were added and the one in
+    // |removed|, if not zero, was removed.
+    LIST_CHANGED,
+    // It isn't known what changed, so the whole list has to be read again.
+    LIST_RELOAD,
+  };
+  // Unless nothing changed, |first_entry| is set to the head of the list.
+  ListChange ReadChanges(std::vector<uint64_t>* added, uint64_t* removed, uint64_t* first_entry);
+
   ArchEnum arch_ = ARCH_UNKNOWN;
 
   std::shared_ptr<Memory> memory_;
   std::vector<std::string> search_libs_;
+
+ private:
+  bool ReadEntryLink(uint64_t addr, uint64_t* next, uint64_t* timestamp);
+
+  // Zero unless the changes to a descriptor are being followed.
+  uint64_t descriptor_addr_ = 0;
+  uint32_t action_seqlock_ = 0;
+  uint64_t action_timestamp_ = 0;
 };
 
 }  // namespace unwindstack
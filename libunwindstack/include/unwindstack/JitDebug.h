@@ -22,6 +22,7 @@
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include <unwindstack/Global.h>
@@ -44,24 +45,39 @@ class JitDebug : public Global {
 
  private:
   void Init(Maps* maps);
+  void Update();
 
-  uint64_t (JitDebug::*read_descriptor_func_)(uint64_t) = nullptr;
-  uint64_t (JitDebug::*read_entry_func_)(uint64_t*, uint64_t*) = nullptr;
+  Elf* AddElf(uint64_t entry, uint64_t start, uint64_t size);
+  void RemoveElf(uint64_t entry);
 
-  uint64_t ReadDescriptor32(uint64_t);
-  uint64_t ReadDescriptor64(uint64_t);
+  bool (JitDebug::*read_entry_func_)(uint64_t, uint64_t*, uint64_t*, uint64_t*) = nullptr;
 
-  uint64_t ReadEntry32Pack(uint64_t* start, uint64_t* size);
-  uint64_t ReadEntry32Pad(uint64_t* start, uint64_t* size);
-  uint64_t ReadEntry64(uint64_t* start, uint64_t* size);
+  bool ReadEntry32Pack(uint64_t addr, uint64_t* next, uint64_t* start, uint64_t* size);
+  bool ReadEntry32Pad(uint64_t addr, uint64_t* next, uint64_t* start, uint64_t* size);
+  bool ReadEntry64(uint64_t addr, uint64_t* next, uint64_t* start, uint64_t* size);
 
   bool ReadVariableData(uint64_t ptr_offset) override;
 
   void ProcessArch() override;
 
+  struct JitElf {
+    uint64_t entry;
+    // When the entry was registered, zero if the list isn't being followed.
+    uint64_t timestamp;
+    Elf* elf;
+  };
+
+  // The next entry of the list to read.
   uint64_t entry_addr_ = 0;
+  // Entries added to the list after it was first read, still to be read.
+  std::vector<uint64_t> added_entries_;
   bool initialized_ = false;
-  std::vector<Elf*> elf_list_;
+  std::vector<JitElf> elf_list_;
+  // The elf objects of entries that were removed, or of a list that is being
+  // read again, by entry. Another unwind may still be using them, so they
+  // are only deleted with this object. Entries that are found again when the
+  // list is read get theirs back.
+  std::unordered_multimap<uint64_t, JitElf> old_elfs_;
 
   std::mutex lock_;
 };
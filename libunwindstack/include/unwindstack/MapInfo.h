@@ -97,6 +97,11 @@ struct MapInfo {
 
   uint64_t GetLoadBias(const std::shared_ptr<Memory>& process_memory);
 
+  // Takes the elf object of other, the same map in an earlier parse of the
+  // maps, if it has been created, so that it isn't read again. Must be called
+  // before this map is used.
+  void ShareElf(MapInfo* other);
+
   Memory* CreateMemory(const std::shared_ptr<Memory>& process_memory);
 
   bool GetFunctionName(uint64_t addr, std::string* name, uint64_t* func_offset);
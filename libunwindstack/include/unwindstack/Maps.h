@@ -76,7 +76,19 @@ class Maps {
   }
 
  protected:
+  // Adds a map for each line of |content|, which is modified.
+  bool ParseContent(char* content);
+
+  // Must be called after maps_ changes, for Find to stay fast.
+  void UpdateIndex();
+
   std::vector<std::unique_ptr<MapInfo>> maps_;
+  // The end of each map, in the same order as maps_. Searched by Find so that
+  // only the map found is ever touched.
+  std::vector<uint64_t> map_ends_;
+  // The contents of the last maps file read, kept so that its memory is
+  // reused by the next parse.
+  std::string content_;
 };
 
 class RemoteMaps : public Maps {
@@ -101,6 +113,8 @@ class LocalUpdatableMaps : public Maps {
   LocalUpdatableMaps() : Maps() {}
   virtual ~LocalUpdatableMaps() = default;
 
+  // Reads the maps again. Maps that haven't changed are kept, along with
+  // their elf objects, and only new maps are created.
   bool Reparse();
 
   const std::string GetMapsFile() const override;
@@ -45,6 +45,11 @@ class Memory {
 
   bool ReadFully(uint64_t addr, void* dst, size_t size);
 
+  // Reads |count| blocks of |size| bytes each, the i-th from addrs[i] into
+  // dsts[i]. Returns how many blocks, from the first, were read fully.
+  // Implementations that can read many blocks in one go override this.
+  virtual size_t ReadBlocks(const uint64_t* addrs, void* const* dsts, size_t size, size_t count);
+
   inline bool Read32(uint64_t addr, uint32_t* dst) {
     return ReadFully(addr, dst, sizeof(uint32_t));
   }
@@ -61,6 +61,17 @@ struct FrameData {
   int map_flags = 0;
 };
 
+// One thread to unwind with Unwinder::UnwindThreads, and the result.
+struct ThreadUnwind {
+  pid_t tid = 0;
+  // The registers to start from, which are left unchanged.
+  Regs* regs = nullptr;
+
+  std::vector<FrameData> frames;
+  ErrorData error = {ERROR_NONE, 0};
+  bool elf_from_memory_not_file = false;
+};
+
 class Unwinder {
  public:
   Unwinder(size_t max_frames, Maps* maps, Regs* regs, std::shared_ptr<Memory> process_memory)
@@ -87,6 +98,13 @@ class Unwinder {
     return frames;
   }
 
+  // Unwinds every thread in |threads|, all from process |pid|, on up to
+  // |num_workers| threads including the calling one. The threads share the
+  // maps, elf files, jit and dex information and settings of this unwinder,
+  // and each reads |pid|'s memory through a cache of its own. The frames of
+  // this unwinder are not changed.
+  void UnwindThreads(pid_t pid, std::vector<ThreadUnwind>* threads, size_t num_workers);
+
   std::string FormatFrame(size_t frame_num) const;
   std::string FormatFrame(const FrameData& frame) const;
 
@@ -20,6 +20,7 @@
 #include <ios>
 #include <memory>
 #include <string>
+#include <vector>
 
 #include <gtest/gtest.h>
 
@@ -1662,6 +1663,69 @@ TEST_P(ArmExidxDecodeTest, eval_pc_set) {
   ASSERT_EQ(0x10U, (*exidx_->regs())[15]);
 }
 
+TEST_P(ArmExidxDecodeTest, compile_matches_decode) {
+  // The compiled form is only used when nothing is being logged.
+  if (log_ != ARM_LOG_NONE) {
+    return;
+  }
+
+  // Some pops read from here, others move the cfa off the end of it.
+  for (size_t i = 0; i < 0x100; i++) {
+    process_memory_.SetData32(0x10000 + i * 4, 0x10000 + i * 8);
+  }
+
+  struct State {
+    bool return_value;
+    ArmStatus status;
+    uint64_t status_address;
+    uint32_t cfa;
+    bool pc_set;
+    std::vector<uint32_t> regs;
+  };
+  auto run = [this](uint8_t first, uint8_t second, bool compiled) {
+    ResetExidx();
+    for (size_t reg = 0; reg < regs_arm_->total_regs(); reg++) {
+      (*regs_arm_)[reg] = 0x10000 + reg * 12;
+    }
+    data_->push_back(first);
+    data_->push_back(second);
+    data_->push_back(0xb0);
+
+    State state;
+    if (compiled) {
+      ArmExidxProgram program;
+      exidx_->Compile(&program);
+      state.return_value = exidx_->Eval(program);
+    } else {
+      state.return_value = exidx_->Eval();
+    }
+    state.status = exidx_->status();
+    state.status_address = exidx_->status_address();
+    state.cfa = exidx_->cfa();
+    state.pc_set = exidx_->pc_set();
+    for (size_t reg = 0; reg < regs_arm_->total_regs(); reg++) {
+      state.regs.push_back((*regs_arm_)[reg]);
+    }
+    return state;
+  };
+
+  for (size_t first = 0; first < 0x100; first++) {
+    for (size_t second = 0; second < 0x100; second++) {
+      SCOPED_TRACE(::testing::Message() << std::hex << "0x" << first << " 0x" << second);
+      State expected = run(first, second, false);
+      State actual = run(first, second, true);
+      ASSERT_EQ(expected.return_value, actual.return_value);
+      ASSERT_EQ(expected.status, actual.status);
+      if (expected.status == ARM_STATUS_READ_FAILED) {
+        ASSERT_EQ(expected.status_address, actual.status_address);
+      }
+      ASSERT_EQ(expected.cfa, actual.cfa);
+      ASSERT_EQ(expected.pc_set, actual.pc_set);
+      ASSERT_EQ(expected.regs, actual.regs);
+    }
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(Unwindstack, ArmExidxDecodeTest,
                          ::testing::Values("logging", "register_logging", "no_logging"));
 
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include <android-base/file.h>
+#include <android-base/stringprintf.h>
+#include <gtest/gtest.h>
+
+#include <unwindstack/CompactUnwindTable.h>
+#include <unwindstack/DwarfSection.h>
+#include <unwindstack/Elf.h>
+#include <unwindstack/Memory.h>
+
+#include "ElfTestUtils.h"
+
+namespace unwindstack {
+
+class CompactUnwindTableTest : public ::testing::Test {
+ protected:
+  void TearDown() override { CompactUnwindTable::SetCacheDir(""); }
+
+  void InitElf(const char* name) {
+    elf_.reset(new Elf(
+        Memory::CreateFileMemory(TestGetFileDirectory() + "offline/" + name, 0).release()));
+    ASSERT_TRUE(elf_->Init());
+  }
+
+  // Checks that |table| gives the same rules as evaluating |section| does, for every pc.
+  static void VerifyTable(DwarfSection* section, const CompactUnwindTable& table) {
+    size_t pcs = 0;
+    for (const DwarfFde* fde : *section) {
+      for (uint64_t pc = fde->pc_start; pc < fde->pc_end; pc++, pcs++) {
+        dwarf_loc_regs_t expected;
+        ASSERT_TRUE(section->GetCfaLocationInfo(pc, fde, &expected));
+        dwarf_loc_regs_t actual;
+        ASSERT_TRUE(table.GetLocRegs(pc, &actual)) << "No row for pc 0x" << std::hex << pc;
+        ASSERT_LE(actual.pc_start, pc);
+        ASSERT_LT(pc, actual.pc_end);
+        ASSERT_EQ(fde->cie->return_address_register, actual.cie->return_address_register);
+        ASSERT_EQ(expected.size(), actual.size()) << "pc 0x" << std::hex << pc;
+        for (const auto& entry : expected) {
+          auto actual_entry = actual.find(entry.first);
+          ASSERT_TRUE(actual_entry != actual.end()) << "pc 0x" << std::hex << pc;
+          ASSERT_EQ(entry.second.type, actual_entry->second.type);
+          ASSERT_EQ(entry.second.values[0], actual_entry->second.values[0]);
+          ASSERT_EQ(entry.second.values[1], actual_entry->second.values[1]);
+        }
+      }
+    }
+    ASSERT_NE(0U, pcs);
+  }
+
+  std::unique_ptr<Elf> elf_;
+};
+
+TEST_F(CompactUnwindTableTest, create_eh_frame) {
+  ASSERT_NO_FATAL_FAILURE(InitElf("eh_frame_hdr_begin_x86_64/unwind_test64"));
+  DwarfSection* section = elf_->interface()->eh_frame();
+  ASSERT_TRUE(section != nullptr);
+
+  std::unique_ptr<CompactUnwindTable> table(CompactUnwindTable::Create(section));
+  ASSERT_TRUE(table != nullptr);
+  ASSERT_NE(0U, table->NumRows());
+  VerifyTable(section, *table);
+
+  dwarf_loc_regs_t loc_regs;
+  EXPECT_FALSE(table->GetLocRegs(0, &loc_regs));
+  EXPECT_FALSE(table->GetLocRegs(UINT64_MAX, &loc_regs));
+}
+
+TEST_F(CompactUnwindTableTest, create_debug_frame) {
+  ASSERT_NO_FATAL_FAILURE(InitElf("debug_frame_first_x86/waiter"));
+  DwarfSection* section = elf_->interface()->debug_frame();
+  ASSERT_TRUE(section != nullptr);
+
+  std::unique_ptr<CompactUnwindTable> table(CompactUnwindTable::Create(section));
+  ASSERT_TRUE(table != nullptr);
+  VerifyTable(section, *table);
+}
+
+TEST_F(CompactUnwindTableTest, save_load) {
+  ASSERT_NO_FATAL_FAILURE(InitElf("eh_frame_hdr_begin_x86_64/unwind_test64"));
+  DwarfSection* section = elf_->interface()->eh_frame();
+  ASSERT_TRUE(section != nullptr);
+  std::unique_ptr<CompactUnwindTable> table(CompactUnwindTable::Create(section));
+  ASSERT_TRUE(table != nullptr);
+
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/table";
+  ASSERT_TRUE(table->Save(path));
+
+  std::unique_ptr<CompactUnwindTable> loaded(CompactUnwindTable::Load(path));
+  ASSERT_TRUE(loaded != nullptr);
+  ASSERT_EQ(table->NumRows(), loaded->NumRows());
+  VerifyTable(section, *loaded);
+}
+
+TEST_F(CompactUnwindTableTest, load_invalid) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/table";
+  ASSERT_TRUE(CompactUnwindTable::Load(path) == nullptr);
+
+  ASSERT_TRUE(android::base::WriteStringToFile("not a table", path));
+  ASSERT_TRUE(CompactUnwindTable::Load(path) == nullptr);
+
+  ASSERT_NO_FATAL_FAILURE(InitElf("eh_frame_hdr_begin_x86_64/unwind_test64"));
+  std::unique_ptr<CompactUnwindTable> table(
+      CompactUnwindTable::Create(elf_->interface()->eh_frame()));
+  ASSERT_TRUE(table != nullptr);
+  ASSERT_TRUE(table->Save(path));
+  std::string data;
+  ASSERT_TRUE(android::base::ReadFileToString(path, &data));
+
+  // Truncated.
+  ASSERT_TRUE(android::base::WriteStringToFile(data.substr(0, data.size() - 1), path));
+  ASSERT_TRUE(CompactUnwindTable::Load(path) == nullptr);
+
+  // Bad version.
+  std::string bad_data(data);
+  bad_data[4]++;
+  ASSERT_TRUE(android::base::WriteStringToFile(bad_data, path));
+  ASSERT_TRUE(CompactUnwindTable::Load(path) == nullptr);
+
+  // A row that starts where it ends. The first row follows the 24 byte
+  // header and the 8 byte return address register of the only cie.
+  bad_data = data;
+  ASSERT_EQ(1, bad_data[8]);
+  bad_data.replace(40, 8, bad_data, 32, 8);
+  ASSERT_TRUE(android::base::WriteStringToFile(bad_data, path));
+  ASSERT_TRUE(CompactUnwindTable::Load(path) == nullptr);
+
+  ASSERT_TRUE(android::base::WriteStringToFile(data, path));
+  ASSERT_TRUE(CompactUnwindTable::Load(path) != nullptr);
+}
+
+TEST_F(CompactUnwindTableTest, get) {
+  ASSERT_NO_FATAL_FAILURE(InitElf("eh_frame_hdr_begin_x86_64/unwind_test64"));
+  DwarfSection* section = elf_->interface()->eh_frame();
+  ASSERT_TRUE(section != nullptr);
+
+  ASSERT_FALSE(CompactUnwindTable::Enabled());
+  ASSERT_TRUE(CompactUnwindTable::Get(section, "build_id", 0x10) == nullptr);
+
+  TemporaryDir dir;
+  CompactUnwindTable::SetCacheDir(dir.path);
+  ASSERT_TRUE(CompactUnwindTable::Enabled());
+  ASSERT_TRUE(CompactUnwindTable::Get(section, "", 0x10) == nullptr);
+
+  std::unique_ptr<CompactUnwindTable> table(CompactUnwindTable::Get(section, "build_id", 0x10));
+  ASSERT_TRUE(table != nullptr);
+  VerifyTable(section, *table);
+
+  std::string path = std::string(dir.path) + "/6275696c645f6964_10.unwind";
+  std::unique_ptr<CompactUnwindTable> loaded(CompactUnwindTable::Load(path));
+  ASSERT_TRUE(loaded != nullptr);
+  ASSERT_EQ(table->NumRows(), loaded->NumRows());
+
+  // A table that can't be loaded is replaced.
+  ASSERT_TRUE(android::base::WriteStringToFile("not a table", path));
+  table = CompactUnwindTable::Get(section, "build_id", 0x10);
+  ASSERT_TRUE(table != nullptr);
+  ASSERT_TRUE(CompactUnwindTable::Load(path) != nullptr);
+}
+
+TEST_F(CompactUnwindTableTest, elf_init) {
+  TemporaryDir dir;
+  CompactUnwindTable::SetCacheDir(dir.path);
+  ASSERT_NO_FATAL_FAILURE(InitElf("eh_frame_bias_x86/tombstoned"));
+
+  std::string path = std::string(dir.path) + '/';
+  for (const char& c : elf_->GetBuildID()) {
+    path += android::base::StringPrintf("%02hhx", c);
+  }
+  path += android::base::StringPrintf("_%" PRIx64 ".unwind", elf_->interface()->eh_frame_offset());
+  struct stat st;
+  ASSERT_EQ(0, stat(path.c_str(), &st));
+}
+
+}  // namespace unwindstack
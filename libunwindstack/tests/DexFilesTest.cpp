@@ -104,6 +104,10 @@ class DexFilesTest : public ::testing::Test {
   void WriteEntry32(uint64_t entry_addr, uint32_t next, uint32_t prev, uint32_t dex_file);
   void WriteEntry64(uint64_t entry_addr, uint64_t next, uint64_t prev, uint64_t dex_file);
   void WriteDex(uint64_t dex_file);
+  void WriteAndroidDescriptor32(uint64_t addr, uint32_t head, uint32_t seqlock,
+                                uint64_t timestamp);
+  void WriteAndroidEntry32(uint64_t entry_addr, uint32_t next, uint32_t prev, uint32_t dex_file,
+                           uint64_t timestamp);
 
   static constexpr size_t kMapGlobalNonReadable = 2;
   static constexpr size_t kMapGlobalSetToZero = 3;
@@ -156,6 +160,43 @@ void DexFilesTest::WriteDex(uint64_t dex_file) {
   memory_->SetMemory(dex_file, kDexData, sizeof(kDexData) * sizeof(uint32_t));
 }
 
+void DexFilesTest::WriteAndroidDescriptor32(uint64_t addr, uint32_t head, uint32_t seqlock,
+                                            uint64_t timestamp) {
+  // Format of the 32 bit JITDescriptor structure:
+  //   uint32_t version
+  memory_->SetData32(addr, 1);
+  //   uint32_t action_flag
+  memory_->SetData32(addr + 4, 1);
+  //   uint32_t relevant_entry
+  memory_->SetData32(addr + 8, head);
+  //   uint32_t first_entry
+  memory_->SetData32(addr + 12, head);
+  //   uint8_t magic[8]
+  memory_->SetMemory(addr + 16, std::vector<uint8_t>{'A', 'n', 'd', 'r', 'o', 'i', 'd', '1'});
+  //   uint32_t flags
+  memory_->SetData32(addr + 24, 0);
+  //   uint32_t sizeof_descriptor
+  memory_->SetData32(addr + 28, 48);
+  //   uint32_t sizeof_entry
+  memory_->SetData32(addr + 32, 32);
+  //   uint32_t action_seqlock
+  memory_->SetData32(addr + 36, seqlock);
+  //   uint64_t action_timestamp
+  memory_->SetData64(addr + 40, timestamp);
+}
+
+void DexFilesTest::WriteAndroidEntry32(uint64_t entry_addr, uint32_t next, uint32_t prev,
+                                       uint32_t dex_file, uint64_t timestamp) {
+  WriteEntry32(entry_addr, next, prev, dex_file);
+  // The rest of the 32 bit JITCodeEntry structure:
+  //   uint32_t pad
+  memory_->SetData32(entry_addr + 12, 0);
+  //   uint64_t symfile_size
+  memory_->SetData64(entry_addr + 16, 0);
+  //   uint64_t register_timestamp
+  memory_->SetData64(entry_addr + 24, timestamp);
+}
+
 TEST_F(DexFilesTest, get_method_information_invalid) {
   std::string method_name = "nothing";
   uint64_t method_offset = 0x124;
@@ -353,4 +394,26 @@ TEST_F(DexFilesTest, get_method_information_with_empty_map) {
   EXPECT_EQ(0U, method_offset);
 }
 
+TEST_F(DexFilesTest, get_method_information_android_added) {
+  std::string method_name = "nothing";
+  uint64_t method_offset = 0x124;
+  MapInfo* info = maps_->Get(kMapDexFiles);
+
+  WriteAndroidDescriptor32(0x100800, 0x200000, 2, 10);
+  WriteAndroidEntry32(0x200000, 0, 0, 0x100000, 10);
+  WriteDex(0x300000);
+
+  dex_files_->GetMethodInformation(maps_.get(), info, 0x300100, &method_name, &method_offset);
+  EXPECT_EQ("nothing", method_name);
+  EXPECT_EQ(0x124U, method_offset);
+
+  // Register the dex file at the head of the list.
+  WriteAndroidEntry32(0x200100, 0x200000, 0, 0x300000, 20);
+  WriteAndroidDescriptor32(0x100800, 0x200100, 4, 20);
+
+  dex_files_->GetMethodInformation(maps_.get(), info, 0x300100, &method_name, &method_offset);
+  EXPECT_EQ("Main.<init>", method_name);
+  EXPECT_EQ(0U, method_offset);
+}
+
 }  // namespace unwindstack
@@ -0,0 +1,140 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <unwindstack/DwarfLocationCache.h>
+
+namespace unwindstack {
+
+class DwarfLocationCacheTest : public ::testing::Test {
+ protected:
+  void SetUp() override { DwarfLocationCache::SetEnabled(true); }
+
+  void TearDown() override { DwarfLocationCache::SetEnabled(false); }
+
+  static void AddRow(uint64_t key, uint64_t pc_start, uint64_t pc_end, uint64_t cfa_offset) {
+    DwarfCie cie;
+    cie.return_address_register = 5;
+    dwarf_loc_regs_t loc_regs;
+    loc_regs.pc_start = pc_start;
+    loc_regs.pc_end = pc_end;
+    loc_regs[CFA_REG] = DwarfLocation{DWARF_LOCATION_REGISTER, {4, cfa_offset}};
+    DwarfLocationCache::Add(key, cie, loc_regs);
+  }
+};
+
+TEST_F(DwarfLocationCacheTest, key) {
+  ASSERT_EQ(0U, DwarfLocationCache::Key("", 0x1000));
+
+  uint64_t key = DwarfLocationCache::Key("build_id", 0x1000);
+  ASSERT_NE(0U, key);
+  ASSERT_EQ(key, DwarfLocationCache::Key("build_id", 0x1000));
+  ASSERT_NE(key, DwarfLocationCache::Key("build_id", 0x2000));
+  ASSERT_NE(key, DwarfLocationCache::Key("build_id2", 0x1000));
+}
+
+TEST_F(DwarfLocationCacheTest, find) {
+  AddRow(1, 0x1000, 0x2000, 0x10);
+  AddRow(1, 0x3000, 0x4000, 0x20);
+
+  auto row = DwarfLocationCache::Find(1, 0x1000);
+  ASSERT_TRUE(row != nullptr);
+  EXPECT_EQ(0x10U, row->loc_regs.at(CFA_REG).values[1]);
+  EXPECT_EQ(&row->cie, row->loc_regs.cie);
+  EXPECT_EQ(5U, row->cie.return_address_register);
+
+  row = DwarfLocationCache::Find(1, 0x1fff);
+  ASSERT_TRUE(row != nullptr);
+  EXPECT_EQ(0x10U, row->loc_regs.at(CFA_REG).values[1]);
+
+  row = DwarfLocationCache::Find(1, 0x3500);
+  ASSERT_TRUE(row != nullptr);
+  EXPECT_EQ(0x20U, row->loc_regs.at(CFA_REG).values[1]);
+
+  EXPECT_TRUE(DwarfLocationCache::Find(1, 0xfff) == nullptr);
+  EXPECT_TRUE(DwarfLocationCache::Find(1, 0x2000) == nullptr);
+  EXPECT_TRUE(DwarfLocationCache::Find(1, 0x4000) == nullptr);
+}
+
+TEST_F(DwarfLocationCacheTest, find_other_key) {
+  // Same shard, different section.
+  AddRow(1, 0x1000, 0x2000, 0x10);
+  AddRow(17, 0x3000, 0x4000, 0x20);
+
+  EXPECT_TRUE(DwarfLocationCache::Find(17, 0x1500) == nullptr);
+  EXPECT_TRUE(DwarfLocationCache::Find(1, 0x3500) == nullptr);
+  EXPECT_TRUE(DwarfLocationCache::Find(2, 0x1500) == nullptr);
+}
+
+TEST_F(DwarfLocationCacheTest, disabled) {
+  AddRow(1, 0x1000, 0x2000, 0x10);
+  ASSERT_TRUE(DwarfLocationCache::Find(1, 0x1500) != nullptr);
+
+  DwarfLocationCache::SetEnabled(false);
+  EXPECT_TRUE(DwarfLocationCache::Find(1, 0x1500) == nullptr);
+  AddRow(1, 0x1000, 0x2000, 0x10);
+
+  // Nothing survives disabling the cache.
+  DwarfLocationCache::SetEnabled(true);
+  EXPECT_TRUE(DwarfLocationCache::Find(1, 0x1500) == nullptr);
+}
+
+TEST_F(DwarfLocationCacheTest, row_outlives_clear) {
+  AddRow(1, 0x1000, 0x2000, 0x10);
+  auto row = DwarfLocationCache::Find(1, 0x1500);
+  ASSERT_TRUE(row != nullptr);
+
+  DwarfLocationCache::Clear();
+  EXPECT_TRUE(DwarfLocationCache::Find(1, 0x1500) == nullptr);
+  EXPECT_EQ(0x10U, row->loc_regs.at(CFA_REG).values[1]);
+}
+
+TEST_F(DwarfLocationCacheTest, full_shard) {
+  for (uint64_t i = 0; i < 10000; i++) {
+    AddRow(1, i * 0x10, (i + 1) * 0x10, i);
+  }
+
+  // The shard has been emptied along the way, but the latest rows are always there.
+  auto row = DwarfLocationCache::Find(1, 9999 * 0x10);
+  ASSERT_TRUE(row != nullptr);
+  EXPECT_EQ(9999U, row->loc_regs.at(CFA_REG).values[1]);
+  EXPECT_TRUE(DwarfLocationCache::Find(1, 0) == nullptr);
+}
+
+TEST_F(DwarfLocationCacheTest, threads) {
+  std::vector<std::thread> threads;
+  for (uint64_t key = 1; key <= 4; key++) {
+    threads.emplace_back([key]() {
+      for (uint64_t i = 0; i < 1000; i++) {
+        AddRow(key, i * 0x10, (i + 1) * 0x10, i);
+        auto row = DwarfLocationCache::Find(key, i * 0x10 + 8);
+        ASSERT_TRUE(row != nullptr);
+        ASSERT_EQ(i, row->loc_regs.at(CFA_REG).values[1]);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+}  // namespace unwindstack
@@ -1571,6 +1571,89 @@ TYPED_TEST_P(DwarfOpTest, is_dex_pc) {
   EXPECT_FALSE(this->op_->dex_pc_set());
 }
 
+TYPED_TEST_P(DwarfOpTest, compile) {
+  TypeParam value = 0x12345678;
+  this->regular_memory_.SetMemory(0x2000, &value, sizeof(value));
+
+  struct Expression {
+    std::vector<uint8_t> ops;
+    bool compiled;
+  };
+  std::vector<Expression> expressions = {
+      // Pushes.
+      {{0x08, 0x04, 0x08, 0x03, 0x08, 0x02, 0x08, 0x01}, true},
+      // Register.
+      {{0x50}, true},
+      // Enough values to not fit in the inline stack.
+      {std::vector<uint8_t>(40, 0x31), true},
+      // Reads, the second one failing.
+      {{0x0a, 0x00, 0x20, 0x06, 0x30, 0x1a}, true},
+      {{0x0a, 0x00, 0x30, 0x06}, true},
+      // Stack errors.
+      {{0x12}, true},
+      {{0x31, 0x15, 0x01}, true},
+      // Divide by zero.
+      {{0x31, 0x30, 0x1b}, true},
+      // Skip forward.
+      {{0x2f, 0x01, 0x00, 0x30, 0x31}, true},
+      // Infinite loop.
+      {{0x2f, 0xfd, 0xff}, true},
+      // Branch back to itself until a non-zero value ends the expression.
+      {{0x31, 0x30, 0x30, 0x28, 0x03, 0x00, 0x31, 0x32, 0x33}, true},
+      // Dex pc.
+      {{0x0c, 'D', 'E', 'X', '1', 0x13}, true},
+      // Skip into the middle of an op.
+      {{0x2f, 0x01, 0x00, 0x08, 0x05}, false},
+      // Branch to before the expression.
+      {{0x31, 0x2f, 0xf0, 0xff}, false},
+      // Illegal and not implemented ops.
+      {{0x31, 0x00}, false},
+      {{0x31, 0x31, 0x18}, false},
+      // Truncated op.
+      {{0x31, 0x08}, false},
+  };
+
+  for (size_t i = 0; i < expressions.size(); i++) {
+    SCOPED_TRACE(testing::Message() << "Expression " << i);
+    const std::vector<uint8_t>& ops = expressions[i].ops;
+    this->op_memory_.Clear();
+    this->op_memory_.SetMemory(0x100, ops);
+    uint64_t end = 0x100 + ops.size();
+
+    DwarfOpProgram program;
+    this->op_->Compile(0x100, end, &program);
+    ASSERT_EQ(expressions[i].compiled, program.compiled);
+    if (!program.compiled) {
+      continue;
+    }
+
+    bool expected_return = this->op_->Eval(0x100, end);
+    DwarfErrorCode expected_error = this->op_->LastErrorCode();
+    uint64_t expected_address = this->op_->LastErrorAddress();
+    std::vector<TypeParam> expected_stack;
+    for (size_t j = 0; j < this->op_->StackSize(); j++) {
+      expected_stack.push_back(this->op_->StackAt(j));
+    }
+    bool expected_is_register = this->op_->is_register();
+    bool expected_dex_pc_set = this->op_->dex_pc_set();
+
+    // Nothing is read from the op memory any more.
+    this->op_memory_.Clear();
+    ASSERT_EQ(expected_return, this->op_->Eval(program));
+    ASSERT_EQ(expected_error, this->op_->LastErrorCode());
+    if (expected_error == DWARF_ERROR_MEMORY_INVALID) {
+      ASSERT_EQ(expected_address, this->op_->LastErrorAddress());
+    }
+    std::vector<TypeParam> stack;
+    for (size_t j = 0; j < this->op_->StackSize(); j++) {
+      stack.push_back(this->op_->StackAt(j));
+    }
+    ASSERT_EQ(expected_stack, stack);
+    ASSERT_EQ(expected_is_register, this->op_->is_register());
+    ASSERT_EQ(expected_dex_pc_set, this->op_->dex_pc_set());
+  }
+}
+
 REGISTER_TYPED_TEST_SUITE_P(DwarfOpTest, decode, eval, illegal_opcode, not_implemented, op_addr,
                             op_deref, op_deref_size, const_unsigned, const_signed, const_uleb,
                             const_sleb, op_dup, op_drop, op_over, op_pick, op_swap, op_rot, op_abs,
@@ -1578,7 +1661,7 @@ REGISTER_TYPED_TEST_SUITE_P(DwarfOpTest, decode, eval, illegal_opcode, not_imple
                             op_plus, op_plus_uconst, op_shl, op_shr, op_shra, op_xor, op_bra,
                             compare_opcode_stack_error, compare_opcodes, op_skip, op_lit, op_reg,
                             op_regx, op_breg, op_breg_invalid_register, op_bregx, op_nop,
-                            is_dex_pc);
+                            is_dex_pc, compile);
 
 typedef ::testing::Types<uint32_t, uint64_t> DwarfOpTestTypes;
 INSTANTIATE_TYPED_TEST_SUITE_P(Libunwindstack, DwarfOpTest, DwarfOpTestTypes);
@@ -19,6 +19,7 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <unwindstack/DwarfLocationCache.h>
 #include <unwindstack/DwarfSection.h>
 
 #include "MemoryFake.h"
@@ -165,4 +166,50 @@ TEST_F(DwarfSectionTest, Step_cache_not_in_pc) {
   ASSERT_TRUE(section_->Step(0x700, nullptr, &process, &finished));
 }
 
+static bool MatchesCie(const DwarfCie* cie) {
+  return cie != nullptr && cie->return_address_register == 8;
+}
+
+TEST_F(DwarfSectionTest, Step_location_cache) {
+  DwarfLocationCache::SetEnabled(true);
+  section_->SetLocationCacheKey(1);
+
+  DwarfCie cie{};
+  cie.return_address_register = 8;
+  DwarfFde fde{};
+  fde.pc_start = 0x500;
+  fde.pc_end = 0x2000;
+  fde.cie = &cie;
+
+  EXPECT_CALL(*section_, GetFdeFromPc(0x1000)).WillOnce(::testing::Return(&fde));
+  EXPECT_CALL(*section_, GetCfaLocationInfo(0x1000, &fde, ::testing::_))
+      .WillOnce(::testing::Invoke(MockGetCfaLocationInfo));
+
+  MemoryFake process;
+  EXPECT_CALL(*section_, Eval(&cie, &process, ::testing::_, nullptr, ::testing::_))
+      .WillOnce(::testing::Return(true));
+
+  bool finished;
+  ASSERT_TRUE(section_->Step(0x1000, nullptr, &process, &finished));
+
+  // Another section for the same elf finds the locations without looking at its own DWARF.
+  MockDwarfSection other(&memory_);
+  other.SetLocationCacheKey(1);
+  EXPECT_CALL(other, GetFdeFromPc(::testing::_)).Times(0);
+  EXPECT_CALL(other, Eval(::testing::Truly(MatchesCie), &process, ::testing::_, nullptr,
+                          ::testing::_))
+      .Times(2)
+      .WillRepeatedly(::testing::Return(true));
+  ASSERT_TRUE(other.Step(0x1500, nullptr, &process, &finished));
+  ASSERT_TRUE(other.Step(0x500, nullptr, &process, &finished));
+
+  // But not one for a different elf.
+  MockDwarfSection unrelated(&memory_);
+  unrelated.SetLocationCacheKey(2);
+  EXPECT_CALL(unrelated, GetFdeFromPc(0x1000)).WillOnce(::testing::Return(nullptr));
+  ASSERT_FALSE(unrelated.Step(0x1000, nullptr, &process, &finished));
+
+  DwarfLocationCache::SetEnabled(false);
+}
+
 }  // namespace unwindstack
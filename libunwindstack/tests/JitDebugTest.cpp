@@ -169,6 +169,10 @@ class JitDebugTest : public ::testing::Test {
                        uint64_t elf_size);
   void WriteEntry64(uint64_t addr, uint64_t prev, uint64_t next, uint64_t elf_addr,
                     uint64_t elf_size);
+  void WriteAndroidDescriptor32(uint64_t addr, uint32_t entry, uint32_t action_flag,
+                                uint32_t relevant_entry, uint32_t seqlock, uint64_t timestamp);
+  void WriteAndroidEntry32Pad(uint64_t addr, uint32_t prev, uint32_t next, uint32_t elf_addr,
+                              uint64_t elf_size, uint64_t timestamp);
 
   std::shared_ptr<Memory> process_memory_;
   MemoryFake* memory_;
@@ -241,6 +245,36 @@ void JitDebugTest::WriteEntry64(uint64_t addr, uint64_t prev, uint64_t next, uin
   memory_->SetData64(addr + 24, elf_size);
 }
 
+void JitDebugTest::WriteAndroidDescriptor32(uint64_t addr, uint32_t entry, uint32_t action_flag,
+                                            uint32_t relevant_entry, uint32_t seqlock,
+                                            uint64_t timestamp) {
+  WriteDescriptor32(addr, entry);
+  memory_->SetData32(addr + 4, action_flag);
+  memory_->SetData32(addr + 8, relevant_entry);
+  // Fields that ART adds to the 32 bit JITDescriptor structure:
+  //   uint8_t magic[8]
+  memory_->SetMemory(addr + 16, std::vector<uint8_t>{'A', 'n', 'd', 'r', 'o', 'i', 'd', '1'});
+  //   uint32_t flags
+  memory_->SetData32(addr + 24, 0);
+  //   uint32_t sizeof_descriptor
+  memory_->SetData32(addr + 28, 48);
+  //   uint32_t sizeof_entry
+  memory_->SetData32(addr + 32, 32);
+  //   uint32_t action_seqlock
+  memory_->SetData32(addr + 36, seqlock);
+  //   uint64_t action_timestamp
+  memory_->SetData64(addr + 40, timestamp);
+}
+
+void JitDebugTest::WriteAndroidEntry32Pad(uint64_t addr, uint32_t prev, uint32_t next,
+                                          uint32_t elf_addr, uint64_t elf_size,
+                                          uint64_t timestamp) {
+  WriteEntry32Pad(addr, prev, next, elf_addr, elf_size);
+  // Fields that ART adds to the 32 bit JITCodeEntry structure:
+  //   uint64_t register_timestamp
+  memory_->SetData64(addr + 24, timestamp);
+}
+
 TEST_F(JitDebugTest, get_elf_invalid) {
   Elf* elf = jit_debug_->GetElf(maps_.get(), 0x1500);
   ASSERT_TRUE(elf == nullptr);
@@ -411,4 +445,90 @@ TEST_F(JitDebugTest, get_elf_search_libs) {
   EXPECT_TRUE(jit_debug_->GetElf(maps_.get(), 0x1500) != nullptr);
 }
 
+TEST_F(JitDebugTest, get_elf_android_added) {
+  CreateElf<Elf32_Ehdr, Elf32_Shdr>(0x4000, ELFCLASS32, EM_ARM, 0x1500, 0x200);
+  CreateElf<Elf32_Ehdr, Elf32_Shdr>(0x5000, ELFCLASS32, EM_ARM, 0x2300, 0x400);
+
+  WriteAndroidDescriptor32(0x11800, 0x200000, 1, 0x200000, 2, 10);
+  WriteAndroidEntry32Pad(0x200000, 0, 0, 0x4000, 0x1000, 10);
+
+  Elf* elf_1 = jit_debug_->GetElf(maps_.get(), 0x1500);
+  ASSERT_TRUE(elf_1 != nullptr);
+  ASSERT_TRUE(jit_debug_->GetElf(maps_.get(), 0x2300) == nullptr);
+
+  // Register a new entry at the head of the list.
+  WriteAndroidEntry32Pad(0x200100, 0, 0x200000, 0x5000, 0x1000, 20);
+  WriteAndroidDescriptor32(0x11800, 0x200100, 1, 0x200100, 4, 20);
+  // If the whole list was read again, the first entry would no longer be the
+  // one that was read before.
+  memory_->SetData64(0x200000 + 24, 5);
+
+  Elf* elf_2 = jit_debug_->GetElf(maps_.get(), 0x2300);
+  ASSERT_TRUE(elf_2 != nullptr);
+  EXPECT_NE(elf_1, elf_2);
+  EXPECT_EQ(elf_1, jit_debug_->GetElf(maps_.get(), 0x1500));
+}
+
+TEST_F(JitDebugTest, get_elf_android_removed) {
+  CreateElf<Elf32_Ehdr, Elf32_Shdr>(0x4000, ELFCLASS32, EM_ARM, 0x1500, 0x200);
+  CreateElf<Elf32_Ehdr, Elf32_Shdr>(0x5000, ELFCLASS32, EM_ARM, 0x2300, 0x400);
+
+  WriteAndroidDescriptor32(0x11800, 0x200100, 1, 0x200100, 4, 20);
+  WriteAndroidEntry32Pad(0x200100, 0, 0x200000, 0x5000, 0x1000, 20);
+  WriteAndroidEntry32Pad(0x200000, 0x200100, 0, 0x4000, 0x1000, 10);
+
+  Elf* elf_2 = jit_debug_->GetElf(maps_.get(), 0x2300);
+  ASSERT_TRUE(elf_2 != nullptr);
+  ASSERT_TRUE(jit_debug_->GetElf(maps_.get(), 0x1500) != nullptr);
+
+  // Unregister the first entry.
+  WriteAndroidEntry32Pad(0x200100, 0, 0, 0x5000, 0x1000, 20);
+  WriteAndroidDescriptor32(0x11800, 0x200100, 2, 0x200000, 6, 30);
+
+  EXPECT_TRUE(jit_debug_->GetElf(maps_.get(), 0x1500) == nullptr);
+  EXPECT_EQ(elf_2, jit_debug_->GetElf(maps_.get(), 0x2300));
+}
+
+TEST_F(JitDebugTest, get_elf_android_reload) {
+  CreateElf<Elf32_Ehdr, Elf32_Shdr>(0x4000, ELFCLASS32, EM_ARM, 0x1500, 0x200);
+  CreateElf<Elf32_Ehdr, Elf32_Shdr>(0x5000, ELFCLASS32, EM_ARM, 0x2300, 0x400);
+  CreateElf<Elf32_Ehdr, Elf32_Shdr>(0x6000, ELFCLASS32, EM_ARM, 0x3300, 0x400);
+
+  WriteAndroidDescriptor32(0x11800, 0x200100, 1, 0x200100, 4, 20);
+  WriteAndroidEntry32Pad(0x200100, 0, 0x200000, 0x5000, 0x1000, 20);
+  WriteAndroidEntry32Pad(0x200000, 0x200100, 0, 0x4000, 0x1000, 10);
+
+  Elf* elf_1 = jit_debug_->GetElf(maps_.get(), 0x1500);
+  ASSERT_TRUE(elf_1 != nullptr);
+  ASSERT_TRUE(jit_debug_->GetElf(maps_.get(), 0x2300) != nullptr);
+
+  // Three changes that can't all be seen: the second entry is unregistered,
+  // and a new one registered twice at the same address.
+  WriteAndroidEntry32Pad(0x200100, 0, 0x200000, 0x6000, 0x1000, 40);
+  WriteAndroidDescriptor32(0x11800, 0x200100, 1, 0x200100, 10, 40);
+
+  EXPECT_TRUE(jit_debug_->GetElf(maps_.get(), 0x2300) == nullptr);
+  EXPECT_TRUE(jit_debug_->GetElf(maps_.get(), 0x3300) != nullptr);
+  // The elf of the entry that didn't change is kept.
+  EXPECT_EQ(elf_1, jit_debug_->GetElf(maps_.get(), 0x1500));
+}
+
+TEST_F(JitDebugTest, get_elf_android_changing) {
+  CreateElf<Elf32_Ehdr, Elf32_Shdr>(0x4000, ELFCLASS32, EM_ARM, 0x1500, 0x200);
+  CreateElf<Elf32_Ehdr, Elf32_Shdr>(0x5000, ELFCLASS32, EM_ARM, 0x2300, 0x400);
+
+  WriteAndroidDescriptor32(0x11800, 0x200000, 1, 0x200000, 2, 10);
+  WriteAndroidEntry32Pad(0x200000, 0, 0, 0x4000, 0x1000, 10);
+  ASSERT_TRUE(jit_debug_->GetElf(maps_.get(), 0x1500) != nullptr);
+
+  // Nothing is read while the seqlock is held.
+  WriteAndroidEntry32Pad(0x200100, 0, 0x200000, 0x5000, 0x1000, 20);
+  WriteAndroidDescriptor32(0x11800, 0x200100, 1, 0x200100, 3, 20);
+  EXPECT_TRUE(jit_debug_->GetElf(maps_.get(), 0x2300) == nullptr);
+
+  WriteAndroidDescriptor32(0x11800, 0x200100, 1, 0x200100, 4, 20);
+  EXPECT_TRUE(jit_debug_->GetElf(maps_.get(), 0x2300) != nullptr);
+  EXPECT_TRUE(jit_debug_->GetElf(maps_.get(), 0x1500) != nullptr);
+}
+
 }  // namespace unwindstack
@@ -370,4 +370,77 @@ TEST_F(LocalUpdatableMapsTest, add_map_prev_real_name_updated) {
   EXPECT_EQ(maps_.Get(4), map_info->prev_real_map);
 }
 
+TEST_F(LocalUpdatableMapsTest, same_map_kept) {
+  MapInfo* map_info0 = maps_.Get(0);
+  MapInfo* map_info1 = maps_.Get(1);
+
+  TemporaryFile tf;
+  ASSERT_TRUE(
+      android::base::WriteStringToFile("3000-4000 r-xp 00000 00:00 0\n"
+                                       "5000-6000 r-xp 00000 00:00 0 /fake/lib.so\n"
+                                       "8000-9000 r-xp 00000 00:00 0\n",
+                                       tf.path));
+
+  maps_.TestSetMapsFile(tf.path);
+  ASSERT_TRUE(maps_.Reparse());
+  ASSERT_EQ(3U, maps_.Total());
+  EXPECT_EQ(0U, maps_.TestGetSavedMaps().size());
+
+  // The maps that didn't change are the same objects.
+  EXPECT_EQ(map_info0, maps_.Get(0));
+  EXPECT_EQ(map_info1, maps_.Get(2));
+  MapInfo* map_info = maps_.Get(1);
+  EXPECT_EQ(0x5000U, map_info->start);
+  EXPECT_EQ("/fake/lib.so", map_info->name);
+  EXPECT_EQ(map_info0, map_info->prev_map);
+  EXPECT_EQ(map_info0, map_info->prev_real_map);
+
+  EXPECT_EQ(map_info0, maps_.Find(0x3800));
+  EXPECT_EQ(map_info, maps_.Find(0x5800));
+  EXPECT_EQ(map_info1, maps_.Find(0x8800));
+  EXPECT_TRUE(maps_.Find(0x4800) == nullptr);
+}
+
+TEST_F(LocalUpdatableMapsTest, same_map_new_offset) {
+  TemporaryFile tf;
+  ASSERT_TRUE(
+      android::base::WriteStringToFile("3000-4000 r-xp 00000 00:00 0\n"
+                                       "8000-9000 r-xp 01000 00:00 0\n",
+                                       tf.path));
+
+  maps_.TestSetMapsFile(tf.path);
+  ASSERT_TRUE(maps_.Reparse());
+  ASSERT_EQ(2U, maps_.Total());
+
+  auto& saved_maps = maps_.TestGetSavedMaps();
+  ASSERT_EQ(1U, saved_maps.size());
+  EXPECT_EQ(0x8000U, saved_maps[0]->start);
+  EXPECT_EQ(0U, saved_maps[0]->offset);
+  EXPECT_EQ(0x1000U, maps_.Get(1)->offset);
+}
+
+TEST_F(LocalUpdatableMapsTest, reparse_fail) {
+  MapInfo* map_info0 = maps_.Get(0);
+  MapInfo* map_info1 = maps_.Get(1);
+
+  TemporaryFile tf;
+  ASSERT_TRUE(
+      android::base::WriteStringToFile("3000-4000 r-xp 00000 00:00 0\n"
+                                       "1000-2000 r-xp 00000 00:00 0\n"
+                                       "not a map\n",
+                                       tf.path));
+  maps_.TestSetMapsFile(tf.path);
+  ASSERT_FALSE(maps_.Reparse());
+
+  maps_.TestSetMapsFile("/does/not/exist");
+  ASSERT_FALSE(maps_.Reparse());
+
+  // Nothing was changed.
+  ASSERT_EQ(2U, maps_.Total());
+  EXPECT_EQ(map_info0, maps_.Get(0));
+  EXPECT_EQ(map_info1, maps_.Get(1));
+  EXPECT_EQ(0U, maps_.TestGetSavedMaps().size());
+  EXPECT_EQ(map_info1, maps_.Find(0x8000));
+}
+
 }  // namespace unwindstack
@@ -615,4 +615,36 @@ TEST(MapsTest, find) {
   EXPECT_EQ("/system/lib/fake5.so", info->name);
 }
 
+TEST(MapsTest, find_many) {
+  // Maps of different sizes, with a hole after every third one.
+  std::string content;
+  uint64_t start = 0x10000;
+  for (size_t i = 0; i < 1000; i++) {
+    uint64_t end = start + 0x1000 * (1 + i % 4);
+    content += android::base::StringPrintf(
+        "%" PRIx64 "-%" PRIx64 " r-xp 0 00:00 0 /fake/lib%zu.so\n", start, end, i);
+    start = end + ((i % 3 == 2) ? 0x1000 : 0);
+  }
+  BufferMaps maps(content.c_str());
+  ASSERT_TRUE(maps.Parse());
+  ASSERT_EQ(1000U, maps.Total());
+
+  EXPECT_TRUE(maps.Find(0xffff) == nullptr);
+  EXPECT_TRUE(maps.Find(start) == nullptr);
+  for (size_t i = 0; i < maps.Total(); i++) {
+    MapInfo* info = maps.Get(i);
+    ASSERT_EQ(info, maps.Find(info->start)) << "Failed at map " << i;
+    ASSERT_EQ(info, maps.Find(info->end - 1)) << "Failed at map " << i;
+    if (i % 3 == 2 && i + 1 < maps.Total()) {
+      ASSERT_TRUE(maps.Find(info->end) == nullptr) << "Failed at map " << i;
+    }
+  }
+
+  // Maps added after parsing are found too.
+  maps.Add(start + 0x1000, start + 0x2000, 0, PROT_READ, "/fake/added.so", 0);
+  MapInfo* info = maps.Find(start + 0x1800);
+  ASSERT_TRUE(info != nullptr);
+  EXPECT_EQ("/fake/added.so", info->name);
+}
+
 }  // namespace unwindstack
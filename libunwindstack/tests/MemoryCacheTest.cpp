@@ -139,4 +139,79 @@ TEST_F(MemoryCacheTest, read_for_cache_fail_cross) {
   ASSERT_EQ(expect, buffer);
 }
 
+TEST_F(MemoryCacheTest, read_ahead) {
+  std::vector<uint8_t> buffer(16);
+  ASSERT_TRUE(memory_cache_->ReadFully(0x8010, buffer.data(), 16));
+  ASSERT_EQ(std::vector<uint8_t>(16, 0xab), buffer);
+
+  // The page after the one read was cached with it, the partial page after
+  // that was not.
+  memory_->SetMemoryBlock(0x9000, 4096, 0xff);
+  memory_->SetMemoryBlock(0xa000, 3000, 0xff);
+  ASSERT_TRUE(memory_cache_->ReadFully(0x9010, buffer.data(), 16));
+  ASSERT_EQ(std::vector<uint8_t>(16, 0xde), buffer);
+  ASSERT_TRUE(memory_cache_->ReadFully(0xa010, buffer.data(), 16));
+  ASSERT_EQ(std::vector<uint8_t>(16, 0xff), buffer);
+}
+
+class MemoryBlocksFake : public MemoryFake {
+ public:
+  size_t ReadBlocks(const uint64_t* addrs, void* const* dsts, size_t size, size_t count) override {
+    block_reads_.push_back(std::vector<uint64_t>(addrs, addrs + count));
+    return MemoryFake::ReadBlocks(addrs, dsts, size, count);
+  }
+
+  std::vector<std::vector<uint64_t>> block_reads_;
+};
+
+TEST_F(MemoryCacheTest, read_ahead_batched) {
+  MemoryBlocksFake* memory = new MemoryBlocksFake;
+  MemoryCache cache(memory);
+  memory->SetMemoryBlock(0x10000, 0x10000, 0x12);
+
+  uint64_t value;
+  ASSERT_TRUE(cache.Read64(0x13000, &value));
+  ASSERT_EQ(1U, memory->block_reads_.size());
+  ASSERT_EQ(std::vector<uint64_t>({0x13000, 0x14000, 0x15000, 0x16000, 0x17000, 0x18000, 0x19000,
+                                   0x1a000}),
+            memory->block_reads_[0]);
+
+  // Nothing more is read while walking through those pages.
+  for (uint64_t addr = 0x13000; addr < 0x1b000; addr += 0x100) {
+    ASSERT_TRUE(cache.Read64(addr, &value));
+    ASSERT_EQ(0x1212121212121212ULL, value);
+  }
+  ASSERT_EQ(1U, memory->block_reads_.size());
+
+  // Reading ahead stops at the first page already cached.
+  ASSERT_TRUE(cache.Read64(0x10ff8, &value));
+  ASSERT_EQ(2U, memory->block_reads_.size());
+  ASSERT_EQ(std::vector<uint64_t>({0x10000, 0x11000, 0x12000}), memory->block_reads_[1]);
+}
+
+TEST_F(MemoryCacheTest, evict_least_recently_used) {
+  MemoryFake* memory = new MemoryFake;
+  MemoryCache cache(memory, 2);
+  memory->SetMemoryBlock(0x10000, 4096, 0x10);
+  memory->SetMemoryBlock(0x20000, 4096, 0x20);
+  memory->SetMemoryBlock(0x30000, 4096, 0x30);
+
+  uint8_t value;
+  ASSERT_TRUE(cache.ReadFully(0x10000, &value, 1));
+  ASSERT_TRUE(cache.ReadFully(0x20000, &value, 1));
+  ASSERT_TRUE(cache.ReadFully(0x10000, &value, 1));
+  // Pushes out 0x20000, the page least recently used.
+  ASSERT_TRUE(cache.ReadFully(0x30000, &value, 1));
+
+  memory->SetMemoryBlock(0x10000, 4096, 0xff);
+  memory->SetMemoryBlock(0x20000, 4096, 0xff);
+  memory->SetMemoryBlock(0x30000, 4096, 0xff);
+  ASSERT_TRUE(cache.ReadFully(0x10000, &value, 1));
+  ASSERT_EQ(0x10, value);
+  ASSERT_TRUE(cache.ReadFully(0x30000, &value, 1));
+  ASSERT_EQ(0x30, value);
+  ASSERT_TRUE(cache.ReadFully(0x20000, &value, 1));
+  ASSERT_EQ(0xff, value);
+}
+
 }  // namespace unwindstack
@@ -18,6 +18,7 @@
 #include <string.h>
 #include <sys/mman.h>
 
+#include <utility>
 #include <vector>
 
 #include <gtest/gtest.h>
@@ -108,4 +109,41 @@ TEST(MemoryLocalTest, read_hole) {
   ASSERT_EQ(0, munmap(mapping, 3 * 4096));
 }
 
+TEST(MemoryLocalTest, read_blocks) {
+  void* mapping =
+      mmap(nullptr, 4 * 4096, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  ASSERT_NE(MAP_FAILED, mapping);
+  uint8_t* data = static_cast<uint8_t*>(mapping);
+  for (size_t i = 0; i < 4; i++) {
+    memset(&data[i * 4096], i + 1, 4096);
+  }
+  mprotect(&data[2 * 4096], 4096, PROT_NONE);
+
+  MemoryLocal local;
+  std::vector<uint8_t> dst(4096 * 4, 0xCC);
+  // Out of order, to make sure each block goes where it is asked to.
+  uint64_t addrs[] = {reinterpret_cast<uintptr_t>(&data[4096]),
+                      reinterpret_cast<uintptr_t>(&data[0]),
+                      reinterpret_cast<uintptr_t>(&data[2 * 4096]),
+                      reinterpret_cast<uintptr_t>(&data[3 * 4096])};
+  void* dsts[] = {&dst[0], &dst[4096], &dst[2 * 4096], &dst[3 * 4096]};
+  ASSERT_EQ(2U, local.ReadBlocks(addrs, dsts, 4096, 4));
+  for (size_t i = 0; i < 4096; ++i) {
+    ASSERT_EQ(2, dst[i]);
+    ASSERT_EQ(1, dst[4096 + i]);
+    ASSERT_EQ(0xCC, dst[2 * 4096 + i]);
+    ASSERT_EQ(0xCC, dst[3 * 4096 + i]);
+  }
+
+  // Only the blocks before the first one that can't be read count.
+  std::swap(addrs[0], addrs[2]);
+  ASSERT_EQ(0U, local.ReadBlocks(addrs, dsts, 4096, 4));
+
+  // A block that runs into the hole isn't counted.
+  addrs[0] = reinterpret_cast<uintptr_t>(&data[4096]);
+  addrs[1] = reinterpret_cast<uintptr_t>(&data[2 * 4096 - 8]);
+  ASSERT_EQ(1U, local.ReadBlocks(addrs, dsts, 16, 2));
+  ASSERT_EQ(0, munmap(mapping, 4 * 4096));
+}
+
 }  // namespace unwindstack
@@ -299,6 +299,48 @@ TEST_F(MemoryRemoteTest, read_munmap_hole) {
   }
 }
 
+TEST_F(MemoryRemoteTest, read_blocks) {
+  size_t page_size = getpagesize();
+  void* mapping =
+      mmap(nullptr, 3 * page_size, PROT_READ | PROT_WRITE, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+  ASSERT_NE(MAP_FAILED, mapping);
+  uint8_t* data = static_cast<uint8_t*>(mapping);
+  memset(data, 0x11, page_size);
+  memset(&data[page_size], 0x22, page_size);
+  ASSERT_EQ(0, munmap(&data[2 * page_size], page_size));
+
+  pid_t pid;
+  if ((pid = fork()) == 0) {
+    while (true)
+      ;
+    exit(1);
+  }
+  ASSERT_LT(0, pid);
+  TestScopedPidReaper reap(pid);
+
+  ASSERT_EQ(0, munmap(mapping, 2 * page_size));
+
+  ASSERT_TRUE(Attach(pid));
+
+  MemoryRemote remote(pid);
+  std::vector<uint8_t> dst(page_size * 3, 0xCC);
+  uint64_t addrs[] = {reinterpret_cast<uint64_t>(&data[page_size]),
+                      reinterpret_cast<uint64_t>(data),
+                      reinterpret_cast<uint64_t>(&data[2 * page_size])};
+  void* dsts[] = {&dst[0], &dst[page_size], &dst[2 * page_size]};
+  // Once before and once after the read function has been picked.
+  for (size_t pass = 0; pass < 2; pass++) {
+    ASSERT_EQ(2U, remote.ReadBlocks(addrs, dsts, page_size, 3));
+    for (size_t i = 0; i < page_size; ++i) {
+      ASSERT_EQ(0x22, dst[i]);
+      ASSERT_EQ(0x11, dst[page_size + i]);
+      ASSERT_EQ(0xCC, dst[2 * page_size + i]);
+    }
+    uint8_t value;
+    ASSERT_TRUE(remote.ReadFully(reinterpret_cast<uint64_t>(data), &value, 1));
+  }
+}
+
 // Verify that the memory remote object chooses a memory read function
 // properly. Either process_vm_readv or ptrace.
 TEST_F(MemoryRemoteTest, read_choose_correctly) {
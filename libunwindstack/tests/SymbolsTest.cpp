@@ -29,6 +29,7 @@
 #include <vector>
 
 #include <android-base/file.h>
+#include <android-base/stringprintf.h>
 #include <android-base/test_utils.h>
 #include <gtest/gtest.h>
 
@@ -362,9 +363,152 @@ TYPED_TEST_P(SymbolsTest, get_global) {
   EXPECT_EQ(4U, offset);
 }
 
+// Verify a table bigger than a single read is all found, whatever order
+// the entries are in.
+TYPED_TEST_P(SymbolsTest, large_table) {
+  constexpr size_t kNumEntries = 1000;
+  Symbols symbols(0x1000, kNumEntries * sizeof(TypeParam), sizeof(TypeParam), 0x100000, 0x10000);
+
+  for (size_t i = 0; i < kNumEntries; i++) {
+    // Spread the functions out in reverse order of the entries.
+    TypeParam sym;
+    this->InitSym(&sym, 0x200000 + (kNumEntries - 1 - i) * 0x100, 0x80, i * 0x10);
+    this->memory_.SetMemory(0x1000 + i * sizeof(sym), &sym, sizeof(sym));
+    this->memory_.SetMemory(0x100000 + i * 0x10, android::base::StringPrintf("f%zu", i));
+  }
+
+  std::string name;
+  uint64_t func_offset;
+  for (size_t i = 0; i < kNumEntries; i++) {
+    uint64_t addr = 0x200000 + (kNumEntries - 1 - i) * 0x100;
+    ASSERT_TRUE(symbols.GetName<TypeParam>(addr + 0x7f, &this->memory_, &name, &func_offset))
+        << "Failed at entry " << i;
+    ASSERT_EQ(android::base::StringPrintf("f%zu", i), name);
+    ASSERT_EQ(0x7fU, func_offset);
+    ASSERT_FALSE(symbols.GetName<TypeParam>(addr + 0x80, &this->memory_, &name, &func_offset))
+        << "Failed at entry " << i;
+  }
+  ASSERT_FALSE(symbols.GetName<TypeParam>(0x1fffff, &this->memory_, &name, &func_offset));
+}
+
+// Verify the first of several functions at the same address is used.
+TYPED_TEST_P(SymbolsTest, same_start) {
+  Symbols symbols(0x1000, 3 * sizeof(TypeParam), sizeof(TypeParam), 0xa000, 0x1000);
+
+  TypeParam sym;
+  this->InitSym(&sym, 0x5000, 0, 0x100);
+  this->memory_.SetMemory(0x1000, &sym, sizeof(sym));
+  this->InitSym(&sym, 0x5000, 0x10, 0x200);
+  this->memory_.SetMemory(0x1000 + sizeof(sym), &sym, sizeof(sym));
+  this->InitSym(&sym, 0x5000, 0x20, 0x300);
+  this->memory_.SetMemory(0x1000 + 2 * sizeof(sym), &sym, sizeof(sym));
+  this->memory_.SetMemory(0xa100, "empty");
+  this->memory_.SetMemory(0xa200, "first");
+  this->memory_.SetMemory(0xa300, "second");
+
+  std::string name;
+  uint64_t func_offset;
+  ASSERT_TRUE(symbols.GetName<TypeParam>(0x5004, &this->memory_, &name, &func_offset));
+  ASSERT_EQ("first", name);
+  ASSERT_EQ(4U, func_offset);
+  ASSERT_FALSE(symbols.GetName<TypeParam>(0x5010, &this->memory_, &name, &func_offset));
+}
+
+// Verify the entries before a table that can't be read fully are kept.
+TYPED_TEST_P(SymbolsTest, truncated_table) {
+  Symbols symbols(0x1000, 4 * sizeof(TypeParam), sizeof(TypeParam), 0xa000, 0x1000);
+
+  TypeParam sym;
+  this->InitSym(&sym, 0x5000, 0x10, 0x100);
+  this->memory_.SetMemory(0x1000, &sym, sizeof(sym));
+  this->InitSym(&sym, 0x6000, 0x10, 0x200);
+  this->memory_.SetMemory(0x1000 + sizeof(sym), &sym, sizeof(sym));
+  this->memory_.SetMemory(0xa100, "first");
+  this->memory_.SetMemory(0xa200, "second");
+
+  std::string name;
+  uint64_t func_offset;
+  ASSERT_TRUE(symbols.GetName<TypeParam>(0x5000, &this->memory_, &name, &func_offset));
+  ASSERT_EQ("first", name);
+  ASSERT_TRUE(symbols.GetName<TypeParam>(0x6008, &this->memory_, &name, &func_offset));
+  ASSERT_EQ("second", name);
+  ASSERT_EQ(8U, func_offset);
+}
+
+// Verify a second table with the same cache file doesn't read the section.
+TYPED_TEST_P(SymbolsTest, cache_file) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/symbols";
+  Symbols symbols(0x1000, 2 * sizeof(TypeParam), sizeof(TypeParam), 0xa000, 0x1000);
+  symbols.SetCachePath(path);
+
+  TypeParam sym;
+  this->InitSym(&sym, 0x6000, 0x10, 0x200);
+  this->memory_.SetMemory(0x1000, &sym, sizeof(sym));
+  this->InitSym(&sym, 0x5000, 0x10, 0x100);
+  this->memory_.SetMemory(0x1000 + sizeof(sym), &sym, sizeof(sym));
+  this->memory_.SetMemory(0xa100, "first");
+  this->memory_.SetMemory(0xa200, "second");
+
+  std::string name;
+  uint64_t func_offset;
+  ASSERT_TRUE(symbols.GetName<TypeParam>(0x5004, &this->memory_, &name, &func_offset));
+  ASSERT_EQ("first", name);
+  ASSERT_EQ(0, access(path.c_str(), F_OK));
+
+  // Only the names are left to read.
+  this->memory_.Clear();
+  this->memory_.SetMemory(0xa100, "first");
+  this->memory_.SetMemory(0xa200, "second");
+  Symbols cached(0x1000, 2 * sizeof(TypeParam), sizeof(TypeParam), 0xa000, 0x1000);
+  cached.SetCachePath(path);
+  ASSERT_TRUE(cached.GetName<TypeParam>(0x600c, &this->memory_, &name, &func_offset));
+  ASSERT_EQ("second", name);
+  ASSERT_EQ(0xcU, func_offset);
+  ASSERT_TRUE(cached.GetName<TypeParam>(0x5000, &this->memory_, &name, &func_offset));
+  ASSERT_EQ("first", name);
+  ASSERT_FALSE(cached.GetName<TypeParam>(0x5010, &this->memory_, &name, &func_offset));
+
+  // A table of a different size doesn't use it.
+  Symbols other(0x1000, sizeof(TypeParam), sizeof(TypeParam), 0xa000, 0x1000);
+  other.SetCachePath(path);
+  ASSERT_FALSE(other.GetName<TypeParam>(0x5000, &this->memory_, &name, &func_offset));
+}
+
+// Verify a cache file that isn't valid is replaced, and that a table that
+// couldn't be read completely isn't written.
+TYPED_TEST_P(SymbolsTest, cache_file_invalid) {
+  TemporaryDir dir;
+  std::string path = std::string(dir.path) + "/symbols";
+  ASSERT_TRUE(android::base::WriteStringToFile(std::string(100, 'x'), path));
+
+  Symbols symbols(0x1000, sizeof(TypeParam), sizeof(TypeParam), 0xa000, 0x1000);
+  symbols.SetCachePath(path);
+  TypeParam sym;
+  this->InitSym(&sym, 0x5000, 0x10, 0x100);
+  this->memory_.SetMemory(0x1000, &sym, sizeof(sym));
+  this->memory_.SetMemory(0xa100, "first");
+
+  std::string name;
+  uint64_t func_offset;
+  ASSERT_TRUE(symbols.GetName<TypeParam>(0x5000, &this->memory_, &name, &func_offset));
+  ASSERT_EQ("first", name);
+  std::string contents;
+  ASSERT_TRUE(android::base::ReadFileToString(path, &contents));
+  ASSERT_NE(std::string(100, 'x'), contents);
+
+  std::string truncated_path = std::string(dir.path) + "/truncated";
+  Symbols truncated(0x1000, 2 * sizeof(TypeParam), sizeof(TypeParam), 0xa000, 0x1000);
+  truncated.SetCachePath(truncated_path);
+  ASSERT_TRUE(truncated.GetName<TypeParam>(0x5000, &this->memory_, &name, &func_offset));
+  ASSERT_EQ("first", name);
+  ASSERT_NE(0, access(truncated_path.c_str(), F_OK));
+}
+
 REGISTER_TYPED_TEST_SUITE_P(SymbolsTest, function_bounds_check, no_symbol, multiple_entries,
                             multiple_entries_nonstandard_size, symtab_value_out_of_bounds,
-                            symtab_read_cached, get_global);
+                            symtab_read_cached, get_global, large_table, same_start,
+                            truncated_table, cache_file, cache_file_invalid);
 
 typedef ::testing::Types<Elf32_Sym, Elf64_Sym> SymbolsTestTypes;
 INSTANTIATE_TYPED_TEST_SUITE_P(Libunwindstack, SymbolsTest, SymbolsTestTypes);
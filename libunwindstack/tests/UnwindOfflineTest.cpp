@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <dirent.h>
 #include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -28,7 +29,9 @@
 #include <vector>
 
 #include <android-base/file.h>
+#include <android-base/strings.h>
 
+#include <unwindstack/CompactUnwindTable.h>
 #include <unwindstack/JitDebug.h>
 #include <unwindstack/MachineArm.h>
 #include <unwindstack/MachineArm64.h>
@@ -1632,6 +1635,52 @@ TEST_F(UnwindOfflineTest, eh_frame_bias_x86) {
   EXPECT_EQ(0xfffe1d74ULL, unwinder.frames()[10].sp);
 }
 
+// The same unwind, through compact tables created for the elf files on the way.
+TEST_F(UnwindOfflineTest, eh_frame_bias_x86_compact_tables) {
+  TemporaryDir cache_dir;
+  CompactUnwindTable::SetCacheDir(cache_dir.path);
+  ASSERT_NO_FATAL_FAILURE(Init("eh_frame_bias_x86/", ARCH_X86));
+
+  Unwinder unwinder(128, maps_.get(), regs_.get(), process_memory_);
+  unwinder.Unwind();
+  CompactUnwindTable::SetCacheDir("");
+
+  std::string frame_info(DumpFrames(unwinder));
+  ASSERT_EQ(11U, unwinder.NumFrames()) << "Unwind:\n" << frame_info;
+  EXPECT_EQ(
+      "  #00 pc ffffe430  vdso.so (__kernel_vsyscall+16)\n"
+      "  #01 pc 00082a4b  libc.so (__epoll_pwait+43)\n"
+      "  #02 pc 000303a3  libc.so (epoll_pwait+115)\n"
+      "  #03 pc 000303ed  libc.so (epoll_wait+45)\n"
+      "  #04 pc 00010ea2  tombstoned (epoll_dispatch+226)\n"
+      "  #05 pc 0000c5e7  tombstoned (event_base_loop+1095)\n"
+      "  #06 pc 0000c193  tombstoned (event_base_dispatch+35)\n"
+      "  #07 pc 00005c77  tombstoned (main+884)\n"
+      "  #08 pc 00015f66  libc.so (__libc_init+102)\n"
+      "  #09 pc 0000360e  tombstoned (_start+98)\n"
+      "  #10 pc 00000001  <unknown>\n",
+      frame_info);
+  EXPECT_EQ(0xfffe1a30ULL, unwinder.frames()[0].sp);
+  EXPECT_EQ(0xfffe1ae0ULL, unwinder.frames()[4].sp);
+  EXPECT_EQ(0xfffe1d74ULL, unwinder.frames()[10].sp);
+
+  // libc.so and tombstoned have build ids, so both have tables now, and
+  // sorted symbols for the names looked up.
+  std::unique_ptr<DIR, decltype(&closedir)> dir(opendir(cache_dir.path), closedir);
+  ASSERT_TRUE(dir != nullptr);
+  size_t tables = 0;
+  size_t symbols = 0;
+  while (dirent* entry = readdir(dir.get())) {
+    if (android::base::EndsWith(entry->d_name, ".unwind")) {
+      tables++;
+    } else if (android::base::EndsWith(entry->d_name, ".symbols")) {
+      symbols++;
+    }
+  }
+  EXPECT_LE(2U, tables);
+  EXPECT_LE(2U, symbols);
+}
+
 TEST_F(UnwindOfflineTest, signal_load_bias_arm) {
   ASSERT_NO_FATAL_FAILURE(Init("signal_load_bias_arm/", ARCH_ARM));
 
@@ -294,6 +294,54 @@ TEST_F(UnwindTest, unwind_from_pid_remote) {
       << "ptrace detach failed with unexpected error: " << strerror(errno);
 }
 
+// Unwinds the same remote thread many times over, on several threads.
+TEST_F(UnwindTest, unwind_threads_remote) {
+  pid_t pid;
+  if ((pid = fork()) == 0) {
+    OuterFunction(TEST_TYPE_REMOTE);
+    exit(0);
+  }
+  ASSERT_NE(-1, pid);
+  TestScopedPidReaper reap(pid);
+
+  bool completed;
+  WaitForRemote(pid, reinterpret_cast<uint64_t>(&g_ready_for_remote), true, &completed);
+  ASSERT_TRUE(completed) << "Timed out waiting for remote process to be ready.";
+
+  std::unique_ptr<Regs> regs(Regs::RemoteGet(pid));
+  ASSERT_TRUE(regs.get() != nullptr);
+  uint64_t pc = regs->pc();
+
+  UnwinderFromPid unwinder(512, pid);
+  ASSERT_TRUE(unwinder.Init(regs->Arch()));
+
+  std::vector<ThreadUnwind> threads(16);
+  for (auto& thread : threads) {
+    thread.tid = pid;
+    thread.regs = regs.get();
+  }
+  unwinder.UnwindThreads(pid, &threads, 4);
+  ASSERT_EQ(pc, regs->pc());
+  ASSERT_EQ(0U, unwinder.NumFrames());
+
+  for (size_t i = 0; i < threads.size(); i++) {
+    std::vector<const char*> expected_function_names(kFunctionOrder);
+    for (auto& frame : threads[i].frames) {
+      if (frame.function_name == expected_function_names.back()) {
+        expected_function_names.pop_back();
+        if (expected_function_names.empty()) {
+          break;
+        }
+      }
+    }
+    ASSERT_TRUE(expected_function_names.empty()) << "Failed for thread " << i;
+    ASSERT_EQ(threads[0].frames.size(), threads[i].frames.size());
+  }
+
+  ASSERT_EQ(0, ptrace(PTRACE_DETACH, pid, 0, 0))
+      << "ptrace detach failed with unexpected error: " << strerror(errno);
+}
+
 static void RemoteCheckForLeaks(void (*unwind_func)(void*)) {
   pid_t pid;
   if ((pid = fork()) == 0) {
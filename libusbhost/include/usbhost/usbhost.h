@@ -69,10 +69,17 @@ typedef int (* usb_discovery_done_cb)(void *client_data);
 /* Call this to initialize the USB host library. */
 struct usb_host_context *usb_host_init(void);
 
+/* Like usb_host_init(), but devices are discovered through kernel uevents rather than by
+ * watching /dev/bus/usb with inotify. This needs a single read per device rather than
+ * several directory watches and rescans, but the device node may not have been created
+ * yet when added_cb is called; usb_device_open() waits for it.
+ */
+struct usb_host_context *usb_host_init_uevent(void);
+
 /* Call this to cleanup the USB host library. */
 void usb_host_cleanup(struct usb_host_context *context);
 
-/* Call this to get the inotify file descriptor. */
+/* Call this to get the inotify, or uevent socket, file descriptor. */
 int usb_host_get_fd(struct usb_host_context *context);
 
 /* Call this to initialize the usb host context. */
@@ -263,6 +270,18 @@ int usb_request_queue(struct usb_request *req);
   */
 struct usb_request *usb_request_wait(struct usb_device *dev, int timeoutMillis);
 
+/* Submits |count| requests, so that several transfers can be in flight at once.
+ * Returns the number submitted, which is less than |count| if one failed, or -1 if none were.
+ */
+int usb_request_queue_many(struct usb_request **reqs, int count);
+
+/* Waits as usb_request_wait() does for one request to complete, then reaps up to |count| - 1
+ * more that have completed too, without waiting. Stores them in |reqs|.
+ * Returns the number of requests reaped, or -1 for error.
+ */
+int usb_request_wait_many(struct usb_device *dev, struct usb_request **reqs, int count,
+                          int timeoutMillis);
+
 /* Cancels a pending usb_request_queue() operation. */
 int usb_request_cancel(struct usb_request *req);
 
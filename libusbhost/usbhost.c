@@ -43,6 +43,7 @@
 #include <sys/types.h>
 #include <sys/time.h>
 #include <sys/inotify.h>
+#include <sys/socket.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <errno.h>
@@ -50,6 +51,7 @@
 #include <poll.h>
 #include <pthread.h>
 
+#include <linux/netlink.h>
 #include <linux/usbdevice_fs.h>
 #include <asm/byteorder.h>
 
@@ -66,8 +68,13 @@
 
 #define MAX_USBFS_WD_COUNT      10
 
+// Large enough to hold the burst of uevents from a hub full of devices being plugged in at once
+#define UEVENT_RCVBUF_SIZE      (256 * 1024)
+#define UEVENT_MSG_LEN          2048
+
 struct usb_host_context {
     int                         fd;
+    int                         uevent;
     usb_device_added_cb         cb_added;
     usb_device_removed_cb       cb_removed;
     void                        *data;
@@ -84,6 +91,9 @@ struct usb_device {
     int desc_length;
     int fd;
     int writeable;
+    // The supported string descriptor languages, read on first use. -1 until then.
+    int language_count;
+    __u16 languages[MAX_STRING_DESCRIPTOR_LENGTH / sizeof(__u16)];
 };
 
 static inline int badname(const char *name)
@@ -176,6 +186,43 @@ struct usb_host_context *usb_host_init()
     return context;
 }
 
+struct usb_host_context *usb_host_init_uevent()
+{
+    struct sockaddr_nl addr;
+    int on = 1;
+    int size = UEVENT_RCVBUF_SIZE;
+
+    struct usb_host_context *context = calloc(1, sizeof(struct usb_host_context));
+    if (!context) {
+        fprintf(stderr, "out of memory in usb_host_context\n");
+        return NULL;
+    }
+    context->uevent = 1;
+    context->fd = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_KOBJECT_UEVENT);
+    if (context->fd < 0) {
+        fprintf(stderr, "uevent socket failed\n");
+        free(context);
+        return NULL;
+    }
+
+    /* SO_RCVBUFFORCE needs CAP_NET_ADMIN, fall back to what we're allowed */
+    if (setsockopt(context->fd, SOL_SOCKET, SO_RCVBUFFORCE, &size, sizeof(size)) < 0)
+        setsockopt(context->fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    /* to check that uevents come from the kernel */
+    setsockopt(context->fd, SOL_SOCKET, SO_PASSCRED, &on, sizeof(on));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = 1; /* kernel uevents */
+    if (bind(context->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "uevent socket bind failed\n");
+        close(context->fd);
+        free(context);
+        return NULL;
+    }
+    return context;
+}
+
 void usb_host_cleanup(struct usb_host_context *context)
 {
     close(context->fd);
@@ -202,6 +249,14 @@ int usb_host_load(struct usb_host_context *context,
 
     D("Created device discovery thread\n");
 
+    if (context->uevent) {
+        /* the socket is already bound, so devices added during the scan aren't missed */
+        done = find_existing_devices(added_cb, client_data);
+        if (discovery_done_cb)
+            done |= discovery_done_cb(client_data);
+        return done;
+    }
+
     /* watch for files added and deleted within USB_FS_DIR */
     context->wddbus = -1;
     for (i = 0; i < MAX_USBFS_WD_COUNT; i++)
@@ -226,6 +281,77 @@ int usb_host_load(struct usb_host_context *context,
     return done;
 } /* usb_host_load() */
 
+/* Reads one uevent, and calls the added or removed callback if it's about a USB device */
+static int usb_host_read_uevent(struct usb_host_context *context)
+{
+    char msg[UEVENT_MSG_LEN + 2];
+    char cred_msg[CMSG_SPACE(sizeof(struct ucred))];
+    struct iovec iov = {msg, UEVENT_MSG_LEN};
+    struct sockaddr_nl addr;
+    struct msghdr hdr = {
+        .msg_name = &addr,
+        .msg_namelen = sizeof(addr),
+        .msg_iov = &iov,
+        .msg_iovlen = 1,
+        .msg_control = cred_msg,
+        .msg_controllen = sizeof(cred_msg),
+    };
+    const char *action = NULL;
+    const char *subsystem = NULL;
+    const char *devtype = NULL;
+    const char *devname = NULL;
+    char path[100];
+    struct cmsghdr *cmsg;
+    struct ucred *cred;
+    ssize_t n;
+    char *p, *end;
+
+    n = TEMP_FAILURE_RETRY(recvmsg(context->fd, &hdr, 0));
+    if (n <= 0 || n >= UEVENT_MSG_LEN) {
+        /* nothing, or too big to be one of ours */
+        return 0;
+    }
+
+    /* ignore anything that isn't from the kernel */
+    cmsg = CMSG_FIRSTHDR(&hdr);
+    if (addr.nl_groups == 0 || addr.nl_pid != 0 || cmsg == NULL ||
+            cmsg->cmsg_type != SCM_CREDENTIALS)
+        return 0;
+    cred = (struct ucred *)CMSG_DATA(cmsg);
+    if (cred->uid != 0)
+        return 0;
+
+    /* "ACTION@DEVPATH" followed by KEY=VALUE pairs, all NUL separated */
+    msg[n] = '\0';
+    msg[n + 1] = '\0';
+    end = msg + n;
+    for (p = msg + strlen(msg) + 1; p < end; p += strlen(p) + 1) {
+        if (!strncmp(p, "ACTION=", 7))
+            action = p + 7;
+        else if (!strncmp(p, "SUBSYSTEM=", 10))
+            subsystem = p + 10;
+        else if (!strncmp(p, "DEVTYPE=", 8))
+            devtype = p + 8;
+        else if (!strncmp(p, "DEVNAME=", 8))
+            devname = p + 8;
+    }
+
+    /* interfaces and endpoints are reported too, only the devices have usbfs nodes */
+    if (!action || !subsystem || !devtype || !devname || strcmp(subsystem, "usb") ||
+            strcmp(devtype, "usb_device") || strncmp(devname, "bus/usb/", 8))
+        return 0;
+
+    snprintf(path, sizeof(path), DEV_DIR "/%s", devname);
+    if (!strcmp(action, "add")) {
+        D("new device %s\n", path);
+        return context->cb_added(path, context->data);
+    } else if (!strcmp(action, "remove")) {
+        D("gone device %s\n", path);
+        return context->cb_removed(path, context->data);
+    }
+    return 0;
+}
+
 int usb_host_read_event(struct usb_host_context *context)
 {
     struct inotify_event* event;
@@ -235,6 +361,9 @@ int usb_host_read_event(struct usb_host_context *context)
     int offset = 0;
     int wd;
 
+    if (context->uevent)
+        return usb_host_read_uevent(context);
+
     ret = read(context->fd, event_buf, sizeof(event_buf));
     if (ret >= (int)sizeof(struct inotify_event)) {
         while (offset < ret && !done) {
@@ -384,6 +513,7 @@ struct usb_device *usb_device_new(const char *dev_name, int fd)
     strncpy(device->dev_name, dev_name, sizeof(device->dev_name) - 1);
     device->fd = fd;
     device->desc_length = length;
+    device->language_count = -1;
     // assume we are writeable, since usb_device_get_fd will only return writeable fds
     device->writeable = 1;
     return device;
@@ -487,23 +617,25 @@ const unsigned char* usb_device_get_raw_descriptors(const struct usb_device* dev
  */
 int usb_device_get_string_ucs2(struct usb_device* device, int id, int timeout, void** ucs2_out,
                                size_t* response_size) {
-    __u16 languages[MAX_STRING_DESCRIPTOR_LENGTH / sizeof(__u16)];
     char response[MAX_STRING_DESCRIPTOR_LENGTH];
     int result;
-    int languageCount = 0;
 
     if (id == 0) return -1;
     if (*ucs2_out != NULL) return -1;
 
-    memset(languages, 0, sizeof(languages));
-
-    // read list of supported languages
-    result = usb_device_control_transfer(device,
-            USB_DIR_IN|USB_TYPE_STANDARD|USB_RECIP_DEVICE, USB_REQ_GET_DESCRIPTOR,
-            (USB_DT_STRING << 8) | 0, 0, languages, sizeof(languages),
-            timeout);
-    if (result > 0)
-        languageCount = (result - 2) / 2;
+    // read list of supported languages, once, since it's the same for every string
+    if (device->language_count < 0) {
+        memset(device->languages, 0, sizeof(device->languages));
+        result = usb_device_control_transfer(device,
+                USB_DIR_IN|USB_TYPE_STANDARD|USB_RECIP_DEVICE, USB_REQ_GET_DESCRIPTOR,
+                (USB_DT_STRING << 8) | 0, 0, device->languages, sizeof(device->languages),
+                timeout);
+        if (result < 0)
+            return -1;
+        device->language_count = result > 2 ? (result - 2) / 2 : 0;
+    }
+    int languageCount = device->language_count;
+    __u16* languages = device->languages;
 
     for (int i = 1; i <= languageCount; i++) {
         memset(response, 0, sizeof(response));
@@ -773,6 +905,41 @@ struct usb_request *usb_request_wait(struct usb_device *dev, int timeoutMillis)
     }
 }
 
+int usb_request_queue_many(struct usb_request **reqs, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if (usb_request_queue(reqs[i]) < 0)
+            return i > 0 ? i : -1;
+    }
+    return count;
+}
+
+int usb_request_wait_many(struct usb_device *dev, struct usb_request **reqs, int count,
+                          int timeoutMillis)
+{
+    struct usbdevfs_urb *urb;
+    int n = 0;
+
+    if (count <= 0)
+        return 0;
+
+    // Wait for the first one as usb_request_wait() does, then take whatever else has completed
+    // without blocking.
+    reqs[n] = usb_request_wait(dev, timeoutMillis);
+    if (reqs[n] == NULL)
+        return -1;
+    for (n = 1; n < count; n++) {
+        urb = NULL;
+        if (TEMP_FAILURE_RETRY(ioctl(dev->fd, USBDEVFS_REAPURBNDELAY, &urb)) < 0)
+            break;
+        reqs[n] = (struct usb_request*)urb->usercontext;
+        reqs[n]->actual_length = urb->actual_length;
+    }
+    return n;
+}
+
 int usb_request_cancel(struct usb_request *req)
 {
     struct usbdevfs_urb *urb = ((struct usbdevfs_urb*)req->private_data);
@@ -20,13 +20,84 @@
 #include <utils/Errors.h>
 #include <utils/Log.h>
 
+#include <unistd.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <utility>
+
 #include <backtrace/Backtrace.h>
+#include <backtrace/BacktraceMap.h>
 
 #define CALLSTACK_WEAK  // Don't generate weak definitions.
 #include <utils/CallStack.h>
 
 namespace android {
 
+namespace {
+
+constexpr uint32_t kUnknownMap = UINT32_MAX;
+
+struct Symbol {
+    std::string name;
+    uint64_t offset;
+};
+
+// State shared by every captured CallStack in the process. Frames only carry
+// an index into maps, and the function name for a (map, pc) is looked up once,
+// the first time a stack containing it is printed.
+struct CaptureState {
+    std::mutex lock;
+    std::vector<backtrace_map_t> maps;
+    std::multimap<uint64_t, uint32_t> mapsByStart;
+    std::map<std::pair<uint32_t, uint64_t>, Symbol> symbols;
+    // The process's maps as of the last symbolization, rebuilt when a frame
+    // isn't found in it.
+    std::unique_ptr<BacktraceMap> processMap;
+};
+
+CaptureState& getCaptureState() {
+    // Leaked, so that stacks can still be printed from other threads during exit.
+    static CaptureState* state = new CaptureState;
+    return *state;
+}
+
+// Returns the id of the map |frame| is in, adding it to the table if it's new.
+// The unwind doesn't name the maps it finds when it isn't resolving names, so
+// new ones are named from |processMap|. Called with the lock held.
+uint32_t internMap(CaptureState& state, const backtrace_frame_data_t& frame,
+                   BacktraceMap* processMap) {
+    const backtrace_map_t& map = frame.map;
+    if (!BacktraceMap::IsValid(map)) {
+        return kUnknownMap;
+    }
+    auto range = state.mapsByStart.equal_range(map.start);
+    for (auto it = range.first; it != range.second; ++it) {
+        const backtrace_map_t& known = state.maps[it->second];
+        if (known.end == map.end && known.offset == map.offset && known.flags == map.flags) {
+            return it->second;
+        }
+    }
+    backtrace_map_t named;
+    processMap->FillIn(frame.pc, &named);
+    uint32_t id = state.maps.size();
+    state.maps.push_back(map);
+    state.maps.back().name = std::move(named.name);
+    state.mapsByStart.emplace(map.start, id);
+    return id;
+}
+
+// Returns whether |pc| is still in the same mapping as when it was captured
+// in |captured|. Called with the lock held.
+bool isMapped(CaptureState& state, uint64_t pc, const backtrace_map_t& captured) {
+    backtrace_map_t current;
+    state.processMap->FillIn(pc, &current);
+    return current.start == captured.start && current.name == captured.name;
+}
+
+}  // namespace
+
 CallStack::CallStack() {
 }
 
@@ -39,7 +110,7 @@ CallStack::~CallStack() {
 }
 
 void CallStack::update(int32_t ignoreDepth, pid_t tid) {
-    mFrameLines.clear();
+    clear();
 
     std::unique_ptr<Backtrace> backtrace(Backtrace::Create(BACKTRACE_CURRENT_PROCESS, tid));
     if (!backtrace->Unwind(ignoreDepth)) {
@@ -50,6 +121,30 @@ void CallStack::update(int32_t ignoreDepth, pid_t tid) {
     }
 }
 
+void CallStack::capture(int32_t ignoreDepth, pid_t tid) {
+    clear();
+
+    std::unique_ptr<BacktraceMap> map(BacktraceMap::Create(getpid()));
+    if (map == nullptr) {
+        ALOGW("%s: Failed to read the process maps.", __FUNCTION__);
+        return;
+    }
+    map->SetResolveNames(false);
+
+    std::unique_ptr<Backtrace> backtrace(
+            Backtrace::Create(BACKTRACE_CURRENT_PROCESS, tid, map.get()));
+    if (!backtrace->Unwind(ignoreDepth)) {
+        ALOGW("%s: Failed to unwind callstack.", __FUNCTION__);
+    }
+
+    mFrames.reserve(backtrace->NumFrames());
+    CaptureState& state = getCaptureState();
+    std::lock_guard<std::mutex> guard(state.lock);
+    for (const backtrace_frame_data_t& frame : *backtrace) {
+        mFrames.push_back({frame.pc, frame.rel_pc, internMap(state, frame, map.get())});
+    }
+}
+
 void CallStack::log(const char* logtag, android_LogPriority priority, const char* prefix) const {
     LogPrinter printer(logtag, priority, prefix, /*ignoreBlankLines*/false);
     print(printer);
@@ -70,8 +165,77 @@ String8 CallStack::toString(const char* prefix) const {
 }
 
 void CallStack::print(Printer& printer) const {
-    for (size_t i = 0; i < mFrameLines.size(); i++) {
-        printer.printLine(mFrameLines[i]);
+    if (mFrames.empty()) {
+        for (size_t i = 0; i < mFrameLines.size(); i++) {
+            printer.printLine(mFrameLines[i]);
+        }
+        return;
+    }
+
+    Vector<String8> lines;
+    lines.setCapacity(mFrames.size());
+    {
+        CaptureState& state = getCaptureState();
+        std::lock_guard<std::mutex> guard(state.lock);
+
+        // Look up every name this stack is missing in one go, reusing one
+        // Backtrace for all of them.
+        std::unique_ptr<Backtrace> backtrace;
+        bool mapRebuilt = false;
+        for (const Frame& frame : mFrames) {
+            if (frame.mapId == kUnknownMap ||
+                state.symbols.count({frame.mapId, frame.relPc}) != 0) {
+                continue;
+            }
+            const backtrace_map_t& map = state.maps[frame.mapId];
+            if (state.processMap == nullptr ||
+                (!mapRebuilt && !isMapped(state, frame.pc, map))) {
+                // Something has been mapped since the last lookup, so start over
+                // with the current maps, but only once per stack.
+                backtrace.reset();
+                state.processMap.reset(BacktraceMap::Create(getpid()));
+                mapRebuilt = true;
+                if (state.processMap == nullptr) {
+                    break;
+                }
+            }
+
+            Symbol& symbol = state.symbols[{frame.mapId, frame.relPc}];
+            symbol.offset = 0;
+            // The library may have been unloaded since the stack was captured.
+            if (!isMapped(state, frame.pc, map)) {
+                continue;
+            }
+            if (backtrace == nullptr) {
+                backtrace.reset(Backtrace::Create(BACKTRACE_CURRENT_PROCESS,
+                                                  BACKTRACE_CURRENT_THREAD,
+                                                  state.processMap.get()));
+            }
+            symbol.name = backtrace->GetFunctionName(frame.pc, &symbol.offset, &map);
+        }
+
+        backtrace_frame_data_t data = {};
+        for (size_t i = 0; i < mFrames.size(); i++) {
+            const Frame& frame = mFrames[i];
+            data.num = i;
+            data.pc = frame.pc;
+            data.rel_pc = frame.relPc;
+            data.map = frame.mapId == kUnknownMap ? backtrace_map_t() : state.maps[frame.mapId];
+            data.func_name.clear();
+            data.func_offset = 0;
+            if (frame.mapId != kUnknownMap) {
+                auto it = state.symbols.find({frame.mapId, frame.relPc});
+                if (it != state.symbols.end()) {
+                    data.func_name = it->second.name;
+                    data.func_offset = it->second.offset;
+                }
+            }
+            lines.push_back(String8(Backtrace::FormatFrameData(&data).c_str()));
+        }
+    }
+
+    for (size_t i = 0; i < lines.size(); i++) {
+        printer.printLine(lines[i]);
     }
 }
 
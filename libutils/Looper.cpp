@@ -16,7 +16,11 @@
 #include <utils/Looper.h>
 
 #include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <algorithm>
 #include <cinttypes>
+#include <functional>
 
 namespace android {
 
@@ -59,14 +63,32 @@ static const int EPOLL_MAX_EVENTS = 16;
 static pthread_once_t gTLSOnce = PTHREAD_ONCE_INIT;
 static pthread_key_t gTLSKey = 0;
 
+// Registrations in the epoll set carry the request sequence number along with the fd, so
+// that an event from a registration that outlived its fd can be told apart from one for
+// the request now using the same fd number.  The looper's own fds use sequence number -1.
+static uint64_t createEpollData(int fd, int seq) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(seq)) << 32)
+            | static_cast<uint32_t>(fd);
+}
+
+static int epollDataFd(uint64_t data) {
+    return static_cast<int>(static_cast<uint32_t>(data));
+}
+
+static int epollDataSeq(uint64_t data) {
+    return static_cast<int>(static_cast<uint32_t>(data >> 32));
+}
+
 Looper::Looper(bool allowNonCallbacks)
     : mAllowNonCallbacks(allowNonCallbacks),
+      mNextMessageSeq(0),
       mSendingMessage(false),
       mPolling(false),
       mEpollRebuildRequired(false),
       mNextRequestSeq(0),
       mResponseIndex(0),
-      mNextMessageUptime(LLONG_MAX) {
+      mNextMessageUptime(LLONG_MAX),
+      mTimerFdUptime(LLONG_MAX) {
     mWakeEventFd.reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
     LOG_ALWAYS_FATAL_IF(mWakeEventFd.get() < 0, "Could not make wake event fd: %s", strerror(errno));
 
@@ -144,11 +166,18 @@ void Looper::rebuildEpollLocked() {
     struct epoll_event eventItem;
     memset(& eventItem, 0, sizeof(epoll_event)); // zero out unused members of data field union
     eventItem.events = EPOLLIN;
-    eventItem.data.fd = mWakeEventFd.get();
+    eventItem.data.u64 = createEpollData(mWakeEventFd.get(), -1);
     int result = epoll_ctl(mEpollFd.get(), EPOLL_CTL_ADD, mWakeEventFd.get(), &eventItem);
     LOG_ALWAYS_FATAL_IF(result != 0, "Could not add wake event fd to epoll instance: %s",
                         strerror(errno));
 
+    if (mTimerFd >= 0) {
+        eventItem.data.u64 = createEpollData(mTimerFd.get(), -1);
+        result = epoll_ctl(mEpollFd.get(), EPOLL_CTL_ADD, mTimerFd.get(), &eventItem);
+        LOG_ALWAYS_FATAL_IF(result != 0, "Could not add timer fd to epoll instance: %s",
+                            strerror(errno));
+    }
+
     for (size_t i = 0; i < mRequests.size(); i++) {
         const Request& request = mRequests.valueAt(i);
         struct epoll_event eventItem;
@@ -213,8 +242,11 @@ int Looper::pollInner(int timeoutMillis) {
     ALOGD("%p ~ pollOnce - waiting: timeoutMillis=%d", this, timeoutMillis);
 #endif
 
-    // Adjust the timeout based on when the next message is due.
-    if (timeoutMillis != 0 && mNextMessageUptime != LLONG_MAX) {
+    // Adjust the timeout based on when the next message is due, unless the timerfd will wake
+    // us up for it.
+    if (mTimerFd >= 0) {
+        armTimerFd();
+    } else if (timeoutMillis != 0 && mNextMessageUptime != LLONG_MAX) {
         nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
         int messageTimeoutMillis = toMillisecondTimeoutDelay(now, mNextMessageUptime);
         if (messageTimeoutMillis >= 0
@@ -276,7 +308,8 @@ int Looper::pollInner(int timeoutMillis) {
 #endif
 
     for (int i = 0; i < eventCount; i++) {
-        int fd = eventItems[i].data.fd;
+        int fd = epollDataFd(eventItems[i].data.u64);
+        int seq = epollDataSeq(eventItems[i].data.u64);
         uint32_t epollEvents = eventItems[i].events;
         if (fd == mWakeEventFd.get()) {
             if (epollEvents & EPOLLIN) {
@@ -284,9 +317,23 @@ int Looper::pollInner(int timeoutMillis) {
             } else {
                 ALOGW("Ignoring unexpected epoll events 0x%x on wake event fd.", epollEvents);
             }
+        } else if (fd == mTimerFd.get() && seq == -1) {
+            // The messages that are due get handled below; just consume the expiration.
+            uint64_t expirations;
+            TEMP_FAILURE_RETRY(read(mTimerFd.get(), &expirations, sizeof(uint64_t)));
+            mTimerFdUptime = LLONG_MAX;
         } else {
             ssize_t requestIndex = mRequests.indexOfKey(fd);
-            if (requestIndex >= 0) {
+            if (requestIndex >= 0 && mRequests.valueAt(requestIndex).seq != seq) {
+                // The event comes from a registration whose fd was closed before it could be
+                // removed from the epoll set, and whose fd number has since been reused.  See
+                // removeFd().  Only a new epoll set gets rid of it.
+#if DEBUG_CALLBACKS
+                ALOGD("%p ~ pollOnce - stale epoll registration for fd %d, seq=%d",
+                        this, fd, seq);
+#endif
+                scheduleEpollRebuildLocked();
+            } else if (requestIndex >= 0) {
                 int events = 0;
                 if (epollEvents & EPOLLIN) events |= EVENT_INPUT;
                 if (epollEvents & EPOLLOUT) events |= EVENT_OUTPUT;
@@ -296,6 +343,8 @@ int Looper::pollInner(int timeoutMillis) {
             } else {
                 ALOGW("Ignoring unexpected epoll events 0x%x on fd %d that is "
                         "no longer registered.", epollEvents, fd);
+                // It may also be a stale registration; make sure it does not fire again.
+                scheduleEpollRebuildLocked();
             }
         }
     }
@@ -303,18 +352,20 @@ Done: ;
 
     // Invoke pending message callbacks.
     mNextMessageUptime = LLONG_MAX;
-    while (mMessageEnvelopes.size() != 0) {
+    while (!mMessageEnvelopes.empty()) {
         nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
-        const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(0);
+        MessageEnvelope& messageEnvelope = mMessageEnvelopes.front();
         if (messageEnvelope.uptime <= now) {
-            // Remove the envelope from the list.
+            // Remove the envelope from the heap.
             // We keep a strong reference to the handler until the call to handleMessage
             // finishes.  Then we drop it so that the handler can be deleted *before*
             // we reacquire our lock.
             { // obtain handler
-                sp<MessageHandler> handler = messageEnvelope.handler;
+                sp<MessageHandler> handler = std::move(messageEnvelope.handler);
                 Message message = messageEnvelope.message;
-                mMessageEnvelopes.removeAt(0);
+                std::pop_heap(mMessageEnvelopes.begin(), mMessageEnvelopes.end(),
+                              std::greater<MessageEnvelope>());
+                mMessageEnvelopes.pop_back();
                 mSendingMessage = true;
                 mLock.unlock();
 
@@ -416,6 +467,53 @@ void Looper::awoken() {
     TEMP_FAILURE_RETRY(read(mWakeEventFd.get(), &counter, sizeof(uint64_t)));
 }
 
+bool Looper::enableTimerFd() {
+    AutoMutex _l(mLock);
+    if (mTimerFd >= 0) {
+        return true;
+    }
+
+    android::base::unique_fd timerFd(timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC));
+    if (timerFd < 0) {
+        ALOGE("Could not create timer fd: %s", strerror(errno));
+        return false;
+    }
+
+    struct epoll_event eventItem;
+    memset(& eventItem, 0, sizeof(epoll_event)); // zero out unused members of data field union
+    eventItem.events = EPOLLIN;
+    eventItem.data.u64 = createEpollData(timerFd.get(), -1);
+    if (epoll_ctl(mEpollFd.get(), EPOLL_CTL_ADD, timerFd.get(), &eventItem) != 0) {
+        ALOGE("Could not add timer fd to epoll instance: %s", strerror(errno));
+        return false;
+    }
+    mTimerFd = std::move(timerFd);
+    mTimerFdUptime = LLONG_MAX;
+    return true;
+}
+
+void Looper::armTimerFd() {
+    if (mTimerFdUptime == mNextMessageUptime) {
+        return;
+    }
+
+    // A zero it_value disarms the timer.
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    if (mNextMessageUptime != LLONG_MAX) {
+        // A time in the past fires at once, but zero would disarm the timer.
+        nsecs_t uptime = std::max<nsecs_t>(mNextMessageUptime, 1);
+        spec.it_value.tv_sec = uptime / 1000000000LL;
+        spec.it_value.tv_nsec = uptime % 1000000000LL;
+    }
+#if DEBUG_POLL_AND_WAKE
+    ALOGD("%p ~ armTimerFd - uptime=%" PRId64, this, mNextMessageUptime);
+#endif
+    int result = timerfd_settime(mTimerFd.get(), TFD_TIMER_ABSTIME, &spec, nullptr);
+    LOG_ALWAYS_FATAL_IF(result != 0, "Could not arm timer fd: %s", strerror(errno));
+    mTimerFdUptime = mNextMessageUptime;
+}
+
 void Looper::pushResponse(int events, const Request& request) {
     Response response;
     response.events = events;
@@ -482,11 +580,11 @@ int Looper::addFd(int fd, int ident, int events, const sp<LooperCallback>& callb
                     // before returning and unregistering itself.  Callback sequence number
                     // checks further ensure that the race is benign.
                     //
-                    // Unfortunately due to kernel limitations we need to rebuild the epoll
-                    // set from scratch because it may contain an old file handle that we are
-                    // now unable to remove since its file descriptor is no longer valid.
-                    // No such problem would have occurred if we were using the poll system
-                    // call instead, but that approach carries others disadvantages.
+                    // The epoll set may still contain the old file handle if it is open
+                    // elsewhere, and we are unable to remove it since its file descriptor
+                    // is no longer valid.  Its events carry the old sequence number though,
+                    // so pollInner() ignores them and rebuilds the epoll set only if that
+                    // actually happens.
 #if DEBUG_CALLBACKS
                     ALOGD("%p ~ addFd - EPOLL_CTL_MOD failed due to file descriptor "
                             "being recycled, falling back on EPOLL_CTL_ADD: %s",
@@ -498,7 +596,6 @@ int Looper::addFd(int fd, int ident, int events, const sp<LooperCallback>& callb
                                 fd, strerror(errno));
                         return -1;
                     }
-                    scheduleEpollRebuildLocked();
                 } else {
                     ALOGE("Error modifying epoll events for fd %d: %s", fd, strerror(errno));
                     return -1;
@@ -548,16 +645,15 @@ int Looper::removeFd(int fd, int seq) {
                 // side-effect of closing the file descriptor before returning and
                 // unregistering itself.
                 //
-                // Unfortunately due to kernel limitations we need to rebuild the epoll
-                // set from scratch because it may contain an old file handle that we are
-                // now unable to remove since its file descriptor is no longer valid.
-                // No such problem would have occurred if we were using the poll system
-                // call instead, but that approach carries others disadvantages.
+                // The epoll set may still contain the old file handle if it is open
+                // elsewhere, and we are unable to remove it since its file descriptor is
+                // no longer valid.  Rather than rebuild the epoll set from scratch every
+                // time, pollInner() does so only if such a handle ever signals an event,
+                // which it recognizes by the sequence number the event carries.
 #if DEBUG_CALLBACKS
                 ALOGD("%p ~ removeFd - EPOLL_CTL_DEL failed due to file descriptor "
                         "being closed: %s", this, strerror(errno));
 #endif
-                scheduleEpollRebuildLocked();
             } else {
                 // Some other error occurred.  This is really weird because it means
                 // our list of callbacks got out of sync with the epoll set somehow.
@@ -590,17 +686,15 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
             this, uptime, handler.get(), message.what);
 #endif
 
-    size_t i = 0;
+    bool atHead;
     { // acquire lock
         AutoMutex _l(mLock);
 
-        size_t messageCount = mMessageEnvelopes.size();
-        while (i < messageCount && uptime >= mMessageEnvelopes.itemAt(i).uptime) {
-            i += 1;
-        }
-
-        MessageEnvelope messageEnvelope(uptime, handler, message);
-        mMessageEnvelopes.insertAt(messageEnvelope, i, 1);
+        uint64_t seq = mNextMessageSeq++;
+        mMessageEnvelopes.emplace_back(uptime, handler, message, seq);
+        std::push_heap(mMessageEnvelopes.begin(), mMessageEnvelopes.end(),
+                       std::greater<MessageEnvelope>());
+        atHead = mMessageEnvelopes.front().seq == seq;
 
         // Optimization: If the Looper is currently sending a message, then we can skip
         // the call to wake() because the next thing the Looper will do after processing
@@ -612,7 +706,7 @@ void Looper::sendMessageAtTime(nsecs_t uptime, const sp<MessageHandler>& handler
     } // release lock
 
     // Wake the poll loop only when we enqueue a new message at the head.
-    if (i == 0) {
+    if (atHead) {
         wake();
     }
 }
@@ -625,12 +719,9 @@ void Looper::removeMessages(const sp<MessageHandler>& handler) {
     { // acquire lock
         AutoMutex _l(mLock);
 
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler) {
-                mMessageEnvelopes.removeAt(i);
-            }
-        }
+        removeMessagesLocked([&](const MessageEnvelope& messageEnvelope) {
+            return messageEnvelope.handler == handler;
+        });
     } // release lock
 }
 
@@ -642,16 +733,22 @@ void Looper::removeMessages(const sp<MessageHandler>& handler, int what) {
     { // acquire lock
         AutoMutex _l(mLock);
 
-        for (size_t i = mMessageEnvelopes.size(); i != 0; ) {
-            const MessageEnvelope& messageEnvelope = mMessageEnvelopes.itemAt(--i);
-            if (messageEnvelope.handler == handler
-                    && messageEnvelope.message.what == what) {
-                mMessageEnvelopes.removeAt(i);
-            }
-        }
+        removeMessagesLocked([&](const MessageEnvelope& messageEnvelope) {
+            return messageEnvelope.handler == handler && messageEnvelope.message.what == what;
+        });
     } // release lock
 }
 
+template <typename Predicate>
+void Looper::removeMessagesLocked(Predicate predicate) {
+    auto end = std::remove_if(mMessageEnvelopes.begin(), mMessageEnvelopes.end(), predicate);
+    if (end != mMessageEnvelopes.end()) {
+        mMessageEnvelopes.erase(end, mMessageEnvelopes.end());
+        std::make_heap(mMessageEnvelopes.begin(), mMessageEnvelopes.end(),
+                       std::greater<MessageEnvelope>());
+    }
+}
+
 bool Looper::isPolling() const {
     return mPolling;
 }
@@ -663,7 +760,7 @@ void Looper::Request::initEventItem(struct epoll_event* eventItem) const {
 
     memset(eventItem, 0, sizeof(epoll_event)); // zero out unused members of data field union
     eventItem->events = epollEvents;
-    eventItem->data.fd = fd;
+    eventItem->data.u64 = createEpollData(fd, seq);
 }
 
 MessageHandler::~MessageHandler() { }
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <utils/Looper.h>
+#include <utils/Timers.h>
+
+using android::Looper;
+using android::Message;
+using android::MessageHandler;
+using android::sp;
+
+class NullHandler : public MessageHandler {
+    void handleMessage(const Message&) override {}
+};
+
+// Sends state.range(0) messages due at scattered times, as a looper with many pending
+// timeouts sees them, then handles them all.
+void BM_Looper_sendMessageAtTime(benchmark::State& state) {
+    sp<Looper> looper = new Looper(false);
+    sp<MessageHandler> handler = new NullHandler();
+    const int count = state.range(0);
+    uint32_t random = 1;
+    while (state.KeepRunning()) {
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < count; i++) {
+            random = random * 1103515245 + 12345;
+            looper->sendMessageAtTime(now - (random >> 8), handler, Message(i));
+        }
+        looper->pollOnce(0);
+    }
+    state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_Looper_sendMessageAtTime)->Arg(16)->Arg(1024)->Arg(8192);
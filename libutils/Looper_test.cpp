@@ -744,4 +744,108 @@ TEST_F(LooperTest, RemoveMessage_WhenRemovingSomeMessagesForHandler_ShouldRemove
             << "no more messages to handle";
 }
 
+TEST_F(LooperTest, SendMessageAtTime_WhenSentOutOfOrder_ShouldInvokeHandlerInTimeThenSendOrder) {
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    // Message i is due at one of three times in the past; those due at the same time must
+    // come out in the order they were sent.
+    for (int i = 0; i < 30; i++) {
+        mLooper->sendMessageAtTime(now - ms2ns(3 - (i * 7) % 3), handler, Message(i));
+    }
+
+    int result = mLooper->pollOnce(0);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because messages were sent";
+    ASSERT_EQ(size_t(30), handler->messages.size())
+            << "handled messages";
+    for (size_t i = 1; i < handler->messages.size(); i++) {
+        int previous = handler->messages[i - 1].what;
+        int current = handler->messages[i].what;
+        int previousDelay = 3 - (previous * 7) % 3;
+        int currentDelay = 3 - (current * 7) % 3;
+        EXPECT_TRUE(previousDelay > currentDelay
+                    || (previousDelay == currentDelay && previous < current))
+                << "message " << previous << " handled before message " << current;
+    }
+}
+
+TEST_F(LooperTest, SendMessageDelayed_WhenTimerFdEnabled_ShouldInvokeHandlerAfterDelayTime) {
+    ASSERT_TRUE(mLooper->enableTimerFd());
+    sp<StubMessageHandler> handler = new StubMessageHandler();
+    StopWatch stopWatch("pollOnce");
+    mLooper->sendMessageDelayed(ms2ns(100), handler, Message(MSG_TEST1));
+
+    int result = mLooper->pollOnce(1000);
+
+    EXPECT_EQ(Looper::POLL_WAKE, result)
+            << "pollOnce result should be Looper::POLL_WAKE due to wakeup";
+
+    result = mLooper->pollOnce(1000);
+    nsecs_t elapsed = stopWatch.elapsedTime();
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because message was sent";
+    EXPECT_LE(ms2ns(100), elapsed)
+            << "message should not be handled before it is due";
+    EXPECT_NEAR(100, ns2ms(elapsed), TIMING_TOLERANCE_MS)
+            << "timer fd should wake the looper when the message is due";
+    EXPECT_EQ(size_t(1), handler->messages.size())
+            << "handled message";
+
+    // The timer must be rearmed for a message due at the same time as the one just handled.
+    mLooper->sendMessageDelayed(ms2ns(100), handler, Message(MSG_TEST2));
+    mLooper->removeMessages(handler);
+    mLooper->sendMessageDelayed(ms2ns(100), handler, Message(MSG_TEST3));
+    result = mLooper->pollOnce(1000);
+
+    EXPECT_EQ(Looper::POLL_WAKE, result)
+            << "pollOnce result should be Looper::POLL_WAKE due to wakeup";
+
+    result = mLooper->pollOnce(1000);
+
+    EXPECT_EQ(Looper::POLL_CALLBACK, result)
+            << "pollOnce result should be Looper::POLL_CALLBACK because message was sent";
+    ASSERT_EQ(size_t(2), handler->messages.size())
+            << "handled message";
+    EXPECT_EQ(MSG_TEST3, handler->messages[1].what)
+            << "handled message";
+}
+
+TEST_F(LooperTest, AddFd_WhenFdReusedWhileOldFileStillOpen_ShouldNotInvokeNewCallback) {
+    Pipe oldPipe;
+    StubCallbackHandler oldHandler(true);
+    oldHandler.setCallback(mLooper, oldPipe.receiveFd, Looper::EVENT_INPUT);
+
+    // Close the fd without removing it, while a duplicate keeps the file open, so that the
+    // registration in the epoll set outlives the fd.
+    int oldFile = dup(oldPipe.receiveFd);
+    int fd = oldPipe.receiveFd;
+    ::close(oldPipe.receiveFd);
+    oldPipe.receiveFd = -1;
+    oldPipe.writeSignal();
+
+    Pipe newPipe;
+    ASSERT_EQ(fd, newPipe.receiveFd)
+            << "the new pipe should reuse the fd number of the old one";
+    StubCallbackHandler newHandler(true);
+    newHandler.setCallback(mLooper, newPipe.receiveFd, Looper::EVENT_INPUT);
+
+    for (int i = 0; i < 3; i++) {
+        mLooper->pollOnce(0);
+    }
+
+    EXPECT_EQ(0, newHandler.callbackCount)
+            << "the new callback should not be invoked for events on the old file";
+    EXPECT_EQ(0, oldHandler.callbackCount)
+            << "the old callback was replaced";
+
+    newPipe.writeSignal();
+    mLooper->pollOnce(0);
+
+    EXPECT_EQ(1, newHandler.callbackCount)
+            << "the new callback should be invoked for events on the new file";
+    ::close(oldFile);
+}
+
 } // namespace android
@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdint.h>
+
+#include <benchmark/benchmark.h>
+#include <utils/LruCache.h>
+
+using android::LruCache;
+
+// Lookups that hit, as in a glyph or texture cache that is warm.
+void BM_LruCache_get(benchmark::State& state) {
+    const uint32_t size = state.range(0);
+    LruCache<uint32_t, uint32_t> cache(size);
+    for (uint32_t i = 0; i < size; i++) {
+        cache.put(i, i + 1);
+    }
+    uint32_t key = 0;
+    while (state.KeepRunning()) {
+        benchmark::DoNotOptimize(cache.get(key));
+        key = (key + 7) % size;
+    }
+}
+BENCHMARK(BM_LruCache_get)->Arg(64)->Arg(4096);
+
+// Every put misses and evicts the oldest entry.
+void BM_LruCache_put_evict(benchmark::State& state) {
+    const uint32_t size = state.range(0);
+    LruCache<uint32_t, uint32_t> cache(size);
+    uint32_t key = 0;
+    while (state.KeepRunning()) {
+        cache.put(key, key);
+        key++;
+    }
+}
+BENCHMARK(BM_LruCache_put_evict)->Arg(64)->Arg(4096);
@@ -16,6 +16,9 @@
 
 #include <stdlib.h>
 
+#include <list>
+#include <unordered_set>
+
 #include <android/log.h>
 #include <gtest/gtest.h>
 #include <utils/JenkinsHash.h>
@@ -456,4 +459,52 @@ TEST_F(LruCacheTest, DontCopyKeyInGet) {
     cache.get(KeyFailsOnCopy(0));
 }
 
+
+TEST_F(LruCacheTest, MatchesReferenceModel) {
+    // Few enough keys that the cache stays full, so that puts evict and removes hit often.
+    constexpr int kKeys = 64;
+    LruCache<int, int> cache(24);
+    std::list<std::pair<int, int>> model;  // Youngest first.
+    srand(1);
+    for (int i = 0; i < 20000; i++) {
+        int key = rand() % kKeys;
+        auto it = model.begin();
+        while (it != model.end() && it->first != key) {
+            ++it;
+        }
+        switch (rand() % 3) {
+            case 0: {
+                int expected = it == model.end() ? 0 : it->second;
+                if (it != model.end()) {
+                    model.splice(model.begin(), model, it);
+                }
+                ASSERT_EQ(expected, cache.get(key));
+                break;
+            }
+            case 1:
+                if (model.size() >= 24) {
+                    if (it != model.end() && std::next(it) == model.end()) {
+                        it = model.end();
+                    }
+                    model.pop_back();
+                }
+                if (it == model.end()) {
+                    model.emplace_front(key, i + 1);
+                }
+                ASSERT_EQ(it == model.end(), cache.put(key, i + 1));
+                break;
+            default:
+                if (it != model.end()) {
+                    model.erase(it);
+                    ASSERT_TRUE(cache.remove(key));
+                } else {
+                    ASSERT_FALSE(cache.remove(key));
+                }
+                break;
+        }
+        ASSERT_EQ(model.size(), cache.size());
+        ASSERT_EQ(model.empty() ? 0 : model.back().second, cache.peekOldestValue());
+    }
+}
+
 }
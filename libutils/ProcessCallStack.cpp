@@ -127,6 +127,14 @@ void ProcessCallStack::clear() {
 }
 
 void ProcessCallStack::update() {
+    collect(/*symbolize*/true);
+}
+
+void ProcessCallStack::capture() {
+    collect(/*symbolize*/false);
+}
+
+void ProcessCallStack::collect(bool symbolize) {
     std::unique_ptr<DIR, decltype(&closedir)> dp(opendir(PATH_SELF_TASK), closedir);
     if (dp == nullptr) {
         ALOGE("%s: Failed to update the process's call stacks: %s",
@@ -179,7 +187,11 @@ void ProcessCallStack::update() {
         int ignoreDepth = (selfPid == tid) ? IGNORE_DEPTH_CURRENT_THREAD : 0;
 
         // Update thread's call stacks
-        threadInfo.callStack.update(ignoreDepth, tid);
+        if (symbolize) {
+            threadInfo.callStack.update(ignoreDepth, tid);
+        } else {
+            threadInfo.callStack.capture(ignoreDepth, tid);
+        }
 
         // Read/save thread name
         threadInfo.threadName = getThreadName(tid);
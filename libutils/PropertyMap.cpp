@@ -18,6 +18,10 @@
 
 #include <utils/PropertyMap.h>
 
+#include <string_view>
+
+#include <utils/Log.h>
+
 // Enables debug output for the parser.
 #define DEBUG_PARSER 0
 
@@ -44,20 +48,26 @@ void PropertyMap::clear() {
 }
 
 void PropertyMap::addProperty(const String8& key, const String8& value) {
-    mProperties.add(key, value);
+    mProperties[std::string(key.string(), key.length())] =
+            std::string(value.string(), value.length());
+}
+
+const std::string* PropertyMap::findProperty(const String8& key) const {
+    auto it = mProperties.find(std::string(key.string(), key.length()));
+    return it != mProperties.end() ? &it->second : nullptr;
 }
 
 bool PropertyMap::hasProperty(const String8& key) const {
-    return mProperties.indexOfKey(key) >= 0;
+    return findProperty(key) != nullptr;
 }
 
 bool PropertyMap::tryGetProperty(const String8& key, String8& outValue) const {
-    ssize_t index = mProperties.indexOfKey(key);
-    if (index < 0) {
+    const std::string* value = findProperty(key);
+    if (!value) {
         return false;
     }
 
-    outValue = mProperties.valueAt(index);
+    outValue.setTo(value->c_str(), value->size());
     return true;
 }
 
@@ -72,16 +82,16 @@ bool PropertyMap::tryGetProperty(const String8& key, bool& outValue) const {
 }
 
 bool PropertyMap::tryGetProperty(const String8& key, int32_t& outValue) const {
-    String8 stringValue;
-    if (! tryGetProperty(key, stringValue) || stringValue.length() == 0) {
+    const std::string* stringValue = findProperty(key);
+    if (!stringValue || stringValue->empty()) {
         return false;
     }
 
     char* end;
-    int value = strtol(stringValue.string(), & end, 10);
+    int value = strtol(stringValue->c_str(), & end, 10);
     if (*end != '\0') {
         ALOGW("Property key '%s' has invalid value '%s'.  Expected an integer.",
-                key.string(), stringValue.string());
+                key.string(), stringValue->c_str());
         return false;
     }
     outValue = value;
@@ -89,16 +99,16 @@ bool PropertyMap::tryGetProperty(const String8& key, int32_t& outValue) const {
 }
 
 bool PropertyMap::tryGetProperty(const String8& key, float& outValue) const {
-    String8 stringValue;
-    if (! tryGetProperty(key, stringValue) || stringValue.length() == 0) {
+    const std::string* stringValue = findProperty(key);
+    if (!stringValue || stringValue->empty()) {
         return false;
     }
 
     char* end;
-    float value = strtof(stringValue.string(), & end);
+    float value = strtof(stringValue->c_str(), & end);
     if (*end != '\0') {
         ALOGW("Property key '%s' has invalid value '%s'.  Expected a float.",
-                key.string(), stringValue.string());
+                key.string(), stringValue->c_str());
         return false;
     }
     outValue = value;
@@ -106,8 +116,8 @@ bool PropertyMap::tryGetProperty(const String8& key, float& outValue) const {
 }
 
 void PropertyMap::addAll(const PropertyMap* map) {
-    for (size_t i = 0; i < map->mProperties.size(); i++) {
-        mProperties.add(map->mProperties.keyAt(i), map->mProperties.valueAt(i));
+    for (const auto& [key, value] : map->mProperties) {
+        mProperties[key] = value;
     }
 }
 
@@ -166,8 +176,9 @@ status_t PropertyMap::Parser::parse() {
         mTokenizer->skipDelimiters(WHITESPACE);
 
         if (!mTokenizer->isEol() && mTokenizer->peekChar() != '#') {
-            String8 keyToken = mTokenizer->nextToken(WHITESPACE_OR_PROPERTY_DELIMITER);
-            if (keyToken.isEmpty()) {
+            // The tokens are views into the file, only copied once they go into the map.
+            std::string_view keyToken = mTokenizer->nextTokenView(WHITESPACE_OR_PROPERTY_DELIMITER);
+            if (keyToken.empty()) {
                 ALOGE("%s: Expected non-empty property key.", mTokenizer->getLocation().string());
                 return BAD_VALUE;
             }
@@ -182,8 +193,8 @@ status_t PropertyMap::Parser::parse() {
 
             mTokenizer->skipDelimiters(WHITESPACE);
 
-            String8 valueToken = mTokenizer->nextToken(WHITESPACE);
-            if (valueToken.find("\\", 0) >= 0 || valueToken.find("\"", 0) >= 0) {
+            std::string_view valueToken = mTokenizer->nextTokenView(WHITESPACE);
+            if (valueToken.find_first_of("\\\"") != std::string_view::npos) {
                 ALOGE("%s: Found reserved character '\\' or '\"' in property value.",
                         mTokenizer->getLocation().string());
                 return BAD_VALUE;
@@ -197,13 +208,12 @@ status_t PropertyMap::Parser::parse() {
                 return BAD_VALUE;
             }
 
-            if (mMap->hasProperty(keyToken)) {
-                ALOGE("%s: Duplicate property value for key '%s'.",
-                        mTokenizer->getLocation().string(), keyToken.string());
+            if (!mMap->mProperties.try_emplace(std::string(keyToken), valueToken).second) {
+                ALOGE("%s: Duplicate property value for key '%.*s'.",
+                        mTokenizer->getLocation().string(), static_cast<int>(keyToken.size()),
+                        keyToken.data());
                 return BAD_VALUE;
             }
-
-            mMap->addProperty(keyToken, valueToken);
         }
 
         mTokenizer->nextLine();
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <android-base/file.h>
+#include <benchmark/benchmark.h>
+#include <utils/PropertyMap.h>
+#include <utils/Tokenizer.h>
+
+using android::PropertyMap;
+using android::String8;
+using android::Tokenizer;
+
+// Along the lines of the input device configuration of a touch screen.
+static const char kIdc[] =
+        "# Touch screen configuration.\n"
+        "device.internal = 1\n"
+        "touch.deviceType = touchScreen\n"
+        "touch.orientationAware = 1\n"
+        "touch.size.calibration = diameter\n"
+        "touch.size.scale = 10\n"
+        "touch.size.bias = 0\n"
+        "touch.size.isSummed = 0\n"
+        "touch.pressure.calibration = amplitude\n"
+        "touch.pressure.scale = 0.005\n"
+        "touch.orientation.calibration = none\n"
+        "touch.distance.calibration = none\n"
+        "touch.distance.scale = 0\n"
+        "touch.coverage.calibration = box\n"
+        "touch.gestureMode = spots\n"
+        "touch.wake = 1\n"
+        "\n"
+        "# Keyboard.\n"
+        "keyboard.layout = qwerty\n"
+        "keyboard.characterMap = qwerty\n"
+        "keyboard.orientationAware = 1\n"
+        "keyboard.builtIn = 1\n"
+        "cursor.mode = navigation\n"
+        "cursor.orientationAware = 1\n";
+
+// Along the lines of Generic.kl, the fallback key layout that every keyboard loads.
+static String8 makeKeyLayout() {
+    static const char* kKeys[] = {"ESCAPE", "1",         "2",     "3",     "4",
+                                  "5",      "6",         "7",     "8",     "9",
+                                  "0",      "MINUS",     "EQUALS", "DEL",  "TAB",
+                                  "Q",      "W",         "E",     "R",     "T",
+                                  "Y",      "U",         "I",     "O",     "P",
+                                  "LEFT_BRACKET", "RIGHT_BRACKET", "ENTER", "CTRL_LEFT", "A"};
+    String8 contents("# Generic key layout file.\n\n");
+    for (int i = 0; i < 480; ++i) {
+        contents.appendFormat("key %d     %s%s\n", i + 1, kKeys[i % 30],
+                              i % 7 == 0 ? "     FUNCTION" : "");
+    }
+    return contents;
+}
+
+// Tokenizes a key layout the way KeyLayoutMap does, without keeping the tokens.
+void BM_Tokenizer_keyLayout(benchmark::State& state) {
+    String8 contents = makeKeyLayout();
+    while (state.KeepRunning()) {
+        Tokenizer* tokenizer;
+        Tokenizer::fromContents(String8("Generic.kl"), contents.string(), &tokenizer);
+        size_t tokens = 0;
+        while (!tokenizer->isEof()) {
+            tokenizer->skipDelimiters(" \t\r");
+            while (!tokenizer->isEol() && tokenizer->peekChar() != '#') {
+                String8 token = tokenizer->nextToken(" \t\r");
+                tokens += token.length();
+                tokenizer->skipDelimiters(" \t\r");
+            }
+            tokenizer->nextLine();
+        }
+        benchmark::DoNotOptimize(tokens);
+        delete tokenizer;
+    }
+}
+BENCHMARK(BM_Tokenizer_keyLayout);
+
+void BM_Tokenizer_keyLayoutView(benchmark::State& state) {
+    String8 contents = makeKeyLayout();
+    while (state.KeepRunning()) {
+        Tokenizer* tokenizer;
+        Tokenizer::fromContents(String8("Generic.kl"), contents.string(), &tokenizer);
+        size_t tokens = 0;
+        while (!tokenizer->isEof()) {
+            tokenizer->skipDelimiters(" \t\r");
+            while (!tokenizer->isEol() && tokenizer->peekChar() != '#') {
+                std::string_view token = tokenizer->nextTokenView(" \t\r");
+                tokens += token.size();
+                tokenizer->skipDelimiters(" \t\r");
+            }
+            tokenizer->nextLine();
+        }
+        benchmark::DoNotOptimize(tokens);
+        delete tokenizer;
+    }
+}
+BENCHMARK(BM_Tokenizer_keyLayoutView);
+
+void BM_PropertyMap_load(benchmark::State& state) {
+    TemporaryFile tf;
+    android::base::WriteStringToFile(kIdc, tf.path);
+    while (state.KeepRunning()) {
+        PropertyMap* map;
+        PropertyMap::load(String8(tf.path), &map);
+        benchmark::DoNotOptimize(map);
+        delete map;
+    }
+}
+BENCHMARK(BM_PropertyMap_load);
+
+void BM_PropertyMap_tryGetProperty(benchmark::State& state) {
+    TemporaryFile tf;
+    android::base::WriteStringToFile(kIdc, tf.path);
+    PropertyMap* map;
+    PropertyMap::load(String8(tf.path), &map);
+    String8 key("touch.pressure.scale");
+    while (state.KeepRunning()) {
+        float value;
+        benchmark::DoNotOptimize(map->tryGetProperty(key, value));
+    }
+    delete map;
+}
+BENCHMARK(BM_PropertyMap_tryGetProperty);
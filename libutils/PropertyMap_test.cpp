@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utils/PropertyMap.h"
+
+#include <memory>
+
+#include <gtest/gtest.h>
+
+#include "android-base/file.h"
+
+using android::PropertyMap;
+using android::String8;
+using android::Tokenizer;
+
+static std::unique_ptr<PropertyMap> load(const char* contents) {
+    TemporaryFile tf;
+    if (!android::base::WriteStringToFile(contents, tf.path)) return nullptr;
+    PropertyMap* map;
+    if (PropertyMap::load(String8(tf.path), &map) != android::OK) return nullptr;
+    return std::unique_ptr<PropertyMap>(map);
+}
+
+TEST(PropertyMap, load) {
+    std::unique_ptr<PropertyMap> map = load(
+            "# Comment\n"
+            "touch.deviceType = touchScreen\n"
+            "  touch.orientationAware=1  \n"
+            "\n"
+            "touch.pressure.scale\t= 0.005\n"
+            "empty =\n");
+    ASSERT_TRUE(map != nullptr);
+    EXPECT_EQ(4u, map->getProperties().size());
+
+    String8 string;
+    ASSERT_TRUE(map->tryGetProperty(String8("touch.deviceType"), string));
+    EXPECT_EQ(String8("touchScreen"), string);
+    ASSERT_TRUE(map->tryGetProperty(String8("empty"), string));
+    EXPECT_EQ(String8(""), string);
+
+    bool boolean = false;
+    ASSERT_TRUE(map->tryGetProperty(String8("touch.orientationAware"), boolean));
+    EXPECT_TRUE(boolean);
+
+    float number = 0;
+    ASSERT_TRUE(map->tryGetProperty(String8("touch.pressure.scale"), number));
+    EXPECT_FLOAT_EQ(0.005f, number);
+
+    // Values that don't parse, or aren't there, leave the output alone.
+    int32_t integer = 7;
+    EXPECT_FALSE(map->tryGetProperty(String8("touch.deviceType"), integer));
+    EXPECT_FALSE(map->tryGetProperty(String8("empty"), integer));
+    EXPECT_FALSE(map->tryGetProperty(String8("missing"), integer));
+    EXPECT_EQ(7, integer);
+    EXPECT_FALSE(map->hasProperty(String8("touch")));
+}
+
+TEST(PropertyMap, load_errors) {
+    EXPECT_EQ(nullptr, load("key = value\nkey = other\n"));
+    EXPECT_EQ(nullptr, load("key value\n"));
+    EXPECT_EQ(nullptr, load("= value\n"));
+    EXPECT_EQ(nullptr, load("key = two values\n"));
+    EXPECT_EQ(nullptr, load("key = \"quoted\"\n"));
+    EXPECT_EQ(nullptr, load("key = back\\slash\n"));
+}
+
+TEST(PropertyMap, addAll) {
+    PropertyMap map;
+    map.addProperty(String8("a"), String8("1"));
+    map.addProperty(String8("b"), String8("2"));
+
+    PropertyMap other;
+    other.addProperty(String8("b"), String8("3"));
+    other.addProperty(String8("c"), String8("4"));
+    map.addAll(&other);
+
+    int32_t value;
+    ASSERT_TRUE(map.tryGetProperty(String8("a"), value));
+    EXPECT_EQ(1, value);
+    ASSERT_TRUE(map.tryGetProperty(String8("b"), value));
+    EXPECT_EQ(3, value);
+    ASSERT_TRUE(map.tryGetProperty(String8("c"), value));
+    EXPECT_EQ(4, value);
+
+    map.clear();
+    EXPECT_FALSE(map.hasProperty(String8("a")));
+}
+
+TEST(Tokenizer, nextTokenView) {
+    Tokenizer* tokenizer;
+    ASSERT_EQ(android::OK,
+              Tokenizer::fromContents(String8("test"), "key 1  ESCAPE\nnext", &tokenizer));
+    std::unique_ptr<Tokenizer> owner(tokenizer);
+
+    EXPECT_EQ("key", tokenizer->nextTokenView(" "));
+    tokenizer->skipDelimiters(" ");
+    EXPECT_EQ(String8("1"), tokenizer->nextToken(" "));
+    tokenizer->skipDelimiters(" ");
+    EXPECT_EQ("ESCAPE", tokenizer->nextTokenView(" "));
+    EXPECT_TRUE(tokenizer->isEol());
+    EXPECT_EQ("", tokenizer->nextTokenView(" "));
+
+    tokenizer->nextLine();
+    EXPECT_EQ(2, tokenizer->getLineNumber());
+    EXPECT_EQ("next", tokenizer->nextTokenView(" "));
+    EXPECT_TRUE(tokenizer->isEof());
+}
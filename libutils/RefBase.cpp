@@ -17,6 +17,8 @@
 #define LOG_TAG "RefBase"
 // #define LOG_NDEBUG 0
 
+#include <pthread.h>
+
 #include <memory>
 
 #include <android-base/macros.h>
@@ -153,6 +155,9 @@ public:
     RefBase* const          mBase;
     std::atomic<int32_t>    mFlags;
 
+    static void* operator new(size_t size);
+    static void operator delete(void* p);
+
 #if !DEBUG_REFS
 
     explicit weakref_impl(RefBase* base)
@@ -406,6 +411,89 @@ private:
 #endif
 };
 
+// Every RefBase allocates a weakref_impl, and binder creates and destroys RefBase objects at a
+// high rate, so each thread keeps a few freed weakref_impls to reuse instead of going to malloc.
+// A weakref_impl is often freed on a different thread than the one that allocated it; it then
+// simply joins the cache of the freeing thread.
+
+// Large enough to absorb bursts of short-lived objects, small enough not to matter for memory.
+// Reusing freed memory would hide use-after-free bugs from the sanitizers, so don't there.
+#if defined(__has_feature)
+#if __has_feature(address_sanitizer) || __has_feature(hwaddress_sanitizer)
+#define WEAKREF_CACHE_DISABLED 1
+#endif
+#endif
+#if defined(__SANITIZE_ADDRESS__) || defined(WEAKREF_CACHE_DISABLED)
+static constexpr size_t kMaxCachedWeakrefs = 0;
+#else
+static constexpr size_t kMaxCachedWeakrefs = 32;
+#endif
+
+namespace {
+
+struct WeakrefCache {
+    struct Node {
+        Node* next;
+    };
+    Node* head;
+    size_t count;
+    // Whether the pthread key destructor that empties the cache has been set up for this thread.
+    bool registered;
+    // Set once the thread is exiting and the cache has been emptied.
+    bool drained;
+};
+
+// Trivially destructible, so that it can still be used by thread_local destructors that drop
+// references.  The pthread key destructor, which runs after them, empties the cache.
+thread_local WeakrefCache gWeakrefCache;
+
+void drainWeakrefCache(void* arg) {
+    WeakrefCache* cache = static_cast<WeakrefCache*>(arg);
+    while (cache->head != nullptr) {
+        WeakrefCache::Node* node = cache->head;
+        cache->head = node->next;
+        ::operator delete(node);
+    }
+    cache->count = 0;
+    cache->drained = true;
+}
+
+bool registerWeakrefCache(WeakrefCache* cache) {
+    static pthread_key_t key;
+    static bool keyCreated = pthread_key_create(&key, drainWeakrefCache) == 0;
+    cache->registered = keyCreated && pthread_setspecific(key, cache) == 0;
+    return cache->registered;
+}
+
+}  // namespace
+
+void* RefBase::weakref_impl::operator new(size_t size)
+{
+    WeakrefCache* cache = &gWeakrefCache;
+    if (cache->head != nullptr) {
+        WeakrefCache::Node* node = cache->head;
+        cache->head = node->next;
+        cache->count--;
+        return node;
+    }
+    return ::operator new(size);
+}
+
+void RefBase::weakref_impl::operator delete(void* p)
+{
+    static_assert(sizeof(weakref_impl) >= sizeof(WeakrefCache::Node));
+    WeakrefCache* cache = &gWeakrefCache;
+    if (cache->drained || cache->count >= kMaxCachedWeakrefs ||
+            (!cache->registered && !registerWeakrefCache(cache))) {
+        ::operator delete(p);
+        return;
+    }
+    WeakrefCache::Node* node = static_cast<WeakrefCache::Node*>(p);
+    node->next = cache->head;
+    cache->head = node;
+    cache->count++;
+}
+
 // ---------------------------------------------------------------------------
 
 void RefBase::incStrong(const void* id) const
@@ -433,7 +521,16 @@ void RefBase::decStrong(const void* id) const
 {
     weakref_impl* const refs = mRefs;
     refs->removeStrongRef(id);
-    const int32_t c = refs->mStrong.fetch_sub(1, std::memory_order_release);
+    int32_t c;
+    if (refs->mWeak.load(std::memory_order_acquire) == 1) {
+        // Ours is the only reference of any kind, so nothing else can be touching the counts
+        // and we can skip the atomic read-modify-writes.  The acquire load synchronizes with the
+        // release decrements of the references that went away before ours.
+        c = refs->mStrong.load(std::memory_order_relaxed);
+        refs->mStrong.store(c - 1, std::memory_order_relaxed);
+    } else {
+        c = refs->mStrong.fetch_sub(1, std::memory_order_release);
+    }
 #if PRINT_REFS
     ALOGD("decStrong of %p from %p: cnt=%d\n", this, id, c);
 #endif
@@ -512,11 +609,17 @@ void RefBase::weakref_type::decWeak(const void* id)
 {
     weakref_impl* const impl = static_cast<weakref_impl*>(this);
     impl->removeWeakRef(id);
-    const int32_t c = impl->mWeak.fetch_sub(1, std::memory_order_release);
-    LOG_ALWAYS_FATAL_IF(BAD_WEAK(c), "decWeak called on %p too many times",
-            this);
-    if (c != 1) return;
-    atomic_thread_fence(std::memory_order_acquire);
+    if (impl->mWeak.load(std::memory_order_acquire) == 1) {
+        // The last reference; see decStrong().  This is the common case for objects that are
+        // only ever held by a single sp<>.
+        impl->mWeak.store(0, std::memory_order_relaxed);
+    } else {
+        const int32_t c = impl->mWeak.fetch_sub(1, std::memory_order_release);
+        LOG_ALWAYS_FATAL_IF(BAD_WEAK(c), "decWeak called on %p too many times",
+                this);
+        if (c != 1) return;
+        atomic_thread_fence(std::memory_order_acquire);
+    }
 
     int32_t flags = impl->mFlags.load(std::memory_order_relaxed);
     if ((flags&OBJECT_LIFETIME_MASK) == OBJECT_LIFETIME_STRONG) {
@@ -0,0 +1,69 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <utils/LightRefBase.h>
+#include <utils/RefBase.h>
+#include <utils/StrongPointer.h>
+
+using android::LightRefBase;
+using android::RefBase;
+using android::sp;
+using android::wp;
+
+class Heavy : public RefBase {};
+class Light : public LightRefBase<Light> {};
+
+// Allocating an object and dropping its only reference, as binder does for every transaction.
+template <typename T>
+void BM_sp_create(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        sp<T> p = new T();
+        benchmark::DoNotOptimize(p.get());
+    }
+}
+BENCHMARK_TEMPLATE(BM_sp_create, Heavy);
+BENCHMARK_TEMPLATE(BM_sp_create, Light);
+
+template <typename T>
+void BM_sp_copy(benchmark::State& state) {
+    sp<T> p = new T();
+    while (state.KeepRunning()) {
+        sp<T> copy = p;
+        benchmark::DoNotOptimize(copy.get());
+    }
+}
+BENCHMARK_TEMPLATE(BM_sp_copy, Heavy);
+BENCHMARK_TEMPLATE(BM_sp_copy, Light);
+
+void BM_wp_promote(benchmark::State& state) {
+    sp<Heavy> p = new Heavy();
+    wp<Heavy> w = p;
+    while (state.KeepRunning()) {
+        sp<Heavy> promoted = w.promote();
+        benchmark::DoNotOptimize(promoted.get());
+    }
+}
+BENCHMARK(BM_wp_promote);
+
+// Every thread allocates and frees its own objects, so contention on the allocator shows up.
+void BM_sp_create_threaded(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        sp<Heavy> p = new Heavy();
+        benchmark::DoNotOptimize(p.get());
+    }
+}
+BENCHMARK(BM_sp_create_threaded)->ThreadRange(1, 8);
@@ -20,6 +20,7 @@
 #include <utils/RefBase.h>
 
 #include <thread>
+#include <vector>
 #include <atomic>
 #include <sched.h>
 #include <errno.h>
@@ -406,3 +407,40 @@ TEST(RefBase, RacingPromotions) {
         ASSERT_EQ(NITERS, deleteCount) << "Deletions missed!";
     }  // Otherwise this is slow and probably pointless on a uniprocessor.
 }
+
+class Counted : public RefBase {
+public:
+    explicit Counted(std::atomic<int>* delete_count) : mDeleteCount(delete_count) {}
+    ~Counted() { (*mDeleteCount)++; }
+private:
+    std::atomic<int>* mDeleteCount;
+};
+
+// Objects released on a different thread than the one that created them, some of them from a
+// thread_local destructor, so that the per-thread weakref_impl caches are exercised.
+TEST(RefBase, CrossThreadReleases) {
+    static constexpr int kObjects = 1000;
+    static constexpr int kRounds = 10;
+    std::atomic<int> deleteCount(0);
+    for (int round = 0; round < kRounds; ++round) {
+        std::vector<sp<Counted>> objects;
+        for (int i = 0; i < kObjects; ++i) {
+            objects.push_back(new Counted(&deleteCount));
+        }
+        std::vector<wp<Counted>> weak(objects.begin(), objects.end());
+        std::thread t([&objects, &deleteCount]() {
+            thread_local std::vector<sp<Counted>> held;
+            held.swap(objects);
+            // Drop half the references here, and the rest when the thread exits.
+            held.resize(kObjects / 2);
+            for (int i = 0; i < kObjects; ++i) {
+                sp<Counted> temporary = new Counted(&deleteCount);
+            }
+        });
+        t.join();
+        for (const auto& w : weak) {
+            ASSERT_EQ(nullptr, w.promote().get());
+        }
+    }
+    ASSERT_EQ(2 * kRounds * kObjects, deleteCount);
+}
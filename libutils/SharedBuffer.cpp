@@ -41,6 +41,7 @@ SharedBuffer* SharedBuffer::alloc(size_t size)
         // The following is OK on Android-supported platforms.
         sb->mRefs.store(1, std::memory_order_relaxed);
         sb->mSize = size;
+        sb->mSpare = 0;
         sb->mClientMetadata = 0;
     }
     return sb;
@@ -78,6 +79,7 @@ SharedBuffer* SharedBuffer::editResize(size_t newSize) const
         buf = (SharedBuffer*)realloc(buf, sizeof(SharedBuffer) + newSize);
         if (buf != nullptr) {
             buf->mSize = newSize;
+            buf->mSpare = 0;
             return buf;
         }
     }
@@ -90,6 +92,28 @@ SharedBuffer* SharedBuffer::editResize(size_t newSize) const
     return sb;    
 }
 
+SharedBuffer* SharedBuffer::editGrow(size_t newSize) const
+{
+    if (onlyOwner() && newSize <= capacity()) {
+        SharedBuffer* buf = const_cast<SharedBuffer*>(this);
+        buf->mSpare = static_cast<uint32_t>(buf->capacity() - newSize);
+        buf->mSize = newSize;
+        return buf;
+    }
+    // Grow by half, as long as the spare room fits in mSpare.
+    size_t grown = mSize + mSize / 2;
+    if (grown < newSize || grown - newSize > UINT32_MAX ||
+            grown >= SIZE_MAX - sizeof(SharedBuffer)) {
+        grown = newSize;
+    }
+    SharedBuffer* buf = editResize(grown);
+    if (buf) {
+        buf->mSpare = static_cast<uint32_t>(buf->mSize - newSize);
+        buf->mSize = newSize;
+    }
+    return buf;
+}
+
 SharedBuffer* SharedBuffer::attemptEdit() const
 {
     if (onlyOwner()) {
@@ -74,6 +74,15 @@ public:
     //! edit the buffer, resizing if needed
                     SharedBuffer*           editResize(size_t size) const;
 
+    /*! like editResize(), but when the buffer has to grow, allocate more than
+     *  asked for so that a series of small increases only reallocates a
+     *  logarithmic number of times. Shrinking keeps the memory for later.
+     */
+                    SharedBuffer*           editGrow(size_t size) const;
+
+    //! get the size the buffer can be grown to by editGrow() without reallocating
+    inline          size_t                  capacity() const;
+
     //! like edit() but fails if a copy is required
                     SharedBuffer*           attemptEdit() const;
     
@@ -102,7 +111,8 @@ private:
         // Must be sized to preserve correct alignment.
         mutable std::atomic<int32_t>        mRefs;
                 size_t                      mSize;
-                uint32_t                    mReserved;
+                // Bytes allocated past mSize, left by editGrow().
+                uint32_t                    mSpare;
 public:
         // mClientMetadata is reserved for client use.  It is initialized to 0
         // and the clients can do whatever they want with it.  Note that this is
@@ -128,6 +138,10 @@ size_t SharedBuffer::size() const {
     return mSize;
 }
 
+size_t SharedBuffer::capacity() const {
+    return mSize + mSpare;
+}
+
 SharedBuffer* SharedBuffer::bufferFromData(void* data) {
     return data ? static_cast<SharedBuffer *>(data)-1 : nullptr;
 }
@@ -56,3 +56,36 @@ TEST(SharedBufferTest, TestEditResize) {
   ASSERT_EQ(0U, buf->size());
   buf->release();
 }
+
+TEST(SharedBufferTest, TestEditGrow) {
+  android::SharedBuffer* buf = android::SharedBuffer::alloc(10);
+  memset(buf->data(), 'a', 10);
+  buf = buf->editGrow(11);
+  ASSERT_NE(nullptr, buf);
+  ASSERT_EQ(11U, buf->size());
+  ASSERT_EQ(15U, buf->capacity());
+  EXPECT_EQ(0, memcmp(buf->data(), "aaaaaaaaaa", 10));
+
+  // Growing within the capacity, or shrinking, keeps the same memory.
+  android::SharedBuffer* same = buf->editGrow(15);
+  EXPECT_EQ(buf, same);
+  EXPECT_EQ(15U, same->size());
+  same = buf->editGrow(2);
+  EXPECT_EQ(buf, same);
+  EXPECT_EQ(2U, same->size());
+  EXPECT_EQ(15U, same->capacity());
+
+  // A shared buffer is copied, leaving the other owner's alone.
+  buf->acquire();
+  android::SharedBuffer* copy = buf->editGrow(3);
+  ASSERT_NE(buf, copy);
+  EXPECT_EQ(3U, copy->size());
+  EXPECT_EQ(2U, buf->size());
+  EXPECT_EQ(0, memcmp(copy->data(), "aa", 2));
+  copy->release();
+
+  // editResize() gives back the spare capacity.
+  buf = buf->editResize(4);
+  EXPECT_EQ(4U, buf->capacity());
+  buf->release();
+}
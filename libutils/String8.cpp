@@ -118,6 +118,14 @@ static char* allocFromUTF32(const char32_t* in, size_t len)
     return resultStr;
 }
 
+// Whether room was reserved in the buffer, which appending to an empty string should use
+// rather than replace.
+static inline bool hasSpareCapacity(const char* str)
+{
+    const SharedBuffer* buf = SharedBuffer::bufferFromData(str);
+    return buf->capacity() > buf->size();
+}
+
 // ---------------------------------------------------------------------------
 
 String8::String8()
@@ -272,7 +280,7 @@ status_t String8::setTo(const char32_t* other, size_t len)
 status_t String8::append(const String8& other)
 {
     const size_t otherLen = other.bytes();
-    if (bytes() == 0) {
+    if (bytes() == 0 && !hasSpareCapacity(mString)) {
         setTo(other);
         return OK;
     } else if (otherLen == 0) {
@@ -289,7 +297,7 @@ status_t String8::append(const char* other)
 
 status_t String8::append(const char* other, size_t otherLen)
 {
-    if (bytes() == 0) {
+    if (bytes() == 0 && !hasSpareCapacity(mString)) {
         return setTo(other, otherLen);
     } else if (otherLen == 0) {
         return OK;
@@ -311,33 +319,53 @@ status_t String8::appendFormat(const char* fmt, ...)
 
 status_t String8::appendFormatV(const char* fmt, va_list args)
 {
-    int n, result = OK;
-    va_list tmp_args;
+    // Format straight into the spare capacity of the buffer, making sure there is at least a
+    // little.  Only output that doesn't fit is formatted a second time, once the buffer has
+    // been grown to its exact length.
+    static constexpr size_t kMinFormatSpace = 64;
 
+    const size_t oldLength = length();
+    if (oldLength > SIZE_MAX - kMinFormatSpace - 1) {
+        return NO_MEMORY;
+    }
+    SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
+        ->editGrow(oldLength + kMinFormatSpace + 1);
+    if (!buf) {
+        return NO_MEMORY;
+    }
+    const size_t space = buf->capacity() - oldLength;
+    buf = buf->editGrow(buf->capacity());
+    char* str = (char*)buf->data();
+    mString = str;
+
+    va_list tmp_args;
     /* args is undefined after vsnprintf.
      * So we need a copy here to avoid the
      * second vsnprintf access undefined args.
      */
     va_copy(tmp_args, args);
-    n = vsnprintf(nullptr, 0, fmt, tmp_args);
+    int n = vsnprintf(str + oldLength, space, fmt, tmp_args);
     va_end(tmp_args);
 
-    if (n < 0) return UNKNOWN_ERROR;
+    if (n < 0 || (size_t)n > SIZE_MAX - 1 || oldLength > SIZE_MAX - (size_t)n - 1) {
+        buf->editGrow(oldLength + 1);
+        str[oldLength] = '\0';
+        return n < 0 ? UNKNOWN_ERROR : NO_MEMORY;
+    }
 
-    if (n > 0) {
-        size_t oldLength = length();
-        if ((size_t)n > SIZE_MAX - 1 ||
-            oldLength > SIZE_MAX - (size_t)n - 1) {
-            return NO_MEMORY;
-        }
-        char* buf = lockBuffer(oldLength + n);
-        if (buf) {
-            vsnprintf(buf + oldLength, n + 1, fmt, args);
-        } else {
-            result = NO_MEMORY;
-        }
+    SharedBuffer* grown = buf->editGrow(oldLength + n + 1);
+    if (!grown) {
+        // Shrinking within the capacity can't fail, so this is the buffer being grown.
+        buf->editGrow(oldLength + 1);
+        str[oldLength] = '\0';
+        return NO_MEMORY;
     }
-    return result;
+    str = (char*)grown->data();
+    mString = str;
+    if ((size_t)n >= space) {
+        vsnprintf(str + oldLength, n + 1, fmt, args);
+    }
+    return OK;
 }
 
 status_t String8::real_append(const char* other, size_t otherLen)
@@ -345,7 +373,7 @@ status_t String8::real_append(const char* other, size_t otherLen)
     const size_t myLen = bytes();
 
     SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
-        ->editResize(myLen+otherLen+1);
+        ->editGrow(myLen+otherLen+1);
     if (buf) {
         char* str = (char*)buf->data();
         mString = str;
@@ -357,6 +385,22 @@ status_t String8::real_append(const char* other, size_t otherLen)
     return NO_MEMORY;
 }
 
+status_t String8::reserve(size_t size)
+{
+    const size_t len = length();
+    if (size <= len) {
+        return OK;
+    }
+    SharedBuffer* buf = SharedBuffer::bufferFromData(mString)->editGrow(size + 1);
+    if (!buf) {
+        return NO_MEMORY;
+    }
+    // Give back the length, keeping the memory as spare capacity.
+    buf = buf->editGrow(len + 1);
+    mString = (char*)buf->data();
+    return OK;
+}
+
 char* String8::lockBuffer(size_t size)
 {
     SharedBuffer* buf = SharedBuffer::bufferFromData(mString)
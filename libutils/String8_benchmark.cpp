@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <benchmark/benchmark.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+
+using android::String16;
+using android::String8;
+
+// Builds a string of state.range(0) pieces, as dump() implementations do.
+void BM_String8_append(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        String8 s;
+        for (int i = 0; i < state.range(0); ++i) {
+            s.append("field");
+        }
+        benchmark::DoNotOptimize(s.string());
+    }
+}
+BENCHMARK(BM_String8_append)->Arg(1)->Arg(16)->Arg(256);
+
+void BM_String8_append_reserved(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        String8 s;
+        s.reserve(state.range(0) * 5);
+        for (int i = 0; i < state.range(0); ++i) {
+            s.append("field");
+        }
+        benchmark::DoNotOptimize(s.string());
+    }
+}
+BENCHMARK(BM_String8_append_reserved)->Arg(1)->Arg(16)->Arg(256);
+
+void BM_String8_appendFormat(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        String8 s;
+        for (int i = 0; i < state.range(0); ++i) {
+            s.appendFormat("  %s: %d\n", "field", i);
+        }
+        benchmark::DoNotOptimize(s.string());
+    }
+}
+BENCHMARK(BM_String8_appendFormat)->Arg(1)->Arg(16)->Arg(256);
+
+void BM_String8_format(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        String8 s = String8::format("%s/%d", "android.hardware.foo@1.0::IFoo", 42);
+        benchmark::DoNotOptimize(s.string());
+    }
+}
+BENCHMARK(BM_String8_format);
+
+void BM_String16_from_utf8(benchmark::State& state) {
+    while (state.KeepRunning()) {
+        String16 s("android.hardware.foo@1.0::IFoo");
+        benchmark::DoNotOptimize(s.string());
+    }
+}
+BENCHMARK(BM_String16_from_utf8);
+
+void BM_String16_append(benchmark::State& state) {
+    const String16 piece(u"field");
+    while (state.KeepRunning()) {
+        String16 s;
+        for (int i = 0; i < state.range(0); ++i) {
+            s.append(piece);
+        }
+        benchmark::DoNotOptimize(s.string());
+    }
+}
+BENCHMARK(BM_String16_append)->Arg(1)->Arg(16)->Arg(256);
@@ -96,4 +96,42 @@ TEST_F(String8Test, CheckUtf32Conversion) {
     EXPECT_EQ(10U, string8.length());
 }
 
+TEST_F(String8Test, AppendFormat) {
+    String8 s("x");
+    String8 copy(s);
+    std::string expected = "x";
+    for (int i = 0; i < 200; ++i) {
+        ASSERT_EQ(OK, s.appendFormat("%d,", i));
+        expected += std::to_string(i) + ",";
+    }
+    // Longer than any spare capacity, so it is formatted twice.
+    std::string longString(1000, 'y');
+    ASSERT_EQ(OK, s.appendFormat("%s", longString.c_str()));
+    expected += longString;
+    EXPECT_STREQ(expected.c_str(), s.string());
+    EXPECT_EQ(expected.size(), s.length());
+    EXPECT_STREQ("x", copy.string());
+
+    ASSERT_EQ(OK, s.appendFormat("%s", ""));
+    EXPECT_EQ(expected.size(), s.length());
+}
+
+TEST_F(String8Test, Reserve) {
+    String8 s;
+    ASSERT_EQ(OK, s.reserve(100));
+    EXPECT_EQ(0U, s.length());
+    EXPECT_STREQ("", s.string());
+    const char* buffer = s.string();
+    for (int i = 0; i < 10; ++i) {
+        ASSERT_EQ(OK, s.append("0123456789"));
+    }
+    EXPECT_EQ(buffer, s.string());
+    EXPECT_EQ(100U, s.length());
+
+    String8 copy(s);
+    ASSERT_EQ(OK, s.append("!"));
+    EXPECT_EQ(100U, copy.length());
+    EXPECT_EQ(101U, s.length());
+}
+
 }
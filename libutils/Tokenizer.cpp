@@ -123,6 +123,11 @@ String8 Tokenizer::peekRemainderOfLine() const {
 }
 
 String8 Tokenizer::nextToken(const char* delimiters) {
+    std::string_view token = nextTokenView(delimiters);
+    return String8(token.data(), token.size());
+}
+
+std::string_view Tokenizer::nextTokenView(const char* delimiters) {
 #if DEBUG_TOKENIZER
     ALOGD("nextToken");
 #endif
@@ -135,7 +140,7 @@ String8 Tokenizer::nextToken(const char* delimiters) {
         }
         mCurrent += 1;
     }
-    return String8(tokenStart, mCurrent - tokenStart);
+    return std::string_view(tokenStart, mCurrent - tokenStart);
 }
 
 void Tokenizer::nextLine() {
@@ -18,6 +18,7 @@
 
 #include <android-base/macros.h>
 #include <limits.h>
+#include <string.h>
 #include <utils/Unicode.h>
 
 #include <log/log.h>
@@ -66,6 +67,29 @@ static const char32_t kFirstByteMark[] = {
     0x00000000, 0x00000000, 0x000000C0, 0x000000E0, 0x000000F0
 };
 
+// Most strings that cross binder are mostly ASCII (interface names, paths, keys), so the
+// conversions below skip through runs of it a 64-bit word at a time, and only decode
+// characters one by one otherwise.  The runs are only taken where the per-character code
+// would have produced exactly the same output, so the results don't change.
+static const size_t kAsciiRunUtf8 = 8;
+static const size_t kAsciiRunUtf16 = 4;
+
+// Whether the kAsciiRunUtf8 bytes at src are all ASCII, i.e. none has its top bit set.
+static inline bool is_ascii_run_utf8(const uint8_t* src)
+{
+    uint64_t word;
+    memcpy(&word, src, sizeof(word));
+    return (word & 0x8080808080808080ULL) == 0;
+}
+
+// Whether the kAsciiRunUtf16 code units at src are all ASCII, i.e. below 0x80.
+static inline bool is_ascii_run_utf16(const char16_t* src)
+{
+    uint64_t word;
+    memcpy(&word, src, sizeof(word));
+    return (word & 0xFF80FF80FF80FF80ULL) == 0;
+}
+
 // --------------------------------------------------------------------------
 // UTF-32
 // --------------------------------------------------------------------------
@@ -335,6 +359,16 @@ void utf16_to_utf8(const char16_t* src, size_t src_len, char* dst, size_t dst_le
     const char16_t* const end_utf16 = src + src_len;
     char *cur = dst;
     while (cur_utf16 < end_utf16) {
+        if (*cur_utf16 < 0x80 && size_t(end_utf16 - cur_utf16) >= kAsciiRunUtf16 &&
+                dst_len >= kAsciiRunUtf16 && is_ascii_run_utf16(cur_utf16)) {
+            for (size_t i = 0; i < kAsciiRunUtf16; i++) {
+                cur[i] = static_cast<char>(cur_utf16[i]);
+            }
+            cur_utf16 += kAsciiRunUtf16;
+            cur += kAsciiRunUtf16;
+            dst_len -= kAsciiRunUtf16;
+            continue;
+        }
         char32_t utf32;
         // surrogate pairs
         if((*cur_utf16 & 0xFC00) == 0xD800 && (cur_utf16 + 1) < end_utf16
@@ -412,7 +446,10 @@ ssize_t utf16_to_utf8_length(const char16_t *src, size_t src_len)
     const char16_t* const end = src + src_len;
     while (src < end) {
         size_t char_len;
-        if ((*src & 0xFC00) == 0xD800 && (src + 1) < end
+        if (*src < 0x80 && size_t(end - src) >= kAsciiRunUtf16 && is_ascii_run_utf16(src)) {
+            char_len = kAsciiRunUtf16;
+            src += kAsciiRunUtf16;
+        } else if ((*src & 0xFC00) == 0xD800 && (src + 1) < end
                 && (*(src + 1) & 0xFC00) == 0xDC00) {
             // surrogate pairs are always 4 bytes.
             char_len = 4;
@@ -490,6 +527,12 @@ ssize_t utf8_to_utf16_length(const uint8_t* u8str, size_t u8len, bool overreadIs
     /* Validate that the UTF-8 is the correct len */
     size_t u16measuredLen = 0;
     while (u8cur < u8end) {
+        if (*u8cur < 0x80 && size_t(u8end - u8cur) >= kAsciiRunUtf8 &&
+                is_ascii_run_utf8(u8cur)) {
+            u16measuredLen += kAsciiRunUtf8;
+            u8cur += kAsciiRunUtf8;
+            continue;
+        }
         u16measuredLen++;
         int u8charLen = utf8_codepoint_len(*u8cur);
         // Malformed utf8, some characters are beyond the end.
@@ -543,6 +586,15 @@ char16_t* utf8_to_utf16_no_null_terminator(
     char16_t* u16cur = dst;
 
     while (u8cur < u8end && u16cur < u16end) {
+        if (*u8cur < 0x80 && size_t(u8end - u8cur) >= kAsciiRunUtf8 &&
+                size_t(u16end - u16cur) >= kAsciiRunUtf8 && is_ascii_run_utf8(u8cur)) {
+            for (size_t i = 0; i < kAsciiRunUtf8; i++) {
+                u16cur[i] = u8cur[i];
+            }
+            u8cur += kAsciiRunUtf8;
+            u16cur += kAsciiRunUtf8;
+            continue;
+        }
         size_t u8len = utf8_codepoint_len(*u8cur);
         uint32_t codepoint = utf8_to_utf32_codepoint(u8cur, u8len);
 
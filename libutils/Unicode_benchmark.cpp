@@ -0,0 +1,74 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+#include <utils/Unicode.h>
+
+namespace {
+
+// Text of the kinds that go through binder: interface names and paths, European UI strings,
+// CJK UI strings, and chat text with emoji (surrogate pairs in UTF-16).
+const char* const kTexts[] = {
+        "android.hardware.graphics.composer@2.4::IComposerClient/default",
+        "Paramètres de l'écran de verrouillage et sécurité",
+        "画面ロックとセキュリティの設定を変更します",
+        "See you at 8 😀👍 ok? 🎉🎉",
+};
+
+std::string Repeat(const char* text, size_t length) {
+    std::string s;
+    while (s.size() < length) {
+        s += text;
+    }
+    return s;
+}
+
+std::u16string ToUtf16(const std::string& s) {
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(s.data());
+    std::u16string out(utf8_to_utf16_length(src, s.size()), u'\0');
+    utf8_to_utf16_no_null_terminator(src, s.size(), out.data(), out.size());
+    return out;
+}
+
+void BM_utf8_to_utf16(benchmark::State& state) {
+    std::string s = Repeat(kTexts[state.range(0)], state.range(1));
+    const uint8_t* src = reinterpret_cast<const uint8_t*>(s.data());
+    std::vector<char16_t> out(s.size() + 1);
+    while (state.KeepRunning()) {
+        ssize_t len = utf8_to_utf16_length(src, s.size());
+        utf8_to_utf16(src, s.size(), out.data(), len + 1);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * s.size());
+}
+BENCHMARK(BM_utf8_to_utf16)->ArgsProduct({{0, 1, 2, 3}, {16, 1024}});
+
+void BM_utf16_to_utf8(benchmark::State& state) {
+    std::u16string s = ToUtf16(Repeat(kTexts[state.range(0)], state.range(1)));
+    std::vector<char> out(s.size() * 3 + 1);
+    while (state.KeepRunning()) {
+        ssize_t len = utf16_to_utf8_length(s.data(), s.size());
+        utf16_to_utf8(s.data(), s.size(), out.data(), len + 1);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetBytesProcessed(state.iterations() * s.size() * sizeof(char16_t));
+}
+BENCHMARK(BM_utf16_to_utf8)->ArgsProduct({{0, 1, 2, 3}, {16, 1024}});
+
+}  // namespace
@@ -187,4 +187,34 @@ TEST_F(UnicodeTest, InvalidUtf8OverreadDetected) {
             true /* overreadIsFatal */), "" /* regex for ASSERT_DEATH */);
 }
 
+// ASCII is converted a word at a time; make sure runs of it that end, start or are broken up
+// in the middle of a word convert the same as one character at a time.
+TEST_F(UnicodeTest, MixedAsciiRuns) {
+    const char* const utf8 =
+            "interface@1.0::IFoo/d\u00e9faut ab\u3053cdefghijklmn\U0001F600xyz0123456789";
+    const char16_t* const utf16 =
+            u"interface@1.0::IFoo/d\u00e9faut ab\u3053cdefghijklmn\U0001F600xyz0123456789";
+    const size_t utf8_len = strlen(utf8);
+    const size_t utf16_len = strlen16(utf16);
+
+    for (size_t start = 0; start < utf8_len; ++start) {
+        // Skip starts that fall in the middle of a character.
+        if ((utf8[start] & 0xC0) == 0x80) continue;
+        const uint8_t* src = reinterpret_cast<const uint8_t*>(utf8) + start;
+        const size_t src_len = utf8_len - start;
+
+        ssize_t measured = utf8_to_utf16_length(src, src_len);
+        ASSERT_GT(measured, 0) << "start " << start;
+        char16_t converted[64];
+        utf8_to_utf16(src, src_len, converted, measured + 1);
+        const char16_t* expected = utf16 + utf16_len - measured;
+        EXPECT_EQ(0, strcmp16(expected, converted)) << "start " << start;
+
+        EXPECT_EQ(static_cast<ssize_t>(src_len), utf16_to_utf8_length(expected, measured));
+        char back[128];
+        utf16_to_utf8(expected, measured, back, sizeof(back));
+        EXPECT_STREQ(utf8 + start, back) << "start " << start;
+    }
+}
+
 }
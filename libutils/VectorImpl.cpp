@@ -157,6 +157,14 @@ ssize_t VectorImpl::insertAt(const void* item, size_t index, size_t numItems)
     return where ? index : (ssize_t)NO_MEMORY;
 }
 
+ssize_t VectorImpl::insertUninitializedAt(size_t index, size_t numItems)
+{
+    if (index > size())
+        return BAD_INDEX;
+    void* where = _grow(index, numItems);
+    return where ? index : (ssize_t)NO_MEMORY;
+}
+
 static int sortProxy(const void* lhs, const void* rhs, void* func)
 {
     return (*(VectorImpl::compar_t)func)(lhs, rhs);
@@ -344,8 +352,9 @@ ssize_t VectorImpl::setCapacity(size_t new_capacity)
     SharedBuffer* sb = SharedBuffer::alloc(new_allocation_size);
     if (sb) {
         void* array = sb->data();
-        _do_copy(array, mStorage, size());
-        release_storage();
+        const bool move = mStorage && SharedBuffer::bufferFromData(mStorage)->onlyOwner();
+        _do_transfer(array, mStorage, size(), move);
+        _release_storage(move);
         mStorage = const_cast<void*>(array);
     } else {
         return NO_MEMORY;
@@ -407,11 +416,7 @@ void* VectorImpl::_grow(size_t where, size_t amount)
                             "new_alloc_size overflow");
 
         // ALOGV("grow vector %p, new_capacity=%d", this, (int)new_capacity);
-        if ((mStorage) &&
-            (mCount==where) &&
-            (mFlags & HAS_TRIVIAL_COPY) &&
-            (mFlags & HAS_TRIVIAL_DTOR))
-        {
+        if (_can_resize_in_place()) {
             const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
             SharedBuffer* sb = cur_sb->editResize(new_alloc_size);
             if (sb) {
@@ -419,19 +424,25 @@ void* VectorImpl::_grow(size_t where, size_t amount)
             } else {
                 return nullptr;
             }
+            if (where != mCount) {
+                const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
+                void* to = reinterpret_cast<uint8_t *>(mStorage) + (where+amount)*mItemSize;
+                memmove(to, from, (mCount-where)*mItemSize);
+            }
         } else {
             SharedBuffer* sb = SharedBuffer::alloc(new_alloc_size);
             if (sb) {
                 void* array = sb->data();
+                const bool move = mStorage && SharedBuffer::bufferFromData(mStorage)->onlyOwner();
                 if (where != 0) {
-                    _do_copy(array, mStorage, where);
+                    _do_transfer(array, mStorage, where, move);
                 }
                 if (where != mCount) {
                     const void* from = reinterpret_cast<const uint8_t *>(mStorage) + where*mItemSize;
                     void* dest = reinterpret_cast<uint8_t *>(array) + (where+amount)*mItemSize;
-                    _do_copy(dest, from, mCount-where);
+                    _do_transfer(dest, from, mCount-where, move);
                 }
-                release_storage();
+                _release_storage(move);
                 mStorage = const_cast<void*>(array);
             } else {
                 return nullptr;
@@ -486,19 +497,38 @@ void VectorImpl::_shrink(size_t where, size_t amount)
             } else {
                 return;
             }
+        } else if (SharedBuffer::bufferFromData(mStorage)->onlyOwner() && _can_resize_in_place()) {
+            // Close the gap first, since editResize() keeps only the start of the buffer.
+            void* to = reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize;
+            _do_destroy(to, amount);
+            if (where != new_size) {
+                const void* from = reinterpret_cast<uint8_t *>(mStorage) + (where+amount)*mItemSize;
+                memmove(to, from, (new_size - where)*mItemSize);
+            }
+            const SharedBuffer* cur_sb = SharedBuffer::bufferFromData(mStorage);
+            SharedBuffer* sb = cur_sb->editResize(new_capacity * mItemSize);
+            if (sb) {
+                mStorage = sb->data();
+            }
+            // Even if the buffer could not shrink, the items did move.
         } else {
             SharedBuffer* sb = SharedBuffer::alloc(new_capacity * mItemSize);
             if (sb) {
                 void* array = sb->data();
+                const bool move = SharedBuffer::bufferFromData(mStorage)->onlyOwner();
                 if (where != 0) {
-                    _do_copy(array, mStorage, where);
+                    _do_transfer(array, mStorage, where, move);
                 }
                 if (where != new_size) {
                     const void* from = reinterpret_cast<const uint8_t *>(mStorage) + (where+amount)*mItemSize;
                     void* dest = reinterpret_cast<uint8_t *>(array) + where*mItemSize;
-                    _do_copy(dest, from, new_size - where);
+                    _do_transfer(dest, from, new_size - where, move);
                 }
-                release_storage();
+                if (move) {
+                    // Only the removed items are left to destroy.
+                    _do_destroy(reinterpret_cast<uint8_t *>(mStorage) + where*mItemSize, amount);
+                }
+                _release_storage(move);
                 mStorage = const_cast<void*>(array);
             } else{
                 return;
@@ -548,11 +578,50 @@ void VectorImpl::_do_splat(void* dest, const void* item, size_t num) const {
 }
 
 void VectorImpl::_do_move_forward(void* dest, const void* from, size_t num) const {
-    do_move_forward(dest, from, num);
+    if (mFlags & HAS_TRIVIAL_MOVE) {
+        memmove(dest, from, num*itemSize());
+    } else {
+        do_move_forward(dest, from, num);
+    }
 }
 
 void VectorImpl::_do_move_backward(void* dest, const void* from, size_t num) const {
-    do_move_backward(dest, from, num);
+    if (mFlags & HAS_TRIVIAL_MOVE) {
+        memmove(dest, from, num*itemSize());
+    } else {
+        do_move_backward(dest, from, num);
+    }
+}
+
+void VectorImpl::_do_transfer(void* dest, const void* from, size_t num, bool move) const {
+    // The buffers don't overlap, so moving either way works.
+    if (move) {
+        _do_move_forward(dest, from, num);
+    } else {
+        _do_copy(dest, from, num);
+    }
+}
+
+bool VectorImpl::_can_resize_in_place() const {
+    // editResize() copies the items with memcpy.  That is fine for trivial items, and for
+    // trivially movable ones as long as no other vector shares the buffer, since the old
+    // copies then go away with it.
+    if (!mStorage) {
+        return false;
+    }
+    if ((mFlags & HAS_TRIVIAL_COPY) && (mFlags & HAS_TRIVIAL_DTOR)) {
+        return true;
+    }
+    return (mFlags & HAS_TRIVIAL_MOVE) && SharedBuffer::bufferFromData(mStorage)->onlyOwner();
+}
+
+void VectorImpl::_release_storage(bool moved) {
+    if (moved) {
+        // The items were moved out of our unshared buffer, so there is nothing to destroy.
+        SharedBuffer::bufferFromData(mStorage)->release();
+    } else {
+        release_storage();
+    }
 }
 
 /*****************************************************************************/
@@ -15,7 +15,10 @@
  */
 
 #include <benchmark/benchmark.h>
+#include <utils/SortedVector.h>
+#include <utils/String8.h>
 #include <utils/Vector.h>
+#include <string>
 #include <vector>
 
 void BM_fill_android_vector(benchmark::State& state) {
@@ -50,4 +53,57 @@ void BM_prepend_std_vector(benchmark::State& state) {
 }
 BENCHMARK(BM_prepend_std_vector);
 
+// String8 is marked trivially movable, so growing only reallocates its buffer.
+void BM_fill_android_vector_String8(benchmark::State& state) {
+    const android::String8 item("item");
+    while (state.KeepRunning()) {
+        android::Vector<android::String8> v;
+        for (int i = 0; i < state.range(0); ++i) {
+            v.push(item);
+        }
+        benchmark::DoNotOptimize(v.array());
+    }
+}
+BENCHMARK(BM_fill_android_vector_String8)->Arg(16)->Arg(1024);
+
+// std::string has no trait, so growing has to construct the items anew; they get moved.
+void BM_fill_android_vector_string(benchmark::State& state) {
+    const std::string item(32, 'x');
+    while (state.KeepRunning()) {
+        android::Vector<std::string> v;
+        for (int i = 0; i < state.range(0); ++i) {
+            v.emplace(item);
+        }
+        benchmark::DoNotOptimize(v.array());
+    }
+}
+BENCHMARK(BM_fill_android_vector_string)->Arg(16)->Arg(1024);
+
+void BM_prepend_android_vector_String8(benchmark::State& state) {
+    const android::String8 item("item");
+    while (state.KeepRunning()) {
+        android::Vector<android::String8> v;
+        for (int i = 0; i < state.range(0); ++i) {
+            v.insertAt(item, 0);
+        }
+        benchmark::DoNotOptimize(v.array());
+    }
+}
+BENCHMARK(BM_prepend_android_vector_String8)->Arg(16)->Arg(1024);
+
+void BM_add_sorted_vector_String8(benchmark::State& state) {
+    std::vector<android::String8> items;
+    for (int i = 0; i < state.range(0); ++i) {
+        items.push_back(android::String8::format("%d", (i * 7919) % state.range(0)));
+    }
+    while (state.KeepRunning()) {
+        android::SortedVector<android::String8> v;
+        for (const auto& item : items) {
+            v.add(item);
+        }
+        benchmark::DoNotOptimize(v.array());
+    }
+}
+BENCHMARK(BM_add_sorted_vector_String8)->Arg(16)->Arg(1024);
+
 BENCHMARK_MAIN();
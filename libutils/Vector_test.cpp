@@ -22,6 +22,8 @@
 
 #include <android/log.h>
 #include <gtest/gtest.h>
+#include <utils/SortedVector.h>
+#include <utils/String8.h>
 #include <utils/Vector.h>
 
 namespace android {
@@ -136,4 +138,93 @@ TEST_F(VectorTest, editArray_Shared) {
   }
 }
 
+// Counts how its instances get made, to check that growing a vector moves them.
+struct Counted {
+  static int copies;
+  static int moves;
+  static int live;
+
+  int value;
+
+  explicit Counted(int v = 0) : value(v) { ++live; }
+  Counted(const Counted& other) : value(other.value) { ++copies; ++live; }
+  Counted(Counted&& other) : value(other.value) { other.value = -1; ++moves; ++live; }
+  Counted& operator=(const Counted& other) { value = other.value; ++copies; return *this; }
+  ~Counted() { --live; }
+};
+
+int Counted::copies;
+int Counted::moves;
+int Counted::live;
+
+TEST_F(VectorTest, Grow_MovesItemsOutOfUnsharedBuffer) {
+  Counted::copies = Counted::moves = 0;
+  {
+    Vector<Counted> vector;
+    for (int i = 0; i < 100; ++i) {
+      ASSERT_EQ(0, vector.emplaceAt(0, 99 - i)) << "emplaceAt() returns the index";
+    }
+    vector.removeItemsAt(10, 80);
+    ASSERT_EQ(20U, vector.size());
+    for (int i = 0; i < 10; ++i) {
+      EXPECT_EQ(i, vector[i].value);
+      EXPECT_EQ(90 + i, vector[10 + i].value);
+    }
+    EXPECT_EQ(0, Counted::copies);
+    EXPECT_LT(0, Counted::moves);
+  }
+  EXPECT_EQ(0, Counted::live);
+}
+
+TEST_F(VectorTest, Grow_CopiesItemsOfSharedBuffer) {
+  Counted::copies = 0;
+  {
+    Vector<Counted> vector;
+    for (int i = 0; i < 4; ++i) {
+      vector.emplace(i);
+    }
+    Vector<Counted> other = vector;
+    for (int i = 4; i < 100; ++i) {
+      vector.emplace(i);
+    }
+    EXPECT_EQ(4, Counted::copies);
+    ASSERT_EQ(4U, other.size());
+    for (int i = 0; i < 4; ++i) {
+      EXPECT_EQ(i, other[i].value);
+    }
+  }
+  EXPECT_EQ(0, Counted::live);
+}
+
+TEST_F(VectorTest, TriviallyMovable_InsertAndRemoveWhileShared) {
+  Vector<String8> vector;
+  for (int i = 0; i < 100; ++i) {
+    vector.insertAt(String8::format("%d", 99 - i), 0);
+  }
+  Vector<String8> other = vector;
+  vector.insertAt(String8("x"), 50);
+  vector.removeItemsAt(0, 90);
+  ASSERT_EQ(11U, vector.size());
+  EXPECT_EQ(String8("89"), vector[0]);
+  EXPECT_EQ(String8("99"), vector[10]);
+  ASSERT_EQ(100U, other.size());
+  for (int i = 0; i < 100; ++i) {
+    EXPECT_EQ(String8::format("%d", i), other[i]);
+  }
+}
+
+TEST_F(VectorTest, SortedVector_AddAndRemove) {
+  SortedVector<String8> sorted;
+  for (int i = 0; i < 200; ++i) {
+    sorted.add(String8::format("%03d", (i * 37) % 200));
+  }
+  for (int i = 0; i < 200; i += 2) {
+    sorted.remove(String8::format("%03d", i));
+  }
+  ASSERT_EQ(100U, sorted.size());
+  for (size_t i = 0; i < sorted.size(); ++i) {
+    EXPECT_EQ(String8::format("%03zu", 2 * i + 1), sorted[i]);
+  }
+}
+
 } // namespace android
@@ -18,6 +18,7 @@
 #define ANDROID_CALLSTACK_H
 
 #include <memory>
+#include <vector>
 
 #include <android/log.h>
 #include <backtrace/backtrace_constants.h>
@@ -55,12 +56,21 @@ public:
     ~CallStack();
 
     // Reset the stack frames (same as creating an empty call stack).
-    void clear() { mFrameLines.clear(); }
+    void clear() {
+        mFrameLines.clear();
+        mFrames.clear();
+    }
 
     // Immediately collect the stack traces for the specified thread.
     // The default is to dump the stack of the current call.
     void update(int32_t ignoreDepth = 1, pid_t tid = BACKTRACE_CURRENT_THREAD);
 
+    // Like update(), but only record the pcs and the maps they are in. Function
+    // names are looked up when the stack is first printed, and shared with every
+    // other captured stack in the process, so this is much cheaper for stacks
+    // that are collected often but rarely printed.
+    void capture(int32_t ignoreDepth = 1, pid_t tid = BACKTRACE_CURRENT_THREAD);
+
     // Dump a stack trace to the log using the supplied logtag.
     void log(const char* logtag,
              android_LogPriority priority = ANDROID_LOG_DEBUG,
@@ -76,7 +86,7 @@ public:
     void print(Printer& printer) const;
 
     // Get the count of stack frames that are in this call stack.
-    size_t size() const { return mFrameLines.size(); }
+    size_t size() const { return mFrames.empty() ? mFrameLines.size() : mFrames.size(); }
 
     // DO NOT USE ANYTHING BELOW HERE. The following public members are expected
     // to disappear again shortly, once a better replacement facility exists.
@@ -161,7 +171,16 @@ public:
     static void CALLSTACK_WEAK deleteStack(CallStack* stack);
 #endif // WEAKS_AVAILABLE
 
+    // A frame recorded by capture(). The map is an index into a table of maps
+    // kept for the whole process.
+    struct Frame {
+        uint64_t pc;
+        uint64_t relPc;
+        uint32_t mapId;
+    };
+
     Vector<String8> mFrameLines;
+    std::vector<Frame> mFrames;
 };
 
 }  // namespace android
@@ -27,6 +27,7 @@
 #include <android-base/unique_fd.h>
 
 #include <utility>
+#include <vector>
 
 namespace android {
 
@@ -397,6 +398,17 @@ public:
      */
     bool isPolling() const;
 
+    /**
+     * Makes the looper wake up for delayed messages through a timerfd, so that they are
+     * handled at the time they were sent for instead of up to a millisecond later, when the
+     * poll timeout that would otherwise be used runs out.
+     *
+     * Returns true if the timerfd is in use, false if it could not be created.
+     *
+     * This method must be called on the thread that polls the looper.
+     */
+    bool enableTimerFd();
+
     /**
      * Prepares a looper associated with the calling thread, and returns it.
      * If the thread already has a looper, it is returned.  Otherwise, a new
@@ -438,12 +450,18 @@ private:
     };
 
     struct MessageEnvelope {
-        MessageEnvelope() : uptime(0) { }
+        MessageEnvelope() : uptime(0), seq(0) { }
+
+        MessageEnvelope(nsecs_t u, sp<MessageHandler> h, const Message& m, uint64_t s)
+            : uptime(u), seq(s), handler(std::move(h)), message(m) {}
 
-        MessageEnvelope(nsecs_t u, sp<MessageHandler> h, const Message& m)
-            : uptime(u), handler(std::move(h)), message(m) {}
+        // Messages due at the same time are handled in the order they were sent.
+        bool operator>(const MessageEnvelope& other) const {
+            return uptime != other.uptime ? uptime > other.uptime : seq > other.seq;
+        }
 
         nsecs_t uptime;
+        uint64_t seq;
         sp<MessageHandler> handler;
         Message message;
     };
@@ -453,7 +471,9 @@ private:
     android::base::unique_fd mWakeEventFd;  // immutable
     Mutex mLock;
 
-    Vector<MessageEnvelope> mMessageEnvelopes; // guarded by mLock
+    // A heap with the next message due at the front.
+    std::vector<MessageEnvelope> mMessageEnvelopes; // guarded by mLock
+    uint64_t mNextMessageSeq; // guarded by mLock
     bool mSendingMessage; // guarded by mLock
 
     // Whether we are currently waiting for work.  Not protected by a lock,
@@ -473,10 +493,17 @@ private:
     size_t mResponseIndex;
     nsecs_t mNextMessageUptime; // set to LLONG_MAX when none
 
+    // Only used by the looper thread, once enableTimerFd() has been called.
+    android::base::unique_fd mTimerFd;
+    nsecs_t mTimerFdUptime; // the time mTimerFd is armed for, LLONG_MAX when disarmed
+
     int pollInner(int timeoutMillis);
     int removeFd(int fd, int seq);
     void awoken();
+    void armTimerFd();
     void pushResponse(int events, const Request& request);
+    template <typename Predicate>
+    void removeMessagesLocked(Predicate predicate);
     void rebuildEpollLocked();
     void scheduleEpollRebuildLocked();
 
@@ -17,8 +17,11 @@
 #ifndef ANDROID_UTILS_LRU_CACHE_H
 #define ANDROID_UTILS_LRU_CACHE_H
 
+#include <stdint.h>
+
 #include <memory>
-#include <unordered_set>
+#include <unordered_set>  // No longer used here, but users have come to rely on it.
+#include <vector>
 
 #include "utils/TypeHelpers.h"  // hash_t
 
@@ -56,63 +59,48 @@ public:
 private:
     LruCache(const LruCache& that);  // disallow copy constructor
 
-    // Super class so that we can have entries having only a key reference, for searches.
-    class KeyedEntry {
-    public:
-        virtual const TKey& getKey() const = 0;
-        // Make sure the right destructor is executed so that keys and values are deleted.
-        virtual ~KeyedEntry() {}
-    };
+    // The entries are kept packed in one array, so that the cache makes no allocation per entry
+    // and lookups don't chase pointers.  The recency list links them by index, and an
+    // open-addressed hash table with linear probing maps keys to their index.
+    static constexpr uint32_t kNone = UINT32_MAX;
 
-    class Entry final : public KeyedEntry {
-    public:
+    struct Entry {
         TKey key;
         TValue value;
-        Entry* parent;
-        Entry* child;
-
-        Entry(TKey _key, TValue _value) : key(_key), value(_value), parent(nullptr), child(nullptr) {
+        // Kept so that the table can be rehashed, and entries moved around in it, without
+        // touching the keys, which an OnEntryRemoved listener is allowed to invalidate.
+        hash_t hash;
+        uint32_t older;
+        uint32_t younger;
+
+        Entry(const TKey& _key, const TValue& _value, hash_t _hash)
+            : key(_key), value(_value), hash(_hash), older(kNone), younger(kNone) {
         }
-        const TKey& getKey() const final { return key; }
-    };
-
-    class EntryForSearch : public KeyedEntry {
-    public:
-        const TKey& key;
-        EntryForSearch(const TKey& key_) : key(key_) {
-        }
-        const TKey& getKey() const final { return key; }
-    };
-
-    struct HashForEntry : public std::unary_function<KeyedEntry*, hash_t> {
-        size_t operator() (const KeyedEntry* entry) const {
-            return hash_type(entry->getKey());
-        };
     };
 
-    struct EqualityForHashedEntries : public std::unary_function<KeyedEntry*, hash_t> {
-        bool operator() (const KeyedEntry* lhs, const KeyedEntry* rhs) const {
-            return lhs->getKey() == rhs->getKey();
-        };
-    };
-
-    // All entries in the set will be Entry*. Using the weaker KeyedEntry as to allow entries
-    // that have only a key reference, for searching.
-    typedef std::unordered_set<KeyedEntry*, HashForEntry, EqualityForHashedEntries> LruCacheSet;
-
-    void attachToCache(Entry& entry);
-    void detachFromCache(Entry& entry);
-
-    typename LruCacheSet::iterator findByKey(const TKey& key) {
-        EntryForSearch entryForSearch(key);
-        typename LruCacheSet::iterator result = mSet->find(&entryForSearch);
-        return result;
+    // The slot where the probe for hash starts.  hash_type() is the identity for integers, so
+    // the bits are mixed first, or else runs of consecutive keys would make runs in the table.
+    size_t homeSlot(hash_t hash) const {
+        return (static_cast<uint32_t>(hash) * 0x9E3779B9u) >> mTableShift;
     }
-
-    std::unique_ptr<LruCacheSet> mSet;
+    uint32_t findByKey(const TKey& key) const;
+    // The slot of the table that holds the entry at index.
+    size_t findSlot(uint32_t index) const;
+    void insertSlot(uint32_t index);
+    void eraseSlot(size_t slot);
+    void growTable();
+
+    void attachToCache(uint32_t index);
+    void detachFromCache(uint32_t index);
+
+    std::vector<Entry> mEntries;
+    // A power of two in size, and at most half full.
+    std::vector<uint32_t> mTable;
+    // 32 - log2(mTable.size()).
+    uint32_t mTableShift;
     OnEntryRemoved<TKey, TValue>* mListener;
-    Entry* mOldest;
-    Entry* mYoungest;
+    uint32_t mOldest;
+    uint32_t mYoungest;
     uint32_t mMaxCapacity;
     TValue mNullValue;
 
@@ -123,56 +111,45 @@ public:
     // }
     class Iterator {
     public:
-        Iterator(const LruCache<TKey, TValue>& cache):
-                mCache(cache), mIterator(mCache.mSet->begin()), mBeginReturned(false) {
+        Iterator(const LruCache<TKey, TValue>& cache): mCache(cache), mIndex(kNone) {
         }
 
         bool next() {
-            if (mIterator == mCache.mSet->end()) {
+            if (mIndex + 1 >= mCache.mEntries.size()) {
                 return false;
             }
-            if (!mBeginReturned) {
-                // mIterator has been initialized to the beginning and
-                // hasn't been returned. Do not advance:
-                mBeginReturned = true;
-            } else {
-                std::advance(mIterator, 1);
-            }
-            bool ret = (mIterator != mCache.mSet->end());
-            return ret;
+            mIndex++;
+            return true;
         }
 
         const TValue& value() const {
-            // All the elements in the set are of type Entry. See comment in the definition
-            // of LruCacheSet above.
-            return reinterpret_cast<Entry *>(*mIterator)->value;
+            return mCache.mEntries[mIndex].value;
         }
 
         const TKey& key() const {
-            return (*mIterator)->getKey();
+            return mCache.mEntries[mIndex].key;
         }
     private:
         const LruCache<TKey, TValue>& mCache;
-        typename LruCacheSet::iterator mIterator;
-        bool mBeginReturned;
+        // Wraps around to 0 on the first call to next().
+        uint32_t mIndex;
     };
 };
 
 // Implementation is here, because it's fully templated
 template <typename TKey, typename TValue>
 LruCache<TKey, TValue>::LruCache(uint32_t maxCapacity)
-    : mSet(new LruCacheSet())
+    : mTableShift(32)
     , mListener(nullptr)
-    , mOldest(nullptr)
-    , mYoungest(nullptr)
+    , mOldest(kNone)
+    , mYoungest(kNone)
     , mMaxCapacity(maxCapacity)
     , mNullValue(0) {
-    mSet->max_load_factor(1.0);
 };
 
 template <typename TKey, typename TValue>
 LruCache<TKey, TValue>::~LruCache() {
-    // Need to delete created entries.
+    // Need to call the listener for remaining entries.
     clear();
 };
 
@@ -183,21 +160,18 @@ void LruCache<K, V>::setOnEntryRemovedListener(OnEntryRemoved<K, V>* listener) {
 
 template <typename TKey, typename TValue>
 size_t LruCache<TKey, TValue>::size() const {
-    return mSet->size();
+    return mEntries.size();
 }
 
 template <typename TKey, typename TValue>
 const TValue& LruCache<TKey, TValue>::get(const TKey& key) {
-    typename LruCacheSet::const_iterator find_result = findByKey(key);
-    if (find_result == mSet->end()) {
+    uint32_t index = findByKey(key);
+    if (index == kNone) {
         return mNullValue;
     }
-    // All the elements in the set are of type Entry. See comment in the definition
-    // of LruCacheSet above.
-    Entry *entry = reinterpret_cast<Entry*>(*find_result);
-    detachFromCache(*entry);
-    attachToCache(*entry);
-    return entry->value;
+    detachFromCache(index);
+    attachToCache(index);
+    return mEntries[index].value;
 }
 
 template <typename TKey, typename TValue>
@@ -206,38 +180,59 @@ bool LruCache<TKey, TValue>::put(const TKey& key, const TValue& value) {
         removeOldest();
     }
 
-    if (findByKey(key) != mSet->end()) {
+    if (findByKey(key) != kNone) {
         return false;
     }
 
-    Entry* newEntry = new Entry(key, value);
-    mSet->insert(newEntry);
-    attachToCache(*newEntry);
+    if ((mEntries.size() + 1) * 2 > mTable.size()) {
+        growTable();
+    }
+    uint32_t index = mEntries.size();
+    mEntries.emplace_back(key, value, hash_type(key));
+    insertSlot(index);
+    attachToCache(index);
     return true;
 }
 
 template <typename TKey, typename TValue>
 bool LruCache<TKey, TValue>::remove(const TKey& key) {
-    typename LruCacheSet::const_iterator find_result = findByKey(key);
-    if (find_result == mSet->end()) {
+    uint32_t index = findByKey(key);
+    if (index == kNone) {
         return false;
     }
-    // All the elements in the set are of type Entry. See comment in the definition
-    // of LruCacheSet above.
-    Entry* entry = reinterpret_cast<Entry*>(*find_result);
-    mSet->erase(entry);
+    eraseSlot(findSlot(index));
+    Entry& entry = mEntries[index];
     if (mListener) {
-        (*mListener)(entry->key, entry->value);
+        (*mListener)(entry.key, entry.value);
     }
-    detachFromCache(*entry);
-    delete entry;
+    detachFromCache(index);
+
+    // Fill the hole with the last entry, so that the entries stay packed.
+    uint32_t last = mEntries.size() - 1;
+    if (index != last) {
+        size_t slot = findSlot(last);
+        Entry& moved = mEntries[last];
+        if (moved.older != kNone) {
+            mEntries[moved.older].younger = index;
+        } else {
+            mOldest = index;
+        }
+        if (moved.younger != kNone) {
+            mEntries[moved.younger].older = index;
+        } else {
+            mYoungest = index;
+        }
+        entry = std::move(moved);
+        mTable[slot] = index;
+    }
+    mEntries.pop_back();
     return true;
 }
 
 template <typename TKey, typename TValue>
 bool LruCache<TKey, TValue>::removeOldest() {
-    if (mOldest != nullptr) {
-        return remove(mOldest->key);
+    if (mOldest != kNone) {
+        return remove(mEntries[mOldest].key);
         // TODO: should probably abort if false
     }
     return false;
@@ -245,8 +240,8 @@ bool LruCache<TKey, TValue>::removeOldest() {
 
 template <typename TKey, typename TValue>
 const TValue& LruCache<TKey, TValue>::peekOldestValue() {
-    if (mOldest) {
-        return mOldest->value;
+    if (mOldest != kNone) {
+        return mEntries[mOldest].value;
     }
     return mNullValue;
 }
@@ -254,44 +249,107 @@ const TValue& LruCache<TKey, TValue>::peekOldestValue() {
 template <typename TKey, typename TValue>
 void LruCache<TKey, TValue>::clear() {
     if (mListener) {
-        for (Entry* p = mOldest; p != nullptr; p = p->child) {
-            (*mListener)(p->key, p->value);
+        for (uint32_t i = mOldest; i != kNone; i = mEntries[i].younger) {
+            (*mListener)(mEntries[i].key, mEntries[i].value);
         }
     }
-    mYoungest = nullptr;
-    mOldest = nullptr;
-    for (auto entry : *mSet.get()) {
-        delete entry;
+    mYoungest = kNone;
+    mOldest = kNone;
+    mEntries.clear();
+    mTable.assign(mTable.size(), kNone);
+}
+
+template <typename TKey, typename TValue>
+uint32_t LruCache<TKey, TValue>::findByKey(const TKey& key) const {
+    if (mTable.empty()) {
+        return kNone;
+    }
+    const size_t mask = mTable.size() - 1;
+    const hash_t hash = hash_type(key);
+    for (size_t slot = homeSlot(hash); mTable[slot] != kNone; slot = (slot + 1) & mask) {
+        const Entry& entry = mEntries[mTable[slot]];
+        if (entry.hash == hash && entry.key == key) {
+            return mTable[slot];
+        }
+    }
+    return kNone;
+}
+
+template <typename TKey, typename TValue>
+size_t LruCache<TKey, TValue>::findSlot(uint32_t index) const {
+    const size_t mask = mTable.size() - 1;
+    size_t slot = homeSlot(mEntries[index].hash);
+    while (mTable[slot] != index) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+template <typename TKey, typename TValue>
+void LruCache<TKey, TValue>::insertSlot(uint32_t index) {
+    const size_t mask = mTable.size() - 1;
+    size_t slot = homeSlot(mEntries[index].hash);
+    while (mTable[slot] != kNone) {
+        slot = (slot + 1) & mask;
+    }
+    mTable[slot] = index;
+}
+
+template <typename TKey, typename TValue>
+void LruCache<TKey, TValue>::eraseSlot(size_t slot) {
+    // Shift back the entries that follow in the same run, so that no lookup stops early at
+    // the hole; this way the table needs no tombstones.
+    const size_t mask = mTable.size() - 1;
+    size_t hole = slot;
+    for (size_t next = (hole + 1) & mask; mTable[next] != kNone; next = (next + 1) & mask) {
+        size_t home = homeSlot(mEntries[mTable[next]].hash);
+        // Move the entry into the hole unless its home slot lies cyclically in (hole, next].
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            mTable[hole] = mTable[next];
+            hole = next;
+        }
+    }
+    mTable[hole] = kNone;
+}
+
+template <typename TKey, typename TValue>
+void LruCache<TKey, TValue>::growTable() {
+    size_t newSize = mTable.empty() ? 16 : mTable.size() * 2;
+    mTable.assign(newSize, kNone);
+    mTableShift = 32 - __builtin_ctzl(newSize);
+    for (uint32_t i = 0; i < mEntries.size(); i++) {
+        insertSlot(i);
     }
-    mSet->clear();
 }
 
 template <typename TKey, typename TValue>
-void LruCache<TKey, TValue>::attachToCache(Entry& entry) {
-    if (mYoungest == nullptr) {
-        mYoungest = mOldest = &entry;
+void LruCache<TKey, TValue>::attachToCache(uint32_t index) {
+    Entry& entry = mEntries[index];
+    if (mYoungest == kNone) {
+        mYoungest = mOldest = index;
     } else {
-        entry.parent = mYoungest;
-        mYoungest->child = &entry;
-        mYoungest = &entry;
+        entry.older = mYoungest;
+        mEntries[mYoungest].younger = index;
+        mYoungest = index;
     }
 }
 
 template <typename TKey, typename TValue>
-void LruCache<TKey, TValue>::detachFromCache(Entry& entry) {
-    if (entry.parent != nullptr) {
-        entry.parent->child = entry.child;
+void LruCache<TKey, TValue>::detachFromCache(uint32_t index) {
+    Entry& entry = mEntries[index];
+    if (entry.older != kNone) {
+        mEntries[entry.older].younger = entry.younger;
     } else {
-        mOldest = entry.child;
+        mOldest = entry.younger;
     }
-    if (entry.child != nullptr) {
-        entry.child->parent = entry.parent;
+    if (entry.younger != kNone) {
+        mEntries[entry.younger].older = entry.older;
     } else {
-        mYoungest = entry.parent;
+        mYoungest = entry.older;
     }
 
-    entry.parent = nullptr;
-    entry.child = nullptr;
+    entry.older = kNone;
+    entry.younger = kNone;
 }
 
 }
@@ -41,6 +41,10 @@ public:
     // Immediately collect the stack traces for all threads.
     void update();
 
+    // Collect the stack traces for all threads with CallStack::capture(), leaving
+    // the function names to be looked up when they are printed.
+    void capture();
+
     // Print all stack traces to the log using the supplied logtag.
     void log(const char* logtag, android_LogPriority priority = ANDROID_LOG_DEBUG,
              const char* prefix = nullptr) const;
@@ -58,6 +62,8 @@ public:
     size_t size() const;
 
 private:
+    void collect(bool symbolize);
+
     void printInternal(Printer& printer, Printer& csPrinter) const;
 
     // Reset the process's stack frames and metadata.
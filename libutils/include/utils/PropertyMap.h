@@ -17,11 +17,13 @@
 #ifndef _UTILS_PROPERTY_MAP_H
 #define _UTILS_PROPERTY_MAP_H
 
-#include <utils/KeyedVector.h>
 #include <utils/String8.h>
 #include <utils/Errors.h>
 #include <utils/Tokenizer.h>
 
+#include <string>
+#include <unordered_map>
+
 namespace android {
 
 /*
@@ -75,7 +77,9 @@ public:
     void addAll(const PropertyMap* map);
 
     /* Gets the underlying property map. */
-    inline const KeyedVector<String8, String8>& getProperties() const { return mProperties; }
+    inline const std::unordered_map<std::string, std::string>& getProperties() const {
+        return mProperties;
+    }
 
     /* Loads a property map from a file. */
     static status_t load(const String8& filename, PropertyMap** outMap);
@@ -98,7 +102,9 @@ private:
         status_t parseCharacterLiteral(char16_t* outCharacter);
     };
 
-    KeyedVector<String8, String8> mProperties;
+    const std::string* findProperty(const String8& key) const;
+
+    std::unordered_map<std::string, std::string> mProperties;
 };
 
 } // namespace android
@@ -95,6 +95,10 @@ public:
                     __attribute__((format (printf, 2, 3)));
             status_t            appendFormatV(const char* fmt, va_list args);
 
+            // Makes room for the string to grow to size bytes without
+            // reallocating, as long as it isn't copied in the meantime.
+            status_t            reserve(size_t size);
+
     inline  String8&            operator=(const String8& other);
     inline  String8&            operator=(const char* other);
 
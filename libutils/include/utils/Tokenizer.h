@@ -22,6 +22,8 @@
 #include <utils/FileMap.h>
 #include <utils/String8.h>
 
+#include <string_view>
+
 namespace android {
 
 /**
@@ -103,6 +105,12 @@ public:
      */
     String8 nextToken(const char* delimiters);
 
+    /**
+     * Like nextToken(), but returns the token in place rather than a copy of it.
+     * The view is valid for as long as the tokenizer is.
+     */
+    std::string_view nextTokenView(const char* delimiters);
+
     /**
      * Advances to the next line.
      * Does nothing if already at the end of the file.
@@ -19,6 +19,7 @@
 
 #include <new>
 #include <type_traits>
+#include <utility>
 
 #include <stdint.h>
 #include <string.h>
@@ -198,6 +199,9 @@ move_forward_type(TYPE* d, const TYPE* s, size_t n = 1) {
     memmove(d, s, n*sizeof(TYPE));
 }
 
+// The moves below destroy each source item right after it has been moved from, so they
+// move-construct the destination rather than copy it.
+
 template<typename TYPE>
 typename std::enable_if<!use_trivial_move<TYPE>::value>::type
 inline
@@ -208,7 +212,7 @@ move_forward_type(TYPE* d, const TYPE* s, size_t n = 1) {
         n--;
         --d, --s;
         if (!traits<TYPE>::has_trivial_copy) {
-            new(d) TYPE(*s);
+            new(d) TYPE(std::move(*const_cast<TYPE*>(s)));
         } else {
             *d = *s;
         }
@@ -232,7 +236,7 @@ move_backward_type(TYPE* d, const TYPE* s, size_t n = 1) {
     while (n > 0) {
         n--;
         if (!traits<TYPE>::has_trivial_copy) {
-            new(d) TYPE(*s);
+            new(d) TYPE(std::move(*const_cast<TYPE*>(s)));
         } else {
             *d = *s;
         }
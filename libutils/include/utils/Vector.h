@@ -20,6 +20,9 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <new>
+#include <utility>
+
 #include <log/log.h>
 #include <utils/TypeHelpers.h>
 #include <utils/VectorImpl.h>
@@ -164,6 +167,12 @@ public:
     inline  ssize_t         add();
     //! same as push() but returns the index the item was added at (or an error)
             ssize_t         add(const TYPE& item);
+    //! constructs an item in place at the top of the stack, and returns its index (or an error)
+    template<typename... Args>
+            ssize_t         emplace(Args&&... args);
+    //! constructs an item in place at the given index, and returns the index (or an error)
+    template<typename... Args>
+            ssize_t         emplaceAt(size_t index, Args&&... args);
     //! replace an item with a new one initialized with its default constructor
     inline  ssize_t         replaceAt(size_t index);
     //! replace an item with a new one
@@ -230,7 +239,8 @@ Vector<TYPE>::Vector()
     : VectorImpl(sizeof(TYPE),
                 ((traits<TYPE>::has_trivial_ctor   ? HAS_TRIVIAL_CTOR   : 0)
                 |(traits<TYPE>::has_trivial_dtor   ? HAS_TRIVIAL_DTOR   : 0)
-                |(traits<TYPE>::has_trivial_copy   ? HAS_TRIVIAL_COPY   : 0))
+                |(traits<TYPE>::has_trivial_copy   ? HAS_TRIVIAL_COPY   : 0)
+                |(use_trivial_move<TYPE>::value    ? HAS_TRIVIAL_MOVE   : 0))
                 )
 {
 }
@@ -373,6 +383,20 @@ ssize_t Vector<TYPE>::add() {
     return VectorImpl::add();
 }
 
+template<class TYPE> template<typename... Args> inline
+ssize_t Vector<TYPE>::emplace(Args&&... args) {
+    return emplaceAt(size(), std::forward<Args>(args)...);
+}
+
+template<class TYPE> template<typename... Args> inline
+ssize_t Vector<TYPE>::emplaceAt(size_t index, Args&&... args) {
+    ssize_t result = VectorImpl::insertUninitializedAt(index, 1);
+    if (result >= 0) {
+        new (editArray() + result) TYPE(std::forward<Args>(args)...);
+    }
+    return result;
+}
+
 template<class TYPE> inline
 ssize_t Vector<TYPE>::replaceAt(size_t index) {
     return VectorImpl::replaceAt(index);
@@ -250,6 +250,13 @@ namespace zip_archive {
 class Writer {
  public:
   virtual bool Append(uint8_t* buf, size_t buf_size) = 0;
+
+  // Returns memory that the next |length| bytes can be written into
+  // directly, in place of calling Append, or nullptr if there is none.
+  // Writers that hold the whole entry in memory return it so that it
+  // can be inflated in one pass, without a bounce buffer.
+  virtual uint8_t* GetBuffer(size_t length);
+
   virtual ~Writer();
 
  protected:
@@ -263,6 +270,11 @@ class Writer {
 class Reader {
  public:
   virtual bool ReadAtOffset(uint8_t* buf, size_t len, uint32_t offset) const = 0;
+
+  // Returns a pointer to |len| bytes at |offset| if the data is already in
+  // memory, or nullptr if it has to be read with ReadAtOffset.
+  virtual const uint8_t* AccessAtOffset(size_t len, uint32_t offset) const;
+
   virtual ~Reader();
 
  protected:
@@ -283,7 +295,29 @@ class Reader {
  *
  * If |crc_out| is not nullptr, it is set to the crc32 checksum of the
  * uncompressed data.
+ *
+ * If |writer| has a buffer for all |uncompressed_length| bytes, the entry is
+ * inflated straight into it in one pass. Otherwise it is streamed through
+ * |writer| in fixed-size pieces.
  */
 int32_t Inflate(const Reader& reader, const uint32_t compressed_length,
                 const uint32_t uncompressed_length, Writer* writer, uint64_t* crc_out);
 }  // namespace zip_archive
+
+/*
+ * Uncompresses |count| entries, writing |entries[i]| to |writers[i]|. The
+ * entries are spread over up to |max_threads| threads, or one per CPU if
+ * |max_threads| is 0, so writers must not share state without their own
+ * locking. Each writer only sees the data of its own entry, in order.
+ *
+ * Every entry is attempted even if another one fails. If |results| is not
+ * nullptr, |results[i]| is set to the result of extracting |entries[i]|.
+ *
+ * Returns 0 if every entry was extracted, and otherwise the result of the
+ * first entry in |entries| that failed.
+ *
+ * On Windows the entries are extracted one at a time on the calling thread.
+ */
+int32_t ExtractEntriesToWriters(ZipArchiveHandle archive, ZipEntry* entries,
+                                zip_archive::Writer* const* writers, size_t count,
+                                int32_t* results = nullptr, unsigned int max_threads = 0);
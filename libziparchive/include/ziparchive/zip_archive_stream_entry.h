@@ -34,13 +34,28 @@ class ZipArchiveStreamEntry {
   static ZipArchiveStreamEntry* Create(ZipArchiveHandle handle, const ZipEntry& entry);
   static ZipArchiveStreamEntry* CreateRaw(ZipArchiveHandle handle, const ZipEntry& entry);
 
+  // Has the kernel read up to |window| bytes of the entry's data ahead of Read(), so that the
+  // disk is busy with the next part of the entry while this one is inflated and used. 0, the
+  // default, leaves it to the kernel's own readahead. Only has an effect for archives opened
+  // from a file.
+  void SetReadaheadWindow(size_t window) { readahead_window_ = window; }
+
  protected:
   ZipArchiveStreamEntry(ZipArchiveHandle handle) : handle_(handle) {}
 
   virtual bool Init(const ZipEntry& entry);
 
+  // Reads the next |len| bytes of the entry's data into |buf|.
+  bool ReadData(uint8_t* buf, size_t len);
+
   ZipArchiveHandle handle_;
 
   off64_t offset_ = 0;
   uint32_t crc32_ = 0u;
+
+ private:
+  off64_t data_end_ = 0;
+  size_t readahead_window_ = 0;
+  // Everything before this has already been asked for.
+  off64_t readahead_end_ = 0;
 };
@@ -97,6 +97,22 @@ class ZipWriter {
   // Move assignment.
   ZipWriter& operator=(ZipWriter&& zipWriter) noexcept;
 
+  ~ZipWriter();
+
+  /**
+   * Deflates the data of ZipWriter::kCompress entries on up to |threads| threads, or one per CPU
+   * if |threads| is 0. Must be called before the first entry is started.
+   *
+   * Entry data is split into blocks of 128K that are deflated separately, each primed with the
+   * 32K before it, and then joined back up in order. The output only depends on what was
+   * written, not on the number of threads, but it isn't the same as without this mode.
+   *
+   * Entries are written to the file as their blocks are done, so the file may be behind the
+   * calls that add to it until Finish(), DiscardLastEntry() or GetLastEntry() is called.
+   * Returns 0 on success, and an error value < 0 on failure.
+   */
+  int32_t EnableParallelDeflate(unsigned int threads);
+
   /**
    * Starts a new zip entry with the given path and flags.
    * Flags can be a bitwise OR of ZipWriter::kCompress and ZipWriter::kAlign.
@@ -161,11 +177,18 @@ class ZipWriter {
  private:
   DISALLOW_COPY_AND_ASSIGN(ZipWriter);
 
+  class ParallelDeflater;
+
   int32_t HandleError(int32_t error_code);
   int32_t PrepareDeflate();
+  int32_t WriteLocalFileHeader(FileEntry* file, uint32_t alignment);
   int32_t StoreBytes(FileEntry* file, const void* data, uint32_t len);
   int32_t CompressBytes(FileEntry* file, const void* data, uint32_t len);
   int32_t FlushCompressedBytes(FileEntry* file);
+  int32_t WriteEntryTrailer(const FileEntry& file);
+  int32_t QueueBytes(const void* data, uint32_t len);
+  void QueueDeflateBlock(bool last);
+  int32_t WritePendingEntries(bool wait_for_all);
   bool ShouldUseDataDescriptor() const;
 
   enum class State {
@@ -185,5 +208,8 @@ class ZipWriter {
   std::unique_ptr<z_stream, void (*)(z_stream*)> z_stream_;
   std::vector<uint8_t> buffer_;
 
+  // Set by EnableParallelDeflate().
+  std::unique_ptr<ParallelDeflater> parallel_deflater_;
+
   FRIEND_TEST(zipwriter, WriteToUnseekableFile);
 };
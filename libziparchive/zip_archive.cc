@@ -31,7 +31,11 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <memory>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 #if defined(__APPLE__)
@@ -70,7 +74,7 @@ static const uint32_t kMaxEOCDSearch = kMaxCommentLen + sizeof(EocdRecord);
  *
  * We want "open" and "find entry by name" to be fast operations, and
  * we want to use as little memory as possible.  We memory-map the zip
- * central directory, and load a hash table with pointers to the filenames
+ * central directory, and build an index of offsets to the filenames
  * (which aren't null-terminated).  The other fields are at a fixed offset
  * from the filename, so we don't need to extract those (but we do need
  * to byte-read and endian-swap them every time we want them).
@@ -81,80 +85,10 @@ static const uint32_t kMaxEOCDSearch = kMaxCommentLen + sizeof(EocdRecord);
  * To speed comparisons when doing a lookup by name, we could make the mapping
  * "private" (copy-on-write) and null-terminate the filenames after verifying
  * the record structure.  However, this requires a private mapping of
- * every page that the Central Directory touches.  Easier to tuck a copy
- * of the string length into the hash table entry.
+ * every page that the Central Directory touches.  The string length is in
+ * the record right before the filename, so the index doesn't keep a copy.
  */
 
-/*
- * Round up to the next highest power of 2.
- *
- * Found on http://graphics.stanford.edu/~seander/bithacks.html.
- */
-static uint32_t RoundUpPower2(uint32_t val) {
-  val--;
-  val |= val >> 1;
-  val |= val >> 2;
-  val |= val >> 4;
-  val |= val >> 8;
-  val |= val >> 16;
-  val++;
-
-  return val;
-}
-
-static uint32_t ComputeHash(std::string_view name) {
-  return static_cast<uint32_t>(std::hash<std::string_view>{}(name));
-}
-
-/*
- * Convert a ZipEntry to a hash table index, verifying that it's in a
- * valid range.
- */
-static int64_t EntryToIndex(const ZipStringOffset* hash_table, const uint32_t hash_table_size,
-                            std::string_view name, const uint8_t* start) {
-  const uint32_t hash = ComputeHash(name);
-
-  // NOTE: (hash_table_size - 1) is guaranteed to be non-negative.
-  uint32_t ent = hash & (hash_table_size - 1);
-  while (hash_table[ent].name_offset != 0) {
-    if (hash_table[ent].ToStringView(start) == name) {
-      return ent;
-    }
-    ent = (ent + 1) & (hash_table_size - 1);
-  }
-
-  ALOGV("Zip: Unable to find entry %.*s", static_cast<int>(name.size()), name.data());
-  return kEntryNotFound;
-}
-
-/*
- * Add a new entry to the hash table.
- */
-static int32_t AddToHash(ZipStringOffset* hash_table, const uint32_t hash_table_size,
-                         std::string_view name, const uint8_t* start) {
-  const uint64_t hash = ComputeHash(name);
-  uint32_t ent = hash & (hash_table_size - 1);
-
-  /*
-   * We over-allocated the table, so we're guaranteed to find an empty slot.
-   * Further, we guarantee that the hashtable size is not 0.
-   */
-  while (hash_table[ent].name_offset != 0) {
-    if (hash_table[ent].ToStringView(start) == name) {
-      // We've found a duplicate entry. We don't accept duplicates.
-      ALOGW("Zip: Found duplicate entry %.*s", static_cast<int>(name.size()), name.data());
-      return kDuplicateEntry;
-    }
-    ent = (ent + 1) & (hash_table_size - 1);
-  }
-
-  // `name` has already been validated before entry.
-  const char* start_char = reinterpret_cast<const char*>(start);
-  hash_table[ent].name_offset = static_cast<uint32_t>(name.data() - start_char);
-  hash_table[ent].name_length = static_cast<uint16_t>(name.size());
-  return 0;
-}
-
 #if defined(__BIONIC__)
 uint64_t GetOwnerTag(const ZipArchive* archive) {
   return android_fdsan_create_owner_tag(ANDROID_FDSAN_OWNER_TYPE_ZIPARCHIVE,
@@ -168,9 +102,7 @@ ZipArchive::ZipArchive(MappedZipFile&& map, bool assume_ownership)
       directory_offset(0),
       central_directory(),
       directory_map(),
-      num_entries(0),
-      hash_table_size(0),
-      hash_table(nullptr) {
+      num_entries(0) {
 #if defined(__BIONIC__)
   if (assume_ownership) {
     CHECK(mapped_zip.HasFd());
@@ -185,9 +117,7 @@ ZipArchive::ZipArchive(const void* address, size_t length)
       directory_offset(0),
       central_directory(),
       directory_map(),
-      num_entries(0),
-      hash_table_size(0),
-      hash_table(nullptr) {}
+      num_entries(0) {}
 
 ZipArchive::~ZipArchive() {
   if (close_file && mapped_zip.GetFileDescriptor() >= 0) {
@@ -197,8 +127,6 @@ ZipArchive::~ZipArchive() {
     close(mapped_zip.GetFileDescriptor());
 #endif
   }
-
-  free(hash_table);
 }
 
 static int32_t MapCentralDirectory0(const char* debug_file_name, ZipArchive* archive,
@@ -330,8 +258,8 @@ static int32_t MapCentralDirectory(const char* debug_file_name, ZipArchive* arch
 }
 
 /*
- * Parses the Zip archive's Central Directory.  Allocates and populates the
- * hash table.
+ * Parses the Zip archive's Central Directory.  Builds the index of entry
+ * names.
  *
  * Returns 0 on success.
  */
@@ -341,23 +269,11 @@ static int32_t ParseZipArchive(ZipArchive* archive) {
   const uint16_t num_entries = archive->num_entries;
 
   /*
-   * Create hash table.  We have a minimum 75% load factor, possibly as
-   * low as 50% after we round off to a power of 2.  There must be at
-   * least one unused entry to avoid an infinite loop during creation.
-   */
-  archive->hash_table_size = RoundUpPower2(1 + (num_entries * 4) / 3);
-  archive->hash_table =
-      reinterpret_cast<ZipStringOffset*>(calloc(archive->hash_table_size, sizeof(ZipStringOffset)));
-  if (archive->hash_table == nullptr) {
-    ALOGW("Zip: unable to allocate the %u-entry hash_table, entry size: %zu",
-          archive->hash_table_size, sizeof(ZipStringOffset));
-    return kAllocationFailed;
-  }
-
-  /*
-   * Walk through the central directory, adding entries to the hash
-   * table and verifying values.
+   * Walk through the central directory, verifying values and collecting
+   * the filenames to index.
    */
+  std::vector<uint32_t> name_offsets;
+  name_offsets.reserve(num_entries);
   const uint8_t* const cd_end = cd_ptr + cd_length;
   const uint8_t* ptr = cd_ptr;
   for (uint16_t i = 0; i < num_entries; i++) {
@@ -400,14 +316,7 @@ static int32_t ParseZipArchive(ZipArchive* archive) {
       return kInvalidEntryName;
     }
 
-    // Add the CDE filename to the hash table.
-    std::string_view entry_name{reinterpret_cast<const char*>(file_name), file_name_length};
-    const int add_result = AddToHash(archive->hash_table, archive->hash_table_size, entry_name,
-                                     archive->central_directory.GetBasePtr());
-    if (add_result != 0) {
-      ALOGW("Zip: Error adding entry to hash table %d", add_result);
-      return add_result;
-    }
+    name_offsets.push_back(static_cast<uint32_t>(file_name - cd_ptr));
 
     ptr += sizeof(CentralDirectoryRecord) + file_name_length + extra_length + comment_length;
     if ((ptr - cd_ptr) > static_cast<int64_t>(cd_length)) {
@@ -416,6 +325,13 @@ static int32_t ParseZipArchive(ZipArchive* archive) {
     }
   }
 
+  const int32_t index_result =
+      CdEntryIndex::Create(cd_ptr, name_offsets, &archive->cd_entry_index);
+  if (index_result != 0) {
+    ALOGW("Zip: Error indexing entries %d", index_result);
+    return index_result;
+  }
+
   uint32_t lfh_start_bytes;
   if (!archive->mapped_zip.ReadAtOffset(reinterpret_cast<uint8_t*>(&lfh_start_bytes),
                                         sizeof(uint32_t), 0)) {
@@ -533,18 +449,16 @@ static int32_t ValidateDataDescriptor(MappedZipFile& mapped_zip, ZipEntry* entry
   return 0;
 }
 
-static int32_t FindEntry(const ZipArchive* archive, const int32_t ent, ZipEntry* data) {
-  const uint16_t nameLen = archive->hash_table[ent].name_length;
-
+static int32_t FindEntry(const ZipArchive* archive, const uint32_t ent, ZipEntry* data) {
   // Recover the start of the central directory entry from the filename
   // pointer.  The filename is the first entry past the fixed-size data,
   // so we can just subtract back from that.
   const uint8_t* base_ptr = archive->central_directory.GetBasePtr();
-  const uint8_t* ptr = base_ptr + archive->hash_table[ent].name_offset;
+  const uint8_t* ptr = base_ptr + archive->cd_entry_index->NameOffset(ent);
   ptr -= sizeof(CentralDirectoryRecord);
 
   // This is the base of our mmapped region, we have to sanity check that
-  // the name that's in the hash table is a pointer to a location within
+  // the name that's in the index is a pointer to a location within
   // this mapped region.
   if (ptr < base_ptr || ptr > base_ptr + archive->central_directory.GetMapLength()) {
     ALOGW("Zip: Invalid entry pointer");
@@ -552,6 +466,7 @@ static int32_t FindEntry(const ZipArchive* archive, const int32_t ent, ZipEntry*
   }
 
   const CentralDirectoryRecord* cdr = reinterpret_cast<const CentralDirectoryRecord*>(ptr);
+  const uint16_t nameLen = cdr->file_name_length;
 
   // The offset of the start of the central directory in the zipfile.
   // We keep this lying around so that we can sanity check all our lengths
@@ -660,8 +575,7 @@ static int32_t FindEntry(const ZipArchive* archive, const int32_t ent, ZipEntry*
     ALOGW("Zip: failed reading lfh name from offset %" PRId64, static_cast<int64_t>(name_offset));
     return kIoError;
   }
-  const std::string_view entry_name =
-      archive->hash_table[ent].ToStringView(archive->central_directory.GetBasePtr());
+  const std::string_view entry_name = archive->cd_entry_index->Name(ent);
   if (memcmp(entry_name.data(), name_buf.data(), nameLen) != 0) {
     ALOGW("Zip: lfh name did not match central directory");
     return kInconsistentInformation;
@@ -699,16 +613,25 @@ struct IterationHandle {
   std::string prefix;
   std::string suffix;
 
+  // With a prefix, the slots of the entries that start with it, in name order. Without one,
+  // every slot of the index is visited instead.
+  const uint32_t* prefix_begin = nullptr;
+  const uint32_t* prefix_end = nullptr;
+
   uint32_t position = 0;
 
   IterationHandle(ZipArchive* archive, std::string_view in_prefix, std::string_view in_suffix)
-      : archive(archive), prefix(in_prefix), suffix(in_suffix) {}
+      : archive(archive), prefix(in_prefix), suffix(in_suffix) {
+    if (!prefix.empty()) {
+      std::tie(prefix_begin, prefix_end) = archive->cd_entry_index->PrefixRange(prefix);
+    }
+  }
 };
 
 int32_t StartIteration(ZipArchiveHandle archive, void** cookie_ptr,
                        const std::string_view optional_prefix,
                        const std::string_view optional_suffix) {
-  if (archive == NULL || archive->hash_table == NULL) {
+  if (archive == NULL || archive->cd_entry_index == nullptr) {
     ALOGW("Zip: Invalid ZipArchiveHandle");
     return kInvalidHandle;
   }
@@ -734,13 +657,12 @@ int32_t FindEntry(const ZipArchiveHandle archive, const std::string_view entryNa
     return kInvalidEntryName;
   }
 
-  const int64_t ent = EntryToIndex(archive->hash_table, archive->hash_table_size, entryName,
-                                   archive->central_directory.GetBasePtr());
+  const int64_t ent = archive->cd_entry_index->Find(entryName);
   if (ent < 0) {
     ALOGV("Zip: Could not find entry %.*s", static_cast<int>(entryName.size()), entryName.data());
     return static_cast<int32_t>(ent);  // kEntryNotFound is safe to truncate.
   }
-  // We know there are at most hash_table_size entries, safe to truncate.
+  // We know there are at most SlotCount() entries, safe to truncate.
   return FindEntry(archive, static_cast<uint32_t>(ent), data);
 }
 
@@ -761,25 +683,40 @@ int32_t Next(void* cookie, ZipEntry* data, std::string_view* name) {
   }
 
   ZipArchive* archive = handle->archive;
-  if (archive == NULL || archive->hash_table == NULL) {
+  if (archive == NULL || archive->cd_entry_index == nullptr) {
     ALOGW("Zip: Invalid ZipArchiveHandle");
     return kInvalidHandle;
   }
 
+  const CdEntryIndex& index = *archive->cd_entry_index;
   const uint32_t currentOffset = handle->position;
-  const uint32_t hash_table_length = archive->hash_table_size;
-  const ZipStringOffset* hash_table = archive->hash_table;
-  for (uint32_t i = currentOffset; i < hash_table_length; ++i) {
-    const std::string_view entry_name =
-        hash_table[i].ToStringView(archive->central_directory.GetBasePtr());
-    if (hash_table[i].name_offset != 0 && (android::base::StartsWith(entry_name, handle->prefix) &&
-                                           android::base::EndsWith(entry_name, handle->suffix))) {
-      handle->position = (i + 1);
-      const int error = FindEntry(archive, i, data);
-      if (!error && name) {
-        *name = entry_name;
+  if (handle->prefix_begin != nullptr) {
+    // Every entry in the range starts with the prefix.
+    const uint32_t range_length = static_cast<uint32_t>(handle->prefix_end - handle->prefix_begin);
+    for (uint32_t i = currentOffset; i < range_length; ++i) {
+      const uint32_t slot = handle->prefix_begin[i];
+      const std::string_view entry_name = index.Name(slot);
+      if (android::base::EndsWith(entry_name, handle->suffix)) {
+        handle->position = (i + 1);
+        const int error = FindEntry(archive, slot, data);
+        if (!error && name) {
+          *name = entry_name;
+        }
+        return error;
+      }
+    }
+  } else {
+    const uint32_t slot_count = index.SlotCount();
+    for (uint32_t i = currentOffset; i < slot_count; ++i) {
+      const std::string_view entry_name = index.Name(i);
+      if (android::base::EndsWith(entry_name, handle->suffix)) {
+        handle->position = (i + 1);
+        const int error = FindEntry(archive, i, data);
+        if (!error && name) {
+          *name = entry_name;
+        }
+        return error;
       }
-      return error;
     }
   }
 
@@ -806,6 +743,16 @@ class MemoryWriter : public zip_archive::Writer {
     return true;
   }
 
+  virtual uint8_t* GetBuffer(size_t length) override {
+    if (length > size_ - bytes_written_) {
+      return nullptr;
+    }
+
+    uint8_t* buffer = buf_ + bytes_written_;
+    bytes_written_ += length;
+    return buffer;
+  }
+
  private:
   uint8_t* const buf_;
   const size_t size_;
@@ -915,6 +862,10 @@ class EntryReader : public zip_archive::Reader {
     return zip_file_.ReadAtOffset(buf, len, entry_->offset + offset);
   }
 
+  virtual const uint8_t* AccessAtOffset(size_t len, uint32_t offset) const {
+    return zip_file_.AccessAtOffset(len, entry_->offset + offset);
+  }
+
   virtual ~EntryReader() {}
 
  private:
@@ -936,8 +887,84 @@ namespace zip_archive {
 Reader::~Reader() {}
 Writer::~Writer() {}
 
+const uint8_t* Reader::AccessAtOffset(size_t, uint32_t) const {
+  return nullptr;
+}
+
+uint8_t* Writer::GetBuffer(size_t) {
+  return nullptr;
+}
+
+// Inflates a whole entry into |out| with a single call to inflate. Compared with streaming
+// through 32K buffers this saves a copy of every byte, and lets zlib's fast decoding loop run
+// over the whole entry instead of stopping at each buffer boundary.
+static int32_t InflateToBuffer(const Reader& reader, const uint32_t compressed_length,
+                               const uint32_t uncompressed_length, uint8_t* out,
+                               uint64_t* crc_out) {
+  // Use the compressed data in place if the archive is in memory, else read it all at once.
+  std::vector<uint8_t> read_buf;
+  const uint8_t* in = reader.AccessAtOffset(compressed_length, 0);
+  if (in == nullptr) {
+    read_buf.resize(compressed_length);
+    if (!reader.ReadAtOffset(read_buf.data(), compressed_length, 0)) {
+      ALOGW("Zip: inflate read failed, getSize = %u: %s", compressed_length, strerror(errno));
+      return kIoError;
+    }
+    in = read_buf.data();
+  }
+
+  z_stream zstream;
+  memset(&zstream, 0, sizeof(zstream));
+  zstream.next_in = in;
+  zstream.avail_in = compressed_length;
+  zstream.next_out = out;
+  zstream.avail_out = uncompressed_length;
+  zstream.data_type = Z_UNKNOWN;
+
+  int zerr = zlib_inflateInit2(&zstream, -MAX_WBITS);
+  if (zerr != Z_OK) {
+    if (zerr == Z_VERSION_ERROR) {
+      ALOGE("Installed zlib is not compatible with linked version (%s)", ZLIB_VERSION);
+    } else {
+      ALOGW("Call to inflateInit2 failed (zerr=%d)", zerr);
+    }
+
+    return kZlibError;
+  }
+
+  zerr = inflate(&zstream, Z_FINISH);
+  inflateEnd(&zstream);
+
+  if (zerr != Z_STREAM_END) {
+    if (zstream.avail_out == 0 && (zerr == Z_OK || zerr == Z_BUF_ERROR)) {
+      // There's more data than was declared, which the streaming path reports as a write error.
+      ALOGW("Zip: Unexpected size %" PRIu32 " (declared) vs more (actual)", uncompressed_length);
+      return kIoError;
+    }
+    ALOGW("Zip: inflate zerr=%d (aIn=%u aOut=%u)", zerr, zstream.avail_in, zstream.avail_out);
+    return kZlibError;
+  }
+
+  if (zstream.total_out != uncompressed_length) {
+    ALOGW("Zip: size mismatch on inflated file (%lu vs %" PRIu32 ")", zstream.total_out,
+          uncompressed_length);
+    return kInconsistentInformation;
+  }
+
+  if (crc_out != nullptr) {
+    *crc_out = crc32(0, out, uncompressed_length);
+  }
+
+  return 0;
+}
+
 int32_t Inflate(const Reader& reader, const uint32_t compressed_length,
                 const uint32_t uncompressed_length, Writer* writer, uint64_t* crc_out) {
+  uint8_t* out = writer->GetBuffer(uncompressed_length);
+  if (out != nullptr) {
+    return InflateToBuffer(reader, compressed_length, uncompressed_length, out, crc_out);
+  }
+
   const size_t kBufSize = 32768;
   std::vector<uint8_t> read_buf(kBufSize);
   std::vector<uint8_t> write_buf(kBufSize);
@@ -1133,6 +1160,52 @@ int32_t ExtractEntryToFile(ZipArchiveHandle archive, ZipEntry* entry, int fd) {
   return ExtractToWriter(archive, entry, &writer);
 }
 
+int32_t ExtractEntriesToWriters(ZipArchiveHandle archive, ZipEntry* entries,
+                                zip_archive::Writer* const* writers, size_t count,
+                                int32_t* results, unsigned int max_threads) {
+#if defined(_WIN32)
+  // Reads from the archive can only be made concurrently on non-Windows platforms.
+  max_threads = 1;
+#else
+  if (max_threads == 0) {
+    max_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+#endif
+
+  std::vector<int32_t> local_results;
+  if (results == nullptr) {
+    local_results.resize(count);
+    results = local_results.data();
+  }
+
+  // Entries vary a lot in size, so rather than splitting them up front each thread takes the
+  // next entry nobody has started on.
+  std::atomic<size_t> next_entry(0);
+  auto extract = [&]() {
+    size_t i;
+    while ((i = next_entry.fetch_add(1, std::memory_order_relaxed)) < count) {
+      results[i] = ExtractToWriter(archive, &entries[i], writers[i]);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  const size_t thread_count = std::min<size_t>(max_threads, count);
+  for (size_t i = 1; i < thread_count; i++) {
+    threads.emplace_back(extract);
+  }
+  extract();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    if (results[i] != 0) {
+      return results[i];
+    }
+  }
+  return 0;
+}
+
 const char* ErrorCodeString(int32_t error_code) {
   // Make sure that the number of entries in kErrorMessages and ErrorCodes
   // match.
@@ -1217,6 +1290,33 @@ off64_t MappedZipFile::GetFileLength() const {
   }
 }
 
+const uint8_t* MappedZipFile::AccessAtOffset(size_t len, off64_t off) const {
+  if (has_fd_) {
+    return nullptr;
+  }
+
+  if (off < 0 || off > data_length_ || len > static_cast<size_t>(data_length_ - off)) {
+    ALOGE("Zip: invalid access of %zu bytes at offset %" PRId64 ", data length: %" PRId64, len,
+          off, data_length_);
+    return nullptr;
+  }
+  return static_cast<const uint8_t*>(base_ptr_) + off;
+}
+
+void MappedZipFile::Readahead(off64_t off, size_t len) const {
+#if defined(__linux__)
+  off64_t advise_offset;
+  if (!has_fd_ || len == 0 || __builtin_add_overflow(fd_offset_, off, &advise_offset)) {
+    return;
+  }
+  // This is only a hint, so a failure is no reason to fail the read that follows.
+  posix_fadvise64(fd_, advise_offset, static_cast<off64_t>(len), POSIX_FADV_WILLNEED);
+#else
+  (void)off;
+  (void)len;
+#endif
+}
+
 // Attempts to read |len| bytes into |buf| at offset |off|.
 bool MappedZipFile::ReadAtOffset(uint8_t* buf, size_t len, off64_t off) const {
   if (has_fd_) {
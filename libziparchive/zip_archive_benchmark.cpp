@@ -49,6 +49,12 @@ static std::unique_ptr<TemporaryFile> CreateZip(int size = 4, int count = 1000)
   return result;
 }
 
+static std::string ManyEntriesName(size_t i) {
+  static const char* const kDirs[] = {"res/drawable/", "res/layout/", "lib/arm64-v8a/",
+                                      "assets/", "META-INF/", ""};
+  return kDirs[i % 6] + std::string("entry") + std::to_string(i) + ".bin";
+}
+
 static void FindEntry_no_match(benchmark::State& state) {
   // Create a temporary zip archive.
   std::unique_ptr<TemporaryFile> temp_file(CreateZip());
@@ -86,6 +92,76 @@ static void Iterate_all_files(benchmark::State& state) {
 }
 BENCHMARK(Iterate_all_files);
 
+// Creates an archive of |count| empty entries spread over a few directories, like an APK's.
+static std::unique_ptr<TemporaryFile> CreateManyEntriesZip(size_t count) {
+  auto result = std::make_unique<TemporaryFile>();
+  FILE* fp = fdopen(result->fd, "w");
+
+  ZipWriter writer(fp);
+  for (size_t i = 0; i < count; i++) {
+    writer.StartEntry(ManyEntriesName(i), 0);
+    writer.FinishEntry();
+  }
+  writer.Finish();
+  fclose(fp);
+  result->fd = -1;
+
+  return result;
+}
+
+static void Open_many_entries(benchmark::State& state) {
+  std::unique_ptr<TemporaryFile> temp_file(CreateManyEntriesZip(state.range(0)));
+  ZipArchiveHandle handle;
+
+  for (auto _ : state) {
+    OpenArchive(temp_file->path, &handle);
+    CloseArchive(handle);
+  }
+}
+BENCHMARK(Open_many_entries)->Arg(1000)->Arg(50000);
+
+static void FindEntry_many_entries(benchmark::State& state) {
+  const size_t count = static_cast<size_t>(state.range(0));
+  std::unique_ptr<TemporaryFile> temp_file(CreateManyEntriesZip(count));
+  std::vector<std::string> names;
+  for (size_t i = 0; i < count; i++) {
+    names.push_back(ManyEntriesName(i));
+  }
+
+  ZipArchiveHandle handle;
+  if (OpenArchive(temp_file->path, &handle)) {
+    state.SkipWithError("Failed to open archive");
+    return;
+  }
+  ZipEntry data;
+  size_t i = 0;
+  for (auto _ : state) {
+    FindEntry(handle, names[i++ % count], &data);
+  }
+  CloseArchive(handle);
+}
+BENCHMARK(FindEntry_many_entries)->Arg(1000)->Arg(50000);
+
+static void Iterate_prefix_many_entries(benchmark::State& state) {
+  std::unique_ptr<TemporaryFile> temp_file(CreateManyEntriesZip(state.range(0)));
+  ZipArchiveHandle handle;
+  if (OpenArchive(temp_file->path, &handle)) {
+    state.SkipWithError("Failed to open archive");
+    return;
+  }
+  void* iteration_cookie;
+  ZipEntry data;
+  std::string_view name;
+  for (auto _ : state) {
+    StartIteration(handle, &iteration_cookie, "lib/");
+    while (Next(iteration_cookie, &data, &name) == 0) {
+    }
+    EndIteration(iteration_cookie);
+  }
+  CloseArchive(handle);
+}
+BENCHMARK(Iterate_prefix_many_entries)->Arg(1000)->Arg(50000);
+
 static void StartAlignedEntry(benchmark::State& state) {
   TemporaryFile file;
   FILE* fp = fdopen(file.fd, "w");
@@ -108,6 +184,41 @@ static void StartAlignedEntry(benchmark::State& state) {
 }
 BENCHMARK(StartAlignedEntry)->Arg(2)->Arg(16)->Arg(1024)->Arg(4096);
 
+// Writes 16 entries of 1M of text, deflated serially if |state.range(0)| is 0 and on that many
+// threads otherwise.
+static void WriteCompressedEntries(benchmark::State& state) {
+  constexpr size_t kEntryCount = 16;
+  constexpr size_t kEntrySize = 1024 * 1024;
+  std::string contents;
+  for (size_t line = 0; contents.size() < kEntrySize; line++) {
+    contents += "line " + std::to_string(line * 7919 % 100003) + "\n";
+  }
+
+  size_t archive_size = 0;
+  for (auto _ : state) {
+    TemporaryFile file;
+    FILE* fp = fdopen(file.fd, "w");
+    ZipWriter writer(fp);
+    if (state.range(0) != 0) {
+      writer.EnableParallelDeflate(static_cast<unsigned int>(state.range(0)));
+    }
+    for (size_t i = 0; i < kEntryCount; i++) {
+      writer.StartEntry("file" + std::to_string(i), ZipWriter::kCompress);
+      writer.WriteBytes(contents.data(), kEntrySize);
+      writer.FinishEntry();
+    }
+    if (writer.Finish()) {
+      state.SkipWithError("Failed to write archive");
+    }
+    archive_size = static_cast<size_t>(ftello(fp));
+    fclose(fp);
+    file.fd = -1;
+  }
+  state.SetBytesProcessed(state.iterations() * kEntryCount * kEntrySize);
+  state.counters["archive_size"] = static_cast<double>(archive_size);
+}
+BENCHMARK(WriteCompressedEntries)->Arg(0)->Arg(1)->Arg(2)->Arg(4)->UseRealTime();
+
 static void ExtractEntry(benchmark::State& state) {
   std::unique_ptr<TemporaryFile> temp_file(CreateZip(1024 * 1024, 1));
 
@@ -132,4 +243,120 @@ static void ExtractEntry(benchmark::State& state) {
 
 BENCHMARK(ExtractEntry)->Arg(2)->Arg(16)->Arg(1024);
 
+// Creates an archive of |count| deflated entries named "file0", "file1"... of |size| bytes each.
+// The entries are lines of text with some variation, so they deflate to about what text and dex
+// do.
+static std::unique_ptr<TemporaryFile> CreateTextZip(size_t count, size_t size) {
+  auto result = std::make_unique<TemporaryFile>();
+  FILE* fp = fdopen(result->fd, "w");
+
+  ZipWriter writer(fp);
+  for (size_t i = 0; i < count; i++) {
+    writer.StartEntry("file" + std::to_string(i), ZipWriter::kCompress);
+    std::string contents;
+    for (size_t line = 0; contents.size() < size; line++) {
+      contents += "line " + std::to_string(line * 7919 % 100003) + " of entry " +
+                  std::to_string(i) + "\n";
+    }
+    writer.WriteBytes(contents.data(), size);
+    writer.FinishEntry();
+  }
+  writer.Finish();
+  fclose(fp);
+  result->fd = -1;
+
+  return result;
+}
+
+class DiscardWriter : public zip_archive::Writer {
+ public:
+  bool Append(uint8_t*, size_t) override { return true; }
+};
+
+// Inflates one text entry of |state.range(0)| bytes into memory. With |one_pass| that goes
+// through ExtractToMemory, which inflates straight into the buffer. Otherwise the data is copied
+// into the buffer from the 32K pieces it is streamed in, which is how ExtractToMemory worked
+// before Writer::GetBuffer.
+static void InflateEntry(benchmark::State& state, bool one_pass) {
+  const size_t size = static_cast<size_t>(state.range(0));
+  std::unique_ptr<TemporaryFile> temp_file(CreateTextZip(1, size));
+
+  ZipArchiveHandle handle;
+  ZipEntry data;
+  if (OpenArchive(temp_file->path, &handle)) {
+    state.SkipWithError("Failed to open archive");
+    return;
+  }
+  if (FindEntry(handle, "file0", &data)) {
+    state.SkipWithError("Failed to find archive entry");
+  }
+
+  std::vector<uint8_t> buffer(size);
+  for (auto _ : state) {
+    int32_t result;
+    if (one_pass) {
+      result = ExtractToMemory(handle, &data, buffer.data(), uint32_t(buffer.size()));
+    } else {
+      std::tuple<uint8_t*, size_t> out{buffer.data(), 0};
+      result = ProcessZipEntryContents(
+          handle, &data,
+          [](const uint8_t* buf, size_t buf_size, void* cookie) {
+            auto& [out_buf, out_offset] = *reinterpret_cast<std::tuple<uint8_t*, size_t>*>(cookie);
+            memcpy(out_buf + out_offset, buf, buf_size);
+            out_offset += buf_size;
+            return true;
+          },
+          &out);
+    }
+    if (result) {
+      state.SkipWithError("Failed to extract archive entry");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * size);
+  CloseArchive(handle);
+}
+
+static void Inflate_one_pass(benchmark::State& state) {
+  InflateEntry(state, true);
+}
+BENCHMARK(Inflate_one_pass)->Arg(64 * 1024)->Arg(1024 * 1024)->Arg(16 * 1024 * 1024);
+
+static void Inflate_streaming(benchmark::State& state) {
+  InflateEntry(state, false);
+}
+BENCHMARK(Inflate_streaming)->Arg(64 * 1024)->Arg(1024 * 1024)->Arg(16 * 1024 * 1024);
+
+static void ExtractEntriesInParallel(benchmark::State& state) {
+  constexpr size_t kEntryCount = 64;
+  constexpr size_t kEntrySize = 1024 * 1024;
+  std::unique_ptr<TemporaryFile> temp_file(CreateTextZip(kEntryCount, kEntrySize));
+
+  ZipArchiveHandle handle;
+  if (OpenArchive(temp_file->path, &handle)) {
+    state.SkipWithError("Failed to open archive");
+    return;
+  }
+  std::vector<ZipEntry> entries(kEntryCount);
+  std::vector<DiscardWriter> writers(kEntryCount);
+  std::vector<zip_archive::Writer*> writer_ptrs;
+  for (size_t i = 0; i < kEntryCount; i++) {
+    if (FindEntry(handle, "file" + std::to_string(i), &entries[i])) {
+      state.SkipWithError("Failed to find archive entry");
+    }
+    writer_ptrs.push_back(&writers[i]);
+  }
+
+  for (auto _ : state) {
+    if (ExtractEntriesToWriters(handle, entries.data(), writer_ptrs.data(), kEntryCount, nullptr,
+                                static_cast<unsigned int>(state.range(0)))) {
+      state.SkipWithError("Failed to extract archive entries");
+      break;
+    }
+  }
+  state.SetBytesProcessed(state.iterations() * kEntryCount * kEntrySize);
+  CloseArchive(handle);
+}
+BENCHMARK(ExtractEntriesInParallel)->Arg(1)->Arg(2)->Arg(4)->Arg(8)->UseRealTime();
+
 BENCHMARK_MAIN();
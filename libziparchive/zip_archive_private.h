@@ -27,6 +27,7 @@
 
 #include "android-base/macros.h"
 #include "android-base/mapped_file.h"
+#include "zip_cd_entry_index.h"
 
 static const char* kErrorMessages[] = {
     "Success",
@@ -118,6 +119,14 @@ class MappedZipFile {
 
   bool ReadAtOffset(uint8_t* buf, size_t len, off64_t off) const;
 
+  // Returns a pointer to |len| bytes at |off| if the archive is in memory, or nullptr if it has
+  // to be read with ReadAtOffset.
+  const uint8_t* AccessAtOffset(size_t len, off64_t off) const;
+
+  // Starts reading |len| bytes at |off| into the page cache in the background, so that a later
+  // ReadAtOffset of them doesn't have to wait for the disk. Does nothing for archives in memory.
+  void Readahead(off64_t off, size_t len) const;
+
  private:
   // If has_fd_ is true, fd is valid and we'll read contents of a zip archive
   // from the file. Otherwise, we're opening the archive from a memory mapped
@@ -147,26 +156,6 @@ class CentralDirectory {
   size_t length_;
 };
 
-/**
- * More space efficient string representation of strings in an mmaped zipped
- * file than std::string_view. Using std::string_view as an entry in the
- * ZipArchive hash table wastes space. std::string_view stores a pointer to a
- * string (on 64 bit, 8 bytes) and the length to read from that pointer,
- * 2 bytes. Because of alignment, the structure consumes 16 bytes, wasting
- * 6 bytes.
- *
- * ZipStringOffset stores a 4 byte offset from a fixed location in the memory
- * mapped file instead of the entire address, consuming 8 bytes with alignment.
- */
-struct ZipStringOffset {
-  uint32_t name_offset;
-  uint16_t name_length;
-
-  const std::string_view ToStringView(const uint8_t* start) const {
-    return std::string_view{reinterpret_cast<const char*>(start + name_offset), name_length};
-  }
-};
-
 struct ZipArchive {
   // open Zip archive
   mutable MappedZipFile mapped_zip;
@@ -180,12 +169,9 @@ struct ZipArchive {
   // number of entries in the Zip archive
   uint16_t num_entries;
 
-  // We know how many entries are in the Zip archive, so we can have a
-  // fixed-size hash table. We define a load factor of 0.75 and over
-  // allocate so the maximum number entries can never be higher than
-  // ((4 * UINT16_MAX) / 3 + 1) which can safely fit into a uint32_t.
-  uint32_t hash_table_size;
-  ZipStringOffset* hash_table;
+  // Index of the entry names, built once the central directory has been
+  // checked. Entries are identified by their slot in it.
+  std::unique_ptr<CdEntryIndex> cd_entry_index;
 
   ZipArchive(MappedZipFile&& map, bool assume_ownership);
   ZipArchive(const void* address, size_t length);
@@ -23,6 +23,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 
@@ -41,6 +42,34 @@ static constexpr size_t kBufSize = 65535;
 bool ZipArchiveStreamEntry::Init(const ZipEntry& entry) {
   crc32_ = entry.crc32;
   offset_ = entry.offset;
+  data_end_ = entry.offset + entry.compressed_length;
+  readahead_end_ = entry.offset;
+  return true;
+}
+
+bool ZipArchiveStreamEntry::ReadData(uint8_t* buf, size_t len) {
+  ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle_);
+
+  // Ask for the next window once less than half of the last one is left, so there is always
+  // something on its way from the disk while the caller works through what has arrived.
+  const off64_t window = static_cast<off64_t>(readahead_window_);
+  if (window != 0 && readahead_end_ < data_end_ && readahead_end_ - offset_ <= window / 2) {
+    const off64_t start = std::max(readahead_end_, offset_);
+    const off64_t end = std::min(data_end_, offset_ + window);
+    archive->mapped_zip.Readahead(start, static_cast<size_t>(end - start));
+    readahead_end_ = end;
+  }
+
+  errno = 0;
+  if (!archive->mapped_zip.ReadAtOffset(buf, len, offset_)) {
+    if (errno != 0) {
+      ALOGE("Error reading from archive fd: %s", strerror(errno));
+    } else {
+      ALOGE("Short read of zip file, possibly corrupted zip?");
+    }
+    return false;
+  }
+  offset_ += len;
   return true;
 }
 
@@ -89,14 +118,7 @@ const std::vector<uint8_t>* ZipArchiveStreamEntryUncompressed::Read() {
   }
 
   size_t bytes = (length_ > data_.size()) ? data_.size() : length_;
-  ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle_);
-  errno = 0;
-  if (!archive->mapped_zip.ReadAtOffset(data_.data(), bytes, offset_)) {
-    if (errno != 0) {
-      ALOGE("Error reading from archive fd: %s", strerror(errno));
-    } else {
-      ALOGE("Short read of zip file, possibly corrupted zip?");
-    }
+  if (!ReadData(data_.data(), bytes)) {
     length_ = 0;
     return nullptr;
   }
@@ -107,7 +129,6 @@ const std::vector<uint8_t>* ZipArchiveStreamEntryUncompressed::Read() {
   computed_crc32_ = static_cast<uint32_t>(
       crc32(computed_crc32_, data_.data(), static_cast<uint32_t>(data_.size())));
   length_ -= bytes;
-  offset_ += bytes;
   return &data_;
 }
 
@@ -220,19 +241,11 @@ const std::vector<uint8_t>* ZipArchiveStreamEntryCompressed::Read() {
       DCHECK_LE(in_.size(), std::numeric_limits<uint32_t>::max());  // Should be buf size = 64k.
       uint32_t bytes = (compressed_length_ > in_.size()) ? static_cast<uint32_t>(in_.size())
                                                          : compressed_length_;
-      ZipArchive* archive = reinterpret_cast<ZipArchive*>(handle_);
-      errno = 0;
-      if (!archive->mapped_zip.ReadAtOffset(in_.data(), bytes, offset_)) {
-        if (errno != 0) {
-          ALOGE("Error reading from archive fd: %s", strerror(errno));
-        } else {
-          ALOGE("Short read of zip file, possibly corrupted zip?");
-        }
+      if (!ReadData(in_.data(), bytes)) {
         return nullptr;
       }
 
       compressed_length_ -= bytes;
-      offset_ += bytes;
       z_stream_.next_in = in_.data();
       z_stream_.avail_in = bytes;
     }
@@ -23,16 +23,20 @@
 #include <string.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <memory>
+#include <set>
 #include <vector>
 
 #include <android-base/file.h>
 #include <android-base/logging.h>
 #include <android-base/mapped_file.h>
+#include <android-base/strings.h>
 #include <android-base/unique_fd.h>
 #include <gtest/gtest.h>
 #include <ziparchive/zip_archive.h>
 #include <ziparchive/zip_archive_stream_entry.h>
+#include <ziparchive/zip_writer.h>
 
 static std::string test_data_dir = android::base::GetExecutableDirectory() + "/testdata";
 
@@ -517,7 +521,8 @@ TEST(ziparchive, OpenFromMemory) {
 #endif
 
 static void ZipArchiveStreamTest(ZipArchiveHandle& handle, const std::string& entry_name, bool raw,
-                                 bool verified, ZipEntry* entry, std::vector<uint8_t>* read_data) {
+                                 bool verified, ZipEntry* entry, std::vector<uint8_t>* read_data,
+                                 size_t readahead_window = 0) {
   ASSERT_EQ(0, FindEntry(handle, entry_name, entry));
   std::unique_ptr<ZipArchiveStreamEntry> stream;
   if (raw) {
@@ -533,6 +538,7 @@ static void ZipArchiveStreamTest(ZipArchiveHandle& handle, const std::string& en
   }
   uint8_t* read_data_ptr = read_data->data();
   ASSERT_TRUE(stream.get() != nullptr);
+  stream->SetReadaheadWindow(readahead_window);
   const std::vector<uint8_t>* data;
   uint64_t total_size = 0;
   while ((data = stream->Read()) != nullptr) {
@@ -561,13 +567,14 @@ static void ZipArchiveStreamTestUsingContents(const std::string& zip_file,
 }
 
 static void ZipArchiveStreamTestUsingMemory(const std::string& zip_file,
-                                            const std::string& entry_name) {
+                                            const std::string& entry_name,
+                                            size_t readahead_window = 0) {
   ZipArchiveHandle handle;
   ASSERT_EQ(0, OpenArchiveWrapper(zip_file, &handle));
 
   ZipEntry entry;
   std::vector<uint8_t> read_data;
-  ZipArchiveStreamTest(handle, entry_name, false, true, &entry, &read_data);
+  ZipArchiveStreamTest(handle, entry_name, false, true, &entry, &read_data, readahead_window);
 
   std::vector<uint8_t> cmp_data(entry.uncompressed_length);
   ASSERT_EQ(entry.uncompressed_length, read_data.size());
@@ -602,6 +609,16 @@ TEST(ziparchive, StreamLargeUncompressed) {
   ZipArchiveStreamTestUsingMemory(kLargeZip, "uncompress.txt");
 }
 
+// A window smaller than the entries, and one that isn't a multiple of the read size, so that
+// several windows are asked for and the last is cut short at the end of the entry.
+TEST(ziparchive, StreamLargeCompressedReadahead) {
+  ZipArchiveStreamTestUsingMemory(kLargeZip, "compress.txt", 100000);
+}
+
+TEST(ziparchive, StreamLargeUncompressedReadahead) {
+  ZipArchiveStreamTestUsingMemory(kLargeZip, "uncompress.txt", 100000);
+}
+
 TEST(ziparchive, StreamCompressedBadCrc) {
   ZipArchiveHandle handle;
   ASSERT_EQ(0, OpenArchiveWrapper(kBadCrcZip, &handle));
@@ -857,3 +874,116 @@ TEST(ziparchive, Inflate) {
     ASSERT_EQ(0u, writer.GetOutput().size());
   }
 }
+
+TEST(ziparchive, ExtractEntriesToWriters) {
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveWrapper(kLargeZip, &handle));
+
+  std::vector<ZipEntry> entries;
+  void* iteration_cookie;
+  ASSERT_EQ(0, StartIteration(handle, &iteration_cookie));
+  ZipEntry data;
+  std::string_view name;
+  while (Next(iteration_cookie, &data, &name) == 0) {
+    entries.push_back(data);
+  }
+  EndIteration(iteration_cookie);
+  ASSERT_LT(1u, entries.size());
+
+  // The last entry gets a writer that fails, which shouldn't stop the others.
+  std::vector<std::unique_ptr<zip_archive::Writer>> writers;
+  std::vector<zip_archive::Writer*> writer_ptrs;
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (i == entries.size() - 1) {
+      writers.emplace_back(new BadWriter);
+    } else {
+      writers.emplace_back(new VectorWriter);
+    }
+    writer_ptrs.push_back(writers.back().get());
+  }
+
+  std::vector<int32_t> results(entries.size(), 1);
+  ASSERT_EQ(kIoError, ExtractEntriesToWriters(handle, entries.data(), writer_ptrs.data(),
+                                              entries.size(), results.data(), 4));
+  for (size_t i = 0; i < entries.size() - 1; i++) {
+    ASSERT_EQ(0, results[i]);
+    std::vector<uint8_t> expected(entries[i].uncompressed_length);
+    ASSERT_EQ(0, ExtractToMemory(handle, &entries[i], expected.data(),
+                                 entries[i].uncompressed_length));
+    ASSERT_EQ(expected, static_cast<VectorWriter*>(writer_ptrs[i])->GetOutput());
+  }
+  ASSERT_EQ(kIoError, results.back());
+
+  ASSERT_EQ(0, ExtractEntriesToWriters(handle, nullptr, nullptr, 0));
+
+  CloseArchive(handle);
+}
+
+// Writes an archive of empty entries called |names| to |file|.
+static void WriteZipOfNames(TemporaryFile* file, const std::vector<std::string>& names) {
+  FILE* fp = fdopen(file->release(), "w");
+  ASSERT_NE(nullptr, fp);
+  ZipWriter writer(fp);
+  for (const std::string& name : names) {
+    ASSERT_EQ(0, writer.StartEntry(name, 0));
+    ASSERT_EQ(0, writer.FinishEntry());
+  }
+  ASSERT_EQ(0, writer.Finish());
+  ASSERT_EQ(0, fclose(fp));
+}
+
+TEST(ziparchive, FindEntry_many) {
+  std::vector<std::string> names;
+  for (size_t i = 0; i < 20000; i++) {
+    names.push_back(std::string(i % 3 == 0 ? "res/" : i % 3 == 1 ? "lib/" : "") + "entry" +
+                    std::to_string(i * 7919 % 20011));
+  }
+  TemporaryFile tmp_file;
+  ASSERT_NO_FATAL_FAILURE(WriteZipOfNames(&tmp_file, names));
+
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchive(tmp_file.path, &handle));
+  for (const std::string& name : names) {
+    ZipEntry data;
+    ASSERT_EQ(0, FindEntry(handle, name, &data)) << name;
+  }
+  ZipEntry data;
+  ASSERT_EQ(kEntryNotFound, FindEntry(handle, "entry", &data));
+  ASSERT_EQ(kEntryNotFound, FindEntry(handle, "res/entry20011", &data));
+
+  // A prefix gives exactly the entries that start with it, in name order.
+  void* iteration_cookie;
+  ASSERT_EQ(0, StartIteration(handle, &iteration_cookie, "res/"));
+  std::vector<std::string> found;
+  std::string name;
+  while (Next(iteration_cookie, &data, &name) == 0) {
+    found.push_back(name);
+  }
+  EndIteration(iteration_cookie);
+
+  std::vector<std::string> expected;
+  std::copy_if(names.begin(), names.end(), std::back_inserter(expected),
+               [](const std::string& name) { return android::base::StartsWith(name, "res/"); });
+  std::sort(expected.begin(), expected.end());
+  ASSERT_EQ(expected, found);
+
+  // Without a prefix every entry comes back once.
+  ASSERT_EQ(0, StartIteration(handle, &iteration_cookie));
+  std::set<std::string> all;
+  while (Next(iteration_cookie, &data, &name) == 0) {
+    ASSERT_TRUE(all.insert(name).second) << name;
+  }
+  EndIteration(iteration_cookie);
+  ASSERT_EQ(std::set<std::string>(names.begin(), names.end()), all);
+
+  CloseArchive(handle);
+}
+
+TEST(ziparchive, DuplicateEntry) {
+  TemporaryFile tmp_file;
+  ASSERT_NO_FATAL_FAILURE(WriteZipOfNames(&tmp_file, {"a.txt", "b/c.txt", "d", "b/c.txt"}));
+
+  ZipArchiveHandle handle;
+  ASSERT_EQ(kDuplicateEntry, OpenArchive(tmp_file.path, &handle));
+  CloseArchive(handle);
+}
@@ -0,0 +1,285 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "zip_cd_entry_index.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <numeric>
+
+#include <android-base/strings.h>
+#include <log/log.h>
+
+#include "zip_archive_common.h"
+#include "zip_archive_private.h"
+
+// Each level has this many bits for every name still to be placed. More bits leave fewer names
+// colliding and so fewer levels to look through, but make the index bigger.
+static constexpr uint32_t kBitsPerName = 2;
+
+// A count of the set bits is kept for every run of this many words of the bit arrays.
+static constexpr uint32_t kWordsPerRank = 8;
+
+// Names left after this many levels can only be ones whose hashes are the same, and a new seed
+// is tried instead. Each level leaves about 40% of the names it is given, so the most entries a
+// central directory can hold need fewer than 20.
+static constexpr uint32_t kMaxLevels = 64;
+
+// The number of seeds tried before giving up. A seed only fails if two different names hash to
+// the same 64 bits, which isn't expected to happen even once.
+static constexpr int kMaxSeeds = 8;
+
+// The hashing below relies on unsigned arithmetic wrapping around, which the build otherwise
+// traps on.
+__attribute__((no_sanitize("integer")))
+static uint64_t Mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+// MurmurHash64A, reading 8 bytes at a time.
+__attribute__((no_sanitize("integer")))
+static uint64_t HashName(std::string_view name, uint64_t seed) {
+  constexpr uint64_t m = 0xc6a4a7935bd1e995ULL;
+  constexpr int r = 47;
+
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(name.data());
+  size_t len = name.size();
+  uint64_t h = seed ^ (len * m);
+
+  for (; len >= 8; data += 8, len -= 8) {
+    uint64_t k;
+    memcpy(&k, data, sizeof(k));
+    k *= m;
+    k ^= k >> r;
+    k *= m;
+    h ^= k;
+    h *= m;
+  }
+  if (len > 0) {
+    // A loop is cheaper than a memcpy call for these few bytes.
+    uint64_t k = 0;
+    for (size_t i = 0; i < len; i++) {
+      k |= static_cast<uint64_t>(data[i]) << (8 * i);
+    }
+    h ^= k;
+    h *= m;
+  }
+
+  h ^= h >> r;
+  h *= m;
+  h ^= h >> r;
+  return h;
+}
+
+// Maps |x| onto [0, n) without a division.
+static uint32_t Reduce(uint32_t x, uint32_t n) {
+  return static_cast<uint32_t>((static_cast<uint64_t>(x) * n) >> 32);
+}
+
+// Returns the bit that a name with |hash| maps to in |level|, which is |level_size| bits long.
+__attribute__((no_sanitize("integer")))
+static uint32_t LevelBit(uint64_t hash, uint32_t level, uint32_t level_size) {
+  // The hash is already well mixed, so the first two levels, which see most lookups, can use
+  // its two halves as they are.
+  const uint64_t level_hash = level < 2 ? hash >> (32 * level) : Mix(hash + level);
+  return Reduce(static_cast<uint32_t>(level_hash), level_size);
+}
+
+static bool TestBit(const uint64_t* words, uint32_t bit) {
+  return (words[bit / 64] & (1ULL << (bit % 64))) != 0;
+}
+
+CdEntryIndex::CdEntryIndex(const uint8_t* cd_base, uint32_t slot_count)
+    : cd_base_(cd_base), slot_count_(slot_count), slots_(new uint32_t[slot_count]) {}
+
+std::string_view CdEntryIndex::NameAtOffset(uint32_t name_offset) const {
+  const uint8_t* name = cd_base_ + name_offset;
+  const CentralDirectoryRecord* cdr =
+      reinterpret_cast<const CentralDirectoryRecord*>(name - sizeof(CentralDirectoryRecord));
+  return std::string_view(reinterpret_cast<const char*>(name), cdr->file_name_length);
+}
+
+std::string_view CdEntryIndex::Name(uint32_t slot) const {
+  return NameAtOffset(slots_[slot]);
+}
+
+uint32_t CdEntryIndex::Rank(uint32_t bit) const {
+  const uint32_t word = bit / 64;
+  uint32_t rank = ranks_[word / kWordsPerRank];
+  for (uint32_t i = word - word % kWordsPerRank; i < word; i++) {
+    rank += __builtin_popcountll(bits_[i]);
+  }
+  return rank + __builtin_popcountll(bits_[word] & ((1ULL << (bit % 64)) - 1));
+}
+
+int64_t CdEntryIndex::Find(std::string_view name) const {
+  const uint64_t hash = HashName(name, seed_);
+  for (uint32_t level = 0; level + 1 < level_starts_.size(); level++) {
+    const uint32_t level_start = level_starts_[level];
+    const uint32_t bit =
+        level_start + LevelBit(hash, level, level_starts_[level + 1] - level_start);
+    if (TestBit(bits_.data(), bit)) {
+      // A name that isn't in the archive can still land on a set bit, so check that it's
+      // really the one there.
+      const uint32_t slot = Rank(bit);
+      if (Name(slot) == name) {
+        return slot;
+      }
+      break;
+    }
+  }
+
+  ALOGV("Zip: Unable to find entry %.*s", static_cast<int>(name.size()), name.data());
+  return kEntryNotFound;
+}
+
+std::pair<const uint32_t*, const uint32_t*> CdEntryIndex::PrefixRange(
+    std::string_view prefix) const {
+  std::lock_guard<std::mutex> lock(sorted_lock_);
+  if (sorted_slots_.size() != slot_count_) {
+    sorted_slots_.resize(slot_count_);
+    std::iota(sorted_slots_.begin(), sorted_slots_.end(), 0);
+    std::sort(sorted_slots_.begin(), sorted_slots_.end(),
+              [this](uint32_t a, uint32_t b) { return Name(a) < Name(b); });
+  }
+
+  // Every name starting with |prefix| sorts at or after it, and before any name that doesn't.
+  const uint32_t* first = sorted_slots_.data();
+  const uint32_t* last = first + sorted_slots_.size();
+  const uint32_t* begin = std::lower_bound(
+      first, last, prefix,
+      [this](uint32_t slot, std::string_view prefix) { return Name(slot) < prefix; });
+  const uint32_t* end = std::partition_point(begin, last, [this, prefix](uint32_t slot) {
+    return android::base::StartsWith(Name(slot), prefix);
+  });
+  return {begin, end};
+}
+
+// Each level gives every name still to be placed a bit. The names that got a bit to themselves
+// are placed there, and the ones that shared a bit move on to the next level.
+bool CdEntryIndex::Build(const std::vector<uint32_t>& name_offsets, int32_t* result) {
+  const uint32_t count = slot_count_;
+
+  std::vector<uint64_t> hashes(count);
+  std::vector<uint32_t> remaining(count);
+  for (uint32_t i = 0; i < count; i++) {
+    hashes[i] = HashName(NameAtOffset(name_offsets[i]), seed_);
+    remaining[i] = i;
+  }
+
+  level_starts_.assign(1, 0);
+  bits_.clear();
+  // The name placed at each bit, and the bit each remaining name got in the current level.
+  std::vector<uint32_t> bit_names;
+  std::vector<uint32_t> level_bits;
+  std::vector<uint64_t> collided;
+  std::vector<uint32_t> next;
+  while (!remaining.empty()) {
+    const uint32_t level = static_cast<uint32_t>(level_starts_.size() - 1);
+    if (level == kMaxLevels) {
+      return false;
+    }
+
+    // Levels are whole words so that each one starts on a word.
+    const uint32_t level_start = level_starts_.back();
+    const uint32_t level_size =
+        std::max(64u, (static_cast<uint32_t>(remaining.size()) * kBitsPerName + 63) & ~63u);
+    bits_.resize(bits_.size() + level_size / 64);
+    bit_names.resize(bit_names.size() + level_size);
+    uint64_t* taken = &bits_[level_start / 64];
+    collided.assign(level_size / 64, 0);
+    level_bits.resize(remaining.size());
+    for (size_t i = 0; i < remaining.size(); i++) {
+      const uint32_t bit = LevelBit(hashes[remaining[i]], level, level_size);
+      const uint64_t mask = 1ULL << (bit % 64);
+      collided[bit / 64] |= taken[bit / 64] & mask;
+      taken[bit / 64] |= mask;
+      level_bits[i] = bit;
+    }
+
+    next.clear();
+    for (size_t i = 0; i < remaining.size(); i++) {
+      if (TestBit(collided.data(), level_bits[i])) {
+        next.push_back(remaining[i]);
+      } else {
+        bit_names[level_start + level_bits[i]] = remaining[i];
+      }
+    }
+    for (uint32_t i = 0; i < level_size / 64; i++) {
+      taken[i] &= ~collided[i];
+    }
+    level_starts_.push_back(level_start + level_size);
+
+    // Names with the same hash land on the same bit at every level, so once nothing at all can
+    // be placed, check whether that's what is left.
+    if (next.size() == remaining.size()) {
+      std::sort(next.begin(), next.end(),
+                [&hashes](uint32_t a, uint32_t b) { return hashes[a] < hashes[b]; });
+      for (size_t i = 1; i < next.size(); i++) {
+        if (hashes[next[i - 1]] != hashes[next[i]]) continue;
+        const std::string_view name = NameAtOffset(name_offsets[next[i]]);
+        if (name == NameAtOffset(name_offsets[next[i - 1]])) {
+          ALOGW("Zip: Found duplicate entry %.*s", static_cast<int>(name.size()), name.data());
+          *result = kDuplicateEntry;
+        }
+        return false;
+      }
+    }
+    remaining.swap(next);
+  }
+
+  // Slots are numbered in bit order, so they can be filled in with one pass over the bits.
+  ranks_.resize(bits_.size() / kWordsPerRank + 1);
+  uint32_t slot = 0;
+  for (size_t i = 0; i < bits_.size(); i++) {
+    if (i % kWordsPerRank == 0) {
+      ranks_[i / kWordsPerRank] = slot;
+    }
+    for (uint64_t word = bits_[i]; word != 0; word &= word - 1) {
+      slots_[slot++] = name_offsets[bit_names[i * 64 + __builtin_ctzll(word)]];
+    }
+  }
+
+  *result = 0;
+  return true;
+}
+
+int32_t CdEntryIndex::Create(const uint8_t* cd_base, const std::vector<uint32_t>& name_offsets,
+                             std::unique_ptr<CdEntryIndex>* index) {
+  const uint32_t count = static_cast<uint32_t>(name_offsets.size());
+  std::unique_ptr<CdEntryIndex> result(new CdEntryIndex(cd_base, count));
+
+  for (int i = 0; i < kMaxSeeds; i++) {
+    result->seed_ = Mix(static_cast<uint64_t>(i) + 1);
+    int32_t error = kAllocationFailed;
+    if (result->Build(name_offsets, &error)) {
+      *index = std::move(result);
+      return 0;
+    }
+    if (error == kDuplicateEntry) {
+      return error;
+    }
+  }
+
+  ALOGW("Zip: unable to build an index of %u entries", count);
+  return kAllocationFailed;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/**
+ * An immutable index of the entry names in a mapped central directory.
+ *
+ * Names are found through a minimal perfect hash that numbers the n entries
+ * 0 to n-1. It is a stack of bit arrays: a name hashes to one bit in each,
+ * and the first array whose bit is set tells where it stopped. Counting the
+ * set bits before that one gives the name's slot, which holds the 4 byte
+ * offset of the name in the central directory; the name's length is in the
+ * record right before it. A lookup is one hash, usually one or two bit
+ * tests, and a single name comparison, and the index is about 4.5 bytes per
+ * entry. It is built with a couple of passes over bit arrays that fit in
+ * cache, so it takes no longer than filling a hash table would.
+ *
+ * All of it is plain data, fixed once built, with nothing pointing into the
+ * process, so the index could equally be mapped read-only from a file.
+ *
+ * Names in sorted order, which turn a prefix into a range, are only worked
+ * out the first time a prefix is asked for.
+ */
+class CdEntryIndex {
+ public:
+  /**
+   * Builds the index of the names at |name_offsets| in the central directory
+   * mapped at |cd_base|. Each offset is that of the name, which follows its
+   * CentralDirectoryRecord. Returns 0 on success, or kDuplicateEntry if two
+   * entries have the same name.
+   */
+  static int32_t Create(const uint8_t* cd_base, const std::vector<uint32_t>& name_offsets,
+                        std::unique_ptr<CdEntryIndex>* index);
+
+  /** The number of slots, one per entry, numbered from 0. */
+  uint32_t SlotCount() const { return slot_count_; }
+
+  /** Returns the slot holding the entry called |name|, or kEntryNotFound. */
+  int64_t Find(std::string_view name) const;
+
+  /** Returns the offset of the name in |slot|. */
+  uint32_t NameOffset(uint32_t slot) const { return slots_[slot]; }
+
+  /** Returns the name in |slot|. */
+  std::string_view Name(uint32_t slot) const;
+
+  /**
+   * Returns the slots of every entry whose name starts with |prefix|, in
+   * name order, as a [begin, end) range that lives as long as the index.
+   */
+  std::pair<const uint32_t*, const uint32_t*> PrefixRange(std::string_view prefix) const;
+
+ private:
+  CdEntryIndex(const uint8_t* cd_base, uint32_t slot_count);
+
+  std::string_view NameAtOffset(uint32_t name_offset) const;
+  uint32_t Rank(uint32_t bit) const;
+  bool Build(const std::vector<uint32_t>& name_offsets, int32_t* result);
+
+  const uint8_t* const cd_base_;
+  const uint32_t slot_count_;
+  uint64_t seed_ = 0;
+  // The bit arrays, one after the other. Level i is bits [level_starts_[i], level_starts_[i+1]).
+  std::vector<uint32_t> level_starts_;
+  std::vector<uint64_t> bits_;
+  // The number of set bits before each run of kWordsPerRank words.
+  std::vector<uint32_t> ranks_;
+  std::unique_ptr<uint32_t[]> slots_;
+
+  mutable std::mutex sorted_lock_;
+  mutable std::vector<uint32_t> sorted_slots_;
+};
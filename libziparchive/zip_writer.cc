@@ -22,7 +22,13 @@
 #include <cstdio>
 #define DEF_MEM_LEVEL 8  // normally in zutil.h?
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <memory>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "android-base/logging.h"
@@ -47,6 +53,16 @@ enum {
 // Size of the output buffer used for compression.
 static const size_t kBufSize = 32768u;
 
+// In parallel mode, entry data is deflated in blocks of this size.
+static const size_t kDeflateBlockSize = 128 * 1024;
+
+// Each block is primed with this much of the data before it, as far back as deflate can refer.
+static const size_t kDeflateDictionarySize = 32 * 1024;
+
+// In parallel mode, the writer waits for the oldest block once the data of this many blocks per
+// thread is waiting to be written.
+static const size_t kQueuedBlocksPerThread = 4;
+
 // No error, operation completed successfully.
 static const int32_t kNoError = 0;
 
@@ -84,6 +100,165 @@ static void DeleteZStream(z_stream* stream) {
   delete stream;
 }
 
+static int DeflateInit(z_stream* stream) {
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wold-style-cast"
+  return deflateInit2(stream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL,
+                      Z_DEFAULT_STRATEGY);
+#pragma GCC diagnostic pop
+}
+
+/**
+ * Deflates blocks of entry data on a set of threads, and holds the entries that haven't been
+ * written to the file yet.
+ */
+class ZipWriter::ParallelDeflater {
+ public:
+  struct Block {
+    // The dictionary followed by the data, for a block to be deflated.
+    std::vector<uint8_t> input;
+    size_t dictionary_length = 0;
+    // Whether this is the entry's last block, which ends its deflate stream.
+    bool last = false;
+    // The length of the entry data in the block.
+    size_t length = 0;
+
+    // Set once |output| is ready. Stored data goes straight into |output|.
+    std::atomic<bool> done{false};
+    bool ok = false;
+    std::vector<uint8_t> output;
+  };
+
+  struct Entry {
+    FileEntry file;
+    uint32_t alignment = 0;
+    bool header_written = false;
+    // The blocks of data not written yet, in order.
+    std::deque<std::shared_ptr<Block>> blocks;
+    // Whether FinishEntry() has been called for it.
+    bool finished = false;
+  };
+
+  explicit ParallelDeflater(unsigned int threads);
+  ~ParallelDeflater();
+
+  void Deflate(const std::shared_ptr<Block>& block);
+  void Wait(const Block& block);
+
+  const size_t max_queued_bytes;
+
+  // The entries not all written yet, oldest first. Only the last one can still be open.
+  std::deque<Entry> entries;
+  // Data of the open entry that isn't in a block yet, after the dictionary for its block.
+  std::vector<uint8_t> input;
+  size_t dictionary_length = 0;
+  // The total length of the data in the blocks of |entries|.
+  size_t queued_bytes = 0;
+
+ private:
+  static bool DeflateBlock(z_stream* stream, Block* block);
+  void Run();
+
+  std::mutex lock_;
+  std::condition_variable work_added_;
+  std::condition_variable work_done_;
+  std::deque<std::shared_ptr<Block>> work_;
+  bool stopping_ = false;
+  std::vector<std::thread> threads_;
+};
+
+ZipWriter::ParallelDeflater::ParallelDeflater(unsigned int threads)
+    : max_queued_bytes(threads * kQueuedBlocksPerThread * kDeflateBlockSize) {
+  for (unsigned int i = 0; i < threads; i++) {
+    threads_.emplace_back(&ParallelDeflater::Run, this);
+  }
+}
+
+ZipWriter::ParallelDeflater::~ParallelDeflater() {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    stopping_ = true;
+  }
+  work_added_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void ZipWriter::ParallelDeflater::Deflate(const std::shared_ptr<Block>& block) {
+  {
+    std::lock_guard<std::mutex> lock(lock_);
+    work_.push_back(block);
+  }
+  work_added_.notify_one();
+}
+
+void ZipWriter::ParallelDeflater::Wait(const Block& block) {
+  std::unique_lock<std::mutex> lock(lock_);
+  work_done_.wait(lock, [&block] { return block.done.load(); });
+}
+
+bool ZipWriter::ParallelDeflater::DeflateBlock(z_stream* stream, Block* block) {
+  if (deflateReset(stream) != Z_OK) {
+    return false;
+  }
+  if (block->dictionary_length != 0 &&
+      deflateSetDictionary(stream, block->input.data(),
+                           static_cast<uint32_t>(block->dictionary_length)) != Z_OK) {
+    return false;
+  }
+
+  const size_t data_length = block->input.size() - block->dictionary_length;
+  stream->next_in = block->input.data() + block->dictionary_length;
+  stream->avail_in = static_cast<uint32_t>(data_length);
+  // deflateBound() doesn't count the empty stored block that a sync flush ends with.
+  block->output.resize(deflateBound(stream, static_cast<uLong>(data_length)) + 16);
+  stream->next_out = block->output.data();
+  stream->avail_out = static_cast<uint32_t>(block->output.size());
+
+  // Every block but the last ends on a byte boundary without ending the deflate stream, so the
+  // next block's output can follow straight on.
+  const int flush = block->last ? Z_FINISH : Z_SYNC_FLUSH;
+  int zerr;
+  while ((zerr = deflate(stream, flush)) == Z_OK && stream->avail_out == 0) {
+    const size_t used = block->output.size();
+    block->output.resize(used + kBufSize);
+    stream->next_out = block->output.data() + used;
+    stream->avail_out = static_cast<uint32_t>(kBufSize);
+  }
+  block->output.resize(block->output.size() - stream->avail_out);
+
+  if (block->last) {
+    return zerr == Z_STREAM_END;
+  }
+  // A flush that exactly filled the output has nothing left to do the next time round.
+  return (zerr == Z_OK || zerr == Z_BUF_ERROR) && stream->avail_in == 0;
+}
+
+void ZipWriter::ParallelDeflater::Run() {
+  std::unique_ptr<z_stream, void (*)(z_stream*)> stream(new z_stream(), DeleteZStream);
+  const int init_error = DeflateInit(stream.get());
+  if (init_error != Z_OK) {
+    LOG(ERROR) << "deflateInit2 failed (zerr=" << init_error << ")";
+  }
+
+  std::unique_lock<std::mutex> lock(lock_);
+  while (true) {
+    work_added_.wait(lock, [this] { return stopping_ || !work_.empty(); });
+    if (stopping_) {
+      return;
+    }
+    std::shared_ptr<Block> block = std::move(work_.front());
+    work_.pop_front();
+
+    lock.unlock();
+    block->ok = init_error == Z_OK && DeflateBlock(stream.get(), block.get());
+    lock.lock();
+    block->done = true;
+    work_done_.notify_all();
+  }
+}
+
 ZipWriter::ZipWriter(FILE* f)
     : file_(f),
       seekable_(false),
@@ -106,7 +281,8 @@ ZipWriter::ZipWriter(ZipWriter&& writer) noexcept
       state_(writer.state_),
       files_(std::move(writer.files_)),
       z_stream_(std::move(writer.z_stream_)),
-      buffer_(std::move(writer.buffer_)) {
+      buffer_(std::move(writer.buffer_)),
+      parallel_deflater_(std::move(writer.parallel_deflater_)) {
   writer.file_ = nullptr;
   writer.state_ = State::kError;
 }
@@ -119,11 +295,26 @@ ZipWriter& ZipWriter::operator=(ZipWriter&& writer) noexcept {
   files_ = std::move(writer.files_);
   z_stream_ = std::move(writer.z_stream_);
   buffer_ = std::move(writer.buffer_);
+  parallel_deflater_ = std::move(writer.parallel_deflater_);
   writer.file_ = nullptr;
   writer.state_ = State::kError;
   return *this;
 }
 
+ZipWriter::~ZipWriter() = default;
+
+int32_t ZipWriter::EnableParallelDeflate(unsigned int threads) {
+  if (state_ != State::kWritingZip || !files_.empty()) {
+    return kInvalidState;
+  }
+
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  parallel_deflater_.reset(new ParallelDeflater(threads));
+  return kNoError;
+}
+
 int32_t ZipWriter::HandleError(int32_t error_code) {
   state_ = State::kError;
   z_stream_.reset();
@@ -205,7 +396,11 @@ int32_t ZipWriter::StartAlignedEntryWithTime(std::string_view path, size_t flags
   }
 
   // Can only have 16535 entries because of zip records.
-  if (files_.size() == std::numeric_limits<uint16_t>::max()) {
+  size_t entry_count = files_.size();
+  if (parallel_deflater_ != nullptr) {
+    entry_count += parallel_deflater_->entries.size();
+  }
+  if (entry_count == std::numeric_limits<uint16_t>::max()) {
     return HandleError(kIoError);
   }
 
@@ -221,13 +416,7 @@ int32_t ZipWriter::StartAlignedEntryWithTime(std::string_view path, size_t flags
   }
 
   FileEntry file_entry = {};
-  file_entry.local_file_header_offset = current_offset_;
   file_entry.path = path;
-  // No support for larger than 4GB files.
-  if (file_entry.local_file_header_offset > std::numeric_limits<uint32_t>::max()) {
-    return HandleError(kIoError);
-  }
-
   if (!IsValidEntryName(reinterpret_cast<const uint8_t*>(file_entry.path.data()),
                         file_entry.path.size())) {
     return kInvalidEntryName;
@@ -236,9 +425,11 @@ int32_t ZipWriter::StartAlignedEntryWithTime(std::string_view path, size_t flags
   if (flags & ZipWriter::kCompress) {
     file_entry.compression_method = kCompressDeflated;
 
-    int32_t result = PrepareDeflate();
-    if (result != kNoError) {
-      return result;
+    if (parallel_deflater_ == nullptr) {
+      int32_t result = PrepareDeflate();
+      if (result != kNoError) {
+        return result;
+      }
     }
   } else {
     file_entry.compression_method = kCompressStored;
@@ -246,7 +437,38 @@ int32_t ZipWriter::StartAlignedEntryWithTime(std::string_view path, size_t flags
 
   ExtractTimeAndDate(time, &file_entry.last_mod_time, &file_entry.last_mod_date);
 
-  off_t offset = current_offset_ + sizeof(LocalFileHeader) + file_entry.path.size();
+  if (parallel_deflater_ != nullptr) {
+    // The header is written once the entries before this one have been.
+    ParallelDeflater::Entry entry;
+    entry.file = file_entry;
+    entry.alignment = alignment;
+    parallel_deflater_->entries.push_back(std::move(entry));
+    parallel_deflater_->input.clear();
+    parallel_deflater_->dictionary_length = 0;
+
+    current_file_entry_ = std::move(file_entry);
+    state_ = State::kWritingEntry;
+    return WritePendingEntries(false /*wait_for_all*/);
+  }
+
+  int32_t result = WriteLocalFileHeader(&file_entry, alignment);
+  if (result != kNoError) {
+    return result;
+  }
+
+  current_file_entry_ = std::move(file_entry);
+  state_ = State::kWritingEntry;
+  return kNoError;
+}
+
+int32_t ZipWriter::WriteLocalFileHeader(FileEntry* file, uint32_t alignment) {
+  file->local_file_header_offset = current_offset_;
+  // No support for larger than 4GB files.
+  if (file->local_file_header_offset > std::numeric_limits<uint32_t>::max()) {
+    return HandleError(kIoError);
+  }
+
+  off_t offset = current_offset_ + sizeof(LocalFileHeader) + file->path.size();
   // prepare a pre-zeroed memory page in case when we need to pad some aligned data.
   static constexpr auto kPageSize = 4096;
   static constexpr char kSmallZeroPadding[kPageSize] = {};
@@ -257,7 +479,7 @@ int32_t ZipWriter::StartAlignedEntryWithTime(std::string_view path, size_t flags
   if (alignment != 0 && (offset & (alignment - 1))) {
     // Pad the extra field so the data will be aligned.
     uint16_t padding = static_cast<uint16_t>(alignment - (offset % alignment));
-    file_entry.padding_length = padding;
+    file->padding_length = padding;
     offset += padding;
     if (padding <= std::size(kSmallZeroPadding)) {
         zero_padding = kSmallZeroPadding;
@@ -270,29 +492,36 @@ int32_t ZipWriter::StartAlignedEntryWithTime(std::string_view path, size_t flags
   LocalFileHeader header = {};
   // Always start expecting a data descriptor. When the data has finished being written,
   // if it is possible to seek back, the GPB flag will reset and the sizes written.
-  CopyFromFileEntry(file_entry, true /*use_data_descriptor*/, &header);
+  CopyFromFileEntry(*file, true /*use_data_descriptor*/, &header);
 
   if (fwrite(&header, sizeof(header), 1, file_) != 1) {
     return HandleError(kIoError);
   }
 
-  if (fwrite(path.data(), 1, path.size(), file_) != path.size()) {
+  if (fwrite(file->path.data(), 1, file->path.size(), file_) != file->path.size()) {
     return HandleError(kIoError);
   }
 
-  if (file_entry.padding_length != 0 && fwrite(zero_padding, 1, file_entry.padding_length,
-                                               file_) != file_entry.padding_length) {
+  if (file->padding_length != 0 && fwrite(zero_padding, 1, file->padding_length,
+                                          file_) != file->padding_length) {
     return HandleError(kIoError);
   }
 
-  current_file_entry_ = std::move(file_entry);
   current_offset_ = offset;
-  state_ = State::kWritingEntry;
   return kNoError;
 }
 
 int32_t ZipWriter::DiscardLastEntry() {
-  if (state_ != State::kWritingZip || files_.empty()) {
+  if (state_ != State::kWritingZip) {
+    return kInvalidState;
+  }
+  if (parallel_deflater_ != nullptr) {
+    int32_t result = WritePendingEntries(true /*wait_for_all*/);
+    if (result != kNoError) {
+      return result;
+    }
+  }
+  if (files_.empty()) {
     return kInvalidState;
   }
 
@@ -308,6 +537,12 @@ int32_t ZipWriter::DiscardLastEntry() {
 int32_t ZipWriter::GetLastEntry(FileEntry* out_entry) {
   CHECK(out_entry != nullptr);
 
+  if (state_ != State::kError && parallel_deflater_ != nullptr) {
+    int32_t result = WritePendingEntries(true /*wait_for_all*/);
+    if (result != kNoError) {
+      return result;
+    }
+  }
   if (files_.empty()) {
     return kInvalidState;
   }
@@ -321,11 +556,7 @@ int32_t ZipWriter::PrepareDeflate() {
   // Initialize the z_stream for compression.
   z_stream_ = std::unique_ptr<z_stream, void (*)(z_stream*)>(new z_stream(), DeleteZStream);
 
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wold-style-cast"
-  int zerr = deflateInit2(z_stream_.get(), Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS,
-                          DEF_MEM_LEVEL, Z_DEFAULT_STRATEGY);
-#pragma GCC diagnostic pop
+  int zerr = DeflateInit(z_stream_.get());
 
   if (zerr != Z_OK) {
     if (zerr == Z_VERSION_ERROR) {
@@ -355,7 +586,9 @@ int32_t ZipWriter::WriteBytes(const void* data, size_t len) {
   uint32_t len32 = static_cast<uint32_t>(len);
 
   int32_t result = kNoError;
-  if (current_file_entry_.compression_method & kCompressDeflated) {
+  if (parallel_deflater_ != nullptr) {
+    result = QueueBytes(data, len32);
+  } else if (current_file_entry_.compression_method & kCompressDeflated) {
     result = CompressBytes(&current_file_entry_, data, len32);
   } else {
     result = StoreBytes(&current_file_entry_, data, len32);
@@ -455,6 +688,109 @@ int32_t ZipWriter::FlushCompressedBytes(FileEntry* file) {
   return kNoError;
 }
 
+int32_t ZipWriter::QueueBytes(const void* data, uint32_t len) {
+  CHECK(state_ == State::kWritingEntry);
+  ParallelDeflater::Entry& entry = parallel_deflater_->entries.back();
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(data);
+
+  if (entry.file.compression_method == kCompressStored) {
+    // Stored data can go straight to the file once everything before it is there.
+    if (parallel_deflater_->entries.size() == 1 && entry.header_written && entry.blocks.empty()) {
+      return StoreBytes(&entry.file, data, len);
+    }
+    auto block = std::make_shared<ParallelDeflater::Block>();
+    block->output.assign(bytes, bytes + len);
+    block->length = len;
+    block->ok = true;
+    block->done = true;
+    entry.blocks.push_back(std::move(block));
+    parallel_deflater_->queued_bytes += len;
+  } else {
+    std::vector<uint8_t>& input = parallel_deflater_->input;
+    while (len > 0) {
+      const size_t block_length = input.size() - parallel_deflater_->dictionary_length;
+      const uint32_t n =
+          static_cast<uint32_t>(std::min<size_t>(len, kDeflateBlockSize - block_length));
+      input.insert(input.end(), bytes, bytes + n);
+      bytes += n;
+      len -= n;
+      if (block_length + n == kDeflateBlockSize) {
+        QueueDeflateBlock(false /*last*/);
+      }
+    }
+  }
+
+  return WritePendingEntries(false /*wait_for_all*/);
+}
+
+void ZipWriter::QueueDeflateBlock(bool last) {
+  auto block = std::make_shared<ParallelDeflater::Block>();
+  block->input = std::move(parallel_deflater_->input);
+  block->dictionary_length = parallel_deflater_->dictionary_length;
+  block->last = last;
+  block->length = block->input.size() - block->dictionary_length;
+
+  // The next block is primed with the data that comes right before it.
+  const size_t dictionary_length = std::min(kDeflateDictionarySize, block->input.size());
+  parallel_deflater_->input.assign(block->input.end() - dictionary_length, block->input.end());
+  parallel_deflater_->dictionary_length = dictionary_length;
+
+  parallel_deflater_->queued_bytes += block->length;
+  parallel_deflater_->entries.back().blocks.push_back(block);
+  parallel_deflater_->Deflate(block);
+}
+
+// Writes out the pending entries as far as their blocks are done. Then waits for more blocks to
+// be done, either until all of them have been or only until no more than the limit of data is
+// left waiting.
+int32_t ZipWriter::WritePendingEntries(bool wait_for_all) {
+  std::deque<ParallelDeflater::Entry>& entries = parallel_deflater_->entries;
+  while (!entries.empty()) {
+    ParallelDeflater::Entry& entry = entries.front();
+    if (!entry.header_written) {
+      int32_t result = WriteLocalFileHeader(&entry.file, entry.alignment);
+      if (result != kNoError) {
+        return result;
+      }
+      entry.header_written = true;
+    }
+
+    while (!entry.blocks.empty()) {
+      const ParallelDeflater::Block& block = *entry.blocks.front();
+      if (!block.done) {
+        if (!wait_for_all &&
+            parallel_deflater_->queued_bytes <= parallel_deflater_->max_queued_bytes) {
+          return kNoError;
+        }
+        parallel_deflater_->Wait(block);
+      }
+      if (!block.ok) {
+        return HandleError(kZlibError);
+      }
+
+      const size_t write_bytes = block.output.size();
+      if (fwrite(block.output.data(), 1, write_bytes, file_) != write_bytes) {
+        return HandleError(kIoError);
+      }
+      entry.file.compressed_size += static_cast<uint32_t>(write_bytes);
+      current_offset_ += write_bytes;
+      parallel_deflater_->queued_bytes -= block.length;
+      entry.blocks.pop_front();
+    }
+
+    if (!entry.finished) {
+      return kNoError;
+    }
+    int32_t result = WriteEntryTrailer(entry.file);
+    if (result != kNoError) {
+      return result;
+    }
+    files_.emplace_back(std::move(entry.file));
+    entries.pop_front();
+  }
+  return kNoError;
+}
+
 bool ZipWriter::ShouldUseDataDescriptor() const {
   // Only use a trailing "data descriptor" if the output isn't seekable.
   return !seekable_;
@@ -465,6 +801,18 @@ int32_t ZipWriter::FinishEntry() {
     return kInvalidState;
   }
 
+  if (parallel_deflater_ != nullptr) {
+    ParallelDeflater::Entry& entry = parallel_deflater_->entries.back();
+    if (entry.file.compression_method & kCompressDeflated) {
+      QueueDeflateBlock(true /*last*/);
+    }
+    entry.file.crc32 = current_file_entry_.crc32;
+    entry.file.uncompressed_size = current_file_entry_.uncompressed_size;
+    entry.finished = true;
+    state_ = State::kWritingZip;
+    return WritePendingEntries(false /*wait_for_all*/);
+  }
+
   if (current_file_entry_.compression_method & kCompressDeflated) {
     int32_t result = FlushCompressedBytes(&current_file_entry_);
     if (result != kNoError) {
@@ -472,6 +820,17 @@ int32_t ZipWriter::FinishEntry() {
     }
   }
 
+  int32_t result = WriteEntryTrailer(current_file_entry_);
+  if (result != kNoError) {
+    return result;
+  }
+
+  files_.emplace_back(std::move(current_file_entry_));
+  state_ = State::kWritingZip;
+  return kNoError;
+}
+
+int32_t ZipWriter::WriteEntryTrailer(const FileEntry& file) {
   if (ShouldUseDataDescriptor()) {
     // Some versions of ZIP don't allow STORED data to have a trailing DataDescriptor.
     // If this file is not seekable, or if the data is compressed, write a DataDescriptor.
@@ -481,21 +840,21 @@ int32_t ZipWriter::FinishEntry() {
     }
 
     DataDescriptor dd = {};
-    dd.crc32 = current_file_entry_.crc32;
-    dd.compressed_size = current_file_entry_.compressed_size;
-    dd.uncompressed_size = current_file_entry_.uncompressed_size;
+    dd.crc32 = file.crc32;
+    dd.compressed_size = file.compressed_size;
+    dd.uncompressed_size = file.uncompressed_size;
     if (fwrite(&dd, sizeof(dd), 1, file_) != 1) {
       return HandleError(kIoError);
     }
     current_offset_ += sizeof(DataDescriptor::kOptSignature) + sizeof(dd);
   } else {
     // Seek back to the header and rewrite to include the size.
-    if (fseeko(file_, current_file_entry_.local_file_header_offset, SEEK_SET) != 0) {
+    if (fseeko(file_, file.local_file_header_offset, SEEK_SET) != 0) {
       return HandleError(kIoError);
     }
 
     LocalFileHeader header = {};
-    CopyFromFileEntry(current_file_entry_, false /*use_data_descriptor*/, &header);
+    CopyFromFileEntry(file, false /*use_data_descriptor*/, &header);
 
     if (fwrite(&header, sizeof(header), 1, file_) != 1) {
       return HandleError(kIoError);
@@ -505,9 +864,6 @@ int32_t ZipWriter::FinishEntry() {
       return HandleError(kIoError);
     }
   }
-
-  files_.emplace_back(std::move(current_file_entry_));
-  state_ = State::kWritingZip;
   return kNoError;
 }
 
@@ -516,6 +872,13 @@ int32_t ZipWriter::Finish() {
     return kInvalidState;
   }
 
+  if (parallel_deflater_ != nullptr) {
+    int32_t result = WritePendingEntries(true /*wait_for_all*/);
+    if (result != kNoError) {
+      return result;
+    }
+  }
+
   off_t startOfCdr = current_offset_;
   for (FileEntry& file : files_) {
     CentralDirectoryRecord cdr = {};
@@ -20,7 +20,9 @@
 #include <android-base/test_utils.h>
 #include <gtest/gtest.h>
 #include <time.h>
+#include <algorithm>
 #include <memory>
+#include <string>
 #include <vector>
 
 static ::testing::AssertionResult AssertFileEntryContentsEq(const std::string& expected,
@@ -403,6 +405,124 @@ TEST_F(zipwriter, TruncateFileAfterBackup) {
   ASSERT_GT(before_len, after_len);
 }
 
+// Writes a mix of entries, using parallel deflate with |threads| threads.
+static void WriteParallelDeflateZip(FILE* file, unsigned int threads, const std::string& large) {
+  ZipWriter writer(file);
+  ASSERT_EQ(0, writer.EnableParallelDeflate(threads));
+
+  // Written in uneven pieces so that blocks are made of several writes, and writes span blocks.
+  ASSERT_EQ(0, writer.StartEntry("large.txt", ZipWriter::kCompress));
+  for (size_t offset = 0; offset < large.size(); offset += 100000) {
+    const size_t length = std::min<size_t>(100000, large.size() - offset);
+    ASSERT_EQ(0, writer.WriteBytes(large.data() + offset, length));
+  }
+  ASSERT_EQ(0, writer.FinishEntry());
+
+  ASSERT_EQ(0, writer.StartEntry("small.txt", ZipWriter::kCompress));
+  ASSERT_EQ(0, writer.WriteBytes("helo", 4));
+  ASSERT_EQ(0, writer.FinishEntry());
+
+  ASSERT_EQ(0, writer.StartAlignedEntry("stored.txt", 0, 4096));
+  ASSERT_EQ(0, writer.WriteBytes(large.data(), 300000));
+  ASSERT_EQ(0, writer.FinishEntry());
+
+  ASSERT_EQ(0, writer.StartEntry("empty.txt", ZipWriter::kCompress));
+  ASSERT_EQ(0, writer.FinishEntry());
+
+  ASSERT_EQ(0, writer.Finish());
+}
+
+static std::string MakeLargeText() {
+  std::string text;
+  for (size_t i = 0; text.size() < 1000000; i++) {
+    text += "line " + std::to_string(i * 7919 % 100003) + "\n";
+  }
+  return text;
+}
+
+TEST_F(zipwriter, ParallelDeflate) {
+  const std::string large = MakeLargeText();
+  ASSERT_NO_FATAL_FAILURE(WriteParallelDeflateZip(file_, 4, large));
+  ASSERT_GE(0, lseek(fd_, 0, SEEK_SET));
+
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveFd(fd_, "temp", &handle, false));
+
+  ZipEntry data;
+  ASSERT_EQ(0, FindEntry(handle, "large.txt", &data));
+  EXPECT_EQ(kCompressDeflated, data.method);
+  EXPECT_EQ(0u, data.has_data_descriptor);
+  EXPECT_GT(large.size() / 2, data.compressed_length);
+  ASSERT_TRUE(AssertFileEntryContentsEq(large, handle, &data));
+
+  ASSERT_EQ(0, FindEntry(handle, "small.txt", &data));
+  EXPECT_EQ(kCompressDeflated, data.method);
+  ASSERT_TRUE(AssertFileEntryContentsEq("helo", handle, &data));
+
+  ASSERT_EQ(0, FindEntry(handle, "stored.txt", &data));
+  EXPECT_EQ(kCompressStored, data.method);
+  EXPECT_EQ(0, data.offset & 0xfff);
+  ASSERT_TRUE(AssertFileEntryContentsEq(large.substr(0, 300000), handle, &data));
+
+  ASSERT_EQ(0, FindEntry(handle, "empty.txt", &data));
+  ASSERT_TRUE(AssertFileEntryContentsEq("", handle, &data));
+
+  CloseArchive(handle);
+}
+
+TEST_F(zipwriter, ParallelDeflateDoesNotDependOnThreads) {
+  const std::string large = MakeLargeText();
+  ASSERT_NO_FATAL_FAILURE(WriteParallelDeflateZip(file_, 1, large));
+
+  TemporaryFile other_file;
+  FILE* other = fdopen(other_file.fd, "w");
+  ASSERT_NE(nullptr, other);
+  ASSERT_NO_FATAL_FAILURE(WriteParallelDeflateZip(other, 8, large));
+  ASSERT_EQ(0, fclose(other));
+  other_file.fd = -1;
+
+  std::string one_thread;
+  std::string eight_threads;
+  ASSERT_TRUE(android::base::ReadFileToString(temp_file_->path, &one_thread));
+  ASSERT_TRUE(android::base::ReadFileToString(other_file.path, &eight_threads));
+  ASSERT_EQ(one_thread, eight_threads);
+}
+
+TEST_F(zipwriter, ParallelDeflateBackup) {
+  ZipWriter writer(file_);
+  ASSERT_EQ(0, writer.EnableParallelDeflate(2));
+
+  ASSERT_EQ(0, writer.StartEntry("keep.txt", ZipWriter::kCompress));
+  ASSERT_EQ(0, writer.WriteBytes("keep this", 9));
+  ASSERT_EQ(0, writer.FinishEntry());
+  ASSERT_EQ(0, writer.StartEntry("drop.txt", ZipWriter::kCompress));
+  ASSERT_EQ(0, writer.WriteBytes("drop this", 9));
+  ASSERT_EQ(0, writer.FinishEntry());
+
+  ZipWriter::FileEntry entry;
+  ASSERT_EQ(0, writer.GetLastEntry(&entry));
+  EXPECT_EQ("drop.txt", entry.path);
+  ASSERT_EQ(0, writer.DiscardLastEntry());
+  ASSERT_EQ(0, writer.Finish());
+
+  ASSERT_GE(0, lseek(fd_, 0, SEEK_SET));
+  ZipArchiveHandle handle;
+  ASSERT_EQ(0, OpenArchiveFd(fd_, "temp", &handle, false));
+  ZipEntry data;
+  ASSERT_EQ(0, FindEntry(handle, "keep.txt", &data));
+  ASSERT_TRUE(AssertFileEntryContentsEq("keep this", handle, &data));
+  ASSERT_NE(0, FindEntry(handle, "drop.txt", &data));
+  CloseArchive(handle);
+}
+
+TEST_F(zipwriter, ParallelDeflateMustBeFirst) {
+  ZipWriter writer(file_);
+  ASSERT_EQ(0, writer.StartEntry("file.txt", 0));
+  ASSERT_EQ(0, writer.FinishEntry());
+  ASSERT_EQ(-1, writer.EnableParallelDeflate(2));
+  ASSERT_EQ(0, writer.Finish());
+}
+
 static ::testing::AssertionResult AssertFileEntryContentsEq(const std::string& expected,
                                                             ZipArchiveHandle handle,
                                                             ZipEntry* zip_entry) {
@@ -28,7 +28,7 @@
 #include <sys/cdefs.h>  // ___STRING, __predict_true() and _predict_false()
 #include <sys/mman.h>   // mlockall()
 #include <sys/prctl.h>
-#include <sys/stat.h>     // lstat()
+#include <sys/stat.h>     // fstatat()
 #include <sys/syscall.h>  // __NR_getdents64
 #include <sys/sysinfo.h>  // get_nprocs_conf()
 #include <sys/types.h>
@@ -164,6 +164,13 @@ class dir {
           available_bytes(0),
           next(nullptr) {}
 
+    // Opens directory relative to an already open parent, so that the kernel
+    // only has to walk the last path component.
+    dir(int dirfd, const char* directory)
+        : fd(::openat(dirfd, directory, O_CLOEXEC | O_DIRECTORY | O_RDONLY)),
+          available_bytes(0),
+          next(nullptr) {}
+
     // Don't need any copy or move constructors.
     explicit dir(const dir& c) = delete;
     explicit dir(dir& c) = delete;
@@ -177,6 +184,8 @@ class dir {
 
     operator bool() const { return fd >= 0; }
 
+    int getFd(void) const { return fd; }
+
     void reset(void) {
         if (fd >= 0) {
             ::close(fd);
@@ -233,6 +242,27 @@ std::string ReadFile(std::string&& path) {
     return content;
 }
 
+// Reads <dirfd>/<name>/<node> into buf with a single read(), which is all
+// it takes for the small seq_file backed /proc nodes.  Keeps the hot path
+// free of path building, fstat() and std::string reallocation.
+ssize_t llkReadAt(int dirfd, const char* name, const char* node, char* buf, size_t size) {
+    char path[64];
+    snprintf(path, sizeof(path), "%s/%s", name, node);
+    int fd = ::openat(dirfd, path, O_CLOEXEC | O_RDONLY);
+    if (fd < 0) {
+        PLOG(DEBUG) << "Read " << path << " failed";
+        return -1;
+    }
+    auto rc = TEMP_FAILURE_RETRY(::read(fd, buf, size - 1));
+    ::close(fd);
+    if (rc < 0) {
+        PLOG(DEBUG) << "Read " << path << " failed";
+        return -1;
+    }
+    buf[rc] = '\0';
+    return rc;
+}
+
 std::string llkProcGetName(pid_t tid, const char* node = "/cmdline") {
     std::string content = ReadFile(procdir + std::to_string(tid) + node);
     static constexpr char needles[] = " \t\r\n";  // including trailing nul
@@ -756,7 +786,7 @@ bool llkSkipUid(uid_t uid) {
            __predict_true(pwd->pw_name[0] != '\0') && llkSkipName(pwd->pw_name, llkIgnorelistUid);
 }
 
-bool getValidTidDir(dirent* dp, std::string* piddir) {
+bool isValidTidDir(int dirfd, dirent* dp) {
     if (!::isdigit(dp->d_name[0])) {
         return false;
     }
@@ -765,15 +795,12 @@ bool getValidTidDir(dirent* dp, std::string* piddir) {
     if (__predict_false(dp->d_type != DT_DIR)) {
         if (__predict_false(dp->d_type == DT_UNKNOWN)) {  // can't b/c procfs
             struct stat st;
-            *piddir = procdir;
-            *piddir += dp->d_name;
-            return (lstat(piddir->c_str(), &st) == 0) && (st.st_mode & S_IFDIR);
+            return (fstatat(dirfd, dp->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0) &&
+                   S_ISDIR(st.st_mode);
         }
         return false;
     }
 
-    *piddir = procdir;
-    *piddir += dp->d_name;
     return true;
 }
 
@@ -998,32 +1025,36 @@ milliseconds llkCheck(bool checkRunning) {
     auto myPid = ::getpid();
     auto myTid = ::gettid();
     auto dump = true;
+    auto threads = 0;
     for (auto dp = llkTopDirectory.read(); dp != nullptr; dp = llkTopDirectory.read()) {
-        std::string piddir;
-
-        if (!getValidTidDir(dp, &piddir)) {
+        if (!isValidTidDir(llkTopDirectory.getFd(), dp)) {
             continue;
         }
 
         // Get the process tasks
-        std::string taskdir = piddir + "/task/";
+        std::string taskdir = dp->d_name;
+        taskdir += "/task";
         int pid = -1;
-        LOG(VERBOSE) << "+opendir(\"" << taskdir << "\")";
-        dir taskDirectory(taskdir);
+        LOG(VERBOSE) << "+opendir(\"" << procdir << taskdir << "\")";
+        dir taskDirectory(llkTopDirectory.getFd(), taskdir.c_str());
         if (__predict_false(!taskDirectory)) {
-            LOG(DEBUG) << "+opendir(\"" << taskdir << "\") failed";
+            LOG(DEBUG) << "+opendir(\"" << procdir << taskdir << "\") failed";
         }
+        // Without a task directory, the process stands in for its threads.
+        auto taskfd = taskDirectory ? taskDirectory.getFd() : llkTopDirectory.getFd();
         for (auto tp = taskDirectory.read(dir::task, dp); tp != nullptr;
              tp = taskDirectory.read(dir::task)) {
-            if (!getValidTidDir(tp, &piddir)) {
+            if (!isValidTidDir(taskfd, tp)) {
                 continue;
             }
 
-            // Get the process stat
-            std::string stat = ReadFile(piddir + "/stat");
-            if (stat.empty()) {
+            // Get the process stat, the only node read for every thread.
+            // The fields we parse are well within the first 1K.
+            static char stat[1024];
+            if (llkReadAt(taskfd, tp->d_name, "stat", stat, sizeof(stat)) <= 0) {
                 continue;
             }
+            ++threads;
             unsigned tid = -1;
             char pdir[TASK_COMM_LEN + 1];
             char state = '?';
@@ -1034,7 +1065,7 @@ milliseconds llkCheck(bool checkRunning) {
             pdir[0] = '\0';
             // tid should not change value
             auto match = ::sscanf(
-                stat.c_str(),
+                stat,
                 "%u (%" ___STRING(
                     TASK_COMM_LEN) "[^)]) %c %u %*d %*d %*d %*d %*d %*d %*d %*d %*d %u %u %d",
                 &tid, pdir, &state, &ppid, &utime, &stime, &dummy);
@@ -1047,18 +1078,12 @@ milliseconds llkCheck(bool checkRunning) {
                 continue;
             }
 
-            // Get the process cgroup
-            auto cgroup = ReadFile(piddir + "/cgroup");
-            auto frozen = cgroup.find(":freezer:/frozen") != std::string::npos;
-
             auto procp = llkTidLookup(tid);
             if (procp == nullptr) {
-                procp = llkTidAlloc(tid, pid, ppid, pdir, utime + stime, state, frozen);
+                procp = llkTidAlloc(tid, pid, ppid, pdir, utime + stime, state, false);
             } else {
                 // comm can change ...
                 procp->setComm(pdir);
-                // frozen can change, too...
-                procp->setFrozen(frozen);
                 procp->updated = true;
                 // pid/ppid/tid wrap?
                 if (((procp->update != prevUpdate) && (procp->update != llkUpdate)) ||
@@ -1098,6 +1123,12 @@ milliseconds llkCheck(bool checkRunning) {
             if ((tid == myTid) || llkSkipPid(tid)) {
                 continue;
             }
+            std::string piddir = procdir;
+            piddir += tp->d_name;
+            // Get the process cgroup, frozen can change too, but only matters
+            // for the threads that made it this far.
+            auto cgroup = ReadFile(piddir + "/cgroup");
+            procp->setFrozen(cgroup.find(":freezer:/frozen") != std::string::npos);
             if (procp->isFrozen()) {
                 break;
             }
@@ -1205,18 +1236,16 @@ milliseconds llkCheck(bool checkRunning) {
                 }
             }
             // We are here because we have confirmed kernel live-lock
-            std::vector<std::string> threads;
+            std::vector<std::string> group;
             auto taskdir = procdir + std::to_string(tid) + "/task/";
             dir taskDirectory(taskdir);
             for (auto tp = taskDirectory.read(); tp != nullptr; tp = taskDirectory.read()) {
-                std::string piddir;
-                if (getValidTidDir(tp, &piddir))
-                    threads.push_back(android::base::Basename(piddir));
+                if (isValidTidDir(taskDirectory.getFd(), tp)) group.push_back(tp->d_name);
             }
             const auto message = state + " "s + llkFormat(procp->count) + " " +
                                  std::to_string(ppid) + "->" + std::to_string(pid) + "->" +
                                  std::to_string(tid) + " " + process_comm + " [panic]\n" +
-                                 "  thread group: {" + android::base::Join(threads, ",") +
+                                 "  thread group: {" + android::base::Join(group, ",") +
                                  "}";
             llkPanicKernel(dump, tid,
                            (state == 'Z') ? "zombie" : (state == 'D') ? "driver" : "sleeping",
@@ -1259,7 +1288,8 @@ milliseconds llkCheck(bool checkRunning) {
     timespec end;
     ::clock_gettime(CLOCK_MONOTONIC_COARSE, &end);
     auto milli = llkGetTimespecDiffMs(&now, &end);
-    LOG((milli > 10s) ? ERROR : (milli > 1s) ? WARNING : VERBOSE) << "sample " << llkFormat(milli);
+    LOG((milli > 10s) ? ERROR : (milli > 1s) ? WARNING : VERBOSE)
+            << "sample " << llkFormat(milli) << " threads=" << threads;
 
     // cap to minimum sleep for 1 second since last cycle
     if (llkCycle < (ms + 1s)) {
@@ -31,12 +31,18 @@
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <atomic>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <regex>
+#include <set>
 #include <string>
+#include <thread>
 #include <utility>
 #include <vector>
 
@@ -68,11 +74,45 @@ class Logcat {
     int Run(int argc, char** argv);
 
   private:
+    // One entry of a --format-threads batch, formatted into a buffer that is kept between uses.
+    struct FormatSlot {
+        struct log_msg msg;
+        std::vector<char> line;
+        size_t length = 0;  // of the formatted line, 0 if not printed
+        bool match = false;
+        bool failed = false;
+    };
+
+    struct FormatBatch {
+        std::vector<FormatSlot> slots;
+        size_t count = 0;
+        size_t next = 0;  // next slot to be claimed by a formatter
+        size_t done = 0;  // slots formatted
+        // android_logger_list_read() ended the dump after this batch
+        bool last = false;
+        int read_result = 0;
+        struct log_msg read_msg;
+    };
+
     void RotateLogs();
+    bool ProcessEntry(struct log_msg* buf, AndroidLogEntry* entry, char* binary_msg_buf,
+                      size_t binary_msg_buf_size, bool* match);
     void ProcessBuffer(struct log_msg* buf);
+    const std::string* NextDivider(log_id_t log_id, bool print_dividers);
     void PrintDividers(log_id_t log_id, bool print_dividers);
     void SetupOutputAndSchedulingPolicy(bool blocking);
     int SetLogFormat(const char* format_string);
+    void RunPipeline(struct logger_list* logger_list, bool print_dividers);
+    void PipelineReader(struct logger_list* logger_list);
+    void PipelineFormatter();
+    void FormatSlotLine(FormatSlot* slot);
+    bool PipelineWork(FormatBatch** batch, size_t* begin, size_t* end);
+    void WritePipelineBatch(FormatBatch* batch, bool print_dividers);
+    bool ArchiveTag(struct log_msg* log_msg, std::string* tag);
+    void OpenArchiveIndex();
+    void WriteArchiveEntry(struct log_msg* log_msg);
+    void FlushArchiveBlock();
+    int ReadArchive(log_time start, bool print_dividers);
 
     // Used for all options
     android::base::unique_fd output_fd_{dup(STDOUT_FILENO)};
@@ -100,6 +140,31 @@ class Logcat {
     // For PrintDividers()
     log_id_t last_printed_id_ = LOG_ID_MAX;
     bool printed_start_[LOG_ID_MAX] = {};
+    std::string dividers_[2][LOG_ID_MAX];
+
+    // For --format-threads, see RunPipeline()
+    size_t format_threads_ = 0;
+    bool monotonic_format_ = false;
+    std::vector<std::unique_ptr<FormatBatch>> batches_;
+    std::mutex pipeline_lock_;
+    std::condition_variable batch_free_;
+    std::condition_variable batch_ready_;
+    std::condition_variable batch_done_;
+    // Batches are used round robin: the reader fills read_seq_, the writer empties write_seq_.
+    size_t read_seq_ = 0;
+    size_t write_seq_ = 0;
+    bool pipeline_stop_ = false;
+
+    // For --binary-archive and --read-archive, see WriteArchiveEntry()
+    bool binary_archive_ = false;
+    android::base::unique_fd archive_index_fd_;
+    uint64_t archive_block_offset_ = 0;
+    size_t archive_block_count_ = 0;
+    log_time archive_block_first_;
+    log_time archive_block_last_;
+    std::set<std::string> archive_block_tags_;
+    const char* read_archive_ = nullptr;
+    std::set<std::string> archive_tags_;
 
     bool debug_ = false;
 };
@@ -134,11 +199,110 @@ static void closeLogFile(const char* pathname) {
     close(fd);
 }
 
+// --binary-archive writes <file> as a sequence of raw log entries, each prefixed with its length
+// as a native uint32_t, and <file>.idx as a sequence of ArchiveBlock records. Each block covers
+// kArchiveBlockEntries entries of <file> and is followed by the distinct tags logged in it, each as
+// a uint8_t length and the tag itself. A block is only indexed once complete, entries after the
+// last indexed block are always scanned.
+struct __attribute__((__packed__)) ArchiveBlock {
+    uint64_t offset;
+    uint64_t length;
+    uint32_t first_sec;
+    uint32_t first_nsec;
+    uint32_t last_sec;
+    uint32_t last_nsec;
+    uint16_t nr_tags;
+};
+
+static constexpr size_t kArchiveBlockEntries = 256;
+
+static std::string ArchiveIndexName(const std::string& file) {
+    return file + ".idx";
+}
+
+struct ArchiveIndexEntry {
+    ArchiveBlock block;
+    std::vector<std::string> tags;
+};
+
+// Returns what could be parsed of <file>.idx, a torn last block is ignored.
+static std::vector<ArchiveIndexEntry> ReadArchiveIndex(const std::string& file) {
+    std::vector<ArchiveIndexEntry> index;
+    std::string content;
+    if (!android::base::ReadFileToString(ArchiveIndexName(file), &content)) return index;
+
+    const char* cp = content.data();
+    const char* end = cp + content.size();
+    while (static_cast<size_t>(end - cp) >= sizeof(ArchiveBlock)) {
+        ArchiveIndexEntry entry;
+        memcpy(&entry.block, cp, sizeof(entry.block));
+        cp += sizeof(entry.block);
+        for (uint16_t i = 0; i < entry.block.nr_tags; ++i) {
+            if (cp >= end || static_cast<size_t>(end - cp) < 1u + static_cast<uint8_t>(*cp)) {
+                return index;
+            }
+            entry.tags.emplace_back(cp + 1, static_cast<uint8_t>(*cp));
+            cp += 1 + static_cast<uint8_t>(*cp);
+        }
+        index.emplace_back(std::move(entry));
+    }
+    return index;
+}
+
+// Reads the entry at *offset into log_msg and advances *offset past it, false at the end of the
+// range or at anything that does not look like an entry.
+static bool ReadArchiveRecord(int fd, uint64_t* offset, uint64_t end, struct log_msg* log_msg) {
+    uint32_t len;
+    if (*offset + sizeof(len) > end ||
+        TEMP_FAILURE_RETRY(pread(fd, &len, sizeof(len), *offset)) != sizeof(len)) {
+        return false;
+    }
+    if (len < sizeof(log_msg->entry) || len > LOGGER_ENTRY_MAX_LEN ||
+        *offset + sizeof(len) + len > end ||
+        TEMP_FAILURE_RETRY(pread(fd, log_msg->buf, len, *offset + sizeof(len))) != len) {
+        return false;
+    }
+    if (log_msg->entry.hdr_size < sizeof(log_msg->entry) ||
+        log_msg->entry.hdr_size + log_msg->entry.len != len) {
+        return false;
+    }
+    *offset += sizeof(len) + len;
+    return true;
+}
+
+// Find the time of the last entry in an archive, to pick up from there.
+static log_time lastArchiveTime(const char* file) {
+    log_time last(log_time::EPOCH);
+    android::base::unique_fd fd(open(file, O_RDONLY | O_CLOEXEC));
+    struct stat st;
+    if (!fd.ok() || fstat(fd.get(), &st)) return last;
+
+    uint64_t offset = 0;
+    for (const auto& entry : ReadArchiveIndex(file)) {
+        log_time t(entry.block.last_sec, entry.block.last_nsec);
+        if (t > last) last = t;
+        offset = std::max(offset, entry.block.offset + entry.block.length);
+    }
+    struct log_msg log_msg;
+    while (ReadArchiveRecord(fd.get(), &offset, st.st_size, &log_msg)) {
+        log_time t(log_msg.entry.sec, log_msg.entry.nsec);
+        if (t > last) last = t;
+    }
+    if (last == log_time::EPOCH) return last;
+    // tail_time prints matching or higher
+    last += log_time(0, 1);
+    return last;
+}
+
 void Logcat::RotateLogs() {
     // Can't rotate logs if we're not outputting to a file
     if (!output_file_name_) return;
 
     output_fd_.reset();
+    if (binary_archive_) {
+        FlushArchiveBlock();
+        archive_index_fd_.reset();
+    }
 
     // Compute the maximum number of digits needed to count up to
     // maxRotatedLogs in decimal.  eg:
@@ -171,6 +335,13 @@ void Logcat::RotateLogs() {
         if (err < 0 && errno != ENOENT) {
             perror("while rotating log files");
         }
+
+        if (binary_archive_) {
+            err = rename(ArchiveIndexName(file0).c_str(), ArchiveIndexName(file1).c_str());
+            if (err < 0 && errno != ENOENT) {
+                perror("while rotating log files");
+            }
+        }
     }
 
     output_fd_.reset(openLogFile(output_file_name_, log_rotate_size_kb_));
@@ -180,13 +351,19 @@ void Logcat::RotateLogs() {
     }
 
     out_byte_count_ = 0;
+
+    if (binary_archive_) {
+        OpenArchiveIndex();
+    }
 }
 
-void Logcat::ProcessBuffer(struct log_msg* buf) {
-    int bytesWritten = 0;
+// Decodes buf into entry, returns true if it passes the filterspecs and is to be printed. *match
+// tells whether it counts towards --max-count.
+bool Logcat::ProcessEntry(struct log_msg* buf, AndroidLogEntry* entry, char* binary_msg_buf,
+                          size_t binary_msg_buf_size, bool* match) {
     int err;
-    AndroidLogEntry entry;
-    char binaryMsgBuf[1024];
+
+    *match = false;
 
     bool is_binary =
             buf->id() == LOG_ID_EVENTS || buf->id() == LOG_ID_STATS || buf->id() == LOG_ID_SECURITY;
@@ -196,29 +373,40 @@ void Logcat::ProcessBuffer(struct log_msg* buf) {
             event_tag_map_.reset(android_openEventTagMap(nullptr));
             has_opened_event_tag_map_ = true;
         }
-        err = android_log_processBinaryLogBuffer(&buf->entry, &entry, event_tag_map_.get(),
-                                                 binaryMsgBuf, sizeof(binaryMsgBuf));
+        err = android_log_processBinaryLogBuffer(&buf->entry, entry, event_tag_map_.get(),
+                                                 binary_msg_buf, binary_msg_buf_size);
         // printf(">>> pri=%d len=%d msg='%s'\n",
         //    entry.priority, entry.messageLen, entry.message);
     } else {
-        err = android_log_processLogBuffer(&buf->entry, &entry);
+        err = android_log_processLogBuffer(&buf->entry, entry);
+    }
+    if (err < 0 && !debug_) return false;
+
+    if (!android_log_shouldPrintLine(logformat_.get(),
+                                     std::string(entry->tag, entry->tagLen).c_str(),
+                                     entry->priority)) {
+        return false;
     }
-    if (err < 0 && !debug_) return;
 
-    if (android_log_shouldPrintLine(logformat_.get(), std::string(entry.tag, entry.tagLen).c_str(),
-                                    entry.priority)) {
-        bool match = !regex_ ||
-                     std::regex_search(entry.message, entry.message + entry.messageLen, *regex_);
+    *match = !regex_ ||
+             std::regex_search(entry->message, entry->message + entry->messageLen, *regex_);
+    return *match || print_it_anyways_;
+}
 
-        print_count_ += match;
-        if (match || print_it_anyways_) {
-            bytesWritten = android_log_printLogLine(logformat_.get(), output_fd_.get(), &entry);
+void Logcat::ProcessBuffer(struct log_msg* buf) {
+    int bytesWritten = 0;
+    AndroidLogEntry entry;
+    char binaryMsgBuf[1024];
+    bool match;
 
-            if (bytesWritten < 0) {
-                error(EXIT_FAILURE, 0, "Output error.");
-            }
+    if (ProcessEntry(buf, &entry, binaryMsgBuf, sizeof(binaryMsgBuf), &match)) {
+        bytesWritten = android_log_printLogLine(logformat_.get(), output_fd_.get(), &entry);
+
+        if (bytesWritten < 0) {
+            error(EXIT_FAILURE, 0, "Output error.");
         }
     }
+    print_count_ += match;
 
     out_byte_count_ += bytesWritten;
 
@@ -227,19 +415,422 @@ void Logcat::ProcessBuffer(struct log_msg* buf) {
     }
 }
 
-void Logcat::PrintDividers(log_id_t log_id, bool print_dividers) {
-    if (log_id == last_printed_id_ || print_binary_) {
-        return;
+// Returns the divider to print before a message of log_id, or nullptr for none.
+const std::string* Logcat::NextDivider(log_id_t log_id, bool print_dividers) {
+    if (log_id == last_printed_id_ || print_binary_ || binary_archive_) {
+        return nullptr;
     }
+    const std::string* divider = nullptr;
     if (!printed_start_[log_id] || print_dividers) {
-        if (dprintf(output_fd_.get(), "--------- %s %s\n",
-                    printed_start_[log_id] ? "switch to" : "beginning of",
-                    android_log_id_to_name(log_id)) < 0) {
-            error(EXIT_FAILURE, errno, "Output error");
+        std::string& text = dividers_[printed_start_[log_id]][log_id];
+        if (text.empty()) {
+            text = StringPrintf("--------- %s %s\n",
+                                printed_start_[log_id] ? "switch to" : "beginning of",
+                                android_log_id_to_name(log_id));
         }
+        divider = &text;
     }
     last_printed_id_ = log_id;
     printed_start_[log_id] = true;
+    return divider;
+}
+
+void Logcat::PrintDividers(log_id_t log_id, bool print_dividers) {
+    const std::string* divider = NextDivider(log_id, print_dividers);
+    if (divider && !android::base::WriteFully(output_fd_.get(), divider->data(), divider->size())) {
+        error(EXIT_FAILURE, errno, "Output error");
+    }
+}
+
+// Exits on a failed android_logger_list_read(), returns false at the end of a dump.
+static bool CheckLogRead(int ret, struct log_msg& log_msg) {
+    if (!ret) {
+        error(EXIT_FAILURE, 0, R"init(Unexpected EOF!
+
+This means that either the device shut down, logd crashed, or this instance of logcat was unable to read log
+messages as quickly as they were being produced.
+
+If you have enabled significant logging, look into using the -G option to increase log buffer sizes.)init");
+    }
+
+    if (ret < 0) {
+        if (ret == -EAGAIN) return false;
+
+        if (ret == -EIO) {
+            error(EXIT_FAILURE, 0, "Unexpected EOF!");
+        }
+        if (ret == -EINVAL) {
+            error(EXIT_FAILURE, 0, "Unexpected length.");
+        }
+        error(EXIT_FAILURE, errno, "Logcat read failure");
+    }
+
+    if (log_msg.id() > LOG_ID_MAX) {
+        error(EXIT_FAILURE, 0, "Unexpected log id (%d) over LOG_ID_MAX (%d).", log_msg.id(),
+              LOG_ID_MAX);
+    }
+    return true;
+}
+
+static constexpr size_t kPipelineBatchSlots = 128;
+static constexpr size_t kPipelineChunk = 16;
+
+// Formatting a dump is CPU bound, so with --format-threads the work is spread out: a reader
+// thread fills batches of messages, format_threads_ formatters claim chunks of them, and this
+// thread writes each batch out in order with as few writev() calls as possible. Everything
+// that has to happen in order (dividers, --max-count, rotation) stays with the writer.
+void Logcat::RunPipeline(struct logger_list* logger_list, bool print_dividers) {
+    // Formatters share these read only, make sure nothing is opened lazily.
+    if (!event_tag_map_ && !has_opened_event_tag_map_) {
+        event_tag_map_.reset(android_openEventTagMap(nullptr));
+        has_opened_event_tag_map_ = true;
+    }
+
+    size_t nr_batches = format_threads_ * 2 + 2;
+    for (size_t i = 0; i < nr_batches; ++i) {
+        batches_.emplace_back(new FormatBatch);
+        batches_.back()->slots.resize(kPipelineBatchSlots);
+    }
+
+    std::thread reader(&Logcat::PipelineReader, this, logger_list);
+    std::vector<std::thread> formatters;
+    for (size_t i = 0; i < format_threads_; ++i) {
+        formatters.emplace_back(&Logcat::PipelineFormatter, this);
+    }
+
+    FormatBatch* last = nullptr;
+    for (;;) {
+        FormatBatch* batch;
+        {
+            std::unique_lock<std::mutex> lock(pipeline_lock_);
+            batch_done_.wait(lock, [this] {
+                if (write_seq_ == read_seq_) return false;
+                FormatBatch* b = batches_[write_seq_ % batches_.size()].get();
+                return b->done == b->count;
+            });
+            batch = batches_[write_seq_ % batches_.size()].get();
+        }
+
+        WritePipelineBatch(batch, print_dividers);
+
+        std::lock_guard<std::mutex> lock(pipeline_lock_);
+        if (batch->last || (max_count_ && print_count_ >= max_count_)) {
+            last = batch->last ? batch : nullptr;
+            pipeline_stop_ = true;
+            batch_free_.notify_all();
+            batch_ready_.notify_all();
+            break;
+        }
+        ++write_seq_;
+        batch_free_.notify_one();
+    }
+
+    reader.join();
+    for (auto& formatter : formatters) {
+        formatter.join();
+    }
+
+    if (last) {
+        CheckLogRead(last->read_result, last->read_msg);
+    }
+}
+
+void Logcat::PipelineReader(struct logger_list* logger_list) {
+    for (;;) {
+        FormatBatch* batch;
+        {
+            std::unique_lock<std::mutex> lock(pipeline_lock_);
+            batch_free_.wait(lock, [this] {
+                return pipeline_stop_ || read_seq_ - write_seq_ < batches_.size();
+            });
+            if (pipeline_stop_) return;
+            batch = batches_[read_seq_ % batches_.size()].get();
+        }
+
+        batch->count = 0;
+        batch->last = false;
+        while (batch->count < batch->slots.size()) {
+            struct log_msg* log_msg = &batch->slots[batch->count].msg;
+            int ret = android_logger_list_read(logger_list, log_msg);
+            if (ret <= 0 || log_msg->id() > LOG_ID_MAX) {
+                // Reported by the writer, once everything before it is out.
+                batch->read_result = ret;
+                if (ret > 0) batch->read_msg = *log_msg;
+                batch->last = true;
+                break;
+            }
+            ++batch->count;
+        }
+        std::lock_guard<std::mutex> lock(pipeline_lock_);
+        batch->next = 0;
+        batch->done = 0;
+        ++read_seq_;
+        batch_ready_.notify_all();
+        batch_done_.notify_one();
+        if (batch->last) return;
+    }
+}
+
+// Claims the next chunk of unformatted slots, false once the pipeline stops. Work is handed out
+// under the lock so that a batch is never touched again once it is done.
+bool Logcat::PipelineWork(FormatBatch** batch, size_t* begin, size_t* end) {
+    std::unique_lock<std::mutex> lock(pipeline_lock_);
+    if (*batch) {
+        (*batch)->done += *end - *begin;
+        if ((*batch)->done == (*batch)->count) {
+            batch_done_.notify_one();
+        }
+    }
+    for (;;) {
+        if (pipeline_stop_) return false;
+        for (size_t seq = write_seq_; seq != read_seq_; ++seq) {
+            FormatBatch* b = batches_[seq % batches_.size()].get();
+            if (b->next < b->count) {
+                *batch = b;
+                *begin = b->next;
+                *end = std::min(b->next + kPipelineChunk, b->count);
+                b->next = *end;
+                return true;
+            }
+        }
+        batch_ready_.wait(lock);
+    }
+}
+
+void Logcat::PipelineFormatter() {
+    FormatBatch* batch = nullptr;
+    size_t begin = 0, end = 0;
+    while (PipelineWork(&batch, &begin, &end)) {
+        for (size_t i = begin; i < end; ++i) {
+            FormatSlotLine(&batch->slots[i]);
+        }
+    }
+}
+
+// Formats into the slot's own buffer, growing it rather than allocating per line.
+void Logcat::FormatSlotLine(FormatSlot* slot) {
+    AndroidLogEntry entry;
+    char binary_msg_buf[1024];
+
+    slot->length = 0;
+    slot->failed = false;
+    if (!ProcessEntry(&slot->msg, &entry, binary_msg_buf, sizeof(binary_msg_buf), &slot->match)) {
+        return;
+    }
+
+    if (slot->line.size() < 1024) slot->line.resize(1024);
+    size_t length;
+    char* line = android_log_formatLogLine(logformat_.get(), slot->line.data(), slot->line.size(),
+                                           &entry, &length);
+    if (!line) {
+        slot->failed = true;
+        return;
+    }
+    if (line != slot->line.data()) {
+        slot->line.assign(line, line + length);
+        free(line);
+    }
+    slot->length = length;
+}
+
+void Logcat::WritePipelineBatch(FormatBatch* batch, bool print_dividers) {
+    struct iovec iov[kPipelineBatchSlots * 2];
+    size_t nr = 0;
+    size_t pending = 0;
+
+    auto flush = [&] {
+        struct iovec* v = iov;
+        while (nr) {
+            ssize_t ret = TEMP_FAILURE_RETRY(writev(output_fd_.get(), v, nr));
+            if (ret < 0) {
+                fprintf(stderr, "+++ LOG: write failed (errno=%d)\n", errno);
+                pending = 0;
+                break;
+            }
+            while (nr && static_cast<size_t>(ret) >= v->iov_len) {
+                ret -= v->iov_len;
+                ++v;
+                --nr;
+            }
+            if (nr) {
+                v->iov_base = static_cast<char*>(v->iov_base) + ret;
+                v->iov_len -= ret;
+            }
+        }
+        out_byte_count_ += pending;
+        nr = 0;
+        pending = 0;
+    };
+
+    for (size_t i = 0; i < batch->count; ++i) {
+        FormatSlot* slot = &batch->slots[i];
+
+        const std::string* divider = NextDivider(slot->msg.id(), print_dividers);
+        if (divider) {
+            iov[nr].iov_base = const_cast<char*>(divider->data());
+            iov[nr].iov_len = divider->size();
+            ++nr;
+        }
+
+        if (slot->failed) {
+            flush();
+            error(EXIT_FAILURE, 0, "Output error.");
+        }
+        if (slot->length) {
+            iov[nr].iov_base = slot->line.data();
+            iov[nr].iov_len = slot->length;
+            ++nr;
+            pending += slot->length;
+        }
+        print_count_ += slot->match;
+
+        if (log_rotate_size_kb_ > 0 && ((out_byte_count_ + pending) / 1024) >= log_rotate_size_kb_) {
+            flush();
+            RotateLogs();
+        }
+        if (max_count_ && print_count_ >= max_count_) {
+            break;
+        }
+    }
+    flush();
+}
+
+// The tag as the index records it: text logs carry it after the priority, binary logs a tag
+// number that is looked up in the event tag map, or kept as the number if unknown.
+bool Logcat::ArchiveTag(struct log_msg* log_msg, std::string* tag) {
+    const char* msg = log_msg->msg();
+    size_t len = log_msg->entry.len;
+    log_id_t log_id = log_msg->id();
+
+    if (log_id == LOG_ID_EVENTS || log_id == LOG_ID_STATS || log_id == LOG_ID_SECURITY) {
+        if (len < sizeof(uint32_t)) return false;
+        if (!event_tag_map_ && !has_opened_event_tag_map_) {
+            event_tag_map_.reset(android_openEventTagMap(nullptr));
+            has_opened_event_tag_map_ = true;
+        }
+        uint32_t tag_num;
+        memcpy(&tag_num, msg, sizeof(tag_num));
+        size_t tag_len = 0;
+        const char* name = android_lookupEventTag_len(event_tag_map_.get(), &tag_len, tag_num);
+        if (name) {
+            tag->assign(name, tag_len);
+        } else {
+            *tag = std::to_string(tag_num);
+        }
+        return true;
+    }
+
+    if (len < 2) return false;
+    tag->assign(msg + 1, strnlen(msg + 1, len - 1));
+    return true;
+}
+
+void Logcat::OpenArchiveIndex() {
+    archive_index_fd_.reset(open(ArchiveIndexName(output_file_name_).c_str(),
+                                 O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC,
+                                 S_IRUSR | S_IWUSR | S_IRGRP));
+    if (!archive_index_fd_.ok()) {
+        error(EXIT_FAILURE, errno, "Couldn't open archive index");
+    }
+    archive_block_count_ = 0;
+}
+
+// Capture without formatting anything: the entry goes out as received and only its tag and time
+// are looked at, for the index.
+void Logcat::WriteArchiveEntry(struct log_msg* log_msg) {
+    uint32_t len = log_msg->len();
+    struct iovec iov[2] = {{&len, sizeof(len)}, {log_msg->buf, len}};
+    if (!archive_block_count_) {
+        archive_block_offset_ = out_byte_count_;
+        archive_block_first_ = log_time(log_msg->entry.sec, log_msg->entry.nsec);
+    }
+
+    ssize_t ret = TEMP_FAILURE_RETRY(writev(output_fd_.get(), iov, arraysize(iov)));
+    if (ret != static_cast<ssize_t>(sizeof(len) + len)) {
+        error(EXIT_FAILURE, errno, "Output error");
+    }
+    out_byte_count_ += ret;
+
+    archive_block_last_ = log_time(log_msg->entry.sec, log_msg->entry.nsec);
+    std::string tag;
+    if (ArchiveTag(log_msg, &tag)) {
+        archive_block_tags_.emplace(tag.substr(0, UINT8_MAX));
+    }
+    if (++archive_block_count_ >= kArchiveBlockEntries) {
+        FlushArchiveBlock();
+    }
+
+    if (log_rotate_size_kb_ > 0 && (out_byte_count_ / 1024) >= log_rotate_size_kb_) {
+        RotateLogs();
+    }
+}
+
+void Logcat::FlushArchiveBlock() {
+    if (!archive_block_count_ || !archive_index_fd_.ok()) return;
+
+    ArchiveBlock block = {};
+    block.offset = archive_block_offset_;
+    block.length = out_byte_count_ - archive_block_offset_;
+    block.first_sec = archive_block_first_.tv_sec;
+    block.first_nsec = archive_block_first_.tv_nsec;
+    block.last_sec = archive_block_last_.tv_sec;
+    block.last_nsec = archive_block_last_.tv_nsec;
+    block.nr_tags = std::min(archive_block_tags_.size(), static_cast<size_t>(UINT16_MAX));
+
+    std::string record(reinterpret_cast<const char*>(&block), sizeof(block));
+    size_t nr_tags = 0;
+    for (const auto& tag : archive_block_tags_) {
+        if (nr_tags++ == block.nr_tags) break;
+        record += static_cast<char>(tag.size());
+        record += tag;
+    }
+    if (!android::base::WriteFully(archive_index_fd_.get(), record.data(), record.size())) {
+        error(EXIT_FAILURE, errno, "Archive index write error");
+    }
+
+    archive_block_count_ = 0;
+    archive_block_tags_.clear();
+}
+
+// Prints what matches start and --archive-tag, reading only the blocks the index says can have it.
+int Logcat::ReadArchive(log_time start, bool print_dividers) {
+    android::base::unique_fd fd(open(read_archive_, O_RDONLY | O_CLOEXEC));
+    struct stat st;
+    if (!fd.ok() || fstat(fd.get(), &st)) {
+        error(EXIT_FAILURE, errno, "Couldn't open archive '%s'", read_archive_);
+    }
+
+    std::vector<std::pair<uint64_t, uint64_t>> ranges;
+    uint64_t indexed_end = 0;
+    for (const auto& entry : ReadArchiveIndex(read_archive_)) {
+        const ArchiveBlock& block = entry.block;
+        indexed_end = std::max(indexed_end, block.offset + block.length);
+        if (log_time(block.last_sec, block.last_nsec) < start) continue;
+        if (!archive_tags_.empty() &&
+            std::none_of(entry.tags.begin(), entry.tags.end(),
+                         [this](const std::string& tag) { return archive_tags_.count(tag); })) {
+            continue;
+        }
+        ranges.emplace_back(block.offset, block.offset + block.length);
+    }
+    ranges.emplace_back(indexed_end, st.st_size);
+
+    for (const auto& [begin, end] : ranges) {
+        uint64_t offset = begin;
+        struct log_msg log_msg;
+        while (ReadArchiveRecord(fd.get(), &offset, end, &log_msg)) {
+            if (log_time(log_msg.entry.sec, log_msg.entry.nsec) < start) continue;
+            std::string tag;
+            if (!archive_tags_.empty() &&
+                (!ArchiveTag(&log_msg, &tag) || !archive_tags_.count(tag))) {
+                continue;
+            }
+            PrintDividers(log_msg.id(), print_dividers);
+            ProcessBuffer(&log_msg);
+            if (max_count_ && print_count_ >= max_count_) return EXIT_SUCCESS;
+        }
+    }
+    return EXIT_SUCCESS;
 }
 
 void Logcat::SetupOutputAndSchedulingPolicy(bool blocking) {
@@ -278,6 +869,10 @@ void Logcat::SetupOutputAndSchedulingPolicy(bool blocking) {
     }
 
     out_byte_count_ = statbuf.st_size;
+
+    if (binary_archive_) {
+        OpenArchiveIndex();
+    }
 }
 
 // clang-format off
@@ -315,9 +910,16 @@ Formatting:
                               modifiers are allowed.
   -D, --dividers              Print dividers between each log buffer.
   -B, --binary                Output the log in binary.
+  --format-threads=<n>        Format a dump (-d, -t) with <n> threads while reading and writing
+                              from two more, for large buffers. Output order is preserved.
 
 Outfile files:
   -f, --file=<file>           Log to file instead of stdout.
+  --binary-archive            Write the raw entries to the -f file, unformatted, with an index of
+                              times and tags alongside in <file>.idx. Requires -f option.
+  --read-archive=<file>       Print a --binary-archive file. Only reads the parts the index says
+                              can match -T '<time>' and --archive-tag.
+  --archive-tag=<tag>         With --read-archive, only print these tags, comma separated.
   -r, --rotate-kbytes=<n>     Rotate log every <n> kbytes. Requires -f option.
   -n, --rotate-count=<count>  Sets max number of rotated logs to <count>, default 4.
   --id=<id>                   If the signature <id> for logging to file changes, then clear the
@@ -418,6 +1020,9 @@ int Logcat::SetLogFormat(const char* format_string) {
     // invalid string?
     if (format == FORMAT_OFF) return -1;
 
+    // android_log_formatLogLine() converts monotonic time with unlocked global state.
+    if (format == FORMAT_MODIFIER_MONOTONIC) monotonic_format_ = true;
+
     return android_log_setPrintFormat(logformat_.get(), format);
 }
 
@@ -529,8 +1134,11 @@ int Logcat::Run(int argc, char** argv) {
     const char* setId = nullptr;
     int mode = ANDROID_LOG_RDONLY;
     std::string forceFilters;
+    // The same filters again, for logd to apply before sending anything.
+    std::string logd_filter;
     size_t tail_lines = 0;
     log_time tail_time(log_time::EPOCH);
+    bool tail_time_from_file = false;
     size_t pid = 0;
     bool got_t = false;
     unsigned id_mask = 0;
@@ -553,9 +1161,15 @@ int Logcat::Run(int argc, char** argv) {
         static const char id_str[] = "id";
         static const char wrap_str[] = "wrap";
         static const char print_str[] = "print";
+        static const char format_threads_str[] = "format-threads";
+        static const char binary_archive_str[] = "binary-archive";
+        static const char read_archive_str[] = "read-archive";
+        static const char archive_tag_str[] = "archive-tag";
         // clang-format off
         static const struct option long_options[] = {
+          { archive_tag_str, required_argument, nullptr, 0 },
           { "binary",        no_argument,       nullptr, 'B' },
+          { binary_archive_str, no_argument,    nullptr, 0 },
           { "buffer",        required_argument, nullptr, 'b' },
           { "buffer-size",   optional_argument, nullptr, 'g' },
           { "clear",         no_argument,       nullptr, 'c' },
@@ -563,6 +1177,7 @@ int Logcat::Run(int argc, char** argv) {
           { "dividers",      no_argument,       nullptr, 'D' },
           { "file",          required_argument, nullptr, 'f' },
           { "format",        required_argument, nullptr, 'v' },
+          { format_threads_str, required_argument, nullptr, 0 },
           // hidden and undocumented reserved alias for --regex
           { "grep",          required_argument, nullptr, 'e' },
           // hidden and undocumented reserved alias for --max-count
@@ -574,6 +1189,7 @@ int Logcat::Run(int argc, char** argv) {
           { pid_str,         required_argument, nullptr, 0 },
           { print_str,       no_argument,       nullptr, 0 },
           { "prune",         optional_argument, nullptr, 'p' },
+          { read_archive_str, required_argument, nullptr, 0 },
           { "regex",         required_argument, nullptr, 'e' },
           { "rotate-count",  required_argument, nullptr, 'n' },
           { "rotate-kbytes", required_argument, nullptr, 'r' },
@@ -620,6 +1236,27 @@ int Logcat::Run(int argc, char** argv) {
                     }
                     break;
                 }
+                if (long_options[option_index].name == format_threads_str) {
+                    if (!ParseUint(optarg, &format_threads_, static_cast<size_t>(64))) {
+                        error(EXIT_FAILURE, 0, "%s %s out of range.",
+                              long_options[option_index].name, optarg);
+                    }
+                    break;
+                }
+                if (long_options[option_index].name == binary_archive_str) {
+                    binary_archive_ = true;
+                    break;
+                }
+                if (long_options[option_index].name == read_archive_str) {
+                    read_archive_ = optarg;
+                    break;
+                }
+                if (long_options[option_index].name == archive_tag_str) {
+                    for (const auto& tag : Split(optarg, delimiters)) {
+                        if (!tag.empty()) archive_tags_.emplace(tag);
+                    }
+                    break;
+                }
                 if (long_options[option_index].name == print_str) {
                     print_it_anyways_ = true;
                     break;
@@ -636,6 +1273,7 @@ int Logcat::Run(int argc, char** argv) {
             case 's':
                 // default to all silent
                 android_log_addFilterRule(logformat_.get(), "*:s");
+                logd_filter += "*:s ";
                 break;
 
             case 'c':
@@ -743,6 +1381,7 @@ int Logcat::Run(int argc, char** argv) {
             case 'f':
                 if ((tail_time == log_time::EPOCH) && !tail_lines) {
                     tail_time = lastLogTime(optarg);
+                    tail_time_from_file = true;
                 }
                 // redirect output to a file
                 output_file_name_ = optarg;
@@ -906,6 +1545,22 @@ int Logcat::Run(int argc, char** argv) {
         error(EXIT_FAILURE, 0, "-r requires -f as well.");
     }
 
+    if (binary_archive_) {
+        if (!output_file_name_) {
+            error(EXIT_FAILURE, 0, "--binary-archive requires -f as well.");
+        }
+        if (print_binary_ || read_archive_) {
+            error(EXIT_FAILURE, 0, "--binary-archive is incompatible with -B and --read-archive.");
+        }
+        // -f looked for the last line of a text log, resume from the archive instead.
+        if (tail_time_from_file) {
+            tail_time = lastArchiveTime(output_file_name_);
+        }
+    }
+    if (!archive_tags_.empty() && !read_archive_) {
+        error(EXIT_FAILURE, 0, "--archive-tag requires --read-archive as well.");
+    }
+
     if (setId != 0) {
         if (!output_file_name_) {
             error(EXIT_FAILURE, 0, "--id='%s' requires -f as well.", setId);
@@ -942,6 +1597,7 @@ int Logcat::Run(int argc, char** argv) {
         if (err < 0) {
             error(EXIT_FAILURE, 0, "Invalid filter expression in logcat args.");
         }
+        logd_filter += forceFilters;
     } else if (argc == optind) {
         // Add from environment variable
         const char* env_tags_orig = getenv("ANDROID_LOG_TAGS");
@@ -952,6 +1608,7 @@ int Logcat::Run(int argc, char** argv) {
             if (err < 0) {
                 error(EXIT_FAILURE, 0, "Invalid filter expression in ANDROID_LOG_TAGS.");
             }
+            logd_filter += env_tags_orig;
         }
     } else {
         // Add from commandline
@@ -960,6 +1617,8 @@ int Logcat::Run(int argc, char** argv) {
             if (err < 0) {
                 error(EXIT_FAILURE, 0, "Invalid filter expression '%s'.", argv[i]);
             }
+            logd_filter += argv[i];
+            logd_filter += ' ';
         }
     }
 
@@ -1000,6 +1659,14 @@ int Logcat::Run(int argc, char** argv) {
                     fprintf(stderr, "failed to delete log file '%s': %s\n", file.c_str(),
                             strerror(errno));
                 }
+
+                if (binary_archive_) {
+                    err = unlink(ArchiveIndexName(file).c_str());
+                    if (err < 0 && errno != ENOENT) {
+                        fprintf(stderr, "failed to delete log file '%s': %s\n",
+                                ArchiveIndexName(file).c_str(), strerror(errno));
+                    }
+                }
             }
         }
 
@@ -1008,6 +1675,11 @@ int Logcat::Run(int argc, char** argv) {
         }
     }
 
+    if (read_archive_) {
+        SetupOutputAndSchedulingPolicy(false);
+        return ReadArchive(tail_time, printDividers);
+    }
+
     std::unique_ptr<logger_list, decltype(&android_logger_list_free)> logger_list{
             nullptr, &android_logger_list_free};
     if (tail_time != log_time::EPOCH) {
@@ -1015,6 +1687,12 @@ int Logcat::Run(int argc, char** argv) {
     } else {
         logger_list.reset(android_logger_list_alloc(mode, tail_lines, pid));
     }
+    // Binary output is never filtered, and logd can not filter pstore.
+    if (!logd_filter.empty() && !print_binary_ && !binary_archive_ &&
+        !(mode & ANDROID_LOG_PSTORE)) {
+        // A filter too long for logd just means it sends everything.
+        __android_logger_list_set_filter(logger_list.get(), logd_filter.c_str());
+    }
     // We have three orthogonal actions below to clear, set log size and
     // get log size. All sharing the same iteration loop.
     std::vector<std::string> open_device_failures;
@@ -1137,43 +1815,37 @@ int Logcat::Run(int argc, char** argv) {
 
     SetupOutputAndSchedulingPolicy(!(mode & ANDROID_LOG_NONBLOCK));
 
+    if (format_threads_) {
+        if ((mode & ANDROID_LOG_NONBLOCK) && !print_binary_ && !binary_archive_ &&
+            !monotonic_format_) {
+            RunPipeline(logger_list.get(), printDividers);
+            return EXIT_SUCCESS;
+        }
+        fprintf(stderr,
+                "WARNING: "
+                "--format-threads ignored, only applies to dumps (-d, -t) that are\n"
+                "         "
+                "not binary (-B) or monotonic (-v monotonic)\n");
+    }
+
     while (!max_count_ || print_count_ < max_count_) {
         struct log_msg log_msg;
         int ret = android_logger_list_read(logger_list.get(), &log_msg);
-        if (!ret) {
-            error(EXIT_FAILURE, 0, R"init(Unexpected EOF!
-
-This means that either the device shut down, logd crashed, or this instance of logcat was unable to read log
-messages as quickly as they were being produced.
-
-If you have enabled significant logging, look into using the -G option to increase log buffer sizes.)init");
-        }
-
-        if (ret < 0) {
-            if (ret == -EAGAIN) break;
-
-            if (ret == -EIO) {
-                error(EXIT_FAILURE, 0, "Unexpected EOF!");
-            }
-            if (ret == -EINVAL) {
-                error(EXIT_FAILURE, 0, "Unexpected length.");
-            }
-            error(EXIT_FAILURE, errno, "Logcat read failure");
-        }
-
-        if (log_msg.id() > LOG_ID_MAX) {
-            error(EXIT_FAILURE, 0, "Unexpected log id (%d) over LOG_ID_MAX (%d).", log_msg.id(),
-                  LOG_ID_MAX);
-        }
+        if (!CheckLogRead(ret, log_msg)) break;
 
         PrintDividers(log_msg.id(), printDividers);
 
         if (print_binary_) {
             TEMP_FAILURE_RETRY(write(output_fd_.get(), &log_msg, log_msg.len()));
+        } else if (binary_archive_) {
+            WriteArchiveEntry(&log_msg);
         } else {
             ProcessBuffer(&log_msg);
         }
     }
+    if (binary_archive_) {
+        FlushArchiveBlock();
+    }
     return EXIT_SUCCESS;
 }
 
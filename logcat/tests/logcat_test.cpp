@@ -1474,6 +1474,116 @@ TEST(logcat, maxcount) {
     ASSERT_EQ(3, count);
 }
 
+TEST(logcat, format_threads) {
+    static const int num = 1000;
+    char buffer[BIG_BUFFER];
+
+    // Spans several pipeline batches, and must come out complete and in order.
+    for (int i = 0; i < num; ++i) {
+        LOG_FAILURE_RETRY(__android_log_print(ANDROID_LOG_WARN, "logcat_test",
+                                              "logcat_test %d", i));
+    }
+
+    rest();
+
+    snprintf(buffer, sizeof(buffer),
+             logcat_executable " --pid %d -d -v raw --format-threads=4 2>/dev/null", getpid());
+
+    FILE* fp;
+    ASSERT_TRUE(NULL != (fp = popen(buffer, "r")));
+
+    int expected = 0;
+    while (fgets(buffer, sizeof(buffer), fp)) {
+        int seq;
+        if (sscanf(buffer, "logcat_test %d", &seq) != 1) {
+            continue;
+        }
+        EXPECT_EQ(expected, seq);
+        expected = seq + 1;
+    }
+
+    pclose(fp);
+
+    ASSERT_EQ(num, expected);
+}
+
+TEST(logcat, format_threads_maxcount) {
+    FILE* fp;
+    int count = 0;
+
+    char buffer[BIG_BUFFER];
+
+    snprintf(buffer, sizeof(buffer),
+             logcat_executable " --pid %d -d --max-count 3 --format-threads=2", getpid());
+
+    LOG_FAILURE_RETRY(
+        __android_log_print(ANDROID_LOG_WARN, "logcat_test", "logcat_test"));
+    LOG_FAILURE_RETRY(
+        __android_log_print(ANDROID_LOG_WARN, "logcat_test", "logcat_test"));
+    LOG_FAILURE_RETRY(
+        __android_log_print(ANDROID_LOG_WARN, "logcat_test", "logcat_test"));
+    LOG_FAILURE_RETRY(
+        __android_log_print(ANDROID_LOG_WARN, "logcat_test", "logcat_test"));
+
+    rest();
+
+    ASSERT_TRUE(NULL != (fp = popen(buffer, "r")));
+
+    while (fgets(buffer, sizeof(buffer), fp)) {
+        if (!strncmp(begin, buffer, sizeof(begin) - 1)) {
+            continue;
+        }
+
+        count++;
+    }
+
+    pclose(fp);
+
+    ASSERT_EQ(3, count);
+}
+
+TEST(logcat, binary_archive) {
+    static const char form[] = "/data/local/tmp/logcat.archive.XXXXXX";
+    char tmp_out_dir[sizeof(form)];
+    ASSERT_TRUE(NULL != mkdtemp(strcpy(tmp_out_dir, form)));
+
+    LOG_FAILURE_RETRY(__android_log_print(ANDROID_LOG_WARN, "logcat_test_archive",
+                                          "logcat_test archived"));
+    LOG_FAILURE_RETRY(__android_log_print(ANDROID_LOG_WARN, "logcat_test_other",
+                                          "logcat_test not archived"));
+
+    rest();
+
+    std::string archive = android::base::StringPrintf("%s/log.bin", tmp_out_dir);
+    std::string command = android::base::StringPrintf(
+        logcat_executable " -b main --pid %d -d --binary-archive -f %s", getpid(), archive.c_str());
+    EXPECT_FALSE(IsFalse(system(command.c_str()), command.c_str()));
+
+    struct stat st;
+    EXPECT_EQ(0, stat((archive + ".idx").c_str(), &st));
+
+    command = android::base::StringPrintf(
+        logcat_executable " --read-archive=%s --archive-tag=logcat_test_archive -v raw 2>&1",
+        archive.c_str());
+    FILE* fp;
+    ASSERT_TRUE(NULL != (fp = popen(command.c_str(), "r")));
+
+    int archived = 0;
+    int other = 0;
+    char buffer[BIG_BUFFER];
+    while (fgets(buffer, sizeof(buffer), fp)) {
+        if (strstr(buffer, "logcat_test archived")) ++archived;
+        if (strstr(buffer, "logcat_test not archived")) ++other;
+    }
+    pclose(fp);
+
+    EXPECT_EQ(1, archived);
+    EXPECT_EQ(0, other);
+
+    command = android::base::StringPrintf("rm -rf %s", tmp_out_dir);
+    EXPECT_FALSE(IsFalse(system(command.c_str()), command.c_str()));
+}
+
 static bool End_to_End(const char* tag, const char* fmt, ...)
 #if defined(__GNUC__)
     __attribute__((__format__(printf, 2, 3)))
@@ -47,6 +47,7 @@ CommandListener::CommandListener(LogBuffer* buf, LogReader* /*reader*/,
     registerCmd(new SetBufSizeCmd(buf));
     registerCmd(new GetBufSizeUsedCmd(buf));
     registerCmd(new GetStatisticsCmd(buf));
+    registerCmd(new GetMetricsCmd(buf));
     registerCmd(new SetPruneListCmd(buf));
     registerCmd(new GetPruneListCmd(buf));
     registerCmd(new GetEventTagCmd(buf));
@@ -245,6 +246,22 @@ int CommandListener::GetStatisticsCmd::runCommand(SocketClient* cli, int argc,
     return 0;
 }
 
+CommandListener::GetMetricsCmd::GetMetricsCmd(LogBuffer* buf)
+    : LogCommand("getMetrics"), mBuf(*buf) {
+}
+
+int CommandListener::GetMetricsCmd::runCommand(SocketClient* cli,
+                                               int /*argc*/, char** /*argv*/) {
+    setname();
+    if (!clientHasLogCredentials(cli)) {
+        cli->sendMsg("Permission Denied");
+        return 0;
+    }
+
+    cli->sendMsg(PackageString(mBuf.formatMetrics()).c_str());
+    return 0;
+}
+
 CommandListener::GetPruneListCmd::GetPruneListCmd(LogBuffer* buf)
     : LogCommand("getPruneList"), mBuf(*buf) {
 }
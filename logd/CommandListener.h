@@ -62,6 +62,7 @@ class CommandListener : public FrameworkListener {
     LogBufferCmd(SetBufSize);
     LogBufferCmd(GetBufSizeUsed);
     LogBufferCmd(GetStatistics);
+    LogBufferCmd(GetMetrics);
     LogBufferCmd(GetPruneList);
     LogBufferCmd(SetPruneList);
     LogBufferCmd(GetEventTag);
@@ -48,13 +48,13 @@
 LogAudit::LogAudit(LogBuffer* buf, LogReader* reader, int fdDmesg)
     : SocketListener(getLogSocket(), false),
       logbuf(buf),
-      reader(reader),
       fdDmesg(fdDmesg),
       main(__android_logger_property_get_bool("ro.logd.auditd.main",
                                               BOOL_DEFAULT_TRUE)),
       events(__android_logger_property_get_bool("ro.logd.auditd.events",
                                                 BOOL_DEFAULT_TRUE)),
-      initialized(false) {
+      initialized(false),
+      batch(buf, reader) {
     static const char auditd_message[] = { KMSG_PRIORITY(LOG_INFO),
                                            'l',
                                            'o',
@@ -97,6 +97,20 @@ bool LogAudit::onDataAvailable(SocketClient* cli) {
 
     logPrint("type=%d %.*s", rep.nlh.nlmsg_type, rep.nlh.nlmsg_len, rep.data);
 
+    // Pick up whatever else is already queued, so that a denial storm is
+    // committed to the buffer a batch at a time.
+    for (size_t count = 1; count < LogBuffer::maxBatch; ++count) {
+        rep.nlh.nlmsg_type = 0;
+        rep.nlh.nlmsg_len = 0;
+        rep.data[0] = '\0';
+        if ((audit_get_reply(cli->getSocket(), &rep, GET_REPLY_NONBLOCKING, 0) < 0) ||
+            !rep.nlh.nlmsg_len) {
+            break;
+        }
+        logPrint("type=%d %.*s", rep.nlh.nlmsg_type, rep.nlh.nlmsg_len, rep.data);
+    }
+    batch.flush();
+
     return true;
 }
 
@@ -244,6 +258,8 @@ int LogAudit::logPrint(const char* fmt, ...) {
     }
 
     log_time now(log_time::EPOCH);
+    // duplicates are the same report with a different serial
+    std::string key;
 
     static const char audit_str[] = " audit(";
     char* timeptr = strstr(str, audit_str);
@@ -252,6 +268,9 @@ int LogAudit::logPrint(const char* fmt, ...) {
         (*cp == ':')) {
         memcpy(timeptr + sizeof(audit_str) - 1, "0.0", 3);
         memmove(timeptr + sizeof(audit_str) - 1 + 3, cp, strlen(cp) + 1);
+        key = str;
+        size_t serial = timeptr - str + sizeof(audit_str) - 1 + 3;
+        key.erase(serial, key.find(')', serial) - serial);
         if (!isMonotonic()) {
             if (android::isMonotonic(now)) {
                 LogKlog::convertMonotonicToReal(now);
@@ -277,10 +296,14 @@ int LogAudit::logPrint(const char* fmt, ...) {
                   : LOGGER_ENTRY_MAX_PAYLOAD;
     size_t message_len = str_len + sizeof(android_log_event_string_t);
 
-    log_mask_t notify = 0;
+    bool queued = false;
 
     if (events) {  // begin scope for event buffer
-        uint32_t buffer[(message_len + sizeof(uint32_t) - 1) / sizeof(uint32_t)];
+        char* buffer = batch.reserve(message_len);
+        if (!buffer) {
+            free(str);
+            return -ENOMEM;
+        }
 
         android_log_event_string_t* event =
             reinterpret_cast<android_log_event_string_t*>(buffer);
@@ -291,12 +314,10 @@ int LogAudit::logPrint(const char* fmt, ...) {
         memcpy(event->data + str_len - denial_metadata.length(),
                denial_metadata.c_str(), denial_metadata.length());
 
-        rc = logbuf->log(
-            LOG_ID_EVENTS, now, uid, pid, tid, reinterpret_cast<char*>(event),
-            (message_len <= UINT16_MAX) ? (uint16_t)message_len : UINT16_MAX);
-        if (rc >= 0) {
-            notify |= 1 << LOG_ID_EVENTS;
-        }
+        batch.add(LOG_ID_EVENTS, now, uid, pid, tid, buffer,
+                  (message_len <= UINT16_MAX) ? (uint16_t)message_len : UINT16_MAX,
+                  key);
+        queued = true;
         // end scope for event buffer
     }
 
@@ -338,7 +359,12 @@ int LogAudit::logPrint(const char* fmt, ...) {
         str_len + prefix_len + suffix_len + denial_metadata.length() + 2;
 
     if (main) {  // begin scope for main buffer
-        char newstr[message_len];
+        char* newstr = batch.reserve(message_len);
+        if (!newstr) {
+            free(const_cast<char*>(commfree));
+            free(str);
+            return queued ? message_len : -ENOMEM;
+        }
 
         *newstr = info ? ANDROID_LOG_INFO : ANDROID_LOG_WARN;
         strlcpy(newstr + 1, comm, str_len);
@@ -347,27 +373,18 @@ int LogAudit::logPrint(const char* fmt, ...) {
         strncpy(newstr + 1 + str_len + prefix_len + suffix_len,
                 denial_metadata.c_str(), denial_metadata.length());
 
-        rc = logbuf->log(
-            LOG_ID_MAIN, now, uid, pid, tid, newstr,
-            (message_len <= UINT16_MAX) ? (uint16_t)message_len : UINT16_MAX);
-
-        if (rc >= 0) {
-            notify |= 1 << LOG_ID_MAIN;
-        }
+        batch.add(LOG_ID_MAIN, now, uid, pid, tid, newstr,
+                  (message_len <= UINT16_MAX) ? (uint16_t)message_len : UINT16_MAX,
+                  key);
+        queued = true;
         // end scope for main buffer
     }
 
     free(const_cast<char*>(commfree));
     free(str);
 
-    if (notify) {
-        reader->notifyNewLog(notify);
-        if (rc < 0) {
-            rc = message_len;
-        }
-    }
-
-    return rc;
+    // readers are notified once the batch is flushed
+    return queued ? message_len : 0;
 }
 
 int LogAudit::log(char* buf, size_t len) {
@@ -22,20 +22,26 @@
 #include <sysutils/SocketListener.h>
 
 #include "LogBuffer.h"
+#include "LogIngestBatch.h"
 
 class LogReader;
 
 class LogAudit : public SocketListener {
     LogBuffer* logbuf;
-    LogReader* reader;
     int fdDmesg;  // fdDmesg >= 0 is functionally bool dmesg
     bool main;
     bool events;
     bool initialized;
+    // parsed entries waiting for a single LogBuffer::log()
+    LogIngestBatch batch;
 
    public:
     LogAudit(LogBuffer* buf, LogReader* reader, int fdDmesg);
+    // Parses and queues one report, see flush()
     int log(char* buf, size_t len);
+    void flush() {
+        batch.flush();
+    }
     bool isMonotonic() {
         return logbuf->isMonotonic();
     }
@@ -19,6 +19,7 @@
 #include <ctype.h>
 #include <endian.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/cdefs.h>
@@ -26,8 +27,10 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <unordered_map>
 
+#include <android-base/stringprintf.h>
 #include <cutils/properties.h>
 #include <private/android_logger.h>
 
@@ -73,6 +76,26 @@ void LogBuffer::init() {
         // be corrected. 1/30 corner case YMMV.
         //
         rdlock();
+        log_id_for_each(id) {
+            std::lock_guard<std::mutex> shard(mShardLocks[id]);
+            for (LogChunk& chunk : mLogChunks[id]) {
+                chunk.forEachEntry([this](SerializedLogEntry* entry) {
+                    log_time realtime = entry->getRealTime();
+                    if (monotonic == android::isMonotonic(realtime)) {
+                        return;
+                    }
+                    if (monotonic) {
+                        LogKlog::convertRealToMonotonic(realtime);
+                    } else {
+                        LogKlog::convertMonotonicToReal(realtime);
+                    }
+                    if ((realtime.tv_nsec % 1000) == 0) {
+                        realtime.tv_nsec++;
+                    }
+                    entry->setRealTime(realtime);
+                });
+            }
+        }
         LogBufferElementCollection::iterator it = mLogElements.begin();
         while ((it != mLogElements.end())) {
             LogBufferElement* e = *it;
@@ -94,6 +117,10 @@ void LogBuffer::init() {
             ++it;
         }
         unlock();
+
+        wrlock();
+        rebuildTimeIndex();
+        unlock();
     }
 
     // We may have been triggered by a SIGHUP. Release any sleeping reader
@@ -114,12 +141,21 @@ void LogBuffer::init() {
 }
 
 LogBuffer::LogBuffer(LastLogTimes* times)
-    : monotonic(android_log_clockid() == CLOCK_MONOTONIC), mTimes(*times) {
+    : mTimeIndexCountdown(timeIndexInterval),
+      monotonic(android_log_clockid() == CLOCK_MONOTONIC),
+      mChunked(false),
+      mSequence(0),
+      mTimes(*times) {
     pthread_rwlock_init(&mLogElementsLock, nullptr);
 
     log_id_for_each(i) {
         lastLoggedElements[i] = nullptr;
         droppedElements[i] = nullptr;
+        mChunkSizes[i] = 0;
+        mChunkGenerations[i] = 0;
+    }
+    for (size_t i = 0; i < writerWaitBuckets; ++i) {
+        mWriterWaits[i] = 0;
     }
 
     init();
@@ -132,6 +168,15 @@ LogBuffer::~LogBuffer() {
     }
 }
 
+void LogBuffer::enableChunkedStore() {
+    wrlock();
+    if (mLogElements.empty()) {
+        mChunked = true;
+        stats.setEntryOverhead(sizeof(SerializedLogEntry));
+    }
+    unlock();
+}
+
 enum match_type { DIFFERENT, SAME, SAME_LIBLOG };
 
 static enum match_type identical(LogBufferElement* elem,
@@ -198,49 +243,94 @@ static enum match_type identical(LogBufferElement* elem,
 
 int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
                    pid_t tid, const char* msg, uint16_t len) {
-    if (log_id >= LOG_ID_MAX) {
-        return -EINVAL;
-    }
+    LogBufferInput input = {log_id, realtime, uid, pid, tid, msg, len, 0};
+    log(&input, 1);
+    return input.result;
+}
 
-    // Slip the time by 1 nsec if the incoming lands on xxxxxx000 ns.
-    // This prevents any chance that an outside source can request an
-    // exact entry with time specified in ms or us precision.
-    if ((realtime.tv_nsec % 1000) == 0) ++realtime.tv_nsec;
+void LogBuffer::log(LogBufferInput* inputs, size_t count) {
+    while (count > maxBatch) {
+        log(inputs, maxBatch);
+        inputs += maxBatch;
+        count -= maxBatch;
+    }
+    log_time start(CLOCK_MONOTONIC);
+
+    // Everything that can be done without the lock goes first, so that the
+    // whole batch costs a single wrlock().
+    LogBufferElement* elems[maxBatch];
+    bool loggable[maxBatch];
+    for (size_t i = 0; i < count; ++i) {
+        LogBufferInput& in = inputs[i];
+        elems[i] = nullptr;
+        loggable[i] = false;
+        if (in.log_id >= LOG_ID_MAX) {
+            in.result = -EINVAL;
+            continue;
+        }
 
-    LogBufferElement* elem = new LogBufferElement(log_id, realtime, uid, pid, tid, msg, len);
+        // Slip the time by 1 nsec if the incoming lands on xxxxxx000 ns.
+        // This prevents any chance that an outside source can request an
+        // exact entry with time specified in ms or us precision.
+        if ((in.realtime.tv_nsec % 1000) == 0) ++in.realtime.tv_nsec;
 
-    // b/137093665: don't coalesce security messages.
-    if (log_id == LOG_ID_SECURITY) {
-        wrlock();
-        log(elem);
-        unlock();
-
-        return len;
+        uint32_t tag;
+        if (mChunked) {
+            tag = LogStatisticsElement(in.log_id, in.realtime, in.uid, in.pid,
+                                       in.tid, in.msg, in.len)
+                      .getTag();
+        } else {
+            elems[i] = new LogBufferElement(in.log_id, in.realtime, in.uid,
+                                            in.pid, in.tid, in.msg, in.len);
+            tag = elems[i]->getTag();
+        }
+        // b/137093665: don't coalesce security messages.
+        loggable[i] = (in.log_id == LOG_ID_SECURITY) ||
+                      isLoggable(in.log_id, in.msg, in.len, tag);
+        in.result = loggable[i] ? in.len : -EACCES;
     }
 
-    int prio = ANDROID_LOG_INFO;
-    const char* tag = nullptr;
-    size_t tag_len = 0;
-    if (log_id == LOG_ID_EVENTS || log_id == LOG_ID_STATS) {
-        tag = tagToName(elem->getTag());
-        if (tag) {
-            tag_len = strlen(tag);
+    log_time lockedAt = writerLock();
+    for (size_t i = 0; i < count; ++i) {
+        LogBufferInput& in = inputs[i];
+        if (in.result == -EINVAL) {
+            continue;
         }
-    } else {
-        prio = *msg;
-        tag = msg + 1;
-        tag_len = strnlen(tag, len - 1);
-    }
-    if (!__android_log_is_loggable_len(prio, tag, tag_len, ANDROID_LOG_VERBOSE)) {
-        // Log traffic received to total
-        wrlock();
-        stats.addTotal(elem);
-        unlock();
-        delete elem;
-        return -EACCES;
+        if (mChunked) {
+            LogStatisticsElement element(in.log_id, in.realtime, in.uid, in.pid,
+                                         in.tid, in.msg, in.len);
+            if (!loggable[i]) {
+                // Log traffic received to total
+                std::lock_guard<std::mutex> lock(mStatsLock);
+                stats.addTotal(&element);
+                continue;
+            }
+            std::lock_guard<std::mutex> shard(mShardLocks[in.log_id]);
+            logChunked(&element);
+            continue;
+        }
+        if (!loggable[i]) {
+            // Log traffic received to total
+            stats.addTotal(elems[i]);
+            delete elems[i];
+            continue;
+        }
+        if (in.log_id == LOG_ID_SECURITY) {
+            log(elems[i]);
+            continue;
+        }
+        logLocked(elems[i]);
     }
+    writerUnlock(lockedAt);
+    mLogLatency.recordSince(start);
+}
+
+// Chatty processing and insertion of one element.
+//
+// LogBuffer::wrlock() must be held when this function is called, owns elem.
+void LogBuffer::logLocked(LogBufferElement* elem) {
+    log_id_t log_id = elem->getLogId();
 
-    wrlock();
     LogBufferElement* currentLast = lastLoggedElements[log_id];
     if (currentLast) {
         LogBufferElement* dropped = droppedElements[log_id];
@@ -341,15 +431,13 @@ int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
                     // check for overflow
                     if (total >= UINT32_MAX) {
                         log(currentLast);
-                        unlock();
-                        return len;
+                        return;
                     }
                     stats.addTotal(currentLast);
                     delete currentLast;
                     swab = total;
                     event->payload.data = htole32(swab);
-                    unlock();
-                    return len;
+                    return;
                 }
                 if (count == USHRT_MAX) {
                     log(dropped);
@@ -365,8 +453,7 @@ int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
             }
             droppedElements[log_id] = currentLast;
             lastLoggedElements[log_id] = elem;
-            unlock();
-            return len;
+            return;
         }
         if (dropped) {         // State 1 or 2
             if (count) {       // State 2
@@ -383,9 +470,24 @@ int LogBuffer::log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
     lastLoggedElements[log_id] = new LogBufferElement(*elem);
 
     log(elem);
-    unlock();
+}
 
-    return len;
+bool LogBuffer::isLoggable(log_id_t log_id, const char* msg, uint16_t len,
+                           uint32_t tag_id) {
+    int prio = ANDROID_LOG_INFO;
+    const char* tag = nullptr;
+    size_t tag_len = 0;
+    if (log_id == LOG_ID_EVENTS || log_id == LOG_ID_STATS) {
+        tag = tagToName(tag_id);
+        if (tag) {
+            tag_len = strlen(tag);
+        }
+    } else {
+        prio = *msg;
+        tag = msg + 1;
+        tag_len = strnlen(tag, len - 1);
+    }
+    return __android_log_is_loggable_len(prio, tag, tag_len, ANDROID_LOG_VERBOSE);
 }
 
 // assumes LogBuffer::wrlock() held, owns elem, look after garbage collection
@@ -404,6 +506,8 @@ void LogBuffer::log(LogBufferElement* elem) {
                         (elem->getLogId() != LOG_ID_KERNEL) &&
                         ((*it)->getLogId() != LOG_ID_KERNEL))) {
         mLogElements.push_back(elem);
+        linkChain(--mLogElements.end());
+        indexTime(--mLogElements.end());
     } else {
         log_time end(log_time::EPOCH);
         bool end_set = false;
@@ -428,6 +532,8 @@ void LogBuffer::log(LogBufferElement* elem) {
 
         if (end_always || (end_set && (end > (*it)->getRealTime()))) {
             mLogElements.push_back(elem);
+            linkChain(--mLogElements.end());
+            indexTime(--mLogElements.end());
         } else {
             // should be short as timestamps are localized near end()
             do {
@@ -438,7 +544,7 @@ void LogBuffer::log(LogBufferElement* elem) {
                 --it;
             } while (((*it)->getRealTime() > elem->getRealTime()) &&
                      (!end_set || (end <= (*it)->getRealTime())));
-            mLogElements.insert(last, elem);
+            linkChain(mLogElements.insert(last, elem));
         }
         LogTimeEntry::unlock();
     }
@@ -449,8 +555,16 @@ void LogBuffer::log(LogBufferElement* elem) {
 
 // Prune at most 10% of the log entries or maxPrune, whichever is less.
 //
-// LogBuffer::wrlock() must be held when this function is called.
+// LogBuffer::wrlock() must be held when this function is called, or for the
+// chunked store rdlock() and the shard lock of id.
 void LogBuffer::maybePrune(log_id_t id) {
+    if (mChunked) {
+        if (mChunkSizes[id] > log_buffer_size(id)) {
+            prune(id, 1);
+        }
+        return;
+    }
+
     size_t sizes = stats.sizes(id);
     unsigned long maxSize = log_buffer_size(id);
     if (sizes > maxSize) {
@@ -512,6 +626,8 @@ LogBufferElementCollection::iterator LogBuffer::erase(
                   ? element->getTag()
                   : element->getUid();
 #endif
+    unlinkChain(it);
+    unindexTime(it);
     it = mLogElements.erase(it);
     if (doSetLast) {
         log_id_for_each(i) {
@@ -556,6 +672,156 @@ LogBufferElementCollection::iterator LogBuffer::erase(
     return it;
 }
 
+// Link a newly inserted element into the prune chain of its key.
+//
+// LogBuffer::wrlock() must be held when this function is called.
+void LogBuffer::linkChain(LogBufferElementCollection::iterator it) {
+    LogBufferElement* element = *it;
+    log_id_t id = element->getLogId();
+    int key = pruneKey(element);
+
+    LogBufferChainMap::iterator found = mChains[id].find(key);
+    if (found == mChains[id].end()) {
+        element->mChainPrev = element->mChainNext = mLogElements.end();
+        mChains[id].emplace(key, LogBufferChain{it, it});
+        return;
+    }
+    LogBufferChain& chain = found->second;
+
+    // Keep the chain in list order. Elements are only inserted close to the
+    // end of the list, so looking for the chain's next element is short.
+    LogBufferElementCollection::iterator next = it;
+    for (++next; next != mLogElements.end(); ++next) {
+        if (((*next)->getLogId() == id) && (pruneKey(*next) == key)) {
+            break;
+        }
+    }
+    LogBufferElementCollection::iterator prev;
+    if (next == mLogElements.end()) {
+        prev = chain.tail;
+        chain.tail = it;
+    } else {
+        prev = (*next)->mChainPrev;
+        (*next)->mChainPrev = it;
+    }
+    if (prev == mLogElements.end()) {
+        chain.head = it;
+    } else {
+        (*prev)->mChainNext = it;
+    }
+    element->mChainPrev = prev;
+    element->mChainNext = next;
+}
+
+// LogBuffer::wrlock() must be held when this function is called.
+void LogBuffer::unlinkChain(LogBufferElementCollection::iterator it) {
+    LogBufferElement* element = *it;
+    log_id_t id = element->getLogId();
+
+    LogBufferChainMap::iterator found = mChains[id].find(pruneKey(element));
+    if (found == mChains[id].end()) {
+        return;
+    }
+    LogBufferChain& chain = found->second;
+
+    LogBufferElementCollection::iterator prev = element->mChainPrev;
+    LogBufferElementCollection::iterator next = element->mChainNext;
+    if (prev == mLogElements.end()) {
+        chain.head = next;
+    } else {
+        (*prev)->mChainNext = next;
+    }
+    if (next == mLogElements.end()) {
+        chain.tail = prev;
+    } else {
+        (*next)->mChainPrev = prev;
+    }
+    if ((chain.head == mLogElements.end()) &&
+        (chain.tail == mLogElements.end())) {
+        mChains[id].erase(found);
+    }
+}
+
+// Oldest element of the prune key, or end().
+//
+// LogBuffer::wrlock() must be held when this function is called.
+LogBufferElementCollection::iterator LogBuffer::chainHead(log_id_t id,
+                                                          int key) {
+    LogBufferChainMap::iterator found = mChains[id].find(key);
+    if (found == mChains[id].end()) {
+        return mLogElements.end();
+    }
+    return found->second.head;
+}
+
+// Note an element appended to the end of the list in the time index.
+//
+// LogBuffer::wrlock() must be held when this function is called.
+void LogBuffer::indexTime(LogBufferElementCollection::iterator it) {
+    if (--mTimeIndexCountdown) {
+        return;
+    }
+    mTimeIndexCountdown = timeIndexInterval;
+    // Out of order entries are left out, so the index stays sorted.
+    if (!mTimeIndex.empty() &&
+        ((*mTimeIndex.back())->getRealTime() > (*it)->getRealTime())) {
+        return;
+    }
+    mTimeIndex.push_back(it);
+}
+
+// LogBuffer::wrlock() must be held when this function is called.
+void LogBuffer::unindexTime(LogBufferElementCollection::iterator it) {
+    if (mTimeIndex.empty()) {
+        return;
+    }
+    // Most of the time we are pruning from the front.
+    if (mTimeIndex.front() == it) {
+        mTimeIndex.pop_front();
+        return;
+    }
+
+    log_time realtime = (*it)->getRealTime();
+    auto found = std::lower_bound(
+        mTimeIndex.begin(), mTimeIndex.end(), realtime,
+        [](const LogBufferElementCollection::iterator& index,
+           const log_time& time) { return (*index)->getRealTime() < time; });
+    for (; (found != mTimeIndex.end()) && ((**found)->getRealTime() == realtime);
+         ++found) {
+        if (*found == it) {
+            mTimeIndex.erase(found);
+            return;
+        }
+    }
+}
+
+// LogBuffer::wrlock() must be held when this function is called.
+void LogBuffer::rebuildTimeIndex() {
+    mTimeIndex.clear();
+    mTimeIndexCountdown = timeIndexInterval;
+    for (LogBufferElementCollection::iterator it = mLogElements.begin();
+         it != mLogElements.end(); ++it) {
+        indexTime(it);
+    }
+}
+
+// The first indexed element newer than start, or end().
+//
+// LogBuffer::rdlock() must be held when this function is called.
+LogBufferElementCollection::iterator LogBuffer::seekTime(
+    const log_time& start) {
+    auto found = std::upper_bound(
+        mTimeIndex.begin(), mTimeIndex.end(), start,
+        [](const log_time& time,
+           const LogBufferElementCollection::iterator& index) {
+            return time < (*index)->getRealTime();
+        });
+    if (found == mTimeIndex.end()) {
+        return mLogElements.end();
+    }
+    return *found;
+}
+
 // Define a temporary mechanism to report the last LogBufferElement pointer
 // for the specified uid, pid and tid. Used below to help merge-sort when
 // pruning for worst UID.
@@ -705,9 +971,11 @@ void LogBuffer::kickMe(LogTimeEntry* me, log_id_t id, unsigned long pruneRows) {
 // The third thread is optional, and only gets hit if there was a whitelist
 // and more needs to be pruned against the backstop of the region lock.
 //
-// LogBuffer::wrlock() must be held when this function is called.
+// LogBuffer::wrlock() must be held when this function is called, or for the
+// chunked store rdlock() and the shard lock of id.
 //
 bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
+    LogLatencyTimer timer(mPruneLatency);
     LogTimeEntry* oldest = nullptr;
     bool busy = false;
     bool clearAll = pruneRows == ULONG_MAX;
@@ -726,6 +994,12 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
         }
         times++;
     }
+    if (mChunked) {
+        busy = pruneChunks(id, clearAll, caller_uid, oldest);
+        LogTimeEntry::unlock();
+        return busy;
+    }
+
     log_time watermark(log_time::tv_sec_max, log_time::tv_nsec_max);
     if (oldest) watermark = oldest->mStart - pruneMargin;
 
@@ -733,8 +1007,14 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
 
     if (__predict_false(caller_uid != AID_ROOT)) {  // unlikely
         // Only here if clear all request from non system source, so chatty
-        // filter logistics is not required.
-        it = mLastSet[id] ? mLast[id] : mLogElements.begin();
+        // filter logistics is not required. Unless it is keyed by tag, the
+        // prune chain of the caller's uid holds exactly the entries to go.
+        bool chained = (id != LOG_ID_EVENTS) && (id != LOG_ID_SECURITY);
+        if (chained) {
+            it = chainHead(id, caller_uid);
+        } else {
+            it = mLastSet[id] ? mLast[id] : mLogElements.begin();
+        }
         while (it != mLogElements.end()) {
             LogBufferElement* element = *it;
 
@@ -755,7 +1035,14 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
                 break;
             }
 
-            it = erase(it);
+            if (chained) {
+                LogBufferElementCollection::iterator next =
+                    element->mChainNext;
+                erase(it);
+                it = next;
+            } else {
+                it = erase(it);
+            }
             if (--pruneRows == 0) {
                 break;
             }
@@ -834,8 +1121,24 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
         lastt = mLogElements.end();
         --lastt;
         LogBufferElementLast last;
+        // Short of a blacklist or a garbage collection pass, nothing but the
+        // worst offender's entries needs looking at, so follow its prune
+        // chain past everything else.
+        bool chained = !gc && !hasBlacklist && (worst != -1);
+        LogBufferElementCollection::iterator nextWorst = mLogElements.end();
+        if (chained) {
+            if ((it != mLogElements.end()) && ((*it)->getLogId() == id) &&
+                (pruneKey(*it) == worst)) {
+                nextWorst = it;
+            } else {
+                nextWorst = chainHead(id, worst);
+            }
+        }
         while (it != mLogElements.end()) {
             LogBufferElement* element = *it;
+            if (it == nextWorst) {
+                nextWorst = element->mChainNext;
+            }
 
             if (oldest && (watermark <= element->getRealTime())) {
                 busy = isBusy(watermark);
@@ -921,7 +1224,11 @@ bool LogBuffer::prune(log_id_t id, unsigned long pruneRows, uid_t caller_uid) {
                 (worstPid && (element->getPid() != worstPid))) {
                 leading = false;
                 last.clear(element);
-                ++it;
+                if (chained) {
+                    it = nextWorst;
+                } else {
+                    ++it;
+                }
                 continue;
             }
             // key == worst below here
@@ -1086,7 +1393,14 @@ bool LogBuffer::clear(log_id_t id, uid_t uid) {
 // get the used space associated with "id".
 unsigned long LogBuffer::getSizeUsed(log_id_t id) {
     rdlock();
-    size_t retval = stats.sizes(id);
+    size_t retval;
+    if (mChunked) {
+        // the chunked store accounts what it holds in memory, compressed or not
+        std::lock_guard<std::mutex> shard(mShardLocks[id]);
+        retval = mChunkSizes[id];
+    } else {
+        retval = stats.sizes(id);
+    }
     unlock();
     return retval;
 }
@@ -1113,9 +1427,17 @@ unsigned long LogBuffer::getSize(log_id_t id) {
 
 log_time LogBuffer::flushTo(SocketClient* reader, const log_time& start,
                             pid_t* lastTid, bool privileged, bool security,
-                            int (*filter)(const LogBufferElement* element,
+                            int (*filter)(const LogStatisticsElement* element,
                                           void* arg),
-                            void* arg) {
+                            void* arg, uint64_t* sequence,
+                            unsigned int logMask) {
+    LogLatencyTimer timer(mFlushLatency);
+
+    if (mChunked) {
+        return flushToChunks(reader, start, lastTid, privileged, security,
+                             filter, arg, sequence, logMask);
+    }
+
     LogBufferElementCollection::iterator it;
     uid_t uid = reader->getUid();
 
@@ -1128,10 +1450,11 @@ log_time LogBuffer::flushTo(SocketClient* reader, const log_time& start,
         // Cap to 300 iterations we look back for out-of-order entries.
         size_t count = 300;
 
-        // Client wants to start from some specified time. Chances are
-        // we are better off starting from the end of the time sorted list.
+        // Client wants to start from some specified time. The time index
+        // takes us to just past it, from where we look back through the
+        // time sorted list for the exact starting point.
         LogBufferElementCollection::iterator last;
-        for (last = it = mLogElements.end(); it != mLogElements.begin();
+        for (last = it = seekTime(start); it != mLogElements.begin();
              /* do nothing */) {
             --it;
             LogBufferElement* element = *it;
@@ -1175,7 +1498,8 @@ log_time LogBuffer::flushTo(SocketClient* reader, const log_time& start,
 
         // NB: calling out to another object with wrlock() held (safe)
         if (filter) {
-            int ret = (*filter)(element, arg);
+            LogStatisticsElement view(element);
+            int ret = (*filter)(&view, arg);
             if (ret == false) {
                 continue;
             }
@@ -1213,13 +1537,592 @@ log_time LogBuffer::flushTo(SocketClient* reader, const log_time& start,
     return curr;
 }
 
+// Acquire wrlock() on behalf of a writer, accounting for the time spent
+// waiting on readers and the pruning of other writers. The chunked store only
+// needs rdlock(), its writers are kept apart by the shard locks. Returns when
+// the lock was acquired.
+log_time LogBuffer::writerLock() {
+    bool shared = mChunked;
+    int ret = shared ? pthread_rwlock_tryrdlock(&mLogElementsLock)
+                     : pthread_rwlock_trywrlock(&mLogElementsLock);
+    if (ret == 0) {
+        mWriterWaits[0].fetch_add(1, std::memory_order_relaxed);
+        return log_time(CLOCK_MONOTONIC);
+    }
+
+    log_time start(CLOCK_MONOTONIC);
+    if (shared) {
+        rdlock();
+    } else {
+        wrlock();
+    }
+    log_time lockedAt(CLOCK_MONOTONIC);
+    uint64_t usec = (lockedAt - start).nsec() / 1000;
+
+    size_t bucket = 1;
+    while ((bucket < (writerWaitBuckets - 1)) && (usec >> bucket)) {
+        ++bucket;
+    }
+    mWriterWaits[bucket].fetch_add(1, std::memory_order_relaxed);
+    return lockedAt;
+}
+
+// Pairs with writerLock().
+void LogBuffer::writerUnlock(const log_time& lockedAt) {
+    mWriterHold.recordSince(lockedAt);
+    unlock();
+}
+
+std::string LogBuffer::formatWriterWaits() {
+    uint64_t waits[writerWaitBuckets];
+    uint64_t total = 0;
+    for (size_t i = 0; i < writerWaitBuckets; ++i) {
+        waits[i] = mWriterWaits[i].load(std::memory_order_relaxed);
+        total += waits[i];
+    }
+    if (!total) {
+        return std::string("");
+    }
+
+    std::string ret = "\nWriter lock waits\n";
+    ret += android::base::StringPrintf("  uncontended %" PRIu64 "\n",
+                                       waits[0]);
+    for (size_t i = 1; i < writerWaitBuckets; ++i) {
+        if (!waits[i]) continue;
+        if (i == (writerWaitBuckets - 1)) {
+            ret += android::base::StringPrintf(
+                "  >= %8" PRIu64 "us %" PRIu64 "\n", uint64_t(1) << (i - 1),
+                waits[i]);
+        } else {
+            ret += android::base::StringPrintf(
+                "  <  %8" PRIu64 "us %" PRIu64 "\n", uint64_t(1) << i,
+                waits[i]);
+        }
+    }
+    return ret;
+}
+
+// Only a snapshot of the statistics is taken under the lock. Formatting them
+// looks up process and package names and sorts every table, writers would
+// otherwise stall for as long as that takes.
 std::string LogBuffer::formatStatistics(uid_t uid, pid_t pid,
                                         unsigned int logMask) {
-    wrlock();
+    rdlock();
+    std::unique_lock<std::mutex> lock(mStatsLock);
+    LogStatistics snapshot(stats);
+    lock.unlock();
+    std::string chunks;
+    if (mChunked) {
+        chunks = formatChunkStatistics(logMask);
+    }
+    unlock();
+
+    return snapshot.format(uid, pid, logMask) + chunks + formatWriterWaits();
+}
 
-    std::string ret = stats.format(uid, pid, logMask);
+// Allocator overhead is not accounted for, list and hash nodes are counted as
+// the links and payload they hold.
+std::string LogBuffer::formatMetrics() {
+    static constexpr size_t listNode = 2 * sizeof(void*);
+    size_t entries[LOG_ID_MAX] = {};
+    size_t headers[LOG_ID_MAX] = {};
+    size_t payload[LOG_ID_MAX] = {};
+    size_t chains[LOG_ID_MAX] = {};
+    size_t chunks[LOG_ID_MAX] = {};
+    size_t chunkCounts[LOG_ID_MAX] = {};
+    uint64_t writerWaits[writerWaitBuckets];
 
+    rdlock();
+    for (const LogBufferElement* element : mLogElements) {
+        log_id_t id = element->getLogId();
+        ++entries[id];
+        headers[id] +=
+            sizeof(LogBufferElement) + sizeof(LogBufferElement*) + listNode;
+        payload[id] += element->getMsgLen();
+    }
+    log_id_for_each(id) {
+        chains[id] = mChains[id].bucket_count() * sizeof(void*) +
+                     mChains[id].size() *
+                         (sizeof(LogBufferChainMap::value_type) + sizeof(void*));
+        std::lock_guard<std::mutex> shard(mShardLocks[id]);
+        chunks[id] = mChunkSizes[id];
+        chunkCounts[id] = mLogChunks[id].size();
+    }
+    size_t timeIndex = mTimeIndex.size() *
+                       sizeof(LogBufferElementCollection::iterator);
+    size_t statistics;
+    {
+        std::lock_guard<std::mutex> lock(mStatsLock);
+        statistics = stats.sizeOf();
+    }
+    for (size_t i = 0; i < writerWaitBuckets; ++i) {
+        writerWaits[i] = mWriterWaits[i].load(std::memory_order_relaxed);
+    }
     unlock();
 
-    return ret;
+    size_t readerCount = 0;
+    std::string readers;
+    LogTimeEntry::rdlock();
+    for (const auto& entry : mTimes) {
+        ++readerCount;
+        readers += entry->formatMetrics_Locked();
+    }
+    LogTimeEntry::unlock();
+
+    std::string ret;
+    size_t total = timeIndex + statistics + readerCount * sizeof(LogTimeEntry);
+    log_id_for_each(id) {
+        const char* name = android_log_id_to_name(id);
+        ret += android::base::StringPrintf(
+            "memory.%s.entries %zu\n"
+            "memory.%s.headers %zu\n"
+            "memory.%s.payload %zu\n"
+            "memory.%s.chains %zu\n",
+            name, entries[id], name, headers[id], name, payload[id], name,
+            chains[id]);
+        if (mChunked) {
+            ret += android::base::StringPrintf(
+                "memory.%s.chunk_count %zu\nmemory.%s.chunks %zu\n", name,
+                chunkCounts[id], name, chunks[id]);
+        }
+        total += headers[id] + payload[id] + chains[id] + chunks[id];
+    }
+    ret += android::base::StringPrintf(
+        "memory.time_index %zu\n"
+        "memory.statistics %zu\n"
+        "memory.readers %zu\n"
+        "memory.total %zu\n",
+        timeIndex, statistics, readerCount * sizeof(LogTimeEntry), total);
+
+    ret += mLogLatency.format("latency.log");
+    ret += mPruneLatency.format("latency.prune");
+    ret += mFlushLatency.format("latency.flush");
+    ret += mWriterHold.format("lock.writer_hold");
+    ret += android::base::StringPrintf("lock.writer_wait.uncontended %" PRIu64
+                                       "\n",
+                                       writerWaits[0]);
+    for (size_t i = 1; i < writerWaitBuckets; ++i) {
+        if (!writerWaits[i]) continue;
+        if (i == (writerWaitBuckets - 1)) {
+            ret += android::base::StringPrintf(
+                "lock.writer_wait.ge_%" PRIu64 "us %" PRIu64 "\n",
+                uint64_t(1) << (i - 1), writerWaits[i]);
+        } else {
+            ret += android::base::StringPrintf(
+                "lock.writer_wait.lt_%" PRIu64 "us %" PRIu64 "\n",
+                uint64_t(1) << i, writerWaits[i]);
+        }
+    }
+
+    return ret + readers;
+}
+
+// Chunked log store
+//
+// Each log id owns a list of LogChunk, oldest first. New entries are appended
+// to the last chunk, a new chunk is started once it is full. Each log id is a
+// shard of its own: unless noted otherwise, the following require either
+// wrlock(), or rdlock() and the shard lock of the log id they work on.
+
+void LogBuffer::logChunked(const LogStatisticsElement* element) {
+    log_id_t log_id = element->getLogId();
+    uint16_t len = element->getMsgLen();
+
+    LogChunkCollection& chunks = mLogChunks[log_id];
+    if (chunks.empty() || !chunks.back().canLog(len)) {
+        if (!chunks.empty()) {
+            LogChunk& full = chunks.back();
+            mChunkSizes[log_id] -= full.storageSize();
+            full.seal();
+            mChunkSizes[log_id] += full.storageSize();
+        }
+        // A quarter of the buffer keeps pruning granularity reasonable.
+        size_t capacity = std::max<size_t>(
+            log_buffer_size(log_id) / 4,
+            sizeof(SerializedLogEntry) + LOGGER_ENTRY_MAX_PAYLOAD);
+        chunks.emplace_back(capacity);
+    }
+    const SerializedLogEntry* entry = chunks.back().log(
+        mSequence.fetch_add(1, std::memory_order_relaxed) + 1,
+        element->getRealTime(), element->getUid(), element->getPid(),
+        element->getTid(), element->getMsg(), len);
+    mChunkSizes[log_id] += entry->getTotalLen();
+
+    {
+        std::lock_guard<std::mutex> lock(mStatsLock);
+        stats.add(element);
+    }
+    maybePrune(log_id);
+}
+
+void LogBuffer::eraseChunk(log_id_t id, LogChunkCollection::iterator chunk) {
+    std::shared_ptr<const char[]> contents = chunk->contents();
+    std::unique_lock<std::mutex> lock(mStatsLock);
+    for (size_t offset = 0; contents && (offset < chunk->writeOffset());) {
+        const SerializedLogEntry* entry =
+            LogChunk::entryAt(contents.get(), offset);
+        LogStatisticsElement element = entry->toLogStatisticsElement(id);
+        stats.subtract(&element);
+        offset += entry->getTotalLen();
+    }
+    lock.unlock();
+    mChunkSizes[id] -= chunk->storageSize();
+    mLogChunks[id].erase(chunk);
+    ++mChunkGenerations[id];
+}
+
+// Release the oldest chunks of "id" until it fits in its buffer size, or all
+// of them if clearAll. A chunk that a reader is still walking through is the
+// region lock here, it and everything newer is left in place and the oldest
+// reader is asked to catch up.
+//
+// LogTimeEntry::rdlock() must be held as well.
+bool LogBuffer::pruneChunks(log_id_t id, bool clearAll, uid_t caller_uid,
+                            LogTimeEntry* oldest) {
+    LogChunkCollection& chunks = mLogChunks[id];
+    bool busy = false;
+
+    if (__predict_false(caller_uid != AID_ROOT)) {  // unlikely
+        // Only here if clear all request from non system source, compact
+        // the caller's entries out of every chunk no reader is walking.
+        for (LogChunk& chunk : chunks) {
+            if (chunk.isReferenced()) {
+                busy = true;
+                continue;
+            }
+            mChunkSizes[id] -= chunk.storageSize();
+            std::lock_guard<std::mutex> lock(mStatsLock);
+            chunk.eraseIf(
+                [caller_uid](const SerializedLogEntry* entry) {
+                    return entry->getUid() == caller_uid;
+                },
+                [this, id](const SerializedLogEntry* entry) {
+                    LogStatisticsElement element =
+                        entry->toLogStatisticsElement(id);
+                    stats.subtract(&element);
+                });
+            mChunkSizes[id] += chunk.storageSize();
+            ++mChunkGenerations[id];
+        }
+        if (busy && oldest) {
+            std::lock_guard<std::mutex> lock(mStatsLock);
+            kickMe(oldest, id, stats.realElements(id));
+        }
+        return busy;
+    }
+
+    while (!chunks.empty() &&
+           (clearAll || (mChunkSizes[id] > log_buffer_size(id)))) {
+        LogChunkCollection::iterator chunk = chunks.begin();
+        if (chunk->isReferenced()) {
+            busy = true;
+            if (oldest) {
+                std::lock_guard<std::mutex> lock(mStatsLock);
+                kickMe(oldest, id, stats.realElements(id) / chunks.size());
+            }
+            break;
+        }
+        eraseChunk(id, chunk);
+    }
+    return busy;
+}
+
+namespace {
+
+// A reader position within the chunks of one log id. Only valid while the
+// shard lock of the log id is held, or while the chunk generation it was taken
+// at is still current; otherwise it is found again by sequence number.
+class LogChunkPosition {
+    LogChunkCollection* mChunks = nullptr;
+    const uint64_t* mGeneration = nullptr;
+    uint64_t mSeenGeneration = 0;
+    LogChunkCollection::iterator mChunk;
+    // uncompressed entries of mChunk
+    std::shared_ptr<const char[]> mContents;
+    size_t mOffset = 0;
+    // every entry up to and including this sequence number was consumed
+    uint64_t mAfter = 0;
+
+    const SerializedLogEntry* entry() const {
+        return LogChunk::entryAt(mContents.get(), mOffset);
+    }
+
+    // Point at mChunk, its contents are only fetched (and decompressed) once
+    // the reader actually walks into it.
+    void enter() {
+        mContents.reset();
+        mOffset = 0;
+    }
+
+    bool load() {
+        if (!mContents) mContents = mChunk->contents();
+        return !!mContents;
+    }
+
+    void seek(const std::function<bool(const SerializedLogEntry*)>& before) {
+        mSeenGeneration = *mGeneration;
+        enter();
+        if (!load()) {
+            mOffset = mChunk->writeOffset();
+            return;
+        }
+        while (mOffset < mChunk->writeOffset()) {
+            const SerializedLogEntry* e = entry();
+            if (!before(e)) break;
+            mAfter = e->getSequence();
+            mOffset += e->getTotalLen();
+        }
+    }
+
+   public:
+    // Position at the first entry of chunks, from chunk onwards, that does not
+    // satisfy before(entry).
+    void init(LogChunkCollection* chunks, const uint64_t* generation,
+              LogChunkCollection::iterator chunk,
+              const std::function<bool(const SerializedLogEntry*)>& before) {
+        if (chunk == chunks->end()) {
+            if (chunks->empty()) return;
+            // everything present has been consumed, wait at the end
+            --chunk;
+            mChunks = chunks;
+            mGeneration = generation;
+            mSeenGeneration = *generation;
+            mChunk = chunk;
+            mAfter = chunk->highestSequence();
+            mOffset = chunk->writeOffset();
+            return;
+        }
+        mChunks = chunks;
+        mGeneration = generation;
+        mChunk = chunk;
+        if (chunk != chunks->begin()) {
+            mAfter = std::prev(chunk)->highestSequence();
+        }
+        seek(before);
+    }
+
+    // Must be called with the shard lock held.
+    const SerializedLogEntry* peek() {
+        if (!mChunks) return nullptr;
+        if (mSeenGeneration != *mGeneration) {
+            // chunks were pruned or compacted under us, find our place again
+            uint64_t after = mAfter;
+            mChunk = mChunks->begin();
+            while ((mChunk != mChunks->end()) &&
+                   (mChunk->highestSequence() <= after)) {
+                ++mChunk;
+            }
+            if (mChunk == mChunks->end()) {
+                mChunks = nullptr;
+                mContents.reset();
+                return nullptr;
+            }
+            seek([after](const SerializedLogEntry* entry) {
+                return entry->getSequence() <= after;
+            });
+        }
+        for (;;) {
+            if ((mOffset < mChunk->writeOffset()) && load()) {
+                return entry();
+            }
+            LogChunkCollection::iterator next = std::next(mChunk);
+            if (next == mChunks->end()) return nullptr;
+            mChunk = next;
+            enter();
+        }
+    }
+
+    LogChunk& chunk() {
+        return *mChunk;
+    }
+
+    uint64_t consumed() const {
+        return mAfter;
+    }
+
+    // Must follow a successful peek() with the shard lock still held.
+    void next() {
+        const SerializedLogEntry* e = entry();
+        mAfter = e->getSequence();
+        mOffset += e->getTotalLen();
+    }
+};
+
+}  // namespace
+
+// Shard locks are always taken in log id order, ids is sorted.
+void LogBuffer::lockShards(const log_id_t* ids, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        mShardLocks[ids[i]].lock();
+    }
+}
+
+void LogBuffer::unlockShards(const log_id_t* ids, size_t count) {
+    for (size_t i = count; i > 0; --i) {
+        mShardLocks[ids[i - 1]].unlock();
+    }
+}
+
+// Merges the shards of the log ids in logMask back into the order the entries
+// were logged. Writers to the other log ids never wait on this reader.
+log_time LogBuffer::flushToChunks(SocketClient* reader, const log_time& start,
+                                  pid_t* lastTid, bool privileged,
+                                  bool security,
+                                  int (*filter)(const LogStatisticsElement* element,
+                                                void* arg),
+                                  void* arg, uint64_t* sequence,
+                                  unsigned int logMask) {
+    uid_t uid = reader->getUid();
+    LogChunkPosition positions[LOG_ID_MAX];
+    log_id_t ids[LOG_ID_MAX];
+    size_t count = 0;
+
+    log_id_for_each(id) {
+        if (!(logMask & (1 << id))) continue;
+        if (!security && (id == LOG_ID_SECURITY)) continue;
+        ids[count++] = id;
+    }
+    if (!count) {
+        return start;
+    }
+
+    rdlock();
+    lockShards(ids, count);
+
+    for (size_t i = 0; i < count; ++i) {
+        log_id_t id = ids[i];
+        LogChunkCollection& chunks = mLogChunks[id];
+        LogChunkCollection::iterator chunk = chunks.begin();
+        if (sequence && !sequence[id] && chunks.empty()) {
+            // anything logged to it from now on is new to the reader
+            sequence[id] = mSequence.load(std::memory_order_relaxed);
+        }
+        if (sequence && sequence[id]) {
+            uint64_t after = sequence[id];
+            while ((chunk != chunks.end()) &&
+                   (chunk->highestSequence() <= after)) {
+                ++chunk;
+            }
+            positions[id].init(&chunks, &mChunkGenerations[id], chunk,
+                               [after](const SerializedLogEntry* entry) {
+                                   return entry->getSequence() <= after;
+                               });
+        } else if (start == log_time::EPOCH) {
+            positions[id].init(&chunks, &mChunkGenerations[id], chunk,
+                               [](const SerializedLogEntry*) { return false; });
+        } else {
+            while ((chunk != chunks.end()) &&
+                   (chunk->highestRealTime() < start)) {
+                ++chunk;
+            }
+            positions[id].init(&chunks, &mChunkGenerations[id], chunk,
+                               [&start](const SerializedLogEntry* entry) {
+                                   return entry->getRealTime() < start;
+                               });
+        }
+    }
+
+    log_time curr = start;
+
+    for (;;) {
+        // Sequence numbers are only ordered within a shard, an entry can turn
+        // up behind one of a higher sequence in another; the per log id
+        // cursors make sure it is still picked up by the next flush.
+        log_id_t id = LOG_ID_MAX;
+        const SerializedLogEntry* entry = nullptr;
+        for (size_t i = 0; i < count; ++i) {
+            const SerializedLogEntry* candidate = positions[ids[i]].peek();
+            if (candidate &&
+                (!entry || (candidate->getSequence() < entry->getSequence()))) {
+                id = ids[i];
+                entry = candidate;
+            }
+        }
+        if (!entry) {
+            break;
+        }
+
+        if (!privileged && (entry->getUid() != uid)) {
+            if (sequence) sequence[id] = entry->getSequence();
+            positions[id].next();
+            continue;
+        }
+
+        // NB: calling out to another object with the shard locks held (safe)
+        if (filter) {
+            LogStatisticsElement element = entry->toLogStatisticsElement(id);
+            int ret = (*filter)(&element, arg);
+            if (ret == false) {
+                if (sequence) sequence[id] = entry->getSequence();
+                positions[id].next();
+                continue;
+            }
+            if (ret != true) {
+                break;
+            }
+        }
+
+        if (lastTid) {
+            lastTid[id] = entry->getTid();
+        }
+
+        // The reader reference keeps pruning away from the chunk, and with
+        // it the entry, while we write to the socket without the locks.
+        LogChunk& chunk = positions[id].chunk();
+        chunk.incReaderRefCount();
+        unlockShards(ids, count);
+        unlock();
+
+        bool ok = entry->flushTo(reader, id);
+        curr = entry->getRealTime();
+
+        rdlock();
+        lockShards(ids, count);
+        chunk.decReaderRefCount();
+        if (!ok) {
+            unlockShards(ids, count);
+            unlock();
+            return LogBufferElement::FLUSH_ERROR;
+        }
+
+        if (sequence) sequence[id] = entry->getSequence();
+        positions[id].next();
+    }
+
+    // Entries passed over before start count as consumed as well, the next
+    // flush resumes by sequence rather than searching by time again.
+    for (size_t i = 0; sequence && (i < count); ++i) {
+        log_id_t id = ids[i];
+        sequence[id] = std::max(sequence[id], positions[id].consumed());
+    }
+    unlockShards(ids, count);
+    unlock();
+
+    return curr;
+}
+
+// LogBuffer::rdlock() must be held when this function is called.
+std::string LogBuffer::formatChunkStatistics(unsigned int logMask) {
+    std::string output = "\nChunks       Sealed   Uncompressed   Compressed  Ratio\n";
+    log_id_for_each(id) {
+        if (!(logMask & (1 << id))) continue;
+
+        std::lock_guard<std::mutex> shard(mShardLocks[id]);
+
+        size_t sealed = 0;
+        size_t uncompressed = 0;
+        size_t compressed = 0;
+        for (const LogChunk& chunk : mLogChunks[id]) {
+            if (!chunk.isSealed()) continue;
+            ++sealed;
+            uncompressed += chunk.writeOffset();
+            compressed += chunk.storageSize();
+        }
+        if (mLogChunks[id].empty()) continue;
+        output += android::base::StringPrintf(
+            "%-10s %8zu/%zu %12zu %12zu %5.2fx\n", android_log_id_to_name(id),
+            sealed, mLogChunks[id].size(), uncompressed, compressed,
+            compressed ? static_cast<double>(uncompressed) / compressed : 1.0);
+    }
+    return output;
 }
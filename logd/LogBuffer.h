@@ -19,7 +19,10 @@
 
 #include <sys/types.h>
 
+#include <atomic>
+#include <deque>
 #include <list>
+#include <mutex>
 #include <string>
 
 #include <android/log.h>
@@ -27,6 +30,8 @@
 #include <sysutils/SocketClient.h>
 
 #include "LogBufferElement.h"
+#include "LogChunk.h"
+#include "LogLatency.h"
 #include "LogStatistics.h"
 #include "LogTags.h"
 #include "LogTimes.h"
@@ -72,7 +77,20 @@ static bool isMonotonic(const log_time& mono) {
 }
 }
 
-typedef std::list<LogBufferElement*> LogBufferElementCollection;
+typedef std::list<LogChunk> LogChunkCollection;
+
+// One message handed to LogBuffer::log(LogBufferInput*, size_t), result
+// receives what LogBuffer::log() would have returned for it.
+struct LogBufferInput {
+    log_id_t log_id;
+    log_time realtime;
+    uid_t uid;
+    pid_t pid;
+    pid_t tid;
+    const char* msg;
+    uint16_t len;
+    int result;
+};
 
 class LogBuffer {
     LogBufferElementCollection mLogElements;
@@ -92,6 +110,20 @@ class LogBuffer {
     typedef std::unordered_map<pid_t, LogBufferElementCollection::iterator>
         LogBufferPidIteratorMap;
     LogBufferPidIteratorMap mLastWorstPidOfSystem[LOG_ID_MAX];
+    // Per log id chains of the elements sharing a prune key (uid, or tag for
+    // binary logs) in list order, through LogBufferElement::mChainPrev and
+    // mChainNext. They take pruning straight to the worst offender's entries.
+    struct LogBufferChain {
+        LogBufferElementCollection::iterator head;
+        LogBufferElementCollection::iterator tail;
+    };
+    typedef std::unordered_map<int, LogBufferChain> LogBufferChainMap;
+    LogBufferChainMap mChains[LOG_ID_MAX];
+    // Sparse time index, every timeIndexInterval'th element appended to
+    // mLogElements in non-decreasing time order, for flushTo() to seek by.
+    static constexpr size_t timeIndexInterval = 64;
+    std::deque<LogBufferElementCollection::iterator> mTimeIndex;
+    size_t mTimeIndexCountdown;
 
     unsigned long mMaxSize[LOG_ID_MAX];
 
@@ -102,6 +134,39 @@ class LogBuffer {
     LogBufferElement* lastLoggedElements[LOG_ID_MAX];
     LogBufferElement* droppedElements[LOG_ID_MAX];
     void log(LogBufferElement* elem);
+    void logLocked(LogBufferElement* elem);
+
+    // Histogram of the time writers waited for mLogElementsLock, bucket n
+    // counts waits of less than 2^n microseconds, the first uncontended.
+    static constexpr size_t writerWaitBuckets = 16;
+    std::atomic<uint64_t> mWriterWaits[writerWaitBuckets];
+
+    // Latency instrumentation reported by formatMetrics()
+    LogLatency mLogLatency;    // log() of a batch, lock waits included
+    LogLatency mWriterHold;    // writerLock() held by log()
+    LogLatency mPruneLatency;  // prune(), from maybePrune() or clear()
+    LogLatency mFlushLatency;  // flushTo(), all readers
+
+    // Alternative store packing entries contiguously into fixed-size chunks
+    // per log id, used instead of mLogElements once enableChunkedStore() is
+    // called. There is no chatty processing in this mode, the oldest chunk
+    // is released as a whole when pruning. Full chunks are sealed and kept
+    // compressed, the buffer size limits what is held in memory.
+    bool mChunked;
+    LogChunkCollection mLogChunks[LOG_ID_MAX];
+    // memory held by mLogChunks[id], compressed for sealed chunks
+    size_t mChunkSizes[LOG_ID_MAX];
+    // bumped whenever entries of mLogChunks[id] move or go away
+    uint64_t mChunkGenerations[LOG_ID_MAX];
+    // Taken under the shard lock, so it only increases within a log id.
+    std::atomic<uint64_t> mSequence;
+    // The chunked store is sharded by log id. Writers and readers only hold
+    // rdlock() and the shard locks of the log ids they work on, which guard
+    // mLogChunks[id] and the sizes and generation that go with it; wrlock()
+    // is left to whole-buffer operations. stats is shared by all of the log
+    // ids and guarded by mStatsLock, taken last, in this mode.
+    std::mutex mShardLocks[LOG_ID_MAX];
+    std::mutex mStatsLock;
 
    public:
     LastLogTimes& mTimes;
@@ -113,17 +178,34 @@ class LogBuffer {
         return monotonic;
     }
 
+    // Switch to the chunked log store, only valid before anything is logged.
+    void enableChunkedStore();
+    bool isChunked() const {
+        return mChunked;
+    }
+
     int log(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid, pid_t tid, const char* msg,
             uint16_t len);
+    // Log a batch of messages under a single acquisition of the lock.
+    static constexpr size_t maxBatch = 64;
+    void log(LogBufferInput* inputs, size_t count);
     // lastTid is an optional context to help detect if the last previous
     // valid message was from the same source so we can differentiate chatty
     // filter types (identical or expired)
+    //
+    // sequence is an optional set of cursors used by the chunked store, one
+    // per log id: where one holds a non-zero value, flushing that log id
+    // resumes right after the entry instead of searching for start, and it is
+    // updated with the last entry consumed. The chunked store also leaves the
+    // log ids outside of logMask alone, the filter has to skip them otherwise.
     log_time flushTo(SocketClient* writer, const log_time& start,
                      pid_t* lastTid,  // &lastTid[LOG_ID_MAX] or nullptr
                      bool privileged, bool security,
-                     int (*filter)(const LogBufferElement* element,
+                     int (*filter)(const LogStatisticsElement* element,
                                    void* arg) = nullptr,
-                     void* arg = nullptr);
+                     void* arg = nullptr,
+                     uint64_t* sequence = nullptr,  // &sequence[LOG_ID_MAX]
+                     unsigned int logMask = ~0U);
 
     bool clear(log_id_t id, uid_t uid = AID_ROOT);
     unsigned long getSize(log_id_t id);
@@ -131,6 +213,9 @@ class LogBuffer {
     unsigned long getSizeUsed(log_id_t id);
 
     std::string formatStatistics(uid_t uid, pid_t pid, unsigned int logMask);
+    // Memory held per log id and the latency histograms, as "<key> <value>"
+    // lines meant for tools rather than people.
+    std::string formatMetrics();
 
     void enableStatistics() {
         stats.enableStatistics();
@@ -184,6 +269,37 @@ class LogBuffer {
     bool prune(log_id_t id, unsigned long pruneRows, uid_t uid = AID_ROOT);
     LogBufferElementCollection::iterator erase(
         LogBufferElementCollection::iterator it, bool coalesce = false);
+    static int pruneKey(const LogBufferElement* element) {
+        return element->isBinary() ? element->getTag() : element->getUid();
+    }
+    void linkChain(LogBufferElementCollection::iterator it);
+    void unlinkChain(LogBufferElementCollection::iterator it);
+    LogBufferElementCollection::iterator chainHead(log_id_t id, int key);
+    void indexTime(LogBufferElementCollection::iterator it);
+    void unindexTime(LogBufferElementCollection::iterator it);
+    void rebuildTimeIndex();
+    LogBufferElementCollection::iterator seekTime(const log_time& start);
+
+    bool isLoggable(log_id_t log_id, const char* msg, uint16_t len,
+                    uint32_t tag);
+
+    log_time writerLock();
+    std::string formatWriterWaits();
+    void writerUnlock(const log_time& lockedAt);
+
+    void logChunked(const LogStatisticsElement* element);
+    bool pruneChunks(log_id_t id, bool clearAll, uid_t uid,
+                     LogTimeEntry* oldest);
+    void eraseChunk(log_id_t id, LogChunkCollection::iterator chunk);
+    void lockShards(const log_id_t* ids, size_t count);
+    void unlockShards(const log_id_t* ids, size_t count);
+    std::string formatChunkStatistics(unsigned int logMask);
+    log_time flushToChunks(SocketClient* writer, const log_time& start,
+                           pid_t* lastTid, bool privileged, bool security,
+                           int (*filter)(const LogStatisticsElement* element,
+                                         void* arg),
+                           void* arg, uint64_t* sequence,
+                           unsigned int logMask);
 };
 
 #endif  // _LOGD_LOG_BUFFER_H__
@@ -21,10 +21,15 @@
 #include <stdlib.h>
 #include <sys/types.h>
 
+#include <list>
+
 #include <log/log.h>
 #include <sysutils/SocketClient.h>
 
 class LogBuffer;
+class LogBufferElement;
+
+typedef std::list<LogBufferElement*> LogBufferElementCollection;
 
 #define EXPIRE_HOUR_THRESHOLD 24  // Only expire chatty UID logs to preserve
                                   // non-chatty UIDs less than this age in hours
@@ -32,24 +37,29 @@ class LogBuffer;
                                   // chatty for the temporal expire messages
 #define EXPIRE_RATELIMIT 10  // maximum rate in seconds to report expiration
 
-class __attribute__((packed)) LogBufferElement {
+class LogBufferElement {
     friend LogBuffer;
 
-    // sized to match reality of incoming log packets
-    const uint32_t mUid;
-    const uint32_t mPid;
-    const uint32_t mTid;
-    log_time mRealTime;
+    // sized to match reality of incoming log packets, and ordered so that
+    // there is no padding between the fields
     union {
         char* mMsg;    // mDropped == false
         int32_t mTag;  // mDropped == true
     };
+    const uint32_t mUid;
+    const uint32_t mPid;
+    const uint32_t mTid;
+    log_time mRealTime;
     union {
         const uint16_t mMsgLen;  // mDropped == false
         uint16_t mDroppedCount;  // mDropped == true
     };
     const uint8_t mLogId;
     bool mDropped;
+    // Neighbours in the LogBuffer prune chain of our log id and uid (or tag
+    // for binary logs), end() of LogBuffer::mLogElements at either end.
+    LogBufferElementCollection::iterator mChainPrev;
+    LogBufferElementCollection::iterator mChainNext;
 
     static atomic_int_fast64_t sequence;
 
@@ -0,0 +1,178 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <sys/uio.h>
+
+#include <lz4.h>
+#include <private/android_logger.h>
+
+#include "LogChunk.h"
+#include "LogUtils.h"
+
+bool SerializedLogEntry::flushTo(SocketClient* reader, log_id_t log_id) const {
+    struct logger_entry entry = {};
+
+    entry.hdr_size = sizeof(struct logger_entry);
+    entry.lid = log_id;
+    entry.pid = mPid;
+    entry.tid = mTid;
+    entry.uid = mUid;
+    entry.sec = mRealTime.tv_sec;
+    entry.nsec = mRealTime.tv_nsec;
+    entry.len = mMsgLen;
+
+    struct iovec iovec[2];
+    iovec[0].iov_base = &entry;
+    iovec[0].iov_len = entry.hdr_size;
+    iovec[1].iov_base = const_cast<char*>(getMsg());
+    iovec[1].iov_len = entry.len;
+
+    return reader->sendDatav(iovec, 1 + (entry.len != 0)) == 0;
+}
+
+LogChunk::LogChunk(size_t capacity)
+    : mContents(new char[capacity]), mCapacity(capacity), mReaderRefCount(0) {
+}
+
+// assumes canLog(len) was checked by the caller
+const SerializedLogEntry* LogChunk::log(uint64_t sequence, log_time realtime,
+                                        uid_t uid, pid_t pid, pid_t tid,
+                                        const char* msg, uint16_t len) {
+    char* where = &mContents[mWriteOffset];
+    SerializedLogEntry* entry =
+        new (where) SerializedLogEntry(uid, pid, tid, sequence, realtime, len);
+    memcpy(where + sizeof(SerializedLogEntry), msg, len);
+    mWriteOffset += entry->getTotalLen();
+
+    mHighestSequence = sequence;
+    if (mHighestRealTime < realtime) {
+        mHighestRealTime = realtime;
+    }
+    return entry;
+}
+
+void LogChunk::compress(const char* contents) {
+    int bound = LZ4_compressBound(mWriteOffset);
+    std::unique_ptr<char[]> compressed(new char[bound]);
+    int size = LZ4_compress_default(contents, compressed.get(), mWriteOffset,
+                                    bound);
+    if ((size <= 0) || (static_cast<size_t>(size) >= mWriteOffset)) {
+        // Not worth it, keep the entries as they are.
+        mCompressed.reset();
+        mCompressedSize = 0;
+        if (mContents.get() != contents) {
+            mContents.reset(new char[mWriteOffset]);
+            memcpy(mContents.get(), contents, mWriteOffset);
+        }
+        return;
+    }
+    mCompressed.reset(new char[size]);
+    memcpy(mCompressed.get(), compressed.get(), size);
+    mCompressedSize = size;
+    mContents.reset();
+}
+
+void LogChunk::seal() {
+    if (mSealed) return;
+    mSealed = true;
+    // Readers still walking the uncompressed copy get to keep sharing it.
+    mDecompressed = mContents;
+    std::shared_ptr<char[]> contents = mContents;
+    compress(contents.get());
+}
+
+std::shared_ptr<char[]> LogChunk::decompress() {
+    std::shared_ptr<char[]> contents(new char[mWriteOffset]);
+    int size = LZ4_decompress_safe(mCompressed.get(), contents.get(),
+                                   mCompressedSize, mWriteOffset);
+    if ((size < 0) || (static_cast<size_t>(size) != mWriteOffset)) {
+        android::prdebug("LogChunk: failed to decompress %zu bytes",
+                         mCompressedSize);
+        return nullptr;
+    }
+    return contents;
+}
+
+std::shared_ptr<const char[]> LogChunk::contents() {
+    if (mContents) {
+        return mContents;
+    }
+
+    std::lock_guard<std::mutex> lock(mDecompressedLock);
+    std::shared_ptr<char[]> contents = mDecompressed.lock();
+    if (!contents) {
+        contents = decompress();
+        mDecompressed = contents;
+    }
+    return contents;
+}
+
+void LogChunk::forEachEntry(
+    const std::function<void(SerializedLogEntry* entry)>& modify) {
+    std::shared_ptr<char[]> contents = mContents ? mContents : decompress();
+    if (!contents) return;
+
+    for (size_t offset = 0; offset < mWriteOffset;) {
+        SerializedLogEntry* entry =
+            reinterpret_cast<SerializedLogEntry*>(&contents[offset]);
+        modify(entry);
+        offset += entry->getTotalLen();
+    }
+
+    if (mCompressed) {
+        mDecompressed.reset();
+        compress(contents.get());
+    }
+}
+
+size_t LogChunk::eraseIf(
+    const std::function<bool(const SerializedLogEntry* entry)>& predicate,
+    const std::function<void(const SerializedLogEntry* entry)>& erased) {
+    std::shared_ptr<char[]> contents = mContents ? mContents : decompress();
+    if (!contents) return 0;
+
+    size_t readOffset = 0;
+    size_t writeOffset = 0;
+    size_t count = 0;
+    mHighestRealTime = log_time();
+
+    while (readOffset < mWriteOffset) {
+        const SerializedLogEntry* entry = entryAt(contents.get(), readOffset);
+        size_t len = entry->getTotalLen();
+        if (predicate(entry)) {
+            erased(entry);
+            ++count;
+        } else {
+            if (mHighestRealTime < entry->getRealTime()) {
+                mHighestRealTime = entry->getRealTime();
+            }
+            if (readOffset != writeOffset) {
+                memmove(&contents[writeOffset], &contents[readOffset], len);
+            }
+            writeOffset += len;
+        }
+        readOffset += len;
+    }
+    mWriteOffset = writeOffset;
+    // mHighestSequence is kept, it still bounds every entry in the chunk.
+
+    if (mSealed && count) {
+        mDecompressed.reset();
+        compress(contents.get());
+    }
+    return count;
+}
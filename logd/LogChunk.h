@@ -0,0 +1,190 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+#include <log/log.h>
+#include <sysutils/SocketClient.h>
+
+#include "LogStatistics.h"
+
+// A log entry as stored in a LogChunk, the message payload immediately
+// follows this header in the chunk's contiguous storage.
+class __attribute__((packed)) SerializedLogEntry {
+    const uint32_t mUid;
+    const uint32_t mPid;
+    const uint32_t mTid;
+    const uint64_t mSequence;
+    log_time mRealTime;
+    const uint16_t mMsgLen;
+
+   public:
+    SerializedLogEntry(uid_t uid, pid_t pid, pid_t tid, uint64_t sequence,
+                       log_time realtime, uint16_t len)
+        : mUid(uid),
+          mPid(pid),
+          mTid(tid),
+          mSequence(sequence),
+          mRealTime(realtime),
+          mMsgLen(len) {
+    }
+    SerializedLogEntry(const SerializedLogEntry&) = delete;
+    SerializedLogEntry& operator=(const SerializedLogEntry&) = delete;
+
+    uid_t getUid() const {
+        return mUid;
+    }
+    pid_t getPid() const {
+        return mPid;
+    }
+    pid_t getTid() const {
+        return mTid;
+    }
+    uint64_t getSequence() const {
+        return mSequence;
+    }
+    log_time getRealTime() const {
+        return mRealTime;
+    }
+    // only for the in-place monotonic <-> realtime fixup in LogBuffer::init()
+    void setRealTime(log_time realtime) {
+        mRealTime = realtime;
+    }
+    uint16_t getMsgLen() const {
+        return mMsgLen;
+    }
+    const char* getMsg() const {
+        return reinterpret_cast<const char*>(this) + sizeof(*this);
+    }
+    size_t getTotalLen() const {
+        return sizeof(*this) + mMsgLen;
+    }
+
+    LogStatisticsElement toLogStatisticsElement(log_id_t log_id) const {
+        return LogStatisticsElement(log_id, mRealTime, mUid, mPid, mTid,
+                                    getMsg(), mMsgLen);
+    }
+
+    // returns false if the reader socket failed
+    bool flushTo(SocketClient* reader, log_id_t log_id) const;
+};
+
+// A fixed-size block of contiguous storage holding the SerializedLogEntry
+// records of a single log id, in the order they were logged. Entries are
+// only appended while the chunk is open; once full, it is sealed and its
+// contents are kept LZ4 compressed. Readers get at the entries through
+// contents(), which decompresses a sealed chunk on demand and shares the
+// result with every other reader walking it at the same time.
+class LogChunk {
+    // uncompressed entries, only while the chunk is open for writing
+    std::shared_ptr<char[]> mContents;
+    // sealed chunk contents, handed out to readers by contents()
+    std::weak_ptr<char[]> mDecompressed;
+    std::mutex mDecompressedLock;
+    std::unique_ptr<char[]> mCompressed;
+    size_t mCompressedSize = 0;
+    bool mSealed = false;
+
+    const size_t mCapacity;
+    size_t mWriteOffset = 0;
+    uint64_t mHighestSequence = 0;
+    log_time mHighestRealTime;
+    // Readers hold references while they have an entry of ours in flight
+    // outside of LogBuffer::rdlock(), any number of them can do so at once.
+    std::atomic<unsigned int> mReaderRefCount;
+
+    std::shared_ptr<char[]> decompress();
+    // replace the contents of a sealed chunk
+    void compress(const char* contents);
+
+   public:
+    explicit LogChunk(size_t capacity);
+    LogChunk(const LogChunk&) = delete;
+    LogChunk& operator=(const LogChunk&) = delete;
+
+    bool canLog(size_t len) const {
+        return !mSealed &&
+               ((mWriteOffset + sizeof(SerializedLogEntry) + len) <= mCapacity);
+    }
+    const SerializedLogEntry* log(uint64_t sequence, log_time realtime,
+                                  uid_t uid, pid_t pid, pid_t tid,
+                                  const char* msg, uint16_t len);
+
+    // No more entries will be added, compress the contents.
+    void seal();
+
+    // The entries, valid for as long as the returned reference is held. Safe
+    // to call from concurrent readers with LogBuffer::rdlock() held. Empty
+    // if a sealed chunk can not be decompressed.
+    std::shared_ptr<const char[]> contents();
+
+    static const SerializedLogEntry* entryAt(const char* contents,
+                                             size_t offset) {
+        return reinterpret_cast<const SerializedLogEntry*>(&contents[offset]);
+    }
+
+    // Call modify on every entry in place. Must not be called while readers
+    // reference the chunk.
+    void forEachEntry(const std::function<void(SerializedLogEntry* entry)>& modify);
+
+    // Remove all entries matching the predicate, compacting the chunk. Must
+    // not be called while readers reference the chunk.
+    size_t eraseIf(
+        const std::function<bool(const SerializedLogEntry* entry)>& predicate,
+        const std::function<void(const SerializedLogEntry* entry)>& erased);
+
+    void incReaderRefCount() {
+        mReaderRefCount.fetch_add(1, std::memory_order_relaxed);
+    }
+    void decReaderRefCount() {
+        mReaderRefCount.fetch_sub(1, std::memory_order_relaxed);
+    }
+    bool isReferenced() const {
+        return mReaderRefCount.load(std::memory_order_relaxed) != 0;
+    }
+
+    bool isSealed() const {
+        return mSealed;
+    }
+    bool empty() const {
+        return mWriteOffset == 0;
+    }
+    // size of the entries, uncompressed
+    size_t writeOffset() const {
+        return mWriteOffset;
+    }
+    // memory held for the entries, compressed if sealed
+    size_t storageSize() const {
+        return mCompressed ? mCompressedSize : mWriteOffset;
+    }
+    size_t capacity() const {
+        return mCapacity;
+    }
+    uint64_t highestSequence() const {
+        return mHighestSequence;
+    }
+    log_time highestRealTime() const {
+        return mHighestRealTime;
+    }
+};
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+
+#include "LogIngestBatch.h"
+#include "LogReader.h"
+
+static constexpr size_t arenaSize =
+    LogBuffer::maxBatch * LOGGER_ENTRY_MAX_PAYLOAD;
+// <prio><tag, cut to 30>\0<count> duplicate messages suppressed\0
+static constexpr size_t noticeMax = 64;
+
+LogIngestBatch::LogIngestBatch(LogBuffer* buf, LogReader* reader)
+    : mLogBuffer(buf),
+      mReader(reader),
+      mCount(0),
+      mArena(new char[arenaSize]),
+      mUsed(0) {
+    for (auto& recent : mRecent) {
+        recent.mHash = 0;
+        recent.mCount = 0;
+        recent.mSuppressed = 0;
+    }
+}
+
+char* LogIngestBatch::reserve(size_t len) {
+    if (len > arenaSize - LOG_ID_MAX * noticeMax) {
+        return nullptr;
+    }
+    // Leave room for the suppression notices flush() may have to add.
+    if ((mCount + 1 + LOG_ID_MAX > LogBuffer::maxBatch) ||
+        (mUsed + len > arenaSize - LOG_ID_MAX * noticeMax)) {
+        flush();
+    }
+    return mArena.get() + mUsed;
+}
+
+bool LogIngestBatch::isDuplicate(log_id_t log_id, log_time realtime,
+                                 uid_t uid, pid_t pid, pid_t tid,
+                                 const char* msg, uint16_t len,
+                                 std::string_view key) {
+    Recent& recent = mRecent[log_id];
+    if (key.empty()) {
+        key = std::string_view(msg, len);
+    }
+    size_t hash = std::hash<std::string_view>()(key) ^ uid;
+
+    if ((hash == recent.mHash) && recent.mCount &&
+        (realtime >= recent.mSince) &&
+        ((realtime - recent.mSince).nsec() < dupWindow)) {
+        if (++recent.mCount <= dupBurst) {
+            return false;
+        }
+        ++recent.mSuppressed;
+        recent.mLast = realtime;
+        recent.mUid = uid;
+        recent.mPid = pid;
+        recent.mTid = tid;
+        return true;
+    }
+
+    // Something else, whatever was held back is reported before it, which
+    // moves msg up.
+    addSuppressed(log_id, len);
+    msg = mArena.get() + mUsed;
+    recent.mHash = hash;
+    recent.mSince = realtime;
+    recent.mCount = 1;
+    if ((log_id != LOG_ID_EVENTS) && (log_id != LOG_ID_SECURITY) &&
+        (log_id != LOG_ID_STATS) && (len >= 2)) {
+        recent.mPrio = msg[0];
+        recent.mTag.assign(msg + 1, strnlen(msg + 1, len - 1));
+    } else {
+        recent.mTag.clear();
+    }
+    return false;
+}
+
+// Binary buffers have no text to put it in, their suppressed entries are
+// only dropped. pending bytes at the end of the arena belong to an entry that
+// is being added, the notice goes in front of them.
+void LogIngestBatch::addSuppressed(log_id_t log_id, size_t pending) {
+    Recent& recent = mRecent[log_id];
+    if (!recent.mSuppressed) {
+        return;
+    }
+    unsigned suppressed = recent.mSuppressed;
+    recent.mSuppressed = 0;
+    if (recent.mTag.empty() || (mCount >= LogBuffer::maxBatch)) {
+        return;
+    }
+
+    char notice[noticeMax];
+    size_t tagLen = std::min(recent.mTag.length(), static_cast<size_t>(30));
+    notice[0] = recent.mPrio;
+    memcpy(notice + 1, recent.mTag.data(), tagLen);
+    notice[1 + tagLen] = '\0';
+    size_t len = 1 + tagLen + 1;
+    len += snprintf(notice + len, sizeof(notice) - len,
+                    "%u duplicate messages suppressed", suppressed) + 1;
+    if ((len > sizeof(notice)) || (mUsed + pending + len > arenaSize)) {
+        return;
+    }
+
+    char* msg = mArena.get() + mUsed;
+    memmove(msg + len, msg, pending);
+    memcpy(msg, notice, len);
+    mInputs[mCount++] = {log_id,     recent.mLast, recent.mUid,
+                         recent.mPid, recent.mTid, msg,
+                         static_cast<uint16_t>(len), 0};
+    mUsed += len;
+}
+
+int LogIngestBatch::add(log_id_t log_id, log_time realtime, uid_t uid,
+                        pid_t pid, pid_t tid, const char* msg, uint16_t len,
+                        std::string_view key) {
+    if ((log_id >= LOG_ID_MAX) ||
+        isDuplicate(log_id, realtime, uid, pid, tid, msg, len, key)) {
+        return 0;
+    }
+
+    // A notice may just have been put in front of it.
+    msg = mArena.get() + mUsed;
+    mInputs[mCount++] = {log_id, realtime, uid, pid, tid, msg, len, 0};
+    mUsed += len;
+    return len;
+}
+
+void LogIngestBatch::flush() {
+    for (int i = LOG_ID_MIN; i < LOG_ID_MAX; ++i) {
+        addSuppressed(static_cast<log_id_t>(i), 0);
+    }
+    if (!mCount) {
+        return;
+    }
+
+    mLogBuffer->log(mInputs, mCount);
+
+    log_mask_t logMask = 0;
+    for (size_t i = 0; i < mCount; ++i) {
+        if (mInputs[i].result >= 0) {
+            logMask |= static_cast<log_mask_t>(1 << mInputs[i].log_id);
+        }
+    }
+    mCount = 0;
+    mUsed = 0;
+
+    if (logMask) {
+        mReader->notifyNewLog(logMask);
+    }
+}
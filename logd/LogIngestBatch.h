@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <log/log.h>
+
+#include "LogBuffer.h"
+
+class LogReader;
+
+// Collects the entries LogKlog and LogAudit parse out of one read, and hands
+// them to LogBuffer under a single acquisition of its lock, with one reader
+// notification. Parsing happens before anything is queued, so none of it
+// runs under the lock.
+//
+// Storms of the same message are cut down before they get that far: after
+// dupBurst copies within dupWindow, identical entries are dropped and
+// replaced by a "<n> duplicate messages suppressed" entry per flush().
+class LogIngestBatch {
+    static constexpr unsigned dupBurst = 5;
+    static constexpr uint64_t dupWindow = NS_PER_SEC;
+
+    struct Recent {
+        size_t mHash;
+        log_time mSince;
+        unsigned mCount;
+        // what to attribute the suppressed entries to
+        unsigned mSuppressed;
+        log_time mLast;
+        uid_t mUid;
+        pid_t mPid;
+        pid_t mTid;
+        char mPrio;
+        std::string mTag;
+    };
+
+    LogBuffer* mLogBuffer;
+    LogReader* mReader;
+    LogBufferInput mInputs[LogBuffer::maxBatch];
+    size_t mCount;
+    std::unique_ptr<char[]> mArena;
+    size_t mUsed;
+    Recent mRecent[LOG_ID_MAX];
+
+    bool isDuplicate(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
+                     pid_t tid, const char* msg, uint16_t len,
+                     std::string_view key);
+    void addSuppressed(log_id_t log_id, size_t pending);
+
+   public:
+    LogIngestBatch(LogBuffer* buf, LogReader* reader);
+    LogIngestBatch(const LogIngestBatch&) = delete;
+    LogIngestBatch& operator=(const LogIngestBatch&) = delete;
+
+    // Room for a message of len bytes, flushing first if the batch is full.
+    char* reserve(size_t len);
+    // Queues the message built in the last reserve(). key, if not empty, is
+    // what duplicates are told apart by instead of the message. Returns len,
+    // or 0 if it was suppressed as a duplicate.
+    int add(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
+            pid_t tid, const char* msg, uint16_t len,
+            std::string_view key = std::string_view());
+    void flush();
+};
@@ -205,11 +205,11 @@ LogKlog::LogKlog(LogBuffer* buf, LogReader* reader, int fdWrite, int fdRead,
                  bool auditd)
     : SocketListener(fdRead, false),
       logbuf(buf),
-      reader(reader),
       signature(CLOCK_MONOTONIC),
       initialized(false),
       enableLogging(true),
-      auditd(auditd) {
+      auditd(auditd),
+      batch(buf, reader) {
     static const char klogd_message[] = "%s%s%" PRIu64 "\n";
     char buffer[strlen(priority_message) + strlen(klogdStr) +
                 strlen(klogd_message) + 20];
@@ -231,6 +231,8 @@ bool LogKlog::onDataAvailable(SocketClient* cli) {
     for (;;) {
         ssize_t retval = 0;
         if (len < (ssize_t)(sizeof(buffer) - 1)) {
+            // Commit what the last read gave us before possibly blocking.
+            batch.flush();
             retval =
                 read(cli->getSocket(), buffer + len, sizeof(buffer) - 1 - len);
         }
@@ -238,6 +240,7 @@ bool LogKlog::onDataAvailable(SocketClient* cli) {
             break;
         }
         if (retval < 0) {
+            batch.flush();
             return false;
         }
         len += retval;
@@ -259,6 +262,7 @@ bool LogKlog::onDataAvailable(SocketClient* cli) {
         }
     }
 
+    batch.flush();
     return true;
 }
 
@@ -766,13 +770,12 @@ int LogKlog::log(const char* buf, ssize_t len) {
         return -EINVAL;
     }
 
-    // Careful.
-    // We are using the stack to house the log buffer for speed reasons.
-    // If we malloc'd this buffer, we could get away without n's USHRT_MAX
-    // test above, but we would then required a max(n, USHRT_MAX) as
-    // truncating length argument to logbuf->log() below. Gain is protection
-    // of stack sanity and speedup, loss is truncated long-line content.
-    char newstr[n];
+    // Built in place in the batch, n's USHRT_MAX test above keeps it to what
+    // LogBuffer takes.
+    char* newstr = batch.reserve(n);
+    if (!newstr) {
+        return -EINVAL;
+    }
     char* np = newstr;
 
     // Convert priority into single-byte Android logger priority
@@ -814,13 +817,6 @@ int LogKlog::log(const char* buf, ssize_t len) {
         }
     }
 
-    // Log message
-    int rc = logbuf->log(LOG_ID_KERNEL, now, uid, pid, tid, newstr, (uint16_t)n);
-
-    // notify readers
-    if (rc > 0) {
-        reader->notifyNewLog(static_cast<log_mask_t>(1 << LOG_ID_KERNEL));
-    }
-
-    return rc;
+    // Queue message, readers are notified once the batch is flushed
+    return batch.add(LOG_ID_KERNEL, now, uid, pid, tid, newstr, (uint16_t)n);
 }
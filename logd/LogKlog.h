@@ -20,12 +20,13 @@
 #include <private/android_logger.h>
 #include <sysutils/SocketListener.h>
 
+#include "LogIngestBatch.h"
+
 class LogBuffer;
 class LogReader;
 
 class LogKlog : public SocketListener {
     LogBuffer* logbuf;
-    LogReader* reader;
     const log_time signature;
     // Set once thread is started, separates KLOG_ACTION_READ_ALL
     // and KLOG_ACTION_READ phases.
@@ -35,13 +36,19 @@ class LogKlog : public SocketListener {
     // set if we are also running auditd, to filter out audit reports from
     // our copy of the kernel log
     bool auditd;
+    // parsed entries waiting for a single LogBuffer::log()
+    LogIngestBatch batch;
 
     static log_time correction;
 
    public:
     LogKlog(LogBuffer* buf, LogReader* reader, int fdWrite, int fdRead,
             bool auditd);
+    // Parses and queues one line, see flush()
     int log(const char* buf, ssize_t len);
+    void flush() {
+        batch.flush();
+    }
     void synchronize(const char* buf, ssize_t len);
 
     bool isMonotonic() {
@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+
+#include <android-base/stringprintf.h>
+
+#include "LogLatency.h"
+
+LogLatency::LogLatency() : mTotal(0), mMax(0) {
+    for (auto& count : mCounts) {
+        count.store(0, std::memory_order_relaxed);
+    }
+}
+
+void LogLatency::record(uint64_t usec) {
+    size_t bucket = 0;
+    while ((bucket < (buckets - 1)) && (usec >> bucket)) {
+        ++bucket;
+    }
+    mCounts[bucket].fetch_add(1, std::memory_order_relaxed);
+    mTotal.fetch_add(usec, std::memory_order_relaxed);
+
+    uint64_t max = mMax.load(std::memory_order_relaxed);
+    while ((usec > max) &&
+           !mMax.compare_exchange_weak(max, usec, std::memory_order_relaxed)) {
+    }
+}
+
+std::string LogLatency::format(const std::string& name) const {
+    uint64_t count = 0;
+    std::string buckets_out;
+    for (size_t i = 0; i < buckets; ++i) {
+        uint64_t n = mCounts[i].load(std::memory_order_relaxed);
+        if (!n) continue;
+        count += n;
+        if (i == (buckets - 1)) {
+            buckets_out += android::base::StringPrintf(
+                "%s.ge_%" PRIu64 "us %" PRIu64 "\n", name.c_str(),
+                uint64_t(1) << (i - 1), n);
+        } else {
+            buckets_out += android::base::StringPrintf(
+                "%s.lt_%" PRIu64 "us %" PRIu64 "\n", name.c_str(),
+                uint64_t(1) << i, n);
+        }
+    }
+
+    return android::base::StringPrintf(
+               "%s.count %" PRIu64 "\n%s.total_us %" PRIu64
+               "\n%s.max_us %" PRIu64 "\n",
+               name.c_str(), count, name.c_str(),
+               mTotal.load(std::memory_order_relaxed), name.c_str(),
+               mMax.load(std::memory_order_relaxed)) +
+           buckets_out;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <string>
+
+#include <log/log_time.h>
+
+// Histogram of durations, bucket n counts those of less than 2^n
+// microseconds, the last everything longer. Recording is lock free so it
+// can be done from under any lock, format() may race with it and then only
+// sees a slightly stale picture.
+class LogLatency {
+    static constexpr size_t buckets = 20;
+
+    std::atomic<uint64_t> mCounts[buckets];
+    std::atomic<uint64_t> mTotal;  // usec
+    std::atomic<uint64_t> mMax;    // usec
+
+   public:
+    LogLatency();
+    LogLatency(const LogLatency&) = delete;
+    LogLatency& operator=(const LogLatency&) = delete;
+
+    void record(uint64_t usec);
+    void recordSince(const log_time& start) {
+        record((log_time(CLOCK_MONOTONIC) - start).nsec() / 1000);
+    }
+
+    // One "<name>.<key> <value>" line per figure, empty buckets left out.
+    std::string format(const std::string& name) const;
+};
+
+// Records the lifetime of the object, for functions with many exits.
+class LogLatencyTimer {
+    LogLatency& mLatency;
+    const log_time mStart;
+
+   public:
+    explicit LogLatencyTimer(LogLatency& latency)
+        : mLatency(latency), mStart(CLOCK_MONOTONIC) {
+    }
+    ~LogLatencyTimer() {
+        mLatency.recordSince(mStart);
+    }
+    LogLatencyTimer(const LogLatencyTimer&) = delete;
+    LogLatencyTimer& operator=(const LogLatencyTimer&) = delete;
+};
@@ -22,6 +22,7 @@
 #include <sys/un.h>
 #include <unistd.h>
 
+#include <android-base/unique_fd.h>
 #include <cutils/sockets.h>
 #include <private/android_filesystem_config.h>
 #include <private/android_logger.h>
@@ -31,7 +32,31 @@
 #include "LogUtils.h"
 
 LogListener::LogListener(LogBuffer* buf, LogReader* reader)
-    : SocketListener(getLogSocket(), false), logbuf(buf), reader(reader) {}
+    : SocketListener(getLogSocket(), false),
+      logbuf(buf),
+      reader(reader),
+      queue(nullptr),
+      rings(nullptr) {}
+
+bool LogListener::enableWriteQueue() {
+    LogWriteQueue* q = new LogWriteQueue(logbuf, reader);
+    if (!q->startMerger()) {
+        delete q;
+        return false;
+    }
+    queue = q;
+    return true;
+}
+
+bool LogListener::enableRings() {
+    LogRingListener* r = new LogRingListener(logbuf, reader);
+    if (!r->startListener()) {
+        delete r;
+        return false;
+    }
+    rings = r;
+    return true;
+}
 
 bool LogListener::onDataAvailable(SocketClient* cli) {
     static bool name_set;
@@ -44,9 +69,15 @@ bool LogListener::onDataAvailable(SocketClient* cli) {
     char buffer[sizeof(android_log_header_t) + LOGGER_ENTRY_MAX_PAYLOAD + 1];
     struct iovec iov = { buffer, sizeof(buffer) - 1 };
 
-    alignas(4) char control[CMSG_SPACE(sizeof(struct ucred))];
+    // Descriptors are only accepted with rings enabled, otherwise the kernel
+    // discards them for lack of room.
+    static const size_t maxFds = 3;
+    alignas(4) char control[CMSG_SPACE(sizeof(struct ucred)) +
+                            CMSG_SPACE(sizeof(int) * maxFds)];
     struct msghdr hdr = {
-        nullptr, 0, &iov, 1, control, sizeof(control), 0,
+        nullptr, 0, &iov, 1,
+        control, rings ? sizeof(control) : CMSG_SPACE(sizeof(struct ucred)),
+        0,
     };
 
     int socket = cli->getSocket();
@@ -55,25 +86,42 @@ bool LogListener::onDataAvailable(SocketClient* cli) {
     // overhead under logging load. We are safe because we check counts, but
     // still need to clear null terminator
     // memset(buffer, 0, sizeof(buffer));
-    ssize_t n = recvmsg(socket, &hdr, 0);
-    if (n <= (ssize_t)(sizeof(android_log_header_t))) {
+    ssize_t n = recvmsg(socket, &hdr, MSG_CMSG_CLOEXEC);
+    if (n < 0) {
         return false;
     }
 
-    buffer[n] = 0;
-
     struct ucred* cred = nullptr;
+    // anything we received and do not hand on is closed on return
+    android::base::unique_fd fds[maxFds];
+    size_t nfds = 0;
 
     struct cmsghdr* cmsg = CMSG_FIRSTHDR(&hdr);
     while (cmsg != nullptr) {
         if (cmsg->cmsg_level == SOL_SOCKET &&
             cmsg->cmsg_type == SCM_CREDENTIALS) {
             cred = (struct ucred*)CMSG_DATA(cmsg);
-            break;
+        } else if (cmsg->cmsg_level == SOL_SOCKET &&
+                   cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int* received = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+            for (size_t i = 0; i < count; ++i) {
+                if (nfds < maxFds) {
+                    fds[nfds++].reset(received[i]);
+                } else {
+                    close(received[i]);
+                }
+            }
         }
         cmsg = CMSG_NXTHDR(&hdr, cmsg);
     }
 
+    if (n <= (ssize_t)(sizeof(android_log_header_t))) {
+        return false;
+    }
+
+    buffer[n] = 0;
+
     if (cred == nullptr) {
         return false;
     }
@@ -87,6 +135,20 @@ bool LogListener::onDataAvailable(SocketClient* cli) {
 
     android_log_header_t* header =
         reinterpret_cast<android_log_header_t*>(buffer);
+
+    if (rings && (header->id == LOG_RING_REGISTER_ID)) {
+        log_ring_register_t* reg = reinterpret_cast<log_ring_register_t*>(
+            buffer + sizeof(android_log_header_t));
+        if ((nfds == maxFds) &&
+            (n == sizeof(android_log_header_t) + sizeof(*reg)) &&
+            (reg->magic == LOG_RING_MAGIC) &&
+            (reg->version == LOG_RING_VERSION)) {
+            rings->add(cred, fds[0].release(), fds[1].release(),
+                       fds[2].release());
+        }
+        return true;
+    }
+
     log_id_t logId = static_cast<log_id_t>(header->id);
     if (/* logId < LOG_ID_MIN || */ logId >= LOG_ID_MAX ||
         logId == LOG_ID_KERNEL) {
@@ -105,8 +167,13 @@ bool LogListener::onDataAvailable(SocketClient* cli) {
     // NB: hdr.msg_flags & MSG_TRUNC is not tested, silently passing a
     // truncated message to the logs.
 
-    int res = logbuf->log(logId, header->realtime, cred->uid, cred->pid, header->tid, msg,
-                          ((size_t)n <= UINT16_MAX) ? (uint16_t)n : UINT16_MAX);
+    uint16_t len = ((size_t)n <= UINT16_MAX) ? (uint16_t)n : UINT16_MAX;
+    if (queue && queue->push(logId, header->realtime, cred->uid, cred->pid,
+                             header->tid, msg, len)) {
+        return true;
+    }
+
+    int res = logbuf->log(logId, header->realtime, cred->uid, cred->pid, header->tid, msg, len);
     if (res > 0) {
         reader->notifyNewLog(static_cast<log_mask_t>(1 << logId));
     }
@@ -19,14 +19,25 @@
 
 #include <sysutils/SocketListener.h>
 #include "LogReader.h"
+#include "LogRingListener.h"
+#include "LogWriteQueue.h"
 
 class LogListener : public SocketListener {
     LogBuffer* logbuf;
     LogReader* reader;
+    LogWriteQueue* queue;
+    LogRingListener* rings;
 
    public:
      LogListener(LogBuffer* buf, LogReader* reader);
 
+    // Hand incoming messages to a LogWriteQueue instead of logging them from
+    // the listener thread, must be called before startListener().
+    bool enableWriteQueue();
+    // Accept shared memory rings registered on logdw, must be called before
+    // startListener().
+    bool enableRings();
+
    protected:
     virtual bool onDataAvailable(SocketClient* cli);
 
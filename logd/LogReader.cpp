@@ -31,7 +31,9 @@
 #include "LogUtils.h"
 
 LogReader::LogReader(LogBuffer* logbuf)
-    : SocketListener(getLogSocket(), true), mLogbuf(*logbuf) {
+    : SocketListener(getLogSocket(), true),
+      mLogbuf(*logbuf),
+      mService(logbuf->mTimes) {
 }
 
 // When we are notified a new log entry is available, inform
@@ -49,7 +51,8 @@ bool LogReader::onDataAvailable(SocketClient* cli) {
         name_set = true;
     }
 
-    char buffer[255];
+    // Room for a filter= spec after everything else.
+    char buffer[1024];
 
     int len = read(cli->getSocket(), buffer, sizeof(buffer) - 1);
     if (len <= 0) {
@@ -70,9 +73,20 @@ bool LogReader::onDataAvailable(SocketClient* cli) {
     }
     LogTimeEntry::unlock();
 
+    // Always last, cut off so the other arguments can not be found in it.
+    const char* filter = nullptr;
+    size_t filterLen = 0;
+    static const char _filter[] = " filter=";
+    char* cp = strstr(buffer, _filter);
+    if (cp) {
+        filter = cp + sizeof(_filter) - 1;
+        filterLen = strlen(filter);
+        *cp = '\0';
+    }
+
     unsigned long tail = 0;
     static const char _tail[] = " tail=";
-    char* cp = strstr(buffer, _tail);
+    cp = strstr(buffer, _tail);
     if (cp) {
         tail = atol(cp + sizeof(_tail) - 1);
     }
@@ -166,7 +180,7 @@ bool LogReader::onDataAvailable(SocketClient* cli) {
                   mIsMonotonic(isMonotonic) {
             }
 
-            static int callback(const LogBufferElement* element, void* obj) {
+            static int callback(const LogStatisticsElement* element, void* obj) {
                 LogFindStart* me = reinterpret_cast<LogFindStart*>(obj);
                 if ((!me->mPid || (me->mPid == element->getPid())) &&
                     (me->mLogMask & (1 << element->getLogId()))) {
@@ -198,7 +212,7 @@ bool LogReader::onDataAvailable(SocketClient* cli) {
 
         logbuf().flushTo(cli, sequence, nullptr, FlushCommand::hasReadLogs(cli),
                          FlushCommand::hasSecurityLogs(cli),
-                         logFindStart.callback, &logFindStart);
+                         logFindStart.callback, &logFindStart, nullptr, logMask);
 
         if (!logFindStart.found()) {
             doSocketDelete(cli);
@@ -208,9 +222,10 @@ bool LogReader::onDataAvailable(SocketClient* cli) {
 
     android::prdebug(
         "logdr: UID=%d GID=%d PID=%d %c tail=%lu logMask=%x pid=%d "
-        "start=%" PRIu64 "ns timeout=%" PRIu64 "ns\n",
+        "start=%" PRIu64 "ns timeout=%" PRIu64 "ns filter=%.*s\n",
         cli->getUid(), cli->getGid(), cli->getPid(), nonBlock ? 'n' : 'b', tail,
-        logMask, (int)pid, sequence.nsec(), timeout);
+        logMask, (int)pid, sequence.nsec(), timeout, (int)filterLen,
+        filter ? filter : "");
 
     if (sequence == log_time::EPOCH) {
         timeout = 0;
@@ -218,7 +233,8 @@ bool LogReader::onDataAvailable(SocketClient* cli) {
 
     LogTimeEntry::wrlock();
     auto entry = std::make_unique<LogTimeEntry>(
-        *this, cli, nonBlock, tail, logMask, pid, sequence, timeout);
+        *this, cli, nonBlock, tail, logMask, pid, sequence, timeout, filter,
+        filterLen);
     if (!entry->startReader_Locked()) {
         LogTimeEntry::unlock();
         return false;
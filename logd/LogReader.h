@@ -19,6 +19,7 @@
 
 #include <sysutils/SocketListener.h>
 
+#include "LogReaderService.h"
 #include "LogTimes.h"
 
 #define LOGD_SNDTIMEO 32
@@ -27,6 +28,7 @@ class LogBuffer;
 
 class LogReader : public SocketListener {
     LogBuffer& mLogbuf;
+    LogReaderService mService;
 
    public:
     explicit LogReader(LogBuffer* logbuf);
@@ -35,6 +37,9 @@ class LogReader : public SocketListener {
     LogBuffer& logbuf(void) const {
         return mLogbuf;
     }
+    LogReaderService& service(void) {
+        return mService;
+    }
 
    protected:
     virtual bool onDataAvailable(SocketClient* cli);
@@ -0,0 +1,262 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <limits.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#include <android-base/macros.h>
+#include <private/android_logger.h>
+
+#include "LogReaderService.h"
+#include "LogUtils.h"
+
+// epoll data of the wakeup eventfd, LogTimeEntry ids start at 1
+static constexpr uint64_t wakeupId = 0;
+
+static bool startThread(void* (*start)(void*), void* arg) {
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    if (!pthread_attr_init(&attr)) {
+        if (!pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) {
+            if (!pthread_create(&thread, &attr, start, arg)) {
+                pthread_attr_destroy(&attr);
+                return true;
+            }
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    return false;
+}
+
+LogReaderService::LogReaderService(LastLogTimes& times)
+    : mTimes(times),
+      mPollerStarted(false),
+      mWorkers(0),
+      mEpollFd(-1),
+      mEventFd(-1) {
+    pthread_cond_init(&mRunnable, nullptr);
+}
+
+bool LogReaderService::start_Locked() {
+    if (mEpollFd < 0) {
+        int epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            return false;
+        }
+        int eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        if (eventFd < 0) {
+            close(epollFd);
+            return false;
+        }
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = wakeupId;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, eventFd, &event)) {
+            close(eventFd);
+            close(epollFd);
+            return false;
+        }
+        mEpollFd = epollFd;
+        mEventFd = eventFd;
+    }
+
+    if (!mPollerStarted) {
+        mPollerStarted = startThread(pollerStart, this);
+    }
+    while ((mWorkers < numWorkers) && startThread(workerStart, this)) {
+        ++mWorkers;
+    }
+
+    return mPollerStarted && mWorkers;
+}
+
+bool LogReaderService::add_Locked(LogTimeEntry* entry) {
+    if (!start_Locked()) {
+        return false;
+    }
+
+    if (entry->hasTimeout_Locked()) {
+        // Nothing to do until triggered or timed out.
+        entry->mState = LogTimeEntry::STATE_IDLE;
+        wakePoller();
+    } else {
+        enqueue_Locked(entry);
+    }
+    return true;
+}
+
+void LogReaderService::trigger_Locked(LogTimeEntry* entry) {
+    entry->mTriggered = true;
+
+    switch (entry->mState) {
+        case LogTimeEntry::STATE_IDLE:
+            enqueue_Locked(entry);
+            break;
+        case LogTimeEntry::STATE_PARKED:
+            // New data can wait for the socket, a release can not.
+            if (entry->mRelease) {
+                unpark_Locked(entry);
+                enqueue_Locked(entry);
+            }
+            break;
+        case LogTimeEntry::STATE_QUEUED:
+        case LogTimeEntry::STATE_RUNNING:
+            break;
+    }
+}
+
+void LogReaderService::enqueue_Locked(LogTimeEntry* entry) {
+    entry->mState = LogTimeEntry::STATE_QUEUED;
+    mRunQueue.push_back(entry);
+    pthread_cond_signal(&mRunnable);
+}
+
+void LogReaderService::park_Locked(LogTimeEntry* entry) {
+    struct epoll_event event = {};
+    event.events = EPOLLOUT | EPOLLONESHOT;
+    event.data.u64 = entry->mId;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, entry->mClient->getSocket(),
+                  &event)) {
+        // Can not wait for it, fall back to a blocking write next time.
+        android::prdebug("logd.reader: failed to park reader, pid %d",
+                         entry->mClient->getPid());
+        enqueue_Locked(entry);
+        return;
+    }
+    entry->mState = LogTimeEntry::STATE_PARKED;
+    mParked[entry->mId] = entry;
+}
+
+void LogReaderService::unpark_Locked(LogTimeEntry* entry) {
+    epoll_ctl(mEpollFd, EPOLL_CTL_DEL, entry->mClient->getSocket(), nullptr);
+    mParked.erase(entry->mId);
+}
+
+void LogReaderService::wakePoller() {
+    uint64_t one = 1;
+    TEMP_FAILURE_RETRY(write(mEventFd, &one, sizeof(one)));
+}
+
+void* LogReaderService::workerStart(void* me) {
+    prctl(PR_SET_NAME, "logd.reader.per");
+    static_cast<LogReaderService*>(me)->workerLoop();
+    return nullptr;
+}
+
+void LogReaderService::workerLoop() {
+    LogTimeEntry::wrlock();
+    for (;;) {
+        while (mRunQueue.empty()) {
+            pthread_cond_wait(&mRunnable, &LogTimeEntry::timesLock);
+        }
+        LogTimeEntry* entry = mRunQueue.front();
+        mRunQueue.pop_front();
+
+        entry->mState = LogTimeEntry::STATE_RUNNING;
+        entry->mTriggered = false;
+        if (entry->flush_Locked()) {
+            entry->finish_Locked();
+            continue;
+        }
+
+        if (entry->mBlocked) {
+            park_Locked(entry);
+        } else if (entry->mTriggered) {
+            enqueue_Locked(entry);
+        } else {
+            entry->mState = LogTimeEntry::STATE_IDLE;
+            if (entry->hasTimeout_Locked()) {
+                wakePoller();
+            }
+        }
+    }
+}
+
+void* LogReaderService::pollerStart(void* me) {
+    prctl(PR_SET_NAME, "logd.reader.poll");
+    static_cast<LogReaderService*>(me)->pollerLoop();
+    return nullptr;
+}
+
+// Milliseconds until the earliest idle reader times out, -1 if none.
+int LogReaderService::pollTimeout_Locked() {
+    log_time now(CLOCK_REALTIME);
+    int timeout = -1;
+
+    for (const auto& entry : mTimes) {
+        if ((entry->mState != LogTimeEntry::STATE_IDLE) ||
+            !entry->hasTimeout_Locked()) {
+            continue;
+        }
+        log_time deadline(entry->mTimeout);
+        if (deadline <= now) {
+            return 0;
+        }
+        uint64_t ms = ((deadline - now).nsec() + NS_PER_SEC / 1000 - 1) /
+                      (NS_PER_SEC / 1000);
+        if (ms > INT_MAX) ms = INT_MAX;
+        if ((timeout < 0) || (static_cast<int>(ms) < timeout)) {
+            timeout = ms;
+        }
+    }
+    return timeout;
+}
+
+void LogReaderService::pollerLoop() {
+    struct epoll_event events[16];
+
+    LogTimeEntry::wrlock();
+    for (;;) {
+        int timeout = pollTimeout_Locked();
+        LogTimeEntry::unlock();
+
+        int n = epoll_wait(mEpollFd, events, arraysize(events), timeout);
+
+        LogTimeEntry::wrlock();
+
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.u64 == wakeupId) {
+                uint64_t count;
+                TEMP_FAILURE_RETRY(read(mEventFd, &count, sizeof(count)));
+                continue;
+            }
+            auto it = mParked.find(events[i].data.u64);
+            if (it == mParked.end()) {
+                continue;
+            }
+            LogTimeEntry* entry = it->second;
+            unpark_Locked(entry);
+            enqueue_Locked(entry);
+        }
+
+        log_time now(CLOCK_REALTIME);
+        for (const auto& entry : mTimes) {
+            if ((entry->mState == LogTimeEntry::STATE_IDLE) &&
+                entry->hasTimeout_Locked() &&
+                (log_time(entry->mTimeout) <= now)) {
+                entry->mTimeout.tv_sec = 0;
+                entry->mTimeout.tv_nsec = 0;
+                enqueue_Locked(entry.get());
+            }
+        }
+    }
+}
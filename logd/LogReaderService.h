@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <deque>
+#include <unordered_map>
+
+#include "LogTimes.h"
+
+// Serves every connected reader from a small fixed pool of threads instead of
+// one thread per LogTimeEntry. Runnable entries are queued and each worker
+// flushes one entry at a time. A reader whose socket fills up is parked on an
+// epoll set until it can take more data, rather than tying up a worker. The
+// poller thread also looks after reader timeouts.
+//
+// Everything here is protected by LogTimeEntry::wrlock().
+class LogReaderService {
+    static constexpr size_t numWorkers = 4;
+
+    LastLogTimes& mTimes;
+    bool mPollerStarted;
+    size_t mWorkers;
+    std::deque<LogTimeEntry*> mRunQueue;
+    pthread_cond_t mRunnable;
+    // parked entries by LogTimeEntry::mId, so that late epoll events for
+    // entries that have gone away are harmless
+    std::unordered_map<uint64_t, LogTimeEntry*> mParked;
+    int mEpollFd;
+    int mEventFd;
+
+    bool start_Locked();
+    static void* workerStart(void* me);
+    static void* pollerStart(void* me);
+    void workerLoop();
+    void pollerLoop();
+    int pollTimeout_Locked();
+    void wakePoller();
+    void park_Locked(LogTimeEntry* entry);
+    void unpark_Locked(LogTimeEntry* entry);
+    void enqueue_Locked(LogTimeEntry* entry);
+
+   public:
+    explicit LogReaderService(LastLogTimes& times);
+    LogReaderService(const LogReaderService&) = delete;
+    LogReaderService& operator=(const LogReaderService&) = delete;
+
+    // Start serving a new entry, false if the service could not be started.
+    bool add_Locked(LogTimeEntry* entry);
+    // The entry has new data to flush, or is being released.
+    void trigger_Locked(LogTimeEntry* entry);
+};
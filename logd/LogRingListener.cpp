@@ -0,0 +1,333 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <android-base/macros.h>
+#include <private/android_logger.h>
+
+#include "LogBuffer.h"
+#include "LogReader.h"
+#include "LogRingListener.h"
+#include "LogUtils.h"
+
+// epoll data is the ring id shifted left, the low bit tells the liveness pipe
+// from the doorbell
+static constexpr uint64_t aliveBit = 1;
+
+LogRingListener::LogRingListener(LogBuffer* buf, LogReader* reader)
+    : mLogBuffer(buf),
+      mReader(reader),
+      mNextId(1),
+      mEpollFd(-1),
+      mBuffer(new char[LogBuffer::maxBatch * LOGGER_ENTRY_MAX_PAYLOAD]) {
+    pthread_mutex_init(&mLock, nullptr);
+}
+
+bool LogRingListener::startListener() {
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (mEpollFd < 0) {
+        return false;
+    }
+
+    pthread_t thread;
+    pthread_attr_t attr;
+
+    if (!pthread_attr_init(&attr)) {
+        if (!pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) {
+            if (!pthread_create(&thread, &attr, LogRingListener::threadStart,
+                                this)) {
+                pthread_attr_destroy(&attr);
+                return true;
+            }
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    close(mEpollFd);
+    mEpollFd = -1;
+    return false;
+}
+
+bool LogRingListener::add(const struct ucred* cred, int memFd, int doorbell,
+                          int alive) {
+    void* map = MAP_FAILED;
+    size_t mapSize = 0;
+    struct stat st;
+
+    // Without these seals the client could shrink the memfd under us and
+    // turn every access into a SIGBUS.
+    int seals = fcntl(memFd, F_GET_SEALS);
+    if ((mEpollFd < 0) || (seals < 0) ||
+        ((seals & (F_SEAL_SHRINK | F_SEAL_GROW)) !=
+         (F_SEAL_SHRINK | F_SEAL_GROW)) ||
+        fstat(memFd, &st) || (st.st_size <= (off_t)sizeof(log_ring_header_t))) {
+        goto refuse;
+    }
+    mapSize = st.st_size;
+    {
+        size_t size = mapSize - sizeof(log_ring_header_t);
+        if ((size < LOG_RING_MIN_SIZE) || (size > LOG_RING_MAX_SIZE) ||
+            (size & (size - 1))) {
+            goto refuse;
+        }
+    }
+    // The doorbell is only ever drained, never waited on with read().
+    if (fcntl(doorbell, F_SETFL, O_NONBLOCK)) {
+        goto refuse;
+    }
+
+    map = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, memFd, 0);
+    close(memFd);
+    memFd = -1;
+    if (map == MAP_FAILED) {
+        goto refuse;
+    }
+
+    {
+        log_ring_header_t* header = static_cast<log_ring_header_t*>(map);
+        uint32_t size = mapSize - sizeof(log_ring_header_t);
+        if ((header->magic != LOG_RING_MAGIC) ||
+            (header->version != LOG_RING_VERSION) || (header->size != size)) {
+            goto refuse;
+        }
+
+        pthread_mutex_lock(&mLock);
+        bool duplicate = false;
+        for (const auto& it : mRings) {
+            if (it.second->mPid == cred->pid) {
+                duplicate = true;
+                break;
+            }
+        }
+        if (duplicate || (mRings.size() >= maxRings)) {
+            pthread_mutex_unlock(&mLock);
+            goto refuse;
+        }
+
+        Ring* ring = new Ring;
+        ring->mId = mNextId++;
+        ring->mUid = cred->uid;
+        ring->mPid = cred->pid;
+        ring->mPrivileged =
+            clientHasLogCredentials(cred->uid, cred->gid, cred->pid);
+        ring->mDead = false;
+        ring->mHeader = header;
+        ring->mMapSize = mapSize;
+        ring->mSize = size;
+        ring->mTail = header->tail.load(std::memory_order_relaxed);
+        ring->mDoorbell = doorbell;
+        ring->mAlive = alive;
+
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = ring->mId << 1;
+        struct epoll_event hangup = {};
+        hangup.events = EPOLLRDHUP;
+        hangup.data.u64 = (ring->mId << 1) | aliveBit;
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, doorbell, &event)) {
+            pthread_mutex_unlock(&mLock);
+            delete ring;
+            goto refuse;
+        }
+        if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, alive, &hangup)) {
+            epoll_ctl(mEpollFd, EPOLL_CTL_DEL, doorbell, nullptr);
+            pthread_mutex_unlock(&mLock);
+            delete ring;
+            goto refuse;
+        }
+        mRings[ring->mId] = ring;
+        header->sleeping.store(0, std::memory_order_relaxed);
+        header->ready.store(1, std::memory_order_release);
+        pthread_mutex_unlock(&mLock);
+    }
+    return true;
+
+refuse:
+    android::prdebug("logd.ring: refused ring from pid %d", cred->pid);
+    if (map != MAP_FAILED) {
+        munmap(map, mapSize);
+    }
+    if (memFd >= 0) {
+        close(memFd);
+    }
+    close(doorbell);
+    close(alive);
+    return false;
+}
+
+void LogRingListener::remove_Locked(Ring* ring) {
+    epoll_ctl(mEpollFd, EPOLL_CTL_DEL, ring->mDoorbell, nullptr);
+    epoll_ctl(mEpollFd, EPOLL_CTL_DEL, ring->mAlive, nullptr);
+    close(ring->mDoorbell);
+    close(ring->mAlive);
+    munmap(ring->mHeader, ring->mMapSize);
+    mRings.erase(ring->mId);
+    delete ring;
+}
+
+void* LogRingListener::threadStart(void* me) {
+    prctl(PR_SET_NAME, "logd.ring");
+    static_cast<LogRingListener*>(me)->threadLoop();
+    return nullptr;
+}
+
+void LogRingListener::threadLoop() {
+    struct epoll_event events[16];
+
+    for (;;) {
+        // Pairs with the client: either it sees us sleeping and rings the
+        // doorbell, or we see what it published before going to sleep.
+        bool pending = false;
+        pthread_mutex_lock(&mLock);
+        for (const auto& it : mRings) {
+            Ring* ring = it.second;
+            ring->mHeader->sleeping.store(1, std::memory_order_seq_cst);
+            if (ring->mHeader->head.load(std::memory_order_seq_cst) !=
+                ring->mTail) {
+                pending = true;
+            }
+        }
+        pthread_mutex_unlock(&mLock);
+
+        int n = epoll_wait(mEpollFd, events, arraysize(events),
+                           pending ? 0 : -1);
+
+        pthread_mutex_lock(&mLock);
+        for (int i = 0; i < n; ++i) {
+            auto it = mRings.find(events[i].data.u64 >> 1);
+            if (it == mRings.end()) {
+                continue;
+            }
+            if (events[i].data.u64 & aliveBit) {
+                it->second->mDead = true;
+            } else {
+                uint64_t count;
+                TEMP_FAILURE_RETRY(
+                    read(it->second->mDoorbell, &count, sizeof(count)));
+            }
+        }
+
+        for (auto it = mRings.begin(); it != mRings.end();) {
+            Ring* ring = it->second;
+            ++it;
+            ring->mHeader->sleeping.store(0, std::memory_order_relaxed);
+            drain_Locked(ring);
+            if (ring->mDead) {
+                remove_Locked(ring);
+            }
+        }
+        pthread_mutex_unlock(&mLock);
+    }
+}
+
+// Nothing read from the ring is trusted: every record is bounds checked and
+// its payload copied out before LogBuffer gets to parse it.
+void LogRingListener::drain_Locked(Ring* ring) {
+    LogBufferInput inputs[LogBuffer::maxBatch];
+    const unsigned char* data = ring->mHeader->data;
+    const uint32_t mask = ring->mSize - 1;
+
+    for (;;) {
+        uint32_t head = ring->mHeader->head.load(std::memory_order_acquire);
+        if ((head - ring->mTail) > ring->mSize) {
+            android::prdebug("logd.ring: corrupt ring from pid %d",
+                             ring->mPid);
+            ring->mDead = true;
+            return;
+        }
+
+        char* buffer = mBuffer.get();
+        size_t count = 0;
+        while ((count < LogBuffer::maxBatch) && (ring->mTail != head)) {
+            uint32_t avail = head - ring->mTail;
+            uint32_t offset = ring->mTail & mask;
+            uint32_t room = ring->mSize - offset;
+
+            log_ring_record_t record;
+            if (room >= sizeof(record)) {
+                memcpy(&record, data + offset, sizeof(record));
+            }
+            if ((room < sizeof(record)) || (record.id == LOG_RING_PAD_ID)) {
+                if (room > avail) {
+                    ring->mDead = true;
+                    break;
+                }
+                ring->mTail += room;
+                continue;
+            }
+
+            uint32_t recordSize = log_ring_record_size(record.len);
+            if ((record.len > LOGGER_ENTRY_MAX_PAYLOAD) ||
+                (recordSize > room) || (recordSize > avail)) {
+                ring->mDead = true;
+                break;
+            }
+            ring->mTail += recordSize;
+
+            log_id_t logId = static_cast<log_id_t>(record.id);
+            if ((logId >= LOG_ID_MAX) || (logId == LOG_ID_KERNEL)) {
+                continue;
+            }
+            if ((logId == LOG_ID_SECURITY) &&
+                (!ring->mPrivileged || !__android_log_security())) {
+                continue;
+            }
+
+            memcpy(buffer, data + offset + sizeof(record), record.len);
+            inputs[count] = {logId,       log_time(record.tv_sec, record.tv_nsec),
+                             ring->mUid,  ring->mPid,
+                             static_cast<pid_t>(record.tid),
+                             buffer,      record.len,
+                             0};
+            buffer += record.len;
+            ++count;
+        }
+
+        // Everything is copied out, hand the space back to the client.
+        ring->mHeader->tail.store(ring->mTail, std::memory_order_release);
+
+        if (count) {
+            mLogBuffer->log(inputs, count);
+
+            log_mask_t logMask = 0;
+            for (size_t i = 0; i < count; ++i) {
+                if (inputs[i].result > 0) {
+                    logMask |= static_cast<log_mask_t>(1 << inputs[i].log_id);
+                }
+            }
+            if (logMask) {
+                mReader->notifyNewLog(logMask);
+            }
+        }
+
+        if (ring->mDead) {
+            android::prdebug("logd.ring: corrupt ring from pid %d",
+                             ring->mPid);
+            return;
+        }
+        if (ring->mTail == head) {
+            return;
+        }
+    }
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include <memory>
+#include <unordered_map>
+
+#include <private/android_log_ring.h>
+
+class LogBuffer;
+class LogReader;
+
+// Drains the shared memory rings that clients register through logdw, see
+// private/android_log_ring.h. A single thread waits on every ring's doorbell
+// and hands what it finds to LogBuffer in batches. Rings are dropped when the
+// client goes away, or as soon as one is found to be corrupt.
+class LogRingListener {
+    static constexpr size_t maxRings = 32;
+
+    struct Ring {
+        uint64_t mId;
+        uid_t mUid;
+        pid_t mPid;
+        bool mPrivileged;
+        bool mDead;
+        log_ring_header_t* mHeader;
+        size_t mMapSize;
+        // our own copies, the client can scribble over the shared ones
+        uint32_t mSize;
+        uint32_t mTail;
+        int mDoorbell;
+        int mAlive;
+    };
+
+    LogBuffer* mLogBuffer;
+    LogReader* mReader;
+    // protects mRings, add() runs on the logdw listener thread
+    pthread_mutex_t mLock;
+    std::unordered_map<uint64_t, Ring*> mRings;
+    uint64_t mNextId;
+    int mEpollFd;
+    // payloads of one batch, copied out of the ring before they are parsed
+    std::unique_ptr<char[]> mBuffer;
+
+    static void* threadStart(void* me);
+    void threadLoop();
+    void drain_Locked(Ring* ring);
+    void remove_Locked(Ring* ring);
+
+   public:
+    LogRingListener(LogBuffer* buf, LogReader* reader);
+    LogRingListener(const LogRingListener&) = delete;
+    LogRingListener& operator=(const LogRingListener&) = delete;
+
+    bool startListener();
+
+    // Takes ownership of the descriptors, they are closed if the ring is
+    // refused. Returns false if it was refused.
+    bool add(const struct ucred* cred, int memFd, int doorbell, int alive);
+};
@@ -34,7 +34,12 @@ static const uint64_t monthSec = 31 * 24 * hourSec;
 
 size_t LogStatistics::SizesTotal;
 
-LogStatistics::LogStatistics() : enable(false) {
+LogStatistics::LogStatistics()
+    : enable(false),
+      // estimate the std::list overhead.
+      mEntryOverhead(((sizeof(LogBufferElement) + sizeof(uint64_t) - 1) &
+                      -sizeof(uint64_t)) +
+                     sizeof(std::list<LogBufferElement*>)) {
     log_time now(CLOCK_REALTIME);
     log_id_for_each(id) {
         mSizes[id] = 0;
@@ -79,7 +84,7 @@ char* pidToName(pid_t pid) {
 }
 }
 
-void LogStatistics::addTotal(LogBufferElement* element) {
+void LogStatistics::addTotal(const LogStatisticsElement* element) {
     if (element->getDropped()) return;
 
     log_id_t log_id = element->getLogId();
@@ -89,7 +94,7 @@ void LogStatistics::addTotal(LogBufferElement* element) {
     ++mElementsTotal[log_id];
 }
 
-void LogStatistics::add(LogBufferElement* element) {
+void LogStatistics::add(const LogStatisticsElement* element) {
     log_id_t log_id = element->getLogId();
     uint16_t size = element->getMsgLen();
     mSizes[log_id] += size;
@@ -159,7 +164,7 @@ void LogStatistics::add(LogBufferElement* element) {
     }
 }
 
-void LogStatistics::subtract(LogBufferElement* element) {
+void LogStatistics::subtract(const LogStatisticsElement* element) {
     log_id_t log_id = element->getLogId();
     uint16_t size = element->getMsgLen();
     mSizes[log_id] -= size;
@@ -204,7 +209,7 @@ void LogStatistics::subtract(LogBufferElement* element) {
 
 // Atomically set an entry to drop
 // entry->setDropped(1) must follow this call, caller should do this explicitly.
-void LogStatistics::drop(LogBufferElement* element) {
+void LogStatistics::drop(const LogStatisticsElement* element) {
     log_id_t log_id = element->getLogId();
     uint16_t size = element->getMsgLen();
     mSizes[log_id] -= size;
@@ -753,12 +758,7 @@ std::string LogStatistics::format(uid_t uid, pid_t pid,
         if (els) {
             oldLength = output.length();
             if (spaces < 0) spaces = 0;
-            // estimate the std::list overhead.
-            static const size_t overhead =
-                ((sizeof(LogBufferElement) + sizeof(uint64_t) - 1) &
-                 -sizeof(uint64_t)) +
-                sizeof(std::list<LogBufferElement*>);
-            size_t szs = sizes(id) + els * overhead;
+            size_t szs = sizes(id) + els * mEntryOverhead;
             totalSize += szs;
             output += android::base::StringPrintf("%*s%zu", spaces, "", szs);
             spaces -= output.length() - oldLength;
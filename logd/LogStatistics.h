@@ -42,6 +42,81 @@
 #define log_id_for_each(i) \
     for (log_id_t i = LOG_ID_MIN; (i) < LOG_ID_MAX; (i) = (log_id_t)((i) + 1))
 
+// A flattened, non-owning view of a log entry, so that statistics can be
+// collected no matter how the buffer stores the entry itself.
+class LogStatisticsElement {
+    uid_t mUid;
+    pid_t mPid;
+    pid_t mTid;
+    uint32_t mTag;
+    log_time mRealTime;
+    const char* mMsg;
+    uint16_t mMsgLen;
+    uint16_t mDroppedCount;
+    log_id_t mLogId;
+
+   public:
+    explicit LogStatisticsElement(const LogBufferElement* element)
+        : mUid(element->getUid()),
+          mPid(element->getPid()),
+          mTid(element->getTid()),
+          mTag(element->getTag()),
+          mRealTime(element->getRealTime()),
+          mMsg(element->getMsg()),
+          mMsgLen(element->getMsgLen()),
+          mDroppedCount(element->getDropped()),
+          mLogId(element->getLogId()) {
+    }
+    LogStatisticsElement(log_id_t log_id, log_time realtime, uid_t uid,
+                         pid_t pid, pid_t tid, const char* msg, uint16_t len)
+        : mUid(uid),
+          mPid(pid),
+          mTid(tid),
+          mTag(0),
+          mRealTime(realtime),
+          mMsg(msg),
+          mMsgLen(len),
+          mDroppedCount(0),
+          mLogId(log_id) {
+        // Binary buffers carry the tag in the message header.
+        if (isBinary() && msg && (len >= sizeof(android_event_header_t))) {
+            mTag = reinterpret_cast<const android_event_header_t*>(msg)->tag;
+        }
+    }
+
+    bool isBinary(void) const {
+        return (mLogId == LOG_ID_EVENTS) || (mLogId == LOG_ID_SECURITY);
+    }
+
+    log_id_t getLogId() const {
+        return mLogId;
+    }
+    uid_t getUid(void) const {
+        return mUid;
+    }
+    pid_t getPid(void) const {
+        return mPid;
+    }
+    pid_t getTid(void) const {
+        return mTid;
+    }
+    uint32_t getTag() const {
+        return mTag;
+    }
+    uint16_t getDropped(void) const {
+        return mDroppedCount;
+    }
+    uint16_t getMsgLen() const {
+        return mMsgLen;
+    }
+    const char* getMsg() const {
+        return mMsg;
+    }
+    log_time getRealTime(void) const {
+        return mRealTime;
+    }
+};
+
 class LogStatistics;
 
 template <typename TKey, typename TEntry>
@@ -117,7 +192,7 @@ class LogHashtable {
         return sorted;
     }
 
-    inline iterator add(const TKey& key, const LogBufferElement* element) {
+    inline iterator add(const TKey& key, const LogStatisticsElement* element) {
         iterator it = map.find(key);
         if (it == map.end()) {
             it = map.insert(std::make_pair(key, TEntry(element))).first;
@@ -137,21 +212,21 @@ class LogHashtable {
         return it;
     }
 
-    void subtract(TKey&& key, const LogBufferElement* element) {
+    void subtract(TKey&& key, const LogStatisticsElement* element) {
         iterator it = map.find(std::move(key));
         if ((it != map.end()) && it->second.subtract(element)) {
             map.erase(it);
         }
     }
 
-    void subtract(const TKey& key, const LogBufferElement* element) {
+    void subtract(const TKey& key, const LogStatisticsElement* element) {
         iterator it = map.find(key);
         if ((it != map.end()) && it->second.subtract(element)) {
             map.erase(it);
         }
     }
 
-    inline void drop(TKey key, const LogBufferElement* element) {
+    inline void drop(TKey key, const LogStatisticsElement* element) {
         iterator it = map.find(key);
         if (it != map.end()) {
             it->second.drop(element);
@@ -211,7 +286,7 @@ struct EntryBase {
 
     EntryBase() : size(0) {
     }
-    explicit EntryBase(const LogBufferElement* element)
+    explicit EntryBase(const LogStatisticsElement* element)
         : size(element->getMsgLen()) {
     }
 
@@ -219,10 +294,10 @@ struct EntryBase {
         return size;
     }
 
-    inline void add(const LogBufferElement* element) {
+    inline void add(const LogStatisticsElement* element) {
         size += element->getMsgLen();
     }
-    inline bool subtract(const LogBufferElement* element) {
+    inline bool subtract(const LogStatisticsElement* element) {
         size -= element->getMsgLen();
         return !size;
     }
@@ -253,7 +328,7 @@ struct EntryBaseDropped : public EntryBase {
 
     EntryBaseDropped() : dropped(0) {
     }
-    explicit EntryBaseDropped(const LogBufferElement* element)
+    explicit EntryBaseDropped(const LogStatisticsElement* element)
         : EntryBase(element), dropped(element->getDropped()) {
     }
 
@@ -261,15 +336,15 @@ struct EntryBaseDropped : public EntryBase {
         return dropped;
     }
 
-    inline void add(const LogBufferElement* element) {
+    inline void add(const LogStatisticsElement* element) {
         dropped += element->getDropped();
         EntryBase::add(element);
     }
-    inline bool subtract(const LogBufferElement* element) {
+    inline bool subtract(const LogStatisticsElement* element) {
         dropped -= element->getDropped();
         return EntryBase::subtract(element) && !dropped;
     }
-    inline void drop(const LogBufferElement* element) {
+    inline void drop(const LogStatisticsElement* element) {
         dropped += 1;
         EntryBase::subtract(element);
     }
@@ -279,7 +354,7 @@ struct UidEntry : public EntryBaseDropped {
     const uid_t uid;
     pid_t pid;
 
-    explicit UidEntry(const LogBufferElement* element)
+    explicit UidEntry(const LogStatisticsElement* element)
         : EntryBaseDropped(element),
           uid(element->getUid()),
           pid(element->getPid()) {
@@ -295,7 +370,7 @@ struct UidEntry : public EntryBaseDropped {
         return pid;
     }
 
-    inline void add(const LogBufferElement* element) {
+    inline void add(const LogStatisticsElement* element) {
         if (pid != element->getPid()) {
             pid = -1;
         }
@@ -321,7 +396,7 @@ struct PidEntry : public EntryBaseDropped {
           uid(android::pidToUid(pid)),
           name(android::pidToName(pid)) {
     }
-    explicit PidEntry(const LogBufferElement* element)
+    explicit PidEntry(const LogStatisticsElement* element)
         : EntryBaseDropped(element),
           pid(element->getPid()),
           uid(element->getUid()),
@@ -360,7 +435,7 @@ struct PidEntry : public EntryBaseDropped {
         }
     }
 
-    inline void add(const LogBufferElement* element) {
+    inline void add(const LogStatisticsElement* element) {
         uid_t incomingUid = element->getUid();
         if (getUid() != incomingUid) {
             uid = incomingUid;
@@ -389,7 +464,7 @@ struct TidEntry : public EntryBaseDropped {
           uid(android::pidToUid(tid)),
           name(android::tidToName(tid)) {
     }
-    explicit TidEntry(const LogBufferElement* element)
+    explicit TidEntry(const LogStatisticsElement* element)
         : EntryBaseDropped(element),
           tid(element->getTid()),
           pid(element->getPid()),
@@ -433,7 +508,7 @@ struct TidEntry : public EntryBaseDropped {
         }
     }
 
-    inline void add(const LogBufferElement* element) {
+    inline void add(const LogStatisticsElement* element) {
         uid_t incomingUid = element->getUid();
         pid_t incomingPid = element->getPid();
         if ((getUid() != incomingUid) || (getPid() != incomingPid)) {
@@ -456,7 +531,7 @@ struct TagEntry : public EntryBaseDropped {
     pid_t pid;
     uid_t uid;
 
-    explicit TagEntry(const LogBufferElement* element)
+    explicit TagEntry(const LogStatisticsElement* element)
         : EntryBaseDropped(element),
           tag(element->getTag()),
           pid(element->getPid()),
@@ -476,7 +551,7 @@ struct TagEntry : public EntryBaseDropped {
         return android::tagToName(tag);
     }
 
-    inline void add(const LogBufferElement* element) {
+    inline void add(const LogStatisticsElement* element) {
         if (uid != element->getUid()) {
             uid = -1;
         }
@@ -494,7 +569,7 @@ struct TagNameKey {
     std::string* alloc;
     std::string_view name;  // Saves space if const char*
 
-    explicit TagNameKey(const LogBufferElement* element)
+    explicit TagNameKey(const LogStatisticsElement* element)
         : alloc(nullptr), name("", strlen("")) {
         if (element->isBinary()) {
             uint32_t tag = element->getTag();
@@ -583,7 +658,7 @@ struct TagNameEntry : public EntryBase {
     uid_t uid;
     TagNameKey name;
 
-    explicit TagNameEntry(const LogBufferElement* element)
+    explicit TagNameEntry(const LogStatisticsElement* element)
         : EntryBase(element),
           tid(element->getTid()),
           pid(element->getPid()),
@@ -610,7 +685,7 @@ struct TagNameEntry : public EntryBase {
         return name.getAllocLength();
     }
 
-    inline void add(const LogBufferElement* element) {
+    inline void add(const LogStatisticsElement* element) {
         if (uid != element->getUid()) {
             uid = -1;
         }
@@ -676,6 +751,8 @@ class LogStatistics {
     log_time mNewestDropped[LOG_ID_MAX];
     static size_t SizesTotal;
     bool enable;
+    // estimated per entry storage cost on top of the message itself
+    size_t mEntryOverhead;
 
     // uid to size list
     typedef LogHashtable<uid_t, UidEntry> uidTable_t;
@@ -704,6 +781,7 @@ class LogStatistics {
     typedef LogHashtable<TagNameKey, TagNameEntry> tagNameTable_t;
     tagNameTable_t tagNameTable;
 
+   public:
     size_t sizeOf() const {
         size_t size = sizeof(*this) + pidTable.sizeOf() + tidTable.sizeOf() +
                       tagTable.sizeOf() + securityTagTable.sizeOf() +
@@ -729,18 +807,42 @@ class LogStatistics {
         return size;
     }
 
-   public:
     LogStatistics();
+    // A copy is a snapshot that can be formatted without holding the lock of
+    // the original.
+    LogStatistics(const LogStatistics&) = default;
+    LogStatistics& operator=(const LogStatistics&) = delete;
 
     void enableStatistics() {
         enable = true;
     }
 
-    void addTotal(LogBufferElement* entry);
-    void add(LogBufferElement* entry);
-    void subtract(LogBufferElement* entry);
+    void setEntryOverhead(size_t overhead) {
+        mEntryOverhead = overhead;
+    }
+
+    void addTotal(const LogStatisticsElement* entry);
+    void add(const LogStatisticsElement* entry);
+    void subtract(const LogStatisticsElement* entry);
     // entry->setDropped(1) must follow this call
-    void drop(LogBufferElement* entry);
+    void drop(const LogStatisticsElement* entry);
+
+    void addTotal(LogBufferElement* entry) {
+        LogStatisticsElement element(entry);
+        addTotal(&element);
+    }
+    void add(LogBufferElement* entry) {
+        LogStatisticsElement element(entry);
+        add(&element);
+    }
+    void subtract(LogBufferElement* entry) {
+        LogStatisticsElement element(entry);
+        subtract(&element);
+    }
+    void drop(LogBufferElement* entry) {
+        LogStatisticsElement element(entry);
+        drop(&element);
+    }
     // Correct for coalescing two entries referencing dropped content
     void erase(LogBufferElement* element) {
         log_id_t log_id = element->getLogId();
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ctype.h>
+#include <string.h>
+
+#include "LogStatistics.h"
+#include "LogTagFilter.h"
+#include "LogUtils.h"
+
+// Same as filterCharToPri() in liblog/logprint.cpp
+static android_LogPriority filterCharToPri(char c) {
+    c = tolower(c);
+
+    if ((c >= '0') && (c <= '9')) {
+        if (c >= ('0' + ANDROID_LOG_SILENT)) {
+            return ANDROID_LOG_VERBOSE;
+        }
+        return static_cast<android_LogPriority>(c - '0');
+    }
+    switch (c) {
+        case 'v':
+            return ANDROID_LOG_VERBOSE;
+        case 'd':
+            return ANDROID_LOG_DEBUG;
+        case 'i':
+            return ANDROID_LOG_INFO;
+        case 'w':
+            return ANDROID_LOG_WARN;
+        case 'e':
+            return ANDROID_LOG_ERROR;
+        case 'f':
+            return ANDROID_LOG_FATAL;
+        case 's':
+            return ANDROID_LOG_SILENT;
+        case '*':
+            return ANDROID_LOG_DEFAULT;
+    }
+    return ANDROID_LOG_UNKNOWN;
+}
+
+// Later rules win, as they do in android_log_addFilterRule().
+bool LogTagFilter::compile(const char* spec, size_t len) {
+    std::string_view rest(spec, len);
+
+    while (!rest.empty()) {
+        size_t end = rest.find_first_of(" \t,");
+        std::string_view rule = rest.substr(0, end);
+        rest = (end == std::string_view::npos) ? std::string_view()
+                                               : rest.substr(end + 1);
+        if (rule.empty()) {
+            continue;
+        }
+
+        android_LogPriority pri = ANDROID_LOG_DEFAULT;
+        size_t colon = rule.find(':');
+        std::string_view tag = rule.substr(0, colon);
+        if (tag.empty()) {
+            goto error;
+        }
+        if (colon != std::string_view::npos) {
+            pri = (colon + 1 < rule.size()) ? filterCharToPri(rule[colon + 1])
+                                            : ANDROID_LOG_UNKNOWN;
+            if (pri == ANDROID_LOG_UNKNOWN) {
+                goto error;
+            }
+        }
+
+        if (tag == "*") {
+            mGlobal = (pri == ANDROID_LOG_DEFAULT) ? ANDROID_LOG_DEBUG : pri;
+            continue;
+        }
+        if (pri == ANDROID_LOG_DEFAULT) {
+            pri = ANDROID_LOG_VERBOSE;
+        }
+        auto it = mTags.find(tag);
+        if (it != mTags.end()) {
+            it->second = pri;
+        } else {
+            mNames.emplace_back(tag);
+            mTags.emplace(mNames.back(), pri);
+        }
+    }
+    return true;
+
+error:
+    mGlobal = ANDROID_LOG_VERBOSE;
+    mTags.clear();
+    mNames.clear();
+    return false;
+}
+
+android_LogPriority LogTagFilter::priority(std::string_view tag) const {
+    auto it = mTags.find(tag);
+    return (it == mTags.end()) ? mGlobal : it->second;
+}
+
+bool LogTagFilter::matches_Locked(const LogStatisticsElement* element) {
+    if (mTags.empty() && (mGlobal <= ANDROID_LOG_VERBOSE)) {
+        return true;
+    }
+
+    const char* msg = element->getMsg();
+    uint16_t len = element->getMsgLen();
+    if (element->getDropped() || !msg) {
+        return true;
+    }
+
+    switch (element->getLogId()) {
+        case LOG_ID_EVENTS:
+        case LOG_ID_SECURITY: {
+            // logcat prints binary entries at INFO, under their tag name.
+            uint32_t tag = element->getTag();
+            auto it = mEvents.find(tag);
+            if (it == mEvents.end()) {
+                const char* name = android::tagToName(tag);
+                bool match = !name || (ANDROID_LOG_INFO >= priority(name));
+                it = mEvents.emplace(tag, match).first;
+            }
+            return it->second;
+        }
+        case LOG_ID_STATS:
+            return true;
+        default:
+            break;
+    }
+
+    // <priority:1><tag:N>\0<message:N>\0
+    if (len < 2) {
+        return true;
+    }
+    android_LogPriority pri = static_cast<android_LogPriority>(msg[0]);
+    size_t tagLen = strnlen(msg + 1, len - 1);
+    return pri >= priority(std::string_view(msg + 1, tagLen));
+}
@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#include <list>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <android/log.h>
+
+class LogStatisticsElement;
+
+// A reader's tag:priority filter, in the android_log_addFilterString() syntax
+// logcat takes on its command line, compiled into hashed lookups so flushTo()
+// can drop what the reader would filter out anyway before it is serialized.
+// It only ever errs on the side of sending: entries it can not attribute to a
+// tag are let through for the client to decide.
+class LogTagFilter {
+    android_LogPriority mGlobal;
+    // owns the keys of mTags
+    std::list<std::string> mNames;
+    std::unordered_map<std::string_view, android_LogPriority> mTags;
+    // binary tag numbers resolved so far, tagToName() takes a lock
+    std::unordered_map<uint32_t, bool> mEvents;
+
+    android_LogPriority priority(std::string_view tag) const;
+
+   public:
+    LogTagFilter() : mGlobal(ANDROID_LOG_VERBOSE) {
+    }
+
+    // Returns false, and leaves the filter passing everything, if spec does
+    // not parse.
+    bool compile(const char* spec, size_t len);
+
+    // Caller holds LogTimeEntry::timesLock.
+    bool matches_Locked(const LogStatisticsElement* element);
+};
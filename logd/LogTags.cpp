@@ -174,6 +174,8 @@ void LogTags::AddEventLogTags(uint32_t tag, uid_t uid, const std::string& Name,
         // updatePersist -> trigger output on modified
         // content, reset tag2total if available
         if (update && (itot != tag2total.end())) tag2total[tag] = 0;
+
+        publish_locked(tag);
     }
 
     if (update) {
@@ -348,7 +350,106 @@ void LogTags::ReadPersistEventLogTags() {
     android_logger_list_free(logger_list);
 }
 
-LogTags::LogTags() {
+LogTags::TagTable* LogTags::newTagTable(size_t size) {
+    TagTable* table = new TagTable;
+    table->mask = size - 1;
+    table->used = 0;
+    table->slots.reset(new TagSlot[size]);
+    for (size_t i = 0; i < size; ++i) {
+        table->slots[i].tag.store(emptyTag, std::memory_order_relaxed);
+        table->slots[i].name.store(nullptr, std::memory_order_relaxed);
+        table->slots[i].format.store(nullptr, std::memory_order_relaxed);
+        table->slots[i].dynamic.store(false, std::memory_order_relaxed);
+    }
+    return table;
+}
+
+static inline size_t hashTag(uint32_t tag) {
+    return (tag * UINT64_C(0x9E3779B97F4A7C15)) >> 32;
+}
+
+// Bounded by the table size, never waits on a writer.
+const LogTags::TagSlot* LogTags::findSlot(uint32_t tag) const {
+    const TagTable* table = tagTable.load(std::memory_order_acquire);
+    size_t i = hashTag(tag);
+    for (size_t n = 0; n <= table->mask; ++n, ++i) {
+        const TagSlot& slot = table->slots[i & table->mask];
+        uint32_t found = slot.tag.load(std::memory_order_acquire);
+        if (found == tag) return &slot;
+        if (found == emptyTag) break;
+    }
+    return nullptr;
+}
+
+const char* LogTags::intern_locked(const std::string& string) {
+    return internPool.emplace(string).first->c_str();
+}
+
+// Caller holds the writer lock, after changing any of tag2name, tag2format
+// or the set of tags in tag2total for tag.
+void LogTags::publish_locked(uint32_t tag) {
+    if (tag == emptyTag) return;
+
+    tag2name_const_iterator iname = tag2name.find(tag);
+    const char* name = ((iname != tag2name.end()) && iname->second.length())
+                           ? intern_locked(iname->second)
+                           : nullptr;
+    tag2format_const_iterator iform = tag2format.find(tag);
+    const char* format =
+        (iform != tag2format.end()) ? intern_locked(iform->second) : nullptr;
+    bool dynamic = tag2total.find(tag) != tag2total.end();
+
+    TagTable* table = tagTable.load(std::memory_order_relaxed);
+    TagSlot* slot = const_cast<TagSlot*>(findSlot(tag));
+    if (slot) {
+        slot->name.store(name, std::memory_order_release);
+        slot->format.store(format, std::memory_order_release);
+        slot->dynamic.store(dynamic, std::memory_order_release);
+        return;
+    }
+
+    // Keep it at most half full, so misses stay short.
+    if ((table->used + 1) * 2 > (table->mask + 1)) {
+        TagTable* bigger = newTagTable((table->mask + 1) * 2);
+        for (size_t i = 0; i <= table->mask; ++i) {
+            const TagSlot& from = table->slots[i];
+            uint32_t t = from.tag.load(std::memory_order_relaxed);
+            if (t == emptyTag) continue;
+            size_t j = hashTag(t);
+            while (bigger->slots[j & bigger->mask].tag.load(
+                       std::memory_order_relaxed) != emptyTag) {
+                ++j;
+            }
+            TagSlot& to = bigger->slots[j & bigger->mask];
+            to.name.store(from.name.load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+            to.format.store(from.format.load(std::memory_order_relaxed),
+                            std::memory_order_relaxed);
+            to.dynamic.store(from.dynamic.load(std::memory_order_relaxed),
+                             std::memory_order_relaxed);
+            to.tag.store(t, std::memory_order_relaxed);
+            ++bigger->used;
+        }
+        tagTable.store(bigger, std::memory_order_release);
+        retiredTables.emplace_back(table);
+        table = bigger;
+    }
+
+    size_t i = hashTag(tag);
+    while (table->slots[i & table->mask].tag.load(std::memory_order_relaxed) !=
+           emptyTag) {
+        ++i;
+    }
+    slot = &table->slots[i & table->mask];
+    slot->name.store(name, std::memory_order_relaxed);
+    slot->format.store(format, std::memory_order_relaxed);
+    slot->dynamic.store(dynamic, std::memory_order_relaxed);
+    // Readers only look past the tag once they see it.
+    slot->tag.store(tag, std::memory_order_release);
+    ++table->used;
+}
+
+LogTags::LogTags() : tagTable(newTagTable(1024)) {
     ReadFileEventLogTags(system_event_log_tags);
     // Following will likely fail on boot, but is required if logd restarts
     ReadFileEventLogTags(dynamic_event_log_tags, false);
@@ -360,16 +461,20 @@ LogTags::LogTags() {
     logtags = this;
 }
 
+LogTags::~LogTags() {
+    if (logtags == this) logtags = nullptr;
+    delete tagTable.load(std::memory_order_relaxed);
+}
+
 // Converts an event tag into a name
 const char* LogTags::tagToName(uint32_t tag) const {
-    tag2name_const_iterator it;
-
-    android::RWLock::AutoRLock readLock(const_cast<android::RWLock&>(rwlock));
-
-    it = tag2name.find(tag);
-    if ((it == tag2name.end()) || (it->second.length() == 0)) return nullptr;
+    const TagSlot* slot = findSlot(tag);
+    return slot ? slot->name.load(std::memory_order_acquire) : nullptr;
+}
 
-    return it->second.c_str();
+bool LogTags::isDynamic(uint32_t tag) const {
+    const TagSlot* slot = findSlot(tag);
+    return slot && slot->dynamic.load(std::memory_order_acquire);
 }
 
 // Prototype in LogUtils.h allowing external access to our database.
@@ -387,7 +492,8 @@ const char* android::tagToName(uint32_t tag) {
     LogTags* me = logtags;
 
     if (!me) return nullptr;
-    me->WritePmsgEventLogTags(tag);
+    // Only runtime entries are recorded to pmsg, skip its lock for the rest.
+    if (me->isDynamic(tag)) me->WritePmsgEventLogTags(tag);
     return me->tagToName(tag);
 }
 
@@ -410,14 +516,8 @@ void android::ReReadEventLogTags() {
 
 // converts an event tag into a format
 const char* LogTags::tagToFormat(uint32_t tag) const {
-    tag2format_const_iterator iform;
-
-    android::RWLock::AutoRLock readLock(const_cast<android::RWLock&>(rwlock));
-
-    iform = tag2format.find(tag);
-    if (iform == tag2format.end()) return nullptr;
-
-    return iform->second.c_str();
+    const TagSlot* slot = findSlot(tag);
+    return slot ? slot->format.load(std::memory_order_acquire) : nullptr;
 }
 
 // converts a name into an event tag
@@ -688,6 +788,7 @@ void LogTags::WritePersistEventLogTags(uint32_t tag, uid_t uid,
     // record totals for next watermark.
     android::RWLock::AutoWLock writeLock(rwlock);
     tag2total[tag] = lastTotal;
+    publish_locked(tag);
 }
 
 // nameToTag converts a name into an event tag. If format is NULL, then we
@@ -798,6 +899,8 @@ uint32_t LogTags::nameToTag(uid_t uid, const char* name, const char* format) {
             tag2uid[Tag].emplace(uid);
             uid2count[uid] = count + 1;
         }
+
+        publish_locked(Tag);
     }
 
     if (updateTag || updateFormat || updateWrite) {
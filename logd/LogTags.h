@@ -17,9 +17,12 @@
 #ifndef _LOGD_LOG_TAGS_H__
 #define _LOGD_LOG_TAGS_H__
 
+#include <atomic>
+#include <memory>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
+#include <vector>
 
 #include <utils/RWLock.h>
 
@@ -53,6 +56,32 @@ class LogTags {
     typedef std::unordered_map<uint32_t, std::string>::const_iterator
         tag2format_const_iterator;
 
+    // Wait-free reverse lookups for tagToName() and tagToFormat(), kept in
+    // step with the maps above by publish_locked(). Slots are only ever
+    // filled in or have their strings swapped, never emptied, and the strings
+    // come from internPool which never frees, so a reader can use whatever it
+    // loads. A table that fills up is replaced by one twice the size; the old
+    // one stays in retiredTables as readers may still be probing it.
+    struct TagSlot {
+        std::atomic<uint32_t> tag;
+        std::atomic<const char*> name;
+        std::atomic<const char*> format;
+        std::atomic<bool> dynamic;
+    };
+    struct TagTable {
+        size_t mask;
+        size_t used;
+        std::unique_ptr<TagSlot[]> slots;
+    };
+    std::atomic<TagTable*> tagTable;
+    std::vector<std::unique_ptr<TagTable>> retiredTables;
+    std::unordered_set<std::string> internPool;
+
+    static TagTable* newTagTable(size_t size);
+    const TagSlot* findSlot(uint32_t tag) const;
+    const char* intern_locked(const std::string& string);
+    void publish_locked(uint32_t tag);
+
     static const size_t max_per_uid = 256;  // Put a cap on the tags per uid
     std::unordered_map<uid_t, size_t> uid2count;
     typedef std::unordered_map<uid_t, size_t>::const_iterator
@@ -105,6 +134,9 @@ class LogTags {
     static const char debug_event_log_tags[];
 
     LogTags();
+    LogTags(const LogTags&) = delete;
+    LogTags& operator=(const LogTags&) = delete;
+    ~LogTags();
 
     void WritePmsgEventLogTags(uint32_t tag, uid_t uid = AID_ROOT);
     void ReadFileEventLogTags(const char* filename, bool warn = true);
@@ -112,6 +144,8 @@ class LogTags {
     // reverse lookup from tag
     const char* tagToName(uint32_t tag) const;
     const char* tagToFormat(uint32_t tag) const;
+    // runtime registered, rather than from the system file
+    bool isDynamic(uint32_t tag) const;
     std::string formatEntry(uint32_t tag, uid_t uid);
     // find associated tag
     uint32_t nameToTag(const char* name) const;
@@ -15,28 +15,44 @@
  */
 
 #include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
 #include <string.h>
-#include <sys/prctl.h>
 
+#include <algorithm>
+
+#include <android-base/stringprintf.h>
 #include <private/android_logger.h>
 
 #include "FlushCommand.h"
 #include "LogBuffer.h"
 #include "LogReader.h"
+#include "LogReaderService.h"
 #include "LogTimes.h"
+#include "LogUtils.h"
 
 pthread_mutex_t LogTimeEntry::timesLock = PTHREAD_MUTEX_INITIALIZER;
+uint64_t LogTimeEntry::nextId = 0;
 
 LogTimeEntry::LogTimeEntry(LogReader& reader, SocketClient* client,
                            bool nonBlock, unsigned long tail, log_mask_t logMask,
-                           pid_t pid, log_time start, uint64_t timeout)
-    : leadingDropped(false),
+                           pid_t pid, log_time start, uint64_t timeout,
+                           const char* filter, size_t filterLen)
+    : leadingDropped(true),
       mReader(reader),
       mLogMask(logMask),
       mPid(pid),
       mCount(0),
       mTail(tail),
       mIndex(0),
+      mId(++nextId),
+      mState(STATE_IDLE),
+      mTriggered(false),
+      mBlocked(false),
+      mSent(0),
+      mPrivileged(FlushCommand::hasReadLogs(client)),
+      mSecurity(FlushCommand::hasSecurityLogs(client)),
+      mFlushStart(start),
       mClient(client),
       mStart(start),
       mNonBlock(nonBlock),
@@ -44,87 +60,85 @@ LogTimeEntry::LogTimeEntry(LogReader& reader, SocketClient* client,
     mTimeout.tv_sec = timeout / NS_PER_SEC;
     mTimeout.tv_nsec = timeout % NS_PER_SEC;
     memset(mLastTid, 0, sizeof(mLastTid));
-    pthread_cond_init(&threadTriggeredCondition, nullptr);
+    memset(mSequence, 0, sizeof(mSequence));
     cleanSkip_Locked();
+    if (filter && !mFilter.compile(filter, filterLen)) {
+        android::prdebug("logdr: ignoring bad filter from pid %d",
+                         client->getPid());
+    }
 }
 
 bool LogTimeEntry::startReader_Locked() {
-    pthread_attr_t attr;
-
-    if (!pthread_attr_init(&attr)) {
-        if (!pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) {
-            if (!pthread_create(&mThread, &attr, LogTimeEntry::threadStart,
-                                this)) {
-                pthread_attr_destroy(&attr);
-                return true;
-            }
-        }
-        pthread_attr_destroy(&attr);
-    }
-
-    return false;
+    return mReader.service().add_Locked(this);
 }
 
-void* LogTimeEntry::threadStart(void* obj) {
-    prctl(PR_SET_NAME, "logd.reader.per");
+void LogTimeEntry::triggerReader_Locked(void) {
+    mReader.service().trigger_Locked(this);
+}
 
-    LogTimeEntry* me = reinterpret_cast<LogTimeEntry*>(obj);
+std::string LogTimeEntry::formatMetrics_Locked() const {
+    std::string name = android::base::StringPrintf("reader.%" PRIu64, mId);
+    return android::base::StringPrintf("%s.pid %d\n%s.uid %u\n%s.mask 0x%x\n",
+                                       name.c_str(), mClient->getPid(),
+                                       name.c_str(), mClient->getUid(),
+                                       name.c_str(), mLogMask) +
+           mFlushLatency.format(name + ".flush");
+}
 
-    SocketClient* client = me->mClient;
+// Called by a LogReaderService worker, drops the lock around the flushes.
+// Returns true once this reader is done.
+bool LogTimeEntry::flush_Locked() {
+    if (mRelease) {
+        return true;
+    }
 
-    LogBuffer& logbuf = me->mReader.logbuf();
+    LogBuffer& logbuf = mReader.logbuf();
+    log_time start = mFlushStart;
+    mBlocked = false;
+    mSent = 0;
 
-    bool privileged = FlushCommand::hasReadLogs(client);
-    bool security = FlushCommand::hasSecurityLogs(client);
+    unlock();
 
-    me->leadingDropped = true;
+    log_time flushStart(CLOCK_MONOTONIC);
+    if (mTail) {
+        uint64_t sequence[LOG_ID_MAX];
+        memcpy(sequence, mSequence, sizeof(sequence));
+        logbuf.flushTo(mClient, start, nullptr, mPrivileged, mSecurity,
+                       FilterFirstPass, this, sequence, mLogMask);
+        leadingDropped = true;
+    }
+    start = logbuf.flushTo(mClient, start, mLastTid, mPrivileged, mSecurity,
+                           FilterSecondPass, this, mSequence, mLogMask);
+    mFlushLatency.recordSince(flushStart);
 
     wrlock();
 
-    log_time start = me->mStart;
-
-    while (!me->mRelease) {
-        if (me->mTimeout.tv_sec || me->mTimeout.tv_nsec) {
-            if (pthread_cond_timedwait(&me->threadTriggeredCondition,
-                                       &timesLock, &me->mTimeout) == ETIMEDOUT) {
-                me->mTimeout.tv_sec = 0;
-                me->mTimeout.tv_nsec = 0;
-            }
-            if (me->mRelease) {
-                break;
-            }
-        }
-
-        unlock();
-
-        if (me->mTail) {
-            logbuf.flushTo(client, start, nullptr, privileged, security,
-                           FilterFirstPass, me);
-            me->leadingDropped = true;
-        }
-        start = logbuf.flushTo(client, start, me->mLastTid, privileged,
-                               security, FilterSecondPass, me);
-
-        wrlock();
-
-        if (start == LogBufferElement::FLUSH_ERROR) {
-            break;
-        }
-
-        me->mStart = start + log_time(0, 1);
-
-        if (me->mNonBlock || me->mRelease) {
-            break;
-        }
+    if (start == LogBufferElement::FLUSH_ERROR) {
+        return true;
+    }
 
-        me->cleanSkip_Locked();
+    mFlushStart = start;
+    mStart = start + log_time(0, 1);
 
-        if (!me->mTimeout.tv_sec && !me->mTimeout.tv_nsec) {
-            pthread_cond_wait(&me->threadTriggeredCondition, &timesLock);
-        }
+    if (mRelease) {
+        return true;
+    }
+    if (mBlocked) {
+        // Resumed once the socket drains, skips requested meanwhile apply.
+        return false;
     }
+    if (mNonBlock) {
+        return true;
+    }
+
+    cleanSkip_Locked();
+    return false;
+}
 
-    LogReader& reader = me->mReader;
+// Called by a LogReaderService worker, deletes this.
+void LogTimeEntry::finish_Locked() {
+    LogReader& reader = mReader;
+    SocketClient* client = mClient;
     reader.release(client);
 
     client->decRef();
@@ -132,19 +146,21 @@ void* LogTimeEntry::threadStart(void* obj) {
     LastLogTimes& times = reader.logbuf().mTimes;
     auto it =
         std::find_if(times.begin(), times.end(),
-                     [&me](const auto& other) { return other.get() == me; });
+                     [this](const auto& other) { return other.get() == this; });
 
     if (it != times.end()) {
         times.erase(it);
     }
+}
 
-    unlock();
-
-    return nullptr;
+bool LogTimeEntry::isWritable() const {
+    struct pollfd p = { mClient->getSocket(), POLLOUT, 0 };
+    // Errors and hangups are left for the next write to report.
+    return TEMP_FAILURE_RETRY(poll(&p, 1, 0)) != 0;
 }
 
 // A first pass to count the number of elements
-int LogTimeEntry::FilterFirstPass(const LogBufferElement* element, void* obj) {
+int LogTimeEntry::FilterFirstPass(const LogStatisticsElement* element, void* obj) {
     LogTimeEntry* me = reinterpret_cast<LogTimeEntry*>(obj);
 
     LogTimeEntry::wrlock();
@@ -162,7 +178,8 @@ int LogTimeEntry::FilterFirstPass(const LogBufferElement* element, void* obj) {
     }
 
     if ((!me->mPid || (me->mPid == element->getPid())) &&
-        (me->isWatching(element->getLogId()))) {
+        (me->isWatching(element->getLogId())) &&
+        me->mFilter.matches_Locked(element)) {
         ++me->mCount;
     }
 
@@ -172,7 +189,7 @@ int LogTimeEntry::FilterFirstPass(const LogBufferElement* element, void* obj) {
 }
 
 // A second pass to send the selected elements
-int LogTimeEntry::FilterSecondPass(const LogBufferElement* element, void* obj) {
+int LogTimeEntry::FilterSecondPass(const LogStatisticsElement* element, void* obj) {
     LogTimeEntry* me = reinterpret_cast<LogTimeEntry*>(obj);
 
     LogTimeEntry::wrlock();
@@ -204,6 +221,10 @@ int LogTimeEntry::FilterSecondPass(const LogBufferElement* element, void* obj) {
         goto skip;
     }
 
+    if (!me->mFilter.matches_Locked(element)) {
+        goto skip;
+    }
+
     if (me->mRelease) {
         goto stop;
     }
@@ -224,6 +245,13 @@ int LogTimeEntry::FilterSecondPass(const LogBufferElement* element, void* obj) {
 
 ok:
     if (!me->skipAhead[element->getLogId()]) {
+        // Streaming readers that can not keep up get parked by their
+        // LogReaderService instead of blocking a worker in the socket write.
+        if (!me->mTail && !(me->mSent++ % writableCheckInterval) &&
+            !me->isWritable()) {
+            me->mBlocked = true;
+            goto stop;
+        }
         LogTimeEntry::unlock();
         return true;
     }
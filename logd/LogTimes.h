@@ -24,38 +24,72 @@
 
 #include <list>
 #include <memory>
+#include <string>
 
 #include <log/log.h>
 #include <sysutils/SocketClient.h>
 
+#include "LogLatency.h"
+#include "LogTagFilter.h"
+
 typedef unsigned int log_mask_t;
 
 class LogReader;
-class LogBufferElement;
+class LogStatisticsElement;
 
 class LogTimeEntry {
+    friend class LogReaderService;
+
     static pthread_mutex_t timesLock;
+    static uint64_t nextId;
     bool mRelease = false;
     bool leadingDropped;
-    pthread_cond_t threadTriggeredCondition;
-    pthread_t mThread;
     LogReader& mReader;
-    static void* threadStart(void* me);
     const log_mask_t mLogMask;
     const pid_t mPid;
+    LogTagFilter mFilter;
     unsigned int skipAhead[LOG_ID_MAX];
     pid_t mLastTid[LOG_ID_MAX];
     unsigned long mCount;
     unsigned long mTail;
     unsigned long mIndex;
 
+    // LogReaderService scheduling state
+    enum State { STATE_IDLE, STATE_QUEUED, STATE_RUNNING, STATE_PARKED };
+    const uint64_t mId;
+    State mState;
+    // new data arrived, or we are released, while queued or running
+    bool mTriggered;
+    // the last flush stopped because the socket was full
+    bool mBlocked;
+    // entries sent in this flush, the socket is polled every so many
+    static constexpr unsigned int writableCheckInterval = 16;
+    unsigned int mSent;
+    const bool mPrivileged;
+    const bool mSecurity;
+    // where the next flush resumes
+    log_time mFlushStart;
+    // time spent in the flushTo() calls of each flush
+    LogLatency mFlushLatency;
+
+    bool flush_Locked();
+    void finish_Locked();
+    bool isWritable() const;
+    bool hasTimeout_Locked() const {
+        return mTimeout.tv_sec || mTimeout.tv_nsec;
+    }
+
    public:
     LogTimeEntry(LogReader& reader, SocketClient* client, bool nonBlock,
                  unsigned long tail, log_mask_t logMask, pid_t pid,
-                 log_time start, uint64_t timeout);
+                 log_time start, uint64_t timeout, const char* filter = nullptr,
+                 size_t filterLen = 0);
 
     SocketClient* mClient;
     log_time mStart;
+    // flushTo() cursors for the chunked store, one per log id, 0 until the
+    // first flush
+    uint64_t mSequence[LOG_ID_MAX];
     struct timespec mTimeout;
     const bool mNonBlock;
     const log_time mEnd;  // only relevant if mNonBlock
@@ -73,9 +107,10 @@ class LogTimeEntry {
 
     bool startReader_Locked();
 
-    void triggerReader_Locked(void) {
-        pthread_cond_signal(&threadTriggeredCondition);
-    }
+    // "reader.<id>.*" lines for LogBuffer::formatMetrics()
+    std::string formatMetrics_Locked() const;
+
+    void triggerReader_Locked(void);
 
     void triggerSkip_Locked(log_id_t id, unsigned int skip) {
         skipAhead[id] = skip;
@@ -86,7 +121,7 @@ class LogTimeEntry {
         // gracefully shut down the socket.
         shutdown(mClient->getSocket(), SHUT_RDWR);
         mRelease = true;
-        pthread_cond_signal(&threadTriggeredCondition);
+        triggerReader_Locked();
     }
 
     bool isWatching(log_id_t id) const {
@@ -96,8 +131,8 @@ class LogTimeEntry {
         return mLogMask & logMask;
     }
     // flushTo filter callbacks
-    static int FilterFirstPass(const LogBufferElement* element, void* me);
-    static int FilterSecondPass(const LogBufferElement* element, void* me);
+    static int FilterFirstPass(const LogStatisticsElement* element, void* me);
+    static int FilterSecondPass(const LogStatisticsElement* element, void* me);
 };
 
 typedef std::list<std::unique_ptr<LogTimeEntry>> LastLogTimes;
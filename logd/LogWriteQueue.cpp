@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+
+#include <new>
+
+#include "LogBuffer.h"
+#include "LogReader.h"
+#include "LogWriteQueue.h"
+
+LogWriteQueue::Queue::Queue() : mHead(&mStub), mTail(&mStub) {
+    mStub.mNext.store(nullptr, std::memory_order_relaxed);
+}
+
+void LogWriteQueue::Queue::push(Node* node) {
+    node->mNext.store(nullptr, std::memory_order_relaxed);
+    Node* prev = mHead.exchange(node, std::memory_order_acq_rel);
+    prev->mNext.store(node, std::memory_order_release);
+}
+
+// Returns nullptr if empty, or if a producer is half way through push().
+LogWriteQueue::Node* LogWriteQueue::Queue::pop() {
+    Node* tail = mTail;
+    Node* next = tail->mNext.load(std::memory_order_acquire);
+    if (tail == &mStub) {
+        if (!next) return nullptr;
+        mTail = next;
+        tail = next;
+        next = next->mNext.load(std::memory_order_acquire);
+    }
+    if (next) {
+        mTail = next;
+        return tail;
+    }
+    if (tail != mHead.load(std::memory_order_acquire)) return nullptr;
+    push(&mStub);
+    next = tail->mNext.load(std::memory_order_acquire);
+    if (next) {
+        mTail = next;
+        return tail;
+    }
+    return nullptr;
+}
+
+LogWriteQueue::LogWriteQueue(LogBuffer* buf, LogReader* reader)
+    : mLogBuffer(buf),
+      mReader(reader),
+      mTicket(0),
+      mPending(0),
+      mSleeping(false) {
+    sem_init(&mWakeup, 0, 0);
+}
+
+bool LogWriteQueue::startMerger() {
+    pthread_attr_t attr;
+
+    if (!pthread_attr_init(&attr)) {
+        if (!pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED)) {
+            if (!pthread_create(&mThread, &attr, LogWriteQueue::threadStart,
+                                this)) {
+                pthread_attr_destroy(&attr);
+                return true;
+            }
+        }
+        pthread_attr_destroy(&attr);
+    }
+
+    return false;
+}
+
+bool LogWriteQueue::push(log_id_t log_id, log_time realtime, uid_t uid,
+                         pid_t pid, pid_t tid, const char* msg, uint16_t len) {
+    if ((log_id >= LOG_ID_MAX) ||
+        (mPending.load(std::memory_order_relaxed) >= maxPending)) {
+        return false;
+    }
+
+    void* where = malloc(sizeof(Node) + len);
+    if (!where) {
+        return false;
+    }
+    Node* node = new (where) Node;
+    node->mRealTime = realtime;
+    node->mUid = uid;
+    node->mPid = pid;
+    node->mTid = tid;
+    node->mMsgLen = len;
+    memcpy(node->getMsg(), msg, len);
+
+    node->mTicket = mTicket.fetch_add(1, std::memory_order_relaxed);
+    mQueues[log_id].push(node);
+
+    // Pairs with threadLoop(): either it sees the message before going to
+    // sleep, or we see it sleeping and wake it up.
+    mPending.fetch_add(1, std::memory_order_seq_cst);
+    if (mSleeping.exchange(false, std::memory_order_seq_cst)) {
+        sem_post(&mWakeup);
+    }
+    return true;
+}
+
+void* LogWriteQueue::threadStart(void* me) {
+    prctl(PR_SET_NAME, "logd.ingest");
+    static_cast<LogWriteQueue*>(me)->threadLoop();
+    return nullptr;
+}
+
+void LogWriteQueue::threadLoop() {
+    for (;;) {
+        mSleeping.store(true, std::memory_order_seq_cst);
+        if (mPending.load(std::memory_order_seq_cst) <= 0) {
+            sem_wait(&mWakeup);
+        }
+        mSleeping.store(false, std::memory_order_relaxed);
+        drain();
+    }
+}
+
+// Takes what is in the queues right now and merges it by ticket, so messages
+// enter LogBuffer in the same order they were pushed.
+void LogWriteQueue::drain() {
+    Node* heads[LOG_ID_MAX];
+    Node* tails[LOG_ID_MAX];
+    log_id_for_each(i) {
+        heads[i] = nullptr;
+        tails[i] = nullptr;
+        for (size_t n = 0; n < LogBuffer::maxBatch; ++n) {
+            Node* node = mQueues[i].pop();
+            if (!node) break;
+            // Reuse mNext for our private list, the queue is done with it.
+            node->mNext.store(nullptr, std::memory_order_relaxed);
+            if (tails[i]) {
+                tails[i]->mNext.store(node, std::memory_order_relaxed);
+            } else {
+                heads[i] = node;
+            }
+            tails[i] = node;
+        }
+    }
+
+    LogBufferInput inputs[LogBuffer::maxBatch];
+    Node* nodes[LogBuffer::maxBatch];
+    for (;;) {
+        size_t count = 0;
+        while (count < LogBuffer::maxBatch) {
+            log_id_t oldest = LOG_ID_MAX;
+            log_id_for_each(i) {
+                if (heads[i] && ((oldest == LOG_ID_MAX) ||
+                                 (heads[i]->mTicket < heads[oldest]->mTicket))) {
+                    oldest = i;
+                }
+            }
+            if (oldest == LOG_ID_MAX) break;
+
+            Node* node = heads[oldest];
+            heads[oldest] = node->mNext.load(std::memory_order_relaxed);
+            nodes[count] = node;
+            inputs[count] = {oldest,       node->mRealTime, node->mUid,
+                             node->mPid,   node->mTid,      node->getMsg(),
+                             node->mMsgLen, 0};
+            ++count;
+        }
+        if (!count) break;
+
+        mLogBuffer->log(inputs, count);
+        mPending.fetch_sub(count, std::memory_order_relaxed);
+
+        log_mask_t mask = 0;
+        for (size_t i = 0; i < count; ++i) {
+            if (inputs[i].result > 0) {
+                mask |= static_cast<log_mask_t>(1 << inputs[i].log_id);
+            }
+            nodes[i]->~Node();
+            free(nodes[i]);
+        }
+        if (mask) {
+            mReader->notifyNewLog(mask);
+        }
+    }
+}
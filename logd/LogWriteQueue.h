@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+
+#include <log/log.h>
+
+class LogBuffer;
+class LogReader;
+
+// Decouples the writers from LogBuffer. Producers push messages onto lock-free
+// per log id queues and return without touching the LogBuffer lock, a single
+// merge thread drains the queues in arrival order and hands them to LogBuffer
+// in batches, taking its lock and notifying the readers once per batch.
+class LogWriteQueue {
+    struct Node {
+        std::atomic<Node*> mNext;
+        uint64_t mTicket;
+        log_time mRealTime;
+        uid_t mUid;
+        pid_t mPid;
+        pid_t mTid;
+        uint16_t mMsgLen;
+
+        // the message payload is allocated right after the node
+        char* getMsg() {
+            return reinterpret_cast<char*>(this + 1);
+        }
+    };
+
+    // Intrusive multiple producer, single consumer queue (Vyukov). Producers
+    // only ever touch mHead, the merge thread owns mTail.
+    struct Queue {
+        std::atomic<Node*> mHead;
+        Node* mTail;
+        Node mStub;
+
+        Queue();
+        void push(Node* node);
+        Node* pop();
+    };
+
+    // Upper bound of queued messages, past it producers log directly.
+    static constexpr int64_t maxPending = 4096;
+
+    LogBuffer* mLogBuffer;
+    LogReader* mReader;
+    Queue mQueues[LOG_ID_MAX];
+    // orders messages across log ids
+    std::atomic<uint64_t> mTicket;
+    std::atomic<int64_t> mPending;
+    // set while the merge thread is, or is about to be, waiting on mWakeup
+    std::atomic<bool> mSleeping;
+    sem_t mWakeup;
+    pthread_t mThread;
+
+    static void* threadStart(void* me);
+    void threadLoop();
+    void drain();
+
+   public:
+    LogWriteQueue(LogBuffer* buf, LogReader* reader);
+    LogWriteQueue(const LogWriteQueue&) = delete;
+    LogWriteQueue& operator=(const LogWriteQueue&) = delete;
+
+    bool startMerger();
+
+    // Safe to call from any number of threads. Returns false if the message
+    // could not be queued, the caller is then expected to log it directly.
+    bool push(log_id_t log_id, log_time realtime, uid_t uid, pid_t pid,
+              pid_t tid, const char* msg, uint16_t len);
+};
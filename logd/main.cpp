@@ -268,6 +268,12 @@ static void readDmesg(LogAudit* al, LogKlog* kl) {
             rc = kl->log(tok, sublen);
         }
     }
+    if (al) {
+        al->flush();
+    }
+    if (kl) {
+        kl->flush();
+    }
 }
 
 static int issueReinit() {
@@ -377,6 +383,12 @@ int main(int argc, char* argv[]) {
         logBuf->enableStatistics();
     }
 
+    if (__android_logger_property_get_bool("logd.chunked",
+                                           BOOL_DEFAULT_FALSE |
+                                               BOOL_DEFAULT_FLAG_PERSIST)) {
+        logBuf->enableChunkedStore();
+    }
+
     // LogReader listens on /dev/socket/logdr. When a client
     // connects, log entries in the LogBuffer are written to the client.
 
@@ -390,6 +402,16 @@ int main(int argc, char* argv[]) {
     // and LogReader is notified to send updates to connected clients.
 
     LogListener* swl = new LogListener(logBuf, reader);
+    if (__android_logger_property_get_bool("logd.write_queue",
+                                           BOOL_DEFAULT_FALSE |
+                                               BOOL_DEFAULT_FLAG_PERSIST)) {
+        swl->enableWriteQueue();
+    }
+    if (__android_logger_property_get_bool("logd.ring_transport",
+                                           BOOL_DEFAULT_FALSE |
+                                               BOOL_DEFAULT_FLAG_PERSIST)) {
+        swl->enableRings();
+    }
     // Backlog and /proc/sys/net/unix/max_dgram_qlen set to large value
     if (swl->startListener(600)) {
         return EXIT_FAILURE;
@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <benchmark/benchmark.h>
+
+#include "../LogBuffer.h"
+#include "../LogTimes.h"
+
+BENCHMARK_MAIN();
+
+// Because system/core/logd/main.cpp defines these.
+namespace android {
+void prdebug(char const* fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+char* uidToName(uid_t) {
+    return strdup("fake");
+}
+}  // namespace android
+
+// A main buffer log_msg: priority, tag and message.
+static size_t fillMessage(char* msg, size_t size, uint64_t count) {
+    msg[0] = ANDROID_LOG_INFO;
+    int len = snprintf(msg + 1, size - 1, "BM_prune%c chatty message %" PRIu64,
+                       '\0', count);
+    return 1 + len + 1;
+}
+
+/*
+ *	Flood a full main buffer from state.range(0) uids, one of which logs half
+ * of the entries, so every log() has to prune the worst offender out from
+ * between everybody else's entries.
+ */
+static void BM_prune_worst_uid(benchmark::State& state) {
+    const uid_t uids = state.range(0);
+
+    LastLogTimes times;
+    LogBuffer logbuf(&times);
+    logbuf.enableStatistics();
+    logbuf.initPrune(nullptr);
+    logbuf.setSize(LOG_ID_MAIN, 256 * 1024);
+
+    char msg[LOGGER_ENTRY_MAX_PAYLOAD];
+    uint64_t count = 0;
+    auto logOne = [&]() {
+        uid_t uid = (count & 1) ? 10000 : (10001 + (count / 2) % uids);
+        log_time realtime(CLOCK_REALTIME);
+        size_t len = fillMessage(msg, sizeof(msg), count);
+        logbuf.log(LOG_ID_MAIN, realtime, uid, uid, uid, msg, len);
+        ++count;
+    };
+
+    // Fill up the buffer so that we are pruning from the start.
+    while (logbuf.getSizeUsed(LOG_ID_MAIN) < logbuf.getSize(LOG_ID_MAIN)) {
+        logOne();
+    }
+
+    while (state.KeepRunning()) {
+        logOne();
+    }
+}
+BENCHMARK(BM_prune_worst_uid)->Arg(16)->Arg(128)->Arg(512);
@@ -777,6 +777,31 @@ TEST(logd, SNDTIMEO) {
 #endif
 }
 
+TEST(logd, getMetrics) {
+#ifdef __ANDROID__
+    char buffer[16384];
+    memset(buffer, 0, sizeof(buffer));
+    snprintf(buffer, sizeof(buffer), "getMetrics");
+    send_to_control(buffer, sizeof(buffer));
+    buffer[sizeof(buffer) - 1] = '\0';
+    if (!strcmp(buffer, "Permission Denied")) {
+        GTEST_LOG_(INFO) << "This test needs log credentials.\n";
+        return;
+    }
+    char* cp;
+    long ret = strtol(buffer, &cp, 10);
+    EXPECT_GT(ret, 0);
+    EXPECT_TRUE(strstr(buffer, "\nmemory.main.headers ") != nullptr);
+    EXPECT_TRUE(strstr(buffer, "\nmemory.main.payload ") != nullptr);
+    EXPECT_TRUE(strstr(buffer, "\nmemory.statistics ") != nullptr);
+    EXPECT_TRUE(strstr(buffer, "\nmemory.total ") != nullptr);
+    EXPECT_TRUE(strstr(buffer, "\nlatency.log.count ") != nullptr);
+    EXPECT_TRUE(strstr(buffer, "\nlock.writer_hold.count ") != nullptr);
+#else
+    GTEST_LOG_(INFO) << "This test does nothing.\n";
+#endif
+}
+
 TEST(logd, getEventTag_list) {
 #ifdef __ANDROID__
     char buffer[256];
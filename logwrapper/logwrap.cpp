@@ -24,6 +24,7 @@
 #include <string.h>
 #include <sys/socket.h>
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
@@ -55,6 +56,9 @@ static struct sigaction old_hup;
 
 #define MAX_KLOG_TAG 16
 
+/* The largest record written to the kernel log, including the tag and newline. */
+#define MAX_KLOG_LINE 511
+
 /* This is a simple buffer that holds up to the first beginning_buf->buf_size
  * bytes of output from a command.
  */
@@ -93,7 +97,8 @@ struct abbr_buf {
 /* Collect all the various bits of info needed for logging in one place. */
 struct log_info {
     int log_target;
-    char klog_fmt[MAX_KLOG_TAG * 2];
+    char klog_prefix[MAX_KLOG_TAG * 2];
+    size_t klog_prefix_len;
     const char* btag;
     bool abbreviated;
     FILE* fp;
@@ -156,13 +161,21 @@ static void add_line_to_circular_buf(struct ending_buf* e_buf, char* line, ssize
 /* Log directly to the specified log */
 static void do_log_line(struct log_info* log_info, const char* line) {
     if (log_info->log_target & LOG_KLOG) {
-        klog_write(6, log_info->klog_fmt, line);
+        /* Each write is one record, so lines can't be batched, but they needn't be formatted. */
+        size_t max_len = MAX_KLOG_LINE - log_info->klog_prefix_len - 1;
+        struct iovec iov[3] = {
+                {log_info->klog_prefix, log_info->klog_prefix_len},
+                {const_cast<char*>(line), strnlen(line, max_len)},
+                {const_cast<char*>("\n"), 1},
+        };
+        klog_writev(6, iov, arraysize(iov));
     }
     if (log_info->log_target & LOG_ALOG) {
-        ALOG(LOG_INFO, log_info->btag, "%s", line);
+        __android_log_write(ANDROID_LOG_INFO, log_info->btag, line);
     }
     if (log_info->log_target & LOG_FILE) {
-        fprintf(log_info->fp, "%s\n", line);
+        fputs(line, log_info->fp);
+        fputc('\n', log_info->fp);
     }
 }
 
@@ -364,10 +377,15 @@ static int parent(const char* tag, int parent_read, pid_t pid, int* chld_sts, in
     }
 
     if (log_target & LOG_KLOG) {
-        snprintf(log_info.klog_fmt, sizeof(log_info.klog_fmt), "<6>%.*s: %%s\n", MAX_KLOG_TAG,
+        snprintf(log_info.klog_prefix, sizeof(log_info.klog_prefix), "<6>%.*s: ", MAX_KLOG_TAG,
                  log_info.btag);
+        log_info.klog_prefix_len = strlen(log_info.klog_prefix);
     }
 
+    // Output is drained with non-blocking reads until there's none left, rather than going back
+    // to poll() after every read.
+    fcntl(parent_read, F_SETFL, fcntl(parent_read, F_GETFL) | O_NONBLOCK);
+
     if ((log_target & LOG_FILE) && !file_path) {
         /* No file_path specified, clear the LOG_FILE bit */
         log_target &= ~LOG_FILE;
@@ -395,9 +413,13 @@ static int parent(const char* tag, int parent_read, pid_t pid, int* chld_sts, in
             goto err_poll;
         }
 
-        if (poll_fds[0].revents & POLLIN) {
+        while (poll_fds[0].revents & POLLIN) {
             received_messages = true;
             sz = TEMP_FAILURE_RETRY(read(parent_read, &buffer[b], sizeof(buffer) - 1 - b));
+            if (sz <= 0) {
+                // EAGAIN once everything has been read, or EIO once the child is gone.
+                break;
+            }
 
             sz += b;
             // Log one line at a time
@@ -16,6 +16,8 @@
 
 #include "logwrap/logwrap.h"
 
+#include <string>
+
 #include <android-base/logging.h>
 #include <benchmark/benchmark.h>
 
@@ -29,4 +31,17 @@ static void BM_android_fork_execvp_ext(benchmark::State& state) {
 }
 BENCHMARK(BM_android_fork_execvp_ext);
 
+// How quickly the child's output is read, split into lines and written out.
+static void BM_logwrap_lines(benchmark::State& state) {
+    const std::string count = std::to_string(state.range(0));
+    const char* argv[] = {"/system/bin/seq", "1", count.c_str()};
+    const int argc = 3;
+    while (state.KeepRunning()) {
+        int rc = logwrap_fork_execvp(argc, argv, nullptr, false, LOG_FILE, false, "/dev/null");
+        CHECK_EQ(0, rc);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_logwrap_lines)->Arg(1000)->Arg(100000);
+
 BENCHMARK_MAIN();
@@ -23,6 +23,12 @@
 #include <cutils/klog.h>
 #include <log/log.h>
 #include <logwrap/logwrap.h>
+#if !defined(__ANDROID_VNDK__)
+#include <private/android_logger.h>
+#endif
+
+// How long logwrapper lets the child's lines build up before sending them to logd together.
+static constexpr uint32_t kLogBatchDelayUs = 100 * 1000;
 
 void fatal(const char* msg) {
     fprintf(stderr, "%s", msg);
@@ -78,7 +84,18 @@ int main(int argc, char* argv[]) {
         usage();
     }
 
+#if !defined(__ANDROID_VNDK__)
+    if (log_target & LOG_ALOG) {
+        __android_log_set_logd_batching(kLogBatchDelayUs, 0);
+    }
+#endif
+
     rc = logwrap_fork_execvp(argc, &argv[0], &status, true, log_target, abbreviated, nullptr);
+
+#if !defined(__ANDROID_VNDK__)
+    // Flushes whatever is still held back.
+    __android_log_set_logd_batching(0, 0);
+#endif
     if (!rc) {
         if (WIFEXITED(status))
             rc = WEXITSTATUS(status);
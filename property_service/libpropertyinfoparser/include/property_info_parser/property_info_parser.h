@@ -52,8 +52,26 @@ struct TrieNodeInternal {
   // Exact matches are a sorted list of exact matches at this node_; binary search them.
   uint32_t num_exact_matches;
   uint32_t exact_match_entries;
+
+  // Version 2 and later: an 8 byte aligned array of TrieChildKey() for each of the children, in
+  // the same order as child_nodes, so that the search only looks at child names on a key tie.
+  uint32_t child_keys;
 };
 
+// The first version that writes TrieNodeInternal::child_keys.
+static constexpr uint32_t kTrieChildKeysVersion = 2;
+
+// The first 8 bytes of a child's name, big endian and zero padded, such that comparing keys
+// orders names the same way strcmp() does.  Names shorter than 8 bytes have unique keys.
+inline uint64_t TrieChildKey(const char* name, uint32_t namelen) {
+  uint64_t key = 0;
+  for (uint32_t i = 0; i < 8; ++i) {
+    key <<= 8;
+    if (i < namelen) key |= static_cast<unsigned char>(name[i]);
+  }
+  return key;
+}
+
 struct PropertyInfoAreaHeader {
   // The current version of this data as created by property service.
   uint32_t current_version;
@@ -86,6 +104,16 @@ class SerializedData {
     return *reinterpret_cast<const uint32_t*>(data_base_ + offset);
   }
 
+  const uint64_t* uint64_array(uint32_t offset) const {
+    if (offset != 0 && offset > size()) return nullptr;
+    return reinterpret_cast<const uint64_t*>(data_base_ + offset);
+  }
+
+  bool has_child_keys() const {
+    return reinterpret_cast<const PropertyInfoAreaHeader*>(data_base_)->current_version >=
+           kTrieChildKeysVersion;
+  }
+
   const char* data_base() const { return data_base_; }
 
  private:
@@ -113,6 +141,12 @@ class TrieNode {
     return TrieNode(serialized_data_, trie_node_base);
   }
 
+  // Returns nullptr for data written before kTrieChildKeysVersion.
+  const uint64_t* child_keys() const {
+    if (!serialized_data_->has_child_keys()) return nullptr;
+    return serialized_data_->uint64_array(trie_node_base_->child_keys);
+  }
+
   bool FindChildForString(const char* input, uint32_t namelen, TrieNode* child) const;
 
   uint32_t num_prefixes() const { return trie_node_base_->num_prefixes; }
@@ -68,6 +68,36 @@ int PropertyInfoArea::FindTypeIndex(const char* type) const {
 // Binary search the list of children nodes to find a TrieNode for a given property piece.
 // Used to traverse the Trie in GetPropertyInfoIndexes().
 bool TrieNode::FindChildForString(const char* name, uint32_t namelen, TrieNode* child) const {
+  const uint64_t* keys = child_keys();
+  if (keys != nullptr) {
+    // Search the packed keys for the first child that isn't less than name.  This keeps to one
+    // contiguous array and compiles to conditional moves rather than unpredictable branches.
+    uint64_t key = TrieChildKey(name, namelen);
+    uint32_t num_children = trie_node_base_->num_child_nodes;
+    if (num_children == 0) return false;
+    const uint64_t* base = keys;
+    while (num_children > 1) {
+      uint32_t half = num_children / 2;
+      base = base[half] < key ? base + half : base;
+      num_children -= half;
+    }
+    uint32_t index = (base - keys) + (*base < key);
+
+    // Names shorter than 8 bytes have unique keys, so only longer ones need their name compared.
+    for (; index < trie_node_base_->num_child_nodes && keys[index] == key; ++index) {
+      if (namelen < 8) {
+        *child = child_node(index);
+        return true;
+      }
+      const char* child_name = child_node(index).name();
+      if (!strncmp(child_name, name, namelen) && child_name[namelen] == '\0') {
+        *child = child_node(index);
+        return true;
+      }
+    }
+    return false;
+  }
+
   auto node_index = Find(trie_node_base_->num_child_nodes, [this, name, namelen](auto array_offset) {
     const char* child_name = child_node(array_offset).name();
     int cmp = strncmp(child_name, name, namelen);
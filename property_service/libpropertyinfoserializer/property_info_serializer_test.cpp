@@ -39,7 +39,7 @@ TEST(propertyinfoserializer, TrieNodeCheck) {
   auto property_info_area = reinterpret_cast<const PropertyInfoArea*>(serialized_trie.data());
 
   // Initial checks for property area.
-  EXPECT_EQ(1U, property_info_area->current_version());
+  EXPECT_EQ(2U, property_info_area->current_version());
   EXPECT_EQ(1U, property_info_area->minimum_supported_version());
 
   // Check the root node
@@ -889,5 +889,71 @@ TEST(propertyinfoserializer, GetPropertyInfo_empty_context_and_type) {
   EXPECT_STREQ("5th", type);
 }
 
+TEST(propertyinfoserializer, GetPropertyInfo_long_shared_child_names) {
+  // Children whose names share their first 8 bytes have the same key.
+  auto property_info = std::vector<PropertyInfoEntry>{
+      {"vendor.abcdefgh.", "1st", "1st", false},
+      {"vendor.abcdefghi.", "2nd", "2nd", false},
+      {"vendor.abcdefghij.", "3rd", "3rd", false},
+      {"vendor.abcdefghik.", "4th", "4th", false},
+      {"vendor.abc.", "5th", "5th", false},
+      {"vendor.abcdefg.", "6th", "6th", false},
+  };
+
+  auto serialized_trie = std::string();
+  auto build_trie_error = std::string();
+  ASSERT_TRUE(BuildTrie(property_info, "default", "default", &serialized_trie, &build_trie_error))
+      << build_trie_error;
+
+  auto property_info_area = reinterpret_cast<const PropertyInfoArea*>(serialized_trie.data());
+
+  auto expected_contexts = std::vector<std::pair<std::string, std::string>>{
+      {"vendor.abcdefgh.x", "1st"},  {"vendor.abcdefghi.x", "2nd"}, {"vendor.abcdefghij.x", "3rd"},
+      {"vendor.abcdefghik.x", "4th"}, {"vendor.abc.x", "5th"},       {"vendor.abcdefg.x", "6th"},
+      {"vendor.abcdefghil.x", "default"}, {"vendor.abcd.x", "default"},
+      {"vendor.abcdefghijk.x", "default"}, {"vendor.ab.x", "default"},
+  };
+  for (const auto& [property, context] : expected_contexts) {
+    const char* returned_context;
+    property_info_area->GetPropertyInfo(property.c_str(), &returned_context, nullptr);
+    EXPECT_STREQ(context.c_str(), returned_context) << property;
+  }
+}
+
+TEST(propertyinfoserializer, GetPropertyInfo_version_1) {
+  auto property_info = std::vector<PropertyInfoEntry>{
+      {"persist.", "1st", "1st", false},
+      {"persist.radio", "2nd", "2nd", false},
+      {"persist.radio.long.property.exact.match", "3rd", "3rd", true},
+      {"persist.vendor.abcdefghij.", "4th", "4th", false},
+      {"ro.", "5th", "5th", false},
+  };
+
+  auto serialized_trie = std::string();
+  auto build_trie_error = std::string();
+  ASSERT_TRUE(BuildTrie(property_info, "default", "default", &serialized_trie, &build_trie_error))
+      << build_trie_error;
+
+  // Data written before child_keys existed is searched by name instead.
+  auto version_1_trie = serialized_trie;
+  reinterpret_cast<PropertyInfoAreaHeader*>(version_1_trie.data())->current_version = 1;
+
+  auto property_info_area = reinterpret_cast<const PropertyInfoArea*>(serialized_trie.data());
+  auto version_1_area = reinterpret_cast<const PropertyInfoArea*>(version_1_trie.data());
+  ASSERT_NE(nullptr, property_info_area->root_node().child_keys());
+  ASSERT_EQ(nullptr, version_1_area->root_node().child_keys());
+
+  for (const char* property :
+       {"persist.notradio", "persist.radio", "persist.radio.sub", "persist.radiowords",
+        "persist.radio.long.property.exact.match", "persist.vendor.abcdefghij.x",
+        "persist.vendor.abcdefghi.x", "ro.x", "r.x", "other"}) {
+    const char* context;
+    const char* version_1_context;
+    property_info_area->GetPropertyInfo(property, &context, nullptr);
+    version_1_area->GetPropertyInfo(property, &version_1_context, nullptr);
+    EXPECT_STREQ(version_1_context, context) << property;
+  }
+}
+
 }  // namespace properties
 }  // namespace android
@@ -61,6 +61,18 @@ class TrieNodeArena {
     return reinterpret_cast<uint32_t*>(data_.data() + offset);
   }
 
+  // Unlike the other allocations, this is aligned to 8 bytes.
+  uint32_t AllocateUint64Array(int length) {
+    if (current_data_pointer_ % sizeof(uint64_t) != 0) AllocateData(sizeof(uint32_t), nullptr);
+    uint32_t offset;
+    AllocateData(sizeof(uint64_t) * length, &offset);
+    return offset;
+  }
+
+  uint64_t* uint64_array(uint32_t offset) {
+    return reinterpret_cast<uint64_t*>(data_.data() + offset);
+  }
+
   uint32_t AllocateAndWriteString(const std::string& string) {
     uint32_t offset;
     char* data = static_cast<char*>(AllocateData(string.size() + 1, &offset));
@@ -103,6 +103,14 @@ uint32_t TrieSerializer::WriteTrieNode(const TrieBuilderNode& builder_node) {
   uint32_t children_offset_array_offset = arena_->AllocateUint32Array(sorted_children.size());
   trie->child_nodes = children_offset_array_offset;
 
+  // Sorting children by name also sorts their keys.
+  uint32_t child_keys_array_offset = arena_->AllocateUint64Array(sorted_children.size());
+  trie->child_keys = child_keys_array_offset;
+  for (unsigned int i = 0; i < sorted_children.size(); ++i) {
+    const std::string& name = sorted_children[i].name();
+    arena_->uint64_array(child_keys_array_offset)[i] = TrieChildKey(name.c_str(), name.size());
+  }
+
   for (unsigned int i = 0; i < sorted_children.size(); ++i) {
     arena_->uint32_array(children_offset_array_offset)[i] = WriteTrieNode(sorted_children[i]);
   }
@@ -115,7 +123,7 @@ std::string TrieSerializer::SerializeTrie(const TrieBuilder& trie_builder) {
   arena_.reset(new TrieNodeArena());
 
   auto header = arena_->AllocateObject<PropertyInfoAreaHeader>(nullptr);
-  header->current_version = 1;
+  header->current_version = kTrieChildKeysVersion;
   header->minimum_supported_version = 1;
 
   // Store where we're about to write the contexts.
@@ -84,7 +84,9 @@ static bool should_use_sdcardfs(void) {
 
 // NOTE: This is a vestigial program that simply exists to mount the in-kernel
 // sdcardfs filesystem.  The older FUSE-based design that used to live here has
-// been completely removed to avoid confusion.
+// been completely removed to avoid confusion.  Both sdcardfs and esdfs are
+// stacked in the kernel, so once they are mounted no file I/O passes through
+// this process; it exits as soon as the mounts are set up.
 
 /* Supplementary groups to execute with. */
 static const gid_t kGroups[1] = { AID_PACKAGE_INFO };
@@ -63,6 +63,8 @@ using namespace android;
 #define DEFAULT_PERIODIC_CHORES_INTERVAL_UID_IO ( 3600 )
 #define DEFAULT_PERIODIC_CHORES_INTERVAL_UID_IO_LIMIT ( 300 )
 #define DEFAULT_PERIODIC_CHORES_INTERVAL_FLUSH_PROTO ( 3600 )
+// How many interval units storaged may sleep at once while the disk is idle
+#define MAX_IDLE_PAUSE_UNITS ( 8 )
 
 // UID IO threshold in bytes
 #define DEFAULT_PERIODIC_CHORES_UID_IO_THRESHOLD ( 1024 * 1024 * 1024ULL )
@@ -79,6 +81,9 @@ class storaged_t : public android::hardware::health::V2_0::IHealthInfoCallback,
                    public android::hardware::hidl_death_recipient {
   private:
     time_t mTimer;
+    // interval units to sleep before the next event, and how many the idle backoff is at
+    int mPauseUnits;
+    int mIdleUnits;
     storaged_config mConfig;
     unique_ptr<disk_stats_monitor> mDsm;
     uid_monitor mUidm;
@@ -87,10 +92,13 @@ class storaged_t : public android::hardware::health::V2_0::IHealthInfoCallback,
     unique_ptr<storage_info_t> storage_info;
     static const uint32_t current_version;
     unordered_map<userid_t, bool> proto_loaded;
+    // checksum of the contents last written to each user's proto file
+    unordered_map<userid_t, uint32_t> proto_flushed_crc;
     void load_proto(userid_t user_id);
     char* prepare_proto(userid_t user_id, StoragedProto* proto);
     void flush_proto(userid_t user_id, StoragedProto* proto);
-    void flush_proto_data(userid_t user_id, const char* data, ssize_t size);
+    bool flush_proto_data(userid_t user_id, const char* data, ssize_t size);
+    int next_pause_units(bool disk_idle);
     string proto_path(userid_t user_id) {
         return string("/data/misc_ce/") + to_string(user_id) +
                "/storaged/storaged.proto";
@@ -103,7 +111,7 @@ class storaged_t : public android::hardware::health::V2_0::IHealthInfoCallback,
     void event(void);
     void event_checked(void);
     void pause(void) {
-        sleep(mConfig.periodic_chores_interval_unit);
+        sleep(mConfig.periodic_chores_interval_unit * mPauseUnits);
     }
 
     time_t get_starttime(void) {
@@ -149,6 +149,7 @@ private:
     struct disk_stats mAccumulate;      /* reset after stall */
     struct disk_stats mAccumulate_pub;  /* reset after publish */
     bool mStall;
+    bool mIdle;                         /* no I/O since the previous update */
     std::queue<struct disk_perf> mBuffer;
     struct {
         stream_stats read_perf;           // read speed (bytes/s)
@@ -185,6 +186,7 @@ public:
         mAccumulate(),
         mAccumulate_pub(),
         mStall(false),
+        mIdle(false),
         mValid(false),
         mWindow(window_size),
         mSigma(sigma),
@@ -194,6 +196,7 @@ public:
   bool enabled() { return mHealth != nullptr || DISK_STATS_PATH != nullptr; }
   void update(void);
   void publish(void);
+  bool idle() { return mIdle; }
 };
 
 #endif /* _STORAGED_DISKSTATS_H_ */
@@ -76,13 +76,48 @@ struct uid_records {
     vector<uid_record> entries;
 };
 
+// One uid's line from /proc/uid_io/stats, with its tasks in the tasks of the same snapshot.
+struct uid_io_snapshot {
+    uint32_t uid;
+    io_stats io[UID_STATS];
+    uint32_t first_task;
+    uint32_t task_count;
+};
+
+struct task_io_snapshot {
+    pid_t pid;
+    io_stats io[UID_STATS];
+    string comm;
+};
+
+// A parsed /proc/uid_io/stats.  Snapshots are reused from one poll to the next, so that parsing
+// stops allocating once they have grown to the size of the file.
+struct uid_io_snapshots {
+    // sorted by uid
+    vector<uid_io_snapshot> uids;
+    // grouped by uid and sorted by pid; only the first task_count are valid, the rest are kept
+    // for the capacity of their comm strings
+    vector<task_io_snapshot> tasks;
+    size_t task_count = 0;
+
+    // parses the contents of /proc/uid_io/stats, skipping malformed lines
+    void parse(const string& stats);
+};
+
 class uid_monitor {
 private:
     FRIEND_TEST(storaged_test, uid_monitor);
     FRIEND_TEST(storaged_test, load_uid_io_proto);
-
-    // last dump from /proc/uid_io/stats, uid -> uid_info
-    unordered_map<uint32_t, uid_info> last_uid_io_stats_;
+    FRIEND_TEST(storaged_test, uid_io_stats_delta);
+
+    // last dump from /proc/uid_io/stats
+    uid_io_snapshots last_uid_io_stats_;
+    // dump being compared against last_uid_io_stats_, swapped with it afterwards
+    uid_io_snapshots new_uid_io_stats_;
+    // contents of /proc/uid_io/stats, kept for its capacity
+    string uid_io_buffer_;
+    // package names of the uids seen so far, uid -> name
+    unordered_map<uint32_t, string> uid_names_;
     // current io usage for next report, app name -> uid_io_usage
     unordered_map<string, uid_io_usage> curr_io_stats_;
     // io usage records, end timestamp -> {start timestamp, vector of records}
@@ -97,11 +132,15 @@ private:
     const bool enabled_;
 
     // reads from /proc/uid_io/stats
-    unordered_map<uint32_t, uid_info> get_uid_io_stats_locked();
+    bool read_uid_io_stats_locked(uid_io_snapshots* stats);
+    // makes sure that all uids in stats have a name
+    void update_uid_names_locked(const uid_io_snapshots& stats);
     // flushes curr_io_stats to records
     void add_records_locked(uint64_t curr_ts);
     // updates curr_io_stats and set last_uid_io_stats
     void update_curr_io_stats_locked();
+    // adds the I/O since last_uid_io_stats to curr_io_stats, then makes stats the last ones
+    void update_curr_io_stats_locked(uid_io_snapshots* stats);
     // writes io_history to protobuf
     void update_uid_io_proto(unordered_map<int, StoragedProto>* protos);
 
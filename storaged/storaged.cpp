@@ -159,6 +159,8 @@ storaged_t::storaged_t(void) {
 
     mStarttime = time(NULL);
     mTimer = 0;
+    mPauseUnits = 1;
+    mIdleUnits = 1;
 }
 
 void storaged_t::add_user_ce(userid_t user_id) {
@@ -170,6 +172,7 @@ void storaged_t::add_user_ce(userid_t user_id) {
 
 void storaged_t::remove_user_ce(userid_t user_id) {
     proto_loaded[user_id] = false;
+    proto_flushed_crc.erase(user_id);
     mUidm.clear_user_history(user_id);
     RemoveFileIfExists(proto_path(user_id), nullptr);
 }
@@ -234,7 +237,7 @@ char* storaged_t:: prepare_proto(userid_t user_id, StoragedProto* proto) {
     return data;
 }
 
-void storaged_t::flush_proto_data(userid_t user_id,
+bool storaged_t::flush_proto_data(userid_t user_id,
                                   const char* data, ssize_t size) {
     string proto_file = proto_path(user_id);
     string tmp_file = proto_file + "_tmp";
@@ -244,7 +247,7 @@ void storaged_t::flush_proto_data(userid_t user_id,
                  S_IRUSR | S_IWUSR)));
     if (fd == -1) {
         PLOG(ERROR) << "Faied to open tmp file: " << tmp_file;
-        return;
+        return false;
     }
 
     if (user_id == USER_SYSTEM) {
@@ -259,7 +262,7 @@ void storaged_t::flush_proto_data(userid_t user_id,
             ret = write(fd, data, MIN(benchmark_unit_size, size));
             if (ret <= 0) {
                 PLOG(ERROR) << "Faied to write tmp file: " << tmp_file;
-                return;
+                return false;
             }
             end = steady_clock::now();
             /*
@@ -282,19 +285,32 @@ void storaged_t::flush_proto_data(userid_t user_id,
     } else {
         if (!WriteFully(fd, data, size)) {
             PLOG(ERROR) << "Faied to write tmp file: " << tmp_file;
-            return;
+            return false;
         }
     }
 
     fd.reset(-1);
-    rename(tmp_file.c_str(), proto_file.c_str());
+    return rename(tmp_file.c_str(), proto_file.c_str()) == 0;
 }
 
 void storaged_t::flush_proto(userid_t user_id, StoragedProto* proto) {
+    // Rewriting the file when nothing has changed since the last flush would only add writes,
+    // which matters most on devices that sit idle for long periods.
+    string content = proto->uid_io_usage().SerializeAsString();
+    content += proto->perf_history().SerializeAsString();
+    uint32_t content_crc = crc32(current_version, reinterpret_cast<const Bytef*>(content.data()),
+                                 content.size());
+    auto flushed = proto_flushed_crc.find(user_id);
+    if (flushed != proto_flushed_crc.end() && flushed->second == content_crc) {
+        return;
+    }
+
     unique_ptr<char> proto_data(prepare_proto(user_id, proto));
     if (proto_data == nullptr) return;
 
-    flush_proto_data(user_id, proto_data.get(), proto->ByteSize());
+    if (flush_proto_data(user_id, proto_data.get(), proto->ByteSize())) {
+        proto_flushed_crc[user_id] = content_crc;
+    }
 }
 
 void storaged_t::flush_protos(unordered_map<int, StoragedProto>* protos) {
@@ -308,11 +324,32 @@ void storaged_t::flush_protos(unordered_map<int, StoragedProto>* protos) {
     }
 }
 
+int storaged_t::next_pause_units(bool disk_idle) {
+    // Sleep for longer and longer while the disk is idle, so that storaged doesn't wake up the
+    // CPU every interval unit only to find out that nothing happened.  Periodic chores still run
+    // on schedule: the pause ends at the first unit where one of them is due.
+    mIdleUnits = disk_idle ? min(mIdleUnits * 2, MAX_IDLE_PAUSE_UNITS) : 1;
+
+    const time_t unit = mConfig.periodic_chores_interval_unit;
+    int units = 1;
+    for (; units < mIdleUnits; units++) {
+        time_t t = mTimer + units * unit;
+        if (!(t % mConfig.periodic_chores_interval_disk_stats_publish) ||
+            !(t % mConfig.periodic_chores_interval_uid_io) ||
+            !(t % mConfig.periodic_chores_interval_flush_proto)) {
+            break;
+        }
+    }
+    return units;
+}
+
 void storaged_t::event(void) {
     unordered_map<int, StoragedProto> protos;
+    bool disk_idle = true;
 
     if (mDsm->enabled()) {
         mDsm->update();
+        disk_idle = mDsm->idle();
         if (!(mTimer % mConfig.periodic_chores_interval_disk_stats_publish)) {
             mDsm->publish();
         }
@@ -330,7 +367,8 @@ void storaged_t::event(void) {
         flush_protos(&protos);
     }
 
-    mTimer += mConfig.periodic_chores_interval_unit;
+    mPauseUnits = next_pause_units(disk_idle);
+    mTimer += mConfig.periodic_chores_interval_unit * mPauseUnits;
 }
 
 void storaged_t::event_checked(void) {
@@ -269,6 +269,7 @@ void disk_stats_monitor::update(struct disk_stats* curr)
     disk_stats inc;
     get_inc_disk_stats(&mPrevious, curr, &inc);
     add_disk_stats(&inc, &mAccumulate_pub);
+    mIdle = inc.read_ios == 0 && inc.write_ios == 0 && curr->io_in_flight == 0;
 
     struct disk_perf perf = get_disk_perf(&inc);
     log_debug_disk_perf(&perf, "regular");
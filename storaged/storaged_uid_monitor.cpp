@@ -17,8 +17,10 @@
 #define LOG_TAG "storaged"
 
 #include <stdint.h>
+#include <string.h>
 #include <time.h>
 
+#include <algorithm>
 #include <string>
 #include <unordered_map>
 #include <unordered_set>
@@ -52,7 +54,28 @@ const char* UID_IO_STATS_PATH = "/proc/uid_io/stats";
 std::unordered_map<uint32_t, uid_info> uid_monitor::get_uid_io_stats()
 {
     Mutex::Autolock _l(uidm_mutex_);
-    return get_uid_io_stats_locked();
+
+    std::unordered_map<uint32_t, uid_info> uid_io_stats;
+    uid_io_snapshots stats;
+    if (!read_uid_io_stats_locked(&stats)) {
+        return uid_io_stats;
+    }
+    update_uid_names_locked(stats);
+
+    for (const auto& u : stats.uids) {
+        uid_info& info = uid_io_stats[u.uid];
+        info.uid = u.uid;
+        info.name = uid_names_[u.uid];
+        std::copy(std::begin(u.io), std::end(u.io), info.io);
+        for (uint32_t i = u.first_task; i < u.first_task + u.task_count; i++) {
+            const task_io_snapshot& t = stats.tasks[i];
+            task_info& task = info.tasks[t.pid];
+            task.comm = t.comm;
+            task.pid = t.pid;
+            std::copy(std::begin(t.io), std::end(t.io), task.io);
+        }
+    }
+    return uid_io_stats;
 };
 
 /* return true on parse success and false on failure */
@@ -150,50 +173,167 @@ void get_uid_names(const vector<int>& uids, const vector<std::string*>& uid_name
 
 } // namespace
 
-std::unordered_map<uint32_t, uid_info> uid_monitor::get_uid_io_stats_locked()
+namespace {
+
+// Parses the unsigned number at *p, and the separator after it unless it is the last one of
+// [*p, end).
+bool next_number(const char** p, const char* end, char sep, uint64_t* value)
 {
-    std::unordered_map<uint32_t, uid_info> uid_io_stats;
-    std::string buffer;
-    if (!ReadFileToString(UID_IO_STATS_PATH, &buffer)) {
-        PLOG(ERROR) << UID_IO_STATS_PATH << ": ReadFileToString failed";
-        return uid_io_stats;
+    const char* q = *p;
+    uint64_t v = 0;
+    if (q == end || *q < '0' || *q > '9') {
+        return false;
+    }
+    for (; q != end && *q >= '0' && *q <= '9'; q++) {
+        if (__builtin_mul_overflow(v, 10, &v) || __builtin_add_overflow(v, *q - '0', &v)) {
+            return false;
+        }
     }
+    if (q != end) {
+        if (*q != sep) {
+            return false;
+        }
+        q++;
+    }
+    *p = q;
+    *value = v;
+    return true;
+}
 
-    std::vector<std::string> io_stats = Split(std::move(buffer), "\n");
-    uid_info u;
-    vector<int> uids;
-    vector<std::string*> uid_names;
+// Parses the ten counters that end the lines of /proc/uid_io/stats.
+bool parse_io_stats(const char** p, const char* end, char sep, io_stats io[UID_STATS])
+{
+    return next_number(p, end, sep, &io[FOREGROUND].rchar) &&
+           next_number(p, end, sep, &io[FOREGROUND].wchar) &&
+           next_number(p, end, sep, &io[FOREGROUND].read_bytes) &&
+           next_number(p, end, sep, &io[FOREGROUND].write_bytes) &&
+           next_number(p, end, sep, &io[BACKGROUND].rchar) &&
+           next_number(p, end, sep, &io[BACKGROUND].wchar) &&
+           next_number(p, end, sep, &io[BACKGROUND].read_bytes) &&
+           next_number(p, end, sep, &io[BACKGROUND].write_bytes) &&
+           next_number(p, end, sep, &io[FOREGROUND].fsync) &&
+           next_number(p, end, sep, &io[BACKGROUND].fsync);
+}
 
-    for (uint32_t i = 0; i < io_stats.size(); i++) {
-        if (io_stats[i].empty()) {
-            continue;
+// "uid fg_rchar fg_wchar fg_rbytes fg_wbytes bg_rchar bg_wchar bg_rbytes bg_wbytes fg_fsync
+// bg_fsync", possibly followed by more fields.
+bool parse_uid_line(const char* p, const char* end, uid_io_snapshot* u)
+{
+    uint64_t uid;
+    if (!next_number(&p, end, ' ', &uid) || uid > UINT32_MAX ||
+        !parse_io_stats(&p, end, ' ', u->io)) {
+        return false;
+    }
+    u->uid = uid;
+    return true;
+}
+
+// "task,comm,pid,<the ten counters>", where comm may contain commas.
+bool parse_task_line(const char* p, const char* end, task_io_snapshot* t)
+{
+    const char* comm = p + strlen("task,");
+    const char* q = end;
+    for (int commas = 0; commas < 11; commas++) {
+        while (q > comm && q[-1] != ',') {
+            q--;
+        }
+        if (q <= comm) {
+            return false;
         }
+        q--;
+    }
+    const char* numbers = q + 1;
+    uint64_t pid;
+    if (!next_number(&numbers, end, ',', &pid) || pid > INT32_MAX ||
+        !parse_io_stats(&numbers, end, ',', t->io) || numbers != end) {
+        return false;
+    }
+    t->pid = pid;
+    t->comm.assign(comm, q - comm);
+    return true;
+}
 
-        if (io_stats[i].compare(0, 4, "task")) {
-            if (!u.parse_uid_io_stats(std::move(io_stats[i])))
-                continue;
-            uid_io_stats[u.uid] = u;
-            uid_io_stats[u.uid].name = std::to_string(u.uid);
-            uids.push_back(u.uid);
-            uid_names.push_back(&uid_io_stats[u.uid].name);
-            if (last_uid_io_stats_.find(u.uid) == last_uid_io_stats_.end()) {
-                refresh_uid_names = true;
+} // namespace
+
+void uid_io_snapshots::parse(const std::string& stats)
+{
+    uids.clear();
+    task_count = 0;
+
+    const char* p = stats.data();
+    const char* end = p + stats.size();
+    uid_io_snapshot* u = nullptr;
+    while (p < end) {
+        const char* eol = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (eol == nullptr) {
+            eol = end;
+        }
+        if (eol - p >= 4 && !memcmp(p, "task", 4)) {
+            if (task_count == tasks.size()) {
+                tasks.emplace_back();
+            }
+            if (u != nullptr && parse_task_line(p, eol, &tasks[task_count])) {
+                task_count++;
+                u->task_count++;
             } else {
-                uid_io_stats[u.uid].name = last_uid_io_stats_[u.uid].name;
+                LOG(WARNING) << "Invalid task I/O stats: \"" << std::string(p, eol) << "\"";
+            }
+        } else if (eol != p) {
+            uids.emplace_back();
+            u = &uids.back();
+            if (parse_uid_line(p, eol, u)) {
+                u->first_task = task_count;
+                u->task_count = 0;
+            } else {
+                LOG(WARNING) << "Invalid uid I/O stats: \"" << std::string(p, eol) << "\"";
+                uids.pop_back();
+                u = nullptr;
             }
-        } else {
-            task_info t;
-            if (!t.parse_task_io_stats(std::move(io_stats[i])))
-                continue;
-            uid_io_stats[u.uid].tasks[t.pid] = t;
         }
+        p = eol + 1;
     }
 
-    if (!uids.empty() && refresh_uid_names) {
-        get_uid_names(uids, uid_names);
+    // Sort for the merge with the previous snapshot.  The tasks of a uid are contiguous.
+    for (const auto& uid : uids) {
+        std::sort(tasks.begin() + uid.first_task, tasks.begin() + uid.first_task + uid.task_count,
+                  [](const task_io_snapshot& a, const task_io_snapshot& b) {
+                      return a.pid < b.pid;
+                  });
     }
+    std::sort(uids.begin(), uids.end(), [](const uid_io_snapshot& a, const uid_io_snapshot& b) {
+        return a.uid < b.uid;
+    });
+}
 
-    return uid_io_stats;
+bool uid_monitor::read_uid_io_stats_locked(uid_io_snapshots* stats)
+{
+    if (!ReadFileToString(UID_IO_STATS_PATH, &uid_io_buffer_)) {
+        PLOG(ERROR) << UID_IO_STATS_PATH << ": ReadFileToString failed";
+        return false;
+    }
+    stats->parse(uid_io_buffer_);
+    return true;
+}
+
+void uid_monitor::update_uid_names_locked(const uid_io_snapshots& stats)
+{
+    for (const auto& u : stats.uids) {
+        if (uid_names_.find(u.uid) == uid_names_.end()) {
+            uid_names_.emplace(u.uid, std::to_string(u.uid));
+            refresh_uid_names = true;
+        }
+    }
+    if (stats.uids.empty() || !refresh_uid_names) {
+        return;
+    }
+
+    vector<int> uids;
+    vector<std::string*> uid_names;
+    for (const auto& u : stats.uids) {
+        uids.push_back(u.uid);
+        uid_names.push_back(&uid_names_[u.uid]);
+    }
+    get_uid_names(uids, uid_names);
 }
 
 namespace {
@@ -300,67 +440,96 @@ std::map<uint64_t, struct uid_records> uid_monitor::dump(
     return dump_records;
 }
 
+namespace {
+
+// Computes the bytes read and written since last, or returns false if there were none.
+bool get_io_delta(const io_stats curr[UID_STATS], const io_stats* last,
+                  uint64_t delta[IO_TYPES][UID_STATS])
+{
+    static constexpr io_stats kNoStats[UID_STATS] = {};
+    if (last == nullptr) {
+        last = kNoStats;
+    }
+
+    bool any = false;
+    for (int i = 0; i < UID_STATS; i++) {
+        // Counters can go backwards when the kernel's stats are reset.
+        int64_t rd_delta = curr[i].read_bytes - last[i].read_bytes;
+        int64_t wr_delta = curr[i].write_bytes - last[i].write_bytes;
+        delta[READ][i] = (rd_delta < 0) ? 0 : rd_delta;
+        delta[WRITE][i] = (wr_delta < 0) ? 0 : wr_delta;
+        any |= delta[READ][i] || delta[WRITE][i];
+    }
+    return any;
+}
+
+void add_io_delta(const uint64_t delta[IO_TYPES][UID_STATS], charger_stat_t charger,
+                  io_usage* usage)
+{
+    for (int i = 0; i < IO_TYPES; i++) {
+        for (int j = 0; j < UID_STATS; j++) {
+            usage->bytes[i][j][charger] += delta[i][j];
+        }
+    }
+}
+
+} // namespace
+
 void uid_monitor::update_curr_io_stats_locked()
 {
-    std::unordered_map<uint32_t, uid_info> uid_io_stats =
-        get_uid_io_stats_locked();
-    if (uid_io_stats.empty()) {
+    if (!read_uid_io_stats_locked(&new_uid_io_stats_) || new_uid_io_stats_.uids.empty()) {
         return;
     }
+    update_curr_io_stats_locked(&new_uid_io_stats_);
+}
 
-    for (const auto& it : uid_io_stats) {
-        const uid_info& uid = it.second;
-        if (curr_io_stats_.find(uid.name) == curr_io_stats_.end()) {
-            curr_io_stats_[uid.name] = {};
+void uid_monitor::update_curr_io_stats_locked(uid_io_snapshots* stats)
+{
+    update_uid_names_locked(*stats);
+
+    // Both snapshots are sorted by uid, and the tasks of each uid by pid, so they can be walked
+    // side by side.  Only uids that did some I/O get an entry in curr_io_stats.
+    const uid_io_snapshots& last = last_uid_io_stats_;
+    auto last_uid = last.uids.begin();
+    for (const auto& uid : stats->uids) {
+        while (last_uid != last.uids.end() && last_uid->uid < uid.uid) {
+            ++last_uid;
         }
+        const uid_io_snapshot* prev =
+                (last_uid != last.uids.end() && last_uid->uid == uid.uid) ? &*last_uid : nullptr;
+
+        struct uid_io_usage* usage = nullptr;
+        auto get_usage = [&]() {
+            if (usage == nullptr) {
+                usage = &curr_io_stats_[uid_names_[uid.uid]];
+                usage->user_id = multiuser_get_user_id(uid.uid);
+            }
+            return usage;
+        };
 
-        struct uid_io_usage& usage = curr_io_stats_[uid.name];
-        usage.user_id = multiuser_get_user_id(uid.uid);
-
-        int64_t fg_rd_delta = uid.io[FOREGROUND].read_bytes -
-            last_uid_io_stats_[uid.uid].io[FOREGROUND].read_bytes;
-        int64_t bg_rd_delta = uid.io[BACKGROUND].read_bytes -
-            last_uid_io_stats_[uid.uid].io[BACKGROUND].read_bytes;
-        int64_t fg_wr_delta = uid.io[FOREGROUND].write_bytes -
-            last_uid_io_stats_[uid.uid].io[FOREGROUND].write_bytes;
-        int64_t bg_wr_delta = uid.io[BACKGROUND].write_bytes -
-            last_uid_io_stats_[uid.uid].io[BACKGROUND].write_bytes;
-
-        usage.uid_ios.bytes[READ][FOREGROUND][charger_stat_] +=
-            (fg_rd_delta < 0) ? 0 : fg_rd_delta;
-        usage.uid_ios.bytes[READ][BACKGROUND][charger_stat_] +=
-            (bg_rd_delta < 0) ? 0 : bg_rd_delta;
-        usage.uid_ios.bytes[WRITE][FOREGROUND][charger_stat_] +=
-            (fg_wr_delta < 0) ? 0 : fg_wr_delta;
-        usage.uid_ios.bytes[WRITE][BACKGROUND][charger_stat_] +=
-            (bg_wr_delta < 0) ? 0 : bg_wr_delta;
-
-        for (const auto& task_it : uid.tasks) {
-            const task_info& task = task_it.second;
-            const pid_t pid = task_it.first;
-            const std::string& comm = task_it.second.comm;
-            int64_t task_fg_rd_delta = task.io[FOREGROUND].read_bytes -
-                last_uid_io_stats_[uid.uid].tasks[pid].io[FOREGROUND].read_bytes;
-            int64_t task_bg_rd_delta = task.io[BACKGROUND].read_bytes -
-                last_uid_io_stats_[uid.uid].tasks[pid].io[BACKGROUND].read_bytes;
-            int64_t task_fg_wr_delta = task.io[FOREGROUND].write_bytes -
-                last_uid_io_stats_[uid.uid].tasks[pid].io[FOREGROUND].write_bytes;
-            int64_t task_bg_wr_delta = task.io[BACKGROUND].write_bytes -
-                last_uid_io_stats_[uid.uid].tasks[pid].io[BACKGROUND].write_bytes;
-
-            io_usage& task_usage = usage.task_ios[comm];
-            task_usage.bytes[READ][FOREGROUND][charger_stat_] +=
-                (task_fg_rd_delta < 0) ? 0 : task_fg_rd_delta;
-            task_usage.bytes[READ][BACKGROUND][charger_stat_] +=
-                (task_bg_rd_delta < 0) ? 0 : task_bg_rd_delta;
-            task_usage.bytes[WRITE][FOREGROUND][charger_stat_] +=
-                (task_fg_wr_delta < 0) ? 0 : task_fg_wr_delta;
-            task_usage.bytes[WRITE][BACKGROUND][charger_stat_] +=
-                (task_bg_wr_delta < 0) ? 0 : task_bg_wr_delta;
+        uint64_t delta[IO_TYPES][UID_STATS];
+        if (get_io_delta(uid.io, prev ? prev->io : nullptr, delta)) {
+            add_io_delta(delta, charger_stat_, &get_usage()->uid_ios);
+        }
+
+        uint32_t prev_task = prev ? prev->first_task : 0;
+        uint32_t prev_end = prev ? prev->first_task + prev->task_count : 0;
+        for (uint32_t i = uid.first_task; i < uid.first_task + uid.task_count; i++) {
+            const task_io_snapshot& task = stats->tasks[i];
+            while (prev_task < prev_end && last.tasks[prev_task].pid < task.pid) {
+                prev_task++;
+            }
+            const io_stats* prev_io = nullptr;
+            if (prev_task < prev_end && last.tasks[prev_task].pid == task.pid) {
+                prev_io = last.tasks[prev_task].io;
+            }
+            if (get_io_delta(task.io, prev_io, delta)) {
+                add_io_delta(delta, charger_stat_, &get_usage()->task_ios[task.comm]);
+            }
         }
     }
 
-    last_uid_io_stats_ = uid_io_stats;
+    std::swap(last_uid_io_stats_, *stats);
 }
 
 void uid_monitor::report(unordered_map<int, StoragedProto>* protos)
@@ -532,7 +701,11 @@ void uid_monitor::init(charger_stat_t stat)
     charger_stat_ = stat;
 
     start_ts_ = time(NULL);
-    last_uid_io_stats_ = get_uid_io_stats();
+
+    Mutex::Autolock _l(uidm_mutex_);
+    if (read_uid_io_stats_locked(&last_uid_io_stats_)) {
+        update_uid_names_locked(last_uid_io_stats_);
+    }
 }
 
 uid_monitor::uid_monitor()
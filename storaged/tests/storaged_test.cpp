@@ -684,3 +684,54 @@ TEST(storaged_test, load_uid_io_proto) {
     uidm.load_uid_io_proto(0, user_0);
     ASSERT_LE(io_history.size(), size_t(uid_monitor::MAX_UID_RECORDS_SIZE));
 }
+
+TEST(storaged_test, uid_io_stats_delta) {
+    uid_monitor uidm;
+    // Named up front so that no names are requested from the package manager.
+    uidm.uid_names_ = {{10001, "app1"}, {10002, "app2"}, {1010003, "app3"}};
+    uidm.charger_stat_ = CHARGER_OFF;
+
+    uid_io_snapshots stats;
+    stats.parse(
+        "10002 0 0 100 200 0 0 0 0 0 0\n"
+        "task,worker,1001,0,0,100,200,0,0,0,0,0,0\n"
+        "10001 0 0 1000 0 0 0 0 0 0 0\n"
+        "task,a,b,c,1000,0,0,1000,0,0,0,0,0,0,0\n"
+        "invalid\n");
+    ASSERT_EQ(stats.uids.size(), 2UL);
+    EXPECT_EQ(stats.uids[0].uid, 10001U);
+    EXPECT_EQ(stats.uids[0].io[FOREGROUND].read_bytes, 1000UL);
+    ASSERT_EQ(stats.uids[0].task_count, 1U);
+    EXPECT_EQ(stats.tasks[stats.uids[0].first_task].comm, "a,b,c");
+    EXPECT_EQ(stats.tasks[stats.uids[0].first_task].pid, 1000);
+    EXPECT_EQ(stats.uids[1].uid, 10002U);
+    EXPECT_EQ(stats.uids[1].io[FOREGROUND].write_bytes, 200UL);
+    ASSERT_EQ(stats.uids[1].task_count, 1U);
+    EXPECT_EQ(stats.tasks[stats.uids[1].first_task].comm, "worker");
+    uidm.update_curr_io_stats_locked(&stats);
+    uidm.curr_io_stats_.clear();
+
+    // app1 does nothing, app2 writes in the background, and app3 appears.
+    stats.parse(
+        "10001 0 0 1000 0 0 0 0 0 0 0\n"
+        "task,a,b,c,1000,0,0,1000,0,0,0,0,0,0,0\n"
+        "10002 0 0 100 200 0 0 0 50 0 0\n"
+        "task,worker,1001,0,0,100,200,0,0,0,20,0,0\n"
+        "task,other,1002,0,0,0,0,0,0,0,30,0,0\n"
+        "1010003 0 0 10 0 0 0 0 0 0 0\n");
+    uidm.update_curr_io_stats_locked(&stats);
+
+    auto& curr = uidm.curr_io_stats_;
+    EXPECT_EQ(curr.size(), 2UL);
+    EXPECT_EQ(curr.count("app1"), 0UL);
+    ASSERT_EQ(curr.count("app2"), 1UL);
+    EXPECT_EQ(curr["app2"].user_id, 0U);
+    EXPECT_EQ(curr["app2"].uid_ios.bytes[WRITE][BACKGROUND][CHARGER_OFF], 50UL);
+    EXPECT_EQ(curr["app2"].uid_ios.bytes[WRITE][FOREGROUND][CHARGER_OFF], 0UL);
+    EXPECT_EQ(curr["app2"].task_ios.size(), 2UL);
+    EXPECT_EQ(curr["app2"].task_ios["worker"].bytes[WRITE][BACKGROUND][CHARGER_OFF], 20UL);
+    EXPECT_EQ(curr["app2"].task_ios["other"].bytes[WRITE][BACKGROUND][CHARGER_OFF], 30UL);
+    ASSERT_EQ(curr.count("app3"), 1UL);
+    EXPECT_EQ(curr["app3"].user_id, 10U);
+    EXPECT_EQ(curr["app3"].uid_ios.bytes[READ][FOREGROUND][CHARGER_OFF], 10UL);
+}
@@ -11,6 +11,7 @@
 #include <linux/input.h>
 #include <err.h>
 #include <errno.h>
+#include <signal.h>
 #include <unistd.h>
 
 struct label {
@@ -35,8 +36,47 @@ static struct label key_value_labels[] = {
 
 static struct pollfd *ufds;
 static char **device_names;
+static int *device_ids;
+static int next_device_id;
 static int nfds;
 
+/*
+ * Binary capture (-b) and decoding (-D).
+ *
+ * A capture starts with CAPTURE_MAGIC, followed by records: a capture_record header and then
+ * |size| bytes of payload. CAPTURE_ADD_DEVICE carries the device's path and name, each
+ * nul-terminated; CAPTURE_EVENTS carries the capture_events read from a device in one go;
+ * CAPTURE_REMOVE_DEVICE has no payload. Devices are numbered in the order they were opened,
+ * and numbers aren't reused. Everything is in the byte order of the device that captured it.
+ */
+#define CAPTURE_MAGIC "GETEVT01"
+
+enum {
+    CAPTURE_ADD_DEVICE      = 1,
+    CAPTURE_REMOVE_DEVICE   = 2,
+    CAPTURE_EVENTS          = 3,
+};
+
+struct capture_record {
+    uint16_t kind;
+    uint16_t device;
+    uint32_t size;
+};
+
+struct capture_event {
+    int64_t time_us;
+    uint16_t type;
+    uint16_t code;
+    int32_t value;
+};
+
+#define CAPTURE_READ_EVENTS 64
+
+static int capture_fd = -1;
+static char capture_buf[64 * 1024];
+static size_t capture_len;
+static volatile sig_atomic_t capture_stop;
+
 enum {
     PRINT_DEVICE_ERRORS     = 1U << 0,
     PRINT_DEVICE            = 1U << 1,
@@ -309,6 +349,68 @@ static void print_hid_descriptor(int bus, int vendor, int product)
     closedir(dir);
 }
 
+static int capture_flush(void)
+{
+    size_t done = 0;
+    while(done < capture_len) {
+        ssize_t res = write(capture_fd, capture_buf + done, capture_len - done);
+        if(res < 0) {
+            if(errno == EINTR)
+                continue;
+            fprintf(stderr, "could not write capture, %s\n", strerror(errno));
+            return -1;
+        }
+        done += res;
+    }
+    capture_len = 0;
+    return 0;
+}
+
+static void capture_append(const void *data, size_t size)
+{
+    if(capture_len + size > sizeof(capture_buf) && capture_flush() < 0)
+        exit(1);
+    memcpy(capture_buf + capture_len, data, size);
+    capture_len += size;
+}
+
+static void capture_add_device(int id, const char *device, const char *name)
+{
+    struct capture_record record = { CAPTURE_ADD_DEVICE, id, strlen(device) + strlen(name) + 2 };
+    capture_append(&record, sizeof(record));
+    capture_append(device, strlen(device) + 1);
+    capture_append(name, strlen(name) + 1);
+}
+
+static void capture_remove_device(int id)
+{
+    struct capture_record record = { CAPTURE_REMOVE_DEVICE, id, 0 };
+    capture_append(&record, sizeof(record));
+}
+
+/* Appends |count| events from device |id|, which are converted to the compact format. */
+static void capture_events(int id, const struct input_event *events, int count)
+{
+    struct capture_record record = { CAPTURE_EVENTS, id, count * sizeof(struct capture_event) };
+    struct capture_event out[CAPTURE_READ_EVENTS];
+    int i;
+
+    for(i = 0; i < count; i++) {
+        out[i].time_us = events[i].time.tv_sec * 1000000LL + events[i].time.tv_usec;
+        out[i].type = events[i].type;
+        out[i].code = events[i].code;
+        out[i].value = events[i].value;
+    }
+    capture_append(&record, sizeof(record));
+    capture_append(out, record.size);
+}
+
+static void capture_signal_handler(int sig)
+{
+    (void)sig;
+    capture_stop = 1;
+}
+
 static int open_device(const char *device, int print_flags)
 {
     int version;
@@ -316,6 +418,7 @@ static int open_device(const char *device, int print_flags)
     int clkid = CLOCK_MONOTONIC;
     struct pollfd *new_ufds;
     char **new_device_names;
+    int *new_device_ids;
     char name[80];
     char location[80];
     char idstr[80];
@@ -371,6 +474,12 @@ static int open_device(const char *device, int print_flags)
         return -1;
     }
     device_names = new_device_names;
+    new_device_ids = realloc(device_ids, sizeof(device_ids[0]) * (nfds + 1));
+    if(new_device_ids == NULL) {
+        fprintf(stderr, "out of memory\n");
+        return -1;
+    }
+    device_ids = new_device_ids;
 
     if(print_flags & PRINT_DEVICE)
         printf("add device %d: %s\n", nfds, device);
@@ -403,6 +512,9 @@ static int open_device(const char *device, int print_flags)
     ufds[nfds].fd = fd;
     ufds[nfds].events = POLLIN;
     device_names[nfds] = strdup(device);
+    device_ids[nfds] = next_device_id++;
+    if(capture_fd >= 0)
+        capture_add_device(device_ids[nfds], device, name);
     nfds++;
 
     return 0;
@@ -416,8 +528,11 @@ int close_device(const char *device, int print_flags)
             int count = nfds - i - 1;
             if(print_flags & PRINT_DEVICE)
                 printf("remove device %d: %s\n", i, device);
+            if(capture_fd >= 0)
+                capture_remove_device(device_ids[i]);
             free(device_names[i]);
             memmove(device_names + i, device_names + i + 1, sizeof(device_names[0]) * count);
+            memmove(device_ids + i, device_ids + i + 1, sizeof(device_ids[0]) * count);
             memmove(ufds + i, ufds + i + 1, sizeof(ufds[0]) * count);
             nfds--;
             return 0;
@@ -494,9 +609,153 @@ static int scan_dir(const char *dirname, int print_flags)
     return 0;
 }
 
+/* Prints a capture made with -b the way events are printed live. */
+static int decode_capture(const char *path, int print_flags, int get_time, const char *newline)
+{
+    FILE *file;
+    char magic[sizeof(CAPTURE_MAGIC) - 1];
+    struct capture_record record;
+    char *payload = NULL;
+    char **names = NULL;
+    int names_size = 0;
+    int rc = 0;
+
+    file = strcmp(path, "-") == 0 ? stdin : fopen(path, "re");
+    if(file == NULL) {
+        fprintf(stderr, "could not open %s, %s\n", path, strerror(errno));
+        return 1;
+    }
+    if(fread(magic, sizeof(magic), 1, file) != 1 || memcmp(magic, CAPTURE_MAGIC, sizeof(magic))) {
+        fprintf(stderr, "%s is not a getevent capture\n", path);
+        rc = 1;
+        goto done;
+    }
+
+    while(fread(&record, sizeof(record), 1, file) == 1) {
+        char *new_payload = realloc(payload, record.size + 1);
+        if(new_payload == NULL) {
+            fprintf(stderr, "out of memory\n");
+            rc = 1;
+            break;
+        }
+        payload = new_payload;
+        if(record.size && fread(payload, record.size, 1, file) != 1) {
+            fprintf(stderr, "truncated capture\n");
+            rc = 1;
+            break;
+        }
+        payload[record.size] = '\0';
+
+        if(record.device >= names_size) {
+            int new_size = record.device + 1;
+            char **new_names = realloc(names, sizeof(names[0]) * new_size);
+            if(new_names == NULL) {
+                fprintf(stderr, "out of memory\n");
+                rc = 1;
+                break;
+            }
+            memset(new_names + names_size, 0, sizeof(names[0]) * (new_size - names_size));
+            names = new_names;
+            names_size = new_size;
+        }
+
+        switch(record.kind) {
+        case CAPTURE_ADD_DEVICE:
+            free(names[record.device]);
+            names[record.device] = strdup(payload);
+            if(print_flags & PRINT_DEVICE)
+                printf("add device %d: %s\n", record.device, payload);
+            if(print_flags & PRINT_DEVICE_NAME)
+                printf("  name:     \"%s\"\n", payload + strlen(payload) + 1);
+            break;
+        case CAPTURE_REMOVE_DEVICE:
+            if(print_flags & PRINT_DEVICE)
+                printf("remove device %d: %s\n", record.device,
+                       names[record.device] ? names[record.device] : "?");
+            break;
+        case CAPTURE_EVENTS: {
+            const struct capture_event *event = (const struct capture_event *)payload;
+            size_t count = record.size / sizeof(*event);
+            size_t i;
+            for(i = 0; i < count; i++, event++) {
+                if(get_time)
+                    printf("[%8lld.%06lld] ", (long long)(event->time_us / 1000000),
+                           (long long)(event->time_us % 1000000));
+                printf("%s: ", names[record.device] ? names[record.device] : "?");
+                print_event(event->type, event->code, event->value, print_flags);
+                printf("%s", newline);
+            }
+            break;
+        }
+        default:
+            /* Unknown records are skipped, so the format can grow. */
+            break;
+        }
+    }
+
+done:
+    free(payload);
+    while(names_size > 0)
+        free(names[--names_size]);
+    free(names);
+    if(file != stdin)
+        fclose(file);
+    return rc;
+}
+
+/* Captures events from every open device to capture_fd until interrupted or |event_count|. */
+static int capture_loop(const char *device_path, int print_flags, int event_count)
+{
+    struct input_event events[CAPTURE_READ_EVENTS];
+    struct sigaction sa;
+    int i, res;
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = capture_signal_handler;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    while(!capture_stop) {
+        if(poll(ufds, nfds, -1) < 0) {
+            if(errno == EINTR)
+                continue;
+            fprintf(stderr, "poll failed, %s\n", strerror(errno));
+            break;
+        }
+        if(ufds[0].revents & POLLIN) {
+            read_notify(device_path, ufds[0].fd, print_flags);
+        }
+        for(i = 1; i < nfds; i++) {
+            if(!(ufds[i].revents & POLLIN))
+                continue;
+            /* Take everything the device has queued, up to a batch, in one read. */
+            res = read(ufds[i].fd, events, sizeof(events));
+            if(res < (int)sizeof(events[0])) {
+                if(res < 0 && errno == EINTR)
+                    continue;
+                fprintf(stderr, "could not get event\n");
+                capture_flush();
+                return 1;
+            }
+            res /= sizeof(events[0]);
+            if(event_count && res >= event_count) {
+                capture_events(device_ids[i], events, event_count);
+                return capture_flush() < 0;
+            }
+            capture_events(device_ids[i], events, res);
+            if(event_count)
+                event_count -= res;
+        }
+        /* One write per wakeup, however many devices and events it brought. */
+        if(capture_flush() < 0)
+            return 1;
+    }
+    return capture_flush() < 0;
+}
+
 static void usage(char *name)
 {
-    fprintf(stderr, "Usage: %s [-t] [-n] [-s switchmask] [-S] [-v [mask]] [-d] [-p] [-i] [-l] [-q] [-c count] [-r] [device]\n", name);
+    fprintf(stderr, "Usage: %s [-t] [-n] [-s switchmask] [-S] [-v [mask]] [-d] [-p] [-i] [-l] [-q] [-c count] [-r] [-b file] [-D file] [device]\n", name);
     fprintf(stderr, "    -t: show time stamps\n");
     fprintf(stderr, "    -n: don't print newlines\n");
     fprintf(stderr, "    -s: print switch states for given bits\n");
@@ -509,6 +768,8 @@ static void usage(char *name)
     fprintf(stderr, "    -q: quiet (clear verbosity mask)\n");
     fprintf(stderr, "    -c: print given number of events then exit\n");
     fprintf(stderr, "    -r: print rate events are received\n");
+    fprintf(stderr, "    -b: capture events to the given file (- for stdout) in binary, for -D\n");
+    fprintf(stderr, "    -D: print the events in the given binary capture\n");
 }
 
 int getevent_main(int argc, char *argv[])
@@ -529,13 +790,15 @@ int getevent_main(int argc, char *argv[])
     int64_t last_sync_time = 0;
     const char *device = NULL;
     const char *device_path = "/dev/input";
+    const char *capture_path = NULL;
+    const char *decode_path = NULL;
 
     /* disable buffering on stdout */
     setbuf(stdout, NULL);
 
     opterr = 0;
     do {
-        c = getopt(argc, argv, "tns:Sv::dpilqc:rh");
+        c = getopt(argc, argv, "tns:Sv::dpilqc:rb:D:h");
         if (c == EOF)
             break;
         switch (c) {
@@ -591,6 +854,12 @@ int getevent_main(int argc, char *argv[])
         case 'r':
             sync_rate = 1;
             break;
+        case 'b':
+            capture_path = optarg;
+            break;
+        case 'D':
+            decode_path = optarg;
+            break;
         case '?':
             fprintf(stderr, "%s: invalid option -%c\n",
                 argv[0], optopt);
@@ -602,6 +871,27 @@ int getevent_main(int argc, char *argv[])
     if(dont_block == -1)
         dont_block = 0;
 
+    if(decode_path) {
+        if(!print_flags_set)
+            print_flags |= PRINT_DEVICE | PRINT_DEVICE_NAME;
+        return decode_capture(decode_path, print_flags, get_time, newline);
+    }
+    if(capture_path) {
+        if(strcmp(capture_path, "-") == 0) {
+            capture_fd = STDOUT_FILENO;
+            /* Only errors, which go to stderr, can be printed alongside the capture. */
+            print_flags &= PRINT_DEVICE_ERRORS;
+            print_flags_set = 1;
+        } else {
+            capture_fd = open(capture_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if(capture_fd < 0) {
+                fprintf(stderr, "could not open %s, %s\n", capture_path, strerror(errno));
+                return 1;
+            }
+        }
+        capture_append(CAPTURE_MAGIC, sizeof(CAPTURE_MAGIC) - 1);
+    }
+
     if (optind + 1 == argc) {
         device = argv[optind];
         optind++;
@@ -651,7 +941,10 @@ int getevent_main(int argc, char *argv[])
     }
 
     if(dont_block)
-        return 0;
+        return capture_fd >= 0 ? capture_flush() < 0 : 0;
+
+    if(capture_fd >= 0)
+        return capture_loop(device_path, print_flags, event_count);
 
     while(1) {
         //int pollres =
@@ -17,8 +17,11 @@
 #include <getopt.h>
 #include <sys/system_properties.h>
 
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <utility>
 #include <vector>
 
 #include <android-base/properties.h>
@@ -35,39 +38,120 @@ enum class ResultType {
     Type,
 };
 
-void PrintAllProperties(ResultType result_type) {
-    std::vector<std::pair<std::string, std::string>> properties;
-    __system_property_foreach(
-        [](const prop_info* pi, void* cookie) {
-            __system_property_read_callback(
-                pi,
-                [](void* cookie, const char* name, const char* value, unsigned) {
-                    auto properties =
-                        reinterpret_cast<std::vector<std::pair<std::string, std::string>>*>(cookie);
-                    properties->emplace_back(name, value);
+// Every property, read once from the property areas. Names and values are stored back to back in
+// one buffer, and the entries, sorted by name, point into it.
+class PropertySnapshot {
+  public:
+    struct Entry {
+        std::string_view name;
+        std::string_view value;
+    };
+
+    void Load() {
+        std::vector<std::pair<size_t, size_t>> offsets;
+        std::pair<PropertySnapshot*, decltype(offsets)*> state(this, &offsets);
+        __system_property_foreach(
+                [](const prop_info* pi, void* cookie) {
+                    __system_property_read_callback(
+                            pi,
+                            [](void* cookie, const char* name, const char* value, unsigned) {
+                                auto [snapshot, offsets] =
+                                        *reinterpret_cast<decltype(state)*>(cookie);
+                                size_t name_offset = snapshot->data_.size();
+                                snapshot->data_.append(name);
+                                snapshot->data_.push_back('\0');
+                                offsets->emplace_back(name_offset, snapshot->data_.size());
+                                snapshot->data_.append(value);
+                                snapshot->data_.push_back('\0');
+                            },
+                            cookie);
                 },
-                cookie);
-        },
-        &properties);
+                &state);
+
+        // The buffer doesn't move any more, so the entries can point into it.
+        entries_.clear();
+        entries_.reserve(offsets.size());
+        for (const auto& [name_offset, value_offset] : offsets) {
+            entries_.push_back(Entry{
+                    std::string_view(&data_[name_offset], value_offset - name_offset - 1),
+                    std::string_view(&data_[value_offset])});
+        }
+        std::sort(entries_.begin(), entries_.end(),
+                  [](const Entry& lhs, const Entry& rhs) { return lhs.name < rhs.name; });
+    }
+
+    const std::vector<Entry>& entries() const { return entries_; }
+
+    // Returns the range of entries whose names start with |prefix|.
+    std::pair<const Entry*, const Entry*> FindPrefix(std::string_view prefix) const {
+        const Entry* begin = entries_.data();
+        const Entry* end = begin + entries_.size();
+        auto first = std::lower_bound(begin, end, prefix, [](const Entry& entry, auto prefix) {
+            return entry.name < prefix;
+        });
+        auto last = std::find_if(first, end, [prefix](const Entry& entry) {
+            return entry.name.substr(0, prefix.size()) != prefix;
+        });
+        return {first, last};
+    }
+
+    // Returns the entry named |name|, or null.
+    const Entry* Find(std::string_view name) const {
+        auto [first, last] = FindPrefix(name);
+        return first != last && first->name == name ? first : nullptr;
+    }
 
-    std::sort(properties.begin(), properties.end());
+  private:
+    std::string data_;
+    std::vector<Entry> entries_;
+};
 
+// Appends "[name]: [value]" for |name|, with its context or type instead of |value| if asked.
+static void AppendProperty(std::string* out, std::string_view name, std::string_view value,
+                           ResultType result_type) {
     if (result_type != ResultType::Value) {
-        for (auto& [name, value] : properties) {
-            const char* context = nullptr;
-            const char* type = nullptr;
-            property_info_file->GetPropertyInfo(name.c_str(), &context, &type);
-            if (result_type == ResultType::Context) {
-                value = context;
-            } else {
-                value = type;
-            }
-        }
+        // Names are always followed by a nul, in the snapshot's buffer or in argv.
+        const char* context = nullptr;
+        const char* type = nullptr;
+        property_info_file->GetPropertyInfo(name.data(), &context, &type);
+        const char* info = result_type == ResultType::Context ? context : type;
+        value = info != nullptr ? info : "";
     }
+    out->append("[").append(name).append("]: [").append(value).append("]\n");
+}
+
+void PrintAllProperties(ResultType result_type) {
+    PropertySnapshot snapshot;
+    snapshot.Load();
+
+    std::string out;
+    for (const auto& [name, value] : snapshot.entries()) {
+        AppendProperty(&out, name, value, result_type);
+    }
+    std::cout << out << std::flush;
+}
 
-    for (const auto& [name, value] : properties) {
-        std::cout << "[" << name << "]: [" << value << "]" << std::endl;
+// Prints each of |queries| from one snapshot: a name, or every property starting with a prefix
+// if the query ends in '*'.
+void PrintProperties(char** queries, int count, ResultType result_type) {
+    PropertySnapshot snapshot;
+    snapshot.Load();
+
+    std::string out;
+    for (int i = 0; i < count; i++) {
+        std::string_view query = queries[i];
+        if (!query.empty() && query.back() == '*') {
+            query.remove_suffix(1);
+            auto [first, last] = snapshot.FindPrefix(query);
+            for (auto entry = first; entry != last; ++entry) {
+                AppendProperty(&out, entry->name, entry->value, result_type);
+            }
+        } else {
+            auto entry = snapshot.Find(query);
+            AppendProperty(&out, query, entry ? entry->value : "", result_type);
+        }
     }
+    std::cout << out << std::flush;
 }
 
 void PrintProperty(const char* name, const char* default_value, ResultType result_type) {
@@ -92,6 +176,7 @@ void PrintProperty(const char* name, const char* default_value, ResultType resul
 
 extern "C" int getprop_main(int argc, char** argv) {
     auto result_type = ResultType::Value;
+    bool multiple = false;
 
     while (true) {
         static const struct option long_options[] = {
@@ -99,7 +184,7 @@ extern "C" int getprop_main(int argc, char** argv) {
             {nullptr, 0, nullptr, 0},
         };
 
-        int arg = getopt_long(argc, argv, "TZ", long_options, nullptr);
+        int arg = getopt_long(argc, argv, "mTZ", long_options, nullptr);
 
         if (arg == -1) {
             break;
@@ -108,13 +193,18 @@ extern "C" int getprop_main(int argc, char** argv) {
         switch (arg) {
             case 'h':
                 std::cout << "usage: getprop [-TZ] [NAME [DEFAULT]]\n"
+                             "       getprop [-TZ] -m NAME|PREFIX*...\n"
                              "\n"
                              "Gets an Android system property, or lists them all.\n"
                              "\n"
+                             "-m\tList the given properties, and those starting with each PREFIX\n"
                              "-T\tShow property types instead of values\n"
                              "-Z\tShow property contexts instead of values\n"
                           << std::endl;
                 return 0;
+            case 'm':
+                multiple = true;
+                break;
             case 'T':
                 if (result_type != ResultType::Value) {
                     std::cerr << "Only one of -T or -Z may be specified" << std::endl;
@@ -150,6 +240,11 @@ extern "C" int getprop_main(int argc, char** argv) {
         return 0;
     }
 
+    if (multiple) {
+        PrintProperties(&argv[optind], argc - optind, result_type);
+        return 0;
+    }
+
     if (optind < argc - 2) {
         std::cerr << "getprop: Max 2 arguments (see \"getprop --help\")" << std::endl;
         return -1;
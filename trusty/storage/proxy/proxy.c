@@ -122,6 +122,15 @@ static int handle_req(struct storage_msg* msg, const void* req, size_t req_len)
         return ipc_respond(msg, NULL, 0);
     }
 
+    /* gathered writes are only kept back until something else comes along */
+    if (msg->cmd != STORAGE_FILE_WRITE) {
+        rc = storage_flush_writes();
+        if (rc < 0) {
+            msg->result = STORAGE_ERR_GENERIC;
+            return ipc_respond(msg, NULL, 0);
+        }
+    }
+
     if (msg->flags & STORAGE_MSG_FLAG_PRE_COMMIT) {
         rc = storage_sync_checkpoint();
         if (rc < 0) {
@@ -23,6 +23,7 @@
 #include <string.h>
 #include <sys/ioctl.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <unistd.h>
 
@@ -248,17 +249,31 @@ static int send_virt_rpmb_req(int rpmb_fd, void* read_buf, size_t read_size, con
     int rc;
     uint16_t res_count = read_size / MMC_BLOCK_SIZE;
     uint16_t cmd_count = payload_size / MMC_BLOCK_SIZE;
-    rc = write(rpmb_fd, &res_count, sizeof(res_count));
-    if (rc < 0) {
-        return rc;
-    }
-    rc = write(rpmb_fd, &cmd_count, sizeof(cmd_count));
-    if (rc < 0) {
-        return rc;
-    }
-    rc = write(rpmb_fd, payload, payload_size);
-    if (rc < 0) {
-        return rc;
+    /* send the counts and the frames together, in a single write */
+    struct iovec iovs[] = {
+            {&res_count, sizeof(res_count)},
+            {&cmd_count, sizeof(cmd_count)},
+            {(void*)payload, payload_size},
+    };
+    size_t size = sizeof(res_count) + sizeof(cmd_count) + payload_size;
+    struct iovec* iov = iovs;
+    int iovcnt = sizeof(iovs) / sizeof(iovs[0]);
+    while (size > 0) {
+        ssize_t written = TEMP_FAILURE_RETRY(writev(rpmb_fd, iov, iovcnt));
+        if (written < 0) {
+            return written;
+        }
+        size -= written;
+        /* skip past whatever was written, in case the write was short */
+        while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = (uint8_t*)iov->iov_base + written;
+            iov->iov_len -= written;
+        }
     }
     rc = read(rpmb_fd, read_buf, read_size);
     return rc;
@@ -13,6 +13,10 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE /* for sync_file_range() */
+#endif
+
 #include <errno.h>
 #include <fcntl.h>
 #include <inttypes.h>
@@ -30,6 +34,7 @@
 
 #define FD_TBL_SIZE 64
 #define MAX_READ_SIZE 4096
+#define MAX_PENDING_WRITE_SIZE (64 * 1024)
 
 enum sync_state {
     SS_UNUSED = -1,
@@ -49,6 +54,20 @@ static struct {
    uint8_t data[MAX_READ_SIZE];
 }  read_rsp;
 
+/*
+ * Writes to consecutive offsets of the same file are gathered here and
+ * issued with a single pwrite() before any other request is handled. Nothing
+ * is durable before the next checkpoint anyway, so the only visible
+ * difference is that a failed write is reported on the request that flushes
+ * it.
+ */
+static struct {
+    int fd;
+    uint64_t offset;
+    size_t size;
+    uint8_t data[MAX_PENDING_WRITE_SIZE];
+} pending_write;
+
 static uint32_t insert_fd(int open_flags, int fd)
 {
     uint32_t handle = fd;
@@ -159,6 +178,24 @@ static ssize_t read_with_retry(int fd, void *buf_, size_t size, off_t offset)
     return rcnt;
 }
 
+int storage_flush_writes(void)
+{
+    if (!pending_write.size)
+        return 0;
+
+    size_t size = pending_write.size;
+    pending_write.size = 0;
+    if (write_with_retry(pending_write.fd, pending_write.data, size,
+                         pending_write.offset) < 0) {
+        int error = errno;
+        ALOGW("%s: error writing file (fd=%d): %s\n",
+              __func__, pending_write.fd, strerror(error));
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
 int storage_file_delete(struct storage_msg *msg,
                         const void *r, size_t req_len)
 {
@@ -349,8 +386,25 @@ int storage_file_write(struct storage_msg *msg,
     }
 
     int fd = lookup_fd(req->handle, true);
-    if (write_with_retry(fd, &req->data[0], req_len - sizeof(*req),
-                         req->offset) < 0) {
+    size_t size = req_len - sizeof(*req);
+    if (pending_write.size &&
+        (pending_write.fd != fd ||
+         pending_write.offset + pending_write.size != req->offset ||
+         size > sizeof(pending_write.data) - pending_write.size)) {
+        if (storage_flush_writes() < 0) {
+            msg->result = translate_errno(errno);
+            goto err_response;
+        }
+    }
+
+    if (size <= sizeof(pending_write.data) - pending_write.size) {
+        if (!pending_write.size) {
+            pending_write.fd = fd;
+            pending_write.offset = req->offset;
+        }
+        memcpy(pending_write.data + pending_write.size, &req->data[0], size);
+        pending_write.size += size;
+    } else if (write_with_retry(fd, &req->data[0], size, req->offset) < 0) {
         rc = errno;
         ALOGW("%s: error writing file (fd=%d): %s\n",
               __func__, fd, strerror(errno));
@@ -487,14 +541,35 @@ int storage_sync_checkpoint(void)
 {
     int rc;
 
+    rc = storage_flush_writes();
+    if (rc < 0)
+        return rc;
+
+    /*
+     * start writeback of every dirty file before waiting for any of them, so
+     * that the device gets all of their data at once rather than one file
+     * per flush
+     */
+    if (fs_state == SS_CLEAN) {
+        for (uint fd = 0; fd < FD_TBL_SIZE; fd++) {
+            if (fd_state[fd] == SS_DIRTY) {
+                /* errors are reported by fdatasync() below */
+                sync_file_range(fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+            }
+        }
+    }
+
     /* sync fd table and reset it to clean state first */
     for (uint fd = 0; fd < FD_TBL_SIZE; fd++) {
          if (fd_state[fd] == SS_DIRTY) {
              if (fs_state == SS_CLEAN) {
-                 /* need to sync individual fd */
-                 rc = fsync(fd);
+                 /*
+                  * need to sync individual fd; fdatasync() still syncs the
+                  * file size, which is all the metadata that matters here
+                  */
+                 rc = fdatasync(fd);
                  if (rc < 0) {
-                     ALOGE("fsync for fd=%d failed: %s\n", fd, strerror(errno));
+                     ALOGE("fdatasync for fd=%d failed: %s\n", fd, strerror(errno));
                      return rc;
                  }
              }
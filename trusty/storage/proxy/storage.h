@@ -41,5 +41,7 @@ int storage_file_set_size(struct storage_msg *msg,
 
 int storage_init(const char *dirname);
 
+int storage_flush_writes(void);
+
 int storage_sync_checkpoint(void);
 